@@ -36,17 +36,59 @@
 #include "udiskslinuxblockbcache.h"
 #include "udiskslinuxmanagerbcache.h"
 
+#define BCACHE_CONF_FILE  "udisks2_bcache.conf"
+#define BCACHE_CONF_GROUP "udisks2_bcache"
+#define BCACHE_CONF_STATS_SAMPLE_INTERVAL_KEY "stats_sample_interval"
+
+/* seconds */
+#define BCACHE_DEFAULT_STATS_SAMPLE_INTERVAL 5
+
 gchar *
 udisks_module_id (void)
 {
   return g_strdup (BCACHE_MODULE_NAME);
 }
 
+/* Reads the interval of the hit/miss counters sampling from the module
+ * configuration file
+ */
+static guint
+load_stats_sample_interval (UDisksDaemon *daemon)
+{
+  GKeyFile *key_file;
+  GError *error = NULL;
+  gchar *path;
+  gint interval = BCACHE_DEFAULT_STATS_SAMPLE_INTERVAL;
+
+  path = g_build_filename (udisks_daemon_get_uninstalled (daemon) ? BUILD_DIR "modules/bcache/data" : PACKAGE_SYSCONF_DIR "/udisks2/modules.conf.d",
+                           BCACHE_CONF_FILE,
+                           NULL);
+  key_file = g_key_file_new ();
+  if (g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL) &&
+      g_key_file_has_key (key_file, BCACHE_CONF_GROUP, BCACHE_CONF_STATS_SAMPLE_INTERVAL_KEY, NULL))
+    {
+      interval = g_key_file_get_integer (key_file, BCACHE_CONF_GROUP, BCACHE_CONF_STATS_SAMPLE_INTERVAL_KEY, &error);
+      if (error != NULL || interval < 0)
+        {
+          udisks_warning ("Bcache plugin: invalid %s in %s, using %d",
+                          BCACHE_CONF_STATS_SAMPLE_INTERVAL_KEY, path, BCACHE_DEFAULT_STATS_SAMPLE_INTERVAL);
+          interval = BCACHE_DEFAULT_STATS_SAMPLE_INTERVAL;
+          g_clear_error (&error);
+        }
+    }
+
+  g_key_file_free (key_file);
+  g_free (path);
+
+  return interval;
+}
+
 gpointer
 udisks_module_init (UDisksDaemon *daemon)
 {
   gboolean ret = FALSE;
   GError *error = NULL;
+  UDisksBcacheState *state;
 
   /* NULL means no specific so_name (implementation) */
   BDPluginSpec kbd_plugin = {BD_PLUGIN_KBD, NULL};
@@ -64,7 +106,10 @@ udisks_module_init (UDisksDaemon *daemon)
         }
     }
 
-  return udisks_bcache_state_new (daemon);
+  state = udisks_bcache_state_new (daemon);
+  udisks_bcache_state_set_stats_sample_interval (state, load_stats_sample_interval (daemon));
+
+  return state;
 }
 
 void
@@ -78,6 +123,17 @@ udisks_module_teardown (UDisksDaemon *daemon)
   udisks_bcache_state_free (state_pointer);
 }
 
+void
+udisks_module_reload_configuration (UDisksDaemon *daemon)
+{
+  UDisksModuleManager *manager = udisks_daemon_get_module_manager (daemon);
+  UDisksBcacheState *state = (UDisksBcacheState *) \
+                              udisks_module_manager_get_module_state_pointer (manager,
+                                                                              BCACHE_MODULE_NAME);
+
+  udisks_bcache_state_set_stats_sample_interval (state, load_stats_sample_interval (daemon));
+}
+
 /* ------------------------------------------------------------------------------------ */
 
 static gboolean
@@ -125,6 +181,21 @@ udisks_module_get_block_object_iface_setup_entries (void)
   return iface;
 }
 
+static const gchar * const bcache_device_file_prefixes[] = { "/dev/bcache", NULL };
+
+UDisksModuleInterfaceMatch **
+udisks_module_get_block_object_iface_matches (void)
+{
+  UDisksModuleInterfaceMatch **matches;
+
+  matches = g_new0 (UDisksModuleInterfaceMatch *, 2);
+  matches[0] = g_new0 (UDisksModuleInterfaceMatch, 1);
+  matches[0]->skeleton_type = UDISKS_TYPE_LINUX_BLOCK_BCACHE;
+  matches[0]->device_file_prefixes = bcache_device_file_prefixes;
+
+  return matches;
+}
+
 /* ------------------------------------------------------------------------------------ */
 
 UDisksModuleInterfaceInfo **
@@ -23,6 +23,9 @@
 struct _UDisksBcacheState
 {
   UDisksDaemon *daemon;
+
+  /* seconds between reads of the hit/miss counters (0 = only on uevents) */
+  guint stats_sample_interval;
 };
 
 /**
@@ -46,6 +49,7 @@ udisks_bcache_state_new (UDisksDaemon *daemon)
   if (state)
     {
       state->daemon = daemon;
+      state->stats_sample_interval = 0;
     }
   return state;
 
@@ -58,3 +62,20 @@ udisks_bcache_state_free (UDisksBcacheState* state)
 
   g_free (state);
 }
+
+guint
+udisks_bcache_state_get_stats_sample_interval (UDisksBcacheState *state)
+{
+  g_return_val_if_fail (state, 0);
+
+  return state->stats_sample_interval;
+}
+
+void
+udisks_bcache_state_set_stats_sample_interval (UDisksBcacheState *state,
+                                               guint              interval)
+{
+  g_return_if_fail (state);
+
+  state->stats_sample_interval = interval;
+}
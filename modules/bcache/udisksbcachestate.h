@@ -29,5 +29,9 @@ G_BEGIN_DECLS
 UDisksBcacheState  *udisks_bcache_state_new   (UDisksDaemon       *daemon);
 void                udisks_bcache_state_free  (UDisksBcacheState  *state);
 
+guint               udisks_bcache_state_get_stats_sample_interval (UDisksBcacheState *state);
+void                udisks_bcache_state_set_stats_sample_interval (UDisksBcacheState *state,
+                                                                   guint              interval);
+
 G_END_DECLS
 #endif /* __UDISKS_BCACHE_STATE_H__ */
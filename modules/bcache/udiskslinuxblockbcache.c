@@ -17,15 +17,25 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <blockdev/kbd.h>
 #include <glib/gi18n.h>
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslogging.h>
 #include <src/udiskslinuxblockobject.h>
+#include <src/udiskslinuxdevice.h>
+#include <src/udiskslinuxdrive.h>
+#include <src/udisksmodulemanager.h>
 
 #include "udiskslinuxblockbcache.h"
+#include "udisksbcachestate.h"
 #include "udisksbcacheutil.h"
 #include "udisks-bcache-generated.h"
 
@@ -46,6 +56,25 @@
 
 struct _UDisksLinuxBlockBcache {
   UDisksBlockBcacheSkeleton parent_instance;
+
+  /* the device file and its bcache directory in sysfs */
+  gchar *device_file;
+  gchar *bcache_dir;
+
+  /* contents of the cache_mode file the Mode property was set from */
+  gchar *cache_mode;
+
+  /* counters from the last update, for the deltas */
+  gboolean have_counters;
+  guint64 hits;
+  guint64 misses;
+  guint64 bypass_hits;
+  guint64 bypass_misses;
+
+  guint sample_timeout_id;
+
+  /* whether the tuning from the drive configuration has been applied */
+  gboolean configuration_applied;
 };
 
 struct _UDisksLinuxBlockBcacheClass {
@@ -97,6 +126,14 @@ udisks_linux_block_bcache_dispose (GObject *object)
 static void
 udisks_linux_block_bcache_finalize (GObject *object)
 {
+  UDisksLinuxBlockBcache *block = UDISKS_LINUX_BLOCK_BCACHE (object);
+
+  if (block->sample_timeout_id > 0)
+    g_source_remove (block->sample_timeout_id);
+  g_free (block->device_file);
+  g_free (block->bcache_dir);
+  g_free (block->cache_mode);
+
   if (G_OBJECT_CLASS (udisks_linux_block_bcache_parent_class))
     G_OBJECT_CLASS (udisks_linux_block_bcache_parent_class)->finalize (object);
 }
@@ -110,14 +147,13 @@ udisks_linux_block_bcache_class_init (UDisksLinuxBlockBcacheClass *klass)
   gobject_class->set_property = udisks_linux_block_bcache_set_property;
   gobject_class->dispose = udisks_linux_block_bcache_dispose;
   gobject_class->finalize = udisks_linux_block_bcache_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_block_bcache_init (UDisksLinuxBlockBcache *self)
 {
-    g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (self),
-                                         G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
-
 }
 
 /**
@@ -167,6 +203,440 @@ udisks_linux_block_bcache_get_daemon (UDisksLinuxBlockBcache *block)
   return daemon;
 }
 
+static gboolean
+read_counter (const gchar *dir,
+              const gchar *name,
+              guint64     *out_value)
+{
+  gchar *path;
+  gchar *contents = NULL;
+  gboolean ret;
+
+  path = g_build_filename (dir, name, NULL);
+  ret = g_file_get_contents (path, &contents, NULL, NULL);
+  if (ret)
+    *out_value = g_ascii_strtoull (contents, NULL, 10);
+
+  g_free (contents);
+  g_free (path);
+  return ret;
+}
+
+static gdouble
+hit_ratio (guint64 hits,
+           guint64 misses)
+{
+  return hits + misses > 0 ? (gdouble) hits / (hits + misses) : 0.0;
+}
+
+/* The tuning knobs of SetTuning(), the files are relative to the bcache
+ * directory of the device; the same keys prefixed with "bcache-" are used in
+ * the configuration of the drive of the backing device.
+ */
+static const struct
+{
+  const gchar *key;
+  const gchar *attr;
+  const GVariantType *type;
+} tuning_settings[] =
+{
+  {"sequential-cutoff",            "sequential_cutoff",                  G_VARIANT_TYPE_UINT32},
+  {"writeback-percent",            "writeback_percent",                  G_VARIANT_TYPE_UINT32},
+  {"writeback-running",            "writeback_running",                  G_VARIANT_TYPE_BOOLEAN},
+  {"congested-read-threshold-us",  "cache/congested_read_threshold_us",  G_VARIANT_TYPE_UINT32},
+  {"congested-write-threshold-us", "cache/congested_write_threshold_us", G_VARIANT_TYPE_UINT32},
+};
+
+/* Reads a size printed by bcache in the human readable form, e.g. "4.0M" */
+static gboolean
+read_human_size (const gchar *dir,
+                 const gchar *name,
+                 guint64     *out_value)
+{
+  static const gchar units[] = "kMGTPEZY";
+  gchar *path;
+  gchar *contents = NULL;
+  gchar *end = NULL;
+  const gchar *unit;
+  gdouble value;
+  gboolean ret;
+  gint n;
+
+  path = g_build_filename (dir, name, NULL);
+  ret = g_file_get_contents (path, &contents, NULL, NULL);
+  if (ret)
+    {
+      value = g_ascii_strtod (contents, &end);
+      if (end != NULL && *end != '\0' && (unit = strchr (units, *end)) != NULL)
+        for (n = 0; n <= unit - units; n++)
+          value *= 1024;
+      *out_value = value > 0 ? (guint64) value : 0;
+    }
+
+  g_free (contents);
+  g_free (path);
+  return ret;
+}
+
+static gboolean
+write_bcache_attr (const gchar  *dir,
+                   const gchar  *attr,
+                   const gchar  *value,
+                   GError      **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename;
+  gint fd;
+
+  filename = g_build_filename (dir, attr, NULL);
+  fd = open (filename, O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %s", filename, g_strerror (errno));
+      goto out;
+    }
+  if (write (fd, value, strlen (value)) == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error writing '%s' to %s: %s", value, filename, g_strerror (errno));
+      close (fd);
+      goto out;
+    }
+  close (fd);
+  ret = TRUE;
+
+ out:
+  g_free (filename);
+  return ret;
+}
+
+/* Writes the tuning settings in @settings, with the keys prefixed by
+ * @key_prefix, to the sysfs files of the bcache device */
+static gboolean
+apply_tuning (UDisksLinuxBlockBcache  *block,
+              GVariant                *settings,
+              const gchar             *key_prefix,
+              GError                 **error)
+{
+  gboolean ret = TRUE;
+  guint n;
+
+  for (n = 0; ret && n < G_N_ELEMENTS (tuning_settings); n++)
+    {
+      GVariant *value;
+      gchar *key;
+      gchar *str;
+
+      key = g_strconcat (key_prefix, tuning_settings[n].key, NULL);
+      value = g_variant_lookup_value (settings, key, tuning_settings[n].type);
+      g_free (key);
+      if (value == NULL)
+        continue;
+
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+        str = g_strdup (g_variant_get_boolean (value) ? "1" : "0");
+      else
+        str = g_strdup_printf ("%u", g_variant_get_uint32 (value));
+
+      ret = write_bcache_attr (block->bcache_dir, tuning_settings[n].attr, str, error);
+
+      g_free (str);
+      g_variant_unref (value);
+    }
+
+  return ret;
+}
+
+/* Updates the tuning properties, these only change through SetTuning() or
+ * direct writes to sysfs so they are not part of the periodic sampling */
+static void
+update_tuning (UDisksLinuxBlockBcache *block)
+{
+  UDisksBlockBcache *iface = UDISKS_BLOCK_BCACHE (block);
+  gchar *cache_dir;
+  guint64 value;
+
+  cache_dir = g_build_filename (block->bcache_dir, "cache", NULL);
+
+  g_object_freeze_notify (G_OBJECT (block));
+  if (read_human_size (block->bcache_dir, "sequential_cutoff", &value))
+    udisks_block_bcache_set_sequential_cutoff (iface, MIN (value, G_MAXUINT32));
+  if (read_counter (block->bcache_dir, "writeback_percent", &value))
+    udisks_block_bcache_set_writeback_percent (iface, value);
+  if (read_counter (block->bcache_dir, "writeback_running", &value))
+    udisks_block_bcache_set_writeback_running (iface, value != 0);
+  if (read_counter (cache_dir, "congested_read_threshold_us", &value))
+    udisks_block_bcache_set_congested_read_threshold_us (iface, value);
+  if (read_counter (cache_dir, "congested_write_threshold_us", &value))
+    udisks_block_bcache_set_congested_write_threshold_us (iface, value);
+  g_object_thaw_notify (G_OBJECT (block));
+
+  g_free (cache_dir);
+}
+
+static void
+update_dirty_data (UDisksLinuxBlockBcache *block)
+{
+  guint64 dirty_data;
+
+  if (read_human_size (block->bcache_dir, "dirty_data", &dirty_data))
+    udisks_block_bcache_set_dirty_data (UDISKS_BLOCK_BCACHE (block), dirty_data);
+}
+
+/* Returns the drive of the backing device of the bcache device at @sysfs_path */
+static UDisksDrive *
+dup_backing_drive (UDisksDaemon *daemon,
+                   const gchar  *sysfs_path)
+{
+  UDisksObject *backing_object = NULL;
+  UDisksObject *drive_object = NULL;
+  UDisksDrive *drive = NULL;
+  UDisksBlock *backing_block;
+  gchar *slaves_path;
+  gchar *device_file;
+  const gchar *name;
+  GDir *dir;
+
+  slaves_path = g_build_filename (sysfs_path, "slaves", NULL);
+  dir = g_dir_open (slaves_path, 0, NULL);
+  g_free (slaves_path);
+  if (dir == NULL)
+    return NULL;
+
+  /* the backing device is the only slave of a bcache device */
+  name = g_dir_read_name (dir);
+  if (name != NULL)
+    {
+      device_file = g_strconcat ("/dev/", name, NULL);
+      backing_object = udisks_daemon_find_block_by_device_file (daemon, device_file);
+      g_free (device_file);
+    }
+  g_dir_close (dir);
+
+  backing_block = backing_object ? udisks_object_peek_block (backing_object) : NULL;
+  if (backing_block != NULL)
+    drive_object = udisks_daemon_find_object (daemon, udisks_block_get_drive (backing_block));
+  if (drive_object != NULL)
+    drive = udisks_object_get_drive (drive_object);
+
+  g_clear_object (&drive_object);
+  g_clear_object (&backing_object);
+  return drive;
+}
+
+/* Applies the tuning stored in the drive configuration of the backing
+ * device, once per bcache device */
+static void
+apply_configuration (UDisksLinuxBlockBcache *block,
+                     UDisksLinuxBlockObject *object,
+                     const gchar            *sysfs_path)
+{
+  UDisksDrive *drive;
+  GVariant *configuration = NULL;
+  GError *error = NULL;
+
+  if (block->configuration_applied)
+    return;
+
+  /* try again on the next update if the backing device isn't known yet */
+  drive = dup_backing_drive (udisks_linux_block_object_get_daemon (object), sysfs_path);
+  if (drive == NULL)
+    return;
+  block->configuration_applied = TRUE;
+
+  configuration = udisks_drive_dup_configuration (drive);
+  if (configuration != NULL && ! apply_tuning (block, configuration, "bcache-", &error))
+    {
+      udisks_warning ("Error applying the bcache configuration of %s: %s",
+                      block->device_file, error->message);
+      g_clear_error (&error);
+    }
+
+  if (configuration != NULL)
+    g_variant_unref (configuration);
+  g_object_unref (drive);
+}
+
+/* counters are reset when the cache is re-attached, count them from 0 */
+static guint64
+counter_delta (guint64 old_value,
+               guint64 new_value)
+{
+  return new_value >= old_value ? new_value - old_value : new_value;
+}
+
+static void
+set_counters (UDisksLinuxBlockBcache *block,
+              guint64                 hits,
+              guint64                 misses,
+              guint64                 bypass_hits,
+              guint64                 bypass_misses)
+{
+  UDisksBlockBcache *iface = UDISKS_BLOCK_BCACHE (block);
+
+  if (block->have_counters)
+    {
+      udisks_block_bcache_set_hits_delta (iface, counter_delta (block->hits, hits));
+      udisks_block_bcache_set_misses_delta (iface, counter_delta (block->misses, misses));
+      udisks_block_bcache_set_bypass_hits_delta (iface, counter_delta (block->bypass_hits, bypass_hits));
+      udisks_block_bcache_set_bypass_misses_delta (iface, counter_delta (block->bypass_misses, bypass_misses));
+    }
+  udisks_block_bcache_set_hits (iface, hits);
+  udisks_block_bcache_set_misses (iface, misses);
+  udisks_block_bcache_set_bypass_hits (iface, bypass_hits);
+  udisks_block_bcache_set_bypass_misses (iface, bypass_misses);
+  udisks_block_bcache_set_hit_ratio (iface, hit_ratio (hits, misses));
+
+  block->have_counters = TRUE;
+  block->hits = hits;
+  block->misses = misses;
+  block->bypass_hits = bypass_hits;
+  block->bypass_misses = bypass_misses;
+}
+
+/* Updates the Mode property, the libblockdev lookups are only done when
+ * the contents of the cache_mode file changed since the last time
+ */
+static gboolean
+update_mode (UDisksLinuxBlockBcache  *block,
+             const gchar             *dev_file,
+             GError                 **error)
+{
+  gchar *path = NULL;
+  gchar *contents = NULL;
+  BDKBDBcacheMode mode;
+  const gchar *mode_str;
+  gboolean ret = FALSE;
+
+  if (block->bcache_dir)
+    {
+      path = g_build_filename (block->bcache_dir, "cache_mode", NULL);
+      if (g_file_get_contents (path, &contents, NULL, NULL) &&
+          g_strcmp0 (contents, block->cache_mode) == 0)
+        {
+          ret = TRUE;
+          goto out;
+        }
+    }
+
+  mode = bd_kbd_bcache_get_mode (dev_file, error);
+  if (mode == BD_KBD_MODE_UNKNOWN)
+    {
+      g_prefix_error (error, "Can't get Bcache mode for %s: ", dev_file);
+      goto out;
+    }
+  mode_str = bd_kbd_bcache_get_mode_str (mode, error);
+  if (! mode_str)
+    {
+      g_prefix_error (error, "Can't get Bcache mode string for %s: ", dev_file);
+      goto out;
+    }
+
+  udisks_block_bcache_set_mode (UDISKS_BLOCK_BCACHE (block), mode_str);
+  g_free (block->cache_mode);
+  block->cache_mode = g_steal_pointer (&contents);
+  ret = TRUE;
+
+out:
+  g_free (contents);
+  g_free (path);
+  return ret;
+}
+
+static void
+update_five_minute_ratio (UDisksLinuxBlockBcache *block)
+{
+  gchar *dir;
+  guint64 hits = 0, misses = 0;
+
+  dir = g_build_filename (block->bcache_dir, "cache", "stats_five_minute", NULL);
+  if (read_counter (dir, "cache_hits", &hits) &&
+      read_counter (dir, "cache_misses", &misses))
+    udisks_block_bcache_set_five_minute_hit_ratio (UDISKS_BLOCK_BCACHE (block), hit_ratio (hits, misses));
+  g_free (dir);
+}
+
+/* Reads just the hit/miss counters, the dirty data and the cache mode from sysfs */
+static void
+sample_stats (UDisksLinuxBlockBcache *block)
+{
+  gchar *total_dir;
+  guint64 hits = 0, misses = 0, bypass_hits = 0, bypass_misses = 0;
+  GError *error = NULL;
+
+  /* the same cache set counters bd_kbd_bcache_status() reports */
+  total_dir = g_build_filename (block->bcache_dir, "cache", "stats_total", NULL);
+  if (read_counter (total_dir, "cache_hits", &hits) &&
+      read_counter (total_dir, "cache_misses", &misses) &&
+      read_counter (total_dir, "cache_bypass_hits", &bypass_hits) &&
+      read_counter (total_dir, "cache_bypass_misses", &bypass_misses))
+    set_counters (block, hits, misses, bypass_hits, bypass_misses);
+
+  update_five_minute_ratio (block);
+  update_dirty_data (block);
+
+  if (! update_mode (block, block->device_file, &error))
+    {
+      udisks_warning ("%s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_free (total_dir);
+}
+
+static gboolean
+sample_timeout (gpointer user_data)
+{
+  GWeakRef *ref = user_data;
+  UDisksLinuxBlockBcache *block;
+
+  block = g_weak_ref_get (ref);
+  if (! block)
+    return G_SOURCE_REMOVE;
+
+  sample_stats (block);
+  g_object_unref (block);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+free_weak_ref (gpointer data)
+{
+  g_weak_ref_clear (data);
+  g_free (data);
+}
+
+static void
+start_sampling (UDisksLinuxBlockBcache *block,
+                UDisksLinuxBlockObject *object)
+{
+  UDisksDaemon *daemon;
+  UDisksBcacheState *state;
+  GWeakRef *ref;
+  guint interval;
+
+  if (block->sample_timeout_id > 0 || ! block->bcache_dir)
+    return;
+
+  daemon = udisks_linux_block_object_get_daemon (object);
+  state = udisks_module_manager_get_module_state_pointer (udisks_daemon_get_module_manager (daemon),
+                                                          BCACHE_MODULE_NAME);
+  interval = state ? udisks_bcache_state_get_stats_sample_interval (state) : 0;
+  if (interval == 0)
+    return;
+
+  ref = g_new0 (GWeakRef, 1);
+  g_weak_ref_init (ref, block);
+  block->sample_timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                     "bcache-stats-sample",
+                                                                     interval,
+                                                                     sample_timeout,
+                                                                     ref,
+                                                                     free_weak_ref);
+}
+
 /**
  * udisks_linux_block_bcache_update:
  * @block: A #UDisksLinuxBlockBcache
@@ -185,15 +655,23 @@ udisks_linux_block_bcache_update (UDisksLinuxBlockBcache  *block,
   GError *error = NULL;
   gchar *dev_file = NULL;
   gboolean rval = FALSE;
-  BDKBDBcacheStats *stats;
-  BDKBDBcacheMode mode;
-  const gchar* mode_str = NULL;
+  BDKBDBcacheStats *stats = NULL;
+  UDisksLinuxDevice *device;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK_BCACHE (block), FALSE);
   g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object), FALSE);
 
   dev_file = udisks_linux_block_object_get_device_file (object);
 
+  device = udisks_linux_block_object_get_device (object);
+  g_free (block->bcache_dir);
+  block->bcache_dir = g_build_filename (g_udev_device_get_sysfs_path (device->udev_device), "bcache", NULL);
+  g_free (block->device_file);
+  block->device_file = g_strdup (dev_file);
+
+  apply_configuration (block, object, g_udev_device_get_sysfs_path (device->udev_device));
+  g_object_unref (device);
+
   stats = bd_kbd_bcache_status (dev_file, &error);
   if (! stats)
     {
@@ -201,30 +679,23 @@ udisks_linux_block_bcache_update (UDisksLinuxBlockBcache  *block,
       rval = FALSE;
       goto out;
     }
-  mode = bd_kbd_bcache_get_mode (dev_file, &error);
-  if (mode == BD_KBD_MODE_UNKNOWN)
+  if (! update_mode (block, dev_file, &error))
     {
-      udisks_critical ("Can't get Bcache mode for %s: %s", dev_file, error->message);
-      rval = FALSE;
-      goto out;
-    }
-  mode_str = bd_kbd_bcache_get_mode_str (mode, &error);
-  if (! mode_str)
-    {
-      udisks_critical ("Can't get Bcache mode string for %s: %s", dev_file, error->message);
+      udisks_critical ("%s", error->message);
       rval = FALSE;
       goto out;
     }
 
-  udisks_block_bcache_set_mode (iface, mode_str);
   udisks_block_bcache_set_state (iface, stats->state);
   udisks_block_bcache_set_block_size (iface, stats->block_size);
   udisks_block_bcache_set_cache_size (iface, stats->cache_size);
   udisks_block_bcache_set_cache_used (iface, stats->cache_used);
-  udisks_block_bcache_set_hits (iface, stats->hits);
-  udisks_block_bcache_set_misses (iface, stats->misses);
-  udisks_block_bcache_set_bypass_hits (iface, stats->bypass_hits);
-  udisks_block_bcache_set_bypass_misses (iface, stats->bypass_misses);
+  set_counters (block, stats->hits, stats->misses, stats->bypass_hits, stats->bypass_misses);
+  update_five_minute_ratio (block);
+  update_dirty_data (block);
+  update_tuning (block);
+
+  start_sampling (block, object);
 out:
   if (stats)
     bd_kbd_bcache_stats_free (stats);
@@ -284,6 +755,7 @@ handle_bcache_destroy (UDisksBlockBcache      *block_,
                                                          (gpointer) object_path,
                                                          NULL,
                                                          10,
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &error))
     {
       g_prefix_error (&error, "Error waiting for bcache to disappear: ");
@@ -350,9 +822,153 @@ out:
   return TRUE;
 }
 
+/* Returns the configuration of @drive with the bcache settings replaced by
+ * those in @settings.
+ */
+static GVariant *
+merge_configuration (UDisksDrive *drive,
+                     GVariant    *settings)
+{
+  GVariantBuilder builder;
+  GVariant *configuration;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  configuration = udisks_drive_dup_configuration (drive);
+  if (configuration != NULL)
+    {
+      g_variant_iter_init (&iter, configuration);
+      while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+        {
+          if (! g_str_has_prefix (key, "bcache-") ||
+              ! g_variant_lookup (settings, key + strlen ("bcache-"), "*", NULL))
+            g_variant_builder_add (&builder, "{sv}", key, value);
+          g_variant_unref (value);
+        }
+      g_variant_unref (configuration);
+    }
+
+  g_variant_iter_init (&iter, settings);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      gchar *conf_key = g_strconcat ("bcache-", key, NULL);
+      g_variant_builder_add (&builder, "{sv}", conf_key, value);
+      g_free (conf_key);
+      g_variant_unref (value);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static gboolean
+handle_set_tuning (UDisksBlockBcache      *block_,
+                   GDBusMethodInvocation  *invocation,
+                   GVariant               *settings,
+                   GVariant               *options)
+{
+  GError *error = NULL;
+  UDisksLinuxBlockBcache *block = UDISKS_LINUX_BLOCK_BCACHE (block_);
+  UDisksLinuxBlockObject *object = NULL;
+  UDisksLinuxDevice *device = NULL;
+  UDisksDrive *drive = NULL;
+  GVariant *configuration = NULL;
+  gboolean persist = FALSE;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  object = udisks_daemon_util_dup_object (block, &error);
+  if (! object)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* reject unknown settings instead of silently ignoring them */
+  g_variant_iter_init (&iter, settings);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      guint n;
+
+      for (n = 0; n < G_N_ELEMENTS (tuning_settings); n++)
+        {
+          if (g_strcmp0 (tuning_settings[n].key, key) == 0)
+            break;
+        }
+      if (n == G_N_ELEMENTS (tuning_settings) || ! g_variant_is_of_type (value, tuning_settings[n].type))
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                                 "Unknown bcache setting %s of type %s",
+                                                 key, g_variant_get_type_string (value));
+          g_variant_unref (value);
+          goto out;
+        }
+      g_variant_unref (value);
+    }
+
+  device = udisks_linux_block_object_get_device (object);
+  g_variant_lookup (options, "persist", "b", &persist);
+  if (persist)
+    {
+      drive = dup_backing_drive (udisks_linux_block_object_get_daemon (object),
+                                 g_udev_device_get_sysfs_path (device->udev_device));
+      if (drive == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                 "The backing device has no drive to store the settings in");
+          goto out;
+        }
+    }
+
+  /* Policy check */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (udisks_linux_block_bcache_get_daemon (block),
+                                     NULL,
+                                     bcache_policy_action_id,
+                                     options,
+                                     N_("Authentication is required to tune bcache device."),
+                                     invocation);
+
+  if (! apply_tuning (block, settings, "", &error))
+    {
+      /* some of the settings may have been applied */
+      update_tuning (block);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  update_tuning (block);
+
+  if (drive != NULL)
+    {
+      configuration = g_variant_ref_sink (merge_configuration (drive, settings));
+      if (! udisks_linux_drive_set_configuration_sync (UDISKS_LINUX_DRIVE (drive), configuration, &error))
+        {
+          g_prefix_error (&error, "Error storing the bcache settings: ");
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+    }
+
+  udisks_notice ("Changed tuning of %s%s",
+                 block->device_file,
+                 drive != NULL ? " persistently" : "");
+  udisks_block_bcache_complete_set_tuning (block_, invocation);
+
+out:
+  if (configuration != NULL)
+    g_variant_unref (configuration);
+  g_clear_object (&drive);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return TRUE;
+}
+
 static void
 udisks_linux_block_bcache_iface_init (UDisksBlockBcacheIface *iface)
 {
   iface->handle_bcache_destroy = handle_bcache_destroy;
   iface->handle_set_mode = handle_set_mode;
+  iface->handle_set_tuning = handle_set_tuning;
 }
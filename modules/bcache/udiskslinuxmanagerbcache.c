@@ -24,6 +24,7 @@
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslogging.h>
 #include <src/udiskslinuxblock.h>
 #include <src/udiskslinuxblockobject.h>
@@ -155,13 +156,13 @@ udisks_linux_manager_bcache_class_init (UDisksLinuxManagerBcacheClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_manager_bcache_init (UDisksLinuxManagerBcache *self)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (self),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 /**
@@ -312,6 +313,7 @@ handle_bcache_create (UDisksManagerBcache    *object,
                                                       bcache_file,
                                                       NULL,
                                                       10, /* timeout_seconds */
+                                                      udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                       &error);
 
   if (bcache_object == NULL)
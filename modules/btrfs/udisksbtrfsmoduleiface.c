@@ -130,6 +130,21 @@ udisks_module_get_block_object_iface_setup_entries (void)
   return iface;
 }
 
+static const gchar * const btrfs_fs_types[] = { "btrfs", NULL };
+
+UDisksModuleInterfaceMatch **
+udisks_module_get_block_object_iface_matches (void)
+{
+  UDisksModuleInterfaceMatch **matches;
+
+  matches = g_new0 (UDisksModuleInterfaceMatch *, 2);
+  matches[0] = g_new0 (UDisksModuleInterfaceMatch, 1);
+  matches[0]->skeleton_type = UDISKS_TYPE_LINUX_FILESYSTEM_BTRFS;
+  matches[0]->fs_types = btrfs_fs_types;
+
+  return matches;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 UDisksModuleInterfaceInfo **
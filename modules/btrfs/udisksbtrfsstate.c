@@ -24,8 +24,24 @@
 struct _UDisksBTRFSState
 {
   UDisksDaemon *daemon;
+
+  /* maps from filesystem UUIDs to UDisksBTRFSFilesystem instances */
+  GHashTable *filesystems;
 };
 
+static void
+btrfs_filesystem_free (UDisksBTRFSFilesystem *filesystem)
+{
+  if (filesystem->refresh_timeout_id != 0)
+    g_source_remove (filesystem->refresh_timeout_id);
+  if (filesystem->info != NULL)
+    bd_btrfs_filesystem_info_free (filesystem->info);
+  g_hash_table_unref (filesystem->members);
+  g_free (filesystem->device_file);
+  g_free (filesystem->uuid);
+  g_free (filesystem);
+}
+
 /**
  * udisks_btrfs_state_new:
  * @daemon: A #UDisksDaemon instance.
@@ -47,6 +63,10 @@ udisks_btrfs_state_new (UDisksDaemon *daemon)
     {
       /* Initialize members. */
       state->daemon = daemon;
+      state->filesystems = g_hash_table_new_full (g_str_hash,
+                                                  g_str_equal,
+                                                  NULL,
+                                                  (GDestroyNotify) btrfs_filesystem_free);
     }
 
   return state;
@@ -58,6 +78,71 @@ udisks_btrfs_state_free (UDisksBTRFSState *state)
   g_return_if_fail (state);
 
   /* Free/Unref members. */
+  g_hash_table_unref (state->filesystems);
 
   g_free (state);
 }
+
+/**
+ * udisks_btrfs_state_get_filesystem:
+ * @state: A #UDisksBTRFSState.
+ * @uuid: The UUID of a btrfs filesystem.
+ *
+ * Gets the cached info of the btrfs filesystem with @uuid.
+ *
+ * Returns: (transfer none): A #UDisksBTRFSFilesystem owned by @state or %NULL if not known.
+ */
+UDisksBTRFSFilesystem *
+udisks_btrfs_state_get_filesystem (UDisksBTRFSState *state,
+                                   const gchar      *uuid)
+{
+  g_return_val_if_fail (state, NULL);
+
+  return g_hash_table_lookup (state->filesystems, uuid);
+}
+
+/**
+ * udisks_btrfs_state_add_filesystem:
+ * @state: A #UDisksBTRFSState.
+ * @uuid: The UUID of a btrfs filesystem.
+ *
+ * Like udisks_btrfs_state_get_filesystem() but creates an empty entry
+ * if there is none yet.
+ *
+ * Returns: (transfer none): A #UDisksBTRFSFilesystem owned by @state.
+ */
+UDisksBTRFSFilesystem *
+udisks_btrfs_state_add_filesystem (UDisksBTRFSState *state,
+                                   const gchar      *uuid)
+{
+  UDisksBTRFSFilesystem *filesystem;
+
+  g_return_val_if_fail (state, NULL);
+
+  filesystem = g_hash_table_lookup (state->filesystems, uuid);
+  if (filesystem == NULL)
+    {
+      filesystem = g_new0 (UDisksBTRFSFilesystem, 1);
+      filesystem->uuid = g_strdup (uuid);
+      filesystem->members = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_insert (state->filesystems, filesystem->uuid, filesystem);
+    }
+
+  return filesystem;
+}
+
+/**
+ * udisks_btrfs_state_remove_filesystem:
+ * @state: A #UDisksBTRFSState.
+ * @uuid: The UUID of a btrfs filesystem.
+ *
+ * Drops the cached info of the btrfs filesystem with @uuid.
+ */
+void
+udisks_btrfs_state_remove_filesystem (UDisksBTRFSState *state,
+                                      const gchar      *uuid)
+{
+  g_return_if_fail (state);
+
+  g_hash_table_remove (state->filesystems, uuid);
+}
@@ -21,14 +21,37 @@
 #define __UDISKS_BTRFS_STATE_H__
 
 #include <glib.h>
+#include <blockdev/btrfs.h>
 #include <src/udisksdaemontypes.h>
 #include "udisksbtrfstypes.h"
 
 G_BEGIN_DECLS
 
+/* The info of a btrfs filesystem shared by all its member devices */
+struct _UDisksBTRFSFilesystem
+{
+  gchar *uuid;
+  /* NULL until the first refresh has finished */
+  BDBtrfsFilesystemInfo *info;
+  /* object paths of the block objects of the member devices */
+  GHashTable *members;
+  /* the member device to query in the next refresh */
+  gchar *device_file;
+  guint refresh_timeout_id;
+  gboolean refreshing;
+  gboolean refresh_again;
+};
+
 UDisksBTRFSState                     *udisks_btrfs_state_new  (UDisksDaemon *daemon);
 void                                  udisks_btrfs_state_free (UDisksBTRFSState *state);
 
+UDisksBTRFSFilesystem                *udisks_btrfs_state_get_filesystem    (UDisksBTRFSState *state,
+                                                                            const gchar      *uuid);
+UDisksBTRFSFilesystem                *udisks_btrfs_state_add_filesystem    (UDisksBTRFSState *state,
+                                                                            const gchar      *uuid);
+void                                  udisks_btrfs_state_remove_filesystem (UDisksBTRFSState *state,
+                                                                            const gchar      *uuid);
+
 G_END_DECLS
 
 #endif /* __UDISKS_BTRFS_STATE_H__ */
@@ -23,6 +23,7 @@
 #define BTRFS_MODULE_NAME "btrfs"
 
 typedef struct _UDisksBTRFSState UDisksBTRFSState;
+typedef struct _UDisksBTRFSFilesystem UDisksBTRFSFilesystem;
 
 typedef struct _UDisksLinuxManagerBTRFS        UDisksLinuxManagerBTRFS;
 typedef struct _UDisksLinuxManagerBTRFSClass   UDisksLinuxManagerBTRFSClass;
@@ -19,15 +19,29 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+
 #include <blockdev/btrfs.h>
 #include "udisksbtrfsutil.h"
 
+/* Size of the buffer the tree search results are copied into */
+#define SEARCH_BUF_SIZE (64 * 1024)
+
 const gchar *btrfs_subvolume_fmt = "(tts)";
 const gchar *btrfs_subvolumes_fmt = "a(tts)";
 const gchar *btrfs_policy_action_id = "org.freedesktop.udisks2.btrfs.manage-btrfs";
 
 GVariant *
 btrfs_subvolumes_to_gvariant (BDBtrfsSubvolumeInfo **subvolumes_info,
+                              guint64                parent_id,
+                              guint64                start_id,
+                              guint                  limit,
                               gint                  *subvolumes_cnt)
 {
   BDBtrfsSubvolumeInfo **infos;
@@ -39,8 +53,16 @@ btrfs_subvolumes_to_gvariant (BDBtrfsSubvolumeInfo **subvolumes_info,
 
   *subvolumes_cnt = 0;
 
-  for (infos = subvolumes_info; *infos; ++infos, ++*subvolumes_cnt)
+  for (infos = subvolumes_info; *infos; ++infos)
     {
+      if (limit > 0 && (guint) *subvolumes_cnt >= limit)
+        break;
+      if ((*infos)->id < start_id)
+        continue;
+      if (parent_id > 0 && (*infos)->parent_id != parent_id)
+        continue;
+
+      ++*subvolumes_cnt;
       g_variant_builder_add (&builder,
                              btrfs_subvolume_fmt,
                              (*infos)->id,
@@ -63,3 +85,325 @@ btrfs_free_subvolumes_info (BDBtrfsSubvolumeInfo **subvolumes_info)
     bd_btrfs_subvolume_info_free (*infos);
   g_free ((gpointer) subvolumes_info);
 }
+
+typedef struct
+{
+  guint64  id;
+  guint64  parent_id;
+  guint64  dirid;
+  gchar   *name;
+  gchar   *path;        /* relative to the top-level subvolume, resolved lazily */
+} SubvolumeRef;
+
+static void
+subvolume_ref_free (SubvolumeRef *ref)
+{
+  g_free (ref->name);
+  g_free (ref->path);
+  g_free (ref);
+}
+
+static gboolean
+tree_search (gint                               fd,
+             struct btrfs_ioctl_search_args_v2 *args,
+             GError                           **error)
+{
+  if (ioctl (fd, BTRFS_IOC_TREE_SEARCH_V2, args) < 0)
+    {
+      g_set_error (error, G_IO_ERROR,
+                   errno == ENOTTY ? G_IO_ERROR_NOT_SUPPORTED : g_io_error_from_errno (errno),
+                   "Error searching the BTRFS root tree: %m");
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static struct btrfs_ioctl_search_args_v2 *
+search_args_new (guint64 min_objectid,
+                 guint64 max_objectid,
+                 guint32 min_type,
+                 guint32 max_type)
+{
+  struct btrfs_ioctl_search_args_v2 *args;
+
+  args = g_malloc0 (sizeof (struct btrfs_ioctl_search_args_v2) + SEARCH_BUF_SIZE);
+  args->key.tree_id = BTRFS_ROOT_TREE_OBJECTID;
+  args->key.min_objectid = min_objectid;
+  args->key.max_objectid = max_objectid;
+  args->key.min_type = min_type;
+  args->key.max_type = max_type;
+  args->key.min_offset = 0;
+  args->key.max_offset = G_MAXUINT64;
+  args->key.min_transid = 0;
+  args->key.max_transid = G_MAXUINT64;
+  args->buf_size = SEARCH_BUF_SIZE;
+
+  return args;
+}
+
+/* Moves the start of the search right after the given key, returns FALSE
+ * if there's nothing more to search
+ */
+static gboolean
+search_args_advance (struct btrfs_ioctl_search_args_v2 *args,
+                     guint64                            objectid,
+                     guint32                            type,
+                     guint64                            offset)
+{
+  args->key.min_objectid = objectid;
+  args->key.min_type = type;
+  args->key.min_offset = offset;
+
+  if (args->key.min_offset < G_MAXUINT64)
+    {
+      args->key.min_offset++;
+      return TRUE;
+    }
+  args->key.min_offset = 0;
+  if (args->key.min_type < G_MAXUINT8)
+    {
+      args->key.min_type++;
+      return TRUE;
+    }
+  args->key.min_type = 0;
+  if (args->key.min_objectid < args->key.max_objectid)
+    {
+      args->key.min_objectid++;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+static SubvolumeRef *
+subvolume_ref_new (guint64       id,
+                   guint64       parent_id,
+                   const guint8 *data,
+                   guint32       len)
+{
+  struct btrfs_root_ref ref;
+  SubvolumeRef *ret;
+  guint16 name_len;
+
+  if (len < sizeof (struct btrfs_root_ref))
+    return NULL;
+
+  memcpy (&ref, data, sizeof (struct btrfs_root_ref));
+  name_len = GUINT16_FROM_LE (ref.name_len);
+  if (len < sizeof (struct btrfs_root_ref) + name_len)
+    return NULL;
+
+  ret = g_new0 (SubvolumeRef, 1);
+  ret->id = id;
+  ret->parent_id = parent_id;
+  ret->dirid = GUINT64_FROM_LE (ref.dirid);
+  ret->name = g_strndup ((const gchar *) data + sizeof (struct btrfs_root_ref), name_len);
+
+  return ret;
+}
+
+/* Looks up the back reference of a subvolume that was not part of the listing */
+static SubvolumeRef *
+lookup_subvolume_ref (gint      fd,
+                      guint64   id,
+                      GError  **error)
+{
+  struct btrfs_ioctl_search_args_v2 *args;
+  struct btrfs_ioctl_search_header sh;
+  SubvolumeRef *ret = NULL;
+
+  args = search_args_new (id, id, BTRFS_ROOT_BACKREF_KEY, BTRFS_ROOT_BACKREF_KEY);
+  args->key.nr_items = 1;
+  if (! tree_search (fd, args, error))
+    goto out;
+
+  if (args->key.nr_items > 0)
+    {
+      memcpy (&sh, args->buf, sizeof (sh));
+      ret = subvolume_ref_new (id, sh.offset, (const guint8 *) args->buf + sizeof (sh), sh.len);
+    }
+  if (! ret)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                 "Error looking up the parent of BTRFS subvolume %" G_GUINT64_FORMAT, id);
+
+ out:
+  g_free (args);
+  return ret;
+}
+
+static const gchar *
+resolve_subvolume_path (gint          fd,
+                        GHashTable   *refs,
+                        SubvolumeRef *ref,
+                        GError      **error)
+{
+  struct btrfs_ioctl_ino_lookup_args lookup;
+  const gchar *parent_path = "";
+
+  if (ref->path)
+    return ref->path;
+
+  if (ref->parent_id != BTRFS_FS_TREE_OBJECTID)
+    {
+      SubvolumeRef *parent;
+
+      parent = g_hash_table_lookup (refs, &ref->parent_id);
+      if (! parent)
+        {
+          parent = lookup_subvolume_ref (fd, ref->parent_id, error);
+          if (! parent)
+            return NULL;
+          g_hash_table_insert (refs, &parent->id, parent);
+        }
+      parent_path = resolve_subvolume_path (fd, refs, parent, error);
+      if (! parent_path)
+        return NULL;
+    }
+
+  /* path of the directory containing the subvolume within its parent */
+  memset (&lookup, 0, sizeof (lookup));
+  lookup.treeid = ref->parent_id;
+  lookup.objectid = ref->dirid;
+  if (ioctl (fd, BTRFS_IOC_INO_LOOKUP, &lookup) < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error looking up the path of BTRFS subvolume %" G_GUINT64_FORMAT ": %m",
+                   ref->id);
+      return NULL;
+    }
+  lookup.name[BTRFS_INO_LOOKUP_PATH_MAX - 1] = '\0';
+
+  ref->path = g_strconcat (parent_path, *parent_path ? "/" : "", lookup.name, ref->name, NULL);
+  return ref->path;
+}
+
+/**
+ * btrfs_list_subvolumes_sync:
+ * @mount_point: A mount point of the BTRFS volume.
+ * @snapshots_only: Whether to list only snapshots.
+ * @parent_id: Only list the subvolumes with this parent or 0 for all.
+ * @start_id: Only list the subvolumes with this or a higher ID.
+ * @limit: The maximum number of subvolumes to list or 0 for no limit.
+ * @subvolumes_cnt: (out): Return location for the number of subvolumes.
+ * @error: Return location for error or %NULL.
+ *
+ * Lists the subvolumes of the BTRFS volume mounted at @mount_point by
+ * searching its root tree directly, without spawning btrfs-progs. The
+ * subvolumes are listed in the order of their IDs so the listing can be
+ * paged by passing the last returned ID + 1 as @start_id. Fails with
+ * %G_IO_ERROR_NOT_SUPPORTED if the kernel lacks the v2 tree search.
+ *
+ * This may block so it must not be called from the main thread.
+ *
+ * Returns: (transfer floating): An array of subvolumes formatted as
+ *          a(tts) or %NULL if @error is set.
+ */
+GVariant *
+btrfs_list_subvolumes_sync (const gchar  *mount_point,
+                            gboolean      snapshots_only,
+                            guint64       parent_id,
+                            guint64       start_id,
+                            guint         limit,
+                            gint         *subvolumes_cnt,
+                            GError      **error)
+{
+  struct btrfs_ioctl_search_args_v2 *args = NULL;
+  struct btrfs_ioctl_search_header sh;
+  GHashTable *refs = NULL;
+  GPtrArray *matches = NULL;
+  GVariantBuilder builder;
+  GVariant *ret = NULL;
+  guint64 root_id = 0;
+  gboolean root_is_snapshot = FALSE;
+  gboolean done = FALSE;
+  gint fd;
+  guint n;
+
+  fd = open (mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error opening %s: %m", mount_point);
+      return NULL;
+    }
+
+  refs = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                NULL, (GDestroyNotify) subvolume_ref_free);
+  matches = g_ptr_array_new ();
+
+  /* Every subvolume has a ROOT_ITEM (with a non-zero offset for snapshots)
+   * followed by a ROOT_BACKREF pointing to its parent in the root tree.
+   */
+  args = search_args_new (MAX (start_id, BTRFS_FIRST_FREE_OBJECTID), BTRFS_LAST_FREE_OBJECTID,
+                          BTRFS_ROOT_ITEM_KEY, BTRFS_ROOT_BACKREF_KEY);
+  while (! done)
+    {
+      gsize off = 0;
+      guint32 i;
+
+      args->key.nr_items = G_MAXUINT32;
+      if (! tree_search (fd, args, error))
+        goto out;
+      if (args->key.nr_items == 0)
+        break;
+
+      for (i = 0; i < args->key.nr_items; i++)
+        {
+          const guint8 *data;
+
+          memcpy (&sh, (const guint8 *) args->buf + off, sizeof (sh));
+          data = (const guint8 *) args->buf + off + sizeof (sh);
+          off += sizeof (sh) + sh.len;
+
+          if (sh.type == BTRFS_ROOT_ITEM_KEY)
+            {
+              root_id = sh.objectid;
+              root_is_snapshot = sh.offset != 0;
+            }
+          else if (sh.type == BTRFS_ROOT_BACKREF_KEY && sh.objectid == root_id)
+            {
+              SubvolumeRef *ref;
+
+              ref = subvolume_ref_new (sh.objectid, sh.offset, data, sh.len);
+              if (! ref)
+                continue;
+              g_hash_table_insert (refs, &ref->id, ref);
+
+              if ((parent_id == 0 || ref->parent_id == parent_id) &&
+                  (! snapshots_only || root_is_snapshot))
+                g_ptr_array_add (matches, ref);
+              if (limit > 0 && matches->len >= limit)
+                {
+                  done = TRUE;
+                  break;
+                }
+            }
+        }
+
+      if (! done)
+        done = ! search_args_advance (args, sh.objectid, sh.type, sh.offset);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (btrfs_subvolumes_fmt));
+  for (n = 0; n < matches->len; n++)
+    {
+      SubvolumeRef *ref = matches->pdata[n];
+      const gchar *path;
+
+      path = resolve_subvolume_path (fd, refs, ref, error);
+      if (! path)
+        {
+          g_variant_builder_clear (&builder);
+          goto out;
+        }
+      g_variant_builder_add (&builder, btrfs_subvolume_fmt, ref->id, ref->parent_id, path);
+    }
+  *subvolumes_cnt = matches->len;
+  ret = g_variant_builder_end (&builder);
+
+ out:
+  close (fd);
+  g_free (args);
+  g_ptr_array_free (matches, TRUE);
+  g_hash_table_destroy (refs);
+  return ret;
+}
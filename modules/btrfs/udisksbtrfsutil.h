@@ -20,15 +20,26 @@
 #ifndef __UDISKS_BTRFS_UTIL_H__
 #define __UDISKS_BTRFS_UTIL_H__
 
-#include <glib.h>
+#include <gio/gio.h>
 
 typedef struct BDBtrfsSubvolumeInfo BDBtrfsSubvolumeInfo;
 
 extern const gchar *btrfs_policy_action_id;
 
 GVariant           *btrfs_subvolumes_to_gvariant (BDBtrfsSubvolumeInfo **subvolumes_info,
+                                                  guint64                parent_id,
+                                                  guint64                start_id,
+                                                  guint                  limit,
                                                   gint                  *subvolumes_cnt);
 
 void                btrfs_free_subvolumes_info   (BDBtrfsSubvolumeInfo **subvolumes_info);
 
+GVariant           *btrfs_list_subvolumes_sync   (const gchar  *mount_point,
+                                                  gboolean      snapshots_only,
+                                                  guint64       parent_id,
+                                                  guint64       start_id,
+                                                  guint         limit,
+                                                  gint         *subvolumes_cnt,
+                                                  GError      **error);
+
 #endif /* __UDISKS_BTRFS_UTIL_H__ */
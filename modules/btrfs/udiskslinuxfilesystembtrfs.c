@@ -23,12 +23,15 @@
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxblockobject.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslogging.h>
+#include <src/udisksmodulemanager.h>
 #include <blockdev/btrfs.h>
 
 #include "udiskslinuxfilesystembtrfs.h"
+#include "udisksbtrfsstate.h"
 #include "udisks-btrfs-generated.h"
 #include "udisksbtrfsutil.h"
 
@@ -155,13 +158,13 @@ udisks_linux_filesystem_btrfs_class_init (UDisksLinuxFilesystemBTRFSClass *klass
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_filesystem_btrfs_init (UDisksLinuxFilesystemBTRFS *l_fs_btrfs)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (l_fs_btrfs),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 /**
@@ -210,12 +213,228 @@ udisks_linux_filesystem_btrfs_get_daemon (UDisksLinuxFilesystemBTRFS *l_fs_btrfs
   return daemon;
 }
 
+static UDisksBTRFSState *
+get_module_state (UDisksDaemon *daemon)
+{
+  UDisksModuleManager *manager = udisks_daemon_get_module_manager (daemon);
+
+  return (UDisksBTRFSState *) udisks_module_manager_get_module_state_pointer (manager, BTRFS_MODULE_NAME);
+}
+
+static void
+apply_filesystem_info (UDisksFilesystemBTRFS *fs_btrfs,
+                       BDBtrfsFilesystemInfo *btrfs_info)
+{
+  udisks_filesystem_btrfs_set_label (fs_btrfs, btrfs_info->label);
+  udisks_filesystem_btrfs_set_uuid (fs_btrfs, btrfs_info->uuid);
+  udisks_filesystem_btrfs_set_num_devices (fs_btrfs, btrfs_info->num_devices);
+  udisks_filesystem_btrfs_set_used (fs_btrfs, btrfs_info->used);
+}
+
+/* Reads the filesystem info of @object's device and updates @fs_btrfs
+ * from it, bypassing the shared info; may be called from any thread
+ */
+static void
+update_sync (UDisksFilesystemBTRFS  *fs_btrfs,
+             UDisksLinuxBlockObject *object)
+{
+  BDBtrfsFilesystemInfo *btrfs_info;
+  GError *error = NULL;
+  gchar *dev_file;
+
+  dev_file = udisks_linux_block_object_get_device_file (object);
+  if (! dev_file)
+    return;
+
+  btrfs_info = bd_btrfs_filesystem_info (dev_file, &error);
+  if (! btrfs_info)
+    {
+      udisks_critical ("Can't get BTRFS filesystem info for %s: %s", dev_file, error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      apply_filesystem_info (fs_btrfs, btrfs_info);
+      bd_btrfs_filesystem_info_free (btrfs_info);
+    }
+
+  g_free (dev_file);
+}
+
+typedef struct {
+  UDisksDaemon *daemon;
+  gchar *uuid;
+} RefreshData;
+
+static void
+refresh_data_free (RefreshData *data)
+{
+  g_free (data->uuid);
+  g_free (data);
+}
+
+static void schedule_refresh (UDisksDaemon          *daemon,
+                              UDisksBTRFSFilesystem *filesystem);
+
+static void
+refresh_func (GTask        *task,
+              gpointer      source_object,
+              gpointer      task_data,
+              GCancellable *cancellable)
+{
+  const gchar *dev_file = task_data;
+  BDBtrfsFilesystemInfo *btrfs_info;
+  GError *error = NULL;
+
+  btrfs_info = bd_btrfs_filesystem_info (dev_file, &error);
+  if (btrfs_info == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, btrfs_info, (GDestroyNotify) bd_btrfs_filesystem_info_free);
+}
+
+/* Called in the main thread once the info for a filesystem is read,
+ * publishes it on all the member devices
+ */
+static void
+refresh_done (GObject      *source_object,
+              GAsyncResult *result,
+              gpointer      user_data)
+{
+  UDisksDaemon *daemon = UDISKS_DAEMON (source_object);
+  gchar *uuid = user_data;
+  UDisksBTRFSFilesystem *filesystem;
+  BDBtrfsFilesystemInfo *btrfs_info;
+  GError *error = NULL;
+  GHashTableIter iter;
+  gpointer key;
+
+  btrfs_info = g_task_propagate_pointer (G_TASK (result), &error);
+
+  /* the filesystem may be gone in the meantime */
+  filesystem = udisks_btrfs_state_get_filesystem (get_module_state (daemon), uuid);
+  if (filesystem == NULL)
+    {
+      if (btrfs_info)
+        bd_btrfs_filesystem_info_free (btrfs_info);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  filesystem->refreshing = FALSE;
+
+  if (btrfs_info == NULL)
+    {
+      udisks_critical ("Can't get BTRFS filesystem info for %s: %s", filesystem->device_file, error->message);
+      g_clear_error (&error);
+    }
+  else
+    {
+      if (filesystem->info)
+        bd_btrfs_filesystem_info_free (filesystem->info);
+      filesystem->info = btrfs_info;
+
+      g_hash_table_iter_init (&iter, filesystem->members);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          UDisksObject *object;
+          UDisksBlock *block;
+          GDBusInterface *iface = NULL;
+
+          object = udisks_daemon_find_object (daemon, key);
+          block = object ? udisks_object_peek_block (object) : NULL;
+          if (block && g_strcmp0 (udisks_block_get_id_uuid (block), uuid) == 0)
+            iface = g_dbus_object_get_interface (G_DBUS_OBJECT (object), "org.freedesktop.UDisks2.Filesystem.BTRFS");
+
+          if (iface)
+            apply_filesystem_info (UDISKS_FILESYSTEM_BTRFS (iface), btrfs_info);
+          else
+            /* not a member (or not existing) anymore */
+            g_hash_table_iter_remove (&iter);
+
+          g_clear_object (&iface);
+          g_clear_object (&object);
+        }
+
+      if (g_hash_table_size (filesystem->members) == 0)
+        {
+          udisks_btrfs_state_remove_filesystem (get_module_state (daemon), uuid);
+          goto out;
+        }
+    }
+
+  if (filesystem->refresh_again)
+    {
+      filesystem->refresh_again = FALSE;
+      schedule_refresh (daemon, filesystem);
+    }
+
+ out:
+  g_free (uuid);
+}
+
+static gboolean
+refresh_timeout (gpointer user_data)
+{
+  RefreshData *data = user_data;
+  UDisksBTRFSFilesystem *filesystem;
+  GTask *task;
+
+  filesystem = udisks_btrfs_state_get_filesystem (get_module_state (data->daemon), data->uuid);
+  g_assert (filesystem != NULL);
+
+  filesystem->refresh_timeout_id = 0;
+  filesystem->refreshing = TRUE;
+
+  /* the callback (refresh_done) is called in the default main loop (context) */
+  task = g_task_new (data->daemon, NULL /* cancellable */, refresh_done, g_strdup (data->uuid));
+  g_task_set_task_data (task, g_strdup (filesystem->device_file), g_free);
+
+  /* holds a reference to 'task' until it is finished */
+  g_task_run_in_thread (task, refresh_func);
+  g_object_unref (task);
+
+  return FALSE;
+}
+
+/* Uevents usually come for all the member devices at once, refresh
+ * the filesystem info only once for all of them
+ */
+#define REFRESH_DELAY_MSEC 100
+
+static void
+schedule_refresh (UDisksDaemon          *daemon,
+                  UDisksBTRFSFilesystem *filesystem)
+{
+  RefreshData *data;
+
+  if (filesystem->refreshing)
+    {
+      filesystem->refresh_again = TRUE;
+      return;
+    }
+
+  if (filesystem->refresh_timeout_id != 0)
+    return;
+
+  data = g_new0 (RefreshData, 1);
+  data->daemon = daemon;
+  data->uuid = g_strdup (filesystem->uuid);
+  filesystem->refresh_timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                                       REFRESH_DELAY_MSEC,
+                                                       refresh_timeout,
+                                                       data,
+                                                       (GDestroyNotify) refresh_data_free);
+}
+
 /**
  * udisks_linux_filesystem_btrfs_update:
  * @l_fs_btrfs: A #UDisksLinuxFilesystemBTRFS.
  * @object: The enclosing #UDisksLlinuxDriveObject instance.
  *
- * Updates the interface.
+ * Updates the interface. The filesystem info is shared by all the
+ * member devices of a filesystem and refreshed in a worker thread, the
+ * interface is updated once the new info is available.
  *
  * Returns: %TRUE if the configuration has changed, %FALSE otherwise.
  */
@@ -224,44 +443,47 @@ udisks_linux_filesystem_btrfs_update (UDisksLinuxFilesystemBTRFS *l_fs_btrfs,
                                       UDisksLinuxBlockObject     *object)
 {
   UDisksFilesystemBTRFS *fs_btrfs = UDISKS_FILESYSTEM_BTRFS (l_fs_btrfs);
-  BDBtrfsFilesystemInfo *btrfs_info = NULL;
-  GError *error = NULL;
+  UDisksDaemon *daemon;
+  UDisksLinuxDevice *device;
+  UDisksBTRFSFilesystem *filesystem;
+  const gchar *uuid;
   gchar *dev_file = NULL;
-  gboolean rval = FALSE;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_FILESYSTEM_BTRFS (fs_btrfs), FALSE);
   g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object), FALSE);
 
   dev_file = udisks_linux_block_object_get_device_file (object);
   if (! dev_file)
+    goto out;
+
+  device = udisks_linux_block_object_get_device (object);
+  uuid = g_udev_device_get_property (device->udev_device, "ID_FS_UUID");
+  if (uuid == NULL || *uuid == '\0')
     {
-      rval = FALSE;
+      udisks_critical ("Can't get BTRFS filesystem UUID for %s", dev_file);
+      g_object_unref (device);
       goto out;
     }
 
-  btrfs_info = bd_btrfs_filesystem_info (dev_file, &error);
+  daemon = udisks_linux_block_object_get_daemon (object);
+  filesystem = udisks_btrfs_state_add_filesystem (get_module_state (daemon), uuid);
+  g_object_unref (device);
 
-  if (! btrfs_info)
-    {
-      udisks_critical ("Can't get BTRFS filesystem info for %s", dev_file);
-      rval = FALSE;
-      goto out;
-    }
+  g_hash_table_add (filesystem->members, g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))));
+  g_free (filesystem->device_file);
+  filesystem->device_file = dev_file;
+  dev_file = NULL;
 
-  /* Update the interface */
-  udisks_filesystem_btrfs_set_label (fs_btrfs, btrfs_info->label);
-  udisks_filesystem_btrfs_set_uuid (fs_btrfs, btrfs_info->uuid);
-  udisks_filesystem_btrfs_set_num_devices (fs_btrfs, btrfs_info->num_devices);
-  udisks_filesystem_btrfs_set_used (fs_btrfs, btrfs_info->used);
+  /* publish what is known already, the refresh updates it later */
+  if (filesystem->info)
+    apply_filesystem_info (fs_btrfs, filesystem->info);
+
+  schedule_refresh (daemon, filesystem);
 
 out:
-  if (btrfs_info)
-    bd_btrfs_filesystem_info_free (btrfs_info);
-  if (error)
-    g_clear_error (&error);
   g_free (dev_file);
 
-  return rval;
+  return FALSE;
 }
 
 /**
@@ -496,8 +718,11 @@ btrfs_device_perform_action (UDisksFilesystemBTRFS *fs_btrfs,
       goto out;
     }
 
-  /* Update the interface. */
-  udisks_linux_filesystem_btrfs_update (l_fs_btrfs, object);
+  /* Update the interface. This runs in a handler thread so the info is
+   * read right away, the info shared with the other member devices is
+   * refreshed on the uevents caused by the change.
+   */
+  update_sync (fs_btrfs, object);
 
   /* Complete DBus call. */
   udisks_filesystem_btrfs_complete_add_device (fs_btrfs, invocation);
@@ -569,11 +794,13 @@ handle_remove_subvolume (UDisksFilesystemBTRFS *fs_btrfs,
                                          "the subvolume for the given BTRFS volume");
 }
 
-static gboolean
-handle_get_subvolumes (UDisksFilesystemBTRFS *fs_btrfs,
-                       GDBusMethodInvocation *invocation,
-                       gboolean               arg_snapshots_only,
-                       GVariant              *arg_options)
+/* returns a floating reference or %NULL if an error was returned to @invocation */
+static GVariant *
+get_subvolumes (UDisksFilesystemBTRFS *fs_btrfs,
+                GDBusMethodInvocation *invocation,
+                gboolean               arg_snapshots_only,
+                GVariant              *arg_options,
+                gint                  *out_subvolumes_cnt)
 {
   UDisksLinuxFilesystemBTRFS *l_fs_btrfs = UDISKS_LINUX_FILESYSTEM_BTRFS (fs_btrfs);
   UDisksLinuxBlockObject *object = NULL;
@@ -582,6 +809,9 @@ handle_get_subvolumes (UDisksFilesystemBTRFS *fs_btrfs,
   GError *error = NULL;
   gchar *mount_point = NULL;
   gint subvolumes_cnt = 0;
+  guint64 parent_id = 0;
+  guint64 start_id = 0;
+  guint limit = 0;
 
   object = udisks_daemon_util_dup_object (fs_btrfs, &error);
   if (! object)
@@ -607,24 +837,46 @@ handle_get_subvolumes (UDisksFilesystemBTRFS *fs_btrfs,
       goto out;
     }
 
-  /* Get subvolume infos. */
-  subvolumes_info = bd_btrfs_list_subvolumes (mount_point,
-                                              arg_snapshots_only,
-                                              &error);
+  g_variant_lookup (arg_options, "parent_id", "t", &parent_id);
+  g_variant_lookup (arg_options, "start_id", "t", &start_id);
+  g_variant_lookup (arg_options, "limit", "u", &limit);
+
+  /* Search the root tree directly, fall back to btrfs-progs on old kernels. */
+  subvolumes = btrfs_list_subvolumes_sync (mount_point,
+                                           arg_snapshots_only,
+                                           parent_id,
+                                           start_id,
+                                           limit,
+                                           &subvolumes_cnt,
+                                           &error);
+  if (! subvolumes && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+    {
+      g_clear_error (&error);
 
-  if (! subvolumes_info && error)
+      /* Get subvolume infos. */
+      subvolumes_info = bd_btrfs_list_subvolumes (mount_point,
+                                                  arg_snapshots_only,
+                                                  &error);
+
+      if (! subvolumes_info && error)
+        {
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+
+      subvolumes = btrfs_subvolumes_to_gvariant (subvolumes_info,
+                                                 parent_id,
+                                                 start_id,
+                                                 limit,
+                                                 &subvolumes_cnt);
+    }
+  else if (! subvolumes)
     {
       g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
 
-  subvolumes = btrfs_subvolumes_to_gvariant (subvolumes_info, &subvolumes_cnt);
-
-  /* Complete DBus call. */
-  udisks_filesystem_btrfs_complete_get_subvolumes (fs_btrfs,
-                                                   invocation,
-                                                   subvolumes,
-                                                   subvolumes_cnt);
+  *out_subvolumes_cnt = subvolumes_cnt;
 
 out:
   /* Release the resources */
@@ -632,6 +884,64 @@ out:
   btrfs_free_subvolumes_info (subvolumes_info);
   g_free (mount_point);
 
+  return subvolumes;
+}
+
+static gboolean
+handle_get_subvolumes (UDisksFilesystemBTRFS *fs_btrfs,
+                       GDBusMethodInvocation *invocation,
+                       gboolean               arg_snapshots_only,
+                       GVariant              *arg_options)
+{
+  GVariant *subvolumes;
+  gint subvolumes_cnt = 0;
+
+  subvolumes = get_subvolumes (fs_btrfs, invocation, arg_snapshots_only, arg_options, &subvolumes_cnt);
+  if (subvolumes != NULL)
+    udisks_filesystem_btrfs_complete_get_subvolumes (fs_btrfs,
+                                                     invocation,
+                                                     subvolumes,
+                                                     subvolumes_cnt);
+
+  /* Indicate that we handled the method invocation */
+  return TRUE;
+}
+
+static gboolean
+handle_get_subvolumes_fd (UDisksFilesystemBTRFS *fs_btrfs,
+                          GDBusMethodInvocation *invocation,
+                          GUnixFDList           *fd_list,
+                          gboolean               arg_snapshots_only,
+                          GVariant              *arg_options)
+{
+  GUnixFDList *out_fd_list = NULL;
+  GVariant *subvolumes;
+  GError *error = NULL;
+  gint subvolumes_cnt = 0;
+
+  subvolumes = get_subvolumes (fs_btrfs, invocation, arg_snapshots_only, arg_options, &subvolumes_cnt);
+  if (subvolumes == NULL)
+    goto out;
+  g_variant_ref_sink (subvolumes);
+
+  out_fd_list = udisks_daemon_util_variant_to_fd_list (subvolumes, &error);
+  if (out_fd_list == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_filesystem_btrfs_complete_get_subvolumes_fd (fs_btrfs,
+                                                      invocation,
+                                                      out_fd_list,
+                                                      g_variant_new_handle (0),
+                                                      subvolumes_cnt);
+
+out:
+  g_clear_object (&out_fd_list);
+  if (subvolumes != NULL)
+    g_variant_unref (subvolumes);
+
   /* Indicate that we handled the method invocation */
   return TRUE;
 }
@@ -815,6 +1125,7 @@ udisks_linux_filesystem_btrfs_iface_init (UDisksFilesystemBTRFSIface *iface)
   iface->handle_create_subvolume = handle_create_subvolume;
   iface->handle_remove_subvolume = handle_remove_subvolume;
   iface->handle_get_subvolumes = handle_get_subvolumes;
+  iface->handle_get_subvolumes_fd = handle_get_subvolumes_fd;
   iface->handle_create_snapshot = handle_create_snapshot;
   iface->handle_repair = handle_repair;
   iface->handle_resize = handle_resize;
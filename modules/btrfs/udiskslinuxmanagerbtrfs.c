@@ -24,6 +24,7 @@
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslogging.h>
 
 #include "udiskslinuxmanagerbtrfs.h"
@@ -147,13 +148,13 @@ udisks_linux_manager_btrfs_class_init (UDisksLinuxManagerBTRFSClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_manager_btrfs_init (UDisksLinuxManagerBTRFS *self)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (self),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 /**
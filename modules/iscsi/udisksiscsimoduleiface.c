@@ -132,6 +132,38 @@ udisks_module_get_object_new_funcs (void)
   return funcs;
 }
 
+UDisksModuleObjectNewFuncMatch **
+udisks_module_get_object_new_func_matches (void)
+{
+  UDisksModuleObjectNewFuncMatch **matches = NULL;
+
+  matches = g_new0 (UDisksModuleObjectNewFuncMatch *, 2);
+#ifdef HAVE_LIBISCSI_GET_SESSION_INFOS
+  /* sessions are only ever created for devices below an iSCSI session */
+  matches[0] = g_new0 (UDisksModuleObjectNewFuncMatch, 1);
+  matches[0]->new_func = iscsi_session_object_new;
+  matches[0]->sysfs_path_pattern = "*/session*";
+#endif /* HAVE_LIBISCSI_GET_SESSION_INFOS */
+
+  return matches;
+}
+
+UDisksModuleObjectHousekeepingInfo **
+udisks_module_get_object_housekeeping_infos (void)
+{
+  UDisksModuleObjectHousekeepingInfo **infos = NULL;
+
+  infos = g_new0 (UDisksModuleObjectHousekeepingInfo *, 2);
+#ifdef HAVE_LIBISCSI_GET_SESSION_INFOS
+  /* session objects have nothing to housekeep */
+  infos[0] = g_new0 (UDisksModuleObjectHousekeepingInfo, 1);
+  infos[0]->new_func = iscsi_session_object_new;
+  infos[0]->interval = 0;
+#endif /* HAVE_LIBISCSI_GET_SESSION_INFOS */
+
+  return infos;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static GDBusInterfaceSkeleton *
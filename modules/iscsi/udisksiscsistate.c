@@ -23,14 +23,44 @@
 
 #include "udisksiscsistate.h"
 
+/* How long discovery results are served from the cache, in seconds. */
+#define ISCSI_DISCOVERY_CACHE_TTL 300
+
 struct _UDisksISCSIState
 {
   UDisksDaemon *daemon;
 
   GMutex libiscsi_mutex;
   struct libiscsi_context *iscsi_ctx;
+
+  /* protects discovery_cache and the entries in it */
+  GMutex discovery_mutex;
+  /* signalled when a pending discovery finishes */
+  GCond discovery_cond;
+  /* maps from the cache key to ISCSIDiscoveryEntry */
+  GHashTable *discovery_cache;
 };
 
+typedef struct
+{
+  GVariant *nodes;
+  gint nodes_cnt;
+  gint64 expire_usec;
+
+  /* the discovery is running; the other callers wait for it */
+  gboolean pending;
+  /* invalidated while pending, don't store the results */
+  gboolean stale;
+} ISCSIDiscoveryEntry;
+
+static void
+iscsi_discovery_entry_free (ISCSIDiscoveryEntry *entry)
+{
+  if (entry->nodes != NULL)
+    g_variant_unref (entry->nodes);
+  g_free (entry);
+}
+
 /**
  * udisks_iscsi_state_new:
  * @daemon: A #UDisksDaemon instance.
@@ -55,6 +85,13 @@ udisks_iscsi_state_new (UDisksDaemon *daemon)
 
       g_mutex_init (&state->libiscsi_mutex);
       state->iscsi_ctx = libiscsi_init ();
+
+      g_mutex_init (&state->discovery_mutex);
+      g_cond_init (&state->discovery_cond);
+      state->discovery_cache = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      g_free,
+                                                      (GDestroyNotify) iscsi_discovery_entry_free);
     }
 
   return state;
@@ -69,6 +106,10 @@ udisks_iscsi_state_free (UDisksISCSIState *state)
   if (state->iscsi_ctx)
     libiscsi_cleanup (state->iscsi_ctx);
 
+  g_hash_table_unref (state->discovery_cache);
+  g_cond_clear (&state->discovery_cond);
+  g_mutex_clear (&state->discovery_mutex);
+
   g_free (state);
 }
 
@@ -90,3 +131,156 @@ udisks_iscsi_state_get_libiscsi_context (UDisksISCSIState *state)
   g_return_val_if_fail (state, NULL);
   return state->iscsi_ctx;
 }
+
+/**
+ * udisks_iscsi_state_begin_discovery:
+ * @state: A #UDisksISCSIState.
+ * @key: The cache key of the discovery.
+ * @refresh: Whether to ignore cached results.
+ * @nodes: Return location for the cached nodes, free with g_variant_unref().
+ * @nodes_cnt: Return location for the number of cached nodes.
+ *
+ * Looks up the results of the discovery identified by @key. If another
+ * thread is running the same discovery, waits for it to finish first
+ * so that the portal is only queried once.
+ *
+ * If there are no valid cached results, the discovery is marked as
+ * pending and the caller has to perform it and then call
+ * udisks_iscsi_state_end_discovery().
+ *
+ * Returns: %TRUE if @nodes and @nodes_cnt were set from the cache,
+ * %FALSE if the caller has to perform the discovery.
+ */
+gboolean
+udisks_iscsi_state_begin_discovery (UDisksISCSIState  *state,
+                                    const gchar       *key,
+                                    gboolean           refresh,
+                                    GVariant         **nodes,
+                                    gint              *nodes_cnt)
+{
+  ISCSIDiscoveryEntry *entry;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (state, FALSE);
+  g_return_val_if_fail (key, FALSE);
+
+  g_mutex_lock (&state->discovery_mutex);
+
+  while ((entry = g_hash_table_lookup (state->discovery_cache, key)) != NULL && entry->pending)
+    g_cond_wait (&state->discovery_cond, &state->discovery_mutex);
+
+  if (entry != NULL && !refresh && g_get_monotonic_time () < entry->expire_usec)
+    {
+      *nodes = g_variant_ref (entry->nodes);
+      *nodes_cnt = entry->nodes_cnt;
+      ret = TRUE;
+      goto out;
+    }
+
+  entry = g_new0 (ISCSIDiscoveryEntry, 1);
+  entry->pending = TRUE;
+  g_hash_table_replace (state->discovery_cache, g_strdup (key), entry);
+
+ out:
+  g_mutex_unlock (&state->discovery_mutex);
+  return ret;
+}
+
+/**
+ * udisks_iscsi_state_end_discovery:
+ * @state: A #UDisksISCSIState.
+ * @key: The cache key passed to udisks_iscsi_state_begin_discovery().
+ * @nodes: (allow-none): The discovered nodes or %NULL if the discovery failed.
+ * @nodes_cnt: The number of discovered nodes.
+ *
+ * Finishes the pending discovery identified by @key and caches @nodes
+ * for ISCSI_DISCOVERY_CACHE_TTL seconds. Failed discoveries are not
+ * cached.
+ */
+void
+udisks_iscsi_state_end_discovery (UDisksISCSIState *state,
+                                  const gchar      *key,
+                                  GVariant         *nodes,
+                                  gint              nodes_cnt)
+{
+  ISCSIDiscoveryEntry *entry;
+
+  g_return_if_fail (state);
+  g_return_if_fail (key);
+
+  g_mutex_lock (&state->discovery_mutex);
+
+  entry = g_hash_table_lookup (state->discovery_cache, key);
+  if (entry != NULL)
+    {
+      if (nodes == NULL || entry->stale)
+        {
+          g_hash_table_remove (state->discovery_cache, key);
+        }
+      else
+        {
+          entry->nodes = g_variant_ref (nodes);
+          entry->nodes_cnt = nodes_cnt;
+          entry->expire_usec = g_get_monotonic_time () + ISCSI_DISCOVERY_CACHE_TTL * G_USEC_PER_SEC;
+          entry->pending = FALSE;
+        }
+    }
+
+  g_cond_broadcast (&state->discovery_cond);
+  g_mutex_unlock (&state->discovery_mutex);
+}
+
+/* Whether @target_name is among the nodes discovered by @entry */
+static gboolean
+iscsi_discovery_entry_has_target (ISCSIDiscoveryEntry *entry,
+                                  const gchar         *target_name)
+{
+  GVariantIter iter;
+  const gchar *name;
+
+  if (entry->nodes == NULL)
+    return FALSE;
+
+  g_variant_iter_init (&iter, entry->nodes);
+  while (g_variant_iter_next (&iter, "(&sisis)", &name, NULL, NULL, NULL, NULL))
+    {
+      if (g_strcmp0 (name, target_name) == 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * udisks_iscsi_state_invalidate_discovery:
+ * @state: A #UDisksISCSIState.
+ * @target_name: (allow-none): A target name or %NULL for all targets.
+ *
+ * Drops the cached discovery results that contain @target_name, e.g.
+ * because a session to it went away, or all cached results if
+ * @target_name is %NULL. The nodes are compared instead of the portal
+ * as the sessions know the portal only by its IP address.
+ */
+void
+udisks_iscsi_state_invalidate_discovery (UDisksISCSIState *state,
+                                         const gchar      *target_name)
+{
+  GHashTableIter iter;
+  ISCSIDiscoveryEntry *entry;
+
+  g_return_if_fail (state);
+
+  g_mutex_lock (&state->discovery_mutex);
+
+  g_hash_table_iter_init (&iter, state->discovery_cache);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      /* the running discovery may have been answered before the change */
+      if (entry->pending)
+        entry->stale = TRUE;
+      else if (target_name == NULL || iscsi_discovery_entry_has_target (entry, target_name))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  g_mutex_unlock (&state->discovery_mutex);
+}
@@ -33,6 +33,18 @@ struct libiscsi_context *udisks_iscsi_state_get_libiscsi_context    (UDisksISCSI
 void                     udisks_iscsi_state_lock_libiscsi_context   (UDisksISCSIState *state);
 void                     udisks_iscsi_state_unlock_libiscsi_context (UDisksISCSIState *state);
 
+gboolean                 udisks_iscsi_state_begin_discovery         (UDisksISCSIState  *state,
+                                                                     const gchar       *key,
+                                                                     gboolean           refresh,
+                                                                     GVariant         **nodes,
+                                                                     gint              *nodes_cnt);
+void                     udisks_iscsi_state_end_discovery           (UDisksISCSIState  *state,
+                                                                     const gchar       *key,
+                                                                     GVariant          *nodes,
+                                                                     gint               nodes_cnt);
+void                     udisks_iscsi_state_invalidate_discovery    (UDisksISCSIState  *state,
+                                                                     const gchar       *target_name);
+
 G_END_DECLS
 
 #endif /* __UDISKS_ISCSI_STATE_H__ */
@@ -107,6 +107,9 @@ enum {
 const gchar *iscsi_nodes_fmt = "a(sisis)";
 const gchar *iscsi_node_fmt = "(sisis)";
 
+/* Maximum number of nodes logged in or out concurrently by a batch. */
+#define ISCSI_BATCH_MAX_THREADS 16
+
 static struct libiscsi_context *
 iscsi_get_libiscsi_context (UDisksDaemon *daemon)
 {
@@ -174,19 +177,15 @@ iscsi_make_node (struct libiscsi_node *node,
 }
 
 static gint
-iscsi_perform_login_action (UDisksDaemon             *daemon,
+iscsi_perform_login_action (struct libiscsi_context    *ctx,
                             libiscsi_login_action       action,
                             struct libiscsi_node       *node,
                             struct libiscsi_auth_info  *auth_info,
                             gchar                     **errorstr)
 {
-  struct libiscsi_context *ctx;
   gint err;
 
-  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), 1);
-
-  /* Get a libiscsi context. */
-  ctx = iscsi_get_libiscsi_context (daemon);
+  g_return_val_if_fail (ctx, 1);
 
   if (action == ACTION_LOGIN &&
       auth_info && auth_info->method == libiscsi_auth_chap)
@@ -281,17 +280,16 @@ iscsi_params_pop_chap_data (GVariant      *params,
   return g_variant_dict_end (&dict);
 }
 
-gint
-iscsi_login (UDisksDaemon  *daemon,
-             const gchar   *name,
-             const gint     tpgt,
-             const gchar   *address,
-             const gint     port,
-             const gchar   *iface,
-             GVariant      *params,
-             gchar        **errorstr)
+static gint
+iscsi_node_login (struct libiscsi_context  *ctx,
+                  const gchar              *name,
+                  const gint                tpgt,
+                  const gchar              *address,
+                  const gint                port,
+                  const gchar              *iface,
+                  GVariant                 *params,
+                  gchar                   **errorstr)
 {
-  struct libiscsi_context *ctx;
   struct libiscsi_auth_info auth_info = {0,};
   struct libiscsi_node node = {0,};
   GVariant *params_without_chap;
@@ -301,8 +299,6 @@ iscsi_login (UDisksDaemon  *daemon,
   const gchar *reverse_password = NULL;
   gint err;
 
-  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), 1);
-
   /* Optional data for CHAP authentication. We pop these parameters from the
    * dictionary; it then contains only iSCSI node parameters. */
   params_without_chap = iscsi_params_pop_chap_data (params,
@@ -321,11 +317,8 @@ iscsi_login (UDisksDaemon  *daemon,
   /* Create iscsi node. */
   iscsi_make_node (&node, name, tpgt, address, port, iface);
 
-  /* Get iscsi context. */
-  ctx = iscsi_get_libiscsi_context (daemon);
-
   /* Login */
-  err = iscsi_perform_login_action (daemon,
+  err = iscsi_perform_login_action (ctx,
                                     ACTION_LOGIN,
                                     &node,
                                     &auth_info,
@@ -342,30 +335,24 @@ iscsi_login (UDisksDaemon  *daemon,
   return err;
 }
 
-gint
-iscsi_logout (UDisksDaemon  *daemon,
-              const gchar   *name,
-              const gint     tpgt,
-              const gchar   *address,
-              const gint     port,
-              const gchar   *iface,
-              GVariant      *params,
-              gchar        **errorstr)
+static gint
+iscsi_node_logout (struct libiscsi_context  *ctx,
+                   const gchar              *name,
+                   const gint                tpgt,
+                   const gchar              *address,
+                   const gint                port,
+                   const gchar              *iface,
+                   GVariant                 *params,
+                   gchar                   **errorstr)
 {
-  struct libiscsi_context *ctx;
   struct libiscsi_node node = {0,};
   gint err;
 
-  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), 1);
-
   /* Create iscsi node. */
   iscsi_make_node (&node, name, tpgt, address, port, iface);
 
-  /* Get iscsi context. */
-  ctx = iscsi_get_libiscsi_context (daemon);
-
   /* Logout */
-  err = iscsi_perform_login_action (daemon,
+  err = iscsi_perform_login_action (ctx,
                                     ACTION_LOGOUT,
                                     &node,
                                     NULL,
@@ -381,6 +368,181 @@ iscsi_logout (UDisksDaemon  *daemon,
   return err;
 }
 
+gint
+iscsi_login (UDisksDaemon  *daemon,
+             const gchar   *name,
+             const gint     tpgt,
+             const gchar   *address,
+             const gint     port,
+             const gchar   *iface,
+             GVariant      *params,
+             gchar        **errorstr)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), 1);
+
+  return iscsi_node_login (iscsi_get_libiscsi_context (daemon),
+                           name, tpgt, address, port, iface,
+                           params, errorstr);
+}
+
+gint
+iscsi_logout (UDisksDaemon  *daemon,
+              const gchar   *name,
+              const gint     tpgt,
+              const gchar   *address,
+              const gint     port,
+              const gchar   *iface,
+              GVariant      *params,
+              gchar        **errorstr)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), 1);
+
+  return iscsi_node_logout (iscsi_get_libiscsi_context (daemon),
+                            name, tpgt, address, port, iface,
+                            params, errorstr);
+}
+
+typedef struct
+{
+  libiscsi_login_action action;
+  gchar *name;
+  gint tpgt;
+  gchar *address;
+  gint port;
+  gchar *iface;
+  GVariant *params;
+  gint err;
+  gchar *errorstr;
+} ISCSIBatchItem;
+
+static void
+iscsi_batch_item_free (ISCSIBatchItem *item)
+{
+  g_free (item->name);
+  g_free (item->address);
+  g_free (item->iface);
+  g_variant_unref (item->params);
+  g_free (item->errorstr);
+  g_free (item);
+}
+
+static void
+iscsi_batch_item_func (gpointer data,
+                       gpointer user_data)
+{
+  ISCSIBatchItem *item = data;
+  struct libiscsi_context *ctx;
+
+  /* A libiscsi context can't be shared between threads, every node gets
+   * its own one. */
+  ctx = libiscsi_init ();
+  if (ctx == NULL)
+    {
+      item->err = ISCSI_ERR_NOMEM;
+      item->errorstr = g_strdup ("Failed to initialize libiscsi");
+      return;
+    }
+
+  if (item->action == ACTION_LOGIN)
+    item->err = iscsi_node_login (ctx, item->name, item->tpgt, item->address,
+                                  item->port, item->iface, item->params,
+                                  &item->errorstr);
+  else
+    item->err = iscsi_node_logout (ctx, item->name, item->tpgt, item->address,
+                                   item->port, item->iface, item->params,
+                                   &item->errorstr);
+
+  libiscsi_cleanup (ctx);
+}
+
+/**
+ * iscsi_perform_batch:
+ * @action: Whether to login or logout.
+ * @nodes: A #GVariant array of nodes in the discovery results format.
+ * @params: Options applied to every node.
+ * @errorstr: An error string pointer; may be NULL. Free with g_free().
+ *
+ * Logs in to or out of all the @nodes concurrently, independently of the
+ * shared libiscsi context.
+ *
+ * Returns: 0 if all the nodes succeeded, otherwise the error of the first
+ * failed node. @errorstr then lists the errors of all failed nodes.
+ */
+gint
+iscsi_perform_batch (libiscsi_login_action   action,
+                     GVariant               *nodes,
+                     GVariant               *params,
+                     gchar                 **errorstr)
+{
+  GThreadPool *pool;
+  GPtrArray *items;
+  GString *errors = NULL;
+  GVariantIter iter;
+  ISCSIBatchItem *item;
+  const gchar *name;
+  const gchar *address;
+  const gchar *iface;
+  gint tpgt;
+  gint port;
+  gint err = 0;
+  guint i;
+
+  g_return_val_if_fail (nodes, ISCSI_ERR_INVAL);
+  g_return_val_if_fail (params, ISCSI_ERR_INVAL);
+
+  items = g_ptr_array_new_with_free_func ((GDestroyNotify) iscsi_batch_item_free);
+  pool = g_thread_pool_new (iscsi_batch_item_func, NULL,
+                            ISCSI_BATCH_MAX_THREADS, FALSE, NULL);
+
+  g_variant_iter_init (&iter, nodes);
+  while (g_variant_iter_next (&iter, "(&si&si&s)", &name, &tpgt, &address, &port, &iface))
+    {
+      item = g_new0 (ISCSIBatchItem, 1);
+      item->action = action;
+      item->name = g_strdup (name);
+      item->tpgt = tpgt;
+      item->address = g_strdup (address);
+      item->port = port;
+      item->iface = g_strdup (iface);
+      item->params = g_variant_ref (params);
+      g_ptr_array_add (items, item);
+
+      g_thread_pool_push (pool, item, NULL);
+    }
+
+  /* Wait for all the nodes to be processed. */
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  for (i = 0; i < items->len; i++)
+    {
+      item = g_ptr_array_index (items, i);
+      if (item->err == 0)
+        continue;
+
+      if (err == 0)
+        {
+          err = item->err;
+          errors = g_string_new (NULL);
+        }
+      else
+        g_string_append (errors, "; ");
+      g_string_append_printf (errors, "%s: %s", item->name,
+                              item->errorstr ? item->errorstr : "unknown error");
+    }
+
+  if (errors != NULL)
+    {
+      if (errorstr)
+        *errorstr = g_string_free (errors, FALSE);
+      else
+        g_string_free (errors, TRUE);
+    }
+
+  g_ptr_array_unref (items);
+
+  return err;
+}
+
 gint
 iscsi_discover_send_targets (UDisksDaemon   *daemon,
                              const gchar    *address,
@@ -392,7 +554,7 @@ iscsi_discover_send_targets (UDisksDaemon   *daemon,
 {
   struct libiscsi_context *ctx;
   struct libiscsi_auth_info auth_info = {0,};
-  struct libiscsi_node *found_nodes;
+  struct libiscsi_node *found_nodes = NULL;
   const gchar *username = NULL;
   const gchar *password = NULL;
   const gchar *reverse_username = NULL;
@@ -401,7 +563,15 @@ iscsi_discover_send_targets (UDisksDaemon   *daemon,
 
   g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), 1);
 
-  ctx = iscsi_get_libiscsi_context (daemon);
+  /* Like the batches, every discovery gets its own libiscsi context so
+   * that discoveries of different portals run concurrently. */
+  ctx = libiscsi_init ();
+  if (ctx == NULL)
+    {
+      if (errorstr)
+        *errorstr = g_strdup ("Failed to initialize libiscsi");
+      return ISCSI_ERR_NOMEM;
+    }
 
   /* Optional data for CHAP authentication. */
   iscsi_params_get_chap_data (params,
@@ -432,6 +602,7 @@ iscsi_discover_send_targets (UDisksDaemon   *daemon,
 
   /* Release the resources */
   iscsi_libiscsi_nodes_free (found_nodes);
+  libiscsi_cleanup (ctx);
 
   return err;
 }
@@ -560,3 +731,64 @@ wait_for_iscsi_session_object (UDisksDaemon *daemon,
   g_list_free_full (objects, g_object_unref);
   return ret;
 }
+
+/* Returns the object for the last of the iqns in @user_data if @wait_func
+ * found objects for all of them (@all) or for any of them (!@all).
+ */
+static UDisksObject *
+wait_for_iscsi_objects_multi (UDisksDaemon *daemon,
+                              gpointer      user_data,
+                              UDisksObject *(*wait_func) (UDisksDaemon *, gpointer),
+                              gboolean      all)
+{
+  const gchar *const *device_iqns = user_data;
+  UDisksObject *ret = NULL;
+  UDisksObject *object;
+
+  for (guint n = 0; device_iqns[n] != NULL; n++)
+    {
+      object = wait_func (daemon, (gpointer) device_iqns[n]);
+      if (object == NULL && all)
+        {
+          g_clear_object (&ret);
+          break;
+        }
+      if (object != NULL)
+        {
+          g_clear_object (&ret);
+          ret = object;
+          if (! all)
+            break;
+        }
+    }
+
+  return ret;
+}
+
+UDisksObject *
+wait_for_iscsi_objects (UDisksDaemon *daemon,
+                        gpointer      user_data)
+{
+  return wait_for_iscsi_objects_multi (daemon, user_data, wait_for_iscsi_object, TRUE);
+}
+
+UDisksObject *
+wait_for_any_iscsi_object (UDisksDaemon *daemon,
+                           gpointer      user_data)
+{
+  return wait_for_iscsi_objects_multi (daemon, user_data, wait_for_iscsi_object, FALSE);
+}
+
+UDisksObject *
+wait_for_iscsi_session_objects (UDisksDaemon *daemon,
+                                gpointer      user_data)
+{
+  return wait_for_iscsi_objects_multi (daemon, user_data, wait_for_iscsi_session_object, TRUE);
+}
+
+UDisksObject *
+wait_for_any_iscsi_session_object (UDisksDaemon *daemon,
+                                   gpointer      user_data)
+{
+  return wait_for_iscsi_objects_multi (daemon, user_data, wait_for_iscsi_session_object, FALSE);
+}
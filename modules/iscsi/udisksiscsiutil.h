@@ -51,6 +51,11 @@ gint                     iscsi_logout (UDisksDaemon  *daemon,
                                        GVariant      *params,
                                        gchar        **errorstr);
 
+gint                     iscsi_perform_batch (libiscsi_login_action   action,
+                                              GVariant               *nodes,
+                                              GVariant               *params,
+                                              gchar                 **errorstr);
+
 gint      iscsi_discover_send_targets (UDisksDaemon   *daemon,
                                        const gchar    *address,
                                        const guint16   port,
@@ -69,5 +74,13 @@ UDisksObject *wait_for_iscsi_object (UDisksDaemon *daemon,
                                      gpointer      user_data);
 UDisksObject *wait_for_iscsi_session_object (UDisksDaemon *daemon,
                                              gpointer      user_data);
+UDisksObject *wait_for_iscsi_objects (UDisksDaemon *daemon,
+                                      gpointer      user_data);
+UDisksObject *wait_for_any_iscsi_object (UDisksDaemon *daemon,
+                                         gpointer      user_data);
+UDisksObject *wait_for_iscsi_session_objects (UDisksDaemon *daemon,
+                                              gpointer      user_data);
+UDisksObject *wait_for_any_iscsi_session_object (UDisksDaemon *daemon,
+                                                 gpointer      user_data);
 
 #endif /* __UDISKS_ISCSI_UTIL_H__ */
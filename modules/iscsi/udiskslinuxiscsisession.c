@@ -24,6 +24,7 @@
 #include <src/udiskslogging.h>
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 
 #include "udisksiscsistate.h"
 #include "udisksiscsitypes.h"
@@ -65,13 +66,12 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxISCSISession, udisks_linux_iscsi_session,
 static void
 udisks_linux_iscsi_session_class_init (UDisksLinuxISCSISessionClass *klass)
 {
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_iscsi_session_init (UDisksLinuxISCSISession *self)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (self),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 /**
@@ -177,6 +177,7 @@ handle_logout_interface (UDisksISCSISession    *session,
                                                         g_strdup (name),
                                                         g_free,
                                                         15, /* timeout_seconds */
+                                                        udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                         &error))
     {
       g_prefix_error (&error, "Error waiting for iSCSI device to disappear: ");
@@ -189,6 +190,7 @@ handle_logout_interface (UDisksISCSISession    *session,
                                                         g_strdup (name),
                                                         g_free,
                                                         15, /* timeout_seconds */
+                                                        udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                         &error))
     {
       g_prefix_error (&error, "Error waiting for iSCSI session object to disappear: ");
@@ -412,6 +412,11 @@ udisks_linux_iscsi_session_object_process_uevent (UDisksModuleObject *module_obj
       g_free (session_id);
       if (g_strcmp0 (action, "remove") == 0)
         {
+          /* The target may have changed, don't serve it from the
+           * discovery cache anymore. */
+          udisks_iscsi_state_invalidate_discovery (session_object->state,
+                                                   udisks_iscsi_session_get_target_name (UDISKS_ISCSI_SESSION (session_object->iface_iscsi_session)));
+
           /* Returning FALSE means that the device is removed. */
           return FALSE;
         }
@@ -29,6 +29,7 @@
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslogging.h>
 #include <src/udisksmodulemanager.h>
 
@@ -84,6 +85,9 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxManagerISCSIInitiator, udisks_linux_manager_
 #define INITIATOR_FILENAME "/etc/iscsi/initiatorname.iscsi"
 #define INITIATOR_NAME_KEY "InitiatorName"
 
+/* Used by libiscsi if the port of a portal is 0. */
+#define ISCSI_DEFAULT_PORT 3260
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -176,6 +180,8 @@ udisks_linux_manager_iscsi_initiator_class_init (UDisksLinuxManagerISCSIInitiato
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
@@ -183,8 +189,6 @@ udisks_linux_manager_iscsi_initiator_init (UDisksLinuxManagerISCSIInitiator *man
 {
   manager->daemon = NULL;
 
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (manager),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 #ifdef HAVE_LIBISCSI_GET_SESSION_INFOS
   udisks_manager_iscsi_initiator_set_sessions_supported (UDISKS_MANAGER_ISCSI_INITIATOR (manager),
                                                          TRUE);
@@ -500,18 +504,21 @@ discover_firmware (UDisksManagerISCSIInitiator  *object,
                    gint                         *nodes_cnt,
                    gchar                       **errorstr)
 {
-  UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
-  UDisksISCSIState *state = udisks_linux_manager_iscsi_initiator_get_state (manager);
-
   gint rval;
   struct libiscsi_context *ctx;
-  struct libiscsi_node *found_nodes;
+  struct libiscsi_node *found_nodes = NULL;
 
-  /* Enter a critical section. */
-  udisks_iscsi_state_lock_libiscsi_context (state);
+  /* Like the send targets discovery, use a libiscsi context of our own
+   * instead of entering the critical section. */
+  ctx = libiscsi_init ();
+  if (ctx == NULL)
+    {
+      if (errorstr)
+        *errorstr = g_strdup ("Failed to initialize libiscsi");
+      return 1;
+    }
 
   /* Discovery */
-  ctx = udisks_linux_manager_iscsi_initiator_get_iscsi_context (manager);
   rval = libiscsi_discover_firmware (ctx,
                                      nodes_cnt,
                                      &found_nodes);
@@ -521,15 +528,31 @@ discover_firmware (UDisksManagerISCSIInitiator  *object,
   else if (errorstr)
     *errorstr = g_strdup (libiscsi_get_error_string (ctx));
 
-  /* Leave the critical section. */
-  udisks_iscsi_state_unlock_libiscsi_context (state);
-
   /* Release the resources */
   iscsi_libiscsi_nodes_free (found_nodes);
+  libiscsi_cleanup (ctx);
 
   return rval;
 }
 
+/* The results of a send targets discovery depend on the portal and on
+ * the credentials the initiator presents to it. */
+static gchar *
+send_targets_cache_key (const gchar *address,
+                        guint16      port,
+                        GVariant    *options)
+{
+  const gchar *username = "";
+  const gchar *reverse_username = "";
+
+  g_variant_lookup (options, "username", "&s", &username);
+  g_variant_lookup (options, "reverse-username", "&s", &reverse_username);
+
+  return g_strdup_printf ("sendtargets:%s:%u:%s:%s",
+                          address, (guint) (port == 0 ? ISCSI_DEFAULT_PORT : port),
+                          username, reverse_username);
+}
+
 static gboolean
 handle_discover_send_targets (UDisksManagerISCSIInitiator *object,
                               GDBusMethodInvocation       *invocation,
@@ -541,6 +564,8 @@ handle_discover_send_targets (UDisksManagerISCSIInitiator *object,
   UDisksISCSIState *state = udisks_linux_manager_iscsi_initiator_get_state (manager);
   GVariant *nodes = NULL;
   gchar *errorstr = NULL;
+  gchar *cache_key = NULL;
+  gboolean refresh = FALSE;
   gint err = 0;
   gint nodes_cnt = 0;
 
@@ -552,20 +577,24 @@ handle_discover_send_targets (UDisksManagerISCSIInitiator *object,
                                      N_("Authentication is required to discover targets"),
                                      invocation);
 
-  /* Enter a critical section. */
-  udisks_iscsi_state_lock_libiscsi_context (state);
+  g_variant_lookup (arg_options, "refresh", "b", &refresh);
+  cache_key = send_targets_cache_key (arg_address, arg_port, arg_options);
 
-  /* Perform the discovery. */
-  err = iscsi_discover_send_targets (manager->daemon,
-                                     arg_address,
-                                     arg_port,
-                                     arg_options,
-                                     &nodes,
-                                     &nodes_cnt,
-                                     &errorstr);
-
-  /* Leave the critical section. */
-  udisks_iscsi_state_unlock_libiscsi_context (state);
+  if (!udisks_iscsi_state_begin_discovery (state, cache_key, refresh, &nodes, &nodes_cnt))
+    {
+      /* Perform the discovery; it uses a libiscsi context of its own, no
+       * need to enter the critical section. */
+      err = iscsi_discover_send_targets (manager->daemon,
+                                         arg_address,
+                                         arg_port,
+                                         arg_options,
+                                         &nodes,
+                                         &nodes_cnt,
+                                         &errorstr);
+      if (err == 0)
+        g_variant_ref_sink (nodes);
+      udisks_iscsi_state_end_discovery (state, cache_key, err == 0 ? nodes : NULL, nodes_cnt);
+    }
 
   if (err != 0)
     {
@@ -585,6 +614,9 @@ handle_discover_send_targets (UDisksManagerISCSIInitiator *object,
                                                                  nodes_cnt);
 
 out:
+  if (nodes != NULL)
+    g_variant_unref (nodes);
+  g_free (cache_key);
   g_free ((gpointer) errorstr);
 
   /* Indicate that we handled the method invocation. */
@@ -597,7 +629,9 @@ handle_discover_firmware (UDisksManagerISCSIInitiator *object,
                           GVariant                    *arg_options)
 {
   UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
+  UDisksISCSIState *state = udisks_linux_manager_iscsi_initiator_get_state (manager);
   GVariant *nodes = NULL;
+  gboolean refresh = FALSE;
   gint err = 0;
   gint nodes_cnt = 0;
   gchar *errorstr = NULL;
@@ -610,11 +644,19 @@ handle_discover_firmware (UDisksManagerISCSIInitiator *object,
                                      N_("Authentication is required to discover firmware targets"),
                                      invocation);
 
-  /* Perform the discovery. */
-  err = discover_firmware (object,
-                           &nodes,
-                           &nodes_cnt,
-                           &errorstr);
+  g_variant_lookup (arg_options, "refresh", "b", &refresh);
+
+  if (!udisks_iscsi_state_begin_discovery (state, "firmware", refresh, &nodes, &nodes_cnt))
+    {
+      /* Perform the discovery. */
+      err = discover_firmware (object,
+                               &nodes,
+                               &nodes_cnt,
+                               &errorstr);
+      if (err == 0)
+        g_variant_ref_sink (nodes);
+      udisks_iscsi_state_end_discovery (state, "firmware", err == 0 ? nodes : NULL, nodes_cnt);
+    }
 
   if (err != 0)
     {
@@ -635,6 +677,9 @@ handle_discover_firmware (UDisksManagerISCSIInitiator *object,
                                                              nodes_cnt);
 
 out:
+  if (nodes != NULL)
+    g_variant_unref (nodes);
+
   /* Indicate that we handled the method invocation. */
   return TRUE;
 }
@@ -698,6 +743,7 @@ handle_login (UDisksManagerISCSIInitiator *object,
                                                      g_strdup (arg_name),
                                                      g_free,
                                                      15, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                      &error);
    if (iscsi_object == NULL)
     {
@@ -713,6 +759,7 @@ handle_login (UDisksManagerISCSIInitiator *object,
                                                                  g_strdup (arg_name),
                                                                  g_free,
                                                                  15, /* timeout_seconds */
+                                                                 udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                                  &error);
       if (iscsi_session_object == NULL)
         {
@@ -786,12 +833,15 @@ handle_logout(UDisksManagerISCSIInitiator *object,
       goto out;
     }
 
+  udisks_iscsi_state_invalidate_discovery (state, arg_name);
+
   /* now sit and wait until the device and session disappear on dbus */
   if (!udisks_daemon_wait_for_object_to_disappear_sync (manager->daemon,
                                                         wait_for_iscsi_object,
                                                         g_strdup (arg_name),
                                                         g_free,
                                                         15, /* timeout_seconds */
+                                                        udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                         &error))
     {
       g_prefix_error (&error, "Error waiting for iSCSI device to disappear: ");
@@ -806,6 +856,7 @@ handle_logout(UDisksManagerISCSIInitiator *object,
                                                             g_strdup (arg_name),
                                                             g_free,
                                                             15, /* timeout_seconds */
+                                                            udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                             &error))
         {
           g_prefix_error (&error, "Error waiting for iSCSI session object to disappear: ");
@@ -825,6 +876,201 @@ out:
   return TRUE;
 }
 
+static gchar **
+nodes_to_names (GVariant *nodes)
+{
+  GPtrArray *names;
+  GVariantIter iter;
+  const gchar *name;
+
+  names = g_ptr_array_new ();
+  g_variant_iter_init (&iter, nodes);
+  while (g_variant_iter_next (&iter, "(&sisis)", &name, NULL, NULL, NULL, NULL))
+    g_ptr_array_add (names, g_strdup (name));
+  g_ptr_array_add (names, NULL);
+
+  return (gchar **) g_ptr_array_free (names, FALSE);
+}
+
+static gboolean
+handle_login_batch (UDisksManagerISCSIInitiator *object,
+                    GDBusMethodInvocation       *invocation,
+                    GVariant                    *arg_nodes,
+                    GVariant                    *arg_options)
+{
+  UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
+  gint err = 0;
+  gchar *errorstr = NULL;
+  GError *error = NULL;
+  UDisksObject *iscsi_object = NULL;
+  UDisksObject *iscsi_session_object = NULL;
+  gchar **names = NULL;
+
+  /* Policy check. */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (manager->daemon,
+                                     NULL,
+                                     ISCSI_MODULE_POLICY_ACTION_ID,
+                                     arg_options,
+                                     N_("Authentication is required to perform iSCSI login"),
+                                     invocation);
+
+  names = nodes_to_names (arg_nodes);
+  if (names[0] == NULL)
+    goto done;
+
+  /* Login; every node uses its own libiscsi context, no need to enter
+   * the critical section. */
+  err = iscsi_perform_batch (ACTION_LOGIN,
+                             arg_nodes,
+                             arg_options,
+                             &errorstr);
+  if (err != 0)
+    {
+      /* Login failed. */
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             iscsi_error_to_udisks_error (err),
+                                             N_("Login failed: %s"),
+                                             errorstr);
+      goto out;
+    }
+
+  /* sit and wait until all the devices appear on dbus */
+  iscsi_object = udisks_daemon_wait_for_object_sync (manager->daemon,
+                                                     wait_for_iscsi_objects,
+                                                     g_strdupv (names),
+                                                     (GDestroyNotify) g_strfreev,
+                                                     15, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                     &error);
+  if (iscsi_object == NULL)
+    {
+      g_prefix_error (&error, "Error waiting for iSCSI devices to appear: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (udisks_manager_iscsi_initiator_get_sessions_supported (UDISKS_MANAGER_ISCSI_INITIATOR (manager)))
+    {
+      iscsi_session_object = udisks_daemon_wait_for_object_sync (manager->daemon,
+                                                                 wait_for_iscsi_session_objects,
+                                                                 g_strdupv (names),
+                                                                 (GDestroyNotify) g_strfreev,
+                                                                 15, /* timeout_seconds */
+                                                                 udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                                 &error);
+      if (iscsi_session_object == NULL)
+        {
+          g_prefix_error (&error, "Error waiting for iSCSI session objects to appear: ");
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+    }
+
+done:
+  /* Complete DBus call. */
+  udisks_manager_iscsi_initiator_complete_login_batch (object,
+                                                       invocation);
+
+out:
+  g_clear_object (&iscsi_object);
+  g_clear_object (&iscsi_session_object);
+  g_strfreev (names);
+  g_free ((gpointer) errorstr);
+
+  /* Indicate that we handled the method invocation. */
+  return TRUE;
+}
+
+static gboolean
+handle_logout_batch (UDisksManagerISCSIInitiator *object,
+                     GDBusMethodInvocation       *invocation,
+                     GVariant                    *arg_nodes,
+                     GVariant                    *arg_options)
+{
+  UDisksLinuxManagerISCSIInitiator *manager = UDISKS_LINUX_MANAGER_ISCSI_INITIATOR (object);
+  UDisksISCSIState *state = udisks_linux_manager_iscsi_initiator_get_state (manager);
+  gint err = 0;
+  gchar *errorstr = NULL;
+  GError *error = NULL;
+  gchar **names = NULL;
+  guint i;
+
+  /* Policy check. */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (manager->daemon,
+                                     NULL,
+                                     ISCSI_MODULE_POLICY_ACTION_ID,
+                                     arg_options,
+                                     N_("Authentication is required to perform iSCSI logout"),
+                                     invocation);
+
+  names = nodes_to_names (arg_nodes);
+  if (names[0] == NULL)
+    goto done;
+
+  /* Logout; every node uses its own libiscsi context, no need to enter
+   * the critical section. */
+  err = iscsi_perform_batch (ACTION_LOGOUT,
+                             arg_nodes,
+                             arg_options,
+                             &errorstr);
+  if (err != 0)
+    {
+      /* Logout failed. */
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             iscsi_error_to_udisks_error (err),
+                                             N_("Logout failed: %s"),
+                                             errorstr);
+      goto out;
+    }
+
+  for (i = 0; names[i] != NULL; i++)
+    udisks_iscsi_state_invalidate_discovery (state, names[i]);
+
+  /* now sit and wait until all the devices and sessions disappear on dbus */
+  if (!udisks_daemon_wait_for_object_to_disappear_sync (manager->daemon,
+                                                        wait_for_any_iscsi_object,
+                                                        g_strdupv (names),
+                                                        (GDestroyNotify) g_strfreev,
+                                                        15, /* timeout_seconds */
+                                                        udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                        &error))
+    {
+      g_prefix_error (&error, "Error waiting for iSCSI devices to disappear: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (udisks_manager_iscsi_initiator_get_sessions_supported (UDISKS_MANAGER_ISCSI_INITIATOR (manager)))
+    {
+      if (!udisks_daemon_wait_for_object_to_disappear_sync (manager->daemon,
+                                                            wait_for_any_iscsi_session_object,
+                                                            g_strdupv (names),
+                                                            (GDestroyNotify) g_strfreev,
+                                                            15, /* timeout_seconds */
+                                                            udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                            &error))
+        {
+          g_prefix_error (&error, "Error waiting for iSCSI session objects to disappear: ");
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+    }
+
+done:
+  /* Complete DBus call. */
+  udisks_manager_iscsi_initiator_complete_logout_batch (object,
+                                                        invocation);
+
+out:
+  g_strfreev (names);
+  g_free ((gpointer) errorstr);
+
+  /* Indicate that we handled the method invocation. */
+  return TRUE;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -838,4 +1084,6 @@ udisks_linux_manager_iscsi_initiator_iface_init (UDisksManagerISCSIInitiatorIfac
   iface->handle_discover_firmware = handle_discover_firmware;
   iface->handle_login = handle_login;
   iface->handle_logout = handle_logout;
+  iface->handle_login_batch = handle_login_batch;
+  iface->handle_logout_batch = handle_logout_batch;
 }
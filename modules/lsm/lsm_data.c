@@ -61,7 +61,7 @@ struct _LsmUriSet
  */
 struct _LsmConnData
 {
-  lsm_connect *lsm_conn;
+  struct _LsmConnWorker *worker;
   lsm_volume *lsm_vol;
   const char *pl_id;
 };
@@ -93,34 +93,82 @@ struct _LsmVriData
   uint32_t raid_disk_count;
 };
 
+/*
+ * _LsmConnWorker is holding the connection of one configured URI and the
+ * data retrieved through it. Every worker runs in its own thread with its
+ * own refresh timer, so a slow or unreachable storage system does not delay
+ * the others.
+ * The tables are only replaced by the worker thread with _lsm_data_mutex
+ * held.
+ */
+struct _LsmConnWorker
+{
+  struct _LsmUriSet *lsm_uri_set;
+  lsm_connect *lsm_conn;
+  GHashTable *supported_sys_id_hash;
+  GHashTable *vpd83_2_lsm_conn_data_hash;
+  GHashTable *pl_id_2_lsm_pl_data_hash;
+  GHashTable *vpd83_2_lsm_vri_data_hash;
+  GThread *thread;
+
+  /* protected by _lsm_data_mutex */
+  GCond cond;
+  gboolean quit;
+  gboolean kick;
+  guint full_refresh_requested;
+  guint full_refresh_done;
+};
+
 static GPtrArray *_conf_lsm_uri_sets = NULL;
 static uint32_t _conf_refresh_interval = 30;
 static const gboolean _sys_id_supported = TRUE;
-static GPtrArray *_all_lsm_conn_array = NULL;
-static GHashTable *_supported_sys_id_hash = NULL;
-static GHashTable *_vpd83_2_lsm_conn_data_hash = NULL;
-static GHashTable *_pl_id_2_lsm_pl_data_hash = NULL;
-static GHashTable *_vpd83_2_lsm_vri_data_hash = NULL;
+static GPtrArray *_lsm_conn_workers = NULL;
 static char *_std_lsm_conf_file_abs_path = NULL;
 
+/*
+ * All the volumes of all the workers. Keys and values are borrowed from the
+ * vpd83_2_lsm_conn_data_hash of the worker the volume belongs to.
+ * Protected by _lsm_data_mutex.
+ */
+static GHashTable *_vpd83_2_lsm_conn_data_hash = NULL;
+
+/*
+ * Held for lookups and for any change of the published data, never for the
+ * communication with the storage systems.
+ */
+static GMutex _lsm_data_mutex;
+static GCond _lsm_full_refresh_cond;
+
 static struct _LsmUriSet *_lsm_uri_set_new (const char *uri, const char *pass);
 static void _handle_lsm_error (const char *msg, lsm_connect *lsm_conn);
 static const char *_lsm_raid_type_to_str (lsm_volume_raid_type raid_type);
 static void _load_module_conf (UDisksDaemon *daemon);
 static lsm_connect *_create_lsm_connect (struct _LsmUriSet *lsm_uri_set);
-static GPtrArray *_get_supported_lsm_volumes (lsm_connect *lsm_conn);
-static GPtrArray *_get_supported_lsm_pls (lsm_connect *lsm_conn);
-static gboolean _fill_supported_system_id_hash (lsm_connect *lsm_conn);
-static void _fill_pl_id_2_lsm_pl_data_hash (GPtrArray *lsm_pl_array,
+static GPtrArray *_get_supported_lsm_volumes (lsm_connect *lsm_conn,
+                                              GHashTable *supported_sys_id_hash);
+static GPtrArray *_get_supported_lsm_pls (lsm_connect *lsm_conn,
+                                          GHashTable *supported_sys_id_hash);
+static gboolean _fill_supported_system_id_hash (lsm_connect *lsm_conn,
+                                                GHashTable *supported_sys_id_hash);
+static void _fill_pl_id_2_lsm_pl_data_hash (GHashTable *pl_id_2_lsm_pl_data_hash,
+                                            GPtrArray *lsm_pl_array,
                                             gint64 last_refresh_time);
-static void _fill_vpd83_2_lsm_conn_data_hash (lsm_connect *lsm_conn,
+static void _fill_vpd83_2_lsm_conn_data_hash (GHashTable *vpd83_2_lsm_conn_data_hash,
+                                              struct _LsmConnWorker *worker,
                                               GPtrArray *lsm_vol_array);
 static void _fill_lsm_pl_data (struct _LsmPlData *lsm_pl_data,
                                lsm_pool *lsm_pl, gint64 last_refresh_time);
 static struct _LsmVriData *
-_refresh_lsm_vri_data (struct _LsmConnData *lsm_conn_data, const char *vpd83);
+_get_lsm_vri_data (struct _LsmConnData *lsm_conn_data, const char *vpd83,
+                   gboolean *deleted);
+static void _lsm_conn_worker_refresh (struct _LsmConnWorker *worker,
+                                      gboolean full);
+static void _lsm_conn_workers_full_refresh (void);
 static struct _LsmPlData *_lsm_pl_data_lookup (const char *vpd83);
 static struct _LsmVriData *_lsm_vri_data_lookup (const char *vpd83);
+static GHashTable *_lsm_conn_data_hash_new (void);
+static GHashTable *_lsm_pl_data_hash_new (void);
+static GHashTable *_lsm_vri_data_hash_new (void);
 
 static const gchar *_lsm_get_conf_path (UDisksDaemon *daemon);
 
@@ -129,6 +177,7 @@ static void _free_lsm_uri_set (gpointer data);
 static void _free_lsm_conn_data (gpointer data);
 static void _free_lsm_pl_data (gpointer data);
 static void _free_lsm_vri_data (gpointer data);
+static void _free_lsm_conn_worker (gpointer data);
 
 static struct _LsmUriSet *
 _lsm_uri_set_new (const char *uri, const char *pass)
@@ -364,7 +413,7 @@ _create_lsm_connect (struct _LsmUriSet *lsm_uri_set)
 }
 
 /*
- * Update _supported_sys_id_hash GHashTable when system is having
+ * Update supported_sys_id_hash GHashTable when system is having
  * LSM_CAP_VOLUMES and LSM_CAP_VOLUME_RAID_INFO capabilities:
  *  {
  *    system_id: TRUE;
@@ -372,7 +421,8 @@ _create_lsm_connect (struct _LsmUriSet *lsm_uri_set)
  * Return TRUE when provided connection has supported system, or FALSE.
  */
 static gboolean
-_fill_supported_system_id_hash (lsm_connect *lsm_conn)
+_fill_supported_system_id_hash (lsm_connect *lsm_conn,
+                                GHashTable *supported_sys_id_hash)
 {
   lsm_storage_capabilities *lsm_cap = NULL;
   lsm_system **lsm_syss = NULL;
@@ -419,7 +469,7 @@ _fill_supported_system_id_hash (lsm_connect *lsm_conn)
         {
           udisks_debug ("LSM: System '%s'(%s) is connected and supported.",
                         lsm_system_name_get (lsm_syss[i]), lsm_sys_id);
-          g_hash_table_insert (_supported_sys_id_hash,
+          g_hash_table_insert (supported_sys_id_hash,
                                (gpointer) g_strdup (lsm_sys_id),
                                (gpointer) &_sys_id_supported);
           rc = TRUE;
@@ -449,7 +499,8 @@ _free_lsm_volume_record (gpointer data)
  * Return an array of lsm_volume which system_id is in supported_sys_id_hash.
  */
 static GPtrArray *
-_get_supported_lsm_volumes (lsm_connect *lsm_conn)
+_get_supported_lsm_volumes (lsm_connect *lsm_conn,
+                            GHashTable *supported_sys_id_hash)
 {
   GPtrArray *lsm_vol_array = NULL;
   lsm_volume **lsm_vols = NULL;
@@ -484,7 +535,7 @@ _get_supported_lsm_volumes (lsm_connect *lsm_conn)
         }
 
       lsm_sys_id = lsm_volume_system_id_get (lsm_vols[i]);
-      if (g_hash_table_lookup (_supported_sys_id_hash, lsm_sys_id) == NULL)
+      if (g_hash_table_lookup (supported_sys_id_hash, lsm_sys_id) == NULL)
         {
           udisks_debug
             ("LSM: Volume VPD %s been rule out as its system is not "
@@ -519,7 +570,8 @@ _free_lsm_pool_record (gpointer data)
  * Return an array of lsm_pool which system_id is in supported_sys_id_hash.
  */
 static GPtrArray *
-_get_supported_lsm_pls (lsm_connect *lsm_conn)
+_get_supported_lsm_pls (lsm_connect *lsm_conn,
+                        GHashTable *supported_sys_id_hash)
 {
   GPtrArray *lsm_pl_array = NULL;
   lsm_pool **lsm_pls = NULL;
@@ -545,7 +597,7 @@ _get_supported_lsm_pls (lsm_connect *lsm_conn)
     {
 
       lsm_sys_id = lsm_pool_system_id_get (lsm_pls[i]);
-      if (g_hash_table_lookup (_supported_sys_id_hash, lsm_sys_id) == NULL)
+      if (g_hash_table_lookup (supported_sys_id_hash, lsm_sys_id) == NULL)
         {
           udisks_debug
             ("LSM: Pool %s(%s) been rule out as its system is not supported",
@@ -572,7 +624,8 @@ _get_supported_lsm_pls (lsm_connect *lsm_conn)
 }
 
 static void
-_fill_pl_id_2_lsm_pl_data_hash (GPtrArray *lsm_pl_array,
+_fill_pl_id_2_lsm_pl_data_hash (GHashTable *pl_id_2_lsm_pl_data_hash,
+                                GPtrArray *lsm_pl_array,
                                 gint64 last_refresh_time)
 {
   struct _LsmPlData *lsm_pl_data = NULL;
@@ -582,6 +635,9 @@ _fill_pl_id_2_lsm_pl_data_hash (GPtrArray *lsm_pl_array,
   struct _LsmPlData *orig_lsm_pl_data = NULL;
   guint i;
 
+  if (lsm_pl_array == NULL)
+    return;
+
   for (i = 0; i < lsm_pl_array->len; ++i)
     {
       lsm_pl = g_ptr_array_index (lsm_pl_array, i);
@@ -590,31 +646,30 @@ _fill_pl_id_2_lsm_pl_data_hash (GPtrArray *lsm_pl_array,
         continue;
 
       /* Overide old data  */
-      g_hash_table_lookup_extended (_pl_id_2_lsm_pl_data_hash, pl_id,
+      g_hash_table_lookup_extended (pl_id_2_lsm_pl_data_hash, pl_id,
                                     (gpointer *) &orig_pl_id,
                                     (gpointer *) &orig_lsm_pl_data);
       if (orig_pl_id != NULL)
-        g_hash_table_remove (_pl_id_2_lsm_pl_data_hash,
+        g_hash_table_remove (pl_id_2_lsm_pl_data_hash,
                              (gconstpointer) orig_pl_id);
 
       lsm_pl_data = (struct _LsmPlData *)
         g_malloc (sizeof (struct _LsmPlData));
 
       _fill_lsm_pl_data (lsm_pl_data, lsm_pl, last_refresh_time);
-      g_hash_table_insert (_pl_id_2_lsm_pl_data_hash,
+      g_hash_table_insert (pl_id_2_lsm_pl_data_hash,
                            (gpointer) g_strdup (pl_id),
                            (gpointer) lsm_pl_data);
     }
 }
 
 /*
- * Use lsm_conn_data to fill in these hash tables to speed up the future
- * search:
- *    _vpd83_2_lsm_conn_data_hash
- *    _pl_id_2_lsm_pl_data_hash
+ * Use lsm_conn_data to fill in the vpd83_2_lsm_conn_data_hash of the worker
+ * to speed up the future search.
  */
 static void
-_fill_vpd83_2_lsm_conn_data_hash (lsm_connect *lsm_conn,
+_fill_vpd83_2_lsm_conn_data_hash (GHashTable *vpd83_2_lsm_conn_data_hash,
+                                  struct _LsmConnWorker *worker,
                                   GPtrArray *lsm_vol_array)
 {
   struct _LsmConnData *lsm_conn_data = NULL;
@@ -641,13 +696,13 @@ _fill_vpd83_2_lsm_conn_data_hash (lsm_connect *lsm_conn,
       lsm_conn_data = (struct _LsmConnData *)
         g_malloc (sizeof (struct _LsmConnData));
 
-      lsm_conn_data->lsm_conn = lsm_conn;
+      lsm_conn_data->worker = worker;
       lsm_conn_data->lsm_vol = lsm_volume_record_copy (lsm_vol);
       if (lsm_conn_data->lsm_vol == NULL)
         exit (1);   // No memory
       lsm_conn_data->pl_id = g_strdup (pl_id);
 
-      g_hash_table_insert (_vpd83_2_lsm_conn_data_hash, g_strdup (vpd83),
+      g_hash_table_insert (vpd83_2_lsm_conn_data_hash, g_strdup (vpd83),
                            lsm_conn_data);
     }
 }
@@ -718,31 +773,23 @@ _fill_lsm_pl_data (struct _LsmPlData *lsm_pl_data, lsm_pool *lsm_pl,
 
 
 /*
- * Refresh _LsmVriData in _vpd83_2_lsm_vri_data_hash for certain VPD83.
- * If volume has been delete, update _vpd83_2_lsm_conn_data_hash also to
- * reflect that.
+ * Query the volume RAID information for certain VPD83.
+ * Return NULL on failure, with *deleted set to TRUE if the volume has been
+ * deleted.
  */
 static struct _LsmVriData *
-_refresh_lsm_vri_data (struct _LsmConnData *lsm_conn_data,
-                       const char *vpd83)
+_get_lsm_vri_data (struct _LsmConnData *lsm_conn_data,
+                   const char *vpd83,
+                   gboolean *deleted)
 {
   struct _LsmVriData *lsm_vri_data = NULL;
-  const char *orig_vpd83 = NULL;
-  struct _LsmVriData *orig_lsm_vri_data = NULL;
-  struct _LsmConnData *orig_lsm_conn_data = NULL;
   lsm_volume_raid_type raid_type;
   uint32_t strip_size, disk_count, min_io_size, opt_io_size;
   int lsm_rc;
 
-  // Remove _vpd83_2_lsm_vri_data_hash old entry
-  g_hash_table_lookup_extended (_vpd83_2_lsm_vri_data_hash, vpd83,
-                                (gpointer *) &orig_vpd83,
-                                (gpointer *) &orig_lsm_vri_data);
-  if (orig_vpd83 != NULL)
-    g_hash_table_remove (_vpd83_2_lsm_vri_data_hash,
-                         (gconstpointer) orig_vpd83);
+  *deleted = FALSE;
 
-  lsm_rc = lsm_volume_raid_info (lsm_conn_data->lsm_conn,
+  lsm_rc = lsm_volume_raid_info (lsm_conn_data->worker->lsm_conn,
                                  lsm_conn_data->lsm_vol, &raid_type,
                                  &strip_size, &disk_count, &min_io_size,
                                  &opt_io_size, LSM_CLIENT_FLAG_RSVD);
@@ -750,20 +797,13 @@ _refresh_lsm_vri_data (struct _LsmConnData *lsm_conn_data,
   if (lsm_rc != LSM_ERR_OK)
     {
       if (lsm_rc == LSM_ERR_NOT_FOUND_VOLUME)
-        udisks_debug ("LSM: Volume %s deleted", vpd83);
+        {
+          udisks_debug ("LSM: Volume %s deleted", vpd83);
+          *deleted = TRUE;
+        }
       else
         _handle_lsm_error ("LSM: Failed to retrieve RAID information "
-                           "of volume", lsm_conn_data->lsm_conn);
-
-      // Remove _vpd83_2_lsm_conn_data_hash entry
-      g_hash_table_lookup_extended (_vpd83_2_lsm_conn_data_hash, vpd83,
-                                    (gpointer *) &orig_vpd83,
-                                    (gpointer *) &orig_lsm_conn_data);
-
-      if (orig_vpd83 != NULL)
-        g_hash_table_remove (_vpd83_2_lsm_conn_data_hash,
-                             (gconstpointer) orig_vpd83);
-
+                           "of volume", lsm_conn_data->worker->lsm_conn);
       return NULL;
     }
 
@@ -775,115 +815,335 @@ _refresh_lsm_vri_data (struct _LsmConnData *lsm_conn_data,
   lsm_vri_data->raid_disk_count = disk_count;
   lsm_vri_data->last_refresh_time = g_get_monotonic_time ();
 
-  g_hash_table_insert (_vpd83_2_lsm_vri_data_hash, g_strdup (vpd83),
-                       lsm_vri_data);
-
   return lsm_vri_data;
 }
 
 /*
- * Check _pl_id_2_lsm_pl_data_hash and _vpd83_2_lsm_conn_data_hash hash table
- * to find out the struct _LsmPlData.
- * If data is outdated, try to update it.
+ * Publish the volumes of the worker in _vpd83_2_lsm_conn_data_hash, or
+ * remove them from it.
+ * Must be called with _lsm_data_mutex held.
  */
-static struct _LsmPlData *
-_lsm_pl_data_lookup (const char *vpd83)
+static void
+_lsm_conn_worker_publish_locked (struct _LsmConnWorker *worker,
+                                 gboolean publish)
 {
+  GHashTableIter iter;
+  const char *vpd83 = NULL;
   struct _LsmConnData *lsm_conn_data = NULL;
-  struct _LsmPlData *lsm_pl_data = NULL;
-  GPtrArray *new_lsm_pl_array = NULL;
-  gint64 current_time = 0;
-  gint64 refresh_interval = 0;
-  const char *orig_pl_id;
-  struct _LsmPlData *orig_lsm_pl_data;
 
-  refresh_interval = std_lsm_refresh_time_get ();
+  g_hash_table_iter_init (&iter, worker->vpd83_2_lsm_conn_data_hash);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &vpd83,
+                                 (gpointer *) &lsm_conn_data))
+    {
+      if (publish)
+        g_hash_table_replace (_vpd83_2_lsm_conn_data_hash,
+                              (gpointer) vpd83, lsm_conn_data);
+      /* the same volume might have been published by another worker since */
+      else if (g_hash_table_lookup (_vpd83_2_lsm_conn_data_hash,
+                                    vpd83) == lsm_conn_data)
+        g_hash_table_remove (_vpd83_2_lsm_conn_data_hash, vpd83);
+    }
+}
 
-  if ((_vpd83_2_lsm_conn_data_hash == NULL) ||
-      (_pl_id_2_lsm_pl_data_hash == NULL))
-    return NULL;
+/*
+ * Refresh the pool and volume RAID data of the worker. On a full refresh,
+ * or when (re)connected, the list of volumes is refreshed as well.
+ * Volumes whose RAID information can't be retrieved keep the old one.
+ * Runs in the worker thread.
+ */
+static void
+_lsm_conn_worker_refresh (struct _LsmConnWorker *worker,
+                          gboolean full)
+{
+  GHashTable *conn_hash = NULL;
+  GHashTable *new_conn_hash = NULL;
+  GHashTable *new_pl_hash = NULL;
+  GHashTable *new_vri_hash = NULL;
+  GHashTable *old_conn_hash = NULL;
+  GHashTable *old_pl_hash = NULL;
+  GHashTable *old_vri_hash = NULL;
+  GPtrArray *lsm_vol_array = NULL;
+  GPtrArray *lsm_pl_array = NULL;
+  GPtrArray *deleted_vpd83s = NULL;
+  GHashTableIter iter;
+  const char *vpd83 = NULL;
+  struct _LsmConnData *lsm_conn_data = NULL;
+  struct _LsmVriData *lsm_vri_data = NULL;
+  struct _LsmVriData *old_lsm_vri_data = NULL;
+  gboolean deleted;
+  guint i;
 
-  lsm_conn_data = g_hash_table_lookup (_vpd83_2_lsm_conn_data_hash, vpd83);
+  if (worker->lsm_conn == NULL)
+    {
+      worker->lsm_conn = _create_lsm_connect (worker->lsm_uri_set);
+      if (worker->lsm_conn == NULL)
+        return;
+      g_hash_table_remove_all (worker->supported_sys_id_hash);
+      if (! _fill_supported_system_id_hash (worker->lsm_conn,
+                                            worker->supported_sys_id_hash))
+        {
+          _free_lsm_connect (worker->lsm_conn);
+          worker->lsm_conn = NULL;
+          return;
+        }
+      full = TRUE;
+    }
 
-  if ((lsm_conn_data == NULL) || (lsm_conn_data->pl_id == NULL))
-    return NULL;
+  udisks_debug ("LSM: Refreshing %s data of URI '%s'",
+                full ? "all the" : "pool and volume RAID",
+                worker->lsm_uri_set->uri);
+
+  /* Only this thread replaces the worker tables, no need to lock for
+   * reading them.
+   */
+  conn_hash = worker->vpd83_2_lsm_conn_data_hash;
+  if (full)
+    {
+      new_conn_hash = _lsm_conn_data_hash_new ();
+      lsm_vol_array = _get_supported_lsm_volumes (worker->lsm_conn,
+                                                  worker->supported_sys_id_hash);
+      if (lsm_vol_array != NULL)
+        {
+          _fill_vpd83_2_lsm_conn_data_hash (new_conn_hash, worker,
+                                            lsm_vol_array);
+          g_ptr_array_unref (lsm_vol_array);
+        }
+      conn_hash = new_conn_hash;
+    }
 
-  lsm_pl_data = g_hash_table_lookup (_pl_id_2_lsm_pl_data_hash,
-                                     lsm_conn_data->pl_id);
+  new_pl_hash = _lsm_pl_data_hash_new ();
+  lsm_pl_array = _get_supported_lsm_pls (worker->lsm_conn,
+                                         worker->supported_sys_id_hash);
+  _fill_pl_id_2_lsm_pl_data_hash (new_pl_hash, lsm_pl_array,
+                                  g_get_monotonic_time ());
+  if (lsm_pl_array != NULL)
+    g_ptr_array_unref (lsm_pl_array);
+
+  new_vri_hash = _lsm_vri_data_hash_new ();
+  deleted_vpd83s = g_ptr_array_new_with_free_func (g_free);
+  g_hash_table_iter_init (&iter, conn_hash);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &vpd83,
+                                 (gpointer *) &lsm_conn_data))
+    {
+      lsm_vri_data = _get_lsm_vri_data (lsm_conn_data, vpd83, &deleted);
+      if (lsm_vri_data == NULL && deleted)
+        {
+          g_ptr_array_add (deleted_vpd83s, g_strdup (vpd83));
+          continue;
+        }
+      if (lsm_vri_data == NULL)
+        {
+          old_lsm_vri_data = g_hash_table_lookup (worker->vpd83_2_lsm_vri_data_hash,
+                                                  vpd83);
+          if (old_lsm_vri_data == NULL)
+            continue;
+          lsm_vri_data = g_memdup (old_lsm_vri_data, sizeof (struct _LsmVriData));
+          lsm_vri_data->raid_type_str = g_strdup (old_lsm_vri_data->raid_type_str);
+        }
+      g_hash_table_insert (new_vri_hash, g_strdup (vpd83), lsm_vri_data);
+    }
 
-  if (lsm_pl_data == NULL)
-    return NULL;
+  g_mutex_lock (&_lsm_data_mutex);
+  _lsm_conn_worker_publish_locked (worker, FALSE);
+  if (new_conn_hash != NULL)
+    {
+      old_conn_hash = worker->vpd83_2_lsm_conn_data_hash;
+      worker->vpd83_2_lsm_conn_data_hash = new_conn_hash;
+    }
+  for (i = 0; i < deleted_vpd83s->len; ++i)
+    g_hash_table_remove (worker->vpd83_2_lsm_conn_data_hash,
+                         g_ptr_array_index (deleted_vpd83s, i));
+  old_pl_hash = worker->pl_id_2_lsm_pl_data_hash;
+  worker->pl_id_2_lsm_pl_data_hash = new_pl_hash;
+  old_vri_hash = worker->vpd83_2_lsm_vri_data_hash;
+  worker->vpd83_2_lsm_vri_data_hash = new_vri_hash;
+  _lsm_conn_worker_publish_locked (worker, TRUE);
+  g_mutex_unlock (&_lsm_data_mutex);
+
+  if (old_conn_hash != NULL)
+    g_hash_table_unref (old_conn_hash);
+  g_hash_table_unref (old_pl_hash);
+  g_hash_table_unref (old_vri_hash);
+  g_ptr_array_unref (deleted_vpd83s);
+}
 
-  current_time = g_get_monotonic_time ();
+static gpointer
+_lsm_conn_worker_thread_func (gpointer data)
+{
+  struct _LsmConnWorker *worker = (struct _LsmConnWorker *) data;
+  guint full_refresh;
+  gint64 interval;
+  gint64 deadline;
 
-  if ((current_time - lsm_pl_data->last_refresh_time) / 1000000
-      < refresh_interval)
-    return lsm_pl_data;
+  /* refresh well before the data is considered outdated */
+  interval = MAX (std_lsm_refresh_time_get () / 2, 1) * G_TIME_SPAN_SECOND;
 
-  // Refresh data is required.
-  udisks_debug ("LSM: Refreshing Pool(id %s) data", lsm_conn_data->pl_id);
-  new_lsm_pl_array = _get_supported_lsm_pls (lsm_conn_data->lsm_conn);
-  _fill_pl_id_2_lsm_pl_data_hash (new_lsm_pl_array, current_time);
-  g_ptr_array_unref (new_lsm_pl_array);
+  g_mutex_lock (&_lsm_data_mutex);
+  while (! worker->quit)
+    {
+      deadline = g_get_monotonic_time () + interval;
+      while (! worker->quit && ! worker->kick &&
+             worker->full_refresh_done == worker->full_refresh_requested)
+        if (! g_cond_wait_until (&worker->cond, &_lsm_data_mutex, deadline))
+          break;
+      if (worker->quit)
+        break;
+      worker->kick = FALSE;
+      full_refresh = worker->full_refresh_requested;
+
+      g_mutex_unlock (&_lsm_data_mutex);
+      _lsm_conn_worker_refresh (worker,
+                                full_refresh != worker->full_refresh_done);
+      g_mutex_lock (&_lsm_data_mutex);
+
+      /* also done when failed to connect, retried on the next interval */
+      worker->full_refresh_done = full_refresh;
+      g_cond_broadcast (&_lsm_full_refresh_cond);
+    }
+  g_mutex_unlock (&_lsm_data_mutex);
 
-  // Search again
-  lsm_pl_data = g_hash_table_lookup (_pl_id_2_lsm_pl_data_hash,
-                                     lsm_conn_data->pl_id);
+  return NULL;
+}
 
-  if (_pl_id_2_lsm_pl_data_hash == NULL)
-    // Normally old data should not be delete yet.
-    return NULL;
+static struct _LsmConnWorker *
+_lsm_conn_worker_new (struct _LsmUriSet *lsm_uri_set)
+{
+  struct _LsmConnWorker *worker;
+
+  worker = g_new0 (struct _LsmConnWorker, 1);
+  worker->lsm_uri_set = lsm_uri_set;
+  worker->supported_sys_id_hash =
+    g_hash_table_new_full (g_str_hash, g_str_equal,
+                           (GDestroyNotify) g_free,
+                           NULL);
+  worker->vpd83_2_lsm_conn_data_hash = _lsm_conn_data_hash_new ();
+  worker->pl_id_2_lsm_pl_data_hash = _lsm_pl_data_hash_new ();
+  worker->vpd83_2_lsm_vri_data_hash = _lsm_vri_data_hash_new ();
+  g_cond_init (&worker->cond);
+  worker->thread = g_thread_new ("lsm-worker", _lsm_conn_worker_thread_func,
+                                 worker);
+  return worker;
+}
+
+/*
+ * Ask all the workers for a full refresh and wait for them to finish, at
+ * most for the LSM connection timeout.
+ */
+static void
+_lsm_conn_workers_full_refresh (void)
+{
+  struct _LsmConnWorker *worker = NULL;
+  gboolean pending;
+  gint64 deadline;
+  guint i;
+
+  deadline = g_get_monotonic_time () +
+    _STD_LSM_CONNECTION_DEFAULT_TMO * G_TIME_SPAN_MILLISECOND;
 
-  if (lsm_pl_data->last_refresh_time != current_time)
+  g_mutex_lock (&_lsm_data_mutex);
+  for (i = 0; i < _lsm_conn_workers->len; ++i)
     {
-      udisks_debug ("LSM: _lsm_pl_data_lookup: pool deleted");
+      worker = g_ptr_array_index (_lsm_conn_workers, i);
+      worker->full_refresh_requested++;
+      g_cond_signal (&worker->cond);
+    }
 
-      // Pool got deleted, we should delete the old data
-      g_hash_table_lookup_extended (_pl_id_2_lsm_pl_data_hash,
-                                    lsm_conn_data->pl_id,
-                                    (gpointer *) &orig_pl_id,
-                                    (gpointer *) &orig_lsm_pl_data);
-      if (orig_pl_id != NULL)
-        g_hash_table_remove (_pl_id_2_lsm_pl_data_hash,
-                             (gconstpointer) orig_pl_id);
-      return NULL;
+  while (TRUE)
+    {
+      pending = FALSE;
+      for (i = 0; i < _lsm_conn_workers->len; ++i)
+        {
+          worker = g_ptr_array_index (_lsm_conn_workers, i);
+          if (worker->full_refresh_done != worker->full_refresh_requested)
+            pending = TRUE;
+        }
+      if (! pending)
+        break;
+      if (! g_cond_wait_until (&_lsm_full_refresh_cond, &_lsm_data_mutex,
+                               deadline))
+        {
+          udisks_debug ("LSM: Timed out waiting for the storage systems");
+          break;
+        }
     }
-  return lsm_pl_data;
+  g_mutex_unlock (&_lsm_data_mutex);
+}
+
+/*
+ * Check _vpd83_2_lsm_conn_data_hash and the pool table of the worker
+ * to find out the struct _LsmPlData. The data is kept up to date by the
+ * worker thread.
+ * Must be called with _lsm_data_mutex held.
+ */
+static struct _LsmPlData *
+_lsm_pl_data_lookup (const char *vpd83)
+{
+  struct _LsmConnData *lsm_conn_data = NULL;
+
+  if (_vpd83_2_lsm_conn_data_hash == NULL)
+    return NULL;
+
+  lsm_conn_data = g_hash_table_lookup (_vpd83_2_lsm_conn_data_hash, vpd83);
+
+  if ((lsm_conn_data == NULL) || (lsm_conn_data->pl_id == NULL))
+    return NULL;
+
+  return g_hash_table_lookup (lsm_conn_data->worker->pl_id_2_lsm_pl_data_hash,
+                              lsm_conn_data->pl_id);
 }
 
 /*
- * Search _vpd83_2_lsm_vri_data_hash, if not found or outdated, update it.
+ * Search the volume RAID table of the worker, if not found, ask the worker
+ * to retrieve it.
+ * Must be called with _lsm_data_mutex held.
  */
 static struct _LsmVriData *
 _lsm_vri_data_lookup (const char *vpd83)
 {
   struct _LsmConnData *lsm_conn_data = NULL;
   struct _LsmVriData *lsm_vri_data = NULL;
-  gint64 current_time = 0;
-  gint64 refresh_interval = 0;
-
-  refresh_interval = std_lsm_refresh_time_get ();
 
   if (_vpd83_2_lsm_conn_data_hash == NULL)
     return NULL;
 
   lsm_conn_data = g_hash_table_lookup (_vpd83_2_lsm_conn_data_hash, vpd83);
-
   if (lsm_conn_data == NULL)
     return NULL;
 
-  lsm_vri_data = g_hash_table_lookup (_vpd83_2_lsm_vri_data_hash, vpd83);
+  lsm_vri_data = g_hash_table_lookup (lsm_conn_data->worker->vpd83_2_lsm_vri_data_hash,
+                                      vpd83);
+  if (lsm_vri_data == NULL)
+    {
+      udisks_debug ("LSM: No VRI data for %s yet", vpd83);
+      lsm_conn_data->worker->kick = TRUE;
+      g_cond_signal (&lsm_conn_data->worker->cond);
+    }
 
-  current_time = g_get_monotonic_time ();
+  return lsm_vri_data;
+}
 
-  if ((lsm_vri_data != NULL) &&
-      ((current_time - lsm_vri_data->last_refresh_time) / 1000000
-        < refresh_interval))
-    return lsm_vri_data;
+static GHashTable *
+_lsm_conn_data_hash_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal,
+                                (GDestroyNotify) g_free,
+                                (GDestroyNotify) _free_lsm_conn_data);
+}
+
+static GHashTable *
+_lsm_pl_data_hash_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal,
+                                (GDestroyNotify) g_free,
+                                (GDestroyNotify) _free_lsm_pl_data);
+}
 
-  //Refresh data is required.
-  udisks_debug ("LSM: Refreshing VRI data for %s", vpd83);
-  return _refresh_lsm_vri_data (lsm_conn_data, vpd83);
+static GHashTable *
+_lsm_vri_data_hash_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal,
+                                (GDestroyNotify) g_free,
+                                (GDestroyNotify) _free_lsm_vri_data);
 }
 
 static const char *
@@ -906,6 +1166,21 @@ _free_lsm_connect (gpointer data)
   lsm_connect_close ((lsm_connect *) data, LSM_CLIENT_FLAG_RSVD);
 }
 
+static void
+_free_lsm_conn_worker (gpointer data)
+{
+  struct _LsmConnWorker *worker = (struct _LsmConnWorker *) data;
+
+  if (worker->lsm_conn != NULL)
+    _free_lsm_connect (worker->lsm_conn);
+  g_hash_table_unref (worker->supported_sys_id_hash);
+  g_hash_table_unref (worker->vpd83_2_lsm_conn_data_hash);
+  g_hash_table_unref (worker->pl_id_2_lsm_pl_data_hash);
+  g_hash_table_unref (worker->vpd83_2_lsm_vri_data_hash);
+  g_cond_clear (&worker->cond);
+  g_free (worker);
+}
+
 static void
 _free_lsm_uri_set (gpointer data)
 {
@@ -958,12 +1233,7 @@ _free_lsm_vri_data (gpointer data)
 void
 std_lsm_data_init (UDisksDaemon *daemon)
 {
-  struct _LsmUriSet *lsm_uri_set = NULL;
-  lsm_connect *lsm_conn = NULL;
-  GPtrArray *lsm_vol_array = NULL;
-  GPtrArray *lsm_pl_array = NULL;
   guint i = 0;
-  gboolean rc = FALSE;
 
   _load_module_conf (daemon);
   if (_conf_lsm_uri_sets == NULL)
@@ -973,55 +1243,19 @@ std_lsm_data_init (UDisksDaemon *daemon)
       return;
     }
 
-  _all_lsm_conn_array =
-    g_ptr_array_new_full (0, (GDestroyNotify) _free_lsm_connect);
+  _vpd83_2_lsm_conn_data_hash = g_hash_table_new (g_str_hash, g_str_equal);
 
-  _vpd83_2_lsm_conn_data_hash =
-      g_hash_table_new_full (g_str_hash, g_str_equal,
-                            (GDestroyNotify) g_free,
-                            (GDestroyNotify) _free_lsm_conn_data);
+  _lsm_conn_workers =
+    g_ptr_array_new_full (0, (GDestroyNotify) _free_lsm_conn_worker);
 
-  _pl_id_2_lsm_pl_data_hash =
-      g_hash_table_new_full (g_str_hash, g_str_equal,
-                            (GDestroyNotify) g_free,
-                            (GDestroyNotify) _free_lsm_pl_data);
+  for (i = 0; i < _conf_lsm_uri_sets->len; ++i)
+    g_ptr_array_add (_lsm_conn_workers,
+                     _lsm_conn_worker_new (g_ptr_array_index (_conf_lsm_uri_sets, i)));
 
-  _vpd83_2_lsm_vri_data_hash =
-      g_hash_table_new_full (g_str_hash, g_str_equal,
-                             (GDestroyNotify) g_free,
-                             (GDestroyNotify) _free_lsm_vri_data);
-
-  _supported_sys_id_hash =
-      g_hash_table_new_full (g_str_hash, g_str_equal,
-                             (GDestroyNotify) g_free,
-                             NULL);
-
-  for (i =0; i < _conf_lsm_uri_sets->len; ++i)
-    {
-      lsm_uri_set = g_ptr_array_index (_conf_lsm_uri_sets, i);
-      lsm_conn = _create_lsm_connect (lsm_uri_set);
-      if (lsm_conn == NULL)
-        continue;
-      rc = _fill_supported_system_id_hash (lsm_conn);
-      if (rc != TRUE)
-        {
-          lsm_connect_close (lsm_conn, LSM_CLIENT_FLAG_RSVD);
-          continue;
-        }
-      g_ptr_array_add (_all_lsm_conn_array, lsm_conn);
-
-      lsm_vol_array = _get_supported_lsm_volumes (lsm_conn);
-      if (lsm_vol_array == NULL)
-        {
-          continue;
-        }
-      lsm_pl_array = _get_supported_lsm_pls (lsm_conn);
-
-      _fill_pl_id_2_lsm_pl_data_hash (lsm_pl_array, g_get_monotonic_time ());
-      _fill_vpd83_2_lsm_conn_data_hash (lsm_conn, lsm_vol_array);
-      g_ptr_array_unref (lsm_vol_array);
-      g_ptr_array_unref (lsm_pl_array);
-    }
+  /* Have the data ready for the coldplug, the workers keep it up to date
+   * from now on.
+   */
+  _lsm_conn_workers_full_refresh ();
 }
 
 uint32_t
@@ -1041,6 +1275,8 @@ std_lsm_vol_data_get (const char *vpd83)
   struct _LsmPlData *lsm_pl_data = NULL;
   struct _LsmVriData *lsm_vri_data = NULL;
 
+  g_mutex_lock (&_lsm_data_mutex);
+
   lsm_pl_data = _lsm_pl_data_lookup (vpd83);
   if (lsm_pl_data == NULL)
     goto out;
@@ -1072,6 +1308,7 @@ std_lsm_vol_data_get (const char *vpd83)
   std_lsm_vol_data->raid_disk_count = lsm_vri_data->raid_disk_count;
 
 out:
+  g_mutex_unlock (&_lsm_data_mutex);
   return std_lsm_vol_data;
 
 }
@@ -1085,23 +1322,39 @@ std_lsm_vol_data_free (struct StdLsmVolData *std_lsm_vol_data)
 void
 std_lsm_data_teardown (void)
 {
-  g_ptr_array_unref (_conf_lsm_uri_sets);
-  _conf_lsm_uri_sets = NULL;
+  struct _LsmConnWorker *worker = NULL;
+  guint i;
 
-  g_hash_table_unref (_supported_sys_id_hash);
-  _supported_sys_id_hash = NULL;
+  if (_lsm_conn_workers != NULL)
+    {
+      g_mutex_lock (&_lsm_data_mutex);
+      for (i = 0; i < _lsm_conn_workers->len; ++i)
+        {
+          worker = g_ptr_array_index (_lsm_conn_workers, i);
+          worker->quit = TRUE;
+          g_cond_signal (&worker->cond);
+        }
+      g_mutex_unlock (&_lsm_data_mutex);
 
-  g_ptr_array_unref (_all_lsm_conn_array);
-  _all_lsm_conn_array = NULL;
+      for (i = 0; i < _lsm_conn_workers->len; ++i)
+        {
+          worker = g_ptr_array_index (_lsm_conn_workers, i);
+          g_thread_join (worker->thread);
+        }
+    }
 
-  g_hash_table_unref (_vpd83_2_lsm_conn_data_hash);
+  /* borrows from the workers */
+  if (_vpd83_2_lsm_conn_data_hash != NULL)
+    g_hash_table_unref (_vpd83_2_lsm_conn_data_hash);
   _vpd83_2_lsm_conn_data_hash = NULL;
 
-  g_hash_table_unref (_vpd83_2_lsm_vri_data_hash);
-  _vpd83_2_lsm_vri_data_hash = NULL;
+  if (_lsm_conn_workers != NULL)
+    g_ptr_array_unref (_lsm_conn_workers);
+  _lsm_conn_workers = NULL;
 
-  g_hash_table_unref (_pl_id_2_lsm_pl_data_hash);
-  _pl_id_2_lsm_pl_data_hash = NULL;
+  if (_conf_lsm_uri_sets != NULL)
+    g_ptr_array_unref (_conf_lsm_uri_sets);
+  _conf_lsm_uri_sets = NULL;
 
   g_free ((gpointer) _std_lsm_conf_file_abs_path);
   _std_lsm_conf_file_abs_path = NULL;
@@ -1110,47 +1363,25 @@ std_lsm_data_teardown (void)
 void
 std_lsm_vpd83_list_refresh (void)
 {
-  lsm_connect *lsm_conn = NULL;
-  GPtrArray *lsm_pl_array = NULL;
-  GPtrArray *lsm_vol_array = NULL;
-  guint i;
-
   udisks_debug ("LSM: std_lsm_vpd83_list_refresh ()");
 
-  if (_all_lsm_conn_array == NULL )
+  if (_lsm_conn_workers == NULL)
     return;
 
-  /* free old data:
-   *  _vpd83_2_lsm_conn_data_hash
-   *  _pl_id_2_lsm_pl_data_hash
-   */
-  g_hash_table_remove_all (_vpd83_2_lsm_conn_data_hash);
-  g_hash_table_remove_all (_pl_id_2_lsm_pl_data_hash);
-
-  for (i = 0; i < _all_lsm_conn_array->len; ++i)
-    {
-      lsm_conn = g_ptr_array_index (_all_lsm_conn_array, i);
-      if (lsm_conn == NULL)
-        continue;
-
-      lsm_vol_array = _get_supported_lsm_volumes (lsm_conn);
-      if (lsm_vol_array == NULL)
-        continue;
-      lsm_pl_array = _get_supported_lsm_pls (lsm_conn);
-
-      _fill_pl_id_2_lsm_pl_data_hash (lsm_pl_array, g_get_monotonic_time ());
-      _fill_vpd83_2_lsm_conn_data_hash (lsm_conn, lsm_vol_array);
-      g_ptr_array_unref (lsm_vol_array);
-      g_ptr_array_unref (lsm_pl_array);
-    }
+  _lsm_conn_workers_full_refresh ();
 }
 
 gboolean
 std_lsm_vpd83_is_managed (const char *vpd83)
 {
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&_lsm_data_mutex);
   if ((vpd83 != NULL) &&
       (_vpd83_2_lsm_conn_data_hash != NULL) &&
       g_hash_table_lookup (_vpd83_2_lsm_conn_data_hash, vpd83))
-    return TRUE;
-  return FALSE;
+    ret = TRUE;
+  g_mutex_unlock (&_lsm_data_mutex);
+
+  return ret;
 }
@@ -347,7 +347,9 @@ udisks_linux_drive_lsm_update (UDisksLinuxDriveLSM *std_lx_drv_lsm,
   g_object_add_weak_pointer ((GObject *) std_lx_drv_obj,
                              (gpointer *) &std_lx_drv_lsm->std_lx_drv_obj);
   std_lx_drv_lsm->loop_source =
-    g_timeout_source_new_seconds (std_lsm_refresh_time_get ());
+    udisks_daemon_util_timeout_source_new (udisks_linux_drive_object_get_daemon (std_lx_drv_obj),
+                                           "lsm-refresh",
+                                           std_lsm_refresh_time_get ());
   g_source_set_callback (std_lx_drv_lsm->loop_source,
                          (GSourceFunc) _on_refresh_data,
                          (gpointer) std_lx_drv_lsm, NULL);
@@ -25,9 +25,145 @@
 #include <blockdev/utils.h>
 
 #include <src/udisksthreadedjob.h>
+#include <src/udisksdaemon.h>
 
 #include "jobhelpers.h"
 
+struct _VGJobQueue {
+  GMutex lock;
+  GCond cond;
+  /* the jobs waiting for their turn, the head is the one running */
+  GQueue waiting;
+};
+
+typedef struct {
+  VGJobQueue *queue;
+  UDisksThreadedJobFunc job_func;
+  gpointer user_data;
+} VGQueuedJob;
+
+VGJobQueue *
+vg_job_queue_new (void)
+{
+  VGJobQueue *queue = g_new0 (VGJobQueue, 1);
+
+  g_mutex_init (&queue->lock);
+  g_cond_init (&queue->cond);
+  g_queue_init (&queue->waiting);
+
+  return queue;
+}
+
+void
+vg_job_queue_free (VGJobQueue *queue)
+{
+  g_warn_if_fail (g_queue_is_empty (&queue->waiting));
+
+  g_mutex_clear (&queue->lock);
+  g_cond_clear (&queue->cond);
+  g_free (queue);
+}
+
+static void
+vg_queued_job_cancelled (GCancellable *cancellable,
+                         gpointer      user_data)
+{
+  VGJobQueue *queue = user_data;
+
+  g_mutex_lock (&queue->lock);
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+}
+
+static gboolean
+vg_queued_job_func (UDisksThreadedJob  *job,
+                    GCancellable       *cancellable,
+                    gpointer            user_data,
+                    GError            **error)
+{
+  VGQueuedJob *queued = user_data;
+  VGJobQueue *queue = queued->queue;
+  gulong handler_id = 0;
+  gboolean ret = FALSE;
+
+  if (cancellable != NULL)
+    handler_id = g_cancellable_connect (cancellable, G_CALLBACK (vg_queued_job_cancelled), queue, NULL);
+
+  /* wait for all the jobs that started before this one on the same VG */
+  g_mutex_lock (&queue->lock);
+  g_queue_push_tail (&queue->waiting, queued);
+  while (g_queue_peek_head (&queue->waiting) != queued
+         && !g_cancellable_is_cancelled (cancellable))
+    g_cond_wait (&queue->cond, &queue->lock);
+
+  if (g_queue_peek_head (&queue->waiting) != queued)
+    {
+      g_queue_remove (&queue->waiting, queued);
+      g_mutex_unlock (&queue->lock);
+      g_cancellable_set_error_if_cancelled (cancellable, error);
+      goto out;
+    }
+  g_mutex_unlock (&queue->lock);
+
+  ret = queued->job_func (job, cancellable, queued->user_data, error);
+
+  g_mutex_lock (&queue->lock);
+  g_queue_pop_head (&queue->waiting);
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+
+ out:
+  /* must not be called with the lock held, it waits for the handler */
+  g_cancellable_disconnect (cancellable, handler_id);
+  return ret;
+}
+
+/**
+ * vg_job_queue_launch_sync:
+ * @queue: The #VGJobQueue of the volume group the job operates on.
+ *
+ * Like udisks_daemon_launch_threaded_job_sync(), but @job_func only runs
+ * once all the jobs launched through @queue before have finished. The
+ * job is visible (and can be cancelled) while it waits for its turn.
+ *
+ * Jobs on different volume groups use different queues and still run
+ * in parallel.
+ */
+gboolean
+vg_job_queue_launch_sync (VGJobQueue             *queue,
+                          UDisksDaemon           *daemon,
+                          UDisksObject           *object,
+                          const gchar            *job_operation,
+                          uid_t                   job_started_by_uid,
+                          UDisksThreadedJobFunc   job_func,
+                          gpointer                user_data,
+                          GDestroyNotify          user_data_free_func,
+                          GCancellable           *cancellable,
+                          GError                **error)
+{
+  VGQueuedJob queued;
+  gboolean ret;
+
+  queued.queue = queue;
+  queued.job_func = job_func;
+  queued.user_data = user_data;
+
+  ret = udisks_daemon_launch_threaded_job_sync (daemon,
+                                                object,
+                                                job_operation,
+                                                job_started_by_uid,
+                                                vg_queued_job_func,
+                                                &queued,
+                                                NULL, /* user_data_free_func */
+                                                cancellable,
+                                                error);
+
+  if (user_data_free_func != NULL)
+    user_data_free_func (user_data);
+
+  return ret;
+}
+
 gboolean lvcreate_job_func (UDisksThreadedJob  *job,
                             GCancellable       *cancellable,
                             gpointer            user_data,
@@ -72,6 +208,59 @@ gboolean lvcreate_thin_job_func (UDisksThreadedJob  *job,
     return bd_lvm_thlvcreate (data->vg_name, data->pool_name, data->new_lv_name, data->new_lv_size, NULL /* extra_args */, error);
 }
 
+gboolean lvcreate_batch_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error)
+{
+    LVBatchJobData *data = user_data;
+
+    for (guint i = 0; i < data->lvs->len; i++)
+      {
+        LVJobData *lv_data = g_ptr_array_index (data->lvs, i);
+        gboolean ret;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+          return FALSE;
+
+        if (lv_data->pool_name)
+          ret = bd_lvm_thlvcreate (data->vg_name, lv_data->pool_name, lv_data->new_lv_name, lv_data->new_lv_size, NULL /* extra_args */, error);
+        else
+          ret = bd_lvm_lvcreate (data->vg_name, lv_data->new_lv_name, lv_data->new_lv_size, NULL /* type */, NULL /* pvs */, NULL /* extra_args */, error);
+        if (!ret)
+          {
+            g_prefix_error (error, "Error creating '%s': ", lv_data->new_lv_name);
+            return FALSE;
+          }
+      }
+
+    return TRUE;
+}
+
+gboolean lvremove_batch_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error)
+{
+    LVBatchJobData *data = user_data;
+
+    for (guint i = 0; i < data->lvs->len; i++)
+      {
+        LVJobData *lv_data = g_ptr_array_index (data->lvs, i);
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+          return FALSE;
+
+        if (!bd_lvm_lvremove (data->vg_name, lv_data->lv_name, TRUE /* force */, NULL /* extra_args */, error))
+          {
+            g_prefix_error (error, "Error deleting '%s': ", lv_data->lv_name);
+            return FALSE;
+          }
+      }
+
+    return TRUE;
+}
+
 gboolean lvremove_job_func (UDisksThreadedJob  *job,
                             GCancellable       *cancellable,
                             gpointer            user_data,
@@ -298,6 +487,46 @@ void vgs_task_func (GTask        *task,
     g_task_return_pointer (task, ret, (GDestroyNotify) vgs_pvs_data_free);
 }
 
+void vg_pvs_names_free (VGPVsNames *names) {
+  g_free (names->vg_name);
+  g_strfreev (names->pv_names);
+  g_free (names);
+}
+
+/* Like vgs_task_func() but only reports the VG and PVs named in the
+ * VGPVsNames task data, 'vgs' holds just the one VG.
+ */
+void vg_task_func (GTask        *task,
+                   gpointer      source_obj,
+                   gpointer      task_data,
+                   GCancellable *cancellable)
+{
+  GError *error = NULL;
+  VGPVsNames *names = task_data;
+  VGsPVsData *ret = g_new0 (VGsPVsData, 1);
+  guint n_pvs = names->pv_names ? g_strv_length (names->pv_names) : 0;
+
+  ret->vgs = g_new0 (BDLVMVGdata *, 2);
+  ret->vgs[0] = bd_lvm_vginfo (names->vg_name, &error);
+  if (!ret->vgs[0]) {
+    vgs_pvs_data_free (ret);
+    g_task_return_error (task, error);
+    return;
+  }
+
+  ret->pvs = g_new0 (BDLVMPVdata *, n_pvs + 1);
+  for (guint i = 0; i < n_pvs; i++) {
+    ret->pvs[i] = bd_lvm_pvinfo (names->pv_names[i], &error);
+    if (!ret->pvs[i]) {
+      vgs_pvs_data_free (ret);
+      g_task_return_error (task, error);
+      return;
+    }
+  }
+
+  g_task_return_pointer (task, ret, (GDestroyNotify) vgs_pvs_data_free);
+}
+
 void lvs_task_func (GTask        *task,
                     gpointer      source_obj,
                     gpointer      task_data,
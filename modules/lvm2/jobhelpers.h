@@ -26,8 +26,11 @@
 #include <glib.h>
 #include <blockdev/lvm.h>
 
+#include <src/udisksdaemontypes.h>
 #include <src/udisksthreadedjob.h>
 
+#include "udiskslvm2types.h"
+
 G_BEGIN_DECLS
 
 typedef struct {
@@ -42,6 +45,12 @@ typedef struct {
   gboolean destroy;
 } LVJobData;
 
+typedef struct {
+  const gchar *vg_name;
+  /* LVJobData for each LV, in order */
+  GPtrArray *lvs;
+} LVBatchJobData;
+
 typedef struct {
   const gchar *vg_name;
   const gchar *new_vg_name;
@@ -58,6 +67,11 @@ typedef struct {
   BDLVMPVdata **pvs;
 } VGsPVsData;
 
+typedef struct {
+  gchar *vg_name;
+  gchar **pv_names;
+} VGPVsNames;
+
 gboolean lvcreate_job_func (UDisksThreadedJob  *job,
                             GCancellable       *cancellable,
                             gpointer            user_data,
@@ -73,6 +87,16 @@ gboolean lvcreate_thin_job_func (UDisksThreadedJob  *job,
                                  gpointer            user_data,
                                  GError            **error);
 
+gboolean lvcreate_batch_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error);
+
+gboolean lvremove_batch_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error);
+
 gboolean lvremove_job_func (UDisksThreadedJob  *job,
                             GCancellable       *cancellable,
                             gpointer            user_data,
@@ -156,16 +180,37 @@ gboolean pvmove_job_func (UDisksThreadedJob  *job,
                           GError            **error);
 
 
+/* Serializes the jobs operating on one VG in the order they start */
+VGJobQueue *vg_job_queue_new  (void);
+void        vg_job_queue_free (VGJobQueue *queue);
+
+gboolean vg_job_queue_launch_sync (VGJobQueue             *queue,
+                                   UDisksDaemon           *daemon,
+                                   UDisksObject           *object,
+                                   const gchar            *job_operation,
+                                   uid_t                   job_started_by_uid,
+                                   UDisksThreadedJobFunc   job_func,
+                                   gpointer                user_data,
+                                   GDestroyNotify          user_data_free_func,
+                                   GCancellable           *cancellable,
+                                   GError                **error);
+
 void vg_list_free (BDLVMVGdata **vg_list);
 void pv_list_free (BDLVMPVdata **pv_list);
 void lv_list_free (BDLVMLVdata **lv_list);
 void vgs_pvs_data_free (VGsPVsData *data);
+void vg_pvs_names_free (VGPVsNames *names);
 
 void vgs_task_func (GTask        *task,
                     gpointer      source_obj,
                     gpointer      task_data,
                     GCancellable *cancellable);
 
+void vg_task_func (GTask        *task,
+                   gpointer      source_obj,
+                   gpointer      task_data,
+                   GCancellable *cancellable);
+
 void lvs_task_func (GTask        *task,
                     gpointer      source_obj,
                     gpointer      task_data,
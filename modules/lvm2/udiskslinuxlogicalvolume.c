@@ -30,6 +30,7 @@
 #include <src/udisksdaemon.h>
 #include <src/udisksstate.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslinuxblock.h>
 
@@ -66,6 +67,8 @@ struct _UDisksLinuxLogicalVolume
   UDisksLogicalVolumeSkeleton parent_instance;
 
   gboolean needs_udev_hack;
+  /* whether the usage was above the watermark in the last update */
+  gboolean above_watermark;
 };
 
 struct _UDisksLinuxLogicalVolumeClass
@@ -91,8 +94,6 @@ static void
 udisks_linux_logical_volume_init (UDisksLinuxLogicalVolume *logical_volume)
 {
   logical_volume->needs_udev_hack = TRUE;
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (logical_volume),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
@@ -117,6 +118,8 @@ udisks_linux_logical_volume_class_init (UDisksLinuxLogicalVolumeClass *klass)
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize    = udisks_linux_logical_volume_finalize;
   gobject_class->constructed = udisks_linux_logical_volume_constructed;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -171,7 +174,10 @@ udisks_linux_logical_volume_update (UDisksLinuxLogicalVolume     *logical_volume
       gchar state       = lv_info->attr[4];
       gchar target_type = lv_info->attr[6];
 
-      if (target_type == 't')
+      /* thin pools and thin volumes are sampled by the volume group
+       * object unless that has been disabled
+       */
+      if (target_type == 't' && udisks_daemon_util_lvm2_get_thin_pool_sample_interval (udisks_linux_volume_group_object_get_daemon (group_object)) == 0)
         *needs_polling_ret = TRUE;
 
       if (target_type == 't' && volume_type == 't')
@@ -195,8 +201,10 @@ udisks_linux_logical_volume_update (UDisksLinuxLogicalVolume     *logical_volume
   if (!active)
     udisks_logical_volume_set_block_device (iface, "/");
 
-  udisks_logical_volume_set_data_allocated_ratio (iface, lv_info->data_percent / 100.0);
-  udisks_logical_volume_set_metadata_allocated_ratio (iface, lv_info->metadata_percent / 100.0);
+  udisks_linux_logical_volume_update_allocation (logical_volume,
+                                                 group_object,
+                                                 lv_info->data_percent / 100.0,
+                                                 lv_info->metadata_percent / 100.0);
 
   pool_objpath = "/";
   if (lv_info->pool_lv)
@@ -234,6 +242,45 @@ udisks_linux_logical_volume_update (UDisksLinuxLogicalVolume     *logical_volume
     }
 }
 
+/**
+ * udisks_linux_logical_volume_update_allocation:
+ * @logical_volume: A #UDisksLinuxLogicalVolume.
+ * @group_object: The volume group of @logical_volume.
+ * @data_ratio: How full the data area is.
+ * @metadata_ratio: How full the metadata area is.
+ *
+ * Updates the allocation ratios of @logical_volume and emits
+ * #UDisksLogicalVolume::watermark-reached if one of them passed the
+ * configured watermark since the last update.
+ */
+void
+udisks_linux_logical_volume_update_allocation (UDisksLinuxLogicalVolume     *logical_volume,
+                                               UDisksLinuxVolumeGroupObject *group_object,
+                                               gdouble                       data_ratio,
+                                               gdouble                       metadata_ratio)
+{
+  UDisksLogicalVolume *iface = UDISKS_LOGICAL_VOLUME (logical_volume);
+  UDisksDaemon *daemon = udisks_linux_volume_group_object_get_daemon (group_object);
+  gdouble watermark;
+  gboolean above_watermark;
+
+  watermark = udisks_daemon_util_lvm2_get_thin_pool_watermark (daemon);
+
+  udisks_logical_volume_set_data_allocated_ratio (iface, data_ratio);
+  udisks_logical_volume_set_metadata_allocated_ratio (iface, metadata_ratio);
+
+  above_watermark = data_ratio >= watermark || metadata_ratio >= watermark;
+  if (above_watermark && !logical_volume->above_watermark)
+    {
+      udisks_notice ("Logical volume %s/%s reached the watermark: %.1f%% data, %.1f%% metadata used",
+                     udisks_linux_volume_group_object_get_name (group_object),
+                     udisks_logical_volume_get_name (iface),
+                     data_ratio * 100, metadata_ratio * 100);
+      udisks_logical_volume_emit_watermark_reached (iface, data_ratio, metadata_ratio);
+    }
+  logical_volume->above_watermark = above_watermark;
+}
+
 void
 udisks_linux_logical_volume_update_etctabs (UDisksLinuxLogicalVolume     *logical_volume,
                                             UDisksLinuxVolumeGroupObject *group_object)
@@ -457,15 +504,16 @@ handle_delete (UDisksLogicalVolume   *_volume,
   data.vg_name = udisks_linux_volume_group_object_get_name (group_object);
   data.lv_name = udisks_linux_logical_volume_object_get_name (object);
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lvol-delete",
-                                               caller_uid,
-                                               lvremove_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-delete",
+                                 caller_uid,
+                                 lvremove_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -484,6 +532,7 @@ handle_delete (UDisksLogicalVolume   *_volume,
                                                          &wait_data,
                                                          NULL,
                                                          10, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &error))
     {
       g_prefix_error (&error,
@@ -519,6 +568,7 @@ wait_for_logical_volume_object (UDisksDaemon *daemon,
 static const gchar *
 wait_for_logical_volume_path (UDisksLinuxVolumeGroupObject  *group_object,
                               const gchar                   *name,
+                              GCancellable                  *cancellable,
                               GError                       **error)
 {
   struct WaitData data;
@@ -534,6 +584,7 @@ wait_for_logical_volume_path (UDisksLinuxVolumeGroupObject  *group_object,
                                                       &data,
                                                       NULL,
                                                       10, /* timeout_seconds */
+                                                      cancellable,
                                                       error);
   if (volume_object == NULL)
     return NULL;
@@ -569,15 +620,16 @@ handle_rename (UDisksLogicalVolume   *_volume,
   data.lv_name = udisks_linux_logical_volume_object_get_name (object);
   data.new_lv_name = new_name;
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lvol-rename",
-                                               caller_uid,
-                                               lvrename_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-rename",
+                                 caller_uid,
+                                 lvrename_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -588,7 +640,9 @@ handle_rename (UDisksLogicalVolume   *_volume,
       goto out;
     }
 
-  lv_objpath = wait_for_logical_volume_path (group_object, new_name, &error);
+  lv_objpath = wait_for_logical_volume_path (group_object, new_name,
+                                             udisks_daemon_util_get_invocation_cancellable (invocation),
+                                             &error);
   if (lv_objpath == NULL)
     {
       g_prefix_error (&error,
@@ -636,15 +690,16 @@ handle_resize (UDisksLogicalVolume   *_volume,
   g_variant_lookup (options, "resize_fsys", "b", &(data.resize_fs));
   g_variant_lookup (options, "force", "b", &(data.force));
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lvol-resize",
-                                               caller_uid,
-                                               lvresize_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-resize",
+                                 caller_uid,
+                                 lvresize_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -724,15 +779,16 @@ handle_activate (UDisksLogicalVolume *_volume,
   data.vg_name = udisks_linux_volume_group_object_get_name (group_object);
   data.lv_name = udisks_linux_logical_volume_object_get_name (object);
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lvol-activate",
-                                               caller_uid,
-                                               lvactivate_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-activate",
+                                 caller_uid,
+                                 lvactivate_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
 
     {
       g_dbus_method_invocation_return_error (invocation,
@@ -749,6 +805,7 @@ handle_activate (UDisksLogicalVolume *_volume,
                                                      object,
                                                      NULL,
                                                      10, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                      &error);
   if (block_object == NULL)
     {
@@ -792,15 +849,16 @@ handle_deactivate (UDisksLogicalVolume   *_volume,
   data.vg_name = udisks_linux_volume_group_object_get_name (group_object);
   data.lv_name = udisks_linux_logical_volume_object_get_name (object);
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lvol-deactivate",
-                                               caller_uid,
-                                               lvdeactivate_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-deactivate",
+                                 caller_uid,
+                                 lvdeactivate_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -816,6 +874,7 @@ handle_deactivate (UDisksLogicalVolume   *_volume,
                                                          object,
                                                          NULL,
                                                          10, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &error))
     {
       g_prefix_error (&error,
@@ -861,15 +920,16 @@ handle_create_snapshot (UDisksLogicalVolume   *_volume,
   data.new_lv_name = name;
   data.new_lv_size = size;
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lvol-snapshot",
-                                               caller_uid,
-                                               lvsnapshot_create_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-snapshot",
+                                 caller_uid,
+                                 lvsnapshot_create_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -880,7 +940,9 @@ handle_create_snapshot (UDisksLogicalVolume   *_volume,
       goto out;
     }
 
-  lv_objpath = wait_for_logical_volume_path (group_object, name, &error);
+  lv_objpath = wait_for_logical_volume_path (group_object, name,
+                                             udisks_daemon_util_get_invocation_cancellable (invocation),
+                                             &error);
   if (lv_objpath == NULL)
     {
       g_prefix_error (&error,
@@ -931,15 +993,16 @@ handle_cache_attach (UDisksLogicalVolume   *volume_,
   data.lv_name = udisks_linux_logical_volume_object_get_name (object);
   data.pool_name = cache_name;
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lv-make-cache",
-                                               caller_uid,
-                                               lvcache_attach_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lv-make-cache",
+                                 caller_uid,
+                                 lvcache_attach_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -994,15 +1057,16 @@ handle_cache_detach_or_split (UDisksLogicalVolume  *volume_,
   data.lv_name = udisks_linux_logical_volume_object_get_name (object);
   data.destroy = destroy;
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-lv-split-cache",
-                                               caller_uid,
-                                               lvcache_detach_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (group_object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lv-split-cache",
+                                 caller_uid,
+                                 lvcache_detach_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
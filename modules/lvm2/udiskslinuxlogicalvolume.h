@@ -41,6 +41,10 @@ void                 udisks_linux_logical_volume_update   (UDisksLinuxLogicalVol
                                                            BDLVMLVdata                  *lv_info,
                                                            BDLVMLVdata                  *meta_lv_info,
                                                            gboolean                     *needs_polling_ret);
+void                 udisks_linux_logical_volume_update_allocation (UDisksLinuxLogicalVolume     *logical_volume,
+                                                                    UDisksLinuxVolumeGroupObject *group_object,
+                                                                    gdouble                       data_ratio,
+                                                                    gdouble                       metadata_ratio);
 void                   udisks_linux_logical_volume_update_etctabs (UDisksLinuxLogicalVolume     *logical_volume,
                                                                    UDisksLinuxVolumeGroupObject *group_object);
 
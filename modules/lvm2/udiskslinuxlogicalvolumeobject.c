@@ -306,6 +306,18 @@ udisks_linux_logical_volume_object_update (UDisksLinuxLogicalVolumeObject *objec
                                       needs_polling_ret);
 }
 
+void
+udisks_linux_logical_volume_object_update_allocation (UDisksLinuxLogicalVolumeObject *object,
+                                                      gdouble                         data_ratio,
+                                                      gdouble                         metadata_ratio)
+{
+  g_return_if_fail (UDISKS_IS_LINUX_LOGICAL_VOLUME_OBJECT (object));
+
+  udisks_linux_logical_volume_update_allocation (UDISKS_LINUX_LOGICAL_VOLUME (object->iface_logical_volume),
+                                                 object->volume_group,
+                                                 data_ratio, metadata_ratio);
+}
+
 void
 udisks_linux_logical_volume_object_update_etctabs (UDisksLinuxLogicalVolumeObject *object)
 {
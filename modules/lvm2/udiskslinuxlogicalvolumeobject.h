@@ -48,6 +48,9 @@ void                            udisks_linux_logical_volume_object_update
                                                                                      BDLVMLVdata                    *meta_lv_info,
                                                                                      gboolean                       *needs_polling_ret);
 void                            udisks_linux_logical_volume_object_update_etctabs   (UDisksLinuxLogicalVolumeObject *object);
+void                            udisks_linux_logical_volume_object_update_allocation (UDisksLinuxLogicalVolumeObject *object,
+                                                                                      gdouble                         data_ratio,
+                                                                                      gdouble                         metadata_ratio);
 
 
 G_END_DECLS
@@ -32,6 +32,7 @@
 #include <src/udiskslogging.h>
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslinuxblockobject.h>
 
@@ -129,8 +130,6 @@ udisks_linux_manager_lvm2_set_property (GObject      *object,
 static void
 udisks_linux_manager_lvm2_init (UDisksLinuxManagerLVM2 *manager)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (manager),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
@@ -157,6 +156,8 @@ udisks_linux_manager_lvm2_class_init (UDisksLinuxManagerLVM2Class *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -377,6 +378,7 @@ handle_volume_group_create (UDisksManagerLVM2     *_object,
                                                      (gpointer) arg_name,
                                                      NULL,
                                                      10, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                      &error);
   if (group_object == NULL)
     {
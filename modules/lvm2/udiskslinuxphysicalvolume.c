@@ -29,6 +29,7 @@
 #include <src/udisksdaemon.h>
 #include <src/udisksstate.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslinuxprovider.h>
 
@@ -77,8 +78,6 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxPhysicalVolume, udisks_linux_physical_volume
 static void
 udisks_linux_physical_volume_init (UDisksLinuxPhysicalVolume *physical_volume)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (physical_volume),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
@@ -103,6 +102,8 @@ udisks_linux_physical_volume_class_init (UDisksLinuxPhysicalVolumeClass *klass)
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize    = udisks_linux_physical_volume_finalize;
   gobject_class->constructed = udisks_linux_physical_volume_constructed;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
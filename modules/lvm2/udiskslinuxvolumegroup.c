@@ -40,6 +40,7 @@
 #include <src/udisksdaemon.h>
 #include <src/udisksstate.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslinuxblock.h>
 #include <src/udiskslinuxblockobject.h>
@@ -100,8 +101,6 @@ udisks_linux_volume_group_finalize (GObject *object)
 static void
 udisks_linux_volume_group_init (UDisksLinuxVolumeGroup *volume_group)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (volume_group),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
@@ -111,6 +110,8 @@ udisks_linux_volume_group_class_init (UDisksLinuxVolumeGroupClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize = udisks_linux_volume_group_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -314,15 +315,16 @@ handle_delete (UDisksVolumeGroup     *_group,
 
   data.vg_name = udisks_linux_volume_group_object_get_name (object);
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-vg-delete",
-                                               caller_uid,
-                                               vgremove_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-vg-delete",
+                                 caller_uid,
+                                 vgremove_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -410,15 +412,16 @@ handle_rename (UDisksVolumeGroup     *_group,
   data.vg_name = udisks_linux_volume_group_object_get_name (object);
   data.new_vg_name = new_name;
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-vg-rename",
-                                               caller_uid,
-                                               vgrename_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-vg-rename",
+                                 caller_uid,
+                                 vgrename_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -434,6 +437,7 @@ handle_rename (UDisksVolumeGroup     *_group,
                                                      (gpointer) new_name,
                                                      NULL,
                                                      10, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                      &error);
   if (group_object == NULL)
     {
@@ -559,15 +563,16 @@ handle_add_device (UDisksVolumeGroup     *_group,
   data.vg_name = udisks_linux_volume_group_object_get_name (object);
   data.pv_path = udisks_block_get_device (new_member_device);
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-vg-add-device",
-                                               caller_uid,
-                                               vgextend_job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-vg-add-device",
+                                 caller_uid,
+                                 vgextend_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -676,15 +681,16 @@ handle_remove_common (UDisksVolumeGroup     *_group,
 
   data.pv_path = udisks_block_get_device (member_device);
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               job_operation,
-                                               caller_uid,
-                                               job_func,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 job_operation,
+                                 caller_uid,
+                                 job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -777,6 +783,7 @@ wait_for_logical_volume_object (UDisksDaemon *daemon,
 static const gchar *
 wait_for_logical_volume_path (UDisksLinuxVolumeGroupObject  *group_object,
                               const gchar                   *name,
+                              GCancellable                  *cancellable,
                               GError                       **error)
 {
   struct WaitData data;
@@ -792,6 +799,7 @@ wait_for_logical_volume_path (UDisksLinuxVolumeGroupObject  *group_object,
                                                       &data,
                                                       NULL,
                                                       10, /* timeout_seconds */
+                                                      cancellable,
                                                       error);
   if (volume_object == NULL)
     return NULL;
@@ -896,15 +904,16 @@ handle_create_volume (UDisksVolumeGroup              *_group,
       data.pool_name = udisks_linux_logical_volume_object_get_name (pool_object);
     }
 
-  if (!udisks_daemon_launch_threaded_job_sync (daemon,
-                                               UDISKS_OBJECT (object),
-                                               "lvm-vg-create-volume",
-                                               caller_uid,
-                                               create_function,
-                                               &data,
-                                               NULL, /* user_data_free_func */
-                                               NULL, /* GCancellable */
-                                               &error))
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-vg-create-volume",
+                                 caller_uid,
+                                 create_function,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
     {
       g_dbus_method_invocation_return_error (invocation,
                                              UDISKS_ERROR,
@@ -915,7 +924,9 @@ handle_create_volume (UDisksVolumeGroup              *_group,
       goto out;
     }
 
-  lv_objpath = wait_for_logical_volume_path (object, arg_name, &error);
+  lv_objpath = wait_for_logical_volume_path (object, arg_name,
+                                             udisks_daemon_util_get_invocation_cancellable (invocation),
+                                             &error);
   if (lv_objpath == NULL)
     {
       g_prefix_error (&error,
@@ -973,6 +984,321 @@ handle_create_thin_volume (UDisksVolumeGroup     *_group,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+struct WaitBatchData {
+  UDisksLinuxVolumeGroupObject *group_object;
+  GPtrArray *lvs;
+};
+
+/* Returns the group object while any of the LVs is still missing (or
+ * still present if @missing is FALSE)
+ */
+static UDisksObject *
+wait_for_logical_volume_objects_common (struct WaitBatchData *data,
+                                        gboolean              missing)
+{
+  for (guint i = 0; i < data->lvs->len; i++)
+    {
+      LVJobData *lv_data = g_ptr_array_index (data->lvs, i);
+      const gchar *name = lv_data->new_lv_name ? lv_data->new_lv_name : lv_data->lv_name;
+
+      if ((udisks_linux_volume_group_object_find_logical_volume_object (data->group_object, name) == NULL) == missing)
+        return g_object_ref (UDISKS_OBJECT (data->group_object));
+    }
+
+  return NULL;
+}
+
+static UDisksObject *
+wait_for_all_logical_volume_objects (UDisksDaemon *daemon,
+                                     gpointer      user_data)
+{
+  struct WaitBatchData *data = user_data;
+  UDisksObject *object;
+
+  object = wait_for_logical_volume_objects_common (data, TRUE);
+  if (object != NULL)
+    {
+      g_object_unref (object);
+      return NULL;
+    }
+
+  return g_object_ref (UDISKS_OBJECT (data->group_object));
+}
+
+static UDisksObject *
+wait_for_any_logical_volume_object (UDisksDaemon *daemon,
+                                    gpointer      user_data)
+{
+  return wait_for_logical_volume_objects_common (user_data, FALSE);
+}
+
+static gboolean
+handle_create_volumes (UDisksVolumeGroup     *_group,
+                       GDBusMethodInvocation *invocation,
+                       GVariant              *arg_volumes,
+                       GVariant              *options)
+{
+  GError *error = NULL;
+  UDisksLinuxVolumeGroup *group = UDISKS_LINUX_VOLUME_GROUP (_group);
+  UDisksLinuxVolumeGroupObject *object = NULL;
+  UDisksDaemon *daemon;
+  uid_t caller_uid;
+  LVBatchJobData data;
+  struct WaitBatchData wait_data;
+  UDisksObject *wait_object;
+  GPtrArray *lv_objpaths = NULL;
+  GVariantIter iter;
+  const gchar *name;
+  guint64 size;
+  const gchar *pool;
+
+  data.lvs = g_ptr_array_new_with_free_func (g_free);
+
+  object = udisks_daemon_util_dup_object (group, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_volume_group_object_get_daemon (object);
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  /* Policy check. */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (daemon,
+                                     UDISKS_OBJECT (object),
+                                     lvm2_policy_action_id,
+                                     options,
+                                     N_("Authentication is required to create logical volumes"),
+                                     invocation);
+
+  data.vg_name = udisks_linux_volume_group_object_get_name (object);
+
+  g_variant_iter_init (&iter, arg_volumes);
+  while (g_variant_iter_next (&iter, "(&st&o)", &name, &size, &pool))
+    {
+      LVJobData *lv_data = g_new0 (LVJobData, 1);
+
+      lv_data->new_lv_name = name;
+      lv_data->new_lv_size = size;
+      g_ptr_array_add (data.lvs, lv_data);
+
+      if (g_strcmp0 (pool, "/") != 0)
+        {
+          UDisksLinuxLogicalVolumeObject *pool_object;
+
+          pool_object = UDISKS_LINUX_LOGICAL_VOLUME_OBJECT (udisks_daemon_find_object (daemon, pool));
+          if (pool_object == NULL || !UDISKS_IS_LINUX_LOGICAL_VOLUME_OBJECT (pool_object)
+              || udisks_linux_logical_volume_object_get_volume_group (pool_object) != object)
+            {
+              g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                     "%s is not a logical volume in this volume group", pool);
+              g_clear_object (&pool_object);
+              goto out;
+            }
+          /* the name is owned by the object which is kept alive by the group */
+          lv_data->pool_name = udisks_linux_logical_volume_object_get_name (pool_object);
+          g_object_unref (pool_object);
+        }
+    }
+
+  if (data.lvs->len == 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "No volumes to create");
+      goto out;
+    }
+
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-vg-create-volume",
+                                 caller_uid,
+                                 lvcreate_batch_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Error creating volumes: %s",
+                                             error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  wait_data.group_object = object;
+  wait_data.lvs = data.lvs;
+  wait_object = udisks_daemon_wait_for_object_sync (daemon,
+                                                    wait_for_all_logical_volume_objects,
+                                                    &wait_data,
+                                                    NULL,
+                                                    10 + data.lvs->len, /* timeout_seconds */
+                                                    udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                    &error);
+  if (wait_object == NULL)
+    {
+      g_prefix_error (&error, "Error waiting for the logical volume objects: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  g_object_unref (wait_object);
+
+  lv_objpaths = g_ptr_array_new ();
+  for (guint i = 0; i < data.lvs->len; i++)
+    {
+      LVJobData *lv_data = g_ptr_array_index (data.lvs, i);
+      UDisksLinuxLogicalVolumeObject *volume;
+
+      volume = udisks_linux_volume_group_object_find_logical_volume_object (object, lv_data->new_lv_name);
+      g_ptr_array_add (lv_objpaths, (gpointer) g_dbus_object_get_object_path (G_DBUS_OBJECT (volume)));
+    }
+  g_ptr_array_add (lv_objpaths, NULL);
+
+  udisks_volume_group_complete_create_volumes (_group, invocation, (const gchar *const *) lv_objpaths->pdata);
+
+ out:
+  if (lv_objpaths != NULL)
+    g_ptr_array_free (lv_objpaths, TRUE);
+  g_ptr_array_free (data.lvs, TRUE);
+  g_clear_object (&object);
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+handle_delete_volumes (UDisksVolumeGroup     *_group,
+                       GDBusMethodInvocation *invocation,
+                       const gchar *const    *arg_volumes,
+                       GVariant              *options)
+{
+  GError *error = NULL;
+  UDisksLinuxVolumeGroup *group = UDISKS_LINUX_VOLUME_GROUP (_group);
+  UDisksLinuxVolumeGroupObject *object = NULL;
+  UDisksDaemon *daemon;
+  uid_t caller_uid;
+  LVBatchJobData data;
+  struct WaitBatchData wait_data;
+
+  data.lvs = g_ptr_array_new_with_free_func (g_free);
+
+  object = udisks_daemon_util_dup_object (group, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_volume_group_object_get_daemon (object);
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  /* Policy check. */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (daemon,
+                                     UDISKS_OBJECT (object),
+                                     lvm2_policy_action_id,
+                                     options,
+                                     N_("Authentication is required to delete logical volumes"),
+                                     invocation);
+
+  data.vg_name = udisks_linux_volume_group_object_get_name (object);
+
+  for (guint i = 0; arg_volumes[i] != NULL; i++)
+    {
+      UDisksLinuxLogicalVolumeObject *volume;
+      LVJobData *lv_data;
+
+      volume = UDISKS_LINUX_LOGICAL_VOLUME_OBJECT (udisks_daemon_find_object (daemon, arg_volumes[i]));
+      if (volume == NULL || !UDISKS_IS_LINUX_LOGICAL_VOLUME_OBJECT (volume)
+          || udisks_linux_logical_volume_object_get_volume_group (volume) != object)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                 "%s is not a logical volume in this volume group", arg_volumes[i]);
+          g_clear_object (&volume);
+          goto out;
+        }
+
+      lv_data = g_new0 (LVJobData, 1);
+      /* the name is owned by the object which is kept alive by the group */
+      lv_data->lv_name = udisks_linux_logical_volume_object_get_name (volume);
+      g_ptr_array_add (data.lvs, lv_data);
+      g_object_unref (volume);
+    }
+
+  if (data.lvs->len == 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "No volumes to delete");
+      goto out;
+    }
+
+  if (!vg_job_queue_launch_sync (udisks_linux_volume_group_object_get_job_queue (object),
+                                 daemon,
+                                 UDISKS_OBJECT (object),
+                                 "lvm-lvol-delete",
+                                 caller_uid,
+                                 lvremove_batch_job_func,
+                                 &data,
+                                 NULL, /* user_data_free_func */
+                                 NULL, /* GCancellable */
+                                 &error))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Error deleting volumes: %s",
+                                             error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  wait_data.group_object = object;
+  wait_data.lvs = data.lvs;
+  if (!udisks_daemon_wait_for_object_to_disappear_sync (daemon,
+                                                        wait_for_any_logical_volume_object,
+                                                        &wait_data,
+                                                        NULL,
+                                                        10 + data.lvs->len, /* timeout_seconds */
+                                                        udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                        &error))
+    {
+      g_prefix_error (&error, "Error waiting for the logical volume objects to disappear: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_volume_group_complete_delete_volumes (_group, invocation);
+
+ out:
+  g_ptr_array_free (data.lvs, TRUE);
+  g_clear_object (&object);
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 volume_group_iface_init (UDisksVolumeGroupIface *iface)
 {
@@ -988,4 +1314,6 @@ volume_group_iface_init (UDisksVolumeGroupIface *iface)
   iface->handle_create_plain_volume = handle_create_plain_volume;
   iface->handle_create_thin_pool_volume = handle_create_thin_pool_volume;
   iface->handle_create_thin_volume = handle_create_thin_volume;
+  iface->handle_create_volumes = handle_create_volumes;
+  iface->handle_delete_volumes = handle_delete_volumes;
 }
@@ -32,6 +32,7 @@
 #include <src/udisksdaemonutil.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslinuxblockobject.h>
+#include <src/udisksmetrics.h>
 
 #include "udiskslinuxvolumegroupobject.h"
 #include "udiskslinuxvolumegroup.h"
@@ -67,10 +68,27 @@ struct _UDisksLinuxVolumeGroupObject
   gchar *name;
 
   GHashTable *logical_volumes;
+  /* device names of the PVs seen in the last update */
+  gchar **pv_names;
   guint32 poll_epoch;
   guint poll_timeout_id;
   gboolean poll_requested;
 
+  /* pvmove in progress, its progress is read from the device-mapper status */
+  gchar *pvmove_lv_name;
+  gchar *pvmove_pv;
+  guint pvmove_timeout_id;
+  guint pvmove_n_mirrors;
+  guint64 pvmove_total;
+  gdouble pvmove_progress;
+  gint64 pvmove_progress_time;
+
+  /* periodic sampling of the thin pool and thin volume usage */
+  guint thin_sample_timeout_id;
+
+  /* jobs operating on this VG run one after another */
+  VGJobQueue *job_queue;
+
   /* interface */
   UDisksVolumeGroup *iface_volume_group;
 };
@@ -109,6 +127,10 @@ udisks_linux_volume_group_object_finalize (GObject *_object)
     g_object_unref (object->iface_volume_group);
 
   g_hash_table_unref (object->logical_volumes);
+  g_strfreev (object->pv_names);
+  vg_job_queue_free (object->job_queue);
+  g_free (object->pvmove_lv_name);
+  g_free (object->pvmove_pv);
   g_free (object->name);
 
   g_signal_handlers_disconnect_by_func (udisks_daemon_get_fstab_monitor (object->daemon),
@@ -180,6 +202,7 @@ udisks_linux_volume_group_object_init (UDisksLinuxVolumeGroupObject *object)
   object->poll_epoch = 0;
   object->poll_timeout_id = 0;
   object->poll_requested = FALSE;
+  object->job_queue = vg_job_queue_new ();
 }
 
 static void
@@ -306,6 +329,38 @@ udisks_linux_volume_group_object_get_daemon (UDisksLinuxVolumeGroupObject *objec
   return object->daemon;
 }
 
+/**
+ * udisks_linux_volume_group_object_get_job_queue: (skip)
+ * @object: A #UDisksLinuxVolumeGroupObject.
+ *
+ * Gets the queue the jobs operating on @object have to be launched
+ * through with vg_job_queue_launch_sync().
+ *
+ * Returns: The queue. Do not free, the queue is owned by @object.
+ */
+VGJobQueue *
+udisks_linux_volume_group_object_get_job_queue (UDisksLinuxVolumeGroupObject *object)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_VOLUME_GROUP_OBJECT (object), NULL);
+  return object->job_queue;
+}
+
+/**
+ * udisks_linux_volume_group_object_get_pv_names:
+ * @object: A #UDisksLinuxVolumeGroupObject.
+ *
+ * Gets the device names of the physical volumes @object had in the
+ * last update.
+ *
+ * Returns: (transfer none) (allow-none): A %NULL-terminated array or %NULL if @object hasn't been updated yet. Do not free, the array is owned by @object.
+ */
+const gchar * const *
+udisks_linux_volume_group_object_get_pv_names (UDisksLinuxVolumeGroupObject *object)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_VOLUME_GROUP_OBJECT (object), NULL);
+  return (const gchar * const *) object->pv_names;
+}
+
 static void
 update_etctabs (UDisksLinuxVolumeGroupObject *object)
 {
@@ -390,22 +445,214 @@ update_progress_for_device (UDisksDaemon *daemon,
   g_list_free_full (objects, g_object_unref);
 }
 
+/* Intervals for reading the progress of a pvmove, the interval is
+ * chosen so that about PVMOVE_POLL_STEPS polls happen in the
+ * estimated remaining time
+ */
+#define PVMOVE_POLL_MIN_SECONDS 1
+#define PVMOVE_POLL_MAX_SECONDS 30
+#define PVMOVE_POLL_INITIAL_SECONDS 2
+#define PVMOVE_POLL_STEPS 20
+
+static void
+pvmove_stop_tracking (UDisksLinuxVolumeGroupObject *object)
+{
+  if (object->pvmove_timeout_id != 0)
+    {
+      g_source_remove (object->pvmove_timeout_id);
+      object->pvmove_timeout_id = 0;
+    }
+  g_clear_pointer (&object->pvmove_lv_name, g_free);
+  g_clear_pointer (&object->pvmove_pv, g_free);
+}
+
+static gboolean pvmove_poll_timeout (gpointer user_data);
+
+static void
+pvmove_schedule_poll (UDisksLinuxVolumeGroupObject *object,
+                      guint                         interval)
+{
+  object->pvmove_timeout_id = udisks_daemon_util_timeout_add_seconds (object->daemon,
+                                                                      "lvm2-pvmove-poll",
+                                                                      interval,
+                                                                      pvmove_poll_timeout,
+                                                                      g_object_ref (object),
+                                                                      g_object_unref);
+}
+
+static gboolean
+pvmove_poll_timeout (gpointer user_data)
+{
+  UDisksLinuxVolumeGroupObject *object = UDISKS_LINUX_VOLUME_GROUP_OBJECT (user_data);
+  guint64 in_sync = 0;
+  guint64 total = 0;
+  guint n_mirrors = 0;
+  gdouble progress;
+  gint64 now;
+  guint interval = PVMOVE_POLL_MAX_SECONDS;
+
+  object->pvmove_timeout_id = 0;
+
+  if (!udisks_daemon_util_lvm2_get_mirror_sync_status (object->name, object->pvmove_lv_name,
+                                                       &in_sync, &total, &n_mirrors, NULL)
+      || n_mirrors == 0
+      || n_mirrors != object->pvmove_n_mirrors
+      || total != object->pvmove_total
+      || in_sync >= total)
+    {
+      /* The pvmove LV is gone, moved on to other segments or
+       * finished - get the new state from a full LV report
+       */
+      pvmove_stop_tracking (object);
+      udisks_linux_volume_group_object_poll (object);
+      return FALSE;
+    }
+
+  progress = (gdouble) in_sync / total;
+  now = g_get_monotonic_time ();
+  update_progress_for_device (object->daemon, "lvm-vg-empty-device", object->pvmove_pv, progress);
+
+  if (progress > object->pvmove_progress && object->pvmove_progress_time > 0)
+    {
+      gdouble rate = (progress - object->pvmove_progress) / (now - object->pvmove_progress_time);
+      gdouble remaining = (1.0 - progress) / rate / G_TIME_SPAN_SECOND;
+      interval = CLAMP (remaining / PVMOVE_POLL_STEPS, PVMOVE_POLL_MIN_SECONDS, PVMOVE_POLL_MAX_SECONDS);
+    }
+  object->pvmove_progress = progress;
+  object->pvmove_progress_time = now;
+
+  pvmove_schedule_poll (object, interval);
+  return FALSE;
+}
+
+static void
+pvmove_start_tracking (UDisksLinuxVolumeGroupObject *object,
+                       BDLVMLVdata                  *lv_info)
+{
+  guint64 in_sync = 0;
+
+  if (object->pvmove_lv_name != NULL)
+    return;
+
+  if (!udisks_daemon_util_lvm2_get_mirror_sync_status (object->name, lv_info->lv_name, &in_sync,
+                                                       &object->pvmove_total, &object->pvmove_n_mirrors, NULL)
+      || object->pvmove_n_mirrors == 0)
+    return;
+
+  object->pvmove_lv_name = g_strdup (lv_info->lv_name);
+  object->pvmove_pv = g_strdup (lv_info->move_pv);
+  object->pvmove_progress = 0;
+  object->pvmove_progress_time = 0;
+  pvmove_schedule_poll (object, PVMOVE_POLL_INITIAL_SECONDS);
+}
+
+static gboolean
+lv_is_active_thin (UDisksLinuxLogicalVolumeObject *volume)
+{
+  UDisksLogicalVolume *iface = udisks_object_peek_logical_volume (UDISKS_OBJECT (volume));
+
+  return iface != NULL
+    && udisks_logical_volume_get_active (iface)
+    && (g_strcmp0 (udisks_logical_volume_get_type_ (iface), "pool") == 0
+        || g_strcmp0 (udisks_logical_volume_get_thin_pool (iface), "/") != 0);
+}
+
+static void
+thin_sampling_stop (UDisksLinuxVolumeGroupObject *object)
+{
+  if (object->thin_sample_timeout_id != 0)
+    {
+      g_source_remove (object->thin_sample_timeout_id);
+      object->thin_sample_timeout_id = 0;
+    }
+}
+
+/* Reads the usage of the active thin pools and thin volumes from the
+ * device-mapper status, so that it's up to date without running lvs
+ * for the whole VG
+ */
+static gboolean
+thin_sample_timeout (gpointer user_data)
+{
+  UDisksLinuxVolumeGroupObject *object = UDISKS_LINUX_VOLUME_GROUP_OBJECT (user_data);
+  GHashTableIter volume_iter;
+  gpointer key, value;
+  gboolean have_thin = FALSE;
+
+  g_hash_table_iter_init (&volume_iter, object->logical_volumes);
+  while (g_hash_table_iter_next (&volume_iter, &key, &value))
+    {
+      UDisksLinuxLogicalVolumeObject *volume = value;
+      gdouble data_ratio, metadata_ratio;
+
+      if (!lv_is_active_thin (volume))
+        continue;
+
+      have_thin = TRUE;
+      if (udisks_daemon_util_lvm2_get_thin_usage (object->name, key, &data_ratio, &metadata_ratio, NULL))
+        udisks_linux_logical_volume_object_update_allocation (volume, data_ratio, metadata_ratio);
+    }
+
+  if (!have_thin)
+    {
+      object->thin_sample_timeout_id = 0;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+thin_sampling_update (UDisksLinuxVolumeGroupObject *object)
+{
+  GHashTableIter volume_iter;
+  gpointer value;
+  guint interval;
+  gboolean have_thin = FALSE;
+
+  interval = udisks_daemon_util_lvm2_get_thin_pool_sample_interval (object->daemon);
+  if (interval == 0 || object->thin_sample_timeout_id != 0)
+    return;
+
+  g_hash_table_iter_init (&volume_iter, object->logical_volumes);
+  while (!have_thin && g_hash_table_iter_next (&volume_iter, NULL, &value))
+    have_thin = lv_is_active_thin (value);
+
+  if (have_thin)
+    object->thin_sample_timeout_id = udisks_daemon_util_timeout_add_seconds (object->daemon,
+                                                                             "lvm2-thin-pool-sample",
+                                                                             interval,
+                                                                             thin_sample_timeout,
+                                                                             g_object_ref (object),
+                                                                             g_object_unref);
+}
+
 static void
-update_operations (UDisksDaemon *daemon,
-                   const gchar  *lv_name,
-                   BDLVMLVdata  *lv_info,
-                   gboolean     *needs_polling_ret)
+update_operations (UDisksLinuxVolumeGroupObject *object,
+                   const gchar                  *lv_name,
+                   BDLVMLVdata                  *lv_info,
+                   gboolean                     *pvmove_seen,
+                   gboolean                     *needs_polling_ret)
 {
   if (lv_is_pvmove_volume (lv_name))
     {
+      *pvmove_seen = TRUE;
       if (lv_info->move_pv && lv_info->copy_percent)
         {
-          update_progress_for_device (daemon,
+          update_progress_for_device (object->daemon,
                                       "lvm-vg-empty-device",
                                       lv_info->move_pv,
                                       lv_info->copy_percent/100.0);
         }
-      *needs_polling_ret = TRUE;
+
+      /* Follow the progress in the device-mapper status of the pvmove
+       * LV, only fall back to having the LVs polled by clients if that
+       * isn't possible
+       */
+      if (lv_info->move_pv)
+        pvmove_start_tracking (object, lv_info);
+      if (object->pvmove_lv_name == NULL)
+        *needs_polling_ret = TRUE;
     }
 }
 
@@ -497,6 +744,8 @@ update_block (UDisksLinuxBlockObject       *block_object,
 
   if (pv_info)
     {
+      udisks_daemon_util_lvm2_forget_unrelated_device (udisks_linux_volume_group_object_get_daemon (group_object),
+                                                       block_object);
       udisks_linux_block_object_update_lvm_pv (block_object, group_object, pv_info);
     }
   else
@@ -508,6 +757,19 @@ update_block (UDisksLinuxBlockObject       *block_object,
     }
 }
 
+static void
+add_block (GHashTable             *blocks,
+           UDisksLinuxBlockObject *block_object)
+{
+  if (block_object == NULL)
+    return;
+
+  if (g_hash_table_contains (blocks, block_object))
+    g_object_unref (block_object);
+  else
+    g_hash_table_add (blocks, block_object);
+}
+
 /**
  * cmp_int_lv_name: (skip)
  *
@@ -547,9 +809,12 @@ update_vg (GObject      *source_obj,
   gpointer key, value;
   GHashTable *new_lvs;
   GHashTable *new_pvs;
-  GList *objects, *l;
+  GPtrArray *pv_names;
+  GHashTable *blocks;
   gboolean needs_polling = FALSE;
+  gboolean pvmove_seen = FALSE;
   GError *error = NULL;
+  gint64 start_time = g_get_monotonic_time ();
 
   UDisksLinuxVolumeGroupObject *object = UDISKS_LINUX_VOLUME_GROUP_OBJECT (source_obj);
   GTask *task = G_TASK (result);
@@ -588,7 +853,7 @@ update_vg (GObject      *source_obj,
   udisks_linux_volume_group_update (UDISKS_LINUX_VOLUME_GROUP (object->iface_volume_group), vg_info, &needs_polling);
 
   if (!g_dbus_object_manager_server_is_exported (manager, G_DBUS_OBJECT_SKELETON (object)))
-    g_dbus_object_manager_server_export_uniquely (manager, G_DBUS_OBJECT_SKELETON (object));
+    udisks_daemon_export_object_uniquely (daemon, G_DBUS_OBJECT_SKELETON (object));
 
   new_lvs = g_hash_table_new (g_str_hash, g_str_equal);
 
@@ -599,7 +864,7 @@ update_vg (GObject      *source_obj,
       const gchar *lv_name = lv_info->lv_name;
       BDLVMLVdata *meta_lv_info = NULL;
 
-      update_operations (daemon, lv_name, lv_info, &needs_polling);
+      update_operations (object, lv_name, lv_info, &pvmove_seen, &needs_polling);
 
       if (udisks_daemon_util_lvm2_name_is_reserved (lv_name))
         continue;
@@ -616,7 +881,7 @@ update_vg (GObject      *source_obj,
           volume = udisks_linux_logical_volume_object_new (daemon, object, lv_name);
           udisks_linux_logical_volume_object_update (volume, lv_info, meta_lv_info, &needs_polling);
           udisks_linux_logical_volume_object_update_etctabs (volume);
-          g_dbus_object_manager_server_export_uniquely (manager, G_DBUS_OBJECT_SKELETON (volume));
+          udisks_daemon_export_object_uniquely (daemon, G_DBUS_OBJECT_SKELETON (volume));
           g_hash_table_insert (object->logical_volumes, g_strdup (lv_name), volume);
         }
       else
@@ -639,26 +904,48 @@ update_vg (GObject      *source_obj,
         }
     }
 
+  if (!pvmove_seen)
+    pvmove_stop_tracking (object);
+
+  thin_sampling_update (object);
+
   udisks_volume_group_set_needs_polling (UDISKS_VOLUME_GROUP (object->iface_volume_group),
                                          needs_polling);
 
-  /* Update block objects. */
+  /* Update block objects. Only the block devices of the LVs and of the
+   * current and former PVs of this VG need to be looked at.
+   */
+  blocks = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+
+  g_hash_table_iter_init (&volume_iter, new_lvs);
+  while (g_hash_table_iter_next (&volume_iter, &key, NULL))
+    add_block (blocks, udisks_daemon_util_lvm2_find_lv_block_object (daemon, object->name, key));
+
   new_pvs = g_hash_table_new (g_str_hash, g_str_equal);
+  pv_names = g_ptr_array_new ();
   for (GSList *vg_pvs_p=vg_pvs; vg_pvs_p; vg_pvs_p=vg_pvs_p->next)
     {
       BDLVMPVdata *pv_info = vg_pvs_p->data;
       gchar *pv_name = pv_info->pv_name;
       if (pv_name)
-        g_hash_table_insert (new_pvs, pv_name, pv_info);
+        {
+          g_hash_table_insert (new_pvs, pv_name, pv_info);
+          g_ptr_array_add (pv_names, g_strdup (pv_name));
+          add_block (blocks, udisks_daemon_util_lvm2_find_pv_block_object (daemon, pv_name));
+        }
     }
+  g_ptr_array_add (pv_names, NULL);
 
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      if (UDISKS_IS_LINUX_BLOCK_OBJECT (l->data))
-        update_block (UDISKS_LINUX_BLOCK_OBJECT (l->data), object, new_lvs, new_pvs);
-    }
-  g_list_free_full (objects, g_object_unref);
+  for (gchar **old_pv_names_p=object->pv_names; old_pv_names_p && *old_pv_names_p; old_pv_names_p++)
+    add_block (blocks, udisks_daemon_util_lvm2_find_pv_block_object (daemon, *old_pv_names_p));
+
+  g_strfreev (object->pv_names);
+  object->pv_names = (gchar **) g_ptr_array_free (pv_names, FALSE);
+
+  g_hash_table_iter_init (&volume_iter, blocks);
+  while (g_hash_table_iter_next (&volume_iter, &key, NULL))
+    update_block (UDISKS_LINUX_BLOCK_OBJECT (key), object, new_lvs, new_pvs);
+  g_hash_table_destroy (blocks);
 
   g_hash_table_destroy (new_lvs);
   g_hash_table_destroy (new_pvs);
@@ -667,6 +954,12 @@ update_vg (GObject      *source_obj,
   bd_lvm_vgdata_free (vg_info);
   lv_list_free (lvs);
 
+  /* just the part in the main loop, the LVM queries run in a thread */
+  udisks_metrics_record (udisks_daemon_get_metrics (daemon),
+                         UDISKS_METRICS_KIND_UPDATE,
+                         "UDisksLinuxVolumeGroupObject",
+                         g_get_monotonic_time () - start_time);
+
   g_object_unref (object);
 }
 
@@ -696,7 +989,8 @@ poll_vg_update (GObject      *source_obj,
                 gpointer      user_data)
 {
   UDisksDaemon *daemon;
-  gboolean needs_polling;
+  gboolean needs_polling = FALSE;
+  gboolean pvmove_seen = FALSE;
   GError *error = NULL;
   UDisksLinuxVolumeGroupObject *object = UDISKS_LINUX_VOLUME_GROUP_OBJECT (source_obj);
   GTask *task = G_TASK (result);
@@ -747,18 +1041,21 @@ poll_vg_update (GObject      *source_obj,
           if (cmp_int_lv_name ((*lvs_np)->lv_name, lv_info->metadata_lv))
             meta_lv_info = *lvs_np;
 
-      update_operations (daemon, lv_name, lv_info, &needs_polling);
+      update_operations (object, lv_name, lv_info, &pvmove_seen, &needs_polling);
       volume = g_hash_table_lookup (object->logical_volumes, lv_name);
       if (volume)
         udisks_linux_logical_volume_object_update (volume, lv_info, meta_lv_info, &needs_polling);
     }
 
+  if (!pvmove_seen)
+    pvmove_stop_tracking (object);
+
+  thin_sampling_update (object);
+
   lv_list_free (lvs);
   g_object_unref (object);
 }
 
-static void poll_now (UDisksLinuxVolumeGroupObject *object);
-
 static gboolean
 poll_in_main_thread (gpointer user_data)
 {
@@ -795,7 +1092,12 @@ poll_now (UDisksLinuxVolumeGroupObject *object)
   gchar *vg_name = g_strdup (udisks_linux_volume_group_object_get_name (object));
   GTask *task = NULL;
 
-  object->poll_timeout_id = g_timeout_add (5000, poll_timeout, g_object_ref (object));
+  object->poll_timeout_id = udisks_daemon_util_timeout_add_seconds (object->daemon,
+                                                                    "lvm2-vg-poll",
+                                                                    5,
+                                                                    poll_timeout,
+                                                                    g_object_ref (object),
+                                                                    NULL);
 
   /* starting a new poll -> increment the epoch */
   object->poll_epoch++;
@@ -823,6 +1125,9 @@ udisks_linux_volume_group_object_destroy (UDisksLinuxVolumeGroupObject *object)
   GHashTableIter volume_iter;
   gpointer key, value;
 
+  pvmove_stop_tracking (object);
+  thin_sampling_stop (object);
+
   g_hash_table_iter_init (&volume_iter, object->logical_volumes);
   while (g_hash_table_iter_next (&volume_iter, &key, &value))
     {
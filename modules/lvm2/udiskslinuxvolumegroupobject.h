@@ -39,6 +39,8 @@ UDisksLinuxVolumeGroupObject   *udisks_linux_volume_group_object_new           (
                                                                                 const gchar                  *name);
 const gchar                    *udisks_linux_volume_group_object_get_name      (UDisksLinuxVolumeGroupObject *object);
 UDisksDaemon                   *udisks_linux_volume_group_object_get_daemon    (UDisksLinuxVolumeGroupObject *object);
+const gchar * const            *udisks_linux_volume_group_object_get_pv_names  (UDisksLinuxVolumeGroupObject *object);
+VGJobQueue                     *udisks_linux_volume_group_object_get_job_queue (UDisksLinuxVolumeGroupObject *object);
 void                            udisks_linux_volume_group_object_update        (UDisksLinuxVolumeGroupObject *object,
                                                                                 BDLVMVGdata *vginfo,
                                                                                 GSList *pvs);
@@ -24,6 +24,8 @@
 #include <gio/gunixfdlist.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <ctype.h>
 
 #include <sys/types.h>
@@ -34,6 +36,7 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/fs.h>
+#include <linux/dm-ioctl.h>
 
 #include <blockdev/lvm.h>
 
@@ -46,6 +49,7 @@
 #include <src/udiskslogging.h>
 #include <src/udiskslinuxblockobject.h>
 #include <src/udiskslinuxdriveobject.h>
+#include <src/udiskslinuxdevice.h>
 #include <src/udisksmodulemanager.h>
 
 #include "udiskslvm2daemonutil.h"
@@ -249,10 +253,8 @@ udisks_daemon_util_lvm2_wipe_block (UDisksDaemon  *daemon,
 
 /* -------------------------------------------------------------------------------- */
 
-/*  transfer-none  */
-UDisksLinuxVolumeGroupObject *
-udisks_daemon_util_lvm2_find_volume_group_object (UDisksDaemon *daemon,
-                                                  const gchar  *name)
+static UDisksLVM2State *
+get_module_state (UDisksDaemon *daemon)
 {
   UDisksLVM2State *state;
   UDisksModuleManager *manager;
@@ -263,9 +265,330 @@ udisks_daemon_util_lvm2_find_volume_group_object (UDisksDaemon *daemon,
   state = (UDisksLVM2State *) udisks_module_manager_get_module_state_pointer (manager, LVM2_MODULE_NAME);
   g_assert (state != NULL);
 
+  return state;
+}
+
+/*  transfer-none  */
+UDisksLinuxVolumeGroupObject *
+udisks_daemon_util_lvm2_find_volume_group_object (UDisksDaemon *daemon,
+                                                  const gchar  *name)
+{
+  UDisksLVM2State *state = get_module_state (daemon);
+
   return g_hash_table_lookup (udisks_lvm2_state_get_name_to_volume_group (state), name);
 }
 
+/*  transfer-full  */
+UDisksLinuxBlockObject *
+udisks_daemon_util_lvm2_find_lv_block_object (UDisksDaemon *daemon,
+                                              const gchar  *vg_name,
+                                              const gchar  *lv_name)
+{
+  UDisksLVM2State *state = get_module_state (daemon);
+  dev_t device_number;
+
+  device_number = udisks_lvm2_state_get_lv_block_device (state, vg_name, lv_name);
+  if (device_number == 0)
+    return NULL;
+
+  return (UDisksLinuxBlockObject *) udisks_daemon_find_block (daemon, device_number);
+}
+
+/*  transfer-full  */
+UDisksLinuxBlockObject *
+udisks_daemon_util_lvm2_find_pv_block_object (UDisksDaemon *daemon,
+                                              const gchar  *pv_name)
+{
+  UDisksLVM2State *state = get_module_state (daemon);
+  dev_t device_number;
+
+  device_number = udisks_lvm2_state_get_pv_block_device (state, pv_name);
+  if (device_number == 0)
+    /* not seen in a uevent (yet), the PV may still be known by its device file */
+    return (UDisksLinuxBlockObject *) udisks_daemon_find_block_by_device_file (daemon, pv_name);
+
+  return (UDisksLinuxBlockObject *) udisks_daemon_find_block (daemon, device_number);
+}
+
+/* Makes sure uevents for the block device of @block_object are looked
+ * at again, e.g. because it became a PV without its udev properties
+ * saying so
+ */
+void
+udisks_daemon_util_lvm2_forget_unrelated_device (UDisksDaemon           *daemon,
+                                                 UDisksLinuxBlockObject *block_object)
+{
+  UDisksLVM2State *state = get_module_state (daemon);
+  UDisksLinuxDevice *device;
+
+  device = udisks_linux_block_object_get_device (block_object);
+  if (device == NULL)
+    return;
+
+  udisks_lvm2_state_set_unrelated_device (state, g_udev_device_get_device_number (device->udev_device), NULL);
+  g_object_unref (device);
+}
+
+/* -------------------------------------------------------------------------------- */
+
+/* device-mapper names are "vg-lv" with the dashes in both names doubled */
+static void
+append_escaped_dm_name (GString     *str,
+                        const gchar *name)
+{
+  for (; *name; name++)
+    {
+      if (*name == '-')
+        g_string_append_c (str, '-');
+      g_string_append_c (str, *name);
+    }
+}
+
+/* Builds the device-mapper name of the LV @lv_name in the VG @vg_name,
+ * with the "-@layer" suffix of one of its internal devices if @layer is
+ * not %NULL
+ */
+static gchar *
+build_dm_name (const gchar *vg_name,
+               const gchar *lv_name,
+               const gchar *layer)
+{
+  GString *dm_name;
+  gchar *plain_lv_name;
+
+  /* hidden LVs may be reported in square brackets */
+  plain_lv_name = g_strdup (lv_name[0] == '[' ? lv_name + 1 : lv_name);
+  if (g_str_has_suffix (plain_lv_name, "]"))
+    plain_lv_name[strlen (plain_lv_name) - 1] = '\0';
+
+  dm_name = g_string_new (NULL);
+  append_escaped_dm_name (dm_name, vg_name);
+  g_string_append_c (dm_name, '-');
+  append_escaped_dm_name (dm_name, plain_lv_name);
+  if (layer != NULL)
+    g_string_append_printf (dm_name, "-%s", layer);
+
+  g_free (plain_lv_name);
+  return g_string_free (dm_name, FALSE);
+}
+
+/* Runs DM_TABLE_STATUS on the device-mapper device @dm_name, returns a
+ * buffer starting with the struct dm_ioctl and followed by the target
+ * specs (free with g_free()) or %NULL on error
+ */
+static guchar *
+get_dm_table_status (const gchar  *dm_name,
+                     guint32       flags,
+                     GError      **error)
+{
+  gsize buf_size = 16 * 1024;
+  guchar *buf = NULL;
+  struct dm_ioctl *dmi;
+  gint fd;
+
+  fd = open ("/dev/mapper/control", O_RDWR | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening /dev/mapper/control: %m");
+      return NULL;
+    }
+
+  while (TRUE)
+    {
+      g_free (buf);
+      buf = g_malloc0 (buf_size);
+      dmi = (struct dm_ioctl *) buf;
+      dmi->version[0] = DM_VERSION_MAJOR;
+      dmi->data_size = buf_size;
+      dmi->data_start = sizeof (struct dm_ioctl);
+      dmi->flags = flags;
+      g_strlcpy (dmi->name, dm_name, sizeof (dmi->name));
+
+      if (ioctl (fd, DM_TABLE_STATUS, dmi) != 0)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error getting the status of %s: %m", dm_name);
+          g_clear_pointer (&buf, g_free);
+          break;
+        }
+      if (!(dmi->flags & DM_BUFFER_FULL_FLAG))
+        break;
+      buf_size *= 2;
+    }
+
+  close (fd);
+  return buf;
+}
+
+/*
+ * udisks_daemon_util_lvm2_get_mirror_sync_status:
+ *
+ * Reads the status of the mirror targets of the device-mapper device of
+ * the LV @lv_name (e.g. a pvmove LV) in the VG @vg_name straight from
+ * the kernel, without running any LVM tools.
+ *
+ * The number of regions in sync and the total number of regions of all
+ * the mirror segments are returned in @out_in_sync and @out_total, the
+ * number of mirror segments in @out_n_mirrors.
+ */
+gboolean
+udisks_daemon_util_lvm2_get_mirror_sync_status (const gchar  *vg_name,
+                                                const gchar  *lv_name,
+                                                guint64      *out_in_sync,
+                                                guint64      *out_total,
+                                                guint        *out_n_mirrors,
+                                                GError      **error)
+{
+  gchar *dm_name;
+  guchar *buf;
+  struct dm_ioctl *dmi;
+  guint64 in_sync = 0;
+  guint64 total = 0;
+  guint n_mirrors = 0;
+
+  dm_name = build_dm_name (vg_name, lv_name, NULL);
+  buf = get_dm_table_status (dm_name, 0, error);
+  g_free (dm_name);
+  if (buf == NULL)
+    return FALSE;
+
+  dmi = (struct dm_ioctl *) buf;
+  for (guint i = 0, next = 0; i < dmi->target_count; i++)
+    {
+      struct dm_target_spec *spec = (struct dm_target_spec *) (buf + dmi->data_start + next);
+      gchar **tokens;
+      guint n_devices;
+
+      next = spec->next;
+      if (g_strcmp0 (spec->target_type, "mirror") != 0)
+        continue;
+
+      /* "<#mirrors> <device>... <in-sync>/<total> ..." */
+      tokens = g_strsplit ((const gchar *) (spec + 1), " ", -1);
+      n_devices = tokens[0] ? (guint) g_ascii_strtoull (tokens[0], NULL, 10) : 0;
+      if (g_strv_length (tokens) > n_devices + 1)
+        {
+          guint64 seg_in_sync, seg_total;
+          if (sscanf (tokens[n_devices + 1], "%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT,
+                      &seg_in_sync, &seg_total) == 2)
+            {
+              in_sync += seg_in_sync;
+              total += seg_total;
+              n_mirrors++;
+            }
+        }
+      g_strfreev (tokens);
+    }
+
+  *out_in_sync = in_sync;
+  *out_total = total;
+  *out_n_mirrors = n_mirrors;
+
+  g_free (buf);
+  return TRUE;
+}
+
+/*
+ * udisks_daemon_util_lvm2_get_thin_usage:
+ *
+ * Reads how full the active thin pool or thin volume @lv_name in the VG
+ * @vg_name is from the status of its device-mapper target, without
+ * running any LVM tools and without making the kernel commit the pool
+ * metadata.
+ *
+ * The ratios of used data and metadata blocks are returned in
+ * @out_data_ratio and @out_metadata_ratio, the latter is always 0 for a
+ * thin volume.
+ */
+gboolean
+udisks_daemon_util_lvm2_get_thin_usage (const gchar  *vg_name,
+                                        const gchar  *lv_name,
+                                        gdouble      *out_data_ratio,
+                                        gdouble      *out_metadata_ratio,
+                                        GError      **error)
+{
+  gchar *dm_name;
+  guchar *buf;
+  struct dm_ioctl *dmi;
+  struct dm_target_spec *spec;
+  const gchar *params;
+  gboolean ret = FALSE;
+
+  /* a pool in use by thin volumes has its thin-pool target in the
+   * "-tpool" layer, otherwise it's the top-level device
+   */
+  dm_name = build_dm_name (vg_name, lv_name, "tpool");
+  buf = get_dm_table_status (dm_name, DM_NOFLUSH_FLAG, NULL);
+  g_free (dm_name);
+  if (buf == NULL)
+    {
+      dm_name = build_dm_name (vg_name, lv_name, NULL);
+      buf = get_dm_table_status (dm_name, DM_NOFLUSH_FLAG, error);
+      g_free (dm_name);
+      if (buf == NULL)
+        return FALSE;
+    }
+
+  dmi = (struct dm_ioctl *) buf;
+  if (dmi->target_count != 1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Unexpected number of targets for %s/%s: %u", vg_name, lv_name, dmi->target_count);
+      goto out;
+    }
+
+  spec = (struct dm_target_spec *) (buf + dmi->data_start);
+  params = (const gchar *) (spec + 1);
+  if (g_strcmp0 (spec->target_type, "thin-pool") == 0)
+    {
+      guint64 transaction_id, meta_used, meta_total, data_used, data_total;
+
+      /* "<transaction id> <used meta>/<total meta> <used data>/<total data> ..." */
+      if (sscanf (params, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT
+                  " %" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT,
+                  &transaction_id, &meta_used, &meta_total, &data_used, &data_total) == 5
+          && meta_total > 0 && data_total > 0)
+        {
+          *out_data_ratio = (gdouble) data_used / data_total;
+          *out_metadata_ratio = (gdouble) meta_used / meta_total;
+          ret = TRUE;
+        }
+    }
+  else if (g_strcmp0 (spec->target_type, "thin") == 0)
+    {
+      guint64 mapped;
+
+      /* "<nr mapped sectors> <highest mapped sector>" */
+      if (sscanf (params, "%" G_GUINT64_FORMAT, &mapped) == 1 && spec->length > 0)
+        {
+          *out_data_ratio = (gdouble) mapped / spec->length;
+          *out_metadata_ratio = 0.0;
+          ret = TRUE;
+        }
+    }
+
+  if (!ret)
+    g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                 "Unexpected %s status for %s/%s: %s", spec->target_type, vg_name, lv_name, params);
+
+ out:
+  g_free (buf);
+  return ret;
+}
+
+guint
+udisks_daemon_util_lvm2_get_thin_pool_sample_interval (UDisksDaemon *daemon)
+{
+  return udisks_lvm2_state_get_thin_pool_sample_interval (get_module_state (daemon));
+}
+
+gdouble
+udisks_daemon_util_lvm2_get_thin_pool_watermark (UDisksDaemon *daemon)
+{
+  return udisks_lvm2_state_get_thin_pool_watermark (get_module_state (daemon));
+}
+
 /* -------------------------------------------------------------------------------- */
 
 gboolean
@@ -38,8 +38,34 @@ gboolean udisks_daemon_util_lvm2_name_is_reserved (const gchar *name);
 UDisksLinuxVolumeGroupObject * udisks_daemon_util_lvm2_find_volume_group_object (UDisksDaemon *daemon,
                                                                                  const gchar  *name);
 
+UDisksLinuxBlockObject * udisks_daemon_util_lvm2_find_lv_block_object (UDisksDaemon *daemon,
+                                                                       const gchar  *vg_name,
+                                                                       const gchar  *lv_name);
+
+UDisksLinuxBlockObject * udisks_daemon_util_lvm2_find_pv_block_object (UDisksDaemon *daemon,
+                                                                       const gchar  *pv_name);
+
+void udisks_daemon_util_lvm2_forget_unrelated_device (UDisksDaemon           *daemon,
+                                                      UDisksLinuxBlockObject *block_object);
+
 void udisks_daemon_util_lvm2_trigger_udev (const gchar *device_file);
 
+gboolean udisks_daemon_util_lvm2_get_mirror_sync_status (const gchar  *vg_name,
+                                                         const gchar  *lv_name,
+                                                         guint64      *out_in_sync,
+                                                         guint64      *out_total,
+                                                         guint        *out_n_mirrors,
+                                                         GError      **error);
+
+gboolean udisks_daemon_util_lvm2_get_thin_usage (const gchar  *vg_name,
+                                                 const gchar  *lv_name,
+                                                 gdouble      *out_data_ratio,
+                                                 gdouble      *out_metadata_ratio,
+                                                 GError      **error);
+
+guint   udisks_daemon_util_lvm2_get_thin_pool_sample_interval (UDisksDaemon *daemon);
+gdouble udisks_daemon_util_lvm2_get_thin_pool_watermark       (UDisksDaemon *daemon);
+
 G_END_DECLS
 
 #endif /* __UDISKS_LVM2_DAEMON_UTIL_H__ */
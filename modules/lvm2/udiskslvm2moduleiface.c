@@ -50,6 +50,19 @@
 #include "udiskslinuxphysicalvolume.h"
 
 
+#define LVM2_CONF_FILE  "udisks2_lvm2.conf"
+#define LVM2_CONF_GROUP "udisks2_lvm2"
+#define LVM2_CONF_BACKEND_KEY "backend"
+#define LVM2_CONF_THIN_POOL_SAMPLE_INTERVAL_KEY "thin_pool_sample_interval"
+#define LVM2_CONF_THIN_POOL_WATERMARK_KEY "thin_pool_watermark"
+
+/* seconds, percent */
+#define LVM2_DEFAULT_THIN_POOL_SAMPLE_INTERVAL 5
+#define LVM2_DEFAULT_THIN_POOL_WATERMARK 80
+
+#define LVM2_PLUGIN_CLI_SONAME  "libbd_lvm.so.2"
+#define LVM2_PLUGIN_DBUS_SONAME "libbd_lvm-dbus.so.2"
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 gchar *
@@ -58,15 +71,119 @@ udisks_module_id (void)
   return g_strdup (LVM2_MODULE_NAME);
 }
 
+/* Loads the module configuration file, returns %NULL if there is none */
+static GKeyFile *
+load_config (UDisksDaemon  *daemon,
+             gchar        **out_path)
+{
+  GKeyFile *key_file;
+  gchar *path;
+
+  path = g_build_filename (udisks_daemon_get_uninstalled (daemon) ? BUILD_DIR "modules/lvm2/data" : PACKAGE_SYSCONF_DIR "/udisks2/modules.conf.d",
+                           LVM2_CONF_FILE,
+                           NULL);
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL))
+    {
+      g_key_file_free (key_file);
+      key_file = NULL;
+    }
+
+  *out_path = path;
+  return key_file;
+}
+
+/* Returns whether the lvmdbusd based libblockdev plugin was chosen in
+ * the module configuration. It keeps the LVM state in a long-running
+ * service so reports don't have to fork the LVM tools and rescan all
+ * devices for every request.
+ */
+static gboolean
+use_dbus_backend (GKeyFile    *key_file,
+                  const gchar *path)
+{
+  gchar *backend = NULL;
+  gboolean ret = FALSE;
+
+  if (key_file != NULL)
+    backend = g_key_file_get_string (key_file, LVM2_CONF_GROUP, LVM2_CONF_BACKEND_KEY, NULL);
+
+  if (backend != NULL)
+    {
+      g_strstrip (backend);
+      if (g_strcmp0 (backend, "dbus") == 0)
+        ret = TRUE;
+      else if (g_strcmp0 (backend, "cli") != 0)
+        udisks_warning ("LVM2 plugin: unknown backend '%s' in %s, using 'cli'", backend, path);
+    }
+
+  g_free (backend);
+  return ret;
+}
+
+static void
+load_thin_pool_config (GKeyFile        *key_file,
+                       const gchar     *path,
+                       UDisksLVM2State *state)
+{
+  gint interval = LVM2_DEFAULT_THIN_POOL_SAMPLE_INTERVAL;
+  gint watermark = LVM2_DEFAULT_THIN_POOL_WATERMARK;
+  GError *error = NULL;
+
+  if (key_file != NULL && g_key_file_has_key (key_file, LVM2_CONF_GROUP, LVM2_CONF_THIN_POOL_SAMPLE_INTERVAL_KEY, NULL))
+    {
+      interval = g_key_file_get_integer (key_file, LVM2_CONF_GROUP, LVM2_CONF_THIN_POOL_SAMPLE_INTERVAL_KEY, &error);
+      if (error != NULL || interval < 0)
+        {
+          udisks_warning ("LVM2 plugin: invalid %s in %s, using %d",
+                          LVM2_CONF_THIN_POOL_SAMPLE_INTERVAL_KEY, path, LVM2_DEFAULT_THIN_POOL_SAMPLE_INTERVAL);
+          interval = LVM2_DEFAULT_THIN_POOL_SAMPLE_INTERVAL;
+          g_clear_error (&error);
+        }
+    }
+
+  if (key_file != NULL && g_key_file_has_key (key_file, LVM2_CONF_GROUP, LVM2_CONF_THIN_POOL_WATERMARK_KEY, NULL))
+    {
+      watermark = g_key_file_get_integer (key_file, LVM2_CONF_GROUP, LVM2_CONF_THIN_POOL_WATERMARK_KEY, &error);
+      if (error != NULL || watermark < 1 || watermark > 100)
+        {
+          udisks_warning ("LVM2 plugin: invalid %s in %s, using %d",
+                          LVM2_CONF_THIN_POOL_WATERMARK_KEY, path, LVM2_DEFAULT_THIN_POOL_WATERMARK);
+          watermark = LVM2_DEFAULT_THIN_POOL_WATERMARK;
+          g_clear_error (&error);
+        }
+    }
+
+  udisks_lvm2_state_set_thin_pool_sample_interval (state, interval);
+  udisks_lvm2_state_set_thin_pool_watermark (state, watermark / 100.0);
+}
+
 gpointer
 udisks_module_init (UDisksDaemon *daemon)
 {
   gboolean ret = FALSE;
   GError *error = NULL;
+  GKeyFile *key_file;
+  gchar *path = NULL;
+  UDisksLVM2State *state;
 
-  BDPluginSpec lvm_plugin = {BD_PLUGIN_LVM, "libbd_lvm.so.2"};
+  BDPluginSpec lvm_plugin = {BD_PLUGIN_LVM, LVM2_PLUGIN_CLI_SONAME};
   BDPluginSpec *plugins[] = {&lvm_plugin, NULL};
 
+  key_file = load_config (daemon, &path);
+
+  if (!bd_is_plugin_available (BD_PLUGIN_LVM) && use_dbus_backend (key_file, path))
+    {
+      lvm_plugin.so_name = LVM2_PLUGIN_DBUS_SONAME;
+      if (!bd_reinit (plugins, FALSE, NULL, &error))
+        {
+          udisks_warning ("Error initializing the lvm-dbus libblockdev plugin, falling back to the lvm plugin: %s (%s, %d)",
+                          error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+          lvm_plugin.so_name = LVM2_PLUGIN_CLI_SONAME;
+        }
+    }
+
   if (!bd_is_plugin_available (BD_PLUGIN_LVM))
     {
       ret = bd_reinit (plugins, FALSE, NULL, &error);
@@ -79,7 +196,14 @@ udisks_module_init (UDisksDaemon *daemon)
         }
     }
 
-  return udisks_lvm2_state_new (daemon);
+  state = udisks_lvm2_state_new (daemon);
+  load_thin_pool_config (key_file, path, state);
+
+  if (key_file != NULL)
+    g_key_file_free (key_file);
+  g_free (path);
+
+  return state;
 }
 
 void
@@ -110,6 +234,21 @@ get_module_state (UDisksDaemon *daemon)
   return state;
 }
 
+void
+udisks_module_reload_configuration (UDisksDaemon *daemon)
+{
+  GKeyFile *key_file;
+  gchar *path = NULL;
+
+  /* the backend is picked when the libblockdev plugin is loaded and stays */
+  key_file = load_config (daemon, &path);
+  load_thin_pool_config (key_file, path, get_module_state (daemon));
+
+  if (key_file != NULL)
+    g_key_file_free (key_file);
+  g_free (path);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 UDisksModuleInterfaceInfo **
@@ -146,6 +285,8 @@ lvm_update_vgs (GObject      *source_obj,
   GHashTableIter vg_name_iter;
   gpointer key, value;
   const gchar *vg_name;
+  GHashTable *vg_name_to_vg;
+  GHashTable *vg_name_to_pvs;
 
   if (!data)
     {
@@ -169,21 +310,40 @@ lvm_update_vgs (GObject      *source_obj,
   manager = udisks_daemon_get_object_manager (daemon);
   state = get_module_state (daemon);
 
+  /* Group the VGs and PVs by VG name in one pass, the PVs are moved
+   * into the per-VG lists instead of being copied
+   */
+  vg_name_to_vg = g_hash_table_new (g_str_hash, g_str_equal);
+  for (BDLVMVGdata **vgs_p=vgs; *vgs_p; vgs_p++)
+    g_hash_table_insert (vg_name_to_vg, (*vgs_p)->name, *vgs_p);
+
+  vg_name_to_pvs = g_hash_table_new (g_str_hash, g_str_equal);
+  for (BDLVMPVdata **pvs_p=pvs; *pvs_p; pvs_p++)
+    {
+      GSList *vg_pvs;
+
+      /* PVs not assigned to any VG or assigned to a non-existing VG are unused */
+      if ((*pvs_p)->vg_name == NULL || !g_hash_table_contains (vg_name_to_vg, (*pvs_p)->vg_name))
+        {
+          bd_lvm_pvdata_free (*pvs_p);
+          continue;
+        }
+
+      vg_pvs = g_hash_table_lookup (vg_name_to_pvs, (*pvs_p)->vg_name);
+      g_hash_table_insert (vg_name_to_pvs, (*pvs_p)->vg_name, g_slist_prepend (vg_pvs, *pvs_p));
+    }
+
   /* Remove obsolete groups */
   g_hash_table_iter_init (&vg_name_iter,
                           udisks_lvm2_state_get_name_to_volume_group (state));
   while (g_hash_table_iter_next (&vg_name_iter, &key, &value))
     {
       UDisksLinuxVolumeGroupObject *group;
-      gboolean found = FALSE;
 
       vg_name = key;
       group = value;
 
-      for (BDLVMVGdata **vgs_p=vgs; !found && (*vgs_p); vgs_p++)
-          found = g_strcmp0 ((*vgs_p)->name, vg_name) == 0;
-
-      if (!found)
+      if (!g_hash_table_contains (vg_name_to_vg, vg_name))
         {
           udisks_linux_volume_group_object_destroy (group);
           g_dbus_object_manager_server_unexport (manager,
@@ -208,19 +368,15 @@ lvm_update_vgs (GObject      *source_obj,
                                g_strdup (vg_name), group);
         }
 
-      for (BDLVMPVdata **pvs_p=pvs; *pvs_p; pvs_p++)
-        if (g_strcmp0 ((*pvs_p)->vg_name, vg_name) == 0)
-            vg_pvs = g_slist_prepend (vg_pvs, bd_lvm_pvdata_copy (*pvs_p));
+      /* the list (and the PVs in it) is passed to the group */
+      vg_pvs = g_hash_table_lookup (vg_name_to_pvs, vg_name);
+      g_hash_table_remove (vg_name_to_pvs, vg_name);
 
       udisks_linux_volume_group_object_update (group, *vgs_p, vg_pvs);
     }
 
-  /* UDisksLinuxVolumeGroupObject carries copies of BDLVMPVdata that belong to the VG.
-  *  The rest of the PVs, either not assigned to any VG or assigned to a non-existing VG,
-  *  are basically unused and freed here anyway.
-  */
-  for (BDLVMPVdata **pvs_p=pvs; *pvs_p; pvs_p++)
-    bd_lvm_pvdata_free (*pvs_p);
+  g_hash_table_destroy (vg_name_to_pvs);
+  g_hash_table_destroy (vg_name_to_vg);
 
   /* only free the containers, the contents were passed further */
   g_free (vgs);
@@ -239,26 +395,132 @@ lvm_update (UDisksDaemon *daemon)
   g_object_unref (task);
 }
 
+static void trigger_delayed_lvm_update (UDisksDaemon *daemon,
+                                        const gchar  *vg_name);
+
+static void
+lvm_update_vg_done (GObject      *source_obj,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+  UDisksLinuxVolumeGroupObject *group = UDISKS_LINUX_VOLUME_GROUP_OBJECT (source_obj);
+  UDisksDaemon *daemon = udisks_linux_volume_group_object_get_daemon (group);
+  UDisksLVM2State *state;
+  GTask *task = G_TASK (result);
+  GError *error = NULL;
+  VGsPVsData *data = g_task_propagate_pointer (task, &error);
+  GSList *vg_pvs = NULL;
+
+  if (!data)
+    {
+      /* the VG or one of its PVs is gone, let the full update sort it out */
+      udisks_debug ("LVM2 plugin: refreshing VG %s failed, rescanning all VGs: %s",
+                    udisks_linux_volume_group_object_get_name (group),
+                    error ? error->message : "no error reported");
+      g_clear_error (&error);
+      trigger_delayed_lvm_update (daemon, NULL);
+      return;
+    }
+
+  state = get_module_state (daemon);
+
+  /* a full update may have removed the group in the meantime */
+  if (g_hash_table_lookup (udisks_lvm2_state_get_name_to_volume_group (state),
+                           udisks_linux_volume_group_object_get_name (group)) != group)
+    {
+      vgs_pvs_data_free (data);
+      return;
+    }
+
+  for (BDLVMPVdata **pvs_p=data->pvs; *pvs_p; pvs_p++)
+    vg_pvs = g_slist_prepend (vg_pvs, *pvs_p);
+
+  udisks_linux_volume_group_object_update (group, data->vgs[0], vg_pvs);
+
+  /* only free the containers, the contents were passed further */
+  g_free (data->vgs);
+  g_free (data->pvs);
+  g_free (data);
+}
+
+static void
+lvm_update_vg (UDisksLinuxVolumeGroupObject *group)
+{
+  VGPVsNames *names = g_new0 (VGPVsNames, 1);
+  GTask *task;
+
+  names->vg_name = g_strdup (udisks_linux_volume_group_object_get_name (group));
+  names->pv_names = g_strdupv ((gchar **) udisks_linux_volume_group_object_get_pv_names (group));
+
+  /* the callback (lvm_update_vg_done) is called in the default main loop (context) */
+  task = g_task_new (group, NULL /* cancellable */, lvm_update_vg_done, NULL /* callback_data */);
+  g_task_set_task_data (task, names, (GDestroyNotify) vg_pvs_names_free);
+
+  /* holds a reference to 'task' until it is finished */
+  g_task_run_in_thread (task, (GTaskThreadFunc) vg_task_func);
+
+  g_object_unref (task);
+}
+
 static gboolean
 delayed_lvm_update (gpointer user_data)
 {
   UDisksDaemon *daemon = UDISKS_DAEMON (user_data);
   UDisksLVM2State *state;
+  GHashTable *vg_names;
+  GHashTableIter iter;
+  gpointer key;
+  gboolean full;
 
   state = get_module_state (daemon);
+  vg_names = udisks_lvm2_state_get_lvm_delayed_update_vgs (state);
+  full = udisks_lvm2_state_get_lvm_delayed_update_full (state);
 
-  lvm_update (daemon);
+  /* groups that haven't been updated yet don't know their PVs */
+  g_hash_table_iter_init (&iter, vg_names);
+  while (!full && g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      UDisksLinuxVolumeGroupObject *group;
+
+      group = g_hash_table_lookup (udisks_lvm2_state_get_name_to_volume_group (state), key);
+      if (group == NULL || udisks_linux_volume_group_object_get_pv_names (group) == NULL)
+        full = TRUE;
+    }
+
+  if (full)
+    {
+      lvm_update (daemon);
+    }
+  else
+    {
+      g_hash_table_iter_init (&iter, vg_names);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        lvm_update_vg (g_hash_table_lookup (udisks_lvm2_state_get_name_to_volume_group (state), key));
+    }
+
+  g_hash_table_remove_all (vg_names);
+  udisks_lvm2_state_set_lvm_delayed_update_full (state, FALSE);
   udisks_lvm2_state_set_lvm_delayed_update_id (state, 0);
   return FALSE;
 }
 
+/* Schedules a refresh of the VG called @vg_name, or of all VGs and
+ * PVs if @vg_name is %NULL or not known yet.
+ */
 static void
-trigger_delayed_lvm_update (UDisksDaemon *daemon)
+trigger_delayed_lvm_update (UDisksDaemon *daemon,
+                            const gchar  *vg_name)
 {
   UDisksLVM2State *state;
 
   state = get_module_state (daemon);
 
+  if (vg_name != NULL
+      && g_hash_table_contains (udisks_lvm2_state_get_name_to_volume_group (state), vg_name))
+    g_hash_table_add (udisks_lvm2_state_get_lvm_delayed_update_vgs (state), g_strdup (vg_name));
+  else
+    udisks_lvm2_state_set_lvm_delayed_update_full (state, TRUE);
+
   if (udisks_lvm2_state_get_lvm_delayed_update_id (state) > 0)
     return;
 
@@ -270,6 +532,8 @@ trigger_delayed_lvm_update (UDisksDaemon *daemon)
        * coldplugging has been finished or not. Might be subject to change in
        * the future. */
       udisks_lvm2_state_set_coldplug_done (state, TRUE);
+      udisks_lvm2_state_set_lvm_delayed_update_full (state, FALSE);
+      g_hash_table_remove_all (udisks_lvm2_state_get_lvm_delayed_update_vgs (state));
       lvm_update (daemon);
     }
   else
@@ -284,7 +548,13 @@ trigger_delayed_lvm_update (UDisksDaemon *daemon)
 static gboolean
 is_logical_volume (UDisksLinuxDevice *device)
 {
-  const gchar *dm_vg_name = g_udev_device_get_property (device->udev_device, "DM_VG_NAME");
+  const gchar *dm_vg_name;
+
+  /* skips the udev database lookup for all the non-LVM devices */
+  if (udisks_linux_device_get_dm_type (device) != UDISKS_LINUX_DEVICE_DM_TYPE_LVM)
+    return FALSE;
+
+  dm_vg_name = g_udev_device_get_property (device->udev_device, "DM_VG_NAME");
   return dm_vg_name && *dm_vg_name;
 }
 
@@ -309,10 +579,63 @@ is_recorded_as_physical_volume (UDisksDaemon      *daemon,
   return ret;
 }
 
+/* Records the LV or PV behind @device so VG updates don't need to
+ * look through all block objects
+ */
+static void
+index_block_device (UDisksDaemon      *daemon,
+                    UDisksLinuxDevice *device)
+{
+  UDisksLVM2State *state;
+  dev_t device_number;
+  const gchar *vg_name;
+  const gchar *lv_name;
+
+  state = get_module_state (daemon);
+  device_number = g_udev_device_get_device_number (device->udev_device);
+
+  vg_name = g_udev_device_get_property (device->udev_device, "DM_VG_NAME");
+  lv_name = g_udev_device_get_property (device->udev_device, "DM_LV_NAME");
+  if (vg_name && *vg_name && lv_name && *lv_name)
+    udisks_lvm2_state_set_lv_block_device (state, vg_name, lv_name, device_number);
+
+  if (has_physical_volume_label (device))
+    {
+      const gchar * const *symlinks;
+
+      udisks_lvm2_state_set_pv_block_device (state,
+                                             g_udev_device_get_device_file (device->udev_device),
+                                             device_number);
+      symlinks = g_udev_device_get_device_file_symlinks (device->udev_device);
+      for (; symlinks && *symlinks; symlinks++)
+        udisks_lvm2_state_set_pv_block_device (state, *symlinks, device_number);
+    }
+}
+
+/* The udev properties deciding whether a block device is related to
+ * LVM, free with g_free()
+ */
+static gchar *
+get_device_fingerprint (UDisksLinuxDevice *device)
+{
+  const gchar *id_fs_type = g_udev_device_get_property (device->udev_device, "ID_FS_TYPE");
+  const gchar *dm_vg_name = g_udev_device_get_property (device->udev_device, "DM_VG_NAME");
+  const gchar *dm_lv_name = g_udev_device_get_property (device->udev_device, "DM_LV_NAME");
+
+  return g_strdup_printf ("%s\n%s\n%s",
+                          id_fs_type ? id_fs_type : "",
+                          dm_vg_name ? dm_vg_name : "",
+                          dm_lv_name ? dm_lv_name : "");
+}
+
 static GDBusObjectSkeleton *
 lvm2_object_new (UDisksDaemon      *daemon,
                  UDisksLinuxDevice *device)
 {
+  UDisksLVM2State *state;
+  dev_t device_number;
+  gchar *fingerprint;
+
   /* This is bit of a hack. We never return any instance and thus effectively
    * taking the UDisksLinuxProvider module uevent machinery out of sight. We
    * only get an uevent and related UDisksLinuxDevice where we perform basic
@@ -320,11 +643,43 @@ lvm2_object_new (UDisksDaemon      *daemon,
    * reference to UDisksDaemon instance though for manually performing dbus
    * stuff onto. */
 
-  if (is_logical_volume (device)
-      || has_physical_volume_label (device)
+  state = get_module_state (daemon);
+  device_number = g_udev_device_get_device_number (device->udev_device);
+
+  /* Most uevents are for devices that have nothing to do with LVM (or
+   * are just re-probes of them), skip those as long as the properties
+   * LVM cares about stay the same.
+   */
+  if (g_strcmp0 (g_udev_device_get_action (device->udev_device), "remove") == 0)
+    {
+      udisks_lvm2_state_set_unrelated_device (state, device_number, NULL);
+      fingerprint = NULL;
+    }
+  else
+    {
+      fingerprint = get_device_fingerprint (device);
+      if (udisks_lvm2_state_is_unrelated_device (state, device_number, fingerprint))
+        {
+          g_free (fingerprint);
+          return NULL;
+        }
+    }
+
+  index_block_device (daemon, device);
+
+  /* A change of a PV label may move PVs between VGs or create and
+   * remove VGs so rescan everything. Changes of an LV only affect the
+   * VG it belongs to.
+   */
+  if (has_physical_volume_label (device)
       || is_recorded_as_physical_volume (daemon, device))
-    trigger_delayed_lvm_update (daemon);
+    trigger_delayed_lvm_update (daemon, NULL);
+  else if (is_logical_volume (device))
+    trigger_delayed_lvm_update (daemon, g_udev_device_get_property (device->udev_device, "DM_VG_NAME"));
+  else if (fingerprint != NULL)
+    udisks_lvm2_state_set_unrelated_device (state, device_number, fingerprint);
 
+  g_free (fingerprint);
   return NULL;
 }
 
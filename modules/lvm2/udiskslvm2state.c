@@ -30,8 +30,31 @@ struct _UDisksLVM2State
   /* maps from volume group name to UDisksLinuxVolumeGroupObject instances. */
   GHashTable *name_to_volume_group;
 
+  /* maps from "vg_name/lv_name" and from PV device files (and their
+   * symlinks) to the device numbers of the block devices, as seen in
+   * uevents; entries may be stale and must be verified by the caller
+   */
+  GHashTable *lv_to_block_device;
+  GHashTable *pv_to_block_device;
+
+  /* maps from device numbers of block devices seen to be neither LVs nor
+   * PVs to the udev properties the decision was based on
+   */
+  GHashTable *unrelated_devices;
+
   gint lvm_delayed_update_id;
+  /* names of the volume groups to refresh in the next delayed update */
+  GHashTable *lvm_delayed_update_vgs;
+  /* whether the next delayed update needs to rescan all volume groups */
+  gboolean lvm_delayed_update_full;
   gboolean coldplug_done;
+
+  /* how often to read the usage of active thin pools and thin volumes
+   * from the device-mapper status (0 = never) and the ratio above which
+   * they are reported as running full
+   */
+  guint thin_pool_sample_interval;
+  gdouble thin_pool_watermark;
 };
 
 /**
@@ -54,7 +77,25 @@ udisks_lvm2_state_new (UDisksDaemon *daemon)
                                                        g_str_equal,
                                                        g_free,
                                                        (GDestroyNotify) g_object_unref);
+  state->lv_to_block_device = g_hash_table_new_full (g_str_hash,
+                                                     g_str_equal,
+                                                     g_free,
+                                                     g_free);
+  state->pv_to_block_device = g_hash_table_new_full (g_str_hash,
+                                                     g_str_equal,
+                                                     g_free,
+                                                     g_free);
+  state->unrelated_devices = g_hash_table_new_full (g_int64_hash,
+                                                    g_int64_equal,
+                                                    g_free,
+                                                    g_free);
+  state->lvm_delayed_update_vgs = g_hash_table_new_full (g_str_hash,
+                                                         g_str_equal,
+                                                         g_free,
+                                                         NULL);
   state->coldplug_done = FALSE;
+  state->thin_pool_sample_interval = 0;
+  state->thin_pool_watermark = 1.0;
 
   return state;
 }
@@ -71,6 +112,10 @@ udisks_lvm2_state_free (UDisksLVM2State *state)
   g_assert (state != NULL);
 
   g_hash_table_unref (state->name_to_volume_group);
+  g_hash_table_unref (state->lvm_delayed_update_vgs);
+  g_hash_table_unref (state->lv_to_block_device);
+  g_hash_table_unref (state->pv_to_block_device);
+  g_hash_table_unref (state->unrelated_devices);
 
   g_free (state);
 }
@@ -83,6 +128,113 @@ udisks_lvm2_state_get_name_to_volume_group (UDisksLVM2State *state)
   return state->name_to_volume_group;
 }
 
+static void
+block_device_index_set (GHashTable  *index,
+                        gchar       *key,
+                        dev_t        device_number)
+{
+  gint64 *value = g_new (gint64, 1);
+
+  *value = device_number;
+  g_hash_table_replace (index, key, value);
+}
+
+static dev_t
+block_device_index_get (GHashTable  *index,
+                        const gchar *key)
+{
+  gint64 *value = g_hash_table_lookup (index, key);
+
+  return value ? (dev_t) *value : 0;
+}
+
+/**
+ * udisks_lvm2_state_set_lv_block_device:
+ * @state: A #UDisksLVM2State.
+ * @vg_name: The name of the volume group.
+ * @lv_name: The name of the logical volume.
+ * @device_number: The device number of the block device of the logical volume.
+ *
+ * Records the block device of a logical volume.
+ */
+void
+udisks_lvm2_state_set_lv_block_device (UDisksLVM2State *state,
+                                       const gchar     *vg_name,
+                                       const gchar     *lv_name,
+                                       dev_t            device_number)
+{
+  g_assert (state != NULL);
+
+  block_device_index_set (state->lv_to_block_device,
+                          g_strdup_printf ("%s/%s", vg_name, lv_name),
+                          device_number);
+}
+
+/**
+ * udisks_lvm2_state_get_lv_block_device:
+ * @state: A #UDisksLVM2State.
+ * @vg_name: The name of the volume group.
+ * @lv_name: The name of the logical volume.
+ *
+ * Gets the block device last recorded for a logical volume with
+ * udisks_lvm2_state_set_lv_block_device().
+ *
+ * Returns: A device number or 0 if not known.
+ */
+dev_t
+udisks_lvm2_state_get_lv_block_device (UDisksLVM2State *state,
+                                       const gchar     *vg_name,
+                                       const gchar     *lv_name)
+{
+  gchar *key;
+  dev_t ret;
+
+  g_assert (state != NULL);
+
+  key = g_strdup_printf ("%s/%s", vg_name, lv_name);
+  ret = block_device_index_get (state->lv_to_block_device, key);
+  g_free (key);
+
+  return ret;
+}
+
+/**
+ * udisks_lvm2_state_set_pv_block_device:
+ * @state: A #UDisksLVM2State.
+ * @device_file: A device file or symlink of a physical volume.
+ * @device_number: The device number of the block device.
+ *
+ * Records the block device of a physical volume.
+ */
+void
+udisks_lvm2_state_set_pv_block_device (UDisksLVM2State *state,
+                                       const gchar     *device_file,
+                                       dev_t            device_number)
+{
+  g_assert (state != NULL);
+
+  block_device_index_set (state->pv_to_block_device, g_strdup (device_file), device_number);
+}
+
+/**
+ * udisks_lvm2_state_get_pv_block_device:
+ * @state: A #UDisksLVM2State.
+ * @device_file: A device file or symlink of a physical volume.
+ *
+ * Gets the block device last recorded for @device_file with
+ * udisks_lvm2_state_set_pv_block_device().
+ *
+ * Returns: A device number or 0 if not known.
+ */
+dev_t
+udisks_lvm2_state_get_pv_block_device (UDisksLVM2State *state,
+                                       const gchar     *device_file)
+{
+  g_assert (state != NULL);
+
+  return block_device_index_get (state->pv_to_block_device, device_file);
+}
+
 gint
 udisks_lvm2_state_get_lvm_delayed_update_id (UDisksLVM2State *state)
 {
@@ -91,6 +243,71 @@ udisks_lvm2_state_get_lvm_delayed_update_id (UDisksLVM2State *state)
   return state->lvm_delayed_update_id;
 }
 
+GHashTable *
+udisks_lvm2_state_get_lvm_delayed_update_vgs (UDisksLVM2State *state)
+{
+  g_assert (state != NULL);
+
+  return state->lvm_delayed_update_vgs;
+}
+
+gboolean
+udisks_lvm2_state_get_lvm_delayed_update_full (UDisksLVM2State *state)
+{
+  g_assert (state != NULL);
+
+  return state->lvm_delayed_update_full;
+}
+
+/**
+ * udisks_lvm2_state_set_unrelated_device:
+ * @state: A #UDisksLVM2State.
+ * @device_number: The device number of a block device.
+ * @fingerprint: (allow-none): The udev properties of the block device relevant to LVM or %NULL.
+ *
+ * Records that the block device with @device_number and the given
+ * @fingerprint is neither a logical nor a physical volume, or forgets
+ * about the block device if @fingerprint is %NULL.
+ */
+void
+udisks_lvm2_state_set_unrelated_device (UDisksLVM2State *state,
+                                        dev_t            device_number,
+                                        const gchar     *fingerprint)
+{
+  gint64 key = device_number;
+
+  g_assert (state != NULL);
+
+  if (fingerprint == NULL)
+    g_hash_table_remove (state->unrelated_devices, &key);
+  else
+    g_hash_table_replace (state->unrelated_devices, g_memdup (&key, sizeof (key)), g_strdup (fingerprint));
+}
+
+/**
+ * udisks_lvm2_state_is_unrelated_device:
+ * @state: A #UDisksLVM2State.
+ * @device_number: The device number of a block device.
+ * @fingerprint: The udev properties of the block device relevant to LVM.
+ *
+ * Checks whether the block device with @device_number was recorded
+ * with udisks_lvm2_state_set_unrelated_device() and @fingerprint hasn't
+ * changed since.
+ *
+ * Returns: %TRUE if the block device is known to be unrelated to LVM.
+ */
+gboolean
+udisks_lvm2_state_is_unrelated_device (UDisksLVM2State *state,
+                                       dev_t            device_number,
+                                       const gchar     *fingerprint)
+{
+  gint64 key = device_number;
+
+  g_assert (state != NULL);
+
+  return g_strcmp0 (g_hash_table_lookup (state->unrelated_devices, &key), fingerprint) == 0;
+}
+
 gboolean
 udisks_lvm2_state_get_coldplug_done (UDisksLVM2State *state)
 {
@@ -108,6 +325,15 @@ udisks_lvm2_state_set_lvm_delayed_update_id (UDisksLVM2State *state,
   state->lvm_delayed_update_id = id;
 }
 
+void
+udisks_lvm2_state_set_lvm_delayed_update_full (UDisksLVM2State *state,
+                                               gboolean         full)
+{
+  g_assert (state != NULL);
+
+  state->lvm_delayed_update_full = full;
+}
+
 void
 udisks_lvm2_state_set_coldplug_done (UDisksLVM2State *state,
                                      gboolean         coldplug_done)
@@ -116,3 +342,37 @@ udisks_lvm2_state_set_coldplug_done (UDisksLVM2State *state,
 
   state->coldplug_done = coldplug_done;
 }
+
+guint
+udisks_lvm2_state_get_thin_pool_sample_interval (UDisksLVM2State *state)
+{
+  g_assert (state != NULL);
+
+  return state->thin_pool_sample_interval;
+}
+
+gdouble
+udisks_lvm2_state_get_thin_pool_watermark (UDisksLVM2State *state)
+{
+  g_assert (state != NULL);
+
+  return state->thin_pool_watermark;
+}
+
+void
+udisks_lvm2_state_set_thin_pool_sample_interval (UDisksLVM2State *state,
+                                                 guint            interval)
+{
+  g_assert (state != NULL);
+
+  state->thin_pool_sample_interval = interval;
+}
+
+void
+udisks_lvm2_state_set_thin_pool_watermark (UDisksLVM2State *state,
+                                           gdouble          watermark)
+{
+  g_assert (state != NULL);
+
+  state->thin_pool_watermark = watermark;
+}
@@ -49,4 +49,7 @@ typedef struct _UDisksLinuxManagerLVM2 UDisksLinuxManagerLVM2;
 struct _UDisksLinuxBlockLVM2;
 typedef struct _UDisksLinuxBlockLVM2 UDisksLinuxBlockLVM2;
 
+struct _VGJobQueue;
+typedef struct _VGJobQueue VGJobQueue;
+
 #endif /* __UDISKS_LVM2_TYPES_H__ */
@@ -40,6 +40,9 @@ G_MODULE_EXPORT gpointer udisks_module_init (UDisksDaemon *daemon);
 /* Corresponds with the UDisksModuleTeardownFunc type */
 G_MODULE_EXPORT void udisks_module_teardown (UDisksDaemon *daemon);
 
+/* Corresponds with the UDisksModuleReloadConfigurationFunc type, optional */
+G_MODULE_EXPORT void udisks_module_reload_configuration (UDisksDaemon *daemon);
+
 /**
  * UDisks module setup entry functions:
  *   Functions below are module entry functions that return an array of setup
@@ -54,9 +57,18 @@ G_MODULE_EXPORT void udisks_module_teardown (UDisksDaemon *daemon);
 G_MODULE_EXPORT UDisksModuleInterfaceInfo **udisks_module_get_block_object_iface_setup_entries (void);
 G_MODULE_EXPORT UDisksModuleInterfaceInfo **udisks_module_get_drive_object_iface_setup_entries (void);
 
+/* Corresponds with the UDisksModuleInterfaceMatchSetupFunc type, optional */
+G_MODULE_EXPORT UDisksModuleInterfaceMatch **udisks_module_get_block_object_iface_matches (void);
+
 /* Corresponds with the UDisksModuleObjectNewSetupFunc type */
 G_MODULE_EXPORT UDisksModuleObjectNewFunc  *udisks_module_get_object_new_funcs (void);
 
+/* Corresponds with the UDisksModuleObjectNewFuncMatchSetupFunc type, optional */
+G_MODULE_EXPORT UDisksModuleObjectNewFuncMatch **udisks_module_get_object_new_func_matches (void);
+
+/* Corresponds with the UDisksModuleObjectHousekeepingInfoSetupFunc type, optional */
+G_MODULE_EXPORT UDisksModuleObjectHousekeepingInfo **udisks_module_get_object_housekeeping_infos (void);
+
 /* Corresponds with the UDisksModuleNewManagerIfaceSetupFunc type */
 G_MODULE_EXPORT UDisksModuleNewManagerIfaceFunc *udisks_module_get_new_manager_iface_funcs (void);
 
@@ -46,7 +46,8 @@ G_BEGIN_DECLS
  * themselves whose call the @has_func, @connect_func and @update_func respectively
  * as needed. Purpose of these member functions is to check whether the particular
  * #UDisksModuleInterfaceInfo record is applicable to the current device and
- * construct a new #GDBusInterface if so.
+ * construct a new #GDBusInterface if so. Like all callbacks of modules they
+ * are called in the main thread, see #UDisksModuleObjectIface.
  *
  * See #UDisksObjectHasInterfaceFunc, #UDisksObjectConnectInterfaceFunc and
  * #UDisksObjectUpdateInterfaceFunc for detailed description and return values.
@@ -61,6 +62,36 @@ struct _UDisksModuleInterfaceInfo
 
 typedef struct _UDisksModuleInterfaceInfo UDisksModuleInterfaceInfo;
 
+/**
+ * UDisksModuleInterfaceMatch:
+ * @skeleton_type: The @skeleton_type of the #UDisksModuleInterfaceInfo the keys apply to.
+ * @fs_types: (nullable): A %NULL-terminated array of ID_FS_TYPE udev property values.
+ * @dm_uuid_prefixes: (nullable): A %NULL-terminated array of prefixes of the DM_UUID
+ *                    udev property.
+ * @device_file_prefixes: (nullable): A %NULL-terminated array of prefixes of the
+ *                        device file (e.g. "/dev/zram").
+ * @major: Major number of the device or 0 for any.
+ *
+ * Structure containing cheap predicate keys describing the block devices a
+ * #UDisksModuleInterfaceInfo can possibly apply to. A device may match if it
+ * satisfies at least one of the keys that are set.
+ *
+ * #UDisksLinuxBlockObject evaluates these keys before calling the @has_func of
+ * the corresponding #UDisksModuleInterfaceInfo and skips it for devices that
+ * cannot match and don't have the interface exported already. Interfaces
+ * without any keys declared are checked on every uevent.
+ */
+struct _UDisksModuleInterfaceMatch
+{
+  GType skeleton_type;
+  const gchar * const *fs_types;
+  const gchar * const *dm_uuid_prefixes;
+  const gchar * const *device_file_prefixes;
+  guint major;
+};
+
+typedef struct _UDisksModuleInterfaceMatch UDisksModuleInterfaceMatch;
+
 /**
  * UDisksModuleObjectNewFunc:
  * @daemon: A #UDisksDaemon instance.
@@ -117,6 +148,75 @@ typedef struct _UDisksModuleInterfaceInfo UDisksModuleInterfaceInfo;
 typedef GDBusObjectSkeleton* (*UDisksModuleObjectNewFunc) (UDisksDaemon      *daemon,
                                                            UDisksLinuxDevice *device);
 
+/**
+ * UDisksModuleObjectNewFuncMatch:
+ * @new_func: The #UDisksModuleObjectNewFunc the criteria apply to.
+ * @devtype: (nullable): Device type (e.g. "disk" or "partition") the device must have.
+ * @sysfs_path_pattern: (nullable): A glob pattern (see g_pattern_match_simple()) the
+ *                      sysfs path of the device must match.
+ * @udev_properties: (nullable): A %NULL-terminated array of udev property names
+ *                   of which the device must have at least one set.
+ *
+ * Structure describing the devices a #UDisksModuleObjectNewFunc can possibly
+ * be interested in. Every criterion that is not %NULL must be satisfied.
+ *
+ * #UDisksLinuxProvider uses these criteria to skip calling @new_func (and
+ * asking its existing instances to claim the device) for uevents on devices
+ * that cannot match. Instances that have already claimed a device keep
+ * receiving all of its uevents regardless of the criteria. Functions that
+ * don't declare any criteria are called for every uevent.
+ */
+struct _UDisksModuleObjectNewFuncMatch
+{
+  UDisksModuleObjectNewFunc new_func;
+  const gchar *devtype;
+  const gchar *sysfs_path_pattern;
+  const gchar * const *udev_properties;
+};
+
+typedef struct _UDisksModuleObjectNewFuncMatch UDisksModuleObjectNewFuncMatch;
+
+/**
+ * UDisksModuleHousekeepingCost:
+ * @UDISKS_MODULE_HOUSEKEEPING_COST_CHEAP: Housekeeping is cheap (e.g. only
+ *   reads state cached in memory or in sysfs) and runs independently of
+ *   any other housekeeping.
+ * @UDISKS_MODULE_HOUSEKEEPING_COST_EXPENSIVE: Housekeeping issues I/O or
+ *   calls out to slow tools. It shares the budget of parallel housekeeping
+ *   runs (see the housekeeping_max_parallel key in udisks2.conf) with the
+ *   SMART housekeeping of drives.
+ *
+ * Cost classes of module object housekeeping.
+ */
+typedef enum
+{
+  UDISKS_MODULE_HOUSEKEEPING_COST_CHEAP,
+  UDISKS_MODULE_HOUSEKEEPING_COST_EXPENSIVE,
+} UDisksModuleHousekeepingCost;
+
+/**
+ * UDisksModuleObjectHousekeepingInfo:
+ * @new_func: The #UDisksModuleObjectNewFunc whose instances the info applies to.
+ * @interval: Seconds between two housekeeping runs of the instances or 0 if
+ *            udisks_module_object_housekeeping() does nothing and should never be called.
+ * @cost: A #UDisksModuleHousekeepingCost.
+ *
+ * Structure describing how often and at what cost the instances created by
+ * @new_func are to be housekept. #UDisksLinuxProvider schedules every
+ * #UDisksModuleObjectNewFunc separately from the housekeeping of drives.
+ * Housekeeping is checked for every ten seconds so shorter intervals are
+ * rounded up. Instances of functions that don't declare any info are
+ * housekept as expensive every ten minutes.
+ */
+struct _UDisksModuleObjectHousekeepingInfo
+{
+  UDisksModuleObjectNewFunc new_func;
+  guint interval;
+  UDisksModuleHousekeepingCost cost;
+};
+
+typedef struct _UDisksModuleObjectHousekeepingInfo UDisksModuleObjectHousekeepingInfo;
+
 /**
  * UDisksModuleNewManagerIfaceFunc:
  * @daemon: A #UDisksDaemon instance.
@@ -169,6 +269,20 @@ typedef gpointer (*UDisksModuleInitFunc) (UDisksDaemon *daemon);
  */
 typedef void (*UDisksModuleTeardownFunc) (UDisksDaemon *daemon);
 
+/**
+ * UDisksModuleReloadConfigurationFunc:
+ * @daemon: A #UDisksDaemon instance.
+ *
+ * Function prototype that is called when the configuration file of the module
+ * in the modules.conf.d directory has changed. Its purpose is to read the file
+ * again and take over the settings that can be changed at runtime, e.g. by
+ * updating the module state.
+ *
+ * Corresponds with the optional udisks_module_reload_configuration() module symbol.
+ * Used internally by #UDisksModuleManager.
+ */
+typedef void (*UDisksModuleReloadConfigurationFunc) (UDisksDaemon *daemon);
+
 /**
  * UDisksModuleIfaceSetupFunc:
  *
@@ -182,6 +296,18 @@ typedef void (*UDisksModuleTeardownFunc) (UDisksDaemon *daemon);
  */
 typedef UDisksModuleInterfaceInfo ** (*UDisksModuleIfaceSetupFunc) (void);
 
+/**
+ * UDisksModuleInterfaceMatchSetupFunc:
+ *
+ * Type declaration of a module setup entry function.
+ *
+ * Corresponds with the optional udisks_module_get_block_object_iface_matches()
+ * module symbol. Used internally by #UDisksModuleManager.
+ *
+ * Returns: An array of pointers to the #UDisksModuleInterfaceMatch structs. Free with g_free().
+ */
+typedef UDisksModuleInterfaceMatch ** (*UDisksModuleInterfaceMatchSetupFunc) (void);
+
 /**
  * UDisksModuleObjectNewSetupFunc:
  *
@@ -194,6 +320,30 @@ typedef UDisksModuleInterfaceInfo ** (*UDisksModuleIfaceSetupFunc) (void);
  */
 typedef UDisksModuleObjectNewFunc * (*UDisksModuleObjectNewSetupFunc) (void);
 
+/**
+ * UDisksModuleObjectNewFuncMatchSetupFunc:
+ *
+ * Type declaration of a module setup entry function.
+ *
+ * Corresponds with the optional udisks_module_get_object_new_func_matches()
+ * module symbol. Used internally by #UDisksModuleManager.
+ *
+ * Returns: An array of pointers to the #UDisksModuleObjectNewFuncMatch structs. Free with g_free().
+ */
+typedef UDisksModuleObjectNewFuncMatch ** (*UDisksModuleObjectNewFuncMatchSetupFunc) (void);
+
+/**
+ * UDisksModuleObjectHousekeepingInfoSetupFunc:
+ *
+ * Type declaration of a module setup entry function.
+ *
+ * Corresponds with the optional udisks_module_get_object_housekeeping_infos()
+ * module symbol. Used internally by #UDisksModuleManager.
+ *
+ * Returns: An array of pointers to the #UDisksModuleObjectHousekeepingInfo structs. Free with g_free().
+ */
+typedef UDisksModuleObjectHousekeepingInfo ** (*UDisksModuleObjectHousekeepingInfoSetupFunc) (void);
+
 /**
  * UDisksModuleNewManagerIfaceSetupFunc:
  *
@@ -43,6 +43,23 @@ struct _UDisksModuleObject;
 typedef struct _UDisksModuleObject         UDisksModuleObject;
 typedef struct _UDisksModuleObjectIface    UDisksModuleObjectIface;
 
+/**
+ * UDisksModuleObjectIface:
+ * @parent_iface: The parent interface.
+ * @process_uevent: Processes a uevent, see udisks_module_object_process_uevent().
+ * @housekeeping: Performs housekeeping, see udisks_module_object_housekeeping().
+ *
+ * Interface for objects exported by modules.
+ *
+ * Uevents are applied to the core objects in a dedicated thread, but the
+ * callbacks of modules are always called in the main thread: @process_uevent,
+ * the #UDisksModuleObjectNewFunc functions and the #UDisksModuleInterfaceInfo
+ * functions for block and drive objects are handed off to the default
+ * #GMainContext in the order of the uevents. Modules may therefore share
+ * their state with D-Bus method handlers, g_timeout_add() callbacks and the
+ * callbacks of #GTask instances created in them without locking. Only
+ * @housekeeping runs in a separate thread.
+ */
 struct _UDisksModuleObjectIface
 {
   GTypeInterface parent_iface;
@@ -23,6 +23,7 @@
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxblockobject.h>
 #include <src/udiskslinuxdevice.h>
 #include <src/udiskslogging.h>
@@ -51,8 +52,24 @@ struct _UDisksLinuxBlockVDO {
   UDisksBlockVDOSkeleton parent_instance;
 
   UDisksDaemon *daemon;
+
+  /* protects the statistics snapshots, GetStatistics() is handled in threads */
+  GMutex stats_mutex;
+  GHashTable *stats;
+  gint64 stats_time;
+  GHashTable *prev_stats;
+  gint64 prev_stats_time;
+  gint64 last_stats_request;
+  guint stats_timeout_id;
+  gboolean stats_collecting;
 };
 
+/* seconds between the statistics snapshots taken in the background and
+ * without GetStatistics() calls after which the collection stops
+ */
+#define STATS_SAMPLE_INTERVAL 5
+#define STATS_IDLE_TIMEOUT    60
+
 struct _UDisksLinuxBlockVDOClass {
   UDisksBlockVDOSkeletonClass parent_class;
 };
@@ -123,6 +140,14 @@ udisks_linux_block_vdo_dispose (GObject *object)
 static void
 udisks_linux_block_vdo_finalize (GObject *object)
 {
+  UDisksLinuxBlockVDO *l_block_vdo = UDISKS_LINUX_BLOCK_VDO (object);
+
+  if (l_block_vdo->stats_timeout_id > 0)
+    g_source_remove (l_block_vdo->stats_timeout_id);
+  g_clear_pointer (&l_block_vdo->stats, g_hash_table_destroy);
+  g_clear_pointer (&l_block_vdo->prev_stats, g_hash_table_destroy);
+  g_mutex_clear (&l_block_vdo->stats_mutex);
+
   if (G_OBJECT_CLASS (udisks_linux_block_vdo_parent_class))
     G_OBJECT_CLASS (udisks_linux_block_vdo_parent_class)->finalize (object);
 }
@@ -152,13 +177,14 @@ udisks_linux_block_vdo_class_init (UDisksLinuxBlockVDOClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_block_vdo_init (UDisksLinuxBlockVDO *l_block_vdo)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (l_block_vdo),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&l_block_vdo->stats_mutex);
 }
 
 /**
@@ -709,38 +735,228 @@ handle_stop (UDisksBlockVDO        *block_vdo,
   return TRUE;
 }
 
+/* Must be called with stats_mutex held */
+static void
+stats_store_snapshot_locked (UDisksLinuxBlockVDO *l_block_vdo,
+                             GHashTable          *stats)
+{
+  g_clear_pointer (&l_block_vdo->prev_stats, g_hash_table_destroy);
+  l_block_vdo->prev_stats = l_block_vdo->stats;
+  l_block_vdo->prev_stats_time = l_block_vdo->stats_time;
+  l_block_vdo->stats = stats;
+  l_block_vdo->stats_time = g_get_monotonic_time ();
+}
+
+static void
+stats_collect_thread (GTask        *task,
+                      gpointer      source_object,
+                      gpointer      task_data,
+                      GCancellable *cancellable)
+{
+  GHashTable *stats;
+  GError *error = NULL;
+
+  stats = bd_vdo_get_stats_full (task_data, &error);
+  if (stats == NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_pointer (task, stats, (GDestroyNotify) g_hash_table_destroy);
+}
+
+static void
+stats_collect_done (GObject      *source_object,
+                    GAsyncResult *res,
+                    gpointer      user_data)
+{
+  UDisksLinuxBlockVDO *l_block_vdo = UDISKS_LINUX_BLOCK_VDO (source_object);
+  GHashTable *stats;
+  GError *error = NULL;
+
+  stats = g_task_propagate_pointer (G_TASK (res), &error);
+  if (stats == NULL)
+    {
+      udisks_warning ("Error collecting statistics of the VDO volume %s: %s (%s, %d)",
+                      udisks_block_vdo_get_name (UDISKS_BLOCK_VDO (l_block_vdo)),
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+
+  g_mutex_lock (&l_block_vdo->stats_mutex);
+  if (stats != NULL)
+    stats_store_snapshot_locked (l_block_vdo, stats);
+  l_block_vdo->stats_collecting = FALSE;
+  g_mutex_unlock (&l_block_vdo->stats_mutex);
+}
+
+static gboolean
+stats_timeout (gpointer user_data)
+{
+  UDisksLinuxBlockVDO *l_block_vdo;
+  gboolean ret = G_SOURCE_CONTINUE;
+  GTask *task;
+
+  l_block_vdo = g_weak_ref_get (user_data);
+  if (l_block_vdo == NULL)
+    return G_SOURCE_REMOVE;
+
+  g_mutex_lock (&l_block_vdo->stats_mutex);
+  if (g_get_monotonic_time () - l_block_vdo->last_stats_request > STATS_IDLE_TIMEOUT * G_USEC_PER_SEC)
+    {
+      /* nobody is interested, the next request fetches a fresh snapshot */
+      g_clear_pointer (&l_block_vdo->stats, g_hash_table_destroy);
+      g_clear_pointer (&l_block_vdo->prev_stats, g_hash_table_destroy);
+      l_block_vdo->stats_timeout_id = 0;
+      ret = G_SOURCE_REMOVE;
+    }
+  else if (! l_block_vdo->stats_collecting)
+    {
+      l_block_vdo->stats_collecting = TRUE;
+      task = g_task_new (l_block_vdo, NULL, stats_collect_done, NULL);
+      g_task_set_task_data (task, g_strdup (udisks_block_vdo_get_name (UDISKS_BLOCK_VDO (l_block_vdo))), g_free);
+      g_task_run_in_thread (task, stats_collect_thread);
+      g_object_unref (task);
+    }
+  g_mutex_unlock (&l_block_vdo->stats_mutex);
+
+  g_object_unref (l_block_vdo);
+  return ret;
+}
+
+static void
+weak_ref_free (gpointer ref)
+{
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
+
+/* Must be called with stats_mutex held */
+static void
+stats_start_collecting_locked (UDisksLinuxBlockVDO *l_block_vdo)
+{
+  UDisksDaemon *daemon;
+  GWeakRef *ref;
+
+  if (l_block_vdo->stats_timeout_id > 0)
+    return;
+
+  daemon = udisks_linux_block_vdo_get_daemon (l_block_vdo);
+  if (daemon == NULL)
+    return;
+
+  ref = g_new0 (GWeakRef, 1);
+  g_weak_ref_init (ref, l_block_vdo);
+  l_block_vdo->stats_timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                          "vdo-stats-sample",
+                                                                          STATS_SAMPLE_INTERVAL,
+                                                                          stats_timeout,
+                                                                          ref,
+                                                                          weak_ref_free);
+}
+
 static void
 stats_add_element (const gchar *key, const gchar *value, GVariantBuilder *builder)
 {
   g_variant_builder_add (builder, "{ss}", key, value);
 }
 
+static gboolean
+parse_counter (const gchar *str,
+               guint64     *out_value)
+{
+  gchar *end = NULL;
+
+  if (! g_ascii_isdigit (*str))
+    return FALSE;
+  *out_value = g_ascii_strtoull (str, &end, 10);
+  return *end == '\0';
+}
+
+/* Adds the changes per second of the numeric statistics between the two
+ * last snapshots as "<key>_per_second". Must be called with stats_mutex held.
+ */
+static void
+stats_add_rates_locked (UDisksLinuxBlockVDO *l_block_vdo,
+                        GVariantBuilder     *builder)
+{
+  GHashTableIter iter;
+  const gchar *key;
+  const gchar *value;
+  gdouble seconds;
+
+  if (l_block_vdo->prev_stats == NULL || l_block_vdo->stats_time <= l_block_vdo->prev_stats_time)
+    return;
+
+  seconds = (gdouble) (l_block_vdo->stats_time - l_block_vdo->prev_stats_time) / G_USEC_PER_SEC;
+  g_hash_table_iter_init (&iter, l_block_vdo->stats);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &value))
+    {
+      const gchar *prev_value;
+      guint64 cur, prev;
+      gchar *rate_key;
+      gchar rate[G_ASCII_DTOSTR_BUF_SIZE];
+
+      prev_value = g_hash_table_lookup (l_block_vdo->prev_stats, key);
+      if (prev_value == NULL || ! parse_counter (value, &cur) || ! parse_counter (prev_value, &prev))
+        continue;
+
+      rate_key = g_strdup_printf ("%s_per_second", key);
+      g_ascii_formatd (rate, sizeof (rate), "%.2f", ((gdouble) cur - (gdouble) prev) / seconds);
+      g_variant_builder_add (builder, "{ss}", rate_key, rate);
+      g_free (rate_key);
+    }
+}
+
 static gboolean
 handle_get_statistics (UDisksBlockVDO        *block_vdo,
                        GDBusMethodInvocation *invocation,
                        GVariant              *arg_options)
 {
+  UDisksLinuxBlockVDO *l_block_vdo = UDISKS_LINUX_BLOCK_VDO (block_vdo);
   const gchar *dm_name;
   GHashTable *stats;
   GVariantBuilder builder;
   GError *error = NULL;
+  gboolean refresh = FALSE;
+  gboolean rates = FALSE;
+  gchar *age;
 
-  dm_name = udisks_block_vdo_get_name (block_vdo);
-  stats = bd_vdo_get_stats_full (dm_name, &error);
-  if (stats == NULL)
+  g_variant_lookup (arg_options, "refresh", "b", &refresh);
+  g_variant_lookup (arg_options, "rates", "b", &rates);
+
+  g_mutex_lock (&l_block_vdo->stats_mutex);
+  l_block_vdo->last_stats_request = g_get_monotonic_time ();
+  if (l_block_vdo->stats == NULL || refresh)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error retrieving volume statistics: %s",
-                                             error->message);
-      g_error_free (error);
-      return TRUE;
+      /* no snapshot yet, fetch one right away */
+      g_mutex_unlock (&l_block_vdo->stats_mutex);
+      dm_name = udisks_block_vdo_get_name (block_vdo);
+      stats = bd_vdo_get_stats_full (dm_name, &error);
+      if (stats == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation,
+                                                 UDISKS_ERROR,
+                                                 UDISKS_ERROR_FAILED,
+                                                 "Error retrieving volume statistics: %s",
+                                                 error->message);
+          g_error_free (error);
+          return TRUE;
+        }
+      g_mutex_lock (&l_block_vdo->stats_mutex);
+      stats_store_snapshot_locked (l_block_vdo, stats);
     }
+  stats_start_collecting_locked (l_block_vdo);
+
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ss}"));
-  g_hash_table_foreach (stats, (GHFunc) stats_add_element, &builder);
+  g_hash_table_foreach (l_block_vdo->stats, (GHFunc) stats_add_element, &builder);
+  age = g_strdup_printf ("%" G_GINT64_FORMAT,
+                         (g_get_monotonic_time () - l_block_vdo->stats_time) / 1000);
+  g_variant_builder_add (&builder, "{ss}", "snapshot_age_msec", age);
+  g_free (age);
+  if (rates)
+    stats_add_rates_locked (l_block_vdo, &builder);
+  g_mutex_unlock (&l_block_vdo->stats_mutex);
+
   udisks_block_vdo_complete_get_statistics (block_vdo, invocation, g_variant_builder_end (&builder));
-  g_hash_table_destroy (stats);
 
   /* Indicate that we handled the method invocation */
   return TRUE;
@@ -24,6 +24,7 @@
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslogging.h>
 #include <src/udiskssimplejob.h>
 
@@ -146,13 +147,13 @@ udisks_linux_manager_vdo_class_init (UDisksLinuxManagerVDOClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_manager_vdo_init (UDisksLinuxManagerVDO *self)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (self),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 /**
@@ -323,6 +324,7 @@ handle_create_volume (UDisksManagerVDO      *manager,
                                                    (gpointer) arg_name,
                                                    NULL,
                                                    10, /* timeout_seconds */
+                                                   udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                    &error);
   if (vdo_object == NULL)
     {
@@ -439,6 +441,7 @@ handle_start_volume_by_name (UDisksManagerVDO      *manager,
                                                (gpointer) arg_name,
                                                NULL,
                                                10, /* timeout_seconds */
+                                               udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                &error);
   if (object == NULL)
     {
@@ -82,7 +82,6 @@ check_want_vdo_block (UDisksObject *object)
 {
   UDisksLinuxDevice *device;
   gboolean ret;
-  const gchar *dm_uuid;
   const gchar *dm_name;
   BDVDOInfo *bd_info;
 
@@ -91,12 +90,11 @@ check_want_vdo_block (UDisksObject *object)
   /* Check for associated DM udev attributes. Unfortunately there are no VDO-specific
    * attributes exposed at the moment. */
   device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
-  dm_uuid = g_udev_device_get_property (device->udev_device, "DM_UUID");
   dm_name = g_udev_device_get_property (device->udev_device, "DM_NAME");
 
   ret = FALSE;
   /* XXX: this is not guaranteed in any way */
-  if (dm_uuid != NULL && dm_name != NULL && g_str_has_prefix (dm_uuid, "VDO-"))
+  if (dm_name != NULL && udisks_linux_device_get_dm_type (device) == UDISKS_LINUX_DEVICE_DM_TYPE_VDO)
     {
       /* Test if we can get VDO info */
       bd_info = bd_vdo_info (dm_name, NULL);
@@ -139,6 +137,21 @@ udisks_module_get_block_object_iface_setup_entries (void)
   return iface;
 }
 
+static const gchar * const vdo_dm_uuid_prefixes[] = { "VDO-", NULL };
+
+UDisksModuleInterfaceMatch **
+udisks_module_get_block_object_iface_matches (void)
+{
+  UDisksModuleInterfaceMatch **matches;
+
+  matches = g_new0 (UDisksModuleInterfaceMatch *, 2);
+  matches[0] = g_new0 (UDisksModuleInterfaceMatch, 1);
+  matches[0]->skeleton_type = UDISKS_TYPE_LINUX_BLOCK_VDO;
+  matches[0]->dm_uuid_prefixes = vdo_dm_uuid_prefixes;
+
+  return matches;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 UDisksModuleInterfaceInfo **
@@ -18,12 +18,16 @@
  */
 #include "config.h"
 
+#include <stdio.h>
 #include <glib/gi18n.h>
 
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslinuxblockobject.h>
 #include <src/udiskslogging.h>
 #include <src/udisksdaemon.h>
+#include <src/udiskslinuxdevice.h>
+#include <src/udisksmountmonitor.h>
 #include <blockdev/kbd.h>
 #include <blockdev/swap.h>
 
@@ -48,14 +52,42 @@
 
 struct _UDisksLinuxBlockZRAM {
   UDisksBlockZRAMSkeleton parent_instance;
+
+  /* sysfs directory and device number, set by update() */
+  gchar *sysfs_path;
+  dev_t dev;
+
+  /* protects the fields below, Subscribe() is handled in a thread */
+  GMutex subscribers_mutex;
+  /* unique bus name -> Subscriber */
+  GHashTable *subscribers;
+  guint sample_timeout_id;
+  guint sample_interval;
 };
 
+typedef struct
+{
+  guint watch_id;
+  guint interval;
+} Subscriber;
+
+/* milliseconds */
+#define DEFAULT_SAMPLE_INTERVAL 1000
+#define MIN_SAMPLE_INTERVAL 100
+
 struct _UDisksLinuxBlockZRAMClass {
   UDisksBlockZRAMSkeletonClass parent_instance;
 };
 
 static void udisks_linux_block_zram_iface_init (UDisksBlockZRAMIface *iface);
 
+static void
+subscriber_free (Subscriber *subscriber)
+{
+  g_bus_unwatch_name (subscriber->watch_id);
+  g_free (subscriber);
+}
+
 G_DEFINE_TYPE_WITH_CODE (UDisksLinuxBlockZRAM, udisks_linux_block_zram,
                          UDISKS_TYPE_BLOCK_ZRAM_SKELETON,
                          G_IMPLEMENT_INTERFACE (UDISKS_TYPE_BLOCK_ZRAM,
@@ -99,6 +131,14 @@ udisks_linux_block_zram_dispose (GObject *object)
 static void
 udisks_linux_block_zram_finalize (GObject *object)
 {
+  UDisksLinuxBlockZRAM *zramblock = UDISKS_LINUX_BLOCK_ZRAM (object);
+
+  if (zramblock->sample_timeout_id > 0)
+    g_source_remove (zramblock->sample_timeout_id);
+  g_hash_table_destroy (zramblock->subscribers);
+  g_mutex_clear (&zramblock->subscribers_mutex);
+  g_free (zramblock->sysfs_path);
+
   if (G_OBJECT_CLASS (udisks_linux_block_zram_parent_class))
     G_OBJECT_CLASS (udisks_linux_block_zram_parent_class)->finalize (object);
 }
@@ -112,13 +152,16 @@ udisks_linux_block_zram_class_init (UDisksLinuxBlockZRAMClass *klass)
   gobject_class->set_property = udisks_linux_block_zram_set_property;
   gobject_class->dispose = udisks_linux_block_zram_dispose;
   gobject_class->finalize = udisks_linux_block_zram_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_block_zram_init (UDisksLinuxBlockZRAM *zramblock)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (zramblock),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&zramblock->subscribers_mutex);
+  zramblock->subscribers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, (GDestroyNotify) subscriber_free);
 }
 
 /**
@@ -183,6 +226,151 @@ extract_comp_algorithm (const gchar *alg_str)
   return g_strndup (begin, end - begin);
 }
 
+/* Whether the device is in use as swap according to the mount monitor, so
+ * that /proc/swaps doesn't need to be parsed for every update
+ */
+static gboolean
+is_swap_active (UDisksLinuxBlockZRAM *zramblock)
+{
+  UDisksDaemon *daemon;
+  UDisksMountType mount_type;
+
+  daemon = udisks_linux_block_zram_get_daemon (zramblock);
+  if (! daemon)
+    return FALSE;
+
+  return udisks_mount_monitor_is_dev_in_use (udisks_daemon_get_mount_monitor (daemon),
+                                             zramblock->dev, &mount_type) &&
+         mount_type == UDISKS_MOUNT_TYPE_SWAP;
+}
+
+static void
+set_sizes (UDisksLinuxBlockZRAM *zramblock,
+           guint64               orig_data_size,
+           guint64               compr_data_size,
+           guint64               mem_used_total)
+{
+  UDisksBlockZRAM *iface = UDISKS_BLOCK_ZRAM (zramblock);
+
+  udisks_block_zram_set_orig_data_size (iface, orig_data_size);
+  udisks_block_zram_set_compr_data_size (iface, compr_data_size);
+  udisks_block_zram_set_mem_used_total (iface, mem_used_total);
+  udisks_block_zram_set_compression_ratio (iface,
+                                           compr_data_size > 0 ? (gdouble) orig_data_size / compr_data_size : 0.0);
+}
+
+/* Updates the sizes from a single read of mm_stat */
+static void
+sample_stats (UDisksLinuxBlockZRAM *zramblock)
+{
+  gchar *path;
+  gchar *contents = NULL;
+  guint64 orig_data_size, compr_data_size, mem_used_total;
+
+  if (! zramblock->sysfs_path)
+    return;
+
+  path = g_build_filename (zramblock->sysfs_path, "mm_stat", NULL);
+  if (g_file_get_contents (path, &contents, NULL, NULL) &&
+      sscanf (contents, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+              &orig_data_size, &compr_data_size, &mem_used_total) == 3)
+    set_sizes (zramblock, orig_data_size, compr_data_size, mem_used_total);
+
+  udisks_block_zram_set_active (UDISKS_BLOCK_ZRAM (zramblock), is_swap_active (zramblock));
+
+  g_free (contents);
+  g_free (path);
+}
+
+static gboolean
+sample_timeout (gpointer user_data)
+{
+  UDisksLinuxBlockZRAM *zramblock;
+
+  zramblock = g_weak_ref_get (user_data);
+  if (! zramblock)
+    return G_SOURCE_REMOVE;
+
+  sample_stats (zramblock);
+  g_object_unref (zramblock);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gpointer
+weak_ref_new (gpointer object)
+{
+  GWeakRef *ref;
+
+  ref = g_new0 (GWeakRef, 1);
+  g_weak_ref_init (ref, object);
+  return ref;
+}
+
+static void
+weak_ref_free (gpointer ref)
+{
+  g_weak_ref_clear (ref);
+  g_free (ref);
+}
+
+/* Samples at the shortest interval requested by the subscribers, if any.
+ * Must be called with subscribers_mutex held.
+ */
+static void
+update_sampling_locked (UDisksLinuxBlockZRAM *zramblock)
+{
+  GHashTableIter iter;
+  Subscriber *subscriber;
+  guint interval = 0;
+
+  g_hash_table_iter_init (&iter, zramblock->subscribers);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &subscriber))
+    if (interval == 0 || subscriber->interval < interval)
+      interval = subscriber->interval;
+
+  if (interval == zramblock->sample_interval)
+    return;
+
+  if (zramblock->sample_timeout_id > 0)
+    {
+      g_source_remove (zramblock->sample_timeout_id);
+      zramblock->sample_timeout_id = 0;
+    }
+  if (interval > 0)
+    zramblock->sample_timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                                       interval,
+                                                       sample_timeout,
+                                                       weak_ref_new (zramblock),
+                                                       weak_ref_free);
+  zramblock->sample_interval = interval;
+}
+
+static void
+remove_subscriber (UDisksLinuxBlockZRAM *zramblock,
+                   const gchar          *name)
+{
+  g_mutex_lock (&zramblock->subscribers_mutex);
+  if (g_hash_table_remove (zramblock->subscribers, name))
+    update_sampling_locked (zramblock);
+  g_mutex_unlock (&zramblock->subscribers_mutex);
+}
+
+static void
+on_subscriber_vanished (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         user_data)
+{
+  UDisksLinuxBlockZRAM *zramblock;
+
+  zramblock = g_weak_ref_get (user_data);
+  if (! zramblock)
+    return;
+
+  remove_subscriber (zramblock, name);
+  g_object_unref (zramblock);
+}
+
 /**
  * udisks_linux_block_zram_update:
  * @zramblock: A #UDisksLinuxBlockZRAM
@@ -203,12 +391,19 @@ udisks_linux_block_zram_update (UDisksLinuxBlockZRAM    *zramblock,
   gboolean rval = FALSE;
   BDKBDZramStats *zram_info;
   gchar *algorithm = NULL;
+  UDisksLinuxDevice *device;
 
   g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK_ZRAM (zramblock), FALSE);
   g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object), FALSE);
 
   dev_file = udisks_linux_block_object_get_device_file (object);
 
+  device = udisks_linux_block_object_get_device (object);
+  g_free (zramblock->sysfs_path);
+  zramblock->sysfs_path = g_strdup (g_udev_device_get_sysfs_path (device->udev_device));
+  zramblock->dev = g_udev_device_get_device_number (device->udev_device);
+  g_object_unref (device);
+
   zram_info = bd_kbd_zram_get_stats (dev_file, &error);
 
   if (! zram_info)
@@ -234,11 +429,9 @@ udisks_linux_block_zram_update (UDisksLinuxBlockZRAM    *zramblock,
   udisks_block_zram_set_zero_pages (iface, zram_info->zero_pages);
   udisks_block_zram_set_max_comp_streams (iface, zram_info->max_comp_streams);
   udisks_block_zram_set_comp_algorithm (iface, algorithm);
-  udisks_block_zram_set_orig_data_size (iface, zram_info->orig_data_size);
-  udisks_block_zram_set_compr_data_size (iface, zram_info->compr_data_size);
-  udisks_block_zram_set_mem_used_total (iface, zram_info->mem_used_total);
+  set_sizes (zramblock, zram_info->orig_data_size, zram_info->compr_data_size, zram_info->mem_used_total);
 
-  udisks_block_zram_set_active (iface, bd_swap_swapstatus (dev_file, &error));
+  udisks_block_zram_set_active (iface, is_swap_active (zramblock));
 out:
   if (zram_info)
     bd_kbd_zram_stats_free (zram_info);
@@ -413,6 +606,85 @@ out:
   return TRUE;
 }
 
+static gboolean
+handle_subscribe (UDisksBlockZRAM       *zramblock_,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksLinuxBlockZRAM *zramblock = UDISKS_LINUX_BLOCK_ZRAM (zramblock_);
+  const gchar *sender;
+  Subscriber *subscriber;
+  guint interval = DEFAULT_SAMPLE_INTERVAL;
+
+  g_variant_lookup (options, "interval", "u", &interval);
+  if (interval < MIN_SAMPLE_INTERVAL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "The sampling interval must be at least %d ms",
+                                             MIN_SAMPLE_INTERVAL);
+      return TRUE;
+    }
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  sender = g_dbus_method_invocation_get_sender (invocation);
+
+  g_mutex_lock (&zramblock->subscribers_mutex);
+  subscriber = g_hash_table_lookup (zramblock->subscribers, sender);
+  if (! subscriber)
+    {
+      subscriber = g_new0 (Subscriber, 1);
+      subscriber->watch_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                                             sender,
+                                                             G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                             NULL,
+                                                             on_subscriber_vanished,
+                                                             weak_ref_new (zramblock),
+                                                             weak_ref_free);
+      g_hash_table_insert (zramblock->subscribers, g_strdup (sender), subscriber);
+    }
+  subscriber->interval = interval;
+  update_sampling_locked (zramblock);
+  g_mutex_unlock (&zramblock->subscribers_mutex);
+
+  udisks_block_zram_complete_subscribe (zramblock_, invocation);
+  return TRUE;
+}
+
+static gboolean
+handle_unsubscribe (UDisksBlockZRAM       *zramblock_,
+                    GDBusMethodInvocation *invocation,
+                    GVariant              *options)
+{
+  UDisksLinuxBlockZRAM *zramblock = UDISKS_LINUX_BLOCK_ZRAM (zramblock_);
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  remove_subscriber (zramblock, g_dbus_method_invocation_get_sender (invocation));
+  udisks_block_zram_complete_unsubscribe (zramblock_, invocation);
+  return TRUE;
+}
+
 static void
 udisks_linux_block_zram_iface_init (UDisksBlockZRAMIface *iface)
 {
@@ -420,4 +692,6 @@ udisks_linux_block_zram_iface_init (UDisksBlockZRAMIface *iface)
   iface->handle_activate = handle_activate;
   iface->handle_activate_labeled = handle_activate_labeled;
   iface->handle_deactivate = handle_deactivate;
+  iface->handle_subscribe = handle_subscribe;
+  iface->handle_unsubscribe = handle_unsubscribe;
 }
@@ -22,15 +22,21 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 #include <blockdev/kbd.h>
+#include <blockdev/swap.h>
+#include <blockdev/utils.h>
 
 #include <src/udisksdaemon.h>
 #include <src/udisksdaemonutil.h>
+#include <src/udisksmethoddispatcher.h>
 #include <src/udiskslogging.h>
 #include <src/udiskslinuxblockobject.h>
+#include <src/udiskslinuxswapspace.h>
 #include "udisks-zram-generated.h"
 #include "udiskslinuxblockzram.h"
 #include "udiskslinuxmanagerzram.h"
@@ -159,13 +165,13 @@ udisks_linux_manager_zram_class_init (UDisksLinuxManagerZRAMClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 static void
 udisks_linux_manager_zram_init (UDisksLinuxManagerZRAM *self)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (self),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 /**
@@ -382,6 +388,9 @@ handle_create_devices (UDisksManagerZRAM     *object,
   gchar **zram_paths = NULL;
   UDisksObject **zram_objects = NULL;
   gchar **zram_object_paths = NULL;
+  gboolean activate = FALSE;
+  gint priority = -1;
+  const gchar *discard = NULL;
 
   /* Policy check */
   UDISKS_DAEMON_CHECK_AUTHORIZATION (manager->daemon,
@@ -398,6 +407,13 @@ handle_create_devices (UDisksManagerZRAM     *object,
                                                       &streams_len,
                                                       sizeof (guint64));
 
+  g_variant_lookup (options, "activate", "b", &activate);
+  if (activate && ! udisks_linux_swapspace_get_start_options (options, &priority, &discard, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
   if (! create_conf_files ((guint64) streams_len, sizes, num_streams, &error))
     {
       g_dbus_method_invocation_take_error (invocation, error);
@@ -415,12 +431,39 @@ handle_create_devices (UDisksManagerZRAM     *object,
   for (gsize i = 0; i < sizes_len; i++)
     zram_paths[i] = g_strdup_printf ("/dev/zram%" G_GSIZE_FORMAT, i);
 
+  /* Activate the devices right away, one after the other, so that the swap
+   * is usable once we return and a single wait for the objects below covers
+   * them all.
+   */
+  for (gsize i = 0; activate && i < sizes_len; i++)
+    {
+      gchar *filename;
+
+      if (! bd_swap_mkswap (zram_paths[i], NULL, NULL, &error) ||
+          ! udisks_linux_swapspace_swapon_sync (zram_paths[i], priority, discard, &error))
+        {
+          g_prefix_error (&error, "Error activating %s: ", zram_paths[i]);
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+
+      filename = g_build_filename (PACKAGE_ZRAMCONF_DIR, zram_paths[i] + strlen ("/dev/"), NULL);
+      if (! set_conf_property (filename, "SWAP", "y", &error))
+        {
+          g_free (filename);
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      g_free (filename);
+    }
+
   /* sit and wait for the zram objects to show up */
   zram_objects = udisks_daemon_wait_for_objects_sync (manager->daemon,
                                                       wait_for_zram_objects,
                                                       zram_paths,
                                                       NULL,
                                                       10, /* timeout_seconds */
+                                                      udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                       &error);
 
   if (zram_objects == NULL)
@@ -503,6 +546,7 @@ handle_destroy_devices (UDisksManagerZRAM     *object,
                                                          NULL,
                                                          NULL,
                                                          10,
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &error))
     {
       g_prefix_error (&error, "Error waiting for zram objects to disappear: ");
@@ -515,9 +559,407 @@ out:
   return TRUE;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Dynamic devices, added and removed one at a time through the zram-control
+ * class (kernel 4.2 and newer) without reloading the module.
+ */
+
+#define ZRAM_CONTROL_DIR "/sys/class/zram-control"
+
+static gboolean
+write_zram_attr (const gchar  *filename,
+                 const gchar  *value,
+                 GError      **error)
+{
+  gint fd;
+
+  fd = open (filename, O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %s", filename, g_strerror (errno));
+      return FALSE;
+    }
+  if (write (fd, value, strlen (value)) == -1)
+    {
+      g_set_error (error, UDISKS_ERROR,
+                   errno == EBUSY ? UDISKS_ERROR_DEVICE_BUSY : UDISKS_ERROR_FAILED,
+                   "Error writing '%s' to %s: %s", value, filename, g_strerror (errno));
+      close (fd);
+      return FALSE;
+    }
+  close (fd);
+
+  return TRUE;
+}
+
+static gboolean
+ensure_zram_control (GError **error)
+{
+  const gchar *argv[] = { "modprobe", "zram", "num_devices=0", NULL };
+
+  if (g_file_test (ZRAM_CONTROL_DIR, G_FILE_TEST_IS_DIR))
+    return TRUE;
+
+  /* don't let the module create any devices of its own, all of them come
+   * from hot_add */
+  if (! g_file_test ("/sys/module/zram", G_FILE_TEST_IS_DIR) &&
+      ! bd_utils_exec_and_report_error (argv, NULL, error))
+    return FALSE;
+
+  if (! g_file_test (ZRAM_CONTROL_DIR, G_FILE_TEST_IS_DIR))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                   "Adding zram devices dynamically is not supported by the kernel");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+hot_remove_zram (guint    id,
+                 GError **error)
+{
+  gchar value[32];
+
+  g_snprintf (value, sizeof value, "%u", id);
+  return write_zram_attr (ZRAM_CONTROL_DIR "/hot_remove", value, error);
+}
+
+static gboolean
+persist_zram_device (guint         id,
+                     guint64       size,
+                     guint64       num_streams,
+                     const gchar  *algorithm,
+                     gboolean      swap,
+                     GError      **error)
+{
+  gboolean rval = FALSE;
+  gchar *filename = NULL;
+  gchar *contents = NULL;
+  gchar *old_contents = NULL;
+  guint64 num_devices = 0;
+  gchar *p;
+
+  filename = g_build_filename (PACKAGE_MODLOAD_DIR, "zram.conf", NULL);
+  if (! g_file_set_contents (filename, "zram\n", -1, error))
+    goto out;
+  g_free (filename);
+
+  /* the module must create at least as many devices at boot as there are
+   * configured ones; never shrink what is already there */
+  filename = g_build_filename (PACKAGE_MODPROBE_DIR, "zram.conf", NULL);
+  if (g_file_get_contents (filename, &old_contents, NULL, NULL) &&
+      (p = strstr (old_contents, "num_devices=")) != NULL)
+    num_devices = g_ascii_strtoull (p + strlen ("num_devices="), NULL, 10);
+  if (num_devices < (guint64) id + 1)
+    {
+      contents = g_strdup_printf ("options zram num_devices=%u\n", id + 1);
+      if (! g_file_set_contents (filename, contents, -1, error))
+        goto out;
+      g_free (contents);
+      contents = NULL;
+    }
+  g_free (filename);
+  filename = NULL;
+
+  if (g_mkdir_with_parents (PACKAGE_ZRAMCONF_DIR, 0755) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error creating directory %s: %m", PACKAGE_ZRAMCONF_DIR);
+      goto out;
+    }
+
+  p = g_strdup_printf ("zram%u", id);
+  filename = g_build_filename (PACKAGE_ZRAMCONF_DIR, p, NULL);
+  g_free (p);
+  contents = g_strdup_printf ("#!/bin/bash\n\n"
+                              "ZRAM_NUM_STR=%" G_GUINT64_FORMAT "\n"
+                              "ZRAM_DEV_SIZE=%" G_GUINT64_FORMAT "\n"
+                              "%s%s%s"
+                              "SWAP=%s\n",
+                              num_streams,
+                              size,
+                              algorithm ? "ZRAM_COMP_ALGORITHM=" : "",
+                              algorithm ? algorithm : "",
+                              algorithm ? "\n" : "",
+                              swap ? "y" : "n");
+  if (! g_file_set_contents (filename, contents, -1, error))
+    goto out;
+
+  rval = TRUE;
+
+ out:
+  g_free (old_contents);
+  g_free (contents);
+  g_free (filename);
+  return rval;
+}
+
+static void
+unpersist_zram_device (const gchar *zram_name)
+{
+  gchar *filename;
+
+  filename = g_build_filename (PACKAGE_ZRAMCONF_DIR, zram_name, NULL);
+  if (g_unlink (filename) != 0 && errno != ENOENT)
+    udisks_warning ("Error removing %s: %m", filename);
+  g_free (filename);
+}
+
+static UDisksObject *
+wait_for_zram_object (UDisksDaemon *daemon,
+                      gpointer      user_data)
+{
+  const gchar *device_file = user_data;
+  UDisksObject *object;
+
+  object = udisks_daemon_find_block_by_device_file (daemon, device_file);
+  if (object != NULL && udisks_object_peek_block (object) == NULL)
+    g_clear_object (&object);
+
+  return object;
+}
+
+static gboolean
+handle_add_device (UDisksManagerZRAM     *object,
+                   GDBusMethodInvocation *invocation,
+                   guint64                size,
+                   guint64                num_streams,
+                   GVariant              *options)
+{
+  UDisksLinuxManagerZRAM *manager = UDISKS_LINUX_MANAGER_ZRAM (object);
+  GError *error = NULL;
+  gchar *contents = NULL;
+  gchar *device_file = NULL;
+  gchar *sysfs_dir = NULL;
+  gchar *filename = NULL;
+  gchar value[32];
+  UDisksObject *zram_object = NULL;
+  const gchar *algorithm = NULL;
+  gboolean activate = FALSE;
+  gboolean persistent = FALSE;
+  gint priority = -1;
+  const gchar *discard = NULL;
+  guint64 id;
+  gboolean added = FALSE;
+
+  /* Policy check */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (manager->daemon,
+                                     NULL,
+                                     zram_policy_action_id,
+                                     options,
+                                     N_("Authentication is required to add a zRAM device"),
+                                     invocation);
+
+  if (size == 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "The size of the device must be greater than zero");
+      goto out;
+    }
+
+  g_variant_lookup (options, "algorithm", "&s", &algorithm);
+  g_variant_lookup (options, "persistent", "b", &persistent);
+  g_variant_lookup (options, "activate", "b", &activate);
+  if (activate && ! udisks_linux_swapspace_get_start_options (options, &priority, &discard, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (! ensure_zram_control (&error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* reading hot_add allocates a new device and returns its number */
+  if (! g_file_get_contents (ZRAM_CONTROL_DIR "/hot_add", &contents, NULL, &error))
+    {
+      g_prefix_error (&error, "Error adding zram device: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  id = g_ascii_strtoull (contents, NULL, 10);
+  added = TRUE;
+
+  device_file = g_strdup_printf ("/dev/zram%" G_GUINT64_FORMAT, id);
+  sysfs_dir = g_strdup_printf ("/sys/block/zram%" G_GUINT64_FORMAT, id);
+
+  /* the algorithm and the streams can only be set before the size */
+  if (algorithm != NULL)
+    {
+      filename = g_build_filename (sysfs_dir, "comp_algorithm", NULL);
+      if (! write_zram_attr (filename, algorithm, &error))
+        {
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      g_free (filename);
+      filename = NULL;
+    }
+
+  /* max_comp_streams is a no-op on kernels with per-CPU streams */
+  if (num_streams > 0)
+    {
+      filename = g_build_filename (sysfs_dir, "max_comp_streams", NULL);
+      g_snprintf (value, sizeof value, "%" G_GUINT64_FORMAT, num_streams);
+      if (! write_zram_attr (filename, value, &error))
+        {
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      g_free (filename);
+      filename = NULL;
+    }
+
+  filename = g_build_filename (sysfs_dir, "disksize", NULL);
+  g_snprintf (value, sizeof value, "%" G_GUINT64_FORMAT, size);
+  if (! write_zram_attr (filename, value, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (activate &&
+      (! bd_swap_mkswap (device_file, NULL, NULL, &error) ||
+       ! udisks_linux_swapspace_swapon_sync (device_file, priority, discard, &error)))
+    {
+      g_prefix_error (&error, "Error activating %s: ", device_file);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (persistent &&
+      ! persist_zram_device ((guint) id, size, num_streams, algorithm, activate, &error))
+    {
+      g_prefix_error (&error, "Error writing configuration for %s: ", device_file);
+      g_dbus_method_invocation_take_error (invocation, error);
+      if (activate)
+        bd_swap_swapoff (device_file, NULL);
+      goto out;
+    }
+
+  /* the object shows up on the add uevent of the new device */
+  zram_object = udisks_daemon_wait_for_object_sync (manager->daemon,
+                                                    wait_for_zram_object,
+                                                    device_file,
+                                                    NULL,
+                                                    10, /* timeout_seconds */
+                                                    udisks_daemon_util_get_invocation_cancellable (invocation),
+                                                    &error);
+  if (zram_object == NULL)
+    {
+      g_prefix_error (&error, "Error waiting for ZRAM object after creating: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  /* pick up the size and the algorithm set after the add uevent */
+  udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (zram_object));
+  added = FALSE;
+
+  udisks_manager_zram_complete_add_device (object,
+                                           invocation,
+                                           g_dbus_object_get_object_path (G_DBUS_OBJECT (zram_object)));
+
+ out:
+  if (added)
+    {
+      GError *local_error = NULL;
+
+      if (! hot_remove_zram ((guint) id, &local_error))
+        {
+          udisks_warning ("Error removing %s after failing to set it up: %s",
+                          device_file, local_error->message);
+          g_clear_error (&local_error);
+        }
+    }
+  g_clear_object (&zram_object);
+  g_free (filename);
+  g_free (sysfs_dir);
+  g_free (device_file);
+  g_free (contents);
+  return TRUE;
+}
+
+static gboolean
+handle_remove_device (UDisksManagerZRAM     *object,
+                      GDBusMethodInvocation *invocation,
+                      const gchar           *zram_path,
+                      GVariant              *options)
+{
+  UDisksLinuxManagerZRAM *manager = UDISKS_LINUX_MANAGER_ZRAM (object);
+  GError *error = NULL;
+  UDisksObject *zram_object = NULL;
+  UDisksBlock *block;
+  GDBusInterface *zram_iface = NULL;
+  gchar *device_file = NULL;
+  const gchar *zram_name;
+  guint64 id;
+
+  /* Policy check */
+  UDISKS_DAEMON_CHECK_AUTHORIZATION (manager->daemon,
+                                     NULL,
+                                     zram_policy_action_id,
+                                     options,
+                                     N_("Authentication is required to remove a zRAM device"),
+                                     invocation);
+
+  zram_object = udisks_daemon_find_object (manager->daemon, zram_path);
+  block = zram_object ? udisks_object_peek_block (zram_object) : NULL;
+  zram_iface = zram_object ? g_dbus_object_get_interface (G_DBUS_OBJECT (zram_object),
+                                                          "org.freedesktop.UDisks2.Block.ZRAM") : NULL;
+  if (block == NULL || zram_iface == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Object %s is not a zram device", zram_path);
+      goto out;
+    }
+
+  device_file = udisks_block_dup_device (block);
+  zram_name = device_file + strlen ("/dev/");
+  id = g_ascii_strtoull (zram_name + strlen ("zram"), NULL, 10);
+
+  /* fails with DeviceBusy while the device is open, e.g. as active swap */
+  if (! ensure_zram_control (&error) || ! hot_remove_zram ((guint) id, &error))
+    {
+      g_prefix_error (&error, "Error removing %s: ", device_file);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  unpersist_zram_device (zram_name);
+
+  if (! udisks_daemon_wait_for_object_to_disappear_sync (manager->daemon,
+                                                         wait_for_zram_object,
+                                                         device_file,
+                                                         NULL,
+                                                         10,
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation),
+                                                         &error))
+    {
+      g_prefix_error (&error, "Error waiting for %s to disappear: ", device_file);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_manager_zram_complete_remove_device (object, invocation);
+
+ out:
+  g_clear_object (&zram_iface);
+  g_clear_object (&zram_object);
+  g_free (device_file);
+  return TRUE;
+}
+
 static void
 udisks_linux_manager_zram_iface_init (UDisksManagerZRAMIface *iface)
 {
   iface->handle_create_devices = handle_create_devices;
   iface->handle_destroy_devices = handle_destroy_devices;
+  iface->handle_add_device = handle_add_device;
+  iface->handle_remove_device = handle_remove_device;
 }
@@ -127,6 +127,21 @@ udisks_module_get_block_object_iface_setup_entries (void)
   return iface;
 }
 
+static const gchar * const zram_device_file_prefixes[] = { "/dev/zram", NULL };
+
+UDisksModuleInterfaceMatch **
+udisks_module_get_block_object_iface_matches (void)
+{
+  UDisksModuleInterfaceMatch **matches;
+
+  matches = g_new0 (UDisksModuleInterfaceMatch *, 2);
+  matches[0] = g_new0 (UDisksModuleInterfaceMatch, 1);
+  matches[0]->skeleton_type = UDISKS_TYPE_LINUX_BLOCK_ZRAM;
+  matches[0]->device_file_prefixes = zram_device_file_prefixes;
+
+  return matches;
+}
+
 /* ------------------------------------------------------------------------------------ */
 
 UDisksModuleInterfaceInfo **
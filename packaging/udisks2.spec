@@ -88,6 +88,7 @@ BuildRequires: libblockdev-mdraid-devel >= %{libblockdev_version}
 BuildRequires: libblockdev-fs-devel     >= %{libblockdev_version}
 BuildRequires: libblockdev-crypto-devel >= %{libblockdev_version}
 BuildRequires: libmount-devel
+BuildRequires: cryptsetup-devel
 
 Requires: libblockdev        >= %{libblockdev_version}
 Requires: libblockdev-part   >= %{libblockdev_version}
@@ -379,8 +380,10 @@ udevadm trigger
 %{_libdir}/girepository-1.0/UDisks-2.0.typelib
 
 %files -n %{name}-lvm2
+%dir %{_sysconfdir}/udisks2/modules.conf.d
 %{_libdir}/udisks2/modules/libudisks2_lvm2.so
 %{_datadir}/polkit-1/actions/org.freedesktop.UDisks2.lvm2.policy
+%config(noreplace) %{_sysconfdir}/udisks2/modules.conf.d/udisks2_lvm2.conf
 
 %files -n %{name}-iscsi
 %{_libdir}/udisks2/modules/libudisks2_iscsi.so
@@ -400,8 +403,10 @@ udevadm trigger
 
 %if 0%{?with_bcache}
 %files -n %{name}-bcache
+%dir %{_sysconfdir}/udisks2/modules.conf.d
 %{_libdir}/udisks2/modules/libudisks2_bcache.so
 %{_datadir}/polkit-1/actions/org.freedesktop.UDisks2.bcache.policy
+%config(noreplace) %{_sysconfdir}/udisks2/modules.conf.d/udisks2_bcache.conf
 %endif
 
 %if 0%{?with_btrfs}
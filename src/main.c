@@ -27,6 +27,15 @@
 #include "udiskslogging.h"
 #include "udisksdaemontypes.h"
 #include "udisksdaemon.h"
+#include "udisksconfigmanager.h"
+#include "udisksidlemonitor.h"
+#include "udisksjobscheduler.h"
+#include "udisksmanagedobjectscache.h"
+#include "udisksmethoddispatcher.h"
+#include "udiskspeerserver.h"
+
+/* how often the method calls still in flight are checked for when exiting on idle */
+#define IDLE_DRAIN_INTERVAL_MSEC 100
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -39,6 +48,7 @@ static gboolean opt_no_sigint = FALSE;
 static gboolean opt_disable_modules = FALSE;
 static gboolean opt_force_load_modules = FALSE;
 static gboolean opt_uninstalled = FALSE;
+static gboolean opt_profile_startup = FALSE;
 static GOptionEntry opt_entries[] =
 {
   {"replace", 'r', 0, G_OPTION_ARG_NONE, &opt_replace, "Replace existing daemon", NULL},
@@ -47,23 +57,92 @@ static GOptionEntry opt_entries[] =
   {"no-sigint", 's', 0, G_OPTION_ARG_NONE, &opt_no_sigint, "Do not handle SIGINT for controlled shutdown", NULL},
   {"disable-modules", 0, 0, G_OPTION_ARG_NONE, &opt_disable_modules, "Do not load modules even when asked for it", NULL},
   {"force-load-modules", 0, 0, G_OPTION_ARG_NONE, &opt_force_load_modules, "Activate modules on startup", NULL},
+  {"profile-startup", 0, 0, G_OPTION_ARG_NONE, &opt_profile_startup, "Log the durations of the start-up phases", NULL},
   {"uninstalled", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_uninstalled, "Load modules from build directory", NULL},
   {NULL }
 };
 
 static UDisksDaemon *the_daemon = NULL;
+static UDisksIdleMonitor *idle_monitor = NULL;
+static UDisksManagedObjectsCache *managed_objects_cache = NULL;
+static UDisksPeerServer *peer_server = NULL;
+static guint name_owner_id = 0;
+
+static gboolean
+on_idle_drain_timeout (gpointer user_data)
+{
+  guint queued;
+  guint running;
+
+  /* let the calls received before the name was released finish */
+  udisks_method_dispatcher_get_counts (udisks_daemon_get_method_dispatcher (the_daemon),
+                                       &queued, &running, NULL);
+  if (queued > 0 || running > 0 ||
+      !udisks_job_scheduler_is_idle (udisks_daemon_get_job_scheduler (the_daemon)))
+    return G_SOURCE_CONTINUE;
+
+  g_main_loop_quit (loop);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_idle (UDisksIdleMonitor *monitor,
+         gpointer           user_data)
+{
+  /* Release the name first so new calls start a new instance instead of
+   * getting lost. Releasing it is a synchronous call, so all the calls
+   * routed to us before have been received once it returns and are
+   * dispatched before the drain timeout runs. */
+  if (name_owner_id != 0)
+    {
+      g_bus_unown_name (name_owner_id);
+      name_owner_id = 0;
+    }
+  g_timeout_add (IDLE_DRAIN_INTERVAL_MSEC, on_idle_drain_timeout, NULL);
+}
 
 static void
 on_bus_acquired (GDBusConnection *connection,
                  const gchar     *name,
                  gpointer         user_data)
 {
+  UDisksConfigManager *config_manager;
+  GError *error = NULL;
+  guint idle_timeout;
+
   the_daemon = udisks_daemon_new (connection,
                                   opt_disable_modules,
                                   opt_force_load_modules,
                                   opt_uninstalled,
-                                  enable_tcrypt);
+                                  enable_tcrypt,
+                                  opt_profile_startup);
   udisks_debug ("Connected to the system bus");
+
+  config_manager = udisks_daemon_get_config_manager (the_daemon);
+  idle_timeout = udisks_config_manager_get_idle_exit_timeout (config_manager);
+  if (udisks_config_manager_get_private_socket (config_manager) && idle_timeout > 0)
+    {
+      /* nothing would bring the daemon back for the peer-to-peer clients */
+      udisks_notice ("Not exiting when idle, the private socket is enabled");
+      idle_timeout = 0;
+    }
+  if (idle_timeout > 0)
+    idle_monitor = udisks_idle_monitor_new (the_daemon, idle_timeout, on_idle, NULL);
+
+  if (udisks_config_manager_get_private_socket (config_manager))
+    {
+      /* the idle monitor does not see the peer-to-peer connections otherwise */
+      peer_server = udisks_peer_server_new (the_daemon, idle_monitor, &error);
+      if (peer_server == NULL)
+        {
+          udisks_warning ("Error listening on the private socket: %s (%s, %d)",
+                          error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+    }
+
+  /* after the idle monitor which needs to see the GetManagedObjects() calls */
+  managed_objects_cache = udisks_managed_objects_cache_new (the_daemon);
 }
 
 static void
@@ -90,6 +169,21 @@ on_name_acquired (GDBusConnection *connection,
   udisks_notice ("Acquired the name %s on the system message bus", name);
 }
 
+static gboolean
+on_sigusr1 (gpointer user_data)
+{
+  gchar *report;
+
+  if (the_daemon == NULL)
+    return G_SOURCE_CONTINUE;
+
+  report = udisks_daemon_get_footprint_report (the_daemon);
+  udisks_notice ("Caught SIGUSR1. Memory footprint report:\n%s", report);
+  g_free (report);
+
+  return G_SOURCE_CONTINUE;
+}
+
 static gboolean
 on_sigint (gpointer user_data)
 {
@@ -105,14 +199,14 @@ main (int    argc,
   GError *error;
   GOptionContext *opt_context;
   gint ret;
-  guint name_owner_id;
   guint sigint_id;
+  guint sigusr1_id;
 
   ret = 1;
   loop = NULL;
   opt_context = NULL;
-  name_owner_id = 0;
   sigint_id = 0;
+  sigusr1_id = 0;
 
   /* avoid gvfs (http://bugzilla.gnome.org/show_bug.cgi?id=526454) */
   if (!g_setenv ("GIO_USE_VFS", "local", TRUE))
@@ -158,6 +252,12 @@ main (int    argc,
                                           NULL); /* GDestroyNotify */
     }
 
+  sigusr1_id = g_unix_signal_add_full (G_PRIORITY_DEFAULT,
+                                       SIGUSR1,
+                                       on_sigusr1,
+                                       NULL,  /* user_data */
+                                       NULL); /* GDestroyNotify */
+
   enable_tcrypt = g_file_test ("/etc/udisks2/tcrypt.conf", G_FILE_TEST_IS_REGULAR);
 
   name_owner_id = g_bus_own_name (G_BUS_TYPE_SYSTEM,
@@ -180,6 +280,14 @@ main (int    argc,
  out:
   if (sigint_id > 0)
     g_source_remove (sigint_id);
+  if (sigusr1_id > 0)
+    g_source_remove (sigusr1_id);
+  if (peer_server != NULL)
+    udisks_peer_server_free (peer_server);
+  if (managed_objects_cache != NULL)
+    udisks_managed_objects_cache_free (managed_objects_cache);
+  if (idle_monitor != NULL)
+    udisks_idle_monitor_free (idle_monitor);
   if (the_daemon != NULL)
     g_object_unref (the_daemon);
   if (name_owner_id != 0)
@@ -0,0 +1,103 @@
+"""Helpers shared by the udisksd benchmarks
+
+Finding the daemon and sampling its resource usage, waiting for it to
+settle after a burst of uevents and reading the latency histograms of
+org.freedesktop.UDisks2.Manager.GetLatencyStatistics().
+"""
+
+from __future__ import print_function
+
+import os
+import time
+
+import dbus
+
+UDISKS_BUS_NAME = 'org.freedesktop.UDisks2'
+UDISKS_OBJECT_PATH = '/org/freedesktop/UDisks2'
+UDISKS_MANAGER_PATH = '/org/freedesktop/UDisks2/Manager'
+UDISKS_MANAGER_IFACE = 'org.freedesktop.UDisks2.Manager'
+
+
+def daemon_pid(bus):
+    dbus_obj = bus.get_object('org.freedesktop.DBus', '/org/freedesktop/DBus')
+    return int(dbus_obj.GetConnectionUnixProcessID(UDISKS_BUS_NAME,
+                                                   dbus_interface='org.freedesktop.DBus'))
+
+
+def daemon_rss_kb(pid):
+    with open('/proc/%d/status' % pid) as status:
+        for line in status:
+            if line.startswith('VmRSS:'):
+                return int(line.split()[1])
+    return 0
+
+
+def daemon_cpu_seconds(pid):
+    with open('/proc/%d/stat' % pid) as stat:
+        # the command name may contain spaces, the fields start after it
+        fields = stat.read().rsplit(')', 1)[1].split()
+    # utime and stime are the 14th and 15th fields
+    return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+
+class SignalCounter(object):
+    '''Counts the signals sent by udisksd and the time of the last one'''
+
+    def __init__(self, bus):
+        self.count = 0
+        self.last = time.monotonic()
+        bus.add_signal_receiver(self._on_signal, sender_keyword='sender',
+                                bus_name=UDISKS_BUS_NAME, path_keyword='path')
+
+    def _on_signal(self, *args, **kwargs):
+        self.count += 1
+        self.last = time.monotonic()
+
+    def reset(self):
+        self.count = 0
+        self.last = time.monotonic()
+
+
+def wait_settled(loop, counter, quiet_period, timeout):
+    '''Runs the main loop until no signal came for quiet_period seconds'''
+
+    deadline = time.monotonic() + timeout
+    context = loop.get_context()
+    while time.monotonic() < deadline:
+        while context.pending():
+            context.iteration(False)
+        if time.monotonic() - counter.last >= quiet_period:
+            return counter.last
+        context.iteration(False)
+        time.sleep(0.01)
+    return None
+
+
+def get_histograms(bus, kind):
+    '''Returns a dict from name to (sum, count, cumulative buckets) for the
+    latency histograms of the given kind (e.g. "uevent" or "update")'''
+
+    manager = dbus.Interface(bus.get_object(UDISKS_BUS_NAME, UDISKS_MANAGER_PATH),
+                             UDISKS_MANAGER_IFACE)
+    histograms = {}
+    for (hist_kind, name, hist_sum, count, buckets) in manager.GetLatencyStatistics(dbus.Dictionary({}, signature='sv')):
+        if hist_kind == kind:
+            histograms[str(name)] = (int(hist_sum), int(count),
+                                     [(int(bound), int(n)) for (bound, n) in buckets])
+    return histograms
+
+
+def percentile(before, after, fraction):
+    '''Upper bound (in msec) of the bucket holding the fraction of the samples
+    recorded between the before and after histograms'''
+
+    count = after[1] - (before[1] if before else 0)
+    if count == 0:
+        return None
+    wanted = fraction * count
+    for n, (bound, cumulative) in enumerate(after[2]):
+        if before:
+            cumulative -= before[2][n][1]
+        if cumulative >= wanted:
+            return None if bound < 0 else bound / 1000.0
+    return None
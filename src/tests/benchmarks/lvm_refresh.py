@@ -0,0 +1,207 @@
+#!/usr/bin/python3
+
+"""Scaling benchmark for the LVM2 module refreshes
+
+Creates volume groups with a configurable number of logical volumes on
+loop devices, triggers storms of "change" uevents on the PVs and LVs and
+reports, for every scale, how long it takes udisksd to settle (no more
+D-Bus signals for --quiet-period seconds) together with the number of
+D-Bus signals, the number of processes forked by udisksd and the growth
+of its memory usage.
+
+Needs to be run as root against a running udisksd with the LVM2 module
+loaded. All the devices are created on sparse files and removed again.
+
+Example:
+    ./lvm_refresh.py --lvs 1,10,100,1000 --storm 50
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import dbus
+import dbus.mainloop.glib
+from gi.repository import GLib
+
+from benchutil import SignalCounter, daemon_pid, daemon_rss_kb, wait_settled
+
+VG_PREFIX = 'udisks_bench_vg'
+LV_PREFIX = 'lv'
+
+
+def run(cmd):
+    subprocess.check_call(cmd, stdout=subprocess.DEVNULL)
+
+
+def run_output(cmd):
+    return subprocess.check_output(cmd).decode().strip()
+
+
+class ForkCounter(object):
+    '''Counts the processes forked by udisksd using strace'''
+
+    def __init__(self, pid):
+        self.pid = pid
+        self.proc = None
+        self.output = None
+
+    def start(self):
+        if shutil.which('strace') is None:
+            return
+        self.output = tempfile.NamedTemporaryFile(prefix='udisks-bench-strace', mode='r')
+        self.proc = subprocess.Popen(['strace', '-f', '-qq', '-e', 'trace=execve',
+                                      '-o', self.output.name, '-p', str(self.pid)],
+                                     stderr=subprocess.DEVNULL)
+        # give strace the time to attach to all the threads
+        time.sleep(1)
+
+    def stop(self):
+        if self.proc is None:
+            return None
+        self.proc.terminate()
+        self.proc.wait()
+        execs = sum(1 for line in self.output if 'execve(' in line and '= 0' in line)
+        self.output.close()
+        return execs
+
+
+class Setup(object):
+    '''Loop devices, VGs and LVs used for one scale'''
+
+    def __init__(self, workdir, n_vgs, n_lvs, pv_size_mb):
+        self.workdir = workdir
+        self.n_vgs = n_vgs
+        self.n_lvs = n_lvs
+        self.pv_size_mb = pv_size_mb
+        self.loops = []
+        self.vgs = []
+
+    def create(self):
+        for i in range(self.n_vgs):
+            backing = os.path.join(self.workdir, 'pv%d' % i)
+            with open(backing, 'w') as f:
+                f.truncate(self.pv_size_mb * 1024**2)
+            loop = run_output(['losetup', '--find', '--show', backing])
+            self.loops.append(loop)
+
+            vg_name = '%s%d' % (VG_PREFIX, i)
+            run(['vgcreate', '-y', vg_name, loop])
+            self.vgs.append(vg_name)
+            for j in range(self.n_lvs):
+                run(['lvcreate', '-y', '-Zn', '-Wn', '-L', '4m', '-n', '%s%d' % (LV_PREFIX, j), vg_name])
+        run(['udevadm', 'settle'])
+
+    def destroy(self):
+        for vg_name in self.vgs:
+            subprocess.call(['vgremove', '-y', '-f', vg_name], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        for loop in self.loops:
+            subprocess.call(['pvremove', '-y', loop], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            subprocess.call(['losetup', '-d', loop])
+        run(['udevadm', 'settle'])
+
+    def devices(self):
+        devs = list(self.loops)
+        for vg_name in self.vgs:
+            for j in range(self.n_lvs):
+                devs.append(os.path.realpath('/dev/%s/%s%d' % (vg_name, LV_PREFIX, j)))
+        return devs
+
+
+def trigger_storm(devices, rounds):
+    for _ in range(rounds):
+        for dev in devices:
+            with open('/sys/class/block/%s/uevent' % os.path.basename(dev), 'w') as uevent:
+                uevent.write('change')
+
+
+def bench_scale(args, bus, loop, counter, pid, n_lvs):
+    setup = Setup(args.workdir, args.vgs, n_lvs, max(64, n_lvs * 4 + 16))
+    try:
+        setup.create()
+        devices = setup.devices()
+        n_events = len(devices) * args.storm
+
+        # let the daemon process the creation first
+        wait_settled(loop, counter, args.quiet_period, args.timeout)
+
+        forks = ForkCounter(pid)
+        forks.start()
+        rss_before = daemon_rss_kb(pid)
+        counter.reset()
+
+        start = time.monotonic()
+        trigger_storm(devices, args.storm)
+        end = wait_settled(loop, counter, args.quiet_period, args.timeout)
+
+        n_forks = forks.stop()
+        rss_after = daemon_rss_kb(pid)
+
+        if end is None:
+            latency = 'timeout'
+        else:
+            latency = '%.3f' % max(end - start, 0)
+
+        print('%6d %4d %8d %10s %10.2f %8s %10d' %
+              (n_lvs, args.vgs, n_events, latency,
+               counter.count / n_events,
+               '-' if n_forks is None else '%.2f' % (n_forks / n_events),
+               rss_after - rss_before))
+        sys.stdout.flush()
+    finally:
+        setup.destroy()
+
+
+def main():
+    argparser = argparse.ArgumentParser(description='udisks LVM2 refresh benchmark')
+    argparser.add_argument('--lvs', default='1,10,100',
+                           help='comma separated list of the numbers of LVs per VG to test with')
+    argparser.add_argument('--vgs', type=int, default=1,
+                           help='number of VGs (each on its own loop device)')
+    argparser.add_argument('--storm', type=int, default=10,
+                           help='number of "change" uevents triggered on every PV and LV')
+    argparser.add_argument('--quiet-period', type=float, default=2.0,
+                           help='seconds without D-Bus signals after which the daemon is considered settled')
+    argparser.add_argument('--timeout', type=float, default=600.0,
+                           help='maximum number of seconds to wait for the daemon to settle')
+    argparser.add_argument('--workdir', default=None,
+                           help='directory for the backing files of the loop devices')
+    args = argparser.parse_args()
+
+    if os.geteuid() != 0:
+        print('The benchmark needs to be run as root', file=sys.stderr)
+        sys.exit(1)
+
+    scales = [int(n) for n in re.split(r'[, ]+', args.lvs.strip()) if n]
+
+    dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
+    bus = dbus.SystemBus()
+    loop = GLib.MainLoop()
+    counter = SignalCounter(bus)
+    pid = daemon_pid(bus)
+
+    cleanup_workdir = args.workdir is None
+    if cleanup_workdir:
+        args.workdir = tempfile.mkdtemp(prefix='udisks-bench')
+
+    print('# udisksd pid %d, %s' % (pid, 'forks counted with strace' if shutil.which('strace')
+                                    else 'strace not found, forks not counted'))
+    print('%6s %4s %8s %10s %10s %8s %10s' %
+          ('LVs/VG', 'VGs', 'uevents', 'settle[s]', 'signals/ev', 'forks/ev', 'RSS[kB]'))
+    try:
+        for n_lvs in scales:
+            bench_scale(args, bus, loop, counter, pid, n_lvs)
+    finally:
+        if cleanup_workdir:
+            shutil.rmtree(args.workdir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,412 @@
+#!/usr/bin/python3
+
+"""Benchmark for the update hot paths of the udisks modules
+
+Sets up a small fixture device for every module (a btrfs filesystem, a
+bcache device, a zram device, an LVM2 volume group, a VDO volume and a
+scsi_debug drive for the LSM lookups) next to a plain loop device used
+as the baseline, triggers --count "change" uevents on every fixture and
+reports what the uevents cost in udisksd:
+
+  * the number of calls, the mean and the p99 time of the interface and
+    module object updates run for the uevents (the "update" latency kind
+    of org.freedesktop.UDisks2.Manager.GetLatencyStatistics(), recorded
+    per type name of the interface or module object)
+  * the CPU time of udisksd per uevent
+  * with --strace, the number of syscalls and forks of udisksd per uevent
+    (strace attached to the daemon slows it down, the times are only
+    reported for the runs without it)
+
+Comparing a fixture against the baseline shows the cost a module adds to
+every uevent. Fixtures whose tools or kernel modules are not available
+are skipped.
+
+Needs to be run as root against a running udisksd. All the devices are
+created on sparse files and removed again.
+
+Example:
+    ./module_update.py --count 200 --strace
+    ./module_update.py --fixtures baseline,lvm2 --count 1000
+"""
+
+from __future__ import print_function
+
+import argparse
+import glob
+import os
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+import dbus
+import dbus.mainloop.glib
+from gi.repository import GLib
+
+from benchutil import (UDISKS_BUS_NAME, UDISKS_MANAGER_IFACE, UDISKS_MANAGER_PATH, SignalCounter,
+                       daemon_cpu_seconds, daemon_pid, get_histograms, percentile, wait_settled)
+
+VG_NAME = 'udisks_bench_update_vg'
+FORK_SYSCALLS = ('clone', 'clone3', 'fork', 'vfork')
+
+
+def run(cmd):
+    subprocess.check_call(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def run_output(cmd):
+    return subprocess.check_output(cmd, stderr=subprocess.DEVNULL).decode().strip()
+
+
+def have_tool(tool):
+    return shutil.which(tool) is not None
+
+
+class Fixture(object):
+    '''A set of block devices exercising one module
+
+    Subclasses set up the devices in setup() and return the names of the
+    block devices (as in /sys/class/block) to trigger the uevents on.
+    '''
+
+    name = None
+    module = None
+    tools = ()
+    kernel_modules = ()
+
+    def __init__(self, workdir, size_mb):
+        self.workdir = workdir
+        self.size_mb = size_mb
+        self.loops = []
+
+    def available(self):
+        for tool in self.tools:
+            if not have_tool(tool):
+                return 'missing %s' % tool
+        for kmod in self.kernel_modules:
+            if subprocess.call(['modprobe', kmod],
+                               stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL) != 0:
+                return 'missing the %s kernel module' % kmod
+        return None
+
+    def make_loop(self, size_mb=None):
+        path = os.path.join(self.workdir, '%s-%d.img' % (self.name, len(self.loops)))
+        with open(path, 'wb') as backing:
+            backing.truncate((size_mb or self.size_mb) * 1024 * 1024)
+        dev = run_output(['losetup', '--find', '--show', path])
+        os.unlink(path)
+        self.loops.append(dev)
+        return dev
+
+    def setup(self):
+        raise NotImplementedError
+
+    def teardown(self):
+        for dev in reversed(self.loops):
+            subprocess.call(['losetup', '-d', dev], stderr=subprocess.DEVNULL)
+        self.loops = []
+
+
+class BaselineFixture(Fixture):
+    name = 'baseline'
+    tools = ('losetup',)
+
+    def setup(self):
+        return [os.path.basename(self.make_loop())]
+
+
+class BtrfsFixture(Fixture):
+    name = 'btrfs'
+    module = 'btrfs'
+    tools = ('losetup', 'mkfs.btrfs')
+    kernel_modules = ('btrfs',)
+
+    def setup(self):
+        devs = [self.make_loop(), self.make_loop()]
+        run(['mkfs.btrfs', '-f', '-d', 'raid1', '-m', 'raid1'] + devs)
+        return [os.path.basename(dev) for dev in devs]
+
+
+class BcacheFixture(Fixture):
+    name = 'bcache'
+    module = 'bcache'
+    tools = ('losetup', 'make-bcache', 'wipefs')
+    kernel_modules = ('bcache',)
+
+    def setup(self):
+        backing = self.make_loop()
+        cache = self.make_loop()
+        run(['make-bcache', '-B', backing, '-C', cache])
+        deadline = time.monotonic() + 10
+        while time.monotonic() < deadline:
+            bcaches = glob.glob('/sys/block/%s/bcache/dev' % os.path.basename(backing))
+            if bcaches:
+                return [os.path.basename(os.path.realpath(bcaches[0]))]
+            time.sleep(0.1)
+        raise RuntimeError('bcache device for %s did not appear' % backing)
+
+    def teardown(self):
+        for stop in glob.glob('/sys/block/%s/bcache/stop' % os.path.basename(self.loops[0])):
+            with open(stop, 'w') as f:
+                f.write('1')
+        for cset in glob.glob('/sys/block/%s/bcache/set/stop' % os.path.basename(self.loops[1])):
+            with open(cset, 'w') as f:
+                f.write('1')
+        time.sleep(1)
+        for dev in self.loops:
+            subprocess.call(['wipefs', '-a', dev], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        Fixture.teardown(self)
+
+
+class ZRAMFixture(Fixture):
+    name = 'zram'
+    module = 'zram'
+    kernel_modules = ('zram',)
+
+    def __init__(self, *args):
+        Fixture.__init__(self, *args)
+        self.zram = None
+
+    def setup(self):
+        with open('/sys/class/zram-control/hot_add') as hot_add:
+            self.zram = 'zram%d' % int(hot_add.read())
+        with open('/sys/block/%s/disksize' % self.zram, 'w') as disksize:
+            disksize.write('%dM' % self.size_mb)
+        return [self.zram]
+
+    def teardown(self):
+        if self.zram is not None:
+            with open('/sys/class/zram-control/hot_remove', 'w') as hot_remove:
+                hot_remove.write(self.zram[len('zram'):])
+            self.zram = None
+
+
+class LVM2Fixture(Fixture):
+    name = 'lvm2'
+    module = 'lvm2'
+    tools = ('losetup', 'pvcreate', 'vgcreate', 'lvcreate', 'vgremove', 'pvremove')
+    kernel_modules = ('dm_mod',)
+
+    def setup(self):
+        pv = self.make_loop()
+        run(['pvcreate', '-y', pv])
+        run(['vgcreate', '-y', VG_NAME, pv])
+        run(['lvcreate', '-y', '-L', '%dM' % (self.size_mb // 4), '-n', 'lv0', VG_NAME])
+        lv = os.path.basename(os.path.realpath('/dev/%s/lv0' % VG_NAME))
+        return [os.path.basename(pv), lv]
+
+    def teardown(self):
+        subprocess.call(['vgremove', '-y', '-f', VG_NAME], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        for dev in self.loops:
+            subprocess.call(['pvremove', '-y', dev], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        Fixture.teardown(self)
+
+
+class VDOFixture(Fixture):
+    name = 'vdo'
+    module = 'vdo'
+    tools = ('losetup', 'vdo')
+    kernel_modules = ('kvdo',)
+
+    def setup(self):
+        # VDO needs at least a few GiB of (sparse) backing storage
+        dev = self.make_loop(10 * 1024)
+        run(['vdo', 'create', '--name=udisks_bench_vdo', '--device=%s' % dev,
+             '--vdoLogicalSize=10G', '--force'])
+        vdo = os.path.basename(os.path.realpath('/dev/mapper/udisks_bench_vdo'))
+        return [os.path.basename(dev), vdo]
+
+    def teardown(self):
+        subprocess.call(['vdo', 'remove', '--name=udisks_bench_vdo', '--force'],
+                        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        Fixture.teardown(self)
+
+
+class LSMFixture(Fixture):
+    name = 'lsm'
+    module = 'lsm'
+    kernel_modules = ('scsi_debug',)
+
+    def available(self):
+        if os.path.exists('/sys/bus/pseudo/drivers/scsi_debug'):
+            return 'scsi_debug already in use'
+        return Fixture.available(self)
+
+    def setup(self):
+        # the modprobe in available() created a default scsi_debug disk
+        deadline = time.monotonic() + 10
+        while time.monotonic() < deadline:
+            blocks = glob.glob('/sys/bus/pseudo/drivers/scsi_debug/adapter*/host*/target*/*:*/block/*')
+            if blocks:
+                return [os.path.basename(blocks[0])]
+            time.sleep(0.1)
+        raise RuntimeError('scsi_debug disk did not appear')
+
+    def teardown(self):
+        subprocess.call(['modprobe', '-r', 'scsi_debug'], stderr=subprocess.DEVNULL)
+
+
+FIXTURES = (BaselineFixture, BtrfsFixture, BcacheFixture, ZRAMFixture,
+            LVM2Fixture, VDOFixture, LSMFixture)
+
+
+def trigger(devices, count, loop):
+    '''Writes count "change" uevents to every device, returns the number of
+    uevents triggered'''
+
+    context = loop.get_context()
+    n_events = 0
+    for _ in range(count):
+        for dev in devices:
+            with open('/sys/class/block/%s/uevent' % dev, 'w') as uevent:
+                uevent.write('change')
+            n_events += 1
+        while context.pending():
+            context.iteration(False)
+    return n_events
+
+
+def start_strace(pid, output):
+    proc = subprocess.Popen(['strace', '-f', '-c', '-q', '-o', output, '-p', str(pid)],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    # give strace time to attach to all the threads
+    time.sleep(1)
+    return proc
+
+
+def stop_strace(proc, output):
+    '''Returns the total number of syscalls and the number of forks'''
+
+    proc.send_signal(signal.SIGINT)
+    proc.wait()
+    syscalls = forks = 0
+    with open(output) as summary:
+        for line in summary:
+            fields = line.split()
+            # % time, seconds, usecs/call, calls, [errors,] syscall
+            if len(fields) < 5 or not fields[3].isdigit():
+                continue
+            if fields[-1] == 'total':
+                syscalls = int(fields[3])
+            elif fields[-1] in FORK_SYSCALLS:
+                forks += int(fields[3])
+    return (syscalls, forks)
+
+
+def measure(fixture, devices, args, bus, loop, counter, pid):
+    wait_settled(loop, counter, args.quiet_period, args.timeout)
+
+    histograms_before = get_histograms(bus, 'update')
+    cpu_before = daemon_cpu_seconds(pid)
+    n_events = trigger(devices, args.count, loop)
+    end = wait_settled(loop, counter, args.quiet_period, args.timeout)
+    cpu_after = daemon_cpu_seconds(pid)
+    histograms_after = get_histograms(bus, 'update')
+    if end is None:
+        print('# %s: udisksd did not settle in %g seconds' % (fixture.name, args.timeout))
+
+    syscalls = forks = None
+    if args.strace:
+        output = os.path.join(args.workdir, 'strace-%s.txt' % fixture.name)
+        proc = start_strace(pid, output)
+        try:
+            n_traced = trigger(devices, args.count, loop)
+            wait_settled(loop, counter, args.quiet_period, args.timeout)
+        finally:
+            (syscalls, forks) = stop_strace(proc, output)
+        syscalls /= max(n_traced, 1)
+        forks /= max(n_traced, 1)
+
+    print('%-10s %8d %10.3f %12s %10s' %
+          (fixture.name, n_events,
+           (cpu_after - cpu_before) * 1000.0 / max(n_events, 1),
+           '-' if syscalls is None else '%.1f' % syscalls,
+           '-' if forks is None else '%.2f' % forks))
+
+    for name in sorted(histograms_after):
+        after = histograms_after[name]
+        before = histograms_before.get(name)
+        calls = after[1] - (before[1] if before else 0)
+        if calls == 0:
+            continue
+        total = after[0] - (before[0] if before else 0)
+        p99 = percentile(before, after, 0.99)
+        print('    %-40s %8.2f %12.3f %10s' %
+              (name, calls / max(n_events, 1), total / 1000.0 / calls,
+               'inf' if p99 is None else '%g' % p99))
+    sys.stdout.flush()
+
+
+def main():
+    argparser = argparse.ArgumentParser(description='udisks module update benchmark')
+    argparser.add_argument('--fixtures', default=','.join(f.name for f in FIXTURES),
+                           help='comma separated list of the fixtures to run (default: all)')
+    argparser.add_argument('--count', type=int, default=100,
+                           help='number of "change" uevents to trigger on every fixture device')
+    argparser.add_argument('--size', type=int, default=256,
+                           help='size of the fixture devices in MiB')
+    argparser.add_argument('--strace', action='store_true',
+                           help='count the syscalls and forks of udisksd in a second, traced, run')
+    argparser.add_argument('--quiet-period', type=float, default=2.0,
+                           help='seconds without D-Bus signals after which the daemon is considered settled')
+    argparser.add_argument('--timeout', type=float, default=600.0,
+                           help='maximum number of seconds to wait for the daemon to settle')
+    args = argparser.parse_args()
+
+    if os.geteuid() != 0:
+        print('The module update benchmark needs to be run as root', file=sys.stderr)
+        sys.exit(1)
+    if args.strace and not have_tool('strace'):
+        print('--strace needs strace to be installed', file=sys.stderr)
+        sys.exit(1)
+
+    names = args.fixtures.split(',')
+    unknown = set(names) - set(f.name for f in FIXTURES)
+    if unknown:
+        print('Unknown fixtures: %s' % ', '.join(sorted(unknown)), file=sys.stderr)
+        sys.exit(1)
+
+    dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
+    bus = dbus.SystemBus()
+    loop = GLib.MainLoop()
+    counter = SignalCounter(bus)
+    pid = daemon_pid(bus)
+    manager = dbus.Interface(bus.get_object(UDISKS_BUS_NAME, UDISKS_MANAGER_PATH),
+                             UDISKS_MANAGER_IFACE)
+
+    args.workdir = tempfile.mkdtemp(prefix='udisks-bench-update-')
+    print('# udisksd pid %d, %d uevents per fixture device%s' %
+          (pid, args.count, ', strace' if args.strace else ''))
+    print('%-10s %8s %10s %12s %10s' % ('fixture', 'uevents', 'cpu/ev[ms]', 'syscalls/ev', 'forks/ev'))
+    print('    %-40s %8s %12s %10s' % ('update', 'calls/ev', 'mean[ms]', 'p99[ms]'))
+
+    try:
+        for fixture_class in FIXTURES:
+            if fixture_class.name not in names:
+                continue
+            fixture = fixture_class(args.workdir, args.size)
+            reason = fixture.available()
+            if reason is not None:
+                print('# %s: skipped, %s' % (fixture.name, reason))
+                continue
+            if fixture.module is not None:
+                try:
+                    manager.EnableModule(fixture.module, dbus.Boolean(True))
+                except dbus.exceptions.DBusException as e:
+                    print('# %s: skipped, %s' % (fixture.name, e.get_dbus_message()))
+                    continue
+            try:
+                devices = fixture.setup()
+                measure(fixture, devices, args, bus, loop, counter, pid)
+            except (subprocess.CalledProcessError, RuntimeError, IOError, OSError) as e:
+                print('# %s: failed, %s' % (fixture.name, e))
+            finally:
+                fixture.teardown()
+    finally:
+        shutil.rmtree(args.workdir, ignore_errors=True)
+
+
+if __name__ == '__main__':
+    main()
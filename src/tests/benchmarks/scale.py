@@ -0,0 +1,303 @@
+#!/usr/bin/python3
+
+"""Scale test for udisksd with thousands of block devices
+
+Provisions a large number of block devices (scsi_debug LUNs, null_blk or
+brd devices), optionally partitions them and puts LVM2 and MD RAID layers
+on top of some of them, restarts udisksd and measures
+
+  * the coldplug time (restart until the daemon owns its bus name),
+  * the memory usage of the daemon after the coldplug,
+  * the latency of ObjectManager.GetManagedObjects(),
+  * the time to settle after a "change" uevent storm on all the devices.
+
+The results can be stored as a baseline (--save-baseline) and compared
+against a stored baseline (--baseline). Any result exceeding the
+baseline by more than --tolerance percent is reported as a regression
+and makes the script exit with a non-zero status.
+
+Needs to be run as root on a test machine. All the devices are removed
+again at the end (the kernel modules are unloaded).
+
+Example:
+    ./scale.py --backend scsi_debug --devices 2000 --partitions 2 --lvm 50 --mdraid 20 \\
+               --save-baseline scale-2000.json
+    ./scale.py --backend scsi_debug --devices 2000 --partitions 2 --lvm 50 --mdraid 20 \\
+               --baseline scale-2000.json
+"""
+
+from __future__ import print_function
+
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+import time
+
+import dbus
+import dbus.mainloop.glib
+from gi.repository import GLib
+
+from benchutil import UDISKS_BUS_NAME, UDISKS_OBJECT_PATH, SignalCounter, daemon_pid, daemon_rss_kb, wait_settled
+
+VG_PREFIX = 'udisks_scale_vg'
+MD_PREFIX = 'udisks_scale_md'
+
+# result name, description, unit
+RESULTS = (('coldplug', 'coldplug time', 's'),
+           ('rss', 'RSS after coldplug', 'kB'),
+           ('objects', 'exported objects', ''),
+           ('get_managed_objects', 'GetManagedObjects() latency', 'ms'),
+           ('storm_settle', 'uevent storm settle time', 's'),
+           ('storm_rss', 'RSS growth during the storm', 'kB'))
+
+
+def run(cmd):
+    subprocess.check_call(cmd, stdout=subprocess.DEVNULL)
+
+
+def run_quiet(cmd):
+    return subprocess.call(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+class Setup(object):
+    '''The block devices (and the layers on top of them) used for the test'''
+
+    def __init__(self, args):
+        self.args = args
+        self.disks = []
+        self.vgs = []
+        self.mds = []
+
+    def _find_disks(self):
+        if self.args.backend == 'scsi_debug':
+            disks = []
+            for host in glob.glob('/sys/bus/pseudo/drivers/scsi_debug/adapter*/host*'):
+                disks.extend(glob.glob(os.path.join(host, 'target*/*/block/*')))
+            return ['/dev/' + os.path.basename(d) for d in disks]
+        elif self.args.backend == 'null_blk':
+            return sorted(glob.glob('/dev/nullb[0-9]*'))
+        else:
+            return sorted(glob.glob('/dev/ram[0-9]*'))
+
+    def create(self):
+        n = self.args.devices
+        if self.args.backend == 'scsi_debug':
+            # all the LUNs share one RAM store
+            run(['modprobe', 'scsi_debug', 'num_tgts=%d' % n, 'max_luns=1',
+                 'dev_size_mb=%d' % self.args.size])
+        elif self.args.backend == 'null_blk':
+            run(['modprobe', 'null_blk', 'nr_devices=%d' % n, 'gb=1'])
+        else:
+            run(['modprobe', 'brd', 'rd_nr=%d' % n, 'rd_size=%d' % (self.args.size * 1024),
+                 'max_part=%d' % max(self.args.partitions, 1)])
+        run(['udevadm', 'settle', '--timeout=600'])
+
+        self.disks = self._find_disks()
+        if len(self.disks) < n:
+            raise RuntimeError('Only %d of the %d %s devices showed up' %
+                               (len(self.disks), n, self.args.backend))
+
+        # LVM2 and MD RAID go on the first disks, the rest gets partitioned
+        n_lvm = min(self.args.lvm, len(self.disks))
+        for i, disk in enumerate(self.disks[:n_lvm]):
+            vg_name = '%s%d' % (VG_PREFIX, i)
+            run(['vgcreate', '-y', vg_name, disk])
+            self.vgs.append(vg_name)
+            run(['lvcreate', '-y', '-Zn', '-Wn', '-l', '100%FREE', '-n', 'lv', vg_name])
+
+        md_disks = self.disks[n_lvm:n_lvm + 2 * self.args.mdraid]
+        for i in range(len(md_disks) // 2):
+            md_name = '/dev/md/%s%d' % (MD_PREFIX, i)
+            run(['mdadm', '--create', md_name, '--run', '--level=1', '--raid-devices=2',
+                 '--metadata=1.2', '--assume-clean', md_disks[2 * i], md_disks[2 * i + 1]])
+            self.mds.append(md_name)
+
+        if self.args.partitions > 0:
+            layout = 'label: gpt\n' + ''.join(',%dM\n' % (self.args.size // (self.args.partitions + 1))
+                                              for _ in range(self.args.partitions))
+            for disk in self.disks[n_lvm + len(md_disks):]:
+                proc = subprocess.Popen(['sfdisk', '-q', disk], stdin=subprocess.PIPE,
+                                        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+                proc.communicate(layout.encode())
+        run(['udevadm', 'settle', '--timeout=600'])
+
+    def destroy(self):
+        for md_name in self.mds:
+            run_quiet(['mdadm', '--stop', md_name])
+        for vg_name in self.vgs:
+            run_quiet(['vgremove', '-y', '-f', vg_name])
+        for disk in self.disks:
+            run_quiet(['wipefs', '-a', disk])
+        run_quiet(['udevadm', 'settle', '--timeout=600'])
+        # the daemon may still hold some of the devices open for a moment
+        for _ in range(10):
+            if run_quiet(['modprobe', '-r', self.args.backend]) == 0:
+                break
+            time.sleep(1)
+
+    def block_devices(self):
+        '''The disks, their partitions and the LVs and MD RAID arrays on them'''
+
+        devices = []
+        for disk in self.disks:
+            name = os.path.basename(disk)
+            devices.append(name)
+            devices.extend(os.path.basename(p) for p in glob.glob('/sys/class/block/%s/%s*' % (name, name)))
+            for holder in glob.glob('/sys/class/block/%s/holders/*' % name):
+                devices.append(os.path.basename(holder))
+        return sorted(set(devices))
+
+    def description(self):
+        return {'backend': self.args.backend, 'devices': len(self.disks),
+                'partitions': self.args.partitions, 'vgs': len(self.vgs), 'mds': len(self.mds)}
+
+
+def restart_daemon(args, bus):
+    '''Restarts udisksd and returns the time it takes until the new instance
+    owns its bus name (i.e. until coldplug is done)'''
+
+    dbus_obj = bus.get_object('org.freedesktop.DBus', '/org/freedesktop/DBus')
+    start = time.monotonic()
+    run(args.restart_command.split())
+    deadline = start + args.timeout
+    while time.monotonic() < deadline:
+        if dbus_obj.NameHasOwner(UDISKS_BUS_NAME, dbus_interface='org.freedesktop.DBus'):
+            return time.monotonic() - start
+        time.sleep(0.01)
+    raise RuntimeError('udisksd did not come back within %d seconds' % args.timeout)
+
+
+def measure(args, bus, loop, setup):
+    results = {}
+
+    results['coldplug'] = restart_daemon(args, bus)
+    pid = daemon_pid(bus)
+    counter = SignalCounter(bus)
+    wait_settled(loop, counter, args.quiet_period, args.timeout)
+    results['rss'] = daemon_rss_kb(pid)
+
+    manager = dbus.Interface(bus.get_object(UDISKS_BUS_NAME, UDISKS_OBJECT_PATH),
+                             'org.freedesktop.DBus.ObjectManager')
+    latencies = []
+    for _ in range(args.calls):
+        start = time.monotonic()
+        objects = manager.GetManagedObjects(timeout=args.timeout)
+        latencies.append(time.monotonic() - start)
+    results['objects'] = len(objects)
+    latencies.sort()
+    results['get_managed_objects'] = latencies[len(latencies) // 2] * 1000.0
+
+    devices = setup.block_devices()
+    counter.reset()
+    start = time.monotonic()
+    for dev in devices:
+        try:
+            with open('/sys/class/block/%s/uevent' % dev, 'w') as uevent:
+                uevent.write('change')
+        except (IOError, OSError):
+            pass
+    end = wait_settled(loop, counter, args.quiet_period, args.timeout)
+    results['storm_settle'] = None if end is None else max(end - start, 0)
+    results['storm_rss'] = daemon_rss_kb(pid) - results['rss']
+
+    return results
+
+
+def report(results, baseline, tolerance):
+    '''Prints the results and returns the list of regressions'''
+
+    regressions = []
+    print('%-30s %12s %12s %8s' % ('', 'result', 'baseline', 'change'))
+    for (key, desc, unit) in RESULTS:
+        value = results.get(key)
+        base = baseline.get(key) if baseline else None
+        label = '%s [%s]' % (desc, unit) if unit else desc
+        if value is None:
+            print('%-30s %12s' % (label, 'timeout'))
+            regressions.append(key)
+            continue
+        if base:
+            change = (value - base) * 100.0 / base
+            print('%-30s %12.3f %12.3f %+7.1f%%' % (label, value, base, change))
+            # the number of objects is a property of the setup, not of the daemon
+            if change > tolerance and key != 'objects':
+                regressions.append(key)
+        else:
+            print('%-30s %12.3f %12s %8s' % (label, value, '-', '-'))
+    return regressions
+
+
+def main():
+    argparser = argparse.ArgumentParser(description='udisks scale test')
+    argparser.add_argument('--backend', choices=('scsi_debug', 'null_blk', 'brd'), default='scsi_debug',
+                           help='kernel module providing the block devices')
+    argparser.add_argument('--devices', type=int, default=2000,
+                           help='number of block devices to create')
+    argparser.add_argument('--size', type=int, default=64,
+                           help='size of the devices in MiB (shared by all the scsi_debug LUNs)')
+    argparser.add_argument('--partitions', type=int, default=2,
+                           help='number of partitions created on the devices not used for LVM2 or MD RAID')
+    argparser.add_argument('--lvm', type=int, default=0,
+                           help='number of devices to create a VG with one LV on')
+    argparser.add_argument('--mdraid', type=int, default=0,
+                           help='number of RAID1 arrays (each on two devices) to create')
+    argparser.add_argument('--calls', type=int, default=5,
+                           help='number of GetManagedObjects() calls to take the median latency of')
+    argparser.add_argument('--restart-command', default='systemctl restart udisks2.service',
+                           help='command restarting udisksd')
+    argparser.add_argument('--quiet-period', type=float, default=5.0,
+                           help='seconds without D-Bus signals after which the daemon is considered settled')
+    argparser.add_argument('--timeout', type=float, default=1800.0,
+                           help='maximum number of seconds to wait for the daemon')
+    argparser.add_argument('--baseline', default=None,
+                           help='JSON file with the baseline results to compare against')
+    argparser.add_argument('--save-baseline', default=None,
+                           help='JSON file to store the results in as a new baseline')
+    argparser.add_argument('--tolerance', type=float, default=20.0,
+                           help='percentage by which a result may exceed the baseline')
+    args = argparser.parse_args()
+
+    if os.geteuid() != 0:
+        print('The scale test needs to be run as root', file=sys.stderr)
+        sys.exit(1)
+
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
+    bus = dbus.SystemBus()
+    loop = GLib.MainLoop()
+
+    setup = Setup(args)
+    try:
+        setup.create()
+        print('# %d %s devices, %d partitions each, %d VGs, %d MD RAID arrays' %
+              (len(setup.disks), args.backend, args.partitions, len(setup.vgs), len(setup.mds)))
+        sys.stdout.flush()
+        results = measure(args, bus, loop, setup)
+        results['setup'] = setup.description()
+    finally:
+        setup.destroy()
+
+    if baseline and baseline.get('setup') != results['setup']:
+        print('Warning: the baseline was taken with a different setup: %s' % baseline.get('setup'),
+              file=sys.stderr)
+
+    regressions = report(results, baseline, args.tolerance)
+
+    if args.save_baseline:
+        with open(args.save_baseline, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    if regressions:
+        print('Regressions: %s' % ', '.join(regressions), file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
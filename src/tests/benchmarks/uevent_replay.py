@@ -0,0 +1,216 @@
+#!/usr/bin/python3
+
+"""Uevent replay benchmark for the udisksd uevent pipeline
+
+Records the block uevents seen on the system with "udevadm monitor" and
+replays them, at the original pace, scaled by --speed or at a fixed
+--rate, by writing to the "uevent" files of the devices in sysfs. While
+replaying, the D-Bus signals sent by udisksd are counted and its CPU
+time and memory usage are sampled. Once the daemon has settled (no more
+D-Bus signals for --quiet-period seconds), the percentiles of the
+latencies of the uevent stages (probe-wait, probe, apply-wait and apply,
+see org.freedesktop.UDisks2.Manager.GetLatencyStatistics()) are reported
+for the replayed events.
+
+Only devices that still exist are replayed to. By default "add" and
+"remove" uevents are replayed as "change" uevents so the replay doesn't
+tear down objects that are in use. Use --keep-actions to replay them as
+they were recorded.
+
+Needs to be run as root against a running udisksd.
+
+Example:
+    ./uevent_replay.py record --duration 60 capture.txt
+    ./uevent_replay.py replay --speed 10 --repeat 5 capture.txt
+"""
+
+from __future__ import print_function
+
+import argparse
+import os
+import subprocess
+import sys
+import time
+
+import dbus
+import dbus.mainloop.glib
+from gi.repository import GLib
+
+from benchutil import (SignalCounter, daemon_cpu_seconds, daemon_pid, daemon_rss_kb,
+                       get_histograms, percentile, wait_settled)
+
+UEVENT_STAGES = ('probe-wait', 'probe', 'apply-wait', 'apply')
+
+
+def parse_capture(path):
+    '''Parses "udevadm monitor --kernel --property" output into a list of
+    (seconds since the first event, action, devpath) tuples'''
+
+    events = []
+    start = None
+    with open(path) as capture:
+        timestamp = action = devpath = None
+        for line in capture:
+            line = line.strip()
+            if line.startswith('KERNEL['):
+                # KERNEL[1234.567890] change   /devices/... (block)
+                timestamp = float(line[len('KERNEL['):line.index(']')])
+                action = line.split()[1]
+                devpath = None
+            elif line.startswith('DEVPATH='):
+                devpath = line[len('DEVPATH='):]
+            elif line == '' and timestamp is not None:
+                if devpath is not None:
+                    if start is None:
+                        start = timestamp
+                    events.append((timestamp - start, action, devpath))
+                timestamp = None
+        if timestamp is not None and devpath is not None:
+            if start is None:
+                start = timestamp
+            events.append((timestamp - start, action, devpath))
+    return events
+
+
+def record(args):
+    with open(args.capture, 'w') as capture:
+        proc = subprocess.Popen(['udevadm', 'monitor', '--kernel', '--property',
+                                 '--subsystem-match=block'],
+                                stdout=capture)
+        try:
+            time.sleep(args.duration)
+        finally:
+            proc.terminate()
+            proc.wait()
+    print('%d uevents recorded to %s' % (len(parse_capture(args.capture)), args.capture))
+
+
+def replay_events(events, args, loop):
+    '''Writes the uevents to sysfs at the requested pace, returns the number
+    of uevents triggered'''
+
+    context = loop.get_context()
+    n_events = 0
+    start = time.monotonic()
+    for n, (offset, action, devpath) in enumerate(events):
+        if args.rate:
+            due = start + n / args.rate
+        else:
+            due = start + offset / args.speed
+        while time.monotonic() < due:
+            while context.pending():
+                context.iteration(False)
+            time.sleep(min(0.001, max(due - time.monotonic(), 0)))
+
+        if not args.keep_actions and action != 'change':
+            action = 'change'
+        try:
+            with open('/sys%s/uevent' % devpath, 'w') as uevent:
+                uevent.write(action)
+            n_events += 1
+        except (IOError, OSError):
+            # the device is gone (or doesn't support synthetic uevents)
+            pass
+    return n_events
+
+
+def replay(args):
+    if os.geteuid() != 0:
+        print('Replaying uevents needs to be run as root', file=sys.stderr)
+        sys.exit(1)
+
+    events = parse_capture(args.capture)
+    if not events:
+        print('No uevents found in %s' % args.capture, file=sys.stderr)
+        sys.exit(1)
+
+    dbus.mainloop.glib.DBusGMainLoop(set_as_default=True)
+    bus = dbus.SystemBus()
+    loop = GLib.MainLoop()
+    counter = SignalCounter(bus)
+    pid = daemon_pid(bus)
+
+    print('# udisksd pid %d, %d uevents in %s, %s' %
+          (pid, len(events), args.capture,
+           ('%.1f uevents/s' % args.rate) if args.rate else ('%.1fx speed' % args.speed)))
+    print('%5s %8s %10s %10s %10s %10s  %s' %
+          ('run', 'uevents', 'settle[s]', 'signals/ev', 'cpu/ev[ms]', 'RSS[kB]',
+           '  '.join('%s p50/p90/p99[ms]' % stage for stage in UEVENT_STAGES)))
+
+    # let the daemon finish whatever it's doing first
+    wait_settled(loop, counter, args.quiet_period, args.timeout)
+
+    for run in range(args.repeat):
+        counter.reset()
+        histograms_before = get_histograms(bus, 'uevent')
+        cpu_before = daemon_cpu_seconds(pid)
+        rss_before = daemon_rss_kb(pid)
+
+        start = time.monotonic()
+        n_events = replay_events(events, args, loop)
+        end = wait_settled(loop, counter, args.quiet_period, args.timeout)
+
+        cpu_after = daemon_cpu_seconds(pid)
+        rss_after = daemon_rss_kb(pid)
+        histograms_after = get_histograms(bus, 'uevent')
+
+        if end is None:
+            settle = 'timeout'
+        else:
+            settle = '%.3f' % max(end - start, 0)
+
+        stages = []
+        for stage in UEVENT_STAGES:
+            after = histograms_after.get(stage)
+            if after is None:
+                stages.append('-')
+                continue
+            before = histograms_before.get(stage)
+            values = [percentile(before, after, fraction) for fraction in (0.5, 0.9, 0.99)]
+            stages.append('/'.join('inf' if v is None else '%g' % v for v in values))
+
+        print('%5d %8d %10s %10.2f %10.3f %10d  %s' %
+              (run + 1, n_events, settle,
+               counter.count / max(n_events, 1),
+               (cpu_after - cpu_before) * 1000.0 / max(n_events, 1),
+               rss_after - rss_before,
+               '  '.join('%-22s' % s for s in stages)))
+        sys.stdout.flush()
+
+
+def main():
+    argparser = argparse.ArgumentParser(description='udisks uevent replay benchmark')
+    subparsers = argparser.add_subparsers(dest='command')
+
+    record_parser = subparsers.add_parser('record', help='record the block uevents seen on the system')
+    record_parser.add_argument('--duration', type=float, default=60.0,
+                               help='number of seconds to record')
+    record_parser.add_argument('capture', help='file to store the "udevadm monitor" output in')
+
+    replay_parser = subparsers.add_parser('replay', help='replay recorded uevents')
+    replay_parser.add_argument('--speed', type=float, default=1.0,
+                               help='factor to speed up the recorded pace by')
+    replay_parser.add_argument('--rate', type=float, default=None,
+                               help='replay at a fixed number of uevents per second instead')
+    replay_parser.add_argument('--repeat', type=int, default=1,
+                               help='number of times to replay the capture')
+    replay_parser.add_argument('--keep-actions', action='store_true',
+                               help='replay "add" and "remove" uevents as such instead of as "change"')
+    replay_parser.add_argument('--quiet-period', type=float, default=2.0,
+                               help='seconds without D-Bus signals after which the daemon is considered settled')
+    replay_parser.add_argument('--timeout', type=float, default=600.0,
+                               help='maximum number of seconds to wait for the daemon to settle')
+    replay_parser.add_argument('capture', help='"udevadm monitor --kernel --property" output to replay')
+
+    args = argparser.parse_args()
+    if args.command == 'record':
+        record(args)
+    elif args.command == 'replay':
+        replay(args)
+    else:
+        argparser.print_help()
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
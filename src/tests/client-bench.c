@@ -0,0 +1,458 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Benchmark for the libudisks2 client side.
+ *
+ * For every scale a private message bus is started with a mock daemon
+ * exporting that many drives, each with a partitioned whole disk block
+ * device and a partition (three objects per drive). The mock daemon runs
+ * in the same thread as the client so the startup time includes the
+ * time it takes to serialize the objects, just like with udisksd.
+ *
+ * Measured are the udisks_client_new_for_connection() startup, the
+ * lookup helpers (average per call, over all the objects), a cold
+ * and a warm pass of udisks_client_get_object_info() and the latency
+ * from a property change in the daemon to UDisksClient::changed, which
+ * includes the coalescing timeout of the client.
+ *
+ * Example:
+ *   ./udisks-client-bench --objects 10,100,1000,10000
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include <udisks/udisks.h>
+
+#define BENCH_DEVICE_MAJOR 259
+
+static gchar *opt_objects = NULL;
+static gint opt_changes = 20;
+
+static const GOptionEntry option_entries[] =
+{
+  { "objects", 'n', 0, G_OPTION_ARG_STRING, &opt_objects,
+    "Comma separated numbers of drives to test with (default: 10,100,1000,10000)", NULL },
+  { "changes", 'c', 0, G_OPTION_ARG_INT, &opt_changes,
+    "Number of property changes to measure the changed signal latency with", NULL },
+  { NULL }
+};
+
+typedef struct
+{
+  GTestDBus *bus;
+  GDBusConnection *connection;
+  GDBusObjectManagerServer *object_manager;
+  GPtrArray *partition_blocks;  /* UDisksBlock skeletons */
+} MockDaemon;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GDBusConnection *
+bus_connect (GTestDBus *bus)
+{
+  GDBusConnection *ret;
+  GError *error = NULL;
+
+  ret = g_dbus_connection_new_for_address_sync (g_test_dbus_get_bus_address (bus),
+                                                G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                NULL, /* GDBusAuthObserver */
+                                                NULL, /* GCancellable */
+                                                &error);
+  if (ret == NULL)
+    g_error ("Error connecting to the test bus: %s", error->message);
+  return ret;
+}
+
+static void
+mock_daemon_export (MockDaemon      *daemon,
+                    const gchar     *object_path,
+                    UDisksDrive     *drive,
+                    UDisksBlock     *block,
+                    UDisksPartition *partition,
+                    UDisksPartitionTable *table)
+{
+  UDisksObjectSkeleton *object;
+
+  object = udisks_object_skeleton_new (object_path);
+  if (drive != NULL)
+    udisks_object_skeleton_set_drive (object, drive);
+  if (block != NULL)
+    udisks_object_skeleton_set_block (object, block);
+  if (partition != NULL)
+    udisks_object_skeleton_set_partition (object, partition);
+  if (table != NULL)
+    udisks_object_skeleton_set_partition_table (object, table);
+  g_dbus_object_manager_server_export (daemon->object_manager, G_DBUS_OBJECT_SKELETON (object));
+  g_object_unref (object);
+}
+
+static MockDaemon *
+mock_daemon_new (guint n_drives)
+{
+  MockDaemon *daemon;
+  UDisksManager *manager;
+  GVariant *result;
+  GError *error = NULL;
+  guint n;
+
+  daemon = g_new0 (MockDaemon, 1);
+  daemon->partition_blocks = g_ptr_array_new_with_free_func (g_object_unref);
+
+  daemon->bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (daemon->bus);
+  daemon->connection = bus_connect (daemon->bus);
+
+  daemon->object_manager = g_dbus_object_manager_server_new ("/org/freedesktop/UDisks2");
+
+  manager = udisks_manager_skeleton_new ();
+  udisks_manager_set_version (manager, PACKAGE_VERSION);
+  {
+    UDisksObjectSkeleton *object = udisks_object_skeleton_new ("/org/freedesktop/UDisks2/Manager");
+    udisks_object_skeleton_set_manager (object, manager);
+    g_dbus_object_manager_server_export (daemon->object_manager, G_DBUS_OBJECT_SKELETON (object));
+    g_object_unref (object);
+  }
+  g_object_unref (manager);
+
+  for (n = 0; n < n_drives; n++)
+    {
+      UDisksDrive *drive;
+      UDisksBlock *block;
+      UDisksPartitionTable *table;
+      UDisksPartition *partition;
+      gchar *drive_path;
+      gchar *disk_path;
+      gchar *partition_path;
+      gchar *s;
+
+      drive_path = g_strdup_printf ("/org/freedesktop/UDisks2/drives/Bench_Disk_%u", n);
+      disk_path = g_strdup_printf ("/org/freedesktop/UDisks2/block_devices/bench%u", n);
+      partition_path = g_strdup_printf ("/org/freedesktop/UDisks2/block_devices/bench%up1", n);
+
+      drive = udisks_drive_skeleton_new ();
+      udisks_drive_set_vendor (drive, "Bench");
+      udisks_drive_set_model (drive, "Disk");
+      s = g_strdup_printf ("BENCH%08u", n);
+      udisks_drive_set_serial (drive, s);
+      udisks_drive_set_id (drive, s);
+      g_free (s);
+      s = g_strdup_printf ("01bench%08u", n);
+      udisks_drive_set_sort_key (drive, s);
+      g_free (s);
+      udisks_drive_set_size (drive, 1000ULL * 1000 * 1000 * 1000);
+      mock_daemon_export (daemon, drive_path, drive, NULL, NULL, NULL);
+      g_object_unref (drive);
+
+      block = udisks_block_skeleton_new ();
+      s = g_strdup_printf ("/dev/bench%u", n);
+      udisks_block_set_device (block, s);
+      udisks_block_set_preferred_device (block, s);
+      g_free (s);
+      udisks_block_set_device_number (block, makedev (BENCH_DEVICE_MAJOR, 2 * n));
+      udisks_block_set_size (block, 1000ULL * 1000 * 1000 * 1000);
+      udisks_block_set_drive (block, drive_path);
+      udisks_block_set_crypto_backing_device (block, "/");
+      udisks_block_set_mdraid (block, "/");
+      udisks_block_set_mdraid_member (block, "/");
+      table = udisks_partition_table_skeleton_new ();
+      udisks_partition_table_set_type_ (table, "gpt");
+      mock_daemon_export (daemon, disk_path, NULL, block, NULL, table);
+      g_object_unref (table);
+      g_object_unref (block);
+
+      block = udisks_block_skeleton_new ();
+      s = g_strdup_printf ("/dev/bench%up1", n);
+      udisks_block_set_device (block, s);
+      udisks_block_set_preferred_device (block, s);
+      g_free (s);
+      udisks_block_set_device_number (block, makedev (BENCH_DEVICE_MAJOR, 2 * n + 1));
+      udisks_block_set_size (block, 1000ULL * 1000 * 1000 * 1000 - 2 * 1024 * 1024);
+      udisks_block_set_drive (block, drive_path);
+      udisks_block_set_crypto_backing_device (block, "/");
+      udisks_block_set_mdraid (block, "/");
+      udisks_block_set_mdraid_member (block, "/");
+      udisks_block_set_id_usage (block, "filesystem");
+      udisks_block_set_id_type (block, "ext4");
+      s = g_strdup_printf ("00000000-0000-0000-0000-%012u", n);
+      udisks_block_set_id_uuid (block, s);
+      g_free (s);
+      s = g_strdup_printf ("bench%u", n);
+      udisks_block_set_id_label (block, s);
+      g_free (s);
+      partition = udisks_partition_skeleton_new ();
+      udisks_partition_set_table (partition, disk_path);
+      udisks_partition_set_number (partition, 1);
+      udisks_partition_set_type_ (partition, "0fc63daf-8483-4772-8e79-3d69d8477de4");
+      udisks_partition_set_offset (partition, 1024 * 1024);
+      udisks_partition_set_size (partition, udisks_block_get_size (block));
+      mock_daemon_export (daemon, partition_path, NULL, block, partition, NULL);
+      g_ptr_array_add (daemon->partition_blocks, block);
+      g_object_unref (partition);
+
+      g_free (partition_path);
+      g_free (disk_path);
+      g_free (drive_path);
+    }
+
+  g_dbus_object_manager_server_set_connection (daemon->object_manager, daemon->connection);
+
+  result = g_dbus_connection_call_sync (daemon->connection,
+                                        "org.freedesktop.DBus",
+                                        "/org/freedesktop/DBus",
+                                        "org.freedesktop.DBus",
+                                        "RequestName",
+                                        g_variant_new ("(su)", "org.freedesktop.UDisks2", 0),
+                                        G_VARIANT_TYPE ("(u)"),
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1, /* default timeout */
+                                        NULL, /* GCancellable */
+                                        &error);
+  if (result == NULL)
+    g_error ("Error owning the name: %s", error->message);
+  g_variant_unref (result);
+
+  return daemon;
+}
+
+static void
+mock_daemon_free (MockDaemon *daemon)
+{
+  g_ptr_array_unref (daemon->partition_blocks);
+  g_object_unref (daemon->object_manager);
+  g_dbus_connection_close_sync (daemon->connection, NULL, NULL);
+  g_object_unref (daemon->connection);
+  g_test_dbus_down (daemon->bus);
+  g_object_unref (daemon->bus);
+  g_free (daemon);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_client_ready (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  UDisksClient **client = user_data;
+  GError *error = NULL;
+
+  *client = udisks_client_new_for_connection_finish (res, &error);
+  if (*client == NULL)
+    g_error ("Error creating the client: %s", error->message);
+}
+
+static void
+on_client_changed (UDisksClient *client,
+                   gpointer      user_data)
+{
+  gboolean *changed = user_data;
+  *changed = TRUE;
+}
+
+static void
+run_until (gboolean *done)
+{
+  while (!*done)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+unref0 (gpointer object)
+{
+  if (object != NULL)
+    g_object_unref (object);
+}
+
+/* Returns microseconds per call */
+static gdouble
+per_call (gint64 start,
+          guint  n_calls)
+{
+  return n_calls > 0 ? (gdouble) (g_get_monotonic_time () - start) / n_calls : 0.0;
+}
+
+static void
+bench_scale (guint n_drives)
+{
+  MockDaemon *daemon;
+  GDBusConnection *connection;
+  UDisksClient *client = NULL;
+  GList *objects, *l;
+  GPtrArray *blocks, *drives, *tables, *partitions;
+  gint64 start;
+  gdouble startup_ms;
+  gdouble by_dev_us, drive_for_block_us, block_for_drive_us, table_us, partitions_us, jobs_us;
+  gdouble info_cold_us, info_warm_us, changed_ms;
+  guint n;
+
+  daemon = mock_daemon_new (n_drives);
+  connection = bus_connect (daemon->bus);
+
+  start = g_get_monotonic_time ();
+  udisks_client_new_for_connection (connection, NULL, on_client_ready, &client);
+  while (client == NULL)
+    g_main_context_iteration (NULL, TRUE);
+  startup_ms = (g_get_monotonic_time () - start) / 1000.0;
+
+  blocks = g_ptr_array_new_with_free_func (g_object_unref);
+  drives = g_ptr_array_new_with_free_func (g_object_unref);
+  tables = g_ptr_array_new_with_free_func (g_object_unref);
+  partitions = g_ptr_array_new_with_free_func (g_object_unref);
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      if (udisks_object_peek_block (object) != NULL)
+        g_ptr_array_add (blocks, udisks_object_get_block (object));
+      if (udisks_object_peek_drive (object) != NULL)
+        g_ptr_array_add (drives, udisks_object_get_drive (object));
+      if (udisks_object_peek_partition_table (object) != NULL)
+        g_ptr_array_add (tables, udisks_object_get_partition_table (object));
+      if (udisks_object_peek_partition (object) != NULL)
+        g_ptr_array_add (partitions, udisks_object_get_partition (object));
+    }
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < blocks->len; n++)
+    unref0 (udisks_client_get_block_for_dev (client,
+                                                     udisks_block_get_device_number (blocks->pdata[n])));
+  by_dev_us = per_call (start, blocks->len);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < blocks->len; n++)
+    unref0 (udisks_client_get_drive_for_block (client, blocks->pdata[n]));
+  drive_for_block_us = per_call (start, blocks->len);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < drives->len; n++)
+    unref0 (udisks_client_get_block_for_drive (client, drives->pdata[n], FALSE));
+  block_for_drive_us = per_call (start, drives->len);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < partitions->len; n++)
+    unref0 (udisks_client_get_partition_table (client, partitions->pdata[n]));
+  table_us = per_call (start, partitions->len);
+
+  start = g_get_monotonic_time ();
+  for (n = 0; n < tables->len; n++)
+    g_list_free_full (udisks_client_get_partitions (client, tables->pdata[n]), g_object_unref);
+  partitions_us = per_call (start, tables->len);
+
+  start = g_get_monotonic_time ();
+  for (l = objects; l != NULL; l = l->next)
+    g_list_free_full (udisks_client_get_jobs_for_object (client, UDISKS_OBJECT (l->data)), g_object_unref);
+  jobs_us = per_call (start, g_list_length (objects));
+
+  start = g_get_monotonic_time ();
+  for (l = objects; l != NULL; l = l->next)
+    g_object_unref (udisks_client_get_object_info (client, UDISKS_OBJECT (l->data)));
+  info_cold_us = per_call (start, g_list_length (objects));
+
+  start = g_get_monotonic_time ();
+  for (l = objects; l != NULL; l = l->next)
+    g_object_unref (udisks_client_get_object_info (client, UDISKS_OBJECT (l->data)));
+  info_warm_us = per_call (start, g_list_length (objects));
+
+  /* property change in the daemon -> UDisksClient::changed */
+  start = g_get_monotonic_time ();
+  for (n = 0; n < (guint) opt_changes && daemon->partition_blocks->len > 0; n++)
+    {
+      UDisksBlock *block = daemon->partition_blocks->pdata[n % daemon->partition_blocks->len];
+      gboolean changed = FALSE;
+      gulong handler_id;
+      gchar *s;
+
+      handler_id = g_signal_connect (client, "changed", G_CALLBACK (on_client_changed), &changed);
+      s = g_strdup_printf ("changed%u", n);
+      udisks_block_set_id_label (block, s);
+      g_free (s);
+      run_until (&changed);
+      g_signal_handler_disconnect (client, handler_id);
+    }
+  changed_ms = per_call (start, opt_changes) / 1000.0;
+
+  g_print ("%7u %7u %10.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %9.2f %9.2f %10.2f\n",
+           n_drives, g_list_length (objects), startup_ms,
+           by_dev_us, drive_for_block_us, block_for_drive_us, table_us, partitions_us, jobs_us,
+           info_cold_us, info_warm_us, changed_ms);
+
+  g_list_free_full (objects, g_object_unref);
+  g_ptr_array_unref (partitions);
+  g_ptr_array_unref (tables);
+  g_ptr_array_unref (drives);
+  g_ptr_array_unref (blocks);
+  g_object_unref (client);
+  g_dbus_connection_close_sync (connection, NULL, NULL);
+  g_object_unref (connection);
+  mock_daemon_free (daemon);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar **scales;
+  guint n;
+
+  context = g_option_context_new ("- udisks client benchmark");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      g_option_context_free (context);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  g_print ("# times per call in microseconds unless noted otherwise\n");
+  g_print ("%7s %7s %10s %8s %8s %8s %8s %8s %8s %9s %9s %10s\n",
+           "drives", "objects", "startup/ms",
+           "by-dev", "drive", "block", "table", "parts", "jobs",
+           "info-cold", "info-warm", "changed/ms");
+
+  scales = g_strsplit (opt_objects != NULL ? opt_objects : "10,100,1000,10000", ",", 0);
+  for (n = 0; scales[n] != NULL; n++)
+    {
+      guint64 n_drives;
+      gchar *endp;
+
+      n_drives = g_ascii_strtoull (g_strstrip (scales[n]), &endp, 10);
+      if (endp == scales[n] || *endp != '\0' || n_drives == 0 || n_drives > G_MAXUINT)
+        {
+          g_printerr ("Invalid number of drives `%s'\n", scales[n]);
+          g_strfreev (scales);
+          return 1;
+        }
+      bench_scale ((guint) n_drives);
+    }
+  g_strfreev (scales);
+  g_free (opt_objects);
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 import udiskstestcase
 import dbus
 import os
+import six
 from distutils.spawn import find_executable
 
 class UdisksBaseTest(udiskstestcase.UdisksTestCase):
@@ -29,6 +30,27 @@ class UdisksBaseTest(udiskstestcase.UdisksTestCase):
         version = self.get_property(self.manager_obj, '.Manager', 'Version')
         version.assertIsNotNone()
 
+    def test_15_coldplug_complete(self):
+        '''Testing the coldplug readiness properties'''
+        complete = self.get_property(self.manager_obj, '.Manager', 'ColdplugComplete')
+        complete.assertTrue()
+
+        stats = self.get_property_raw(self.manager_obj, '.Manager', 'ColdplugStatistics')
+        self.assertIn('devices-probed', stats)
+        self.assertGreater(stats['devices-probed'], 0)
+        self.assertIn('probe-time-usec', stats)
+        self.assertIn('export-time-usec', stats)
+
+    def test_16_health_summary(self):
+        '''Testing the drive health summary'''
+        summary = self.get_property_raw(self.manager_obj, '.Manager', 'HealthSummary')
+        for key in ('drives', 'failing', 'attributes-failing', 'over-temperature',
+                    'drives-with-bad-sectors', 'bad-sectors', 'temperature-threshold'):
+            self.assertIn(key, summary)
+        self.assertLessEqual(summary['failing'], summary['drives'])
+        self.assertLessEqual(summary['over-temperature'], summary['drives'])
+        self.assertGreater(summary['temperature-threshold'], 273.15)
+
     def test_20_enable_modules(self):
         manager = self.get_interface(self.manager_obj, '.Manager')
         manager_intro = dbus.Interface(self.manager_obj, "org.freedesktop.DBus.Introspectable")
@@ -46,6 +68,25 @@ class UdisksBaseTest(udiskstestcase.UdisksTestCase):
             for module in modules:
                 self.assertIn('interface name="%s.Manager.%s"' % (self.iface_prefix, module), intro_data)
 
+    def test_25_enable_module(self):
+        manager = self.get_interface(self.manager_obj, '.Manager')
+        manager_intro = dbus.Interface(self.manager_obj, "org.freedesktop.DBus.Introspectable")
+        if 'LVM2' not in self._get_modules():
+            self.skipTest("LVM2 module not available, nothing to test")
+
+        # enabling an already loaded module (see test_20) is a noop
+        manager.EnableModule('lvm2', dbus.Boolean(True))
+        intro_data = manager_intro.Introspect()
+        self.assertIn('interface name="%s.Manager.LVM2"' % self.iface_prefix, intro_data)
+
+        msg = 'Module i-dont-exist is not available'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            manager.EnableModule('i-dont-exist', dbus.Boolean(True))
+
+        msg = 'Invalid value "FALSE"'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            manager.EnableModule('lvm2', dbus.Boolean(False))
+
     def test_30_supported_filesystems(self):
         fss = self.get_property(self.manager_obj, '.Manager', 'SupportedFilesystems')
         self.assertEqual({str(s) for s in fss.value},
@@ -168,6 +209,50 @@ class UdisksBaseTest(udiskstestcase.UdisksTestCase):
         for path in block_paths:
             self.assertIn(path, dbus_blocks)
 
+        # the object manager of the subtree only has the block devices
+        subtree = self.get_object('/block_devices')
+        subtree_objects = subtree.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
+        self.assertEqual(sorted(subtree_objects.keys()), sorted(block_paths))
+        for path in block_paths:
+            self.assertEqual(sorted(subtree_objects[path].keys()), sorted(objects[path].keys()))
+
+    def test_55_watch_jobs(self):
+        manager = self.get_interface(self.manager_obj, '.Manager')
+        manager_intro = dbus.Interface(self.manager_obj, "org.freedesktop.DBus.Introspectable")
+        self.assertIn('signal name="JobsChanged"', manager_intro.Introspect())
+
+        # subscribing twice and unsubscribing when not subscribed is fine
+        manager.WatchJobs(self.no_options)
+        manager.WatchJobs(self.no_options)
+        manager.UnwatchJobs(self.no_options)
+        manager.UnwatchJobs(self.no_options)
+
+    def test_56_latency_statistics(self):
+        manager = self.get_interface(self.manager_obj, '.Manager')
+
+        # the first call is only recorded once it is replied to
+        manager.GetBlockDevices(self.no_options)
+        histograms = manager.GetLatencyStatistics(self.no_options)
+        methods = {str(name): (count, buckets) for (kind, name, _sum, count, buckets) in histograms
+                   if kind == 'method'}
+        self.assertIn('org.freedesktop.UDisks2.Manager.GetBlockDevices', methods)
+
+        # the wait for a thread of the method dispatcher is recorded before the call runs
+        queued = [str(name) for (kind, name, _sum, _count, _buckets) in histograms if kind == 'queue']
+        self.assertIn('org.freedesktop.UDisks2.Manager.GetLatencyStatistics', queued)
+
+        # the Block interface is updated for every block device at least once
+        updates = [str(name) for (kind, name, _sum, _count, _buckets) in histograms if kind == 'update']
+        self.assertIn('UDisksLinuxBlock', updates)
+
+        for (kind, name, _sum, count, buckets) in histograms:
+            self.assertIn(kind, ('method', 'uevent', 'job', 'lock', 'timer', 'queue', 'update'))
+            # cumulative buckets ending with +Inf (-1) holding all the samples
+            self.assertEqual(buckets[-1][0], -1)
+            self.assertEqual(buckets[-1][1], count)
+            counts = [c for (_bound, c) in buckets]
+            self.assertEqual(counts, sorted(counts))
+
     def _wipe(self, device, retry=True):
         ret, out = self.run_command('wipefs -a %s' % device)
         if ret != 0:
@@ -223,6 +308,11 @@ class UdisksBaseTest(udiskstestcase.UdisksTestCase):
         dbus_label = self.get_property(disk, '.Block', 'IdLabel')
         dbus_label.assertEqual(label)
 
+        # the cached GetManagedObjects() reply must not be out of date
+        objects = self.get_object('').GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
+        object_path = '%s/block_devices/%s' % (self.path_prefix, os.path.basename(self.vdevs[0]))
+        self.assertEqual(objects[object_path][self.iface_prefix + '.Block']['IdLabel'], label)
+
         # now it should return the disk
         spec = dbus.Dictionary({'path': self.vdevs[0], 'label': label}, signature='sv')
         devices = manager.ResolveDevice(spec, self.no_options)
@@ -261,6 +351,56 @@ class UdisksBaseTest(udiskstestcase.UdisksTestCase):
         self.assertEqual(len(devices), 1)
         self.assertIn(object_path, devices)
 
+    def test_65_get_objects(self):
+        manager = self.get_interface(self.manager_obj, '.Manager')
+        object_path = '%s/block_devices/%s' % (self.path_prefix, os.path.basename(self.vdevs[0]))
+        missing_path = self.missing_object_path()
+
+        objects = manager.GetObjects([object_path, missing_path], dbus.Array([], signature='s'),
+                                     self.no_options)
+        self.assertEqual(list(objects.keys()), [object_path])
+        self.assertIn(self.iface_prefix + '.Block', objects[object_path])
+        block_props = objects[object_path][self.iface_prefix + '.Block']
+        self.assertEqual(self.ay_to_str(block_props['Device']), self.vdevs[0])
+
+        # only the requested interfaces should be returned
+        objects = manager.GetObjects([object_path], [self.iface_prefix + '.Block'], self.no_options)
+        self.assertEqual(list(objects[object_path].keys()), [self.iface_prefix + '.Block'])
+
+    def test_66_query_objects(self):
+        manager = self.get_interface(self.manager_obj, '.Manager')
+        disk_name = os.path.basename(self.vdevs[0])
+        object_path = '%s/block_devices/%s' % (self.path_prefix, disk_name)
+        no_projection = dbus.Dictionary({}, signature='sas')
+        size = self.get_property_raw(self.get_object('/block_devices/' + disk_name), '.Block', 'Size')
+
+        # all block devices
+        spec = dbus.Dictionary({'interface': self.iface_prefix + '.Block'}, signature='sv')
+        objects = manager.QueryObjects(spec, no_projection, self.no_options)
+        self.assertIn(object_path, objects)
+        for props in objects.values():
+            self.assertIn(self.iface_prefix + '.Block', props)
+
+        # size range and projection
+        spec = dbus.Dictionary({'interface': self.iface_prefix + '.Block',
+                                'size-min': dbus.UInt64(size),
+                                'size-max': dbus.UInt64(size)}, signature='sv')
+        projection = dbus.Dictionary({self.iface_prefix + '.Block': ['Size']}, signature='sas')
+        objects = manager.QueryObjects(spec, projection, self.no_options)
+        self.assertIn(object_path, objects)
+        self.assertEqual(dict(objects[object_path]), {self.iface_prefix + '.Block': {'Size': size}})
+
+        spec = dbus.Dictionary({'size-min': dbus.UInt64(size + 1),
+                                'size-max': dbus.UInt64(size + 1)}, signature='sv')
+        objects = manager.QueryObjects(spec, no_projection, self.no_options)
+        self.assertNotIn(object_path, objects)
+
+        # unknown filter keys are errors
+        spec = dbus.Dictionary({'i-dont-exist': 'foo'}, signature='sv')
+        msg = 'Unknown filter key'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            manager.QueryObjects(spec, no_projection, self.no_options)
+
     def test_80_device_presence(self):
         '''Test the debug devices are present on the bus'''
         for d in self.vdevs:
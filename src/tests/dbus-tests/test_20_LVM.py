@@ -371,3 +371,42 @@ class UdisksLVMTest(udiskstestcase.UdisksTestCase):
 
         _ret, out = self.run_command('pvs --noheadings -o vg_name %s' % self.vdevs[0])
         self.assertEqual(out, '')
+
+    def test_70_bulk(self):
+        ''' Test creating and deleting several LVs at once '''
+
+        vgname = 'udisks_test_bulk_vg'
+
+        # Use all the virtual devices
+        devs = dbus.Array()
+        for d in self.vdevs:
+            dev_obj = self.get_object('/block_devices/' + os.path.basename(d))
+            self.assertIsNotNone(dev_obj)
+            devs.append(dev_obj)
+        vg = self._create_vg(vgname, devs)
+        self.addCleanup(self._remove_vg, vg)
+
+        lvnames = ['udisks_test_lv%d' % i for i in range(3)]
+        volumes = dbus.Array([dbus.Struct((name, dbus.UInt64(4 * 1024**2), dbus.ObjectPath('/')))
+                              for name in lvnames], signature='(sto)')
+        lv_paths = vg.CreateVolumes(volumes, self.no_options,
+                                    dbus_interface=self.iface_prefix + '.VolumeGroup')
+        self.assertEqual(len(lv_paths), len(lvnames))
+
+        for lvname, lv_path in zip(lvnames, lv_paths):
+            ret, _out = self.run_command('lvs %s' % os.path.join(vgname, lvname))
+            self.assertEqual(ret, 0)
+
+            lv = self.bus.get_object(self.iface_prefix, lv_path)
+            dbus_name = self.get_property(lv, '.LogicalVolume', 'Name')
+            dbus_name.assertEqual(lvname)
+
+        vg.DeleteVolumes(dbus.Array(lv_paths, signature='o'), self.no_options,
+                         dbus_interface=self.iface_prefix + '.VolumeGroup')
+
+        udisks = self.get_object('')
+        objects = udisks.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
+        for lvname, lv_path in zip(lvnames, lv_paths):
+            ret, _out = self.run_command('lvs %s' % os.path.join(vgname, lvname))
+            self.assertNotEqual(ret, 0)
+            self.assertNotIn(lv_path, objects.keys())
@@ -210,6 +210,62 @@ class UdisksISCSITest(udiskstestcase.UdisksTestCase):
         objects = udisks.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
         self.assertNotIn(dbus_path, objects.keys())
 
+    def test_discovery_cache(self):
+        manager = self.get_object('/Manager')
+        nodes, nodes_cnt = manager.DiscoverSendTargets(self.address, self.port, self.no_options,
+                                                       dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+        self.assertEqual(len(nodes), nodes_cnt)
+
+        # repeated discovery is served from the cache
+        cached, cached_cnt = manager.DiscoverSendTargets(self.address, self.port, self.no_options,
+                                                         dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+        self.assertEqual(sorted(cached), sorted(nodes))
+        self.assertEqual(cached_cnt, nodes_cnt)
+
+        # 'refresh' asks the portal again
+        refreshed, refreshed_cnt = manager.DiscoverSendTargets(self.address, self.port, {'refresh': True},
+                                                               dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+        self.assertEqual(sorted(refreshed), sorted(nodes))
+        self.assertEqual(refreshed_cnt, nodes_cnt)
+
+    def test_login_batch(self):
+        manager = self.get_object('/Manager')
+        nodes, _ = manager.DiscoverSendTargets(self.address, self.port, self.no_options,
+                                               dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+
+        node = next((node for node in nodes if node[0] == self.noauth_iqn), None)
+        self.assertIsNotNone(node)
+
+        # empty batch is a no-op
+        batch = dbus.Array([], signature='(sisis)')
+        manager.LoginBatch(batch, self.no_options,
+                           dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+
+        batch = dbus.Array([node], signature='(sisis)')
+        self.addCleanup(self._force_lougout, self.noauth_iqn)
+        manager.LoginBatch(batch, self.no_options,
+                           dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+
+        devs = glob.glob('/dev/disk/by-path/*%s*' % self.noauth_iqn)
+        self.assertEqual(len(devs), 1)
+
+        # the block device should already be on dbus
+        disk_name = os.path.realpath(devs[0]).split('/')[-1]
+        disk_obj = self.get_object('/block_devices/' + disk_name)
+        dbus_path = str(disk_obj.object_path)
+        udisks = self.get_object('')
+        objects = udisks.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
+        self.assertIn(dbus_path, objects.keys())
+
+        manager.LogoutBatch(batch, self.no_options,
+                            dbus_interface=self.iface_prefix + '.Manager.ISCSI.Initiator')
+
+        devs = glob.glob('/dev/disk/by-path/*%s*' % self.noauth_iqn)
+        self.assertEqual(len(devs), 0)
+
+        objects = udisks.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
+        self.assertNotIn(dbus_path, objects.keys())
+
     def test_session(self):
         manager = self.get_object('/Manager')
 
@@ -73,6 +73,28 @@ class UdisksDriveTest(udiskstestcase.UdisksTestCase):
                                        'Failed: No usb device'):
                 drive.PowerOff(self.no_options)
 
+    @udiskstestcase.skip_on(("centos", "enterprise_linux"), "7", reason="SCSI debug bug causing kernel panic on CentOS/RHEL 7")
+    def test_25_poweroff_drives(self):
+        ''' Test of Manager.PowerOffDrives method '''
+        manager = self.get_interface('/Manager', '.Manager')
+        paths = [self.path_prefix + '/drives/' + self.get_drive_name(self.get_device(dev))
+                 for dev in (self.vdevs[0], self.cd_dev)]
+        results = self.call_bulk(manager.PowerOffDrives, paths, self.missing_object_path('drives'), 'o')
+
+        # neither drive can be powered off, each of them fails on its own
+        for (_path, error_name, error_message) in results:
+            self.assertEqual(error_name, 'org.freedesktop.UDisks2.Error.Failed')
+            self.assertEqual(error_message, 'No usb device')
+
+    def test_26_secure_erase_drives(self):
+        ''' Test of Manager.SecureEraseDrives method '''
+        manager = self.get_interface('/Manager', '.Manager')
+        path = self.path_prefix + '/drives/' + self.get_drive_name(self.get_device(self.vdevs[0]))
+
+        # scsi_debug drives are neither ATA nor NVMe drives, nothing gets erased
+        results = self.call_bulk(manager.SecureEraseDrives, [path], self.missing_object_path('drives'), 'o')
+        self.assertEqual(results[0][1], 'org.freedesktop.UDisks2.Error.NotSupported')
+
     @udiskstestcase.skip_on(("centos", "enterprise_linux"), "7", reason="SCSI debug bug causing kernel panic on CentOS/RHEL 7")
     def test_30_setconfiguration(self):
         ''' Test of Drive.SetConfiguration method '''
@@ -119,7 +141,10 @@ class UdisksDriveTest(udiskstestcase.UdisksTestCase):
             'WWN': wwn,
             'OpticalNumDataTracks': 1,
             'OpticalNumTracks': 1,
-            'Size': 8388608
+            'Size': 8388608,
+            # scsi_debug devices are not in any SES enclosure
+            'Enclosure': '/',
+            'EnclosureSlot': ''
         }
 
         for prop_name, expected_val in expected_prop_vals.items():
@@ -133,3 +158,29 @@ class UdisksDriveTest(udiskstestcase.UdisksTestCase):
         self.assertEqual(timedetected.value, timemediadetected.value)
         sortkey = self.get_property(self.cd_drive, '.Drive', 'SortKey')
         sortkey.assertEqual('01hotplug/%d' % timedetected.value)
+
+    @udiskstestcase.skip_on(("centos", "enterprise_linux"), "7", reason="SCSI debug bug causing kernel panic on CentOS/RHEL 7")
+    def test_50_statistics(self):
+        ''' Test of the Drive.Statistics interface '''
+        stats = self.get_interface(self.cd_drive, '.Drive.Statistics')
+
+        # nothing is sampled without subscribers
+        self.get_property(self.cd_drive, '.Drive.Statistics', 'Updated').assertEqual(0)
+
+        stats.Subscribe(self.no_options)
+        try:
+            # the rates are computed from the second sample on
+            interval = self.get_property(self.cd_drive, '.Drive.Statistics', 'Interval')
+            interval.assertGreater(0, timeout=15)
+            updated = self.get_property(self.cd_drive, '.Drive.Statistics', 'Updated')
+            updated.assertGreater(0)
+            utilization = self.get_property(self.cd_drive, '.Drive.Statistics', 'Utilization')
+            self.assertTrue(0 <= utilization.value <= 1)
+
+            # subscribing twice is fine
+            stats.Subscribe(self.no_options)
+        finally:
+            stats.Unsubscribe(self.no_options)
+
+        self.get_property(self.cd_drive, '.Drive.Statistics', 'Updated').assertEqual(0)
+        self.get_property(self.cd_drive, '.Drive.Statistics', 'Interval').assertEqual(0)
@@ -2,6 +2,7 @@ import copy
 import dbus
 import fcntl
 import os
+import six
 import time
 import unittest
 
@@ -279,3 +280,73 @@ class UdisksBlockTest(udiskstestcase.UdisksTestCase):
         self.assertIsNotNone(disk)
 
         disk.Rescan(self.no_options, dbus_interface=self.iface_prefix + '.Block')
+
+    def test_zoned(self):
+        for vdev in self.vdevs:
+            disk = self.get_object('/block_devices/' + os.path.basename(vdev))
+            self.assertIsNotNone(disk)
+
+            model = self.read_file('/sys/block/%s/queue/zoned' % os.path.basename(vdev)).strip()
+            if model == 'none':
+                # regular disks don't get the interface
+                with self.assertRaises(dbus.exceptions.DBusException):
+                    disk.Get(self.iface_prefix + '.Block.Zoned', 'Model',
+                             dbus_interface=dbus.PROPERTIES_IFACE)
+                continue
+
+            self.get_property(disk, '.Block.Zoned', 'Model').assertEqual(model)
+            num_zones = self.get_property_raw(disk, '.Block.Zoned', 'NumZones')
+            zones = disk.ReportZones(0, 2, self.no_options,
+                                     dbus_interface=self.iface_prefix + '.Block.Zoned')
+            self.assertEqual(len(zones), min(2, num_zones))
+            self.assertEqual(zones[0][0], 0)
+
+    def test_queue(self):
+        vdev = self.vdevs[0]
+        disk = self.get_object('/block_devices/' + os.path.basename(vdev))
+        self.assertIsNotNone(disk)
+
+        queue_dir = '/sys/block/%s/queue/' % os.path.basename(vdev)
+        read_ahead = int(self.read_file(queue_dir + 'read_ahead_kb'))
+        self.get_property(disk, '.Block.Queue', 'ReadAheadKB').assertEqual(read_ahead)
+        self.addCleanup(self.write_file, queue_dir + 'read_ahead_kb', str(read_ahead))
+
+        scheduler = self.get_property_raw(disk, '.Block.Queue', 'Scheduler')
+        self.assertIn(scheduler, self.get_property_raw(disk, '.Block.Queue', 'AvailableSchedulers'))
+
+        new_read_ahead = 256 if read_ahead != 256 else 512
+        disk.SetSettings({'read-ahead-kb': dbus.UInt32(new_read_ahead)}, self.no_options,
+                         dbus_interface=self.iface_prefix + '.Block.Queue')
+        self.get_property(disk, '.Block.Queue', 'ReadAheadKB').assertEqual(new_read_ahead)
+        self.assertEqual(int(self.read_file(queue_dir + 'read_ahead_kb')), new_read_ahead)
+
+        # unknown settings and wrong types are rejected
+        msg = 'Unknown queue setting'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.SetSettings({'no-such-setting': dbus.UInt32(1)}, self.no_options,
+                             dbus_interface=self.iface_prefix + '.Block.Queue')
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.SetSettings({'read-ahead-kb': 'fast'}, self.no_options,
+                             dbus_interface=self.iface_prefix + '.Block.Queue')
+
+    def test_benchmark(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.assertIsNotNone(disk)
+
+        options = dbus.Dictionary({'pattern': 'random', 'block-sizes': dbus.Array([dbus.UInt64(4096)], signature='t'),
+                                   'queue-depth': dbus.UInt32(4), 'duration': dbus.UInt32(1)}, signature='sv')
+        results = disk.Benchmark(options, dbus_interface=self.iface_prefix + '.Block')
+        self.assertEqual(len(results), 1)
+        self.assertEqual(results[0]['block-size'], 4096)
+        self.assertGreater(results[0]['operations'], 0)
+        self.assertEqual(results[0]['bytes'], results[0]['operations'] * 4096)
+        self.assertGreater(results[0]['iops'], 0)
+        self.assertLessEqual(results[0]['latency-min'], results[0]['latency-p50'])
+        self.assertLessEqual(results[0]['latency-p50'], results[0]['latency-p99'])
+        self.assertLessEqual(results[0]['latency-p99'], results[0]['latency-max'])
+
+        # block sizes have to be multiples of the sector size
+        msg = 'Invalid block size'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            options['block-sizes'] = dbus.Array([dbus.UInt64(1000)], signature='t')
+            disk.Benchmark(options, dbus_interface=self.iface_prefix + '.Block')
@@ -280,6 +280,44 @@ class UdisksPartitionTableTest(udiskstestcase.UdisksTestCase):
         _ret, sys_type = self.run_command('blkid /dev/%s -p -o value -s PART_ENTRY_TYPE' % part_name)
         self.assertEqual(sys_type, gpt_type)
 
+    def test_create_gpt_partitions(self):
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.assertIsNotNone(disk)
+
+        self._create_format(disk, 'gpt')
+        self.addCleanup(self._remove_format, disk)
+
+        gpt_type = '933ac7e1-2eb4-4f13-b844-0e14e2aef915'
+        partitions = dbus.Array([(dbus.UInt64((1 + i * 20) * 1024**2), dbus.UInt64(20 * 1024**2),
+                                  gpt_type, 'part%d' % i, self.no_options) for i in range(4)],
+                                signature='(ttssa{sv})')
+        paths = disk.CreatePartitions(partitions, self.no_options,
+                                      dbus_interface=self.iface_prefix + '.PartitionTable')
+        self.assertEqual(len(paths), 4)
+
+        self.udev_settle()
+        for i, path in enumerate(paths):
+            part = self.bus.get_object(self.iface_prefix, path)
+            self.assertIsNotNone(part)
+            self.addCleanup(self._remove_partition, part)
+
+            offset = self.get_property(part, '.Partition', 'Offset')
+            offset.assertEqual((1 + i * 20) * 1024**2)
+
+            size = self.get_property(part, '.Partition', 'Size')
+            size.assertEqual(20 * 1024**2)
+
+            dbus_name = self.get_property(part, '.Partition', 'Name')
+            dbus_name.assertEqual('part%d' % i)
+
+        # overlapping with the first one
+        partitions = dbus.Array([(dbus.UInt64(2 * 1024**2), dbus.UInt64(10 * 1024**2),
+                                  '', '', self.no_options)], signature='(ttssa{sv})')
+        msg = 'org.freedesktop.UDisks2.Error.Failed: Error creating partition 1: .*overlaps'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.CreatePartitions(partitions, self.no_options,
+                                  dbus_interface=self.iface_prefix + '.PartitionTable')
+
     def test_create_with_format(self):
         disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
         self.assertIsNotNone(disk)
@@ -164,6 +164,43 @@ class UdisksEncryptedTest(udiskstestcase.UdisksTestCase):
         dbus_cleartext = self.get_property(disk, '.Encrypted', 'CleartextDevice')
         dbus_cleartext.assertEqual(luks)
 
+    def test_unlock_many(self):
+        manager = self.get_interface('/Manager', '.Manager')
+        disks = []
+        for vdev in self.vdevs[:2]:
+            disk = self.get_object('/block_devices/' + os.path.basename(vdev))
+            self._create_luks(disk, 'test')
+            self.addCleanup(self._remove_luks, disk)
+            disk.Lock(self.no_options, dbus_interface=self.iface_prefix + '.Encrypted')
+            disks.append(disk)
+        self.udev_settle()
+
+        # the first one uses the passphrase from the options, the second one has a wrong one
+        devices = [(disks[0].object_path, '', self.no_options),
+                   (disks[1].object_path, 'shbdkjaf', self.no_options)]
+        options = dbus.Dictionary({'passphrase': 'test', 'max-parallel': dbus.UInt32(2)}, signature='sv')
+        results = self.call_bulk(manager.UnlockEncrypted, devices,
+                                 (self.missing_object_path(), 'test', self.no_options), '(osa{sv})',
+                                 options)
+        self.assertEqual(results[0][2], '')
+        dbus_cleartext = self.get_property(disks[0], '.Encrypted', 'CleartextDevice')
+        dbus_cleartext.assertEqual(results[0][1])
+        self.assertEqual(results[1][1], '/')
+        self.assertEqual(results[1][2], 'org.freedesktop.UDisks2.Error.Failed')
+
+        # a tiny budget unlocks one device at a time
+        devices = dbus.Array([(disks[0].object_path, 'test', self.no_options),
+                              (disks[1].object_path, 'test', self.no_options)],
+                             signature='(osa{sv})')
+        options = dbus.Dictionary({'kdf-memory-budget': dbus.UInt64(1)}, signature='sv')
+        results = manager.UnlockEncrypted(devices, options)
+        # the first one is still unlocked
+        self.assertEqual(results[0][2], 'org.freedesktop.UDisks2.Error.Failed')
+        self.assertIn('is already unlocked', results[0][3])
+        self.assertEqual(results[1][2], '')
+        dbus_cleartext = self.get_property(disks[1], '.Encrypted', 'CleartextDevice')
+        dbus_cleartext.assertEqual(results[1][1])
+
     @unittest.skipUnless("JENKINS_HOME" in os.environ, "skipping test that modifies system configuration")
     def test_open_crypttab(self):
         # this test will change /etc/crypttab, we might want to revert the changes when it finishes
@@ -563,5 +600,46 @@ class UdisksEncryptedTestLUKS2(UdisksEncryptedTest):
         dbus_cleartext = self.get_property(device, '.Encrypted', 'CleartextDevice')
         dbus_cleartext.assertEqual('/')
 
+    def _get_volume_key_digest(self, disk):
+        ret, out = self.run_command("cryptsetup luksDump %s" % disk)
+        if ret != 0:
+            self.fail("Failed to get LUKS 2 information from '%s':\n%s" % (disk, out))
+
+        m = re.search(r"Digests:\s*\n\s*[0-9]+: \S+\s*\n(?:.*\n)*?\s*Digest:\s*(.*)", out)
+        if m is None:
+            self.fail("Failed to get LUKS 2 digest information using 'cryptsetup luksDump %s'" % disk)
+        return m.group(1).strip()
+
+    def test_reencrypt(self):
+        passwd = 'test'
+
+        device = self.get_device(self.vdevs[0])
+        self._create_luks(device, passwd)
+        self.addCleanup(self._remove_luks, device)
+        self.udev_settle()
+
+        _ret, clear_dev = self.run_command('ls /sys/block/%s/holders/' % os.path.basename(self.vdevs[0]))
+        self.assertEqual(_ret, 0)
+        digest = self._get_volume_key_digest(self.vdevs[0])
+
+        # wrong passphrase
+        msg = 'org.freedesktop.UDisks2.Error.(Failed|NotSupported): Error reencrypting device %s: .*' % self.vdevs[0]
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            device.Reencrypt('wrongpassphrase', self.no_options,
+                             dbus_interface=self.iface_prefix + '.Encrypted')
+
+        try:
+            device.Reencrypt(passwd, {'max-bandwidth': dbus.UInt64(64 * 1024 * 1024)},
+                             dbus_interface=self.iface_prefix + '.Encrypted')
+        except dbus.exceptions.DBusException as e:
+            if 'NotSupported' in e.get_dbus_name():
+                self.skipTest('LUKS2 reencryption not supported')
+            raise
+
+        # new volume key, the data is still there
+        self.assertNotEqual(self._get_volume_key_digest(self.vdevs[0]), digest)
+        _ret, fstype = self.run_command('blkid -p -s TYPE -o value /dev/%s' % clear_dev)
+        self.assertEqual(fstype, 'xfs')
+
 
 del UdisksEncryptedTest  # skip UdisksEncryptedTest
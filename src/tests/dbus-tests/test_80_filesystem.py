@@ -4,6 +4,7 @@ import re
 import six
 import shutil
 import tempfile
+import threading
 import unittest
 import time
 from distutils.spawn import find_executable
@@ -188,6 +189,19 @@ class UdisksFSTestCase(udiskstestcase.UdisksTestCase):
         self.assertTrue(disk.Check(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem'))
         self.get_property(disk, '.Filesystem', 'Size').assertEqual(size // 2)
 
+        # low priority
+        options = dbus.Dictionary({'ioprio.class': 'idle', 'nice': 19}, signature='sv')
+        self.assertTrue(disk.Check(options, dbus_interface=self.iface_prefix + '.Filesystem'))
+        options = dbus.Dictionary({'ioprio.level': 7}, signature='sv')
+        self.assertTrue(disk.Repair(options, dbus_interface=self.iface_prefix + '.Filesystem'))
+
+        # raising the priority is not allowed
+        msg = 'org.freedesktop.UDisks2.Error.OptionNotPermitted'
+        for options in ({'ioprio.class': 'realtime'}, {'ioprio.level': 8}, {'nice': -5}):
+            with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+                disk.Check(dbus.Dictionary(options, signature='sv'),
+                           dbus_interface=self.iface_prefix + '.Filesystem')
+
     def test_size(self):
         if not self._can_create:
             self.skipTest('Cannot create %s filesystem' % self._fs_name)
@@ -216,6 +230,51 @@ class UdisksFSTestCase(udiskstestcase.UdisksTestCase):
         size = self.get_property(disk, '.Block', 'Size').value
         self.get_property(disk, '.Filesystem', 'Size').assertEqual(size)
 
+    def test_usage(self):
+        if not self._can_create:
+            self.skipTest('Cannot create %s filesystem' % self._fs_name)
+
+        if not self._can_mount:
+            self.skipTest('Cannot mount %s filesystem' % self._fs_name)
+
+        disk = self.get_object('/block_devices/' + os.path.basename(self.vdevs[0]))
+        self.assertIsNotNone(disk)
+
+        # create filesystem
+        disk.Format(self._fs_name, self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self._clean_format, self.vdevs[0])
+
+        # mount
+        d = dbus.Dictionary(signature='sv')
+        d['fstype'] = self._fs_name
+        mnt_path = disk.Mount(d, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.addCleanup(self._unmount, self.vdevs[0])
+
+        # no subscribers, no samples
+        self.get_property(disk, '.Filesystem', 'UsageUpdated').assertEqual(0)
+
+        # invalid thresholds
+        d = dbus.Dictionary(signature='sv')
+        d['thresholds'] = dbus.Array([1.5], signature='d')
+        msg = 'Invalid threshold'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            disk.SubscribeUsage(d, dbus_interface=self.iface_prefix + '.Filesystem')
+
+        d['thresholds'] = dbus.Array([0.9], signature='d')
+        disk.SubscribeUsage(d, dbus_interface=self.iface_prefix + '.Filesystem')
+
+        # the first sample is taken right away
+        self.get_property(disk, '.Filesystem', 'UsageUpdated').assertGreater(0)
+        self.get_property(disk, '.Filesystem', 'Free').assertGreater(0)
+        st = os.statvfs(mnt_path)
+        free = self.get_property_raw(disk, '.Filesystem', 'Free')
+        self.assertAlmostEqual(free, st.f_bavail * st.f_frsize, delta=16 * 1024 * 1024)
+
+        # the properties are reset once the last subscriber is gone
+        disk.UnsubscribeUsage(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        self.get_property(disk, '.Filesystem', 'UsageUpdated').assertEqual(0)
+        self.get_property(disk, '.Filesystem', 'Free').assertEqual(0)
+
     def test_mount_auto(self):
         if not self._can_create:
             self.skipTest('Cannot create %s filesystem' % self._fs_name)
@@ -257,6 +316,118 @@ class UdisksFSTestCase(udiskstestcase.UdisksTestCase):
         disk.Unmount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
         self.assertFalse(os.path.ismount(mnt_path))
 
+    def test_mount_many(self):
+        if not self._can_create:
+            self.skipTest('Cannot create %s filesystem' % self._fs_name)
+
+        if not self._can_mount:
+            self.skipTest('Cannot mount %s filesystem' % self._fs_name)
+
+        manager = self.get_interface('/Manager', '.Manager')
+        disks = []
+        for vdev in self.vdevs[:2]:
+            disk = self.get_object('/block_devices/' + os.path.basename(vdev))
+            self.assertIsNotNone(disk)
+            disk.Format(self._fs_name, self.no_options, dbus_interface=self.iface_prefix + '.Block')
+            self.addCleanup(self._clean_format, vdev)
+            self.addCleanup(self._unmount, vdev)
+            disks.append(disk)
+
+        d = dbus.Dictionary(signature='sv')
+        d['fstype'] = self._fs_name
+        filesystems = [(disk.object_path, d) for disk in disks]
+        missing = (self.missing_object_path(), d)
+
+        # the first filesystem is mounted already, that doesn't stop the second one
+        disks[0].Mount(self.no_options, dbus_interface=self.iface_prefix + '.Filesystem')
+        options = dbus.Dictionary({'max-parallel': dbus.UInt32(2)}, signature='sv')
+        results = self.call_bulk(manager.MountFilesystems, filesystems, missing, '(oa{sv})', options)
+        self.assertEqual(results[0][1], '')
+        self.assertEqual(results[0][2], 'org.freedesktop.UDisks2.Error.AlreadyMounted')
+        (_path, mnt_path, error_name, error_message) = results[1]
+        self.assertEqual(error_name, '')
+        self.assertEqual(error_message, '')
+        self.assertTrue(os.path.ismount(mnt_path))
+
+        # the mount path is the one Filesystem.Mount() would have returned
+        dbus_mounts = self.get_property(disks[1], '.Filesystem', 'MountPoints')
+        dbus_mounts.assertLen(1)
+        self.assertEqual(self.ay_to_str(dbus_mounts.value[0]), mnt_path)
+
+        results = self.call_bulk(manager.UnmountFilesystems, filesystems, missing, '(oa{sv})')
+        self.assertEqual([r[1:] for r in results], [('', ''), ('', '')])
+        for vdev in self.vdevs[:2]:
+            _ret, out = self.run_command('mount | grep %s' % vdev)
+            self.assertEqual(out, '')
+
+        # each of them fails on its own now
+        results = manager.UnmountFilesystems(dbus.Array(filesystems, signature='(oa{sv})'), self.no_options)
+        self.assertEqual([r[1] for r in results], ['org.freedesktop.UDisks2.Error.NotMounted'] * 2)
+
+    def test_format_many(self):
+        if not self._can_create:
+            self.skipTest('Cannot create %s filesystem' % self._fs_name)
+
+        manager = self.get_interface('/Manager', '.Manager')
+        disks = []
+        for vdev in self.vdevs[:2]:
+            disk = self.get_object('/block_devices/' + os.path.basename(vdev))
+            self.assertIsNotNone(disk)
+            self.addCleanup(self._clean_format, vdev)
+            disks.append(disk)
+
+        # an unknown type only fails its own device
+        devices = [(disks[0].object_path, 'i_dont_exist', self.no_options),
+                   (disks[1].object_path, self._fs_name, self.no_options)]
+        missing = (self.missing_object_path(), self._fs_name, self.no_options)
+        results = self.call_bulk(manager.FormatDevices, devices, missing, '(osa{sv})')
+        self.assertEqual(results[0][1], 'org.freedesktop.UDisks2.Error.NotSupported')
+        self.assertEqual(results[1][1:], ('', ''))
+
+        fstype = self.get_property(disks[1], '.Block', 'IdType')
+        fstype.assertEqual(self._fs_name)
+        _ret, sys_fstype = self.run_command('lsblk -d -no FSTYPE %s' % self.vdevs[1])
+        self.assertEqual(sys_fstype, self._fs_name)
+
+    @unstable_test
+    def test_format_many_job(self):
+        if not self._can_create:
+            self.skipTest('Cannot create %s filesystem' % self._fs_name)
+
+        udisks = self.get_object('')
+        paths = []
+        for vdev in self.vdevs[:2]:
+            self.addCleanup(self._clean_format, vdev)
+            paths.append(self.path_prefix + '/block_devices/' + os.path.basename(vdev))
+
+        # call from another thread and connection to look at the job meanwhile
+        results = []
+        def format_devices():
+            ret = safe_dbus.call_sync(self.iface_prefix,
+                                      self.path_prefix + '/Manager',
+                                      self.iface_prefix + '.Manager',
+                                      'FormatDevices',
+                                      GLib.Variant('(a(osa{sv})a{sv})',
+                                                   ([(path, self._fs_name, {}) for path in paths], {})))
+            results.extend(ret[0])
+        thread = threading.Thread(target=format_devices)
+        thread.start()
+
+        # a single format-mkfs job reports the progress of all the devices
+        job_objects = None
+        while job_objects is None and thread.is_alive():
+            objects = udisks.GetManagedObjects(dbus_interface='org.freedesktop.DBus.ObjectManager')
+            for ifaces in objects.values():
+                job = ifaces.get(self.iface_prefix + '.Job')
+                if job is not None and job['Operation'] == 'format-mkfs' and len(job['Objects']) == len(paths):
+                    job_objects = job['Objects']
+            time.sleep(0.01)
+        thread.join()
+
+        self.assertIsNotNone(job_objects)
+        self.assertEqual(sorted(job_objects), sorted(paths))
+        self.assertEqual([r[1:] for r in results], [('', ''), ('', '')])
+
     def test_mount_fstab(self):
         if not self._can_create:
             self.skipTest('Cannot create %s filesystem' % self._fs_name)
@@ -577,6 +748,28 @@ class VFATTestCase(UdisksFSTestCase):
         pipe.close()
         return
 
+    def _mount_many_as_user(self, pipe, uid, gid, devices):
+        """ Try to mount all of @devices in one call as user with given @uid
+            and @gid and send the results.
+        """
+        os.setresgid(gid, gid, gid)
+        os.setresuid(uid, uid, uid)
+
+        paths = [self.path_prefix + '/block_devices/' + os.path.basename(device) for device in devices]
+        try:
+            ret = safe_dbus.call_sync(self.iface_prefix,
+                                      self.path_prefix + '/Manager',
+                                      self.iface_prefix + '.Manager',
+                                      'MountFilesystems',
+                                      GLib.Variant('(a(oa{sv})a{sv})', ([(path, {}) for path in paths], {})))
+        except Exception as e:
+            pipe.send([False, 'MountFilesystems DBus call failed: %s' % str(e)])
+            pipe.close()
+            return
+
+        pipe.send([True, ret[0]])
+        pipe.close()
+
     def _mount_as_user_fstab_fail(self, pipe, uid, gid, device):
         """ Try to mount @device as user with given @uid and @gid.
             @device shouldn't be listed in /etc/fstab when running this, so
@@ -687,6 +880,50 @@ class VFATTestCase(UdisksFSTestCase):
         if not res[0]:
             self.fail(res[1])
 
+    @unittest.skipUnless("JENKINS_HOME" in os.environ, "skipping test that modifies system configuration")
+    def test_mount_many_user(self):
+        if not self._can_create:
+            self.skipTest('Cannot create %s filesystem' % self._fs_name)
+
+        if not self._can_mount:
+            self.skipTest('Cannot mount %s filesystem' % self._fs_name)
+
+        # this test will change /etc/fstab, we might want to revert the changes after it finishes
+        fstab = self.read_file('/etc/fstab')
+        self.addCleanup(self.write_file, '/etc/fstab', fstab)
+
+        for vdev in self.vdevs[:2]:
+            disk = self.get_object('/block_devices/' + os.path.basename(vdev))
+            self.assertIsNotNone(disk)
+            disk.Format(self._fs_name, self.no_options, dbus_interface=self.iface_prefix + '.Block')
+            self.addCleanup(self._clean_format, vdev)
+            self.addCleanup(self._unmount, vdev)
+
+        self.addCleanup(self._remove_user, self.username)
+        uid, gid = self._add_user(self.username)
+
+        # only the first disk may be mounted by the user
+        self._set_user_mountable(self.get_object('/block_devices/' + os.path.basename(self.vdevs[0])))
+
+        parent_conn, child_conn = Pipe()
+        proc = Process(target=self._mount_many_as_user, args=(child_conn, int(uid), int(gid), self.vdevs[:2]))
+        proc.start()
+        res = parent_conn.recv()
+        parent_conn.close()
+        proc.join()
+
+        if not res[0]:
+            self.fail(res[1])
+
+        # the denied authorization only fails the second disk
+        results = res[1]
+        self.assertEqual(results[0][2], '')
+        self.assertTrue(os.path.ismount(results[0][1]))
+        self.assertEqual(results[1][1], '')
+        self.assertEqual(results[1][2], 'org.freedesktop.UDisks2.Error.NotAuthorizedCanObtain')
+        _ret, out = self.run_command('mount | grep %s' % self.vdevs[1])
+        self.assertEqual(out, '')
+
     @unittest.skipUnless("JENKINS_HOME" in os.environ, "skipping test that modifies system configuration")
     def test_mount_fstab_user_fail(self):
         if not self._can_create:
@@ -916,6 +1153,9 @@ class FailsystemTestCase(UdisksFSTestCase):
     def test_size(self):
         pass
 
+    def test_usage(self):
+        pass
+
 class UdisksISO9660TestCase(udiskstestcase.UdisksTestCase):
     def _unmount(self, disk_path):
         self.run_command('umount %s' % disk_path)
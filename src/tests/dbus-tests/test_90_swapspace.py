@@ -2,6 +2,7 @@
 
 import os
 import dbus
+import six
 import udiskstestcase
 from udiskstestcase import unstable_test
 
@@ -74,3 +75,47 @@ class UdisksSwapSpaceTest(udiskstestcase.UdisksTestCase):
 
         _ret, out = self.run_command('lsblk -noLABEL %s' % self.dev)
         self.assertEqual('udisks_swap', out.strip())
+
+    def test_40_start_options(self):
+        self.device.Format('swap', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+
+        # invalid priority and discard policy
+        msg = 'org.freedesktop.UDisks2.Error.OptionNotPermitted'
+        for options in ({'priority': dbus.Int32(-2)}, {'discard': 'always'}):
+            d = dbus.Dictionary(options, signature='sv')
+            with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+                self.device.Start(d, dbus_interface=self.iface_prefix + '.Swapspace')
+
+        d = dbus.Dictionary({'priority': dbus.Int32(42), 'discard': 'once'}, signature='sv')
+        self.device.Start(d, dbus_interface=self.iface_prefix + '.Swapspace')
+        active = self.get_property(self.device, '.Swapspace', 'Active')
+        active.assertTrue()
+
+        _ret, out = self.run_command('swapon --show=NAME,PRIO --noheadings')
+        self.assertIn('%s 42' % self.dev, ' '.join(out.split()))
+
+    def _clean_swap(self, dev):
+        self.run_command('swapoff %s' % dev)
+        self.run_command('wipefs -a %s' % dev)
+
+    def test_50_start_many(self):
+        self.device.Format('swap', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        other = self.get_device(self.vdevs[1])
+        other.Format('swap', self.no_options, dbus_interface=self.iface_prefix + '.Block')
+        self.addCleanup(self._clean_swap, self.vdevs[1])
+
+        # the other swap space is active already, that doesn't stop the following one
+        other.Start(self.no_options, dbus_interface=self.iface_prefix + '.Swapspace')
+        manager = self.get_interface('/Manager', '.Manager')
+        d = dbus.Dictionary({'priority': dbus.Int32(7)}, signature='sv')
+        swapspaces = [(other.object_path, self.no_options), (self.device.object_path, d)]
+        results = self.call_bulk(manager.StartSwapspaces, swapspaces,
+                                 (self.missing_object_path(), self.no_options), '(oa{sv})',
+                                 ordered=True)
+        self.assertNotEqual(results[0][1], '')
+        self.assertEqual(results[1][1:], ('', ''))
+
+        active = self.get_property(self.device, '.Swapspace', 'Active')
+        active.assertTrue()
+        _ret, out = self.run_command('swapon --show=NAME,PRIO --noheadings')
+        self.assertIn('%s 7' % self.dev, ' '.join(out.split()))
@@ -1,5 +1,7 @@
+import dbus
 import os
 import re
+import six
 import time
 import unittest
 
@@ -122,6 +124,20 @@ class UdisksBcacheTest(udiskstestcase.UdisksTestCase):
         dbus_bymisses = self.get_property(bcache, '.Block.Bcache', 'BypassMisses')
         dbus_bymisses.assertEqual(int(sys_bymisses))
 
+        # read through the cache, the counters are sampled without uevents
+        self.run_command('dd if=/dev/%s of=/dev/null bs=1M count=4 iflag=direct' % bcache_name)
+        sys_hits = int(self.read_file('/sys/block/%s/bcache/cache/stats_total' \
+                                      '/cache_hits' % bcache_name))
+        sys_misses = int(self.read_file('/sys/block/%s/bcache/cache/stats_total' \
+                                        '/cache_misses' % bcache_name))
+        dbus_misses = self.get_property(bcache, '.Block.Bcache', 'Misses')
+        dbus_misses.assertEqual(sys_misses, timeout=15)
+        dbus_ratio = self.get_property(bcache, '.Block.Bcache', 'HitRatio')
+        if sys_hits + sys_misses > 0:
+            dbus_ratio.assertAlmostEqual(sys_hits / (sys_hits + sys_misses), delta=0.01)
+        else:
+            dbus_ratio.assertEqual(0)
+
         # destroy the cache
         bcache.BcacheDestroy(self.no_options, dbus_interface=self.iface_prefix + '.Block.Bcache')
 
@@ -157,3 +173,49 @@ class UdisksBcacheTest(udiskstestcase.UdisksTestCase):
 
         sys_mode = self._get_mode(bcache_name)
         self.assertEqual(sys_mode, 'writeback')
+
+    def test_set_tuning(self):
+        '''Test changing the tuning of an existing bcache'''
+
+        manager = self.get_object('/Manager')
+        try:
+            bcache_path = manager.BcacheCreate(self._obj_path_from_path(self.vdevs[0]),
+                                               self._obj_path_from_path(self.vdevs[1]), self.no_options,
+                                               dbus_interface=self.iface_prefix + '.Manager.Bcache')
+        except Exception as e:
+            self._handle_create_fail(self.vdevs[0], self.vdevs[1])
+            raise e
+
+        self.assertIsNotNone(bcache_path)
+        bcache_name = bcache_path.split('/')[-1]
+        self.addCleanup(self._force_remove, bcache_name, self.vdevs[0], self.vdevs[1])
+
+        bcache = self.get_object('/block_devices/' + bcache_name)
+        settings = dbus.Dictionary({'sequential-cutoff': dbus.UInt32(8 * 1024**2),
+                                    'writeback-percent': dbus.UInt32(20),
+                                    'congested-read-threshold-us': dbus.UInt32(4000)},
+                                   signature='sv')
+        bcache.SetTuning(settings, self.no_options,
+                         dbus_interface=self.iface_prefix + '.Block.Bcache')
+
+        dbus_cutoff = self.get_property(bcache, '.Block.Bcache', 'SequentialCutoff')
+        dbus_cutoff.assertEqual(8 * 1024**2)
+        dbus_percent = self.get_property(bcache, '.Block.Bcache', 'WritebackPercent')
+        dbus_percent.assertEqual(20)
+        dbus_threshold = self.get_property(bcache, '.Block.Bcache', 'CongestedReadThresholdUs')
+        dbus_threshold.assertEqual(4000)
+
+        sys_percent = self.read_file('/sys/block/%s/bcache/writeback_percent' % bcache_name).strip()
+        self.assertEqual(int(sys_percent), 20)
+        sys_threshold = self.read_file('/sys/block/%s/bcache/cache/congested_read_threshold_us' % bcache_name).strip()
+        self.assertEqual(int(sys_threshold), 4000)
+
+        # the dirty data is reported
+        dbus_dirty = self.get_property(bcache, '.Block.Bcache', 'DirtyData')
+        self.assertGreaterEqual(dbus_dirty.value, 0)
+
+        # unknown settings are rejected
+        msg = r'Unknown bcache setting'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            bcache.SetTuning(dbus.Dictionary({'cache-mode': 'writeback'}, signature='sv'), self.no_options,
+                             dbus_interface=self.iface_prefix + '.Block.Bcache')
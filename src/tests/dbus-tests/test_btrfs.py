@@ -1,4 +1,5 @@
 import dbus
+import os
 import six
 import shutil
 import re
@@ -10,6 +11,10 @@ from collections import namedtuple
 from contextlib import contextmanager
 from distutils.version import LooseVersion
 
+import gi
+gi.require_version('GLib', '2.0')
+from gi.repository import GLib
+
 import udiskstestcase
 from udiskstestcase import unstable_test
 
@@ -206,6 +211,66 @@ class UdisksBtrfsTest(udiskstestcase.UdisksTestCase):
                                                dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
             self.assertEqual(num, 0)
 
+    def test_subvolumes_filters(self):
+        dev = self._get_devices(1)[0]
+        self.addCleanup(self._clean_format, dev.obj)
+
+        manager = self.get_object('/Manager')
+        manager.CreateVolume([dev.obj_path],
+                             'test_subvols', 'single', 'single',
+                             self.no_options,
+                             dbus_interface=self.iface_prefix + '.Manager.BTRFS')
+        self.write_file("/sys/block/%s/uevent" % dev.name, "change\n")
+
+        fstype = self.get_property(dev.obj, '.Block', 'IdType')
+        fstype.assertEqual('btrfs')
+
+        with self._temp_mount(dev.path) as mnt:
+            for name in ('test_sub1', 'test_sub2', 'test_sub1/nested'):
+                dev.obj.CreateSubvolume(name, self.no_options,
+                                        dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
+
+            subs, num = dev.obj.GetSubvolumes(False, self.no_options,
+                                              dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
+            self.assertEqual(num, 3)
+            self.assertEqual(sorted(s[2] for s in subs), ['test_sub1', 'test_sub1/nested', 'test_sub2'])
+            ids = {s[2]: s[0] for s in subs}
+
+            # only the subvolumes below test_sub1
+            opts = dbus.Dictionary({'parent_id': dbus.UInt64(ids['test_sub1'])}, signature='sv')
+            subs, num = dev.obj.GetSubvolumes(False, opts,
+                                              dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
+            self.assertEqual(num, 1)
+            self.assertEqual(subs[0][2], 'test_sub1/nested')
+
+            # page through the subvolumes one by one
+            listed = []
+            start = 0
+            while True:
+                opts = dbus.Dictionary({'start_id': dbus.UInt64(start), 'limit': dbus.UInt32(1)},
+                                       signature='sv')
+                subs, num = dev.obj.GetSubvolumes(False, opts,
+                                                  dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
+                if num == 0:
+                    break
+                self.assertEqual(num, 1)
+                listed.append(str(subs[0][2]))
+                start = subs[0][0] + 1
+            self.assertEqual(sorted(listed), ['test_sub1', 'test_sub1/nested', 'test_sub2'])
+
+            # the same list passed in a sealed memory file
+            fd, num = dev.obj.GetSubvolumesFD(False, self.no_options,
+                                              dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
+            self.assertEqual(num, 3)
+            with os.fdopen(fd.take(), 'rb') as f:
+                data = f.read()
+            subs = GLib.Variant.new_from_bytes(GLib.VariantType.new('a(tts)'), GLib.Bytes.new(data), False)
+            self.assertEqual(sorted(s[2] for s in subs.unpack()), ['test_sub1', 'test_sub1/nested', 'test_sub2'])
+
+            for name in ('test_sub1/nested', 'test_sub2', 'test_sub1'):
+                dev.obj.RemoveSubvolume(name, self.no_options,
+                                        dbus_interface=self.iface_prefix + '.Filesystem.BTRFS')
+
     def test_add_remove_device(self):
         dev1, dev2 = self._get_devices(2)
         self.addCleanup(self._clean_format, dev1.obj)
@@ -25,13 +25,16 @@ class UdisksJobTest(udiskstestcase.UdisksTestCase):
                                       None)
         return objects
 
-    def _secure_erase(self, devname):
+    def _secure_erase(self, devname, extra_options=None):
+        options = {'erase': GLib.Variant("s", 'zero')}
+        if extra_options:
+            options.update(extra_options)
         try:
             safe_dbus.call_sync(self.iface_prefix,
                                 self.path_prefix + '/block_devices/' + devname,
                                 self.iface_prefix + '.Block',
                                 'Format',
-                                GLib.Variant('(sa{sv})', ('empty', {'erase': GLib.Variant("s", 'zero')})))
+                                GLib.Variant('(sa{sv})', ('empty', options)))
         except Exception as e:
             self.exception = e
 
@@ -145,3 +148,38 @@ class UdisksJobTest(udiskstestcase.UdisksTestCase):
         self.assertIsNotNone(self.exception)
         self.assertTrue(isinstance(self.exception, safe_dbus.DBusCallError))
         self.assertIn('Error erasing device: Job was canceled', str(self.exception))
+
+    def test_rate_limit(self):
+        '''Test that the erase bandwidth limit is applied and reported'''
+
+        disk_name = os.path.basename(self.vdevs[0])
+        obj_path = self.path_prefix + '/block_devices/' + disk_name
+        limit = 1024**2
+
+        watch_thread = threading.Thread(target=self._wait_for_job_thread, args=('format-erase', obj_path))
+        watch_thread.start()
+
+        erase_thread = threading.Thread(target=self._secure_erase,
+                                        args=(disk_name, {'erase.max-bandwidth': GLib.Variant('t', limit)}))
+        erase_thread.start()
+
+        watch_thread.join(timeout=10)
+        if not self.job:
+            watch_thread.run = False
+            if self.exception:
+                raise self.exception
+            else:
+                self.fail('Failed to find the job objects.')
+
+        properties = self.job[1][self.iface_prefix + '.Job']
+        self.assertEqual(properties['RateLimit'], limit)
+
+        # erasing the whole device at 1 MiB/s would take too long
+        safe_dbus.call_sync(self.iface_prefix,
+                            self.job[0],
+                            self.iface_prefix + '.Job',
+                            'Cancel',
+                            GLib.Variant('(a{sv})', ({},)))
+        erase_thread.join()
+        self.assertIsNotNone(self.exception)
+        self.assertIn('Error erasing device: Job was canceled', str(self.exception))
@@ -238,3 +238,26 @@ class UdisksManagerLoopDeviceTest(udiskstestcase.UdisksTestCase):
 
         # partitions should be scanned
         self.assertTrue(os.path.exists("/dev/%sp1" % loop_dev))
+
+    def test_60_create_direct_io(self):
+        opts = dbus.Dictionary({"direct-io": dbus.Boolean(True)}, signature=dbus.Signature('sv'))
+        loop_devs = []
+        # two devices set up right after each other have to be different ones
+        for _i in range(2):
+            with open(self.LOOP_DEVICE_FILENAME, "r+b") as loop_file:
+                fd = loop_file.fileno()
+                loop_dev_obj_path = self.manager.LoopSetup(fd, opts)
+            self.assertTrue(loop_dev_obj_path)
+            path, loop_dev = loop_dev_obj_path.rsplit("/", 1)
+            self.addCleanup(self.run_command, "losetup -d /dev/%s" % loop_dev)
+            loop_devs.append(loop_dev)
+
+            loop_dev_obj = self.get_object(loop_dev_obj_path)
+            raw = self.get_property(loop_dev_obj, '.Loop', 'BackingFile')
+            backing_file = self.str_to_ay(os.path.join(os.getcwd(), self.LOOP_DEVICE_FILENAME))
+            raw.assertEqual(backing_file)
+
+            size = self.get_property(loop_dev_obj, ".Block", "Size")
+            size.assertEqual(10 * 1024**2)
+
+        self.assertNotEqual(loop_devs[0], loop_devs[1])
@@ -1,5 +1,6 @@
 import dbus
 import os
+import six
 import time
 
 from collections import namedtuple
@@ -378,6 +379,64 @@ class RAID1TestCase(RAIDLevel):
         sys_bitmap = self.read_file('/sys/block/%s/md/bitmap/location' % md_name).strip()
         dbus_bitmap.assertEqual(self.str_to_ay(sys_bitmap))
 
+    @unstable_test
+    def test_create_bitmap_assume_clean(self):
+        array_name = 'udisks_test_clean'
+        self.addCleanup(self._force_remove, array_name, [m.path for m in self.members])
+
+        manager = self.get_object('/Manager')
+        d = dbus.Dictionary({'bitmap-chunk': dbus.UInt64(64 * 1024 * 1024),
+                             'assume-clean': True}, signature='sv')
+        array_path = manager.MDRaidCreate(dbus.Array(m.obj for m in self.members),
+                                          self.level, array_name, self.chunk_size, d,
+                                          dbus_interface=self.iface_prefix + '.Manager')
+        self.assertIsNotNone(self.bus.get_object(self.iface_prefix, array_path))
+
+        # no initial resync and an internal bitmap with the requested chunk
+        md_name = os.path.realpath('/dev/md/%s' % array_name).split('/')[-1]
+        sync_action = self.read_file('/sys/block/%s/md/sync_action' % md_name).strip()
+        self.assertEqual(sync_action, 'idle')
+        bitmap_chunk = self.read_file('/sys/block/%s/md/bitmap/chunksize' % md_name).strip()
+        self.assertEqual(int(bitmap_chunk), 64 * 1024 * 1024)
+
+        # bitmap chunk has to be a power of 2
+        d = dbus.Dictionary({'bitmap-chunk': dbus.UInt64(3 * 4096)}, signature='sv')
+        msg = 'org.freedesktop.UDisks2.Error.OptionNotPermitted'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            manager.MDRaidCreate(dbus.Array(m.obj for m in self.members),
+                                 self.level, 'udisks_test_bad', self.chunk_size, d,
+                                 dbus_interface=self.iface_prefix + '.Manager')
+
+    @unstable_test
+    def test_sync_speed(self):
+        array_name = 'udisks_test_speed'
+        array = self._array_create(array_name)
+        md_name = os.path.realpath('/dev/md/%s' % array_name).split('/')[-1]
+
+        array.SetSyncSpeed(dbus.UInt64(2048 * 1024), dbus.UInt64(4096 * 1024), self.no_options,
+                           dbus_interface=self.iface_prefix + '.MDRaid')
+        sys_min = self.read_file('/sys/block/%s/md/sync_speed_min' % md_name)
+        sys_max = self.read_file('/sys/block/%s/md/sync_speed_max' % md_name)
+        self.assertTrue(sys_min.startswith('2048 (local)'))
+        self.assertTrue(sys_max.startswith('4096 (local)'))
+        self.get_property(array, '.MDRaid', 'SyncSpeedMin').assertEqual(2048 * 1024)
+        self.get_property(array, '.MDRaid', 'SyncSpeedMax').assertEqual(4096 * 1024)
+        self.get_property(array, '.MDRaid', 'SyncSpeedAdaptive').assertFalse()
+
+        # minimum above the maximum
+        msg = 'org.freedesktop.UDisks2.Error.OptionNotPermitted'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            array.SetSyncSpeed(dbus.UInt64(8192 * 1024), dbus.UInt64(4096 * 1024), self.no_options,
+                               dbus_interface=self.iface_prefix + '.MDRaid')
+
+        # back to the system defaults, adaptively
+        d = dbus.Dictionary({'adaptive': True}, signature='sv')
+        array.SetSyncSpeed(dbus.UInt64(0), dbus.UInt64(0), d,
+                           dbus_interface=self.iface_prefix + '.MDRaid')
+        sys_min = self.read_file('/sys/block/%s/md/sync_speed_min' % md_name)
+        self.assertIn('(system)', sys_min)
+        self.get_property(array, '.MDRaid', 'SyncSpeedAdaptive').assertTrue()
+
     @unstable_test
     def test_request_action(self):
 
@@ -146,6 +146,13 @@ class UdisksVDOTest(udiskstestcase.UdisksTestCase):
         self.assertIsNotNone(stats)
         self.assertGreater(len(stats), 0)
         self.assertIn("block_size", stats)
+        self.assertIn("snapshot_age_msec", stats)
+
+        # the cached snapshot is returned, a refresh gives rates between the two last snapshots
+        opts = dbus.Dictionary({'refresh': dbus.Boolean(True), 'rates': dbus.Boolean(True)}, signature='sv')
+        stats = vdo.GetStatistics(opts, dbus_interface=self.iface_prefix + '.Block.VDO')
+        self.assertIn("block_size", stats)
+        self.assertIn("data_blocks_used_per_second", stats)
 
         # destroy the volume
         vdo.Remove(False, self.no_options, dbus_interface=self.iface_prefix + '.Block.VDO')
@@ -1,4 +1,6 @@
+import dbus
 import os
+import six
 import re
 import time
 import unittest
@@ -116,6 +118,45 @@ class UdisksZRAMTest(udiskstestcase.UdisksTestCase):
         zrams = self._get_zrams()
         self.assertEqual(len(zrams), 0)
 
+    @unstable_test
+    def test_add_remove(self):
+        manager = self.get_object('/Manager')
+        opts = dbus.Dictionary({'algorithm': 'lzo', 'activate': True}, signature='sv')
+        try:
+            zram_path = manager.AddDevice(dbus.UInt64(10 * 1024**2), dbus.UInt64(1), opts,
+                                          dbus_interface=self.iface_prefix + '.Manager.ZRAM')
+        except dbus.exceptions.DBusException as e:
+            if 'NotSupported' in e.get_dbus_name():
+                self.skipTest('Adding zram devices dynamically is not supported')
+            raise
+
+        zram_name = zram_path.split('/')[-1]
+        self.addCleanup(self.run_command, 'echo %s > /sys/class/zram-control/hot_remove' % zram_name[4:])
+        self.addCleanup(self._swapoff, '/dev/%s' % zram_name)
+
+        # set up directly, no configuration files
+        self.assertEqual(int(self.read_file('/sys/block/%s/disksize' % zram_name)), 10 * 1024**2)
+        self.assertEqual(self._get_algorithm(zram_name), 'lzo')
+        self.assertFalse(os.path.exists(ZRAMCONFDIR + '/' + zram_name))
+        _ret, out = self.run_command('swapon --show=NAME --noheadings')
+        self.assertIn('/dev/%s' % zram_name, out.split())
+
+        zram = self.bus.get_object(self.iface_prefix, zram_path)
+        dbus_size = self.get_property(zram, '.Block.ZRAM', 'Disksize')
+        dbus_size.assertEqual(10 * 1024**2)
+
+        # active swap can't be removed
+        msg = r'org.freedesktop.UDisks2.Error.DeviceBusy'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            manager.RemoveDevice(zram_path, self.no_options,
+                                 dbus_interface=self.iface_prefix + '.Manager.ZRAM')
+
+        self._swapoff('/dev/%s' % zram_name)
+        manager.RemoveDevice(zram_path, self.no_options,
+                             dbus_interface=self.iface_prefix + '.Manager.ZRAM')
+        self.assertFalse(os.path.exists('/sys/block/%s' % zram_name))
+        self.assertNotIn(zram_path, self._get_zrams())
+
     def _test_zram_properties_fedora(self, zram_obj, zram_name):
         # test some properties
         sys_stat = self.read_file('/sys/block/%s/stat' % zram_name).strip().split()
@@ -220,3 +261,35 @@ class UdisksZRAMTest(udiskstestcase.UdisksTestCase):
                                dbus_interface=self.iface_prefix + '.Manager.ZRAM')
         zrams = self._get_zrams()
         self.assertEqual(len(zrams), 0)
+
+    @unstable_test
+    def test_subscribe(self):
+        manager = self.get_object('/Manager')
+        zrams = manager.CreateDevices([10 * 1024**2], [1], self.no_options,
+                                      dbus_interface=self.iface_prefix + '.Manager.ZRAM')
+        self.assertEqual(len(zrams), 1)
+        self.addCleanup(manager.DestroyDevices, self.no_options,
+                        dbus_interface=self.iface_prefix + '.Manager.ZRAM')
+
+        zram = self.bus.get_object(self.iface_prefix, zrams[0])
+        zram_name = zrams[0].split('/')[-1]
+
+        # too short interval
+        opts = dbus.Dictionary({'interval': dbus.UInt32(10)}, signature='sv')
+        msg = r'The sampling interval must be at least'
+        with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+            zram.Subscribe(opts, dbus_interface=self.iface_prefix + '.Block.ZRAM')
+
+        opts = dbus.Dictionary({'interval': dbus.UInt32(200)}, signature='sv')
+        zram.Subscribe(opts, dbus_interface=self.iface_prefix + '.Block.ZRAM')
+        self.addCleanup(zram.Unsubscribe, self.no_options, dbus_interface=self.iface_prefix + '.Block.ZRAM')
+
+        # store some data, the sizes should get updated without Refresh()
+        self.run_command('dd if=/dev/urandom of=/dev/%s bs=1M count=2 oflag=direct' % zram_name)
+        sys_orig = int(self.read_file('/sys/block/%s/mm_stat' % zram_name).split()[0])
+        self.assertGreater(sys_orig, 0)
+
+        dbus_orig = self.get_property(zram, '.Block.ZRAM', 'OrigDataSize')
+        dbus_orig.assertEqual(sys_orig)
+        dbus_ratio = self.get_property(zram, '.Block.ZRAM', 'CompressionRatio')
+        dbus_ratio.assertGreater(0)
@@ -6,6 +6,7 @@ import subprocess
 import os
 import time
 import re
+import six
 import sys
 from datetime import datetime
 from systemd import journal
@@ -495,6 +496,51 @@ class UdisksTestCase(unittest.TestCase):
         if not val.startswith(prefix):
             raise AssertionError("'%s' does not start with '%s'" % (val, prefix))
 
+    @classmethod
+    def missing_object_path(self, kind='block_devices'):
+        """Get the path of an object of the given kind (e.g. "drives") that doesn't exist"""
+        return '%s/%s/i_dont_exist' % (self.path_prefix, kind)
+
+    def call_bulk(self, method, entries, missing_entry, signature, options=None, ordered=False):
+        """Call a Manager method acting on many objects at once (e.g. MountFilesystems)
+
+        Checks what all these methods have in common and returns the results
+        of *entries* for the checks specific to the method.
+
+        :param method: the method to call
+        :param entries: the entries of existing objects, object paths or tuples starting with one
+        :param missing_entry: an entry for an object that doesn't exist
+        :param str signature: the signature of an entry
+        :param options: the options of the call
+        :param bool ordered: whether the method has no max-parallel option
+
+        """
+        def path(entry):
+            return entry if isinstance(entry, str) else entry[0]
+
+        if options is None:
+            options = self.no_options
+
+        # the missing object fails and an object listed twice is only processed once
+        all_entries = dbus.Array(list(entries) + [missing_entry, entries[0]], signature=signature)
+
+        if not ordered:
+            width = dbus.Dictionary(options, signature='sv')
+            width['max-parallel'] = dbus.UInt32(0)
+            msg = 'org.freedesktop.UDisks2.Error.OptionNotPermitted'
+            with six.assertRaisesRegex(self, dbus.exceptions.DBusException, msg):
+                method(all_entries, width)
+
+        results = method(all_entries, options)
+
+        # one result per entry, in the same order, the error name and message come last
+        self.assertEqual([r[0] for r in results], [path(e) for e in all_entries])
+        self.assertEqual(results[-2][-2], 'org.freedesktop.UDisks2.Error.Failed')
+        self.assertEqual(results[-1][-2], 'org.freedesktop.UDisks2.Error.OptionNotPermitted')
+        self.assertIn('listed more than once', results[-1][-1])
+
+        return results[:len(entries)]
+
 
 class FlightRecorder(object):
     """Context manager for recording data/logs
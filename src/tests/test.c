@@ -20,16 +20,23 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 #include <string.h>
 
+#include <glib/gstdio.h>
+
 #include <udisksdaemontypes.h>
 #include <udisksdaemon.h>
 #include <udisksspawnedjob.h>
 #include <udisksthreadedjob.h>
+#include <udisksata.h>
+#include <udiskssuperblock.h>
+#include <udisksdaemonutil.h>
 
 #include "testutil.h"
 
@@ -380,6 +387,96 @@ test_spawned_job_binary_output (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+output_limit_on_spawned_job_completed (UDisksSpawnedJob *job,
+                                       GError           *error,
+                                       gint              status,
+                                       GString          *standard_output,
+                                       GString          *standard_error,
+                                       gpointer          user_data)
+{
+  const gchar *marker = "\n[... 100 bytes omitted ...]\n";
+  gsize marker_len = strlen (marker);
+  guint n;
+
+  g_assert_no_error (error);
+  g_assert_cmpstr (standard_error->str, ==, "");
+  g_assert (WIFEXITED (status));
+  g_assert (WEXITSTATUS (status) == 0);
+
+  /* the first and the last 50 of the 200 bytes are kept */
+  g_assert_cmpint (standard_output->len, ==, 100 + marker_len);
+  for (n = 0; n < 25; n++)
+    {
+      g_assert_cmpint (standard_output->str[n*2+0], ==, n);
+      g_assert_cmpint (standard_output->str[n*2+1], ==, 0);
+    }
+  g_assert (memcmp (standard_output->str + 50, marker, marker_len) == 0);
+  for (n = 0; n < 25; n++)
+    {
+      g_assert_cmpint (standard_output->str[50 + marker_len + n*2+0], ==, 75 + n);
+      g_assert_cmpint (standard_output->str[50 + marker_len + n*2+1], ==, 0);
+    }
+  return FALSE;
+}
+
+static void
+test_spawned_job_output_limit (void)
+{
+  UDisksSpawnedJob *job;
+  gchar *s;
+
+  s = g_strdup_printf (UDISKS_TEST_DIR "/udisks-test-helper 6");
+  job = udisks_spawned_job_new (s, NULL, getuid (), geteuid (), NULL, NULL);
+  udisks_spawned_job_set_output_limit (job, 100);
+  udisks_spawned_job_start (job);
+  _g_assert_signal_received (job, "spawned-job-completed", G_CALLBACK (output_limit_on_spawned_job_completed), NULL);
+  g_object_unref (job);
+  g_free (s);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+progress_func_parse_counter (UDisksSpawnedJob *job,
+                             const gchar      *line,
+                             gdouble          *out_progress,
+                             gpointer          user_data)
+{
+  guint *num_lines = user_data;
+  guint done, total;
+
+  (*num_lines)++;
+  if (g_str_has_prefix (line, "Working: "))
+    line += strlen ("Working: ");
+  if (sscanf (line, "%u/%u", &done, &total) != 2)
+    return FALSE;
+  *out_progress = (gdouble) done / total;
+  return TRUE;
+}
+
+static void
+test_spawned_job_progress_func (void)
+{
+  UDisksSpawnedJob *job;
+  guint num_lines = 0;
+  gchar *s;
+
+  s = g_strdup_printf (UDISKS_TEST_DIR "/udisks-test-helper 9");
+  job = udisks_spawned_job_new (s, NULL, getuid (), geteuid (), NULL, NULL);
+  udisks_spawned_job_set_progress_func (job, progress_func_parse_counter, &num_lines, NULL);
+  udisks_spawned_job_start (job);
+  _g_assert_signal_received (job, "completed", G_CALLBACK (on_completed_expect_success), NULL);
+  /* the counters and "done" separated by backspaces */
+  g_assert_cmpuint (num_lines, ==, 4);
+  g_assert (udisks_job_get_progress_valid (UDISKS_JOB (job)));
+  g_assert_cmpfloat (udisks_job_get_progress (UDISKS_JOB (job)), ==, 1.0);
+  g_object_unref (job);
+  g_free (s);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static gboolean
 input_string_on_spawned_job_completed (UDisksSpawnedJob *job,
                                        GError           *error,
@@ -678,6 +775,240 @@ test_threaded_job_override_signal_handler (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+test_ata_smart_parse (void)
+{
+  guchar data_page[512] = {0, };
+  guchar thresholds_page[512] = {0, };
+  UDisksAtaSmartData data;
+  UDisksAtaSmartData data2;
+  UDisksAtaSmartUnit unit;
+  guint64 pretty;
+
+  /* spin-up-time in slot 0, temperature-celsius-2 in slot 2, unknown attribute in slot 3 */
+  data_page[2 + 0 * 12 + 0] = 3;
+  data_page[2 + 0 * 12 + 1] = 0x27;
+  data_page[2 + 0 * 12 + 3] = 20;  /* current */
+  data_page[2 + 0 * 12 + 4] = 10;  /* worst */
+  data_page[2 + 0 * 12 + 5] = 0x10;
+  data_page[2 + 0 * 12 + 6] = 0x27;
+  data_page[2 + 2 * 12 + 0] = 194;
+  data_page[2 + 2 * 12 + 3] = 0xfe; /* invalid current */
+  data_page[2 + 2 * 12 + 4] = 60;
+  data_page[2 + 2 * 12 + 5] = 40;   /* 40 degrees celsius */
+  data_page[2 + 3 * 12 + 0] = 160;
+  data_page[363] = 0xf3;            /* in progress, 30% remaining */
+
+  /* thresholds in a different order than the data */
+  thresholds_page[2 + 0 * 12 + 0] = 194;
+  thresholds_page[2 + 0 * 12 + 1] = 0xfe;
+  thresholds_page[2 + 5 * 12 + 0] = 3;
+  thresholds_page[2 + 5 * 12 + 1] = 21;
+
+  udisks_ata_smart_parse (data_page, thresholds_page, &data);
+  g_assert_cmpuint (data.num_attributes, ==, 3);
+  g_assert_cmpuint (data.self_test_execution_status, ==, 0xf3);
+
+  g_assert_cmpuint (data.attributes[0].id, ==, 3);
+  g_assert_cmpuint (data.attributes[0].flags, ==, 0x27);
+  g_assert (data.attributes[0].current_valid);
+  g_assert_cmpuint (data.attributes[0].current, ==, 20);
+  g_assert (data.attributes[0].threshold_valid);
+  g_assert_cmpuint (data.attributes[0].threshold, ==, 21);
+  g_assert_cmpstr (udisks_ata_smart_attribute_get_name (&data.attributes[0]), ==, "spin-up-time");
+  pretty = udisks_ata_smart_attribute_get_pretty (&data.attributes[0], &unit);
+  g_assert_cmpint (unit, ==, UDISKS_ATA_SMART_UNIT_MSECONDS);
+  g_assert_cmpuint (pretty, ==, 0x2710);
+
+  g_assert_cmpuint (data.attributes[1].id, ==, 194);
+  g_assert (!data.attributes[1].current_valid);
+  g_assert (data.attributes[1].worst_valid);
+  g_assert (!data.attributes[1].threshold_valid);
+  pretty = udisks_ata_smart_attribute_get_pretty (&data.attributes[1], &unit);
+  g_assert_cmpint (unit, ==, UDISKS_ATA_SMART_UNIT_MKELVIN);
+  g_assert_cmpuint (pretty, ==, 313150);
+
+  g_assert_cmpuint (data.attributes[2].id, ==, 160);
+  g_assert (udisks_ata_smart_attribute_get_name (&data.attributes[2]) == NULL);
+  g_assert (!data.attributes[2].threshold_valid);
+  udisks_ata_smart_attribute_get_pretty (&data.attributes[2], &unit);
+  g_assert_cmpint (unit, ==, UDISKS_ATA_SMART_UNIT_UNKNOWN);
+
+  /* the result is fully initialized and can be compared */
+  udisks_ata_smart_parse (data_page, thresholds_page, &data2);
+  g_assert (memcmp (&data, &data2, sizeof (UDisksAtaSmartData)) == 0);
+  data_page[2 + 2 * 12 + 5] = 41;
+  udisks_ata_smart_parse (data_page, thresholds_page, &data2);
+  g_assert (memcmp (&data, &data2, sizeof (UDisksAtaSmartData)) != 0);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+put_le16 (guchar *p, guint16 value)
+{
+  p[0] = value & 0xff;
+  p[1] = value >> 8;
+}
+
+static void
+put_le32 (guchar *p, guint32 value)
+{
+  put_le16 (p, value & 0xffff);
+  put_le16 (p + 2, value >> 16);
+}
+
+static void
+put_le64 (guchar *p, guint64 value)
+{
+  put_le32 (p, value & 0xffffffff);
+  put_le32 (p + 4, value >> 32);
+}
+
+static void
+put_be32 (guchar *p, guint32 value)
+{
+  p[0] = value >> 24;
+  p[1] = (value >> 16) & 0xff;
+  p[2] = (value >> 8) & 0xff;
+  p[3] = value & 0xff;
+}
+
+static void
+test_superblock_parse_size (void)
+{
+  guchar buf[UDISKS_SUPERBLOCK_READ_SIZE];
+  guint64 size;
+
+  /* ext4, 4k blocks, 64bit */
+  memset (buf, 0, sizeof (buf));
+  g_assert (!udisks_superblock_parse_size ("ext4", buf, sizeof (buf), &size));
+  put_le16 (buf + 1024 + 0x38, 0xef53);
+  put_le32 (buf + 1024 + 0x18, 2);
+  put_le32 (buf + 1024 + 0x04, 1000);
+  g_assert (udisks_superblock_parse_size ("ext4", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 1000 * 4096);
+  put_le32 (buf + 1024 + 0x150, 1);
+  g_assert (udisks_superblock_parse_size ("ext4", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 1000 * 4096);
+  put_le32 (buf + 1024 + 0x60, 0x80);
+  g_assert (udisks_superblock_parse_size ("ext2", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, ((1ULL << 32) + 1000) * 4096);
+  /* too short */
+  g_assert (!udisks_superblock_parse_size ("ext4", buf, 2048, &size));
+
+  /* xfs */
+  memset (buf, 0, sizeof (buf));
+  g_assert (!udisks_superblock_parse_size ("xfs", buf, sizeof (buf), &size));
+  memcpy (buf, "XFSB", 4);
+  put_be32 (buf + 4, 4096);
+  put_be32 (buf + 8, 0);
+  put_be32 (buf + 12, 262144);
+  g_assert (udisks_superblock_parse_size ("xfs", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 262144ULL * 4096);
+
+  /* btrfs, relative to udisks_superblock_get_offset() */
+  g_assert_cmpint (udisks_superblock_get_offset ("btrfs"), ==, 64 * 1024);
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf + 0x40, "_BHRfS_M", 8);
+  put_le64 (buf + 0x70, 5ULL * 1024 * 1024 * 1024);
+  g_assert (udisks_superblock_parse_size ("btrfs", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 5ULL * 1024 * 1024 * 1024);
+
+  /* vfat with 16 and 32 bit sector counts */
+  memset (buf, 0, sizeof (buf));
+  put_le16 (buf + 11, 512);
+  buf[13] = 4;
+  put_le16 (buf + 19, 2048);
+  g_assert (!udisks_superblock_parse_size ("vfat", buf, sizeof (buf), &size));
+  buf[510] = 0x55;
+  buf[511] = 0xaa;
+  g_assert (udisks_superblock_parse_size ("vfat", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 2048 * 512);
+  put_le16 (buf + 19, 0);
+  put_le32 (buf + 32, 4194304);
+  g_assert (udisks_superblock_parse_size ("vfat", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 4194304ULL * 512);
+  put_le16 (buf + 11, 1000);
+  g_assert (!udisks_superblock_parse_size ("vfat", buf, sizeof (buf), &size));
+
+  /* exfat */
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf + 3, "EXFAT   ", 8);
+  put_le64 (buf + 72, 1048576);
+  buf[108] = 9;
+  g_assert (udisks_superblock_parse_size ("exfat", buf, sizeof (buf), &size));
+  g_assert_cmpuint (size, ==, 1048576ULL * 512);
+
+  /* unsupported */
+  g_assert (!udisks_superblock_is_supported ("ntfs"));
+  g_assert (!udisks_superblock_parse_size ("ntfs", buf, sizeof (buf), &size));
+}
+
+static void
+test_superblock_read_size (void)
+{
+  guchar buf[UDISKS_SUPERBLOCK_READ_SIZE];
+  GError *error = NULL;
+  gchar *path;
+  guint64 size = 0;
+  gint fd;
+
+  fd = g_file_open_tmp ("udisks-test-superblock-XXXXXX", &path, &error);
+  g_assert_no_error (error);
+
+  memset (buf, 0, sizeof (buf));
+  put_le16 (buf + 1024 + 0x38, 0xef53);
+  put_le32 (buf + 1024 + 0x04, 8192);
+  g_assert_cmpint (write (fd, buf, sizeof (buf)), ==, sizeof (buf));
+  close (fd);
+
+  g_assert (udisks_superblock_read_size (path, "ext3", &size, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (size, ==, 8192 * 1024);
+
+  /* no btrfs superblock at 64k */
+  g_assert (!udisks_superblock_read_size (path, "btrfs", &size, &error));
+  g_assert_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED);
+  g_clear_error (&error);
+
+  g_assert (!udisks_superblock_read_size (path, "ntfs", &size, &error));
+  g_assert_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED);
+  g_clear_error (&error);
+
+  g_unlink (path);
+  g_free (path);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_safe_append_to_object_path (void)
+{
+  GString *str;
+
+  str = g_string_new ("/org/freedesktop/UDisks2/drives/");
+  udisks_safe_append_to_object_path (str, "Samsung_SSD_850");
+  g_assert_cmpstr (str->str, ==, "/org/freedesktop/UDisks2/drives/Samsung_SSD_850");
+
+  g_string_truncate (str, 0);
+  udisks_safe_append_to_object_path (str, "a b-c.");
+  g_assert_cmpstr (str->str, ==, "a_20b_2dc_2e");
+
+  /* non-ASCII bytes are sign-extended, as they always were */
+  g_string_truncate (str, 0);
+  udisks_safe_append_to_object_path (str, "\xc3\xa9x");
+  g_assert_cmpstr (str->str, ==, "_ffffffc3_ffffffa9x");
+
+  g_string_truncate (str, 0);
+  udisks_safe_append_to_object_path (str, "");
+  g_assert_cmpstr (str->str, ==, "");
+
+  g_string_free (str, TRUE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 int
 main (int    argc,
       char **argv)
@@ -708,6 +1039,8 @@ main (int    argc,
   g_test_add_func ("/udisks/daemon/spawned_job/exit_status", test_spawned_job_exit_status);
   g_test_add_func ("/udisks/daemon/spawned_job/abnormal_termination", test_spawned_job_abnormal_termination);
   g_test_add_func ("/udisks/daemon/spawned_job/binary_output", test_spawned_job_binary_output);
+  g_test_add_func ("/udisks/daemon/spawned_job/output_limit", test_spawned_job_output_limit);
+  g_test_add_func ("/udisks/daemon/spawned_job/progress_func", test_spawned_job_progress_func);
   g_test_add_func ("/udisks/daemon/spawned_job/input_string", test_spawned_job_input_string);
   g_test_add_func ("/udisks/daemon/spawned_job/binary_input_string", test_spawned_job_binary_input_string);
   g_test_add_func ("/udisks/daemon/threaded_job/successful", test_threaded_job_successful);
@@ -719,6 +1052,10 @@ main (int    argc,
   g_test_add_func ("/udisks/daemon/threaded_job_sync/failure", test_threaded_job_sync_failure);
   g_test_add_func ("/udisks/daemon/threaded_job_sync/cancelled_at_start", test_threaded_job_sync_cancelled_at_start);
   g_test_add_func ("/udisks/daemon/threaded_job_sync/cancelled_midway", test_threaded_job_sync_cancelled_midway);
+  g_test_add_func ("/udisks/daemon/ata/smart_parse", test_ata_smart_parse);
+  g_test_add_func ("/udisks/daemon/superblock/parse_size", test_superblock_parse_size);
+  g_test_add_func ("/udisks/daemon/superblock/read_size", test_superblock_read_size);
+  g_test_add_func ("/udisks/daemon/util/safe_append_to_object_path", test_safe_append_to_object_path);
 
   ret = g_test_run();
 
@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <linux/bsg.h>
 #include <scsi/scsi.h>
 #include <scsi/sg.h>
@@ -308,3 +309,668 @@ udisks_ata_send_command_sync (gint                       fd,
  out:
   return ret;
 }
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  guint8              id;
+  const gchar        *name;
+  UDisksAtaSmartUnit  unit;
+} SmartAttributeInfo;
+
+/* Names follow the ones used by libatasmart so the attributes look
+ * the same no matter which one decoded them.
+ */
+static const SmartAttributeInfo smart_attribute_info[] =
+{
+  {   1, "raw-read-error-rate",         UDISKS_ATA_SMART_UNIT_NONE },
+  {   2, "throughput-performance",      UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  {   3, "spin-up-time",                UDISKS_ATA_SMART_UNIT_MSECONDS },
+  {   4, "start-stop-count",            UDISKS_ATA_SMART_UNIT_NONE },
+  {   5, "reallocated-sector-count",    UDISKS_ATA_SMART_UNIT_SECTORS },
+  {   6, "read-channel-margin",         UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  {   7, "seek-error-rate",             UDISKS_ATA_SMART_UNIT_NONE },
+  {   8, "seek-time-performance",       UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  {   9, "power-on-hours",              UDISKS_ATA_SMART_UNIT_MSECONDS },
+  {  10, "spin-retry-count",            UDISKS_ATA_SMART_UNIT_NONE },
+  {  11, "calibration-retry-count",     UDISKS_ATA_SMART_UNIT_NONE },
+  {  12, "power-cycle-count",           UDISKS_ATA_SMART_UNIT_NONE },
+  {  13, "read-soft-error-rate",        UDISKS_ATA_SMART_UNIT_NONE },
+  { 170, "available-reserved-space",    UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 171, "program-fail-count",          UDISKS_ATA_SMART_UNIT_NONE },
+  { 172, "erase-fail-count",            UDISKS_ATA_SMART_UNIT_NONE },
+  { 175, "program-fail-count-chip",     UDISKS_ATA_SMART_UNIT_NONE },
+  { 176, "erase-fail-count-chip",       UDISKS_ATA_SMART_UNIT_NONE },
+  { 177, "wear-leveling-count",         UDISKS_ATA_SMART_UNIT_NONE },
+  { 178, "used-reserved-blocks-chip",   UDISKS_ATA_SMART_UNIT_NONE },
+  { 179, "used-reserved-blocks-total",  UDISKS_ATA_SMART_UNIT_NONE },
+  { 180, "unused-reserved-blocks",      UDISKS_ATA_SMART_UNIT_NONE },
+  { 181, "program-fail-count-total",    UDISKS_ATA_SMART_UNIT_NONE },
+  { 182, "erase-fail-count-total",      UDISKS_ATA_SMART_UNIT_NONE },
+  { 183, "runtime-bad-block-total",     UDISKS_ATA_SMART_UNIT_NONE },
+  { 184, "end-to-end-error",            UDISKS_ATA_SMART_UNIT_NONE },
+  { 187, "reported-uncorrect",          UDISKS_ATA_SMART_UNIT_SECTORS },
+  { 188, "command-timeout",             UDISKS_ATA_SMART_UNIT_NONE },
+  { 189, "high-fly-writes",             UDISKS_ATA_SMART_UNIT_NONE },
+  { 190, "airflow-temperature-celsius", UDISKS_ATA_SMART_UNIT_MKELVIN },
+  { 191, "g-sense-error-rate",          UDISKS_ATA_SMART_UNIT_NONE },
+  { 192, "power-off-retract-count",     UDISKS_ATA_SMART_UNIT_NONE },
+  { 193, "load-cycle-count",            UDISKS_ATA_SMART_UNIT_NONE },
+  { 194, "temperature-celsius-2",       UDISKS_ATA_SMART_UNIT_MKELVIN },
+  { 195, "hardware-ecc-recovered",      UDISKS_ATA_SMART_UNIT_NONE },
+  { 196, "reallocated-event-count",     UDISKS_ATA_SMART_UNIT_NONE },
+  { 197, "current-pending-sector",      UDISKS_ATA_SMART_UNIT_SECTORS },
+  { 198, "offline-uncorrectable",       UDISKS_ATA_SMART_UNIT_SECTORS },
+  { 199, "udma-crc-error-count",        UDISKS_ATA_SMART_UNIT_NONE },
+  { 200, "multi-zone-error-rate",       UDISKS_ATA_SMART_UNIT_NONE },
+  { 201, "soft-read-error-rate",        UDISKS_ATA_SMART_UNIT_NONE },
+  { 202, "ta-increase-count",           UDISKS_ATA_SMART_UNIT_NONE },
+  { 203, "run-out-cancel",              UDISKS_ATA_SMART_UNIT_NONE },
+  { 204, "shock-count-write-open",      UDISKS_ATA_SMART_UNIT_NONE },
+  { 205, "shock-rate-write-open",       UDISKS_ATA_SMART_UNIT_NONE },
+  { 206, "flying-height",               UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 207, "spin-high-current",           UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 208, "spin-buzz",                   UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 209, "offline-seek-performance",    UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 220, "disk-shift",                  UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 221, "g-sense-error-rate-2",        UDISKS_ATA_SMART_UNIT_NONE },
+  { 222, "loaded-hours",                UDISKS_ATA_SMART_UNIT_MSECONDS },
+  { 223, "load-retry-count",            UDISKS_ATA_SMART_UNIT_NONE },
+  { 224, "load-friction",               UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 225, "load-cycle-count-2",          UDISKS_ATA_SMART_UNIT_NONE },
+  { 226, "load-in-time",                UDISKS_ATA_SMART_UNIT_MSECONDS },
+  { 227, "torq-amp-count",              UDISKS_ATA_SMART_UNIT_NONE },
+  { 228, "power-off-retract-count-2",   UDISKS_ATA_SMART_UNIT_NONE },
+  { 230, "head-amplitude",              UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 231, "temperature-celsius",         UDISKS_ATA_SMART_UNIT_MKELVIN },
+  { 232, "endurance-remaining",         UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 234, "uncorrectable-ecc-count",     UDISKS_ATA_SMART_UNIT_SECTORS },
+  { 235, "good-block-rate",             UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 240, "head-flying-hours",           UDISKS_ATA_SMART_UNIT_MSECONDS },
+  { 241, "total-lbas-written",          UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 242, "total-lbas-read",             UDISKS_ATA_SMART_UNIT_UNKNOWN },
+  { 250, "read-error-retry-rate",       UDISKS_ATA_SMART_UNIT_NONE },
+  { 254, "free-fall-protection",        UDISKS_ATA_SMART_UNIT_NONE },
+};
+
+static const SmartAttributeInfo *
+lookup_smart_attribute_info (guint8 id)
+{
+  guint lo = 0;
+  guint hi = G_N_ELEMENTS (smart_attribute_info);
+
+  /* the table is sorted by id */
+  while (lo < hi)
+    {
+      guint mid = (lo + hi) / 2;
+      if (smart_attribute_info[mid].id == id)
+        return &smart_attribute_info[mid];
+      else if (smart_attribute_info[mid].id < id)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return NULL;
+}
+
+/**
+ * udisks_ata_smart_parse:
+ * @data_page: The 512-byte result of the SMART READ DATA command.
+ * @thresholds_page: (allow-none): The 512-byte result of the SMART READ THRESHOLDS command or %NULL.
+ * @out_data: Return location for the decoded data.
+ *
+ * Decodes the SMART data and thresholds pages into @out_data. No
+ * memory is allocated. The whole of @out_data is initialized so two
+ * results can be compared using memcmp().
+ */
+void
+udisks_ata_smart_parse (const guchar       *data_page,
+                        const guchar       *thresholds_page,
+                        UDisksAtaSmartData *out_data)
+{
+  guint n;
+
+  g_return_if_fail (data_page != NULL);
+  g_return_if_fail (out_data != NULL);
+
+  memset (out_data, 0, sizeof (UDisksAtaSmartData));
+
+  /* ATA8: 7.53.6.2 Off-line data collection status and 7.53.6.3 Self-test execution status */
+  out_data->offline_data_collection_status = data_page[362];
+  out_data->self_test_execution_status = data_page[363];
+
+  /* the attribute table starts at byte 2 and consists of 30 12-byte entries */
+  for (n = 0; n < UDISKS_ATA_SMART_MAX_ATTRIBUTES; n++)
+    {
+      const guchar *p = data_page + 2 + n * 12;
+      UDisksAtaSmartAttribute *a;
+      guint m;
+
+      /* unused slot */
+      if (p[0] == 0)
+        continue;
+
+      a = &out_data->attributes[out_data->num_attributes++];
+      a->id = p[0];
+      a->flags = p[1] | (p[2] << 8);
+      a->current = p[3];
+      a->current_valid = p[3] >= 1 && p[3] <= 0xfd;
+      a->worst = p[4];
+      a->worst_valid = p[4] >= 1 && p[4] <= 0xfd;
+      memcpy (a->raw, p + 5, 6);
+
+      if (thresholds_page == NULL)
+        continue;
+
+      /* the thresholds table uses the same layout, usually in the same order */
+      for (m = 0; m < UDISKS_ATA_SMART_MAX_ATTRIBUTES; m++)
+        {
+          guint slot = (n + m) % UDISKS_ATA_SMART_MAX_ATTRIBUTES;
+          const guchar *t = thresholds_page + 2 + slot * 12;
+          if (t[0] == a->id)
+            {
+              a->threshold = t[1];
+              a->threshold_valid = t[1] != 0xfe;
+              break;
+            }
+        }
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* How long to wait for the commands queued before a command, in
+ * addition to the timeout of the command itself
+ */
+#define UDISKS_ATA_COMMAND_QUEUE_GRACE_MSEC (5 * 1000)
+
+/**
+ * UDisksAtaCommandQueue:
+ *
+ * A queue sending ATA commands to a device one at a time from a
+ * dedicated thread, see udisks_ata_command_queue_new().
+ */
+struct _UDisksAtaCommandQueue
+{
+  GThreadPool *pool;
+};
+
+typedef struct
+{
+  gint ref_count;
+
+  GMutex lock;
+  GCond cond;
+  gboolean done;       /* protected by lock */
+  gboolean abandoned;  /* protected by lock */
+
+  gint fd;
+  gint timeout_msec;
+  UDisksAtaCommandProtocol protocol;
+  /* own copies of the caller's structures and buffers, the caller may
+   * give up on the command while it's still pending
+   */
+  UDisksAtaCommandInput input;
+  UDisksAtaCommandOutput output;
+  gboolean ret;
+  GError *error;
+} QueuedCommand;
+
+static void
+queued_command_unref (QueuedCommand *command)
+{
+  if (!g_atomic_int_dec_and_test (&command->ref_count))
+    return;
+
+  if (command->fd != -1)
+    close (command->fd);
+  g_free (command->input.buffer);
+  g_free (command->output.buffer);
+  g_clear_error (&command->error);
+  g_mutex_clear (&command->lock);
+  g_cond_clear (&command->cond);
+  g_free (command);
+}
+
+/* runs in the thread of the queue */
+static void
+command_queue_thread_func (gpointer data,
+                           gpointer user_data)
+{
+  QueuedCommand *command = data;
+  gboolean abandoned;
+
+  g_mutex_lock (&command->lock);
+  abandoned = command->abandoned;
+  g_mutex_unlock (&command->lock);
+
+  /* don't bother the device with commands no one is waiting for */
+  if (!abandoned)
+    command->ret = udisks_ata_send_command_sync (command->fd,
+                                                 command->timeout_msec,
+                                                 command->protocol,
+                                                 &command->input,
+                                                 &command->output,
+                                                 &command->error);
+
+  g_mutex_lock (&command->lock);
+  command->done = TRUE;
+  g_cond_signal (&command->cond);
+  g_mutex_unlock (&command->lock);
+
+  queued_command_unref (command);
+}
+
+/**
+ * udisks_ata_command_queue_new:
+ *
+ * Creates a new queue for sending ATA commands to a device. The
+ * commands are sent one at a time from a thread dedicated to the
+ * queue so a device that stops responding only blocks the callers
+ * sending commands to it, and only until their timeout expires.
+ *
+ * Returns: A new #UDisksAtaCommandQueue. Free with udisks_ata_command_queue_free().
+ */
+UDisksAtaCommandQueue *
+udisks_ata_command_queue_new (void)
+{
+  UDisksAtaCommandQueue *queue;
+
+  queue = g_new0 (UDisksAtaCommandQueue, 1);
+  queue->pool = g_thread_pool_new (command_queue_thread_func,
+                                   NULL,
+                                   1,     /* max_threads */
+                                   FALSE, /* exclusive */
+                                   NULL);
+  return queue;
+}
+
+/**
+ * udisks_ata_command_queue_free:
+ * @queue: A #UDisksAtaCommandQueue.
+ *
+ * Frees @queue. Commands still pending are completed in the
+ * background without anyone waiting for them.
+ */
+void
+udisks_ata_command_queue_free (UDisksAtaCommandQueue *queue)
+{
+  g_return_if_fail (queue != NULL);
+
+  g_thread_pool_free (queue->pool, FALSE /* immediate */, FALSE /* wait */);
+  g_free (queue);
+}
+
+static void
+on_queued_command_cancelled (GCancellable *cancellable,
+                             gpointer      user_data)
+{
+  QueuedCommand *command = user_data;
+
+  g_mutex_lock (&command->lock);
+  g_cond_signal (&command->cond);
+  g_mutex_unlock (&command->lock);
+}
+
+/**
+ * udisks_ata_command_queue_send_sync:
+ * @queue: (allow-none): A #UDisksAtaCommandQueue or %NULL.
+ * @fd: A file descriptor for a ATA device.
+ * @timeout_msec: Timeout in milli-seconds for the command. Use -1 for the default (5 seconds) timeout and %G_MAXINT for no timeout.
+ * @protocol: The direction of the command.
+ * @input: The input for the command.
+ * @output: The output for the command.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Like udisks_ata_send_command_sync() but the command is sent from
+ * the thread of @queue after the commands queued before it. The
+ * calling thread waits for at most the time the earlier commands
+ * and the command itself are allowed to take, or until @cancellable
+ * is cancelled, and fails with %G_IO_ERROR_TIMED_OUT or
+ * %G_IO_ERROR_CANCELLED if the command didn't complete by then.
+ *
+ * If @queue is %NULL, this is the same as udisks_ata_send_command_sync().
+ *
+ * Returns: %TRUE if the command succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_ata_command_queue_send_sync (UDisksAtaCommandQueue     *queue,
+                                    gint                       fd,
+                                    gint                       timeout_msec,
+                                    UDisksAtaCommandProtocol   protocol,
+                                    UDisksAtaCommandInput     *input,
+                                    UDisksAtaCommandOutput    *output,
+                                    GCancellable              *cancellable,
+                                    GError                   **error)
+{
+  QueuedCommand *command;
+  gint64 end_time = -1;
+  gulong cancelled_id = 0;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (fd != -1, FALSE);
+  g_return_val_if_fail (timeout_msec == -1 || timeout_msec > 0, FALSE);
+  g_return_val_if_fail (input != NULL, FALSE);
+  g_return_val_if_fail (input->buffer_size == 0 || input->buffer != NULL, FALSE);
+  g_return_val_if_fail (output != NULL, FALSE);
+  g_return_val_if_fail (output->buffer_size == 0 || output->buffer != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (queue == NULL)
+    return udisks_ata_send_command_sync (fd, timeout_msec, protocol, input, output, error);
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  command = g_new0 (QueuedCommand, 1);
+  command->ref_count = 2; /* one for the caller, one for the queue */
+  g_mutex_init (&command->lock);
+  g_cond_init (&command->cond);
+  /* the caller is free to close @fd once we return */
+  command->fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+  if (command->fd == -1)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error duplicating file descriptor: %m");
+      command->ref_count = 1;
+      goto out;
+    }
+  command->timeout_msec = timeout_msec;
+  command->protocol = protocol;
+  command->input = *input;
+  command->input.buffer = g_memdup (input->buffer, input->buffer_size);
+  command->output.buffer_size = output->buffer_size;
+  command->output.buffer = g_malloc0 (output->buffer_size);
+
+  if (timeout_msec != G_MAXINT)
+    {
+      if (timeout_msec == -1)
+        timeout_msec = UDISKS_ATA_DEFAULT_COMMAND_TIMEOUT_MSEC;
+      end_time = g_get_monotonic_time () + (timeout_msec + UDISKS_ATA_COMMAND_QUEUE_GRACE_MSEC) * G_TIME_SPAN_MILLISECOND;
+    }
+
+  if (cancellable != NULL)
+    cancelled_id = g_cancellable_connect (cancellable,
+                                          G_CALLBACK (on_queued_command_cancelled),
+                                          command,
+                                          NULL);
+
+  g_thread_pool_push (queue->pool, command, NULL);
+
+  g_mutex_lock (&command->lock);
+  while (!command->done)
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
+      if (end_time == -1)
+        g_cond_wait (&command->cond, &command->lock);
+      else if (!g_cond_wait_until (&command->cond, &command->lock, end_time))
+        break;
+    }
+  if (!command->done)
+    command->abandoned = TRUE;
+  g_mutex_unlock (&command->lock);
+
+  g_cancellable_disconnect (cancellable, cancelled_id);
+
+  if (!command->done)
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                     "ATA command 0x%02x was cancelled", (guint) input->command);
+      else
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                     "Timed out waiting for ATA command 0x%02x", (guint) input->command);
+      goto out;
+    }
+
+  output->error = command->output.error;
+  output->count = command->output.count;
+  output->device = command->output.device;
+  output->status = command->output.status;
+  output->lba = command->output.lba;
+  if (output->buffer_size > 0)
+    memcpy (output->buffer, command->output.buffer, output->buffer_size);
+  if (!command->ret)
+    {
+      g_propagate_error (error, command->error);
+      command->error = NULL;
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  queued_command_unref (command);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+smart_read_page (UDisksAtaCommandQueue  *queue,
+                 gint                    fd,
+                 guint8                  feature,
+                 guchar                 *page,
+                 GCancellable           *cancellable,
+                 GError                **error)
+{
+  /* ATA8: 7.53 SMART - B0h */
+  UDisksAtaCommandInput input = {.command = 0xb0, .feature = feature, .count = 1, .lba = 0x004fc2};
+  UDisksAtaCommandOutput output = {.buffer = page, .buffer_size = 512};
+
+  return udisks_ata_command_queue_send_sync (queue,
+                                             fd,
+                                             -1,
+                                             UDISKS_ATA_COMMAND_PROTOCOL_DRIVE_TO_HOST,
+                                             &input,
+                                             &output,
+                                             cancellable,
+                                             error);
+}
+
+/**
+ * udisks_ata_smart_read_sync:
+ * @queue: (allow-none): A #UDisksAtaCommandQueue to send the commands through or %NULL.
+ * @fd: A file descriptor for a ATA device.
+ * @out_data: Return location for the decoded data.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Sends the SMART READ DATA and SMART READ THRESHOLDS commands to the
+ * device and decodes the result using udisks_ata_smart_parse(). Blocks
+ * the calling thread while the commands are pending, see
+ * udisks_ata_command_queue_send_sync().
+ *
+ * Returns: %TRUE if the commands succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_ata_smart_read_sync (UDisksAtaCommandQueue  *queue,
+                            gint                    fd,
+                            UDisksAtaSmartData     *out_data,
+                            GCancellable           *cancellable,
+                            GError                **error)
+{
+  guchar data_page[512];
+  guchar thresholds_page[512];
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (fd != -1, FALSE);
+  g_return_val_if_fail (out_data != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  /* ATA8: 7.53.6 SMART READ DATA - B0h/D0h, PIO Data-In */
+  if (!smart_read_page (queue, fd, 0xd0, data_page, cancellable, error))
+    {
+      g_prefix_error (error, "Error sending ATA command SMART READ DATA: ");
+      goto out;
+    }
+
+  /* SMART READ THRESHOLDS - B0h/D1h, PIO Data-In (obsolete in ATA8 but still widely implemented) */
+  if (!smart_read_page (queue, fd, 0xd1, thresholds_page, cancellable, error))
+    {
+      g_prefix_error (error, "Error sending ATA command SMART READ THRESHOLDS: ");
+      goto out;
+    }
+
+  udisks_ata_smart_parse (data_page, thresholds_page, out_data);
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/**
+ * udisks_ata_smart_return_status_sync:
+ * @queue: (allow-none): A #UDisksAtaCommandQueue to send the command through or %NULL.
+ * @fd: A file descriptor for a ATA device.
+ * @out_failing: Return location for whether a threshold has been exceeded.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Sends the SMART RETURN STATUS command to the device. Blocks the
+ * calling thread while the command is pending, see
+ * udisks_ata_command_queue_send_sync().
+ *
+ * Returns: %TRUE if the command succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_ata_smart_return_status_sync (UDisksAtaCommandQueue  *queue,
+                                     gint                    fd,
+                                     gboolean               *out_failing,
+                                     GCancellable           *cancellable,
+                                     GError                **error)
+{
+  /* ATA8: 7.53.8 SMART RETURN STATUS - B0h/DAh, Non-Data */
+  UDisksAtaCommandInput input = {.command = 0xb0, .feature = 0xda, .lba = 0x004fc2};
+  UDisksAtaCommandOutput output = {0};
+  guint8 lba_mid;
+  guint8 lba_high;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (fd != -1, FALSE);
+  g_return_val_if_fail (out_failing != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!udisks_ata_command_queue_send_sync (queue,
+                                           fd,
+                                           -1,
+                                           UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                           &input,
+                                           &output,
+                                           cancellable,
+                                           error))
+    {
+      g_prefix_error (error, "Error sending ATA command SMART RETURN STATUS: ");
+      goto out;
+    }
+
+  lba_mid = (output.lba >> 8) & 0xff;
+  lba_high = (output.lba >> 16) & 0xff;
+  if (lba_mid == 0x4f && lba_high == 0xc2)
+    {
+      *out_failing = FALSE;
+    }
+  else if (lba_mid == 0xf4 && lba_high == 0x2c)
+    {
+      *out_failing = TRUE;
+    }
+  else
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Unexpected SMART RETURN STATUS result: lba_mid=0x%02x lba_high=0x%02x",
+                   (guint) lba_mid, (guint) lba_high);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/**
+ * udisks_ata_smart_attribute_get_name:
+ * @attribute: A #UDisksAtaSmartAttribute.
+ *
+ * Gets the well-known name of @attribute.
+ *
+ * Returns: A static string or %NULL if the attribute is not known.
+ */
+const gchar *
+udisks_ata_smart_attribute_get_name (const UDisksAtaSmartAttribute *attribute)
+{
+  const SmartAttributeInfo *info;
+
+  g_return_val_if_fail (attribute != NULL, NULL);
+
+  info = lookup_smart_attribute_info (attribute->id);
+  return info != NULL ? info->name : NULL;
+}
+
+/**
+ * udisks_ata_smart_attribute_get_pretty:
+ * @attribute: A #UDisksAtaSmartAttribute.
+ * @out_unit: Return location for the unit of the returned value.
+ *
+ * Interprets the raw value of @attribute.
+ *
+ * Returns: The interpreted value, to be ignored if @out_unit is set to
+ *   %UDISKS_ATA_SMART_UNIT_UNKNOWN.
+ */
+guint64
+udisks_ata_smart_attribute_get_pretty (const UDisksAtaSmartAttribute *attribute,
+                                       UDisksAtaSmartUnit            *out_unit)
+{
+  const SmartAttributeInfo *info;
+  const guint8 *raw;
+  guint64 raw48;
+  guint64 ret;
+
+  g_return_val_if_fail (attribute != NULL, 0);
+  g_return_val_if_fail (out_unit != NULL, 0);
+
+  raw = attribute->raw;
+  raw48 = ((guint64) raw[0]) |
+          ((guint64) raw[1] << 8) |
+          ((guint64) raw[2] << 16) |
+          ((guint64) raw[3] << 24) |
+          ((guint64) raw[4] << 32) |
+          ((guint64) raw[5] << 40);
+
+  info = lookup_smart_attribute_info (attribute->id);
+  *out_unit = info != NULL ? info->unit : UDISKS_ATA_SMART_UNIT_UNKNOWN;
+
+  switch (attribute->id)
+    {
+    case 3:   /* spin-up-time */
+      ret = raw[0] | (raw[1] << 8);
+      break;
+
+    case 9:   /* power-on-hours */
+    case 222: /* loaded-hours */
+    case 240: /* head-flying-hours */
+      /* vendors tend to stuff other things into the upper bytes */
+      ret = (raw48 & 0xffffffffU) * 60 * 60 * 1000;
+      break;
+
+    case 190: /* airflow-temperature-celsius */
+    case 194: /* temperature-celsius-2 */
+    case 231: /* temperature-celsius */
+      ret = raw[0] * 1000 + 273150;
+      break;
+
+    case 5:   /* reallocated-sector-count */
+    case 197: /* current-pending-sector */
+      ret = raw48 & 0xffffffffU;
+      break;
+
+    default:
+      ret = raw48;
+      break;
+    }
+
+  return ret;
+}
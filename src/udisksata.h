@@ -80,6 +80,91 @@ gboolean udisks_ata_send_command_sync (gint                       fd,
                                        UDisksAtaCommandOutput    *output,
                                        GError                   **error);
 
+UDisksAtaCommandQueue *udisks_ata_command_queue_new       (void);
+void                   udisks_ata_command_queue_free      (UDisksAtaCommandQueue     *queue);
+gboolean               udisks_ata_command_queue_send_sync (UDisksAtaCommandQueue     *queue,
+                                                           gint                       fd,
+                                                           gint                       timeout_msec,
+                                                           UDisksAtaCommandProtocol   protocol,
+                                                           UDisksAtaCommandInput     *input,
+                                                           UDisksAtaCommandOutput    *output,
+                                                           GCancellable              *cancellable,
+                                                           GError                   **error);
+
+/**
+ * UDISKS_ATA_SMART_MAX_ATTRIBUTES:
+ *
+ * The number of attribute slots in the SMART READ DATA page.
+ */
+#define UDISKS_ATA_SMART_MAX_ATTRIBUTES 30
+
+/**
+ * UDisksAtaSmartAttribute:
+ * @id: Attribute ID.
+ * @flags: Attribute flags.
+ * @current: Normalized current value.
+ * @current_valid: Whether @current is valid.
+ * @worst: Normalized worst value.
+ * @worst_valid: Whether @worst is valid.
+ * @threshold: Threshold from the SMART READ THRESHOLDS page.
+ * @threshold_valid: Whether @threshold is valid.
+ * @raw: Vendor specific 48-bit raw value, little-endian.
+ *
+ * A SMART attribute decoded from the SMART READ DATA and SMART READ
+ * THRESHOLDS pages.
+ */
+struct _UDisksAtaSmartAttribute
+{
+  /*< public >*/
+  guint8   id;
+  guint16  flags;
+  guint8   current;
+  gboolean current_valid;
+  guint8   worst;
+  gboolean worst_valid;
+  guint8   threshold;
+  gboolean threshold_valid;
+  guint8   raw[6];
+};
+
+/**
+ * UDisksAtaSmartData:
+ * @offline_data_collection_status: Off-line data collection status.
+ * @self_test_execution_status: Self-test execution status, the upper
+ *   four bits are the status and the lower four bits the percentage
+ *   remaining in tens of percent.
+ * @num_attributes: Number of valid elements in @attributes.
+ * @attributes: The attributes, in the order reported by the drive.
+ *
+ * Decoded SMART data. Fixed size, so it can be kept around and
+ * compared with memcmp() to find out if anything changed.
+ */
+struct _UDisksAtaSmartData
+{
+  /*< public >*/
+  guint8                  offline_data_collection_status;
+  guint8                  self_test_execution_status;
+  guint                   num_attributes;
+  UDisksAtaSmartAttribute attributes[UDISKS_ATA_SMART_MAX_ATTRIBUTES];
+};
+
+void         udisks_ata_smart_parse                 (const guchar                   *data_page,
+                                                     const guchar                   *thresholds_page,
+                                                     UDisksAtaSmartData             *out_data);
+gboolean     udisks_ata_smart_read_sync             (UDisksAtaCommandQueue          *queue,
+                                                     gint                            fd,
+                                                     UDisksAtaSmartData             *out_data,
+                                                     GCancellable                   *cancellable,
+                                                     GError                        **error);
+gboolean     udisks_ata_smart_return_status_sync    (UDisksAtaCommandQueue          *queue,
+                                                     gint                            fd,
+                                                     gboolean                       *out_failing,
+                                                     GCancellable                   *cancellable,
+                                                     GError                        **error);
+const gchar *udisks_ata_smart_attribute_get_name    (const UDisksAtaSmartAttribute  *attribute);
+guint64      udisks_ata_smart_attribute_get_pretty  (const UDisksAtaSmartAttribute  *attribute,
+                                                     UDisksAtaSmartUnit             *out_unit);
+
 
 G_END_DECLS
 
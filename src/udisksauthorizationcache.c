@@ -0,0 +1,296 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <stdlib.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksconfigmanager.h"
+#include "udisksauthorizationcache.h"
+
+/**
+ * SECTION:udisksauthorizationcache
+ * @title: UDisksAuthorizationCache
+ * @short_description: Cache of polkit authorization results
+ *
+ * If <literal>auth_cache_ttl</literal> is set in udisks2.conf(5), positive
+ * results of authorization checks done without user interaction are
+ * remembered for that many seconds, keyed by the caller's unique bus
+ * name, the action id and the polkit details of the check, so that
+ * callers issuing many privileged calls don't have to wait for a polkit
+ * round trip each time.
+ *
+ * Results obtained through an authentication dialog are never cached
+ * since polkit may require authenticating every time. The whole cache is
+ * dropped whenever the polkit authority reports a change (e.g. of its
+ * rules or temporary authorizations) and whenever systemd-logind (or
+ * elogind) emits a signal, since a change of the sessions or the active
+ * session may change the results of the checks.
+ */
+
+struct _UDisksAuthorizationCache
+{
+  UDisksDaemon *daemon;
+
+  gint64 ttl_usec;
+
+  PolkitAuthority *authority;
+  gulong authority_changed_handler_id;
+  guint login1_subscription_id;
+
+  /* protects entries */
+  GMutex lock;
+  /* maps from key to the monotonic time it expires, as gint64 */
+  GHashTable *entries;
+};
+
+static void
+on_authority_changed (PolkitAuthority *authority,
+                      gpointer         user_data)
+{
+  UDisksAuthorizationCache *cache = user_data;
+
+  udisks_debug ("polkit authority changed, dropping cached authorizations");
+  udisks_authorization_cache_invalidate (cache);
+}
+
+static void
+on_login1_signal (GDBusConnection *connection,
+                  const gchar     *sender_name,
+                  const gchar     *object_path,
+                  const gchar     *interface_name,
+                  const gchar     *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+  UDisksAuthorizationCache *cache = user_data;
+
+  udisks_debug ("%s.%s on %s, dropping cached authorizations", interface_name, signal_name, object_path);
+  udisks_authorization_cache_invalidate (cache);
+}
+
+/**
+ * udisks_authorization_cache_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new #UDisksAuthorizationCache for @daemon. The cache is only
+ * enabled if the <literal>auth_cache_ttl</literal> configuration option is
+ * set and polkit is available.
+ *
+ * Returns: A #UDisksAuthorizationCache. Free with udisks_authorization_cache_free().
+ */
+UDisksAuthorizationCache *
+udisks_authorization_cache_new (UDisksDaemon *daemon)
+{
+  UDisksAuthorizationCache *cache;
+  guint ttl;
+
+  cache = g_new0 (UDisksAuthorizationCache, 1);
+  cache->daemon = daemon;
+  g_mutex_init (&cache->lock);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  ttl = udisks_config_manager_get_auth_cache_ttl (udisks_daemon_get_config_manager (daemon));
+  if (ttl == 0 || udisks_daemon_get_authority (daemon) == NULL)
+    return cache;
+
+  cache->ttl_usec = (gint64) ttl * G_USEC_PER_SEC;
+  cache->authority = g_object_ref (udisks_daemon_get_authority (daemon));
+  cache->authority_changed_handler_id = g_signal_connect (cache->authority,
+                                                          "changed",
+                                                          G_CALLBACK (on_authority_changed),
+                                                          cache);
+  cache->login1_subscription_id = g_dbus_connection_signal_subscribe (udisks_daemon_get_connection (daemon),
+                                                                      "org.freedesktop.login1",
+                                                                      NULL, /* interface */
+                                                                      NULL, /* member */
+                                                                      NULL, /* path */
+                                                                      NULL, /* arg0 */
+                                                                      G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                      on_login1_signal,
+                                                                      cache,
+                                                                      NULL); /* GDestroyNotify */
+  udisks_notice ("Caching positive authorization results for %u seconds", ttl);
+
+  return cache;
+}
+
+/**
+ * udisks_authorization_cache_free:
+ * @cache: A #UDisksAuthorizationCache.
+ *
+ * Frees @cache.
+ */
+void
+udisks_authorization_cache_free (UDisksAuthorizationCache *cache)
+{
+  if (cache->authority != NULL)
+    {
+      g_signal_handler_disconnect (cache->authority, cache->authority_changed_handler_id);
+      g_object_unref (cache->authority);
+      g_dbus_connection_signal_unsubscribe (udisks_daemon_get_connection (cache->daemon),
+                                            cache->login1_subscription_id);
+    }
+  g_hash_table_unref (cache->entries);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+/**
+ * udisks_authorization_cache_get_enabled:
+ * @cache: A #UDisksAuthorizationCache.
+ *
+ * Gets whether authorization results are cached at all.
+ *
+ * Returns: %TRUE if @cache is enabled, %FALSE otherwise.
+ */
+gboolean
+udisks_authorization_cache_get_enabled (UDisksAuthorizationCache *cache)
+{
+  return cache->ttl_usec > 0;
+}
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/**
+ * udisks_authorization_cache_build_key:
+ * @subject: The unique bus name of the caller.
+ * @action_id: The polkit action id.
+ * @details: The #PolkitDetails of the check.
+ *
+ * Builds the key a result is cached under. All the details are part of
+ * the key since polkit rules may use any of them.
+ *
+ * Returns: The key. Free with g_free().
+ */
+gchar *
+udisks_authorization_cache_build_key (const gchar   *subject,
+                                      const gchar   *action_id,
+                                      PolkitDetails *details)
+{
+  GString *key;
+  gchar **keys;
+  guint n;
+
+  key = g_string_new (NULL);
+  g_string_append_printf (key, "%s\n%s", subject, action_id);
+
+  keys = polkit_details_get_keys (details);
+  if (keys != NULL)
+    {
+      qsort (keys, g_strv_length (keys), sizeof (gchar *), compare_strings);
+      for (n = 0; keys[n] != NULL; n++)
+        g_string_append_printf (key, "\n%s=%s", keys[n], polkit_details_lookup (details, keys[n]));
+      g_strfreev (keys);
+    }
+
+  return g_string_free (key, FALSE);
+}
+
+/**
+ * udisks_authorization_cache_lookup:
+ * @cache: A #UDisksAuthorizationCache.
+ * @key: A key from udisks_authorization_cache_build_key().
+ *
+ * Checks whether a positive result is cached for @key. May be called
+ * from any thread.
+ *
+ * Returns: %TRUE if the check for @key is known to succeed, %FALSE otherwise.
+ */
+gboolean
+udisks_authorization_cache_lookup (UDisksAuthorizationCache *cache,
+                                   const gchar              *key)
+{
+  gint64 *expires;
+  gboolean ret = FALSE;
+
+  if (cache->ttl_usec == 0)
+    return FALSE;
+
+  g_mutex_lock (&cache->lock);
+  expires = g_hash_table_lookup (cache->entries, key);
+  if (expires != NULL)
+    {
+      if (*expires > g_get_monotonic_time ())
+        ret = TRUE;
+      else
+        g_hash_table_remove (cache->entries, key);
+    }
+  g_mutex_unlock (&cache->lock);
+
+  return ret;
+}
+
+/**
+ * udisks_authorization_cache_add:
+ * @cache: A #UDisksAuthorizationCache.
+ * @key: A key from udisks_authorization_cache_build_key().
+ *
+ * Remembers that the check for @key succeeded without user interaction.
+ * May be called from any thread.
+ */
+void
+udisks_authorization_cache_add (UDisksAuthorizationCache *cache,
+                                const gchar              *key)
+{
+  GHashTableIter iter;
+  gint64 *expires;
+  gint64 now;
+
+  if (cache->ttl_usec == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  g_mutex_lock (&cache->lock);
+
+  /* drop expired entries (e.g. of callers that have gone away) */
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &expires))
+    if (*expires <= now)
+      g_hash_table_iter_remove (&iter);
+
+  expires = g_new (gint64, 1);
+  *expires = now + cache->ttl_usec;
+  g_hash_table_replace (cache->entries, g_strdup (key), expires);
+
+  g_mutex_unlock (&cache->lock);
+}
+
+/**
+ * udisks_authorization_cache_invalidate:
+ * @cache: A #UDisksAuthorizationCache.
+ *
+ * Drops all the cached results. May be called from any thread.
+ */
+void
+udisks_authorization_cache_invalidate (UDisksAuthorizationCache *cache)
+{
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove_all (cache->entries);
+  g_mutex_unlock (&cache->lock);
+}
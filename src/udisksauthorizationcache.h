@@ -0,0 +1,42 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_AUTHORIZATION_CACHE_H__
+#define __UDISKS_AUTHORIZATION_CACHE_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+UDisksAuthorizationCache *udisks_authorization_cache_new         (UDisksDaemon             *daemon);
+void                      udisks_authorization_cache_free        (UDisksAuthorizationCache *cache);
+gboolean                  udisks_authorization_cache_get_enabled (UDisksAuthorizationCache *cache);
+gchar                    *udisks_authorization_cache_build_key   (const gchar              *subject,
+                                                                  const gchar              *action_id,
+                                                                  PolkitDetails            *details);
+gboolean                  udisks_authorization_cache_lookup      (UDisksAuthorizationCache *cache,
+                                                                  const gchar              *key);
+void                      udisks_authorization_cache_add         (UDisksAuthorizationCache *cache,
+                                                                  const gchar              *key);
+void                      udisks_authorization_cache_invalidate  (UDisksAuthorizationCache *cache);
+
+G_END_DECLS
+
+#endif /* __UDISKS_AUTHORIZATION_CACHE_H__ */
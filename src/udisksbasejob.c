@@ -31,6 +31,12 @@
 
 #define MAX_SAMPLES 100
 
+/* Weight of the newest speed measurement in the smoothed speed */
+#define SPEED_SMOOTHING_FACTOR 0.3
+
+/* Minimum interval between updates of the Rate and ExpectedEndTime properties */
+#define ESTIMATE_UPDATE_INTERVAL_USEC (G_USEC_PER_SEC)
+
 typedef struct
 {
   gint64 time_usec;
@@ -53,8 +59,13 @@ struct _UDisksBaseJobPrivate
   gboolean auto_estimate;
   gulong notify_progress_signal_handler_id;
 
+  /* ring buffer, the oldest sample is at samples[first_sample] */
   Sample *samples;
   guint num_samples;
+  guint first_sample;
+
+  gdouble smoothed_speed;
+  gint64 last_estimate_usec;
 };
 
 static void job_iface_init (UDisksJobIface *iface);
@@ -460,11 +471,10 @@ on_notify_progress (GObject     *object,
                     gpointer     user_data)
 {
   UDisksBaseJob *job = UDISKS_BASE_JOB (user_data);
+  UDisksBaseJobPrivate *priv = job->priv;
+  Sample *oldest;
   Sample *sample;
-  guint n;
-  gdouble sum_of_speeds;
-  guint num_speeds;
-  gdouble avg_speed;
+  gdouble speed;
   gint64 usec_remaining;
   gint64 now;
   guint64 bytes;
@@ -473,46 +483,52 @@ on_notify_progress (GObject     *object,
   now = g_get_real_time ();
   current_progress = udisks_job_get_progress (UDISKS_JOB (job));
 
-  /* first add new sample... */
-  if (job->priv->num_samples == MAX_SAMPLES)
+  /* first add new sample, overwriting the oldest one when full... */
+  if (priv->num_samples == MAX_SAMPLES)
     {
-      memmove (job->priv->samples, job->priv->samples + 1, sizeof (Sample) * (MAX_SAMPLES - 1));
-      job->priv->num_samples -= 1;
+      sample = &priv->samples[priv->first_sample];
+      priv->first_sample = (priv->first_sample + 1) % MAX_SAMPLES;
+    }
+  else
+    {
+      sample = &priv->samples[(priv->first_sample + priv->num_samples) % MAX_SAMPLES];
+      priv->num_samples++;
     }
-  sample = &job->priv->samples[job->priv->num_samples++];
   sample->time_usec = now;
   sample->value = current_progress;
 
-  /* ... then update expected-end-time from samples - we want at
+  /* ... then update the speed over the window of samples - we want at
    * least five samples before making an estimate...
    */
-  if (job->priv->num_samples < 5)
+  if (priv->num_samples < 5)
     goto out;
 
-  num_speeds = 0;
-  sum_of_speeds = 0.0;
-  for (n = 1; n < job->priv->num_samples; n++)
-    {
-      Sample *a = &job->priv->samples[n-1];
-      Sample *b = &job->priv->samples[n];
-      gdouble speed;
-      speed = (b->value - a->value) / (b->time_usec - a->time_usec);
-      sum_of_speeds += speed;
-      num_speeds++;
-    }
-  avg_speed = sum_of_speeds / num_speeds;
+  oldest = &priv->samples[priv->first_sample];
+  if (sample->time_usec <= oldest->time_usec)
+    goto out;
+  speed = (sample->value - oldest->value) / (sample->time_usec - oldest->time_usec);
+  if (priv->smoothed_speed > 0.0)
+    speed = SPEED_SMOOTHING_FACTOR * speed + (1.0 - SPEED_SMOOTHING_FACTOR) * priv->smoothed_speed;
+  priv->smoothed_speed = speed;
+
+  /* ... and publish the estimate, but not more often than once per
+   * interval to not flood the bus for jobs updating progress rapidly */
+  if (speed <= 0.0 ||
+      (priv->last_estimate_usec != 0 && now - priv->last_estimate_usec < ESTIMATE_UPDATE_INTERVAL_USEC))
+    goto out;
+  priv->last_estimate_usec = now;
 
   bytes = udisks_job_get_bytes (UDISKS_JOB (job));
   if (bytes > 0)
     {
-      udisks_job_set_rate (UDISKS_JOB (job), bytes * avg_speed * G_USEC_PER_SEC);
+      udisks_job_set_rate (UDISKS_JOB (job), bytes * speed * G_USEC_PER_SEC);
     }
   else
     {
       udisks_job_set_rate (UDISKS_JOB (job), 0);
     }
 
-  usec_remaining = (1.0 - current_progress) / avg_speed;
+  usec_remaining = (1.0 - current_progress) / speed;
   udisks_job_set_expected_end_time (UDISKS_JOB (job), now + usec_remaining);
 
  out:
@@ -0,0 +1,275 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udiskscallercache.h"
+
+/**
+ * SECTION:udiskscallercache
+ * @title: UDisksCallerCache
+ * @short_description: Cache of the credentials of callers
+ *
+ * The credentials of a peer on the message bus can't change while it
+ * stays connected and its unique name is never reused, so they only
+ * need to be asked from the bus daemon once per caller. The entries are
+ * dropped once the bus daemon reports the caller has disconnected.
+ */
+
+struct _UDisksCallerCache
+{
+  UDisksDaemon *daemon;
+
+  guint name_owner_changed_subscription_id;
+
+  /* protects credentials */
+  GMutex lock;
+  /* maps from unique bus name to Credentials */
+  GHashTable *credentials;
+};
+
+typedef struct
+{
+  uid_t uid;
+  pid_t pid;
+} Credentials;
+
+/* called in the main thread */
+static void
+on_name_owner_changed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  UDisksCallerCache *cache = user_data;
+  const gchar *name;
+  const gchar *old_owner;
+  const gchar *new_owner;
+
+  g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+  if (name[0] != ':' || new_owner[0] != '\0')
+    return;
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove (cache->credentials, name);
+  g_mutex_unlock (&cache->lock);
+}
+
+/**
+ * udisks_caller_cache_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new #UDisksCallerCache for the callers on the connection of
+ * @daemon. Must be called from the main thread.
+ *
+ * Returns: A #UDisksCallerCache. Free with udisks_caller_cache_free().
+ */
+UDisksCallerCache *
+udisks_caller_cache_new (UDisksDaemon *daemon)
+{
+  UDisksCallerCache *cache;
+
+  cache = g_new0 (UDisksCallerCache, 1);
+  cache->daemon = daemon;
+  g_mutex_init (&cache->lock);
+  cache->credentials = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  cache->name_owner_changed_subscription_id =
+    g_dbus_connection_signal_subscribe (udisks_daemon_get_connection (daemon),
+                                        "org.freedesktop.DBus",
+                                        "org.freedesktop.DBus",
+                                        "NameOwnerChanged",
+                                        "/org/freedesktop/DBus",
+                                        NULL, /* arg0 */
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_name_owner_changed,
+                                        cache,
+                                        NULL); /* GDestroyNotify */
+
+  return cache;
+}
+
+/**
+ * udisks_caller_cache_free:
+ * @cache: A #UDisksCallerCache.
+ *
+ * Frees @cache.
+ */
+void
+udisks_caller_cache_free (UDisksCallerCache *cache)
+{
+  g_dbus_connection_signal_unsubscribe (udisks_daemon_get_connection (cache->daemon),
+                                        cache->name_owner_changed_subscription_id);
+  g_hash_table_unref (cache->credentials);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
+
+static gboolean
+get_credentials_sync (GDBusConnection  *connection,
+                      const gchar      *caller,
+                      GCancellable     *cancellable,
+                      Credentials      *out_credentials,
+                      GError          **error)
+{
+  GVariant *value;
+  GVariant *dict;
+  guint32 uid;
+  guint32 pid;
+  gboolean ret = FALSE;
+
+  G_STATIC_ASSERT (sizeof (uid_t) == sizeof (guint32));
+  G_STATIC_ASSERT (sizeof (pid_t) == sizeof (guint32));
+
+  /* a single round trip for both the uid and the pid */
+  value = g_dbus_connection_call_sync (connection,
+                                       "org.freedesktop.DBus",  /* bus name */
+                                       "/org/freedesktop/DBus", /* object path */
+                                       "org.freedesktop.DBus",  /* interface */
+                                       "GetConnectionCredentials",
+                                       g_variant_new ("(s)", caller),
+                                       G_VARIANT_TYPE ("(a{sv})"),
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1, /* timeout_msec */
+                                       cancellable,
+                                       error);
+  if (value == NULL)
+    goto out;
+
+  dict = g_variant_get_child_value (value, 0);
+  if (!g_variant_lookup (dict, "UnixUserID", "u", &uid) ||
+      !g_variant_lookup (dict, "ProcessID", "u", &pid))
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "The bus doesn't know the UNIX credentials of the caller");
+      g_variant_unref (dict);
+      g_variant_unref (value);
+      goto out;
+    }
+  g_variant_unref (dict);
+  g_variant_unref (value);
+
+  out_credentials->uid = uid;
+  /* NOTE: pid_t is a signed 32 bit, but the bus returns an unsigned */
+  out_credentials->pid = (pid_t) pid;
+  ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/**
+ * udisks_caller_cache_get_credentials:
+ * @cache: A #UDisksCallerCache.
+ * @connection: The #GDBusConnection @caller is on.
+ * @caller: (allow-none): The unique bus name of the caller or %NULL for the peer of a peer-to-peer @connection.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @out_uid: (out) (allow-none): Return location for the uid or %NULL.
+ * @out_pid: (out) (allow-none): Return location for the pid or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Gets the UNIX user and process id of @caller, asking the bus daemon
+ * only if they are not cached yet. On peer-to-peer connections (with a
+ * %NULL @caller) the credentials of the socket are used instead. May be
+ * called from any thread.
+ *
+ * Returns: %TRUE if the credentials were obtained, %FALSE if @error is set.
+ */
+gboolean
+udisks_caller_cache_get_credentials (UDisksCallerCache  *cache,
+                                     GDBusConnection    *connection,
+                                     const gchar        *caller,
+                                     GCancellable       *cancellable,
+                                     uid_t              *out_uid,
+                                     pid_t              *out_pid,
+                                     GError            **error)
+{
+  Credentials *credentials;
+  Credentials fetched;
+  GError *local_error = NULL;
+
+  if (caller == NULL)
+    {
+      GCredentials *peer_credentials;
+
+      peer_credentials = g_dbus_connection_get_peer_credentials (connection);
+      if (peer_credentials == NULL)
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "The UNIX credentials of the peer are not known");
+          return FALSE;
+        }
+      fetched.uid = g_credentials_get_unix_user (peer_credentials, error);
+      if (fetched.uid == (uid_t) -1)
+        return FALSE;
+      fetched.pid = g_credentials_get_unix_pid (peer_credentials, error);
+      if (fetched.pid == -1)
+        return FALSE;
+      goto out;
+    }
+
+  g_mutex_lock (&cache->lock);
+  credentials = g_hash_table_lookup (cache->credentials, caller);
+  if (credentials != NULL)
+    fetched = *credentials;
+  g_mutex_unlock (&cache->lock);
+
+  if (credentials == NULL)
+    {
+      if (!get_credentials_sync (connection, caller, cancellable, &fetched, &local_error))
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error determining uid of caller %s: %s (%s, %d)",
+                       caller,
+                       local_error->message,
+                       g_quark_to_string (local_error->domain),
+                       local_error->code);
+          g_clear_error (&local_error);
+          return FALSE;
+        }
+
+      /* only cache callers on our own connection, we only track the names on it */
+      if (connection == udisks_daemon_get_connection (cache->daemon))
+        {
+          g_mutex_lock (&cache->lock);
+          g_hash_table_replace (cache->credentials, g_strdup (caller), g_memdup (&fetched, sizeof fetched));
+          g_mutex_unlock (&cache->lock);
+        }
+    }
+
+ out:
+  if (out_uid != NULL)
+    *out_uid = fetched.uid;
+  if (out_pid != NULL)
+    *out_pid = fetched.pid;
+
+  return TRUE;
+}
@@ -0,0 +1,40 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_CALLER_CACHE_H__
+#define __UDISKS_CALLER_CACHE_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+UDisksCallerCache *udisks_caller_cache_new             (UDisksDaemon       *daemon);
+void               udisks_caller_cache_free            (UDisksCallerCache  *cache);
+gboolean           udisks_caller_cache_get_credentials (UDisksCallerCache  *cache,
+                                                        GDBusConnection    *connection,
+                                                        const gchar        *caller,
+                                                        GCancellable       *cancellable,
+                                                        uid_t              *out_uid,
+                                                        pid_t              *out_pid,
+                                                        GError            **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_CALLER_CACHE_H__ */
@@ -36,6 +36,41 @@ struct _UDisksConfigManager {
   GList *modules;
 
   const gchar *encryption;
+
+  guint housekeeping_max_parallel;
+  guint housekeeping_max_parallel_per_controller;
+
+  guint jobs_max_parallel;
+  guint jobs_max_parallel_per_drive;
+
+  guint64 jobs_io_max_bandwidth;
+  guint jobs_io_max_iops;
+
+  guint method_calls_max_threads;
+  guint method_calls_max_threads_per_caller;
+
+  guint metrics_file_interval;
+
+  guint statistics_interval;
+
+  guint usage_interval;
+
+  guint health_temperature_threshold;
+
+  guint auth_cache_ttl;
+
+  gboolean probe_snapshot;
+
+  guint idle_exit_timeout;
+
+  UDisksPassiveDevices passive_devices;
+
+  gboolean private_socket;
+
+  guint trim_interval;
+  guint64 trim_max_bandwidth;
+
+  guint uevent_buffer_size;
 };
 
 struct _UDisksConfigManagerClass {
@@ -56,6 +91,26 @@ enum
 #define MODULES_GROUP_NAME  PACKAGE_NAME_UDISKS2
 #define MODULES_KEY "modules"
 #define MODULES_LOAD_PREFERENCE_KEY "modules_load_preference"
+#define HOUSEKEEPING_MAX_PARALLEL_KEY "housekeeping_max_parallel"
+#define HOUSEKEEPING_MAX_PARALLEL_PER_CONTROLLER_KEY "housekeeping_max_parallel_per_controller"
+#define JOBS_MAX_PARALLEL_KEY "jobs_max_parallel"
+#define JOBS_MAX_PARALLEL_PER_DRIVE_KEY "jobs_max_parallel_per_drive"
+#define JOBS_IO_MAX_BANDWIDTH_KEY "jobs_io_max_bandwidth"
+#define JOBS_IO_MAX_IOPS_KEY "jobs_io_max_iops"
+#define METHOD_CALLS_MAX_THREADS_KEY "method_calls_max_threads"
+#define METHOD_CALLS_MAX_THREADS_PER_CALLER_KEY "method_calls_max_threads_per_caller"
+#define METRICS_FILE_INTERVAL_KEY "metrics_file_interval"
+#define STATISTICS_INTERVAL_KEY "statistics_interval"
+#define USAGE_INTERVAL_KEY "usage_interval"
+#define HEALTH_TEMPERATURE_THRESHOLD_KEY "health_temperature_threshold"
+#define AUTH_CACHE_TTL_KEY "auth_cache_ttl"
+#define PROBE_SNAPSHOT_KEY "probe_snapshot"
+#define IDLE_EXIT_TIMEOUT_KEY "idle_exit_timeout"
+#define PASSIVE_DEVICES_KEY "passive_devices"
+#define PRIVATE_SOCKET_KEY "private_socket"
+#define TRIM_INTERVAL_KEY "trim_interval"
+#define TRIM_MAX_BANDWIDTH_KEY "trim_max_bandwidth"
+#define UEVENT_BUFFER_SIZE_KEY "uevent_buffer_size"
 
 #define DEFAULTS_GROUP_NAME "defaults"
 #define DEFAULTS_ENCRYPTION_KEY "encryption"
@@ -146,6 +201,11 @@ udisks_config_manager_constructed (GObject *object)
   gchar *conf_filename;
   gchar *load_preference;
   gchar *encryption;
+  gchar *passive_devices;
+  gint max_parallel;
+  gboolean probe_snapshot;
+  gboolean private_socket;
+  GError *error = NULL;
   gchar *module_i;
   gchar **modules;
   gchar **modules_tmp;
@@ -173,6 +233,26 @@ udisks_config_manager_constructed (GObject *object)
     }
   manager->load_preference = UDISKS_MODULE_LOAD_ONDEMAND;
   manager->encryption = UDISKS_ENCRYPTION_DEFAULT;
+  manager->housekeeping_max_parallel = UDISKS_HOUSEKEEPING_MAX_PARALLEL_DEFAULT;
+  manager->housekeeping_max_parallel_per_controller = UDISKS_HOUSEKEEPING_MAX_PARALLEL_PER_CONTROLLER_DEFAULT;
+  manager->jobs_max_parallel = UDISKS_JOBS_MAX_PARALLEL_DEFAULT;
+  manager->jobs_max_parallel_per_drive = UDISKS_JOBS_MAX_PARALLEL_PER_DRIVE_DEFAULT;
+  manager->jobs_io_max_bandwidth = UDISKS_JOBS_IO_MAX_BANDWIDTH_DEFAULT;
+  manager->jobs_io_max_iops = UDISKS_JOBS_IO_MAX_IOPS_DEFAULT;
+  manager->method_calls_max_threads = UDISKS_METHOD_CALLS_MAX_THREADS_DEFAULT;
+  manager->method_calls_max_threads_per_caller = UDISKS_METHOD_CALLS_MAX_THREADS_PER_CALLER_DEFAULT;
+  manager->metrics_file_interval = UDISKS_METRICS_FILE_INTERVAL_DEFAULT;
+  manager->statistics_interval = UDISKS_STATISTICS_INTERVAL_DEFAULT;
+  manager->usage_interval = UDISKS_USAGE_INTERVAL_DEFAULT;
+  manager->health_temperature_threshold = UDISKS_HEALTH_TEMPERATURE_THRESHOLD_DEFAULT;
+  manager->auth_cache_ttl = UDISKS_AUTH_CACHE_TTL_DEFAULT;
+  manager->probe_snapshot = UDISKS_PROBE_SNAPSHOT_DEFAULT;
+  manager->idle_exit_timeout = UDISKS_IDLE_EXIT_TIMEOUT_DEFAULT;
+  manager->passive_devices = UDISKS_PASSIVE_DEVICES_DEFAULT;
+  manager->private_socket = UDISKS_PRIVATE_SOCKET_DEFAULT;
+  manager->trim_interval = UDISKS_TRIM_INTERVAL_DEFAULT;
+  manager->trim_max_bandwidth = UDISKS_TRIM_MAX_BANDWIDTH_DEFAULT;
+  manager->uevent_buffer_size = UDISKS_UEVENT_BUFFER_SIZE_DEFAULT;
 
   /* Load config */
   if (g_key_file_load_from_file (config_file,
@@ -215,6 +295,10 @@ udisks_config_manager_constructed (GObject *object)
             {
               manager->load_preference = UDISKS_MODULE_LOAD_ONSTARTUP;
             }
+          else if (g_ascii_strcasecmp (load_preference, "lazy") == 0)
+            {
+              manager->load_preference = UDISKS_MODULE_LOAD_LAZY;
+            }
           else
             {
               udisks_warning ("Unknown value used for 'modules_load_preference': %s"
@@ -229,6 +313,478 @@ udisks_config_manager_constructed (GObject *object)
           udisks_debug ("No 'modules_load_preference' found in configuration file");
         }
 
+      /* Read the number of drives to housekeep at the same time. */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             HOUSEKEEPING_MAX_PARALLEL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel > 0)
+            {
+              manager->housekeeping_max_parallel = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'housekeeping_max_parallel': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->housekeeping_max_parallel);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'housekeeping_max_parallel' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the number of drives behind the same controller to housekeep at the same time. */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             HOUSEKEEPING_MAX_PARALLEL_PER_CONTROLLER_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel > 0)
+            {
+              manager->housekeeping_max_parallel_per_controller = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'housekeeping_max_parallel_per_controller': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->housekeeping_max_parallel_per_controller);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'housekeeping_max_parallel_per_controller' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the number of jobs to run at the same time (0 means no limit). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             JOBS_MAX_PARALLEL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->jobs_max_parallel = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'jobs_max_parallel': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->jobs_max_parallel);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'jobs_max_parallel' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the number of jobs on the same drive to run at the same time (0 means no limit). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             JOBS_MAX_PARALLEL_PER_DRIVE_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->jobs_max_parallel_per_drive = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'jobs_max_parallel_per_drive': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->jobs_max_parallel_per_drive);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'jobs_max_parallel_per_drive' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the bandwidth limit of the I/O done by jobs in MiB/s (0 means no limit). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             JOBS_IO_MAX_BANDWIDTH_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->jobs_io_max_bandwidth = (guint64) max_parallel * 1024 * 1024;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'jobs_io_max_bandwidth': %d"
+                              "; defaulting to %d",
+                              max_parallel, UDISKS_JOBS_IO_MAX_BANDWIDTH_DEFAULT);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'jobs_io_max_bandwidth' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the limit of I/O requests per second done by jobs (0 means no limit). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             JOBS_IO_MAX_IOPS_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->jobs_io_max_iops = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'jobs_io_max_iops': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->jobs_io_max_iops);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'jobs_io_max_iops' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the number of method calls to handle at the same time (at least 1). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             METHOD_CALLS_MAX_THREADS_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel > 0)
+            {
+              manager->method_calls_max_threads = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'method_calls_max_threads': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->method_calls_max_threads);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'method_calls_max_threads' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the number of method calls of the same caller to handle at the same time (0 means no limit). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             METHOD_CALLS_MAX_THREADS_PER_CALLER_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->method_calls_max_threads_per_caller = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'method_calls_max_threads_per_caller': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->method_calls_max_threads_per_caller);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'method_calls_max_threads_per_caller' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read how often the metrics file is written (0 means never). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             METRICS_FILE_INTERVAL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->metrics_file_interval = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'metrics_file_interval': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->metrics_file_interval);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'metrics_file_interval' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read how often drive statistics are sampled while clients subscribe to them. */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             STATISTICS_INTERVAL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel > 0)
+            {
+              manager->statistics_interval = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'statistics_interval': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->statistics_interval);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'statistics_interval' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read how often filesystem usage is sampled while clients subscribe to it. */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             USAGE_INTERVAL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel > 0)
+            {
+              manager->usage_interval = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'usage_interval': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->usage_interval);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'usage_interval' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the temperature above which drives count as over temperature in the health summary. */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             HEALTH_TEMPERATURE_THRESHOLD_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel > 0)
+            {
+              manager->health_temperature_threshold = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'health_temperature_threshold': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->health_temperature_threshold);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'health_temperature_threshold' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read how long positive authorization results are cached (0 means not at all). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             AUTH_CACHE_TTL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->auth_cache_ttl = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'auth_cache_ttl': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->auth_cache_ttl);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'auth_cache_ttl' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read whether the probed device data is kept across restarts. */
+      probe_snapshot = g_key_file_get_boolean (config_file,
+                                               MODULES_GROUP_NAME,
+                                               PROBE_SNAPSHOT_KEY,
+                                               &error);
+      if (error == NULL)
+        {
+          manager->probe_snapshot = probe_snapshot;
+        }
+      else
+        {
+          udisks_debug ("No valid 'probe_snapshot' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read after how long without clients the daemon exits (0 means never). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             IDLE_EXIT_TIMEOUT_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->idle_exit_timeout = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'idle_exit_timeout': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->idle_exit_timeout);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'idle_exit_timeout' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read how block devices used only through other devices are exported. */
+      passive_devices = g_key_file_get_string (config_file,
+                                               MODULES_GROUP_NAME,
+                                               PASSIVE_DEVICES_KEY,
+                                               NULL);
+      if (passive_devices)
+        {
+          /* Check the key value */
+          if (g_ascii_strcasecmp (passive_devices, "full") == 0)
+            {
+              manager->passive_devices = UDISKS_PASSIVE_DEVICES_FULL;
+            }
+          else if (g_ascii_strcasecmp (passive_devices, "minimal") == 0)
+            {
+              manager->passive_devices = UDISKS_PASSIVE_DEVICES_MINIMAL;
+            }
+          else if (g_ascii_strcasecmp (passive_devices, "hidden") == 0)
+            {
+              manager->passive_devices = UDISKS_PASSIVE_DEVICES_HIDDEN;
+            }
+          else
+            {
+              udisks_warning ("Unknown value used for 'passive_devices': %s"
+                              "; defaulting to 'full'",
+                              passive_devices);
+            }
+
+          g_free (passive_devices);
+        }
+      else
+        {
+          udisks_debug ("No 'passive_devices' found in configuration file");
+        }
+
+      /* Read whether to accept peer-to-peer connections on the private socket. */
+      private_socket = g_key_file_get_boolean (config_file,
+                                               MODULES_GROUP_NAME,
+                                               PRIVATE_SOCKET_KEY,
+                                               &error);
+      if (error == NULL)
+        {
+          manager->private_socket = private_socket;
+        }
+      else
+        {
+          udisks_debug ("No valid 'private_socket' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read how often mounted filesystems are trimmed in seconds (0 means never). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             TRIM_INTERVAL_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->trim_interval = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'trim_interval': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->trim_interval);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'trim_interval' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the per-device rate limit of scheduled trims in MiB/s (0 means no limit). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             TRIM_MAX_BANDWIDTH_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0)
+            {
+              manager->trim_max_bandwidth = (guint64) max_parallel * 1024 * 1024;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'trim_max_bandwidth': %d"
+                              "; defaulting to %d",
+                              max_parallel, UDISKS_TRIM_MAX_BANDWIDTH_DEFAULT);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'trim_max_bandwidth' found in configuration file");
+          g_clear_error (&error);
+        }
+
+      /* Read the size of the receive buffer of the uevent socket in MiB (0 means the system default). */
+      max_parallel = g_key_file_get_integer (config_file,
+                                             MODULES_GROUP_NAME,
+                                             UEVENT_BUFFER_SIZE_KEY,
+                                             &error);
+      if (error == NULL)
+        {
+          if (max_parallel >= 0 && max_parallel <= 1024)
+            {
+              manager->uevent_buffer_size = max_parallel;
+            }
+          else
+            {
+              udisks_warning ("Invalid value used for 'uevent_buffer_size': %d"
+                              "; defaulting to %d",
+                              max_parallel, manager->uevent_buffer_size);
+            }
+        }
+      else
+        {
+          udisks_debug ("No valid 'uevent_buffer_size' found in configuration file");
+          g_clear_error (&error);
+        }
+
       /* Read the load preference configuration option. */
       encryption = g_key_file_get_string (config_file,
                                           DEFAULTS_GROUP_NAME,
@@ -333,7 +889,7 @@ udisks_config_manager_class_init (UDisksConfigManagerClass *klass)
                                                      "Module load preference",
                                                      "When to load the additional modules",
                                                      UDISKS_MODULE_LOAD_ONDEMAND,
-                                                     UDISKS_MODULE_LOAD_ONSTARTUP,
+                                                     UDISKS_MODULE_LOAD_LAZY,
                                                      UDISKS_MODULE_LOAD_ONDEMAND,
                                                      G_PARAM_READABLE |
                                                      G_PARAM_WRITABLE |
@@ -386,6 +942,86 @@ udisks_config_manager_get_uninstalled (UDisksConfigManager *manager)
   return manager->uninstalled;
 }
 
+static gboolean
+module_lists_equal (GList *a,
+                    GList *b)
+{
+  for (; a != NULL && b != NULL; a = a->next, b = b->next)
+    if (g_strcmp0 (a->data, b->data) != 0)
+      return FALSE;
+  return a == NULL && b == NULL;
+}
+
+#define RELOAD_VALUE(field)                   \
+  G_STMT_START {                              \
+    if (manager->field != fresh->field)       \
+      {                                       \
+        manager->field = fresh->field;        \
+        changed = TRUE;                       \
+      }                                       \
+  } G_STMT_END
+
+/**
+ * udisks_config_manager_reload:
+ * @manager: A #UDisksConfigManager.
+ *
+ * Reads the configuration file again and takes over the values of the
+ * settings that can be changed at runtime. The list of modules, the
+ * module load preference, the metrics file interval, the authorization
+ * cache TTL, the probe snapshot setting, the idle exit timeout, the way
+ * passive devices are exported and the private socket setting are only
+ * used on start-up, changes to them are logged and otherwise ignored.
+ *
+ * Returns: %TRUE if any of the runtime settings has changed, %FALSE otherwise.
+ */
+gboolean
+udisks_config_manager_reload (UDisksConfigManager *manager)
+{
+  UDisksConfigManager *fresh;
+  gboolean changed = FALSE;
+
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager), FALSE);
+
+  fresh = UDISKS_CONFIG_MANAGER (g_object_new (UDISKS_TYPE_CONFIG_MANAGER,
+                                               "uninstalled", manager->uninstalled,
+                                               NULL));
+
+  if (!module_lists_equal (manager->modules, fresh->modules) ||
+      manager->load_preference != fresh->load_preference ||
+      manager->metrics_file_interval != fresh->metrics_file_interval ||
+      manager->auth_cache_ttl != fresh->auth_cache_ttl ||
+      manager->probe_snapshot != fresh->probe_snapshot ||
+      manager->idle_exit_timeout != fresh->idle_exit_timeout ||
+      manager->passive_devices != fresh->passive_devices ||
+      manager->private_socket != fresh->private_socket)
+    udisks_notice ("Changes of the '%s', '%s', '%s', '%s', '%s', '%s', '%s' and '%s' settings take effect after a restart",
+                   MODULES_KEY, MODULES_LOAD_PREFERENCE_KEY,
+                   METRICS_FILE_INTERVAL_KEY, AUTH_CACHE_TTL_KEY,
+                   PROBE_SNAPSHOT_KEY, IDLE_EXIT_TIMEOUT_KEY,
+                   PASSIVE_DEVICES_KEY, PRIVATE_SOCKET_KEY);
+
+  RELOAD_VALUE (encryption);
+  RELOAD_VALUE (housekeeping_max_parallel);
+  RELOAD_VALUE (housekeeping_max_parallel_per_controller);
+  RELOAD_VALUE (jobs_max_parallel);
+  RELOAD_VALUE (jobs_max_parallel_per_drive);
+  RELOAD_VALUE (jobs_io_max_bandwidth);
+  RELOAD_VALUE (jobs_io_max_iops);
+  RELOAD_VALUE (method_calls_max_threads);
+  RELOAD_VALUE (method_calls_max_threads_per_caller);
+  RELOAD_VALUE (statistics_interval);
+  RELOAD_VALUE (usage_interval);
+  RELOAD_VALUE (health_temperature_threshold);
+  RELOAD_VALUE (trim_interval);
+  RELOAD_VALUE (trim_max_bandwidth);
+
+  g_object_unref (fresh);
+
+  return changed;
+}
+
+#undef RELOAD_VALUE
+
 const GList *
 udisks_config_manager_get_modules (UDisksConfigManager *manager)
 {
@@ -417,3 +1053,163 @@ udisks_config_manager_get_encryption (UDisksConfigManager *manager)
                         UDISKS_ENCRYPTION_DEFAULT);
   return manager->encryption;
 }
+
+guint
+udisks_config_manager_get_housekeeping_max_parallel (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_HOUSEKEEPING_MAX_PARALLEL_DEFAULT);
+  return manager->housekeeping_max_parallel;
+}
+
+guint
+udisks_config_manager_get_housekeeping_max_parallel_per_controller (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_HOUSEKEEPING_MAX_PARALLEL_PER_CONTROLLER_DEFAULT);
+  return manager->housekeeping_max_parallel_per_controller;
+}
+
+guint
+udisks_config_manager_get_jobs_max_parallel (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_JOBS_MAX_PARALLEL_DEFAULT);
+  return manager->jobs_max_parallel;
+}
+
+guint
+udisks_config_manager_get_jobs_max_parallel_per_drive (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_JOBS_MAX_PARALLEL_PER_DRIVE_DEFAULT);
+  return manager->jobs_max_parallel_per_drive;
+}
+
+guint64
+udisks_config_manager_get_jobs_io_max_bandwidth (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_JOBS_IO_MAX_BANDWIDTH_DEFAULT);
+  return manager->jobs_io_max_bandwidth;
+}
+
+guint
+udisks_config_manager_get_jobs_io_max_iops (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_JOBS_IO_MAX_IOPS_DEFAULT);
+  return manager->jobs_io_max_iops;
+}
+
+guint
+udisks_config_manager_get_method_calls_max_threads (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_METHOD_CALLS_MAX_THREADS_DEFAULT);
+  return manager->method_calls_max_threads;
+}
+
+guint
+udisks_config_manager_get_method_calls_max_threads_per_caller (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_METHOD_CALLS_MAX_THREADS_PER_CALLER_DEFAULT);
+  return manager->method_calls_max_threads_per_caller;
+}
+
+guint
+udisks_config_manager_get_metrics_file_interval (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_METRICS_FILE_INTERVAL_DEFAULT);
+  return manager->metrics_file_interval;
+}
+
+guint
+udisks_config_manager_get_statistics_interval (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_STATISTICS_INTERVAL_DEFAULT);
+  return manager->statistics_interval;
+}
+
+guint
+udisks_config_manager_get_usage_interval (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_USAGE_INTERVAL_DEFAULT);
+  return manager->usage_interval;
+}
+
+guint
+udisks_config_manager_get_health_temperature_threshold (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_HEALTH_TEMPERATURE_THRESHOLD_DEFAULT);
+  return manager->health_temperature_threshold;
+}
+
+guint
+udisks_config_manager_get_auth_cache_ttl (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_AUTH_CACHE_TTL_DEFAULT);
+  return manager->auth_cache_ttl;
+}
+
+gboolean
+udisks_config_manager_get_probe_snapshot (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_PROBE_SNAPSHOT_DEFAULT);
+  return manager->probe_snapshot;
+}
+
+guint
+udisks_config_manager_get_idle_exit_timeout (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_IDLE_EXIT_TIMEOUT_DEFAULT);
+  return manager->idle_exit_timeout;
+}
+
+UDisksPassiveDevices
+udisks_config_manager_get_passive_devices (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_PASSIVE_DEVICES_DEFAULT);
+  return manager->passive_devices;
+}
+
+gboolean
+udisks_config_manager_get_private_socket (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_PRIVATE_SOCKET_DEFAULT);
+  return manager->private_socket;
+}
+
+guint
+udisks_config_manager_get_trim_interval (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_TRIM_INTERVAL_DEFAULT);
+  return manager->trim_interval;
+}
+
+guint64
+udisks_config_manager_get_trim_max_bandwidth (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_TRIM_MAX_BANDWIDTH_DEFAULT);
+  return manager->trim_max_bandwidth;
+}
+
+guint
+udisks_config_manager_get_uevent_buffer_size (UDisksConfigManager *manager)
+{
+  g_return_val_if_fail (UDISKS_IS_CONFIG_MANAGER (manager),
+                        UDISKS_UEVENT_BUFFER_SIZE_DEFAULT);
+  return manager->uevent_buffer_size;
+}
@@ -36,30 +36,116 @@ G_BEGIN_DECLS
  * UDisksModuleLoadPreference:
  * @UDISKS_MODULE_LOAD_ONDEMAND
  * @UDISKS_MODULE_LOAD_ONSTARTUP
+ * @UDISKS_MODULE_LOAD_LAZY: Load every module when it's first needed. Since 2.9.0.
  *
  * Enumeration used to specify when to load additional modules.
  */
 typedef enum
 {
  UDISKS_MODULE_LOAD_ONDEMAND,
- UDISKS_MODULE_LOAD_ONSTARTUP
+ UDISKS_MODULE_LOAD_ONSTARTUP,
+ UDISKS_MODULE_LOAD_LAZY
 } UDisksModuleLoadPreference;
 
+/**
+ * UDisksPassiveDevices:
+ * @UDISKS_PASSIVE_DEVICES_FULL: Export passive devices like all other block devices.
+ * @UDISKS_PASSIVE_DEVICES_MINIMAL: Export passive devices with the #UDisksBlock interface only.
+ * @UDISKS_PASSIVE_DEVICES_HIDDEN: Don't export passive devices at all.
+ *
+ * Enumeration used to specify how block devices that are only used through
+ * other block devices are exported, see udisks_linux_device_is_passive().
+ */
+typedef enum
+{
+ UDISKS_PASSIVE_DEVICES_FULL,
+ UDISKS_PASSIVE_DEVICES_MINIMAL,
+ UDISKS_PASSIVE_DEVICES_HIDDEN
+} UDisksPassiveDevices;
+
+#define UDISKS_PASSIVE_DEVICES_DEFAULT UDISKS_PASSIVE_DEVICES_FULL
+
 #define UDISKS_ENCRYPTION_LUKS1 "luks1"
 #define UDISKS_ENCRYPTION_LUKS2 "luks2"
 #define UDISKS_ENCRYPTION_DEFAULT UDISKS_ENCRYPTION_LUKS1
 
+#define UDISKS_HOUSEKEEPING_MAX_PARALLEL_DEFAULT 4
+#define UDISKS_HOUSEKEEPING_MAX_PARALLEL_PER_CONTROLLER_DEFAULT 2
+
+/* 0 means no limit */
+#define UDISKS_JOBS_MAX_PARALLEL_DEFAULT 0
+#define UDISKS_JOBS_MAX_PARALLEL_PER_DRIVE_DEFAULT 0
+#define UDISKS_JOBS_IO_MAX_BANDWIDTH_DEFAULT 0
+#define UDISKS_JOBS_IO_MAX_IOPS_DEFAULT 0
+
+/* method calls handled at the same time, overall and per caller (0 means no limit) */
+#define UDISKS_METHOD_CALLS_MAX_THREADS_DEFAULT 32
+#define UDISKS_METHOD_CALLS_MAX_THREADS_PER_CALLER_DEFAULT 8
+
+/* seconds, 0 means the metrics file is not written */
+#define UDISKS_METRICS_FILE_INTERVAL_DEFAULT 0
+
+/* seconds between samples of the Drive.Statistics interface */
+#define UDISKS_STATISTICS_INTERVAL_DEFAULT 5
+
+/* seconds between samples of the usage of mounted filesystems */
+#define UDISKS_USAGE_INTERVAL_DEFAULT 30
+
+/* degrees Celsius, see Manager:HealthSummary */
+#define UDISKS_HEALTH_TEMPERATURE_THRESHOLD_DEFAULT 55
+
+/* seconds, 0 means authorization results are not cached */
+#define UDISKS_AUTH_CACHE_TTL_DEFAULT 0
+
+/* whether probed device data is kept in /run/udisks2 across restarts */
+#define UDISKS_PROBE_SNAPSHOT_DEFAULT FALSE
+
+/* seconds, 0 means the daemon never exits when idle */
+#define UDISKS_IDLE_EXIT_TIMEOUT_DEFAULT 0
+
+/* whether peer-to-peer connections are accepted on /run/udisks2/udisks2.socket */
+#define UDISKS_PRIVATE_SOCKET_DEFAULT FALSE
+
+/* seconds between scheduled trims of a filesystem, 0 means never */
+#define UDISKS_TRIM_INTERVAL_DEFAULT 0
+/* per device, 0 means no limit */
+#define UDISKS_TRIM_MAX_BANDWIDTH_DEFAULT 0
+
+/* MiB, 0 means the system default */
+#define UDISKS_UEVENT_BUFFER_SIZE_DEFAULT 128
+
 GType                 udisks_config_manager_get_type        (void) G_GNUC_CONST;
 UDisksConfigManager  *udisks_config_manager_new             (void);
 UDisksConfigManager  *udisks_config_manager_new_uninstalled (void);
 
 gboolean              udisks_config_manager_get_uninstalled (UDisksConfigManager *manager);
+gboolean              udisks_config_manager_reload          (UDisksConfigManager *manager);
 
 const GList          *udisks_config_manager_get_modules     (UDisksConfigManager *manager);
 gboolean              udisks_config_manager_get_modules_all (UDisksConfigManager *manager);
 UDisksModuleLoadPreference
                       udisks_config_manager_get_load_preference (UDisksConfigManager *manager);
 const gchar          *udisks_config_manager_get_encryption (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_housekeeping_max_parallel (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_housekeeping_max_parallel_per_controller (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_jobs_max_parallel (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_jobs_max_parallel_per_drive (UDisksConfigManager *manager);
+guint64               udisks_config_manager_get_jobs_io_max_bandwidth (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_jobs_io_max_iops (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_method_calls_max_threads (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_method_calls_max_threads_per_caller (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_metrics_file_interval (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_statistics_interval (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_usage_interval (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_health_temperature_threshold (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_auth_cache_ttl (UDisksConfigManager *manager);
+gboolean              udisks_config_manager_get_probe_snapshot (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_idle_exit_timeout (UDisksConfigManager *manager);
+UDisksPassiveDevices  udisks_config_manager_get_passive_devices (UDisksConfigManager *manager);
+gboolean              udisks_config_manager_get_private_socket (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_trim_interval (UDisksConfigManager *manager);
+guint64               udisks_config_manager_get_trim_max_bandwidth (UDisksConfigManager *manager);
+guint                 udisks_config_manager_get_uevent_buffer_size (UDisksConfigManager *manager);
 
 G_END_DECLS
 
@@ -60,6 +60,15 @@ struct _UDisksCrypttabMonitor
   gboolean have_data;
   GList *crypttab_entries;
 
+  /* maps from the device field of the entries (e.g. "UUID=..." or
+   * "/dev/disk/by-id/...") to GPtrArrays of the entries with that value,
+   * rebuilt along with crypttab_entries and not holding references */
+  GHashTable *entries_by_device;
+
+  /* maps from the uuid in the x-parent= options of the entries to
+   * GPtrArrays of the entries, rebuilt along with crypttab_entries */
+  GHashTable *entries_by_parent;
+
   GFileMonitor *file_monitor;
 };
 
@@ -99,6 +108,8 @@ udisks_crypttab_monitor_finalize (GObject *object)
 
   g_object_unref (monitor->file_monitor);
 
+  g_hash_table_unref (monitor->entries_by_parent);
+  g_hash_table_unref (monitor->entries_by_device);
   g_list_free_full (monitor->crypttab_entries, g_object_unref);
 
   if (G_OBJECT_CLASS (udisks_crypttab_monitor_parent_class)->finalize != NULL)
@@ -109,6 +120,10 @@ static void
 udisks_crypttab_monitor_init (UDisksCrypttabMonitor *monitor)
 {
   monitor->crypttab_entries = NULL;
+  monitor->entries_by_device = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      NULL, (GDestroyNotify) g_ptr_array_unref);
+  monitor->entries_by_parent = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, (GDestroyNotify) g_ptr_array_unref);
 }
 
 static void
@@ -318,10 +333,47 @@ udisks_crypttab_monitor_invalidate (UDisksCrypttabMonitor *monitor)
 {
   monitor->have_data = FALSE;
 
+  g_hash_table_remove_all (monitor->entries_by_parent);
+  g_hash_table_remove_all (monitor->entries_by_device);
   g_list_free_full (monitor->crypttab_entries, g_object_unref);
   monitor->crypttab_entries = NULL;
 }
 
+/* Adds @entry to the arrays in @index for every x-parent=<uuid> in @options */
+static void
+index_entry_by_parent (GHashTable  *index,
+                       const gchar *options,
+                       gpointer     entry)
+{
+  gchar **tokens;
+  guint n;
+
+  if (options == NULL || strstr (options, "x-parent=") == NULL)
+    return;
+
+  tokens = g_strsplit (options, ",", 0);
+  for (n = 0; tokens[n] != NULL; n++)
+    {
+      const gchar *parent;
+      GPtrArray *children;
+
+      if (!g_str_has_prefix (tokens[n], "x-parent="))
+        continue;
+      parent = tokens[n] + strlen ("x-parent=");
+
+      children = g_hash_table_lookup (index, parent);
+      if (children == NULL)
+        {
+          children = g_ptr_array_new ();
+          g_hash_table_insert (index, g_strdup (parent), children);
+        }
+      /* the same parent may be given more than once */
+      if (children->len == 0 || g_ptr_array_index (children, children->len - 1) != entry)
+        g_ptr_array_add (children, entry);
+    }
+  g_strfreev (tokens);
+}
+
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -448,7 +500,19 @@ udisks_crypttab_monitor_ensure (UDisksCrypttabMonitor *monitor)
                                           num_tokens >= 4 ? tokens[3] : NULL);
       if (!have_entry (monitor, entry))
         {
+          GPtrArray *same_device;
+
           monitor->crypttab_entries = g_list_prepend (monitor->crypttab_entries, entry);
+
+          same_device = g_hash_table_lookup (monitor->entries_by_device, udisks_crypttab_entry_get_device (entry));
+          if (same_device == NULL)
+            {
+              same_device = g_ptr_array_new ();
+              g_hash_table_insert (monitor->entries_by_device, (gpointer) udisks_crypttab_entry_get_device (entry), same_device);
+            }
+          g_ptr_array_add (same_device, entry);
+
+          index_entry_by_parent (monitor->entries_by_parent, udisks_crypttab_entry_get_options (entry), entry);
         }
       else
         {
@@ -486,3 +550,66 @@ udisks_crypttab_monitor_get_entries (UDisksCrypttabMonitor  *monitor)
   ret = g_list_copy_deep (monitor->crypttab_entries, (GCopyFunc) udisks_g_object_ref_copy, NULL);
   return ret;
 }
+
+/**
+ * udisks_crypttab_monitor_get_entries_for_device:
+ * @monitor: A #UDisksCrypttabMonitor.
+ * @device: The device field to look for, e.g. <literal>UUID=...</literal> or a device file.
+ *
+ * Gets the /etc/crypttab entries whose device field is exactly @device, without
+ * going through all entries.
+ *
+ * Returns: (transfer full) (element-type UDisksCrypttabEntry): A list of #UDisksCrypttabEntry objects that must be freed with g_list_free() after each element has been freed with g_object_unref().
+ */
+GList *
+udisks_crypttab_monitor_get_entries_for_device (UDisksCrypttabMonitor *monitor,
+                                                const gchar           *device)
+{
+  GPtrArray *entries;
+  GList *ret = NULL;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_CRYPTTAB_MONITOR (monitor), NULL);
+  g_return_val_if_fail (device != NULL, NULL);
+
+  udisks_crypttab_monitor_ensure (monitor);
+
+  entries = g_hash_table_lookup (monitor->entries_by_device, device);
+  if (entries != NULL)
+    for (n = 0; n < entries->len; n++)
+      ret = g_list_prepend (ret, g_object_ref (g_ptr_array_index (entries, n)));
+
+  return ret;
+}
+
+/**
+ * udisks_crypttab_monitor_get_entries_for_parent:
+ * @monitor: A #UDisksCrypttabMonitor.
+ * @uuid: The UUID of the parent object.
+ *
+ * Gets the /etc/crypttab entries with a <literal>x-parent=@uuid</literal>
+ * option, in the order they appear in the file, without going through
+ * all entries.
+ *
+ * Returns: (transfer full) (element-type UDisksCrypttabEntry): A list of #UDisksCrypttabEntry objects that must be freed with g_list_free() after each element has been freed with g_object_unref().
+ */
+GList *
+udisks_crypttab_monitor_get_entries_for_parent (UDisksCrypttabMonitor *monitor,
+                                                const gchar           *uuid)
+{
+  GPtrArray *entries;
+  GList *ret = NULL;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_CRYPTTAB_MONITOR (monitor), NULL);
+  g_return_val_if_fail (uuid != NULL, NULL);
+
+  udisks_crypttab_monitor_ensure (monitor);
+
+  entries = g_hash_table_lookup (monitor->entries_by_parent, uuid);
+  if (entries != NULL)
+    for (n = entries->len; n > 0; n--)
+      ret = g_list_prepend (ret, g_object_ref (g_ptr_array_index (entries, n - 1)));
+
+  return ret;
+}
@@ -23,6 +23,9 @@
 #include <glib/gi18n-lib.h>
 #include <blockdev/blockdev.h>
 
+#include <stdio.h>
+#include <unistd.h>
+
 #include "udiskslogging.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
@@ -43,6 +46,14 @@
 #include "udiskslinuxdevice.h"
 #include "udisksmodulemanager.h"
 #include "udisksconfigmanager.h"
+#include "udisksjobscheduler.h"
+#include "udisksmetrics.h"
+#include "udiskstrimscheduler.h"
+#include "udisksmethoddispatcher.h"
+#include "udisksauthorizationcache.h"
+#include "udiskstrace.h"
+#include "udiskscallercache.h"
+#include "udisksprogressparsers.h"
 
 #ifdef HAVE_LIBMOUNT
 #include "udisksutabmonitor.h"
@@ -70,15 +81,32 @@ struct _UDisksDaemon
   GDBusConnection *connection;
   GDBusObjectManagerServer *object_manager;
 
+  /* protects path_suffixes and serializes udisks_daemon_export_object_uniquely() */
+  GMutex export_lock;
+  /* object path -> next suffix to try for objects colliding with it */
+  GHashTable *path_suffixes;
+
   UDisksMountMonitor *mount_monitor;
 
   UDisksLinuxProvider *linux_provider;
 
+  UDisksJobScheduler *job_scheduler;
+
+  UDisksMetrics *metrics;
+
+  UDisksMethodDispatcher *method_dispatcher;
+
   /* may be NULL if polkit is masked */
   PolkitAuthority *authority;
 
+  UDisksAuthorizationCache *authorization_cache;
+
+  UDisksCallerCache *caller_cache;
+
   UDisksState *state;
 
+  UDisksTrimScheduler *trim_scheduler;
+
   UDisksFstabMonitor *fstab_monitor;
 
   UDisksCrypttabMonitor *crypttab_monitor;
@@ -95,6 +123,12 @@ struct _UDisksDaemon
   gboolean force_load_modules;
   gboolean uninstalled;
   gboolean enable_tcrypt;
+  gboolean profile_startup;
+
+  /* protects interfaces_batch_depth, held while notifying about changes of it */
+  GRecMutex interfaces_batch_lock;
+  /* nesting level of udisks_daemon_begin_interfaces_batch() */
+  guint interfaces_batch_depth;
 };
 
 struct _UDisksDaemonClass
@@ -116,6 +150,8 @@ enum
   PROP_FORCE_LOAD_MODULES,
   PROP_UNINSTALLED,
   PROP_ENABLE_TCRYPT,
+  PROP_PROFILE_STARTUP,
+  PROP_INTERFACES_BATCHED,
 };
 
 G_DEFINE_TYPE (UDisksDaemon, udisks_daemon, G_TYPE_OBJECT);
@@ -125,13 +161,26 @@ udisks_daemon_finalize (GObject *object)
 {
   UDisksDaemon *daemon = UDISKS_DAEMON (object);
 
+  /* waits for the method calls still running */
+  udisks_method_dispatcher_free (daemon->method_dispatcher);
+
+  /* stops the trim in progress */
+  udisks_trim_scheduler_free (daemon->trim_scheduler);
+
   udisks_state_stop_cleanup (daemon->state);
   g_object_unref (daemon->state);
 
+  udisks_authorization_cache_free (daemon->authorization_cache);
+  udisks_caller_cache_free (daemon->caller_cache);
   g_clear_object (&daemon->authority);
   g_object_unref (daemon->object_manager);
+  g_hash_table_unref (daemon->path_suffixes);
+  g_mutex_clear (&daemon->export_lock);
+  g_rec_mutex_clear (&daemon->interfaces_batch_lock);
   g_object_unref (daemon->linux_provider);
+  udisks_job_scheduler_free (daemon->job_scheduler);
   g_object_unref (daemon->connection);
+  udisks_metrics_free (daemon->metrics);
 
   /* Modules use the monitors and try to reference them when cleaning up */
   udisks_module_manager_unload_modules (daemon->module_manager);
@@ -204,6 +253,14 @@ udisks_daemon_get_property (GObject    *object,
       g_value_set_boolean (value, udisks_daemon_get_enable_tcrypt (daemon));
       break;
 
+    case PROP_PROFILE_STARTUP:
+      g_value_set_boolean (value, udisks_daemon_get_profile_startup (daemon));
+      break;
+
+    case PROP_INTERFACES_BATCHED:
+      g_value_set_boolean (value, udisks_daemon_get_interfaces_batched (daemon));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -241,6 +298,10 @@ udisks_daemon_set_property (GObject      *object,
       daemon->enable_tcrypt = g_value_get_boolean (value);
       break;
 
+    case PROP_PROFILE_STARTUP:
+      daemon->profile_startup = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -258,7 +319,7 @@ mount_monitor_on_mount_removed (UDisksMountMonitor *monitor,
                                 gpointer            user_data)
 {
   UDisksDaemon *daemon = UDISKS_DAEMON (user_data);
-  udisks_state_check (daemon->state);
+  udisks_state_check_block (daemon->state, udisks_mount_get_dev (mount));
 }
 
 static void
@@ -282,11 +343,16 @@ udisks_daemon_constructed (GObject *object)
   BDPluginSpec *plugins[] = {&part_plugin, &swap_plugin, &loop_plugin, &mdraid_plugin,
                              &fs_plugin, &crypto_plugin, NULL};
   BDPluginSpec **plugin_p = NULL;
+  gint64 constructed_start_time;
+  gint64 start_time;
   error = NULL;
 
+  constructed_start_time = g_get_monotonic_time ();
+
   /* Skip runtime dependency checks when initializing libblockdev. Plugin
      shouldn't fail to load just because some if its dependencies is missing.
    */
+  start_time = g_get_monotonic_time ();
   ret = bd_switch_init_checks (FALSE, &error);
   if (!ret)
     {
@@ -314,6 +380,9 @@ udisks_daemon_constructed (GObject *object)
                             bd_get_plugin_name ((*plugin_p)->name));
       }
     }
+  udisks_daemon_profile_phase (daemon, "libblockdev initialization", start_time);
+
+  start_time = g_get_monotonic_time ();
 
   daemon->authority = polkit_authority_get_sync (NULL, &error);
   if (daemon->authority == NULL)
@@ -322,8 +391,12 @@ udisks_daemon_constructed (GObject *object)
                     error->message, g_quark_to_string (error->domain), error->code);
       g_clear_error (&error);
     }
+  udisks_daemon_profile_phase (daemon, "polkit authority", start_time);
 
   daemon->object_manager = g_dbus_object_manager_server_new ("/org/freedesktop/UDisks2");
+  g_mutex_init (&daemon->export_lock);
+  g_rec_mutex_init (&daemon->interfaces_batch_lock);
+  daemon->path_suffixes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
   if (!g_file_test ("/run/udisks2", G_FILE_TEST_IS_DIR))
     {
@@ -355,6 +428,16 @@ udisks_daemon_constructed (GObject *object)
 
   daemon->mount_monitor = udisks_mount_monitor_new ();
 
+  daemon->job_scheduler = udisks_job_scheduler_new (daemon);
+
+  daemon->metrics = udisks_metrics_new (daemon);
+
+  daemon->method_dispatcher = udisks_method_dispatcher_new (daemon);
+
+  daemon->authorization_cache = udisks_authorization_cache_new (daemon);
+
+  daemon->caller_cache = udisks_caller_cache_new (daemon);
+
   daemon->state = udisks_state_new (daemon);
 
   g_signal_connect (daemon->mount_monitor,
@@ -375,10 +458,14 @@ udisks_daemon_constructed (GObject *object)
       || (udisks_config_manager_get_load_preference (daemon->config_manager)
           == UDISKS_MODULE_LOAD_ONSTARTUP))
     {
+      start_time = g_get_monotonic_time ();
       udisks_module_manager_load_modules (daemon->module_manager);
+      udisks_daemon_profile_phase (daemon, "module loading", start_time);
     }
 
+  start_time = g_get_monotonic_time ();
   udisks_provider_start (UDISKS_PROVIDER (daemon->linux_provider));
+  udisks_daemon_profile_phase (daemon, "provider start (total)", start_time);
 
   /* Export the ObjectManager */
   g_dbus_object_manager_server_set_connection (daemon->object_manager, daemon->connection);
@@ -387,6 +474,10 @@ udisks_daemon_constructed (GObject *object)
   udisks_state_start_cleanup (daemon->state);
   udisks_state_check (daemon->state);
 
+  daemon->trim_scheduler = udisks_trim_scheduler_new (daemon);
+
+  udisks_daemon_profile_phase (daemon, "daemon construction (total)", constructed_start_time);
+
   if (G_OBJECT_CLASS (udisks_daemon_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (udisks_daemon_parent_class)->constructed (object);
 }
@@ -506,6 +597,38 @@ udisks_daemon_class_init (UDisksDaemonClass *klass)
                                                          G_PARAM_READABLE |
                                                          G_PARAM_WRITABLE |
                                                          G_PARAM_CONSTRUCT_ONLY));
+
+  /**
+   * UDisksDaemon:profile-startup:
+   *
+   * Whether the durations of the start-up phases should be logged.
+   *
+   * Since: 2.9.0
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_PROFILE_STARTUP,
+                                   g_param_spec_boolean ("profile-startup",
+                                                         "Profile start-up",
+                                                         "Whether the durations of the start-up phases should be logged",
+                                                         FALSE,
+                                                         G_PARAM_READABLE |
+                                                         G_PARAM_WRITABLE |
+                                                         G_PARAM_CONSTRUCT_ONLY));
+
+  /**
+   * UDisksDaemon:interfaces-batched:
+   *
+   * Whether interfaces are being added to many exported objects at once,
+   * see udisks_daemon_begin_interfaces_batch().
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_INTERFACES_BATCHED,
+                                   g_param_spec_boolean ("interfaces-batched",
+                                                         "Interfaces batched",
+                                                         "Whether interfaces are being added to many objects at once",
+                                                         FALSE,
+                                                         G_PARAM_READABLE |
+                                                         G_PARAM_STATIC_STRINGS));
 }
 
 /**
@@ -515,6 +638,7 @@ udisks_daemon_class_init (UDisksDaemonClass *klass)
  * @force_load_modules: Activate modules on startup (for debugging purposes).
  * @uninstalled: Loads modules from the build directory (for debugging purposes).
  * @enable_tcrypt: Checks whether devices could be TCRYPT encrypted.
+ * @profile_startup: Log the durations of the start-up phases (for debugging purposes).
  *
  * Create a new daemon object for exporting objects on @connection.
  *
@@ -525,7 +649,8 @@ udisks_daemon_new (GDBusConnection *connection,
                    gboolean         disable_modules,
                    gboolean         force_load_modules,
                    gboolean         uninstalled,
-                   gboolean         enable_tcrypt)
+                   gboolean         enable_tcrypt,
+                   gboolean         profile_startup)
 {
   g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
   return UDISKS_DAEMON (g_object_new (UDISKS_TYPE_DAEMON,
@@ -534,6 +659,7 @@ udisks_daemon_new (GDBusConnection *connection,
                                       "force-load-modules", force_load_modules,
                                       "uninstalled", uninstalled,
                                       "enable-tcrypt", enable_tcrypt,
+                                      "profile-startup", profile_startup,
                                       NULL));
 }
 
@@ -644,6 +770,51 @@ udisks_daemon_get_linux_provider (UDisksDaemon *daemon)
   return daemon->linux_provider;
 }
 
+/**
+ * udisks_daemon_get_job_scheduler:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the job scheduler used by @daemon.
+ *
+ * Returns: A #UDisksJobScheduler. Do not free, the object is owned by @daemon.
+ */
+UDisksJobScheduler *
+udisks_daemon_get_job_scheduler (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->job_scheduler;
+}
+
+/**
+ * udisks_daemon_get_method_dispatcher:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the dispatcher running the method calls on the objects exported by @daemon.
+ *
+ * Returns: A #UDisksMethodDispatcher. Do not free, the object is owned by @daemon.
+ */
+UDisksMethodDispatcher *
+udisks_daemon_get_method_dispatcher (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->method_dispatcher;
+}
+
+/**
+ * udisks_daemon_get_metrics:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the latency metrics recorded by @daemon.
+ *
+ * Returns: A #UDisksMetrics. Do not free, the object is owned by @daemon.
+ */
+UDisksMetrics *
+udisks_daemon_get_metrics (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->metrics;
+}
+
 /**
  * udisks_daemon_get_authority:
  * @daemon: A #UDisksDaemon.
@@ -661,6 +832,36 @@ udisks_daemon_get_authority (UDisksDaemon *daemon)
   return daemon->authority;
 }
 
+/**
+ * udisks_daemon_get_authorization_cache:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the cache of authorization results used by @daemon.
+ *
+ * Returns: A #UDisksAuthorizationCache. Do not free, the object is owned by @daemon.
+ */
+UDisksAuthorizationCache *
+udisks_daemon_get_authorization_cache (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->authorization_cache;
+}
+
+/**
+ * udisks_daemon_get_caller_cache:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets the cache of the credentials of callers used by @daemon.
+ *
+ * Returns: A #UDisksCallerCache. Do not free, the object is owned by @daemon.
+ */
+UDisksCallerCache *
+udisks_daemon_get_caller_cache (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return daemon->caller_cache;
+}
+
 /**
  * udisks_daemon_get_state:
  * @daemon: A #UDisksDaemon.
@@ -678,6 +879,138 @@ udisks_daemon_get_state (UDisksDaemon *daemon)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+typedef struct
+{
+  guint count;
+  gsize properties_size;
+} FootprintEntry;
+
+static void
+footprint_add (GHashTable  *table,
+               const gchar *name,
+               gsize        properties_size)
+{
+  FootprintEntry *entry;
+
+  entry = g_hash_table_lookup (table, name);
+  if (entry == NULL)
+    {
+      entry = g_new0 (FootprintEntry, 1);
+      g_hash_table_insert (table, (gpointer) name, entry);
+    }
+  entry->count++;
+  entry->properties_size += properties_size;
+}
+
+static void
+footprint_append (GString     *str,
+                  const gchar *title,
+                  GHashTable  *table,
+                  gboolean     with_size)
+{
+  GList *names;
+  GList *l;
+
+  g_string_append_printf (str, "%s:\n", title);
+  names = g_list_sort (g_hash_table_get_keys (table), (GCompareFunc) g_strcmp0);
+  for (l = names; l != NULL; l = l->next)
+    {
+      FootprintEntry *entry = g_hash_table_lookup (table, l->data);
+
+      if (with_size)
+        g_string_append_printf (str, "  %s: %u (%" G_GSIZE_FORMAT " bytes of properties)\n",
+                                (const gchar *) l->data, entry->count, entry->properties_size);
+      else
+        g_string_append_printf (str, "  %s: %u\n", (const gchar *) l->data, entry->count);
+    }
+  g_list_free (names);
+}
+
+/**
+ * udisks_daemon_get_footprint_report:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Builds a human-readable report of what the memory of the daemon is
+ * used for: the number of exported objects per type, the number of
+ * interfaces and the serialized size of their properties per interface
+ * and the sizes of the internal tables. udisksd logs it on SIGUSR1.
+ *
+ * Returns: The report. Free with g_free().
+ */
+gchar *
+udisks_daemon_get_footprint_report (UDisksDaemon *daemon)
+{
+  GString *str;
+  GHashTable *objects_by_type;
+  GHashTable *interfaces_by_name;
+  GList *objects;
+  GList *l;
+  gchar *statm = NULL;
+  gsize total_size = 0;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+
+  str = g_string_new (NULL);
+
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL))
+    {
+      guint64 size_pages = 0;
+      guint64 resident_pages = 0;
+
+      if (sscanf (statm, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &size_pages, &resident_pages) == 2)
+        g_string_append_printf (str, "VmSize: %" G_GUINT64_FORMAT " kB, VmRSS: %" G_GUINT64_FORMAT " kB\n",
+                                size_pages * sysconf (_SC_PAGESIZE) / 1024,
+                                resident_pages * sysconf (_SC_PAGESIZE) / 1024);
+      g_free (statm);
+    }
+
+  /* type and interface names are static strings, no need to copy them */
+  objects_by_type = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  interfaces_by_name = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      GDBusObject *object = G_DBUS_OBJECT (l->data);
+      GList *interfaces;
+      GList *ll;
+
+      footprint_add (objects_by_type, G_OBJECT_TYPE_NAME (object), 0);
+
+      interfaces = g_dbus_object_get_interfaces (object);
+      for (ll = interfaces; ll != NULL; ll = ll->next)
+        {
+          GDBusInterfaceSkeleton *interface = G_DBUS_INTERFACE_SKELETON (ll->data);
+          GVariant *properties;
+          gsize size;
+
+          properties = g_dbus_interface_skeleton_get_properties (interface);
+          size = g_variant_get_size (properties);
+          g_variant_unref (properties);
+
+          footprint_add (interfaces_by_name, g_dbus_interface_skeleton_get_info (interface)->name, size);
+          total_size += size;
+        }
+      g_list_free_full (interfaces, g_object_unref);
+    }
+
+  g_string_append_printf (str, "Exported objects: %u, %" G_GSIZE_FORMAT " bytes of properties\n",
+                          g_list_length (objects), total_size);
+  g_list_free_full (objects, g_object_unref);
+
+  footprint_append (str, "Objects by type", objects_by_type, FALSE);
+  footprint_append (str, "Interfaces", interfaces_by_name, TRUE);
+  g_hash_table_unref (objects_by_type);
+  g_hash_table_unref (interfaces_by_name);
+
+  g_string_append (str, "Provider tables:\n");
+  udisks_linux_provider_append_footprint (daemon->linux_provider, str);
+
+  return g_string_free (str, FALSE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 typedef struct
 {
   UDisksDaemon *daemon;
@@ -705,6 +1038,15 @@ on_job_completed (UDisksJob    *job,
   object = UDISKS_OBJECT_SKELETON (g_dbus_interface_get_object (G_DBUS_INTERFACE (job)));
   g_assert (object != NULL);
 
+  udisks_metrics_record (daemon->metrics,
+                         UDISKS_METRICS_KIND_JOB,
+                         udisks_job_get_operation (job),
+                         g_get_real_time () - (gint64) udisks_job_get_start_time (job));
+  UDISKS_TRACE3 (job_completed,
+                 g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                 udisks_job_get_operation (job),
+                 success);
+
   /* Unexport job */
   g_dbus_object_manager_server_unexport (daemon->object_manager,
                                          g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
@@ -760,6 +1102,9 @@ common_job (UDisksDaemon    *daemon,
   udisks_job_set_started_by_uid (UDISKS_JOB (job), job_started_by_uid);
 
   g_dbus_object_manager_server_export (daemon->object_manager, G_DBUS_OBJECT_SKELETON (job_object));
+  UDISKS_TRACE2 (job_started,
+                 g_dbus_object_get_object_path (G_DBUS_OBJECT (job_object)),
+                 job_operation);
   g_signal_connect_after (job,
                           "completed",
                           G_CALLBACK (on_job_completed),
@@ -926,6 +1271,9 @@ udisks_daemon_launch_spawned_job (UDisksDaemon    *daemon,
   return job;
 }
 
+/* Maximum number of bytes of output kept of spawned jobs, per stream */
+#define SPAWNED_JOB_OUTPUT_LIMIT (1024 * 1024)
+
 /**
  * udisks_daemon_launch_spawned_job_gstring:
  * @daemon: A #UDisksDaemon.
@@ -984,6 +1332,17 @@ udisks_daemon_launch_spawned_job_gstring (
   command_line = g_strdup_vprintf (command_line_format, var_args);
   va_end (var_args);
   job = udisks_spawned_job_new (command_line, input_string, run_as_uid, run_as_euid, daemon, cancellable);
+  /* the output only ends up in (error) messages, don't let a chatty tool
+   * make the daemon buffer an unbounded amount of it */
+  udisks_spawned_job_set_output_limit (job, SPAWNED_JOB_OUTPUT_LIMIT);
+  /* tools reporting progress get the size of the device they work on so that
+   * the rate is estimated too */
+  if (udisks_progress_parsers_attach (job, command_line) && object != NULL)
+    {
+      UDisksBlock *block = udisks_object_peek_block (object);
+      if (block != NULL)
+        udisks_job_set_bytes (UDISKS_JOB (job), udisks_block_get_size (block));
+    }
   g_free (command_line);
 
   return common_job (daemon, object, job_operation, job_started_by_uid, job);
@@ -1188,32 +1547,107 @@ udisks_daemon_launch_spawned_job_gstring_sync (UDisksDaemon    *daemon,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* The job libblockdev calls made from the current thread report their
+ * progress to, see udisks_bd_thread_set_progress_for_job() */
 static __thread UDisksJob *thread_job = NULL;
 
+/* Maps libblockdev task IDs to the (referenced) UDisksJob the task was
+ * started for. libblockdev task IDs are unique across threads, so this lets
+ * any number of jobs running libblockdev operations in parallel threads
+ * each get the progress of their own tasks, even when a thread moves on to
+ * another job before all the reports of a task arrived. */
+static GHashTable *task_to_job = NULL;
+G_LOCK_DEFINE_STATIC (task_to_job_lock);
+
+static UDisksJob *
+bd_task_lookup_job (guint64            task_id,
+                    BDUtilsProgStatus  status)
+{
+  UDisksJob *job = NULL;
+
+  G_LOCK (task_to_job_lock);
+  if (task_to_job == NULL)
+    task_to_job = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, g_object_unref);
+
+  if (status == BD_UTILS_PROG_STARTED)
+    {
+      if (thread_job != NULL)
+        {
+          gint64 *key = g_new (gint64, 1);
+          *key = (gint64) task_id;
+          g_hash_table_replace (task_to_job, key, g_object_ref (thread_job));
+          job = g_object_ref (thread_job);
+        }
+    }
+  else
+    {
+      gint64 key = (gint64) task_id;
+      job = g_hash_table_lookup (task_to_job, &key);
+      if (job == NULL)
+        job = thread_job;
+      if (job != NULL)
+        g_object_ref (job);
+      if (status == BD_UTILS_PROG_FINISHED)
+        g_hash_table_remove (task_to_job, &key);
+    }
+  G_UNLOCK (task_to_job_lock);
+
+  return job;
+}
+
 static void
 bd_thread_progress_callback (guint64            task_id,
                              BDUtilsProgStatus  status,
                              guint8             completion,
                              gchar             *msg)
 {
-  if (thread_job != NULL && msg == NULL)
+  UDisksJob *job;
+
+  job = bd_task_lookup_job (task_id, status);
+  if (job == NULL)
+    return;
+
+  if (status == BD_UTILS_PROG_PROGRESS && msg == NULL)
     {
-      if (!udisks_job_get_progress_valid (UDISKS_JOB (thread_job)))
-        {
-          udisks_job_set_progress_valid (UDISKS_JOB (thread_job), TRUE);
-        }
+      if (!udisks_job_get_progress_valid (job))
+        udisks_job_set_progress_valid (job, TRUE);
 
-      udisks_job_set_progress (UDISKS_JOB (thread_job), completion / 100.0);
+      udisks_job_set_progress (job, completion / 100.0);
     }
+
+  g_object_unref (job);
 }
 
+/**
+ * udisks_bd_thread_set_progress_for_job:
+ * @job: A #UDisksJob.
+ *
+ * Makes the progress of the libblockdev operations started from the
+ * calling thread (until udisks_bd_thread_disable_progress() is called)
+ * be reported as the progress of @job. If @job is a #UDisksBaseJob, its
+ * rate and expected end time are estimated from the progress, see
+ * #UDisksBaseJob:auto-estimate.
+ *
+ * Several threads may do this at the same time for different jobs.
+ */
 void
 udisks_bd_thread_set_progress_for_job (UDisksJob *job)
 {
+  g_return_if_fail (UDISKS_IS_JOB (job));
+
+  if (UDISKS_IS_BASE_JOB (job))
+    udisks_base_job_set_auto_estimate (UDISKS_BASE_JOB (job), TRUE);
+
   thread_job = job;
   bd_utils_init_prog_reporting_thread (bd_thread_progress_callback, NULL);
 }
 
+/**
+ * udisks_bd_thread_disable_progress:
+ *
+ * Stops reporting the progress of libblockdev operations started from the
+ * calling thread, see udisks_bd_thread_set_progress_for_job().
+ */
 void
 udisks_bd_thread_disable_progress (void)
 {
@@ -1277,27 +1711,78 @@ udisks_daemon_launch_threaded_job_sync (UDisksDaemon          *daemon,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Interval for rechecking the wait condition even without a notification,
+ * as a safety net for state changes not tied to an object or mount change */
+#define WAIT_RECHECK_INTERVAL_USEC (G_USEC_PER_SEC)
+
+/* Shared between the waiting thread and the signal handlers that may be
+ * invoked from any thread, hence refcounted and protected by @lock */
 typedef struct {
-  GMainContext *context;
-  GMainLoop *loop;
-  gboolean timed_out;
+  volatile gint ref_count;
+  GMutex lock;
+  GCond cond;
+  gboolean changed;
+  gboolean cancelled;
 } WaitData;
 
-static gboolean
-wait_on_timed_out (gpointer user_data)
+static WaitData *
+wait_data_ref (WaitData *data)
 {
-  WaitData *data = user_data;
-  data->timed_out = TRUE;
-  g_main_loop_quit (data->loop);
-  return FALSE; /* remove the source */
+  g_atomic_int_inc (&data->ref_count);
+  return data;
 }
 
-static gboolean
-wait_on_recheck (gpointer user_data)
+static void
+wait_data_unref (WaitData *data)
 {
-  WaitData *data = user_data;
-  g_main_loop_quit (data->loop);
-  return FALSE; /* remove the source */
+  if (g_atomic_int_dec_and_test (&data->ref_count))
+    {
+      g_mutex_clear (&data->lock);
+      g_cond_clear (&data->cond);
+      g_slice_free (WaitData, data);
+    }
+}
+
+static void
+wait_data_closure_notify (gpointer  user_data,
+                          GClosure *closure)
+{
+  wait_data_unref (user_data);
+}
+
+static void
+wait_data_wake_up (WaitData *data,
+                   gboolean  cancelled)
+{
+  g_mutex_lock (&data->lock);
+  data->changed = TRUE;
+  if (cancelled)
+    data->cancelled = TRUE;
+  g_cond_signal (&data->cond);
+  g_mutex_unlock (&data->lock);
+}
+
+static void
+wait_on_object_notify (UDisksProvider *provider,
+                       GDBusObject    *object,
+                       gpointer        user_data)
+{
+  wait_data_wake_up (user_data, FALSE);
+}
+
+static void
+wait_on_mount_notify (UDisksMountMonitor *monitor,
+                      UDisksMount        *mount,
+                      gpointer            user_data)
+{
+  wait_data_wake_up (user_data, FALSE);
+}
+
+static void
+wait_on_cancelled (GCancellable *cancellable,
+                   gpointer      user_data)
+{
+  wait_data_wake_up (user_data, TRUE);
 }
 
 static gpointer wait_for_objects (UDisksDaemon                *daemon,
@@ -1306,60 +1791,117 @@ static gpointer wait_for_objects (UDisksDaemon                *daemon,
                                   GDestroyNotify               user_data_free_func,
                                   guint                        timeout_seconds,
                                   gboolean                     to_disappear,
+                                  GCancellable                *cancellable,
                                   GError                     **error)
 {
+  static const gchar *object_signals[] = { "object-added", "object-changed", "object-removed" };
+  gulong object_handler_ids[G_N_ELEMENTS (object_signals)] = { 0 };
+  gulong mount_added_handler_id = 0;
+  gulong mount_removed_handler_id = 0;
+  gulong cancelled_handler_id = 0;
+  WaitData *data = NULL;
+  gint64 deadline = 0;
+  gboolean cancelled;
   gpointer ret;
-  WaitData data;
-
-  /* TODO: support GCancellable */
+  guint n;
 
   g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
   g_return_val_if_fail (wait_func != NULL, NULL);
-
-  ret = NULL;
-
-  memset (&data, '\0', sizeof (data));
-  data.context = NULL;
-  data.loop = NULL;
+  g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), NULL);
 
   g_object_ref (daemon);
 
- again:
-  ret = wait_func (daemon, user_data);
-
-  if ((!to_disappear && ret == NULL && timeout_seconds > 0) ||
-      (to_disappear && ret != NULL && timeout_seconds > 0))
+  while (TRUE)
     {
-      GSource *source;
+      if (data != NULL)
+        {
+          /* notifications arriving while wait_func() runs are not lost */
+          g_mutex_lock (&data->lock);
+          data->changed = FALSE;
+          g_mutex_unlock (&data->lock);
+        }
+
+      ret = wait_func (daemon, user_data);
 
-      /* sit and wait for up to @timeout_seconds if the object isn't there already */
-      if (data.context == NULL)
+      if (timeout_seconds == 0 ||
+          (!to_disappear && ret != NULL) ||
+          (to_disappear && ret == NULL))
+        break;
+
+      if (data == NULL)
         {
-          /* TODO: this will deadlock if we are calling from the main thread... */
-          data.context = g_main_context_new ();
-          data.loop = g_main_loop_new (data.context, FALSE);
-
-          source = g_timeout_source_new_seconds (timeout_seconds);
-          g_source_set_priority (source, G_PRIORITY_DEFAULT);
-          g_source_set_callback (source, wait_on_timed_out, &data, NULL);
-          g_source_attach (source, data.context);
-          g_source_unref (source);
+          /* sit and wait for up to @timeout_seconds if the object isn't
+           * there already (or still there), rechecking whenever the
+           * provider or the mount monitor signal a change -- the signals
+           * may come from any thread, so this also works when called from
+           * the main thread */
+          data = g_slice_new0 (WaitData);
+          data->ref_count = 1;
+          g_mutex_init (&data->lock);
+          g_cond_init (&data->cond);
+          deadline = g_get_monotonic_time () + timeout_seconds * G_USEC_PER_SEC;
+
+          for (n = 0; n < G_N_ELEMENTS (object_signals); n++)
+            object_handler_ids[n] = g_signal_connect_data (daemon->linux_provider,
+                                                           object_signals[n],
+                                                           G_CALLBACK (wait_on_object_notify),
+                                                           wait_data_ref (data),
+                                                           wait_data_closure_notify,
+                                                           0);
+          mount_added_handler_id = g_signal_connect_data (daemon->mount_monitor,
+                                                          "mount-added",
+                                                          G_CALLBACK (wait_on_mount_notify),
+                                                          wait_data_ref (data),
+                                                          wait_data_closure_notify,
+                                                          0);
+          mount_removed_handler_id = g_signal_connect_data (daemon->mount_monitor,
+                                                            "mount-removed",
+                                                            G_CALLBACK (wait_on_mount_notify),
+                                                            wait_data_ref (data),
+                                                            wait_data_closure_notify,
+                                                            0);
+          if (cancellable != NULL)
+            cancelled_handler_id = g_cancellable_connect (cancellable,
+                                                          G_CALLBACK (wait_on_cancelled),
+                                                          wait_data_ref (data),
+                                                          (GDestroyNotify) wait_data_unref);
+
+          /* something may have changed between wait_func() and connecting */
+          if (to_disappear)
+            g_object_unref (G_OBJECT (ret));
+          continue;
         }
 
-      /* TODO: do something a bit more elegant than checking every 250ms ... it's
-       *       probably going to involve having each UDisksProvider emit a "changed"
-       *       signal when it's time to recheck... for now this works.
-       */
-      source = g_timeout_source_new (250);
-      g_source_set_priority (source, G_PRIORITY_DEFAULT);
-      g_source_set_callback (source, wait_on_recheck, &data, NULL);
-      g_source_attach (source, data.context);
-      g_source_unref (source);
+      g_mutex_lock (&data->lock);
+      while (!data->changed)
+        {
+          gint64 now = g_get_monotonic_time ();
+          if (now >= deadline)
+            break;
+          if (!g_cond_wait_until (&data->cond, &data->lock, MIN (deadline, now + WAIT_RECHECK_INTERVAL_USEC)))
+            break;
+        }
+      cancelled = data->cancelled;
+      g_mutex_unlock (&data->lock);
 
-      g_main_loop_run (data.loop);
+      if (cancelled)
+        {
+          /* when waiting for @ret to disappear, the caller drops the
+           * reference and treats this as a failure */
+          g_set_error (error,
+                       G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                       "Cancelled waiting");
+          break;
+        }
 
-      if (data.timed_out)
+      if (g_get_monotonic_time () >= deadline)
         {
+          /* give it a last chance in case the change came right at the end */
+          if (to_disappear)
+            g_object_unref (G_OBJECT (ret));
+          ret = wait_func (daemon, user_data);
+          if ((!to_disappear && ret != NULL) || (to_disappear && ret == NULL))
+            break;
           if (to_disappear)
             g_set_error (error,
                          UDISKS_ERROR, UDISKS_ERROR_FAILED,
@@ -1368,13 +1910,21 @@ static gpointer wait_for_objects (UDisksDaemon                *daemon,
             g_set_error (error,
                          UDISKS_ERROR, UDISKS_ERROR_FAILED,
                          "Timed out waiting for object");
+          break;
         }
-      else
-        {
-          if (to_disappear)
-            g_object_unref (G_OBJECT (ret));
-          goto again;
-        }
+
+      if (to_disappear)
+        g_object_unref (G_OBJECT (ret));
+    }
+
+  if (data != NULL)
+    {
+      for (n = 0; n < G_N_ELEMENTS (object_signals); n++)
+        g_signal_handler_disconnect (daemon->linux_provider, object_handler_ids[n]);
+      g_signal_handler_disconnect (daemon->mount_monitor, mount_added_handler_id);
+      g_signal_handler_disconnect (daemon->mount_monitor, mount_removed_handler_id);
+      g_cancellable_disconnect (cancellable, cancelled_handler_id);
+      wait_data_unref (data);
     }
 
   if (user_data_free_func != NULL)
@@ -1382,11 +1932,6 @@ static gpointer wait_for_objects (UDisksDaemon                *daemon,
 
   g_object_unref (daemon);
 
-  if (data.loop != NULL)
-    g_main_loop_unref (data.loop);
-  if (data.context != NULL)
-    g_main_context_unref (data.context);
-
   return ret;
 }
 
@@ -1398,14 +1943,17 @@ static gpointer wait_for_objects (UDisksDaemon                *daemon,
  * @user_data: User data to pass to @wait_func.
  * @user_data_free_func: (allow-none): Function to free @user_data or %NULL.
  * @timeout_seconds: Maximum time to wait for the object (in seconds) or 0 to never wait.
+ * @cancellable: A #GCancellable or %NULL.
  * @error: (allow-none): Return location for error or %NULL.
  *
  * Blocks the calling thread until an object picked by @wait_func is
  * available or until @timeout_seconds has passed (in which case the
  * function fails with %UDISKS_ERROR_TIMED_OUT).
  *
- * Note that @wait_func will be called from time to time - for example
- * if there is a device event.
+ * Note that @wait_func will be called whenever there is a chance the
+ * result changed - for example if an object was added, changed or
+ * removed by a #UDisksProvider or if a mount changed. If @cancellable
+ * is cancelled, the function fails with %G_IO_ERROR_CANCELLED.
  *
  * Returns: (transfer full): The object picked by @wait_func or %NULL if @error is set.
  */
@@ -1415,7 +1963,8 @@ udisks_daemon_wait_for_object_sync (UDisksDaemon               *daemon,
                                     gpointer                    user_data,
                                     GDestroyNotify              user_data_free_func,
                                     guint                       timeout_seconds,
-                                    GError                      **error)
+                                    GCancellable               *cancellable,
+                                    GError                    **error)
 {
   return (UDisksObject *) wait_for_objects (daemon,
                                             (UDisksDaemonWaitFuncGeneric) wait_func,
@@ -1423,6 +1972,7 @@ udisks_daemon_wait_for_object_sync (UDisksDaemon               *daemon,
                                             user_data_free_func,
                                             timeout_seconds,
                                             FALSE, /* to_disappear */
+                                            cancellable,
                                             error);
 }
 
@@ -1433,14 +1983,17 @@ udisks_daemon_wait_for_object_sync (UDisksDaemon               *daemon,
  * @user_data: User data to pass to @wait_func.
  * @user_data_free_func: (allow-none): Function to free @user_data or %NULL.
  * @timeout_seconds: Maximum time to wait for the object (in seconds) or 0 to never wait.
+ * @cancellable: A #GCancellable or %NULL.
  * @error: (allow-none): Return location for error or %NULL.
  *
  * Blocks the calling thread until one or more objects picked by @wait_func
  * is/are available or until @timeout_seconds has passed (in which case the
  * function fails with %UDISKS_ERROR_TIMED_OUT).
  *
- * Note that @wait_func will be called from time to time - for example
- * if there is a device event.
+ * Note that @wait_func will be called whenever there is a chance the
+ * result changed - for example if an object was added, changed or
+ * removed by a #UDisksProvider or if a mount changed. If @cancellable
+ * is cancelled, the function fails with %G_IO_ERROR_CANCELLED.
  *
  * Returns: (transfer full): The objects picked by @wait_func or %NULL if @error is set.
  */
@@ -1450,6 +2003,7 @@ udisks_daemon_wait_for_objects_sync (UDisksDaemon                 *daemon,
                                      gpointer                      user_data,
                                      GDestroyNotify                user_data_free_func,
                                      guint                         timeout_seconds,
+                                     GCancellable                 *cancellable,
                                      GError                      **error)
 {
   return (UDisksObject **) wait_for_objects (daemon,
@@ -1458,6 +2012,7 @@ udisks_daemon_wait_for_objects_sync (UDisksDaemon                 *daemon,
                                              user_data_free_func,
                                              timeout_seconds,
                                              FALSE, /* to_disappear */
+                                             cancellable,
                                              error);
 }
 
@@ -1469,14 +2024,17 @@ udisks_daemon_wait_for_objects_sync (UDisksDaemon                 *daemon,
  * @user_data: User data to pass to @wait_func.
  * @user_data_free_func: (allow-none): Function to free @user_data or %NULL.
  * @timeout_seconds: Maximum time to wait for the object to disappear (in seconds) or 0 to never wait.
+ * @cancellable: A #GCancellable or %NULL.
  * @error: (allow-none): Return location for error or %NULL.
  *
  * Blocks the calling thread until an object picked by @wait_func disappears or
  * until @timeout_seconds has passed (in which case the function fails with
  * %UDISKS_ERROR_TIMED_OUT).
  *
- * Note that @wait_func will be called from time to time - for example
- * if there is a device event. For consistency @wait_func is supposed
+ * Note that @wait_func will be called whenever there is a chance the
+ * result changed - for example if an object was added, changed or
+ * removed by a #UDisksProvider or if a mount changed. If @cancellable
+ * is cancelled, the function fails with %G_IO_ERROR_CANCELLED. For consistency @wait_func is supposed
  * to return full reference to an existing object; udisks_daemon_wait_for_object_to_disappear_sync()
  * will take care of dropping the reference after each iteration.
  *
@@ -1488,7 +2046,8 @@ udisks_daemon_wait_for_object_to_disappear_sync (UDisksDaemon               *dae
                                                  gpointer                    user_data,
                                                  GDestroyNotify              user_data_free_func,
                                                  guint                       timeout_seconds,
-                                                 GError                      **error)
+                                                 GCancellable               *cancellable,
+                                                 GError                    **error)
 {
   UDisksObject *object;
 
@@ -1498,6 +2057,7 @@ udisks_daemon_wait_for_object_to_disappear_sync (UDisksDaemon               *dae
                                               user_data_free_func,
                                               timeout_seconds,
                                               TRUE, /* to_disappear */
+                                              cancellable,
                                               error);
   if (object != NULL)
     g_object_unref (object);
@@ -1521,28 +2081,8 @@ UDisksObject *
 udisks_daemon_find_block (UDisksDaemon *daemon,
                           dev_t         block_device_number)
 {
-  UDisksObject *ret = NULL;
-  GList *objects, *l;
-
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_peek_block (object);
-      if (block == NULL)
-        continue;
-
-      if (udisks_block_get_device_number (block) == block_device_number)
-        {
-          ret = g_object_ref (object);
-          goto out;
-        }
-    }
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
+  return (UDisksObject *) udisks_linux_provider_find_block_by_device_number (daemon->linux_provider,
+                                                                             block_device_number);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1560,28 +2100,8 @@ UDisksObject *
 udisks_daemon_find_block_by_device_file (UDisksDaemon *daemon,
                                          const gchar  *device_file)
 {
-  UDisksObject *ret = NULL;
-  GList *objects, *l;
-
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_peek_block (object);
-      if (block == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_block_get_device (block), device_file) == 0)
-        {
-          ret = g_object_ref (object);
-          goto out;
-        }
-    }
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
+  return (UDisksObject *) udisks_linux_provider_find_block_by_device_file (daemon->linux_provider,
+                                                                           device_file);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1599,33 +2119,8 @@ UDisksObject *
 udisks_daemon_find_block_by_sysfs_path (UDisksDaemon *daemon,
                                         const gchar  *sysfs_path)
 {
-  UDisksObject *ret = NULL;
-  GList *objects, *l;
-
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksLinuxDevice *device;
-
-      if (!UDISKS_IS_LINUX_BLOCK_OBJECT (object))
-        continue;
-
-      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
-      if (device == NULL)
-        continue;
-
-      if (g_strcmp0 (g_udev_device_get_sysfs_path (device->udev_device), sysfs_path) == 0)
-        {
-          g_object_unref (device);
-          ret = g_object_ref (object);
-          goto out;
-        }
-      g_object_unref (device);
-    }
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
+  return (UDisksObject *) udisks_linux_provider_find_block_by_sysfs_path (daemon->linux_provider,
+                                                                          sysfs_path);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1661,6 +2156,70 @@ udisks_daemon_get_objects (UDisksDaemon *daemon)
   return g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (daemon->object_manager));
 }
 
+static gboolean
+object_path_is_taken (UDisksDaemon *daemon,
+                      const gchar  *object_path)
+{
+  GDBusObject *other;
+
+  other = g_dbus_object_manager_get_object (G_DBUS_OBJECT_MANAGER (daemon->object_manager), object_path);
+  if (other == NULL)
+    return FALSE;
+  g_object_unref (other);
+  return TRUE;
+}
+
+/**
+ * udisks_daemon_export_object_uniquely:
+ * @daemon: A #UDisksDaemon.
+ * @object: The #GDBusObjectSkeleton to export.
+ *
+ * Like g_dbus_object_manager_server_export_uniquely(), exports @object
+ * on the object manager of @daemon, appending <literal>_N</literal> to
+ * its object path if the path is already taken by another object.
+ *
+ * Instead of probing <literal>_1</literal>, <literal>_2</literal>, ...
+ * every time, the next suffix to try is remembered for every colliding
+ * object path, so that exporting many objects with the same name
+ * (e.g. logical volumes with the same name in different volume groups
+ * or drives without a serial number) costs a constant number of
+ * lookups per object instead of one per object already exported. May
+ * be called from any thread.
+ */
+void
+udisks_daemon_export_object_uniquely (UDisksDaemon        *daemon,
+                                      GDBusObjectSkeleton *object)
+{
+  const gchar *orig_object_path;
+  gchar *object_path = NULL;
+  guint suffix;
+
+  g_return_if_fail (UDISKS_IS_DAEMON (daemon));
+  g_return_if_fail (G_IS_DBUS_OBJECT_SKELETON (object));
+
+  orig_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+
+  g_mutex_lock (&daemon->export_lock);
+  if (object_path_is_taken (daemon, orig_object_path))
+    {
+      suffix = GPOINTER_TO_UINT (g_hash_table_lookup (daemon->path_suffixes, orig_object_path));
+      if (suffix == 0)
+        suffix = 1;
+      do
+        {
+          g_free (object_path);
+          object_path = g_strdup_printf ("%s_%u", orig_object_path, suffix++);
+        }
+      while (object_path_is_taken (daemon, object_path));
+      g_hash_table_replace (daemon->path_suffixes, g_strdup (orig_object_path), GUINT_TO_POINTER (suffix));
+
+      g_dbus_object_skeleton_set_object_path (object, object_path);
+      g_free (object_path);
+    }
+  g_dbus_object_manager_server_export (daemon->object_manager, object);
+  g_mutex_unlock (&daemon->export_lock);
+}
+
 /**
  * udisks_daemon_get_module_manager:
  * @daemon: A #UDisksDaemon.
@@ -1754,6 +2313,114 @@ udisks_daemon_get_enable_tcrypt (UDisksDaemon *daemon)
   return daemon->enable_tcrypt;
 }
 
+/**
+ * udisks_daemon_get_profile_startup:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets @daemon setting whether the durations of the start-up phases
+ * should be logged.
+ *
+ * Returns: %TRUE if --profile-startup commandline switch has been specified.
+ */
+gboolean
+udisks_daemon_get_profile_startup (UDisksDaemon *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), FALSE);
+  return daemon->profile_startup;
+}
+
+/**
+ * udisks_daemon_begin_interfaces_batch:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Marks the start of adding interfaces to many already exported objects
+ * at once, e.g. when the interfaces of newly loaded modules are attached
+ * to all the drives and block devices. Until the matching
+ * udisks_daemon_end_interfaces_batch() call the
+ * <literal>InterfacesAdded</literal> signals of the objects are held
+ * back and then emitted once per object, see #UDisksManagedObjectsCache.
+ *
+ * The calls can be nested and may be made from any thread. The
+ * #GObject::notify signal of the #UDisksDaemon:interfaces-batched
+ * property is emitted with an internal lock held so that the handlers
+ * see the changes in order.
+ */
+void
+udisks_daemon_begin_interfaces_batch (UDisksDaemon *daemon)
+{
+  g_return_if_fail (UDISKS_IS_DAEMON (daemon));
+
+  g_rec_mutex_lock (&daemon->interfaces_batch_lock);
+  if (daemon->interfaces_batch_depth++ == 0)
+    g_object_notify (G_OBJECT (daemon), "interfaces-batched");
+  g_rec_mutex_unlock (&daemon->interfaces_batch_lock);
+}
+
+/**
+ * udisks_daemon_end_interfaces_batch:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Ends a batch started with udisks_daemon_begin_interfaces_batch().
+ */
+void
+udisks_daemon_end_interfaces_batch (UDisksDaemon *daemon)
+{
+  g_return_if_fail (UDISKS_IS_DAEMON (daemon));
+
+  g_rec_mutex_lock (&daemon->interfaces_batch_lock);
+  if (daemon->interfaces_batch_depth == 0)
+    udisks_warning ("udisks_daemon_end_interfaces_batch() called without a batch in progress");
+  else if (--daemon->interfaces_batch_depth == 0)
+    g_object_notify (G_OBJECT (daemon), "interfaces-batched");
+  g_rec_mutex_unlock (&daemon->interfaces_batch_lock);
+}
+
+/**
+ * udisks_daemon_get_interfaces_batched:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Gets whether interfaces are being added to many objects at once, see
+ * udisks_daemon_begin_interfaces_batch().
+ *
+ * Returns: %TRUE if a batch is in progress.
+ */
+gboolean
+udisks_daemon_get_interfaces_batched (UDisksDaemon *daemon)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), FALSE);
+
+  g_rec_mutex_lock (&daemon->interfaces_batch_lock);
+  ret = daemon->interfaces_batch_depth > 0;
+  g_rec_mutex_unlock (&daemon->interfaces_batch_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_daemon_profile_phase:
+ * @daemon: A #UDisksDaemon.
+ * @phase: A description of the start-up phase.
+ * @start_time: The g_get_monotonic_time() value from the beginning of @phase.
+ *
+ * Logs the duration of the start-up phase @phase if @daemon was
+ * started with --profile-startup. Does nothing otherwise.
+ */
+void
+udisks_daemon_profile_phase (UDisksDaemon *daemon,
+                             const gchar  *phase,
+                             gint64        start_time)
+{
+  g_return_if_fail (UDISKS_IS_DAEMON (daemon));
+
+  if (!daemon->profile_startup)
+    return;
+
+  udisks_notice ("Startup profile: %s took %.1f ms",
+                 phase, (g_get_monotonic_time () - start_time) / 1000.0);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 gchar *
@@ -35,7 +35,8 @@ UDisksDaemon             *udisks_daemon_new                  (GDBusConnection *c
                                                               gboolean         disable_modules,
                                                               gboolean         force_load_modules,
                                                               gboolean         uninstalled,
-                                                              gboolean         enable_tcrypt);
+                                                              gboolean         enable_tcrypt,
+                                                              gboolean         profile_startup);
 GDBusConnection          *udisks_daemon_get_connection        (UDisksDaemon    *daemon);
 GDBusObjectManagerServer *udisks_daemon_get_object_manager    (UDisksDaemon    *daemon);
 UDisksMountMonitor       *udisks_daemon_get_mount_monitor     (UDisksDaemon    *daemon);
@@ -45,7 +46,12 @@ UDisksCrypttabMonitor    *udisks_daemon_get_crypttab_monitor  (UDisksDaemon    *
 UDisksUtabMonitor        *udisks_daemon_get_utab_monitor      (UDisksDaemon    *daemon);
 #endif
 UDisksLinuxProvider      *udisks_daemon_get_linux_provider    (UDisksDaemon    *daemon);
+UDisksJobScheduler       *udisks_daemon_get_job_scheduler     (UDisksDaemon    *daemon);
+UDisksMetrics            *udisks_daemon_get_metrics           (UDisksDaemon    *daemon);
+UDisksMethodDispatcher   *udisks_daemon_get_method_dispatcher (UDisksDaemon    *daemon);
 PolkitAuthority          *udisks_daemon_get_authority         (UDisksDaemon    *daemon);
+UDisksAuthorizationCache *udisks_daemon_get_authorization_cache (UDisksDaemon *daemon);
+UDisksCallerCache        *udisks_daemon_get_caller_cache      (UDisksDaemon    *daemon);
 UDisksState              *udisks_daemon_get_state             (UDisksDaemon    *daemon);
 UDisksModuleManager      *udisks_daemon_get_module_manager    (UDisksDaemon    *daemon);
 UDisksConfigManager      *udisks_daemon_get_config_manager    (UDisksDaemon    *daemon);
@@ -53,6 +59,11 @@ gboolean                  udisks_daemon_get_disable_modules   (UDisksDaemon    *
 gboolean                  udisks_daemon_get_force_load_modules(UDisksDaemon    *daemon);
 gboolean                  udisks_daemon_get_uninstalled       (UDisksDaemon    *daemon);
 gboolean                  udisks_daemon_get_enable_tcrypt     (UDisksDaemon    *daemon);
+gboolean                  udisks_daemon_get_profile_startup   (UDisksDaemon    *daemon);
+void                      udisks_daemon_profile_phase         (UDisksDaemon    *daemon,
+                                                              const gchar     *phase,
+                                                              gint64           start_time);
+gchar                    *udisks_daemon_get_footprint_report  (UDisksDaemon    *daemon);
 
 /**
  * UDisksDaemonWaitFunc:
@@ -75,6 +86,7 @@ UDisksObject             *udisks_daemon_wait_for_object_sync  (UDisksDaemon
                                                                gpointer                   user_data,
                                                                GDestroyNotify             user_data_free_func,
                                                                guint                      timeout_seconds,
+                                                               GCancellable              *cancellable,
                                                                GError                   **error);
 
 UDisksObject             **udisks_daemon_wait_for_objects_sync  (UDisksDaemon                *daemon,
@@ -82,6 +94,7 @@ UDisksObject             **udisks_daemon_wait_for_objects_sync  (UDisksDaemon
                                                                  gpointer                     user_data,
                                                                  GDestroyNotify               user_data_free_func,
                                                                  guint                        timeout_seconds,
+                                                                 GCancellable                *cancellable,
                                                                  GError                       **error);
 
 gboolean             udisks_daemon_wait_for_object_to_disappear_sync (UDisksDaemon               *daemon,
@@ -89,9 +102,15 @@ gboolean             udisks_daemon_wait_for_object_to_disappear_sync (UDisksDaem
                                                                       gpointer                    user_data,
                                                                       GDestroyNotify              user_data_free_func,
                                                                       guint                       timeout_seconds,
+                                                                      GCancellable               *cancellable,
                                                                       GError                      **error);
 
 GList                    *udisks_daemon_get_objects           (UDisksDaemon         *daemon);
+void                      udisks_daemon_export_object_uniquely (UDisksDaemon        *daemon,
+                                                                GDBusObjectSkeleton *object);
+void                      udisks_daemon_begin_interfaces_batch (UDisksDaemon        *daemon);
+void                      udisks_daemon_end_interfaces_batch   (UDisksDaemon        *daemon);
+gboolean                  udisks_daemon_get_interfaces_batched (UDisksDaemon        *daemon);
 
 UDisksObject             *udisks_daemon_find_block            (UDisksDaemon         *daemon,
                                                                dev_t                 block_device_number);
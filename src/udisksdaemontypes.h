@@ -50,12 +50,27 @@ typedef struct _UDisksLinuxDrive UDisksLinuxDrive;
 struct _UDisksLinuxDriveAta;
 typedef struct _UDisksLinuxDriveAta UDisksLinuxDriveAta;
 
+struct _UDisksLinuxDriveNVMe;
+typedef struct _UDisksLinuxDriveNVMe UDisksLinuxDriveNVMe;
+
+struct _UDisksLinuxDriveMultipath;
+typedef struct _UDisksLinuxDriveMultipath UDisksLinuxDriveMultipath;
+
+struct _UDisksLinuxDriveStatistics;
+typedef struct _UDisksLinuxDriveStatistics UDisksLinuxDriveStatistics;
+
 struct _UDisksLinuxMDRaidObject;
 typedef struct _UDisksLinuxMDRaidObject UDisksLinuxMDRaidObject;
 
 struct _UDisksLinuxMDRaid;
 typedef struct _UDisksLinuxMDRaid UDisksLinuxMDRaid;
 
+struct _UDisksLinuxEnclosureObject;
+typedef struct _UDisksLinuxEnclosureObject UDisksLinuxEnclosureObject;
+
+struct _UDisksLinuxEnclosure;
+typedef struct _UDisksLinuxEnclosure UDisksLinuxEnclosure;
+
 struct _UDisksBaseJob;
 typedef struct _UDisksBaseJob UDisksBaseJob;
 
@@ -86,9 +101,18 @@ typedef struct _UDisksLinuxEncrypted UDisksLinuxEncrypted;
 struct _UDisksLinuxLoop;
 typedef struct _UDisksLinuxLoop UDisksLinuxLoop;
 
+struct _UDisksLinuxBlockZoned;
+typedef struct _UDisksLinuxBlockZoned UDisksLinuxBlockZoned;
+
+struct _UDisksLinuxBlockQueue;
+typedef struct _UDisksLinuxBlockQueue UDisksLinuxBlockQueue;
+
 struct _UDisksLinuxManager;
 typedef struct _UDisksLinuxManager UDisksLinuxManager;
 
+struct _UDisksLinuxDriveHealth;
+typedef struct _UDisksLinuxDriveHealth UDisksLinuxDriveHealth;
+
 struct _UDisksLinuxSwapspace;
 typedef struct _UDisksLinuxSwapspace UDisksLinuxSwapspace;
 
@@ -146,9 +170,67 @@ typedef gboolean (*UDisksThreadedJobFunc) (UDisksThreadedJob   *job,
                                            gpointer             user_data,
                                            GError             **error);
 
+/**
+ * UDisksSpawnedJobProgressFunc:
+ * @job: A #UDisksSpawnedJob.
+ * @line: A line of output of the child process, without the line terminator.
+ * @out_progress: (out): Return location for the progress, between 0.0 and 1.0.
+ * @user_data: User data passed to udisks_spawned_job_set_progress_func().
+ *
+ * Function parsing the progress of a spawned job from its output. It is
+ * called in the thread @job was started in for every line the child
+ * process writes to its standard output or standard error, lines are
+ * terminated by either a newline, a carriage return or a backspace (as
+ * used by tools rewriting a counter in place).
+ *
+ * Returns: %TRUE if @line carried progress information and @out_progress was set.
+ *
+ * Since: 2.9.0
+ */
+typedef gboolean (*UDisksSpawnedJobProgressFunc) (UDisksSpawnedJob  *job,
+                                                  const gchar       *line,
+                                                  gdouble           *out_progress,
+                                                  gpointer           user_data);
+
 struct _UDisksState;
 typedef struct _UDisksState UDisksState;
 
+struct _UDisksJobScheduler;
+typedef struct _UDisksJobScheduler UDisksJobScheduler;
+
+struct _UDisksMetrics;
+typedef struct _UDisksMetrics UDisksMetrics;
+
+struct _UDisksMethodDispatcher;
+typedef struct _UDisksMethodDispatcher UDisksMethodDispatcher;
+
+struct _UDisksManagedObjectsCache;
+typedef struct _UDisksManagedObjectsCache UDisksManagedObjectsCache;
+
+struct _UDisksPeerServer;
+typedef struct _UDisksPeerServer UDisksPeerServer;
+
+struct _UDisksAuthorizationCache;
+typedef struct _UDisksAuthorizationCache UDisksAuthorizationCache;
+
+struct _UDisksCallerCache;
+typedef struct _UDisksCallerCache UDisksCallerCache;
+
+struct _UDisksProbeSnapshot;
+typedef struct _UDisksProbeSnapshot UDisksProbeSnapshot;
+
+struct _UDisksIdleMonitor;
+typedef struct _UDisksIdleMonitor UDisksIdleMonitor;
+
+struct _UDisksTrimScheduler;
+typedef struct _UDisksTrimScheduler UDisksTrimScheduler;
+
+struct _UDisksSysfsReader;
+typedef struct _UDisksSysfsReader UDisksSysfsReader;
+
+typedef struct _UDisksBulkAuthorization UDisksBulkAuthorization;
+typedef struct _UDisksBulkCall UDisksBulkCall;
+
 /**
  * UDisksMountType:
  * @UDISKS_MOUNT_TYPE_FILESYSTEM: Object correspond to a mounted filesystem.
@@ -162,6 +244,21 @@ typedef enum
   UDISKS_MOUNT_TYPE_SWAP
 } UDisksMountType;
 
+/**
+ * UDisksMountMonitorDevFunc:
+ * @monitor: The #UDisksMountMonitor.
+ * @mount: The #UDisksMount that was added or removed.
+ * @added: %TRUE if @mount was added, %FALSE if it was removed.
+ * @user_data: The user data passed to udisks_mount_monitor_add_dev_watch().
+ *
+ * Type of functions that get notified about mount changes for a single
+ * device number, see udisks_mount_monitor_add_dev_watch().
+ */
+typedef void (*UDisksMountMonitorDevFunc) (UDisksMountMonitor *monitor,
+                                           UDisksMount        *mount,
+                                           gboolean            added,
+                                           gpointer            user_data);
+
 
 /**
  * UDisksLogLevel:
@@ -191,6 +288,9 @@ typedef struct _UDisksAtaCommandOutput UDisksAtaCommandOutput;
 struct _UDisksAtaCommandInput;
 typedef struct _UDisksAtaCommandInput UDisksAtaCommandInput;
 
+struct _UDisksAtaCommandQueue;
+typedef struct _UDisksAtaCommandQueue UDisksAtaCommandQueue;
+
 /**
  * UDisksAtaCommandProtocol:
  * @UDISKS_ATA_COMMAND_PROTOCOL_NONE: Non-data
@@ -206,6 +306,32 @@ typedef enum
   UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE
 } UDisksAtaCommandProtocol;
 
+struct _UDisksAtaSmartAttribute;
+typedef struct _UDisksAtaSmartAttribute UDisksAtaSmartAttribute;
+
+struct _UDisksAtaSmartData;
+typedef struct _UDisksAtaSmartData UDisksAtaSmartData;
+
+/**
+ * UDisksAtaSmartUnit:
+ * @UDISKS_ATA_SMART_UNIT_UNKNOWN: The pretty value has no known interpretation.
+ * @UDISKS_ATA_SMART_UNIT_NONE: Dimensionless.
+ * @UDISKS_ATA_SMART_UNIT_MSECONDS: Milliseconds.
+ * @UDISKS_ATA_SMART_UNIT_SECTORS: Sectors.
+ * @UDISKS_ATA_SMART_UNIT_MKELVIN: Millikelvin.
+ *
+ * Units for the pretty value of a SMART attribute, matching the
+ * pretty_unit values used by the <literal>SmartGetAttributes()</literal> D-Bus method.
+ */
+typedef enum
+{
+  UDISKS_ATA_SMART_UNIT_UNKNOWN,
+  UDISKS_ATA_SMART_UNIT_NONE,
+  UDISKS_ATA_SMART_UNIT_MSECONDS,
+  UDISKS_ATA_SMART_UNIT_SECTORS,
+  UDISKS_ATA_SMART_UNIT_MKELVIN
+} UDisksAtaSmartUnit;
+
 struct _UDisksLinuxDevice;
 typedef struct _UDisksLinuxDevice UDisksLinuxDevice;
 
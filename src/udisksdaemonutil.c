@@ -18,27 +18,40 @@
  *
  */
 
+#define _GNU_SOURCE /* for memfd_create() and F_ADD_SEALS */
+
 #include "config.h"
 #include <glib/gi18n-lib.h>
 #include <glib/gstdio.h>
 #include <gio/gunixfdlist.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
 #include <fcntl.h>
 #include <errno.h>
 #include <pwd.h>
+#include <unistd.h>
 
 #include <limits.h>
 #include <stdlib.h>
 
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksauthorizationcache.h"
+#include "udiskscallercache.h"
 #include "udisksstate.h"
 #include "udiskslogging.h"
+#include "udisksmetrics.h"
 #include "udiskslinuxblockobject.h"
+#include "udiskslinuxblock.h"
 #include "udiskslinuxdriveobject.h"
 
 #if defined(HAVE_LIBSYSTEMD_LOGIN)
@@ -288,7 +301,10 @@ void
 udisks_safe_append_to_object_path (GString      *str,
                                    const gchar  *s)
 {
+  static const gchar hex[] = "0123456789abcdef";
   guint n;
+  guint run_start = 0;
+
   for (n = 0; s[n] != '\0'; n++)
     {
       gint c = s[n];
@@ -297,15 +313,101 @@ udisks_safe_append_to_object_path (GString      *str,
        * Each element must only contain the ASCII characters "[A-Z][a-z][0-9]_"
        */
       if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')
+        continue;
+
+      /* copy the allowed characters in one go, names rarely need escaping */
+      g_string_append_len (str, s + run_start, n - run_start);
+      run_start = n + 1;
+
+      /* Escape bytes not in [A-Z][a-z][0-9] as _<hex-with-two-digits>,
+       * sign-extended for non-ASCII bytes as the paths always were */
+      g_string_append_c (str, '_');
+      if (c < 0)
+        g_string_append (str, "ffffff");
+      g_string_append_c (str, hex[((guchar) c) >> 4]);
+      g_string_append_c (str, hex[((guchar) c) & 0x0f]);
+    }
+  g_string_append_len (str, s + run_start, n - run_start);
+}
+
+/**
+ * udisks_daemon_util_variant_to_fd_list:
+ * @value: A #GVariant.
+ * @error: Return location for error or %NULL.
+ *
+ * Serializes @value into a sealed memory file (see memfd_create(2)), for
+ * methods returning large results as a file descriptor instead of inline
+ * in the reply. The file descriptor can be passed to the caller as the
+ * handle 0 of the returned #GUnixFDList. The file contains the value in
+ * the normal form of the GVariant serialization format, so the caller
+ * can map the file and use g_variant_new_from_data() with the type the
+ * method documents. The file is sealed against writes and resizing so
+ * the caller can map it without having to worry about the daemon
+ * changing it.
+ *
+ * Returns: (transfer full): A #GUnixFDList with a single file descriptor or %NULL if @error is set.
+ */
+GUnixFDList *
+udisks_daemon_util_variant_to_fd_list (GVariant  *value,
+                                       GError   **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+  GUnixFDList *fd_list = NULL;
+  GVariant *normal;
+  const gchar *data;
+  gsize size;
+  gsize written = 0;
+  gint fd;
+
+  normal = g_variant_get_normal_form (value);
+  data = g_variant_get_data (normal);
+  size = g_variant_get_size (normal);
+
+  fd = memfd_create ("udisks-reply", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error creating memory file: %m");
+      goto out;
+    }
+
+  while (written < size)
+    {
+      gssize ret;
+
+      ret = write (fd, data + written, size - written);
+      if (ret < 0)
         {
-          g_string_append_c (str, c);
-        }
-      else
-        {
-          /* Escape bytes not in [A-Z][a-z][0-9] as _<hex-with-two-digits> */
-          g_string_append_printf (str, "_%02x", (guint) c);
+          if (errno == EINTR)
+            continue;
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error writing %" G_GSIZE_FORMAT " bytes to memory file: %m", size);
+          goto out;
         }
+      written += ret;
     }
+
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error sealing memory file: %m");
+      goto out;
+    }
+
+  /* takes ownership of the file descriptor */
+  fd_list = g_unix_fd_list_new_from_array (&fd, 1);
+  fd = -1;
+
+ out:
+  if (fd >= 0)
+    close (fd);
+  g_variant_unref (normal);
+  return fd_list;
+#else
+  g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+               "Returning results as file descriptors is not supported on this system");
+  return NULL;
+#endif
 }
 
 /**
@@ -343,6 +445,116 @@ udisks_g_object_ref_copy (gconstpointer object, gpointer unused)
   return g_object_ref (G_OBJECT (object));
 }
 
+typedef struct
+{
+  /* the udev initialization time, changes when the device is added again */
+  gchar *usec_initialized;
+  /* the SEQNUM of the uevent the media was last checked for */
+  gchar *seqnum;
+  guint64 size;
+  gboolean media_available;
+} MediaState;
+
+static void
+media_state_free (MediaState *state)
+{
+  g_free (state->usec_initialized);
+  g_free (state->seqnum);
+  g_free (state);
+}
+
+G_LOCK_DEFINE_STATIC (media_state_cache_lock);
+/* maps from sysfs path to MediaState - protected by media_state_cache_lock */
+static GHashTable *media_state_cache = NULL;
+
+static gboolean
+attr_has_media_change (GUdevDevice *device,
+                       const gchar *name)
+{
+  const gchar *events = g_udev_device_get_sysfs_attr (device, name);
+  return events != NULL && strstr (events, "media_change") != NULL;
+}
+
+/* Whether the kernel sends a uevent with DISK_MEDIA_CHANGE=1 whenever the
+ * media of @device changes, either because the device notifies about it
+ * or because the kernel polls it */
+static gboolean
+media_change_events_reported (GUdevDevice *device)
+{
+  if (attr_has_media_change (device, "events_async"))
+    return TRUE;
+  return attr_has_media_change (device, "events") &&
+         g_udev_device_get_sysfs_attr_as_int (device, "events_poll_msecs") > 0;
+}
+
+static gboolean
+probe_media_available (GUdevDevice *device)
+{
+  gint fd;
+
+  /* For the general case, just rely on open(2) failing with
+   * ENOMEDIUM if no medium is inserted
+   */
+  fd = open (g_udev_device_get_device_file (device), O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+  close (fd);
+  return TRUE;
+}
+
+/* Like probe_media_available() but only opens @device if there was a media
+ * change event since the last check, if the size of the device changed or
+ * if the kernel doesn't report media changes for it at all. Each open()
+ * makes the kernel send a TEST UNIT READY to the device. */
+static gboolean
+get_media_available (GUdevDevice *device)
+{
+  const gchar *sysfs_path = g_udev_device_get_sysfs_path (device);
+  const gchar *usec_initialized = g_udev_device_get_property (device, "USEC_INITIALIZED");
+  const gchar *seqnum = g_udev_device_get_property (device, "SEQNUM");
+  guint64 size = g_udev_device_get_sysfs_attr_as_uint64 (device, "size");
+  gboolean media_event;
+  MediaState *state;
+  gboolean ret;
+
+  if (!media_change_events_reported (device))
+    {
+      G_LOCK (media_state_cache_lock);
+      if (media_state_cache != NULL)
+        g_hash_table_remove (media_state_cache, sysfs_path);
+      G_UNLOCK (media_state_cache_lock);
+      return probe_media_available (device);
+    }
+
+  G_LOCK (media_state_cache_lock);
+  if (media_state_cache == NULL)
+    media_state_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) media_state_free);
+  state = g_hash_table_lookup (media_state_cache, sysfs_path);
+  media_event = g_udev_device_get_property_as_boolean (device, "DISK_MEDIA_CHANGE") &&
+                (state == NULL || g_strcmp0 (state->seqnum, seqnum) != 0);
+  if (state != NULL && !media_event && state->size == size &&
+      g_strcmp0 (state->usec_initialized, usec_initialized) == 0)
+    {
+      ret = state->media_available;
+      G_UNLOCK (media_state_cache_lock);
+      return ret;
+    }
+  G_UNLOCK (media_state_cache_lock);
+
+  ret = probe_media_available (device);
+
+  state = g_new0 (MediaState, 1);
+  state->usec_initialized = g_strdup (usec_initialized);
+  state->seqnum = g_strdup (seqnum);
+  state->size = size;
+  state->media_available = ret;
+  G_LOCK (media_state_cache_lock);
+  g_hash_table_replace (media_state_cache, g_strdup (sysfs_path), state);
+  G_UNLOCK (media_state_cache_lock);
+
+  return ret;
+}
+
 /**
  * udisks_daemon_util_block_get_size:
  * @device: A #GUdevDevice for a top-level block device.
@@ -351,6 +563,12 @@ udisks_g_object_ref_copy (gconstpointer object, gpointer unused)
  *
  * Gets the size of the @device top-level block device, checking for media in the process
  *
+ * For removable devices other than optical and floppy drives the device
+ * is opened to check for media, but only after a media change uevent, a
+ * change of the size or if the kernel reports no media changes for the
+ * device, see the <literal>events</literal> and
+ * <literal>events_poll_msecs</literal> sysfs attributes.
+ *
  * Returns: The size of @device or 0 if no media is available or if unknown.
  */
 guint64
@@ -382,16 +600,7 @@ udisks_daemon_util_block_get_size (GUdevDevice *device,
         }
       else
         {
-          gint fd;
-          /* For the general case, just rely on open(2) failing with
-           * ENOMEDIUM if no medium is inserted
-           */
-          fd = open (g_udev_device_get_device_file (device), O_RDONLY);
-          if (fd >= 0)
-            {
-              media_available = TRUE;
-              close (fd);
-            }
+          media_available = get_media_available (device);
         }
     }
   else
@@ -413,6 +622,31 @@ udisks_daemon_util_block_get_size (GUdevDevice *device,
 }
 
 
+/**
+ * udisks_daemon_util_strv_equal:
+ * @a: (allow-none): A %NULL-terminated array of strings or %NULL.
+ * @b: (allow-none): A %NULL-terminated array of strings or %NULL.
+ *
+ * Checks whether @a and @b contain the same strings in the same order.
+ *
+ * Returns: %TRUE if @a and @b are equal or both %NULL, %FALSE otherwise.
+ */
+gboolean
+udisks_daemon_util_strv_equal (const gchar * const *a,
+                               const gchar * const *b)
+{
+  guint n;
+
+  if (a == NULL || b == NULL)
+    return a == b;
+  for (n = 0; a[n] != NULL && b[n] != NULL; n++)
+    {
+      if (g_strcmp0 (a[n], b[n]) != 0)
+        return FALSE;
+    }
+  return a[n] == NULL && b[n] == NULL;
+}
+
 /**
  * udisks_daemon_util_resolve_link:
  * @path: A path
@@ -736,49 +970,22 @@ udisks_daemon_util_check_authorization_sync (UDisksDaemon          *daemon,
   return TRUE;
 }
 
-gboolean
-udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *daemon,
-                                                        UDisksObject           *object,
-                                                        const gchar            *action_id,
-                                                        GVariant               *options,
-                                                        const gchar            *message,
-                                                        GDBusMethodInvocation  *invocation,
-                                                        GError                **error)
+/* Builds the polkit details for a check on @object, see
+ * <xref linkend="udisks-polkit-details"/> */
+static PolkitDetails *
+build_details (UDisksDaemon *daemon,
+               UDisksObject *object,
+               const gchar  *message)
 {
-  PolkitAuthority *authority = NULL;
-  PolkitSubject *subject = NULL;
-  PolkitDetails *details = NULL;
-  PolkitCheckAuthorizationFlags flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE;
-  PolkitAuthorizationResult *result = NULL;
-  GError *sub_error = NULL;
-  gboolean ret = FALSE;
+  PolkitDetails *details;
   UDisksBlock *block = NULL;
+  UDisksLinuxBlockSnapshot *snapshot = NULL;
   UDisksDrive *drive = NULL;
   UDisksPartition *partition = NULL;
-  UDisksObject *block_object = NULL;
   UDisksObject *drive_object = NULL;
-  gboolean auth_no_user_interaction = FALSE;
   const gchar *details_device = NULL;
   gchar *details_drive = NULL;
 
-  authority = udisks_daemon_get_authority (daemon);
-  if (authority == NULL)
-    {
-      ret = check_authorization_no_polkit (daemon, object, action_id, options, message, invocation, error);
-      goto out;
-    }
-
-  subject = polkit_system_bus_name_new (g_dbus_method_invocation_get_sender (invocation));
-  if (options != NULL)
-    {
-      g_variant_lookup (options,
-                        "auth.no_user_interaction",
-                        "b",
-                        &auth_no_user_interaction);
-    }
-  if (!auth_no_user_interaction)
-    flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
-
   details = polkit_details_new ();
   polkit_details_insert (details, "polkit.message", message);
   polkit_details_insert (details, "polkit.gettext_domain", "udisks2");
@@ -787,10 +994,14 @@ udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *
   if (object != NULL)
     {
       block = udisks_object_get_block (object);
-      if (block != NULL)
+      /* we're likely not in the main thread, use a consistent copy of
+       * the properties while the main thread may be updating them */
+      if (block != NULL && UDISKS_IS_LINUX_BLOCK (block))
+        snapshot = udisks_linux_block_get_snapshot (UDISKS_LINUX_BLOCK (block));
+      if (snapshot != NULL)
         {
-          block_object = g_object_ref (object);
-          drive_object = udisks_daemon_find_object (daemon, udisks_block_get_drive (block));
+          if (g_variant_is_object_path (snapshot->drive))
+            drive_object = udisks_daemon_find_object (daemon, snapshot->drive);
           if (drive_object != NULL)
             drive = udisks_object_get_drive (drive_object);
         }
@@ -801,8 +1012,8 @@ udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *
         drive = udisks_object_get_drive (object);
     }
 
-  if (block != NULL)
-    details_device = udisks_block_get_preferred_device (block);
+  if (snapshot != NULL)
+    details_device = snapshot->preferred_device;
 
   /* If we have a drive, use vendor/model in the message (in addition to Block:preferred-device) */
   if (drive != NULL)
@@ -825,9 +1036,9 @@ udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *
       else
         s = g_strdup (model);
 
-      if (block != NULL)
+      if (snapshot != NULL)
         {
-          details_drive = g_strdup_printf ("%s (%s)", s, udisks_block_get_preferred_device (block));
+          details_drive = g_strdup_printf ("%s (%s)", s, snapshot->preferred_device);
         }
       else
         {
@@ -869,13 +1080,13 @@ udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *
         }
     }
 
-  if (block != NULL)
+  if (snapshot != NULL)
     {
-      _safe_polkit_details_insert (details, "id.type",    udisks_block_get_id_type (block));
-      _safe_polkit_details_insert (details, "id.usage",   udisks_block_get_id_usage (block));
-      _safe_polkit_details_insert (details, "id.version", udisks_block_get_id_version (block));
-      _safe_polkit_details_insert (details, "id.label",   udisks_block_get_id_label (block));
-      _safe_polkit_details_insert (details, "id.uuid",    udisks_block_get_id_uuid (block));
+      _safe_polkit_details_insert (details, "id.type",    snapshot->id_type);
+      _safe_polkit_details_insert (details, "id.usage",   snapshot->id_usage);
+      _safe_polkit_details_insert (details, "id.version", snapshot->id_version);
+      _safe_polkit_details_insert (details, "id.label",   snapshot->id_label);
+      _safe_polkit_details_insert (details, "id.uuid",    snapshot->id_uuid);
     }
 
   if (partition != NULL)
@@ -888,14 +1099,96 @@ udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *
     }
 
   /* Fall back to Block:preferred-device */
-  if (details_drive == NULL && block != NULL)
-    details_drive = udisks_block_dup_preferred_device (block);
+  if (details_drive == NULL && snapshot != NULL)
+    details_drive = g_strdup (snapshot->preferred_device);
 
   if (details_device != NULL)
     polkit_details_insert (details, "device", details_device);
   if (details_drive != NULL)
     polkit_details_insert (details, "drive", details_drive);
 
+  g_free (details_drive);
+  g_clear_object (&drive_object);
+  g_clear_object (&block);
+  if (snapshot != NULL)
+    udisks_linux_block_snapshot_unref (snapshot);
+  g_clear_object (&partition);
+  g_clear_object (&drive);
+  return details;
+}
+
+static gboolean
+check_authorization_with_details (UDisksDaemon           *daemon,
+                                  UDisksObject           *object,
+                                  const gchar            *action_id,
+                                  GVariant               *options,
+                                  const gchar            *message,
+                                  PolkitDetails          *details,
+                                  GDBusMethodInvocation  *invocation,
+                                  GError                **error)
+{
+  PolkitAuthority *authority = NULL;
+  PolkitSubject *subject = NULL;
+  PolkitCheckAuthorizationFlags flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE;
+  PolkitAuthorizationResult *result = NULL;
+  GError *sub_error = NULL;
+  gboolean ret = FALSE;
+  gboolean auth_no_user_interaction = FALSE;
+  UDisksAuthorizationCache *cache;
+  gchar *cache_key = NULL;
+
+  authority = udisks_daemon_get_authority (daemon);
+  if (authority == NULL)
+    {
+      ret = check_authorization_no_polkit (daemon, object, action_id, options, message, invocation, error);
+      goto out;
+    }
+
+  if (g_dbus_method_invocation_get_sender (invocation) != NULL)
+    {
+      subject = polkit_system_bus_name_new (g_dbus_method_invocation_get_sender (invocation));
+    }
+  else
+    {
+      uid_t caller_uid;
+      pid_t caller_pid;
+
+      /* peer-to-peer connection, check the process on the other end of the socket */
+      if (!udisks_caller_cache_get_credentials (udisks_daemon_get_caller_cache (daemon),
+                                                g_dbus_method_invocation_get_connection (invocation),
+                                                NULL, /* caller */
+                                                NULL, /* GCancellable* */
+                                                &caller_uid,
+                                                &caller_pid,
+                                                error))
+        goto out;
+      subject = polkit_unix_process_new_for_owner (caller_pid, 0, caller_uid);
+    }
+  if (options != NULL)
+    {
+      g_variant_lookup (options,
+                        "auth.no_user_interaction",
+                        "b",
+                        &auth_no_user_interaction);
+    }
+  if (!auth_no_user_interaction)
+    flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
+
+  cache = udisks_daemon_get_authorization_cache (daemon);
+  /* the results are dropped when the bus name goes away, peers have none */
+  if (udisks_authorization_cache_get_enabled (cache) &&
+      g_dbus_method_invocation_get_sender (invocation) != NULL)
+    {
+      cache_key = udisks_authorization_cache_build_key (g_dbus_method_invocation_get_sender (invocation),
+                                                        action_id,
+                                                        details);
+      if (udisks_authorization_cache_lookup (cache, cache_key))
+        {
+          ret = TRUE;
+          goto out;
+        }
+    }
+
   sub_error = NULL;
   result = polkit_authority_check_authorization_sync (authority,
                                                       subject,
@@ -944,84 +1237,519 @@ udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *
       goto out;
     }
 
+  /* results of interactive checks may not be reused, polkit may require
+   * authenticating every time */
+  if (cache_key != NULL && flags == POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE)
+    udisks_authorization_cache_add (cache, cache_key);
+
   ret = TRUE;
 
  out:
-  g_free (details_drive);
-  g_clear_object (&block_object);
-  g_clear_object (&drive_object);
-  g_clear_object (&block);
-  g_clear_object (&partition);
-  g_clear_object (&drive);
+  g_free (cache_key);
   g_clear_object (&subject);
-  g_clear_object (&details);
   g_clear_object (&result);
   return ret;
 }
 
+gboolean
+udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon           *daemon,
+                                                        UDisksObject           *object,
+                                                        const gchar            *action_id,
+                                                        GVariant               *options,
+                                                        const gchar            *message,
+                                                        GDBusMethodInvocation  *invocation,
+                                                        GError                **error)
+{
+  PolkitDetails *details;
+  gboolean ret;
+
+  details = build_details (daemon, object, message);
+  ret = check_authorization_with_details (daemon, object, action_id, options, message,
+                                          details, invocation, error);
+  g_object_unref (details);
+  return ret;
+}
+
+/**
+ * UDisksBulkAuthorization:
+ *
+ * The authorization of a method call acting on many objects at once,
+ * see udisks_daemon_util_check_authorization_sync_bulk().
+ */
+struct _UDisksBulkAuthorization
+{
+  GMutex lock;
+  GVariant *options;
+  gchar *message;
+  /* maps keys built from the action id and the polkit details of a
+   * check to the GError of the check if it failed or to NULL */
+  GHashTable *checked;
+};
+
+static void
+bulk_authorization_error_free (GError *error)
+{
+  if (error != NULL)
+    g_error_free (error);
+}
+
+/**
+ * udisks_daemon_util_bulk_authorization_new:
+ * @options: The options of the method call, used for all checks.
+ * @message: The message to show in the authentication dialog, used for all checks.
+ *
+ * Creates a new #UDisksBulkAuthorization.
+ *
+ * Returns: A #UDisksBulkAuthorization. Free with udisks_daemon_util_bulk_authorization_free().
+ */
+UDisksBulkAuthorization *
+udisks_daemon_util_bulk_authorization_new (GVariant    *options,
+                                           const gchar *message)
+{
+  UDisksBulkAuthorization *bulk;
+
+  bulk = g_new0 (UDisksBulkAuthorization, 1);
+  g_mutex_init (&bulk->lock);
+  bulk->options = options != NULL ? g_variant_ref (options) : NULL;
+  bulk->message = g_strdup (message);
+  bulk->checked = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, (GDestroyNotify) bulk_authorization_error_free);
+  return bulk;
+}
+
+/**
+ * udisks_daemon_util_bulk_authorization_free:
+ * @bulk: A #UDisksBulkAuthorization.
+ *
+ * Frees @bulk.
+ */
+void
+udisks_daemon_util_bulk_authorization_free (UDisksBulkAuthorization *bulk)
+{
+  g_hash_table_unref (bulk->checked);
+  g_free (bulk->message);
+  if (bulk->options != NULL)
+    g_variant_unref (bulk->options);
+  g_mutex_clear (&bulk->lock);
+  g_free (bulk);
+}
+
+/**
+ * udisks_daemon_util_check_authorization_sync_bulk:
+ * @daemon: A #UDisksDaemon.
+ * @object: (allow-none): The #GDBusObject that the call is on or %NULL.
+ * @action_id: The action id to check for.
+ * @options: (allow-none): A #GVariant to check for the <quote>auth.no_user_interaction</quote> option or %NULL.
+ * @message: The message to convey (use N_).
+ * @invocation: The invocation to check for.
+ * @bulk: (allow-none): A #UDisksBulkAuthorization or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Like udisks_daemon_util_check_authorization_sync_with_error() if @bulk
+ * is %NULL. Otherwise @action_id is checked for @object with the options
+ * and message @bulk was created with and the result is reused for all
+ * the later checks of @action_id with the same polkit details, e.g. for
+ * other partitions of the same drive. Checks on objects with different
+ * details are always done separately so rules using the details apply
+ * to every object. This may be called from several threads at once.
+ *
+ * Returns: %TRUE if caller is authorized, %FALSE if not.
+ */
+gboolean
+udisks_daemon_util_check_authorization_sync_bulk (UDisksDaemon             *daemon,
+                                                  UDisksObject             *object,
+                                                  const gchar              *action_id,
+                                                  GVariant                 *options,
+                                                  const gchar              *message,
+                                                  GDBusMethodInvocation    *invocation,
+                                                  UDisksBulkAuthorization  *bulk,
+                                                  GError                  **error)
+{
+  PolkitDetails *details;
+  GError *checked_error = NULL;
+  gchar *key;
+  gboolean ret;
+
+  if (bulk == NULL)
+    return udisks_daemon_util_check_authorization_sync_with_error (daemon,
+                                                                   object,
+                                                                   action_id,
+                                                                   options,
+                                                                   message,
+                                                                   invocation,
+                                                                   error);
+
+  details = build_details (daemon, object, bulk->message);
+  key = udisks_authorization_cache_build_key ("", action_id, details);
+
+  /* also makes concurrent identical checks wait for the first one */
+  g_mutex_lock (&bulk->lock);
+  if (!g_hash_table_lookup_extended (bulk->checked, key, NULL, (gpointer *) &checked_error))
+    {
+      check_authorization_with_details (daemon,
+                                        object,
+                                        action_id,
+                                        bulk->options,
+                                        bulk->message,
+                                        details,
+                                        invocation,
+                                        &checked_error);
+      g_hash_table_insert (bulk->checked, key, checked_error);
+      key = NULL;
+    }
+  ret = checked_error == NULL;
+  if (!ret)
+    g_propagate_error (error, g_error_copy (checked_error));
+  g_mutex_unlock (&bulk->lock);
+
+  g_free (key);
+  g_object_unref (details);
+  return ret;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
-static gboolean
-dbus_freedesktop_guint32_get (GDBusMethodInvocation   *invocation,
-                              GCancellable            *cancellable,
-                              const gchar             *method,
-                              guint32                 *out_value,
-                              GError                 **error)
+/**
+ * UDisksBulkCall:
+ *
+ * The state of a method call acting on a list of objects at once, e.g.
+ * Manager.MountFilesystems(). It takes care of the parts all these
+ * methods share: the <literal>max-parallel</literal> option, objects
+ * listed more than once, the #UDisksBulkAuthorization, running the
+ * items in a thread pool and building the per-item results.
+ */
+struct _UDisksBulkCall
 {
-  gboolean ret = FALSE;
-  GError *local_error = NULL;
-  GVariant *value;
-  guint32 fetched = 0;
-  const gchar *caller = g_dbus_method_invocation_get_sender (invocation);
-
-
-  value = g_dbus_connection_call_sync (g_dbus_method_invocation_get_connection (invocation),
-                                       "org.freedesktop.DBus",  /* bus name */
-                                       "/org/freedesktop/DBus", /* object path */
-                                       "org.freedesktop.DBus",  /* interface */
-                                       method, /* method */
-                                       g_variant_new ("(s)", caller),
-                                       G_VARIANT_TYPE ("(u)"),
-                                       G_DBUS_CALL_FLAGS_NONE,
-                                       -1, /* timeout_msec */
-                                       cancellable,
-                                       &local_error);
-  if (value == NULL)
+  UDisksBulkAuthorization *authorization;
+  gboolean ordered;
+  guint32 max_parallel;
+  /* BulkCallItem instances, in the order of the call */
+  GArray *items;
+  /* object paths seen so far */
+  GHashTable *object_paths;
+
+  UDisksBulkCallFunc func;
+  gpointer user_data;
+};
+
+typedef struct
+{
+  gchar *object_path;
+  GError *error;
+  gboolean skip;
+} BulkCallItem;
+
+/**
+ * UDisksBulkCallFunc:
+ * @call: The #UDisksBulkCall.
+ * @index: The index of the item to process.
+ * @user_data: The data passed to udisks_daemon_util_bulk_call_run().
+ * @error: Return location for the error of the item.
+ *
+ * Processes one item of @call. Called from a thread of the pool of
+ * udisks_daemon_util_bulk_call_run(), at the same time as for other
+ * items unless @call is ordered.
+ */
+
+/**
+ * udisks_daemon_util_bulk_call_new:
+ * @options: The options of the method call.
+ * @message: The message to show in the authentication dialog, used for all checks.
+ * @ordered: Whether the items have to be processed one after another, in order.
+ * @error: Return location for error or %NULL.
+ *
+ * Creates a new #UDisksBulkCall. Unless @ordered is %TRUE, the items
+ * are processed in parallel, at most as many at the same time as the
+ * <literal>max-parallel</literal> option in @options says, by default
+ * as many as there are processors.
+ *
+ * Returns: A #UDisksBulkCall to be freed with udisks_daemon_util_bulk_call_free()
+ * or %NULL if @options are invalid and @error is set.
+ */
+UDisksBulkCall *
+udisks_daemon_util_bulk_call_new (GVariant     *options,
+                                  const gchar  *message,
+                                  gboolean      ordered,
+                                  GError      **error)
+{
+  UDisksBulkCall *call;
+  guint32 max_parallel;
+
+  max_parallel = ordered ? 1 : g_get_num_processors ();
+  if (!ordered && g_variant_lookup (options, "max-parallel", "u", &max_parallel) && max_parallel == 0)
     {
-      g_set_error (error,
-                   UDISKS_ERROR,
-                   UDISKS_ERROR_FAILED,
-                   "Error determining uid of caller %s: %s (%s, %d)",
-                   caller,
-                   local_error->message,
-                   g_quark_to_string (local_error->domain),
-                   local_error->code);
-      g_clear_error (&local_error);
-      goto out;
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "The max-parallel option has to be at least 1");
+      return NULL;
     }
 
-  {
-    G_STATIC_ASSERT (sizeof (uid_t) == sizeof (guint32));
-    G_STATIC_ASSERT (sizeof (pid_t) == sizeof (guint32));
-  }
+  call = g_new0 (UDisksBulkCall, 1);
+  call->authorization = udisks_daemon_util_bulk_authorization_new (options, message);
+  call->ordered = ordered;
+  call->max_parallel = max_parallel;
+  call->items = g_array_new (FALSE, TRUE, sizeof (BulkCallItem));
+  call->object_paths = g_hash_table_new (g_str_hash, g_str_equal);
+  return call;
+}
 
-  g_variant_get (value, "(u)", &fetched);
-  if (out_value != NULL)
-    *out_value = fetched;
+/**
+ * udisks_daemon_util_bulk_call_free:
+ * @call: A #UDisksBulkCall.
+ *
+ * Frees @call.
+ */
+void
+udisks_daemon_util_bulk_call_free (UDisksBulkCall *call)
+{
+  guint n;
 
-  g_variant_unref (value);
-  ret = TRUE;
-out:
-  return ret;
+  for (n = 0; n < call->items->len; n++)
+    {
+      BulkCallItem *item = &g_array_index (call->items, BulkCallItem, n);
+      g_free (item->object_path);
+      g_clear_error (&item->error);
+    }
+  g_array_unref (call->items);
+  g_hash_table_unref (call->object_paths);
+  udisks_daemon_util_bulk_authorization_free (call->authorization);
+  g_free (call);
+}
+
+/**
+ * udisks_daemon_util_bulk_call_add:
+ * @call: A #UDisksBulkCall.
+ * @object_path: The object path of the item.
+ *
+ * Adds an item for @object_path to @call. An object path that has been
+ * added before is only processed for its first item, the later ones
+ * fail with %UDISKS_ERROR_OPTION_NOT_PERMITTED right away.
+ *
+ * Returns: The index of the new item, i.e. the number of items added before.
+ */
+guint
+udisks_daemon_util_bulk_call_add (UDisksBulkCall *call,
+                                  const gchar    *object_path)
+{
+  BulkCallItem item = { 0 };
+
+  item.object_path = g_strdup (object_path);
+  if (!g_hash_table_add (call->object_paths, item.object_path))
+    g_set_error (&item.error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                 "The object %s is listed more than once", object_path);
+  g_array_append_val (call->items, item);
+  return call->items->len - 1;
+}
+
+/**
+ * udisks_daemon_util_bulk_call_take_error:
+ * @call: A #UDisksBulkCall.
+ * @index: The index of an item.
+ * @error: (transfer full): A #GError.
+ *
+ * Sets the result of the item at @index to @error, e.g. if it can't be
+ * processed at all, unless it has failed already. An item failed before
+ * udisks_daemon_util_bulk_call_run() is not processed.
+ */
+void
+udisks_daemon_util_bulk_call_take_error (UDisksBulkCall *call,
+                                         guint           index,
+                                         GError         *error)
+{
+  BulkCallItem *item = &g_array_index (call->items, BulkCallItem, index);
+
+  if (item->error == NULL)
+    item->error = error;
+  else
+    g_error_free (error);
+}
+
+/**
+ * udisks_daemon_util_bulk_call_skip:
+ * @call: A #UDisksBulkCall.
+ * @index: The index of an item.
+ *
+ * Keeps udisks_daemon_util_bulk_call_run() from processing the item at
+ * @index, e.g. because it is processed together with another item.
+ */
+void
+udisks_daemon_util_bulk_call_skip (UDisksBulkCall *call,
+                                   guint           index)
+{
+  g_array_index (call->items, BulkCallItem, index).skip = TRUE;
+}
+
+/**
+ * udisks_daemon_util_bulk_call_get_error:
+ * @call: A #UDisksBulkCall.
+ * @index: The index of an item.
+ *
+ * Gets the error of the item at @index.
+ *
+ * Returns: (transfer none) (nullable): The #GError of the item or %NULL if it has not failed.
+ */
+const GError *
+udisks_daemon_util_bulk_call_get_error (UDisksBulkCall *call,
+                                        guint           index)
+{
+  return g_array_index (call->items, BulkCallItem, index).error;
+}
+
+/**
+ * udisks_daemon_util_bulk_call_get_authorization:
+ * @call: A #UDisksBulkCall.
+ *
+ * Gets the #UDisksBulkAuthorization to check the items of @call with.
+ *
+ * Returns: (transfer none): A #UDisksBulkAuthorization owned by @call.
+ */
+UDisksBulkAuthorization *
+udisks_daemon_util_bulk_call_get_authorization (UDisksBulkCall *call)
+{
+  return call->authorization;
+}
+
+/* runs in a thread of the pool of udisks_daemon_util_bulk_call_run() */
+static void
+bulk_call_item_func (gpointer data,
+                     gpointer user_data)
+{
+  UDisksBulkCall *call = user_data;
+  guint index = GPOINTER_TO_UINT (data) - 1;
+
+  call->func (call, index, call->user_data,
+              &g_array_index (call->items, BulkCallItem, index).error);
 }
 
+/**
+ * udisks_daemon_util_bulk_call_run:
+ * @call: A #UDisksBulkCall.
+ * @func: Function to process an item with.
+ * @user_data: Data to pass to @func.
+ *
+ * Calls @func for all the items of @call that have neither failed nor
+ * been skipped yet and waits for all of them. No items may be added
+ * while this runs.
+ */
+void
+udisks_daemon_util_bulk_call_run (UDisksBulkCall     *call,
+                                  UDisksBulkCallFunc  func,
+                                  gpointer            user_data)
+{
+  GThreadPool *pool;
+  guint num_pending = 0;
+  guint n;
+
+  call->func = func;
+  call->user_data = user_data;
+
+  for (n = 0; n < call->items->len; n++)
+    {
+      BulkCallItem *item = &g_array_index (call->items, BulkCallItem, n);
+      if (item->error == NULL && !item->skip)
+        num_pending++;
+    }
+  if (num_pending == 0)
+    return;
+
+  pool = g_thread_pool_new (bulk_call_item_func, call, MIN (call->max_parallel, num_pending), FALSE, NULL);
+  for (n = 0; n < call->items->len; n++)
+    {
+      BulkCallItem *item = &g_array_index (call->items, BulkCallItem, n);
+      if (item->error == NULL && !item->skip)
+        g_thread_pool_push (pool, GUINT_TO_POINTER (n + 1), NULL);
+    }
+  /* waits for all the items, a single thread takes them in order */
+  g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+/**
+ * udisks_daemon_util_bulk_call_build_results:
+ * @call: A #UDisksBulkCall.
+ * @extra_type: (allow-none): <literal>"s"</literal> or <literal>"o"</literal> for a value returned for every item or %NULL.
+ * @extras: (allow-none): The values of the items if @extra_type is set, may contain %NULL.
+ *
+ * Builds the results of the call, with an (object path, error name,
+ * error message) tuple for every item, in the order they were added.
+ * With @extra_type, the value of the item from @extras follows the
+ * object path, an empty string or <literal>/</literal> for missing
+ * values. The error name and message are empty for items that didn't
+ * fail.
+ *
+ * Returns: A floating #GVariant of type <literal>a(oss)</literal>,
+ * <literal>a(osss)</literal> or <literal>a(ooss)</literal>.
+ */
+GVariant *
+udisks_daemon_util_bulk_call_build_results (UDisksBulkCall     *call,
+                                            const gchar        *extra_type,
+                                            const gchar *const *extras)
+{
+  GVariantBuilder builder;
+  gchar *type;
+  guint n;
+
+  type = g_strdup_printf ("a(o%sss)", extra_type != NULL ? extra_type : "");
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (type));
+  for (n = 0; n < call->items->len; n++)
+    {
+      BulkCallItem *item = &g_array_index (call->items, BulkCallItem, n);
+      gchar *error_name = NULL;
+
+      if (item->error != NULL)
+        error_name = g_dbus_error_encode_gerror (item->error);
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE (type + 1));
+      g_variant_builder_add (&builder, "o", item->object_path);
+      if (extra_type != NULL)
+        {
+          const gchar *extra = extras != NULL ? extras[n] : NULL;
+
+          if (g_strcmp0 (extra_type, "o") == 0)
+            g_variant_builder_add (&builder, "o", extra != NULL ? extra : "/");
+          else
+            g_variant_builder_add (&builder, "s", extra != NULL ? extra : "");
+        }
+      g_variant_builder_add (&builder, "s", error_name != NULL ? error_name : "");
+      g_variant_builder_add (&builder, "s", item->error != NULL ? item->error->message : "");
+      g_variant_builder_close (&builder);
+
+      g_free (error_name);
+    }
+  g_free (type);
+
+  return g_variant_builder_end (&builder);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* how long resolved user information is reused */
+#define USER_INFO_CACHE_TTL_USEC (60 * G_USEC_PER_SEC)
+
+typedef struct
+{
+  gid_t gid;
+  gchar *user_name;
+  gint64 expires;
+} UserInfo;
+
+static void
+user_info_free (UserInfo *info)
+{
+  g_free (info->user_name);
+  g_free (info);
+}
+
+G_LOCK_DEFINE_STATIC (user_info_cache_lock);
+/* maps from uid to UserInfo - protected by user_info_cache_lock */
+static GHashTable *user_info_cache = NULL;
+
 /**
  * udisks_daemon_util_get_user_info:
  * @out_gid: (out) (allow-none): Return location for resolved gid or %NULL.
  * @out_user_name: (out) (allow-none): Return location for resolved user name or %NULL.
  * @error: Return location for error.
  *
- * Gets the UNIX group and user name for a user id.
+ * Gets the UNIX group and user name for a user id. Successful lookups
+ * are reused for a minute.
  *
  * Returns: %TRUE if the user information was obtained, %FALSE otherwise
  */
@@ -1034,8 +1762,26 @@ udisks_daemon_util_get_user_info (const uid_t uid,
   struct passwd pwstruct;
   gchar pwbuf[8192];
   struct passwd *pw = NULL;
+  UserInfo *info;
+  gint64 now;
   int rc;
 
+  now = g_get_monotonic_time ();
+  G_LOCK (user_info_cache_lock);
+  if (user_info_cache == NULL)
+    user_info_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) user_info_free);
+  info = g_hash_table_lookup (user_info_cache, GUINT_TO_POINTER (uid));
+  if (info != NULL && info->expires > now)
+    {
+      if (out_gid != NULL)
+        *out_gid = info->gid;
+      if (out_user_name != NULL)
+        *out_user_name = g_strdup (info->user_name);
+      G_UNLOCK (user_info_cache_lock);
+      return TRUE;
+    }
+  G_UNLOCK (user_info_cache_lock);
+
   rc = getpwuid_r (uid, &pwstruct, pwbuf, sizeof pwbuf, &pw);
   if (rc == 0 && pw == NULL)
     {
@@ -1060,6 +1806,15 @@ udisks_daemon_util_get_user_info (const uid_t uid,
   if (out_user_name != NULL)
       *out_user_name = g_strdup (pwstruct.pw_name);
 
+  /* only successful lookups are cached, a missing user may be created any time */
+  info = g_new0 (UserInfo, 1);
+  info->gid = pw->pw_gid;
+  info->user_name = g_strdup (pwstruct.pw_name);
+  info->expires = now + USER_INFO_CACHE_TTL_USEC;
+  G_LOCK (user_info_cache_lock);
+  g_hash_table_replace (user_info_cache, GUINT_TO_POINTER (uid), info);
+  G_UNLOCK (user_info_cache_lock);
+
   return TRUE;
 
 out:
@@ -1085,27 +1840,13 @@ udisks_daemon_util_get_caller_uid_sync (UDisksDaemon            *daemon,
                                         uid_t                   *out_uid,
                                         GError                 **error)
 {
-  gboolean ret;
-  uid_t uid;
-
-  /* TODO: cache this on @daemon */
-
-  ret = FALSE;
-
-  if (!dbus_freedesktop_guint32_get (invocation, cancellable,
-                                     "GetConnectionUnixUser",
-                                     &uid, error))
-    {
-      goto out;
-    }
-
-  if (out_uid != NULL)
-    *out_uid = uid;
-
-  ret = TRUE;
-
- out:
-  return ret;
+  return udisks_caller_cache_get_credentials (udisks_daemon_get_caller_cache (daemon),
+                                              g_dbus_method_invocation_get_connection (invocation),
+                                              g_dbus_method_invocation_get_sender (invocation),
+                                              cancellable,
+                                              out_uid,
+                                              NULL, /* out_pid */
+                                              error);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1129,15 +1870,213 @@ udisks_daemon_util_get_caller_pid_sync (UDisksDaemon            *daemon,
                                         pid_t                   *out_pid,
                                         GError                 **error)
 {
-  // "GetConnectionUnixProcessID"
+  return udisks_caller_cache_get_credentials (udisks_daemon_get_caller_cache (daemon),
+                                              g_dbus_method_invocation_get_connection (invocation),
+                                              g_dbus_method_invocation_get_sender (invocation),
+                                              cancellable,
+                                              NULL, /* out_uid */
+                                              out_pid,
+                                              error);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  GCancellable *cancellable;
+  guint watcher_id;
+} InvocationCancellable;
+
+static void
+invocation_cancellable_free (InvocationCancellable *data)
+{
+  if (data->watcher_id != 0)
+    g_bus_unwatch_name (data->watcher_id);
+  g_object_unref (data->cancellable);
+  g_free (data);
+}
+
+static void
+on_caller_vanished (GDBusConnection *connection,
+                    const gchar     *name,
+                    gpointer         user_data)
+{
+  udisks_debug ("Caller %s left the bus, cancelling its pending operations", name);
+  g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+/**
+ * udisks_daemon_util_get_invocation_cancellable:
+ * @invocation: (allow-none): A #GDBusMethodInvocation or %NULL.
+ *
+ * Gets a #GCancellable that is cancelled when the caller of @invocation
+ * disconnects from the bus, so that long waits on its behalf can be
+ * abandoned right away. The caller is only watched once this function
+ * is called for @invocation, and for as long as @invocation is alive.
+ *
+ * Returns: (transfer none): A #GCancellable owned by @invocation or %NULL if @invocation is %NULL.
+ *
+ * Since: 2.9.0
+ */
+GCancellable *
+udisks_daemon_util_get_invocation_cancellable (GDBusMethodInvocation *invocation)
+{
+  InvocationCancellable *data;
+  const gchar *sender;
+
+  if (invocation == NULL)
+    return NULL;
+
+  data = g_object_get_data (G_OBJECT (invocation), "udisks-invocation-cancellable");
+  if (data != NULL)
+    return data->cancellable;
+
+  data = g_new0 (InvocationCancellable, 1);
+  data->cancellable = g_cancellable_new ();
+  /* no sender on peer-to-peer connections */
+  sender = g_dbus_method_invocation_get_sender (invocation);
+  if (sender != NULL)
+    data->watcher_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                                       sender,
+                                                       G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                       NULL, /* name_appeared_handler */
+                                                       on_caller_vanished,
+                                                       g_object_ref (data->cancellable),
+                                                       g_object_unref);
+  g_object_set_data_full (G_OBJECT (invocation), "udisks-invocation-cancellable",
+                          data, (GDestroyNotify) invocation_cancellable_free);
+
+  return data->cancellable;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* from linux/ioprio.h, which is not installed everywhere */
+#define UDISKS_IOPRIO_WHO_PROCESS 1
+#define UDISKS_IOPRIO_CLASS_SHIFT 13
+#define UDISKS_IOPRIO_CLASS_BE    2
+#define UDISKS_IOPRIO_CLASS_IDLE  3
+#define UDISKS_IOPRIO_PRIO_VALUE(class, data) (((class) << UDISKS_IOPRIO_CLASS_SHIFT) | (data))
+
+/**
+ * udisks_daemon_util_set_thread_priority:
+ * @options: The options of a method call.
+ * @out_saved: Return location for the previous priority of the calling thread.
+ * @error: Return location for error or %NULL.
+ *
+ * Lowers the I/O and CPU priority of the calling thread as requested
+ * by the <parameter>ioprio.class</parameter> (either
+ * <literal>idle</literal> or <literal>best-effort</literal>),
+ * <parameter>ioprio.level</parameter> (0 to 7, best-effort only) and
+ * <parameter>nice</parameter> (0 to 19) options in @options. Programs
+ * spawned from the thread and libblockdev calls made from it run with
+ * that priority, restore it with
+ * udisks_daemon_util_restore_thread_priority() when done.
+ *
+ * The real-time I/O class and negative nice values are not accepted so
+ * that callers can't get more resources than the rest of the system.
+ *
+ * Returns: %TRUE if the options are valid and the priority was changed
+ * as requested (if at all), %FALSE with @error set otherwise.
+ */
+gboolean
+udisks_daemon_util_set_thread_priority (GVariant              *options,
+                                        UDisksThreadPriority  *out_saved,
+                                        GError               **error)
+{
+  const gchar *ioprio_class = NULL;
+  gint32 ioprio_level = 4;
+  gint32 nice_value = 0;
+  gboolean has_level;
+  gboolean has_nice;
+  gint ioprio = -1;
+  pid_t tid;
+
+  memset (out_saved, 0, sizeof (UDisksThreadPriority));
+
+  g_variant_lookup (options, "ioprio.class", "&s", &ioprio_class);
+  has_level = g_variant_lookup (options, "ioprio.level", "i", &ioprio_level);
+  has_nice = g_variant_lookup (options, "nice", "i", &nice_value);
+
+  if (g_strcmp0 (ioprio_class, "idle") == 0)
+    {
+      ioprio = UDISKS_IOPRIO_PRIO_VALUE (UDISKS_IOPRIO_CLASS_IDLE, 0);
+    }
+  else if (g_strcmp0 (ioprio_class, "best-effort") == 0 || (ioprio_class == NULL && has_level))
+    {
+      if (ioprio_level < 0 || ioprio_level > 7)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                       "The ioprio.level option has to be between 0 and 7, not %d", ioprio_level);
+          return FALSE;
+        }
+      ioprio = UDISKS_IOPRIO_PRIO_VALUE (UDISKS_IOPRIO_CLASS_BE, ioprio_level);
+    }
+  else if (ioprio_class != NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "The ioprio.class option has to be idle or best-effort, not %s", ioprio_class);
+      return FALSE;
+    }
+
+  if (has_nice && (nice_value < 0 || nice_value > 19))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "The nice option has to be between 0 and 19, not %d", nice_value);
+      return FALSE;
+    }
+
+  /* both are per thread on Linux and inherited by the children */
+  if (ioprio >= 0)
+    {
+      out_saved->ioprio = syscall (SYS_ioprio_get, UDISKS_IOPRIO_WHO_PROCESS, 0);
+      if (out_saved->ioprio < 0 ||
+          syscall (SYS_ioprio_set, UDISKS_IOPRIO_WHO_PROCESS, 0, ioprio) != 0)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error setting the I/O priority: %m");
+          return FALSE;
+        }
+      out_saved->ioprio_changed = TRUE;
+    }
 
-  /* TODO: cache this on @daemon */
-  /* NOTE: pid_t is a signed 32 bit, but the
-   * GetConnectionUnixProcessID dbus method returns an unsigned */
+  if (has_nice)
+    {
+      tid = (pid_t) syscall (SYS_gettid);
+      errno = 0;
+      out_saved->nice = getpriority (PRIO_PROCESS, tid);
+      if ((out_saved->nice == -1 && errno != 0) ||
+          setpriority (PRIO_PROCESS, tid, nice_value) != 0)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error setting the nice value: %m");
+          udisks_daemon_util_restore_thread_priority (out_saved);
+          out_saved->ioprio_changed = FALSE;
+          return FALSE;
+        }
+      out_saved->nice_changed = TRUE;
+    }
 
-  return dbus_freedesktop_guint32_get (invocation, cancellable,
-                                       "GetConnectionUnixProcessID",
-                                       (guint32*)(out_pid), error);
+  return TRUE;
+}
+
+/**
+ * udisks_daemon_util_restore_thread_priority:
+ * @saved: The priority saved by udisks_daemon_util_set_thread_priority().
+ *
+ * Restores the priority of the calling thread changed by
+ * udisks_daemon_util_set_thread_priority(), if any.
+ */
+void
+udisks_daemon_util_restore_thread_priority (const UDisksThreadPriority *saved)
+{
+  if (saved->ioprio_changed &&
+      syscall (SYS_ioprio_set, UDISKS_IOPRIO_WHO_PROCESS, 0, saved->ioprio) != 0)
+    udisks_warning ("Error restoring the I/O priority of the thread: %m");
+
+  if (saved->nice_changed &&
+      setpriority (PRIO_PROCESS, (pid_t) syscall (SYS_gettid), saved->nice) != 0)
+    udisks_warning ("Error restoring the nice value of the thread: %m");
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1589,6 +2528,139 @@ udisks_daemon_util_get_free_mdraid_device (void)
   return ret;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  GSource source;
+  UDisksDaemon *daemon;
+  const gchar *name;
+  gint64 interval_usec;
+} TimeoutSource;
+
+/* rounds @time down to the whole seconds of the monotonic clock */
+static gint64
+timeout_source_tick (gint64 time)
+{
+  return time - time % G_USEC_PER_SEC;
+}
+
+static gboolean
+timeout_source_dispatch (GSource     *source,
+                         GSourceFunc  callback,
+                         gpointer     user_data)
+{
+  TimeoutSource *timeout_source = (TimeoutSource *) source;
+  gboolean ret;
+  gint64 start_time;
+
+  if (callback == NULL)
+    {
+      g_warning ("Timeout source dispatched without callback. "
+                 "You must call g_source_set_callback().");
+      return G_SOURCE_REMOVE;
+    }
+
+  start_time = g_get_monotonic_time ();
+  ret = callback (user_data);
+  udisks_metrics_record (udisks_daemon_get_metrics (timeout_source->daemon),
+                         UDISKS_METRICS_KIND_TIMER,
+                         timeout_source->name,
+                         g_get_monotonic_time () - start_time);
+
+  /* count from the tick the source was dispatched on, not from the end of
+   * the callback, so that the source stays on the common ticks */
+  if (ret)
+    g_source_set_ready_time (source, timeout_source_tick (g_get_monotonic_time ()) + timeout_source->interval_usec);
+
+  return ret;
+}
+
+static GSourceFuncs timeout_source_funcs =
+{
+  NULL, /* prepare */
+  NULL, /* check */
+  timeout_source_dispatch,
+  NULL, /* finalize */
+};
+
+/**
+ * udisks_daemon_util_timeout_source_new:
+ * @daemon: A #UDisksDaemon.
+ * @name: A static string naming the work done by the timeout, e.g. <literal>mdraid-sync-poll</literal>.
+ * @interval: The interval in seconds, must be greater than 0.
+ *
+ * Creates a new timeout source for periodic work. The source expires
+ * @interval seconds from now, rounded up to the next whole second of the
+ * monotonic clock, and then every @interval seconds. Since all the sources
+ * created by this function expire on the same whole-second ticks, no matter
+ * which #GMainContext they are attached to, all the periodic work the
+ * daemon does in a particular second is done in a single wakeup of each
+ * thread involved.
+ *
+ * The number of wakeups and the time spent in the callback are recorded as
+ * the %UDISKS_METRICS_KIND_TIMER metrics under @name.
+ *
+ * Returns: (transfer full): A #GSource. Free with g_source_unref().
+ */
+GSource *
+udisks_daemon_util_timeout_source_new (UDisksDaemon *daemon,
+                                       const gchar  *name,
+                                       guint         interval)
+{
+  GSource *source;
+  TimeoutSource *timeout_source;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (interval > 0, NULL);
+
+  source = g_source_new (&timeout_source_funcs, sizeof (TimeoutSource));
+  timeout_source = (TimeoutSource *) source;
+  timeout_source->daemon = daemon;
+  timeout_source->name = name;
+  timeout_source->interval_usec = (gint64) interval * G_USEC_PER_SEC;
+  g_source_set_name (source, name);
+  g_source_set_ready_time (source,
+                           timeout_source_tick (g_get_monotonic_time () + G_USEC_PER_SEC - 1) + timeout_source->interval_usec);
+
+  return source;
+}
+
+/**
+ * udisks_daemon_util_timeout_add_seconds:
+ * @daemon: A #UDisksDaemon.
+ * @name: A static string naming the work done by the timeout.
+ * @interval: The interval in seconds, must be greater than 0.
+ * @function: Function to call.
+ * @data: Data to pass to @function.
+ * @notify: (allow-none): Function to call when the timeout is removed or %NULL.
+ *
+ * Like g_timeout_add_seconds_full() with %G_PRIORITY_DEFAULT, but using
+ * a source created by udisks_daemon_util_timeout_source_new() so the
+ * wakeups are aligned to the common ticks of the daemon and counted.
+ *
+ * Returns: The ID (greater than 0) of the event source.
+ */
+guint
+udisks_daemon_util_timeout_add_seconds (UDisksDaemon   *daemon,
+                                        const gchar    *name,
+                                        guint           interval,
+                                        GSourceFunc     function,
+                                        gpointer        data,
+                                        GDestroyNotify  notify)
+{
+  GSource *source;
+  guint id;
+
+  g_return_val_if_fail (function != NULL, 0);
+
+  source = udisks_daemon_util_timeout_source_new (daemon, name, interval);
+  g_source_set_callback (source, function, data, notify);
+  id = g_source_attach (source, NULL);
+  g_source_unref (source);
+
+  return id;
+}
 
 /**
  * udisks_ata_identify_get_word:
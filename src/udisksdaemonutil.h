@@ -53,6 +53,9 @@ guint64 udisks_daemon_util_block_get_size (GUdevDevice *device,
 gchar *udisks_daemon_util_resolve_link (const gchar *path,
                                         const gchar *name);
 
+gboolean udisks_daemon_util_strv_equal (const gchar * const *a,
+                                        const gchar * const *b);
+
 gchar **udisks_daemon_util_resolve_links (const gchar *path,
                                           const gchar *dir_name);
 
@@ -79,6 +82,46 @@ gboolean udisks_daemon_util_check_authorization_sync_with_error (UDisksDaemon
                                                                  GDBusMethodInvocation  *invocation,
                                                                  GError                **error);
 
+UDisksBulkAuthorization *udisks_daemon_util_bulk_authorization_new  (GVariant                *options,
+                                                                     const gchar             *message);
+void                     udisks_daemon_util_bulk_authorization_free (UDisksBulkAuthorization *bulk);
+
+gboolean udisks_daemon_util_check_authorization_sync_bulk (UDisksDaemon             *daemon,
+                                                           UDisksObject             *object,
+                                                           const gchar              *action_id,
+                                                           GVariant                 *options,
+                                                           const gchar              *message,
+                                                           GDBusMethodInvocation    *invocation,
+                                                           UDisksBulkAuthorization  *bulk,
+                                                           GError                  **error);
+
+typedef void (*UDisksBulkCallFunc) (UDisksBulkCall  *call,
+                                    guint            index,
+                                    gpointer         user_data,
+                                    GError         **error);
+
+UDisksBulkCall          *udisks_daemon_util_bulk_call_new               (GVariant            *options,
+                                                                         const gchar         *message,
+                                                                         gboolean             ordered,
+                                                                         GError             **error);
+void                     udisks_daemon_util_bulk_call_free              (UDisksBulkCall      *call);
+guint                    udisks_daemon_util_bulk_call_add               (UDisksBulkCall      *call,
+                                                                         const gchar         *object_path);
+void                     udisks_daemon_util_bulk_call_take_error        (UDisksBulkCall      *call,
+                                                                         guint                index,
+                                                                         GError              *error);
+void                     udisks_daemon_util_bulk_call_skip              (UDisksBulkCall      *call,
+                                                                         guint                index);
+const GError            *udisks_daemon_util_bulk_call_get_error         (UDisksBulkCall      *call,
+                                                                         guint                index);
+UDisksBulkAuthorization *udisks_daemon_util_bulk_call_get_authorization (UDisksBulkCall      *call);
+void                     udisks_daemon_util_bulk_call_run               (UDisksBulkCall      *call,
+                                                                         UDisksBulkCallFunc   func,
+                                                                         gpointer             user_data);
+GVariant                *udisks_daemon_util_bulk_call_build_results     (UDisksBulkCall      *call,
+                                                                         const gchar         *extra_type,
+                                                                         const gchar *const  *extras);
+
 gboolean udisks_daemon_util_get_user_info (const uid_t   uid,
                                            gid_t        *out_gid,
                                            gchar       **out_user_name,
@@ -96,9 +139,37 @@ gboolean udisks_daemon_util_get_caller_pid_sync (UDisksDaemon            *daemon
                                                  pid_t                   *out_pid,
                                                  GError                 **error);
 
+GCancellable *udisks_daemon_util_get_invocation_cancellable (GDBusMethodInvocation *invocation);
+
+/**
+ * UDisksThreadPriority:
+ * @ioprio_changed: Whether the I/O priority of the thread was changed.
+ * @ioprio: The previous I/O priority of the thread, as used by ioprio_set(2).
+ * @nice_changed: Whether the nice value of the thread was changed.
+ * @nice: The previous nice value of the thread.
+ *
+ * The priority of a thread before udisks_daemon_util_set_thread_priority()
+ * changed it. Initialize with zeros.
+ */
+typedef struct
+{
+  gboolean ioprio_changed;
+  gint     ioprio;
+  gboolean nice_changed;
+  gint     nice;
+} UDisksThreadPriority;
+
+gboolean udisks_daemon_util_set_thread_priority     (GVariant                   *options,
+                                                     UDisksThreadPriority       *out_saved,
+                                                     GError                    **error);
+void     udisks_daemon_util_restore_thread_priority (const UDisksThreadPriority *saved);
+
 gpointer  udisks_daemon_util_dup_object (gpointer   interface_,
                                          GError   **error);
 
+GUnixFDList *udisks_daemon_util_variant_to_fd_list (GVariant  *value,
+                                                    GError   **error);
+
 gchar *udisks_daemon_util_hexdump (gconstpointer data, gsize len);
 void udisks_daemon_util_hexdump_debug (gconstpointer data, gsize len);
 
@@ -117,6 +188,16 @@ void                 udisks_daemon_util_uninhibit_system_sync (UDisksInhibitCook
 
 gchar *udisks_daemon_util_get_free_mdraid_device (void);
 
+GSource *udisks_daemon_util_timeout_source_new  (UDisksDaemon   *daemon,
+                                                 const gchar    *name,
+                                                 guint           interval);
+guint    udisks_daemon_util_timeout_add_seconds (UDisksDaemon   *daemon,
+                                                 const gchar    *name,
+                                                 guint           interval,
+                                                 GSourceFunc     function,
+                                                 gpointer        data,
+                                                 GDestroyNotify  notify);
+
 guint16 udisks_ata_identify_get_word (const guchar *identify_data, guint word_number);
 
 /* Utility macro for policy verification. */
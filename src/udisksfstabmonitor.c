@@ -58,9 +58,22 @@ struct _UDisksFstabMonitor
 {
   GObject parent_instance;
 
+  /* protects have_data, fstab_entries and entries_by_fsname, which are
+   * also looked up from the threads handling method calls */
+  GMutex entries_mutex;
+
   gboolean have_data;
   GList *fstab_entries;
 
+  /* maps from the fsname field of the entries (e.g. "UUID=..." or
+   * "/dev/disk/by-id/...") to GPtrArrays of the entries with that value,
+   * rebuilt along with fstab_entries and not holding references */
+  GHashTable *entries_by_fsname;
+
+  /* maps from the uuid in the x-parent= options of the entries to
+   * GPtrArrays of the entries, rebuilt along with fstab_entries */
+  GHashTable *entries_by_parent;
+
   GFileMonitor *file_monitor;
 };
 
@@ -104,7 +117,10 @@ udisks_fstab_monitor_finalize (GObject *object)
       g_object_unref (monitor->file_monitor);
     }
 
+  g_hash_table_unref (monitor->entries_by_parent);
+  g_hash_table_unref (monitor->entries_by_fsname);
   g_list_free_full (monitor->fstab_entries, g_object_unref);
+  g_mutex_clear (&monitor->entries_mutex);
 
   if (G_OBJECT_CLASS (udisks_fstab_monitor_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (udisks_fstab_monitor_parent_class)->finalize (object);
@@ -113,7 +129,12 @@ udisks_fstab_monitor_finalize (GObject *object)
 static void
 udisks_fstab_monitor_init (UDisksFstabMonitor *monitor)
 {
+  g_mutex_init (&monitor->entries_mutex);
   monitor->fstab_entries = NULL;
+  monitor->entries_by_fsname = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      NULL, (GDestroyNotify) g_ptr_array_unref);
+  monitor->entries_by_parent = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                      g_free, (GDestroyNotify) g_ptr_array_unref);
 }
 
 static void
@@ -221,6 +242,7 @@ reload_fstab_entries (UDisksFstabMonitor *monitor)
   GList *removed;
   GList *l;
 
+  g_mutex_lock (&monitor->entries_mutex);
   udisks_fstab_monitor_ensure (monitor);
 
   old_fstab_entries = g_list_copy_deep (monitor->fstab_entries, (GCopyFunc) udisks_g_object_ref_copy, NULL);
@@ -228,7 +250,8 @@ reload_fstab_entries (UDisksFstabMonitor *monitor)
   udisks_fstab_monitor_invalidate (monitor);
   udisks_fstab_monitor_ensure (monitor);
 
-  cur_fstab_entries = g_list_copy (monitor->fstab_entries);
+  cur_fstab_entries = g_list_copy_deep (monitor->fstab_entries, (GCopyFunc) udisks_g_object_ref_copy, NULL);
+  g_mutex_unlock (&monitor->entries_mutex);
 
   old_fstab_entries = g_list_sort (old_fstab_entries, (GCompareFunc) udisks_fstab_entry_compare);
   cur_fstab_entries = g_list_sort (cur_fstab_entries, (GCompareFunc) udisks_fstab_entry_compare);
@@ -247,7 +270,7 @@ reload_fstab_entries (UDisksFstabMonitor *monitor)
     }
 
   g_list_free_full (old_fstab_entries, g_object_unref);
-  g_list_free (cur_fstab_entries);
+  g_list_free_full (cur_fstab_entries, g_object_unref);
   g_list_free (removed);
   g_list_free (added);
 }
@@ -323,11 +346,48 @@ udisks_fstab_monitor_invalidate (UDisksFstabMonitor *monitor)
 {
   monitor->have_data = FALSE;
 
+  g_hash_table_remove_all (monitor->entries_by_parent);
+  g_hash_table_remove_all (monitor->entries_by_fsname);
   g_list_free_full (monitor->fstab_entries, g_object_unref);
   monitor->fstab_entries = NULL;
 }
 
 
+/* Adds @entry to the arrays in @index for every x-parent=<uuid> in @options */
+static void
+index_entry_by_parent (GHashTable  *index,
+                       const gchar *options,
+                       gpointer     entry)
+{
+  gchar **tokens;
+  guint n;
+
+  if (options == NULL || strstr (options, "x-parent=") == NULL)
+    return;
+
+  tokens = g_strsplit (options, ",", 0);
+  for (n = 0; tokens[n] != NULL; n++)
+    {
+      const gchar *parent;
+      GPtrArray *children;
+
+      if (!g_str_has_prefix (tokens[n], "x-parent="))
+        continue;
+      parent = tokens[n] + strlen ("x-parent=");
+
+      children = g_hash_table_lookup (index, parent);
+      if (children == NULL)
+        {
+          children = g_ptr_array_new ();
+          g_hash_table_insert (index, g_strdup (parent), children);
+        }
+      /* the same parent may be given more than once */
+      if (children->len == 0 || g_ptr_array_index (children, children->len - 1) != entry)
+        g_ptr_array_add (children, entry);
+    }
+  g_strfreev (tokens);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gboolean
@@ -380,7 +440,19 @@ udisks_fstab_monitor_ensure (UDisksFstabMonitor *monitor)
       entry = _udisks_fstab_entry_new (m);
       if (!have_entry (monitor, entry))
         {
+          GPtrArray *same_fsname;
+
           monitor->fstab_entries = g_list_prepend (monitor->fstab_entries, entry);
+
+          same_fsname = g_hash_table_lookup (monitor->entries_by_fsname, udisks_fstab_entry_get_fsname (entry));
+          if (same_fsname == NULL)
+            {
+              same_fsname = g_ptr_array_new ();
+              g_hash_table_insert (monitor->entries_by_fsname, (gpointer) udisks_fstab_entry_get_fsname (entry), same_fsname);
+            }
+          g_ptr_array_add (same_fsname, entry);
+
+          index_entry_by_parent (monitor->entries_by_parent, udisks_fstab_entry_get_opts (entry), entry);
         }
       else
         {
@@ -410,8 +482,77 @@ udisks_fstab_monitor_get_entries (UDisksFstabMonitor  *monitor)
 
   g_return_val_if_fail (UDISKS_IS_FSTAB_MONITOR (monitor), NULL);
 
+  g_mutex_lock (&monitor->entries_mutex);
   udisks_fstab_monitor_ensure (monitor);
 
   ret = g_list_copy_deep (monitor->fstab_entries, (GCopyFunc) udisks_g_object_ref_copy, NULL);
+  g_mutex_unlock (&monitor->entries_mutex);
+  return ret;
+}
+
+/**
+ * udisks_fstab_monitor_get_entries_for_fsname:
+ * @monitor: A #UDisksFstabMonitor.
+ * @fsname: The fsname field to look for, e.g. <literal>UUID=...</literal> or a device file.
+ *
+ * Gets the /etc/fstab entries whose fsname field is exactly @fsname, without
+ * going through all entries.
+ *
+ * Returns: (transfer full) (element-type UDisksFstabEntry): A list of #UDisksFstabEntry objects that must be freed with g_list_free() after each element has been freed with g_object_unref().
+ */
+GList *
+udisks_fstab_monitor_get_entries_for_fsname (UDisksFstabMonitor *monitor,
+                                             const gchar        *fsname)
+{
+  GPtrArray *entries;
+  GList *ret = NULL;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_FSTAB_MONITOR (monitor), NULL);
+  g_return_val_if_fail (fsname != NULL, NULL);
+
+  g_mutex_lock (&monitor->entries_mutex);
+  udisks_fstab_monitor_ensure (monitor);
+
+  entries = g_hash_table_lookup (monitor->entries_by_fsname, fsname);
+  if (entries != NULL)
+    for (n = 0; n < entries->len; n++)
+      ret = g_list_prepend (ret, g_object_ref (g_ptr_array_index (entries, n)));
+  g_mutex_unlock (&monitor->entries_mutex);
+
+  return ret;
+}
+
+/**
+ * udisks_fstab_monitor_get_entries_for_parent:
+ * @monitor: A #UDisksFstabMonitor.
+ * @uuid: The UUID of the parent object.
+ *
+ * Gets the /etc/fstab entries with a <literal>x-parent=@uuid</literal>
+ * option, in the order they appear in the file, without going through
+ * all entries.
+ *
+ * Returns: (transfer full) (element-type UDisksFstabEntry): A list of #UDisksFstabEntry objects that must be freed with g_list_free() after each element has been freed with g_object_unref().
+ */
+GList *
+udisks_fstab_monitor_get_entries_for_parent (UDisksFstabMonitor *monitor,
+                                             const gchar        *uuid)
+{
+  GPtrArray *entries;
+  GList *ret = NULL;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_FSTAB_MONITOR (monitor), NULL);
+  g_return_val_if_fail (uuid != NULL, NULL);
+
+  g_mutex_lock (&monitor->entries_mutex);
+  udisks_fstab_monitor_ensure (monitor);
+
+  entries = g_hash_table_lookup (monitor->entries_by_parent, uuid);
+  if (entries != NULL)
+    for (n = entries->len; n > 0; n--)
+      ret = g_list_prepend (ret, g_object_ref (g_ptr_array_index (entries, n - 1)));
+  g_mutex_unlock (&monitor->entries_mutex);
+
   return ret;
 }
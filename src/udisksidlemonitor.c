@@ -0,0 +1,309 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udisksstate.h"
+#include "udisksjobscheduler.h"
+#include "udisksmethoddispatcher.h"
+#include "udisksidlemonitor.h"
+
+/**
+ * SECTION:udisksidlemonitor
+ * @title: UDisksIdleMonitor
+ * @short_description: Exit the daemon when nothing needs it
+ *
+ * If <literal>idle_exit_timeout</literal> is set in udisks2.conf(5), the
+ * daemon exits once it has been idle for that many seconds, to be
+ * started again by D-Bus activation when a client needs it. The daemon
+ * is idle while
+ * <itemizedlist>
+ *   <listitem><para>no peer that has called any of its methods (including
+ *   <literal>GetManagedObjects()</literal> and the
+ *   <literal>org.freedesktop.DBus.Properties</literal> methods) is still
+ *   connected to the bus, since such clients are likely waiting for
+ *   signals,</para></listitem>
+ *   <listitem><para>no peer-to-peer connection (see #UDisksPeerServer) is
+ *   open,</para></listitem>
+ *   <listitem><para>no method calls are queued or running in the
+ *   #UDisksMethodDispatcher,</para></listitem>
+ *   <listitem><para>no jobs are running or queued and</para></listitem>
+ *   <listitem><para>nothing set up via udisks, such as mounted filesystems
+ *   or unlocked devices, is recorded in #UDisksState since those need to
+ *   be cleaned up by the daemon.</para></listitem>
+ * </itemizedlist>
+ */
+
+/* how often the idle conditions are checked at most, in seconds */
+#define IDLE_CHECK_SECONDS 10
+
+struct _UDisksIdleMonitor
+{
+  UDisksDaemon *daemon;
+
+  guint timeout;
+  UDisksIdleMonitorFunc func;
+  gpointer user_data;
+
+  guint filter_id;
+  guint name_owner_changed_subscription_id;
+  guint check_timeout_id;
+
+  /* protects clients, peers and last_busy, the filter runs in the GDBus worker thread */
+  GMutex lock;
+  /* set of the unique bus names of the connected peers that called methods */
+  GHashTable *clients;
+  /* set of the open peer-to-peer GDBusConnections */
+  GHashTable *peers;
+  /* monotonic time the daemon was last seen busy */
+  gint64 last_busy;
+};
+
+/* runs in the GDBus worker thread */
+static GDBusMessage *
+on_message (GDBusConnection *connection,
+            GDBusMessage    *message,
+            gboolean         incoming,
+            gpointer         user_data)
+{
+  UDisksIdleMonitor *monitor = user_data;
+  const gchar *sender;
+
+  if (!incoming || g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+    return message;
+
+  sender = g_dbus_message_get_sender (message);
+  if (sender == NULL || sender[0] != ':')
+    return message;
+
+  g_mutex_lock (&monitor->lock);
+  if (!g_hash_table_contains (monitor->clients, sender))
+    g_hash_table_add (monitor->clients, g_strdup (sender));
+  monitor->last_busy = g_get_monotonic_time ();
+  g_mutex_unlock (&monitor->lock);
+
+  return message;
+}
+
+static void
+on_name_owner_changed (GDBusConnection *connection,
+                       const gchar     *sender_name,
+                       const gchar     *object_path,
+                       const gchar     *interface_name,
+                       const gchar     *signal_name,
+                       GVariant        *parameters,
+                       gpointer         user_data)
+{
+  UDisksIdleMonitor *monitor = user_data;
+  const gchar *name;
+  const gchar *old_owner;
+  const gchar *new_owner;
+
+  g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+  if (name[0] != ':' || new_owner[0] != '\0')
+    return;
+
+  g_mutex_lock (&monitor->lock);
+  if (g_hash_table_remove (monitor->clients, name))
+    monitor->last_busy = g_get_monotonic_time ();
+  g_mutex_unlock (&monitor->lock);
+}
+
+static gboolean
+has_jobs (UDisksIdleMonitor *monitor)
+{
+  GList *objects;
+  GList *l;
+  gboolean ret = FALSE;
+
+  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (monitor->daemon)));
+  for (l = objects; l != NULL && !ret; l = l->next)
+    {
+      if (udisks_object_peek_job (UDISKS_OBJECT (l->data)) != NULL)
+        ret = TRUE;
+    }
+  g_list_free_full (objects, g_object_unref);
+
+  return ret;
+}
+
+static gboolean
+has_pending_calls (UDisksIdleMonitor *monitor)
+{
+  guint queued;
+  guint running;
+
+  udisks_method_dispatcher_get_counts (udisks_daemon_get_method_dispatcher (monitor->daemon),
+                                       &queued, &running, NULL);
+  return queued > 0 || running > 0;
+}
+
+static gboolean
+on_check_timeout (gpointer user_data)
+{
+  UDisksIdleMonitor *monitor = user_data;
+  gboolean busy;
+  gint64 now;
+  gint64 idle_usec;
+
+  busy = has_jobs (monitor) ||
+         !udisks_job_scheduler_is_idle (udisks_daemon_get_job_scheduler (monitor->daemon)) ||
+         has_pending_calls (monitor) ||
+         udisks_state_has_entries (udisks_daemon_get_state (monitor->daemon));
+
+  now = g_get_monotonic_time ();
+  g_mutex_lock (&monitor->lock);
+  if (busy || g_hash_table_size (monitor->clients) > 0 || g_hash_table_size (monitor->peers) > 0)
+    monitor->last_busy = now;
+  idle_usec = now - monitor->last_busy;
+  g_mutex_unlock (&monitor->lock);
+
+  if (idle_usec < (gint64) monitor->timeout * G_USEC_PER_SEC)
+    return G_SOURCE_CONTINUE;
+
+  udisks_notice ("No clients, method calls, jobs or devices set up for %u seconds, exiting", monitor->timeout);
+  monitor->check_timeout_id = 0;
+  monitor->func (monitor, monitor->user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * udisks_idle_monitor_new:
+ * @daemon: A #UDisksDaemon.
+ * @timeout: The number of seconds the daemon needs to be idle for.
+ * @func: Function to call once the daemon has been idle for @timeout seconds.
+ * @user_data: Data to pass to @func.
+ *
+ * Creates a new #UDisksIdleMonitor calling @func once, after @daemon has
+ * been idle for @timeout seconds. Must be called from the main thread
+ * before the daemon acquires its name on the bus.
+ *
+ * Returns: A #UDisksIdleMonitor. Free with udisks_idle_monitor_free().
+ */
+UDisksIdleMonitor *
+udisks_idle_monitor_new (UDisksDaemon          *daemon,
+                         guint                  timeout,
+                         UDisksIdleMonitorFunc  func,
+                         gpointer               user_data)
+{
+  UDisksIdleMonitor *monitor;
+  GDBusConnection *connection;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (timeout > 0, NULL);
+
+  monitor = g_new0 (UDisksIdleMonitor, 1);
+  monitor->daemon = daemon;
+  monitor->timeout = timeout;
+  monitor->func = func;
+  monitor->user_data = user_data;
+  g_mutex_init (&monitor->lock);
+  monitor->clients = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  monitor->peers = g_hash_table_new (g_direct_hash, g_direct_equal);
+  monitor->last_busy = g_get_monotonic_time ();
+
+  connection = udisks_daemon_get_connection (daemon);
+  monitor->filter_id = g_dbus_connection_add_filter (connection, on_message, monitor, NULL);
+  monitor->name_owner_changed_subscription_id =
+    g_dbus_connection_signal_subscribe (connection,
+                                        "org.freedesktop.DBus",
+                                        "org.freedesktop.DBus",
+                                        "NameOwnerChanged",
+                                        "/org/freedesktop/DBus",
+                                        NULL, /* arg0 */
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        on_name_owner_changed,
+                                        monitor,
+                                        NULL); /* GDestroyNotify */
+  monitor->check_timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                      "idle-check",
+                                                                      MIN (timeout, IDLE_CHECK_SECONDS),
+                                                                      on_check_timeout,
+                                                                      monitor,
+                                                                      NULL);
+
+  udisks_notice ("Exiting after %u seconds of being idle", timeout);
+
+  return monitor;
+}
+
+/**
+ * udisks_idle_monitor_free:
+ * @monitor: A #UDisksIdleMonitor.
+ *
+ * Frees @monitor.
+ */
+void
+udisks_idle_monitor_free (UDisksIdleMonitor *monitor)
+{
+  GDBusConnection *connection;
+
+  connection = udisks_daemon_get_connection (monitor->daemon);
+  if (monitor->check_timeout_id != 0)
+    g_source_remove (monitor->check_timeout_id);
+  g_dbus_connection_signal_unsubscribe (connection, monitor->name_owner_changed_subscription_id);
+  g_dbus_connection_remove_filter (connection, monitor->filter_id);
+  g_hash_table_unref (monitor->peers);
+  g_hash_table_unref (monitor->clients);
+  g_mutex_clear (&monitor->lock);
+  g_free (monitor);
+}
+
+/**
+ * udisks_idle_monitor_add_peer:
+ * @monitor: A #UDisksIdleMonitor.
+ * @connection: An open peer-to-peer #GDBusConnection.
+ *
+ * Keeps the daemon from being idle while @connection is open, until
+ * udisks_idle_monitor_remove_peer() is called for it. Peer-to-peer
+ * connections have no bus daemon telling when they go away, so they
+ * are not seen by the monitor otherwise.
+ */
+void
+udisks_idle_monitor_add_peer (UDisksIdleMonitor *monitor,
+                              GDBusConnection   *connection)
+{
+  g_mutex_lock (&monitor->lock);
+  g_hash_table_add (monitor->peers, connection);
+  monitor->last_busy = g_get_monotonic_time ();
+  g_mutex_unlock (&monitor->lock);
+}
+
+/**
+ * udisks_idle_monitor_remove_peer:
+ * @monitor: A #UDisksIdleMonitor.
+ * @connection: A #GDBusConnection passed to udisks_idle_monitor_add_peer().
+ *
+ * Stops counting @connection as a client, e.g. once it has been closed.
+ */
+void
+udisks_idle_monitor_remove_peer (UDisksIdleMonitor *monitor,
+                                 GDBusConnection   *connection)
+{
+  g_mutex_lock (&monitor->lock);
+  if (g_hash_table_remove (monitor->peers, connection))
+    monitor->last_busy = g_get_monotonic_time ();
+  g_mutex_unlock (&monitor->lock);
+}
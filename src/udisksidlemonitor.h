@@ -0,0 +1,50 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_IDLE_MONITOR_H__
+#define __UDISKS_IDLE_MONITOR_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+/**
+ * UDisksIdleMonitorFunc:
+ * @monitor: The #UDisksIdleMonitor.
+ * @user_data: The data passed to udisks_idle_monitor_new().
+ *
+ * Function called once the daemon has been idle for long enough.
+ */
+typedef void (*UDisksIdleMonitorFunc) (UDisksIdleMonitor *monitor,
+                                       gpointer           user_data);
+
+UDisksIdleMonitor *udisks_idle_monitor_new         (UDisksDaemon          *daemon,
+                                                    guint                  timeout,
+                                                    UDisksIdleMonitorFunc  func,
+                                                    gpointer               user_data);
+void               udisks_idle_monitor_free        (UDisksIdleMonitor     *monitor);
+void               udisks_idle_monitor_add_peer    (UDisksIdleMonitor     *monitor,
+                                                    GDBusConnection       *connection);
+void               udisks_idle_monitor_remove_peer (UDisksIdleMonitor     *monitor,
+                                                    GDBusConnection       *connection);
+
+G_END_DECLS
+
+#endif /* __UDISKS_IDLE_MONITOR_H__ */
@@ -0,0 +1,591 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksbasejob.h"
+#include "udisksconfigmanager.h"
+#include "udisksjobscheduler.h"
+
+/**
+ * SECTION:udisksjobscheduler
+ * @title: UDisksJobScheduler
+ * @short_description: Limits the number of jobs running at the same time
+ *
+ * The job scheduler decides when #UDisksThreadedJob and
+ * #UDisksSpawnedJob instances actually start. At most
+ * <literal>jobs_max_parallel</literal> jobs run at the same time and at
+ * most <literal>jobs_max_parallel_per_drive</literal> jobs on the same
+ * drive (see udisks2.conf(5), 0 means no limit), the others are queued
+ * with the #org.freedesktop.UDisks2.Job:Queued property set to %TRUE.
+ *
+ * Queued jobs are started by their #UDisksJobPriority, first come first
+ * served within the same priority. Jobs of the
+ * %UDISKS_JOB_PRIORITY_INTERACTIVE class are never queued (but count
+ * towards the limits) so that e.g. unmounting a filesystem doesn't have to
+ * wait for a bulk erase to finish. A queued job that is cancelled is
+ * started right away so that it completes with the cancellation error.
+ */
+
+struct _UDisksJobScheduler
+{
+  UDisksDaemon *daemon;
+
+  guint max_parallel;
+  guint max_parallel_per_drive;
+
+  /* protects all the members below */
+  GMutex lock;
+  /* signalled when a job waiting in udisks_job_scheduler_acquire_sync() is admitted */
+  GCond cond;
+
+  /* QueuedJob instances sorted by priority, FIFO within the same priority */
+  GList *queue;
+
+  /* maps from running UDisksBaseJob to its drive key (or "" if none) */
+  GHashTable *running_jobs;
+  /* maps from drive key to the number of its running jobs */
+  GHashTable *drive_n_running;
+};
+
+typedef enum
+{
+  QUEUED_JOB_PENDING,   /* not yet in the queue */
+  QUEUED_JOB_QUEUED,
+  QUEUED_JOB_ADMITTED,
+} QueuedJobState;
+
+typedef struct
+{
+  UDisksJobScheduler *scheduler;
+  UDisksBaseJob *job;
+  UDisksJobPriority priority;
+  gchar *drive_key;
+
+  /* NULL for jobs waiting in udisks_job_scheduler_acquire_sync() */
+  UDisksJobSchedulerStartFunc start_func;
+  GMainContext *context;
+
+  gulong cancelled_handler_id;
+
+  /* protected by scheduler->lock */
+  QueuedJobState state;
+  gboolean cancelled;
+} QueuedJob;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_job_scheduler_set_limits:
+ * @scheduler: A #UDisksJobScheduler.
+ * @max_parallel: The maximum number of jobs running at the same time or 0 for no limit.
+ * @max_parallel_per_drive: The maximum number of jobs running on the same drive at the same time or 0 for no limit.
+ *
+ * Changes the limits of @scheduler, e.g. when the configuration has
+ * been reloaded. Queued jobs the new limits allow to run are started
+ * right away, jobs already running are never interrupted.
+ */
+void
+udisks_job_scheduler_set_limits (UDisksJobScheduler *scheduler,
+                                 guint               max_parallel,
+                                 guint               max_parallel_per_drive)
+{
+  GList *admitted;
+
+  g_mutex_lock (&scheduler->lock);
+  scheduler->max_parallel = max_parallel;
+  scheduler->max_parallel_per_drive = max_parallel_per_drive;
+  admitted = admit_queued_locked (scheduler);
+  g_mutex_unlock (&scheduler->lock);
+
+  dispatch (scheduler, admitted);
+}
+
+/**
+ * udisks_job_scheduler_is_idle:
+ * @scheduler: A #UDisksJobScheduler.
+ *
+ * Checks whether no jobs are running or waiting to be started. May be
+ * called from any thread.
+ *
+ * Returns: %TRUE if @scheduler has no running or queued jobs, %FALSE otherwise.
+ */
+gboolean
+udisks_job_scheduler_is_idle (UDisksJobScheduler *scheduler)
+{
+  gboolean ret;
+
+  g_mutex_lock (&scheduler->lock);
+  ret = scheduler->queue == NULL && g_hash_table_size (scheduler->running_jobs) == 0;
+  g_mutex_unlock (&scheduler->lock);
+
+  return ret;
+}
+
+/**
+ * udisks_job_scheduler_get_priority_for_operation:
+ * @operation: A job operation, e.g. <literal>format-erase</literal>.
+ *
+ * Gets the priority class of jobs for @operation.
+ *
+ * Returns: A #UDisksJobPriority.
+ */
+UDisksJobPriority
+udisks_job_scheduler_get_priority_for_operation (const gchar *operation)
+{
+  static const gchar *const interactive[] = {
+    "filesystem-mount", "filesystem-unmount",
+    "encrypted-unlock", "encrypted-lock",
+    "swapspace-start", "swapspace-stop",
+    "drive-eject", "drive-power-off",
+    "loop-setup", "cleanup",
+    NULL
+  };
+  static const gchar *const bulk[] = {
+    "format-erase", "ata-secure-erase", "ata-enhanced-secure-erase",
+    "nvme-sanitize", "nvme-format",
+    "ata-smart-selftest",
+    "filesystem-check", "filesystem-repair", "filesystem-trim",
+    "encrypted-reencrypt",
+    "lvm-vg-empty-device",
+    NULL
+  };
+
+  if (operation == NULL)
+    return UDISKS_JOB_PRIORITY_NORMAL;
+  if (g_strv_contains (interactive, operation))
+    return UDISKS_JOB_PRIORITY_INTERACTIVE;
+  if (g_strv_contains (bulk, operation))
+    return UDISKS_JOB_PRIORITY_BULK;
+  return UDISKS_JOB_PRIORITY_NORMAL;
+}
+
+/* Returns the object path of the drive of the first object of @job or the
+ * object path of the object itself if there's no drive, "" if none */
+static gchar *
+get_drive_key (UDisksJobScheduler *scheduler,
+               UDisksBaseJob      *job)
+{
+  const gchar *const *objects;
+  GDBusObject *object;
+  gchar *ret = NULL;
+
+  objects = udisks_job_get_objects (UDISKS_JOB (job));
+  if (objects == NULL || objects[0] == NULL)
+    return g_strdup ("");
+
+  object = g_dbus_object_manager_get_object (G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (scheduler->daemon)),
+                                             objects[0]);
+  if (object != NULL && UDISKS_IS_OBJECT (object))
+    {
+      UDisksBlock *block = udisks_object_peek_block (UDISKS_OBJECT (object));
+      if (block != NULL && g_strcmp0 (udisks_block_get_drive (block), "/") != 0)
+        ret = udisks_block_dup_drive (block);
+    }
+  g_clear_object (&object);
+
+  if (ret == NULL)
+    ret = g_strdup (objects[0]);
+  return ret;
+}
+
+static void
+queued_job_free (QueuedJob *entry)
+{
+  if (entry->context != NULL)
+    g_main_context_unref (entry->context);
+  g_object_unref (entry->job);
+  g_free (entry->drive_key);
+  g_slice_free (QueuedJob, entry);
+}
+
+static gboolean
+can_run_locked (UDisksJobScheduler *scheduler,
+                QueuedJob          *entry)
+{
+  if (entry->priority == UDISKS_JOB_PRIORITY_INTERACTIVE || entry->cancelled)
+    return TRUE;
+
+  if (scheduler->max_parallel > 0 &&
+      g_hash_table_size (scheduler->running_jobs) >= scheduler->max_parallel)
+    return FALSE;
+
+  if (scheduler->max_parallel_per_drive > 0 && entry->drive_key[0] != '\0' &&
+      GPOINTER_TO_UINT (g_hash_table_lookup (scheduler->drive_n_running, entry->drive_key)) >= scheduler->max_parallel_per_drive)
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+admit_locked (UDisksJobScheduler *scheduler,
+              QueuedJob          *entry)
+{
+  guint n;
+
+  if (entry->state == QUEUED_JOB_QUEUED)
+    {
+      scheduler->queue = g_list_remove (scheduler->queue, entry);
+      udisks_job_set_queued (UDISKS_JOB (entry->job), FALSE);
+    }
+  entry->state = QUEUED_JOB_ADMITTED;
+
+  g_hash_table_insert (scheduler->running_jobs, g_object_ref (entry->job), g_strdup (entry->drive_key));
+  n = GPOINTER_TO_UINT (g_hash_table_lookup (scheduler->drive_n_running, entry->drive_key));
+  g_hash_table_insert (scheduler->drive_n_running, g_strdup (entry->drive_key), GUINT_TO_POINTER (n + 1));
+}
+
+/* Admits as many queued jobs as the limits allow, returns them in a list */
+static GList *
+admit_queued_locked (UDisksJobScheduler *scheduler)
+{
+  GList *admitted = NULL;
+  GList *l, *next;
+
+  for (l = scheduler->queue; l != NULL; l = next)
+    {
+      QueuedJob *entry = l->data;
+
+      next = l->next;
+      if (!can_run_locked (scheduler, entry))
+        {
+          /* nothing else can run once the global limit is reached */
+          if (scheduler->max_parallel > 0 &&
+              g_hash_table_size (scheduler->running_jobs) >= scheduler->max_parallel)
+            break;
+          continue;
+        }
+      admit_locked (scheduler, entry);
+      admitted = g_list_prepend (admitted, entry);
+    }
+
+  return g_list_reverse (admitted);
+}
+
+static void
+on_job_completed (UDisksJob   *job,
+                  gboolean     success,
+                  const gchar *message,
+                  gpointer     user_data);
+
+static void
+track_running (UDisksJobScheduler *scheduler,
+               UDisksBaseJob      *job)
+{
+  g_signal_connect (job, "completed", G_CALLBACK (on_job_completed), scheduler);
+}
+
+static gboolean
+start_queued_job_in_idle (gpointer user_data)
+{
+  QueuedJob *entry = user_data;
+
+  /* not called from the "cancelled" handler, see dispatch() */
+  g_cancellable_disconnect (udisks_base_job_get_cancellable (entry->job), entry->cancelled_handler_id);
+
+  track_running (entry->scheduler, entry->job);
+  entry->start_func (entry->job);
+  queued_job_free (entry);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Starts (or wakes up) admitted jobs, called without the lock held */
+static void
+dispatch (UDisksJobScheduler *scheduler,
+          GList              *admitted)
+{
+  GList *l;
+  gboolean wake_up = FALSE;
+
+  for (l = admitted; l != NULL; l = l->next)
+    {
+      QueuedJob *entry = l->data;
+
+      if (entry->start_func != NULL)
+        {
+          GSource *source;
+
+          /* always go through an idle source (instead of
+           * g_main_context_invoke()) so that the job never starts from
+           * the thread completing another job or cancelling this one */
+          source = g_idle_source_new ();
+          g_source_set_priority (source, G_PRIORITY_DEFAULT);
+          g_source_set_callback (source, start_queued_job_in_idle, entry, NULL);
+          g_source_attach (source, entry->context);
+          g_source_unref (source);
+        }
+      else
+        {
+          wake_up = TRUE;
+        }
+    }
+
+  if (wake_up)
+    {
+      g_mutex_lock (&scheduler->lock);
+      g_cond_broadcast (&scheduler->cond);
+      g_mutex_unlock (&scheduler->lock);
+    }
+
+  g_list_free (admitted);
+}
+
+static void
+on_job_completed (UDisksJob   *job,
+                  gboolean     success,
+                  const gchar *message,
+                  gpointer     user_data)
+{
+  UDisksJobScheduler *scheduler = user_data;
+  const gchar *drive_key;
+  GList *admitted;
+  guint n;
+
+  g_signal_handlers_disconnect_by_func (job, G_CALLBACK (on_job_completed), scheduler);
+
+  g_mutex_lock (&scheduler->lock);
+  drive_key = g_hash_table_lookup (scheduler->running_jobs, job);
+  if (drive_key != NULL)
+    {
+      n = GPOINTER_TO_UINT (g_hash_table_lookup (scheduler->drive_n_running, drive_key));
+      if (n > 1)
+        g_hash_table_insert (scheduler->drive_n_running, g_strdup (drive_key), GUINT_TO_POINTER (n - 1));
+      else
+        g_hash_table_remove (scheduler->drive_n_running, drive_key);
+      g_hash_table_remove (scheduler->running_jobs, job);
+    }
+  admitted = admit_queued_locked (scheduler);
+  g_mutex_unlock (&scheduler->lock);
+
+  dispatch (scheduler, admitted);
+}
+
+/* May be called from any thread */
+static void
+on_queued_job_cancelled (GCancellable *cancellable,
+                         gpointer      user_data)
+{
+  QueuedJob *entry = user_data;
+  UDisksJobScheduler *scheduler = entry->scheduler;
+  GList *admitted = NULL;
+
+  g_mutex_lock (&scheduler->lock);
+  entry->cancelled = TRUE;
+  if (entry->state == QUEUED_JOB_QUEUED)
+    {
+      /* start it right away so it completes with the cancellation error */
+      admit_locked (scheduler, entry);
+      admitted = g_list_prepend (NULL, entry);
+    }
+  g_mutex_unlock (&scheduler->lock);
+
+  dispatch (scheduler, admitted);
+}
+
+static QueuedJob *
+queued_job_new (UDisksJobScheduler          *scheduler,
+                UDisksBaseJob               *job,
+                UDisksJobSchedulerStartFunc  start_func)
+{
+  QueuedJob *entry;
+
+  entry = g_slice_new0 (QueuedJob);
+  entry->scheduler = scheduler;
+  entry->job = g_object_ref (job);
+  entry->priority = udisks_job_scheduler_get_priority_for_operation (udisks_job_get_operation (UDISKS_JOB (job)));
+  entry->drive_key = get_drive_key (scheduler, job);
+  entry->start_func = start_func;
+  entry->context = g_main_context_ref_thread_default ();
+  entry->state = QUEUED_JOB_PENDING;
+
+  /* connected before the entry is visible to anyone else, the handler is
+   * invoked right away if the job is already cancelled */
+  entry->cancelled_handler_id = g_cancellable_connect (udisks_base_job_get_cancellable (job),
+                                                       G_CALLBACK (on_queued_job_cancelled),
+                                                       entry,
+                                                       NULL);
+  return entry;
+}
+
+/* Admits @entry right away or queues it, returns whether it was admitted */
+static gboolean
+admit_or_queue_locked (UDisksJobScheduler *scheduler,
+                       QueuedJob          *entry)
+{
+  GList *l;
+
+  if (can_run_locked (scheduler, entry))
+    {
+      admit_locked (scheduler, entry);
+      return TRUE;
+    }
+
+  for (l = scheduler->queue; l != NULL; l = l->next)
+    {
+      QueuedJob *other = l->data;
+      if (other->priority > entry->priority)
+        break;
+    }
+  scheduler->queue = g_list_insert_before (scheduler->queue, l, entry);
+  entry->state = QUEUED_JOB_QUEUED;
+  udisks_job_set_queued (UDISKS_JOB (entry->job), TRUE);
+
+  udisks_debug ("Queued job %s (%s) with %u jobs running",
+                udisks_job_get_operation (UDISKS_JOB (entry->job)),
+                entry->drive_key,
+                g_hash_table_size (scheduler->running_jobs));
+
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_job_scheduler_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new job scheduler with the limits configured for @daemon.
+ *
+ * Returns: A #UDisksJobScheduler. Free with udisks_job_scheduler_free().
+ */
+UDisksJobScheduler *
+udisks_job_scheduler_new (UDisksDaemon *daemon)
+{
+  UDisksJobScheduler *scheduler;
+  UDisksConfigManager *config_manager;
+
+  scheduler = g_new0 (UDisksJobScheduler, 1);
+  /* we don't take a reference to the daemon */
+  scheduler->daemon = daemon;
+
+  config_manager = udisks_daemon_get_config_manager (daemon);
+  scheduler->max_parallel = udisks_config_manager_get_jobs_max_parallel (config_manager);
+  scheduler->max_parallel_per_drive = udisks_config_manager_get_jobs_max_parallel_per_drive (config_manager);
+
+  g_mutex_init (&scheduler->lock);
+  g_cond_init (&scheduler->cond);
+  scheduler->running_jobs = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, g_free);
+  scheduler->drive_n_running = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  return scheduler;
+}
+
+/**
+ * udisks_job_scheduler_free:
+ * @scheduler: A #UDisksJobScheduler.
+ *
+ * Frees @scheduler. No jobs may be queued anymore.
+ */
+void
+udisks_job_scheduler_free (UDisksJobScheduler *scheduler)
+{
+  GHashTableIter iter;
+  gpointer job;
+
+  g_warn_if_fail (scheduler->queue == NULL);
+
+  g_hash_table_iter_init (&iter, scheduler->running_jobs);
+  while (g_hash_table_iter_next (&iter, &job, NULL))
+    g_signal_handlers_disconnect_by_func (job, G_CALLBACK (on_job_completed), scheduler);
+
+  g_hash_table_unref (scheduler->running_jobs);
+  g_hash_table_unref (scheduler->drive_n_running);
+  g_cond_clear (&scheduler->cond);
+  g_mutex_clear (&scheduler->lock);
+  g_free (scheduler);
+}
+
+/**
+ * udisks_job_scheduler_submit:
+ * @scheduler: A #UDisksJobScheduler.
+ * @job: The #UDisksBaseJob to start.
+ * @start_func: The function actually starting @job.
+ *
+ * Calls @start_func for @job right away if the limits allow that,
+ * otherwise queues @job and calls @start_func once it's @job's turn, from
+ * the <link linkend="g-main-context-push-thread-default">thread-default
+ * main context</link> of the caller.
+ */
+void
+udisks_job_scheduler_submit (UDisksJobScheduler          *scheduler,
+                             UDisksBaseJob               *job,
+                             UDisksJobSchedulerStartFunc  start_func)
+{
+  QueuedJob *entry;
+  gboolean admitted;
+
+  g_return_if_fail (UDISKS_IS_BASE_JOB (job));
+  g_return_if_fail (start_func != NULL);
+
+  entry = queued_job_new (scheduler, job, start_func);
+
+  g_mutex_lock (&scheduler->lock);
+  admitted = admit_or_queue_locked (scheduler, entry);
+  g_mutex_unlock (&scheduler->lock);
+
+  if (admitted)
+    {
+      g_cancellable_disconnect (udisks_base_job_get_cancellable (job), entry->cancelled_handler_id);
+      track_running (scheduler, job);
+      start_func (job);
+      queued_job_free (entry);
+    }
+}
+
+/**
+ * udisks_job_scheduler_acquire_sync:
+ * @scheduler: A #UDisksJobScheduler.
+ * @job: The #UDisksBaseJob about to be run synchronously.
+ *
+ * Blocks the calling thread until the limits allow @job to run. The
+ * job is considered running until its #UDisksJob::completed signal is
+ * emitted.
+ *
+ * When called from the thread owning the global default main context,
+ * this never blocks (as that would prevent other jobs from completing).
+ */
+void
+udisks_job_scheduler_acquire_sync (UDisksJobScheduler *scheduler,
+                                   UDisksBaseJob      *job)
+{
+  QueuedJob *entry;
+
+  g_return_if_fail (UDISKS_IS_BASE_JOB (job));
+
+  entry = queued_job_new (scheduler, job, NULL);
+
+  g_mutex_lock (&scheduler->lock);
+  if (g_main_context_is_owner (g_main_context_default ()))
+    entry->priority = UDISKS_JOB_PRIORITY_INTERACTIVE;
+  if (!admit_or_queue_locked (scheduler, entry))
+    {
+      while (entry->state != QUEUED_JOB_ADMITTED)
+        g_cond_wait (&scheduler->cond, &scheduler->lock);
+    }
+  g_mutex_unlock (&scheduler->lock);
+
+  g_cancellable_disconnect (udisks_base_job_get_cancellable (job), entry->cancelled_handler_id);
+  track_running (scheduler, job);
+  queued_job_free (entry);
+}
@@ -0,0 +1,67 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_JOB_SCHEDULER_H__
+#define __UDISKS_JOB_SCHEDULER_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+/**
+ * UDisksJobPriority:
+ * @UDISKS_JOB_PRIORITY_INTERACTIVE: Short operations a user is waiting for (e.g. mounting or unmounting), never queued.
+ * @UDISKS_JOB_PRIORITY_NORMAL: Most operations (e.g. creating a filesystem or a partition).
+ * @UDISKS_JOB_PRIORITY_BULK: Long running operations (e.g. erasing or checking a device), started after all the others.
+ *
+ * Priority classes of jobs, see udisks_job_scheduler_submit().
+ */
+typedef enum
+{
+  UDISKS_JOB_PRIORITY_INTERACTIVE,
+  UDISKS_JOB_PRIORITY_NORMAL,
+  UDISKS_JOB_PRIORITY_BULK,
+} UDisksJobPriority;
+
+/**
+ * UDisksJobSchedulerStartFunc:
+ * @job: The #UDisksBaseJob to start.
+ *
+ * Type of the function actually starting a job submitted with
+ * udisks_job_scheduler_submit().
+ */
+typedef void (*UDisksJobSchedulerStartFunc) (UDisksBaseJob *job);
+
+UDisksJobScheduler *udisks_job_scheduler_new          (UDisksDaemon                *daemon);
+void                udisks_job_scheduler_free         (UDisksJobScheduler          *scheduler);
+void                udisks_job_scheduler_submit       (UDisksJobScheduler          *scheduler,
+                                                       UDisksBaseJob               *job,
+                                                       UDisksJobSchedulerStartFunc  start_func);
+void                udisks_job_scheduler_acquire_sync (UDisksJobScheduler          *scheduler,
+                                                       UDisksBaseJob               *job);
+void                udisks_job_scheduler_set_limits   (UDisksJobScheduler          *scheduler,
+                                                       guint                        max_parallel,
+                                                       guint                        max_parallel_per_drive);
+gboolean            udisks_job_scheduler_is_idle      (UDisksJobScheduler          *scheduler);
+UDisksJobPriority   udisks_job_scheduler_get_priority_for_operation (const gchar *operation);
+
+G_END_DECLS
+
+#endif /* __UDISKS_JOB_SCHEDULER_H__ */
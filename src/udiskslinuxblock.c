@@ -26,7 +26,9 @@
 #include <sys/types.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <pwd.h>
 #include <grp.h>
 #include <string.h>
@@ -43,12 +45,14 @@
 #include "udiskslogging.h"
 #include "udiskslinuxblock.h"
 #include "udiskslinuxblockobject.h"
+#include "udiskslinuxblockbenchmark.h"
 #include "udiskslinuxdriveobject.h"
 #include "udiskslinuxfsinfo.h"
 #include "udisksdaemon.h"
 #include "udisksstate.h"
 #include "udisksconfigmanager.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udiskslinuxprovider.h"
 #include "udisksfstabmonitor.h"
 #include "udisksfstabentry.h"
@@ -94,6 +98,16 @@ struct _UDisksLinuxBlock
 
   /* only allow single cryptsetup call at once */
   GMutex encrypted_lock;
+
+  /* the /etc/fstab and /etc/crypttab entries the Configuration property
+   * was last built from, only used in the "uevent" thread
+   */
+  GList *configuration_entries;
+
+  /* the current snapshot of the properties, replaced (never modified)
+   * whenever they change; the lock only protects the pointer */
+  GMutex snapshot_lock;
+  UDisksLinuxBlockSnapshot *snapshot;
 };
 
 struct _UDisksLinuxBlockClass
@@ -108,12 +122,14 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxBlock, udisks_linux_block, UDISKS_TYPE_BLOCK
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void publish_snapshot (UDisksLinuxBlock *block);
+
 static void
 udisks_linux_block_init (UDisksLinuxBlock *block)
 {
   g_mutex_init (&(block->encrypted_lock));
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (block),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&block->snapshot_lock);
+  publish_snapshot (block);
 }
 
 static void
@@ -122,11 +138,26 @@ udisks_linux_block_finalize (GObject *object)
   UDisksLinuxBlock *block = UDISKS_LINUX_BLOCK (object);
 
   g_mutex_clear (&(block->encrypted_lock));
+  g_list_free_full (block->configuration_entries, g_object_unref);
+  udisks_linux_block_snapshot_unref (block->snapshot);
+  g_mutex_clear (&block->snapshot_lock);
 
   if (G_OBJECT_CLASS (udisks_linux_block_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (udisks_linux_block_parent_class)->finalize (object);
 }
 
+static void
+udisks_linux_block_dispatch_properties_changed (GObject     *object,
+                                                guint        n_pspecs,
+                                                GParamSpec **pspecs)
+{
+  /* runs in the thread that changed the properties, once per
+   * g_object_freeze_notify()/g_object_thaw_notify() section */
+  publish_snapshot (UDISKS_LINUX_BLOCK (object));
+
+  G_OBJECT_CLASS (udisks_linux_block_parent_class)->dispatch_properties_changed (object, n_pspecs, pspecs);
+}
+
 static void
 udisks_linux_block_class_init (UDisksLinuxBlockClass *klass)
 {
@@ -134,6 +165,9 @@ udisks_linux_block_class_init (UDisksLinuxBlockClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize = udisks_linux_block_finalize;
+  gobject_class->dispatch_properties_changed = udisks_linux_block_dispatch_properties_changed;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -152,83 +186,155 @@ udisks_linux_block_new (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/**
+ * UDisksLinuxBlockSnapshot:
+ * @device: The #UDisksBlock:device property.
+ * @preferred_device: The #UDisksBlock:preferred-device property.
+ * @symlinks: The #UDisksBlock:symlinks property.
+ * @device_number: The #UDisksBlock:device-number property.
+ * @size: The #UDisksBlock:size property.
+ * @read_only: The #UDisksBlock:read-only property.
+ * @drive: The #UDisksBlock:drive property.
+ * @crypto_backing_device: The #UDisksBlock:crypto-backing-device property.
+ * @id_usage: The #UDisksBlock:id-usage property.
+ * @id_type: The #UDisksBlock:id-type property.
+ * @id_version: The #UDisksBlock:id-version property.
+ * @id_label: The #UDisksBlock:id-label property.
+ * @id_uuid: The #UDisksBlock:id-uuid property.
+ * @hint_system: The #UDisksBlock:hint-system property.
+ * @hint_ignore: The #UDisksBlock:hint-ignore property.
+ * @hint_auto: The #UDisksBlock:hint-auto property.
+ * @hint_name: The #UDisksBlock:hint-name property.
+ *
+ * An immutable copy of the most commonly used properties of a
+ * #UDisksLinuxBlock, see udisks_linux_block_get_snapshot(). The strings
+ * are never %NULL.
+ */
+
 static gchar *
-get_sysfs_attr (GUdevDevice *device,
-                const gchar *attr)
+dup_nonnull (const gchar *s)
 {
-  gchar *filename = NULL;
-  gchar *value = NULL;
-  gboolean ret = FALSE;
-  GError *error = NULL;
-
-  filename = g_strconcat (g_udev_device_get_sysfs_path (device),
-                          "/",
-                          attr,
-                          NULL);
-
+  return g_strdup (s != NULL ? s : "");
+}
 
-  ret = g_file_get_contents (filename,
-                             &value,
-                             NULL,
-                             &error);
-  if (!ret)
-    {
-      udisks_debug ("Failed to read sysfs attribute %s: %s", attr, error->message);
-      g_clear_error (&error);
-    }
+static void
+publish_snapshot (UDisksLinuxBlock *block)
+{
+  UDisksBlock *iface = UDISKS_BLOCK (block);
+  UDisksLinuxBlockSnapshot *snapshot;
+  UDisksLinuxBlockSnapshot *old_snapshot;
+  const gchar *const *symlinks;
 
-  g_free (filename);
-  return value;
+  snapshot = g_slice_new0 (UDisksLinuxBlockSnapshot);
+  snapshot->ref_count = 1;
+  snapshot->device = dup_nonnull (udisks_block_get_device (iface));
+  snapshot->preferred_device = dup_nonnull (udisks_block_get_preferred_device (iface));
+  symlinks = udisks_block_get_symlinks (iface);
+  snapshot->symlinks = symlinks != NULL ? g_strdupv ((gchar **) symlinks) : g_new0 (gchar *, 1);
+  snapshot->device_number = udisks_block_get_device_number (iface);
+  snapshot->size = udisks_block_get_size (iface);
+  snapshot->read_only = udisks_block_get_read_only (iface);
+  snapshot->drive = dup_nonnull (udisks_block_get_drive (iface));
+  snapshot->crypto_backing_device = dup_nonnull (udisks_block_get_crypto_backing_device (iface));
+  snapshot->id_usage = dup_nonnull (udisks_block_get_id_usage (iface));
+  snapshot->id_type = dup_nonnull (udisks_block_get_id_type (iface));
+  snapshot->id_version = dup_nonnull (udisks_block_get_id_version (iface));
+  snapshot->id_label = dup_nonnull (udisks_block_get_id_label (iface));
+  snapshot->id_uuid = dup_nonnull (udisks_block_get_id_uuid (iface));
+  snapshot->hint_system = udisks_block_get_hint_system (iface);
+  snapshot->hint_ignore = udisks_block_get_hint_ignore (iface);
+  snapshot->hint_auto = udisks_block_get_hint_auto (iface);
+  snapshot->hint_name = dup_nonnull (udisks_block_get_hint_name (iface));
+
+  g_mutex_lock (&block->snapshot_lock);
+  old_snapshot = block->snapshot;
+  block->snapshot = snapshot;
+  g_mutex_unlock (&block->snapshot_lock);
+
+  if (old_snapshot != NULL)
+    udisks_linux_block_snapshot_unref (old_snapshot);
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
-
-static UDisksLinuxBlockObject *
-find_block_device_by_sysfs_path (GDBusObjectManagerServer *object_manager,
-                                 const gchar              *sysfs_path)
+/**
+ * udisks_linux_block_get_snapshot:
+ * @block: A #UDisksLinuxBlock.
+ *
+ * Gets a consistent, immutable copy of the properties of @block as of
+ * their last change. Unlike the udisks_block_get_*() getters this is
+ * safe to use from any thread and the values don't change while the
+ * snapshot is used, even if a uevent updates @block meanwhile. Getting
+ * the snapshot never waits for an update in progress, the snapshot is
+ * built beforehand and only the pointer to it is swapped.
+ *
+ * Returns: (transfer full): A #UDisksLinuxBlockSnapshot. Free with udisks_linux_block_snapshot_unref().
+ */
+UDisksLinuxBlockSnapshot *
+udisks_linux_block_get_snapshot (UDisksLinuxBlock *block)
 {
-  UDisksLinuxBlockObject *ret;
-  GList *objects;
-  GList *l;
+  UDisksLinuxBlockSnapshot *snapshot;
 
-  ret = NULL;
+  g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK (block), NULL);
 
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (object_manager));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      GDBusObjectSkeleton *object = G_DBUS_OBJECT_SKELETON (l->data);
-      UDisksLinuxDevice *device;
+  g_mutex_lock (&block->snapshot_lock);
+  snapshot = udisks_linux_block_snapshot_ref (block->snapshot);
+  g_mutex_unlock (&block->snapshot_lock);
 
-      if (!UDISKS_IS_LINUX_BLOCK_OBJECT (object))
-        continue;
+  return snapshot;
+}
 
-      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
-      if (g_strcmp0 (sysfs_path, g_udev_device_get_sysfs_path (device->udev_device)) == 0)
-        {
-          ret = g_object_ref (UDISKS_LINUX_BLOCK_OBJECT (object));
-          g_object_unref (device);
-          goto out;
-        }
-      g_object_unref (device);
-    }
+/**
+ * udisks_linux_block_snapshot_ref:
+ * @snapshot: A #UDisksLinuxBlockSnapshot.
+ *
+ * Increases the reference count of @snapshot.
+ *
+ * Returns: @snapshot.
+ */
+UDisksLinuxBlockSnapshot *
+udisks_linux_block_snapshot_ref (UDisksLinuxBlockSnapshot *snapshot)
+{
+  g_atomic_int_inc (&snapshot->ref_count);
+  return snapshot;
+}
 
- out:
-  g_list_free_full (objects, g_object_unref);
-  return ret;
+/**
+ * udisks_linux_block_snapshot_unref:
+ * @snapshot: A #UDisksLinuxBlockSnapshot.
+ *
+ * Decreases the reference count of @snapshot, freeing it when it
+ * drops to zero.
+ */
+void
+udisks_linux_block_snapshot_unref (UDisksLinuxBlockSnapshot *snapshot)
+{
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  g_free (snapshot->device);
+  g_free (snapshot->preferred_device);
+  g_strfreev (snapshot->symlinks);
+  g_free (snapshot->drive);
+  g_free (snapshot->crypto_backing_device);
+  g_free (snapshot->id_usage);
+  g_free (snapshot->id_type);
+  g_free (snapshot->id_version);
+  g_free (snapshot->id_label);
+  g_free (snapshot->id_uuid);
+  g_free (snapshot->hint_name);
+  g_slice_free (UDisksLinuxBlockSnapshot, snapshot);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gchar *
-find_drive (GDBusObjectManagerServer  *object_manager,
-            GUdevDevice               *block_device,
-            UDisksDrive              **out_drive)
+find_drive (UDisksDaemon  *daemon,
+            GUdevDevice   *block_device,
+            UDisksDrive  **out_drive)
 {
   GUdevDevice *whole_disk_block_device;
   const gchar *whole_disk_block_device_sysfs_path;
+  UDisksLinuxDriveObject *object;
   gchar *ret;
-  GList *objects;
-  GList *l;
 
   ret = NULL;
 
@@ -236,40 +342,22 @@ find_drive (GDBusObjectManagerServer  *object_manager,
     whole_disk_block_device = g_object_ref (block_device);
   else
     whole_disk_block_device = g_udev_device_get_parent_with_subsystem (block_device, "block", "disk");
+  if (whole_disk_block_device == NULL)
+    goto out;
   whole_disk_block_device_sysfs_path = g_udev_device_get_sysfs_path (whole_disk_block_device);
 
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (object_manager));
-  for (l = objects; l != NULL; l = l->next)
+  object = udisks_linux_provider_find_drive_by_sysfs_path (udisks_daemon_get_linux_provider (daemon),
+                                                           whole_disk_block_device_sysfs_path);
+  if (object != NULL)
     {
-      GDBusObjectSkeleton *object = G_DBUS_OBJECT_SKELETON (l->data);
-      GList *drive_devices;
-      GList *j;
-
-      if (!UDISKS_IS_LINUX_DRIVE_OBJECT (object))
-        continue;
-
-      drive_devices = udisks_linux_drive_object_get_devices (UDISKS_LINUX_DRIVE_OBJECT (object));
-      for (j = drive_devices; j != NULL; j = j->next)
-        {
-          UDisksLinuxDevice *drive_device = UDISKS_LINUX_DEVICE (j->data);
-          const gchar *drive_sysfs_path;
-
-          drive_sysfs_path = g_udev_device_get_sysfs_path (drive_device->udev_device);
-          if (g_strcmp0 (whole_disk_block_device_sysfs_path, drive_sysfs_path) == 0)
-            {
-              if (out_drive != NULL)
-                *out_drive = udisks_object_get_drive (UDISKS_OBJECT (object));
-              ret = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-              g_list_free_full (drive_devices, g_object_unref);
-              goto out;
-            }
-        }
-      g_list_free_full (drive_devices, g_object_unref);
+      if (out_drive != NULL)
+        *out_drive = udisks_object_get_drive (UDISKS_OBJECT (object));
+      ret = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+      g_object_unref (object);
     }
 
- out:
-  g_list_free_full (objects, g_object_unref);
   g_object_unref (whole_disk_block_device);
+ out:
   return ret;
 }
 
@@ -486,159 +574,108 @@ process_device_symlinks (const gchar      *device,
     }
 }
 
-static GList *
-find_fstab_entries_for_device (UDisksLinuxBlock *block,
-                               UDisksDaemon     *daemon)
-{
-  GList *entries;
-  GList *l;
-  GList *ret;
-
-  ret = NULL;
+/* Functions looking up the fstab or crypttab entries with the given
+ * fsname or device field (e.g. "UUID=..." or a device file) */
+typedef GList *(*LookupEntriesFunc) (gpointer     monitor,
+                                     const gchar *spec);
 
-  /* if this is too slow, we could add lookup methods to UDisksFstabMonitor... */
-  entries = udisks_fstab_monitor_get_entries (udisks_daemon_get_fstab_monitor (daemon));
-  for (l = entries; l != NULL; l = l->next)
-    {
-      UDisksFstabEntry *entry = UDISKS_FSTAB_ENTRY (l->data);
-      const gchar *fsname;
-      const gchar *device = NULL;
-      const gchar *label = NULL;
-      const gchar *uuid = NULL;
-      const gchar *partuuid = NULL;
-      const gchar *partlabel = NULL;
+static void
+lookup_entries_for_spec (LookupEntriesFunc   func,
+                         gpointer            monitor,
+                         const gchar        *prefix,
+                         const gchar        *value,
+                         GList             **ret)
+{
+  gchar *spec;
 
-      fsname = udisks_fstab_entry_get_fsname (entry);
-      device = NULL;
-      if (g_str_has_prefix (fsname, "UUID="))
-        {
-          uuid = fsname + 5;
-        }
-      else if (g_str_has_prefix (fsname, "LABEL="))
-        {
-          label = fsname + 6;
-        }
-      else if (g_str_has_prefix (fsname, "PARTUUID="))
-        {
-          partuuid = fsname + 9;
-        }
-      else if (g_str_has_prefix (fsname, "PARTLABEL="))
-        {
-          partlabel = fsname + 10;
-        }
-      else if (g_str_has_prefix (fsname, "/dev"))
-        {
-          device = fsname;
-        }
-      else
-        {
-          /* ignore non-device entries */
-          goto continue_loop;
-        }
+  /* an empty value (e.g. LABEL=) doesn't identify any device */
+  if (value == NULL || *value == '\0')
+    return;
 
-      if (device != NULL)
-        {
-          process_device_symlinks (device, block, entry, &ret);
-        }
-      else if (label != NULL && g_strcmp0 (label, udisks_block_get_id_label (UDISKS_BLOCK (block))) == 0)
-        {
-          ret = g_list_prepend (ret, g_object_ref (entry));
-        }
-      else if (uuid != NULL && g_strcmp0 (uuid, udisks_block_get_id_uuid (UDISKS_BLOCK (block))) == 0)
-        {
-          ret = g_list_prepend (ret, g_object_ref (entry));
-        }
-      else if (partlabel != NULL || partuuid != NULL)
-        {
-          UDisksLinuxBlockObject *object;
-          UDisksLinuxDevice *linux_device;
+  spec = g_strconcat (prefix != NULL ? prefix : "", value, NULL);
+  *ret = g_list_concat (func (monitor, spec), *ret);
+  g_free (spec);
+}
 
-          object = udisks_daemon_util_dup_object (block, NULL);
-          if (object == NULL)
-            goto continue_loop;
-          linux_device = udisks_linux_block_object_get_device (object);
-          g_clear_object (&object);
-          if (linux_device == NULL)
-            goto continue_loop;
-          if (linux_device->udev_device == NULL)
-            {
-              g_object_unref (linux_device);
-              goto continue_loop;
-            }
-          if ((partuuid != NULL && g_strcmp0 (partuuid, g_udev_device_get_property (linux_device->udev_device, "ID_PART_ENTRY_UUID")) == 0) ||
-              (partlabel != NULL && g_strcmp0 (partlabel, g_udev_device_get_property (linux_device->udev_device, "ID_PART_ENTRY_NAME")) == 0))
-            ret = g_list_prepend (ret, g_object_ref (entry));
-          g_object_unref (linux_device);
-        }
+/* looks up the entries referring to @block by its device file, symlinks, label or UUID */
+static GList *
+lookup_entries_for_block (LookupEntriesFunc  func,
+                          gpointer           monitor,
+                          UDisksLinuxBlock  *block)
+{
+  const gchar *const *symlinks;
+  GList *ret = NULL;
+  guint n;
 
-    continue_loop:
-      ;
-    }
+  lookup_entries_for_spec (func, monitor, NULL, udisks_block_get_device (UDISKS_BLOCK (block)), &ret);
+  symlinks = udisks_block_get_symlinks (UDISKS_BLOCK (block));
+  if (symlinks != NULL)
+    for (n = 0; symlinks[n] != NULL; n++)
+      lookup_entries_for_spec (func, monitor, NULL, symlinks[n], &ret);
+  lookup_entries_for_spec (func, monitor, "LABEL=", udisks_block_get_id_label (UDISKS_BLOCK (block)), &ret);
+  lookup_entries_for_spec (func, monitor, "UUID=", udisks_block_get_id_uuid (UDISKS_BLOCK (block)), &ret);
 
-  g_list_free_full (entries, g_object_unref);
   return ret;
 }
 
-static GList *
-find_crypttab_entries_for_device (UDisksLinuxBlock *block,
-                                  UDisksDaemon     *daemon)
+/**
+ * udisks_linux_block_find_fstab_entries:
+ * @block: A #UDisksLinuxBlock.
+ * @daemon: A #UDisksDaemon.
+ *
+ * Looks up the /etc/fstab entries referring to @block by its device
+ * file, one of its symlinks, its label or UUID or its partition UUID
+ * or name, using the index kept by the #UDisksFstabMonitor of @daemon.
+ *
+ * This function may be called from any thread.
+ *
+ * Returns: (transfer full) (element-type UDisksFstabEntry): A list of #UDisksFstabEntry objects that must be freed with g_list_free() after each element has been freed with g_object_unref().
+ */
+GList *
+udisks_linux_block_find_fstab_entries (UDisksLinuxBlock *block,
+                                       UDisksDaemon     *daemon)
 {
-  GList *entries;
-  GList *l;
+  UDisksFstabMonitor *monitor;
+  UDisksLinuxBlockObject *object;
+  UDisksLinuxDevice *linux_device;
   GList *ret;
 
-  ret = NULL;
+  monitor = udisks_daemon_get_fstab_monitor (daemon);
+  ret = lookup_entries_for_block ((LookupEntriesFunc) udisks_fstab_monitor_get_entries_for_fsname,
+                                  monitor, block);
 
-  /* if this is too slow, we could add lookup methods to UDisksCrypttabMonitor... */
-  entries = udisks_crypttab_monitor_get_entries (udisks_daemon_get_crypttab_monitor (daemon));
-  for (l = entries; l != NULL; l = l->next)
+  /* partition UUID and name are only available from udev */
+  object = udisks_daemon_util_dup_object (block, NULL);
+  if (object == NULL)
+    goto out;
+  linux_device = udisks_linux_block_object_get_device (object);
+  g_object_unref (object);
+  if (linux_device == NULL)
+    goto out;
+  if (linux_device->udev_device != NULL)
     {
-      UDisksCrypttabEntry *entry = UDISKS_CRYPTTAB_ENTRY (l->data);
-      const gchar *device_in_entry;
-      const gchar *device = NULL;
-      const gchar *label = NULL;
-      const gchar *uuid = NULL;
-
-      device_in_entry = udisks_crypttab_entry_get_device (entry);
-      if (g_str_has_prefix (device_in_entry, "UUID="))
-        {
-          uuid = device_in_entry + 5;
-        }
-      else if (g_str_has_prefix (device_in_entry, "LABEL="))
-        {
-          label = device_in_entry + 6;
-        }
-      else if (g_str_has_prefix (device_in_entry, "/dev"))
-        {
-          device = device_in_entry;
-        }
-      else
-        {
-          /* ignore non-device entries */
-          goto continue_loop;
-        }
-
-      if (device != NULL)
-        {
-          process_device_symlinks (device, block, entry, &ret);
-        }
-      else if (label != NULL && g_strcmp0 (label, udisks_block_get_id_label (UDISKS_BLOCK (block))) == 0)
-        {
-          ret = g_list_prepend (ret, g_object_ref (entry));
-        }
-      else if (uuid != NULL && g_strcmp0 (uuid, udisks_block_get_id_uuid (UDISKS_BLOCK (block))) == 0)
-        {
-          ret = g_list_prepend (ret, g_object_ref (entry));
-        }
-
-    continue_loop:
-      ;
+      lookup_entries_for_spec ((LookupEntriesFunc) udisks_fstab_monitor_get_entries_for_fsname, monitor,
+                               "PARTUUID=", g_udev_device_get_property (linux_device->udev_device, "ID_PART_ENTRY_UUID"),
+                               &ret);
+      lookup_entries_for_spec ((LookupEntriesFunc) udisks_fstab_monitor_get_entries_for_fsname, monitor,
+                               "PARTLABEL=", g_udev_device_get_property (linux_device->udev_device, "ID_PART_ENTRY_NAME"),
+                               &ret);
     }
+  g_object_unref (linux_device);
 
-  g_list_free_full (entries, g_object_unref);
+ out:
   return ret;
 }
 
+static GList *
+find_crypttab_entries_for_device (UDisksLinuxBlock *block,
+                                  UDisksDaemon     *daemon)
+{
+  return lookup_entries_for_block ((LookupEntriesFunc) udisks_crypttab_monitor_get_entries_for_device,
+                                   udisks_daemon_get_crypttab_monitor (daemon),
+                                   block);
+}
+
 #ifdef HAVE_LIBMOUNT
 static GList *
 find_utab_entries_for_device (UDisksLinuxBlock *block,
@@ -667,9 +704,70 @@ find_utab_entries_for_device (UDisksLinuxBlock *block,
 }
 #endif
 
-static void
-add_fstab_entry (GVariantBuilder  *builder,
-                 UDisksFstabEntry *entry)
+/* The (sa{sv}) items of entries without secrets are attached to the
+ * entries, so blocks matching the same entries share them and they are
+ * built only once per entry. The entries are immutable and replaced
+ * when /etc/fstab or /etc/crypttab changes. The lock protects adding the
+ * items, configurations are also built in method handler threads.
+ */
+G_LOCK_DEFINE_STATIC (configuration_item_lock);
+
+static GQuark
+configuration_item_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("udisks-configuration-item");
+
+  return quark;
+}
+
+/* returns a full reference to the item attached to @entry, if any */
+static GVariant *
+dup_configuration_item (gpointer entry)
+{
+  GVariant *ret;
+
+  G_LOCK (configuration_item_lock);
+  ret = g_object_get_qdata (G_OBJECT (entry), configuration_item_quark ());
+  if (ret != NULL)
+    g_variant_ref (ret);
+  G_UNLOCK (configuration_item_lock);
+
+  return ret;
+}
+
+/* attaches @item to @entry unless another thread got there first,
+ * returns a full reference to the item attached
+ */
+static GVariant *
+attach_configuration_item (gpointer  entry,
+                           GVariant *item)
+{
+  GVariant *ret;
+
+  G_LOCK (configuration_item_lock);
+  ret = g_object_get_qdata (G_OBJECT (entry), configuration_item_quark ());
+  if (ret == NULL)
+    {
+      ret = g_variant_ref_sink (item);
+      g_object_set_qdata_full (G_OBJECT (entry), configuration_item_quark (),
+                               g_variant_ref (ret), (GDestroyNotify) g_variant_unref);
+    }
+  else
+    {
+      g_variant_ref (ret);
+      g_variant_unref (g_variant_ref_sink (item));
+    }
+  G_UNLOCK (configuration_item_lock);
+
+  return ret;
+}
+
+/* returns a floating GVariant */
+static GVariant *
+build_fstab_item (UDisksFstabEntry *entry)
 {
   GVariantBuilder dict_builder;
   g_variant_builder_init (&dict_builder, G_VARIANT_TYPE_VARDICT);
@@ -685,43 +783,42 @@ add_fstab_entry (GVariantBuilder  *builder,
                          g_variant_new_int32 (udisks_fstab_entry_get_freq (entry)));
   g_variant_builder_add (&dict_builder, "{sv}", "passno",
                          g_variant_new_int32 (udisks_fstab_entry_get_passno (entry)));
-  g_variant_builder_add (builder,
-                         "(sa{sv})",
-                         "fstab", &dict_builder);
+  return g_variant_new ("(sa{sv})", "fstab", &dict_builder);
 }
 
-static gboolean
-add_crypttab_entry (GVariantBuilder       *builder,
-                    UDisksCrypttabEntry   *entry,
-                    gboolean               include_secrets,
-                    GError               **error)
+static void
+add_fstab_entry (GVariantBuilder  *builder,
+                 UDisksFstabEntry *entry)
+{
+  GVariant *item;
+
+  item = dup_configuration_item (entry);
+  if (item == NULL)
+    item = attach_configuration_item (entry, build_fstab_item (entry));
+  g_variant_builder_add_value (builder, item);
+  g_variant_unref (item);
+}
+
+/* returns the passphrase path of @entry as exported, "" if there is none */
+static const gchar *
+get_crypttab_passphrase_path (UDisksCrypttabEntry *entry)
 {
-  GVariantBuilder dict_builder;
   const gchar *passphrase_path;
-  const gchar *options;
-  gchar *passphrase_contents;
-  gsize passphrase_contents_length;
 
   passphrase_path = udisks_crypttab_entry_get_passphrase_path (entry);
   if (passphrase_path == NULL || g_strcmp0 (passphrase_path, "none") == 0)
     passphrase_path = "";
-  passphrase_contents = NULL;
-  if (!(g_strcmp0 (passphrase_path, "") == 0 || g_str_has_prefix (passphrase_path, "/dev")))
-    {
-      if (include_secrets)
-        {
-          if (!g_file_get_contents (passphrase_path,
-                                    &passphrase_contents,
-                                    &passphrase_contents_length,
-                                    error))
-            {
-              g_prefix_error (error,
-                              "Error loading secrets from file `%s' referenced in /etc/crypttab entry: ",
-                              passphrase_path);
-              return FALSE;
-            }
-        }
-    }
+
+  return passphrase_path;
+}
+
+/* returns a floating GVariant, @passphrase_contents is only given for secret configurations */
+static GVariant *
+build_crypttab_item (UDisksCrypttabEntry *entry,
+                     const gchar         *passphrase_contents)
+{
+  GVariantBuilder dict_builder;
+  const gchar *options;
 
   options = udisks_crypttab_entry_get_options (entry);
   if (options == NULL)
@@ -733,7 +830,7 @@ add_crypttab_entry (GVariantBuilder       *builder,
   g_variant_builder_add (&dict_builder, "{sv}", "device",
                          g_variant_new_bytestring (udisks_crypttab_entry_get_device (entry)));
   g_variant_builder_add (&dict_builder, "{sv}", "passphrase-path",
-                         g_variant_new_bytestring (passphrase_path));
+                         g_variant_new_bytestring (get_crypttab_passphrase_path (entry)));
   if (passphrase_contents != NULL)
     {
       g_variant_builder_add (&dict_builder, "{sv}", "passphrase-contents",
@@ -741,18 +838,115 @@ add_crypttab_entry (GVariantBuilder       *builder,
     }
   g_variant_builder_add (&dict_builder, "{sv}", "options",
                          g_variant_new_bytestring (options));
-  g_variant_builder_add (builder,
-                         "(sa{sv})",
-                         "crypttab", &dict_builder);
-  if (passphrase_contents != NULL)
+  return g_variant_new ("(sa{sv})", "crypttab", &dict_builder);
+}
+
+static void
+add_crypttab_entry (GVariantBuilder     *builder,
+                    UDisksCrypttabEntry *entry)
+{
+  GVariant *item;
+
+  item = dup_configuration_item (entry);
+  if (item == NULL)
+    item = attach_configuration_item (entry, build_crypttab_item (entry, NULL));
+  g_variant_builder_add_value (builder, item);
+  g_variant_unref (item);
+}
+
+/* Like add_crypttab_entry() but with the contents of the keyfile, if
+ * any. This is the only place key material is read from disk, only for
+ * GetSecretConfiguration() and only after the caller was authorized.
+ * Items with secrets are never kept around.
+ */
+static gboolean
+add_crypttab_entry_with_secrets (GVariantBuilder      *builder,
+                                 UDisksCrypttabEntry  *entry,
+                                 GError              **error)
+{
+  const gchar *passphrase_path;
+  gchar *passphrase_contents = NULL;
+  gsize passphrase_contents_length;
+
+  passphrase_path = get_crypttab_passphrase_path (entry);
+  if (g_strcmp0 (passphrase_path, "") == 0 || g_str_has_prefix (passphrase_path, "/dev"))
     {
-      memset (passphrase_contents, '\0', passphrase_contents_length);
-      g_free (passphrase_contents);
+      add_crypttab_entry (builder, entry);
+      return TRUE;
     }
 
+  if (!g_file_get_contents (passphrase_path,
+                            &passphrase_contents,
+                            &passphrase_contents_length,
+                            error))
+    {
+      g_prefix_error (error,
+                      "Error loading secrets from file `%s' referenced in /etc/crypttab entry: ",
+                      passphrase_path);
+      return FALSE;
+    }
+
+  g_variant_builder_add_value (builder, build_crypttab_item (entry, passphrase_contents));
+
+  memset (passphrase_contents, '\0', passphrase_contents_length);
+  g_free (passphrase_contents);
+
   return TRUE;
 }
 
+/* Finds the /etc/fstab and /etc/crypttab entries the configuration of @block is built from */
+static GList *
+find_configuration_entries (UDisksLinuxBlock *block,
+                            UDisksDaemon     *daemon)
+{
+  GList *ret;
+
+  /* First the /etc/fstab entries */
+  ret = udisks_linux_block_find_fstab_entries (block, daemon);
+
+  /* Then the /etc/crypttab entries (currently only supported for LUKS) */
+  if (udisks_linux_block_is_luks (UDISKS_BLOCK (block)))
+    ret = g_list_concat (ret, find_crypttab_entries_for_device (block, daemon));
+
+  return ret;
+}
+
+/* returns a floating GVariant */
+static GVariant *
+build_configuration (GList     *entries,
+                     gboolean   include_secrets,
+                     GError   **error)
+{
+  GList *l;
+  GVariantBuilder builder;
+  GVariant *ret;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+  for (l = entries; l != NULL; l = l->next)
+    {
+      if (UDISKS_IS_FSTAB_ENTRY (l->data))
+        {
+          add_fstab_entry (&builder, UDISKS_FSTAB_ENTRY (l->data));
+        }
+      else if (!include_secrets)
+        {
+          add_crypttab_entry (&builder, UDISKS_CRYPTTAB_ENTRY (l->data));
+        }
+      else if (!add_crypttab_entry_with_secrets (&builder, UDISKS_CRYPTTAB_ENTRY (l->data), error))
+        {
+          g_variant_builder_clear (&builder);
+          return NULL;
+        }
+    }
+
+  ret = g_variant_builder_end (&builder);
+  /* serialize it in the thread building it, not in the main thread when
+   * the property setter compares it to the old value or when it is sent */
+  g_variant_get_data (ret);
+
+  return ret;
+}
+
 /* returns a floating GVariant */
 static GVariant *
 calculate_configuration (UDisksLinuxBlock  *block,
@@ -761,41 +955,39 @@ calculate_configuration (UDisksLinuxBlock  *block,
                          GError           **error)
 {
   GList *entries;
-  GList *l;
-  GVariantBuilder builder;
   GVariant *ret;
 
   g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
-  ret = NULL;
-
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
-  /* First the /etc/fstab entries */
-  entries = find_fstab_entries_for_device (block, daemon);
-  for (l = entries; l != NULL; l = l->next)
-    add_fstab_entry (&builder, UDISKS_FSTAB_ENTRY (l->data));
+  entries = find_configuration_entries (block, daemon);
+  ret = build_configuration (entries, include_secrets, error);
   g_list_free_full (entries, g_object_unref);
 
-  /* Then the /etc/crypttab entries (currently only supported for LUKS) */
-  if (udisks_linux_block_is_luks (UDISKS_BLOCK (block)))
+  return ret;
+}
+
+static gboolean
+configuration_entries_equal (GList *a,
+                             GList *b)
+{
+  for (; a != NULL && b != NULL; a = a->next, b = b->next)
     {
-      entries = find_crypttab_entries_for_device (block, daemon);
-      for (l = entries; l != NULL; l = l->next)
+      if (a->data == b->data)
+        continue;
+      if (G_OBJECT_TYPE (a->data) != G_OBJECT_TYPE (b->data))
+        return FALSE;
+      if (UDISKS_IS_FSTAB_ENTRY (a->data))
         {
-          if (!add_crypttab_entry (&builder, UDISKS_CRYPTTAB_ENTRY (l->data), include_secrets, error))
-            {
-              g_variant_builder_clear (&builder);
-              g_list_free_full (entries, g_object_unref);
-              goto out;
-            }
+          if (udisks_fstab_entry_compare (a->data, b->data) != 0)
+            return FALSE;
+        }
+      else if (udisks_crypttab_entry_compare (a->data, b->data) != 0)
+        {
+          return FALSE;
         }
-      g_list_free_full (entries, g_object_unref);
     }
 
-  ret = g_variant_builder_end (&builder);
-
- out:
-  return ret;
+  return a == NULL && b == NULL;
 }
 
 #ifdef HAVE_LIBMOUNT
@@ -823,23 +1015,26 @@ calculate_userspace_mount_options (UDisksLinuxBlock *block,
 }
 #endif
 
+/* Only replaces the Configuration property if the entries it is built
+ * from changed, without secrets building it can't fail and reads nothing
+ */
 static void
 update_configuration (UDisksLinuxBlock  *block,
                       UDisksDaemon      *daemon)
 {
-  GVariant *configuration;
-  GError *error;
+  GList *entries;
 
-  error = NULL;
-  configuration = calculate_configuration (block, daemon, FALSE, &error);
-  if (configuration == NULL)
+  entries = find_configuration_entries (block, daemon);
+  if (udisks_block_get_configuration (UDISKS_BLOCK (block)) != NULL &&
+      configuration_entries_equal (entries, block->configuration_entries))
     {
-      udisks_warning ("Error loading configuration: %s (%s, %d)",
-                      error->message, g_quark_to_string (error->domain), error->code);
-      g_clear_error (&error);
-      configuration = g_variant_new ("a(sa{sv})", NULL);
+      g_list_free_full (entries, g_object_unref);
+      return;
     }
-  udisks_block_set_configuration (UDISKS_BLOCK (block), configuration);
+
+  udisks_block_set_configuration (UDISKS_BLOCK (block), build_configuration (entries, FALSE, NULL));
+  g_list_free_full (block->configuration_entries, g_object_unref);
+  block->configuration_entries = entries;
 }
 
 #ifdef HAVE_LIBMOUNT
@@ -858,97 +1053,36 @@ update_userspace_mount_options (UDisksLinuxBlock *block,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static GList *
-find_fstab_entries_for_needle (const gchar  *needle,
-                               UDisksDaemon *daemon)
-{
-  GList *entries;
-  GList *l;
-  GList *ret;
-
-  ret = NULL;
-
-  entries = udisks_fstab_monitor_get_entries (udisks_daemon_get_fstab_monitor (daemon));
-  for (l = entries; l != NULL; l = l->next)
-    {
-      UDisksFstabEntry *entry = UDISKS_FSTAB_ENTRY (l->data);
-      const gchar *opts = NULL;
-
-      opts = udisks_fstab_entry_get_opts (entry);
-      if (opts && strstr(opts, needle))
-        ret = g_list_prepend (ret, g_object_ref (entry));
-    }
-
-  g_list_free_full (entries, g_object_unref);
-  return ret;
-}
-
-static GList *
-find_crypttab_entries_for_needle (gchar        *needle,
-                                  UDisksDaemon *daemon)
-{
-  GList *entries;
-  GList *l;
-  GList *ret;
-
-  ret = NULL;
-
-  entries = udisks_crypttab_monitor_get_entries (udisks_daemon_get_crypttab_monitor (daemon));
-  for (l = entries; l != NULL; l = l->next)
-    {
-      UDisksCrypttabEntry *entry = UDISKS_CRYPTTAB_ENTRY (l->data);
-      const gchar *opts = NULL;
-
-      opts = udisks_crypttab_entry_get_options (entry);
-      if (opts && strstr(opts, needle))
-        ret = g_list_prepend (ret, g_object_ref (entry));
-    }
-
-  g_list_free_full (entries, g_object_unref);
-  return ret;
-}
-
 /* returns a floating GVariant */
 static GVariant *
-find_configurations (gchar         *needle,
-                     UDisksDaemon  *daemon,
-                     gboolean       include_secrets,
-                     GError       **error)
+find_child_configurations (const gchar  *uuid,
+                           UDisksDaemon *daemon)
 {
   GList *entries;
   GList *l;
   GVariantBuilder builder;
   GVariant *ret;
 
-  udisks_debug ("Looking for %s", needle);
-
-  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
-
-  ret = NULL;
+  udisks_debug ("Looking for x-parent=%s", uuid);
 
+  /* the monitors index the x-parent= options of their entries */
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
   /* First the /etc/fstab entries */
-  entries = find_fstab_entries_for_needle (needle, daemon);
+  entries = udisks_fstab_monitor_get_entries_for_parent (udisks_daemon_get_fstab_monitor (daemon), uuid);
   for (l = entries; l != NULL; l = l->next)
     add_fstab_entry (&builder, UDISKS_FSTAB_ENTRY (l->data));
   g_list_free_full (entries, g_object_unref);
 
   /* Then the /etc/crypttab entries */
-  entries = find_crypttab_entries_for_needle (needle, daemon);
+  entries = udisks_crypttab_monitor_get_entries_for_parent (udisks_daemon_get_crypttab_monitor (daemon), uuid);
   for (l = entries; l != NULL; l = l->next)
-    {
-      if (!add_crypttab_entry (&builder, UDISKS_CRYPTTAB_ENTRY (l->data), include_secrets, error))
-        {
-          g_variant_builder_clear (&builder);
-          g_list_free_full (entries, g_object_unref);
-          goto out;
-        }
-    }
+    add_crypttab_entry (&builder, UDISKS_CRYPTTAB_ENTRY (l->data));
   g_list_free_full (entries, g_object_unref);
 
   ret = g_variant_builder_end (&builder);
+  /* like the Configuration property, see build_configuration() */
+  g_variant_get_data (ret);
 
- out:
   return ret;
 }
 
@@ -956,28 +1090,22 @@ GVariant *
 udisks_linux_find_child_configuration (UDisksDaemon *daemon,
                                        const gchar  *uuid)
 {
-  GError *error = NULL;
-  gchar *needle = g_strdup_printf ("x-parent=%s", uuid);
-  GVariant *res = find_configurations (needle, daemon, FALSE, &error);
-  if (res == NULL)
-    {
-      udisks_warning ("Error loading configuration: %s (%s, %d)",
-                      error->message, g_quark_to_string (error->domain), error->code);
-      g_clear_error (&error);
-      res = g_variant_new ("a(sa{sv})", NULL);
-    }
-  g_free (needle);
-  return res;
+  return find_child_configurations (uuid, daemon);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gchar *
-get_slave_sysfs_path (const gchar *sysfs_path)
+get_slave_sysfs_path (UDisksLinuxProvider *provider,
+                      const gchar         *sysfs_path)
 {
   gchar *ret = NULL;
   gchar **slaves;
-  slaves = udisks_daemon_util_resolve_links (sysfs_path, "slaves");
+
+  /* sysfs is only read for devices the graph doesn't know yet */
+  slaves = udisks_linux_provider_dup_slaves (provider, sysfs_path);
+  if (slaves == NULL)
+    slaves = udisks_daemon_util_resolve_links (sysfs_path, "slaves");
   if (slaves != NULL && g_strv_length (slaves) == 1)
     {
       ret = g_strdup (slaves[0]);
@@ -987,16 +1115,46 @@ get_slave_sysfs_path (const gchar *sysfs_path)
   return ret;
 }
 
-/**
- * udisks_linux_block_update:
- * @block: A #UDisksLinuxBlock.
- * @object: The enclosing #UDisksLinuxBlockObject instance.
- *
- * Updates the interface.
- */
-void
-udisks_linux_block_update (UDisksLinuxBlock       *block,
-                           UDisksLinuxBlockObject *object)
+/* Updates everything derived from the udev device and its sysfs
+ * attributes, including the drive and MD-RAID linkage found by walking
+ * the udev parents and slaves of the device */
+/* The generated setters go through g_object_set(), which copies the new
+ * value before the skeleton compares it with the old one, so only call them
+ * if the value has changed */
+#define BLOCK_SET(iface, name, value)                                         \
+  G_STMT_START {                                                              \
+    if (udisks_block_get_##name (iface) != (value))                           \
+      udisks_block_set_##name (iface, (value));                               \
+  } G_STMT_END
+
+#define BLOCK_SET_STRING(iface, name, value)                                  \
+  G_STMT_START {                                                              \
+    const gchar *_value = (value);                                            \
+    if (g_strcmp0 (udisks_block_get_##name (iface), _value) != 0)             \
+      udisks_block_set_##name (iface, _value);                                \
+  } G_STMT_END
+
+#define BLOCK_SET_STRV(iface, name, value)                                    \
+  G_STMT_START {                                                              \
+    const gchar *const *_value = (value);                                     \
+    if (!udisks_daemon_util_strv_equal (udisks_block_get_##name (iface), _value)) \
+      udisks_block_set_##name (iface, _value);                                \
+  } G_STMT_END
+
+/* Checks whether @path is @dir/@name without building the latter */
+static gboolean
+path_is_in_dir (const gchar *path,
+                const gchar *dir,
+                const gchar *name)
+{
+  gsize len = strlen (dir);
+
+  return strncmp (path, dir, len) == 0 && path[len] == '/' && strcmp (path + len + 1, name) == 0;
+}
+
+static void
+update_from_device (UDisksLinuxBlock       *block,
+                    UDisksLinuxBlockObject *object)
 {
   UDisksBlock *iface = UDISKS_BLOCK (block);
   UDisksDaemon *daemon;
@@ -1010,6 +1168,7 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
   const gchar *const *symlinks;
   const gchar *preferred_device_file;
   const gchar *id_device_file;
+  gchar *crypto_backing_device = NULL;
   gboolean media_removable = FALSE;
   guint64 size;
   gboolean media_available;
@@ -1032,70 +1191,59 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
   device_file = g_udev_device_get_device_file (device->udev_device);
   symlinks = g_udev_device_get_device_file_symlinks (device->udev_device);
 
-  udisks_block_set_device (iface, device_file);
-  udisks_block_set_symlinks (iface, symlinks);
-  udisks_block_set_device_number (iface, dev);
+  BLOCK_SET_STRING (iface, device, device_file);
+  BLOCK_SET_STRV (iface, symlinks, symlinks);
+  BLOCK_SET (iface, device_number, dev);
 
   size = udisks_daemon_util_block_get_size (device->udev_device,
                                             &media_available,
                                             &media_change_detected);
-  udisks_block_set_size (iface, size);
+  BLOCK_SET (iface, size, size);
 
   read_only = g_udev_device_get_sysfs_attr_as_boolean (device->udev_device, "ro");
   if (!read_only && g_str_has_prefix (g_udev_device_get_name (device->udev_device), "sr"))
     read_only = TRUE;
-  udisks_block_set_read_only (iface, read_only);
+  BLOCK_SET (iface, read_only, read_only);
 
-  /* dm-crypt
-   *
-   * TODO: this might not be the best way to determine if the device-mapper device
-   *       is a dm-crypt device.. but unfortunately device-mapper keeps all this stuff
-   *       in user-space and wants you to use libdevmapper to obtain it...
-   */
-  udisks_block_set_crypto_backing_device (iface, "/");
-  if (g_str_has_prefix (g_udev_device_get_name (device->udev_device), "dm-"))
+  /* dm-crypt */
+  if (udisks_linux_device_get_dm_type (device) == UDISKS_LINUX_DEVICE_DM_TYPE_CRYPT)
     {
-      gchar *dm_uuid;
-      dm_uuid = get_sysfs_attr (device->udev_device, "dm/uuid");
-      if (dm_uuid != NULL &&
-           (g_str_has_prefix (dm_uuid, "CRYPT-LUKS") || g_str_has_prefix (dm_uuid, "CRYPT-TCRYPT")))
-        {
-          gchar *slave_sysfs_path;
-          slave_sysfs_path = get_slave_sysfs_path (g_udev_device_get_sysfs_path (device->udev_device));
+      UDisksLinuxProvider *provider = udisks_daemon_get_linux_provider (daemon);
+      gchar *slave_sysfs_path;
+      slave_sysfs_path = get_slave_sysfs_path (provider, g_udev_device_get_sysfs_path (device->udev_device));
 
-          while (slave_sysfs_path)
+      while (slave_sysfs_path)
+        {
+          UDisksLinuxBlockObject *slave_object;
+          slave_object = udisks_linux_provider_find_block_by_sysfs_path (provider, slave_sysfs_path);
+          if (slave_object != NULL)
             {
-              UDisksLinuxBlockObject *slave_object;
-              slave_object = find_block_device_by_sysfs_path (object_manager, slave_sysfs_path);
-              if (slave_object != NULL)
-                {
-                  UDisksEncrypted *enc;
+              UDisksEncrypted *enc;
 
-                  udisks_block_set_crypto_backing_device (iface,
-                                                          g_dbus_object_get_object_path (G_DBUS_OBJECT (slave_object)));
-
-                  /* also set the CleartextDevice property for the parent device */
-                  enc = udisks_object_peek_encrypted (UDISKS_OBJECT (slave_object));
-                  if (enc != NULL)
-                    {
-                      udisks_encrypted_set_cleartext_device (UDISKS_ENCRYPTED (enc),
-                                                             g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-                    }
+              crypto_backing_device = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (slave_object)));
 
-                  g_object_unref (slave_object);
-                  g_free (slave_sysfs_path);
-                  break;
-                }
-              else
+              /* also set the CleartextDevice property for the parent device */
+              enc = udisks_object_peek_encrypted (UDISKS_OBJECT (slave_object));
+              if (enc != NULL)
                 {
-                  gchar *old_sysfs_path = slave_sysfs_path;
-                  slave_sysfs_path = get_slave_sysfs_path (old_sysfs_path);
-                  g_free (old_sysfs_path);
+                  udisks_encrypted_set_cleartext_device (UDISKS_ENCRYPTED (enc),
+                                                         g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
                 }
+
+              g_object_unref (slave_object);
+              g_free (slave_sysfs_path);
+              break;
+            }
+          else
+            {
+              gchar *old_sysfs_path = slave_sysfs_path;
+              slave_sysfs_path = get_slave_sysfs_path (provider, old_sysfs_path);
+              g_free (old_sysfs_path);
             }
         }
-      g_free (dm_uuid);
     }
+  BLOCK_SET_STRING (iface, crypto_backing_device, crypto_backing_device != NULL ? crypto_backing_device : "/");
+  g_free (crypto_backing_device);
 
   /* Sort out preferred device... this is what UI shells should
    * display. We default to the block device name.
@@ -1108,32 +1256,27 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
   if (g_str_has_prefix (device_file, "/dev/dm-"))
     {
       const gchar *dm_name;
-      gchar *dm_name_dev_file = NULL;
       const gchar *dm_name_dev_file_as_symlink = NULL;
 
       const gchar *dm_vg_name;
       const gchar *dm_lv_name;
-      gchar *dm_lvm_dev_file = NULL;
 
       dm_name = g_udev_device_get_property (device->udev_device, "DM_NAME");
-      if (dm_name != NULL)
-        dm_name_dev_file = g_strdup_printf ("/dev/mapper/%s", dm_name);
-
       dm_vg_name = g_udev_device_get_property (device->udev_device, "DM_VG_NAME");
       dm_lv_name = g_udev_device_get_property (device->udev_device, "DM_LV_NAME");
-      if (dm_vg_name != NULL && dm_lv_name != NULL)
-        dm_lvm_dev_file =  g_strdup_printf ("/dev/%s/%s", dm_vg_name, dm_lv_name);
 
       for (n = 0; symlinks != NULL && symlinks[n] != NULL; n++)
         {
           if (g_str_has_prefix (symlinks[n], "/dev/vg_")
-              || g_strcmp0 (symlinks[n], dm_lvm_dev_file) == 0)
+              || (dm_vg_name != NULL && dm_lv_name != NULL &&
+                  g_str_has_prefix (symlinks[n], "/dev/") &&
+                  path_is_in_dir (symlinks[n] + strlen ("/dev/"), dm_vg_name, dm_lv_name)))
             {
               /* LVM2 */
               preferred_device_file = symlinks[n];
               break;
             }
-          else if (g_strcmp0 (symlinks[n], dm_name_dev_file) == 0)
+          else if (dm_name != NULL && path_is_in_dir (symlinks[n], "/dev/mapper", dm_name))
             {
               dm_name_dev_file_as_symlink = symlinks[n];
             }
@@ -1141,8 +1284,6 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
       /* fall back to /dev/mapper/$DM_NAME, if available as a symlink */
       if (preferred_device_file == NULL && dm_name_dev_file_as_symlink != NULL)
         preferred_device_file = dm_name_dev_file_as_symlink;
-      g_free (dm_name_dev_file);
-      g_free (dm_lvm_dev_file);
     }
   else if (g_str_has_prefix (device_file, "/dev/md"))
     {
@@ -1158,22 +1299,18 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
   /* fallback to the device name */
   if (preferred_device_file == NULL)
     preferred_device_file = g_udev_device_get_device_file (device->udev_device);
-  udisks_block_set_preferred_device (iface, preferred_device_file);
+  BLOCK_SET_STRING (iface, preferred_device, preferred_device_file);
 
-  /* Determine the drive this block device belongs to
-   *
-   * TODO: if this is slow we could have a cache or ensure that we
-   * only do this once or something else
-   */
-  drive_object_path = find_drive (object_manager, device->udev_device, &drive);
+  /* Determine the drive this block device belongs to */
+  drive_object_path = find_drive (daemon, device->udev_device, &drive);
   if (drive_object_path != NULL)
     {
-      udisks_block_set_drive (iface, drive_object_path);
+      BLOCK_SET_STRING (iface, drive, drive_object_path);
       g_free (drive_object_path);
     }
   else
     {
-      udisks_block_set_drive (iface, "/");
+      BLOCK_SET_STRING (iface, drive, "/");
     }
 
   if (drive != NULL)
@@ -1227,12 +1364,12 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
           if (id[n] == '/' || id[n] == ' ')
             id[n] = '-';
         }
-      udisks_block_set_id (iface, id);
+      BLOCK_SET_STRING (iface, id, id);
       g_free (id);
     }
   else
     {
-      udisks_block_set_id (iface, NULL);
+      BLOCK_SET_STRING (iface, id, NULL);
     }
 
   if (udisks_daemon_get_enable_tcrypt (daemon))
@@ -1248,37 +1385,101 @@ udisks_linux_block_update (UDisksLinuxBlock       *block,
 
   if (seems_encrypted)
     {
-      udisks_block_set_id_usage (iface, "crypto");
-      udisks_block_set_id_type (iface, "crypto_unknown");
+      BLOCK_SET_STRING (iface, id_usage, "crypto");
+      BLOCK_SET_STRING (iface, id_type, "crypto_unknown");
     }
   else
     {
-      udisks_block_set_id_usage (iface, g_udev_device_get_property (device->udev_device, "ID_FS_USAGE"));
-      udisks_block_set_id_type (iface, g_udev_device_get_property (device->udev_device, "ID_FS_TYPE"));
+      BLOCK_SET_STRING (iface, id_usage, g_udev_device_get_property (device->udev_device, "ID_FS_USAGE"));
+      BLOCK_SET_STRING (iface, id_type, g_udev_device_get_property (device->udev_device, "ID_FS_TYPE"));
     }
 
   s = udisks_decode_udev_string (g_udev_device_get_property (device->udev_device, "ID_FS_VERSION"));
-  udisks_block_set_id_version (iface, s);
+  BLOCK_SET_STRING (iface, id_version, s);
   g_free (s);
   s = udisks_decode_udev_string (g_udev_device_get_property (device->udev_device, "ID_FS_LABEL_ENC"));
-  udisks_block_set_id_label (iface, s);
+  BLOCK_SET_STRING (iface, id_label, s);
   g_free (s);
   s = udisks_decode_udev_string (g_udev_device_get_property (device->udev_device, "ID_FS_UUID_ENC"));
-  udisks_block_set_id_uuid (iface, s);
+  BLOCK_SET_STRING (iface, id_uuid, s);
   g_free (s);
 
   update_hints (block, device, drive);
-  update_configuration (block, daemon);
+  update_mdraid (block, device, drive, object_manager);
+
+ out:
+  if (device != NULL)
+    g_object_unref (device);
+  if (drive != NULL)
+    g_object_unref (drive);
+}
+
+/**
+ * udisks_linux_block_update_partial:
+ * @block: A #UDisksLinuxBlock.
+ * @object: The enclosing #UDisksLinuxBlockObject instance.
+ * @flags: The #UDisksLinuxBlockUpdateFlags selecting the properties to update.
+ *
+ * Updates only the properties of @block selected by @flags, i.e. the
+ * ones derived from the inputs that have changed.
+ */
+void
+udisks_linux_block_update_partial (UDisksLinuxBlock            *block,
+                                   UDisksLinuxBlockObject      *object,
+                                   UDisksLinuxBlockUpdateFlags  flags)
+{
+  UDisksDaemon *daemon;
+
+  g_return_if_fail (UDISKS_IS_LINUX_BLOCK (block));
+  g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
+
+  daemon = udisks_linux_block_object_get_daemon (object);
+
+  /* publish a single snapshot of all the changes */
+  g_object_freeze_notify (G_OBJECT (block));
+
+  if (flags & UDISKS_LINUX_BLOCK_UPDATE_DEVICE)
+    update_from_device (block, object);
+
+  /* the configuration is matched against the properties set above */
+  if (flags & (UDISKS_LINUX_BLOCK_UPDATE_DEVICE | UDISKS_LINUX_BLOCK_UPDATE_CONFIGURATION))
+    update_configuration (block, daemon);
+
 #ifdef HAVE_LIBMOUNT
-  update_userspace_mount_options (block, daemon);
+  if (flags & (UDISKS_LINUX_BLOCK_UPDATE_DEVICE | UDISKS_LINUX_BLOCK_UPDATE_MOUNT_OPTIONS))
+    update_userspace_mount_options (block, daemon);
 #endif
-  update_mdraid (block, device, drive, object_manager);
 
- out:
-  if (device != NULL)
-    g_object_unref (device);
-  if (drive != NULL)
-    g_object_unref (drive);
+  g_object_thaw_notify (G_OBJECT (block));
+}
+
+/**
+ * udisks_linux_block_update:
+ * @block: A #UDisksLinuxBlock.
+ * @object: The enclosing #UDisksLinuxBlockObject instance.
+ *
+ * Updates the interface.
+ */
+void
+udisks_linux_block_update (UDisksLinuxBlock       *block,
+                           UDisksLinuxBlockObject *object)
+{
+  udisks_linux_block_update_partial (block, object, UDISKS_LINUX_BLOCK_UPDATE_ALL);
+}
+
+/**
+ * udisks_linux_block_update_configuration:
+ * @block: A #UDisksLinuxBlock.
+ * @object: The enclosing #UDisksLinuxBlockObject instance.
+ *
+ * Updates only the #UDisksBlock:configuration property of @block, e.g.
+ * after /etc/fstab or /etc/crypttab changed.
+ */
+void
+udisks_linux_block_update_configuration (UDisksLinuxBlock       *block,
+                                         UDisksLinuxBlockObject *object)
+{
+  udisks_linux_block_update_partial (block, object, UDISKS_LINUX_BLOCK_UPDATE_CONFIGURATION);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1304,14 +1505,7 @@ handle_get_secret_configuration (UDisksBlock           *_block,
 
   daemon = udisks_linux_block_object_get_daemon (object);
 
-  error = NULL;
-  configuration = calculate_configuration (block, daemon, TRUE, &error);
-  if (configuration == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
-
+  /* don't read any key material before the caller is authorized */
   if (!udisks_daemon_util_check_authorization_sync (daemon,
                                                     NULL,
                                                     "org.freedesktop.udisks2.read-system-configuration-secrets",
@@ -1322,8 +1516,13 @@ handle_get_secret_configuration (UDisksBlock           *_block,
                                                      */
                                                     N_("Authentication is required to read system-level secrets"),
                                                     invocation))
+    goto out;
+
+  error = NULL;
+  configuration = calculate_configuration (block, daemon, TRUE, &error);
+  if (configuration == NULL)
     {
-      g_variant_unref (configuration);
+      g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
 
@@ -2388,7 +2587,161 @@ erase_ata_device (UDisksBlock   *block,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-#define ERASE_SIZE (1 * 1024*1024)
+/* <linux/fs.h> clashes with <sys/mount.h> */
+#ifndef BLKDISCARD
+#define BLKDISCARD _IO(0x12,119)
+#endif
+#ifndef BLKZEROOUT
+#define BLKZEROOUT _IO(0x12,127)
+#endif
+
+/* Chunk size for the BLKZEROOUT / BLKDISCARD offload so that progress
+ * is reported and cancellation is noticed in reasonable time
+ */
+#define ERASE_OFFLOAD_SIZE (256 * 1024*1024)
+
+/* Chunk size when writing zeroes ourselves */
+#define ERASE_SIZE (32 * 1024*1024)
+
+/* Updates Job:Progress, Job:Rate and Job:ExpectedEndTime from the
+ * throughput since @start_usec (monotonic time)
+ */
+static void
+update_erase_progress (UDisksBaseJob *job,
+                       guint64        pos,
+                       guint64        size,
+                       gint64         start_usec,
+                       gint64         now)
+{
+  guint64 rate = 0;
+
+  udisks_job_set_progress (UDISKS_JOB (job), ((gdouble) pos) / size);
+
+  if (now > start_usec)
+    rate = ((gdouble) pos) * G_USEC_PER_SEC / (now - start_usec);
+  udisks_job_set_rate (UDISKS_JOB (job), rate);
+  if (rate > 0)
+    udisks_job_set_expected_end_time (UDISKS_JOB (job),
+                                      g_get_real_time () + ((gdouble) (size - pos)) * G_USEC_PER_SEC / rate);
+}
+
+/* Token bucket limiting the bandwidth and the number of write requests of an
+ * erase, refilled continuously and holding at most a second worth of tokens */
+typedef struct
+{
+  guint64 max_bytes_per_sec;  /* 0 for no limit */
+  guint64 max_ops_per_sec;    /* 0 for no limit */
+  gdouble bytes_tokens;
+  gdouble ops_tokens;
+  gint64 last_usec;
+} EraseThrottle;
+
+/* Longest sleep between the checks for cancellation while throttled */
+#define ERASE_THROTTLE_MAX_SLEEP_USEC (G_USEC_PER_SEC / 10)
+
+/* The tighter of two limits where 0 means no limit */
+static guint64
+tighter_limit (guint64 a,
+               guint64 b)
+{
+  if (a == 0)
+    return b;
+  if (b == 0)
+    return a;
+  return MIN (a, b);
+}
+
+static void
+erase_throttle_init (EraseThrottle *throttle,
+                     guint64        max_bytes_per_sec,
+                     guint64        max_ops_per_sec)
+{
+  throttle->max_bytes_per_sec = max_bytes_per_sec;
+  throttle->max_ops_per_sec = max_ops_per_sec;
+  throttle->bytes_tokens = max_bytes_per_sec;
+  throttle->ops_tokens = max_ops_per_sec;
+  throttle->last_usec = g_get_monotonic_time ();
+}
+
+/* Largest request of at most @size bytes that fits into the bucket */
+static guint64
+erase_throttle_clamp_request (EraseThrottle *throttle,
+                              guint64        size)
+{
+  if (throttle->max_bytes_per_sec == 0)
+    return size;
+  /* keep the requests aligned for O_DIRECT */
+  return MIN (size, MAX (throttle->max_bytes_per_sec & ~((guint64) 4095), 4096));
+}
+
+/* Waits until a request of @bytes bytes may be issued, returns FALSE if
+ * @cancellable was cancelled in the meantime */
+static gboolean
+erase_throttle_wait (EraseThrottle *throttle,
+                     guint64        bytes,
+                     GCancellable  *cancellable)
+{
+  while (TRUE)
+    {
+      gint64 now = g_get_monotonic_time ();
+      gdouble elapsed = (gdouble) (now - throttle->last_usec) / G_USEC_PER_SEC;
+      gdouble wait_usec = 0;
+
+      throttle->last_usec = now;
+      if (throttle->max_bytes_per_sec > 0)
+        {
+          throttle->bytes_tokens = MIN (throttle->bytes_tokens + elapsed * throttle->max_bytes_per_sec,
+                                        MAX (throttle->max_bytes_per_sec, bytes));
+          if (throttle->bytes_tokens < bytes)
+            wait_usec = (bytes - throttle->bytes_tokens) * G_USEC_PER_SEC / throttle->max_bytes_per_sec;
+        }
+      if (throttle->max_ops_per_sec > 0)
+        {
+          throttle->ops_tokens = MIN (throttle->ops_tokens + elapsed * throttle->max_ops_per_sec,
+                                      throttle->max_ops_per_sec);
+          if (throttle->ops_tokens < 1.0)
+            wait_usec = MAX (wait_usec, (1.0 - throttle->ops_tokens) * G_USEC_PER_SEC / throttle->max_ops_per_sec);
+        }
+
+      if (wait_usec <= 0)
+        {
+          throttle->bytes_tokens -= bytes;
+          throttle->ops_tokens -= 1.0;
+          return TRUE;
+        }
+      if (g_cancellable_is_cancelled (cancellable))
+        return FALSE;
+      g_usleep (MIN ((gulong) wait_usec + 1, ERASE_THROTTLE_MAX_SLEEP_USEC));
+    }
+}
+
+/* Returns whether discarding @object's blocks is known to make them read back as zeroes */
+static gboolean
+discard_zeroes_data (UDisksObject *object)
+{
+  UDisksLinuxDevice *device;
+  GUdevDevice *disk = NULL;
+  gboolean ret = FALSE;
+
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (device == NULL)
+    goto out;
+
+  /* the queue/ directory only exists for the whole disk */
+  if (g_strcmp0 (g_udev_device_get_devtype (device->udev_device), "partition") == 0)
+    disk = g_udev_device_get_parent_with_subsystem (device->udev_device, "block", "disk");
+  else
+    disk = g_object_ref (device->udev_device);
+  if (disk == NULL)
+    goto out;
+
+  ret = g_udev_device_get_sysfs_attr_as_int (disk, "queue/discard_zeroes_data") == 1;
+
+ out:
+  g_clear_object (&disk);
+  g_clear_object (&device);
+  return ret;
+}
 
 static gboolean
 erase_device (UDisksBlock   *block,
@@ -2396,8 +2749,12 @@ erase_device (UDisksBlock   *block,
               UDisksDaemon  *daemon,
               uid_t          caller_uid,
               const gchar   *erase_type,
+              guint64        max_bandwidth,
+              guint64        max_iops,
               GError       **error)
 {
+  UDisksConfigManager *config_manager = udisks_daemon_get_config_manager (daemon);
+  EraseThrottle throttle;
   gboolean ret = FALSE;
   const gchar *device_file = NULL;
   UDisksBaseJob *job = NULL;
@@ -2405,7 +2762,10 @@ erase_device (UDisksBlock   *block,
   guint64 size;
   guint64 pos;
   guchar *buf = NULL;
+  gint64 start_usec;
   gint64 time_of_last_signal;
+  unsigned long offload_request;
+  gint flags;
   GError *local_error = NULL;
 
   if (g_strcmp0 (erase_type, "ata-secure-erase") == 0)
@@ -2427,7 +2787,7 @@ erase_device (UDisksBlock   *block,
     }
 
   device_file = udisks_block_get_device (block);
-  fd = open (device_file, O_WRONLY | O_SYNC | O_EXCL);
+  fd = open (device_file, O_WRONLY | O_EXCL);
   if (fd == -1)
     {
       g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
@@ -2435,8 +2795,8 @@ erase_device (UDisksBlock   *block,
       goto out;
     }
 
+  /* the rate and expected end time are set from the actual throughput, see update_erase_progress() */
   job = udisks_daemon_launch_simple_job (daemon, object, "format-erase", caller_uid, NULL);
-  udisks_base_job_set_auto_estimate (UDISKS_BASE_JOB (job), TRUE);
   udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
 
   if (ioctl (fd, BLKGETSIZE64, &size) != 0)
@@ -2448,16 +2808,104 @@ erase_device (UDisksBlock   *block,
 
   udisks_job_set_bytes (UDISKS_JOB (job), size);
 
-  buf = g_new0 (guchar, ERASE_SIZE);
+  /* the caller may only ask for tighter limits than the configured ones */
+  erase_throttle_init (&throttle,
+                       tighter_limit (udisks_config_manager_get_jobs_io_max_bandwidth (config_manager), max_bandwidth),
+                       tighter_limit (udisks_config_manager_get_jobs_io_max_iops (config_manager), max_iops));
+  udisks_job_set_rate_limit (UDISKS_JOB (job), throttle.max_bytes_per_sec);
+
+  start_usec = time_of_last_signal = g_get_monotonic_time ();
+
+  /* Let the device (or the kernel) zero the blocks - this avoids
+   * pushing the zeroes through the page cache and, for devices
+   * supporting WRITE SAME / Write Zeroes or deterministic discards,
+   * doesn't transfer any data at all
+   */
+  offload_request = discard_zeroes_data (object) ? BLKDISCARD : BLKZEROOUT;
+  pos = 0;
+  while (pos < size)
+    {
+      guint64 range[2];
+      gint64 now;
+
+      range[0] = pos;
+      range[1] = erase_throttle_clamp_request (&throttle, MIN (size - pos, ERASE_OFFLOAD_SIZE));
+      if (!erase_throttle_wait (&throttle, range[1], udisks_base_job_get_cancellable (job)))
+        {
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                       "Job was canceled");
+          goto out;
+        }
+      if (ioctl (fd, offload_request, range) != 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (pos == 0 && offload_request == BLKDISCARD)
+            {
+              /* try zeroing out instead */
+              offload_request = BLKZEROOUT;
+              continue;
+            }
+          if (pos == 0 && (errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL))
+            {
+              udisks_debug ("Zeroing out %s is not supported, writing zeroes: %m", device_file);
+              break;
+            }
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error zeroing out %" G_GUINT64_FORMAT " bytes at offset %" G_GUINT64_FORMAT " on %s: %m",
+                       range[1], range[0], device_file);
+          goto out;
+        }
+      pos += range[1];
+
+      if (g_cancellable_is_cancelled (udisks_base_job_get_cancellable (job)))
+        {
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                       "Job was canceled");
+          goto out;
+        }
+
+      /* only emit D-Bus signal at most once a second */
+      now = g_get_monotonic_time ();
+      if (now - time_of_last_signal > G_USEC_PER_SEC)
+        {
+          update_erase_progress (job, pos, size, start_usec, now);
+          time_of_last_signal = now;
+        }
+    }
+  if (pos == size)
+    goto done;
+
+  /* Fall back to writing the zeroes ourselves, bypassing the page
+   * cache with large direct writes; the device is flushed at the end
+   * instead of after every write
+   */
+  flags = fcntl (fd, F_GETFL);
+  if (flags == -1 || fcntl (fd, F_SETFL, flags | O_DIRECT) == -1)
+    udisks_debug ("Error enabling O_DIRECT on %s, using buffered writes: %m", device_file);
+  if (posix_memalign ((void **) &buf, 4096, ERASE_SIZE) != 0)
+    {
+      buf = NULL;
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error allocating memory for erasing %s", device_file);
+      goto out;
+    }
+  memset (buf, 0, ERASE_SIZE);
+  start_usec = g_get_monotonic_time ();
   pos = 0;
-  time_of_last_signal = g_get_monotonic_time ();
   while (pos < size)
     {
       size_t to_write;
       ssize_t num_written;
       gint64 now;
 
-      to_write = MIN (size - pos, ERASE_SIZE);
+      to_write = erase_throttle_clamp_request (&throttle, MIN (size - pos, ERASE_SIZE));
+      if (!erase_throttle_wait (&throttle, to_write, udisks_base_job_get_cancellable (job)))
+        {
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                       "Job was canceled");
+          goto out;
+        }
     again:
       num_written = write (fd, buf, to_write);
       if (num_written == -1 || num_written == 0)
@@ -2482,12 +2930,19 @@ erase_device (UDisksBlock   *block,
       now = g_get_monotonic_time ();
       if (now - time_of_last_signal > G_USEC_PER_SEC)
         {
-          /* TODO: estimation etc. */
-          udisks_job_set_progress (UDISKS_JOB (job), ((gdouble) pos) / size);
+          update_erase_progress (job, pos, size, start_usec, now);
           time_of_last_signal = now;
         }
     }
 
+ done:
+  if (fsync (fd) != 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error syncing %s: %m", device_file);
+      goto out;
+    }
+
   ret = TRUE;
 
  out:
@@ -2500,7 +2955,7 @@ erase_device (UDisksBlock   *block,
     }
   if (local_error != NULL)
     g_propagate_error (error, local_error);
-  g_free (buf);
+  free (buf);
   if (fd != -1)
     close (fd);
   return ret;
@@ -2583,40 +3038,33 @@ peek_partition_table (UDisksDaemon    *daemon,
   return pt;
 }
 
+/* The cleartext device is one of the holders of its backing device so it
+ * is found in the holders/slaves graph, without a scan of all objects. */
 static UDisksBlock *
 get_cleartext_block (UDisksDaemon  *daemon,
                      UDisksBlock   *block)
 {
   UDisksBlock *ret = NULL;
   GDBusObject *object;
-  const gchar *object_path;
-  GList *objects = NULL;
-  GList *l;
+  UDisksLinuxDevice *device;
+  UDisksLinuxBlockObject *cleartext_object;
 
   object = g_dbus_interface_get_object (G_DBUS_INTERFACE (block));
-  if (object == NULL)
+  if (object == NULL || !UDISKS_IS_LINUX_BLOCK_OBJECT (object))
     goto out;
 
-  object_path = g_dbus_object_get_object_path (object);
-  objects = udisks_daemon_get_objects (daemon);
-  for (l = objects; l != NULL; l = l->next)
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  cleartext_object = udisks_linux_provider_find_cleartext_block (udisks_daemon_get_linux_provider (daemon),
+                                                                 g_udev_device_get_sysfs_path (device->udev_device),
+                                                                 g_dbus_object_get_object_path (object));
+  g_object_unref (device);
+  if (cleartext_object != NULL)
     {
-      UDisksObject *iter_object = UDISKS_OBJECT (l->data);
-      UDisksBlock *iter_block;
-
-      iter_block = udisks_object_peek_block (iter_object);
-      if (iter_block == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_block_get_crypto_backing_device (iter_block), object_path) == 0)
-        {
-          ret = g_object_ref (iter_block);
-          goto out;
-        }
+      ret = udisks_object_get_block (UDISKS_OBJECT (cleartext_object));
+      g_object_unref (cleartext_object);
     }
 
  out:
-  g_list_free_full (objects, g_object_unref);
   return ret;
 }
 
@@ -2839,6 +3287,18 @@ handle_format_failure (GDBusMethodInvocation *invocation,
     g_clear_error (&error);
 }
 
+/* Replaces *@error by an UDISKS_ERROR_FAILED error with @prefix prepended to its message */
+static void
+set_error_failed_prefixed (GError      **error,
+                           const gchar  *prefix)
+{
+  GError *failed;
+
+  failed = g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED, "%s%s", prefix, (*error)->message);
+  g_error_free (*error);
+  *error = failed;
+}
+
 static gboolean
 add_blocksize (gchar        **command,
                const gchar   *device,
@@ -2897,13 +3357,57 @@ build_command (const gchar *template,
   return command;
 }
 
-void
-udisks_linux_block_handle_format (UDisksBlock             *block,
-                                  GDBusMethodInvocation   *invocation,
-                                  const gchar             *type,
-                                  GVariant                *options,
-                                  void                   (*complete)(gpointer user_data),
-                                  gpointer                 complete_user_data)
+/* Discards all the blocks of @device_file at once */
+static gboolean
+discard_device (const gchar  *device_file,
+                GError      **error)
+{
+  guint64 range[2] = { 0, 0 };
+  gboolean ret = FALSE;
+  gint fd;
+
+  fd = open (device_file, O_WRONLY | O_EXCL | O_CLOEXEC);
+  if (fd < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening device %s: %m", device_file);
+      return FALSE;
+    }
+
+  if (ioctl (fd, BLKGETSIZE64, &range[1]) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error doing BLKGETSIZE64 ioctl on %s: %m", device_file);
+      goto out;
+    }
+  if (range[1] > 0 && ioctl (fd, BLKDISCARD, range) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error doing BLKDISCARD ioctl on %s: %m", device_file);
+      goto out;
+    }
+  ret = TRUE;
+
+ out:
+  close (fd);
+  return ret;
+}
+
+/* runs in the thread handling @invocation or in a thread formatting one of
+ * the devices of a bulk request, where @complete is %NULL
+ *
+ * Returns FALSE with @out_error set if formatting failed before @complete
+ * was called, failures after that (with the no-block option) are only logged
+ */
+static gboolean
+format_block (UDisksBlock              *block,
+              GDBusMethodInvocation    *invocation,
+              const gchar              *type,
+              GVariant                 *options,
+              UDisksBulkAuthorization  *bulk,
+              void                    (*complete)(gpointer user_data),
+              gpointer                  complete_user_data,
+              GError                  **out_error)
 {
   FormatWaitData *wait_data = NULL;
   UDisksObject *object;
@@ -2931,6 +3435,8 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   GString *encrypt_passphrase = NULL;
   gchar *encrypt_type = NULL;
   gchar *erase_type = NULL;
+  guint64 erase_max_bandwidth = 0;
+  guint64 erase_max_iops = 0;
   gchar *mapped_name = NULL;
   const gchar *label = NULL;
   gchar *device_name = NULL;
@@ -2944,14 +3450,13 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   gboolean no_discard_flag = FALSE;
   BDPartTableType part_table_type = BD_PART_TABLE_UNDEF;
   UDisksObject *filesystem_object;
+  gboolean discarded = FALSE;
+  gboolean ret = FALSE;
 
   error = NULL;
   object = udisks_daemon_util_dup_object (block, &error);
   if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+    goto out;
 
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
   state = udisks_daemon_get_state (daemon);
@@ -2963,6 +3468,8 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   udisks_variant_lookup_binary (options, "encrypt.passphrase", &encrypt_passphrase);
   g_variant_lookup (options, "encrypt.type", "s", &encrypt_type);
   g_variant_lookup (options, "erase", "s", &erase_type);
+  g_variant_lookup (options, "erase.max-bandwidth", "t", &erase_max_bandwidth);
+  g_variant_lookup (options, "erase.max-iops", "t", &erase_max_iops);
   g_variant_lookup (options, "no-block", "b", &no_block);
   g_variant_lookup (options, "update-partition-type", "b", &update_partition_type);
   g_variant_lookup (options, "dry-run-first", "b", &dry_run_first);
@@ -2981,10 +3488,10 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
        */
       if (udisks_partition_get_offset (partition) == 0)
         {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_NOT_SUPPORTED,
-                                                 "This partition cannot be modified because it contains a partition table; please reinitialize layout of the whole device.");
+          g_set_error (&error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_NOT_SUPPORTED,
+                       "This partition cannot be modified because it contains a partition table; please reinitialize layout of the whole device.");
           goto out;
         }
 
@@ -3008,18 +3515,10 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
 
   error = NULL;
   if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+    goto out;
 
   if (!udisks_daemon_util_get_user_info (caller_uid, &caller_gid, NULL /* user name */, &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+    goto out;
 
   if (g_strcmp0 (erase_type, "ata-secure-erase") == 0 ||
       g_strcmp0 (erase_type, "ata-secure-erase-enhanced") == 0)
@@ -3064,7 +3563,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   fs_info = get_fs_info (type);
   if (fs_info == NULL || fs_info->command_create_fs == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation,
+      g_set_error (&error,
                    UDISKS_ERROR,
                    UDISKS_ERROR_NOT_SUPPORTED,
                    "Creation of file system type %s is not supported",
@@ -3072,21 +3571,25 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       goto out;
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
+  if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                         object,
+                                                         action_id,
+                                                         options,
+                                                         message,
+                                                         invocation,
+                                                         bulk,
+                                                         &error))
     goto out;
 
   if ((config_items != NULL || teardown_flag) &&
-      !udisks_daemon_util_check_authorization_sync (daemon,
-                                                    NULL,
-                                                    "org.freedesktop.udisks2.modify-system-configuration",
-                                                    options,
-                                                    N_("Authentication is required to modify the system configuration"),
-                                                    invocation))
+      !udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                         NULL,
+                                                         "org.freedesktop.udisks2.modify-system-configuration",
+                                                         options,
+                                                         N_("Authentication is required to modify the system configuration"),
+                                                         invocation,
+                                                         bulk,
+                                                         &error))
     goto out;
 
   was_partitioned = (udisks_object_peek_partition_table (object) != NULL);
@@ -3094,53 +3597,64 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   if (teardown_flag)
     {
       if (!udisks_linux_block_teardown (block, invocation, options, &error))
-        {
-          g_dbus_method_invocation_take_error (invocation, error);
-          goto out;
-        }
+        goto out;
     }
 
   device_name = udisks_block_dup_device (block);
 
-  /* First wipe the device... */
+  /* Discard the whole device once, up front, mkfs is told not to do it again
+   * below - unless it is going to be erased anyway or discarding is not wanted */
+  if (!no_discard_flag && erase_type == NULL)
+    {
+      if (discard_device (device_name, &error))
+        discarded = TRUE;
+      else
+        udisks_debug ("Not discarding %s before formatting: %s", device_name, error->message);
+      g_clear_error (&error);
+    }
+
+  /* Then wipe the signatures, mkfs doesn't reliably clear all of them (e.g.
+   * the backup GPT header or an MD RAID superblock at the end of the device) */
   if (! bd_fs_wipe (device_name, TRUE, &error)) {
     if (g_error_matches (error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
       /* no signature to remove, ignore */
       g_clear_error (&error);
     else
       {
-        g_dbus_method_invocation_return_error (invocation,
-                                               UDISKS_ERROR,
-                                               UDISKS_ERROR_FAILED,
-                                               "Error wiping device: %s",
-                                               error->message);
-        g_clear_error (&error);
+        set_error_failed_prefixed (&error, "Error wiping device: ");
         goto out;
       }
   }
 
-  /* ...then wait until this change has taken effect */
   wait_data = g_new0 (FormatWaitData, 1);
   wait_data->object = object;
   wait_data->type = "empty";
-  udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object));
   if (was_partitioned)
     udisks_linux_block_object_reread_partition_table (UDISKS_LINUX_BLOCK_OBJECT (object));
-  filesystem_object = udisks_daemon_wait_for_object_sync (daemon,
-                                                          wait_for_filesystem,
-                                                          wait_data,
-                                                          NULL,
-                                                          15,
-                                                          &error);
-  if (filesystem_object == NULL)
+
+  /* ...then wait until this change has taken effect. Only needed if the state
+   * of the object is looked at before the final uevent is processed, i.e. when
+   * creating LUKS where the UUID is waited for, or if that uevent can't be
+   * waited for and the old filesystem could be mistaken for the new one. */
+  if (encrypt_passphrase != NULL || !udisks_linux_block_object_can_trigger_uevent_sync ())
     {
-      g_prefix_error (&error, "Error synchronizing after initial wipe: ");
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      goto out;
+      udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object));
+      filesystem_object = udisks_daemon_wait_for_object_sync (daemon,
+                                                              wait_for_filesystem,
+                                                              wait_data,
+                                                              NULL,
+                                                              15,
+                                                              udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                              &error);
+      if (filesystem_object == NULL)
+        {
+          g_prefix_error (&error, "Error synchronizing after initial wipe: ");
+          goto out;
+        }
+      g_object_unref (filesystem_object);
     }
-  g_object_unref (filesystem_object);
 
-  if (no_discard_flag && fs_info->option_no_discard)
+  if ((no_discard_flag || discarded) && fs_info->option_no_discard)
     command_options = fs_info->option_no_discard;
 
   /* If requested, check whether the ultimate filesystem creation
@@ -3150,10 +3664,8 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
     {
       const gchar *device = udisks_block_get_device (block);
       command = build_command (fs_info->command_validate_create_fs, device, label, command_options, &error);
-      if (command == NULL) {
-            handle_format_failure (invocation, error);
-            goto out;
-      }
+      if (command == NULL)
+        goto out;
 
       if (!udisks_daemon_launch_spawned_job_sync (daemon,
                                                     object,
@@ -3166,11 +3678,11 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                     NULL, /* input_string */
                                                     "%s", command))
         {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error creating file system: %s",
-                                                 error_message);
+          g_set_error (&error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error creating file system: %s",
+                       error_message);
           g_free (error_message);
           goto out;
         }
@@ -3207,9 +3719,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                    NULL, /* cancellable */
                                                    &error))
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "Error creating LUKS device: %s", error->message));
-          g_clear_error (&error);
+          set_error_failed_prefixed (&error, "Error creating LUKS device: ");
           udisks_linux_block_encrypted_unlock (block);
           goto out;
         }
@@ -3221,11 +3731,11 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                              wait_data,
                                                              NULL,
                                                              30,
+                                                             udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                              &error);
       if (luks_uuid_object == NULL)
         {
           g_prefix_error (&error, "Error waiting for LUKS UUID: ");
-          handle_format_failure (invocation, error);
           goto out;
         }
       g_object_unref (luks_uuid_object);
@@ -3235,7 +3745,6 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       if (!mapped_name)
         {
           g_prefix_error (&error, "Failed to get LUKS UUID: ");
-          handle_format_failure (invocation, error);
           goto out;
         }
 
@@ -3252,9 +3761,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                    NULL, /* cancellable */
                                                    &error))
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "Error opening LUKS device: %s", error->message));
-          g_clear_error (&error);
+          set_error_failed_prefixed (&error, "Error opening LUKS device: ");
           udisks_linux_block_encrypted_unlock (block);
           goto out;
         }
@@ -3267,18 +3774,18 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                              wait_data,
                                                              NULL,
                                                              30,
+                                                             udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                              &error);
       if (cleartext_object == NULL)
         {
           g_prefix_error (&error, "Error waiting for LUKS cleartext device: ");
-          handle_format_failure (invocation, error);
           goto out;
         }
       cleartext_block = udisks_object_get_block (cleartext_object);
       if (cleartext_block == NULL)
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                 "LUKS cleartext device does not have block interface"));
+          g_set_error (&error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "LUKS cleartext device does not have block interface");
           goto out;
         }
 
@@ -3287,7 +3794,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       udisks_state_add_unlocked_crypto_dev (state,
                                             udisks_block_get_device_number (cleartext_block),
                                             udisks_block_get_device_number (block),
-                                            g_udev_device_get_sysfs_attr (udev_cleartext_device->udev_device, "dm/uuid"),
+                                            udev_cleartext_device->dm_uuid,
                                             caller_uid);
 
       object_to_mkfs = cleartext_object;
@@ -3300,7 +3807,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
     }
 
   /* complete early, if requested */
-  if (no_block)
+  if (no_block && complete != NULL)
     {
       complete (complete_user_data);
       invocation = NULL;
@@ -3310,10 +3817,10 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
    */
   if (erase_type != NULL)
     {
-      if (!erase_device (block_to_mkfs, object_to_mkfs, daemon, caller_uid, erase_type, &error))
+      if (!erase_device (block_to_mkfs, object_to_mkfs, daemon, caller_uid, erase_type,
+                         erase_max_bandwidth, erase_max_iops, &error))
         {
           g_prefix_error (&error, "Error erasing device: ");
-          handle_format_failure (invocation, error);
           goto out;
         }
     }
@@ -3324,8 +3831,8 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       /* TODO: return an error if label is too long */
       if (strstr (fs_info->command_create_fs, "$LABEL") == NULL)
         {
-          handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
-                                 "File system type %s does not support labels", type));
+          g_set_error (&error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                       "File system type %s does not support labels", type);
           goto out;
         }
     }
@@ -3340,10 +3847,7 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
         const gchar *device = udisks_block_get_device (block_to_mkfs);
         command = build_command (fs_info->command_create_fs, device, label, command_options, &error);
         if (command == NULL)
-          {
-            handle_format_failure (invocation, error);
             goto out;
-          }
 
         if (!udisks_daemon_launch_spawned_job_sync (daemon,
                                                       object_to_mkfs,
@@ -3356,8 +3860,8 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                       NULL, /* input_string */
                                                       "%s", command))
           {
-            handle_format_failure (invocation, g_error_new (UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                   "Error creating file system: %s", error_message));
+            g_set_error (&error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                         "Error creating file system: %s", error_message);
             g_free (error_message);
             goto out;
           }
@@ -3367,29 +3871,27 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
       {
         /* Create the partition table. */
         if (! bd_part_create_table (device_name, part_table_type, TRUE, &error))
-          {
-            handle_format_failure (invocation, error);
             goto out;
-          }
       }
 
   /* The mkfs program may not generate all the uevents we need - so explicitly
-   * trigger an event here
+   * trigger an event here and wait for it to be processed, after that the
+   * object reflects the new filesystem and the wait below is just a check
    */
-  udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object_to_mkfs));
+  udisks_linux_block_object_trigger_uevent_sync (UDISKS_LINUX_BLOCK_OBJECT (object_to_mkfs), 30);
   wait_data->object = object_to_mkfs;
   filesystem_object = udisks_daemon_wait_for_object_sync (daemon,
                                                           wait_for_filesystem,
                                                           wait_data,
                                                           NULL,
                                                           30,
+                                                          udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                           &error);
   if (filesystem_object == NULL)
     {
       g_prefix_error (&error,
                       "Error synchronizing after formatting with type `%s': ",
                       type);
-      handle_format_failure (invocation, error);
       goto out;
     }
   g_object_unref (filesystem_object);
@@ -3398,11 +3900,10 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   if (take_ownership && fs_info->supports_owners)
     {
       if (!take_filesystem_ownership (udisks_block_get_device (block_to_mkfs),
-                                      type, caller_uid, caller_gid, FALSE, &error))
+                                      type, caller_uid, caller_gid, FALSE, NULL, &error))
         {
           g_prefix_error (&error,
                           "Failed to take ownership of newly created filesystem: ");
-          handle_format_failure (invocation, error);
           goto out;
         }
     }
@@ -3419,7 +3920,6 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
                                                      &error))
             {
               g_prefix_error (&error, "Error setting partition type after formatting: ");
-              handle_format_failure (invocation, error);
               goto out;
             }
         }
@@ -3439,27 +3939,35 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
           if (strcmp (item_type, "fstab") == 0)
             {
               if (!add_remove_fstab_entry (block_to_mkfs, NULL, details, &error))
-                {
-                  handle_format_failure (invocation, error);
                   goto out;
-                }
             }
           else if (strcmp (item_type, "crypttab") == 0)
             {
               if (!add_remove_crypttab_entry (block, NULL, details, &error))
-                {
-                  handle_format_failure (invocation, error);
                   goto out;
-                }
             }
           g_variant_unref (details);
         }
     }
 
-  if (invocation != NULL)
+  if (invocation != NULL && complete != NULL)
     complete (complete_user_data);
+  ret = TRUE;
 
  out:
+  if (error != NULL)
+    {
+      if (invocation != NULL)
+        {
+          g_propagate_error (out_error, error);
+        }
+      else
+        {
+          udisks_warning ("%s", error->message);
+          g_clear_error (&error);
+          ret = TRUE;
+        }
+    }
   g_free (device_name);
   g_free (mapped_name);
   g_free (command);
@@ -3475,8 +3983,24 @@ udisks_linux_block_handle_format (UDisksBlock             *block,
   g_clear_object (&partition_table);
   g_clear_object (&partition);
   g_clear_object (&object);
+  return ret;
+}
+
+void
+udisks_linux_block_handle_format (UDisksBlock             *block,
+                                  GDBusMethodInvocation   *invocation,
+                                  const gchar             *type,
+                                  GVariant                *options,
+                                  void                   (*complete)(gpointer user_data),
+                                  gpointer                 complete_user_data)
+{
+  GError *error = NULL;
+
+  if (!format_block (block, invocation, type, options, NULL, complete, complete_user_data, &error))
+    handle_format_failure (invocation, error);
 }
 
+
 struct FormatCompleteData {
   UDisksBlock *block;
   GDBusMethodInvocation *invocation;
@@ -3504,6 +4028,180 @@ handle_format (UDisksBlock           *block,
   return TRUE; /* returning true means that we handled the method invocation */
 }
 
+typedef struct
+{
+  const gchar  *type;
+  GVariant     *options;
+  UDisksObject *object;
+} FormatManyItem;
+
+typedef struct
+{
+  GDBusMethodInvocation *invocation;
+  UDisksBaseJob         *job;
+  FormatManyItem        *items;
+  /* protects num_done */
+  GMutex                 lock;
+  guint                  num_done;
+  guint                  num_items;
+} FormatManyData;
+
+/* runs in a thread of the pool of udisks_daemon_util_bulk_call_run() */
+static void
+format_many_item_func (UDisksBulkCall  *call,
+                       guint            index,
+                       gpointer         user_data,
+                       GError         **error)
+{
+  FormatManyData *format_data = user_data;
+  FormatManyItem *item = &format_data->items[index];
+
+  if (g_cancellable_is_cancelled (udisks_base_job_get_cancellable (format_data->job)))
+    g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                 "The formatting was cancelled");
+  else
+    format_block (udisks_object_peek_block (item->object),
+                  format_data->invocation,
+                  item->type,
+                  item->options,
+                  udisks_daemon_util_bulk_call_get_authorization (call),
+                  NULL, NULL, /* complete */
+                  error);
+
+  g_mutex_lock (&format_data->lock);
+  format_data->num_done++;
+  udisks_job_set_progress (UDISKS_JOB (format_data->job),
+                           ((gdouble) format_data->num_done) / format_data->num_items);
+  g_mutex_unlock (&format_data->lock);
+}
+
+/**
+ * udisks_linux_block_format_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.FormatDevices() call.
+ * @devices: The (object path, type, options) tuples of the devices to format.
+ * @options: The options of the call.
+ * @error: Return location for error or %NULL.
+ *
+ * Formats @devices in parallel, see the documentation of the
+ * Manager.FormatDevices() method. The devices are formatted like with
+ * Block.Format(), sharing the polkit checks with identical details, and
+ * the progress of all of them is reported by a single
+ * <literal>format-mkfs</literal> job. The mkfs jobs of the single
+ * devices are started by the #UDisksJobScheduler within its limits.
+ * Runs in the thread handling @invocation until all the devices are
+ * done.
+ *
+ * Returns: A floating #GVariant of type <literal>a(oss)</literal> with the results
+ * or %NULL if @error is set.
+ */
+GVariant *
+udisks_linux_block_format_many (UDisksDaemon          *daemon,
+                                GDBusMethodInvocation *invocation,
+                                GVariant              *devices,
+                                GVariant              *options,
+                                GError               **error)
+{
+  UDisksBulkCall *call;
+  FormatManyData format_data;
+  FormatManyItem *items;
+  GVariant *ret;
+  uid_t caller_uid;
+  guint num_failed = 0;
+  guint n;
+
+  call = udisks_daemon_util_bulk_call_new (options,
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests formatting several devices at once.
+                                            */
+                                           N_("Authentication is required to format devices"),
+                                           FALSE,
+                                           error);
+  if (call == NULL)
+    return NULL;
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               error))
+    {
+      udisks_daemon_util_bulk_call_free (call);
+      return NULL;
+    }
+
+  format_data.invocation = invocation;
+  g_mutex_init (&format_data.lock);
+  format_data.num_done = 0;
+  format_data.job = udisks_daemon_launch_simple_job (daemon, NULL, "format-mkfs", caller_uid,
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation));
+
+  format_data.num_items = g_variant_n_children (devices);
+  items = g_new0 (FormatManyItem, format_data.num_items);
+  format_data.items = items;
+  for (n = 0; n < format_data.num_items; n++)
+    {
+      UDisksObject *object;
+      const gchar *object_path;
+
+      g_variant_get_child (devices, n, "(&o&s@a{sv})", &object_path, &items[n].type, &items[n].options);
+
+      udisks_daemon_util_bulk_call_add (call, object_path);
+      if (udisks_daemon_util_bulk_call_get_error (call, n) != NULL)
+        {
+          format_data.num_done++;
+          continue;
+        }
+
+      object = udisks_daemon_find_object (daemon, object_path);
+      if (object == NULL || udisks_object_peek_block (object) == NULL)
+        {
+          udisks_daemon_util_bulk_call_take_error (call, n,
+                                                   g_error_new (UDISKS_ERROR,
+                                                                UDISKS_ERROR_FAILED,
+                                                                "No block device for object %s",
+                                                                object_path));
+          g_clear_object (&object);
+          format_data.num_done++;
+          continue;
+        }
+      udisks_base_job_add_object (format_data.job, object);
+      items[n].object = object;
+    }
+  udisks_job_set_progress_valid (UDISKS_JOB (format_data.job), TRUE);
+
+  udisks_daemon_util_bulk_call_run (call, format_many_item_func, &format_data);
+
+  ret = udisks_daemon_util_bulk_call_build_results (call, NULL, NULL);
+
+  for (n = 0; n < format_data.num_items; n++)
+    {
+      if (udisks_daemon_util_bulk_call_get_error (call, n) != NULL)
+        num_failed++;
+      g_clear_object (&items[n].object);
+      g_variant_unref (items[n].options);
+    }
+
+  if (num_failed == 0)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (format_data.job), TRUE, "");
+    }
+  else
+    {
+      gchar *message;
+
+      message = g_strdup_printf ("Formatting %u of %u devices failed", num_failed, format_data.num_items);
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (format_data.job), FALSE, message);
+      g_free (message);
+    }
+
+  g_free (items);
+  g_mutex_clear (&format_data.lock);
+  udisks_daemon_util_bulk_call_free (call);
+
+  return ret;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gint
@@ -3547,6 +4245,136 @@ open_device (const gchar      *device,
   return fd;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Amount of data moved per splice() call in the pipe mode of
+ * OpenForBackup() / OpenForRestore()
+ */
+#define IMAGE_SPLICE_SIZE (1 * 1024*1024)
+
+typedef struct
+{
+  gchar *device;
+  gint device_fd;
+  gint pipe_fd;
+  gboolean to_device;
+} ImageSpliceData;
+
+/* Runs in a dedicated thread - moves the data between the device and
+ * the pipe handed out to the client until either side has no more
+ */
+static gpointer
+image_splice_thread_func (gpointer user_data)
+{
+  ImageSpliceData *data = user_data;
+  gint in_fd = data->to_device ? data->pipe_fd : data->device_fd;
+  gint out_fd = data->to_device ? data->device_fd : data->pipe_fd;
+  guint64 pos = 0;
+
+  while (TRUE)
+    {
+      ssize_t num_moved;
+
+      num_moved = splice (in_fd, NULL, out_fd, NULL, IMAGE_SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (num_moved == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          /* the client closing its end of the pipe ends the backup */
+          if (errno != EPIPE || data->to_device)
+            udisks_warning ("Error moving data %s %s: %m", data->to_device ? "to" : "from", data->device);
+          break;
+        }
+      else if (num_moved == 0)
+        {
+          break;
+        }
+
+      /* don't let the image evict everything else from the page cache */
+      posix_fadvise (data->device_fd, pos, num_moved, POSIX_FADV_DONTNEED);
+      pos += num_moved;
+    }
+
+  if (data->to_device && fsync (data->device_fd) != 0)
+    udisks_warning ("Error syncing %s: %m", data->device);
+
+  close (data->device_fd);
+  close (data->pipe_fd);
+  g_free (data->device);
+  g_free (data);
+  return NULL;
+}
+
+/* Opens @device for imaging and applies the options common to
+ * OpenForBackup() and OpenForRestore(). Returns the fd to pass to the
+ * client - either for the device itself or, if the "pipe" option is
+ * set, the client's end of a pipe the daemon splices the device to
+ * or from.
+ */
+static gint
+open_device_for_image (const gchar  *device,
+                       gboolean      to_device,
+                       GVariant     *options,
+                       GError      **error)
+{
+  gboolean opt_direct = FALSE;
+  gboolean opt_sequential = FALSE;
+  gboolean opt_pipe = FALSE;
+  gint flags = O_CLOEXEC | O_EXCL;
+  gint pipe_fds[2];
+  ImageSpliceData *data;
+  gint fd;
+
+  g_variant_lookup (options, "direct", "b", &opt_direct);
+  g_variant_lookup (options, "sequential", "b", &opt_sequential);
+  g_variant_lookup (options, "pipe", "b", &opt_pipe);
+
+  if (to_device)
+    flags |= O_SYNC;
+  /* partially filled pipe buffers don't satisfy the alignment O_DIRECT needs */
+  if (opt_direct && !(opt_pipe && to_device))
+    flags |= O_DIRECT;
+
+  fd = open_device (device, to_device ? "w" : "r", flags, error);
+  if (fd == -1)
+    goto out;
+
+  if (opt_sequential && posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL) != 0)
+    udisks_debug ("Error setting sequential access hint on %s", device);
+
+  if (!opt_pipe)
+    goto out;
+
+  if (pipe2 (pipe_fds, O_CLOEXEC) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error creating pipe: %m");
+      close (fd);
+      fd = -1;
+      goto out;
+    }
+
+  data = g_new0 (ImageSpliceData, 1);
+  data->device = g_strdup (device);
+  data->device_fd = fd;
+  data->to_device = to_device;
+  if (to_device)
+    {
+      data->pipe_fd = pipe_fds[0];
+      fd = pipe_fds[1];
+    }
+  else
+    {
+      data->pipe_fd = pipe_fds[1];
+      fd = pipe_fds[0];
+    }
+  fcntl (fd, F_SETPIPE_SZ, IMAGE_SPLICE_SIZE);
+  g_thread_unref (g_thread_new ("image-splice", image_splice_thread_func, data));
+
+ out:
+  return fd;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 static gboolean
 handle_open_for_backup (UDisksBlock           *block,
@@ -3591,7 +4419,7 @@ handle_open_for_backup (UDisksBlock           *block,
 
   device = udisks_block_get_device (UDISKS_BLOCK (block));
 
-  fd = open_device (device, "r", O_CLOEXEC | O_EXCL, &error);
+  fd = open_device_for_image (device, FALSE, options, &error);
   if (fd == -1)
     {
       g_dbus_method_invocation_take_error (invocation, error);
@@ -3654,7 +4482,7 @@ handle_open_for_restore (UDisksBlock           *block,
 
   device = udisks_block_get_device (UDISKS_BLOCK (block));
 
-  fd = open_device (device, "w", O_SYNC | O_CLOEXEC | O_EXCL, &error);
+  fd = open_device_for_image (device, TRUE, options, &error);
   if (fd == -1)
     {
       g_dbus_method_invocation_take_error (invocation, error);
@@ -3747,6 +4575,209 @@ handle_open_for_benchmark (UDisksBlock           *block,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+handle_benchmark (UDisksBlock           *block,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksObject *object;
+  UDisksDaemon *daemon;
+  UDisksBaseJob *job = NULL;
+  UDisksBenchmarkWorkload workload;
+  const gchar *action_id;
+  const gchar *message;
+  const gchar *device;
+  const gchar *opt_pattern = "sequential";
+  const gchar *opt_mode = "read";
+  GVariant *opt_block_sizes = NULL;
+  GVariant *results = NULL;
+  GError *error = NULL;
+  uid_t caller_uid;
+  guint64 size;
+  gint sector_size = 512;
+  gint fd = -1;
+  guint n;
+
+  object = udisks_daemon_util_dup_object (block, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  memset (&workload, 0, sizeof (workload));
+  workload.queue_depth = 32;
+  workload.duration = 5;
+  g_variant_lookup (options, "pattern", "&s", &opt_pattern);
+  g_variant_lookup (options, "mode", "&s", &opt_mode);
+  g_variant_lookup (options, "queue-depth", "u", &workload.queue_depth);
+  g_variant_lookup (options, "duration", "u", &workload.duration);
+  g_variant_lookup (options, "seed", "u", &workload.seed);
+  opt_block_sizes = g_variant_lookup_value (options, "block-sizes", G_VARIANT_TYPE ("at"));
+
+  if (g_strcmp0 (opt_pattern, "sequential") != 0 && g_strcmp0 (opt_pattern, "random") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "Unknown pattern `%s'", opt_pattern);
+      goto out;
+    }
+  if (g_strcmp0 (opt_mode, "read") != 0 && g_strcmp0 (opt_mode, "write") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "Unknown mode `%s'", opt_mode);
+      goto out;
+    }
+  workload.random = g_strcmp0 (opt_pattern, "random") == 0;
+  workload.write = g_strcmp0 (opt_mode, "write") == 0;
+
+  if (workload.queue_depth < 1 || workload.queue_depth > UDISKS_BENCHMARK_MAX_QUEUE_DEPTH)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "The queue depth must be between 1 and %d",
+                                             UDISKS_BENCHMARK_MAX_QUEUE_DEPTH);
+      goto out;
+    }
+  if (workload.duration < 1 || workload.duration > UDISKS_BENCHMARK_MAX_DURATION)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "The duration must be between 1 and %d seconds",
+                                             UDISKS_BENCHMARK_MAX_DURATION);
+      goto out;
+    }
+
+  if (opt_block_sizes != NULL)
+    {
+      const guint64 *block_sizes;
+      gsize num_block_sizes;
+
+      block_sizes = g_variant_get_fixed_array (opt_block_sizes, &num_block_sizes, sizeof (guint64));
+      if (num_block_sizes < 1 || num_block_sizes > UDISKS_BENCHMARK_MAX_BLOCK_SIZES)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                                 "Between 1 and %d block sizes are supported",
+                                                 UDISKS_BENCHMARK_MAX_BLOCK_SIZES);
+          goto out;
+        }
+      memcpy (workload.block_sizes, block_sizes, num_block_sizes * sizeof (guint64));
+      workload.num_block_sizes = num_block_sizes;
+    }
+  else
+    {
+      workload.block_sizes[0] = 4096;
+      workload.block_sizes[1] = 65536;
+      workload.block_sizes[2] = 1048576;
+      workload.num_block_sizes = 3;
+    }
+
+  if (workload.write)
+    {
+      /* Translators: Shown in authentication dialog when an application
+       * wants to benchmark writing to a device, destroying its data.
+       *
+       * Do not translate $(drive), it's a placeholder and will
+       * be replaced by the name of the drive/device in question
+       */
+      message = N_("Authentication is required to benchmark writing to $(drive)");
+      action_id = "org.freedesktop.udisks2.modify-device";
+      if (udisks_block_get_hint_system (block))
+        action_id = "org.freedesktop.udisks2.modify-device-system";
+    }
+  else
+    {
+      /* Translators: Shown in authentication dialog when an application
+       * wants to benchmark a device.
+       *
+       * Do not translate $(drive), it's a placeholder and will
+       * be replaced by the name of the drive/device in question
+       */
+      message = N_("Authentication is required to open $(drive) for benchmarking");
+      action_id = "org.freedesktop.udisks2.open-device";
+      if (udisks_block_get_hint_system (block))
+        action_id = "org.freedesktop.udisks2.open-device-system";
+    }
+
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    object,
+                                                    action_id,
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  device = udisks_block_get_device (block);
+
+  /* O_DIRECT so that the device and not the page cache is measured */
+  fd = open_device (device, workload.write ? "rw" : "r",
+                    O_DIRECT | O_CLOEXEC | (workload.write ? O_EXCL : 0), &error);
+  if (fd == -1)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (ioctl (fd, BLKGETSIZE64, &size) != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Error doing BLKGETSIZE64 ioctl on %s: %m", device);
+      goto out;
+    }
+  if (ioctl (fd, BLKSSZGET, &sector_size) != 0)
+    udisks_debug ("Error doing BLKSSZGET ioctl on %s, assuming 512 byte sectors: %m", device);
+
+  for (n = 0; n < workload.num_block_sizes; n++)
+    {
+      guint64 block_size = workload.block_sizes[n];
+
+      if (block_size == 0 || block_size % sector_size != 0 ||
+          block_size > UDISKS_BENCHMARK_MAX_BLOCK_SIZE || block_size > size)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                                 "Invalid block size %" G_GUINT64_FORMAT ": must be a multiple of "
+                                                 "the sector size %d of at most %d bytes and not exceed the device size",
+                                                 block_size, sector_size, UDISKS_BENCHMARK_MAX_BLOCK_SIZE);
+          goto out;
+        }
+    }
+
+  job = udisks_daemon_launch_simple_job (daemon, object, "block-benchmark", caller_uid,
+                                         udisks_daemon_util_get_invocation_cancellable (invocation));
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+
+  results = udisks_linux_block_benchmark_run (fd, device, size, &workload, job, &error);
+  if (results == NULL)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_prefix_error (&error, "Error benchmarking %s: ", device);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
+
+  /* the data on the device is gone, let udev probe it again */
+  if (workload.write)
+    udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  udisks_block_complete_benchmark (block, invocation, results);
+
+ out:
+  if (fd != -1)
+    close (fd);
+  if (opt_block_sizes != NULL)
+    g_variant_unref (opt_block_sizes);
+  g_clear_object (&object);
+  return TRUE; /* returning true means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static gboolean
 handle_open_device (UDisksBlock           *block,
                     GDBusMethodInvocation *invocation,
@@ -3877,6 +4908,7 @@ block_iface_init (UDisksBlockIface *iface)
   iface->handle_open_for_backup           = handle_open_for_backup;
   iface->handle_open_for_restore          = handle_open_for_restore;
   iface->handle_open_for_benchmark        = handle_open_for_benchmark;
+  iface->handle_benchmark                 = handle_benchmark;
   iface->handle_open_device               = handle_open_device;
   iface->handle_rescan                    = handle_rescan;
 }
@@ -29,10 +29,64 @@ G_BEGIN_DECLS
 #define UDISKS_LINUX_BLOCK(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_LINUX_BLOCK, UDisksLinuxBlock))
 #define UDISKS_IS_LINUX_BLOCK(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_LINUX_BLOCK))
 
+/**
+ * UDisksLinuxBlockUpdateFlags:
+ * @UDISKS_LINUX_BLOCK_UPDATE_DEVICE: The udev properties or sysfs attributes of the device changed.
+ *   Everything is updated, since all other properties are derived from these.
+ * @UDISKS_LINUX_BLOCK_UPDATE_CONFIGURATION: /etc/fstab or /etc/crypttab changed.
+ * @UDISKS_LINUX_BLOCK_UPDATE_MOUNT_OPTIONS: The userspace mount options in utab changed.
+ * @UDISKS_LINUX_BLOCK_UPDATE_ALL: Update all properties.
+ *
+ * Flags describing which inputs of a #UDisksLinuxBlock changed, see
+ * udisks_linux_block_update_partial().
+ */
+typedef enum
+{
+  UDISKS_LINUX_BLOCK_UPDATE_DEVICE        = (1 << 0),
+  UDISKS_LINUX_BLOCK_UPDATE_CONFIGURATION = (1 << 1),
+  UDISKS_LINUX_BLOCK_UPDATE_MOUNT_OPTIONS = (1 << 2),
+  UDISKS_LINUX_BLOCK_UPDATE_ALL           = 0x07
+} UDisksLinuxBlockUpdateFlags;
+
+typedef struct
+{
+  /*< private >*/
+  gint ref_count;
+  /*< public >*/
+  gchar *device;
+  gchar *preferred_device;
+  gchar **symlinks;
+  guint64 device_number;
+  guint64 size;
+  gboolean read_only;
+  gchar *drive;
+  gchar *crypto_backing_device;
+  gchar *id_usage;
+  gchar *id_type;
+  gchar *id_version;
+  gchar *id_label;
+  gchar *id_uuid;
+  gboolean hint_system;
+  gboolean hint_ignore;
+  gboolean hint_auto;
+  gchar *hint_name;
+} UDisksLinuxBlockSnapshot;
+
 GType        udisks_linux_block_get_type (void) G_GNUC_CONST;
 UDisksBlock *udisks_linux_block_new      (void);
 void         udisks_linux_block_update   (UDisksLinuxBlock       *block,
                                           UDisksLinuxBlockObject *object);
+void         udisks_linux_block_update_configuration (UDisksLinuxBlock       *block,
+                                                      UDisksLinuxBlockObject *object);
+void         udisks_linux_block_update_partial (UDisksLinuxBlock            *block,
+                                                UDisksLinuxBlockObject      *object,
+                                                UDisksLinuxBlockUpdateFlags  flags);
+UDisksLinuxBlockSnapshot *udisks_linux_block_get_snapshot    (UDisksLinuxBlock         *block);
+UDisksLinuxBlockSnapshot *udisks_linux_block_snapshot_ref   (UDisksLinuxBlockSnapshot *snapshot);
+void                      udisks_linux_block_snapshot_unref (UDisksLinuxBlockSnapshot *snapshot);
+
+GList       *udisks_linux_block_find_fstab_entries   (UDisksLinuxBlock       *block,
+                                                      UDisksDaemon           *daemon);
 
 void         udisks_linux_block_handle_format (UDisksBlock            *block,
                                                GDBusMethodInvocation  *invocation,
@@ -40,6 +94,11 @@ void         udisks_linux_block_handle_format (UDisksBlock            *block,
                                                GVariant               *options,
                                                void                  (*complete)(gpointer user_data),
                                                gpointer                complete_user_data);
+GVariant    *udisks_linux_block_format_many   (UDisksDaemon           *daemon,
+                                               GDBusMethodInvocation  *invocation,
+                                               GVariant               *devices,
+                                               GVariant               *options,
+                                               GError                **error);
 
 gchar       *udisks_linux_get_parent_for_tracking (UDisksDaemon *daemon,
                                                    const gchar    *path,
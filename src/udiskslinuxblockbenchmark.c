@@ -0,0 +1,431 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <aio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "udiskslogging.h"
+#include "udiskslinuxblockbenchmark.h"
+#include "udisksbasejob.h"
+
+/* Latencies are counted in a log-linear histogram: values below
+ * 2^LATENCY_SUB_BITS usec have a bucket each, every power of two above
+ * that is split into 2^LATENCY_SUB_BITS buckets. This keeps the
+ * percentiles within about 6% whatever the number of requests.
+ */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_NUM_BUCKETS (64 << LATENCY_SUB_BITS)
+
+typedef struct
+{
+  guint64 counts[LATENCY_NUM_BUCKETS];
+  guint64 num;
+  guint64 sum;
+  guint64 min;
+  guint64 max;
+} LatencyHistogram;
+
+static guint
+latency_bucket (guint64 usec)
+{
+  guint msb;
+
+  if (usec < (1 << LATENCY_SUB_BITS))
+    return usec;
+  msb = g_bit_storage (usec) - 1;
+  return ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) |
+    ((usec >> (msb - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+/* the smallest latency counted in @bucket */
+static guint64
+latency_bucket_start (guint bucket)
+{
+  guint group = bucket >> LATENCY_SUB_BITS;
+  guint64 sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+
+  if (group == 0)
+    return sub;
+  return ((1 << LATENCY_SUB_BITS) + sub) << (group - 1);
+}
+
+static void
+latency_histogram_add (LatencyHistogram *histogram,
+                       guint64           usec)
+{
+  histogram->counts[latency_bucket (usec)]++;
+  if (histogram->num == 0 || usec < histogram->min)
+    histogram->min = usec;
+  if (usec > histogram->max)
+    histogram->max = usec;
+  histogram->num++;
+  histogram->sum += usec;
+}
+
+/* Gets the latency @percentile percent of the requests completed within */
+static guint64
+latency_histogram_get_percentile (LatencyHistogram *histogram,
+                                  gdouble           percentile)
+{
+  guint64 wanted;
+  guint64 seen = 0;
+  guint n;
+
+  if (histogram->num == 0)
+    return 0;
+
+  wanted = (guint64) (histogram->num * percentile / 100.0 + 0.5);
+  wanted = CLAMP (wanted, 1, histogram->num);
+  for (n = 0; n < LATENCY_NUM_BUCKETS; n++)
+    {
+      seen += histogram->counts[n];
+      if (seen >= wanted)
+        return MIN (latency_bucket_start (n + 1) - 1, histogram->max);
+    }
+
+  return histogram->max;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  const gchar *device_file;
+  guint64 size;
+  const UDisksBenchmarkWorkload *workload;
+  UDisksBaseJob *job;
+  GRand *rand;
+
+  /* One slot per request in flight. glibc processes the POSIX AIO
+   * requests on the same file descriptor one after the other, so each
+   * slot gets a descriptor of its own to keep queue_depth requests
+   * actually in flight on the device. */
+  gint *fds;
+  guchar **bufs;
+  struct aiocb *cbs;
+  gint64 *submit_usec;
+  gboolean *in_flight;
+  guint num_in_flight;
+} Benchmark;
+
+/* Waits for all the requests in flight to finish, used when bailing out */
+static void
+drain_benchmark_requests (Benchmark *benchmark)
+{
+  guint n;
+
+  for (n = 0; n < benchmark->workload->queue_depth; n++)
+    {
+      struct aiocb *cb = &benchmark->cbs[n];
+      const struct aiocb *list[1] = {cb};
+
+      if (!benchmark->in_flight[n])
+        continue;
+      aio_cancel (benchmark->fds[n], cb);
+      while (aio_error (cb) == EINPROGRESS)
+        aio_suspend (list, 1, NULL);
+      aio_return (cb);
+      benchmark->in_flight[n] = FALSE;
+    }
+  benchmark->num_in_flight = 0;
+}
+
+/* Runs the workload with @block_size for the configured duration, pass
+ * @pass of the sweep, and adds its results to @builder */
+static gboolean
+run_benchmark_pass (Benchmark        *benchmark,
+                    guint64           block_size,
+                    guint             pass,
+                    GVariantBuilder  *builder,
+                    GError          **error)
+{
+  const UDisksBenchmarkWorkload *workload = benchmark->workload;
+  GCancellable *cancellable = udisks_base_job_get_cancellable (benchmark->job);
+  LatencyHistogram *histogram;
+  const struct aiocb **list;
+  guint64 num_blocks;
+  guint64 next_offset = 0;
+  guint64 num_bytes = 0;
+  gint64 start_usec;
+  gint64 deadline_usec;
+  gint64 time_of_last_signal;
+  gint64 elapsed;
+  gboolean ret = FALSE;
+  guint n;
+
+  num_blocks = benchmark->size / block_size;
+  if (num_blocks == 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "The device %s is smaller than the block size %" G_GUINT64_FORMAT,
+                   benchmark->device_file, block_size);
+      return FALSE;
+    }
+
+  histogram = g_new0 (LatencyHistogram, 1);
+  list = g_new0 (const struct aiocb *, workload->queue_depth);
+
+  start_usec = time_of_last_signal = g_get_monotonic_time ();
+  deadline_usec = start_usec + (gint64) workload->duration * G_USEC_PER_SEC;
+  while (TRUE)
+    {
+      gint64 now = g_get_monotonic_time ();
+      guint num_listed = 0;
+
+      /* keep the queue full until the time is up */
+      for (n = 0; n < workload->queue_depth && now < deadline_usec; n++)
+        {
+          struct aiocb *cb = &benchmark->cbs[n];
+          guint64 offset;
+
+          if (benchmark->in_flight[n])
+            continue;
+
+          if (workload->random)
+            {
+              offset = (guint64) (g_rand_double (benchmark->rand) * num_blocks);
+              offset = MIN (offset, num_blocks - 1) * block_size;
+            }
+          else
+            {
+              /* start over at the beginning of the device */
+              if (next_offset + block_size > benchmark->size)
+                next_offset = 0;
+              offset = next_offset;
+              next_offset += block_size;
+            }
+
+          memset (cb, 0, sizeof (struct aiocb));
+          cb->aio_fildes = benchmark->fds[n];
+          cb->aio_buf = benchmark->bufs[n];
+          cb->aio_nbytes = block_size;
+          cb->aio_offset = offset;
+          benchmark->submit_usec[n] = g_get_monotonic_time ();
+          if ((workload->write ? aio_write (cb) : aio_read (cb)) != 0)
+            {
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Error queuing %s of %" G_GUINT64_FORMAT " bytes on %s: %m",
+                           workload->write ? "write" : "read", block_size, benchmark->device_file);
+              goto out;
+            }
+          benchmark->in_flight[n] = TRUE;
+          benchmark->num_in_flight++;
+        }
+
+      if (benchmark->num_in_flight == 0)
+        break;
+
+      for (n = 0; n < workload->queue_depth; n++)
+        if (benchmark->in_flight[n])
+          list[num_listed++] = &benchmark->cbs[n];
+      aio_suspend (list, num_listed, NULL);
+
+      now = g_get_monotonic_time ();
+      for (n = 0; n < workload->queue_depth; n++)
+        {
+          struct aiocb *cb = &benchmark->cbs[n];
+          ssize_t num_done;
+          gint rc;
+
+          if (!benchmark->in_flight[n] || (rc = aio_error (cb)) == EINPROGRESS)
+            continue;
+          num_done = aio_return (cb);
+          benchmark->in_flight[n] = FALSE;
+          benchmark->num_in_flight--;
+          if (rc != 0 || num_done != (ssize_t) block_size)
+            {
+              errno = rc != 0 ? rc : EIO;
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Error %s %" G_GUINT64_FORMAT " bytes at offset %" G_GUINT64_FORMAT " on %s: %m",
+                           workload->write ? "writing" : "reading",
+                           block_size, (guint64) cb->aio_offset, benchmark->device_file);
+              goto out;
+            }
+          latency_histogram_add (histogram, now - benchmark->submit_usec[n]);
+          num_bytes += block_size;
+        }
+
+      if (g_cancellable_is_cancelled (cancellable))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                       "Job was canceled");
+          goto out;
+        }
+
+      /* only emit D-Bus signal at most once a second */
+      if (now - time_of_last_signal > G_USEC_PER_SEC)
+        {
+          elapsed = MIN (now - start_usec, (gint64) workload->duration * G_USEC_PER_SEC);
+          udisks_job_set_progress (UDISKS_JOB (benchmark->job),
+                                   (pass + (gdouble) elapsed / (workload->duration * G_USEC_PER_SEC)) /
+                                   workload->num_block_sizes);
+          udisks_job_set_rate (UDISKS_JOB (benchmark->job),
+                               (guint64) (num_bytes * (gdouble) G_USEC_PER_SEC / MAX (now - start_usec, 1)));
+          time_of_last_signal = now;
+        }
+    }
+
+  elapsed = MAX (g_get_monotonic_time () - start_usec, 1);
+  g_variant_builder_open (builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (builder, "{sv}", "block-size", g_variant_new_uint64 (block_size));
+  g_variant_builder_add (builder, "{sv}", "operations", g_variant_new_uint64 (histogram->num));
+  g_variant_builder_add (builder, "{sv}", "bytes", g_variant_new_uint64 (num_bytes));
+  g_variant_builder_add (builder, "{sv}", "duration", g_variant_new_uint64 (elapsed));
+  g_variant_builder_add (builder, "{sv}", "throughput",
+                         g_variant_new_double (num_bytes * (gdouble) G_USEC_PER_SEC / elapsed));
+  g_variant_builder_add (builder, "{sv}", "iops",
+                         g_variant_new_double (histogram->num * (gdouble) G_USEC_PER_SEC / elapsed));
+  g_variant_builder_add (builder, "{sv}", "latency-min", g_variant_new_uint64 (histogram->min));
+  g_variant_builder_add (builder, "{sv}", "latency-mean",
+                         g_variant_new_uint64 (histogram->num > 0 ? histogram->sum / histogram->num : 0));
+  g_variant_builder_add (builder, "{sv}", "latency-p50", g_variant_new_uint64 (latency_histogram_get_percentile (histogram, 50.0)));
+  g_variant_builder_add (builder, "{sv}", "latency-p90", g_variant_new_uint64 (latency_histogram_get_percentile (histogram, 90.0)));
+  g_variant_builder_add (builder, "{sv}", "latency-p99", g_variant_new_uint64 (latency_histogram_get_percentile (histogram, 99.0)));
+  g_variant_builder_add (builder, "{sv}", "latency-p999", g_variant_new_uint64 (latency_histogram_get_percentile (histogram, 99.9)));
+  g_variant_builder_add (builder, "{sv}", "latency-max", g_variant_new_uint64 (histogram->max));
+  g_variant_builder_close (builder);
+
+  udisks_debug ("Benchmarked %s with %" G_GUINT64_FORMAT " byte blocks: %" G_GUINT64_FORMAT " operations in %" G_GINT64_FORMAT " usec",
+                benchmark->device_file, block_size, histogram->num, elapsed);
+
+  ret = TRUE;
+
+ out:
+  drain_benchmark_requests (benchmark);
+  g_free (list);
+  g_free (histogram);
+  return ret;
+}
+
+/**
+ * udisks_linux_block_benchmark_run:
+ * @fd: A file descriptor for the device, opened with <literal>O_DIRECT</literal>.
+ * @device_file: The device file, for error messages.
+ * @size: The size of the device.
+ * @workload: The workload to run.
+ * @job: The job to report progress on and to check for cancellation.
+ * @error: Return location for error or %NULL.
+ *
+ * Runs @workload on @fd for every block size of the sweep, keeping
+ * the configured number of requests in flight with POSIX AIO. Blocks
+ * the calling thread until done.
+ *
+ * Returns: A floating #GVariant of type <literal>aa{sv}</literal> with
+ *   the results for each block size or %NULL if @error is set.
+ */
+GVariant *
+udisks_linux_block_benchmark_run (gint                           fd,
+                                  const gchar                   *device_file,
+                                  guint64                        size,
+                                  const UDisksBenchmarkWorkload *workload,
+                                  UDisksBaseJob                 *job,
+                                  GError                       **error)
+{
+  Benchmark benchmark;
+  GVariantBuilder builder;
+  GVariant *ret = NULL;
+  guint64 max_block_size = 0;
+  guint n;
+
+  g_return_val_if_fail (workload->queue_depth > 0 && workload->queue_depth <= UDISKS_BENCHMARK_MAX_QUEUE_DEPTH, NULL);
+
+  for (n = 0; n < workload->num_block_sizes; n++)
+    max_block_size = MAX (max_block_size, workload->block_sizes[n]);
+
+  memset (&benchmark, 0, sizeof (benchmark));
+  benchmark.device_file = device_file;
+  benchmark.size = size;
+  benchmark.workload = workload;
+  benchmark.job = job;
+  /* the same seed gives the same offsets and data, for repeatable runs */
+  benchmark.rand = g_rand_new_with_seed (workload->seed);
+  benchmark.fds = g_new (gint, workload->queue_depth);
+  benchmark.bufs = g_new0 (guchar *, workload->queue_depth);
+  benchmark.cbs = g_new0 (struct aiocb, workload->queue_depth);
+  benchmark.submit_usec = g_new0 (gint64, workload->queue_depth);
+  benchmark.in_flight = g_new0 (gboolean, workload->queue_depth);
+  for (n = 0; n < workload->queue_depth; n++)
+    benchmark.fds[n] = -1;
+
+  for (n = 0; n < workload->queue_depth; n++)
+    {
+      benchmark.fds[n] = dup (fd);
+      if (benchmark.fds[n] == -1)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error duplicating the file descriptor for %s: %m", device_file);
+          goto out;
+        }
+      if (posix_memalign ((void **) &benchmark.bufs[n], 4096, max_block_size) != 0)
+        {
+          benchmark.bufs[n] = NULL;
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error allocating memory for benchmarking %s", device_file);
+          goto out;
+        }
+      /* random data so compressing or deduplicating devices can't cheat */
+      if (workload->write)
+        {
+          guint64 m;
+          for (m = 0; m < max_block_size; m += sizeof (guint32))
+            *((guint32 *) (benchmark.bufs[n] + m)) = g_rand_int (benchmark.rand);
+        }
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+  for (n = 0; n < workload->num_block_sizes; n++)
+    {
+      if (!run_benchmark_pass (&benchmark, workload->block_sizes[n], n, &builder, error))
+        {
+          g_variant_builder_clear (&builder);
+          goto out;
+        }
+    }
+
+  if (workload->write && fsync (fd) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error syncing %s: %m", device_file);
+      g_variant_builder_clear (&builder);
+      goto out;
+    }
+
+  ret = g_variant_builder_end (&builder);
+
+ out:
+  for (n = 0; n < workload->queue_depth; n++)
+    {
+      if (benchmark.fds[n] != -1)
+        close (benchmark.fds[n]);
+      free (benchmark.bufs[n]);
+    }
+  g_free (benchmark.in_flight);
+  g_free (benchmark.submit_usec);
+  g_free (benchmark.cbs);
+  g_free (benchmark.bufs);
+  g_free (benchmark.fds);
+  g_rand_free (benchmark.rand);
+  return ret;
+}
@@ -0,0 +1,55 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_LINUX_BLOCK_BENCHMARK_H__
+#define __UDISKS_LINUX_BLOCK_BENCHMARK_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+/* limits of the options of Block.Benchmark() */
+#define UDISKS_BENCHMARK_MAX_BLOCK_SIZES 16
+#define UDISKS_BENCHMARK_MAX_BLOCK_SIZE (16 * 1024 * 1024)
+#define UDISKS_BENCHMARK_MAX_QUEUE_DEPTH 128
+#define UDISKS_BENCHMARK_MAX_DURATION 600
+
+typedef struct
+{
+  gboolean random;
+  gboolean write;
+  guint64 block_sizes[UDISKS_BENCHMARK_MAX_BLOCK_SIZES];
+  guint num_block_sizes;
+  guint queue_depth;
+  /* seconds per block size */
+  guint duration;
+  guint32 seed;
+} UDisksBenchmarkWorkload;
+
+GVariant *udisks_linux_block_benchmark_run (gint                           fd,
+                                            const gchar                   *device_file,
+                                            guint64                        size,
+                                            const UDisksBenchmarkWorkload *workload,
+                                            UDisksBaseJob                 *job,
+                                            GError                       **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_LINUX_BLOCK_BENCHMARK_H__ */
@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -31,8 +32,10 @@
 #include <mntent.h>
 
 #include <sys/ioctl.h>
+#include <sys/utsname.h>
 #include <linux/fs.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <glib/gstdio.h>
@@ -52,6 +55,8 @@
 #include "udiskslinuxencrypted.h"
 #include "udiskslinuxswapspace.h"
 #include "udiskslinuxloop.h"
+#include "udiskslinuxblockzoned.h"
+#include "udiskslinuxblockqueue.h"
 #include "udiskslinuxprovider.h"
 #include "udisksfstabmonitor.h"
 #include "udisksfstabentry.h"
@@ -59,6 +64,9 @@
 #include "udiskscrypttabentry.h"
 #include "udiskslinuxdevice.h"
 #include "udisksmodulemanager.h"
+#include "udisksconfigmanager.h"
+#include "udisksmetrics.h"
+#include "udiskstrace.h"
 
 #include <modules/udisksmoduleifacetypes.h>
 
@@ -84,6 +92,8 @@ struct _UDisksLinuxBlockObject
 
   UDisksDaemon *daemon;
   UDisksMountMonitor *mount_monitor;
+  /* device number the mount monitor watch was added for */
+  dev_t mount_watch_dev;
 
   UDisksLinuxDevice *device;
   GMutex device_mutex;
@@ -96,7 +106,17 @@ struct _UDisksLinuxBlockObject
   UDisksSwapspace *iface_swapspace;
   UDisksEncrypted *iface_encrypted;
   UDisksLoop *iface_loop;
+  UDisksBlockZoned *iface_block_zoned;
+  UDisksBlockQueue *iface_block_queue;
   GHashTable *module_ifaces;
+
+  /* whether only the Block interface is exported, see udisks_linux_device_is_passive() */
+  gboolean minimal;
+
+  /* the UeventWaiter structs of udisks_linux_block_object_trigger_uevent_sync() */
+  GMutex uevent_wait_lock;
+  GCond uevent_wait_cond;
+  GSList *uevent_waiters;
 };
 
 struct _UDisksLinuxBlockObjectClass
@@ -110,6 +130,7 @@ typedef struct
   UDisksObjectHasInterfaceFunc has_func;
   UDisksObjectConnectInterfaceFunc connect_func;
   UDisksObjectUpdateInterfaceFunc update_func;
+  UDisksModuleInterfaceMatch *match;
 } ModuleInterfaceEntry;
 
 enum
@@ -121,12 +142,10 @@ enum
 
 G_DEFINE_TYPE (UDisksLinuxBlockObject, udisks_linux_block_object, UDISKS_TYPE_OBJECT_SKELETON);
 
-static void on_mount_monitor_mount_added   (UDisksMountMonitor  *monitor,
-                                            UDisksMount         *mount,
-                                            gpointer             user_data);
-static void on_mount_monitor_mount_removed (UDisksMountMonitor  *monitor,
-                                            UDisksMount         *mount,
-                                            gpointer             user_data);
+static void on_mount_monitor_dev_changed (UDisksMountMonitor  *monitor,
+                                         UDisksMount         *mount,
+                                         gboolean             added,
+                                         gpointer             user_data);
 
 static void
 udisks_linux_block_object_finalize (GObject *_object)
@@ -134,11 +153,13 @@ udisks_linux_block_object_finalize (GObject *_object)
   UDisksLinuxBlockObject *object = UDISKS_LINUX_BLOCK_OBJECT (_object);
 
   /* note: we don't hold a ref to block->daemon or block->mount_monitor */
-  g_signal_handlers_disconnect_by_func (object->mount_monitor, on_mount_monitor_mount_added, object);
-  g_signal_handlers_disconnect_by_func (object->mount_monitor, on_mount_monitor_mount_removed, object);
+  udisks_mount_monitor_remove_dev_watch (object->mount_monitor, object->mount_watch_dev,
+                                         on_mount_monitor_dev_changed, object);
 
   g_object_unref (object->device);
   g_mutex_clear (&object->device_mutex);
+  g_mutex_clear (&object->uevent_wait_lock);
+  g_cond_clear (&object->uevent_wait_cond);
 
   if (object->iface_block_device != NULL)
     g_object_unref (object->iface_block_device);
@@ -154,6 +175,10 @@ udisks_linux_block_object_finalize (GObject *_object)
     g_object_unref (object->iface_encrypted);
   if (object->iface_loop != NULL)
     g_object_unref (object->iface_loop);
+  if (object->iface_block_zoned != NULL)
+    g_object_unref (object->iface_block_zoned);
+  if (object->iface_block_queue != NULL)
+    g_object_unref (object->iface_block_queue);
   if (object->module_ifaces != NULL)
     g_hash_table_destroy (object->module_ifaces);
 
@@ -227,16 +252,14 @@ udisks_linux_block_object_constructed (GObject *_object)
   UDisksPartition *partition = NULL;
 
   g_mutex_init (&object->device_mutex);
+  g_mutex_init (&object->uevent_wait_lock);
+  g_cond_init (&object->uevent_wait_cond);
 
+  /* only get notified about mount changes of our own device */
   object->mount_monitor = udisks_daemon_get_mount_monitor (object->daemon);
-  g_signal_connect (object->mount_monitor,
-                    "mount-added",
-                    G_CALLBACK (on_mount_monitor_mount_added),
-                    object);
-  g_signal_connect (object->mount_monitor,
-                    "mount-removed",
-                    G_CALLBACK (on_mount_monitor_mount_removed),
-                    object);
+  object->mount_watch_dev = g_udev_device_get_device_number (object->device->udev_device);
+  udisks_mount_monitor_add_dev_watch (object->mount_monitor, object->mount_watch_dev,
+                                      on_mount_monitor_dev_changed, object);
 
   /* initial coldplug */
   udisks_linux_block_object_uevent (object, "add", NULL);
@@ -251,12 +274,13 @@ udisks_linux_block_object_constructed (GObject *_object)
   if (block && g_strcmp0 (udisks_block_get_crypto_backing_device (block), "/") != 0)
     udisks_linux_block_object_uevent (object, "change", NULL);
 
-  /* run update for partitions again -- it sets the "Partitions" property
-   * on the PartitionTable interface and we need the object path for that
+  /* run update for the partition again -- it adds the partition to the
+   * PartitionTable interface and we need the object path for that, the
+   * other interfaces don't need to be updated again
    */
   partition = udisks_object_peek_partition (UDISKS_OBJECT (object));
   if (partition)
-    udisks_linux_block_object_uevent (object, "change", NULL);
+    udisks_linux_partition_update (UDISKS_LINUX_PARTITION (partition), object);
 
   if (G_OBJECT_CLASS (udisks_linux_block_object_parent_class)->constructed != NULL)
     G_OBJECT_CLASS (udisks_linux_block_object_parent_class)->constructed (_object);
@@ -441,13 +465,33 @@ update_iface (UDisksObject                     *object,
 
   if (*interface_pointer != NULL)
     {
+      gint64 start_time;
+
+      UDISKS_TRACE2 (update_iface_start,
+                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                     g_type_name (skeleton_type));
+      start_time = g_get_monotonic_time ();
       update_func (object, uevent_action, G_DBUS_INTERFACE (*interface_pointer));
+      udisks_metrics_record (udisks_daemon_get_metrics (UDISKS_LINUX_BLOCK_OBJECT (object)->daemon),
+                             UDISKS_METRICS_KIND_UPDATE,
+                             g_type_name (skeleton_type),
+                             g_get_monotonic_time () - start_time);
+      UDISKS_TRACE2 (update_iface_done,
+                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                     g_type_name (skeleton_type));
       if (add)
         g_dbus_object_skeleton_add_interface (G_DBUS_OBJECT_SKELETON (object),
                                               G_DBUS_INTERFACE_SKELETON (*interface_pointer));
     }
 }
 
+/* has_func for removing all interfaces but Block from minimal objects */
+static gboolean
+minimal_check (UDisksObject *object)
+{
+  return FALSE;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 /* org.freedesktop.UDisks2.Block */
 
@@ -467,6 +511,11 @@ block_device_update (UDisksObject   *object,
                      const gchar    *uevent_action,
                      GDBusInterface *_iface)
 {
+  /* without an action the object is only updated for a mount change and
+   * none of the Block properties depends on the mounts */
+  if (uevent_action == NULL)
+    return FALSE;
+
   udisks_linux_block_update (UDISKS_LINUX_BLOCK (_iface), UDISKS_LINUX_BLOCK_OBJECT (object));
   return TRUE;
 }
@@ -820,6 +869,54 @@ loop_update (UDisksObject   *object,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+block_zoned_check (UDisksObject *object)
+{
+  UDisksLinuxBlockObject *block_object = UDISKS_LINUX_BLOCK_OBJECT (object);
+
+  return udisks_linux_block_zoned_is_zoned (block_object->device);
+}
+
+static void
+block_zoned_connect (UDisksObject *object)
+{
+}
+
+static gboolean
+block_zoned_update (UDisksObject   *object,
+                    const gchar    *uevent_action,
+                    GDBusInterface *_iface)
+{
+  udisks_linux_block_zoned_update (UDISKS_LINUX_BLOCK_ZONED (_iface), UDISKS_LINUX_BLOCK_OBJECT (object));
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+block_queue_check (UDisksObject *object)
+{
+  UDisksLinuxBlockObject *block_object = UDISKS_LINUX_BLOCK_OBJECT (object);
+
+  return udisks_linux_block_queue_has_queue (block_object->device);
+}
+
+static void
+block_queue_connect (UDisksObject *object)
+{
+}
+
+static gboolean
+block_queue_update (UDisksObject   *object,
+                    const gchar    *uevent_action,
+                    GDBusInterface *_iface)
+{
+  udisks_linux_block_queue_update (UDISKS_LINUX_BLOCK_QUEUE (_iface), UDISKS_LINUX_BLOCK_OBJECT (object));
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 free_module_interface_entry (ModuleInterfaceEntry *entry)
 {
@@ -836,28 +933,204 @@ ensure_module_ifaces (UDisksLinuxBlockObject *object,
   ModuleInterfaceEntry *entry;
   UDisksModuleInterfaceInfo *ii;
 
-  /* Assume all modules are either unloaded or loaded at the same time, so don't regenerate entries */
   if (object->module_ifaces == NULL)
+    object->module_ifaces = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_module_interface_entry);
+
+  /* Modules are loaded one by one but never unloaded separately, so only
+   * the entries of the modules loaded since the last call are missing */
+  l = udisks_module_manager_get_block_object_iface_infos (module_manager);
+  if (g_hash_table_size (object->module_ifaces) == g_list_length (l))
+    return;
+
+  for (; l; l = l->next)
+    {
+      ii = l->data;
+      if (g_hash_table_contains (object->module_ifaces, GSIZE_TO_POINTER (ii->skeleton_type)))
+        continue;
+      entry = g_new0 (ModuleInterfaceEntry, 1);
+      entry->has_func = ii->has_func;
+      entry->connect_func = ii->connect_func;
+      entry->update_func = ii->update_func;
+      entry->match = udisks_module_manager_get_block_object_iface_match (module_manager, ii->skeleton_type);
+      g_hash_table_replace (object->module_ifaces, GSIZE_TO_POINTER (ii->skeleton_type), entry);
+    }
+}
+
+static gboolean
+strv_has_prefix_of (const gchar * const *prefixes,
+                    const gchar         *str)
+{
+  const gchar * const *p;
+
+  if (prefixes == NULL || str == NULL)
+    return FALSE;
+  for (p = prefixes; *p != NULL; p++)
+    if (g_str_has_prefix (str, *p))
+      return TRUE;
+  return FALSE;
+}
+
+/* Evaluates the cheap predicate keys of a module interface, see #UDisksModuleInterfaceMatch */
+static gboolean
+module_iface_may_match (UDisksModuleInterfaceMatch *match,
+                        UDisksLinuxDevice          *device)
+{
+  const gchar *fs_type;
+
+  if (match == NULL)
+    return TRUE;
+
+  if (match->fs_types != NULL)
     {
-      object->module_ifaces = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_module_interface_entry);
+      fs_type = g_udev_device_get_property (device->udev_device, "ID_FS_TYPE");
+      if (fs_type != NULL && g_strv_contains (match->fs_types, fs_type))
+        return TRUE;
+    }
+
+  if (strv_has_prefix_of (match->dm_uuid_prefixes,
+                          g_udev_device_get_property (device->udev_device, "DM_UUID")))
+    return TRUE;
+
+  if (strv_has_prefix_of (match->device_file_prefixes,
+                          g_udev_device_get_device_file (device->udev_device)))
+    return TRUE;
+
+  if (match->major != 0 &&
+      major (g_udev_device_get_device_number (device->udev_device)) == match->major)
+    return TRUE;
+
+  return FALSE;
+}
+
+static void
+update_module_ifaces (UDisksLinuxBlockObject *object,
+                      const gchar            *action)
+{
+  UDisksModuleManager *module_manager;
+  GHashTableIter iter;
+  gpointer key;
+  ModuleInterfaceEntry *entry;
+  UDisksLinuxDevice *device;
 
-      l = udisks_module_manager_get_block_object_iface_infos (module_manager);
-      for (; l; l = l->next)
+  if (object->minimal)
+    {
+      /* remove the interfaces exported before the device became passive */
+      if (object->module_ifaces != NULL)
         {
-          ii = l->data;
-          entry = g_new0 (ModuleInterfaceEntry, 1);
-          entry->has_func = ii->has_func;
-          entry->connect_func = ii->connect_func;
-          entry->update_func = ii->update_func;
-          g_hash_table_replace (object->module_ifaces, GSIZE_TO_POINTER (ii->skeleton_type), entry);
+          g_hash_table_iter_init (&iter, object->module_ifaces);
+          while (g_hash_table_iter_next (&iter, &key, (gpointer *) &entry))
+            if (entry->interface != NULL)
+              update_iface (UDISKS_OBJECT (object), action, minimal_check, entry->connect_func, entry->update_func,
+                            (GType) key, &entry->interface);
         }
+      return;
+    }
+
+  module_manager = udisks_daemon_get_module_manager (object->daemon);
+  if (udisks_module_manager_get_modules_available (module_manager))
+    {
+      ensure_module_ifaces (object, module_manager);
+      device = udisks_linux_block_object_get_device (object);
+      g_hash_table_iter_init (&iter, object->module_ifaces);
+      while (g_hash_table_iter_next (&iter, &key, (gpointer *) &entry))
+        {
+          /* Interfaces already exported are always updated so that has_func
+           * gets the chance to remove them */
+          if (entry->interface == NULL && ! module_iface_may_match (entry->match, device))
+            continue;
+          update_iface (UDISKS_OBJECT (object), action, entry->has_func, entry->connect_func, entry->update_func,
+                        (GType) key, &entry->interface);
+        }
+      g_object_unref (device);
     }
 }
 
 /**
- * udisks_linux_block_object_uevent:
+ * udisks_linux_block_object_update_module_ifaces:
  * @object: A #UDisksLinuxBlockObject.
  * @action: Uevent action or %NULL
+ *
+ * Updates only the interfaces from modules on @object, using the
+ * #UDisksLinuxDevice already attached to it. This is used to attach
+ * the interfaces of newly loaded modules without probing the device
+ * again.
+ */
+void
+udisks_linux_block_object_update_module_ifaces (UDisksLinuxBlockObject *object,
+                                                const gchar            *action)
+{
+  g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
+
+  update_module_ifaces (object, action);
+}
+
+typedef struct
+{
+  UDisksLinuxBlockObject *object;
+  gchar *action;
+  gchar *synth_uuid;
+} ModuleIfacesUpdate;
+
+static void
+module_ifaces_update_free (ModuleIfacesUpdate *update)
+{
+  g_object_unref (update->object);
+  g_free (update->action);
+  g_free (update->synth_uuid);
+  g_free (update);
+}
+
+static void uevent_processed (UDisksLinuxBlockObject *object,
+                              const gchar            *synth_uuid);
+
+/* called in the main thread, see udisks_linux_provider_invoke_for_modules() */
+static gboolean
+on_update_module_ifaces (gpointer user_data)
+{
+  ModuleIfacesUpdate *update = user_data;
+
+  update_module_ifaces (update->object, update->action);
+  /* waiters expect the interfaces from modules to be up to date too */
+  uevent_processed (update->object, update->synth_uuid);
+
+  return G_SOURCE_REMOVE;
+}
+
+typedef struct
+{
+  const gchar *uuid;
+  gboolean received;
+} UeventWaiter;
+
+/* wakes up the udisks_linux_block_object_trigger_uevent_sync() call waiting
+ * for the uevent with @synth_uuid, if any */
+static void
+uevent_processed (UDisksLinuxBlockObject *object,
+                  const gchar            *synth_uuid)
+{
+  GSList *l;
+
+  if (synth_uuid == NULL)
+    return;
+
+  g_mutex_lock (&object->uevent_wait_lock);
+  for (l = object->uevent_waiters; l != NULL; l = l->next)
+    {
+      UeventWaiter *waiter = l->data;
+
+      if (g_strcmp0 (waiter->uuid, synth_uuid) == 0)
+        {
+          waiter->received = TRUE;
+          g_cond_broadcast (&object->uevent_wait_cond);
+        }
+    }
+  g_mutex_unlock (&object->uevent_wait_lock);
+}
+
+/**
+ * udisks_linux_block_object_uevent:
+ * @object: A #UDisksLinuxBlockObject.
+ * @action: Uevent action or %NULL if only the mounts of the device changed.
  * @device: A new #UDisksLinuxDevice device object or %NULL if the device hasn't changed.
  *
  * Updates all information on interfaces on @object.
@@ -867,10 +1140,7 @@ udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
                                   const gchar            *action,
                                   UDisksLinuxDevice      *device)
 {
-  UDisksModuleManager *module_manager;
-  GHashTableIter iter;
-  gpointer key;
-  ModuleInterfaceEntry *entry;
+  ModuleIfacesUpdate *update;
 
   g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
   g_return_if_fail (device == NULL || UDISKS_IS_LINUX_DEVICE (device));
@@ -884,80 +1154,96 @@ udisks_linux_block_object_uevent (UDisksLinuxBlockObject *object,
       g_object_notify (G_OBJECT (object), "device");
     }
 
+  /* the device may become passive or stop being passive on any uevent */
+  object->minimal = udisks_config_manager_get_passive_devices (udisks_daemon_get_config_manager (object->daemon))
+                      == UDISKS_PASSIVE_DEVICES_MINIMAL &&
+                    udisks_linux_device_is_passive (object->device);
+
   update_iface (UDISKS_OBJECT (object), action, block_device_check, block_device_connect, block_device_update,
                 UDISKS_TYPE_LINUX_BLOCK, &object->iface_block_device);
-  update_iface (UDISKS_OBJECT (object), action, contains_filesystem, filesystem_connect, filesystem_update,
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : contains_filesystem,
+                filesystem_connect, filesystem_update,
                 UDISKS_TYPE_LINUX_FILESYSTEM, &object->iface_filesystem);
-  update_iface (UDISKS_OBJECT (object), action, swapspace_check, swapspace_connect, swapspace_update,
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : swapspace_check,
+                swapspace_connect, swapspace_update,
                 UDISKS_TYPE_LINUX_SWAPSPACE, &object->iface_swapspace);
-  update_iface (UDISKS_OBJECT (object), action, encrypted_check, encrypted_connect, encrypted_update,
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : encrypted_check,
+                encrypted_connect, encrypted_update,
                 UDISKS_TYPE_LINUX_ENCRYPTED, &object->iface_encrypted);
-  update_iface (UDISKS_OBJECT (object), action, loop_check, loop_connect, loop_update,
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : loop_check,
+                loop_connect, loop_update,
                 UDISKS_TYPE_LINUX_LOOP, &object->iface_loop);
-  update_iface (UDISKS_OBJECT (object), action, partition_table_check, partition_table_connect, partition_table_update,
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : block_zoned_check,
+                block_zoned_connect, block_zoned_update,
+                UDISKS_TYPE_LINUX_BLOCK_ZONED, &object->iface_block_zoned);
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : block_queue_check,
+                block_queue_connect, block_queue_update,
+                UDISKS_TYPE_LINUX_BLOCK_QUEUE, &object->iface_block_queue);
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : partition_table_check,
+                partition_table_connect, partition_table_update,
                 UDISKS_TYPE_LINUX_PARTITION_TABLE, &object->iface_partition_table);
-  update_iface (UDISKS_OBJECT (object), action, partition_check, partition_connect, partition_update,
+  update_iface (UDISKS_OBJECT (object), action, object->minimal ? minimal_check : partition_check,
+                partition_connect, partition_update,
                 UDISKS_TYPE_LINUX_PARTITION, &object->iface_partition);
 
   /* Attach interfaces from modules */
-  module_manager = udisks_daemon_get_module_manager (object->daemon);
-  if (udisks_module_manager_get_modules_available (module_manager))
-    {
-      ensure_module_ifaces (object, module_manager);
-      g_hash_table_iter_init (&iter, object->module_ifaces);
-      while (g_hash_table_iter_next (&iter, &key, (gpointer *) &entry))
-        {
-          update_iface (UDISKS_OBJECT (object), action, entry->has_func, entry->connect_func, entry->update_func,
-                        (GType) key, &entry->interface);
-        }
-    }
+  update = g_new0 (ModuleIfacesUpdate, 1);
+  update->object = g_object_ref (object);
+  update->action = g_strdup (action);
+  if (device != NULL)
+    update->synth_uuid = g_strdup (g_udev_device_get_property (device->udev_device, "SYNTH_UUID"));
+  udisks_linux_provider_invoke_for_modules (udisks_daemon_get_linux_provider (object->daemon),
+                                            on_update_module_ifaces,
+                                            update,
+                                            (GDestroyNotify) module_ifaces_update_free);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static void
-on_mount_monitor_mount_added (UDisksMountMonitor  *monitor,
-                              UDisksMount         *mount,
-                              gpointer             user_data)
+/* called in the "uevent" thread of the provider */
+static gboolean
+on_mount_changed_in_uevent_thread (gpointer user_data)
 {
   UDisksLinuxBlockObject *object = UDISKS_LINUX_BLOCK_OBJECT (user_data);
-  if (udisks_mount_get_dev (mount) == g_udev_device_get_device_number (object->device->udev_device))
-    udisks_linux_block_object_uevent (object, NULL, NULL);
+  udisks_linux_block_object_uevent (object, NULL, NULL);
+  return G_SOURCE_REMOVE;
 }
 
 static void
-on_mount_monitor_mount_removed (UDisksMountMonitor  *monitor,
-                                UDisksMount         *mount,
-                                gpointer             user_data)
+queue_update_for_mount (UDisksLinuxBlockObject *object)
+{
+  UDisksLinuxProvider *provider = udisks_daemon_get_linux_provider (object->daemon);
+
+  /* serialize with the uevents the provider applies to @object */
+  g_main_context_invoke_full (udisks_linux_provider_get_uevent_context (provider),
+                              G_PRIORITY_DEFAULT,
+                              on_mount_changed_in_uevent_thread,
+                              g_object_ref (object),
+                              g_object_unref);
+}
+
+static void
+on_mount_monitor_dev_changed (UDisksMountMonitor  *monitor,
+                              UDisksMount         *mount,
+                              gboolean             added,
+                              gpointer             user_data)
 {
   UDisksLinuxBlockObject *object = UDISKS_LINUX_BLOCK_OBJECT (user_data);
-  if (udisks_mount_get_dev (mount) == g_udev_device_get_device_number (object->device->udev_device))
-    udisks_linux_block_object_uevent (object, NULL, NULL);
+  queue_update_for_mount (object);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 
-/**
- * udisks_linux_block_object_trigger_uevent:
- * @object: A #UDisksLinuxBlockObject.
- *
- * Triggers a 'change' uevent in the kernel.
- *
- * The triggered event will bubble up from the kernel through the udev
- * stack and will eventually be received by the udisks daemon process
- * itself. This method does not wait for the event to be received.
- */
-void
-udisks_linux_block_object_trigger_uevent (UDisksLinuxBlockObject *object)
+/* Writes @request (e.g. "change") to the uevent file of @object */
+static gboolean
+write_uevent_request (UDisksLinuxBlockObject *object,
+                      const gchar            *request)
 {
   UDisksLinuxDevice *device;
   gchar* path = NULL;
   gint fd = -1;
-
-  g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
-
-  /* TODO: would be nice with a variant to wait until the request uevent has been received by ourselves */
+  gboolean ret = FALSE;
 
   device = udisks_linux_block_object_get_device (object);
   path = g_strconcat (g_udev_device_get_sysfs_path (device->udev_device), "/uevent", NULL);
@@ -968,17 +1254,138 @@ udisks_linux_block_object_trigger_uevent (UDisksLinuxBlockObject *object)
       goto out;
     }
 
-  if (write (fd, "change", sizeof "change" - 1) != sizeof "change" - 1)
+  if (write (fd, request, strlen (request)) != (gssize) strlen (request))
     {
-      udisks_warning ("Error writing 'change' to file %s: %m", path);
+      udisks_warning ("Error writing '%s' to file %s: %m", request, path);
       goto out;
     }
 
+  ret = TRUE;
+
  out:
   if (fd >= 0)
     close (fd);
   g_free (path);
   g_object_unref (device);
+  return ret;
+}
+
+/**
+ * udisks_linux_block_object_trigger_uevent:
+ * @object: A #UDisksLinuxBlockObject.
+ *
+ * Triggers a 'change' uevent in the kernel.
+ *
+ * The triggered event will bubble up from the kernel through the udev
+ * stack and will eventually be received by the udisks daemon process
+ * itself. This method does not wait for the event to be received, see
+ * udisks_linux_block_object_trigger_uevent_sync() for that.
+ */
+void
+udisks_linux_block_object_trigger_uevent (UDisksLinuxBlockObject *object)
+{
+  g_return_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object));
+
+  write_uevent_request (object, "change");
+}
+
+/**
+ * udisks_linux_block_object_can_trigger_uevent_sync:
+ *
+ * Checks whether udisks_linux_block_object_trigger_uevent_sync() can
+ * wait for the uevents it triggers, i.e. whether the kernel supports
+ * tagging uevents with a <literal>SYNTH_UUID</literal> (since Linux 4.13).
+ *
+ * Returns: %TRUE if the uevents can be waited for.
+ */
+gboolean
+udisks_linux_block_object_can_trigger_uevent_sync (void)
+{
+  static gsize supported = 0;
+
+  if (g_once_init_enter (&supported))
+    {
+      struct utsname name;
+      guint major = 0;
+      guint minor = 0;
+
+      if (uname (&name) != 0 || sscanf (name.release, "%u.%u", &major, &minor) != 2)
+        major = minor = 0;
+      g_once_init_leave (&supported, (major > 4 || (major == 4 && minor >= 13)) ? 2 : 1);
+    }
+
+  return supported == 2;
+}
+
+/**
+ * udisks_linux_block_object_trigger_uevent_sync:
+ * @object: A #UDisksLinuxBlockObject.
+ * @timeout_seconds: Maximum time to wait for the uevent (in seconds).
+ *
+ * Like udisks_linux_block_object_trigger_uevent() but tags the uevent
+ * with a random UUID (the <literal>SYNTH_UUID</literal> property) and
+ * blocks the calling thread until the daemon has received and processed
+ * it, i.e. until @object reflects the state of the device at the time of
+ * the call, including the interfaces from modules. Must not be called
+ * from the thread processing the uevents or from the main thread, where
+ * the interfaces from modules are updated.
+ *
+ * Returns: %TRUE if the uevent has been processed, %FALSE if the kernel
+ *   doesn't support tagged uevents (an untagged one is triggered
+ *   instead), if the uevent couldn't be triggered or on timeout.
+ */
+gboolean
+udisks_linux_block_object_trigger_uevent_sync (UDisksLinuxBlockObject *object,
+                                               guint                   timeout_seconds)
+{
+  UeventWaiter waiter = { NULL, FALSE };
+  gchar *uuid;
+  gchar *request;
+  gint64 deadline;
+  gboolean ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_BLOCK_OBJECT (object), FALSE);
+
+  if (!udisks_linux_block_object_can_trigger_uevent_sync ())
+    {
+      write_uevent_request (object, "change");
+      return FALSE;
+    }
+
+  uuid = g_strdup_printf ("%08x-%04x-4%03x-%04x-%04x%08x",
+                          g_random_int (),
+                          g_random_int_range (0, 0x10000),
+                          g_random_int_range (0, 0x1000),
+                          0x8000 | g_random_int_range (0, 0x4000),
+                          g_random_int_range (0, 0x10000),
+                          g_random_int ());
+  request = g_strdup_printf ("change %s", uuid);
+  waiter.uuid = uuid;
+
+  g_mutex_lock (&object->uevent_wait_lock);
+  object->uevent_waiters = g_slist_prepend (object->uevent_waiters, &waiter);
+  g_mutex_unlock (&object->uevent_wait_lock);
+
+  ret = write_uevent_request (object, request);
+
+  deadline = g_get_monotonic_time () + timeout_seconds * G_USEC_PER_SEC;
+  g_mutex_lock (&object->uevent_wait_lock);
+  while (ret && !waiter.received)
+    {
+      if (!g_cond_wait_until (&object->uevent_wait_cond, &object->uevent_wait_lock, deadline))
+        break;
+    }
+  ret = ret && waiter.received;
+  object->uevent_waiters = g_slist_remove (object->uevent_waiters, &waiter);
+  g_mutex_unlock (&object->uevent_wait_lock);
+
+  if (!ret)
+    udisks_debug ("Uevent %s on %s not processed in time", uuid,
+                  g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+
+  g_free (request);
+  g_free (uuid);
+  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
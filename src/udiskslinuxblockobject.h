@@ -36,11 +36,16 @@ UDisksLinuxBlockObject   *udisks_linux_block_object_new        (UDisksDaemon
 void                      udisks_linux_block_object_uevent     (UDisksLinuxBlockObject  *object,
                                                                 const gchar             *action,
                                                                 UDisksLinuxDevice       *device);
+void                      udisks_linux_block_object_update_module_ifaces (UDisksLinuxBlockObject *object,
+                                                                          const gchar            *action);
 UDisksDaemon             *udisks_linux_block_object_get_daemon (UDisksLinuxBlockObject  *object);
 UDisksLinuxDevice        *udisks_linux_block_object_get_device (UDisksLinuxBlockObject  *object);
 gchar                    *udisks_linux_block_object_get_device_file (UDisksLinuxBlockObject *object);
 
 void                      udisks_linux_block_object_trigger_uevent (UDisksLinuxBlockObject  *object);
+gboolean                  udisks_linux_block_object_trigger_uevent_sync (UDisksLinuxBlockObject *object,
+                                                                         guint                   timeout_seconds);
+gboolean                  udisks_linux_block_object_can_trigger_uevent_sync (void);
 void                      udisks_linux_block_object_reread_partition_table (UDisksLinuxBlockObject *object);
 gboolean                  udisks_linux_block_object_contains_filesystem (UDisksObject *object);
 
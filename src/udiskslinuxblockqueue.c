@@ -0,0 +1,481 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "udiskslogging.h"
+#include "udiskslinuxblockqueue.h"
+#include "udiskslinuxblockobject.h"
+#include "udiskslinuxdrive.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
+#include "udiskslinuxdevice.h"
+
+/**
+ * SECTION:udiskslinuxblockqueue
+ * @title: UDisksLinuxBlockQueue
+ * @short_description: Linux implementation of #UDisksBlockQueue
+ *
+ * This type provides an implementation of the #UDisksBlockQueue
+ * interface on Linux.
+ *
+ * The settings are read from and written to the
+ * <filename>queue/</filename> sysfs directory of the device. Settings
+ * made persistent are stored in the configuration of the drive of the
+ * device and applied again by udisks_linux_drive_object_uevent() when
+ * the drive appears or its configuration changes, like the ATA
+ * settings are.
+ */
+
+typedef struct _UDisksLinuxBlockQueueClass   UDisksLinuxBlockQueueClass;
+
+/**
+ * UDisksLinuxBlockQueue:
+ *
+ * The #UDisksLinuxBlockQueue structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxBlockQueue
+{
+  UDisksBlockQueueSkeleton parent_instance;
+};
+
+struct _UDisksLinuxBlockQueueClass
+{
+  UDisksBlockQueueSkeletonClass parent_class;
+};
+
+typedef struct
+{
+  const gchar *key;
+  const gchar *attr;
+  const GVariantType *type;
+} QueueSetting;
+
+/* in the order they are applied - changing the scheduler resets nr_requests */
+static const QueueSetting queue_settings[] = {
+  {"scheduler",      "queue/scheduler",      G_VARIANT_TYPE_STRING},
+  {"nr-requests",    "queue/nr_requests",    G_VARIANT_TYPE_UINT32},
+  {"read-ahead-kb",  "queue/read_ahead_kb",  G_VARIANT_TYPE_UINT32},
+  {"max-sectors-kb", "queue/max_sectors_kb", G_VARIANT_TYPE_UINT32},
+  {"rotational",     "queue/rotational",     G_VARIANT_TYPE_BOOLEAN},
+};
+
+static void block_queue_iface_init (UDisksBlockQueueIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksLinuxBlockQueue, udisks_linux_block_queue, UDISKS_TYPE_BLOCK_QUEUE_SKELETON,
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_BLOCK_QUEUE, block_queue_iface_init));
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+udisks_linux_block_queue_init (UDisksLinuxBlockQueue *queue)
+{
+}
+
+static void
+udisks_linux_block_queue_class_init (UDisksLinuxBlockQueueClass *klass)
+{
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
+}
+
+/**
+ * udisks_linux_block_queue_new:
+ *
+ * Creates a new #UDisksLinuxBlockQueue instance.
+ *
+ * Returns: A new #UDisksLinuxBlockQueue. Free with g_object_unref().
+ */
+UDisksBlockQueue *
+udisks_linux_block_queue_new (void)
+{
+  return UDISKS_BLOCK_QUEUE (g_object_new (UDISKS_TYPE_LINUX_BLOCK_QUEUE,
+                                           NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_block_queue_has_queue:
+ * @device: A #UDisksLinuxDevice.
+ *
+ * Checks if @device has a request queue that can be tuned.
+ *
+ * Returns: %TRUE if @device has a <filename>queue/</filename> sysfs directory, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_block_queue_has_queue (UDisksLinuxDevice *device)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), FALSE);
+
+  /* only whole disks have a queue directory */
+  return g_udev_device_has_sysfs_attr (device->udev_device, "queue/read_ahead_kb");
+}
+
+/* Reads @attr directly, the values cached by GUdevDevice are stale once
+ * the settings have been changed.
+ */
+static gchar *
+read_queue_attr (UDisksLinuxDevice *device,
+                 const gchar       *attr)
+{
+  gchar *filename;
+  gchar *contents = NULL;
+
+  filename = g_build_filename (g_udev_device_get_sysfs_path (device->udev_device), attr, NULL);
+  if (g_file_get_contents (filename, &contents, NULL, NULL))
+    g_strstrip (contents);
+  g_free (filename);
+
+  return contents;
+}
+
+static guint
+read_queue_attr_as_uint (UDisksLinuxDevice *device,
+                         const gchar       *attr)
+{
+  gchar *str;
+  guint ret = 0;
+
+  str = read_queue_attr (device, attr);
+  if (str != NULL)
+    ret = (guint) g_ascii_strtoull (str, NULL, 10);
+  g_free (str);
+
+  return ret;
+}
+
+static gboolean
+write_queue_attr (UDisksLinuxDevice  *device,
+                  const gchar        *attr,
+                  const gchar        *value,
+                  GError            **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename;
+  gint fd;
+
+  filename = g_build_filename (g_udev_device_get_sysfs_path (device->udev_device), attr, NULL);
+  fd = open (filename, O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %s", filename, g_strerror (errno));
+      goto out;
+    }
+  if (write (fd, value, strlen (value)) == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error writing '%s' to %s: %s", value, filename, g_strerror (errno));
+      close (fd);
+      goto out;
+    }
+  close (fd);
+  ret = TRUE;
+
+ out:
+  g_free (filename);
+  return ret;
+}
+
+/**
+ * udisks_linux_block_queue_update:
+ * @queue: A #UDisksLinuxBlockQueue.
+ * @object: The enclosing #UDisksLinuxBlockObject instance.
+ *
+ * Updates the interface.
+ */
+void
+udisks_linux_block_queue_update (UDisksLinuxBlockQueue  *queue,
+                                 UDisksLinuxBlockObject *object)
+{
+  UDisksBlockQueue *iface = UDISKS_BLOCK_QUEUE (queue);
+  UDisksLinuxDevice *device;
+  gchar *schedulers_str;
+  gchar **schedulers = NULL;
+  gchar *scheduler = NULL;
+  guint n;
+
+  device = udisks_linux_block_object_get_device (object);
+
+  /* e.g. "mq-deadline kyber [bfq] none", the current one in brackets */
+  schedulers_str = read_queue_attr (device, "queue/scheduler");
+  if (schedulers_str != NULL)
+    {
+      schedulers = g_strsplit (schedulers_str, " ", -1);
+      for (n = 0; schedulers[n] != NULL; n++)
+        {
+          gsize len = strlen (schedulers[n]);
+          if (len > 2 && schedulers[n][0] == '[' && schedulers[n][len - 1] == ']')
+            {
+              memmove (schedulers[n], schedulers[n] + 1, len - 2);
+              schedulers[n][len - 2] = '\0';
+              g_free (scheduler);
+              scheduler = g_strdup (schedulers[n]);
+            }
+        }
+      /* devices without a scheduler just have "none" */
+      if (scheduler == NULL && n == 1)
+        scheduler = g_strdup (schedulers[0]);
+    }
+
+  g_object_freeze_notify (G_OBJECT (queue));
+  udisks_block_queue_set_scheduler (iface, scheduler != NULL ? scheduler : "");
+  udisks_block_queue_set_available_schedulers (iface, (const gchar *const *) schedulers);
+  udisks_block_queue_set_num_requests (iface, read_queue_attr_as_uint (device, "queue/nr_requests"));
+  udisks_block_queue_set_read_ahead_kb (iface, read_queue_attr_as_uint (device, "queue/read_ahead_kb"));
+  udisks_block_queue_set_max_sectors_kb (iface, read_queue_attr_as_uint (device, "queue/max_sectors_kb"));
+  udisks_block_queue_set_max_hw_sectors_kb (iface, read_queue_attr_as_uint (device, "queue/max_hw_sectors_kb"));
+  udisks_block_queue_set_rotational (iface, read_queue_attr_as_uint (device, "queue/rotational") != 0);
+  g_object_thaw_notify (G_OBJECT (queue));
+
+  g_free (scheduler);
+  g_strfreev (schedulers);
+  g_free (schedulers_str);
+  g_object_unref (device);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_block_queue_apply_settings:
+ * @device: A #UDisksLinuxDevice with a request queue.
+ * @settings: A #GVariant of type <literal>a{sv}</literal> with the settings.
+ * @key_prefix: The prefix of the keys of the settings in @settings, e.g. <literal>"queue-"</literal> for the drive configuration.
+ * @error: Return location for error or %NULL.
+ *
+ * Writes the queue settings in @settings to the sysfs files of
+ * @device, see the org.freedesktop.UDisks2.Block.Queue.SetSettings()
+ * method for the known settings. Keys of unknown settings or with a
+ * wrong type are ignored.
+ *
+ * Returns: %TRUE if all the settings have been applied, %FALSE with @error set otherwise.
+ */
+gboolean
+udisks_linux_block_queue_apply_settings (UDisksLinuxDevice  *device,
+                                         GVariant           *settings,
+                                         const gchar        *key_prefix,
+                                         GError            **error)
+{
+  gboolean ret = TRUE;
+  guint n;
+
+  for (n = 0; ret && n < G_N_ELEMENTS (queue_settings); n++)
+    {
+      GVariant *value;
+      gchar *key;
+      gchar *str;
+
+      key = g_strconcat (key_prefix, queue_settings[n].key, NULL);
+      value = g_variant_lookup_value (settings, key, queue_settings[n].type);
+      g_free (key);
+      if (value == NULL)
+        continue;
+
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+        str = g_variant_dup_string (value, NULL);
+      else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+        str = g_strdup (g_variant_get_boolean (value) ? "1" : "0");
+      else
+        str = g_strdup_printf ("%u", g_variant_get_uint32 (value));
+
+      ret = write_queue_attr (device, queue_settings[n].attr, str, error);
+
+      g_free (str);
+      g_variant_unref (value);
+    }
+
+  return ret;
+}
+
+/* Returns the configuration of @drive with the queue settings replaced by
+ * those in @settings.
+ */
+static GVariant *
+merge_configuration (UDisksDrive *drive,
+                     GVariant    *settings)
+{
+  GVariantBuilder builder;
+  GVariant *configuration;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+
+  configuration = udisks_drive_dup_configuration (drive);
+  if (configuration != NULL)
+    {
+      g_variant_iter_init (&iter, configuration);
+      while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+        {
+          if (!g_str_has_prefix (key, "queue-") ||
+              !g_variant_lookup (settings, key + strlen ("queue-"), "*", NULL))
+            g_variant_builder_add (&builder, "{sv}", key, value);
+          g_variant_unref (value);
+        }
+      g_variant_unref (configuration);
+    }
+
+  g_variant_iter_init (&iter, settings);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      gchar *conf_key = g_strconcat ("queue-", key, NULL);
+      g_variant_builder_add (&builder, "{sv}", conf_key, value);
+      g_free (conf_key);
+      g_variant_unref (value);
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+/* runs in thread dedicated to handling method call */
+static gboolean
+handle_set_settings (UDisksBlockQueue      *_queue,
+                     GDBusMethodInvocation *invocation,
+                     GVariant              *settings,
+                     GVariant              *options)
+{
+  UDisksLinuxBlockQueue *queue = UDISKS_LINUX_BLOCK_QUEUE (_queue);
+  UDisksObject *object = NULL;
+  UDisksObject *drive_object = NULL;
+  UDisksDrive *drive = NULL;
+  UDisksDaemon *daemon;
+  UDisksBlock *block;
+  UDisksLinuxDevice *device = NULL;
+  GVariant *configuration = NULL;
+  gboolean persist = FALSE;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+  GError *error = NULL;
+
+  object = udisks_daemon_util_dup_object (queue, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+  block = udisks_object_peek_block (object);
+
+  /* reject unknown settings instead of silently ignoring them */
+  g_variant_iter_init (&iter, settings);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      guint n;
+
+      for (n = 0; n < G_N_ELEMENTS (queue_settings); n++)
+        {
+          if (g_strcmp0 (queue_settings[n].key, key) == 0)
+            break;
+        }
+      if (n == G_N_ELEMENTS (queue_settings) || !g_variant_is_of_type (value, queue_settings[n].type))
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                                 "Unknown queue setting %s of type %s",
+                                                 key, g_variant_get_type_string (value));
+          g_variant_unref (value);
+          goto out;
+        }
+      g_variant_unref (value);
+    }
+
+  g_variant_lookup (options, "persist", "b", &persist);
+  if (persist)
+    {
+      drive_object = udisks_daemon_find_object (daemon, udisks_block_get_drive (block));
+      if (drive_object != NULL)
+        drive = udisks_object_get_drive (drive_object);
+      if (drive == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                 "The device has no drive to store the settings in");
+          goto out;
+        }
+    }
+
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    object,
+                                                    "org.freedesktop.udisks2.modify-drive-settings",
+                                                    options,
+                                                    /* Translators: Shown in authentication dialog when an
+                                                     * application wants to change the request queue settings
+                                                     * of a device, e.g. its I/O scheduler or read-ahead.
+                                                     *
+                                                     * Do not translate $(drive), it's a placeholder and will
+                                                     * be replaced by the name of the drive/device in question
+                                                     */
+                                                    N_("Authentication is required to change the queue settings of $(drive)"),
+                                                    invocation))
+    goto out;
+
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (!udisks_linux_block_queue_apply_settings (device, settings, "", &error))
+    {
+      /* some of the settings may have been applied */
+      udisks_linux_block_queue_update (queue, UDISKS_LINUX_BLOCK_OBJECT (object));
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  udisks_linux_block_queue_update (queue, UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  if (drive != NULL)
+    {
+      configuration = g_variant_ref_sink (merge_configuration (drive, settings));
+      if (!udisks_linux_drive_set_configuration_sync (UDISKS_LINUX_DRIVE (drive), configuration, &error))
+        {
+          g_prefix_error (&error, "Error storing the queue settings: ");
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+    }
+
+  udisks_notice ("Changed queue settings of %s%s",
+                 g_udev_device_get_device_file (device->udev_device),
+                 drive != NULL ? " persistently" : "");
+  udisks_block_queue_complete_set_settings (_queue, invocation);
+
+ out:
+  if (configuration != NULL)
+    g_variant_unref (configuration);
+  g_clear_object (&device);
+  g_clear_object (&drive);
+  g_clear_object (&drive_object);
+  g_clear_object (&object);
+  return TRUE; /* returning true means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+block_queue_iface_init (UDisksBlockQueueIface *iface)
+{
+  iface->handle_set_settings = handle_set_settings;
+}
@@ -0,0 +1,581 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <linux/blkzoned.h>
+
+#include "udiskslogging.h"
+#include "udiskslinuxblockzoned.h"
+#include "udiskslinuxblockobject.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
+#include "udiskslinuxdevice.h"
+#include "udiskssimplejob.h"
+
+/**
+ * SECTION:udiskslinuxblockzoned
+ * @title: UDisksLinuxBlockZoned
+ * @short_description: Linux implementation of #UDisksBlockZoned
+ *
+ * This type provides an implementation of the #UDisksBlockZoned
+ * interface on Linux.
+ *
+ * The zone report is read with the <literal>BLKREPORTZONE</literal>
+ * ioctl the first time it is requested and kept until the next uevent
+ * on the device, a reset of zones or an explicit refresh, so clients
+ * paging through the report don't make the kernel walk the zones of the
+ * device for every page.
+ */
+
+typedef struct _UDisksLinuxBlockZonedClass   UDisksLinuxBlockZonedClass;
+
+/* A zone as reported by the kernel, in 512-byte sectors */
+typedef struct
+{
+  guint64 start;
+  guint64 len;
+  guint64 capacity;
+  guint64 wp;
+  guint8  type;
+  guint8  cond;
+} Zone;
+
+/**
+ * UDisksLinuxBlockZoned:
+ *
+ * The #UDisksLinuxBlockZoned structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxBlockZoned
+{
+  UDisksBlockZonedSkeleton parent_instance;
+
+  /* the cached zone report (of Zone) or NULL if not cached, protected
+   * by object_lock */
+  GArray *zones;
+  /* bumped whenever the cache is invalidated so that a report read
+   * concurrently with the invalidation is not cached, protected by
+   * object_lock */
+  guint zones_generation;
+};
+
+struct _UDisksLinuxBlockZonedClass
+{
+  UDisksBlockZonedSkeletonClass parent_class;
+};
+
+/* Number of zones read with one BLKREPORTZONE ioctl */
+#define REPORT_ZONES_BATCH 4096
+
+static void block_zoned_iface_init (UDisksBlockZonedIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksLinuxBlockZoned, udisks_linux_block_zoned, UDISKS_TYPE_BLOCK_ZONED_SKELETON,
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_BLOCK_ZONED, block_zoned_iface_init));
+
+G_LOCK_DEFINE_STATIC (object_lock);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+udisks_linux_block_zoned_finalize (GObject *object)
+{
+  UDisksLinuxBlockZoned *zoned = UDISKS_LINUX_BLOCK_ZONED (object);
+
+  if (zoned->zones != NULL)
+    g_array_unref (zoned->zones);
+
+  G_OBJECT_CLASS (udisks_linux_block_zoned_parent_class)->finalize (object);
+}
+
+static void
+udisks_linux_block_zoned_init (UDisksLinuxBlockZoned *zoned)
+{
+}
+
+static void
+udisks_linux_block_zoned_class_init (UDisksLinuxBlockZonedClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_block_zoned_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
+}
+
+/**
+ * udisks_linux_block_zoned_new:
+ *
+ * Creates a new #UDisksLinuxBlockZoned instance.
+ *
+ * Returns: A new #UDisksLinuxBlockZoned. Free with g_object_unref().
+ */
+UDisksBlockZoned *
+udisks_linux_block_zoned_new (void)
+{
+  return UDISKS_BLOCK_ZONED (g_object_new (UDISKS_TYPE_LINUX_BLOCK_ZONED,
+                                           NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_block_zoned_is_zoned:
+ * @device: A #UDisksLinuxDevice.
+ *
+ * Checks if @device is a zoned block device.
+ *
+ * Returns: %TRUE if @device is host-managed or host-aware, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_block_zoned_is_zoned (UDisksLinuxDevice *device)
+{
+  const gchar *model;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), FALSE);
+
+  /* only whole disks have a queue directory */
+  model = g_udev_device_get_sysfs_attr (device->udev_device, "queue/zoned");
+  return model != NULL && g_strcmp0 (model, "none") != 0;
+}
+
+static void
+invalidate_zones (UDisksLinuxBlockZoned *zoned)
+{
+  G_LOCK (object_lock);
+  if (zoned->zones != NULL)
+    {
+      g_array_unref (zoned->zones);
+      zoned->zones = NULL;
+    }
+  zoned->zones_generation++;
+  G_UNLOCK (object_lock);
+}
+
+/**
+ * udisks_linux_block_zoned_update:
+ * @zoned: A #UDisksLinuxBlockZoned.
+ * @object: The enclosing #UDisksLinuxBlockObject instance.
+ *
+ * Updates the interface. The cached zone report is dropped, the uevent
+ * may have been caused by something writing to or resetting the zones.
+ */
+void
+udisks_linux_block_zoned_update (UDisksLinuxBlockZoned  *zoned,
+                                 UDisksLinuxBlockObject *object)
+{
+  UDisksLinuxDevice *device;
+  GUdevDevice *udev_device;
+  const gchar *model;
+  guint64 zone_size;
+  guint64 num_zones = 0;
+  guint64 max_open_zones = 0;
+  guint64 max_active_zones = 0;
+
+  device = udisks_linux_block_object_get_device (object);
+  udev_device = device->udev_device;
+
+  model = g_udev_device_get_sysfs_attr (udev_device, "queue/zoned");
+  zone_size = g_udev_device_get_sysfs_attr_as_uint64 (udev_device, "queue/chunk_sectors") * 512;
+
+  /* nr_zones, max_open_zones and max_active_zones are only available on newer kernels */
+  if (g_udev_device_has_sysfs_attr (udev_device, "queue/nr_zones"))
+    num_zones = g_udev_device_get_sysfs_attr_as_uint64 (udev_device, "queue/nr_zones");
+  else if (zone_size > 0)
+    num_zones = (g_udev_device_get_sysfs_attr_as_uint64 (udev_device, "size") * 512 + zone_size - 1) / zone_size;
+  if (g_udev_device_has_sysfs_attr (udev_device, "queue/max_open_zones"))
+    max_open_zones = g_udev_device_get_sysfs_attr_as_uint64 (udev_device, "queue/max_open_zones");
+  if (g_udev_device_has_sysfs_attr (udev_device, "queue/max_active_zones"))
+    max_active_zones = g_udev_device_get_sysfs_attr_as_uint64 (udev_device, "queue/max_active_zones");
+
+  invalidate_zones (zoned);
+
+  g_object_freeze_notify (G_OBJECT (zoned));
+  udisks_block_zoned_set_model (UDISKS_BLOCK_ZONED (zoned), model != NULL ? model : "");
+  udisks_block_zoned_set_zone_size (UDISKS_BLOCK_ZONED (zoned), zone_size);
+  udisks_block_zoned_set_num_zones (UDISKS_BLOCK_ZONED (zoned), num_zones);
+  udisks_block_zoned_set_max_open_zones (UDISKS_BLOCK_ZONED (zoned), max_open_zones);
+  udisks_block_zoned_set_max_active_zones (UDISKS_BLOCK_ZONED (zoned), max_active_zones);
+  g_object_thaw_notify (G_OBJECT (zoned));
+
+  g_object_unref (device);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GArray *
+read_zones (const gchar  *device_file,
+            GError      **error)
+{
+  struct blk_zone_report *report = NULL;
+  GArray *zones = NULL;
+  guint64 sector = 0;
+  gint fd;
+
+  fd = open (device_file, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %m", device_file);
+      goto out;
+    }
+
+  report = g_malloc0 (sizeof (struct blk_zone_report) + REPORT_ZONES_BATCH * sizeof (struct blk_zone));
+  zones = g_array_new (FALSE, FALSE, sizeof (Zone));
+  while (TRUE)
+    {
+      const struct blk_zone *last;
+      guint n;
+
+      report->sector = sector;
+      report->nr_zones = REPORT_ZONES_BATCH;
+      if (ioctl (fd, BLKREPORTZONE, report) != 0)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Error reporting the zones of %s: %m", device_file);
+          g_array_unref (zones);
+          zones = NULL;
+          goto out;
+        }
+
+      /* no more zones past the end of the device */
+      if (report->nr_zones == 0)
+        break;
+
+      for (n = 0; n < report->nr_zones; n++)
+        {
+          const struct blk_zone *z = &report->zones[n];
+          Zone zone;
+
+          zone.start = z->start;
+          zone.len = z->len;
+          zone.wp = z->wp;
+          zone.type = z->type;
+          zone.cond = z->cond;
+#ifdef BLK_ZONE_REP_CAPACITY
+          zone.capacity = (report->flags & BLK_ZONE_REP_CAPACITY) ? z->capacity : z->len;
+#else
+          zone.capacity = z->len;
+#endif
+          g_array_append_val (zones, zone);
+        }
+
+      last = &report->zones[report->nr_zones - 1];
+      sector = last->start + last->len;
+    }
+
+ out:
+  g_free (report);
+  if (fd != -1)
+    close (fd);
+  return zones;
+}
+
+static const gchar *
+zone_type_to_string (guint8 type)
+{
+  switch (type)
+    {
+    case BLK_ZONE_TYPE_CONVENTIONAL:
+      return "conventional";
+    case BLK_ZONE_TYPE_SEQWRITE_REQ:
+      return "sequential-write-required";
+    case BLK_ZONE_TYPE_SEQWRITE_PREF:
+      return "sequential-write-preferred";
+    default:
+      return "";
+    }
+}
+
+static const gchar *
+zone_cond_to_string (guint8 cond)
+{
+  switch (cond)
+    {
+    case BLK_ZONE_COND_NOT_WP:
+      return "not-write-pointer";
+    case BLK_ZONE_COND_EMPTY:
+      return "empty";
+    case BLK_ZONE_COND_IMP_OPEN:
+      return "implicit-open";
+    case BLK_ZONE_COND_EXP_OPEN:
+      return "explicit-open";
+    case BLK_ZONE_COND_CLOSED:
+      return "closed";
+    case BLK_ZONE_COND_READONLY:
+      return "read-only";
+    case BLK_ZONE_COND_FULL:
+      return "full";
+    case BLK_ZONE_COND_OFFLINE:
+      return "offline";
+    default:
+      return "";
+    }
+}
+
+/* the write pointer is undefined for zones that can't be written */
+static gboolean
+zone_has_write_pointer (const Zone *zone)
+{
+  return zone->cond != BLK_ZONE_COND_NOT_WP &&
+    zone->cond != BLK_ZONE_COND_READONLY &&
+    zone->cond != BLK_ZONE_COND_OFFLINE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* runs in thread dedicated to handling method call */
+static gboolean
+handle_report_zones (UDisksBlockZoned      *_zoned,
+                     GDBusMethodInvocation *invocation,
+                     guint                  first_zone,
+                     guint                  num_zones,
+                     GVariant              *options)
+{
+  UDisksLinuxBlockZoned *zoned = UDISKS_LINUX_BLOCK_ZONED (_zoned);
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon;
+  UDisksLinuxDevice *device = NULL;
+  GArray *zones = NULL;
+  GVariantBuilder builder;
+  gboolean refresh = FALSE;
+  guint generation;
+  GError *error = NULL;
+  guint n;
+
+  object = udisks_daemon_util_dup_object (zoned, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  g_variant_lookup (options, "refresh", "b", &refresh);
+  if (refresh)
+    {
+      /* reading the zones from the device is authorized like Block.Rescan() */
+      if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                        object,
+                                                        "org.freedesktop.udisks2.rescan",
+                                                        options,
+                                                        /* Translators: Shown in authentication dialog when an
+                                                         * application wants to re-read the zones of a zoned
+                                                         * device.
+                                                         *
+                                                         * Do not translate $(drive), it's a placeholder and will
+                                                         * be replaced by the name of the drive/device in question
+                                                         */
+                                                        N_("Authentication is required to rescan $(drive)"),
+                                                        invocation))
+        goto out;
+    }
+
+  G_LOCK (object_lock);
+  if (!refresh && zoned->zones != NULL)
+    zones = g_array_ref (zoned->zones);
+  generation = zoned->zones_generation;
+  G_UNLOCK (object_lock);
+
+  if (zones == NULL)
+    {
+      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+      zones = read_zones (g_udev_device_get_device_file (device->udev_device), &error);
+      if (zones == NULL)
+        {
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+
+      G_LOCK (object_lock);
+      if (zoned->zones_generation == generation)
+        {
+          if (zoned->zones != NULL)
+            g_array_unref (zoned->zones);
+          zoned->zones = g_array_ref (zones);
+        }
+      G_UNLOCK (object_lock);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ttttss)"));
+  for (n = first_zone; n < zones->len && n - first_zone < num_zones; n++)
+    {
+      const Zone *zone = &g_array_index (zones, Zone, n);
+
+      g_variant_builder_add (&builder, "(ttttss)",
+                             zone->start * 512,
+                             zone->len * 512,
+                             zone->capacity * 512,
+                             zone_has_write_pointer (zone) ? zone->wp * 512 : (zone->start + zone->len) * 512,
+                             zone_type_to_string (zone->type),
+                             zone_cond_to_string (zone->cond));
+    }
+
+  udisks_block_zoned_complete_report_zones (_zoned, invocation, g_variant_builder_end (&builder));
+
+ out:
+  if (zones != NULL)
+    g_array_unref (zones);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return TRUE; /* returning true means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* runs in thread dedicated to handling method call */
+static gboolean
+handle_reset_zones (UDisksBlockZoned      *_zoned,
+                    GDBusMethodInvocation *invocation,
+                    guint                  first_zone,
+                    guint                  num_zones,
+                    GVariant              *options)
+{
+  UDisksLinuxBlockZoned *zoned = UDISKS_LINUX_BLOCK_ZONED (_zoned);
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon;
+  UDisksBlock *block;
+  UDisksLinuxDevice *device = NULL;
+  UDisksBaseJob *job = NULL;
+  const gchar *action_id;
+  const gchar *device_file;
+  struct blk_zone_range range;
+  guint64 zone_sectors;
+  guint64 device_sectors;
+  uid_t caller_uid;
+  gint fd = -1;
+  GError *error = NULL;
+
+  object = udisks_daemon_util_dup_object (zoned, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+  block = udisks_object_peek_block (object);
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  action_id = "org.freedesktop.udisks2.modify-device";
+  if (!udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+    {
+      if (block != NULL && udisks_block_get_hint_system (block))
+        action_id = "org.freedesktop.udisks2.modify-device-system";
+      else if (!udisks_daemon_util_on_user_seat (daemon, object, caller_uid))
+        action_id = "org.freedesktop.udisks2.modify-device-other-seat";
+    }
+
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    object,
+                                                    action_id,
+                                                    options,
+                                                    /* Translators: Shown in authentication dialog when an
+                                                     * application wants to reset zones of a zoned device,
+                                                     * discarding the data in them.
+                                                     *
+                                                     * Do not translate $(drive), it's a placeholder and will
+                                                     * be replaced by the name of the drive/device in question
+                                                     */
+                                                    N_("Authentication is required to reset zones of $(drive)"),
+                                                    invocation))
+    goto out;
+
+  if (num_zones == 0 ||
+      first_zone >= udisks_block_zoned_get_num_zones (_zoned) ||
+      num_zones > udisks_block_zoned_get_num_zones (_zoned) - first_zone)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Invalid zone range %u+%u, the device has %u zones",
+                                             first_zone, num_zones,
+                                             udisks_block_zoned_get_num_zones (_zoned));
+      goto out;
+    }
+
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  device_file = g_udev_device_get_device_file (device->udev_device);
+  zone_sectors = udisks_block_zoned_get_zone_size (_zoned) / 512;
+  device_sectors = g_udev_device_get_sysfs_attr_as_uint64 (device->udev_device, "size");
+
+  /* the last zone may be smaller than the others */
+  range.sector = first_zone * zone_sectors;
+  range.nr_sectors = MIN ((first_zone + (guint64) num_zones) * zone_sectors, device_sectors) - range.sector;
+
+  job = udisks_daemon_launch_simple_job (daemon, object, "block-reset-zones", caller_uid, NULL);
+  udisks_job_set_cancelable (UDISKS_JOB (job), FALSE);
+
+  /* O_EXCL so the zones of a mounted filesystem can't be reset under it */
+  fd = open (device_file, O_RDWR | O_EXCL | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (&error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %m", device_file);
+    }
+  else if (ioctl (fd, BLKRESETZONE, &range) != 0)
+    {
+      g_set_error (&error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error resetting zones %u+%u of %s: %m", first_zone, num_zones, device_file);
+    }
+
+  /* even a failed reset may have reset some of the zones */
+  invalidate_zones (zoned);
+
+  if (error != NULL)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_notice ("Reset zones %u+%u of %s", first_zone, num_zones, device_file);
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, "");
+  udisks_block_zoned_complete_reset_zones (_zoned, invocation);
+
+ out:
+  if (fd != -1)
+    close (fd);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return TRUE; /* returning true means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+block_zoned_iface_init (UDisksBlockZonedIface *iface)
+{
+  iface->handle_report_zones = handle_report_zones;
+  iface->handle_reset_zones  = handle_reset_zones;
+}
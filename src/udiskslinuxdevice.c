@@ -41,6 +41,7 @@
 #include "udiskslogging.h"
 #include "udisksata.h"
 #include "udisksdaemonutil.h"
+#include "udisksprobesnapshot.h"
 
 /**
  * SECTION:udiskslinuxdevice
@@ -62,6 +63,118 @@ struct _UDisksLinuxDeviceClass
 
 G_DEFINE_TYPE (UDisksLinuxDevice, udisks_linux_device, G_TYPE_OBJECT);
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The IDENTIFY data is interned: a new instance is created on every uevent
+ * of a drive and as long as the data hasn't changed, it shares the buffer
+ * of the previous one instead of keeping a copy of its own.
+ */
+
+#define ATA_IDENTIFY_DATA_SIZE 512
+
+typedef struct
+{
+  gint ref_count;
+  guchar data[ATA_IDENTIFY_DATA_SIZE];
+} SharedIdentifyData;
+
+G_LOCK_DEFINE_STATIC (identify_data_lock);
+
+/* data -> SharedIdentifyData */
+static GHashTable *identify_data_table = NULL;
+
+static guint
+identify_data_hash (gconstpointer v)
+{
+  const guchar *data = v;
+  guint hash = 5381;
+  guint n;
+
+  for (n = 0; n < ATA_IDENTIFY_DATA_SIZE; n++)
+    hash = (hash << 5) + hash + data[n];
+
+  return hash;
+}
+
+static gboolean
+identify_data_equal (gconstpointer a,
+                     gconstpointer b)
+{
+  return memcmp (a, b, ATA_IDENTIFY_DATA_SIZE) == 0;
+}
+
+/* Returns the shared buffer with the same contents as @data */
+static guchar *
+identify_data_intern (const guchar *data)
+{
+  SharedIdentifyData *shared;
+
+  G_LOCK (identify_data_lock);
+  if (identify_data_table == NULL)
+    identify_data_table = g_hash_table_new (identify_data_hash, identify_data_equal);
+
+  shared = g_hash_table_lookup (identify_data_table, data);
+  if (shared != NULL)
+    {
+      shared->ref_count++;
+    }
+  else
+    {
+      shared = g_new (SharedIdentifyData, 1);
+      shared->ref_count = 1;
+      memcpy (shared->data, data, ATA_IDENTIFY_DATA_SIZE);
+      g_hash_table_insert (identify_data_table, shared->data, shared);
+    }
+  G_UNLOCK (identify_data_lock);
+
+  return shared->data;
+}
+
+static void
+identify_data_release (guchar *data)
+{
+  SharedIdentifyData *shared;
+
+  if (data == NULL)
+    return;
+
+  shared = (SharedIdentifyData *) (data - G_STRUCT_OFFSET (SharedIdentifyData, data));
+
+  G_LOCK (identify_data_lock);
+  if (--shared->ref_count == 0)
+    {
+      g_hash_table_remove (identify_data_table, shared->data);
+      g_free (shared);
+    }
+  G_UNLOCK (identify_data_lock);
+}
+
+/**
+ * udisks_linux_device_set_ata_identify_data:
+ * @device: A #UDisksLinuxDevice.
+ * @packet: %TRUE to set the IDENTIFY PACKET DEVICE data, %FALSE to set the IDENTIFY DEVICE data.
+ * @data: (allow-none): 512-byte array with the data or %NULL.
+ *
+ * Sets the @ata_identify_device_data or @ata_identify_packet_device_data
+ * member of @device to the same data as @data. The buffer is shared with
+ * the other instances with the same data so it must not be modified and
+ * the members must only be changed through this function. This can be
+ * called from any thread.
+ */
+void
+udisks_linux_device_set_ata_identify_data (UDisksLinuxDevice *device,
+                                           gboolean           packet,
+                                           const guchar      *data)
+{
+  guchar **member;
+
+  g_return_if_fail (UDISKS_IS_LINUX_DEVICE (device));
+
+  member = packet ? &device->ata_identify_packet_device_data : &device->ata_identify_device_data;
+  identify_data_release (*member);
+  *member = data != NULL ? identify_data_intern (data) : NULL;
+}
+
 static void
 udisks_linux_device_init (UDisksLinuxDevice *device)
 {
@@ -73,8 +186,9 @@ udisks_linux_device_finalize (GObject *object)
   UDisksLinuxDevice *device = UDISKS_LINUX_DEVICE (object);
 
   g_clear_object (&device->udev_device);
-  g_free (device->ata_identify_device_data);
-  g_free (device->ata_identify_packet_device_data);
+  identify_data_release (device->ata_identify_device_data);
+  identify_data_release (device->ata_identify_packet_device_data);
+  g_free (device->dm_uuid);
 
   G_OBJECT_CLASS (udisks_linux_device_parent_class)->finalize (object);
 }
@@ -94,6 +208,41 @@ static gboolean probe_ata (UDisksLinuxDevice  *device,
                            GCancellable       *cancellable,
                            GError            **error);
 
+static void
+probe_dm (UDisksLinuxDevice *device)
+{
+  const gchar *name;
+  gchar *path;
+  gchar *contents = NULL;
+
+  name = g_udev_device_get_name (device->udev_device);
+  if (g_strcmp0 (g_udev_device_get_subsystem (device->udev_device), "block") != 0 ||
+      name == NULL || !g_str_has_prefix (name, "dm-"))
+    return;
+
+  /* Read it right from sysfs, the udev database may lag behind the
+   * table of a device that is just being set up. The attribute is gone
+   * on remove events but the database still carries the last value. */
+  path = g_build_filename (g_udev_device_get_sysfs_path (device->udev_device), "dm", "uuid", NULL);
+  if (g_file_get_contents (path, &contents, NULL, NULL))
+    g_strstrip (contents);
+  else
+    contents = g_strdup (g_udev_device_get_property (device->udev_device, "DM_UUID"));
+  g_free (path);
+
+  if (contents != NULL && contents[0] == '\0')
+    g_clear_pointer (&contents, g_free);
+  device->dm_uuid = contents;
+}
+
+static gboolean
+needs_ata_probe (GUdevDevice *udev_device)
+{
+  return g_strcmp0 (g_udev_device_get_subsystem (udev_device), "block") == 0 &&
+    g_strcmp0 (g_udev_device_get_devtype (udev_device), "disk") == 0 &&
+    g_udev_device_get_property_as_boolean (udev_device, "ID_ATA");
+}
+
 /**
  * udisks_linux_device_new_sync:
  * @udev_device: A #GUdevDevice.
@@ -116,6 +265,7 @@ udisks_linux_device_new_sync (GUdevDevice *udev_device)
 
   device = g_object_new (UDISKS_TYPE_LINUX_DEVICE, NULL);
   device->udev_device = g_object_ref (udev_device);
+  probe_dm (device);
 
   /* No point in probing on remove events */
   if (!(g_strcmp0 (g_udev_device_get_action (udev_device), "remove") == 0))
@@ -135,6 +285,53 @@ udisks_linux_device_new_sync (GUdevDevice *udev_device)
   return device;
 }
 
+/**
+ * udisks_linux_device_new_from_snapshot_sync:
+ * @udev_device: A #GUdevDevice.
+ * @snapshot: A #UDisksProbeSnapshot.
+ * @out_restored: (out) (allow-none): Return location for whether the probed data was taken from @snapshot or %NULL.
+ *
+ * Like udisks_linux_device_new_sync() but takes the probed data from
+ * @snapshot if the device hasn't changed since the snapshot was taken.
+ * Otherwise the device is probed and the results are recorded in
+ * @snapshot.
+ *
+ * Returns: A #UDisksLinuxDevice.
+ */
+UDisksLinuxDevice *
+udisks_linux_device_new_from_snapshot_sync (GUdevDevice         *udev_device,
+                                            UDisksProbeSnapshot *snapshot,
+                                            gboolean            *out_restored)
+{
+  UDisksLinuxDevice *device;
+  gboolean restored = FALSE;
+
+  g_return_val_if_fail (G_UDEV_IS_DEVICE (udev_device), NULL);
+
+  if (needs_ata_probe (udev_device))
+    {
+      device = g_object_new (UDISKS_TYPE_LINUX_DEVICE, NULL);
+      device->udev_device = g_object_ref (udev_device);
+      probe_dm (device);
+      restored = udisks_probe_snapshot_restore (snapshot, device);
+      if (!restored)
+        {
+          g_object_unref (device);
+          device = udisks_linux_device_new_sync (udev_device);
+          udisks_probe_snapshot_store (snapshot, device);
+        }
+    }
+  else
+    {
+      device = udisks_linux_device_new_sync (udev_device);
+    }
+
+  if (out_restored != NULL)
+    *out_restored = restored;
+
+  return device;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /**
@@ -157,9 +354,7 @@ udisks_linux_device_reprobe_sync (UDisksLinuxDevice  *device,
   gboolean ret = FALSE;
 
   /* Get IDENTIFY DEVICE / IDENTIFY PACKET DEVICE data for ATA devices */
-  if (g_strcmp0 (g_udev_device_get_subsystem (device->udev_device), "block") == 0 &&
-      g_strcmp0 (g_udev_device_get_devtype (device->udev_device), "disk") == 0 &&
-      g_udev_device_get_property_as_boolean (device->udev_device, "ID_ATA"))
+  if (needs_ata_probe (device->udev_device))
     {
       if (!probe_ata (device, cancellable, error))
         goto out;
@@ -183,6 +378,7 @@ probe_ata (UDisksLinuxDevice  *device,
   gint fd = -1;
   UDisksAtaCommandInput input = {0};
   UDisksAtaCommandOutput output = {0};
+  guchar buffer[ATA_IDENTIFY_DATA_SIZE] = {0};
 
   device_file = g_udev_device_get_device_file (device->udev_device);
   fd = open (device_file, O_RDONLY|O_NONBLOCK);
@@ -200,8 +396,8 @@ probe_ata (UDisksLinuxDevice  *device,
       /* ATA8: 7.16 IDENTIFY DEVICE - ECh, PIO Data-In */
       input.command = 0xec;
       input.count = 1;
-      output.buffer = g_new0 (guchar, 512);
-      output.buffer_size = 512;
+      output.buffer = buffer;
+      output.buffer_size = sizeof buffer;
       if (!udisks_ata_send_command_sync (fd,
                                          -1,
                                          UDISKS_ATA_COMMAND_PROTOCOL_DRIVE_TO_HOST,
@@ -209,13 +405,11 @@ probe_ata (UDisksLinuxDevice  *device,
                                          &output,
                                          error))
         {
-          g_free (output.buffer);
           g_prefix_error (error, "Error sending ATA command IDENTIFY DEVICE to '%s': ",
                           device_file);
           goto out;
         }
-      g_free (device->ata_identify_device_data);
-      device->ata_identify_device_data = output.buffer;
+      udisks_linux_device_set_ata_identify_data (device, FALSE, buffer);
       /* udisks_daemon_util_hexdump_debug (device->ata_identify_device_data, 512); */
     }
   else
@@ -223,8 +417,8 @@ probe_ata (UDisksLinuxDevice  *device,
       /* ATA8: 7.17 IDENTIFY PACKET DEVICE - A1h, PIO Data-In */
       input.command = 0xa1;
       input.count = 1;
-      output.buffer = g_new0 (guchar, 512);
-      output.buffer_size = 512;
+      output.buffer = buffer;
+      output.buffer_size = sizeof buffer;
       if (!udisks_ata_send_command_sync (fd,
                                          -1,
                                          UDISKS_ATA_COMMAND_PROTOCOL_DRIVE_TO_HOST,
@@ -232,13 +426,11 @@ probe_ata (UDisksLinuxDevice  *device,
                                          &output,
                                          error))
         {
-          g_free (output.buffer);
           g_prefix_error (error, "Error sending ATA command IDENTIFY PACKET DEVICE to '%s': ",
                           device_file);
           goto out;
         }
-      g_free (device->ata_identify_packet_device_data);
-      device->ata_identify_packet_device_data = output.buffer;
+      udisks_linux_device_set_ata_identify_data (device, TRUE, buffer);
       /* udisks_daemon_util_hexdump_debug (device->ata_identify_packet_device_data, 512); */
     }
 
@@ -255,3 +447,68 @@ probe_ata (UDisksLinuxDevice  *device,
     }
   return ret;
 }
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_device_is_passive:
+ * @device: A #UDisksLinuxDevice.
+ *
+ * Checks whether @device is only used through another block device,
+ * i.e. it is a path of a multipath device or an internal layer of a
+ * device-mapper device, such as the data and metadata of a LVM thin pool.
+ * Such devices are exported without most of their interfaces or not at
+ * all, depending on the <literal>passive_devices</literal> option in
+ * udisks2.conf(5).
+ *
+ * Returns: %TRUE if @device is passive, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_device_is_passive (UDisksLinuxDevice *device)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), FALSE);
+
+  /* multipath paths are not probed by our udev rules either and
+   * device-mapper flags private layers to keep /dev/disk links off them */
+  return g_udev_device_get_property_as_boolean (device->udev_device, "DM_MULTIPATH_DEVICE_PATH") ||
+         g_udev_device_get_property_as_boolean (device->udev_device, "DM_UDEV_DISABLE_DISK_RULES_FLAG");
+}
+
+/**
+ * udisks_linux_device_get_dm_type:
+ * @device: A #UDisksLinuxDevice.
+ *
+ * Classifies @device by the owner of its device-mapper table, as
+ * recorded in the @dm_uuid member of @device. The UUID is read once when
+ * @device is created so this can be called as often as needed.
+ *
+ * Returns: A value from #UDisksLinuxDeviceDMType.
+ */
+UDisksLinuxDeviceDMType
+udisks_linux_device_get_dm_type (UDisksLinuxDevice *device)
+{
+  const gchar *uuid;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), UDISKS_LINUX_DEVICE_DM_TYPE_NONE);
+
+  uuid = device->dm_uuid;
+  if (uuid == NULL)
+    {
+      const gchar *name = g_udev_device_get_name (device->udev_device);
+
+      return (name != NULL && g_str_has_prefix (name, "dm-")) ?
+        UDISKS_LINUX_DEVICE_DM_TYPE_OTHER : UDISKS_LINUX_DEVICE_DM_TYPE_NONE;
+    }
+
+  /* the prefixes are set by the tools owning the tables */
+  if (g_str_has_prefix (uuid, "CRYPT-LUKS") || g_str_has_prefix (uuid, "CRYPT-TCRYPT"))
+    return UDISKS_LINUX_DEVICE_DM_TYPE_CRYPT;
+  if (g_str_has_prefix (uuid, "mpath-"))
+    return UDISKS_LINUX_DEVICE_DM_TYPE_MULTIPATH;
+  if (g_str_has_prefix (uuid, "LVM-"))
+    return UDISKS_LINUX_DEVICE_DM_TYPE_LVM;
+  if (g_str_has_prefix (uuid, "VDO-"))
+    return UDISKS_LINUX_DEVICE_DM_TYPE_VDO;
+
+  return UDISKS_LINUX_DEVICE_DM_TYPE_OTHER;
+}
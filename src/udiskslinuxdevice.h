@@ -32,8 +32,9 @@ G_BEGIN_DECLS
 /**
  * UDisksLinuxDevice:
  * @udev_device: A #GUdevDevice.
- * @ata_identify_device_data: 512-byte array containing the result of the IDENTIY DEVICE command or %NULL.
- * @ata_identify_packet_device_data: 512-byte array containing the result of the IDENTIY PACKET DEVICE command or %NULL.
+ * @ata_identify_device_data: 512-byte array containing the result of the IDENTIY DEVICE command or %NULL. Read-only, see udisks_linux_device_set_ata_identify_data().
+ * @ata_identify_packet_device_data: 512-byte array containing the result of the IDENTIY PACKET DEVICE command or %NULL. Read-only, see udisks_linux_device_set_ata_identify_data().
+ * @dm_uuid: The UUID of the device-mapper table or %NULL if not a device-mapper device or the table has no UUID.
  *
  * Object containing information about a device on Linux. This is
  * essentially an instance of #GUdevDevice plus additional data - such
@@ -48,13 +49,43 @@ struct _UDisksLinuxDevice
   GUdevDevice *udev_device;
   guchar *ata_identify_device_data;
   guchar *ata_identify_packet_device_data;
+  gchar *dm_uuid;
 };
 
+/**
+ * UDisksLinuxDeviceDMType:
+ * @UDISKS_LINUX_DEVICE_DM_TYPE_NONE: Not a device-mapper device.
+ * @UDISKS_LINUX_DEVICE_DM_TYPE_OTHER: A device-mapper device not covered by the other types.
+ * @UDISKS_LINUX_DEVICE_DM_TYPE_CRYPT: A LUKS or TrueCrypt mapping set up by cryptsetup.
+ * @UDISKS_LINUX_DEVICE_DM_TYPE_MULTIPATH: A multipath device.
+ * @UDISKS_LINUX_DEVICE_DM_TYPE_LVM: A LVM2 logical volume or one of its internal layers.
+ * @UDISKS_LINUX_DEVICE_DM_TYPE_VDO: A VDO volume.
+ *
+ * The owner of the table of a device-mapper device.
+ */
+typedef enum
+{
+  UDISKS_LINUX_DEVICE_DM_TYPE_NONE,
+  UDISKS_LINUX_DEVICE_DM_TYPE_OTHER,
+  UDISKS_LINUX_DEVICE_DM_TYPE_CRYPT,
+  UDISKS_LINUX_DEVICE_DM_TYPE_MULTIPATH,
+  UDISKS_LINUX_DEVICE_DM_TYPE_LVM,
+  UDISKS_LINUX_DEVICE_DM_TYPE_VDO
+} UDisksLinuxDeviceDMType;
+
 GType              udisks_linux_device_get_type     (void) G_GNUC_CONST;
 UDisksLinuxDevice *udisks_linux_device_new_sync     (GUdevDevice *udev_device);
+UDisksLinuxDevice *udisks_linux_device_new_from_snapshot_sync (GUdevDevice         *udev_device,
+                                                               UDisksProbeSnapshot *snapshot,
+                                                               gboolean            *out_restored);
 gboolean           udisks_linux_device_reprobe_sync (UDisksLinuxDevice  *device,
                                                      GCancellable       *cancellable,
                                                      GError            **error);
+void               udisks_linux_device_set_ata_identify_data (UDisksLinuxDevice *device,
+                                                              gboolean           packet,
+                                                              const guchar      *data);
+gboolean           udisks_linux_device_is_passive   (UDisksLinuxDevice  *device);
+UDisksLinuxDeviceDMType udisks_linux_device_get_dm_type (UDisksLinuxDevice *device);
 
 G_END_DECLS
 
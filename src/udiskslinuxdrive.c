@@ -46,9 +46,13 @@
 #include "udiskslinuxprovider.h"
 #include "udiskslinuxdriveobject.h"
 #include "udiskslinuxdrive.h"
+#include "udiskslinuxdriveata.h"
+#include "udiskslinuxdrivenvme.h"
+#include "udiskslinuxenclosureobject.h"
 #include "udiskslinuxblockobject.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udiskslinuxdevice.h"
 
 /**
@@ -103,8 +107,6 @@ udisks_linux_drive_finalize (GObject *object)
 static void
 udisks_linux_drive_init (UDisksLinuxDrive *drive)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (drive),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
@@ -114,6 +116,8 @@ udisks_linux_drive_class_init (UDisksLinuxDriveClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize     = udisks_linux_drive_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -217,12 +221,23 @@ typedef struct {
   const GVariantType *type;
 } VariantKeyfileMapping;
 
-static const VariantKeyfileMapping drive_configuration_mapping[5] = {
+static const VariantKeyfileMapping drive_configuration_mapping[15] = {
   {"ata-pm-standby",             "ATA", "StandbyTimeout",       G_VARIANT_TYPE_INT32},
   {"ata-apm-level",              "ATA", "APMLevel",             G_VARIANT_TYPE_INT32},
   {"ata-aam-level",              "ATA", "AAMLevel",             G_VARIANT_TYPE_INT32},
   {"ata-write-cache-enabled",    "ATA", "WriteCacheEnabled",    G_VARIANT_TYPE_BOOLEAN},
   {"ata-read-lookahead-enabled", "ATA", "ReadLookaheadEnabled", G_VARIANT_TYPE_BOOLEAN},
+  {"queue-scheduler",            "Queue", "Scheduler",          G_VARIANT_TYPE_STRING},
+  {"queue-nr-requests",          "Queue", "NumRequests",        G_VARIANT_TYPE_UINT32},
+  {"queue-read-ahead-kb",        "Queue", "ReadAheadKB",        G_VARIANT_TYPE_UINT32},
+  {"queue-max-sectors-kb",       "Queue", "MaxSectorsKB",       G_VARIANT_TYPE_UINT32},
+  {"queue-rotational",           "Queue", "Rotational",         G_VARIANT_TYPE_BOOLEAN},
+  /* applied by the bcache module to the bcache devices backed by the drive */
+  {"bcache-sequential-cutoff",            "Bcache", "SequentialCutoff",          G_VARIANT_TYPE_UINT32},
+  {"bcache-writeback-percent",            "Bcache", "WritebackPercent",          G_VARIANT_TYPE_UINT32},
+  {"bcache-writeback-running",            "Bcache", "WritebackRunning",          G_VARIANT_TYPE_BOOLEAN},
+  {"bcache-congested-read-threshold-us",  "Bcache", "CongestedReadThresholdUs",  G_VARIANT_TYPE_UINT32},
+  {"bcache-congested-write-threshold-us", "Bcache", "CongestedWriteThresholdUs", G_VARIANT_TYPE_UINT32},
 };
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -308,6 +323,39 @@ update_configuration (UDisksLinuxDrive       *drive,
               g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_int32 (int_value));
             }
         }
+      else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_UINT32))
+        {
+          guint64 uint_value = g_key_file_get_uint64 (key_file, mapping->group, mapping->key, &error);
+          if (error == NULL && uint_value > G_MAXUINT32)
+            g_set_error (&error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                         "Value %" G_GUINT64_FORMAT " out of range", uint_value);
+          if (error != NULL)
+            {
+              udisks_critical ("Error parsing uint32 key %s in group %s in drive config file %s: %s (%s, %d)",
+                            mapping->key, mapping->group, path,
+                            error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_uint32 (uint_value));
+            }
+        }
+      else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_STRING))
+        {
+          gchar *str_value = g_key_file_get_string (key_file, mapping->group, mapping->key, &error);
+          if (error != NULL)
+            {
+              udisks_critical ("Error parsing string key %s in group %s in drive config file %s: %s (%s, %d)",
+                            mapping->key, mapping->group, path,
+                            error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
+          else
+            {
+              g_variant_builder_add (&builder, "{sv}", mapping->asv_key, g_variant_new_take_string (str_value));
+            }
+        }
       else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_BOOLEAN))
         {
           gboolean bool_value = g_key_file_get_boolean (key_file, mapping->group, mapping->key, &error);
@@ -607,6 +655,28 @@ set_connection_bus (UDisksDrive       *iface,
   g_free (sibling_id);
 }
 
+static void
+set_enclosure (UDisksDrive       *iface,
+               UDisksLinuxDevice *device)
+{
+  gchar *object_path = NULL;
+  gchar *slot = NULL;
+
+  if (udisks_linux_enclosure_object_find_slot (g_udev_device_get_sysfs_path (device->udev_device),
+                                               &object_path, &slot))
+    {
+      udisks_drive_set_enclosure (iface, object_path);
+      udisks_drive_set_enclosure_slot (iface, slot);
+    }
+  else
+    {
+      udisks_drive_set_enclosure (iface, "/");
+      udisks_drive_set_enclosure_slot (iface, "");
+    }
+  g_free (object_path);
+  g_free (slot);
+}
+
 static void
 set_media_time_detected (UDisksLinuxDrive  *drive,
                          UDisksLinuxDevice *device,
@@ -687,6 +757,26 @@ append_fixedup_sd (const gchar *prefix,
   return g_string_free (str, FALSE);
 }
 
+/**
+ * udisks_linux_drive_reload_configuration:
+ * @drive: A #UDisksLinuxDrive.
+ * @object: The enclosing #UDisksLinuxDriveObject instance.
+ *
+ * Reads the drive configuration file again and updates the
+ * #UDisksDrive:configuration property, leaving the rest of the
+ * interface alone.
+ *
+ * Returns: %TRUE if configuration has changed, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_drive_reload_configuration (UDisksLinuxDrive       *drive,
+                                         UDisksLinuxDriveObject *object)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_DRIVE (drive), FALSE);
+
+  return update_configuration (drive, object);
+}
+
 /**
  * udisks_linux_drive_update:
  * @drive: A #UDisksLinuxDrive.
@@ -878,6 +968,7 @@ udisks_linux_drive_update (UDisksLinuxDrive       *drive,
   set_media (iface, device, is_pc_floppy_drive);
   set_rotation_rate (iface, device);
   set_connection_bus (iface, device);
+  set_enclosure (iface, device);
 
   if (udisks_drive_get_media_removable (iface) ||
       g_strcmp0 (udisks_drive_get_connection_bus (iface), "usb") == 0 ||
@@ -1067,56 +1158,36 @@ handle_eject (UDisksDrive           *_drive,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static gboolean
-handle_set_configuration (UDisksDrive           *_drive,
-                          GDBusMethodInvocation *invocation,
-                          GVariant              *configuration,
-                          GVariant              *options)
+/**
+ * udisks_linux_drive_set_configuration_sync:
+ * @drive: A #UDisksLinuxDrive.
+ * @configuration: The new configuration, see the #UDisksDrive:configuration property.
+ * @error: Return location for error or %NULL.
+ *
+ * Writes @configuration to the configuration file of @drive, removing
+ * the known keys not in @configuration. The file monitor of the
+ * provider picks up the change and applies it to the drive.
+ *
+ * Returns: %TRUE if the file was written, %FALSE with @error set otherwise.
+ */
+gboolean
+udisks_linux_drive_set_configuration_sync (UDisksLinuxDrive  *drive,
+                                           GVariant          *configuration,
+                                           GError           **error)
 {
-  UDisksLinuxDrive *drive = UDISKS_LINUX_DRIVE (_drive);
-  UDisksDaemon *daemon;
-  UDisksLinuxDriveObject *object;
-  const gchar *action_id;
-  const gchar *message;
   GKeyFile *key_file = NULL;
-  GError *error = NULL;
+  GError *local_error = NULL;
   gchar *path = NULL;
   gchar *data = NULL;
   gsize data_len;
+  gboolean ret = FALSE;
   guint n;
 
-  object = udisks_daemon_util_dup_object (drive, &error);
-  if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
-
-  daemon = udisks_linux_drive_object_get_daemon (object);
-
-  /* Translators: Shown in authentication dialog when the user
-   * changes settings for a drive.
-   *
-   * Do not translate $(drive), it's a placeholder and will be
-   * replaced by the name of the drive/device in question
-   */
-  message = N_("Authentication is required to configure settings for $(drive)");
-  action_id = "org.freedesktop.udisks2.modify-drive-settings";
-
-  /* Check that the user is actually authorized */
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    UDISKS_OBJECT (object),
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
-    goto out;
-
   path = configuration_get_path (drive);
   if (path == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Drive has no persistent unique id");
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Drive has no persistent unique id");
       goto out;
     }
 
@@ -1124,11 +1195,11 @@ handle_set_configuration (UDisksDrive           *_drive,
   if (!g_key_file_load_from_file (key_file,
                                   path,
                                   G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
-                                  &error))
+                                  &local_error))
     {
-      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      if (!g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
         {
-          g_dbus_method_invocation_take_error (invocation, error);
+          g_propagate_error (error, local_error);
           goto out;
         }
       /* not a problem, just create a new file */
@@ -1137,7 +1208,7 @@ handle_set_configuration (UDisksDrive           *_drive,
                               NULL, /* key */
                               " See udisks(8) for the format of this file.",
                               NULL);
-      g_clear_error (&error);
+      g_clear_error (&local_error);
     }
 
   for (n = 0; n < G_N_ELEMENTS (drive_configuration_mapping); n++)
@@ -1156,6 +1227,14 @@ handle_set_configuration (UDisksDrive           *_drive,
             {
               g_key_file_set_integer (key_file, mapping->group, mapping->key, g_variant_get_int32 (value));
             }
+          else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_UINT32))
+            {
+              g_key_file_set_uint64 (key_file, mapping->group, mapping->key, g_variant_get_uint32 (value));
+            }
+          else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_STRING))
+            {
+              g_key_file_set_string (key_file, mapping->group, mapping->key, g_variant_get_string (value, NULL));
+            }
           else if (g_variant_type_equal (mapping->type, G_VARIANT_TYPE_BOOLEAN))
             {
               g_key_file_set_boolean (key_file, mapping->group, mapping->key, g_variant_get_boolean (value));
@@ -1164,6 +1243,7 @@ handle_set_configuration (UDisksDrive           *_drive,
             {
               g_assert_not_reached ();
             }
+          g_variant_unref (value);
         }
     }
 
@@ -1173,21 +1253,69 @@ handle_set_configuration (UDisksDrive           *_drive,
                                              data,
                                              data_len,
                                              0600, /* mode to use if non-existant */
-                                             &error))
+                                             error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  g_free (data);
+  g_free (path);
+  if (key_file != NULL)
+    g_key_file_free (key_file);
+  return ret;
+}
+
+static gboolean
+handle_set_configuration (UDisksDrive           *_drive,
+                          GDBusMethodInvocation *invocation,
+                          GVariant              *configuration,
+                          GVariant              *options)
+{
+  UDisksLinuxDrive *drive = UDISKS_LINUX_DRIVE (_drive);
+  UDisksDaemon *daemon;
+  UDisksLinuxDriveObject *object;
+  const gchar *action_id;
+  const gchar *message;
+  GError *error = NULL;
+
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
     {
       g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
 
+  daemon = udisks_linux_drive_object_get_daemon (object);
+
+  /* Translators: Shown in authentication dialog when the user
+   * changes settings for a drive.
+   *
+   * Do not translate $(drive), it's a placeholder and will be
+   * replaced by the name of the drive/device in question
+   */
+  message = N_("Authentication is required to configure settings for $(drive)");
+  action_id = "org.freedesktop.udisks2.modify-drive-settings";
+
+  /* Check that the user is actually authorized */
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    UDISKS_OBJECT (object),
+                                                    action_id,
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  if (!udisks_linux_drive_set_configuration_sync (drive, configuration, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
 
   udisks_drive_complete_set_configuration (UDISKS_DRIVE (drive), invocation);
 
  out:
-  g_free (data);
-  g_free (path);
   g_clear_object (&object);
-  if (key_file != NULL)
-    g_key_file_free (key_file);
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
@@ -1323,69 +1451,125 @@ send_scsi_start_stop_unit_command_sync (gint      fd,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* refuses if the drive - or one of its siblings - appears to be in use */
 static gboolean
-handle_power_off (UDisksDrive           *_drive,
-                  GDBusMethodInvocation *invocation,
-                  GVariant              *options)
+check_not_in_use (UDisksLinuxDriveObject  *object,
+                  GList                   *sibling_objects,
+                  GError                 **error)
 {
-  UDisksLinuxDrive *drive = UDISKS_LINUX_DRIVE (_drive);
+  GList *l;
+
+  if (!udisks_linux_drive_object_is_not_in_use (object, NULL, error))
+    {
+      g_prefix_error (error, "The drive in use: ");
+      return FALSE;
+    }
+  for (l = sibling_objects; l != NULL; l = l->next)
+    {
+      UDisksLinuxDriveObject *sibling_object = UDISKS_LINUX_DRIVE_OBJECT (l->data);
+
+      if (sibling_object == object)
+        continue;
+      if (!udisks_linux_drive_object_is_not_in_use (sibling_object, NULL, error))
+        {
+          g_prefix_error (error, "A drive that is part of the same device is in use: ");
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+sync_block (UDisksBlock  *block,
+            GError      **error)
+{
+  const gchar *device_file;
+  gint device_fd;
+
+  device_file = udisks_block_get_device (block);
+  device_fd = open (device_file, O_RDONLY|O_NONBLOCK|O_EXCL);
+  if (device_fd == -1)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error opening %s for fsync: %m",
+                   device_file);
+      return FALSE;
+    }
+  if (fsync (device_fd) != 0)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error syncing  %s: %m",
+                   device_file);
+      close (device_fd);
+      return FALSE;
+    }
+  if (close (device_fd) != 0)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error closing %s (after syncing): %m",
+                   device_file);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Powers off the device @object and its @sibling_objects are part of,
+ * the caller has to check that they are not in use.
+ *
+ * runs in thread dedicated to handling @invocation or in a thread
+ * powering off one of the devices of a bulk request */
+static gboolean
+power_off (UDisksLinuxDriveObject   *object,
+           GList                    *sibling_objects,
+           GDBusMethodInvocation    *invocation,
+           GVariant                 *options,
+           uid_t                     caller_uid,
+           UDisksBulkAuthorization  *bulk,
+           GError                  **error)
+{
+  UDisksDaemon *daemon;
   UDisksLinuxDevice *device = NULL;
-  gchar *remove_path = NULL;
-  FILE *f;
-  GUdevDevice *usb_device = NULL;
-  UDisksLinuxDriveObject *object;
   UDisksLinuxBlockObject *block_object = NULL;
+  UDisksBlock *block;
+  GUdevDevice *usb_device = NULL;
   GList *blocks_to_sync = NULL;
-  UDisksBlock *block = NULL;
-  UDisksDaemon *daemon = NULL;
+  GList *l;
+  gchar *remove_path = NULL;
   const gchar *action_id;
   const gchar *message;
-  gchar *error_message = NULL;
-  GError *error = NULL;
-  uid_t caller_uid;
-  GList *sibling_objects = NULL, *l;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+  FILE *f;
   gint fd = -1;
 
-  object = udisks_daemon_util_dup_object (drive, &error);
-  if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
-
   daemon = udisks_linux_drive_object_get_daemon (object);
   block_object = udisks_linux_drive_object_get_block (object, FALSE);
   if (block_object == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Unable to find block device for drive");
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Unable to find block device for drive");
       goto out;
     }
   block = udisks_object_peek_block (UDISKS_OBJECT (block_object));
   blocks_to_sync = g_list_prepend (blocks_to_sync, g_object_ref (block));
 
-  sibling_objects = udisks_linux_drive_object_get_siblings (object);
-
-  /* refuse if drive - or one of its siblings - appears to be in use */
-  if (!udisks_linux_drive_object_is_not_in_use (object, NULL, &error))
-    {
-      g_prefix_error (&error, "The drive in use: ");
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
   for (l = sibling_objects; l != NULL; l = l->next)
     {
       UDisksLinuxDriveObject *sibling_object = UDISKS_LINUX_DRIVE_OBJECT (l->data);
       UDisksLinuxBlockObject *sibling_block_object;
 
-      if (!udisks_linux_drive_object_is_not_in_use (sibling_object, NULL, &error))
-        {
-          g_prefix_error (&error, "A drive that is part of the same device is in use: ");
-          g_dbus_method_invocation_take_error (invocation, error);
-          goto out;
-        }
+      if (sibling_object == object)
+        continue;
 
       sibling_block_object = udisks_linux_drive_object_get_block (sibling_object, FALSE); /* get_hw */
       if (sibling_block_object != NULL)
@@ -1397,18 +1581,6 @@ handle_power_off (UDisksDrive           *_drive,
         }
     }
 
-  error = NULL;
-  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
-                                               invocation,
-                                               NULL /* GCancellable */,
-                                               &caller_uid,
-                                               &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
-
   /* Translators: Shown in authentication dialog when the user
    * requests ejecting media from a drive.
    *
@@ -1427,50 +1599,21 @@ handle_power_off (UDisksDrive           *_drive,
     }
 
   /* Check that the user is actually authorized */
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    UDISKS_OBJECT (block_object),
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
+  if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                         UDISKS_OBJECT (block_object),
+                                                         action_id,
+                                                         options,
+                                                         message,
+                                                         invocation,
+                                                         bulk,
+                                                         error))
     goto out;
 
   /* sync all block devices */
   for (l = blocks_to_sync; l != NULL ; l = l->next)
     {
-      UDisksBlock *block_to_sync = UDISKS_BLOCK (l->data);
-      const gchar *device_file;
-      gint device_fd;
-      device_file = udisks_block_get_device (block_to_sync);
-      device_fd = open (device_file, O_RDONLY|O_NONBLOCK|O_EXCL);
-      if (device_fd == -1)
-        {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error opening %s for fsync: %m",
-                                                 device_file);
-          goto out;
-        }
-      if (fsync (device_fd) != 0)
-        {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error syncing  %s: %m",
-                                                 device_file);
-          close (device_fd);
-          goto out;
-        }
-      if (close (device_fd) != 0)
-        {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error closing %s (after syncing): %m",
-                                                 device_file);
-          goto out;
-        }
+      if (!sync_block (UDISKS_BLOCK (l->data), error))
+        goto out;
     }
 
   /* Send the "SCSI SYNCHRONIZE CACHE" and then the "SCSI START STOP
@@ -1482,20 +1625,20 @@ handle_power_off (UDisksDrive           *_drive,
   fd = open (udisks_block_get_device (block), O_RDONLY|O_NONBLOCK|O_EXCL);
   if (fd == -1)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error opening %s for cache synchronize: %m",
-                                             udisks_block_get_device (block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error opening %s for cache synchronize: %m",
+                   udisks_block_get_device (block));
       goto out;
     }
 
-  if (!send_scsi_synchronize_cache_command_sync (fd, &error))
+  if (!send_scsi_synchronize_cache_command_sync (fd, &local_error))
     {
       udisks_warning ("Ignoring SCSI command SYNCHRONIZE CACHE failure (%s) on %s",
-                      error->message,
+                      local_error->message,
                       udisks_block_get_device (block));
-      g_clear_error (&error);
+      g_clear_error (&local_error);
     }
   else
     {
@@ -1503,12 +1646,12 @@ handle_power_off (UDisksDrive           *_drive,
                      udisks_block_get_device (block));
     }
 
-  if (!send_scsi_start_stop_unit_command_sync (fd, &error))
+  if (!send_scsi_start_stop_unit_command_sync (fd, &local_error))
     {
       udisks_warning ("Ignoring SCSI command START STOP UNIT failure (%s) on %s",
-                      error->message,
+                      local_error->message,
                       udisks_block_get_device (block));
-      g_clear_error (&error);
+      g_clear_error (&local_error);
     }
   else
     {
@@ -1518,11 +1661,12 @@ handle_power_off (UDisksDrive           *_drive,
 
   if (close (fd) != 0)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error closing %s: %m",
-                                             udisks_block_get_device (block));
+      fd = -1;
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error closing %s: %m",
+                   udisks_block_get_device (block));
       goto out;
     }
   fd = -1;
@@ -1530,19 +1674,19 @@ handle_power_off (UDisksDrive           *_drive,
   device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
   if (device == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "No device");
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "No device");
       goto out;
     }
   usb_device = g_udev_device_get_parent_with_subsystem (device->udev_device, "usb", "usb_device");
   if (usb_device == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "No usb device");
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "No usb device");
       goto out;
     }
 
@@ -1551,11 +1695,11 @@ handle_power_off (UDisksDrive           *_drive,
   f = fopen (remove_path, "w");
   if (f == NULL)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error opening %s for device removal: %m",
-                                             remove_path);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error opening %s for device removal: %m",
+                   remove_path);
       goto out;
     }
   else
@@ -1563,11 +1707,11 @@ handle_power_off (UDisksDrive           *_drive,
       gchar contents[1] = {'1'};
       if (fwrite (contents, 1, 1, f) != 1)
         {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error writing to sysfs file %s: %m",
-                                                 remove_path);
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error writing to sysfs file %s: %m",
+                       remove_path);
           fclose (f);
           goto out;
         }
@@ -1577,7 +1721,7 @@ handle_power_off (UDisksDrive           *_drive,
                  udisks_block_get_device (block),
                  remove_path);
 
-  udisks_drive_complete_power_off (UDISKS_DRIVE (drive), invocation);
+  ret = TRUE;
 
  out:
   if (fd != -1)
@@ -1588,18 +1732,479 @@ handle_power_off (UDisksDrive           *_drive,
         }
     }
   g_list_free_full (blocks_to_sync, g_object_unref);
-  g_list_free_full (sibling_objects, g_object_unref);
   g_free (remove_path);
   g_clear_object (&usb_device);
   g_clear_object (&device);
   g_clear_object (&block_object);
-  g_free (error_message);
+  return ret;
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_power_off (UDisksDrive           *_drive,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksLinuxDrive *drive = UDISKS_LINUX_DRIVE (_drive);
+  UDisksLinuxDriveObject *object;
+  UDisksDaemon *daemon = NULL;
+  GError *error = NULL;
+  uid_t caller_uid;
+  GList *sibling_objects = NULL;
+
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_drive_object_get_daemon (object);
+  sibling_objects = udisks_linux_drive_object_get_siblings (object);
+
+  if (!check_not_in_use (object, sibling_objects, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (!power_off (object, sibling_objects, invocation, options, caller_uid, NULL /* bulk */, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_complete_power_off (UDISKS_DRIVE (drive), invocation);
+
+ out:
+  g_list_free_full (sibling_objects, g_object_unref);
   g_clear_object (&object);
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* the requested drives that are part of the same device */
+typedef struct
+{
+  UDisksLinuxDriveObject *object;
+  GList                  *sibling_objects;
+  /* the index of the first item of the group, the others are skipped */
+  guint                   first_index;
+} PowerOffGroup;
+
+typedef struct
+{
+  GDBusMethodInvocation  *invocation;
+  GVariant               *options;
+  uid_t                   caller_uid;
+  /* the group of every item or NULL */
+  PowerOffGroup         **groups;
+} PowerOffData;
+
+static void
+power_off_group_free (PowerOffGroup *group)
+{
+  g_object_unref (group->object);
+  g_list_free_full (group->sibling_objects, g_object_unref);
+  g_free (group);
+}
+
+/* runs in a thread of the pool of udisks_daemon_util_bulk_call_run() */
+static void
+power_off_group_func (UDisksBulkCall  *call,
+                      guint            index,
+                      gpointer         user_data,
+                      GError         **error)
+{
+  PowerOffData *power_off_data = user_data;
+  PowerOffGroup *group = power_off_data->groups[index];
+
+  power_off (group->object,
+             group->sibling_objects,
+             power_off_data->invocation,
+             power_off_data->options,
+             power_off_data->caller_uid,
+             udisks_daemon_util_bulk_call_get_authorization (call),
+             error);
+}
+
+/* Finds the siblings of all the groups keyed by a sibling id in
+ * @groups_by_sibling_id in one walk over the objects */
+static void
+find_siblings (UDisksDaemon *daemon,
+               GHashTable   *groups_by_sibling_id)
+{
+  GDBusObjectManagerServer *object_manager;
+  GList *objects;
+  GList *l;
+
+  if (g_hash_table_size (groups_by_sibling_id) == 0)
+    return;
+
+  object_manager = udisks_daemon_get_object_manager (daemon);
+  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (object_manager));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksDrive *drive;
+      PowerOffGroup *group;
+
+      if (!UDISKS_IS_LINUX_DRIVE_OBJECT (l->data))
+        continue;
+      drive = udisks_object_peek_drive (UDISKS_OBJECT (l->data));
+      if (drive == NULL)
+        continue;
+
+      group = g_hash_table_lookup (groups_by_sibling_id, udisks_drive_get_sibling_id (drive));
+      if (group != NULL)
+        group->sibling_objects = g_list_prepend (group->sibling_objects, g_object_ref (l->data));
+    }
+  g_list_free_full (objects, g_object_unref);
+}
+
+/**
+ * udisks_linux_drive_power_off_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.PowerOffDrives() call.
+ * @drives: The object paths of the drives to power off.
+ * @options: The options of the call.
+ * @error: Return location for error or %NULL.
+ *
+ * Powers off @drives, see the documentation of the
+ * Manager.PowerOffDrives() method. The drives that are part of the same
+ * device are powered off together and the devices are powered off in
+ * parallel, sharing the polkit checks with identical details. Runs in
+ * the thread handling @invocation.
+ *
+ * Returns: A floating #GVariant of type <literal>a(oss)</literal> with the results
+ * or %NULL if @error is set.
+ */
+GVariant *
+udisks_linux_drive_power_off_many (UDisksDaemon          *daemon,
+                                   GDBusMethodInvocation *invocation,
+                                   const gchar *const    *drives,
+                                   GVariant              *options,
+                                   GError               **error)
+{
+  UDisksBulkCall *call;
+  PowerOffData power_off_data;
+  GHashTable *groups_by_key;
+  GHashTable *groups_by_sibling_id;
+  GPtrArray *groups;
+  GVariant *ret;
+  guint num_items;
+  guint n;
+
+  call = udisks_daemon_util_bulk_call_new (options,
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests powering off several drives at once.
+                                            */
+                                           N_("Authentication is required to power off drives"),
+                                           FALSE,
+                                           error);
+  if (call == NULL)
+    return NULL;
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &power_off_data.caller_uid,
+                                               error))
+    {
+      udisks_daemon_util_bulk_call_free (call);
+      return NULL;
+    }
+
+  num_items = g_strv_length ((gchar **) drives);
+  power_off_data.invocation = invocation;
+  power_off_data.options = options;
+  power_off_data.groups = g_new0 (PowerOffGroup *, num_items);
+
+  /* the groups are keyed by the sibling id or the object path for drives without siblings */
+  groups_by_key = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  groups_by_sibling_id = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  groups = g_ptr_array_new_with_free_func ((GDestroyNotify) power_off_group_free);
+
+  for (n = 0; n < num_items; n++)
+    {
+      UDisksObject *object;
+      UDisksDrive *drive = NULL;
+      const gchar *sibling_id = NULL;
+      const gchar *key;
+      PowerOffGroup *group;
+
+      udisks_daemon_util_bulk_call_add (call, drives[n]);
+      if (udisks_daemon_util_bulk_call_get_error (call, n) != NULL)
+        continue;
+
+      object = udisks_daemon_find_object (daemon, drives[n]);
+      if (object != NULL && UDISKS_IS_LINUX_DRIVE_OBJECT (object))
+        drive = udisks_object_peek_drive (object);
+      if (drive == NULL)
+        {
+          udisks_daemon_util_bulk_call_take_error (call, n,
+                                                   g_error_new (UDISKS_ERROR,
+                                                                UDISKS_ERROR_FAILED,
+                                                                "No drive for object %s",
+                                                                drives[n]));
+          g_clear_object (&object);
+          continue;
+        }
+
+      sibling_id = udisks_drive_get_sibling_id (drive);
+      if (sibling_id != NULL && strlen (sibling_id) == 0)
+        sibling_id = NULL;
+      key = sibling_id != NULL ? sibling_id : drives[n];
+
+      group = g_hash_table_lookup (groups_by_key, key);
+      if (group == NULL)
+        {
+          group = g_new0 (PowerOffGroup, 1);
+          group->object = UDISKS_LINUX_DRIVE_OBJECT (g_object_ref (object));
+          group->first_index = n;
+          g_ptr_array_add (groups, group);
+          g_hash_table_insert (groups_by_key, g_strdup (key), group);
+          if (sibling_id != NULL)
+            g_hash_table_insert (groups_by_sibling_id, g_strdup (sibling_id), group);
+        }
+      else
+        {
+          /* powered off together with the first item of the group */
+          udisks_daemon_util_bulk_call_skip (call, n);
+        }
+      power_off_data.groups[n] = group;
+      g_object_unref (object);
+    }
+
+  find_siblings (daemon, groups_by_sibling_id);
+
+  /* check all the drives before powering off any of them */
+  for (n = 0; n < groups->len; n++)
+    {
+      PowerOffGroup *group = g_ptr_array_index (groups, n);
+      GError *group_error = NULL;
+
+      if (!check_not_in_use (group->object, group->sibling_objects, &group_error))
+        udisks_daemon_util_bulk_call_take_error (call, group->first_index, group_error);
+    }
+
+  udisks_daemon_util_bulk_call_run (call, power_off_group_func, &power_off_data);
+
+  /* the other items of a group share the result of its first item */
+  for (n = 0; n < num_items; n++)
+    {
+      PowerOffGroup *group = power_off_data.groups[n];
+      const GError *group_error;
+
+      if (group == NULL || group->first_index == n)
+        continue;
+      group_error = udisks_daemon_util_bulk_call_get_error (call, group->first_index);
+      if (group_error != NULL)
+        udisks_daemon_util_bulk_call_take_error (call, n, g_error_copy (group_error));
+    }
+
+  ret = udisks_daemon_util_bulk_call_build_results (call, NULL, NULL);
+
+  g_free (power_off_data.groups);
+  g_hash_table_unref (groups_by_sibling_id);
+  g_hash_table_unref (groups_by_key);
+  g_ptr_array_unref (groups);
+  udisks_daemon_util_bulk_call_free (call);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  GDBusMethodInvocation  *invocation;
+  GVariant               *options;
+  uid_t                   caller_uid;
+  gboolean                enhanced;
+  const gchar            *sanitize_action;
+  /* the drive object of every item or NULL */
+  UDisksObject          **objects;
+} SecureEraseData;
+
+/* runs in a thread of the pool of udisks_daemon_util_bulk_call_run() */
+static void
+secure_erase_item_func (UDisksBulkCall  *call,
+                        guint            index,
+                        gpointer         user_data,
+                        GError         **error)
+{
+  SecureEraseData *erase_data = user_data;
+  UDisksObject *object = erase_data->objects[index];
+  UDisksDaemon *daemon;
+  UDisksDriveAta *ata;
+  UDisksDriveNVMe *nvme;
+
+  daemon = udisks_linux_drive_object_get_daemon (UDISKS_LINUX_DRIVE_OBJECT (object));
+  ata = udisks_object_peek_drive_ata (object);
+  nvme = udisks_object_peek_drive_nvme (object);
+
+  if (ata != NULL)
+    {
+      /* Translators: Shown in authentication dialog when the user
+       * requests erasing a hard disk using the SECURE ERASE UNIT command.
+       *
+       * Do not translate $(drive), it's a placeholder and
+       * will be replaced by the name of the drive/device in question
+       */
+      if (udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                            object,
+                                                            "org.freedesktop.udisks2.ata-secure-erase",
+                                                            erase_data->options,
+                                                            N_("Authentication is required to perform a secure erase of $(drive)"),
+                                                            erase_data->invocation,
+                                                            udisks_daemon_util_bulk_call_get_authorization (call),
+                                                            error))
+        udisks_linux_drive_ata_secure_erase_sync (UDISKS_LINUX_DRIVE_ATA (ata),
+                                                  erase_data->caller_uid,
+                                                  erase_data->enhanced,
+                                                  error);
+    }
+  else if (nvme != NULL)
+    {
+      /* Translators: Shown in authentication dialog when the user
+       * requests sanitizing an NVMe drive.
+       *
+       * Do not translate $(drive), it's a placeholder and
+       * will be replaced by the name of the drive/device in question
+       */
+      if (udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                            object,
+                                                            "org.freedesktop.udisks2.nvme-sanitize",
+                                                            erase_data->options,
+                                                            N_("Authentication is required to sanitize $(drive)"),
+                                                            erase_data->invocation,
+                                                            udisks_daemon_util_bulk_call_get_authorization (call),
+                                                            error))
+        udisks_linux_drive_nvme_sanitize_sync (UDISKS_LINUX_DRIVE_NVME (nvme),
+                                               erase_data->caller_uid,
+                                               erase_data->sanitize_action,
+                                               error);
+    }
+}
+
+/**
+ * udisks_linux_drive_secure_erase_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.SecureEraseDrives() call.
+ * @drives: The object paths of the drives to erase.
+ * @options: The options of the call.
+ * @error: Return location for error or %NULL.
+ *
+ * Securely erases @drives in parallel, see the documentation of the
+ * Manager.SecureEraseDrives() method. Every drive is erased through
+ * its own command queue and job, sharing the polkit checks with
+ * identical details. Runs in the thread handling @invocation until all the drives
+ * are done.
+ *
+ * Returns: A floating #GVariant of type <literal>a(oss)</literal> with the results
+ * or %NULL if @error is set.
+ */
+GVariant *
+udisks_linux_drive_secure_erase_many (UDisksDaemon          *daemon,
+                                      GDBusMethodInvocation *invocation,
+                                      const gchar *const    *drives,
+                                      GVariant              *options,
+                                      GError               **error)
+{
+  UDisksBulkCall *call;
+  SecureEraseData erase_data;
+  GVariant *ret;
+  guint num_items;
+  guint n;
+
+  call = udisks_daemon_util_bulk_call_new (options,
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests securely erasing several drives at once.
+                                            */
+                                           N_("Authentication is required to securely erase drives"),
+                                           FALSE,
+                                           error);
+  if (call == NULL)
+    return NULL;
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &erase_data.caller_uid,
+                                               error))
+    {
+      udisks_daemon_util_bulk_call_free (call);
+      return NULL;
+    }
+
+  num_items = g_strv_length ((gchar **) drives);
+  erase_data.invocation = invocation;
+  erase_data.options = options;
+  erase_data.enhanced = FALSE;
+  erase_data.sanitize_action = "block-erase";
+  g_variant_lookup (options, "enhanced", "b", &erase_data.enhanced);
+  g_variant_lookup (options, "sanitize-action", "&s", &erase_data.sanitize_action);
+  erase_data.objects = g_new0 (UDisksObject *, num_items);
+
+  for (n = 0; n < num_items; n++)
+    {
+      UDisksObject *object;
+
+      udisks_daemon_util_bulk_call_add (call, drives[n]);
+      if (udisks_daemon_util_bulk_call_get_error (call, n) != NULL)
+        continue;
+
+      object = udisks_daemon_find_object (daemon, drives[n]);
+      if (object == NULL || !UDISKS_IS_LINUX_DRIVE_OBJECT (object) ||
+          udisks_object_peek_drive (object) == NULL)
+        {
+          udisks_daemon_util_bulk_call_take_error (call, n,
+                                                   g_error_new (UDISKS_ERROR,
+                                                                UDISKS_ERROR_FAILED,
+                                                                "No drive for object %s",
+                                                                drives[n]));
+          g_clear_object (&object);
+          continue;
+        }
+      if (udisks_object_peek_drive_ata (object) == NULL &&
+          udisks_object_peek_drive_nvme (object) == NULL)
+        {
+          udisks_daemon_util_bulk_call_take_error (call, n,
+                                                   g_error_new (UDISKS_ERROR,
+                                                                UDISKS_ERROR_NOT_SUPPORTED,
+                                                                "Drive %s is neither an ATA nor an NVMe drive",
+                                                                drives[n]));
+          g_object_unref (object);
+          continue;
+        }
+      erase_data.objects[n] = object;
+    }
+
+  udisks_daemon_util_bulk_call_run (call, secure_erase_item_func, &erase_data);
+
+  ret = udisks_daemon_util_bulk_call_build_results (call, NULL, NULL);
+
+  for (n = 0; n < num_items; n++)
+    g_clear_object (&erase_data.objects[n]);
+  g_free (erase_data.objects);
+  udisks_daemon_util_bulk_call_free (call);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 drive_iface_init (UDisksDriveIface *iface)
 {
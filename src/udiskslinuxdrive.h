@@ -33,6 +33,21 @@ GType        udisks_linux_drive_get_type (void) G_GNUC_CONST;
 UDisksDrive *udisks_linux_drive_new      (void);
 gboolean     udisks_linux_drive_update   (UDisksLinuxDrive       *drive,
                                           UDisksLinuxDriveObject *object);
+gboolean     udisks_linux_drive_reload_configuration (UDisksLinuxDrive       *drive,
+                                                      UDisksLinuxDriveObject *object);
+gboolean     udisks_linux_drive_set_configuration_sync (UDisksLinuxDrive  *drive,
+                                                        GVariant          *configuration,
+                                                        GError           **error);
+GVariant    *udisks_linux_drive_power_off_many (UDisksDaemon          *daemon,
+                                                GDBusMethodInvocation *invocation,
+                                                const gchar *const    *drives,
+                                                GVariant              *options,
+                                                GError               **error);
+GVariant    *udisks_linux_drive_secure_erase_many (UDisksDaemon          *daemon,
+                                                   GDBusMethodInvocation *invocation,
+                                                   const gchar *const    *drives,
+                                                   GVariant              *options,
+                                                   GError               **error);
 
 G_END_DECLS
 
@@ -41,15 +41,20 @@
 #include "udiskslogging.h"
 #include "udiskslinuxprovider.h"
 #include "udiskslinuxdriveobject.h"
+#include "udiskslinuxmanager.h"
 #include "udiskslinuxdriveata.h"
 #include "udiskslinuxblockobject.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
+#include "udisksmetrics.h"
+#include "udiskssysfsreader.h"
 #include "udisksbasejob.h"
 #include "udiskssimplejob.h"
 #include "udisksthreadedjob.h"
 #include "udisksata.h"
 #include "udiskslinuxdevice.h"
+#include "udiskstrace.h"
 
 /**
  * SECTION:udiskslinuxdriveata
@@ -84,14 +89,54 @@ struct _UDisksLinuxDriveAta
   gint         smart_selftest_percent_remaining;
 
   GVariant    *smart_attributes;
+  /* 'ay' with the IDs of the attributes that changed in the last update */
+  GVariant    *smart_updated_attributes;
+  /* last data read from the drive, used to tell if smart_attributes changed */
+  UDisksAtaSmartData smart_data;
+  gboolean     smart_data_valid;
 
   UDisksThreadedJob *selftest_job;
 
   gboolean     secure_erase_in_progress;
   unsigned long drive_read, drive_write;
+  /* keeps the stat attribute open for update_io_stats() */
+  UDisksSysfsReader *stat_reader;
   gboolean     standby_enabled;
+  /* number of SMART refreshes skipped so as not to wake up the drive, protected by object_lock */
+  guint64      smart_wakeups_avoided;
+
+  /* ATA commands are sent through this so a hung drive can't block the caller indefinitely */
+  UDisksAtaCommandQueue *command_queue;
+
+  /* long-lived fd for polling the drive, protected by device_fd_lock */
+  GMutex       device_fd_lock;
+  gint         device_fd;
+  gchar       *device_fd_file;
+
+  /* result of the last CHECK POWER MODE, also protected by device_fd_lock */
+  gboolean     pm_state_valid;
+  guchar       pm_state;
+  gint64       pm_state_time;
+
+  /* configuration apply queue, see udisks_linux_drive_ata_apply_configuration(),
+   * protected by object_lock */
+  GVariant          *apply_pending;
+  UDisksLinuxDevice *apply_pending_device;
+  gboolean           apply_pending_force;
+  gboolean           apply_queued;
+  /* the configuration applied last, NULL if none has been applied yet */
+  GVariant          *applied_configuration;
+  /* the device the configuration was applied through last, its IDENTIFY
+   * data predates the settings sent to the drive */
+  UDisksLinuxDevice *applied_device;
 };
 
+/* How long the power state of a drive may be reused for e.g. filesystem
+ * updates, which would otherwise send CHECK POWER MODE for every
+ * partition of the drive.
+ */
+#define PM_STATE_MAX_AGE_USEC (10 * G_USEC_PER_SEC)
+
 struct _UDisksLinuxDriveAtaClass
 {
   UDisksDriveAtaSkeletonClass parent_class;
@@ -113,6 +158,23 @@ udisks_linux_drive_ata_finalize (GObject *object)
 
   if (drive->smart_attributes != NULL)
     g_variant_unref (drive->smart_attributes);
+  if (drive->smart_updated_attributes != NULL)
+    g_variant_unref (drive->smart_updated_attributes);
+  if (drive->apply_pending != NULL)
+    g_variant_unref (drive->apply_pending);
+  g_clear_object (&drive->apply_pending_device);
+  g_clear_object (&drive->applied_device);
+  if (drive->applied_configuration != NULL)
+    g_variant_unref (drive->applied_configuration);
+
+  if (drive->device_fd != -1)
+    close (drive->device_fd);
+  g_free (drive->device_fd_file);
+  g_mutex_clear (&drive->device_fd_lock);
+
+  udisks_ata_command_queue_free (drive->command_queue);
+  if (drive->stat_reader != NULL)
+    udisks_sysfs_reader_free (drive->stat_reader);
 
   if (G_OBJECT_CLASS (udisks_linux_drive_ata_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (udisks_linux_drive_ata_parent_class)->finalize (object);
@@ -122,8 +184,9 @@ udisks_linux_drive_ata_finalize (GObject *object)
 static void
 udisks_linux_drive_ata_init (UDisksLinuxDriveAta *drive)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (drive),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&drive->device_fd_lock);
+  drive->device_fd = -1;
+  drive->command_queue = udisks_ata_command_queue_new ();
 }
 
 static void
@@ -133,6 +196,8 @@ udisks_linux_drive_ata_class_init (UDisksLinuxDriveAtaClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize = udisks_linux_drive_ata_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -151,11 +216,64 @@ udisks_linux_drive_ata_new (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* called with drive->device_fd_lock held
+ *
+ * Returns the cached fd for @device, (re)opening it if it was closed
+ * or belongs to a different device file.
+ */
+static gint
+get_device_fd (UDisksLinuxDriveAta  *drive,
+               UDisksLinuxDevice    *device,
+               GError              **error)
+{
+  const gchar *device_file;
+
+  device_file = g_udev_device_get_device_file (device->udev_device);
+  if (drive->device_fd != -1 && g_strcmp0 (drive->device_fd_file, device_file) == 0)
+    goto out;
+
+  if (drive->device_fd != -1)
+    close (drive->device_fd);
+  g_free (drive->device_fd_file);
+  drive->device_fd_file = NULL;
+
+  drive->device_fd = open (device_file, O_RDONLY|O_NONBLOCK);
+  if (drive->device_fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening device file %s: %m",
+                   device_file);
+      goto out;
+    }
+  drive->device_fd_file = g_strdup (device_file);
+
+ out:
+  return drive->device_fd;
+}
+
+static void
+close_device_fd (UDisksLinuxDriveAta *drive)
+{
+  g_mutex_lock (&drive->device_fd_lock);
+  if (drive->device_fd != -1)
+    {
+      close (drive->device_fd);
+      drive->device_fd = -1;
+    }
+  g_free (drive->device_fd_file);
+  drive->device_fd_file = NULL;
+  g_mutex_unlock (&drive->device_fd_lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 /* may be called from *any* thread when the SMART data has been updated */
 static void
-update_smart (UDisksLinuxDriveAta *drive,
-              UDisksLinuxDevice   *device)
+update_smart (UDisksLinuxDriveAta    *drive,
+              UDisksLinuxDriveObject *object,
+              UDisksLinuxDevice      *device)
 {
+  UDisksLinuxDriveHealth health;
   gboolean supported = FALSE;
   gboolean enabled = FALSE;
   guint64 updated = 0;
@@ -167,6 +285,7 @@ update_smart (UDisksLinuxDriveAta *drive,
   gint num_attributes_failing = -1;
   gint num_attributes_failed_in_the_past = -1;
   gint64 num_bad_sectors = 1;
+  GVariant *updated_attributes = NULL;
   guint16 word_82 = 0;
   guint16 word_85 = 0;
 
@@ -190,11 +309,15 @@ update_smart (UDisksLinuxDriveAta *drive,
       num_bad_sectors = drive->smart_num_bad_sectors;
       selftest_status = drive->smart_selftest_status;
       selftest_percent_remaining = drive->smart_selftest_percent_remaining;
+      if (drive->smart_updated_attributes != NULL)
+        updated_attributes = g_variant_ref (drive->smart_updated_attributes);
     }
   G_UNLOCK (object_lock);
 
   if (selftest_status == NULL)
     selftest_status = "";
+  if (updated_attributes == NULL)
+    updated_attributes = g_variant_ref_sink (g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, NULL, 0, 1));
 
   g_object_freeze_notify (G_OBJECT (drive));
   udisks_drive_ata_set_smart_supported (UDISKS_DRIVE_ATA (drive), supported);
@@ -208,7 +331,19 @@ update_smart (UDisksLinuxDriveAta *drive,
   udisks_drive_ata_set_smart_num_bad_sectors (UDISKS_DRIVE_ATA (drive), num_bad_sectors);
   udisks_drive_ata_set_smart_selftest_status (UDISKS_DRIVE_ATA (drive), selftest_status);
   udisks_drive_ata_set_smart_selftest_percent_remaining (UDISKS_DRIVE_ATA (drive), selftest_percent_remaining);
+  udisks_drive_ata_set_smart_updated_attributes (UDISKS_DRIVE_ATA (drive), updated_attributes);
   g_object_thaw_notify (G_OBJECT (drive));
+
+  g_variant_unref (updated_attributes);
+
+  if (updated > 0)
+    {
+      health.failing = failing;
+      health.attributes_failing = num_attributes_failing > 0;
+      health.temperature = temperature;
+      health.num_bad_sectors = MAX (num_bad_sectors, 0);
+    }
+  udisks_linux_drive_object_report_health (object, updated > 0 ? &health : NULL);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -329,11 +464,17 @@ udisks_linux_drive_ata_update (UDisksLinuxDriveAta    *drive,
                                UDisksLinuxDriveObject *object)
 {
   UDisksLinuxDevice *device;
+
+  /* the device may have been reset, replaced or removed - don't
+   * keep polling through a stale fd
+   */
+  close_device_fd (drive);
+
   device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
   if (device == NULL)
     goto out;
 
-  update_smart (drive, device);
+  update_smart (drive, object, device);
   update_pm (drive, device);
   update_security (drive, device);
 
@@ -434,8 +575,9 @@ selftest_status_to_string (SkSmartSelfTestExecutionStatus status)
   return ret;
 }
 
+/* A @max_age_usec of 0 always asks the drive */
 static gboolean
-get_pm_state (UDisksLinuxDevice *device, GError **error, guchar *count)
+get_pm_state (UDisksLinuxDriveAta *drive, UDisksLinuxDevice *device, gint64 max_age_usec, GError **error, guchar *count)
 {
   int fd;
   gboolean rc = FALSE;
@@ -443,52 +585,84 @@ get_pm_state (UDisksLinuxDevice *device, GError **error, guchar *count)
   UDisksAtaCommandInput input = {.command = 0xe5};
   UDisksAtaCommandOutput output = {0};
 
-  fd = open (g_udev_device_get_device_file (device->udev_device), O_RDONLY|O_NONBLOCK);
+  g_mutex_lock (&drive->device_fd_lock);
+
+  if (max_age_usec > 0 && drive->pm_state_valid &&
+      g_get_monotonic_time () - drive->pm_state_time < max_age_usec)
+    {
+      *count = drive->pm_state;
+      rc = TRUE;
+      goto out;
+    }
+
+  fd = get_device_fd (drive, device, error);
   if (fd == -1)
     {
-      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                   "Error opening device file %s while getting PM state: %m",
-                   g_udev_device_get_device_file (device->udev_device));
+      g_prefix_error (error, "Error getting PM state: ");
       goto out;
     }
 
-  if (!udisks_ata_send_command_sync (fd,
-                                     -1,
-                                     UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                     &input,
-                                     &output,
-                                     error))
+  if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                           fd,
+                                           -1,
+                                           UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                           &input,
+                                           &output,
+                                           NULL,
+                                           error))
     {
       g_prefix_error (error, "Error sending ATA command CHECK POWER MODE: ");
       goto out;
     }
   /* count field is used for the state, see ATA8: table 102 */
   *count = output.count;
+  drive->pm_state = output.count;
+  drive->pm_state_time = g_get_monotonic_time ();
+  drive->pm_state_valid = TRUE;
   rc = TRUE;
  out:
-  if (fd != -1)
-    close (fd);
+  g_mutex_unlock (&drive->device_fd_lock);
   return rc;
 }
 
+static void
+invalidate_pm_state (UDisksLinuxDriveAta *drive)
+{
+  g_mutex_lock (&drive->device_fd_lock);
+  drive->pm_state_valid = FALSE;
+  g_mutex_unlock (&drive->device_fd_lock);
+}
+
 static gboolean update_io_stats (UDisksLinuxDriveAta *drive, UDisksLinuxDevice *device)
 {
   const gchar *drivepath = g_udev_device_get_sysfs_path (device->udev_device);
-  gchar statpath[PATH_MAX];
   unsigned long drive_read, drive_write;
-  FILE *statf;
+  UDisksSysfsReader *reader;
+  GError *error = NULL;
+  gchar *stat;
   gboolean noio = FALSE;
-  snprintf (statpath, sizeof(statpath), "%s/stat", drivepath);
-  statf = fopen (statpath, "r");
-  if (statf == NULL)
+
+  /* the stat file is sampled on every SMART refresh, keep it open */
+  G_LOCK (object_lock);
+  if (drive->stat_reader != NULL &&
+      g_strcmp0 (udisks_sysfs_reader_get_sysfs_path (drive->stat_reader), drivepath) != 0)
+    g_clear_pointer (&drive->stat_reader, udisks_sysfs_reader_free);
+  if (drive->stat_reader == NULL)
+    drive->stat_reader = udisks_sysfs_reader_new (drivepath);
+  reader = drive->stat_reader;
+  stat = udisks_sysfs_reader_read (reader, "stat", &error);
+  G_UNLOCK (object_lock);
+
+  if (stat == NULL)
     {
-      udisks_warning ("Failed to open %s\n", statpath);
+      udisks_warning ("Failed to read %s/stat: %s", drivepath, error->message);
+      g_clear_error (&error);
     }
   else
     {
-      if (fscanf (statf, "%lu %*u %*u %*u %lu", &drive_read, &drive_write) != 2)
+      if (sscanf (stat, "%lu %*u %*u %*u %lu", &drive_read, &drive_write) != 2)
         {
-          udisks_warning ("Failed to read %s\n", statpath);
+          udisks_warning ("Failed to parse %s/stat\n", drivepath);
         }
       else
         {
@@ -498,11 +672,141 @@ static gboolean update_io_stats (UDisksLinuxDriveAta *drive, UDisksLinuxDevice *
           drive->drive_read = drive_read;
           drive->drive_write = drive_write;
         }
-      fclose (statf);
+      g_free (stat);
     }
   return noio;
 }
 
+/* Derives the summary values from SMART data read from the drive */
+static void
+summarize_smart_data (const UDisksAtaSmartData *data,
+                      guint64                  *out_temp_mkelvin,
+                      guint64                  *out_power_on_msec,
+                      guint64                  *out_num_bad_sectors,
+                      gint                     *out_num_attributes_failing,
+                      gint                     *out_num_attributes_failed_in_the_past)
+{
+  guint64 temp_mkelvin[3] = {0, 0, 0};
+  guint n;
+
+  *out_power_on_msec = 0;
+  *out_num_bad_sectors = 0;
+  *out_num_attributes_failing = 0;
+  *out_num_attributes_failed_in_the_past = 0;
+
+  for (n = 0; n < data->num_attributes; n++)
+    {
+      const UDisksAtaSmartAttribute *a = &data->attributes[n];
+      UDisksAtaSmartUnit unit;
+      guint64 pretty;
+
+      pretty = udisks_ata_smart_attribute_get_pretty (a, &unit);
+      switch (a->id)
+        {
+        case 194: /* temperature-celsius-2 */
+          temp_mkelvin[0] = pretty;
+          break;
+        case 190: /* airflow-temperature-celsius */
+          temp_mkelvin[1] = pretty;
+          break;
+        case 231: /* temperature-celsius */
+          temp_mkelvin[2] = pretty;
+          break;
+        case 9:   /* power-on-hours */
+          *out_power_on_msec = pretty;
+          break;
+        case 5:   /* reallocated-sector-count */
+        case 197: /* current-pending-sector */
+          *out_num_bad_sectors += pretty;
+          break;
+        default:
+          break;
+        }
+
+      if (a->threshold_valid && a->threshold > 0)
+        {
+          if (a->current_valid && a->current > 0 && a->current <= a->threshold)
+            *out_num_attributes_failing += 1;
+          if (a->worst_valid && a->worst > 0 && a->worst <= a->threshold)
+            *out_num_attributes_failed_in_the_past += 1;
+        }
+    }
+
+  *out_temp_mkelvin = temp_mkelvin[0] != 0 ? temp_mkelvin[0] :
+                      temp_mkelvin[1] != 0 ? temp_mkelvin[1] : temp_mkelvin[2];
+}
+
+/* Returns a floating 'ay' with the IDs of the attributes in @data that
+ * aren't in @old_data (if not %NULL) with the same values
+ */
+static GVariant *
+build_smart_updated_attributes (const UDisksAtaSmartData *old_data,
+                                const UDisksAtaSmartData *data)
+{
+  guint8 ids[UDISKS_ATA_SMART_MAX_ATTRIBUTES];
+  guint num_ids = 0;
+  guint n;
+
+  for (n = 0; n < data->num_attributes; n++)
+    {
+      const UDisksAtaSmartAttribute *a = &data->attributes[n];
+      const UDisksAtaSmartAttribute *old_a = NULL;
+      guint m;
+
+      if (old_data != NULL)
+        {
+          /* the order is normally stable, so check the same slot first */
+          if (n < old_data->num_attributes && old_data->attributes[n].id == a->id)
+            old_a = &old_data->attributes[n];
+          for (m = 0; old_a == NULL && m < old_data->num_attributes; m++)
+            if (old_data->attributes[m].id == a->id)
+              old_a = &old_data->attributes[m];
+        }
+
+      if (old_a == NULL || memcmp (old_a, a, sizeof (UDisksAtaSmartAttribute)) != 0)
+        ids[num_ids++] = a->id;
+    }
+
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, ids, num_ids, 1);
+}
+
+static GVariant *
+build_smart_attributes (const UDisksAtaSmartData *data)
+{
+  GVariantBuilder builder;
+  guint n;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ysqiiixia{sv})"));
+  for (n = 0; n < data->num_attributes; n++)
+    {
+      const UDisksAtaSmartAttribute *a = &data->attributes[n];
+      const gchar *name;
+      gchar name_buf[32];
+      UDisksAtaSmartUnit unit;
+      guint64 pretty;
+
+      name = udisks_ata_smart_attribute_get_name (a);
+      if (name == NULL)
+        {
+          g_snprintf (name_buf, sizeof name_buf, "attribute-%u", (guint) a->id);
+          name = name_buf;
+        }
+      pretty = udisks_ata_smart_attribute_get_pretty (a, &unit);
+
+      g_variant_builder_add (&builder,
+                             "(ysqiiixia{sv})",
+                             a->id,
+                             name,
+                             a->flags,
+                             a->current_valid ? (gint) a->current : -1,
+                             a->worst_valid ? (gint) a->worst : -1,
+                             a->threshold_valid ? (gint) a->threshold : -1,
+                             (gint64) pretty, (gint) unit,
+                             NULL); /* expansion unused for now */
+    }
+  return g_variant_builder_end (&builder);
+}
+
 /**
  * udisks_linux_drive_ata_refresh_smart_sync:
  * @drive: The #UDisksLinuxDriveAta to refresh.
@@ -557,6 +861,7 @@ udisks_linux_drive_ata_refresh_smart_sync (UDisksLinuxDriveAta  *drive,
 
   device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
   g_assert (device != NULL);
+  UDISKS_TRACE1 (smart_read_start, g_udev_device_get_device_file (device->udev_device));
 
   /* TODO: use cancellable */
 
@@ -597,14 +902,48 @@ udisks_linux_drive_ata_refresh_smart_sync (UDisksLinuxDriveAta  *drive,
     {
       guchar count;
       gboolean noio = FALSE;
-      if (!get_pm_state (device, error, &count))
-        goto out;
-      awake = count == 0xFF || count == 0x80;
+
+      /* IDENTIFY DEVICE was already issued when probing, don't bother
+       * the drive if it told us SMART is disabled
+       */
+      if (device->ata_identify_device_data != NULL &&
+          !(udisks_ata_identify_get_word (device->ata_identify_device_data, 85) & (1<<0)))
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "SMART is not enabled");
+          goto out;
+        }
+
+      /* Cheapest check first: if the drive has not seen any I/O since
+       * the last sample it is either asleep or about to be put to sleep
+       * by its standby timer, so don't even send CHECK POWER MODE
+       */
       if (drive->standby_enabled)
         noio = update_io_stats (drive, device);
+      if (nowakeup && noio)
+        {
+          udisks_debug ("Skipping SMART refresh for idle drive %s",
+                        g_udev_device_get_device_file (device->udev_device));
+          awake = FALSE;
+        }
+      else
+        {
+          if (!get_pm_state (drive, device, 0, error, &count))
+            goto out;
+          awake = count == 0xFF || count == 0x80;
+        }
       /* don't wake up disk unless specically asked to */
       if (nowakeup && (!awake || noio))
         {
+          guint64 wakeups_avoided;
+
+          G_LOCK (object_lock);
+          wakeups_avoided = ++drive->smart_wakeups_avoided;
+          G_UNLOCK (object_lock);
+          udisks_drive_ata_set_smart_wakeups_avoided (UDISKS_DRIVE_ATA (drive), wakeups_avoided);
+
           g_set_error (error,
                        UDISKS_ERROR,
                        UDISKS_ERROR_WOULD_WAKEUP,
@@ -613,74 +952,145 @@ udisks_linux_drive_ata_refresh_smart_sync (UDisksLinuxDriveAta  *drive,
         }
     }
 
-  if (sk_disk_open (g_udev_device_get_device_file (device->udev_device), &d) != 0)
+  if (d != NULL)
     {
-      g_set_error (error,
-                   UDISKS_ERROR,
-                   UDISKS_ERROR_FAILED,
-                   "sk_disk_open: %m");
-      goto out;
-    }
+      /* the blob is in the libatasmart format, so let it do the parsing */
+      if (sk_disk_smart_read_data (d) != 0)
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "sk_disk_smart_read_data: %m");
+          goto out;
+        }
 
-  if (sk_disk_smart_read_data (d) != 0)
-    {
-      g_set_error (error,
-                   UDISKS_ERROR,
-                   UDISKS_ERROR_FAILED,
-                   "sk_disk_smart_read_data: %m");
-      goto out;
-    }
+      if (sk_disk_smart_status (d, &good) != 0)
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "sk_disk_smart_status: %m");
+          goto out;
+        }
 
-  if (sk_disk_smart_status (d, &good) != 0)
-    {
-      g_set_error (error,
-                   UDISKS_ERROR,
-                   UDISKS_ERROR_FAILED,
-                   "sk_disk_smart_status: %m");
-      goto out;
-    }
+      if (sk_disk_smart_parse (d, &data) != 0)
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "sk_disk_smart_parse: %m");
+          goto out;
+        }
 
-  if (sk_disk_smart_parse (d, &data) != 0)
-    {
-      g_set_error (error,
-                   UDISKS_ERROR,
-                   UDISKS_ERROR_FAILED,
-                   "sk_disk_smart_parse: %m");
-      goto out;
+      /* don't care if these are failing or not */
+      sk_disk_smart_get_temperature (d, &temp_mkelvin);
+      sk_disk_smart_get_power_on (d, &power_on_msec);
+      sk_disk_smart_get_bad (d, &num_bad_sectors);
+
+      memset (&parse_data, 0, sizeof (ParseData));
+      g_variant_builder_init (&parse_data.builder, G_VARIANT_TYPE ("a(ysqiiixia{sv})"));
+      sk_disk_smart_parse_attributes (d, parse_attr_cb, &parse_data);
+
+      G_LOCK (object_lock);
+      drive->smart_is_from_blob = TRUE;
+      drive->smart_updated = time (NULL);
+      drive->smart_failing = !good;
+      drive->smart_temperature = temp_mkelvin / 1000.0;
+      drive->smart_power_on_seconds = power_on_msec / 1000.0;
+      drive->smart_num_attributes_failing = parse_data.num_attributes_failing;
+      drive->smart_num_attributes_failed_in_the_past = parse_data.num_attributes_failed_in_the_past;
+      drive->smart_num_bad_sectors = num_bad_sectors;
+      drive->smart_selftest_status = selftest_status_to_string (data->self_test_execution_status);
+      drive->smart_selftest_percent_remaining = data->self_test_execution_percent_remaining;
+      if (drive->smart_attributes != NULL)
+        g_variant_unref (drive->smart_attributes);
+      drive->smart_attributes = g_variant_ref_sink (g_variant_builder_end (&parse_data.builder));
+      /* serialized here, in the thread refreshing the data, so that the replies just copy it */
+      g_variant_get_data (drive->smart_attributes);
+      if (drive->smart_updated_attributes != NULL)
+        g_variant_unref (drive->smart_updated_attributes);
+      drive->smart_updated_attributes = NULL;
+      drive->smart_data_valid = FALSE;
+      G_UNLOCK (object_lock);
     }
+  else
+    {
+      UDisksAtaSmartData smart_data;
+      gboolean failing = FALSE;
+      gint num_attributes_failing;
+      gint num_attributes_failed_in_the_past;
+      gint fd;
 
-  /* don't care if these are failing or not */
-  sk_disk_smart_get_temperature (d, &temp_mkelvin);
-  sk_disk_smart_get_power_on (d, &power_on_msec);
-  sk_disk_smart_get_bad (d, &num_bad_sectors);
+      /* IDENTIFY DEVICE data is already known - just read the SMART
+       * pages through the same fd used for CHECK POWER MODE
+       */
+      g_mutex_lock (&drive->device_fd_lock);
+      fd = get_device_fd (drive, device, error);
+      if (fd == -1 ||
+          !udisks_ata_smart_read_sync (drive->command_queue, fd, &smart_data, cancellable, error) ||
+          !udisks_ata_smart_return_status_sync (drive->command_queue, fd, &failing, cancellable, error))
+        {
+          g_mutex_unlock (&drive->device_fd_lock);
+          goto out;
+        }
+      g_mutex_unlock (&drive->device_fd_lock);
 
-  memset (&parse_data, 0, sizeof (ParseData));
-  g_variant_builder_init (&parse_data.builder, G_VARIANT_TYPE ("a(ysqiiixia{sv})"));
-  sk_disk_smart_parse_attributes (d, parse_attr_cb, &parse_data);
+      summarize_smart_data (&smart_data,
+                            &temp_mkelvin,
+                            &power_on_msec,
+                            &num_bad_sectors,
+                            &num_attributes_failing,
+                            &num_attributes_failed_in_the_past);
 
-  G_LOCK (object_lock);
-  drive->smart_is_from_blob = (simulate_path != NULL);
-  drive->smart_updated = time (NULL);
-  drive->smart_failing = !good;
-  drive->smart_temperature = temp_mkelvin / 1000.0;
-  drive->smart_power_on_seconds = power_on_msec / 1000.0;
-  drive->smart_num_attributes_failing = parse_data.num_attributes_failing;
-  drive->smart_num_attributes_failed_in_the_past = parse_data.num_attributes_failed_in_the_past;
-  drive->smart_num_bad_sectors = num_bad_sectors;
-  drive->smart_selftest_status = selftest_status_to_string (data->self_test_execution_status);
-  drive->smart_selftest_percent_remaining = data->self_test_execution_percent_remaining;
-  if (drive->smart_attributes != NULL)
-    g_variant_unref (drive->smart_attributes);
-  drive->smart_attributes = g_variant_ref_sink (g_variant_builder_end (&parse_data.builder));
-  G_UNLOCK (object_lock);
+      G_LOCK (object_lock);
+      drive->smart_is_from_blob = FALSE;
+      drive->smart_updated = time (NULL);
+      drive->smart_failing = failing;
+      drive->smart_temperature = temp_mkelvin / 1000.0;
+      drive->smart_power_on_seconds = power_on_msec / 1000.0;
+      drive->smart_num_attributes_failing = num_attributes_failing;
+      drive->smart_num_attributes_failed_in_the_past = num_attributes_failed_in_the_past;
+      drive->smart_num_bad_sectors = num_bad_sectors;
+      drive->smart_selftest_status = selftest_status_to_string (smart_data.self_test_execution_status >> 4);
+      drive->smart_selftest_percent_remaining = (smart_data.self_test_execution_status & 0x0f) * 10;
+      if (drive->smart_updated_attributes != NULL)
+        g_variant_unref (drive->smart_updated_attributes);
+      /* only rebuild the attributes if any of them changed - the
+       * normal case is that nothing did and the same variant is kept
+       */
+      if (drive->smart_attributes == NULL || !drive->smart_data_valid ||
+          drive->smart_data.num_attributes != smart_data.num_attributes ||
+          memcmp (drive->smart_data.attributes, smart_data.attributes, sizeof (smart_data.attributes)) != 0)
+        {
+          if (drive->smart_attributes != NULL)
+            g_variant_unref (drive->smart_attributes);
+          drive->smart_attributes = g_variant_ref_sink (build_smart_attributes (&smart_data));
+          g_variant_get_data (drive->smart_attributes);
+          drive->smart_updated_attributes =
+            g_variant_ref_sink (build_smart_updated_attributes (drive->smart_data_valid ? &drive->smart_data : NULL,
+                                                                &smart_data));
+        }
+      else
+        {
+          drive->smart_updated_attributes =
+            g_variant_ref_sink (g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, NULL, 0, 1));
+        }
+      drive->smart_data = smart_data;
+      drive->smart_data_valid = TRUE;
+      G_UNLOCK (object_lock);
+    }
 
-  update_smart (drive, device);
+  update_smart (drive, object, device);
 
   ret = TRUE;
   /* update stats again to account for the IO we just did to read the SMART info */
   update_io_stats (drive, device);
 
  out:
+  if (device != NULL)
+    {
+      UDISKS_TRACE2 (smart_read_done, g_udev_device_get_device_file (device->udev_device), ret);
+    }
   g_clear_object (&device);
   if (d != NULL)
     sk_disk_free (d);
@@ -910,6 +1320,49 @@ handle_smart_get_attributes (UDisksDriveAta        *_drive,
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
+static gboolean
+handle_smart_get_attributes_fd (UDisksDriveAta        *_drive,
+                                GDBusMethodInvocation *invocation,
+                                GUnixFDList           *fd_list,
+                                GVariant              *options)
+{
+  UDisksLinuxDriveAta *drive = UDISKS_LINUX_DRIVE_ATA (_drive);
+  GVariant *attributes = NULL;
+  GUnixFDList *out_fd_list = NULL;
+  GError *error = NULL;
+
+  G_LOCK (object_lock);
+  if (drive->smart_attributes != NULL)
+    attributes = g_variant_ref (drive->smart_attributes);
+  G_UNLOCK (object_lock);
+
+  if (attributes == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "SMART data not collected");
+      goto out;
+    }
+
+  /* serialized without the lock held, the value is immutable */
+  out_fd_list = udisks_daemon_util_variant_to_fd_list (attributes, &error);
+  if (out_fd_list == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_ata_complete_smart_get_attributes_fd (UDISKS_DRIVE_ATA (drive), invocation,
+                                                     out_fd_list, g_variant_new_handle (0));
+
+ out:
+  g_clear_object (&out_fd_list);
+  if (attributes != NULL)
+    g_variant_unref (attributes);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gboolean
@@ -1034,7 +1487,9 @@ selftest_job_func (UDisksThreadedJob  *job,
       gboolean still_in_progress;
       GPollFD poll_fd;
       gdouble progress;
+      gint64 start_time;
 
+      start_time = g_get_monotonic_time ();
       if (!udisks_linux_drive_ata_refresh_smart_sync (drive,
                                                       FALSE, /* nowakeup */
                                                       NULL,  /* blob */
@@ -1046,6 +1501,11 @@ selftest_job_func (UDisksThreadedJob  *job,
                           (*error)->message, g_quark_to_string ((*error)->domain), (*error)->code);
           goto out;
         }
+      /* the job sleeps in its own thread, count its wakeups with the timers */
+      udisks_metrics_record (udisks_daemon_get_metrics (udisks_linux_drive_object_get_daemon (object)),
+                             UDISKS_METRICS_KIND_TIMER,
+                             "ata-selftest-poll",
+                             g_get_monotonic_time () - start_time);
 
       /* TODO: set estimation properties etc. on the Job object */
 
@@ -1251,33 +1711,11 @@ handle_smart_selftest_start (UDisksDriveAta        *_drive,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/**
- * udisks_linux_drive_ata_get_pm_state:
- * @drive: A #UDisksLinuxDriveAta.
- * @error: Return location for error.
- * @pm_state: Return location for the current power state value.
- *
- * Get the current power mode state.
- *
- * The format of @pm_state is the result obtained from sending the
- * ATA command `CHECK POWER MODE` to the drive.
- *
- * Known values include:
- *  - `0x00`: Device is in PM2: Standby state.
- *  - `0x40`: Device is in the PM0: Active state, the NV Cache power mode is enabled, and the spindle is spun down or spinning down.
- *  - `0x41`: Device is in the PM0: Active state, the NV Cache power mode is enabled, and the spindle is spun up or spinning up.
- *  - `0x80`: Device is in PM1: Idle state.
- *  - `0xff`: Device is in the PM0: Active state or PM1: Idle State.
- *
- * Typically user interfaces will report "Drive is spun down" if @pm_state is
- * 0x00 and "Drive is spun up" otherwise.
- *
- * Returns: %TRUE if the operation succeeded, %FALSE if @error is set.
- */
-gboolean
-udisks_linux_drive_ata_get_pm_state (UDisksLinuxDriveAta  *drive,
-                                     GError              **error,
-                                     guchar               *pm_state)
+static gboolean
+get_pm_state_for_drive (UDisksLinuxDriveAta  *drive,
+                        gint64                max_age_usec,
+                        GError              **error,
+                        guchar               *pm_state)
 {
   UDisksLinuxDriveObject *object;
   UDisksLinuxDevice *device = NULL;
@@ -1315,7 +1753,7 @@ udisks_linux_drive_ata_get_pm_state (UDisksLinuxDriveAta  *drive,
       goto out;
     }
 
-  ret = get_pm_state (device, error, pm_state);
+  ret = get_pm_state (drive, device, max_age_usec, error, pm_state);
 
  out:
   g_clear_object (&device);
@@ -1324,6 +1762,57 @@ udisks_linux_drive_ata_get_pm_state (UDisksLinuxDriveAta  *drive,
   return ret;
 }
 
+/**
+ * udisks_linux_drive_ata_get_pm_state:
+ * @drive: A #UDisksLinuxDriveAta.
+ * @error: Return location for error.
+ * @pm_state: Return location for the current power state value.
+ *
+ * Get the current power mode state.
+ *
+ * The format of @pm_state is the result obtained from sending the
+ * ATA command `CHECK POWER MODE` to the drive.
+ *
+ * Known values include:
+ *  - `0x00`: Device is in PM2: Standby state.
+ *  - `0x40`: Device is in the PM0: Active state, the NV Cache power mode is enabled, and the spindle is spun down or spinning down.
+ *  - `0x41`: Device is in the PM0: Active state, the NV Cache power mode is enabled, and the spindle is spun up or spinning up.
+ *  - `0x80`: Device is in PM1: Idle state.
+ *  - `0xff`: Device is in the PM0: Active state or PM1: Idle State.
+ *
+ * Typically user interfaces will report "Drive is spun down" if @pm_state is
+ * 0x00 and "Drive is spun up" otherwise.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_linux_drive_ata_get_pm_state (UDisksLinuxDriveAta  *drive,
+                                     GError              **error,
+                                     guchar               *pm_state)
+{
+  return get_pm_state_for_drive (drive, 0, error, pm_state);
+}
+
+/**
+ * udisks_linux_drive_ata_get_cached_pm_state:
+ * @drive: A #UDisksLinuxDriveAta.
+ * @error: Return location for error.
+ * @pm_state: Return location for the power state value.
+ *
+ * Like udisks_linux_drive_ata_get_pm_state() but reuses the power state
+ * if it was read from the drive in the last few seconds, e.g. by the
+ * SMART refresh of the housekeeping or for another partition.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_linux_drive_ata_get_cached_pm_state (UDisksLinuxDriveAta  *drive,
+                                            GError              **error,
+                                            guchar               *pm_state)
+{
+  return get_pm_state_for_drive (drive, PM_STATE_MAX_AGE_USEC, error, pm_state);
+}
+
 static gboolean
 handle_pm_get_state (UDisksDriveAta        *_drive,
                      GDBusMethodInvocation *invocation,
@@ -1494,6 +1983,7 @@ handle_pm_standby_wakeup (UDisksDriveAta        *_drive,
                                                  g_udev_device_get_device_file (device->udev_device));
           goto out;
         }
+      invalidate_pm_state (drive);
       udisks_drive_ata_complete_pm_wakeup (_drive, invocation);
    }
   else
@@ -1501,17 +1991,20 @@ handle_pm_standby_wakeup (UDisksDriveAta        *_drive,
      /* ATA8: 7.55 STANDBY IMMEDIATE - E0h, Non-Data */
      UDisksAtaCommandInput input = {.command = 0xe0};
      UDisksAtaCommandOutput output = {0};
-     if (!udisks_ata_send_command_sync (fd,
-                                        -1,
-                                        UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                        &input,
-                                        &output,
-                                        &error))
+     if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                              fd,
+                                              -1,
+                                              UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                              &input,
+                                              &output,
+                                              NULL,
+                                              &error))
       {
         g_prefix_error (&error, "Error sending ATA command STANDBY IMMEDIATE: ");
         g_dbus_method_invocation_take_error (invocation, error);
         goto out;
       }
+     invalidate_pm_state (drive);
      udisks_drive_ata_complete_pm_standby (_drive, invocation);
    }
 
@@ -1600,6 +2093,9 @@ typedef struct
   gboolean ata_write_cache_enabled_set;
   gboolean ata_read_lookahead_enabled;
   gboolean ata_read_lookahead_enabled_set;
+  /* whether the IDENTIFY data of @device can't be trusted to reflect the
+   * current settings of the drive */
+  gboolean reidentify;
   UDisksLinuxDriveAta *ata;
   UDisksLinuxDevice *device;
   GVariant *configuration;
@@ -1618,11 +2114,102 @@ apply_conf_data_free (ApplyConfData *data)
   g_free (data);
 }
 
-static gpointer
-apply_configuration_thread_func (gpointer user_data)
+/* The settings the drive reports in its IDENTIFY DEVICE data, see ATA8:
+ * 7.16 IDENTIFY DEVICE - ECh, PIO Data-In - Table 29 IDENTIFY DEVICE data.
+ * If the feature set is not supported the setting is never current so the
+ * command is sent and fails as before.
+ */
+static gboolean
+apm_level_is_current (const guchar *identify,
+                      gint          level)
+{
+  guint16 word_83 = udisks_ata_identify_get_word (identify, 83);
+  guint16 word_86 = udisks_ata_identify_get_word (identify, 86);
+  guint16 word_91 = udisks_ata_identify_get_word (identify, 91);
+
+  if (!(word_83 & (1<<3)))
+    return FALSE;
+  if (level == 0xff)
+    return !(word_86 & (1<<3));
+  return (word_86 & (1<<3)) && (word_91 & 0xff) == level;
+}
+
+static gboolean
+aam_level_is_current (const guchar *identify,
+                      gint          level)
+{
+  guint16 word_83 = udisks_ata_identify_get_word (identify, 83);
+  guint16 word_86 = udisks_ata_identify_get_word (identify, 86);
+  guint16 word_94 = udisks_ata_identify_get_word (identify, 94);
+
+  if (!(word_83 & (1<<9)))
+    return FALSE;
+  if (level == 0xff)
+    return !(word_86 & (1<<9));
+  return (word_86 & (1<<9)) && (word_94 & 0xff) == level;
+}
+
+static gboolean
+feature_is_current (const guchar *identify,
+                    guint         bit,
+                    gboolean      enabled)
+{
+  guint16 word_82 = udisks_ata_identify_get_word (identify, 82);
+  guint16 word_85 = udisks_ata_identify_get_word (identify, 85);
+
+  if (!(word_82 & (1<<bit)))
+    return FALSE;
+  return !!(word_85 & (1<<bit)) == !!enabled;
+}
+
+/* Gets the IDENTIFY DEVICE data to compare the configuration with. The
+ * cached data is used unless it may be stale, e.g. after a resume, when a
+ * single IDENTIFY DEVICE is sent instead. Returns %NULL if there's no data
+ * in which case all the settings are sent. Free with g_free(). */
+static guchar *
+get_identify_data (ApplyConfData *data,
+                   gint           fd,
+                   const gchar   *device_file)
+{
+  UDisksAtaCommandInput input = {.command = 0xec, .count = 1};
+  UDisksAtaCommandOutput output = {0};
+  GError *error = NULL;
+
+  if (!data->reidentify)
+    {
+      if (data->device->ata_identify_device_data == NULL)
+        return NULL;
+      return g_memdup (data->device->ata_identify_device_data, 512);
+    }
+
+  /* ATA8: 7.16 IDENTIFY DEVICE - ECh, PIO Data-In */
+  output.buffer = g_new0 (guchar, 512);
+  output.buffer_size = 512;
+  if (!udisks_ata_command_queue_send_sync (data->ata->command_queue,
+                                           fd,
+                                           -1,
+                                           UDISKS_ATA_COMMAND_PROTOCOL_DRIVE_TO_HOST,
+                                           &input,
+                                           &output,
+                                           NULL,
+                                           &error))
+    {
+      udisks_debug ("Error sending ATA command IDENTIFY DEVICE to %s, applying all settings: %s (%s, %d)",
+                    device_file, error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      g_free (output.buffer);
+      return NULL;
+    }
+
+  return output.buffer;
+}
+
+/* Called from a thread of the apply pool, sends the commands and frees @data */
+static void
+apply_configuration_sync (ApplyConfData *data)
 {
-  ApplyConfData *data = user_data;
   const gchar *device_file = NULL;
+  guchar *identify = NULL;
   gint fd = -1;
   GError *error = NULL;
 
@@ -1640,17 +2227,49 @@ apply_configuration_thread_func (gpointer user_data)
       goto out;
     }
 
+  /* Only the settings that differ from what the drive reports are sent.
+   * The standby timer can't be read back so it is always set.
+   */
+  identify = get_identify_data (data, fd, device_file);
+  if (identify != NULL)
+    {
+      if (data->ata_apm_level != -1 && apm_level_is_current (identify, data->ata_apm_level))
+        {
+          udisks_debug ("APM level of %s is already %d, skipping", device_file, data->ata_apm_level);
+          data->ata_apm_level = -1;
+        }
+      if (data->ata_aam_level != -1 && aam_level_is_current (identify, data->ata_aam_level))
+        {
+          udisks_debug ("AAM value of %s is already %d, skipping", device_file, data->ata_aam_level);
+          data->ata_aam_level = -1;
+        }
+      if (data->ata_write_cache_enabled_set && feature_is_current (identify, 5, data->ata_write_cache_enabled))
+        {
+          udisks_debug ("Write-Cache of %s is already %s, skipping", device_file,
+                        data->ata_write_cache_enabled ? "enabled" : "disabled");
+          data->ata_write_cache_enabled_set = FALSE;
+        }
+      if (data->ata_read_lookahead_enabled_set && feature_is_current (identify, 6, data->ata_read_lookahead_enabled))
+        {
+          udisks_debug ("Read Look-ahead of %s is already %s, skipping", device_file,
+                        data->ata_read_lookahead_enabled ? "enabled" : "disabled");
+          data->ata_read_lookahead_enabled_set = FALSE;
+        }
+    }
+
   if (data->ata_pm_standby != -1)
     {
       /* ATA8: 7.18 IDLE - E3h, Non-Data */
       UDisksAtaCommandInput input = {.command = 0xe3, .count = data->ata_pm_standby};
       UDisksAtaCommandOutput output = {0};
-      if (!udisks_ata_send_command_sync (fd,
-                                         -1,
-                                         UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                         &input,
-                                         &output,
-                                         &error))
+      if (!udisks_ata_command_queue_send_sync (data->ata->command_queue,
+                                               fd,
+                                               -1,
+                                               UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                               &input,
+                                               &output,
+                                               NULL,
+                                               &error))
         {
           udisks_critical ("Error sending ATA command IDLE (timeout=%d) to %s: %s (%s, %d)",
                         data->ata_pm_standby, device_file,
@@ -1679,12 +2298,14 @@ apply_configuration_thread_func (gpointer user_data)
           input.feature = 0x85;
           input.count = 0x00;
         }
-      if (!udisks_ata_send_command_sync (fd,
-                                         -1,
-                                         UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                         &input,
-                                         &output,
-                                         &error))
+      if (!udisks_ata_command_queue_send_sync (data->ata->command_queue,
+                                               fd,
+                                               -1,
+                                               UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                               &input,
+                                               &output,
+                                               NULL,
+                                               &error))
         {
           udisks_critical ("Error sending ATA command SET FEATURES, sub-command 0x%02x (ata_apm_level=%d) to %s: %s (%s, %d)",
                         (guint) input.feature, data->ata_apm_level, device_file,
@@ -1710,12 +2331,14 @@ apply_configuration_thread_func (gpointer user_data)
           input.feature = 0xc2;
           input.count = 0x00;
         }
-      if (!udisks_ata_send_command_sync (fd,
-                                         -1,
-                                         UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                         &input,
-                                         &output,
-                                         &error))
+      if (!udisks_ata_command_queue_send_sync (data->ata->command_queue,
+                                               fd,
+                                               -1,
+                                               UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                               &input,
+                                               &output,
+                                               NULL,
+                                               &error))
         {
           udisks_critical ("Error sending ATA command SET FEATURES, sub-command 0x%02x (ata_aam_level=%d) to %s: %s (%s, %d)",
                         (guint) input.feature, data->ata_aam_level, device_file,
@@ -1738,12 +2361,14 @@ apply_configuration_thread_func (gpointer user_data)
       UDisksAtaCommandOutput output = {0};
       if (data->ata_write_cache_enabled)
         input.feature = 0x02;
-      if (!udisks_ata_send_command_sync (fd,
-                                         -1,
-                                         UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                         &input,
-                                         &output,
-                                         &error))
+      if (!udisks_ata_command_queue_send_sync (data->ata->command_queue,
+                                               fd,
+                                               -1,
+                                               UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                               &input,
+                                               &output,
+                                               NULL,
+                                               &error))
         {
           udisks_critical ("Error sending ATA command SET FEATURES, sub-command 0x%02x to %s: %s (%s, %d)",
                         (guint) input.feature, device_file,
@@ -1767,12 +2392,14 @@ apply_configuration_thread_func (gpointer user_data)
       UDisksAtaCommandOutput output = {0};
       if (data->ata_read_lookahead_enabled)
         input.feature = 0xaa;
-      if (!udisks_ata_send_command_sync (fd,
-                                         -1,
-                                         UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                         &input,
-                                         &output,
-                                         &error))
+      if (!udisks_ata_command_queue_send_sync (data->ata->command_queue,
+                                               fd,
+                                               -1,
+                                               UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                               &input,
+                                               &output,
+                                               NULL,
+                                               &error))
         {
           udisks_critical ("Error sending ATA command SET FEATURES, sub-command 0x%02x to %s: %s (%s, %d)",
                         (guint) input.feature, device_file,
@@ -1788,25 +2415,44 @@ apply_configuration_thread_func (gpointer user_data)
     }
 
  out:
+  g_free (identify);
   if (fd != -1)
     close (fd);
   apply_conf_data_free (data);
-  return NULL;
 }
 
-/**
- * udisks_linux_drive_ata_apply_configuration:
- * @drive: A #UDisksLinuxDriveAta.
- * @device: A #UDisksLinuxDevice
- * @configuration: The configuration to apply.
- *
- * Spawns a thread to apply @configuration to @drive, if any. Does not
- * wait for the thread to terminate.
- */
-void
-udisks_linux_drive_ata_apply_configuration (UDisksLinuxDriveAta *drive,
-                                            UDisksLinuxDevice   *device,
-                                            GVariant            *configuration)
+/* Returns the settings of @configuration that differ from @applied (all of
+ * them if @applied is %NULL) */
+static GVariant *
+get_changed_settings (GVariant *configuration,
+                      GVariant *applied)
+{
+  GVariantBuilder builder;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+  GVariant *old_value;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_iter_init (&iter, configuration);
+  while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      old_value = applied != NULL ? g_variant_lookup_value (applied, key, NULL) : NULL;
+      if (old_value == NULL || !g_variant_equal (old_value, value))
+        g_variant_builder_add (&builder, "{sv}", key, value);
+      if (old_value != NULL)
+        g_variant_unref (old_value);
+      g_variant_unref (value);
+    }
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/* Returns %NULL if none of the settings in @configuration is set */
+static ApplyConfData *
+apply_conf_data_new (UDisksLinuxDriveAta *drive,
+                     UDisksLinuxDevice   *device,
+                     GVariant            *configuration)
 {
   gboolean has_conf = FALSE;
   ApplyConfData *data = NULL;
@@ -1831,7 +2477,6 @@ udisks_linux_drive_ata_apply_configuration (UDisksLinuxDriveAta *drive,
   if (data->drive == NULL)
     goto out;
 
-
   has_conf |= g_variant_lookup (configuration, "ata-pm-standby", "i", &data->ata_pm_standby);
   has_conf |= g_variant_lookup (configuration, "ata-apm-level", "i", &data->ata_apm_level);
   has_conf |= g_variant_lookup (configuration, "ata-aam-level", "i", &data->ata_aam_level);
@@ -1846,26 +2491,125 @@ udisks_linux_drive_ata_apply_configuration (UDisksLinuxDriveAta *drive,
       has_conf = TRUE;
     }
 
-  /* don't do anything if none of the configuration is set */
+ out:
   if (!has_conf)
-    goto out;
+    {
+      apply_conf_data_free (data);
+      data = NULL;
+    }
+  return data;
+}
 
-  /* this can easily take a long time and thus block (the drive may be in standby mode
-   * and needs to spin up) - so run it in a thread
-   */
-  g_thread_new ("apply-conf-thread",
-                apply_configuration_thread_func,
-                data);
+/* Maximum number of drives configured at the same time */
+#define APPLY_CONFIGURATION_MAX_THREADS 4
 
-  data = NULL; /* don't free data below */
+static GThreadPool *apply_pool = NULL;
 
- out:
-  if (data != NULL)
-    apply_conf_data_free (data);
+/* Runs in a thread of apply_pool, drains the apply queue of a drive */
+static void
+apply_pool_func (gpointer data,
+                 gpointer user_data)
+{
+  UDisksLinuxDriveAta *drive = UDISKS_LINUX_DRIVE_ATA (data);
+  GVariant *configuration;
+  UDisksLinuxDevice *device;
+  GVariant *changed;
+  gboolean force;
+  gboolean reidentify;
+  ApplyConfData *conf_data;
+
+  G_LOCK (object_lock);
+  while (drive->apply_pending != NULL)
+    {
+      configuration = drive->apply_pending;
+      device = drive->apply_pending_device;
+      force = drive->apply_pending_force;
+      drive->apply_pending = NULL;
+      drive->apply_pending_device = NULL;
+      drive->apply_pending_force = FALSE;
+
+      /* settings that are no longer configured are left as they are */
+      changed = get_changed_settings (configuration, force ? NULL : drive->applied_configuration);
+      if (drive->applied_configuration != NULL)
+        g_variant_unref (drive->applied_configuration);
+      drive->applied_configuration = configuration;
+      /* the drive may have lost its settings on suspend and the IDENTIFY data
+       * of a device already applied through doesn't have the new settings */
+      reidentify = force || device == drive->applied_device;
+      g_clear_object (&drive->applied_device);
+      drive->applied_device = g_object_ref (device);
+      G_UNLOCK (object_lock);
+
+      conf_data = apply_conf_data_new (drive, device, changed);
+      if (conf_data != NULL)
+        {
+          conf_data->reidentify = reidentify;
+          apply_configuration_sync (conf_data);
+        }
+      else
+        udisks_debug ("Configuration of %s has not changed since it was applied last, skipping",
+                      g_udev_device_get_device_file (device->udev_device));
+      g_variant_unref (changed);
+      g_object_unref (device);
+
+      G_LOCK (object_lock);
+    }
+  drive->apply_queued = FALSE;
+  G_UNLOCK (object_lock);
+
+  g_object_unref (drive);
+}
+
+/**
+ * udisks_linux_drive_ata_apply_configuration:
+ * @drive: A #UDisksLinuxDriveAta.
+ * @device: A #UDisksLinuxDevice
+ * @configuration: The configuration to apply.
+ * @force: Whether to apply all of @configuration, e.g. because the drive has
+ *   lost its settings on suspend.
+ *
+ * Queues @configuration to be applied to @drive from a thread pool. Does
+ * not wait for it to be applied. Only the settings whose values differ
+ * from the configuration applied last are considered unless @force is
+ * %TRUE and of those, only the ones that differ from the settings the
+ * drive reports in its IDENTIFY DEVICE data are sent to the drive. At
+ * most one configuration per drive waits to be applied, a newer one
+ * replaces it.
+ */
+void
+udisks_linux_drive_ata_apply_configuration (UDisksLinuxDriveAta *drive,
+                                            UDisksLinuxDevice   *device,
+                                            GVariant            *configuration,
+                                            gboolean             force)
+{
+  G_LOCK (object_lock);
+  if (drive->apply_pending != NULL)
+    g_variant_unref (drive->apply_pending);
+  g_clear_object (&drive->apply_pending_device);
+  drive->apply_pending = g_variant_ref (configuration);
+  drive->apply_pending_device = g_object_ref (device);
+  drive->apply_pending_force |= force;
+
+  if (!drive->apply_queued)
+    {
+      /* applying can easily take a long time and thus block (the drive may be
+       * in standby mode and needs to spin up) - so run it in a thread */
+      if (apply_pool == NULL)
+        apply_pool = g_thread_pool_new (apply_pool_func, NULL,
+                                        APPLY_CONFIGURATION_MAX_THREADS,
+                                        FALSE, NULL);
+      drive->apply_queued = TRUE;
+      g_thread_pool_push (apply_pool, g_object_ref (drive), NULL);
+    }
+  G_UNLOCK (object_lock);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* the number of progress updates of a secure erase and the longest interval between them, in seconds */
+#define SECURE_ERASE_PROGRESS_STEPS        200
+#define SECURE_ERASE_PROGRESS_MAX_INTERVAL 30
+
 static gboolean
 on_secure_erase_update_progress_timeout (gpointer user_data)
 {
@@ -1931,6 +2675,7 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
   guint16 word_128;
   UDisksBaseJob *job = NULL;
   gint num_minutes = 0;
+  guint interval;
   guint timeout_id = 0;
   gboolean claimed = FALSE;
   GError *local_error = NULL;
@@ -1996,12 +2741,14 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
     /* ATA8: 7.16 IDENTIFY DEVICE - ECh, PIO Data-In */
     UDisksAtaCommandInput input = {.command = 0xec, .count = 1};
     UDisksAtaCommandOutput output = {.buffer = identify.buf, .buffer_size = sizeof (identify.buf)};
-    if (!udisks_ata_send_command_sync (fd,
-                                       -1,
-                                       UDISKS_ATA_COMMAND_PROTOCOL_DRIVE_TO_HOST,
-                                       &input,
-                                       &output,
-                                       &local_error))
+    if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                             fd,
+                                             -1,
+                                             UDISKS_ATA_COMMAND_PROTOCOL_DRIVE_TO_HOST,
+                                             &input,
+                                             &output,
+                                             NULL,
+                                             &local_error))
       {
         g_prefix_error (&local_error, "Error sending ATA command IDENTIFY DEVICE: ");
         goto out;
@@ -2075,11 +2822,18 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
       udisks_job_set_expected_end_time (UDISKS_JOB (job),
                                         g_get_real_time () + num_minutes * 60LL * G_USEC_PER_SEC);
       udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
-      timeout_id = g_timeout_add_seconds_full (G_PRIORITY_DEFAULT,
-                                               1,
-                                               on_secure_erase_update_progress_timeout,
-                                               g_object_ref (job),
-                                               g_object_unref);
+      /* The progress is only an estimate from the elapsed time, so
+       * there is no point in updating it more often than every half a
+       * percent - erases of many drives at once would otherwise emit a
+       * PropertiesChanged signal per drive every second for hours
+       */
+      interval = CLAMP (num_minutes * 60 / SECURE_ERASE_PROGRESS_STEPS, 1, SECURE_ERASE_PROGRESS_MAX_INTERVAL);
+      timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                           "ata-secure-erase-progress",
+                                                           interval,
+                                                           on_secure_erase_update_progress_timeout,
+                                                           g_object_ref (job),
+                                                           g_object_unref);
     }
 
   /* Second, set the user password to 'xxxx' */
@@ -2090,12 +2844,14 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
     UDisksAtaCommandOutput output = {0};
     memset (buf, 0, sizeof (buf));
     memcpy (buf + 2, pass, strlen (pass));
-    if (!udisks_ata_send_command_sync (fd,
-                                       -1,
-                                       UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE,
-                                       &input,
-                                       &output,
-                                       &local_error))
+    if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                             fd,
+                                             -1,
+                                             UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE,
+                                             &input,
+                                             &output,
+                                             NULL,
+                                             &local_error))
       {
         g_prefix_error (&local_error, "Error sending ATA command SECURITY SET PASSWORD: ");
         goto out;
@@ -2115,12 +2871,14 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
     /* ATA8: 7.42 SECURITY ERASE PREPARE - F3h, Non-Data */
     UDisksAtaCommandInput input = {.command = 0xf3};
     UDisksAtaCommandOutput output = {0};
-    if (!udisks_ata_send_command_sync (fd,
-                                       -1,
-                                       UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                       &input,
-                                       &output,
-                                       &local_error))
+    if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                             fd,
+                                             -1,
+                                             UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                             &input,
+                                             &output,
+                                             NULL,
+                                             &local_error))
       {
         g_prefix_error (&local_error, "Error sending ATA command SECURITY ERASE PREPARE: ");
         goto out;
@@ -2137,12 +2895,16 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
     if (enhanced)
       buf[0] |= 0x02;
     memcpy (buf + 2, pass, strlen (pass));
-    if (!udisks_ata_send_command_sync (fd,
-                                       G_MAXINT, /* disable timeout */
-                                       UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE,
-                                       &input,
-                                       &output,
-                                       &local_error))
+    /* sent through the queue of the drive so any other command for it
+     * waits for the erase instead of timing out on the busy drive */
+    if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                             fd,
+                                             G_MAXINT, /* disable timeout */
+                                             UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE,
+                                             &input,
+                                             &output,
+                                             NULL,
+                                             &local_error))
       {
         g_prefix_error (&local_error, "Error sending ATA command SECURITY ERASE UNIT (enhanced=%d): ",
                         enhanced ? 1 : 0);
@@ -2167,12 +2929,14 @@ udisks_linux_drive_ata_secure_erase_sync (UDisksLinuxDriveAta  *drive,
       GError *cleanup_error = NULL;
       memset (buf, 0, sizeof (buf));
       memcpy (buf + 2, pass, strlen (pass));
-      if (!udisks_ata_send_command_sync (fd,
-                                         -1,
-                                         UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE,
-                                         &input,
-                                         &output,
-                                         &cleanup_error))
+      if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                               fd,
+                                               -1,
+                                               UDISKS_ATA_COMMAND_PROTOCOL_HOST_TO_DRIVE,
+                                               &input,
+                                               &output,
+                                               NULL,
+                                               &cleanup_error))
         {
           udisks_critical ("Failed to clear user password '%s' on %s (%s) while attemping clean-up after a failed secure erase operation. You may need to manually unlock the drive. The error was: %s (%s, %d)",
                         pass,
@@ -2424,12 +3188,14 @@ handle_smart_set_enabled (UDisksDriveAta        *_drive,
     else
       input.feature = 0xd9;
     input.lba = 0x004fc2; /* will be encoded as 0xc2 0x4f 0x00 as per the ATA spec */
-    if (!udisks_ata_send_command_sync (fd,
-                                       -1,
-                                       UDISKS_ATA_COMMAND_PROTOCOL_NONE,
-                                       &input,
-                                       &output,
-                                       &error))
+    if (!udisks_ata_command_queue_send_sync (drive->command_queue,
+                                             fd,
+                                             -1,
+                                             UDISKS_ATA_COMMAND_PROTOCOL_NONE,
+                                             &input,
+                                             &output,
+                                             NULL,
+                                             &error))
       {
         g_prefix_error (&error, "Error sending ATA command SMART, sub-command %s OPERATIONS: ",
                         value ? "ENABLE" : "DISABLE");
@@ -2462,7 +3228,7 @@ handle_smart_set_enabled (UDisksDriveAta        *_drive,
     }
   else
     {
-      update_smart (drive, device);
+      update_smart (drive, object, device);
     }
   /* ensure property changes are sent before the method return */
   g_dbus_interface_skeleton_flush (G_DBUS_INTERFACE_SKELETON (drive));
@@ -2485,6 +3251,7 @@ drive_ata_iface_init (UDisksDriveAtaIface *iface)
 {
   iface->handle_smart_update = handle_smart_update;
   iface->handle_smart_get_attributes = handle_smart_get_attributes;
+  iface->handle_smart_get_attributes_fd = handle_smart_get_attributes_fd;
   iface->handle_smart_selftest_abort = handle_smart_selftest_abort;
   iface->handle_smart_selftest_start = handle_smart_selftest_start;
   iface->handle_smart_set_enabled = handle_smart_set_enabled;
@@ -59,11 +59,15 @@ gboolean        udisks_linux_drive_ata_secure_erase_sync   (UDisksLinuxDriveAta
 
 void            udisks_linux_drive_ata_apply_configuration (UDisksLinuxDriveAta     *drive,
                                                             UDisksLinuxDevice       *device,
-                                                            GVariant                *configuration);
+                                                            GVariant                *configuration,
+                                                            gboolean                 force);
 
 gboolean        udisks_linux_drive_ata_get_pm_state        (UDisksLinuxDriveAta     *drive,
                                                             GError                 **error,
                                                             guchar                  *pm_state);
+gboolean        udisks_linux_drive_ata_get_cached_pm_state (UDisksLinuxDriveAta     *drive,
+                                                            GError                 **error,
+                                                            guchar                  *pm_state);
 
 G_END_DECLS
 
@@ -0,0 +1,341 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "udiskslogging.h"
+#include "udiskslinuxdriveobject.h"
+#include "udiskslinuxdrivemultipath.h"
+#include "udiskslinuxdevice.h"
+
+/**
+ * SECTION:udiskslinuxdrivemultipath
+ * @title: UDisksLinuxDriveMultipath
+ * @short_description: Linux implementation of #UDisksDriveMultipath
+ *
+ * This type provides an implementation of the #UDisksDriveMultipath
+ * interface on Linux.
+ *
+ * The state of the paths in the multipath device is tracked from the
+ * <literal>PATH_FAILED</literal> and <literal>PATH_REINSTATED</literal>
+ * uevents device-mapper emits on the multipath device. All paths are
+ * assumed to be active until a failure is reported.
+ */
+
+typedef struct _UDisksLinuxDriveMultipathClass   UDisksLinuxDriveMultipathClass;
+
+/**
+ * UDisksLinuxDriveMultipath:
+ *
+ * The #UDisksLinuxDriveMultipath structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxDriveMultipath
+{
+  UDisksDriveMultipathSkeleton parent_instance;
+
+  /* set of the device numbers ("major:minor") of the failed paths,
+   * protected by object_lock */
+  GHashTable *failed_paths;
+};
+
+struct _UDisksLinuxDriveMultipathClass
+{
+  UDisksDriveMultipathSkeletonClass parent_class;
+};
+
+G_DEFINE_TYPE (UDisksLinuxDriveMultipath, udisks_linux_drive_multipath, UDISKS_TYPE_DRIVE_MULTIPATH_SKELETON);
+
+G_LOCK_DEFINE_STATIC (object_lock);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+udisks_linux_drive_multipath_finalize (GObject *object)
+{
+  UDisksLinuxDriveMultipath *drive = UDISKS_LINUX_DRIVE_MULTIPATH (object);
+
+  g_hash_table_unref (drive->failed_paths);
+
+  G_OBJECT_CLASS (udisks_linux_drive_multipath_parent_class)->finalize (object);
+}
+
+static void
+udisks_linux_drive_multipath_init (UDisksLinuxDriveMultipath *drive)
+{
+  drive->failed_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+static void
+udisks_linux_drive_multipath_class_init (UDisksLinuxDriveMultipathClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_drive_multipath_finalize;
+}
+
+/**
+ * udisks_linux_drive_multipath_new:
+ *
+ * Creates a new #UDisksLinuxDriveMultipath instance.
+ *
+ * Returns: A new #UDisksLinuxDriveMultipath. Free with g_object_unref().
+ */
+UDisksDriveMultipath *
+udisks_linux_drive_multipath_new (void)
+{
+  return UDISKS_DRIVE_MULTIPATH (g_object_new (UDISKS_TYPE_LINUX_DRIVE_MULTIPATH,
+                                               NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gchar *
+get_path_key (UDisksLinuxDevice *device)
+{
+  dev_t dev = g_udev_device_get_device_number (device->udev_device);
+
+  return g_strdup_printf ("%u:%u", major (dev), minor (dev));
+}
+
+/* Reads the attribute right from sysfs, gudev caches the values of the
+ * attributes for the lifetime of the GUdevDevice */
+static gchar *
+read_sysfs_attr (UDisksLinuxDevice *device,
+                 const gchar       *attr)
+{
+  gchar *path;
+  gchar *contents = NULL;
+
+  path = g_build_filename (g_udev_device_get_sysfs_path (device->udev_device), attr, NULL);
+  if (g_file_get_contents (path, &contents, NULL, NULL))
+    g_strstrip (contents);
+  g_free (path);
+
+  return contents;
+}
+
+static gboolean
+is_path_failed (UDisksLinuxDriveMultipath *drive,
+                UDisksLinuxDevice         *device)
+{
+  gchar *key;
+  gboolean ret;
+
+  key = get_path_key (device);
+  G_LOCK (object_lock);
+  ret = g_hash_table_contains (drive->failed_paths, key);
+  G_UNLOCK (object_lock);
+  g_free (key);
+
+  return ret;
+}
+
+static gboolean
+is_path_usable (gboolean     failed,
+                const gchar *device_state)
+{
+  /* not all transports have a device state */
+  return !failed && (device_state == NULL || g_strcmp0 (device_state, "running") == 0);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_drive_multipath_update:
+ * @drive: A #UDisksLinuxDriveMultipath.
+ * @object: The enclosing #UDisksLinuxDriveObject instance.
+ *
+ * Updates the interface. This may be called from any thread.
+ *
+ * Returns: %TRUE if configuration has changed, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_drive_multipath_update (UDisksLinuxDriveMultipath *drive,
+                                     UDisksLinuxDriveObject    *object)
+{
+  GVariantBuilder builder;
+  GHashTable *keys;
+  GHashTableIter iter;
+  gpointer key;
+  GList *devices;
+  GList *l;
+  const gchar *active_path = NULL;
+
+  keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+
+  devices = udisks_linux_drive_object_get_devices (object);
+  for (l = devices; l != NULL; l = l->next)
+    {
+      UDisksLinuxDevice *device = UDISKS_LINUX_DEVICE (l->data);
+      GVariantBuilder details;
+      gchar *device_state;
+      gchar *stat;
+      gboolean failed;
+
+      if (udisks_linux_device_get_dm_type (device) == UDISKS_LINUX_DEVICE_DM_TYPE_MULTIPATH)
+        continue;
+
+      g_hash_table_add (keys, get_path_key (device));
+      failed = is_path_failed (drive, device);
+      device_state = read_sysfs_attr (device, "device/state");
+
+      g_variant_builder_init (&details, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add (&details, "{sv}", "state",
+                             g_variant_new_string (failed ? "failed" : "active"));
+      if (device_state != NULL)
+        g_variant_builder_add (&details, "{sv}", "device-state", g_variant_new_string (device_state));
+
+      stat = read_sysfs_attr (device, "stat");
+      if (stat != NULL)
+        {
+          guint64 read_ios;
+          guint64 write_ios;
+
+          /* see Documentation/block/stat.txt in the kernel sources */
+          if (sscanf (stat, "%" G_GUINT64_FORMAT " %*s %*s %*s %" G_GUINT64_FORMAT,
+                      &read_ios, &write_ios) == 2)
+            {
+              g_variant_builder_add (&details, "{sv}", "read-ios", g_variant_new_uint64 (read_ios));
+              g_variant_builder_add (&details, "{sv}", "write-ios", g_variant_new_uint64 (write_ios));
+            }
+          g_free (stat);
+        }
+
+      g_variant_builder_add (&builder, "(s@a{sv})",
+                             g_udev_device_get_device_file (device->udev_device),
+                             g_variant_builder_end (&details));
+
+      if (active_path == NULL && is_path_usable (failed, device_state))
+        active_path = g_udev_device_get_device_file (device->udev_device);
+      g_free (device_state);
+    }
+
+  /* forget about the failures of the paths that are gone */
+  G_LOCK (object_lock);
+  g_hash_table_iter_init (&iter, drive->failed_paths);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_contains (keys, key))
+        g_hash_table_iter_remove (&iter);
+    }
+  G_UNLOCK (object_lock);
+
+  g_object_freeze_notify (G_OBJECT (drive));
+  udisks_drive_multipath_set_paths (UDISKS_DRIVE_MULTIPATH (drive), g_variant_builder_end (&builder));
+  udisks_drive_multipath_set_active_path (UDISKS_DRIVE_MULTIPATH (drive), active_path != NULL ? active_path : "");
+  g_object_thaw_notify (G_OBJECT (drive));
+
+  g_list_free_full (devices, g_object_unref);
+  g_hash_table_unref (keys);
+
+  return FALSE;
+}
+
+/**
+ * udisks_linux_drive_multipath_handle_path_event:
+ * @drive: A #UDisksLinuxDriveMultipath.
+ * @object: The enclosing #UDisksLinuxDriveObject instance.
+ * @device: The #UDisksLinuxDevice of a "change" uevent on @object.
+ *
+ * Checks if @device carries a path failure or reinstatement reported
+ * by device-mapper and if so, records the new state of the path and
+ * updates @drive. Nothing else about the drive changes on such events.
+ *
+ * Returns: %TRUE if the uevent was a path event and has been handled, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_drive_multipath_handle_path_event (UDisksLinuxDriveMultipath *drive,
+                                                UDisksLinuxDriveObject    *object,
+                                                UDisksLinuxDevice         *device)
+{
+  const gchar *dm_action;
+  const gchar *dm_path;
+  gboolean failed;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_DRIVE_MULTIPATH (drive), FALSE);
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), FALSE);
+
+  if (udisks_linux_device_get_dm_type (device) != UDISKS_LINUX_DEVICE_DM_TYPE_MULTIPATH)
+    return FALSE;
+
+  dm_action = g_udev_device_get_property (device->udev_device, "DM_ACTION");
+  dm_path = g_udev_device_get_property (device->udev_device, "DM_PATH");
+  if (g_strcmp0 (dm_action, "PATH_FAILED") == 0)
+    failed = TRUE;
+  else if (g_strcmp0 (dm_action, "PATH_REINSTATED") == 0)
+    failed = FALSE;
+  else
+    return FALSE;
+
+  if (dm_path == NULL)
+    return FALSE;
+
+  udisks_info ("Path %s of drive %s %s",
+               dm_path,
+               g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+               failed ? "failed" : "was reinstated");
+
+  G_LOCK (object_lock);
+  if (failed)
+    g_hash_table_add (drive->failed_paths, g_strdup (dm_path));
+  else
+    g_hash_table_remove (drive->failed_paths, dm_path);
+  G_UNLOCK (object_lock);
+
+  udisks_linux_drive_multipath_update (drive, object);
+
+  return TRUE;
+}
+
+/**
+ * udisks_linux_drive_multipath_is_path_active:
+ * @drive: A #UDisksLinuxDriveMultipath.
+ * @device: A #UDisksLinuxDevice for one of the paths of @drive.
+ *
+ * Checks if commands can be sent down the path @device, i.e. the
+ * path has not failed in the multipath device and the underlying
+ * device is running.
+ *
+ * Returns: %TRUE if @device is usable, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_drive_multipath_is_path_active (UDisksLinuxDriveMultipath *drive,
+                                             UDisksLinuxDevice         *device)
+{
+  gchar *device_state;
+  gboolean ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_DRIVE_MULTIPATH (drive), FALSE);
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), FALSE);
+
+  device_state = read_sysfs_attr (device, "device/state");
+  ret = is_path_usable (is_path_failed (drive, device), device_state);
+  g_free (device_state);
+
+  return ret;
+}
@@ -0,0 +1,1167 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <linux/nvme_ioctl.h>
+
+#include "udiskslogging.h"
+#include "udiskslinuxdriveobject.h"
+#include "udiskslinuxmanager.h"
+#include "udiskslinuxdrivenvme.h"
+#include "udiskslinuxblockobject.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
+#include "udiskslinuxdevice.h"
+#include "udiskssimplejob.h"
+#include "udiskslinuxprovider.h"
+#include "udisksmountmonitor.h"
+
+/**
+ * SECTION:udiskslinuxdrivenvme
+ * @title: UDisksLinuxDriveNVMe
+ * @short_description: Linux implementation of #UDisksDriveNVMe
+ *
+ * This type provides an implementation of the #UDisksDriveNVMe
+ * interface on Linux.
+ *
+ * Sanitize operations run in the background on the controller, their
+ * progress is read from the Sanitize Status log page at an interval
+ * derived from the time the controller estimates the operation to take.
+ */
+
+typedef struct _UDisksLinuxDriveNVMeClass   UDisksLinuxDriveNVMeClass;
+
+/* NVMe 1.3: 5.14.1.2 SMART / Health Information (Log Identifier 02h) */
+#define NVME_ADMIN_GET_LOG_PAGE     0x02
+#define NVME_LOG_SMART              0x02
+#define NVME_LOG_SMART_SIZE         512
+#define NVME_NSID_ALL               0xffffffff
+
+/* NVMe 1.3: 5.15 Identify command */
+#define NVME_ADMIN_IDENTIFY         0x06
+#define NVME_IDENTIFY_CNS_NS        0x00
+#define NVME_IDENTIFY_CNS_CTRL      0x01
+#define NVME_IDENTIFY_SIZE          4096
+
+/* NVMe 1.3: 5.23 Format NVM command, 5.24 Sanitize command */
+#define NVME_ADMIN_FORMAT_NVM       0x80
+#define NVME_ADMIN_SANITIZE         0x84
+#define NVME_FORMAT_TIMEOUT_MSEC    (24 * 3600 * 1000)
+
+/* NVMe 1.3: 5.14.1.17 Sanitize Status (Log Identifier 81h) */
+#define NVME_LOG_SANITIZE           0x81
+#define NVME_LOG_SANITIZE_SIZE      512
+
+/* the longest and the default interval between reads of the sanitize status, in seconds */
+#define SANITIZE_POLL_MAX_INTERVAL  30
+#define SANITIZE_POLL_INTERVAL      5
+
+typedef enum
+{
+  SANITIZE_STATUS_NEVER       = 0,
+  SANITIZE_STATUS_COMPLETED   = 1,
+  SANITIZE_STATUS_IN_PROGRESS = 2,
+  SANITIZE_STATUS_FAILED      = 3,
+  SANITIZE_STATUS_COMPLETED_NO_DEALLOCATE = 4,
+} SanitizeStatus;
+
+typedef struct
+{
+  const gchar *name;
+  guint8       sanact;          /* Sanitize Action, CDW10 bits 2:0 */
+  guint32      sanicap_bit;     /* Sanitize Capabilities in Identify Controller */
+  guint        estimate_offset; /* offset of the Estimated Time in the log page */
+} SanitizeAction;
+
+static const SanitizeAction sanitize_actions[] = {
+  {"block-erase",  0x02, 1 << 1, 12},
+  {"overwrite",    0x03, 1 << 2, 8},
+  {"crypto-erase", 0x04, 1 << 0, 16},
+};
+
+typedef struct
+{
+  guint8  critical_warning;
+  guint16 temperature;
+  guint8  available_spare;
+  guint8  spare_threshold;
+  guint8  percent_used;
+  guint64 data_units_read;
+  guint64 data_units_written;
+  guint64 power_on_hours;
+  guint64 power_cycles;
+  guint64 unsafe_shutdowns;
+  guint64 media_errors;
+  guint64 num_err_log_entries;
+} SmartLog;
+
+/**
+ * UDisksLinuxDriveNVMe:
+ *
+ * The #UDisksLinuxDriveNVMe structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxDriveNVMe
+{
+  UDisksDriveNVMeSkeleton parent_instance;
+
+  /* last log read from the drive, protected by object_lock */
+  guint64      smart_updated;
+  SmartLog     smart_log;
+
+  /* TRUE while a sanitize or format is running, protected by object_lock */
+  gboolean     erase_in_progress;
+};
+
+struct _UDisksLinuxDriveNVMeClass
+{
+  UDisksDriveNVMeSkeletonClass parent_class;
+};
+
+static void drive_nvme_iface_init (UDisksDriveNVMeIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksLinuxDriveNVMe, udisks_linux_drive_nvme, UDISKS_TYPE_DRIVE_NVME_SKELETON,
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_DRIVE_NVME, drive_nvme_iface_init));
+
+G_LOCK_DEFINE_STATIC (object_lock);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+udisks_linux_drive_nvme_init (UDisksLinuxDriveNVMe *drive)
+{
+}
+
+static void
+udisks_linux_drive_nvme_class_init (UDisksLinuxDriveNVMeClass *klass)
+{
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
+}
+
+/**
+ * udisks_linux_drive_nvme_new:
+ *
+ * Creates a new #UDisksLinuxDriveNVMe instance.
+ *
+ * Returns: A new #UDisksLinuxDriveNVMe. Free with g_object_unref().
+ */
+UDisksDriveNVMe *
+udisks_linux_drive_nvme_new (void)
+{
+  return UDISKS_DRIVE_NVME (g_object_new (UDISKS_TYPE_LINUX_DRIVE_NVME,
+                                          NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* may be called from *any* thread when the SMART data has been updated */
+static void
+update_smart (UDisksLinuxDriveNVMe   *drive,
+              UDisksLinuxDriveObject *object)
+{
+  UDisksLinuxDriveHealth health;
+  guint64 updated;
+  SmartLog log;
+
+  G_LOCK (object_lock);
+  updated = drive->smart_updated;
+  log = drive->smart_log;
+  G_UNLOCK (object_lock);
+
+  g_object_freeze_notify (G_OBJECT (drive));
+  udisks_drive_nvme_set_smart_updated (UDISKS_DRIVE_NVME (drive), updated);
+  udisks_drive_nvme_set_smart_critical_warning (UDISKS_DRIVE_NVME (drive), log.critical_warning);
+  udisks_drive_nvme_set_smart_temperature (UDISKS_DRIVE_NVME (drive), log.temperature);
+  udisks_drive_nvme_set_smart_available_spare (UDISKS_DRIVE_NVME (drive), log.available_spare);
+  udisks_drive_nvme_set_smart_spare_threshold (UDISKS_DRIVE_NVME (drive), log.spare_threshold);
+  udisks_drive_nvme_set_smart_percent_used (UDISKS_DRIVE_NVME (drive), log.percent_used);
+  udisks_drive_nvme_set_smart_data_units_read (UDISKS_DRIVE_NVME (drive), log.data_units_read);
+  udisks_drive_nvme_set_smart_data_units_written (UDISKS_DRIVE_NVME (drive), log.data_units_written);
+  udisks_drive_nvme_set_smart_power_on_hours (UDISKS_DRIVE_NVME (drive), log.power_on_hours);
+  udisks_drive_nvme_set_smart_power_cycles (UDISKS_DRIVE_NVME (drive), log.power_cycles);
+  udisks_drive_nvme_set_smart_unsafe_shutdowns (UDISKS_DRIVE_NVME (drive), log.unsafe_shutdowns);
+  udisks_drive_nvme_set_smart_media_errors (UDISKS_DRIVE_NVME (drive), log.media_errors);
+  udisks_drive_nvme_set_smart_num_err_log_entries (UDISKS_DRIVE_NVME (drive), log.num_err_log_entries);
+  g_object_thaw_notify (G_OBJECT (drive));
+
+  if (updated > 0)
+    {
+      health.failing = log.critical_warning != 0;
+      health.attributes_failing = log.available_spare < log.spare_threshold;
+      health.temperature = log.temperature;
+      health.num_bad_sectors = log.media_errors;
+    }
+  udisks_linux_drive_object_report_health (object, updated > 0 ? &health : NULL);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_drive_nvme_update:
+ * @drive: A #UDisksLinuxDriveNVMe.
+ * @object: The enclosing #UDisksLinuxDriveObject instance.
+ *
+ * Updates the interface.
+ *
+ * Returns: %TRUE if configuration has changed, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_drive_nvme_update (UDisksLinuxDriveNVMe   *drive,
+                                UDisksLinuxDriveObject *object)
+{
+  /* the SMART data is only refreshed on housekeeping, don't talk to
+   * the controller on every uevent
+   */
+  update_smart (drive, object);
+
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The counters in the log page are 128-bit little-endian values,
+ * saturate them to 64 bits
+ */
+static guint64
+get_le128 (const guchar *buf)
+{
+  guint64 ret = 0;
+  gint n;
+
+  for (n = 8; n < 16; n++)
+    if (buf[n] != 0)
+      return G_MAXUINT64;
+  for (n = 7; n >= 0; n--)
+    ret = (ret << 8) | buf[n];
+  return ret;
+}
+
+/* the command itself can't be interrupted, @cancellable is checked before sending it */
+static gboolean
+send_admin_command (gint                    fd,
+                    struct nvme_admin_cmd  *cmd,
+                    const gchar            *name,
+                    GCancellable           *cancellable,
+                    GError                **error)
+{
+  gint rc;
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  rc = ioctl (fd, NVME_IOCTL_ADMIN_CMD, cmd);
+  if (rc < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error sending NVMe %s command: %m", name);
+      return FALSE;
+    }
+  else if (rc > 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "NVMe %s command failed with status 0x%04x",
+                   name, rc);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+get_log_page (gint           fd,
+              guint8         log_id,
+              guchar        *buf,
+              gsize          buf_size,
+              GCancellable  *cancellable,
+              GError       **error)
+{
+  struct nvme_admin_cmd cmd;
+
+  memset (&cmd, 0, sizeof (cmd));
+  memset (buf, 0, buf_size);
+  cmd.opcode = NVME_ADMIN_GET_LOG_PAGE;
+  cmd.nsid = NVME_NSID_ALL;
+  cmd.addr = (guint64) (uintptr_t) buf;
+  cmd.data_len = buf_size;
+  /* NUMDL is the 0's based number of dwords to transfer */
+  cmd.cdw10 = log_id | (((buf_size / 4) - 1) << 16);
+
+  return send_admin_command (fd, &cmd, "Get Log Page", cancellable, error);
+}
+
+static gboolean
+identify (gint       fd,
+          guint8     cns,
+          guint32    nsid,
+          guchar    *buf,
+          GError   **error)
+{
+  struct nvme_admin_cmd cmd;
+
+  memset (&cmd, 0, sizeof (cmd));
+  memset (buf, 0, NVME_IDENTIFY_SIZE);
+  cmd.opcode = NVME_ADMIN_IDENTIFY;
+  cmd.nsid = nsid;
+  cmd.addr = (guint64) (uintptr_t) buf;
+  cmd.data_len = NVME_IDENTIFY_SIZE;
+  cmd.cdw10 = cns;
+
+  return send_admin_command (fd, &cmd, "Identify", NULL /* cancellable */, error);
+}
+
+static gboolean
+read_smart_log (gint           fd,
+                SmartLog      *log,
+                GCancellable  *cancellable,
+                GError       **error)
+{
+  guchar buf[NVME_LOG_SMART_SIZE];
+
+  if (!get_log_page (fd, NVME_LOG_SMART, buf, sizeof (buf), cancellable, error))
+    return FALSE;
+
+  /* NVMe 1.3: Figure 94: Get Log Page - SMART / Health Information Log */
+  log->critical_warning = buf[0];
+  log->temperature = buf[1] | (buf[2] << 8);
+  log->available_spare = buf[3];
+  log->spare_threshold = buf[4];
+  log->percent_used = buf[5];
+  log->data_units_read = get_le128 (buf + 32);
+  log->data_units_written = get_le128 (buf + 48);
+  log->power_cycles = get_le128 (buf + 112);
+  log->power_on_hours = get_le128 (buf + 128);
+  log->unsafe_shutdowns = get_le128 (buf + 144);
+  log->media_errors = get_le128 (buf + 160);
+  log->num_err_log_entries = get_le128 (buf + 176);
+
+  return TRUE;
+}
+
+/**
+ * udisks_linux_drive_nvme_refresh_smart_sync:
+ * @drive: The #UDisksLinuxDriveNVMe to refresh.
+ * @cancellable: A #GCancellable or %NULL, checked before sending the admin command.
+ * @error: Return location for error.
+ *
+ * Synchronously reads the SMART / Health Information log page of
+ * @drive through the NVMe admin passthrough ioctl and updates the
+ * properties. The calling thread is blocked until the data has been
+ * obtained.
+ *
+ * This may only be called if @drive has been associated with a
+ * #UDisksLinuxDriveObject instance.
+ *
+ * This method may be called from any thread.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_linux_drive_nvme_refresh_smart_sync (UDisksLinuxDriveNVMe  *drive,
+                                            GCancellable          *cancellable,
+                                            GError               **error)
+{
+  UDisksLinuxDriveObject *object;
+  UDisksLinuxDevice *device = NULL;
+  const gchar *device_file;
+  SmartLog log;
+  gint fd = -1;
+  gboolean ret = FALSE;
+
+  object = udisks_daemon_util_dup_object (drive, error);
+  if (object == NULL)
+    goto out;
+
+  device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
+  if (device == NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "No block device for drive");
+      goto out;
+    }
+
+  device_file = g_udev_device_get_device_file (device->udev_device);
+  fd = open (device_file, O_RDONLY|O_NONBLOCK);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening device file %s: %m",
+                   device_file);
+      goto out;
+    }
+
+  if (!read_smart_log (fd, &log, cancellable, error))
+    {
+      g_prefix_error (error, "%s: ", device_file);
+      goto out;
+    }
+
+  G_LOCK (object_lock);
+  drive->smart_updated = time (NULL);
+  drive->smart_log = log;
+  G_UNLOCK (object_lock);
+
+  update_smart (drive, object);
+
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* runs in a thread dedicated to handling @invocation */
+static gboolean
+handle_smart_update (UDisksDriveNVMe       *_drive,
+                     GDBusMethodInvocation *invocation,
+                     GVariant              *options)
+{
+  UDisksLinuxDriveNVMe *drive = UDISKS_LINUX_DRIVE_NVME (_drive);
+  UDisksLinuxDriveObject *object;
+  UDisksLinuxBlockObject *block_object = NULL;
+  UDisksDaemon *daemon;
+  GError *error;
+  const gchar *message;
+  const gchar *action_id;
+
+  error = NULL;
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_drive_object_get_daemon (object);
+  block_object = udisks_linux_drive_object_get_block (object, TRUE);
+  if (block_object == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Unable to find physical block device for drive");
+      goto out;
+    }
+
+  /* Translators: Shown in authentication dialog when the user
+   * refreshes SMART data from a disk.
+   *
+   * Do not translate $(drive), it's a placeholder and
+   * will be replaced by the name of the drive/device in question
+   */
+  message = N_("Authentication is required to update SMART data from $(drive)");
+  action_id = "org.freedesktop.udisks2.nvme-smart-update";
+
+  /* Check that the user is authorized */
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    UDISKS_OBJECT (block_object),
+                                                    action_id,
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  error = NULL;
+  if (!udisks_linux_drive_nvme_refresh_smart_sync (drive,
+                                                   udisks_daemon_util_get_invocation_cancellable (invocation),
+                                                   &error))
+    {
+      udisks_debug ("Error updating NVMe smart for %s: %s (%s, %d)",
+                    g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                    error->message, g_quark_to_string (error->domain), error->code);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_nvme_complete_smart_update (UDISKS_DRIVE_NVME (drive), invocation);
+
+ out:
+  g_clear_object (&block_object);
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static guint32
+get_le32 (const guchar *buf)
+{
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((guint32) buf[3] << 24);
+}
+
+static const SanitizeAction *
+find_sanitize_action (const gchar *name)
+{
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (sanitize_actions); n++)
+    if (g_strcmp0 (sanitize_actions[n].name, name) == 0)
+      return &sanitize_actions[n];
+  return NULL;
+}
+
+/* Opens the device of the drive for a sanitize or format, fails if
+ * something else is already erasing the drive or if the device is in use */
+static gint
+open_for_erase (UDisksLinuxDriveNVMe    *drive,
+                UDisksLinuxDriveObject **out_object,
+                UDisksLinuxDevice      **out_device,
+                GError                 **error)
+{
+  UDisksLinuxDriveObject *object;
+  UDisksLinuxDevice *device = NULL;
+  const gchar *device_file;
+  gint fd = -1;
+
+  object = udisks_daemon_util_dup_object (drive, error);
+  if (object == NULL)
+    goto out;
+
+  device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
+  if (device == NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "No block device for drive");
+      goto out;
+    }
+
+  G_LOCK (object_lock);
+  if (drive->erase_in_progress)
+    {
+      G_UNLOCK (object_lock);
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_DEVICE_BUSY,
+                   "Sanitize or format in progress");
+      goto out;
+    }
+  drive->erase_in_progress = TRUE;
+  G_UNLOCK (object_lock);
+
+  /* Use O_EXCL so it fails if mounted or in use */
+  device_file = g_udev_device_get_device_file (device->udev_device);
+  fd = open (device_file, O_RDONLY | O_EXCL);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening device file %s: %m",
+                   device_file);
+      G_LOCK (object_lock);
+      drive->erase_in_progress = FALSE;
+      G_UNLOCK (object_lock);
+      goto out;
+    }
+
+ out:
+  if (fd == -1)
+    {
+      g_clear_object (&device);
+      g_clear_object (&object);
+    }
+  *out_object = object;
+  *out_device = device;
+  return fd;
+}
+
+/* Sanitize erases every namespace of the NVM subsystem, not just the one
+ * of @device. Opens all the other namespace block devices with O_EXCL and
+ * checks them and their partitions for mounts. The returned fds are kept
+ * open until the sanitize is done, close them with close_namespace_fds(). */
+static GArray *
+claim_other_namespaces (UDisksLinuxDriveObject  *object,
+                        UDisksLinuxDevice       *device,
+                        GError                 **error)
+{
+  UDisksDaemon *daemon;
+  UDisksMountMonitor *mount_monitor;
+  GUdevClient *udev_client;
+  GUdevDevice *ns_parent;
+  GArray *fds;
+  GList *devices = NULL;
+  GList *l;
+  gboolean ok = FALSE;
+
+  fds = g_array_new (FALSE, FALSE, sizeof (gint));
+
+  /* the controller, or the subsystem with native NVMe multipath */
+  ns_parent = g_udev_device_get_parent (device->udev_device);
+  if (ns_parent == NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "No controller for %s",
+                   g_udev_device_get_device_file (device->udev_device));
+      goto out;
+    }
+
+  daemon = udisks_linux_drive_object_get_daemon (object);
+  mount_monitor = udisks_daemon_get_mount_monitor (daemon);
+  udev_client = udisks_linux_provider_get_udev_client (udisks_daemon_get_linux_provider (daemon));
+  devices = g_udev_client_query_by_subsystem (udev_client, "block");
+  for (l = devices; l != NULL; l = l->next)
+    {
+      GUdevDevice *block_device = G_UDEV_DEVICE (l->data);
+      GUdevDevice *disk;
+      GUdevDevice *parent;
+      gboolean on_subsystem;
+      const gchar *device_file;
+      gint fd;
+
+      if (g_strcmp0 (g_udev_device_get_devtype (block_device), "partition") == 0)
+        disk = g_udev_device_get_parent_with_subsystem (block_device, "block", "disk");
+      else
+        disk = g_object_ref (block_device);
+      if (disk == NULL)
+        continue;
+      parent = g_udev_device_get_parent (disk);
+      on_subsystem = parent != NULL &&
+                     g_strcmp0 (g_udev_device_get_sysfs_path (parent),
+                                g_udev_device_get_sysfs_path (ns_parent)) == 0;
+      g_clear_object (&parent);
+      g_object_unref (disk);
+      if (!on_subsystem)
+        continue;
+
+      device_file = g_udev_device_get_device_file (block_device);
+      if (udisks_mount_monitor_is_dev_in_use (mount_monitor,
+                                              g_udev_device_get_device_number (block_device),
+                                              NULL))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_DEVICE_BUSY,
+                       "%s is mounted or in use, a sanitize erases all the namespaces",
+                       device_file);
+          goto out;
+        }
+
+      if (g_strcmp0 (g_udev_device_get_devtype (block_device), "disk") != 0 ||
+          g_strcmp0 (g_udev_device_get_sysfs_path (block_device),
+                     g_udev_device_get_sysfs_path (device->udev_device)) == 0)
+        continue;
+
+      /* Use O_EXCL so it fails if mounted or in use */
+      fd = open (device_file, O_RDONLY | O_EXCL);
+      if (fd == -1)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_DEVICE_BUSY,
+                       "Error opening device file %s, a sanitize erases all the namespaces: %m",
+                       device_file);
+          goto out;
+        }
+      g_array_append_val (fds, fd);
+    }
+
+  ok = TRUE;
+
+ out:
+  if (!ok)
+    {
+      guint n;
+
+      for (n = 0; n < fds->len; n++)
+        close (g_array_index (fds, gint, n));
+      g_array_free (fds, TRUE);
+      fds = NULL;
+    }
+  g_list_free_full (devices, g_object_unref);
+  g_clear_object (&ns_parent);
+  return fds;
+}
+
+static void
+close_namespace_fds (GArray *fds)
+{
+  guint n;
+
+  if (fds == NULL)
+    return;
+  for (n = 0; n < fds->len; n++)
+    close (g_array_index (fds, gint, n));
+  g_array_free (fds, TRUE);
+}
+
+static void
+finish_erase (UDisksLinuxDriveNVMe   *drive,
+              UDisksLinuxDriveObject *object,
+              UDisksBaseJob          *job,
+              const gchar            *what,
+              GError                 *error)
+{
+  UDisksLinuxBlockObject *block_object;
+
+  G_LOCK (object_lock);
+  drive->erase_in_progress = FALSE;
+  G_UNLOCK (object_lock);
+
+  if (error == NULL)
+    {
+      /* the partition table (if any) is gone now */
+      block_object = udisks_linux_drive_object_get_block (object, FALSE);
+      if (block_object != NULL)
+        {
+          udisks_linux_block_object_reread_partition_table (block_object);
+          g_object_unref (block_object);
+        }
+    }
+
+  if (job != NULL)
+    {
+      if (error == NULL)
+        {
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, "");
+        }
+      else
+        {
+          gchar *s = g_strdup_printf ("%s failed: %s (%s, %d)",
+                                      what,
+                                      error->message, g_quark_to_string (error->domain), error->code);
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, s);
+          g_free (s);
+        }
+    }
+}
+
+/**
+ * udisks_linux_drive_nvme_sanitize_sync:
+ * @drive: A #UDisksLinuxDriveNVMe.
+ * @caller_uid: The unix user if of the caller requesting the operation.
+ * @action: The sanitize action, <literal>block-erase</literal>, <literal>crypto-erase</literal> or <literal>overwrite</literal>.
+ * @error: Return location for error or %NULL.
+ *
+ * Starts a sanitize operation of the NVM subsystem of @drive and
+ * tracks its progress in a job until the controller reports it has
+ * completed. Blocks the calling thread until then. Since all the
+ * namespaces are erased, this fails if any of them is mounted or in use.
+ *
+ * This operation may take a very long time (hours) to complete.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_linux_drive_nvme_sanitize_sync (UDisksLinuxDriveNVMe  *drive,
+                                       uid_t                  caller_uid,
+                                       const gchar           *action,
+                                       GError               **error)
+{
+  UDisksLinuxDriveObject *object = NULL;
+  UDisksLinuxDevice *device = NULL;
+  const SanitizeAction *sanitize_action;
+  UDisksBaseJob *job = NULL;
+  struct nvme_admin_cmd cmd;
+  guchar id_ctrl[NVME_IDENTIFY_SIZE];
+  guchar log[NVME_LOG_SANITIZE_SIZE];
+  const gchar *device_file = NULL;
+  guint32 estimate;
+  guint interval;
+  guint status;
+  GError *local_error = NULL;
+  GArray *namespace_fds = NULL;
+  gboolean ret = FALSE;
+  gint fd = -1;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_DRIVE_NVME (drive), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  sanitize_action = find_sanitize_action (action);
+  if (sanitize_action == NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Unknown sanitize action `%s'", action);
+      return FALSE;
+    }
+
+  fd = open_for_erase (drive, &object, &device, error);
+  if (fd == -1)
+    return FALSE;
+  device_file = g_udev_device_get_device_file (device->udev_device);
+
+  namespace_fds = claim_other_namespaces (object, device, &local_error);
+  if (namespace_fds == NULL)
+    goto out;
+
+  /* NVMe 1.3: Figure 109: Identify - Identify Controller Data Structure, SANICAP */
+  if (!identify (fd, NVME_IDENTIFY_CNS_CTRL, 0, id_ctrl, &local_error))
+    goto out;
+  if (!(get_le32 (id_ctrl + 328) & sanitize_action->sanicap_bit))
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                   "The controller does not support the %s sanitize action",
+                   sanitize_action->name);
+      goto out;
+    }
+
+  /* NVMe 1.3: Figure 98: Sanitize Status Log Page */
+  if (!get_log_page (fd, NVME_LOG_SANITIZE, log, sizeof (log), NULL /* cancellable */, &local_error))
+    goto out;
+  if ((log[2] & 0x07) == SANITIZE_STATUS_IN_PROGRESS)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_DEVICE_BUSY,
+                   "A sanitize operation is already in progress");
+      goto out;
+    }
+  estimate = get_le32 (log + sanitize_action->estimate_offset);
+
+  job = udisks_daemon_launch_simple_job (udisks_linux_drive_object_get_daemon (object),
+                                         UDISKS_OBJECT (object),
+                                         "nvme-sanitize",
+                                         caller_uid, NULL);
+  udisks_job_set_cancelable (UDISKS_JOB (job), FALSE);
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+
+  /* 0xffffffff means no estimate is available */
+  if (estimate != 0xffffffff && estimate > 0)
+    {
+      udisks_job_set_expected_end_time (UDISKS_JOB (job),
+                                        g_get_real_time () + (gint64) estimate * G_USEC_PER_SEC);
+      interval = CLAMP (estimate / 100, 1, SANITIZE_POLL_MAX_INTERVAL);
+    }
+  else
+    {
+      interval = SANITIZE_POLL_INTERVAL;
+    }
+
+  memset (&cmd, 0, sizeof (cmd));
+  cmd.opcode = NVME_ADMIN_SANITIZE;
+  cmd.cdw10 = sanitize_action->sanact;
+  /* a single pass with an all-zero pattern */
+  if (g_strcmp0 (sanitize_action->name, "overwrite") == 0)
+    cmd.cdw10 |= 1 << 4;
+  if (!send_admin_command (fd, &cmd, "Sanitize", NULL /* cancellable */, &local_error))
+    goto out;
+
+  udisks_notice ("Commencing NVMe %s sanitize of %s. The controller estimates it to take %d seconds (-1 if unknown)",
+                 sanitize_action->name,
+                 device_file,
+                 estimate != 0xffffffff ? (gint) estimate : -1);
+
+  /* the controller works on its own, just poll the log page */
+  while (TRUE)
+    {
+      g_usleep (interval * G_USEC_PER_SEC);
+
+      if (!get_log_page (fd, NVME_LOG_SANITIZE, log, sizeof (log), NULL /* cancellable */, &local_error))
+        goto out;
+
+      /* SPROG is the numerator of a fraction of 65536 */
+      udisks_job_set_progress (UDISKS_JOB (job), (log[0] | (log[1] << 8)) / 65536.0);
+
+      status = log[2] & 0x07;
+      if (status == SANITIZE_STATUS_IN_PROGRESS)
+        continue;
+      if (status == SANITIZE_STATUS_FAILED)
+        {
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "The sanitize operation failed, the controller is in restricted failure mode");
+          goto out;
+        }
+      break;
+    }
+  udisks_job_set_progress (UDISKS_JOB (job), 1.0);
+
+ out:
+  if (local_error != NULL)
+    {
+      g_prefix_error (&local_error, "%s: ", device_file);
+      udisks_notice ("Error sanitizing %s: %s (%s, %d)",
+                     device_file,
+                     local_error->message, g_quark_to_string (local_error->domain), local_error->code);
+    }
+  else
+    {
+      udisks_notice ("Finished sanitizing %s", device_file);
+    }
+  finish_erase (drive, object, job, "Sanitize", local_error);
+  if (local_error != NULL)
+    g_propagate_error (error, local_error);
+  else
+    ret = TRUE;
+  close_namespace_fds (namespace_fds);
+  close (fd);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return ret;
+}
+
+/**
+ * udisks_linux_drive_nvme_format_sync:
+ * @drive: A #UDisksLinuxDriveNVMe.
+ * @caller_uid: The unix user if of the caller requesting the operation.
+ * @secure_erase: The secure erase to perform, <literal>none</literal>, <literal>user-data</literal> or <literal>crypto-erase</literal>.
+ * @error: Return location for error or %NULL.
+ *
+ * Formats the namespace of @drive with its current LBA format using
+ * the NVMe Format NVM command. Blocks the calling thread until the
+ * controller completes the command.
+ *
+ * Returns: %TRUE if the operation succeeded, %FALSE if @error is set.
+ */
+gboolean
+udisks_linux_drive_nvme_format_sync (UDisksLinuxDriveNVMe  *drive,
+                                     uid_t                  caller_uid,
+                                     const gchar           *secure_erase,
+                                     GError               **error)
+{
+  UDisksLinuxDriveObject *object = NULL;
+  UDisksLinuxDevice *device = NULL;
+  UDisksBaseJob *job = NULL;
+  struct nvme_admin_cmd cmd;
+  guchar id_ctrl[NVME_IDENTIFY_SIZE];
+  guchar id_ns[NVME_IDENTIFY_SIZE];
+  const gchar *device_file = NULL;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+  guint32 ses;
+  gint nsid;
+  gint fd;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_DRIVE_NVME (drive), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (g_strcmp0 (secure_erase, "none") == 0)
+    ses = 0;
+  else if (g_strcmp0 (secure_erase, "user-data") == 0)
+    ses = 1;
+  else if (g_strcmp0 (secure_erase, "crypto-erase") == 0)
+    ses = 2;
+  else
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Unknown secure erase setting `%s'", secure_erase);
+      return FALSE;
+    }
+
+  fd = open_for_erase (drive, &object, &device, error);
+  if (fd == -1)
+    return FALSE;
+  device_file = g_udev_device_get_device_file (device->udev_device);
+
+  nsid = ioctl (fd, NVME_IOCTL_ID);
+  if (nsid <= 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error getting the namespace ID: %m");
+      goto out;
+    }
+
+  /* NVMe 1.3: Figure 109: Identify - Identify Controller Data Structure, OACS and FNA */
+  if (!identify (fd, NVME_IDENTIFY_CNS_CTRL, 0, id_ctrl, &local_error))
+    goto out;
+  if (!(id_ctrl[256] & (1 << 1)))
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                   "The controller does not support the Format NVM command");
+      goto out;
+    }
+  if (ses == 2 && !(id_ctrl[524] & (1 << 2)))
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                   "The controller does not support cryptographic erase");
+      goto out;
+    }
+
+  /* NVMe 1.3: Figure 114: Identify - Identify Namespace Data Structure, FLBAS and DPS */
+  if (!identify (fd, NVME_IDENTIFY_CNS_NS, nsid, id_ns, &local_error))
+    goto out;
+
+  job = udisks_daemon_launch_simple_job (udisks_linux_drive_object_get_daemon (object),
+                                         UDISKS_OBJECT (object),
+                                         "nvme-format",
+                                         caller_uid, NULL);
+  udisks_job_set_cancelable (UDISKS_JOB (job), FALSE);
+
+  /* keep the LBA format, metadata settings and protection information */
+  memset (&cmd, 0, sizeof (cmd));
+  cmd.opcode = NVME_ADMIN_FORMAT_NVM;
+  cmd.nsid = nsid;
+  cmd.timeout_ms = NVME_FORMAT_TIMEOUT_MSEC;
+  cmd.cdw10 = (id_ns[26] & 0x1f) | ((id_ns[29] & 0x07) << 5) | ((id_ns[29] & 0x08) << 5) | (ses << 9);
+
+  udisks_notice ("Commencing NVMe format of %s (secure erase: %s)", device_file, secure_erase);
+  if (!send_admin_command (fd, &cmd, "Format NVM", NULL /* cancellable */, &local_error))
+    goto out;
+
+ out:
+  if (local_error != NULL)
+    {
+      g_prefix_error (&local_error, "%s: ", device_file);
+      udisks_notice ("Error formatting %s: %s (%s, %d)",
+                     device_file,
+                     local_error->message, g_quark_to_string (local_error->domain), local_error->code);
+    }
+  else
+    {
+      udisks_notice ("Finished formatting %s", device_file);
+    }
+  finish_erase (drive, object, job, "Format", local_error);
+  if (local_error != NULL)
+    g_propagate_error (error, local_error);
+  else
+    ret = TRUE;
+  close (fd);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* runs in a thread dedicated to handling @invocation */
+static gboolean
+handle_sanitize (UDisksDriveNVMe       *_drive,
+                 GDBusMethodInvocation *invocation,
+                 const gchar           *action,
+                 GVariant              *options)
+{
+  UDisksLinuxDriveNVMe *drive = UDISKS_LINUX_DRIVE_NVME (_drive);
+  UDisksLinuxDriveObject *object;
+  UDisksDaemon *daemon;
+  GError *error = NULL;
+  const gchar *message;
+  uid_t caller_uid;
+
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_drive_object_get_daemon (object);
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  /* Translators: Shown in authentication dialog when the user
+   * requests sanitizing an NVMe drive.
+   *
+   * Do not translate $(drive), it's a placeholder and
+   * will be replaced by the name of the drive/device in question
+   */
+  message = N_("Authentication is required to sanitize $(drive)");
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    UDISKS_OBJECT (object),
+                                                    "org.freedesktop.udisks2.nvme-sanitize",
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  if (!udisks_linux_drive_nvme_sanitize_sync (drive, caller_uid, action, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_nvme_complete_sanitize (UDISKS_DRIVE_NVME (drive), invocation);
+
+ out:
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in a thread dedicated to handling @invocation */
+static gboolean
+handle_format (UDisksDriveNVMe       *_drive,
+               GDBusMethodInvocation *invocation,
+               GVariant              *options)
+{
+  UDisksLinuxDriveNVMe *drive = UDISKS_LINUX_DRIVE_NVME (_drive);
+  UDisksLinuxDriveObject *object;
+  UDisksDaemon *daemon;
+  GError *error = NULL;
+  const gchar *message;
+  const gchar *secure_erase = "none";
+  uid_t caller_uid;
+
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_drive_object_get_daemon (object);
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  g_variant_lookup (options, "secure-erase", "&s", &secure_erase);
+
+  /* Translators: Shown in authentication dialog when the user
+   * requests low-level formatting of an NVMe drive.
+   *
+   * Do not translate $(drive), it's a placeholder and
+   * will be replaced by the name of the drive/device in question
+   */
+  message = N_("Authentication is required to format $(drive)");
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    UDISKS_OBJECT (object),
+                                                    "org.freedesktop.udisks2.nvme-format",
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  if (!udisks_linux_drive_nvme_format_sync (drive, caller_uid, secure_erase, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_drive_nvme_complete_format (UDISKS_DRIVE_NVME (drive), invocation);
+
+ out:
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+drive_nvme_iface_init (UDisksDriveNVMeIface *iface)
+{
+  iface->handle_smart_update = handle_smart_update;
+  iface->handle_sanitize = handle_sanitize;
+  iface->handle_format = handle_format;
+}
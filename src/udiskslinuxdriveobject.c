@@ -29,12 +29,20 @@
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
 #include "udiskslinuxprovider.h"
+#include "udiskslinuxmanager.h"
 #include "udiskslinuxdriveobject.h"
 #include "udiskslinuxdrive.h"
 #include "udiskslinuxdriveata.h"
+#include "udiskslinuxdrivenvme.h"
+#include "udiskslinuxdrivemultipath.h"
+#include "udiskslinuxdrivestatistics.h"
 #include "udiskslinuxblockobject.h"
+#include "udiskslinuxblockqueue.h"
+#include "udiskslinuxpartitiontable.h"
 #include "udiskslinuxdevice.h"
 #include "udisksmodulemanager.h"
+#include "udisksmetrics.h"
+#include "udiskstrace.h"
 
 #include <modules/udisksmoduleifacetypes.h>
 
@@ -67,6 +75,9 @@ struct _UDisksLinuxDriveObject
   /* interfaces */
   UDisksDrive *iface_drive;
   UDisksDriveAta *iface_drive_ata;
+  UDisksDriveNVMe *iface_drive_nvme;
+  UDisksDriveMultipath *iface_drive_multipath;
+  UDisksDriveStatistics *iface_drive_statistics;
   GHashTable *module_ifaces;
 };
 
@@ -104,6 +115,12 @@ udisks_linux_drive_object_finalize (GObject *_object)
     g_object_unref (object->iface_drive);
   if (object->iface_drive_ata != NULL)
     g_object_unref (object->iface_drive_ata);
+  if (object->iface_drive_nvme != NULL)
+    g_object_unref (object->iface_drive_nvme);
+  if (object->iface_drive_multipath != NULL)
+    g_object_unref (object->iface_drive_multipath);
+  if (object->iface_drive_statistics != NULL)
+    g_object_unref (object->iface_drive_statistics);
   if (object->module_ifaces != NULL)
     g_hash_table_destroy (object->module_ifaces);
 
@@ -234,10 +251,7 @@ strip_and_replace_with_uscore (gchar *s)
 static gboolean
 is_dm_multipath (UDisksLinuxDevice *device)
 {
-  const gchar *dm_uuid;
-
-  dm_uuid = g_udev_device_get_sysfs_attr (device->udev_device, "dm/uuid");
-  return dm_uuid != NULL && g_str_has_prefix (dm_uuid, "mpath-");
+  return udisks_linux_device_get_dm_type (device) == UDISKS_LINUX_DEVICE_DM_TYPE_MULTIPATH;
 }
 
 static void
@@ -427,8 +441,16 @@ udisks_linux_drive_object_get_device (UDisksLinuxDriveObject *object,
     {
       if (!get_hw || !is_dm_multipath (UDISKS_LINUX_DEVICE (devices->data)))
         {
-          ret = devices->data;
-          break;
+          /* prefer a path that is able to take the commands */
+          if (ret == NULL)
+            ret = devices->data;
+          if (!get_hw || object->iface_drive_multipath == NULL ||
+              udisks_linux_drive_multipath_is_path_active (UDISKS_LINUX_DRIVE_MULTIPATH (object->iface_drive_multipath),
+                                                           UDISKS_LINUX_DEVICE (devices->data)))
+            {
+              ret = devices->data;
+              break;
+            }
         }
     }
 
@@ -554,8 +576,21 @@ update_iface (UDisksObject                     *object,
 
   if (*interface_pointer != NULL)
     {
+      gint64 start_time;
+
+      UDISKS_TRACE2 (update_iface_start,
+                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                     g_type_name (skeleton_type));
+      start_time = g_get_monotonic_time ();
       if (update_func (object, uevent_action, G_DBUS_INTERFACE (*interface_pointer)))
         ret = TRUE;
+      udisks_metrics_record (udisks_daemon_get_metrics (UDISKS_LINUX_DRIVE_OBJECT (object)->daemon),
+                             UDISKS_METRICS_KIND_UPDATE,
+                             g_type_name (skeleton_type),
+                             g_get_monotonic_time () - start_time);
+      UDISKS_TRACE2 (update_iface_done,
+                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                     g_type_name (skeleton_type));
       if (add)
         g_dbus_object_skeleton_add_interface (G_DBUS_OBJECT_SKELETON (object),
                                               G_DBUS_INTERFACE_SKELETON (*interface_pointer));
@@ -626,7 +661,109 @@ drive_ata_update (UDisksObject   *object,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static void apply_configuration (UDisksLinuxDriveObject *object);
+static gboolean
+drive_nvme_check (UDisksObject *object)
+{
+  UDisksLinuxDriveObject *drive_object = UDISKS_LINUX_DRIVE_OBJECT (object);
+  gboolean ret;
+  UDisksLinuxDevice *device;
+  GUdevDevice *parent;
+
+  ret = FALSE;
+  if (drive_object->devices == NULL)
+    goto out;
+
+  device = drive_object->devices->data;
+  parent = g_udev_device_get_parent_with_subsystem (device->udev_device, "nvme", NULL);
+  if (parent != NULL)
+    {
+      ret = TRUE;
+      g_object_unref (parent);
+    }
+
+ out:
+  return ret;
+}
+
+static void
+drive_nvme_connect (UDisksObject *object)
+{
+
+}
+
+static gboolean
+drive_nvme_update (UDisksObject   *object,
+                   const gchar    *uevent_action,
+                   GDBusInterface *_iface)
+{
+  UDisksLinuxDriveObject *drive_object = UDISKS_LINUX_DRIVE_OBJECT (object);
+
+  return udisks_linux_drive_nvme_update (UDISKS_LINUX_DRIVE_NVME (drive_object->iface_drive_nvme), drive_object);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+drive_multipath_check (UDisksObject *object)
+{
+  UDisksLinuxDriveObject *drive_object = UDISKS_LINUX_DRIVE_OBJECT (object);
+  GList *l;
+
+  for (l = drive_object->devices; l != NULL; l = l->next)
+    {
+      if (is_dm_multipath (UDISKS_LINUX_DEVICE (l->data)))
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static void
+drive_multipath_connect (UDisksObject *object)
+{
+
+}
+
+static gboolean
+drive_multipath_update (UDisksObject   *object,
+                        const gchar    *uevent_action,
+                        GDBusInterface *_iface)
+{
+  UDisksLinuxDriveObject *drive_object = UDISKS_LINUX_DRIVE_OBJECT (object);
+
+  return udisks_linux_drive_multipath_update (UDISKS_LINUX_DRIVE_MULTIPATH (drive_object->iface_drive_multipath), drive_object);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+drive_statistics_check (UDisksObject *object)
+{
+  UDisksLinuxDriveObject *drive_object = UDISKS_LINUX_DRIVE_OBJECT (object);
+
+  return drive_object->devices != NULL;
+}
+
+static void
+drive_statistics_connect (UDisksObject *object)
+{
+
+}
+
+static gboolean
+drive_statistics_update (UDisksObject   *object,
+                         const gchar    *uevent_action,
+                         GDBusInterface *_iface)
+{
+  UDisksLinuxDriveObject *drive_object = UDISKS_LINUX_DRIVE_OBJECT (object);
+
+  return udisks_linux_drive_statistics_update (UDISKS_LINUX_DRIVE_STATISTICS (drive_object->iface_drive_statistics), drive_object);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void apply_configuration (UDisksLinuxDriveObject *object,
+                                 gboolean                force);
 
 static GList *
 find_link_for_sysfs_path (UDisksLinuxDriveObject *object,
@@ -664,22 +801,126 @@ ensure_module_ifaces (UDisksLinuxDriveObject *object,
   ModuleInterfaceEntry *entry;
   UDisksModuleInterfaceInfo *ii;
 
-  /* Assume all modules are either unloaded or loaded at the same time, so don't regenerate entries */
   if (object->module_ifaces == NULL)
+    object->module_ifaces = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_module_interface_entry);
+
+  /* Modules are loaded one by one but never unloaded separately, so only
+   * the entries of the modules loaded since the last call are missing */
+  l = udisks_module_manager_get_drive_object_iface_infos (module_manager);
+  if (g_hash_table_size (object->module_ifaces) == g_list_length (l))
+    return;
+
+  for (; l; l = l->next)
     {
-      object->module_ifaces = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_module_interface_entry);
+      ii = l->data;
+      if (g_hash_table_contains (object->module_ifaces, GSIZE_TO_POINTER (ii->skeleton_type)))
+        continue;
+      entry = g_new0 (ModuleInterfaceEntry, 1);
+      entry->has_func = ii->has_func;
+      entry->connect_func = ii->connect_func;
+      entry->update_func = ii->update_func;
+      g_hash_table_replace (object->module_ifaces, GSIZE_TO_POINTER (ii->skeleton_type), entry);
+    }
+}
+
+/* returns whether the configuration needs to be applied again */
+static gboolean
+update_module_ifaces (UDisksLinuxDriveObject *object,
+                      const gchar            *action)
+{
+  UDisksModuleManager *module_manager;
+  GHashTableIter iter;
+  gpointer key;
+  ModuleInterfaceEntry *entry;
+  gboolean conf_changed = FALSE;
 
-      l = udisks_module_manager_get_drive_object_iface_infos (module_manager);
-      for (; l; l = l->next)
+  module_manager = udisks_daemon_get_module_manager (object->daemon);
+  if (udisks_module_manager_get_modules_available (module_manager))
+    {
+      ensure_module_ifaces (object, module_manager);
+      g_hash_table_iter_init (&iter, object->module_ifaces);
+      while (g_hash_table_iter_next (&iter, &key, (gpointer *) &entry))
         {
-          ii = l->data;
-          entry = g_new0 (ModuleInterfaceEntry, 1);
-          entry->has_func = ii->has_func;
-          entry->connect_func = ii->connect_func;
-          entry->update_func = ii->update_func;
-          g_hash_table_replace (object->module_ifaces, GSIZE_TO_POINTER (ii->skeleton_type), entry);
+          conf_changed |= update_iface (UDISKS_OBJECT (object), action, entry->has_func, entry->connect_func, entry->update_func,
+                                        (GType) key, &entry->interface);
         }
     }
+
+  return conf_changed;
+}
+
+/**
+ * udisks_linux_drive_object_update_module_ifaces:
+ * @object: A #UDisksLinuxDriveObject.
+ * @action: Uevent action or %NULL
+ *
+ * Updates only the interfaces from modules on @object, using the
+ * #UDisksLinuxDevice objects already attached to it. This is used to
+ * attach the interfaces of newly loaded modules without probing the
+ * devices (e.g. sending ATA IDENTIFY commands) again.
+ */
+void
+udisks_linux_drive_object_update_module_ifaces (UDisksLinuxDriveObject *object,
+                                                const gchar            *action)
+{
+  g_return_if_fail (UDISKS_IS_LINUX_DRIVE_OBJECT (object));
+
+  if (update_module_ifaces (object, action))
+    apply_configuration (object, FALSE);
+}
+
+typedef struct
+{
+  UDisksLinuxDriveObject *object;
+  gchar *action;
+} ModuleIfacesUpdate;
+
+static void
+module_ifaces_update_free (ModuleIfacesUpdate *update)
+{
+  g_object_unref (update->object);
+  g_free (update->action);
+  g_free (update);
+}
+
+/* called in the main thread, see udisks_linux_provider_invoke_for_modules() */
+static gboolean
+on_update_module_ifaces (gpointer user_data)
+{
+  ModuleIfacesUpdate *update = user_data;
+
+  udisks_linux_drive_object_update_module_ifaces (update->object, update->action);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * udisks_linux_drive_object_reload_configuration:
+ * @object: A #UDisksLinuxDriveObject.
+ *
+ * Reads the configuration file of @object again and applies the
+ * settings whose values have changed. Unlike a "change" uevent this
+ * doesn't update any of the other interfaces on @object and doesn't
+ * touch the drive at all if the configuration stays the same.
+ */
+void
+udisks_linux_drive_object_reload_configuration (UDisksLinuxDriveObject *object)
+{
+  g_return_if_fail (UDISKS_IS_LINUX_DRIVE_OBJECT (object));
+
+  if (object->iface_drive == NULL)
+    return;
+
+  if (!udisks_linux_drive_reload_configuration (UDISKS_LINUX_DRIVE (object->iface_drive), object))
+    {
+      udisks_debug ("Configuration of drive %s has not changed",
+                    g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+      return;
+    }
+
+  /* only the changed settings are sent to the drive, see
+   * udisks_linux_drive_ata_apply_configuration() */
+  apply_configuration (object, FALSE);
 }
 
 /**
@@ -697,10 +938,7 @@ udisks_linux_drive_object_uevent (UDisksLinuxDriveObject *object,
 {
   GList *link;
   gboolean conf_changed;
-  UDisksModuleManager *module_manager;
-  GHashTableIter iter;
-  gpointer key;
-  ModuleInterfaceEntry *entry;
+  ModuleIfacesUpdate *update;
 
   g_return_if_fail (UDISKS_IS_LINUX_DRIVE_OBJECT (object));
   g_return_if_fail (device == NULL || UDISKS_IS_LINUX_DEVICE (device));
@@ -735,36 +973,47 @@ udisks_linux_drive_object_uevent (UDisksLinuxDriveObject *object,
         }
     }
 
+  /* path failures and reinstatements don't change anything but the paths */
+  if (object->iface_drive_multipath != NULL && device != NULL && g_strcmp0 (action, "change") == 0 &&
+      udisks_linux_drive_multipath_handle_path_event (UDISKS_LINUX_DRIVE_MULTIPATH (object->iface_drive_multipath),
+                                                      object,
+                                                      device))
+    return;
+
   conf_changed = FALSE;
   conf_changed |= update_iface (UDISKS_OBJECT (object), action, drive_check, drive_connect, drive_update,
                                 UDISKS_TYPE_LINUX_DRIVE, &object->iface_drive);
   conf_changed |= update_iface (UDISKS_OBJECT (object), action, drive_ata_check, drive_ata_connect, drive_ata_update,
                                 UDISKS_TYPE_LINUX_DRIVE_ATA, &object->iface_drive_ata);
-
-  /* Attach interfaces from modules */
-  module_manager = udisks_daemon_get_module_manager (object->daemon);
-  if (udisks_module_manager_get_modules_available (module_manager))
-    {
-      ensure_module_ifaces (object, module_manager);
-      g_hash_table_iter_init (&iter, object->module_ifaces);
-      while (g_hash_table_iter_next (&iter, &key, (gpointer *) &entry))
-        {
-          conf_changed |= update_iface (UDISKS_OBJECT (object), action, entry->has_func, entry->connect_func, entry->update_func,
-                                        (GType) key, &entry->interface);
-        }
-    }
-
+  conf_changed |= update_iface (UDISKS_OBJECT (object), action, drive_nvme_check, drive_nvme_connect, drive_nvme_update,
+                                UDISKS_TYPE_LINUX_DRIVE_NVME, &object->iface_drive_nvme);
+  conf_changed |= update_iface (UDISKS_OBJECT (object), action, drive_multipath_check, drive_multipath_connect, drive_multipath_update,
+                                UDISKS_TYPE_LINUX_DRIVE_MULTIPATH, &object->iface_drive_multipath);
+  conf_changed |= update_iface (UDISKS_OBJECT (object), action, drive_statistics_check, drive_statistics_connect, drive_statistics_update,
+                                UDISKS_TYPE_LINUX_DRIVE_STATISTICS, &object->iface_drive_statistics);
+
+  /* Attach interfaces from modules, applying the configuration again
+   * if they need it */
+  update = g_new0 (ModuleIfacesUpdate, 1);
+  update->object = g_object_ref (object);
+  update->action = g_strdup (action);
+  udisks_linux_provider_invoke_for_modules (udisks_daemon_get_linux_provider (object->daemon),
+                                            on_update_module_ifaces,
+                                            update,
+                                            (GDestroyNotify) module_ifaces_update_free);
+
+  /* the drive may have lost its settings, e.g. on suspend */
   if (g_strcmp0 (action, "reconfigure") == 0)
-    conf_changed = TRUE;
-
-  if (conf_changed)
-    apply_configuration (object);
+    apply_configuration (object, TRUE);
+  else if (conf_changed)
+    apply_configuration (object, FALSE);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
-apply_configuration (UDisksLinuxDriveObject *object)
+apply_configuration (UDisksLinuxDriveObject *object,
+                     gboolean                force)
 {
   GVariant *configuration = NULL;
   UDisksLinuxDevice *device = NULL;
@@ -784,7 +1033,21 @@ apply_configuration (UDisksLinuxDriveObject *object)
     {
       udisks_linux_drive_ata_apply_configuration (UDISKS_LINUX_DRIVE_ATA (object->iface_drive_ata),
                                                   device,
-                                                  configuration);
+                                                  configuration,
+                                                  force);
+    }
+
+  if (udisks_linux_block_queue_has_queue (device))
+    {
+      GError *error = NULL;
+
+      if (!udisks_linux_block_queue_apply_settings (device, configuration, "queue-", &error))
+        {
+          udisks_warning ("Error applying queue configuration to %s: %s",
+                          g_udev_device_get_device_file (device->udev_device),
+                          error->message);
+          g_clear_error (&error);
+        }
     }
 
  out:
@@ -973,6 +1236,63 @@ udisks_linux_drive_object_should_include_device (GUdevClient        *client,
   return ret;
 }
 
+/* <internal>
+ * udisks_linux_drive_object_dup_identity_key:
+ * @device: A #UDisksLinuxDevice.
+ *
+ * Gets a string made of everything in @device the result of
+ * udisks_linux_drive_object_should_include_device() depends on. Two
+ * devices with the same sysfs path and the same key get the same
+ * result, so it can be reused over "change" uevents.
+ *
+ * Returns: (transfer full): The key. Free with g_free().
+ */
+gchar *
+udisks_linux_drive_object_dup_identity_key (UDisksLinuxDevice *device)
+{
+  static const gchar *const keys[] = {"ID_SERIAL", "ID_WWN_WITH_EXTENSION", "ID_PATH", "ID_MODEL", "ID_VENDOR", NULL};
+  GString *str;
+  guint n;
+
+  /* the properties check_for_vpd() and the workarounds look at, the
+   * multipath UUID stands for the identity of the paths */
+  str = g_string_new (g_udev_device_get_devtype (device->udev_device));
+  for (n = 0; keys[n] != NULL; n++)
+    {
+      const gchar *value = g_udev_device_get_property (device->udev_device, keys[n]);
+      g_string_append_printf (str, "\n%s", value != NULL ? value : "");
+    }
+  g_string_append_printf (str, "\n%s", device->dm_uuid != NULL ? device->dm_uuid : "");
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * udisks_linux_drive_object_report_health:
+ * @object: A #UDisksLinuxDriveObject.
+ * @health: (allow-none): The health of the drive or %NULL if it has no SMART data.
+ *
+ * Reports the health of @object for the #UDisksManager:health-summary
+ * property, see udisks_linux_manager_update_drive_health(). Called by
+ * the interfaces of @object whenever they update their SMART data.
+ *
+ * This may be called from any thread.
+ */
+void
+udisks_linux_drive_object_report_health (UDisksLinuxDriveObject       *object,
+                                         const UDisksLinuxDriveHealth *health)
+{
+  UDisksLinuxManager *manager;
+
+  g_return_if_fail (UDISKS_IS_LINUX_DRIVE_OBJECT (object));
+
+  manager = udisks_linux_provider_get_manager (udisks_daemon_get_linux_provider (object->daemon));
+  if (manager != NULL)
+    udisks_linux_manager_update_drive_health (manager,
+                                              g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                                              health);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /**
@@ -983,7 +1303,9 @@ udisks_linux_drive_object_should_include_device (GUdevClient        *client,
  * @error: Return location for error or %NULL.
  *
  * Called periodically (every ten minutes or so) to perform
- * housekeeping tasks such as refreshing ATA SMART data.
+ * housekeeping tasks such as refreshing ATA SMART data, the NVMe
+ * SMART / Health Information log or the I/O counters of multipath
+ * paths.
  *
  * The function runs in a dedicated thread and is allowed to perform
  * blocking I/O.
@@ -1049,33 +1371,121 @@ udisks_linux_drive_object_housekeeping (UDisksLinuxDriveObject  *object,
         }
     }
 
+  if (object->iface_drive_nvme != NULL)
+    {
+      udisks_info ("Refreshing NVMe SMART data on %s",
+                   g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+
+      if (!udisks_linux_drive_nvme_refresh_smart_sync (UDISKS_LINUX_DRIVE_NVME (object->iface_drive_nvme),
+                                                       cancellable,
+                                                       error))
+        {
+          g_prefix_error (error, "Error updating NVMe SMART data: ");
+          goto out;
+        }
+    }
+
+  if (object->iface_drive_multipath != NULL)
+    udisks_linux_drive_multipath_update (UDISKS_LINUX_DRIVE_MULTIPATH (object->iface_drive_multipath), object);
+
   ret = TRUE;
 
  out:
   return ret;
 }
 
+/* Unlocked LUKS devices are held by their cleartext device, so only the
+ * holders need to be checked rather than all block objects */
 static gboolean
-is_block_unlocked (GList *objects, const gchar *crypto_object_path)
+is_block_unlocked (UDisksLinuxProvider *provider,
+                   UDisksObject        *object)
 {
+  UDisksLinuxDevice *device;
+  const gchar *object_path;
+  gchar **holders;
   gboolean ret = FALSE;
+  guint n;
+
+  device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (object));
+  if (device == NULL)
+    return FALSE;
+
+  object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+  holders = udisks_linux_provider_dup_holders (provider, g_udev_device_get_sysfs_path (device->udev_device));
+  for (n = 0; holders[n] != NULL && !ret; n++)
+    {
+      UDisksLinuxBlockObject *holder_object;
+      UDisksBlock *block;
+
+      holder_object = udisks_linux_provider_find_block_by_sysfs_path (provider, holders[n]);
+      if (holder_object == NULL)
+        continue;
+      block = udisks_object_peek_block (UDISKS_OBJECT (holder_object));
+      if (block != NULL && g_strcmp0 (udisks_block_get_crypto_backing_device (block), object_path) == 0)
+        ret = TRUE;
+      g_object_unref (holder_object);
+    }
+  g_strfreev (holders);
+  g_object_unref (device);
+
+  return ret;
+}
+
+/* Gets the block objects of the drive, i.e. the block devices of the drive
+ * and their partitions. Free with g_list_free_full() and g_object_unref(). */
+static GList *
+get_drive_blocks (UDisksLinuxDriveObject *object)
+{
+  UDisksLinuxProvider *provider;
+  const gchar *drive_object_path;
+  GList *devices;
+  GList *ret = NULL;
   GList *l;
-  for (l = objects; l != NULL; l = l->next)
+
+  provider = udisks_daemon_get_linux_provider (object->daemon);
+  drive_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+
+  devices = udisks_linux_drive_object_get_devices (object);
+  for (l = devices; l != NULL; l = l->next)
     {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksLinuxDevice *device = UDISKS_LINUX_DEVICE (l->data);
+      UDisksLinuxBlockObject *block_object;
       UDisksBlock *block;
-      block = udisks_object_peek_block (object);
-      if (block != NULL)
+      UDisksPartitionTable *table;
+
+      block_object = udisks_linux_provider_find_block_by_sysfs_path (provider,
+                                                                     g_udev_device_get_sysfs_path (device->udev_device));
+      if (block_object == NULL)
+        continue;
+
+      block = udisks_object_peek_block (UDISKS_OBJECT (block_object));
+      if (block == NULL || g_strcmp0 (udisks_block_get_drive (block), drive_object_path) != 0)
+        {
+          g_object_unref (block_object);
+          continue;
+        }
+      ret = g_list_prepend (ret, block_object);
+
+      table = udisks_object_peek_partition_table (UDISKS_OBJECT (block_object));
+      if (table != NULL)
         {
-          if (g_strcmp0 (udisks_block_get_crypto_backing_device (block), crypto_object_path) == 0)
+          GList *partitions;
+          GList *ll;
+          guint num_partitions;
+
+          partitions = udisks_linux_partition_table_get_partitions (object->daemon, table, &num_partitions);
+          for (ll = partitions; ll != NULL; ll = ll->next)
             {
-              ret = TRUE;
-              goto out;
+              GDBusObject *partition_object = g_dbus_interface_dup_object (G_DBUS_INTERFACE (ll->data));
+              if (partition_object != NULL)
+                ret = g_list_prepend (ret, partition_object);
             }
+          g_list_free_full (partitions, g_object_unref);
         }
     }
- out:
-  return ret;
+  g_list_free_full (devices, g_object_unref);
+
+  return g_list_reverse (ret);
 }
 
 /**
@@ -1094,8 +1504,7 @@ udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriveObject  *object,
                                          GCancellable            *cancellable,
                                          GError                 **error)
 {
-  GDBusObjectManagerServer *object_manager;
-  const gchar *drive_object_path;
+  UDisksLinuxProvider *provider;
   gboolean ret = TRUE;
   GList *objects = NULL;
   GList *l;
@@ -1104,25 +1513,23 @@ udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriveObject  *object,
   g_return_val_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  drive_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
-
-  object_manager = udisks_daemon_get_object_manager (object->daemon);
-  objects = g_dbus_object_manager_get_objects (G_DBUS_OBJECT_MANAGER (object_manager));
+  provider = udisks_daemon_get_linux_provider (object->daemon);
+  objects = get_drive_blocks (object);
 
   /* Visit all block devices related to the drive... */
   for (l = objects; l != NULL; l = l->next)
     {
-      GDBusObjectSkeleton *iter_object = G_DBUS_OBJECT_SKELETON (l->data);
+      UDisksObject *iter_object = UDISKS_OBJECT (l->data);
       UDisksBlock *block;
       UDisksFilesystem *filesystem;
 
       if (!UDISKS_IS_LINUX_BLOCK_OBJECT (iter_object))
         continue;
 
-      block = udisks_object_peek_block (UDISKS_OBJECT (iter_object));
-      filesystem = udisks_object_peek_filesystem (UDISKS_OBJECT (iter_object));
+      block = udisks_object_peek_block (iter_object);
+      filesystem = udisks_object_peek_filesystem (iter_object);
 
-      if (g_strcmp0 (udisks_block_get_drive (block), drive_object_path) != 0)
+      if (block == NULL)
         continue;
 
       /* bail if block device is mounted */
@@ -1141,7 +1548,7 @@ udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriveObject  *object,
         }
 
       /* bail if block device is unlocked (LUKS) */
-      if (is_block_unlocked (objects, g_dbus_object_get_object_path (G_DBUS_OBJECT (iter_object))))
+      if (is_block_unlocked (provider, iter_object))
         {
           g_set_error (error,
                        UDISKS_ERROR,
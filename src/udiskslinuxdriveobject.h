@@ -36,6 +36,9 @@ UDisksLinuxDriveObject *udisks_linux_drive_object_new           (UDisksDaemon
 void                    udisks_linux_drive_object_uevent        (UDisksLinuxDriveObject   *object,
                                                                  const gchar              *action,
                                                                  UDisksLinuxDevice        *device);
+void                    udisks_linux_drive_object_reload_configuration (UDisksLinuxDriveObject *object);
+void                    udisks_linux_drive_object_update_module_ifaces (UDisksLinuxDriveObject *object,
+                                                                        const gchar            *action);
 UDisksDaemon           *udisks_linux_drive_object_get_daemon    (UDisksLinuxDriveObject   *object);
 GList                  *udisks_linux_drive_object_get_devices   (UDisksLinuxDriveObject   *object);
 UDisksLinuxDevice      *udisks_linux_drive_object_get_device    (UDisksLinuxDriveObject   *object,
@@ -57,6 +60,9 @@ gboolean                udisks_linux_drive_object_is_not_in_use (UDisksLinuxDriv
 gboolean                udisks_linux_drive_object_should_include_device (GUdevClient        *client,
                                                                          UDisksLinuxDevice  *device,
                                                                          gchar             **out_vpd);
+gchar                  *udisks_linux_drive_object_dup_identity_key (UDisksLinuxDevice *device);
+void                    udisks_linux_drive_object_report_health (UDisksLinuxDriveObject       *object,
+                                                                 const UDisksLinuxDriveHealth *health);
 
 
 G_END_DECLS
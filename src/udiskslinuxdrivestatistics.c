@@ -0,0 +1,520 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udisksconfigmanager.h"
+#include "udiskslinuxdriveobject.h"
+#include "udiskslinuxdrivestatistics.h"
+#include "udiskslinuxdevice.h"
+#include "udiskssysfsreader.h"
+
+/**
+ * SECTION:udiskslinuxdrivestatistics
+ * @title: UDisksLinuxDriveStatistics
+ * @short_description: Linux implementation of #UDisksDriveStatistics
+ *
+ * This type provides an implementation of the #UDisksDriveStatistics
+ * interface on Linux.
+ *
+ * Nothing is sampled until a client subscribes. While there are
+ * subscribers, the <filename>stat</filename> file of the block device
+ * of the drive is read with a #UDisksSysfsReader on the common ticks
+ * of the daemon and the rates are computed from the difference to the
+ * previous sample.
+ */
+
+typedef struct _UDisksLinuxDriveStatisticsClass   UDisksLinuxDriveStatisticsClass;
+
+/* the fields of the stat file, see Documentation/block/stat.txt in the kernel sources */
+typedef struct
+{
+  guint64 read_ios;
+  guint64 read_merges;
+  guint64 read_sectors;
+  guint64 read_ticks;
+  guint64 write_ios;
+  guint64 write_merges;
+  guint64 write_sectors;
+  guint64 write_ticks;
+  guint64 in_flight;
+  guint64 io_ticks;
+  guint64 time_in_queue;
+} IoStat;
+
+/**
+ * UDisksLinuxDriveStatistics:
+ *
+ * The #UDisksLinuxDriveStatistics structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxDriveStatistics
+{
+  UDisksDriveStatisticsSkeleton parent_instance;
+
+  /* all members are protected by object_lock */
+
+  /* maps from the unique name of a subscriber to its name watch id */
+  GHashTable *subscribers;
+
+  guint timeout_id;
+  guint interval;
+
+  UDisksSysfsReader *reader;
+  gboolean have_sample;
+  IoStat last_stat;
+  gint64 last_time;
+};
+
+struct _UDisksLinuxDriveStatisticsClass
+{
+  UDisksDriveStatisticsSkeletonClass parent_class;
+};
+
+typedef struct
+{
+  UDisksLinuxDriveStatistics *drive;
+  gchar *name;
+} Subscriber;
+
+static void drive_statistics_iface_init (UDisksDriveStatisticsIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksLinuxDriveStatistics, udisks_linux_drive_statistics, UDISKS_TYPE_DRIVE_STATISTICS_SKELETON,
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_DRIVE_STATISTICS, drive_statistics_iface_init));
+
+G_LOCK_DEFINE_STATIC (object_lock);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+unwatch_name (gpointer data)
+{
+  g_bus_unwatch_name (GPOINTER_TO_UINT (data));
+}
+
+static void
+udisks_linux_drive_statistics_finalize (GObject *object)
+{
+  UDisksLinuxDriveStatistics *drive = UDISKS_LINUX_DRIVE_STATISTICS (object);
+
+  /* the subscribers and the timeout hold references, so they are gone by now */
+  g_hash_table_unref (drive->subscribers);
+  if (drive->reader != NULL)
+    udisks_sysfs_reader_free (drive->reader);
+
+  G_OBJECT_CLASS (udisks_linux_drive_statistics_parent_class)->finalize (object);
+}
+
+static void
+udisks_linux_drive_statistics_init (UDisksLinuxDriveStatistics *drive)
+{
+  drive->subscribers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, unwatch_name);
+}
+
+static void
+udisks_linux_drive_statistics_class_init (UDisksLinuxDriveStatisticsClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_drive_statistics_finalize;
+}
+
+/**
+ * udisks_linux_drive_statistics_new:
+ *
+ * Creates a new #UDisksLinuxDriveStatistics instance.
+ *
+ * Returns: A new #UDisksLinuxDriveStatistics. Free with g_object_unref().
+ */
+UDisksDriveStatistics *
+udisks_linux_drive_statistics_new (void)
+{
+  return UDISKS_DRIVE_STATISTICS (g_object_new (UDISKS_TYPE_LINUX_DRIVE_STATISTICS,
+                                                NULL));
+}
+
+/**
+ * udisks_linux_drive_statistics_update:
+ * @drive: A #UDisksLinuxDriveStatistics.
+ * @object: The enclosing #UDisksLinuxDriveObject instance.
+ *
+ * Updates the interface. The statistics themselves are only sampled
+ * while there are subscribers, not on uevents.
+ *
+ * Returns: %TRUE if configuration has changed, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_drive_statistics_update (UDisksLinuxDriveStatistics *drive,
+                                      UDisksLinuxDriveObject     *object)
+{
+  return FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+reset_properties (UDisksLinuxDriveStatistics *drive)
+{
+  UDisksDriveStatistics *iface = UDISKS_DRIVE_STATISTICS (drive);
+
+  g_object_freeze_notify (G_OBJECT (drive));
+  udisks_drive_statistics_set_updated (iface, 0);
+  udisks_drive_statistics_set_interval (iface, 0);
+  udisks_drive_statistics_set_read_bytes_per_second (iface, 0.0);
+  udisks_drive_statistics_set_write_bytes_per_second (iface, 0.0);
+  udisks_drive_statistics_set_read_iops (iface, 0.0);
+  udisks_drive_statistics_set_write_iops (iface, 0.0);
+  udisks_drive_statistics_set_read_latency (iface, 0.0);
+  udisks_drive_statistics_set_write_latency (iface, 0.0);
+  udisks_drive_statistics_set_in_flight (iface, 0);
+  udisks_drive_statistics_set_average_queue_size (iface, 0.0);
+  udisks_drive_statistics_set_utilization (iface, 0.0);
+  g_object_thaw_notify (G_OBJECT (drive));
+}
+
+/* The counters are unsigned long in the kernel and wrap around on
+ * 32-bit systems, they also restart when the device is re-created */
+static gdouble
+delta (guint64 now,
+       guint64 last)
+{
+  return now >= last ? (gdouble) (now - last) : 0.0;
+}
+
+static gdouble
+ratio (gdouble numerator,
+       gdouble denominator)
+{
+  return denominator > 0.0 ? numerator / denominator : 0.0;
+}
+
+/* called with object_lock held, returns FALSE if the stat file can't be read */
+static gboolean
+sample_locked (UDisksLinuxDriveStatistics *drive,
+               const gchar                *sysfs_path,
+               IoStat                     *stat,
+               gint64                     *now)
+{
+  GError *error = NULL;
+  gchar *contents;
+  gint num_fields;
+
+  if (drive->reader != NULL &&
+      g_strcmp0 (udisks_sysfs_reader_get_sysfs_path (drive->reader), sysfs_path) != 0)
+    {
+      g_clear_pointer (&drive->reader, udisks_sysfs_reader_free);
+      drive->have_sample = FALSE;
+    }
+  if (drive->reader == NULL)
+    drive->reader = udisks_sysfs_reader_new (sysfs_path);
+
+  contents = udisks_sysfs_reader_read (drive->reader, "stat", &error);
+  *now = g_get_monotonic_time ();
+  if (contents == NULL)
+    {
+      udisks_warning ("Failed to read %s/stat: %s", sysfs_path, error->message);
+      g_clear_error (&error);
+      return FALSE;
+    }
+
+  /* newer kernels append the discard and flush fields, which we don't use */
+  num_fields = sscanf (contents,
+                       "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+                       " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+                       " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+                       &stat->read_ios, &stat->read_merges, &stat->read_sectors, &stat->read_ticks,
+                       &stat->write_ios, &stat->write_merges, &stat->write_sectors, &stat->write_ticks,
+                       &stat->in_flight, &stat->io_ticks, &stat->time_in_queue);
+  if (num_fields != 11)
+    {
+      udisks_warning ("Failed to parse %s/stat: '%s'", sysfs_path, contents);
+      g_free (contents);
+      return FALSE;
+    }
+  g_free (contents);
+
+  return TRUE;
+}
+
+static void start_sampling_locked (UDisksLinuxDriveStatistics *drive,
+                                   UDisksDaemon               *daemon);
+
+static gboolean
+on_sample_timeout (gpointer user_data)
+{
+  UDisksLinuxDriveStatistics *drive = UDISKS_LINUX_DRIVE_STATISTICS (user_data);
+  UDisksDriveStatistics *iface = UDISKS_DRIVE_STATISTICS (drive);
+  UDisksLinuxDriveObject *object;
+  UDisksLinuxDevice *device = NULL;
+  UDisksDaemon *daemon;
+  gboolean have_last;
+  IoStat last;
+  IoStat stat;
+  gint64 last_time;
+  gint64 now;
+  gdouble elapsed_sec;
+  gdouble elapsed_msec;
+  gdouble read_ios;
+  gdouble write_ios;
+  guint interval;
+  gboolean ret = G_SOURCE_CONTINUE;
+
+  object = udisks_daemon_util_dup_object (drive, NULL);
+  if (object == NULL)
+    {
+      /* the drive is gone, nothing left to sample */
+      G_LOCK (object_lock);
+      g_hash_table_remove_all (drive->subscribers);
+      g_clear_pointer (&drive->reader, udisks_sysfs_reader_free);
+      drive->have_sample = FALSE;
+      drive->timeout_id = 0;
+      G_UNLOCK (object_lock);
+      return G_SOURCE_REMOVE;
+    }
+
+  daemon = udisks_linux_drive_object_get_daemon (object);
+  device = udisks_linux_drive_object_get_device (object, FALSE /* get_hw */);
+  if (device == NULL)
+    goto out;
+
+  G_LOCK (object_lock);
+  if (drive->timeout_id == 0)
+    {
+      /* the last subscriber went away while we were getting here */
+      G_UNLOCK (object_lock);
+      ret = G_SOURCE_REMOVE;
+      goto out;
+    }
+  if (!sample_locked (drive, g_udev_device_get_sysfs_path (device->udev_device), &stat, &now))
+    {
+      G_UNLOCK (object_lock);
+      goto out;
+    }
+  have_last = drive->have_sample;
+  last = drive->last_stat;
+  last_time = drive->last_time;
+  drive->have_sample = TRUE;
+  drive->last_stat = stat;
+  drive->last_time = now;
+
+  /* pick up changes of the configured interval */
+  interval = udisks_config_manager_get_statistics_interval (udisks_daemon_get_config_manager (daemon));
+  if (interval != drive->interval)
+    {
+      drive->timeout_id = 0;
+      start_sampling_locked (drive, daemon);
+      ret = G_SOURCE_REMOVE;
+    }
+  interval = drive->interval;
+  G_UNLOCK (object_lock);
+
+  if (!have_last || now <= last_time)
+    goto out;
+
+  elapsed_sec = (gdouble) (now - last_time) / G_USEC_PER_SEC;
+  elapsed_msec = elapsed_sec * 1000.0;
+  read_ios = delta (stat.read_ios, last.read_ios);
+  write_ios = delta (stat.write_ios, last.write_ios);
+
+  g_object_freeze_notify (G_OBJECT (drive));
+  udisks_drive_statistics_set_updated (iface, g_get_real_time ());
+  udisks_drive_statistics_set_interval (iface, interval);
+  /* the sectors are always 512 bytes, whatever the logical block size */
+  udisks_drive_statistics_set_read_bytes_per_second (iface, delta (stat.read_sectors, last.read_sectors) * 512.0 / elapsed_sec);
+  udisks_drive_statistics_set_write_bytes_per_second (iface, delta (stat.write_sectors, last.write_sectors) * 512.0 / elapsed_sec);
+  udisks_drive_statistics_set_read_iops (iface, read_ios / elapsed_sec);
+  udisks_drive_statistics_set_write_iops (iface, write_ios / elapsed_sec);
+  udisks_drive_statistics_set_read_latency (iface, ratio (delta (stat.read_ticks, last.read_ticks), read_ios));
+  udisks_drive_statistics_set_write_latency (iface, ratio (delta (stat.write_ticks, last.write_ticks), write_ios));
+  udisks_drive_statistics_set_in_flight (iface, (guint) MIN (stat.in_flight, G_MAXUINT));
+  udisks_drive_statistics_set_average_queue_size (iface, delta (stat.time_in_queue, last.time_in_queue) / elapsed_msec);
+  udisks_drive_statistics_set_utilization (iface, MIN (delta (stat.io_ticks, last.io_ticks) / elapsed_msec, 1.0));
+  g_object_thaw_notify (G_OBJECT (drive));
+
+ out:
+  g_clear_object (&device);
+  g_object_unref (object);
+  return ret;
+}
+
+/* called with object_lock held */
+static void
+start_sampling_locked (UDisksLinuxDriveStatistics *drive,
+                       UDisksDaemon               *daemon)
+{
+  if (drive->timeout_id != 0)
+    return;
+
+  drive->interval = udisks_config_manager_get_statistics_interval (udisks_daemon_get_config_manager (daemon));
+  drive->timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                              "drive-statistics",
+                                                              drive->interval,
+                                                              on_sample_timeout,
+                                                              g_object_ref (drive),
+                                                              g_object_unref);
+}
+
+/* called with object_lock held */
+static void
+stop_sampling_locked (UDisksLinuxDriveStatistics *drive)
+{
+  if (drive->timeout_id != 0)
+    {
+      g_source_remove (drive->timeout_id);
+      drive->timeout_id = 0;
+    }
+  g_clear_pointer (&drive->reader, udisks_sysfs_reader_free);
+  drive->have_sample = FALSE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+subscriber_free (Subscriber *subscriber)
+{
+  g_object_unref (subscriber->drive);
+  g_free (subscriber->name);
+  g_free (subscriber);
+}
+
+static void
+remove_subscriber (UDisksLinuxDriveStatistics *drive,
+                   const gchar                *name)
+{
+  gboolean stopped = FALSE;
+
+  G_LOCK (object_lock);
+  if (g_hash_table_remove (drive->subscribers, name) &&
+      g_hash_table_size (drive->subscribers) == 0)
+    {
+      stop_sampling_locked (drive);
+      stopped = TRUE;
+    }
+  G_UNLOCK (object_lock);
+
+  if (stopped)
+    reset_properties (drive);
+}
+
+static void
+on_subscriber_vanished (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         user_data)
+{
+  Subscriber *subscriber = user_data;
+
+  remove_subscriber (subscriber->drive, subscriber->name);
+}
+
+static gboolean
+handle_subscribe (UDisksDriveStatistics *_drive,
+                  GDBusMethodInvocation *invocation,
+                  GVariant              *options)
+{
+  UDisksLinuxDriveStatistics *drive = UDISKS_LINUX_DRIVE_STATISTICS (_drive);
+  const gchar *sender = g_dbus_method_invocation_get_sender (invocation);
+  UDisksLinuxDriveObject *object;
+  Subscriber *subscriber;
+  GError *error = NULL;
+  guint watch_id;
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  object = udisks_daemon_util_dup_object (drive, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  G_LOCK (object_lock);
+  if (!g_hash_table_contains (drive->subscribers, sender))
+    {
+      subscriber = g_new0 (Subscriber, 1);
+      subscriber->drive = g_object_ref (drive);
+      subscriber->name = g_strdup (sender);
+      watch_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                                 sender,
+                                                 G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                 NULL, /* name_appeared_handler */
+                                                 on_subscriber_vanished,
+                                                 subscriber,
+                                                 (GDestroyNotify) subscriber_free);
+      g_hash_table_insert (drive->subscribers, g_strdup (sender), GUINT_TO_POINTER (watch_id));
+      start_sampling_locked (drive, udisks_linux_drive_object_get_daemon (object));
+    }
+  G_UNLOCK (object_lock);
+
+  udisks_drive_statistics_complete_subscribe (_drive, invocation);
+
+ out:
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+static gboolean
+handle_unsubscribe (UDisksDriveStatistics *_drive,
+                    GDBusMethodInvocation *invocation,
+                    GVariant              *options)
+{
+  UDisksLinuxDriveStatistics *drive = UDISKS_LINUX_DRIVE_STATISTICS (_drive);
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  remove_subscriber (drive, g_dbus_method_invocation_get_sender (invocation));
+
+  udisks_drive_statistics_complete_unsubscribe (_drive, invocation);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+drive_statistics_iface_init (UDisksDriveStatisticsIface *iface)
+{
+  iface->handle_subscribe = handle_subscribe;
+  iface->handle_unsubscribe = handle_unsubscribe;
+}
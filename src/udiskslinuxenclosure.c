@@ -0,0 +1,517 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
+#include "udiskslinuxprovider.h"
+#include "udiskslinuxenclosureobject.h"
+#include "udiskslinuxenclosure.h"
+#include "udiskslinuxdriveobject.h"
+#include "udiskslinuxdevice.h"
+
+/**
+ * SECTION:udiskslinuxenclosure
+ * @title: UDisksLinuxEnclosure
+ * @short_description: Linux implementation of #UDisksEnclosure
+ *
+ * This type provides an implementation of the #UDisksEnclosure
+ * interface on Linux.
+ *
+ * The status and the LEDs of the elements change without any uevents
+ * so they are read from sysfs on every update, the slot to drive
+ * mapping is only recomputed then too. The identify and fault LEDs
+ * are set through the <literal>locate</literal> and
+ * <literal>fault</literal> attributes of the elements.
+ */
+
+typedef struct _UDisksLinuxEnclosureClass   UDisksLinuxEnclosureClass;
+
+/**
+ * UDisksLinuxEnclosure:
+ *
+ * The #UDisksLinuxEnclosure structure contains only private data and should
+ * only be accessed using the provided API.
+ */
+struct _UDisksLinuxEnclosure
+{
+  UDisksEnclosureSkeleton parent_instance;
+
+  /* sysfs paths of the block devices in the slots, protected by object_lock */
+  gchar **slot_devices;
+};
+
+struct _UDisksLinuxEnclosureClass
+{
+  UDisksEnclosureSkeletonClass parent_class;
+};
+
+static void enclosure_iface_init (UDisksEnclosureIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UDisksLinuxEnclosure, udisks_linux_enclosure, UDISKS_TYPE_ENCLOSURE_SKELETON,
+                         G_IMPLEMENT_INTERFACE (UDISKS_TYPE_ENCLOSURE, enclosure_iface_init));
+
+G_LOCK_DEFINE_STATIC (object_lock);
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+udisks_linux_enclosure_finalize (GObject *object)
+{
+  UDisksLinuxEnclosure *enclosure = UDISKS_LINUX_ENCLOSURE (object);
+
+  g_strfreev (enclosure->slot_devices);
+
+  if (G_OBJECT_CLASS (udisks_linux_enclosure_parent_class)->finalize != NULL)
+    G_OBJECT_CLASS (udisks_linux_enclosure_parent_class)->finalize (object);
+}
+
+static void
+udisks_linux_enclosure_init (UDisksLinuxEnclosure *enclosure)
+{
+  enclosure->slot_devices = g_new0 (gchar *, 1);
+}
+
+static void
+udisks_linux_enclosure_class_init (UDisksLinuxEnclosureClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_enclosure_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
+}
+
+/**
+ * udisks_linux_enclosure_new:
+ *
+ * Creates a new #UDisksLinuxEnclosure instance.
+ *
+ * Returns: A new #UDisksLinuxEnclosure. Free with g_object_unref().
+ */
+UDisksEnclosure *
+udisks_linux_enclosure_new (void)
+{
+  return UDISKS_ENCLOSURE (g_object_new (UDISKS_TYPE_LINUX_ENCLOSURE,
+                                         NULL));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Reads the attribute right from sysfs, gudev caches the values of the
+ * attributes for the lifetime of the GUdevDevice */
+static gchar *
+read_sysfs_attr (const gchar *path,
+                 const gchar *attr)
+{
+  gchar *filename;
+  gchar *contents = NULL;
+
+  filename = g_build_filename (path, attr, NULL);
+  if (g_file_get_contents (filename, &contents, NULL, NULL))
+    g_strstrip (contents);
+  g_free (filename);
+
+  return contents;
+}
+
+static gboolean
+write_sysfs_attr (const gchar  *path,
+                  const gchar  *attr,
+                  const gchar  *value,
+                  GError      **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename;
+  gint fd;
+
+  filename = g_build_filename (path, attr, NULL);
+  fd = open (filename, O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %s", filename, g_strerror (errno));
+      goto out;
+    }
+  if (write (fd, value, strlen (value)) == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error writing %s: %s", filename, g_strerror (errno));
+      close (fd);
+      goto out;
+    }
+  close (fd);
+  ret = TRUE;
+
+ out:
+  g_free (filename);
+  return ret;
+}
+
+static gint
+slot_name_cmp (gconstpointer a,
+               gconstpointer b)
+{
+  gchar *key_a;
+  gchar *key_b;
+  gint ret;
+
+  /* so "Slot 2" comes before "Slot 10" */
+  key_a = g_utf8_collate_key_for_filename (*(const gchar **) a, -1);
+  key_b = g_utf8_collate_key_for_filename (*(const gchar **) b, -1);
+  ret = strcmp (key_a, key_b);
+  g_free (key_a);
+  g_free (key_b);
+
+  return ret;
+}
+
+/* Gets the names of the elements of the enclosure at @sysfs_path, that is
+ * the sub-directories with a "type" attribute. The symlinks, e.g. "device",
+ * are skipped. */
+static GPtrArray *
+get_slot_names (const gchar *sysfs_path)
+{
+  GPtrArray *ret;
+  GDir *dir;
+  const gchar *name;
+
+  ret = g_ptr_array_new_with_free_func (g_free);
+  dir = g_dir_open (sysfs_path, 0, NULL);
+  if (dir == NULL)
+    return ret;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *path;
+      gchar *type_path;
+
+      path = g_build_filename (sysfs_path, name, NULL);
+      type_path = g_build_filename (path, "type", NULL);
+      if (!g_file_test (path, G_FILE_TEST_IS_SYMLINK) &&
+          g_file_test (type_path, G_FILE_TEST_IS_REGULAR))
+        g_ptr_array_add (ret, g_strdup (name));
+      g_free (type_path);
+      g_free (path);
+    }
+  g_dir_close (dir);
+
+  g_ptr_array_sort (ret, slot_name_cmp);
+  return ret;
+}
+
+static void
+add_string (GVariantBuilder *builder,
+            const gchar     *key,
+            const gchar     *path,
+            const gchar     *attr)
+{
+  gchar *value;
+
+  value = read_sysfs_attr (path, attr);
+  if (value != NULL)
+    g_variant_builder_add (builder, "{sv}", key, g_variant_new_string (value));
+  g_free (value);
+}
+
+static void
+add_boolean (GVariantBuilder *builder,
+             const gchar     *key,
+             const gchar     *path,
+             const gchar     *attr)
+{
+  gchar *value;
+
+  value = read_sysfs_attr (path, attr);
+  if (value != NULL && *value != '\0')
+    g_variant_builder_add (builder, "{sv}", key, g_variant_new_boolean (g_ascii_strtoull (value, NULL, 10) != 0));
+  g_free (value);
+}
+
+static gchar *
+get_parent_attr (GUdevDevice *device,
+                 const gchar *attr)
+{
+  GUdevDevice *parent;
+  gchar *ret = NULL;
+
+  parent = g_udev_device_get_parent (device);
+  if (parent != NULL)
+    {
+      ret = g_strdup (g_udev_device_get_sysfs_attr (parent, attr));
+      if (ret != NULL)
+        g_strstrip (ret);
+      g_object_unref (parent);
+    }
+
+  return ret;
+}
+
+/**
+ * udisks_linux_enclosure_update:
+ * @enclosure: A #UDisksLinuxEnclosure.
+ * @object: The enclosing #UDisksLinuxEnclosureObject instance.
+ *
+ * Updates the interface. This may be called from any thread.
+ *
+ * Returns: %TRUE if configuration has changed, %FALSE otherwise.
+ */
+gboolean
+udisks_linux_enclosure_update (UDisksLinuxEnclosure       *enclosure,
+                               UDisksLinuxEnclosureObject *object)
+{
+  UDisksEnclosure *iface = UDISKS_ENCLOSURE (enclosure);
+  UDisksLinuxProvider *provider;
+  UDisksLinuxDevice *device;
+  GVariantBuilder builder;
+  GPtrArray *slot_devices;
+  GPtrArray *slot_names;
+  const gchar *sysfs_path;
+  gchar *vendor;
+  gchar *model;
+  gchar *revision;
+  guint n;
+
+  provider = udisks_daemon_get_linux_provider (udisks_linux_enclosure_object_get_daemon (object));
+  device = udisks_linux_enclosure_object_get_device (object);
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+
+  /* the enclosure itself is a SCSI device of its own */
+  vendor = get_parent_attr (device->udev_device, "vendor");
+  model = get_parent_attr (device->udev_device, "model");
+  revision = get_parent_attr (device->udev_device, "rev");
+
+  slot_devices = g_ptr_array_new ();
+  slot_names = get_slot_names (sysfs_path);
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sa{sv})"));
+  for (n = 0; n < slot_names->len; n++)
+    {
+      const gchar *name = slot_names->pdata[n];
+      GVariantBuilder details;
+      gchar *path;
+      gchar *slot;
+      gchar **blocks;
+
+      path = g_build_filename (sysfs_path, name, NULL);
+      g_variant_builder_init (&details, G_VARIANT_TYPE_VARDICT);
+      add_string (&details, "type", path, "type");
+      slot = read_sysfs_attr (path, "slot");
+      if (slot != NULL && *slot != '\0')
+        g_variant_builder_add (&details, "{sv}", "slot", g_variant_new_int32 (atoi (slot)));
+      g_free (slot);
+      add_string (&details, "status", path, "status");
+      add_boolean (&details, "fault", path, "fault");
+      add_boolean (&details, "locate", path, "locate");
+
+      /* the SCSI device in the slot, if any, and its block device */
+      blocks = udisks_daemon_util_resolve_links (path, "device/block");
+      if (blocks != NULL && blocks[0] != NULL)
+        {
+          UDisksLinuxDriveObject *drive_object;
+
+          g_ptr_array_add (slot_devices, g_strdup (blocks[0]));
+          drive_object = udisks_linux_provider_find_drive_by_sysfs_path (provider, blocks[0]);
+          if (drive_object != NULL)
+            {
+              g_variant_builder_add (&details, "{sv}", "drive",
+                                     g_variant_new_object_path (g_dbus_object_get_object_path (G_DBUS_OBJECT (drive_object))));
+              g_object_unref (drive_object);
+            }
+        }
+      g_strfreev (blocks);
+
+      g_variant_builder_add (&builder, "(s@a{sv})", name, g_variant_builder_end (&details));
+      g_free (path);
+    }
+  g_ptr_array_add (slot_devices, NULL);
+
+  G_LOCK (object_lock);
+  g_strfreev (enclosure->slot_devices);
+  enclosure->slot_devices = (gchar **) g_ptr_array_free (slot_devices, FALSE);
+  G_UNLOCK (object_lock);
+
+  g_object_freeze_notify (G_OBJECT (iface));
+  udisks_enclosure_set_name (iface, g_udev_device_get_name (device->udev_device));
+  udisks_enclosure_set_logical_id (iface, g_udev_device_get_sysfs_attr (device->udev_device, "id"));
+  udisks_enclosure_set_vendor (iface, vendor);
+  udisks_enclosure_set_model (iface, model);
+  udisks_enclosure_set_revision (iface, revision);
+  udisks_enclosure_set_slots (iface, g_variant_builder_end (&builder));
+  g_object_thaw_notify (G_OBJECT (iface));
+
+  g_ptr_array_unref (slot_names);
+  g_free (vendor);
+  g_free (model);
+  g_free (revision);
+  g_object_unref (device);
+
+  return FALSE;
+}
+
+/**
+ * udisks_linux_enclosure_dup_slot_devices:
+ * @enclosure: A #UDisksLinuxEnclosure.
+ *
+ * Gets the sysfs paths of the block devices in the slots of
+ * @enclosure as of the last update. This may be called from any
+ * thread.
+ *
+ * Returns: (transfer full): A %NULL-terminated array of sysfs paths. Free with g_strfreev().
+ */
+gchar **
+udisks_linux_enclosure_dup_slot_devices (UDisksLinuxEnclosure *enclosure)
+{
+  gchar **ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_ENCLOSURE (enclosure), NULL);
+
+  G_LOCK (object_lock);
+  ret = g_strdupv (enclosure->slot_devices);
+  G_UNLOCK (object_lock);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+has_slot (UDisksEnclosure *enclosure,
+          const gchar     *slot)
+{
+  GVariant *slots;
+  GVariantIter iter;
+  const gchar *name;
+  gboolean ret = FALSE;
+
+  slots = udisks_enclosure_dup_slots (enclosure);
+  if (slots == NULL)
+    return FALSE;
+
+  g_variant_iter_init (&iter, slots);
+  while (g_variant_iter_next (&iter, "(&s@a{sv})", &name, NULL))
+    {
+      if (g_strcmp0 (name, slot) == 0)
+        {
+          ret = TRUE;
+          break;
+        }
+    }
+  g_variant_unref (slots);
+
+  return ret;
+}
+
+static gboolean
+handle_set_slot_led (UDisksEnclosure       *_enclosure,
+                     GDBusMethodInvocation *invocation,
+                     const gchar           *slot,
+                     const gchar           *led,
+                     gboolean               on,
+                     GVariant              *options)
+{
+  UDisksLinuxEnclosure *enclosure = UDISKS_LINUX_ENCLOSURE (_enclosure);
+  UDisksLinuxEnclosureObject *object;
+  UDisksLinuxDevice *device = NULL;
+  UDisksDaemon *daemon;
+  const gchar *action_id;
+  const gchar *message;
+  gchar *path = NULL;
+  GError *error = NULL;
+
+  object = udisks_daemon_util_dup_object (enclosure, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_enclosure_object_get_daemon (object);
+
+  if (g_strcmp0 (led, "locate") != 0 && g_strcmp0 (led, "fault") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Unknown LED `%s'", led);
+      goto out;
+    }
+
+  if (!has_slot (_enclosure, slot))
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "No slot `%s' in enclosure %s",
+                                             slot, udisks_enclosure_get_name (_enclosure));
+      goto out;
+    }
+
+  /* Translators: Shown in authentication dialog when the user
+   * attempts to turn the identify or fault LED of a slot of an
+   * enclosure on or off.
+   */
+  message = N_("Authentication is required to manage an enclosure");
+  action_id = "org.freedesktop.udisks2.manage-enclosure";
+  if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                    UDISKS_OBJECT (object),
+                                                    action_id,
+                                                    options,
+                                                    message,
+                                                    invocation))
+    goto out;
+
+  device = udisks_linux_enclosure_object_get_device (object);
+  path = g_build_filename (g_udev_device_get_sysfs_path (device->udev_device), slot, NULL);
+  if (!write_sysfs_attr (path, led, on ? "1" : "0", &error))
+    {
+      g_prefix_error (&error, "Error setting the %s LED of slot `%s': ", led, slot);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  udisks_notice ("Turned the %s LED of slot `%s' in enclosure %s %s",
+                 led, slot, udisks_enclosure_get_name (_enclosure), on ? "on" : "off");
+
+  /* there's no uevent for this */
+  udisks_linux_enclosure_update (enclosure, object);
+
+  udisks_enclosure_complete_set_slot_led (_enclosure, invocation);
+
+ out:
+  g_free (path);
+  g_clear_object (&device);
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+enclosure_iface_init (UDisksEnclosureIface *iface)
+{
+  iface->handle_set_slot_led = handle_set_slot_led;
+}
@@ -0,0 +1,423 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <string.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksdaemonutil.h"
+#include "udiskslinuxenclosureobject.h"
+#include "udiskslinuxenclosure.h"
+#include "udiskslinuxdevice.h"
+
+/**
+ * SECTION:udiskslinuxenclosureobject
+ * @title: UDisksLinuxEnclosureObject
+ * @short_description: Object representing a SES enclosure
+ *
+ * Object corresponding to a SES (SCSI Enclosure Services) enclosure,
+ * i.e. a device in the <literal>enclosure</literal> class, see
+ * <filename>/sys/class/enclosure</filename>.
+ *
+ * The kernel links the SCSI device in a slot of the enclosure and
+ * the element (component) of the enclosure for the slot both ways,
+ * with the <literal>device</literal> link in the element and the
+ * <literal>enclosure_device:<replaceable>slot</replaceable></literal> link in the SCSI device.
+ * The enclosure uses the former to fill its slots and a drive the
+ * latter to find the slot it's in, see udisks_linux_enclosure_object_find_slot().
+ */
+
+typedef struct _UDisksLinuxEnclosureObjectClass   UDisksLinuxEnclosureObjectClass;
+
+/**
+ * UDisksLinuxEnclosureObject:
+ *
+ * The #UDisksLinuxEnclosureObject structure contains only private data and
+ * should only be accessed using the provided API.
+ */
+struct _UDisksLinuxEnclosureObject
+{
+  UDisksObjectSkeleton parent_instance;
+
+  UDisksDaemon *daemon;
+
+  /* The UDisksLinuxDevice for the enclosure class device, protected by object_lock */
+  UDisksLinuxDevice *device;
+
+  /* interfaces */
+  UDisksEnclosure *iface_enclosure;
+};
+
+struct _UDisksLinuxEnclosureObjectClass
+{
+  UDisksObjectSkeletonClass parent_class;
+};
+
+enum
+{
+  PROP_0,
+  PROP_DAEMON,
+  PROP_DEVICE,
+};
+
+G_DEFINE_TYPE (UDisksLinuxEnclosureObject, udisks_linux_enclosure_object, UDISKS_TYPE_OBJECT_SKELETON);
+
+G_LOCK_DEFINE_STATIC (object_lock);
+
+static void
+udisks_linux_enclosure_object_finalize (GObject *_object)
+{
+  UDisksLinuxEnclosureObject *object = UDISKS_LINUX_ENCLOSURE_OBJECT (_object);
+
+  /* note: we don't hold a ref to object->daemon */
+
+  if (object->iface_enclosure != NULL)
+    g_object_unref (object->iface_enclosure);
+
+  g_clear_object (&object->device);
+
+  if (G_OBJECT_CLASS (udisks_linux_enclosure_object_parent_class)->finalize != NULL)
+    G_OBJECT_CLASS (udisks_linux_enclosure_object_parent_class)->finalize (_object);
+}
+
+static void
+udisks_linux_enclosure_object_get_property (GObject    *__object,
+                                            guint       prop_id,
+                                            GValue     *value,
+                                            GParamSpec *pspec)
+{
+  UDisksLinuxEnclosureObject *object = UDISKS_LINUX_ENCLOSURE_OBJECT (__object);
+
+  switch (prop_id)
+    {
+    case PROP_DAEMON:
+      g_value_set_object (value, udisks_linux_enclosure_object_get_daemon (object));
+      break;
+
+    case PROP_DEVICE:
+      g_value_take_object (value, udisks_linux_enclosure_object_get_device (object));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+udisks_linux_enclosure_object_set_property (GObject      *__object,
+                                            guint         prop_id,
+                                            const GValue *value,
+                                            GParamSpec   *pspec)
+{
+  UDisksLinuxEnclosureObject *object = UDISKS_LINUX_ENCLOSURE_OBJECT (__object);
+
+  switch (prop_id)
+    {
+    case PROP_DAEMON:
+      g_assert (object->daemon == NULL);
+      /* we don't take a reference to the daemon */
+      object->daemon = g_value_get_object (value);
+      break;
+
+    case PROP_DEVICE:
+      g_assert (object->device == NULL);
+      object->device = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+udisks_linux_enclosure_object_init (UDisksLinuxEnclosureObject *object)
+{
+}
+
+static void
+udisks_linux_enclosure_object_constructed (GObject *_object)
+{
+  UDisksLinuxEnclosureObject *object = UDISKS_LINUX_ENCLOSURE_OBJECT (_object);
+  gchar *s;
+
+  /* compute the object path */
+  s = udisks_linux_enclosure_object_compute_object_path (g_udev_device_get_name (object->device->udev_device));
+  g_dbus_object_skeleton_set_object_path (G_DBUS_OBJECT_SKELETON (object), s);
+  g_free (s);
+
+  if (G_OBJECT_CLASS (udisks_linux_enclosure_object_parent_class)->constructed != NULL)
+    G_OBJECT_CLASS (udisks_linux_enclosure_object_parent_class)->constructed (_object);
+}
+
+static void
+udisks_linux_enclosure_object_class_init (UDisksLinuxEnclosureObjectClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize     = udisks_linux_enclosure_object_finalize;
+  gobject_class->constructed  = udisks_linux_enclosure_object_constructed;
+  gobject_class->set_property = udisks_linux_enclosure_object_set_property;
+  gobject_class->get_property = udisks_linux_enclosure_object_get_property;
+
+  /**
+   * UDisksLinuxEnclosureObject:daemon:
+   *
+   * The #UDisksDaemon the object is for.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_DAEMON,
+                                   g_param_spec_object ("daemon",
+                                                        "Daemon",
+                                                        "The daemon the object is for",
+                                                        UDISKS_TYPE_DAEMON,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_WRITABLE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksLinuxEnclosureObject:device:
+   *
+   * The #UDisksLinuxDevice of the enclosure class device.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_DEVICE,
+                                   g_param_spec_object ("device",
+                                                        "Device",
+                                                        "The device for the enclosure",
+                                                        UDISKS_TYPE_LINUX_DEVICE,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_WRITABLE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * udisks_linux_enclosure_object_new:
+ * @daemon: A #UDisksDaemon.
+ * @device: The #UDisksLinuxDevice for the enclosure class device.
+ *
+ * Create a new enclosure object.
+ *
+ * Returns: A #UDisksLinuxEnclosureObject object. Free with g_object_unref().
+ */
+UDisksLinuxEnclosureObject *
+udisks_linux_enclosure_object_new (UDisksDaemon      *daemon,
+                                   UDisksLinuxDevice *device)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), NULL);
+  return UDISKS_LINUX_ENCLOSURE_OBJECT (g_object_new (UDISKS_TYPE_LINUX_ENCLOSURE_OBJECT,
+                                                      "daemon", daemon,
+                                                      "device", device,
+                                                      NULL));
+}
+
+/**
+ * udisks_linux_enclosure_object_get_daemon:
+ * @object: A #UDisksLinuxEnclosureObject.
+ *
+ * Gets the daemon used by @object.
+ *
+ * Returns: A #UDisksDaemon. Do not free, the object is owned by @object.
+ */
+UDisksDaemon *
+udisks_linux_enclosure_object_get_daemon (UDisksLinuxEnclosureObject *object)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_ENCLOSURE_OBJECT (object), NULL);
+  return object->daemon;
+}
+
+/**
+ * udisks_linux_enclosure_object_get_device:
+ * @object: A #UDisksLinuxEnclosureObject.
+ *
+ * Gets the current #UDisksLinuxDevice for the enclosure class device.
+ * This may be called from any thread.
+ *
+ * Returns: (transfer full): A #UDisksLinuxDevice. Free with g_object_unref().
+ */
+UDisksLinuxDevice *
+udisks_linux_enclosure_object_get_device (UDisksLinuxEnclosureObject *object)
+{
+  UDisksLinuxDevice *ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_ENCLOSURE_OBJECT (object), NULL);
+
+  G_LOCK (object_lock);
+  ret = g_object_ref (object->device);
+  G_UNLOCK (object_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_enclosure_object_dup_slot_devices:
+ * @object: A #UDisksLinuxEnclosureObject.
+ *
+ * Gets the sysfs paths of the block devices in the slots of @object
+ * as of the last update.
+ *
+ * Returns: (transfer full): A %NULL-terminated array of sysfs paths. Free with g_strfreev().
+ */
+gchar **
+udisks_linux_enclosure_object_dup_slot_devices (UDisksLinuxEnclosureObject *object)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_ENCLOSURE_OBJECT (object), NULL);
+
+  if (object->iface_enclosure == NULL)
+    return g_new0 (gchar *, 1);
+
+  return udisks_linux_enclosure_dup_slot_devices (UDISKS_LINUX_ENCLOSURE (object->iface_enclosure));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_enclosure_object_uevent:
+ * @object: A #UDisksLinuxEnclosureObject.
+ * @action: Uevent action or %NULL
+ * @device: A #UDisksLinuxDevice device object or %NULL if the device hasn't changed.
+ *
+ * Updates all information on interfaces on @object.
+ */
+void
+udisks_linux_enclosure_object_uevent (UDisksLinuxEnclosureObject *object,
+                                      const gchar                *action,
+                                      UDisksLinuxDevice          *device)
+{
+  gboolean add = FALSE;
+
+  g_return_if_fail (UDISKS_IS_LINUX_ENCLOSURE_OBJECT (object));
+  g_return_if_fail (device == NULL || UDISKS_IS_LINUX_DEVICE (device));
+
+  if (device != NULL && device != object->device)
+    {
+      G_LOCK (object_lock);
+      g_object_unref (object->device);
+      object->device = g_object_ref (device);
+      G_UNLOCK (object_lock);
+    }
+
+  /* the enclosure interface is there for as long as the object */
+  if (object->iface_enclosure == NULL)
+    {
+      object->iface_enclosure = udisks_linux_enclosure_new ();
+      add = TRUE;
+    }
+  udisks_linux_enclosure_update (UDISKS_LINUX_ENCLOSURE (object->iface_enclosure), object);
+  if (add)
+    g_dbus_object_skeleton_add_interface (G_DBUS_OBJECT_SKELETON (object),
+                                          G_DBUS_INTERFACE_SKELETON (object->iface_enclosure));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_enclosure_object_compute_object_path:
+ * @name: The kernel name of an enclosure, e.g. <literal>6:0:12:0</literal>.
+ *
+ * Computes the object path of the enclosure object for the enclosure
+ * with the name @name. Enclosure names are unique so the object path
+ * can be computed without looking the object up.
+ *
+ * Returns: The object path. Free with g_free().
+ */
+gchar *
+udisks_linux_enclosure_object_compute_object_path (const gchar *name)
+{
+  GString *str;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  str = g_string_new ("/org/freedesktop/UDisks2/enclosures/");
+  udisks_safe_append_to_object_path (str, name);
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * udisks_linux_enclosure_object_find_slot:
+ * @sysfs_path: The sysfs path of a whole-disk block device.
+ * @out_object_path: (out): Return location for the object path of the enclosure.
+ * @out_slot: (out): Return location for the name of the slot.
+ *
+ * Finds the enclosure slot the SCSI device of the block device at
+ * @sysfs_path is in from the <literal>enclosure_device:</literal>
+ * link the kernel adds to the SCSI device.
+ *
+ * Returns: %TRUE if @out_object_path and @out_slot are set, %FALSE if the device is not in an enclosure.
+ */
+gboolean
+udisks_linux_enclosure_object_find_slot (const gchar  *sysfs_path,
+                                         gchar       **out_object_path,
+                                         gchar       **out_slot)
+{
+  gboolean ret = FALSE;
+  gchar *device_path;
+  GDir *dir;
+  const gchar *name;
+
+  g_return_val_if_fail (sysfs_path != NULL, FALSE);
+  g_return_val_if_fail (out_object_path != NULL, FALSE);
+  g_return_val_if_fail (out_slot != NULL, FALSE);
+
+  device_path = g_build_filename (sysfs_path, "device", NULL);
+  dir = g_dir_open (device_path, 0, NULL);
+  if (dir == NULL)
+    goto out;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *component;
+      gchar *enclosure_path;
+      gchar *enclosure_name;
+
+      if (!g_str_has_prefix (name, "enclosure_device:"))
+        continue;
+
+      /* the link points to the element, in the directory of the enclosure */
+      component = udisks_daemon_util_resolve_link (device_path, name);
+      if (component == NULL)
+        continue;
+
+      enclosure_path = g_path_get_dirname (component);
+      enclosure_name = g_path_get_basename (enclosure_path);
+      *out_object_path = udisks_linux_enclosure_object_compute_object_path (enclosure_name);
+      *out_slot = g_path_get_basename (component);
+      g_free (enclosure_name);
+      g_free (enclosure_path);
+      g_free (component);
+      ret = TRUE;
+      break;
+    }
+
+ out:
+  if (dir != NULL)
+    g_dir_close (dir);
+  g_free (device_path);
+  return ret;
+}
@@ -26,6 +26,7 @@
 #include <grp.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <blockdev/crypto.h>
 
@@ -37,9 +38,12 @@
 #include "udiskslinuxblockobject.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksconfigmanager.h"
+#include "udisksmethoddispatcher.h"
 #include "udisksstate.h"
 #include "udiskslinuxdevice.h"
 #include "udiskslinuxblock.h"
+#include "udiskslinuxprovider.h"
 #include "udisksfstabentry.h"
 #include "udisksfstabmonitor.h"
 #include "udiskscrypttabentry.h"
@@ -69,6 +73,12 @@ typedef struct _UDisksLinuxEncryptedClass   UDisksLinuxEncryptedClass;
 struct _UDisksLinuxEncrypted
 {
   UDisksEncryptedSkeleton parent_instance;
+
+  /* the header the metadata size was last read from, protected by
+   * udisks_linux_block_encrypted_lock() */
+  gchar *header_uuid;
+  guint64 header_seqid;
+  guint64 metadata_size;
 };
 
 struct _UDisksLinuxEncryptedClass
@@ -86,13 +96,28 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxEncrypted, udisks_linux_encrypted, UDISKS_TY
 static void
 udisks_linux_encrypted_init (UDisksLinuxEncrypted *encrypted)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (encrypted),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+}
+
+static void
+udisks_linux_encrypted_finalize (GObject *object)
+{
+  UDisksLinuxEncrypted *encrypted = UDISKS_LINUX_ENCRYPTED (object);
+
+  g_free (encrypted->header_uuid);
+
+  if (G_OBJECT_CLASS (udisks_linux_encrypted_parent_class)->finalize)
+    G_OBJECT_CLASS (udisks_linux_encrypted_parent_class)->finalize (object);
 }
 
 static void
 udisks_linux_encrypted_class_init (UDisksLinuxEncryptedClass *klass)
 {
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_encrypted_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -163,14 +188,35 @@ update_metadata_size (UDisksLinuxEncrypted   *encrypted,
                       UDisksLinuxBlockObject *object)
 {
   UDisksLinuxDevice *device;
+  const gchar *device_file;
   guint64 metadata_size;
+  gchar *header_uuid = NULL;
+  guint64 header_seqid = 0;
   GError *error = NULL;
 
   device = udisks_linux_block_object_get_device (object);
+  device_file = g_udev_device_get_device_file (device->udev_device);
 
-  metadata_size = bd_crypto_luks_get_metadata_size (g_udev_device_get_device_file (device->udev_device),
-                                                    &error);
+  /* Getting the metadata size makes libcryptsetup load and parse the whole
+   * header, up to 4 MiB for LUKS2. Skip that unless it has changed since
+   * the last update, which is cheap to tell from the binary header.
+   */
+  if (luks_get_header_id (device_file, &header_uuid, &header_seqid, NULL))
+    {
+      if (encrypted->header_uuid != NULL &&
+          g_strcmp0 (encrypted->header_uuid, header_uuid) == 0 &&
+          encrypted->header_seqid == header_seqid)
+        {
+          g_free (header_uuid);
+          metadata_size = encrypted->metadata_size;
+          goto out;
+        }
+    }
+
+  metadata_size = bd_crypto_luks_get_metadata_size (device_file, &error);
 
+  g_free (encrypted->header_uuid);
+  encrypted->header_uuid = NULL;
   if (error != NULL)
     {
       udisks_warning ("Error getting '%s' metadata_size: %s (%s, %d)",
@@ -179,8 +225,16 @@ update_metadata_size (UDisksLinuxEncrypted   *encrypted,
                       g_quark_to_string (error->domain),
                       error->code);
       g_clear_error (&error);
+      g_free (header_uuid);
+    }
+  else
+    {
+      encrypted->header_uuid = header_uuid;
+      encrypted->header_seqid = header_seqid;
+      encrypted->metadata_size = metadata_size;
     }
 
+ out:
   g_object_unref (device);
   udisks_encrypted_set_metadata_size (UDISKS_ENCRYPTED (encrypted), metadata_size);
 }
@@ -192,10 +246,13 @@ update_cleartext_device (UDisksLinuxEncrypted   *encrypted,
   UDisksObject *cleartext_object = NULL;
   UDisksDaemon *daemon = udisks_linux_block_object_get_daemon (object);
   const gchar *encrypted_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+  UDisksLinuxDevice *device;
 
-  /* wait_for_cleartext is used primarly in unlock but does exactly what we
-     want -- returns a cleartext object for an encrypted object */
-  cleartext_object = wait_for_cleartext_object (daemon, (gpointer) encrypted_path);
+  device = udisks_linux_block_object_get_device (object);
+  cleartext_object = UDISKS_OBJECT (udisks_linux_provider_find_cleartext_block (udisks_daemon_get_linux_provider (daemon),
+                                                                               g_udev_device_get_sysfs_path (device->udev_device),
+                                                                               encrypted_path));
+  g_object_unref (device);
 
   if (cleartext_object)
     {
@@ -322,22 +379,62 @@ has_option (const gchar *options,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* runs in thread dedicated to handling @invocation */
+/* The memory available for deriving the keys of the devices unlocked
+ * by a single Manager.UnlockEncrypted() call at the same time.
+ */
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  guint64 budget;
+  guint64 used;
+} KdfMemoryBudget;
+
+/* Waits until @memory fits into @budget, a single device that needs more
+ * than the whole budget is unlocked on its own. */
+static void
+kdf_memory_budget_acquire (KdfMemoryBudget *budget,
+                           guint64          memory)
+{
+  g_mutex_lock (&budget->lock);
+  while (budget->used > 0 && budget->used + memory > budget->budget)
+    g_cond_wait (&budget->cond, &budget->lock);
+  budget->used += memory;
+  g_mutex_unlock (&budget->lock);
+}
+
+static void
+kdf_memory_budget_release (KdfMemoryBudget *budget,
+                           guint64          memory)
+{
+  g_mutex_lock (&budget->lock);
+  budget->used -= memory;
+  g_cond_broadcast (&budget->cond);
+  g_mutex_unlock (&budget->lock);
+}
+
+/* Opens the cleartext device of @encrypted, without waiting for its object.
+ *
+ * runs in thread dedicated to handling @invocation or in a thread
+ * unlocking one of the devices of a bulk request
+ */
 static gboolean
-handle_unlock (UDisksEncrypted        *encrypted,
-               GDBusMethodInvocation  *invocation,
-               const gchar            *passphrase,
-               GVariant               *options)
+open_encrypted (UDisksEncrypted          *encrypted,
+                GDBusMethodInvocation    *invocation,
+                const gchar              *passphrase,
+                GVariant                 *options,
+                UDisksBulkAuthorization  *bulk,
+                KdfMemoryBudget          *budget,
+                UDisksObject            **out_object,
+                uid_t                    *out_caller_uid,
+                GError                  **error)
 {
   UDisksObject *object = NULL;
   UDisksBlock *block;
   UDisksDaemon *daemon;
-  UDisksState *state;
   gchar *name = NULL;
   UDisksObject *cleartext_object = NULL;
-  UDisksBlock *cleartext_block;
-  UDisksLinuxDevice *cleartext_device = NULL;
-  GError *error = NULL;
+  GError *local_error = NULL;
   uid_t caller_uid;
   const gchar *action_id;
   const gchar *message;
@@ -359,17 +456,15 @@ handle_unlock (UDisksEncrypted        *encrypted,
   gboolean is_luks;
   gboolean handle_as_tcrypt;
   void *open_func;
+  guint64 kdf_memory = 0;
+  gboolean ret = FALSE;
 
-  object = udisks_daemon_util_dup_object (encrypted, &error);
+  object = udisks_daemon_util_dup_object (encrypted, error);
   if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+    goto out;
 
   block = udisks_object_peek_block (object);
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
-  state = udisks_daemon_get_state (daemon);
   is_luks = udisks_linux_block_is_luks (block);
   handle_as_tcrypt = udisks_linux_block_is_tcrypt (block) || udisks_linux_block_is_unknown_crypto (block);
 
@@ -405,11 +500,11 @@ handle_unlock (UDisksEncrypted        *encrypted,
   /* Fail if the device is not a LUKS or possible TCRYPT device */
   if (!(is_luks || handle_as_tcrypt))
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Device %s does not appear to be a LUKS or TCRYPT device",
-                                             udisks_block_get_device (block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Device %s does not appear to be a LUKS or TCRYPT device",
+                   udisks_block_get_device (block));
       goto out;
     }
 
@@ -419,27 +514,24 @@ handle_unlock (UDisksEncrypted        *encrypted,
                                                          g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
                                                          g_free,
                                                          0, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          NULL); /* error */
   if (cleartext_object != NULL)
     {
       UDisksBlock *unlocked_block;
       unlocked_block = udisks_object_peek_block (cleartext_object);
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Device %s is already unlocked as %s",
-                                             udisks_block_get_device (block),
-                                             udisks_block_get_device (unlocked_block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Device %s is already unlocked as %s",
+                   udisks_block_get_device (block),
+                   udisks_block_get_device (unlocked_block));
       goto out;
     }
 
   /* we need the uid of the caller for the unlocked-crypto-dev file */
-  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, error))
+    goto out;
 
   /* check if in crypttab file */
   if (!check_crypttab (block,
@@ -449,11 +541,8 @@ handle_unlock (UDisksEncrypted        *encrypted,
                        &crypttab_passphrase,
                        &crypttab_passphrase_len,
                        &crypttab_options,
-                       &error))
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+                       error))
+    goto out;
 
   /* fallback mechanism: keyfile_contents (for LUKS) -> passphrase -> crypttab_passphrase -> TCRYPT keyfiles -> error (no key) */
   if (is_luks && udisks_variant_lookup_binary (options, "keyfile_contents", &effective_passphrase))
@@ -468,11 +557,11 @@ handle_unlock (UDisksEncrypted        *encrypted,
     effective_passphrase = g_string_new (NULL);
   else
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "No key available to unlock device %s",
-                                             udisks_block_get_device (block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "No key available to unlock device %s",
+                   udisks_block_get_device (block));
       goto out;
     }
 
@@ -502,12 +591,14 @@ handle_unlock (UDisksEncrypted        *encrypted,
         }
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
+  if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                         object,
+                                                         action_id,
+                                                         options,
+                                                         message,
+                                                         invocation,
+                                                         bulk,
+                                                         error))
     goto out;
 
   /* calculate the name to use */
@@ -552,6 +643,20 @@ handle_unlock (UDisksEncrypted        *encrypted,
   else
     open_func = tcrypt_open_job_func;
 
+  /* TCRYPT and LUKS1 use PBKDF2 which needs hardly any memory */
+  if (budget != NULL && is_luks && g_strcmp0 (udisks_block_get_id_version (block), "1") != 0)
+    {
+      kdf_memory = luks_get_kdf_memory (device, &local_error);
+      if (local_error != NULL)
+        {
+          /* assume the whole budget is needed */
+          udisks_warning ("Error getting the key derivation cost of %s: %s", device, local_error->message);
+          g_clear_error (&local_error);
+          kdf_memory = budget->budget;
+        }
+      kdf_memory_budget_acquire (budget, kdf_memory);
+    }
+
   udisks_linux_block_encrypted_lock (block);
   if (!udisks_daemon_launch_threaded_job_sync (daemon,
                                                object,
@@ -561,15 +666,15 @@ handle_unlock (UDisksEncrypted        *encrypted,
                                                &data,
                                                NULL, /* user_data_free_func */
                                                NULL, /* cancellable */
-                                               &error))
+                                               &local_error))
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error unlocking %s: %s",
-                                             udisks_block_get_device (block),
-                                             error->message);
-      g_clear_error (&error);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error unlocking %s: %s",
+                   udisks_block_get_device (block),
+                   local_error->message);
+      g_clear_error (&local_error);
 
       /* Restore the old encryption type if the unlock failed, because
        * in this case we don't know for sure if we used the correct
@@ -581,59 +686,350 @@ handle_unlock (UDisksEncrypted        *encrypted,
 
   udisks_linux_block_encrypted_unlock (block);
 
+  if (out_object != NULL)
+    *out_object = g_object_ref (object);
+  if (out_caller_uid != NULL)
+    *out_caller_uid = caller_uid;
+  ret = TRUE;
+
+ out:
+  if (budget != NULL)
+    kdf_memory_budget_release (budget, kdf_memory);
+  g_free (device);
+  g_free (crypttab_name);
+  g_free (crypttab_passphrase);
+  g_free (crypttab_options);
+  g_free (name);
+  g_free (old_hint_encryption_type);
+  if (keyfiles_variant)
+    g_variant_unref (keyfiles_variant);
+  g_clear_object (&cleartext_object);
+  g_clear_object (&object);
+  udisks_string_wipe_and_free (effective_passphrase);
+
+  return ret;
+}
+
+/* Updates the unlocked-crypto-dev file for the unlocked @object */
+static void
+add_unlocked_crypto_dev (UDisksDaemon *daemon,
+                         UDisksObject *object,
+                         UDisksObject *cleartext_object,
+                         uid_t         caller_uid)
+{
+  UDisksBlock *block = udisks_object_peek_block (object);
+  UDisksBlock *cleartext_block = udisks_object_peek_block (cleartext_object);
+  UDisksLinuxDevice *cleartext_device;
+
+  udisks_notice ("Unlocked device %s as %s",
+                 udisks_block_get_device (block),
+                 udisks_block_get_device (cleartext_block));
+
+  cleartext_device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (cleartext_object));
+
+  udisks_state_add_unlocked_crypto_dev (udisks_daemon_get_state (daemon),
+                                        udisks_block_get_device_number (cleartext_block),
+                                        udisks_block_get_device_number (block),
+                                        cleartext_device->dm_uuid,
+                                        caller_uid);
+
+  g_object_unref (cleartext_device);
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_unlock (UDisksEncrypted        *encrypted,
+               GDBusMethodInvocation  *invocation,
+               const gchar            *passphrase,
+               GVariant               *options)
+{
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon;
+  UDisksObject *cleartext_object = NULL;
+  GError *error = NULL;
+  uid_t caller_uid;
+
+  if (!open_encrypted (encrypted, invocation, passphrase, options, NULL, NULL, &object, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
   /* Determine the resulting cleartext object */
   cleartext_object = udisks_daemon_wait_for_object_sync (daemon,
                                                          wait_for_cleartext_object,
                                                          g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
                                                          g_free,
                                                          20, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &error);
   if (cleartext_object == NULL)
     {
       g_prefix_error (&error,
                       "Error waiting for cleartext object after unlocking '%s': ",
-                      udisks_block_get_device (block));
+                      udisks_block_get_device (udisks_object_peek_block (object)));
       g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
-  cleartext_block = udisks_object_peek_block (cleartext_object);
 
-  udisks_notice ("Unlocked device %s as %s",
-                 udisks_block_get_device (block),
-                 udisks_block_get_device (cleartext_block));
-
-  cleartext_device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (cleartext_object));
-
-  /* update the unlocked-crypto-dev file */
-  udisks_state_add_unlocked_crypto_dev (state,
-                                        udisks_block_get_device_number (cleartext_block),
-                                        udisks_block_get_device_number (block),
-                                        g_udev_device_get_sysfs_attr (cleartext_device->udev_device, "dm/uuid"),
-                                        caller_uid);
+  add_unlocked_crypto_dev (daemon, object, cleartext_object, caller_uid);
 
   udisks_encrypted_complete_unlock (encrypted,
                                     invocation,
                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (cleartext_object)));
 
  out:
-  g_free (device);
-  g_free (crypttab_name);
-  g_free (crypttab_passphrase);
-  g_free (crypttab_options);
-  g_free (name);
-  g_free (old_hint_encryption_type);
-  if (keyfiles_variant)
-    g_variant_unref (keyfiles_variant);
-  g_clear_object (&cleartext_device);
   g_clear_object (&cleartext_object);
   g_clear_object (&object);
-  udisks_string_wipe_and_free (effective_passphrase);
 
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+typedef struct
+{
+  const gchar  *object_path;
+  const gchar  *passphrase;
+  GVariant     *options;
+  UDisksObject *object;
+  UDisksObject *cleartext_object;
+  uid_t         caller_uid;
+} UnlockManyItem;
+
+typedef struct
+{
+  UDisksDaemon          *daemon;
+  GDBusMethodInvocation *invocation;
+  KdfMemoryBudget        budget;
+  const gchar           *passphrase;
+  UnlockManyItem        *items;
+} UnlockManyData;
+
+/* runs in a thread of the pool of udisks_daemon_util_bulk_call_run() */
+static void
+unlock_many_item_func (UDisksBulkCall  *call,
+                       guint            index,
+                       gpointer         user_data,
+                       GError         **error)
+{
+  UnlockManyData *unlock_data = user_data;
+  UnlockManyItem *item = &unlock_data->items[index];
+  UDisksObject *object;
+  UDisksEncrypted *encrypted = NULL;
+  const gchar *passphrase;
+
+  object = udisks_daemon_find_object (unlock_data->daemon, item->object_path);
+  if (object != NULL)
+    encrypted = udisks_object_get_encrypted (object);
+  if (encrypted == NULL)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "No encrypted device for object %s",
+                   item->object_path);
+      goto out;
+    }
+
+  passphrase = item->passphrase;
+  if (*passphrase == '\0' && unlock_data->passphrase != NULL)
+    passphrase = unlock_data->passphrase;
+
+  open_encrypted (encrypted, unlock_data->invocation, passphrase, item->options,
+                  udisks_daemon_util_bulk_call_get_authorization (call), &unlock_data->budget,
+                  &item->object, &item->caller_uid, error);
+
+ out:
+  g_clear_object (&encrypted);
+  g_clear_object (&object);
+}
+
+static UDisksObject **
+wait_for_cleartext_objects (UDisksDaemon *daemon,
+                            gpointer      user_data)
+{
+  const gchar **crypto_object_paths = user_data;
+  UDisksObject **ret = NULL;
+  GHashTable *cleartext_objects;
+  GList *objects, *l;
+  guint num_paths;
+  guint n, m;
+
+  /* backing device object path -> cleartext object */
+  cleartext_objects = g_hash_table_new (g_str_hash, g_str_equal);
+  objects = udisks_daemon_get_objects (daemon);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksBlock *block;
+
+      block = udisks_object_peek_block (object);
+      if (block != NULL && g_strcmp0 (udisks_block_get_crypto_backing_device (block), "/") != 0)
+        g_hash_table_insert (cleartext_objects,
+                             (gpointer) udisks_block_get_crypto_backing_device (block),
+                             object);
+    }
+
+  num_paths = g_strv_length ((gchar **) crypto_object_paths);
+  ret = g_new0 (UDisksObject *, num_paths + 1);
+  for (n = 0; n < num_paths; n++)
+    {
+      UDisksObject *object = g_hash_table_lookup (cleartext_objects, crypto_object_paths[n]);
+
+      if (object == NULL)
+        {
+          /* not all of them are there yet */
+          for (m = 0; m < n; m++)
+            g_object_unref (ret[m]);
+          g_clear_pointer (&ret, g_free);
+          break;
+        }
+      ret[n] = g_object_ref (object);
+    }
+
+  g_hash_table_unref (cleartext_objects);
+  g_list_free_full (objects, g_object_unref);
+  return ret;
+}
+
+/**
+ * udisks_linux_encrypted_unlock_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.UnlockEncrypted() call.
+ * @devices: The (object path, passphrase, options) triples of the devices to unlock.
+ * @options: The options of the call.
+ * @error: Return location for error or %NULL.
+ *
+ * Unlocks @devices in parallel, sharing the polkit checks with identical
+ * details and keeping the memory needed for deriving the keys of the devices
+ * opened at the same time within a budget, see the documentation of
+ * the Manager.UnlockEncrypted() method. Runs in the thread handling
+ * @invocation.
+ *
+ * Returns: A floating #GVariant of type <literal>a(ooss)</literal> with the results
+ * or %NULL if @options is invalid.
+ */
+GVariant *
+udisks_linux_encrypted_unlock_many (UDisksDaemon          *daemon,
+                                    GDBusMethodInvocation *invocation,
+                                    GVariant              *devices,
+                                    GVariant              *options,
+                                    GError               **error)
+{
+  UDisksBulkCall *call;
+  UnlockManyData unlock_data;
+  UnlockManyItem *items;
+  const gchar **crypto_object_paths;
+  const gchar **cleartext_object_paths;
+  UDisksObject **cleartext_objects;
+  GVariant *ret;
+  guint64 kdf_memory_budget;
+  guint num_items;
+  guint num_opened;
+  guint n;
+
+  call = udisks_daemon_util_bulk_call_new (options,
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests unlocking several encrypted devices at once.
+                                            */
+                                           N_("Authentication is required to unlock encrypted devices"),
+                                           FALSE,
+                                           error);
+  if (call == NULL)
+    return NULL;
+
+  /* half of the RAM by default */
+  kdf_memory_budget = (guint64) sysconf (_SC_PHYS_PAGES) * (guint64) sysconf (_SC_PAGESIZE) / 2;
+  g_variant_lookup (options, "kdf-memory-budget", "t", &kdf_memory_budget);
+
+  num_items = g_variant_n_children (devices);
+  items = g_new0 (UnlockManyItem, num_items);
+
+  unlock_data.daemon = daemon;
+  unlock_data.invocation = invocation;
+  unlock_data.passphrase = NULL;
+  g_variant_lookup (options, "passphrase", "&s", &unlock_data.passphrase);
+  g_mutex_init (&unlock_data.budget.lock);
+  g_cond_init (&unlock_data.budget.cond);
+  unlock_data.budget.budget = kdf_memory_budget;
+  unlock_data.budget.used = 0;
+  unlock_data.items = items;
+
+  for (n = 0; n < num_items; n++)
+    {
+      g_variant_get_child (devices, n, "(&o&s@a{sv})", &items[n].object_path, &items[n].passphrase, &items[n].options);
+      udisks_daemon_util_bulk_call_add (call, items[n].object_path);
+    }
+
+  udisks_daemon_util_bulk_call_run (call, unlock_many_item_func, &unlock_data);
+
+  /* wait for the cleartext objects of all the unlocked devices at once */
+  crypto_object_paths = g_new0 (const gchar *, num_items + 1);
+  num_opened = 0;
+  for (n = 0; n < num_items; n++)
+    if (items[n].object != NULL)
+      crypto_object_paths[num_opened++] = g_dbus_object_get_object_path (G_DBUS_OBJECT (items[n].object));
+  cleartext_objects = NULL;
+  if (num_opened > 0)
+    cleartext_objects = udisks_daemon_wait_for_objects_sync (daemon,
+                                                             wait_for_cleartext_objects,
+                                                             crypto_object_paths,
+                                                             NULL,
+                                                             20, /* timeout_seconds */
+                                                             udisks_daemon_util_get_invocation_cancellable (invocation),
+                                                             NULL); /* error */
+
+  cleartext_object_paths = g_new0 (const gchar *, num_items);
+  num_opened = 0;
+  for (n = 0; n < num_items; n++)
+    {
+      if (items[n].object == NULL)
+        continue;
+
+      if (cleartext_objects != NULL)
+        items[n].cleartext_object = cleartext_objects[num_opened];
+      else
+        items[n].cleartext_object = wait_for_cleartext_object (daemon, (gpointer) crypto_object_paths[num_opened]);
+      num_opened++;
+
+      if (items[n].cleartext_object == NULL)
+        {
+          udisks_daemon_util_bulk_call_take_error (call, n,
+                                                   g_error_new (UDISKS_ERROR,
+                                                                UDISKS_ERROR_TIMED_OUT,
+                                                                "Error waiting for cleartext object after unlocking '%s'",
+                                                                udisks_block_get_device (udisks_object_peek_block (items[n].object))));
+          continue;
+        }
+
+      add_unlocked_crypto_dev (daemon, items[n].object, items[n].cleartext_object, items[n].caller_uid);
+      cleartext_object_paths[n] = g_dbus_object_get_object_path (G_DBUS_OBJECT (items[n].cleartext_object));
+    }
+  g_free (cleartext_objects);
+  g_free (crypto_object_paths);
+
+  ret = udisks_daemon_util_bulk_call_build_results (call, "o", cleartext_object_paths);
+
+  for (n = 0; n < num_items; n++)
+    {
+      g_clear_object (&items[n].cleartext_object);
+      g_clear_object (&items[n].object);
+      g_variant_unref (items[n].options);
+    }
+  g_free (cleartext_object_paths);
+  g_free (items);
+  udisks_daemon_util_bulk_call_free (call);
+  g_mutex_clear (&unlock_data.budget.lock);
+  g_cond_clear (&unlock_data.budget.cond);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 gboolean
 udisks_linux_encrypted_lock (UDisksLinuxEncrypted   *encrypted,
                              GDBusMethodInvocation  *invocation,
@@ -694,6 +1090,7 @@ udisks_linux_encrypted_lock (UDisksLinuxEncrypted   *encrypted,
                                                          g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
                                                          g_free,
                                                          0, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          NULL); /* error */
   if (cleartext_object == NULL)
     {
@@ -792,6 +1189,7 @@ udisks_linux_encrypted_lock (UDisksLinuxEncrypted   *encrypted,
                                                          cleartext_path,
                                                          NULL,
                                                          10,
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &loc_error))
     {
       g_set_error (error,
@@ -1012,6 +1410,7 @@ handle_resize (UDisksEncrypted       *encrypted,
                                                          g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
                                                          g_free,
                                                          0, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          NULL); /* error */
   if (cleartext_object == NULL)
     {
@@ -1107,6 +1506,156 @@ handle_resize (UDisksEncrypted       *encrypted,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* runs in thread dedicated to handling method call */
+static gboolean
+handle_reencrypt (UDisksEncrypted       *encrypted,
+                  GDBusMethodInvocation *invocation,
+                  const gchar           *passphrase,
+                  GVariant              *options)
+{
+  UDisksObject *object = NULL;
+  UDisksBlock *block;
+  UDisksObject *cleartext_object = NULL;
+  UDisksLinuxDevice *cleartext_device = NULL;
+  UDisksDaemon *daemon;
+  UDisksConfigManager *config_manager;
+  uid_t caller_uid;
+  const gchar *action_id = NULL;
+  const gchar *message = NULL;
+  GError *error = NULL;
+  guint64 max_bandwidth = 0;
+  guint64 config_max_bandwidth;
+  ReencryptJobData data = { NULL, NULL, NULL, 0, FALSE };
+
+  object = udisks_daemon_util_dup_object (encrypted, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  block = udisks_object_peek_block (object);
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+  config_manager = udisks_daemon_get_config_manager (daemon);
+
+  /* Fail if the device is not a LUKS2 device, LUKS1 can't be reencrypted online */
+  if (!udisks_linux_block_is_luks (block) ||
+      g_strcmp0 (udisks_block_get_id_version (block), "2") != 0)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Device %s does not appear to be a LUKS2 device",
+                                             udisks_block_get_device (block));
+      goto out;
+    }
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL /* GCancellable */, &caller_uid, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  /* Fail if device is not unlocked */
+  cleartext_object = udisks_daemon_wait_for_object_sync (daemon,
+                                                         wait_for_cleartext_object,
+                                                         g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
+                                                         g_free,
+                                                         0, /* timeout_seconds */
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                         NULL); /* error */
+  if (cleartext_object == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "Device %s is not unlocked",
+                                             udisks_block_get_device (block));
+      goto out;
+    }
+
+  action_id = "org.freedesktop.udisks2.modify-device";
+  /* Translators: Shown in authentication dialog when the user
+   * requests reencrypting an encrypted block device with a new key.
+   *
+   * Do not translate $(drive), it's a placeholder and
+   * will be replaced by the name of the drive/device in question
+   */
+  message = N_("Authentication is required to reencrypt the encrypted device $(drive)");
+  if (! udisks_daemon_util_setup_by_user (daemon, object, caller_uid))
+    {
+      if (udisks_block_get_hint_system (block))
+        {
+          action_id = "org.freedesktop.udisks2.modify-device-system";
+        }
+      else if (! udisks_daemon_util_on_user_seat (daemon, UDISKS_OBJECT (object), caller_uid))
+        {
+          action_id = "org.freedesktop.udisks2.modify-device-other-seat";
+        }
+    }
+
+  /* Check that the user is actually authorized to reencrypt the device. */
+  if (! udisks_daemon_util_check_authorization_sync (daemon,
+                                                     object,
+                                                     action_id,
+                                                     options,
+                                                     message,
+                                                     invocation))
+    goto out;
+
+  /* the caller may only ask for a tighter limit than the configured one */
+  g_variant_lookup (options, "max-bandwidth", "t", &max_bandwidth);
+  config_max_bandwidth = udisks_config_manager_get_jobs_io_max_bandwidth (config_manager);
+  if (config_max_bandwidth > 0 && (max_bandwidth == 0 || max_bandwidth > config_max_bandwidth))
+    max_bandwidth = config_max_bandwidth;
+
+  cleartext_device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (cleartext_object));
+  data.device = udisks_block_get_device (block);
+  data.map_name = g_udev_device_get_sysfs_attr (cleartext_device->udev_device, "dm/name");
+  data.max_bandwidth = max_bandwidth;
+  if (!udisks_variant_lookup_binary (options, "keyfile_contents", &data.passphrase))
+    data.passphrase = g_string_new (passphrase);
+
+  udisks_linux_block_encrypted_lock (block);
+  if (!udisks_daemon_launch_threaded_job_sync (daemon,
+                                               object,
+                                               "encrypted-reencrypt",
+                                               caller_uid,
+                                               luks_reencrypt_job_func,
+                                               &data,
+                                               NULL, /* user_data_free_func */
+                                               NULL, /* cancellable */
+                                               &error))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             UDISKS_ERROR,
+                                             error->domain == UDISKS_ERROR ? error->code : UDISKS_ERROR_FAILED,
+                                             "Error reencrypting device %s: %s",
+                                             udisks_block_get_device (block),
+                                             error->message);
+      g_clear_error (&error);
+      udisks_linux_block_encrypted_unlock (block);
+      goto out;
+    }
+
+  udisks_linux_block_encrypted_unlock (block);
+
+  /* the header has changed */
+  udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  udisks_encrypted_complete_reencrypt (encrypted, invocation);
+
+ out:
+  g_clear_object (&cleartext_device);
+  g_clear_object (&cleartext_object);
+  g_clear_object (&object);
+  udisks_string_wipe_and_free (data.passphrase);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 encrypted_iface_init (UDisksEncryptedIface *iface)
 {
@@ -1114,4 +1663,5 @@ encrypted_iface_init (UDisksEncryptedIface *iface)
   iface->handle_lock                = handle_lock;
   iface->handle_change_passphrase   = handle_change_passphrase;
   iface->handle_resize              = handle_resize;
+  iface->handle_reencrypt           = handle_reencrypt;
 }
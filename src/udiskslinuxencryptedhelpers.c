@@ -20,10 +20,21 @@
  *
  */
 
+#include "config.h"
+
 #include <glib.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <blockdev/crypto.h>
+#ifdef HAVE_LIBCRYPTSETUP_REENCRYPT
+#include <libcryptsetup.h>
+#endif
 
 #include "udisksthreadedjob.h"
+#include "udiskslogging.h"
 #include "udiskslinuxencryptedhelpers.h"
 
 gboolean luks_format_job_func (UDisksThreadedJob  *job,
@@ -88,6 +99,235 @@ gboolean luks_change_key_job_func (UDisksThreadedJob  *job,
                                          error);
 }
 
+#ifdef HAVE_LIBCRYPTSETUP_REENCRYPT
+
+/* The size of the hotzone, the area reencrypted between two checkpoints
+ * in the header, when throttled - small enough for the throttling to be
+ * smooth. Unthrottled, libcryptsetup picks the size. */
+#define REENCRYPT_THROTTLED_HOTZONE_SIZE (4 * 1024 * 1024)
+
+/* Don't sleep for longer than this at once so cancelling is quick */
+#define REENCRYPT_THROTTLE_MAX_SLEEP_USEC (100 * 1000)
+
+typedef struct {
+  UDisksJob *job;
+  GCancellable *cancellable;
+  guint64 max_bandwidth;
+  guint64 start_offset;
+  gint64 start_usec;
+  gint64 time_of_last_signal;
+  gboolean started;
+  /* the last error logged by libcryptsetup */
+  gchar *error_message;
+} ReencryptProgress;
+
+static void
+reencrypt_log (gint         level,
+               const gchar *msg,
+               gpointer     usrptr)
+{
+  ReencryptProgress *progress = usrptr;
+
+  if (level != CRYPT_LOG_ERROR)
+    return;
+  g_free (progress->error_message);
+  progress->error_message = g_strchomp (g_strdup (msg));
+}
+
+/* Called by libcryptsetup after every hotzone, a non-zero return value
+ * interrupts the reencryption at the checkpoint just written. */
+static gint
+reencrypt_progress (guint64  size,
+                    guint64  offset,
+                    gpointer usrptr)
+{
+  ReencryptProgress *progress = usrptr;
+  gint64 now = g_get_monotonic_time ();
+
+  if (!progress->started)
+    {
+      /* a resumed reencryption doesn't start at offset 0 */
+      progress->started = TRUE;
+      progress->start_offset = offset;
+      progress->start_usec = now;
+      udisks_job_set_bytes (progress->job, size);
+      udisks_job_set_progress_valid (progress->job, TRUE);
+    }
+
+  /* only emit D-Bus signal at most once a second, the rate and the
+   * expected end time are estimated from the progress */
+  if (size > 0 && (now - progress->time_of_last_signal > G_USEC_PER_SEC || offset == size))
+    {
+      udisks_job_set_progress (progress->job, (gdouble) offset / size);
+      progress->time_of_last_signal = now;
+    }
+
+  /* wait until the average rate since the start is within the limit */
+  if (progress->max_bandwidth > 0 && offset > progress->start_offset)
+    {
+      gint64 target_usec = progress->start_usec +
+        (gint64) ((gdouble) (offset - progress->start_offset) * G_USEC_PER_SEC / progress->max_bandwidth);
+
+      while (now < target_usec && !g_cancellable_is_cancelled (progress->cancellable))
+        {
+          g_usleep (MIN (target_usec - now, REENCRYPT_THROTTLE_MAX_SLEEP_USEC));
+          now = g_get_monotonic_time ();
+        }
+    }
+
+  return g_cancellable_is_cancelled (progress->cancellable) ? 1 : 0;
+}
+
+static void
+set_reencrypt_error (GError            **error,
+                     ReencryptProgress  *progress,
+                     gint                rc,
+                     const gchar        *what)
+{
+  g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+               "%s: %s", what,
+               progress->error_message != NULL ? progress->error_message : g_strerror (-rc));
+}
+
+#endif /* HAVE_LIBCRYPTSETUP_REENCRYPT */
+
+/* Reencrypts the LUKS2 device with a new volume key while it's in use.
+ * libcryptsetup keeps the progress in the header, an interrupted or
+ * cancelled reencryption is resumed by running this again. */
+gboolean luks_reencrypt_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error)
+{
+#ifdef HAVE_LIBCRYPTSETUP_REENCRYPT
+  ReencryptJobData *data = user_data;
+  ReencryptProgress progress = { 0, };
+  struct crypt_device *cd = NULL;
+  struct crypt_params_luks2 luks2_params = { 0, };
+  struct crypt_params_reencrypt params = { 0, };
+  crypt_reencrypt_info info;
+  gint keyslot_old;
+  gint keyslot_new = -1;
+  gboolean ret = FALSE;
+  gint rc;
+
+  progress.job = UDISKS_JOB (job);
+  progress.cancellable = cancellable;
+  progress.max_bandwidth = data->max_bandwidth;
+  udisks_job_set_rate_limit (UDISKS_JOB (job), data->max_bandwidth);
+
+  rc = crypt_init (&cd, data->device);
+  if (rc < 0)
+    {
+      set_reencrypt_error (error, &progress, rc, "Failed to initialize the device");
+      goto out;
+    }
+  crypt_set_log_callback (cd, reencrypt_log, &progress);
+
+  rc = crypt_load (cd, CRYPT_LUKS2, NULL);
+  if (rc < 0)
+    {
+      set_reencrypt_error (error, &progress, rc, "Failed to load the LUKS2 header");
+      goto out;
+    }
+
+  params.mode = CRYPT_REENCRYPT_REENCRYPT;
+  params.direction = CRYPT_REENCRYPT_FORWARD;
+  /* a crash loses at most the hotzone being written, and that one can be
+   * recovered from the checksums */
+  params.resilience = "checksum";
+  params.hash = "sha256";
+  if (data->max_bandwidth > 0)
+    params.max_hotzone_size = REENCRYPT_THROTTLED_HOTZONE_SIZE / 512;
+
+  info = crypt_reencrypt_status (cd, NULL);
+  if (info == CRYPT_REENCRYPT_CRASH)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "The previous reencryption of %s crashed, it has to be repaired first",
+                   data->device);
+      goto out;
+    }
+  else if (info == CRYPT_REENCRYPT_CLEAN)
+    {
+      /* the checkpoint in the header tells where to continue */
+      params.flags = CRYPT_REENCRYPT_RESUME_ONLY;
+      rc = crypt_reencrypt_init_by_passphrase (cd, data->map_name,
+                                               data->passphrase->str, data->passphrase->len,
+                                               CRYPT_ANY_SLOT, CRYPT_ANY_SLOT,
+                                               NULL, NULL, &params);
+      if (rc < 0)
+        {
+          set_reencrypt_error (error, &progress, rc, "Failed to resume the reencryption");
+          goto out;
+        }
+      data->resumed = TRUE;
+      udisks_notice ("Resuming the reencryption of %s", data->device);
+    }
+  else
+    {
+      /* find out which keyslot the passphrase opens... */
+      keyslot_old = crypt_activate_by_passphrase (cd, NULL, CRYPT_ANY_SLOT,
+                                                  data->passphrase->str, data->passphrase->len, 0);
+      if (keyslot_old < 0)
+        {
+          set_reencrypt_error (error, &progress, keyslot_old, "Failed to verify the passphrase");
+          goto out;
+        }
+
+      /* ... and protect the new volume key with the same passphrase */
+      keyslot_new = crypt_keyslot_add_by_key (cd, CRYPT_ANY_SLOT, NULL, crypt_get_volume_key_size (cd),
+                                              data->passphrase->str, data->passphrase->len,
+                                              CRYPT_VOLUME_KEY_NO_SEGMENT);
+      if (keyslot_new < 0)
+        {
+          set_reencrypt_error (error, &progress, keyslot_new, "Failed to add a keyslot for the new key");
+          goto out;
+        }
+
+      luks2_params.sector_size = crypt_get_sector_size (cd);
+      params.luks2 = &luks2_params;
+      rc = crypt_reencrypt_init_by_passphrase (cd, data->map_name,
+                                               data->passphrase->str, data->passphrase->len,
+                                               keyslot_old, keyslot_new,
+                                               crypt_get_cipher (cd), crypt_get_cipher_mode (cd),
+                                               &params);
+      if (rc < 0)
+        {
+          set_reencrypt_error (error, &progress, rc, "Failed to initialize the reencryption");
+          crypt_keyslot_destroy (cd, keyslot_new);
+          goto out;
+        }
+    }
+
+  rc = crypt_reencrypt_run (cd, reencrypt_progress, &progress);
+  if (g_cancellable_is_cancelled (cancellable))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                   "Job was canceled, the reencryption can be resumed");
+      goto out;
+    }
+  if (rc < 0)
+    {
+      set_reencrypt_error (error, &progress, rc, "Failed to reencrypt the device");
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  if (cd != NULL)
+    crypt_free (cd);
+  g_free (progress.error_message);
+  return ret;
+#else
+  g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+               "LUKS2 reencryption is not supported, libcryptsetup >= 2.4.0 "
+               "was not available when building udisks");
+  return FALSE;
+#endif /* HAVE_LIBCRYPTSETUP_REENCRYPT */
+}
+
 gboolean tcrypt_open_job_func (UDisksThreadedJob  *job,
                                GCancellable       *cancellable,
                                gpointer            user_data,
@@ -113,3 +353,146 @@ gboolean tcrypt_close_job_func (UDisksThreadedJob  *job,
   CryptoJobData *data = (CryptoJobData*) user_data;
   return bd_crypto_tc_close (data->map_name, error);
 }
+
+/* the binary header of LUKS2 is followed by the JSON metadata, both are
+ * part of the header size and at most 4 MiB in total */
+#define LUKS2_BINARY_HEADER_SIZE 4096
+#define LUKS2_MAX_HEADER_SIZE (4 * 1024 * 1024)
+
+/* offsets in the binary headers, the same for both LUKS1 and LUKS2 except
+ * for the sequence ID LUKS1 doesn't have */
+#define LUKS_VERSION_OFFSET 6
+#define LUKS2_HDR_SIZE_OFFSET 8
+#define LUKS2_SEQID_OFFSET 16
+#define LUKS_UUID_OFFSET 168
+#define LUKS_UUID_LENGTH 40
+
+static guint64
+read_be64 (const guchar *data)
+{
+  guint64 ret = 0;
+  guint n;
+
+  for (n = 0; n < 8; n++)
+    ret = (ret << 8) | data[n];
+  return ret;
+}
+
+/* Opens @device and reads its binary LUKS header into @header, returns
+ * the file descriptor or -1 if @error is set. */
+static gint
+read_luks_header (const gchar *device,
+                  guchar       header[LUKS2_BINARY_HEADER_SIZE],
+                  GError     **error)
+{
+  gint fd;
+
+  fd = open (device, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      gint errsv = errno;
+
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Error opening %s: %s", device, g_strerror (errsv));
+      return -1;
+    }
+
+  if (pread (fd, header, LUKS2_BINARY_HEADER_SIZE, 0) != LUKS2_BINARY_HEADER_SIZE ||
+      memcmp (header, "LUKS\xba\xbe", 6) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "No LUKS header found on %s", device);
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+/* Returns the amount of memory (in bytes) the most expensive key slot of
+ * the LUKS @device needs for deriving its key, i.e. the Argon2 memory cost
+ * of the LUKS2 key slots. LUKS1 only supports PBKDF2 which takes hardly
+ * any memory, 0 is returned for it.
+ */
+guint64 luks_get_kdf_memory (const gchar  *device,
+                             GError      **error)
+{
+  guchar header[LUKS2_BINARY_HEADER_SIZE];
+  gchar *json = NULL;
+  const gchar *p;
+  guint64 header_size;
+  guint64 ret = 0;
+  guint16 version;
+  gint fd;
+
+  fd = read_luks_header (device, header, error);
+  if (fd < 0)
+    return 0;
+
+  version = ((guint16) header[LUKS_VERSION_OFFSET] << 8) | header[LUKS_VERSION_OFFSET + 1];
+  if (version == 1)
+    goto out;
+
+  header_size = read_be64 (header + LUKS2_HDR_SIZE_OFFSET);
+  if (version != 2 || header_size <= LUKS2_BINARY_HEADER_SIZE || header_size > LUKS2_MAX_HEADER_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Unsupported LUKS header on %s", device);
+      goto out;
+    }
+
+  json = g_malloc0 (header_size - LUKS2_BINARY_HEADER_SIZE + 1);
+  if (pread (fd, json, header_size - LUKS2_BINARY_HEADER_SIZE, LUKS2_BINARY_HEADER_SIZE) !=
+      (gssize) (header_size - LUKS2_BINARY_HEADER_SIZE))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Error reading the LUKS2 metadata of %s", device);
+      goto out;
+    }
+
+  /* Only the "memory" members of the "kdf" objects of the key slots are
+   * of interest, the cost in KiB. No need for a full JSON parser for that.
+   */
+  for (p = strstr (json, "\"memory\""); p != NULL; p = strstr (p, "\"memory\""))
+    {
+      guint64 memory;
+
+      p += strlen ("\"memory\"");
+      while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':')
+        p++;
+      memory = g_ascii_strtoull (p, NULL, 10);
+      if (memory > ret)
+        ret = memory;
+    }
+  ret *= 1024;
+
+ out:
+  g_free (json);
+  close (fd);
+  return ret;
+}
+
+/* Reads the UUID and the sequence ID of the header of the LUKS @device
+ * without parsing any of its metadata. The sequence ID of a LUKS2 header
+ * is increased with every change of the header, LUKS1 headers have none
+ * and 0 is returned for them.
+ */
+gboolean luks_get_header_id (const gchar  *device,
+                             gchar       **out_uuid,
+                             guint64      *out_seqid,
+                             GError      **error)
+{
+  guchar header[LUKS2_BINARY_HEADER_SIZE];
+  guint16 version;
+  gint fd;
+
+  fd = read_luks_header (device, header, error);
+  if (fd < 0)
+    return FALSE;
+  close (fd);
+
+  version = ((guint16) header[LUKS_VERSION_OFFSET] << 8) | header[LUKS_VERSION_OFFSET + 1];
+  *out_seqid = version == 2 ? read_be64 (header + LUKS2_SEQID_OFFSET) : 0;
+  *out_uuid = g_strndup ((const gchar *) header + LUKS_UUID_OFFSET, LUKS_UUID_LENGTH);
+  return TRUE;
+}
@@ -44,6 +44,17 @@ typedef struct {
   const gchar *type;
 } CryptoJobData;
 
+typedef struct {
+  const gchar *device;
+  /* the name of the active cleartext mapping, reencryption runs online */
+  const gchar *map_name;
+  GString *passphrase;
+  /* bytes per second, 0 for no limit */
+  guint64 max_bandwidth;
+  /* set if an interrupted reencryption was resumed */
+  gboolean resumed;
+} ReencryptJobData;
+
 gboolean luks_format_job_func (UDisksThreadedJob  *job,
                                GCancellable       *cancellable,
                                gpointer            user_data,
@@ -64,6 +75,11 @@ gboolean luks_change_key_job_func (UDisksThreadedJob  *job,
                                    gpointer            user_data,
                                    GError            **error);
 
+gboolean luks_reencrypt_job_func (UDisksThreadedJob  *job,
+                                  GCancellable       *cancellable,
+                                  gpointer            user_data,
+                                  GError            **error);
+
 gboolean tcrypt_open_job_func (UDisksThreadedJob  *job,
                                GCancellable       *cancellable,
                                gpointer            user_data,
@@ -74,6 +90,14 @@ gboolean tcrypt_close_job_func (UDisksThreadedJob  *job,
                                 gpointer            user_data,
                                 GError            **error);
 
+guint64 luks_get_kdf_memory (const gchar  *device,
+                             GError      **error);
+
+gboolean luks_get_header_id (const gchar  *device,
+                             gchar       **out_uuid,
+                             guint64      *out_seqid,
+                             GError      **error);
+
 G_END_DECLS
 
 #endif /* __UDISKS_LINUX_ENCRYPTED_HELPERS_H__ */
@@ -28,8 +28,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <mntent.h>
 #include <sys/sysmacros.h>
+#include <sys/statvfs.h>
 #ifdef HAVE_ACL
 #include <sys/acl.h>
 #endif
@@ -43,15 +43,21 @@
 #include "udiskslinuxfilesystem.h"
 #include "udiskslinuxfilesystemhelpers.h"
 #include "udiskslinuxblockobject.h"
+#include "udiskslinuxblock.h"
+#include "udiskslinuxprovider.h"
+#include "udisksfstabentry.h"
 #include "udiskslinuxfsinfo.h"
 #include "udisksdaemon.h"
 #include "udisksstate.h"
 #include "udisksdaemonutil.h"
+#include "udisksconfigmanager.h"
+#include "udisksmethoddispatcher.h"
 #include "udisksmountmonitor.h"
 #include "udisksmount.h"
 #include "udiskslinuxdevice.h"
 #include "udiskssimplejob.h"
 #include "udiskslinuxdriveata.h"
+#include "udiskssuperblock.h"
 
 /**
  * SECTION:udiskslinuxfilesystem
@@ -74,8 +80,42 @@ struct _UDisksLinuxFilesystem
 {
   UDisksFilesystemSkeleton parent_instance;
   GMutex lock;
+
+  /* The Size property is only read again when the device changed (a new
+   * uevent), the filesystem UUID changed or size_generation was bumped,
+   * e.g. by a resize. Only used from the uevent thread, except for
+   * size_generation which is updated atomically.
+   */
+  UDisksLinuxDevice *cached_size_device;
+  gchar *cached_size_uuid;
+  gint cached_size_generation;
+  guint64 cached_size;
+  volatile gint size_generation;
+
+  /* The usage is only sampled while there are subscribers, all members
+   * below are protected by usage_lock */
+
+  /* maps from the unique name of a subscriber to its UsageSubscription */
+  GHashTable *usage_subscribers;
+  guint usage_timeout_id;
+  guint usage_interval;
+  /* fraction of the space used at the last sample, negative if none */
+  gdouble last_used_fraction;
 };
 
+typedef struct
+{
+  guint watch_id;
+  /* of gdouble */
+  GArray *thresholds;
+} UsageSubscription;
+
+typedef struct
+{
+  UDisksLinuxFilesystem *filesystem;
+  gchar *name;
+} UsageSubscriber;
+
 struct _UDisksLinuxFilesystemClass
 {
   UDisksFilesystemSkeletonClass parent_class;
@@ -86,6 +126,8 @@ static void filesystem_iface_init (UDisksFilesystemIface *iface);
 G_DEFINE_TYPE_WITH_CODE (UDisksLinuxFilesystem, udisks_linux_filesystem, UDISKS_TYPE_FILESYSTEM_SKELETON,
                          G_IMPLEMENT_INTERFACE (UDISKS_TYPE_FILESYSTEM, filesystem_iface_init));
 
+G_LOCK_DEFINE_STATIC (usage_lock);
+
 #ifdef HAVE_FHS_MEDIA
 #define MOUNT_BASE "/media"
 #define MOUNT_BASE_PERSISTENT TRUE
@@ -102,17 +144,30 @@ udisks_linux_filesystem_finalize (GObject *object)
   UDisksLinuxFilesystem *filesystem = UDISKS_LINUX_FILESYSTEM (object);
 
   g_mutex_clear (&(filesystem->lock));
+  g_clear_object (&filesystem->cached_size_device);
+  g_free (filesystem->cached_size_uuid);
+  /* the subscribers and the timeout hold references, so they are gone by now */
+  g_hash_table_unref (filesystem->usage_subscribers);
 
   if (G_OBJECT_CLASS (udisks_linux_filesystem_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (udisks_linux_filesystem_parent_class)->finalize (object);
 }
 
+static void
+usage_subscription_free (UsageSubscription *subscription)
+{
+  g_bus_unwatch_name (subscription->watch_id);
+  g_array_unref (subscription->thresholds);
+  g_free (subscription);
+}
+
 static void
 udisks_linux_filesystem_init (UDisksLinuxFilesystem *filesystem)
 {
   g_mutex_init (&filesystem->lock);
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (filesystem),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  filesystem->usage_subscribers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                         (GDestroyNotify) usage_subscription_free);
+  filesystem->last_used_fraction = -1.0;
 }
 
 static void
@@ -122,6 +177,8 @@ udisks_linux_filesystem_class_init (UDisksLinuxFilesystemClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize     = udisks_linux_filesystem_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -153,6 +210,15 @@ get_filesystem_size (UDisksLinuxBlockObject *object)
   dev = udisks_linux_block_object_get_device_file (object);
   type = g_udev_device_get_property (device->udev_device, "ID_FS_TYPE");
 
+  /* a single read instead of spawning e.g. dumpe2fs or xfs_db */
+  if (udisks_superblock_is_supported (type))
+    {
+      if (udisks_superblock_read_size (dev, type, &size, &error))
+        goto out;
+      udisks_debug ("Error reading the size of %s from the superblock: %s", dev, error->message);
+      g_clear_error (&error);
+    }
+
   if (g_strcmp0 (type, "ext2") == 0) {
       BDFSExt2Info *info = bd_fs_ext2_get_info (dev, &error);
       if (info)
@@ -183,6 +249,7 @@ get_filesystem_size (UDisksLinuxBlockObject *object)
         }
   }
 
+ out:
   g_free (dev);
   g_object_unref (device);
   g_clear_error (&error);
@@ -258,13 +325,30 @@ udisks_linux_filesystem_update (UDisksLinuxFilesystem  *filesystem,
   ata = get_drive_ata (object);
   if (ata != NULL)
     {
-      if (udisks_linux_drive_ata_get_pm_state (UDISKS_LINUX_DRIVE_ATA (ata), NULL, &pm_state))
+      if (udisks_linux_drive_ata_get_cached_pm_state (UDISKS_LINUX_DRIVE_ATA (ata), NULL, &pm_state))
         skip_fs_size = ! UDISKS_LINUX_DRIVE_ATA_IS_AWAKE (pm_state);
     }
   g_clear_object (&ata);
 
   if (! skip_fs_size)
-    udisks_filesystem_set_size (UDISKS_FILESYSTEM (filesystem), get_filesystem_size (object));
+    {
+      const gchar *uuid = g_udev_device_get_property (device->udev_device, "ID_FS_UUID");
+      gint generation = g_atomic_int_get (&filesystem->size_generation);
+
+      /* mount changes don't change the size, no need to read it again */
+      if (filesystem->cached_size_device != device ||
+          g_strcmp0 (filesystem->cached_size_uuid, uuid) != 0 ||
+          filesystem->cached_size_generation != generation)
+        {
+          g_clear_object (&filesystem->cached_size_device);
+          filesystem->cached_size_device = g_object_ref (device);
+          g_free (filesystem->cached_size_uuid);
+          filesystem->cached_size_uuid = g_strdup (uuid);
+          filesystem->cached_size_generation = generation;
+          filesystem->cached_size = get_filesystem_size (object);
+        }
+      udisks_filesystem_set_size (UDISKS_FILESYSTEM (filesystem), filesystem->cached_size);
+    }
 
   g_object_unref (device);
 }
@@ -292,32 +376,46 @@ static const gchar *well_known_filesystems[] =
   NULL,
 };
 
-static gboolean
-is_in_filesystem_file (const gchar *filesystems_file,
-                       const gchar *fstype)
+/* The filesystems listed in /proc/filesystems and /etc/filesystems,
+ * read on first use and protected by filesystem_files_lock. The latter
+ * is monitored for changes. /proc/filesystems can't be monitored but
+ * filesystems are only added to it when modules get loaded, so it is
+ * only read again when looking up a filesystem type that isn't in it.
+ */
+G_LOCK_DEFINE_STATIC (filesystem_files_lock);
+static GHashTable *proc_filesystems = NULL;
+static GHashTable *etc_filesystems = NULL;
+static GFileMonitor *etc_filesystems_monitor = NULL;
+static gboolean etc_filesystems_monitor_tried = FALSE;
+
+static GHashTable *
+read_filesystem_file (const gchar *filesystems_file)
 {
+  GHashTable *ret;
   gchar *filesystems = NULL;
   GError *error = NULL;
-  gboolean ret = FALSE;
   gchar **lines = NULL;
   guint n;
 
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
   if (!g_file_get_contents (filesystems_file,
                             &filesystems,
                             NULL, /* gsize *out_length */
                             &error))
     {
-      udisks_warning ("Error reading %s: %s (%s %d)",
-                      filesystems_file,
-                      error->message,
-                      g_quark_to_string (error->domain),
-                      error->code);
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        udisks_warning ("Error reading %s: %s (%s %d)",
+                        filesystems_file,
+                        error->message,
+                        g_quark_to_string (error->domain),
+                        error->code);
       g_clear_error (&error);
       goto out;
     }
 
   lines = g_strsplit (filesystems, "\n", -1);
-  for (n = 0; lines != NULL && lines[n] != NULL && !ret; n++)
+  for (n = 0; lines != NULL && lines[n] != NULL; n++)
     {
       gchar **tokens;
       gint num_tokens;
@@ -325,10 +423,9 @@ is_in_filesystem_file (const gchar *filesystems_file,
       g_strstrip (lines[n]);
       tokens = g_strsplit (lines[n], " ", -1);
       num_tokens = g_strv_length (tokens);
-      if (num_tokens == 1 && g_strcmp0 (tokens[0], fstype) == 0)
-        {
-          ret = TRUE;
-        }
+      /* skips the "nodev" filesystems of /proc/filesystems */
+      if (num_tokens == 1 && strlen (tokens[0]) > 0)
+        g_hash_table_add (ret, g_strdup (tokens[0]));
       g_strfreev (tokens);
     }
 
@@ -338,6 +435,89 @@ is_in_filesystem_file (const gchar *filesystems_file,
   return ret;
 }
 
+static void
+on_etc_filesystems_changed (GFileMonitor      *file_monitor,
+                            GFile             *file,
+                            GFile             *other_file,
+                            GFileMonitorEvent  event_type,
+                            gpointer           user_data)
+{
+  if (event_type == G_FILE_MONITOR_EVENT_CHANGED ||
+      event_type == G_FILE_MONITOR_EVENT_CREATED ||
+      event_type == G_FILE_MONITOR_EVENT_DELETED)
+    {
+      udisks_debug ("/etc/filesystems changed!");
+      G_LOCK (filesystem_files_lock);
+      g_clear_pointer (&etc_filesystems, g_hash_table_unref);
+      G_UNLOCK (filesystem_files_lock);
+    }
+}
+
+static gboolean
+is_in_proc_filesystems (const gchar *fstype)
+{
+  gboolean ret;
+
+  G_LOCK (filesystem_files_lock);
+  if (proc_filesystems == NULL || !g_hash_table_contains (proc_filesystems, fstype))
+    {
+      if (proc_filesystems != NULL)
+        g_hash_table_unref (proc_filesystems);
+      proc_filesystems = read_filesystem_file ("/proc/filesystems");
+    }
+  ret = g_hash_table_contains (proc_filesystems, fstype);
+  G_UNLOCK (filesystem_files_lock);
+
+  return ret;
+}
+
+static gboolean
+is_in_etc_filesystems (const gchar *fstype)
+{
+  gboolean ret;
+
+  G_LOCK (filesystem_files_lock);
+  if (!etc_filesystems_monitor_tried)
+    {
+      GFile *file;
+      GError *error = NULL;
+
+      /* delivered in the main loop of the daemon, lives as long as it does */
+      file = g_file_new_for_path ("/etc/filesystems");
+      etc_filesystems_monitor = g_file_monitor_file (file,
+                                                     G_FILE_MONITOR_NONE,
+                                                     NULL, /* cancellable */
+                                                     &error);
+      if (etc_filesystems_monitor == NULL)
+        {
+          udisks_warning ("Error monitoring /etc/filesystems: %s (%s, %d)",
+                          error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+      else
+        {
+          g_signal_connect (etc_filesystems_monitor,
+                            "changed",
+                            G_CALLBACK (on_etc_filesystems_changed),
+                            NULL);
+        }
+      g_object_unref (file);
+      etc_filesystems_monitor_tried = TRUE;
+    }
+
+  /* without a monitor the file is read every time, like it always was */
+  if (etc_filesystems == NULL || etc_filesystems_monitor == NULL)
+    {
+      if (etc_filesystems != NULL)
+        g_hash_table_unref (etc_filesystems);
+      etc_filesystems = read_filesystem_file ("/etc/filesystems");
+    }
+  ret = g_hash_table_contains (etc_filesystems, fstype);
+  G_UNLOCK (filesystem_files_lock);
+
+  return ret;
+}
+
 static gboolean
 is_well_known_filesystem (const gchar *fstype)
 {
@@ -356,15 +536,12 @@ is_well_known_filesystem (const gchar *fstype)
   return ret;
 }
 
-/* this is not a very efficient implementation but it's very rarely
- * called so no real point in optimizing it...
- */
 static gboolean
 is_allowed_filesystem (const gchar *fstype)
 {
   return is_well_known_filesystem (fstype) ||
-    is_in_filesystem_file ("/proc/filesystems", fstype) ||
-    is_in_filesystem_file ("/etc/filesystems", fstype);
+    is_in_proc_filesystems (fstype) ||
+    is_in_etc_filesystems (fstype);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1164,96 +1341,39 @@ has_option (const gchar *options,
 static gboolean
 is_in_fstab (UDisksDaemon *daemon,
              UDisksBlock  *block,
-             const gchar  *fstab_path,
              gchar       **out_mount_point,
              gchar       **out_mount_options)
 {
   UDisksMountMonitor *mount_monitor = udisks_daemon_get_mount_monitor (daemon);
-  gboolean ret;
-  FILE *f;
-  char buf[8192];
-  struct mntent mbuf;
-  struct mntent *m;
-
-  ret = FALSE;
-  f = fopen (fstab_path, "r");
-  if (f == NULL)
-    {
-      udisks_warning ("Error opening fstab file %s: %m", fstab_path);
-      goto out;
-    }
+  gboolean ret = FALSE;
+  GList *entries;
+  GList *l;
 
-  while ((m = getmntent_r (f, &mbuf, buf, sizeof (buf))) != NULL && !ret)
+  /* uses the entries already parsed and indexed by the fstab monitor */
+  entries = udisks_linux_block_find_fstab_entries (UDISKS_LINUX_BLOCK (block), daemon);
+  for (l = entries; l != NULL && !ret; l = l->next)
     {
-      gchar *device;
-      struct stat sb;
-
-      device = NULL;
-      if (g_str_has_prefix (m->mnt_fsname, "UUID="))
-        {
-          device = g_strdup_printf ("/dev/disk/by-uuid/%s", m->mnt_fsname + 5);
-        }
-      else if (g_str_has_prefix (m->mnt_fsname, "LABEL="))
-        {
-          device = g_strdup_printf ("/dev/disk/by-label/%s", m->mnt_fsname + 6);
-        }
-      else if (g_str_has_prefix (m->mnt_fsname, "PARTUUID="))
-        {
-          device = g_strdup_printf ("/dev/disk/by-partuuid/%s", m->mnt_fsname + 9);
-        }
-      else if (g_str_has_prefix (m->mnt_fsname, "PARTLABEL="))
-        {
-          device = g_strdup_printf ("/dev/disk/by-partlabel/%s", m->mnt_fsname + 10);
-        }
-      else if (g_str_has_prefix (m->mnt_fsname, "/dev"))
-        {
-          device = g_strdup (m->mnt_fsname);
-        }
-      else
-        {
-          /* ignore non-device entries */
-          goto continue_loop;
-        }
-
-      if (stat (device, &sb) != 0)
-        {
-          udisks_debug ("Error statting %s (for entry %s): %m", device, m->mnt_fsname);
-          goto continue_loop;
-        }
-      if (!S_ISBLK (sb.st_mode))
-        {
-          udisks_debug ("Device %s (for entry %s) is not a block device", device, m->mnt_fsname);
-          goto continue_loop;
-        }
+      UDisksFstabEntry *entry = UDISKS_FSTAB_ENTRY (l->data);
+      const gchar *dir = udisks_fstab_entry_get_dir (entry);
+      UDisksMount *mount;
 
-      /* udisks_debug ("device %d:%d for entry %s", major (sb.st_rdev), minor (sb.st_rdev), m->mnt_fsname); */
-
-      if (udisks_block_get_device_number (block) == sb.st_rdev)
+      /* If this block device is found in fstab, but something else is already
+       * mounted on that mount point, ignore the fstab entry.
+       */
+      mount = udisks_mount_monitor_get_mount_for_path (mount_monitor, dir);
+      if (mount == NULL || udisks_block_get_device_number (block) == udisks_mount_get_dev (mount))
         {
-          /* If this block device is found in fstab, but something else is already
-           * mounted on that mount point, ignore the fstab entry.
-           */
-          UDisksMount *mount = udisks_mount_monitor_get_mount_for_path (mount_monitor,
-                                                                        m->mnt_dir);
-          if (mount == NULL || sb.st_rdev == udisks_mount_get_dev (mount))
-            {
-              ret = TRUE;
-              if (out_mount_point != NULL)
-                *out_mount_point = g_strdup (m->mnt_dir);
-              if (out_mount_options != NULL)
-                *out_mount_options = g_strdup (m->mnt_opts);
-            }
-
-          g_clear_object (&mount);
+          ret = TRUE;
+          if (out_mount_point != NULL)
+            *out_mount_point = g_strdup (dir);
+          if (out_mount_options != NULL)
+            *out_mount_options = g_strdup (udisks_fstab_entry_get_opts (entry));
         }
 
-    continue_loop:
-      g_free (device);
+      g_clear_object (&mount);
     }
+  g_list_free_full (entries, g_object_unref);
 
- out:
-  if (f != NULL)
-    fclose (f);
   return ret;
 }
 
@@ -1273,7 +1393,7 @@ is_system_managed (UDisksDaemon *daemon,
   ret = TRUE;
 
   /* First, check /etc/fstab */
-  if (is_in_fstab (daemon, block, "/etc/fstab", out_mount_point, out_mount_options))
+  if (is_in_fstab (daemon, block, out_mount_point, out_mount_options))
     goto out;
 
   ret = FALSE;
@@ -1343,11 +1463,15 @@ out:
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* runs in thread dedicated to handling @invocation */
+/* runs in thread dedicated to handling @invocation or in a thread
+ * mounting one of the filesystems of a bulk request */
 static gboolean
-handle_mount (UDisksFilesystem      *filesystem,
-              GDBusMethodInvocation *invocation,
-              GVariant              *options)
+mount_filesystem (UDisksFilesystem         *filesystem,
+                  GDBusMethodInvocation    *invocation,
+                  GVariant                 *options,
+                  UDisksBulkAuthorization  *bulk,
+                  gchar                   **out_mount_point,
+                  GError                  **error)
 {
   UDisksObject *object = NULL;
   UDisksBlock *block;
@@ -1363,24 +1487,22 @@ handle_mount (UDisksFilesystem      *filesystem,
   gboolean mpoint_persistent = TRUE;
   gchar *fstab_mount_options = NULL;
   gchar *caller_user_name = NULL;
-  GError *error = NULL;
   const gchar *action_id = NULL;
   const gchar *message = NULL;
   gboolean system_managed = FALSE;
   gboolean success = FALSE;
+  gboolean ret = FALSE;
   gchar *device = NULL;
   UDisksBaseJob *job = NULL;
+  GError *local_error = NULL;
 
 
   /* only allow a single call at a time */
   g_mutex_lock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
-  object = udisks_daemon_util_dup_object (filesystem, &error);
+  object = udisks_daemon_util_dup_object (filesystem, error);
   if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+    goto out;
 
   block = udisks_object_peek_block (object);
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
@@ -1406,12 +1528,12 @@ handle_mount (UDisksFilesystem      *filesystem,
             g_string_append (str, ", ");
           g_string_append_printf (str, "`%s'", existing_mount_points[n]);
         }
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_ALREADY_MOUNTED,
-                                             "Device %s is already mounted at %s.\n",
-                                             device,
-                                             str->str);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_ALREADY_MOUNTED,
+                   "Device %s is already mounted at %s.\n",
+                   device,
+                   str->str);
       g_string_free (str, TRUE);
       goto out;
     }
@@ -1420,19 +1542,11 @@ handle_mount (UDisksFilesystem      *filesystem,
                                                invocation,
                                                NULL /* GCancellable */,
                                                &caller_uid,
-                                               &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+                                               error))
+    goto out;
 
-  if (!udisks_daemon_util_get_user_info (caller_uid, &caller_gid, &caller_user_name, &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+  if (!udisks_daemon_util_get_user_info (caller_uid, &caller_gid, &caller_user_name, error))
+    goto out;
 
   if (system_managed)
     {
@@ -1460,12 +1574,14 @@ handle_mount (UDisksFilesystem      *filesystem,
                 }
             }
 
-          if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                            object,
-                                                            action_id,
-                                                            options,
-                                                            message,
-                                                            invocation))
+          if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                                 object,
+                                                                 action_id,
+                                                                 options,
+                                                                 message,
+                                                                 invocation,
+                                                                 bulk,
+                                                                 error))
             goto out;
           mount_fstab_as_root = TRUE;
         }
@@ -1474,12 +1590,12 @@ handle_mount (UDisksFilesystem      *filesystem,
         {
           if (g_mkdir_with_parents (mount_point_to_use, 0755) != 0)
             {
-              g_dbus_method_invocation_return_error (invocation,
-                                                     UDISKS_ERROR,
-                                                     UDISKS_ERROR_FAILED,
-                                                     "Error creating directory `%s' to be used for mounting %s: %m",
-                                                     mount_point_to_use,
-                                                     device);
+              g_set_error (error,
+                           UDISKS_ERROR,
+                           UDISKS_ERROR_FAILED,
+                           "Error creating directory `%s' to be used for mounting %s: %m",
+                           mount_point_to_use,
+                           device);
               goto out;
             }
         }
@@ -1497,7 +1613,7 @@ handle_mount (UDisksFilesystem      *filesystem,
           BDExtraArg gid_arg = {g_strdup ("run_as_gid"), g_strdup_printf("%d", find_primary_gid (caller_uid))};
           const BDExtraArg *extra_args[3] = {&uid_arg, &gid_arg, NULL};
 
-          success = bd_fs_mount (NULL, mount_point_to_use, NULL, NULL, extra_args, &error);
+          success = bd_fs_mount (NULL, mount_point_to_use, NULL, NULL, extra_args, &local_error);
 
           g_free (uid_arg.opt);
           g_free (uid_arg.val);
@@ -1506,47 +1622,49 @@ handle_mount (UDisksFilesystem      *filesystem,
         }
       else
         {
-          success = bd_fs_mount (NULL, mount_point_to_use, NULL, NULL, NULL, &error);
+          success = bd_fs_mount (NULL, mount_point_to_use, NULL, NULL, NULL, &local_error);
         }
 
       if (!success)
-          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, local_error->message);
       else
           udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
 
       if (!success)
         {
-          if (!mount_fstab_as_root && g_error_matches (error, BD_FS_ERROR, BD_FS_ERROR_AUTH))
+          if (!mount_fstab_as_root && g_error_matches (local_error, BD_FS_ERROR, BD_FS_ERROR_AUTH))
             {
-              g_clear_error (&error);
-              if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                                object,
-                                                                "org.freedesktop.udisks2.filesystem-fstab",
-                                                                options,
-                                                                /* Translators: Shown in authentication dialog when the
-                                                                 * user requests mounting a filesystem that is in
-                                                                 * /etc/fstab file with the x-udisks-auth option.
-                                                                 *
-                                                                 * Do not translate $(drive), it's a
-                                                                 * placeholder and will be replaced by the name of
-                                                                 * the drive/device in question
-                                                                 *
-                                                                 * Do not translate /etc/fstab
-                                                                 */
-                                                                N_("Authentication is required to mount $(drive) referenced in the /etc/fstab file"),
-                                                                invocation))
+              g_clear_error (&local_error);
+              if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                                     object,
+                                                                     "org.freedesktop.udisks2.filesystem-fstab",
+                                                                     options,
+                                                                     /* Translators: Shown in authentication dialog when the
+                                                                      * user requests mounting a filesystem that is in
+                                                                      * /etc/fstab file with the x-udisks-auth option.
+                                                                      *
+                                                                      * Do not translate $(drive), it's a
+                                                                      * placeholder and will be replaced by the name of
+                                                                      * the drive/device in question
+                                                                      *
+                                                                      * Do not translate /etc/fstab
+                                                                      */
+                                                                     N_("Authentication is required to mount $(drive) referenced in the /etc/fstab file"),
+                                                                     invocation,
+                                                                     bulk,
+                                                                     error))
                 goto out;
               mount_fstab_as_root = TRUE;
               goto mount_fstab_again;
             }
 
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error mounting system-managed device %s: %s",
-                                                 device,
-                                                 error->message);
-          g_clear_error (&error);
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error mounting system-managed device %s: %s",
+                       device,
+                       local_error->message);
+          g_clear_error (&local_error);
           goto out;
         }
       udisks_notice ("Mounted %s (system) at %s on behalf of uid %u",
@@ -1561,7 +1679,7 @@ handle_mount (UDisksFilesystem      *filesystem,
                                    caller_uid,
                                    TRUE); /* fstab_mounted */
 
-      udisks_filesystem_complete_mount (filesystem, invocation, mount_point_to_use);
+      ret = TRUE;
       goto out;
     }
 
@@ -1580,25 +1698,21 @@ handle_mount (UDisksFilesystem      *filesystem,
   if (probed_fs_usage != NULL && strlen (probed_fs_usage) > 0 &&
       g_strcmp0 (probed_fs_usage, "filesystem") != 0)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Cannot mount block device %s with probed usage `%s' - expected `filesystem'",
-                                             device,
-                                             probed_fs_usage);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Cannot mount block device %s with probed usage `%s' - expected `filesystem'",
+                   device,
+                   probed_fs_usage);
       goto out;
     }
 
   /* calculate filesystem type (guaranteed to be valid UTF-8) */
   fs_type_to_use = calculate_fs_type (block,
                                       options,
-                                      &error);
+                                      error);
   if (fs_type_to_use == NULL)
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+    goto out;
 
   /* calculate mount options (guaranteed to be valid UTF-8) */
   mount_options_to_use = calculate_mount_options (daemon,
@@ -1606,13 +1720,9 @@ handle_mount (UDisksFilesystem      *filesystem,
                                                   caller_uid,
                                                   fs_type_to_use,
                                                   options,
-                                                  &error);
+                                                  error);
   if (mount_options_to_use == NULL)
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+    goto out;
 
   /* Now, check that the user is actually authorized to mount the
    * device. Need to do this before calculating a mount point since we
@@ -1638,12 +1748,14 @@ handle_mount (UDisksFilesystem      *filesystem,
         }
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
+  if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                         object,
+                                                         action_id,
+                                                         options,
+                                                         message,
+                                                         invocation,
+                                                         bulk,
+                                                         error))
     goto out;
 
   /* calculate mount point (guaranteed to be valid UTF-8) */
@@ -1654,22 +1766,18 @@ handle_mount (UDisksFilesystem      *filesystem,
                                               caller_user_name,
                                               fs_type_to_use,
                                               &mpoint_persistent,
-                                              &error);
+                                              error);
   if (mount_point_to_use == NULL)
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+    goto out;
 
   /* create the mount point */
   if (g_mkdir (mount_point_to_use, 0700) != 0)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error creating mount point `%s': %m",
-                                             mount_point_to_use);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error creating mount point `%s': %m",
+                   mount_point_to_use);
       goto out;
     }
 
@@ -1679,21 +1787,21 @@ handle_mount (UDisksFilesystem      *filesystem,
                                          0,
                                          NULL /* cancellable */);
 
-  if (!bd_fs_mount (device, mount_point_to_use, fs_type_to_use, mount_options_to_use, NULL, &error))
+  if (!bd_fs_mount (device, mount_point_to_use, fs_type_to_use, mount_options_to_use, NULL, &local_error))
     {
       /* ugh, something went wrong.. we need to clean up the created mount point */
       if (g_rmdir (mount_point_to_use) != 0)
         udisks_warning ("Error removing directory %s: %m", mount_point_to_use);
 
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error mounting %s at %s: %s",
-                                             device,
-                                             mount_point_to_use,
-                                             error->message);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
-      g_clear_error (&error);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error mounting %s at %s: %s",
+                   device,
+                   mount_point_to_use,
+                   local_error->message);
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, local_error->message);
+      g_clear_error (&local_error);
       goto out;
     }
   else
@@ -1714,9 +1822,14 @@ handle_mount (UDisksFilesystem      *filesystem,
                  mount_point_to_use,
                  caller_uid);
 
-  udisks_filesystem_complete_mount (filesystem, invocation, mount_point_to_use);
+  ret = TRUE;
 
  out:
+  if (ret && out_mount_point != NULL)
+    {
+      *out_mount_point = mount_point_to_use;
+      mount_point_to_use = NULL;
+    }
   g_free (fs_type_to_use);
   g_free (mount_options_to_use);
   g_free (mount_point_to_use);
@@ -1728,6 +1841,25 @@ handle_mount (UDisksFilesystem      *filesystem,
   /* only allow a single call at a time */
   g_mutex_unlock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
+  return ret;
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_mount (UDisksFilesystem      *filesystem,
+              GDBusMethodInvocation *invocation,
+              GVariant              *options)
+{
+  gchar *mount_point = NULL;
+  GError *error = NULL;
+
+  if (mount_filesystem (filesystem, invocation, options, NULL, &mount_point, &error))
+    udisks_filesystem_complete_mount (filesystem, invocation, mount_point);
+  else
+    g_dbus_method_invocation_take_error (invocation, error);
+
+  g_free (mount_point);
+
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
@@ -1742,47 +1874,161 @@ get_error_code_for_umount (const gchar *error_message)
     return UDISKS_ERROR_FAILED;
 }
 
+/* Waits for the mount monitor to report that a filesystem of a device
+ * was unmounted and for the block object to have updated its
+ * MountPoints property accordingly.
+ */
 typedef struct
 {
-  const gchar *object_path;
-  guint64      old_size;
-  gchar       *mount_point;
-} WaitForFilesystemMountPointsData;
+  volatile gint ref_count;
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+  UDisksMountMonitor *mount_monitor;
+  GMainContext *uevent_context;
+  dev_t dev;
+  gchar *mount_path;
+} UnmountWait;
 
-static UDisksObject *
-wait_for_filesystem_mount_points (UDisksDaemon *daemon,
-                                  gpointer      user_data)
+static UnmountWait *
+unmount_wait_ref (UnmountWait *wait)
 {
-  WaitForFilesystemMountPointsData *data = user_data;
-  UDisksObject *object = NULL;
-  UDisksFilesystem *filesystem = NULL;
-  const gchar * const *mount_points = NULL;
+  g_atomic_int_inc (&wait->ref_count);
+  return wait;
+}
+
+static void
+unmount_wait_unref (UnmountWait *wait)
+{
+  if (g_atomic_int_dec_and_test (&wait->ref_count))
+    {
+      g_free (wait->mount_path);
+      g_cond_clear (&wait->cond);
+      g_mutex_clear (&wait->lock);
+      g_free (wait);
+    }
+}
+
+static void
+unmount_wait_done (UnmountWait *wait)
+{
+  g_mutex_lock (&wait->lock);
+  wait->done = TRUE;
+  g_cond_broadcast (&wait->cond);
+  g_mutex_unlock (&wait->lock);
+}
+
+/* runs in the thread applying the uevents */
+static gboolean
+on_unmount_wait_updated (gpointer user_data)
+{
+  unmount_wait_done (user_data);
+  return G_SOURCE_REMOVE;
+}
 
-  object = udisks_daemon_find_object (daemon, data->object_path);
+static void
+on_unmount_wait_dev_changed (UDisksMountMonitor *monitor,
+                             UDisksMount        *mount,
+                             gboolean            added,
+                             gpointer            user_data)
+{
+  UnmountWait *wait = user_data;
 
-  if (object != NULL)
+  if (added || udisks_mount_get_mount_type (mount) != UDISKS_MOUNT_TYPE_FILESYSTEM)
+    return;
+  if (wait->mount_path != NULL && g_strcmp0 (udisks_mount_get_mount_path (mount), wait->mount_path) != 0)
+    return;
+
+  /* The block object was notified before us and queued the update of
+   * its MountPoints property in the uevent context, so that is done
+   * once this runs there.
+   */
+  g_main_context_invoke_full (wait->uevent_context,
+                              G_PRIORITY_DEFAULT,
+                              on_unmount_wait_updated,
+                              unmount_wait_ref (wait),
+                              (GDestroyNotify) unmount_wait_unref);
+}
+
+static void
+on_unmount_wait_cancelled (GCancellable *cancellable,
+                           gpointer      user_data)
+{
+  unmount_wait_done (user_data);
+}
+
+/* Starts watching for @mount_path (or any filesystem if %NULL) of @dev
+ * to be unmounted, has to be called before unmounting it.
+ */
+static UnmountWait *
+unmount_wait_new (UDisksDaemon *daemon,
+                  dev_t         dev,
+                  const gchar  *mount_path)
+{
+  UnmountWait *wait;
+
+  wait = g_new0 (UnmountWait, 1);
+  wait->ref_count = 1;
+  g_mutex_init (&wait->lock);
+  g_cond_init (&wait->cond);
+  wait->mount_monitor = udisks_daemon_get_mount_monitor (daemon);
+  wait->uevent_context = udisks_linux_provider_get_uevent_context (udisks_daemon_get_linux_provider (daemon));
+  wait->dev = dev;
+  wait->mount_path = g_strdup (mount_path);
+
+  udisks_mount_monitor_add_dev_watch (wait->mount_monitor, dev, on_unmount_wait_dev_changed, wait);
+
+  return wait;
+}
+
+/* Waits up to @timeout_seconds for the unmount if it succeeded and
+ * stops watching */
+static void
+unmount_wait_free (UnmountWait  *wait,
+                   guint         timeout_seconds,
+                   GCancellable *cancellable)
+{
+  gulong cancelled_handler_id = 0;
+  gint64 deadline;
+
+  if (timeout_seconds > 0)
     {
-      filesystem = udisks_object_peek_filesystem (object);
-      if (filesystem != NULL)
-        {
-          mount_points = udisks_filesystem_get_mount_points (filesystem);
-        }
-      /* If we know which mount point should have gone, directly test for it, otherwise test if any has gone */
-      if (mount_points != NULL && ((data->mount_point != NULL && g_strv_contains (mount_points, data->mount_point)) ||
-          g_strv_length ((gchar **) mount_points) == data->old_size))
+      if (cancellable != NULL)
+        cancelled_handler_id = g_cancellable_connect (cancellable,
+                                                      G_CALLBACK (on_unmount_wait_cancelled),
+                                                      wait,
+                                                      NULL);
+
+      deadline = g_get_monotonic_time () + timeout_seconds * G_USEC_PER_SEC;
+      g_mutex_lock (&wait->lock);
+      while (!wait->done)
         {
-          g_clear_object (&object);
+          if (!g_cond_wait_until (&wait->cond, &wait->lock, deadline))
+            {
+              udisks_warning ("Timed out waiting for the unmount of device %u:%u to be noticed",
+                              major (wait->dev), minor (wait->dev));
+              break;
+            }
         }
+      g_mutex_unlock (&wait->lock);
+
+      if (cancellable != NULL)
+        g_cancellable_disconnect (cancellable, cancelled_handler_id);
     }
 
-  return object;
+  udisks_mount_monitor_remove_dev_watch (wait->mount_monitor, wait->dev, on_unmount_wait_dev_changed, wait);
+  unmount_wait_unref (wait);
 }
 
-/* runs in thread dedicated to handling @invocation */
+/* runs in thread dedicated to handling @invocation or in a thread
+ * unmounting one of the filesystems of a bulk request, which cleans up
+ * the state once all of them are unmounted */
 static gboolean
-handle_unmount (UDisksFilesystem      *filesystem,
-                GDBusMethodInvocation *invocation,
-                GVariant              *options)
+unmount_filesystem (UDisksFilesystem         *filesystem,
+                    GDBusMethodInvocation    *invocation,
+                    GVariant                 *options,
+                    UDisksBulkAuthorization  *bulk,
+                    GError                  **error)
 {
   UDisksObject *object;
   UDisksBlock *block;
@@ -1790,7 +2036,7 @@ handle_unmount (UDisksFilesystem      *filesystem,
   UDisksState *state;
   gchar *mount_point = NULL;
   gchar *fstab_mount_options = NULL;
-  GError *error = NULL;
+  GError *local_error = NULL;
   uid_t mounted_by_uid;
   uid_t caller_uid;
   const gchar *const *mount_points;
@@ -1798,19 +2044,16 @@ handle_unmount (UDisksFilesystem      *filesystem,
   gboolean system_managed = FALSE;
   gboolean fstab_mounted;
   gboolean success;
+  gboolean ret = FALSE;
   UDisksBaseJob *job = NULL;
-  UDisksObject *filesystem_object = NULL;
-  WaitForFilesystemMountPointsData wait_data = {NULL, 0, NULL};
+  UnmountWait *wait = NULL;
 
   /* only allow a single call at a time */
   g_mutex_lock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
-  object = udisks_daemon_util_dup_object (filesystem, &error);
+  object = udisks_daemon_util_dup_object (filesystem, error);
   if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+    goto out;
 
   block = udisks_object_peek_block (object);
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
@@ -1827,23 +2070,16 @@ handle_unmount (UDisksFilesystem      *filesystem,
   mount_points = udisks_filesystem_get_mount_points (filesystem);
   if (mount_points == NULL || g_strv_length ((gchar **) mount_points) == 0)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_NOT_MOUNTED,
-                                             "Device `%s' is not mounted",
-                                             udisks_block_get_device (block));
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_NOT_MOUNTED,
+                   "Device `%s' is not mounted",
+                   udisks_block_get_device (block));
       goto out;
     }
 
-  wait_data.object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
-  wait_data.old_size = g_strv_length ((gchar **) mount_points);
-
-  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL, &caller_uid, &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon, invocation, NULL, &caller_uid, error))
+    goto out;
 
   /* check if mount point is managed by e.g. /etc/fstab or similar */
   if (is_system_managed (daemon, block, &mount_point, &fstab_mount_options))
@@ -1860,6 +2096,8 @@ handle_unmount (UDisksFilesystem      *filesystem,
       gboolean unmount_fstab_as_root;
 
       unmount_fstab_as_root = FALSE;
+      wait = unmount_wait_new (daemon, udisks_block_get_device_number (block),
+                               g_strv_contains (mount_points, mount_point) ? mount_point : NULL);
     unmount_fstab_again:
 
       job = udisks_daemon_launch_simple_job (daemon,
@@ -1874,7 +2112,7 @@ handle_unmount (UDisksFilesystem      *filesystem,
           BDExtraArg gid_arg = {g_strdup ("run_as_gid"), g_strdup_printf("%d", find_primary_gid (caller_uid))};
           const BDExtraArg *extra_args[3] = {&uid_arg, &gid_arg, NULL};
 
-          success = bd_fs_unmount (mount_point, opt_force, FALSE, extra_args, &error);
+          success = bd_fs_unmount (mount_point, opt_force, FALSE, extra_args, &local_error);
 
           g_free (uid_arg.opt);
           g_free (uid_arg.val);
@@ -1882,46 +2120,48 @@ handle_unmount (UDisksFilesystem      *filesystem,
           g_free (gid_arg.val);
         }
       else
-          success = bd_fs_unmount (mount_point, opt_force, FALSE, NULL, &error);
+          success = bd_fs_unmount (mount_point, opt_force, FALSE, NULL, &local_error);
 
       if (!success)
-          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, local_error->message);
       else
           udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
 
       if (!success)
         {
-          if (!unmount_fstab_as_root && error->code == BD_FS_ERROR_AUTH)
+          if (!unmount_fstab_as_root && local_error->code == BD_FS_ERROR_AUTH)
             {
-              g_clear_error (&error);
-              if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                                object,
-                                                                "org.freedesktop.udisks2.filesystem-fstab",
-                                                                options,
-                                                                /* Translators: Shown in authentication dialog when the
-                                                                 * user requests unmounting a filesystem that is in
-                                                                 * /etc/fstab file with the x-udisks-auth option.
-                                                                 *
-                                                                 * Do not translate $(drive), it's a
-                                                                 * placeholder and will be replaced by the name of
-                                                                 * the drive/device in question
-                                                                 *
-                                                                 * Do not translate /etc/fstab
-                                                                 */
-                                                                N_("Authentication is required to unmount $(drive) referenced in the /etc/fstab file"),
-                                                                invocation))
+              g_clear_error (&local_error);
+              if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                                     object,
+                                                                     "org.freedesktop.udisks2.filesystem-fstab",
+                                                                     options,
+                                                                     /* Translators: Shown in authentication dialog when the
+                                                                      * user requests unmounting a filesystem that is in
+                                                                      * /etc/fstab file with the x-udisks-auth option.
+                                                                      *
+                                                                      * Do not translate $(drive), it's a
+                                                                      * placeholder and will be replaced by the name of
+                                                                      * the drive/device in question
+                                                                      *
+                                                                      * Do not translate /etc/fstab
+                                                                      */
+                                                                     N_("Authentication is required to unmount $(drive) referenced in the /etc/fstab file"),
+                                                                     invocation,
+                                                                     bulk,
+                                                                     error))
                 goto out;
               unmount_fstab_as_root = TRUE;
               goto unmount_fstab_again;
             }
 
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 get_error_code_for_umount (error->message),
-                                                 "Error unmounting system-managed device %s: %s",
-                                                 udisks_block_get_device (block),
-                                                 error->message);
-          g_clear_error (&error);
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       get_error_code_for_umount (local_error->message),
+                       "Error unmounting system-managed device %s: %s",
+                       udisks_block_get_device (block),
+                       local_error->message);
+          g_clear_error (&local_error);
 
           goto out;
         }
@@ -1958,15 +2198,20 @@ handle_unmount (UDisksFilesystem      *filesystem,
        */
       message = N_("Authentication is required to unmount $(drive) mounted by another user");
 
-      if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                        object,
-                                                        action_id,
-                                                        options,
-                                                        message,
-                                                        invocation))
+      if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                             object,
+                                                             action_id,
+                                                             options,
+                                                             message,
+                                                             invocation,
+                                                             bulk,
+                                                             error))
         goto out;
     }
 
+  wait = unmount_wait_new (daemon, udisks_block_get_device_number (block),
+                           mount_point != NULL && g_strv_contains (mount_points, mount_point) ? mount_point : NULL);
+
   job = udisks_daemon_launch_simple_job (daemon,
                                          UDISKS_OBJECT (object),
                                          "filesystem-unmount",
@@ -1974,23 +2219,24 @@ handle_unmount (UDisksFilesystem      *filesystem,
                                          NULL);
 
   if (!bd_fs_unmount (mount_point ? mount_point : udisks_block_get_device (block),
-                      opt_force, FALSE, NULL, &error))
-    {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             get_error_code_for_umount (error->message),
-                                             "Error unmounting %s: %s",
-                                             udisks_block_get_device (block),
-                                             error->message);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
-      g_clear_error (&error);
+                      opt_force, FALSE, NULL, &local_error))
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   get_error_code_for_umount (local_error->message),
+                   "Error unmounting %s: %s",
+                   udisks_block_get_device (block),
+                   local_error->message);
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, local_error->message);
+      g_clear_error (&local_error);
       goto out;
     }
   else
     udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
 
   /* filesystem unmounted, run the state/cleanup routines now to remove the mountpoint (if applicable) */
-  udisks_state_check_sync (state);
+  if (bulk == NULL)
+    udisks_state_check_sync (state);
 
   udisks_notice ("Unmounted %s on behalf of uid %u",
                  udisks_block_get_device (block),
@@ -1998,26 +2244,202 @@ handle_unmount (UDisksFilesystem      *filesystem,
 
   waiting:
   /* wait for mount-points update before returning from method */
-  wait_data.mount_point = g_strdup (mount_point);
-  filesystem_object = udisks_daemon_wait_for_object_sync (daemon,
-                                                          wait_for_filesystem_mount_points,
-                                                          &wait_data,
-                                                          NULL,
-                                                          5,
-                                                          NULL);
+  unmount_wait_free (wait, 5, udisks_daemon_util_get_invocation_cancellable (invocation));
+  wait = NULL;
 
-  udisks_filesystem_complete_unmount (filesystem, invocation);
+  ret = TRUE;
 
  out:
-  g_free (wait_data.mount_point);
+  if (wait != NULL)
+    unmount_wait_free (wait, 0, NULL);
   g_free (mount_point);
   g_free (fstab_mount_options);
   g_clear_object (&object);
-  g_clear_object (&filesystem_object);
 
   g_mutex_unlock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
-  return TRUE;
+  return ret;
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_unmount (UDisksFilesystem      *filesystem,
+                GDBusMethodInvocation *invocation,
+                GVariant              *options)
+{
+  GError *error = NULL;
+
+  if (unmount_filesystem (filesystem, invocation, options, NULL, &error))
+    udisks_filesystem_complete_unmount (filesystem, invocation);
+  else
+    g_dbus_method_invocation_take_error (invocation, error);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  UDisksDaemon          *daemon;
+  GDBusMethodInvocation *invocation;
+  gboolean               unmount;
+  GVariant              *filesystems;
+  gchar                **mount_points;
+} BulkData;
+
+/* runs in a thread of the pool of udisks_daemon_util_bulk_call_run() */
+static void
+bulk_item_func (UDisksBulkCall  *call,
+                guint            index,
+                gpointer         user_data,
+                GError         **error)
+{
+  BulkData *bulk_data = user_data;
+  UDisksObject *object;
+  UDisksFilesystem *filesystem = NULL;
+  const gchar *object_path;
+  GVariant *options;
+
+  g_variant_get_child (bulk_data->filesystems, index, "(&o@a{sv})", &object_path, &options);
+  object = udisks_daemon_find_object (bulk_data->daemon, object_path);
+  if (object != NULL)
+    filesystem = udisks_object_get_filesystem (object);
+  if (filesystem == NULL)
+    {
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "No filesystem for object %s",
+                   object_path);
+      goto out;
+    }
+
+  if (bulk_data->unmount)
+    unmount_filesystem (filesystem, bulk_data->invocation, options,
+                        udisks_daemon_util_bulk_call_get_authorization (call), error);
+  else
+    mount_filesystem (filesystem, bulk_data->invocation, options,
+                      udisks_daemon_util_bulk_call_get_authorization (call),
+                      &bulk_data->mount_points[index], error);
+
+ out:
+  g_clear_object (&filesystem);
+  g_clear_object (&object);
+  g_variant_unref (options);
+}
+
+/* Mounts or unmounts the a(oa{sv}) @filesystems in parallel and returns
+ * the floating a(osss) or a(oss) results, in the same order.
+ */
+static GVariant *
+bulk_run (UDisksDaemon          *daemon,
+          GDBusMethodInvocation *invocation,
+          GVariant              *filesystems,
+          GVariant              *options,
+          gboolean               unmount,
+          GError               **error)
+{
+  UDisksBulkCall *call;
+  BulkData bulk_data;
+  GVariant *ret;
+  guint num_items;
+  guint n;
+
+  call = udisks_daemon_util_bulk_call_new (options,
+                                           unmount ?
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests unmounting several filesystems at once.
+                                            */
+                                           N_("Authentication is required to unmount filesystems") :
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests mounting several filesystems at once.
+                                            */
+                                           N_("Authentication is required to mount filesystems"),
+                                           FALSE,
+                                           error);
+  if (call == NULL)
+    return NULL;
+
+  num_items = g_variant_n_children (filesystems);
+  bulk_data.daemon = daemon;
+  bulk_data.invocation = invocation;
+  bulk_data.unmount = unmount;
+  bulk_data.filesystems = filesystems;
+  bulk_data.mount_points = g_new0 (gchar *, num_items);
+  for (n = 0; n < num_items; n++)
+    {
+      const gchar *object_path;
+
+      g_variant_get_child (filesystems, n, "(&oa{sv})", &object_path, NULL);
+      udisks_daemon_util_bulk_call_add (call, object_path);
+    }
+
+  udisks_daemon_util_bulk_call_run (call, bulk_item_func, &bulk_data);
+
+  /* the mount points of all the unmounted filesystems are cleaned up at once */
+  if (unmount)
+    udisks_state_check_sync (udisks_daemon_get_state (daemon));
+
+  ret = udisks_daemon_util_bulk_call_build_results (call,
+                                                    unmount ? NULL : "s",
+                                                    (const gchar *const *) bulk_data.mount_points);
+
+  /* not a NULL-terminated array, items without a mount point are NULL */
+  for (n = 0; n < num_items; n++)
+    g_free (bulk_data.mount_points[n]);
+  g_free (bulk_data.mount_points);
+  udisks_daemon_util_bulk_call_free (call);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_filesystem_mount_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.MountFilesystems() call.
+ * @filesystems: The (object path, options) pairs of the filesystems to mount.
+ * @options: The options of the call.
+ * @error: Return location for error or %NULL.
+ *
+ * Mounts @filesystems in parallel, sharing the polkit checks with
+ * identical details, see the documentation of the Manager.MountFilesystems() method.
+ * Runs in the thread handling @invocation.
+ *
+ * Returns: A floating #GVariant of type <literal>a(osss)</literal> with the results
+ * or %NULL if @options is invalid.
+ */
+GVariant *
+udisks_linux_filesystem_mount_many (UDisksDaemon          *daemon,
+                                    GDBusMethodInvocation *invocation,
+                                    GVariant              *filesystems,
+                                    GVariant              *options,
+                                    GError               **error)
+{
+  return bulk_run (daemon, invocation, filesystems, options, FALSE, error);
+}
+
+/**
+ * udisks_linux_filesystem_unmount_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.UnmountFilesystems() call.
+ * @filesystems: The (object path, options) pairs of the filesystems to unmount.
+ * @options: The options of the call.
+ * @error: Return location for error or %NULL.
+ *
+ * Like udisks_linux_filesystem_mount_many() but unmounts @filesystems.
+ *
+ * Returns: A floating #GVariant of type <literal>a(oss)</literal> with the results
+ * or %NULL if @options is invalid.
+ */
+GVariant *
+udisks_linux_filesystem_unmount_many (UDisksDaemon          *daemon,
+                                      GDBusMethodInvocation *invocation,
+                                      GVariant              *filesystems,
+                                      GVariant              *options,
+                                      GError               **error)
+{
+  return bulk_run (daemon, invocation, filesystems, options, TRUE, error);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -2242,6 +2664,7 @@ handle_resize (UDisksFilesystem      *filesystem,
   UDisksBaseJob *job = NULL;
   gchar *required_utility = NULL;
   const gchar * const *existing_mount_points = NULL;
+  UDisksThreadPriority saved_priority = { 0, };
 
   g_mutex_lock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
@@ -2350,6 +2773,12 @@ handle_resize (UDisksFilesystem      *filesystem,
                                                     invocation))
     goto out;
 
+  if (! udisks_daemon_util_set_thread_priority (options, &saved_priority, &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      goto out;
+    }
+
   job = udisks_daemon_launch_simple_job (daemon,
                                          UDISKS_OBJECT (object),
                                          "filesystem-resize",
@@ -2379,12 +2808,14 @@ handle_resize (UDisksFilesystem      *filesystem,
    */
   udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object));
 
+  g_atomic_int_inc (&UDISKS_LINUX_FILESYSTEM (filesystem)->size_generation);
   udisks_filesystem_set_size (filesystem, get_filesystem_size (UDISKS_LINUX_BLOCK_OBJECT (object)));
   udisks_filesystem_complete_resize (filesystem, invocation);
   udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
 
  out:
   udisks_bd_thread_disable_progress ();
+  udisks_daemon_util_restore_thread_priority (&saved_priority);
   g_clear_object (&object);
   g_free (required_utility);
   g_clear_error (&error);
@@ -2394,6 +2825,73 @@ handle_resize (UDisksFilesystem      *filesystem,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* libblockdev doesn't report the progress of checking and repairing XFS,
+ * xfs_repair itself reports the phases it goes through */
+static gboolean
+use_xfs_repair (const gchar *fs_type)
+{
+  gchar *path;
+
+  if (g_strcmp0 (fs_type, "xfs") != 0)
+    return FALSE;
+
+  path = g_find_program_in_path ("xfs_repair");
+  g_free (path);
+  return path != NULL;
+}
+
+/* Runs xfs_repair (with -n to only check) as a spawned job so that its
+ * phases become the progress of the job, see udisks_progress_parsers_attach().
+ * @out_ok is set to whether the filesystem is consistent (or was repaired). */
+static gboolean
+xfs_repair_sync (UDisksDaemon  *daemon,
+                 UDisksObject  *object,
+                 UDisksBlock   *block,
+                 const gchar   *job_operation,
+                 uid_t          caller_uid,
+                 gboolean       no_modify,
+                 gboolean      *out_ok,
+                 GError       **error)
+{
+  gchar *escaped_device;
+  gchar *error_message = NULL;
+  gint status = 0;
+  gboolean ret = FALSE;
+
+  escaped_device = g_shell_quote (udisks_block_get_device (block));
+  if (udisks_daemon_launch_spawned_job_sync (daemon,
+                                             object,
+                                             job_operation,
+                                             caller_uid,
+                                             NULL, /* cancellable */
+                                             0,    /* uid_t run_as_uid */
+                                             0,    /* uid_t run_as_euid */
+                                             &status,
+                                             &error_message,
+                                             NULL, /* input_string */
+                                             "xfs_repair %s%s",
+                                             no_modify ? "-n " : "",
+                                             escaped_device))
+    {
+      *out_ok = TRUE;
+      ret = TRUE;
+    }
+  else if (no_modify && WIFEXITED (status) && WEXITSTATUS (status) == 1)
+    {
+      /* corruption was found */
+      *out_ok = FALSE;
+      ret = TRUE;
+    }
+  else
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED, "%s", error_message);
+    }
+
+  g_free (error_message);
+  g_free (escaped_device);
+  return ret;
+}
+
 /* runs in thread dedicated to handling method call */
 static gboolean
 handle_repair (UDisksFilesystem      *filesystem,
@@ -2413,6 +2911,7 @@ handle_repair (UDisksFilesystem      *filesystem,
   UDisksBaseJob *job = NULL;
   gchar *required_utility = NULL;
   const gchar * const *existing_mount_points = NULL;
+  UDisksThreadPriority saved_priority = { 0, };
 
   g_mutex_lock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
@@ -2511,20 +3010,33 @@ handle_repair (UDisksFilesystem      *filesystem,
                                                      invocation))
     goto out;
 
-  job = udisks_daemon_launch_simple_job (daemon,
-                                         UDISKS_OBJECT (object),
-                                         "filesystem-repair",
-                                         caller_uid,
-                                         NULL);
-  if (job == NULL)
+  if (! udisks_daemon_util_set_thread_priority (options, &saved_priority, &error))
     {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Failed to create a job object");
+      g_dbus_method_invocation_return_gerror (invocation, error);
       goto out;
     }
 
-  udisks_bd_thread_set_progress_for_job (UDISKS_JOB (job));
-  ret = bd_fs_repair (udisks_block_get_device (block), &error);
+  if (use_xfs_repair (probed_fs_type))
+    {
+      xfs_repair_sync (daemon, object, block, "filesystem-repair", caller_uid, FALSE, &ret, &error);
+    }
+  else
+    {
+      job = udisks_daemon_launch_simple_job (daemon,
+                                             UDISKS_OBJECT (object),
+                                             "filesystem-repair",
+                                             caller_uid,
+                                             NULL);
+      if (job == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                 "Failed to create a job object");
+          goto out;
+        }
+
+      udisks_bd_thread_set_progress_for_job (UDISKS_JOB (job));
+      ret = bd_fs_repair (udisks_block_get_device (block), &error);
+    }
   if (error)
     {
       g_dbus_method_invocation_return_error (invocation,
@@ -2533,15 +3045,18 @@ handle_repair (UDisksFilesystem      *filesystem,
                                              "Error reparing filesystem on %s: %s",
                                              udisks_block_get_device (block),
                                              error->message);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      if (job != NULL)
+        udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
       goto out;
     }
 
   udisks_filesystem_complete_repair (filesystem, invocation, ret);
-  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
+  if (job != NULL)
+    udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
 
  out:
   udisks_bd_thread_disable_progress ();
+  udisks_daemon_util_restore_thread_priority (&saved_priority);
   g_clear_object (&object);
   g_free (required_utility);
   g_clear_error (&error);
@@ -2570,6 +3085,7 @@ handle_check (UDisksFilesystem      *filesystem,
   UDisksBaseJob *job = NULL;
   gchar *required_utility = NULL;
   const gchar * const *existing_mount_points = NULL;
+  UDisksThreadPriority saved_priority = { 0, };
 
   g_mutex_lock (&UDISKS_LINUX_FILESYSTEM (filesystem)->lock);
 
@@ -2668,20 +3184,33 @@ handle_check (UDisksFilesystem      *filesystem,
                                                      invocation))
     goto out;
 
-  job = udisks_daemon_launch_simple_job (daemon,
-                                         UDISKS_OBJECT (object),
-                                         "filesystem-check",
-                                         caller_uid,
-                                         NULL);
-  if (job == NULL)
+  if (! udisks_daemon_util_set_thread_priority (options, &saved_priority, &error))
     {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Failed to create a job object");
+      g_dbus_method_invocation_return_gerror (invocation, error);
       goto out;
     }
 
-  udisks_bd_thread_set_progress_for_job (UDISKS_JOB (job));
-  ret = bd_fs_check (udisks_block_get_device (block), &error);
+  if (use_xfs_repair (probed_fs_type))
+    {
+      xfs_repair_sync (daemon, object, block, "filesystem-check", caller_uid, TRUE, &ret, &error);
+    }
+  else
+    {
+      job = udisks_daemon_launch_simple_job (daemon,
+                                             UDISKS_OBJECT (object),
+                                             "filesystem-check",
+                                             caller_uid,
+                                             NULL);
+      if (job == NULL)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                 "Failed to create a job object");
+          goto out;
+        }
+
+      udisks_bd_thread_set_progress_for_job (UDISKS_JOB (job));
+      ret = bd_fs_check (udisks_block_get_device (block), &error);
+    }
   if (error)
     {
       g_dbus_method_invocation_return_error (invocation,
@@ -2690,15 +3219,18 @@ handle_check (UDisksFilesystem      *filesystem,
                                              "Error checking filesystem on %s: %s",
                                              udisks_block_get_device (block),
                                              error->message);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      if (job != NULL)
+        udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
       goto out;
     }
 
   udisks_filesystem_complete_check (filesystem, invocation, ret);
-  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
+  if (job != NULL)
+    udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
 
  out:
   udisks_bd_thread_disable_progress ();
+  udisks_daemon_util_restore_thread_priority (&saved_priority);
   g_clear_object (&object);
   g_free (required_utility);
   g_clear_error (&error);
@@ -2814,6 +3346,7 @@ handle_take_ownership (UDisksFilesystem      *filesystem,
                                    probed_fs_type,
                                    caller_uid, caller_gid,
                                    recursive,
+                                   job,
                                    &error))
     {
       g_dbus_method_invocation_return_error (invocation,
@@ -2839,6 +3372,350 @@ handle_take_ownership (UDisksFilesystem      *filesystem,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+reset_usage_properties (UDisksLinuxFilesystem *filesystem)
+{
+  UDisksFilesystem *iface = UDISKS_FILESYSTEM (filesystem);
+
+  g_object_freeze_notify (G_OBJECT (filesystem));
+  udisks_filesystem_set_usage_updated (iface, 0);
+  udisks_filesystem_set_used (iface, 0);
+  udisks_filesystem_set_free (iface, 0);
+  udisks_filesystem_set_inodes_free (iface, 0);
+  g_object_thaw_notify (G_OBJECT (filesystem));
+}
+
+static gint
+compare_doubles (gconstpointer a,
+                 gconstpointer b)
+{
+  gdouble x = *((const gdouble *) a);
+  gdouble y = *((const gdouble *) b);
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* called with usage_lock held, returns the sorted thresholds of all the subscribers */
+static GArray *
+collect_thresholds_locked (UDisksLinuxFilesystem *filesystem)
+{
+  GHashTableIter iter;
+  UsageSubscription *subscription;
+  GArray *ret;
+
+  ret = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  g_hash_table_iter_init (&iter, filesystem->usage_subscribers);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &subscription))
+    g_array_append_vals (ret, subscription->thresholds->data, subscription->thresholds->len);
+  g_array_sort (ret, compare_doubles);
+
+  return ret;
+}
+
+/* Samples the usage of the filesystem mounted at the first of its mount
+ * points, may be called from any thread */
+static void
+sample_usage (UDisksLinuxFilesystem *filesystem)
+{
+  UDisksFilesystem *iface = UDISKS_FILESYSTEM (filesystem);
+  const gchar *const *mount_points;
+  struct statvfs vfs;
+  guint64 used;
+  guint64 free_bytes;
+  gdouble fraction = -1.0;
+  gdouble last_fraction;
+  GArray *thresholds = NULL;
+  gchar *mount_point = NULL;
+  guint n;
+
+  mount_points = udisks_filesystem_get_mount_points (iface);
+  if (mount_points != NULL && mount_points[0] != NULL)
+    mount_point = g_strdup (mount_points[0]);
+
+  if (mount_point == NULL || statvfs (mount_point, &vfs) != 0)
+    {
+      if (mount_point != NULL)
+        udisks_warning ("Error getting the usage of the filesystem mounted at %s: %m", mount_point);
+      G_LOCK (usage_lock);
+      filesystem->last_used_fraction = -1.0;
+      G_UNLOCK (usage_lock);
+      reset_usage_properties (filesystem);
+      goto out;
+    }
+
+  used = (guint64) (vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+  free_bytes = (guint64) vfs.f_bavail * vfs.f_frsize;
+  if (used + free_bytes > 0)
+    fraction = ((gdouble) used) / (used + free_bytes);
+
+  g_object_freeze_notify (G_OBJECT (filesystem));
+  udisks_filesystem_set_usage_updated (iface, g_get_real_time ());
+  udisks_filesystem_set_used (iface, used);
+  udisks_filesystem_set_free (iface, free_bytes);
+  udisks_filesystem_set_inodes_free (iface, vfs.f_favail);
+  g_object_thaw_notify (G_OBJECT (filesystem));
+
+  G_LOCK (usage_lock);
+  last_fraction = filesystem->last_used_fraction;
+  filesystem->last_used_fraction = fraction;
+  if (last_fraction >= 0.0 && fraction >= 0.0)
+    thresholds = collect_thresholds_locked (filesystem);
+  G_UNLOCK (usage_lock);
+
+  for (n = 0; thresholds != NULL && n < thresholds->len; n++)
+    {
+      gdouble threshold = g_array_index (thresholds, gdouble, n);
+
+      /* several subscribers may use the same threshold */
+      if (n > 0 && threshold == g_array_index (thresholds, gdouble, n - 1))
+        continue;
+      if (last_fraction < threshold && fraction >= threshold)
+        udisks_filesystem_emit_usage_threshold_crossed (iface, threshold, TRUE);
+      else if (last_fraction >= threshold && fraction < threshold)
+        udisks_filesystem_emit_usage_threshold_crossed (iface, threshold, FALSE);
+    }
+
+ out:
+  if (thresholds != NULL)
+    g_array_unref (thresholds);
+  g_free (mount_point);
+}
+
+static void start_usage_sampling_locked (UDisksLinuxFilesystem *filesystem,
+                                         UDisksDaemon          *daemon);
+
+static gboolean
+on_usage_timeout (gpointer user_data)
+{
+  UDisksLinuxFilesystem *filesystem = UDISKS_LINUX_FILESYSTEM (user_data);
+  UDisksObject *object;
+  UDisksDaemon *daemon;
+  guint interval;
+  gboolean ret = G_SOURCE_CONTINUE;
+
+  object = udisks_daemon_util_dup_object (filesystem, NULL);
+  if (object == NULL)
+    {
+      /* the filesystem is gone, nothing left to sample */
+      G_LOCK (usage_lock);
+      g_hash_table_remove_all (filesystem->usage_subscribers);
+      filesystem->usage_timeout_id = 0;
+      G_UNLOCK (usage_lock);
+      return G_SOURCE_REMOVE;
+    }
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  G_LOCK (usage_lock);
+  if (filesystem->usage_timeout_id == 0)
+    {
+      /* the last subscriber went away while we were getting here */
+      G_UNLOCK (usage_lock);
+      ret = G_SOURCE_REMOVE;
+      goto out;
+    }
+  /* pick up changes of the configured interval */
+  interval = udisks_config_manager_get_usage_interval (udisks_daemon_get_config_manager (daemon));
+  if (interval != filesystem->usage_interval)
+    {
+      filesystem->usage_timeout_id = 0;
+      start_usage_sampling_locked (filesystem, daemon);
+      ret = G_SOURCE_REMOVE;
+    }
+  G_UNLOCK (usage_lock);
+
+  sample_usage (filesystem);
+
+ out:
+  g_object_unref (object);
+  return ret;
+}
+
+/* called with usage_lock held */
+static void
+start_usage_sampling_locked (UDisksLinuxFilesystem *filesystem,
+                             UDisksDaemon          *daemon)
+{
+  if (filesystem->usage_timeout_id != 0)
+    return;
+
+  filesystem->usage_interval = udisks_config_manager_get_usage_interval (udisks_daemon_get_config_manager (daemon));
+  filesystem->usage_timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                         "filesystem-usage",
+                                                                         filesystem->usage_interval,
+                                                                         on_usage_timeout,
+                                                                         g_object_ref (filesystem),
+                                                                         g_object_unref);
+}
+
+/* called with usage_lock held */
+static void
+stop_usage_sampling_locked (UDisksLinuxFilesystem *filesystem)
+{
+  if (filesystem->usage_timeout_id != 0)
+    {
+      g_source_remove (filesystem->usage_timeout_id);
+      filesystem->usage_timeout_id = 0;
+    }
+  filesystem->last_used_fraction = -1.0;
+}
+
+static void
+usage_subscriber_free (UsageSubscriber *subscriber)
+{
+  g_object_unref (subscriber->filesystem);
+  g_free (subscriber->name);
+  g_free (subscriber);
+}
+
+static void
+remove_usage_subscriber (UDisksLinuxFilesystem *filesystem,
+                         const gchar           *name)
+{
+  gboolean stopped = FALSE;
+
+  G_LOCK (usage_lock);
+  if (g_hash_table_remove (filesystem->usage_subscribers, name) &&
+      g_hash_table_size (filesystem->usage_subscribers) == 0)
+    {
+      stop_usage_sampling_locked (filesystem);
+      stopped = TRUE;
+    }
+  G_UNLOCK (usage_lock);
+
+  if (stopped)
+    reset_usage_properties (filesystem);
+}
+
+static void
+on_usage_subscriber_vanished (GDBusConnection *connection,
+                              const gchar     *name,
+                              gpointer         user_data)
+{
+  UsageSubscriber *subscriber = user_data;
+
+  remove_usage_subscriber (subscriber->filesystem, subscriber->name);
+}
+
+static gboolean
+handle_subscribe_usage (UDisksFilesystem      *_filesystem,
+                        GDBusMethodInvocation *invocation,
+                        GVariant              *options)
+{
+  UDisksLinuxFilesystem *filesystem = UDISKS_LINUX_FILESYSTEM (_filesystem);
+  const gchar *sender = g_dbus_method_invocation_get_sender (invocation);
+  UDisksObject *object;
+  UsageSubscription *subscription;
+  UsageSubscriber *subscriber;
+  GArray *thresholds;
+  GVariant *thresholds_value = NULL;
+  GError *error = NULL;
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (sender == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  object = udisks_daemon_util_dup_object (filesystem, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  thresholds = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  thresholds_value = g_variant_lookup_value (options, "thresholds", G_VARIANT_TYPE ("ad"));
+  if (thresholds_value != NULL)
+    {
+      const gdouble *values;
+      gsize num_values;
+      gsize n;
+
+      values = g_variant_get_fixed_array (thresholds_value, &num_values, sizeof (gdouble));
+      for (n = 0; n < num_values; n++)
+        {
+          if (!(values[n] > 0.0 && values[n] <= 1.0))
+            {
+              g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                                     "Invalid threshold %g, thresholds must be between 0 and 1",
+                                                     values[n]);
+              g_array_unref (thresholds);
+              goto out;
+            }
+        }
+      g_array_append_vals (thresholds, values, num_values);
+    }
+
+  G_LOCK (usage_lock);
+  subscription = g_hash_table_lookup (filesystem->usage_subscribers, sender);
+  if (subscription != NULL)
+    {
+      g_array_unref (subscription->thresholds);
+      subscription->thresholds = thresholds;
+    }
+  else
+    {
+      subscriber = g_new0 (UsageSubscriber, 1);
+      subscriber->filesystem = g_object_ref (filesystem);
+      subscriber->name = g_strdup (sender);
+      subscription = g_new0 (UsageSubscription, 1);
+      subscription->thresholds = thresholds;
+      subscription->watch_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                                               sender,
+                                                               G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                               NULL, /* name_appeared_handler */
+                                                               on_usage_subscriber_vanished,
+                                                               subscriber,
+                                                               (GDestroyNotify) usage_subscriber_free);
+      g_hash_table_insert (filesystem->usage_subscribers, g_strdup (sender), subscription);
+      start_usage_sampling_locked (filesystem, udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object)));
+    }
+  G_UNLOCK (usage_lock);
+
+  /* don't make the subscriber wait for the first interval */
+  sample_usage (filesystem);
+
+  udisks_filesystem_complete_subscribe_usage (_filesystem, invocation);
+
+ out:
+  if (thresholds_value != NULL)
+    g_variant_unref (thresholds_value);
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+static gboolean
+handle_unsubscribe_usage (UDisksFilesystem      *_filesystem,
+                          GDBusMethodInvocation *invocation,
+                          GVariant              *options)
+{
+  UDisksLinuxFilesystem *filesystem = UDISKS_LINUX_FILESYSTEM (_filesystem);
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  remove_usage_subscriber (filesystem, g_dbus_method_invocation_get_sender (invocation));
+
+  udisks_filesystem_complete_unsubscribe_usage (_filesystem, invocation);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 filesystem_iface_init (UDisksFilesystemIface *iface)
 {
@@ -2849,4 +3726,6 @@ filesystem_iface_init (UDisksFilesystemIface *iface)
   iface->handle_repair    = handle_repair;
   iface->handle_check     = handle_check;
   iface->handle_take_ownership = handle_take_ownership;
+  iface->handle_subscribe_usage = handle_subscribe_usage;
+  iface->handle_unsubscribe_usage = handle_unsubscribe_usage;
 }
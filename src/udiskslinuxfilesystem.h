@@ -34,6 +34,17 @@ UDisksFilesystem *udisks_linux_filesystem_new      (void);
 void              udisks_linux_filesystem_update   (UDisksLinuxFilesystem  *filesystem,
                                                     UDisksLinuxBlockObject *object);
 
+GVariant         *udisks_linux_filesystem_mount_many   (UDisksDaemon          *daemon,
+                                                        GDBusMethodInvocation *invocation,
+                                                        GVariant              *filesystems,
+                                                        GVariant              *options,
+                                                        GError               **error);
+GVariant         *udisks_linux_filesystem_unmount_many (UDisksDaemon          *daemon,
+                                                        GDBusMethodInvocation *invocation,
+                                                        GVariant              *filesystems,
+                                                        GVariant              *options,
+                                                        GError               **error);
+
 G_END_DECLS
 
 #endif /* __UDISKS_LINUX_FILESYSTEM_H__ */
@@ -22,57 +22,350 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <unistd.h>
 #include <blockdev/fs.h>
 
 #include "udiskslinuxfilesystemhelpers.h"
+#include "udisksbasejob.h"
 #include "udiskslogging.h"
 
+/* The recursive chown walks the tree with file descriptors relative to the
+ * parent directory (openat(), fchownat()) instead of building paths, so the
+ * depth of the tree is not limited by PATH_MAX. The directories are processed
+ * by several threads taking them from a common stack. Taking the most recently
+ * found directory first keeps the walk depth-first, so only the directories on
+ * the current paths (and the ones with pending subdirectories) are kept open.
+ */
+
+#define CHOWN_MAX_THREADS 16
+/* how often the job progress is updated */
+#define CHOWN_PROGRESS_INTERVAL_USEC (G_USEC_PER_SEC / 2)
+/* how many entries are processed between checks for errors and cancellation */
+#define CHOWN_CHECK_INTERVAL 1024
 
-static gboolean recursive_chown (const gchar *directory, uid_t caller_uid, gid_t caller_gid)
+typedef struct
 {
-  GDir * gdir = NULL;
-  const gchar *fname = NULL;
-  GError *local_error = NULL;
-  gchar path[PATH_MAX + 1] = {0};
+  gint ref_count;
+  DIR *dir;   /* NULL for the starting point */
+  gint fd;
+} ChownDir;
+
+typedef struct
+{
+  ChownDir *parent;
+  gchar *name;
+} ChownTask;
+
+typedef struct
+{
+  uid_t uid;
+  gid_t gid;
+
+  UDisksBaseJob *job;
+  GCancellable *cancellable;
+  guint64 n_expected;
+
+  GMutex lock;
+  GCond cond;
+  /* the directories to process, last in first out */
+  GPtrArray *tasks;
+  /* the number of directories being processed */
+  guint n_busy;
+  guint64 n_processed;
+  gint64 last_progress_update;
+  GError *error;
+} ChownWalk;
+
+static ChownDir *
+chown_dir_ref (ChownDir *dir)
+{
+  g_atomic_int_inc (&dir->ref_count);
+  return dir;
+}
+
+static void
+chown_dir_unref (ChownDir *dir)
+{
+  if (g_atomic_int_dec_and_test (&dir->ref_count))
+    {
+      if (dir->dir != NULL)
+        closedir (dir->dir);
+      g_slice_free (ChownDir, dir);
+    }
+}
+
+static void
+chown_task_free (ChownTask *task)
+{
+  chown_dir_unref (task->parent);
+  g_free (task->name);
+  g_slice_free (ChownTask, task);
+}
+
+static void
+chown_walk_push (ChownWalk   *walk,
+                 ChownDir    *parent,
+                 const gchar *name)
+{
+  ChownTask *task;
+
+  task = g_slice_new (ChownTask);
+  task->parent = chown_dir_ref (parent);
+  task->name = g_strdup (name);
+
+  g_mutex_lock (&walk->lock);
+  g_ptr_array_add (walk->tasks, task);
+  g_cond_signal (&walk->cond);
+  g_mutex_unlock (&walk->lock);
+}
 
-  gdir = g_dir_open (directory, 0, &local_error);
-  if (gdir == NULL)
+static void
+chown_walk_fail (ChownWalk   *walk,
+                 const gchar *name,
+                 gint         errsv)
+{
+  g_mutex_lock (&walk->lock);
+  if (walk->error == NULL)
+    g_set_error (&walk->error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                 "%s: %s", name, g_strerror (errsv));
+  g_cond_broadcast (&walk->cond);
+  g_mutex_unlock (&walk->lock);
+}
+
+/* Adds @n_processed to the number of entries processed and returns FALSE if
+ * the walk should stop */
+static gboolean
+chown_walk_report (ChownWalk *walk,
+                   guint      n_processed)
+{
+  gdouble progress = -1.0;
+  gboolean ret;
+  gint64 now;
+
+  g_mutex_lock (&walk->lock);
+  if (walk->error == NULL)
+    g_cancellable_set_error_if_cancelled (walk->cancellable, &walk->error);
+  ret = walk->error == NULL;
+  if (!ret)
+    g_cond_broadcast (&walk->cond);
+
+  walk->n_processed += n_processed;
+  now = g_get_monotonic_time ();
+  if (walk->job != NULL && walk->n_expected > 0 &&
+      now - walk->last_progress_update >= CHOWN_PROGRESS_INTERVAL_USEC)
     {
-      g_clear_error (&local_error);
-      return FALSE;
+      walk->last_progress_update = now;
+      progress = MIN ((gdouble) walk->n_processed / walk->n_expected, 1.0);
     }
+  g_mutex_unlock (&walk->lock);
+
+  if (progress >= 0.0)
+    udisks_job_set_progress (UDISKS_JOB (walk->job), progress);
 
-  if (chown (directory, caller_uid, caller_gid) != 0)
+  return ret;
+}
+
+static void
+chown_walk_dir (ChownWalk *walk,
+                ChownTask *task)
+{
+  ChownDir *dir;
+  struct dirent *entry;
+  guint n_processed = 0;
+  gint fd;
+
+  fd = openat (task->parent->fd, task->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0 || fchown (fd, walk->uid, walk->gid) != 0)
+    {
+      chown_walk_fail (walk, task->name, errno);
+      if (fd >= 0)
+        close (fd);
+      return;
+    }
+
+  dir = g_slice_new (ChownDir);
+  dir->ref_count = 1;
+  dir->fd = fd;
+  dir->dir = fdopendir (fd);
+  if (dir->dir == NULL)
     {
-      g_dir_close (gdir);
-      return FALSE;
+      chown_walk_fail (walk, task->name, errno);
+      close (fd);
+      g_slice_free (ChownDir, dir);
+      return;
     }
+  n_processed++;
 
-  while ((fname = g_dir_read_name (gdir)))
+  for (;;)
     {
-      snprintf (path, sizeof (path), "%s/%s", directory, fname);
-      if (g_file_test (path, G_FILE_TEST_IS_DIR))
+      gboolean is_dir = FALSE;
+      gboolean is_regular = FALSE;
+
+      errno = 0;
+      entry = readdir (dir->dir);
+      if (entry == NULL)
         {
-          if (!recursive_chown (path, caller_uid, caller_gid))
+          if (errno != 0)
+            chown_walk_fail (walk, task->name, errno);
+          break;
+        }
+      if (strcmp (entry->d_name, ".") == 0 || strcmp (entry->d_name, "..") == 0)
+        continue;
+
+      if (entry->d_type == DT_DIR)
+        {
+          is_dir = TRUE;
+        }
+      else if (entry->d_type == DT_REG)
+        {
+          is_regular = TRUE;
+        }
+      else if (entry->d_type == DT_UNKNOWN)
+        {
+          struct stat st;
+
+          if (fstatat (dir->fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
             {
-              g_dir_close (gdir);
-              return FALSE;
+              chown_walk_fail (walk, entry->d_name, errno);
+              break;
             }
+          is_dir = S_ISDIR (st.st_mode);
+          is_regular = S_ISREG (st.st_mode);
         }
-      else if (g_file_test (path, G_FILE_TEST_IS_REGULAR) && !g_file_test (path, G_FILE_TEST_IS_SYMLINK))
+
+      /* like before, symlinks and special files are left alone */
+      if (is_dir)
+        {
+          chown_walk_push (walk, dir, entry->d_name);
+        }
+      else if (is_regular)
         {
-          if (chown (path, caller_uid, caller_gid) != 0)
+          if (fchownat (dir->fd, entry->d_name, walk->uid, walk->gid, AT_SYMLINK_NOFOLLOW) != 0)
+            {
+              chown_walk_fail (walk, entry->d_name, errno);
+              break;
+            }
+          if (++n_processed == CHOWN_CHECK_INTERVAL)
             {
-              g_dir_close (gdir);
-              return FALSE;
+              if (!chown_walk_report (walk, n_processed))
+                {
+                  n_processed = 0;
+                  break;
+                }
+              n_processed = 0;
             }
         }
     }
 
-  g_dir_close (gdir);
-  return TRUE;
+  chown_walk_report (walk, n_processed);
+  chown_dir_unref (dir);
+}
+
+static gpointer
+chown_walk_thread (gpointer user_data)
+{
+  ChownWalk *walk = user_data;
+  ChownTask *task;
+
+  g_mutex_lock (&walk->lock);
+  for (;;)
+    {
+      while (walk->tasks->len == 0 && walk->n_busy > 0 && walk->error == NULL)
+        g_cond_wait (&walk->cond, &walk->lock);
+      /* done or failed */
+      if (walk->tasks->len == 0 || walk->error != NULL)
+        break;
+
+      task = g_ptr_array_remove_index (walk->tasks, walk->tasks->len - 1);
+      walk->n_busy++;
+      g_mutex_unlock (&walk->lock);
+
+      chown_walk_dir (walk, task);
+      chown_task_free (task);
+
+      g_mutex_lock (&walk->lock);
+      walk->n_busy--;
+    }
+  /* let the other threads find out, too */
+  g_cond_broadcast (&walk->cond);
+  g_mutex_unlock (&walk->lock);
+
+  return NULL;
+}
+
+static gboolean
+recursive_chown (const gchar    *directory,
+                 uid_t           caller_uid,
+                 gid_t           caller_gid,
+                 UDisksBaseJob  *job,
+                 GError        **error)
+{
+  ChownWalk walk = { 0, };
+  ChownDir *start;
+  struct statvfs vfs;
+  GPtrArray *threads;
+  guint n_threads;
+  guint n;
+  gboolean ret = TRUE;
+
+  walk.uid = caller_uid;
+  walk.gid = caller_gid;
+  walk.job = job;
+  if (job != NULL)
+    walk.cancellable = udisks_base_job_get_cancellable (job);
+  g_mutex_init (&walk.lock);
+  g_cond_init (&walk.cond);
+  walk.tasks = g_ptr_array_new_with_free_func ((GDestroyNotify) chown_task_free);
+
+  /* the used inodes are a good enough estimate of the number of entries */
+  if (statvfs (directory, &vfs) == 0 && vfs.f_files > vfs.f_ffree)
+    walk.n_expected = vfs.f_files - vfs.f_ffree;
+  if (job != NULL && walk.n_expected > 0)
+    {
+      udisks_job_set_progress (UDISKS_JOB (job), 0.0);
+      udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+    }
+
+  start = g_slice_new0 (ChownDir);
+  start->ref_count = 1;
+  start->fd = AT_FDCWD;
+  chown_walk_push (&walk, start, directory);
+  chown_dir_unref (start);
+
+  /* the calling thread takes part in the walk, too */
+  n_threads = CLAMP (g_get_num_processors (), 1, CHOWN_MAX_THREADS);
+  threads = g_ptr_array_new ();
+  for (n = 1; n < n_threads; n++)
+    {
+      GThread *thread;
+
+      thread = g_thread_try_new ("chown-walk", chown_walk_thread, &walk, NULL);
+      if (thread == NULL)
+        break;
+      g_ptr_array_add (threads, thread);
+    }
+  chown_walk_thread (&walk);
+  for (n = 0; n < threads->len; n++)
+    g_thread_join (threads->pdata[n]);
+  g_ptr_array_free (threads, TRUE);
+
+  if (walk.error != NULL)
+    {
+      g_propagate_error (error, walk.error);
+      ret = FALSE;
+    }
+
+  g_ptr_array_free (walk.tasks, TRUE);
+  g_cond_clear (&walk.cond);
+  g_mutex_clear (&walk.lock);
+
+  return ret;
 }
 
 
@@ -81,6 +374,7 @@ gboolean take_filesystem_ownership (const gchar *device,
                                     uid_t caller_uid,
                                     gid_t caller_gid,
                                     gboolean recursive,
+                                    UDisksBaseJob *job,
                                     GError **error)
 
 {
@@ -132,12 +426,12 @@ gboolean take_filesystem_ownership (const gchar *device,
 
   if (recursive)
     {
-      if (!recursive_chown (mountpoint, caller_uid, caller_gid))
+      if (!recursive_chown (mountpoint, caller_uid, caller_gid, job, &local_error))
         {
-            g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                         "Cannot recursively chown %s to uid=%u and gid=%u: %m",
-                         mountpoint, caller_uid, caller_gid);
-
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Cannot recursively chown %s to uid=%u and gid=%u: %s",
+                       mountpoint, caller_uid, caller_gid, local_error->message);
+          g_clear_error (&local_error);
           success = FALSE;
           goto out;
         }
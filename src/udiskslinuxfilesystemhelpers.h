@@ -29,6 +29,8 @@
 
 #include <blockdev/fs.h>
 
+#include "udisksdaemontypes.h"
+
 G_BEGIN_DECLS
 
 gboolean take_filesystem_ownership (const gchar *device,
@@ -36,6 +38,7 @@ gboolean take_filesystem_ownership (const gchar *device,
                                     uid_t caller_uid,
                                     gid_t caller_gid,
                                     gboolean recursive,
+                                    UDisksBaseJob *job,
                                     GError **error);
 
 G_END_DECLS
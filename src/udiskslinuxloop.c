@@ -42,6 +42,7 @@
 #include "udisksdaemon.h"
 #include "udisksstate.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udiskslinuxdevice.h"
 #include "udiskssimplejob.h"
 
@@ -82,13 +83,12 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxLoop, udisks_linux_loop, UDISKS_TYPE_LOOP_SK
 static void
 udisks_linux_loop_init (UDisksLinuxLoop *loop)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (loop),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
 udisks_linux_loop_class_init (UDisksLinuxLoopClass *klass)
 {
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -25,7 +25,9 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
+#include <linux/loop.h>
 
 #include <pwd.h>
 #include <grp.h>
@@ -41,13 +43,20 @@
 #include "udiskslinuxmanager.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udisksstate.h"
 #include "udiskslinuxblockobject.h"
+#include "udiskslinuxblock.h"
 #include "udiskslinuxdevice.h"
 #include "udisksmodulemanager.h"
 #include "udiskslinuxfsinfo.h"
+#include "udiskslinuxfilesystem.h"
+#include "udiskslinuxencrypted.h"
+#include "udiskslinuxdrive.h"
+#include "udiskslinuxswapspace.h"
 #include "udiskssimplejob.h"
 #include "udisksconfigmanager.h"
+#include "udisksmetrics.h"
 
 /**
  * SECTION:udiskslinuxmanager
@@ -66,6 +75,28 @@ typedef struct _UDisksLinuxManagerClass   UDisksLinuxManagerClass;
  * The #UDisksLinuxManager structure contains only private data and should
  * only be accessed using the provided API.
  */
+/* Totals of the DriveHealthEntry instances, signed so that entries can
+ * be subtracted again
+ */
+typedef struct
+{
+  gint64 drives;
+  gint64 failing;
+  gint64 attributes_failing;
+  gint64 over_temperature;
+  gint64 drives_with_bad_sectors;
+  gint64 bad_sectors;
+} HealthTotals;
+
+/* The contribution of a drive to HealthTotals */
+typedef struct
+{
+  gboolean failing;
+  gboolean attributes_failing;
+  gboolean over_temperature;
+  guint64 bad_sectors;
+} DriveHealthEntry;
+
 struct _UDisksLinuxManager
 {
   UDisksManagerSkeleton parent_instance;
@@ -73,6 +104,23 @@ struct _UDisksLinuxManager
   GMutex lock;
 
   UDisksDaemon *daemon;
+
+  /* JobsChanged signal, protected by jobs_lock */
+  GMutex jobs_lock;
+  GHashTable *job_watchers;        /* bus name -> name watcher id */
+  GPtrArray *pending_job_events;   /* of JobEvent, in order of occurrence */
+  GHashTable *pending_job_progress; /* job object path -> JobEvent in pending_job_events */
+  guint jobs_changed_source_id;
+
+  /* free loop devices kept open for LoopSetup(), protected by loop_pool_lock */
+  GMutex loop_pool_lock;
+  GQueue loop_pool;                /* of LoopPoolEntry */
+  gboolean loop_configure_unsupported;
+
+  /* HealthSummary property, protected by health_lock */
+  GMutex health_lock;
+  GHashTable *drive_health;        /* drive object path -> DriveHealthEntry */
+  HealthTotals health_totals;
 };
 
 struct _UDisksLinuxManagerClass
@@ -86,6 +134,61 @@ enum
   PROP_DAEMON
 };
 
+/* Interval of the JobsChanged signal emissions */
+#define JOBS_CHANGED_INTERVAL_MSEC 1000
+
+/* Number of free loop devices kept open for LoopSetup() */
+#define LOOP_POOL_SIZE 2
+
+typedef struct
+{
+  gint number;
+  gint fd;
+} LoopPoolEntry;
+
+static void
+loop_pool_entry_free (LoopPoolEntry *entry)
+{
+  close (entry->fd);
+  g_free (entry);
+}
+
+typedef struct
+{
+  gchar *object_path;
+  const gchar *event;
+  GVariant *details;
+} JobEvent;
+
+static void
+job_event_free (JobEvent *event)
+{
+  g_free (event->object_path);
+  g_variant_unref (event->details);
+  g_free (event);
+}
+
+static void
+unwatch_name (gpointer watcher_id)
+{
+  g_bus_unwatch_name (GPOINTER_TO_UINT (watcher_id));
+}
+
+static void on_object_added (GDBusObjectManager *object_manager,
+                             GDBusObject        *object,
+                             gpointer            user_data);
+
+static void on_object_removed (GDBusObjectManager *object_manager,
+                               GDBusObject        *object,
+                               gpointer            user_data);
+
+static void on_interface_removed (GDBusObjectManager *object_manager,
+                                  GDBusObject        *object,
+                                  GDBusInterface     *interface,
+                                  gpointer            user_data);
+
+static void publish_health_summary (UDisksLinuxManager *manager);
+
 static void manager_iface_init (UDisksManagerIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (UDisksLinuxManager, udisks_linux_manager, UDISKS_TYPE_MANAGER_SKELETON,
@@ -98,6 +201,17 @@ udisks_linux_manager_finalize (GObject *object)
 {
   UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
 
+  if (manager->jobs_changed_source_id != 0)
+    g_source_remove (manager->jobs_changed_source_id);
+  g_hash_table_unref (manager->pending_job_progress);
+  g_ptr_array_unref (manager->pending_job_events);
+  g_hash_table_unref (manager->job_watchers);
+  g_mutex_clear (&(manager->jobs_lock));
+  g_queue_foreach (&manager->loop_pool, (GFunc) loop_pool_entry_free, NULL);
+  g_queue_clear (&manager->loop_pool);
+  g_mutex_clear (&(manager->loop_pool_lock));
+  g_hash_table_unref (manager->drive_health);
+  g_mutex_clear (&(manager->health_lock));
   g_mutex_clear (&(manager->lock));
 
   G_OBJECT_CLASS (udisks_linux_manager_parent_class)->finalize (object);
@@ -149,13 +263,21 @@ static void
 udisks_linux_manager_init (UDisksLinuxManager *manager)
 {
   g_mutex_init (&(manager->lock));
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (manager),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&(manager->jobs_lock));
+  manager->job_watchers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, unwatch_name);
+  manager->pending_job_events = g_ptr_array_new_with_free_func ((GDestroyNotify) job_event_free);
+  manager->pending_job_progress = g_hash_table_new (g_str_hash, g_str_equal);
+  g_mutex_init (&(manager->loop_pool_lock));
+  g_queue_init (&manager->loop_pool);
+  g_mutex_init (&(manager->health_lock));
+  manager->drive_health = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 
   udisks_manager_set_supported_filesystems (UDISKS_MANAGER (manager),
                                             get_supported_filesystems ());
   udisks_manager_set_supported_encryption_types (UDISKS_MANAGER (manager),
                                                  get_supported_encryption_types ());
+  udisks_manager_set_coldplug_statistics (UDISKS_MANAGER (manager),
+                                          g_variant_new ("a{sv}", NULL));
 }
 
 static void
@@ -167,6 +289,26 @@ udisks_linux_manager_constructed (GObject *obj)
   udisks_manager_set_default_encryption_type (UDISKS_MANAGER (manager),
                                               udisks_config_manager_get_encryption (config_manager));
 
+  /* jobs are exported on the object manager when they are started */
+  g_signal_connect_object (udisks_daemon_get_object_manager (manager->daemon),
+                           "object-added",
+                           G_CALLBACK (on_object_added),
+                           manager,
+                           0);
+  /* drives that are gone no longer count for the health summary */
+  g_signal_connect_object (udisks_daemon_get_object_manager (manager->daemon),
+                           "object-removed",
+                           G_CALLBACK (on_object_removed),
+                           manager,
+                           0);
+  g_signal_connect_object (udisks_daemon_get_object_manager (manager->daemon),
+                           "interface-removed",
+                           G_CALLBACK (on_interface_removed),
+                           manager,
+                           0);
+
+  publish_health_summary (manager);
+
   G_OBJECT_CLASS (udisks_linux_manager_parent_class)->constructed (obj);
 }
 
@@ -196,6 +338,8 @@ udisks_linux_manager_class_init (UDisksLinuxManagerClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -233,6 +377,131 @@ udisks_linux_manager_get_daemon (UDisksLinuxManager *manager)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+health_totals_add (HealthTotals           *totals,
+                   const DriveHealthEntry *entry,
+                   gint                    sign)
+{
+  totals->drives += sign;
+  if (entry->failing)
+    totals->failing += sign;
+  if (entry->attributes_failing)
+    totals->attributes_failing += sign;
+  if (entry->over_temperature)
+    totals->over_temperature += sign;
+  if (entry->bad_sectors > 0)
+    totals->drives_with_bad_sectors += sign;
+  totals->bad_sectors += sign * (gint64) entry->bad_sectors;
+}
+
+static gboolean
+drive_health_entry_equal (const DriveHealthEntry *a,
+                          const DriveHealthEntry *b)
+{
+  return a->failing == b->failing &&
+    a->attributes_failing == b->attributes_failing &&
+    a->over_temperature == b->over_temperature &&
+    a->bad_sectors == b->bad_sectors;
+}
+
+static gdouble
+get_temperature_threshold (UDisksLinuxManager *manager)
+{
+  UDisksConfigManager *config_manager = udisks_daemon_get_config_manager (manager->daemon);
+
+  return udisks_config_manager_get_health_temperature_threshold (config_manager) + 273.15;
+}
+
+/* called with health_lock held, or before the manager is exported */
+static void
+publish_health_summary (UDisksLinuxManager *manager)
+{
+  const HealthTotals *totals = &manager->health_totals;
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "drives",
+                         g_variant_new_uint32 (totals->drives));
+  g_variant_builder_add (&builder, "{sv}", "failing",
+                         g_variant_new_uint32 (totals->failing));
+  g_variant_builder_add (&builder, "{sv}", "attributes-failing",
+                         g_variant_new_uint32 (totals->attributes_failing));
+  g_variant_builder_add (&builder, "{sv}", "over-temperature",
+                         g_variant_new_uint32 (totals->over_temperature));
+  g_variant_builder_add (&builder, "{sv}", "drives-with-bad-sectors",
+                         g_variant_new_uint32 (totals->drives_with_bad_sectors));
+  g_variant_builder_add (&builder, "{sv}", "bad-sectors",
+                         g_variant_new_uint64 (totals->bad_sectors));
+  g_variant_builder_add (&builder, "{sv}", "temperature-threshold",
+                         g_variant_new_double (get_temperature_threshold (manager)));
+  udisks_manager_set_health_summary (UDISKS_MANAGER (manager), g_variant_builder_end (&builder));
+}
+
+/**
+ * udisks_linux_manager_update_drive_health:
+ * @manager: A #UDisksLinuxManager.
+ * @drive_object_path: The object path of a drive.
+ * @health: (allow-none): The health of the drive or %NULL if it has no SMART data.
+ *
+ * Updates the contribution of the drive at @drive_object_path to the
+ * #UDisksManager:health-summary property. The totals are adjusted by the
+ * difference to the previous contribution of the drive and the property
+ * is only changed if they did change, so this is cheap to call on every
+ * SMART update. Drives are dropped from the summary automatically when
+ * they are unexported.
+ *
+ * This may be called from any thread.
+ */
+void
+udisks_linux_manager_update_drive_health (UDisksLinuxManager           *manager,
+                                          const gchar                  *drive_object_path,
+                                          const UDisksLinuxDriveHealth *health)
+{
+  DriveHealthEntry *entry = NULL;
+  DriveHealthEntry *old_entry;
+
+  g_return_if_fail (UDISKS_IS_LINUX_MANAGER (manager));
+  g_return_if_fail (drive_object_path != NULL);
+
+  if (health != NULL)
+    {
+      entry = g_new0 (DriveHealthEntry, 1);
+      entry->failing = health->failing;
+      entry->attributes_failing = health->attributes_failing;
+      /* judged with the threshold in effect now, the entry must not
+       * change behind the totals' back when the configuration is reloaded
+       */
+      entry->over_temperature = health->temperature > get_temperature_threshold (manager);
+      entry->bad_sectors = health->num_bad_sectors;
+    }
+
+  g_mutex_lock (&manager->health_lock);
+  old_entry = g_hash_table_lookup (manager->drive_health, drive_object_path);
+  if (old_entry == NULL && entry == NULL)
+    goto out;
+  if (old_entry != NULL && entry != NULL && drive_health_entry_equal (old_entry, entry))
+    goto out;
+
+  if (old_entry != NULL)
+    {
+      health_totals_add (&manager->health_totals, old_entry, -1);
+      g_hash_table_remove (manager->drive_health, drive_object_path);
+    }
+  if (entry != NULL)
+    {
+      health_totals_add (&manager->health_totals, entry, 1);
+      g_hash_table_insert (manager->drive_health, g_strdup (drive_object_path), entry);
+      entry = NULL;
+    }
+  publish_health_summary (manager);
+
+ out:
+  g_mutex_unlock (&manager->health_lock);
+  g_free (entry);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 typedef struct
 {
   const gchar *loop_device;
@@ -310,6 +579,199 @@ wait_for_loop_object (UDisksDaemon *daemon,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Opens /dev/loop@number if it is not bound to a file, returns -1 otherwise */
+static gint
+open_free_loop_device (gint number)
+{
+  gchar loop_device[64];
+  struct loop_info64 info;
+  gint fd;
+
+  snprintf (loop_device, sizeof (loop_device), "/dev/loop%d", number);
+  fd = open (loop_device, O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  if (ioctl (fd, LOOP_GET_STATUS64, &info) == 0 || errno != ENXIO)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+static gboolean
+loop_pool_contains (UDisksLinuxManager *manager,
+                    gint                number)
+{
+  GList *l;
+
+  for (l = manager->loop_pool.head; l != NULL; l = l->next)
+    if (((LoopPoolEntry *) l->data)->number == number)
+      return TRUE;
+  return FALSE;
+}
+
+/* Tops up the pool with free loop devices, creating them if needed.
+ * LOOP_CTL_GET_FREE always returns the same device until it is bound,
+ * so the devices after it are tried as well.
+ *
+ * must be called with loop_pool_lock held
+ */
+static void
+loop_pool_refill (UDisksLinuxManager *manager)
+{
+  gint ctl_fd;
+  gint number;
+  guint attempts;
+
+  if (g_queue_get_length (&manager->loop_pool) >= LOOP_POOL_SIZE)
+    return;
+
+  ctl_fd = open ("/dev/loop-control", O_RDWR | O_CLOEXEC);
+  if (ctl_fd < 0)
+    {
+      udisks_warning ("Error opening /dev/loop-control: %m");
+      return;
+    }
+
+  number = ioctl (ctl_fd, LOOP_CTL_GET_FREE);
+  for (attempts = 0;
+       number >= 0 && attempts < 4 * LOOP_POOL_SIZE && g_queue_get_length (&manager->loop_pool) < LOOP_POOL_SIZE;
+       attempts++, number++)
+    {
+      LoopPoolEntry *entry;
+      gint fd;
+
+      if (attempts > 0 && ioctl (ctl_fd, LOOP_CTL_ADD, number) < 0 && errno != EEXIST)
+        break;
+
+      if (loop_pool_contains (manager, number))
+        continue;
+
+      fd = open_free_loop_device (number);
+      if (fd < 0)
+        continue;
+
+      entry = g_new0 (LoopPoolEntry, 1);
+      entry->number = number;
+      entry->fd = fd;
+      g_queue_push_tail (&manager->loop_pool, entry);
+    }
+
+  close (ctl_fd);
+}
+
+#ifdef LOOP_CONFIGURE
+/* The loop driver of kernels without LOOP_CONFIGURE fails unknown ioctls
+ * with EINVAL, which is also what LOOP_CONFIGURE fails with for a bad
+ * backing file. Kernels knowing LOOP_CONFIGURE look at the backing fd
+ * first, so a configuration without one tells them apart. */
+static gboolean
+loop_configure_probe (gint loop_fd)
+{
+  struct loop_config config;
+
+  memset (&config, 0, sizeof (config));
+  config.fd = -1;
+  if (ioctl (loop_fd, LOOP_CONFIGURE, &config) == 0)
+    return TRUE;
+  return errno != EINVAL && errno != ENOTTY;
+}
+#endif
+
+/* Sets up a loop device for @fd with a single LOOP_CONFIGURE ioctl on a
+ * device from the pool. Fails with G_IO_ERROR_NOT_SUPPORTED if the kernel
+ * doesn't know LOOP_CONFIGURE (before Linux 5.8) or if no free device could
+ * be taken from the pool, the caller has to fall back to setting up the
+ * device with libblockdev then.
+ */
+static gboolean
+loop_setup_configure (UDisksLinuxManager  *manager,
+                      gint                 fd,
+                      const gchar         *path,
+                      guint64              offset,
+                      guint64              size,
+                      gboolean             read_only,
+                      gboolean             part_scan,
+                      gboolean             direct_io,
+                      gchar              **out_loop_device,
+                      GError             **error)
+{
+#ifdef LOOP_CONFIGURE
+  struct loop_config config;
+  gboolean ret = FALSE;
+  guint attempt;
+
+  memset (&config, 0, sizeof (config));
+  config.fd = fd;
+  config.info.lo_offset = offset;
+  config.info.lo_sizelimit = size;
+  if (read_only)
+    config.info.lo_flags |= LO_FLAGS_READ_ONLY;
+  if (part_scan)
+    config.info.lo_flags |= LO_FLAGS_PARTSCAN;
+  if (direct_io)
+    config.info.lo_flags |= LO_FLAGS_DIRECT_IO;
+  g_strlcpy ((gchar *) config.info.lo_file_name, path, LO_NAME_SIZE);
+
+  g_mutex_lock (&manager->loop_pool_lock);
+  if (manager->loop_configure_unsupported)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "LOOP_CONFIGURE is not supported");
+      goto out;
+    }
+
+  /* a device from the pool may have been taken by someone else meanwhile */
+  for (attempt = 0; attempt < 4; attempt++)
+    {
+      LoopPoolEntry *entry;
+      gint errsv;
+
+      loop_pool_refill (manager);
+      entry = g_queue_pop_head (&manager->loop_pool);
+      if (entry == NULL)
+        break;
+
+      if (ioctl (entry->fd, LOOP_CONFIGURE, &config) == 0)
+        {
+          *out_loop_device = g_strdup_printf ("/dev/loop%d", entry->number);
+          loop_pool_entry_free (entry);
+          ret = TRUE;
+          goto out;
+        }
+      errsv = errno;
+
+      /* only latch for the kernel, not for a bad backing fd of one caller */
+      if (errsv == ENOTTY || (errsv == EINVAL && !loop_configure_probe (entry->fd)))
+        {
+          loop_pool_entry_free (entry);
+          manager->loop_configure_unsupported = TRUE;
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "LOOP_CONFIGURE is not supported");
+          goto out;
+        }
+      loop_pool_entry_free (entry);
+      if (errsv != EBUSY)
+        {
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                       "Error setting up loop device: %s", g_strerror (errsv));
+          goto out;
+        }
+    }
+
+  /* the pool couldn't be refilled or its devices kept being taken */
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "No free loop device found for LOOP_CONFIGURE");
+
+ out:
+  g_mutex_unlock (&manager->loop_pool_lock);
+  return ret;
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "LOOP_CONFIGURE is not supported");
+  return FALSE;
+#endif
+}
+
 /* runs in thread dedicated to handling @invocation */
 static gboolean
 handle_loop_setup (UDisksManager          *object,
@@ -330,6 +792,7 @@ handle_loop_setup (UDisksManager          *object,
   UDisksObject *loop_object = NULL;
   gboolean option_read_only = FALSE;
   gboolean option_no_part_scan = FALSE;
+  gboolean option_direct_io = FALSE;
   guint64 option_offset = 0;
   guint64 option_size = 0;
   uid_t caller_uid;
@@ -394,6 +857,7 @@ handle_loop_setup (UDisksManager          *object,
   g_variant_lookup (options, "offset", "t", &option_offset);
   g_variant_lookup (options, "size", "t", &option_size);
   g_variant_lookup (options, "no-part-scan", "b", &option_no_part_scan);
+  g_variant_lookup (options, "direct-io", "b", &option_direct_io);
 
   /* it's not a problem if fstat fails... for example, this can happen if the user
    * passes a fd to a file on the GVfs fuse mount
@@ -402,20 +866,51 @@ handle_loop_setup (UDisksManager          *object,
     fd_statbuf_valid = TRUE;
 
   error = NULL;
-  if (!bd_loop_setup_from_fd (fd,
-                              option_offset,
-                              option_size,
-                              option_read_only,
-                              !option_no_part_scan,
-                              &loop_name,
-                              &error))
-    {
-      g_prefix_error (&error, "Error creating loop device: ");
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+  if (!loop_setup_configure (manager,
+                             fd,
+                             path,
+                             option_offset,
+                             option_size,
+                             option_read_only,
+                             !option_no_part_scan,
+                             option_direct_io,
+                             &loop_device,
+                             &error))
+    {
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+          g_prefix_error (&error, "Error creating loop device: ");
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      g_clear_error (&error);
+
+      if (!bd_loop_setup_from_fd (fd,
+                                  option_offset,
+                                  option_size,
+                                  option_read_only,
+                                  !option_no_part_scan,
+                                  &loop_name,
+                                  &error))
+        {
+          g_prefix_error (&error, "Error creating loop device: ");
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
 
-  loop_device = g_strdup_printf ("/dev/%s", loop_name);
+      loop_device = g_strdup_printf ("/dev/%s", loop_name);
+
+      if (option_direct_io)
+        {
+          gint loop_fd;
+
+          loop_fd = open (loop_device, O_RDONLY | O_CLOEXEC);
+          if (loop_fd < 0 || ioctl (loop_fd, LOOP_SET_DIRECT_IO, 1) < 0)
+            udisks_warning ("Error enabling direct I/O on %s: %m", loop_device);
+          if (loop_fd >= 0)
+            close (loop_fd);
+        }
+    }
 
   /* Update the udisks loop state file (/run/udisks2/loop) with information
    * about the new loop device created by us.
@@ -435,6 +930,7 @@ handle_loop_setup (UDisksManager          *object,
                                                     &wait_data,
                                                     NULL,
                                                     10, /* timeout_seconds */
+                                                    udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                     &error);
   if (loop_object == NULL)
     {
@@ -454,6 +950,12 @@ handle_loop_setup (UDisksManager          *object,
                                       NULL, /* fd_list */
                                       g_dbus_object_get_object_path (G_DBUS_OBJECT (loop_object)));
 
+  /* have a free device ready for the next call */
+  g_mutex_lock (&manager->loop_pool_lock);
+  if (!manager->loop_configure_unsupported)
+    loop_pool_refill (manager);
+  g_mutex_unlock (&manager->loop_pool_lock);
+
  out:
   if (loop_object != NULL)
     g_object_unref (loop_object);
@@ -505,6 +1007,87 @@ wait_for_array_object (UDisksDaemon *daemon,
 
 static const gchar *raid_level_whitelist[] = {"raid0", "raid1", "raid4", "raid5", "raid6", "raid10", NULL};
 
+/* the maximum number of members checked or wiped at the same time */
+#define MDRAID_CREATE_MAX_PARALLEL 16
+
+typedef struct
+{
+  UDisksBlock *block;
+  gchar       *device_file;
+  GError      *error;
+} MDRaidMember;
+
+/* runs in a thread of the pool of mdraid_members_run() */
+static void
+mdraid_member_check_func (gpointer data,
+                          gpointer user_data)
+{
+  MDRaidMember *member = data;
+  int fd;
+
+  /* check we can open the device exclusively, i.e. that it's not in use */
+  fd = open (member->device_file, O_RDWR | O_EXCL);
+  if (fd < 0)
+    {
+      g_set_error (&member->error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening device %s while creating mdraid: %m",
+                   member->device_file);
+      return;
+    }
+  close (fd);
+}
+
+/* runs in a thread of the pool of mdraid_members_run() */
+static void
+mdraid_member_wipe_func (gpointer data,
+                         gpointer user_data)
+{
+  MDRaidMember *member = data;
+
+  if (!bd_fs_wipe (member->device_file, TRUE, &member->error))
+    {
+      /* no signature to remove, ignore */
+      if (g_error_matches (member->error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
+        g_clear_error (&member->error);
+      else
+        g_prefix_error (&member->error,
+                        "Error wiping device '%s' to be used in the RAID array: ",
+                        member->device_file);
+    }
+}
+
+/* Runs @func for all the @members in parallel and waits for all of them,
+ * returning the error of the first failed member in the order of @members.
+ */
+static gboolean
+mdraid_members_run (GFunc          func,
+                    MDRaidMember  *members,
+                    guint          num_members,
+                    GError       **error)
+{
+  GThreadPool *pool;
+  guint n;
+
+  pool = g_thread_pool_new (func, NULL, MIN (num_members, MDRAID_CREATE_MAX_PARALLEL), FALSE, NULL);
+  for (n = 0; n < num_members; n++)
+    g_thread_pool_push (pool, &members[n], NULL);
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  for (n = 0; n < num_members; n++)
+    {
+      if (members[n].error != NULL)
+        {
+          g_propagate_error (error, members[n].error);
+          members[n].error = NULL;
+          break;
+        }
+    }
+  for (; n < num_members; n++)
+    g_clear_error (&members[n].error);
+
+  return error == NULL || *error == NULL;
+}
+
 static gboolean
 handle_mdraid_create (UDisksManager         *_object,
                       GDBusMethodInvocation *invocation,
@@ -531,7 +1114,11 @@ handle_mdraid_create (UDisksManager         *_object,
   dev_t raid_device_num;
   UDisksBaseJob *job = NULL;
   const gchar **disks = NULL;
-  guint disks_top = 0;
+  MDRaidMember *members = NULL;
+  guint64 bitmap_chunk = 0;
+  gboolean assume_clean = FALSE;
+  BDExtraArg *extra[3] = {NULL, NULL, NULL};
+  gint extra_top = -1;
   gboolean success = FALSE;
 
   if (!udisks_daemon_util_get_caller_uid_sync (manager->daemon,
@@ -619,6 +1206,28 @@ handle_mdraid_create (UDisksManager         *_object,
       goto out;
     }
 
+  /* validate the write-intent bitmap chunk */
+  g_variant_lookup (arg_options, "bitmap-chunk", "t", &bitmap_chunk);
+  if (bitmap_chunk != 0)
+    {
+      if (g_strcmp0 (arg_level, "raid0") == 0)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                                 "Level 'raid0' has no write-intent bitmap");
+          success = FALSE;
+          goto out;
+        }
+      if (bitmap_chunk < 4096 || (bitmap_chunk & (bitmap_chunk - 1)) != 0)
+        {
+          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                                 "Bitmap chunk %" G_GUINT64_FORMAT " is not a power of 2 of at least 4KiB",
+                                                 bitmap_chunk);
+          success = FALSE;
+          goto out;
+        }
+    }
+  g_variant_lookup (arg_options, "assume-clean", "b", &assume_clean);
+
   num_devices = g_strv_length ((gchar **) arg_blocks);
 
   /* validate number of devices */
@@ -636,12 +1245,11 @@ handle_mdraid_create (UDisksManager         *_object,
    * is to avoid start deleting half the block devices while the other
    * half is already in use.
    */
-  for (n = 0; arg_blocks != NULL && arg_blocks[n] != NULL; n++)
+  members = g_new0 (MDRaidMember, num_devices);
+  for (n = 0; n < num_devices; n++)
     {
       UDisksObject *object = NULL;
       UDisksBlock *block = NULL;
-      gchar *device_file = NULL;
-      int fd;
 
       object = udisks_daemon_find_object (manager->daemon, arg_blocks[n]);
       if (object == NULL)
@@ -668,48 +1276,22 @@ handle_mdraid_create (UDisksManager         *_object,
           goto out;
         }
 
-      device_file = udisks_block_dup_device (block);
-      fd = open (device_file, O_RDWR | O_EXCL);
-      if (fd < 0)
-        {
-          g_dbus_method_invocation_return_error (invocation,
-                                                 UDISKS_ERROR,
-                                                 UDISKS_ERROR_FAILED,
-                                                 "Error opening device %s while creating mdraid: %m",
-                                                 device_file);
-          g_free (device_file);
-          g_object_unref (block);
-          g_object_unref (object);
-          success = FALSE;
-          goto out;
-        }
-      close (fd);
-      g_free (device_file);
-
-      blocks = g_list_prepend (blocks, block); /* adopts ownership */
+      members[n].block = block; /* adopts ownership */
+      members[n].device_file = udisks_block_dup_device (block);
+      blocks = g_list_prepend (blocks, g_object_ref (block));
       g_object_unref (object);
     }
   blocks = g_list_reverse (blocks);
 
-  /* wipe existing devices */
-  for (l = blocks; l != NULL; l = l->next)
+  /* the checks and wipes are independent per member so for big arrays,
+   * do them in parallel rather than one after the other
+   */
+  if (!mdraid_members_run (mdraid_member_check_func, members, num_devices, &error) ||
+      !mdraid_members_run (mdraid_member_wipe_func, members, num_devices, &error))
     {
-      UDisksBlock *block = UDISKS_BLOCK (l->data);
-      if (!bd_fs_wipe (udisks_block_get_device (block), TRUE, &error))
-        {
-          /* no signature to remove, ignore */
-          if (g_error_matches (error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
-            g_clear_error (&error);
-          else
-            {
-              g_prefix_error (&error,
-                              "Error wiping device '%s' to be used in the RAID array: ",
-                              udisks_block_get_device (block));
-              g_dbus_method_invocation_take_error (invocation, error);
-              success = FALSE;
-              goto out;
-            }
-        }
+      g_dbus_method_invocation_take_error (invocation, error);
+      success = FALSE;
+      goto out;
     }
 
   /* we have name from the user */
@@ -729,15 +1311,22 @@ handle_mdraid_create (UDisksManager         *_object,
     }
 
   /* names of members as gchar** for libblockdev */
-  disks = g_new0 (const gchar*, g_list_length (blocks) + 1);
-  for (l = blocks; l != NULL; l = l->next)
+  disks = g_new0 (const gchar*, num_devices + 1);
+  for (n = 0; n < num_devices; n++)
+    disks[n] = members[n].device_file;
+
+  if (bitmap_chunk != 0)
     {
-      UDisksBlock *block = UDISKS_BLOCK (l->data);
-      disks[disks_top++] = udisks_block_dup_device (block);
+      gchar *value = g_strdup_printf ("%" G_GUINT64_FORMAT "K", bitmap_chunk / 1024);
+      extra[++extra_top] = bd_extra_arg_new ("--bitmap-chunk", value);
+      g_free (value);
     }
-  disks[disks_top] = NULL;
+  /* skip the initial resync, the caller guarantees the members are zeroed */
+  if (assume_clean)
+    extra[++extra_top] = bd_extra_arg_new ("--assume-clean", "");
 
-  if (!bd_md_create (array_name, arg_level, disks, 0, NULL, FALSE, arg_chunk, NULL, &error))
+  if (!bd_md_create (array_name, arg_level, disks, 0, NULL, bitmap_chunk != 0, arg_chunk,
+                     (const BDExtraArg **) extra, &error))
     {
       g_prefix_error (&error, "Error creating RAID array: ");
       g_dbus_method_invocation_take_error (invocation, error);
@@ -769,6 +1358,7 @@ handle_mdraid_create (UDisksManager         *_object,
                                                      raid_device_file,
                                                      NULL,
                                                      10, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                      &error);
   if (array_object == NULL)
     {
@@ -856,7 +1446,18 @@ handle_mdraid_create (UDisksManager         *_object,
       udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), success, NULL);
     }
 
-  g_strfreev ((gchar **) disks);
+  g_free (disks);
+  if (members != NULL)
+    {
+      for (n = 0; n < num_devices; n++)
+        {
+          g_clear_object (&members[n].block);
+          g_free (members[n].device_file);
+        }
+      g_free (members);
+    }
+  for (; extra_top >= 0; extra_top--)
+    bd_extra_arg_free (extra[extra_top]);
   g_free (raid_device_file);
   g_free (raid_node);
   g_free (array_name);
@@ -904,23 +1505,61 @@ handle_enable_modules (UDisksManager *object,
 }
 
 static gboolean
-handle_can_format (UDisksManager         *object,
-                   GDBusMethodInvocation *invocation,
-                   const gchar           *type)
+handle_enable_module (UDisksManager         *object,
+                      GDBusMethodInvocation *invocation,
+                      const gchar           *arg_name,
+                      gboolean               arg_enable)
 {
-  gchar *required_utility = NULL;
-  gchar *binary_path = NULL;
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
 
-  if (g_strcmp0 (type, "swap") == 0)
-    required_utility = g_strdup ("mkswap");
-  else if (g_strcmp0 (type, "empty") == 0)
-    required_utility = g_strdup ("wipefs");
-  else
+  if (! arg_enable)
     {
-      const gchar **supported_fs = get_supported_filesystems ();
-      for (gsize i = 0; supported_fs[i] != NULL; i++)
-        {
-          if (g_strcmp0 (type, supported_fs[i]) == 0)
+      /* TODO: implement proper module unloading */
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                                     "Invalid value \"FALSE\"");
+      return TRUE;
+    }
+
+  if (udisks_daemon_get_disable_modules (manager->daemon))
+    {
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                                                     "Modules are disabled");
+      return TRUE;
+    }
+
+  if (! udisks_module_manager_load_module (udisks_daemon_get_module_manager (manager->daemon), arg_name))
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                             "Module %s is not available", arg_name);
+      return TRUE;
+    }
+
+  udisks_manager_complete_enable_module (object, invocation);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+static gboolean
+handle_can_format (UDisksManager         *object,
+                   GDBusMethodInvocation *invocation,
+                   const gchar           *type)
+{
+  gchar *required_utility = NULL;
+  gchar *binary_path = NULL;
+
+  if (g_strcmp0 (type, "swap") == 0)
+    required_utility = g_strdup ("mkswap");
+  else if (g_strcmp0 (type, "empty") == 0)
+    required_utility = g_strdup ("wipefs");
+  else
+    {
+      const gchar **supported_fs = get_supported_filesystems ();
+      for (gsize i = 0; supported_fs[i] != NULL; i++)
+        {
+          if (g_strcmp0 (type, supported_fs[i]) == 0)
             {
             required_utility = g_strconcat ("mkfs.", type, NULL);
             break;
@@ -1173,6 +1812,789 @@ handle_resolve_device (UDisksManager         *object,
   return TRUE;  /* returning TRUE means that we handled the method invocation */
 }
 
+/* Adds the {oa{sa{sv}}} entry for @dbus_object to @builder. @projection
+ * maps the names of the interfaces to include to a set of the property
+ * names to include, or to %NULL for all properties. A %NULL
+ * @projection includes everything.
+ */
+static void
+add_object_properties (GVariantBuilder *builder,
+                       GDBusObject     *dbus_object,
+                       GHashTable      *projection)
+{
+  GList *interfaces, *l;
+
+  g_variant_builder_open (builder, G_VARIANT_TYPE ("{oa{sa{sv}}}"));
+  g_variant_builder_add (builder, "o", g_dbus_object_get_object_path (dbus_object));
+  g_variant_builder_open (builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  interfaces = g_dbus_object_get_interfaces (dbus_object);
+  for (l = interfaces; l != NULL; l = l->next)
+    {
+      GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (l->data);
+      const gchar *interface_name;
+      GHashTable *property_names = NULL;
+      GVariant *properties;
+
+      interface_name = g_dbus_interface_skeleton_get_info (skeleton)->name;
+      if (projection != NULL &&
+          !g_hash_table_lookup_extended (projection, interface_name, NULL, (gpointer *) &property_names))
+        continue;
+
+      properties = g_dbus_interface_skeleton_get_properties (skeleton);
+      if (property_names != NULL)
+        {
+          GVariantBuilder props_builder;
+          GVariantIter iter;
+          const gchar *property_name;
+          GVariant *value;
+
+          g_variant_builder_init (&props_builder, G_VARIANT_TYPE_VARDICT);
+          g_variant_iter_init (&iter, properties);
+          while (g_variant_iter_next (&iter, "{&sv}", &property_name, &value))
+            {
+              if (g_hash_table_contains (property_names, property_name))
+                g_variant_builder_add (&props_builder, "{sv}", property_name, value);
+              g_variant_unref (value);
+            }
+          g_variant_unref (properties);
+          properties = g_variant_builder_end (&props_builder);
+        }
+
+      g_variant_builder_add (builder, "{s@a{sv}}", interface_name, properties);
+    }
+  g_list_free_full (interfaces, g_object_unref);
+
+  g_variant_builder_close (builder);
+  g_variant_builder_close (builder);
+}
+
+static gboolean
+handle_get_objects (UDisksManager         *object,
+                    GDBusMethodInvocation *invocation,
+                    const gchar *const    *arg_objects,
+                    const gchar *const    *arg_interfaces,
+                    GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GDBusObjectManager *object_manager;
+  GHashTable *projection = NULL;
+  GVariantBuilder builder;
+  guint n;
+
+  object_manager = G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (manager->daemon));
+
+  if (arg_interfaces != NULL && arg_interfaces[0] != NULL)
+    {
+      projection = g_hash_table_new (g_str_hash, g_str_equal);
+      for (n = 0; arg_interfaces[n] != NULL; n++)
+        g_hash_table_insert (projection, (gpointer) arg_interfaces[n], NULL);
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
+  for (n = 0; arg_objects != NULL && arg_objects[n] != NULL; n++)
+    {
+      GDBusObject *dbus_object;
+
+      dbus_object = g_dbus_object_manager_get_object (object_manager, arg_objects[n]);
+      if (dbus_object == NULL)
+        continue;
+
+      add_object_properties (&builder, dbus_object, projection);
+      g_object_unref (dbus_object);
+    }
+
+  udisks_manager_complete_get_objects (object,
+                                       invocation,
+                                       g_variant_builder_end (&builder));
+
+  if (projection != NULL)
+    g_hash_table_unref (projection);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+typedef struct
+{
+  const gchar *interface;
+  const gchar *id_type;
+  const gchar *id_usage;
+  const gchar *drive_serial;
+  gboolean has_size_min;
+  guint64 size_min;
+  gboolean has_size_max;
+  guint64 size_max;
+  gboolean has_mounted;
+  gboolean mounted;
+} QueryFilter;
+
+static gboolean
+query_filter_parse (GVariant     *arg_filter,
+                    QueryFilter  *filter,
+                    GError      **error)
+{
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+  gboolean ret = TRUE;
+
+  memset (filter, 0, sizeof (QueryFilter));
+
+  g_variant_iter_init (&iter, arg_filter);
+  while (ret && g_variant_iter_next (&iter, "{&sv}", &key, &value))
+    {
+      const GVariantType *expected_type = NULL;
+
+      if (g_strcmp0 (key, "interface") == 0 || g_strcmp0 (key, "id-type") == 0 ||
+          g_strcmp0 (key, "id-usage") == 0 || g_strcmp0 (key, "drive-serial") == 0)
+        expected_type = G_VARIANT_TYPE_STRING;
+      else if (g_strcmp0 (key, "size-min") == 0 || g_strcmp0 (key, "size-max") == 0)
+        expected_type = G_VARIANT_TYPE_UINT64;
+      else if (g_strcmp0 (key, "mounted") == 0)
+        expected_type = G_VARIANT_TYPE_BOOLEAN;
+
+      if (expected_type == NULL)
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Unknown filter key `%s'", key);
+          ret = FALSE;
+        }
+      else if (!g_variant_is_of_type (value, expected_type))
+        {
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Filter key `%s' has the wrong type `%s'", key, g_variant_get_type_string (value));
+          ret = FALSE;
+        }
+      else if (g_strcmp0 (key, "interface") == 0)
+        filter->interface = g_variant_get_string (value, NULL);
+      else if (g_strcmp0 (key, "id-type") == 0)
+        filter->id_type = g_variant_get_string (value, NULL);
+      else if (g_strcmp0 (key, "id-usage") == 0)
+        filter->id_usage = g_variant_get_string (value, NULL);
+      else if (g_strcmp0 (key, "drive-serial") == 0)
+        filter->drive_serial = g_variant_get_string (value, NULL);
+      else if (g_strcmp0 (key, "size-min") == 0)
+        {
+          filter->has_size_min = TRUE;
+          filter->size_min = g_variant_get_uint64 (value);
+        }
+      else if (g_strcmp0 (key, "size-max") == 0)
+        {
+          filter->has_size_max = TRUE;
+          filter->size_max = g_variant_get_uint64 (value);
+        }
+      else
+        {
+          filter->has_mounted = TRUE;
+          filter->mounted = g_variant_get_boolean (value);
+        }
+
+      /* the strings point into @arg_filter which outlives @filter */
+      g_variant_unref (value);
+    }
+
+  return ret;
+}
+
+static gboolean
+query_filter_matches (UDisksLinuxManager *manager,
+                      QueryFilter        *filter,
+                      UDisksObject       *object)
+{
+  UDisksBlock *block = udisks_object_peek_block (object);
+  UDisksDrive *drive = udisks_object_peek_drive (object);
+
+  if (filter->interface != NULL)
+    {
+      GDBusInterface *iface;
+
+      iface = g_dbus_object_get_interface (G_DBUS_OBJECT (object), filter->interface);
+      if (iface == NULL)
+        return FALSE;
+      g_object_unref (iface);
+    }
+
+  if (filter->id_type != NULL &&
+      (block == NULL || g_strcmp0 (udisks_block_get_id_type (block), filter->id_type) != 0))
+    return FALSE;
+
+  if (filter->id_usage != NULL &&
+      (block == NULL || g_strcmp0 (udisks_block_get_id_usage (block), filter->id_usage) != 0))
+    return FALSE;
+
+  if (filter->drive_serial != NULL)
+    {
+      const gchar *serial = NULL;
+
+      if (drive != NULL)
+        {
+          serial = udisks_drive_get_serial (drive);
+        }
+      else if (block != NULL)
+        {
+          UDisksObject *drive_object;
+
+          drive_object = udisks_daemon_find_object (manager->daemon, udisks_block_get_drive (block));
+          if (drive_object != NULL)
+            {
+              UDisksDrive *block_drive = udisks_object_peek_drive (drive_object);
+              /* still referenced by the object manager after the unref */
+              if (block_drive != NULL)
+                serial = udisks_drive_get_serial (block_drive);
+              g_object_unref (drive_object);
+            }
+        }
+      if (serial == NULL || g_strcmp0 (serial, filter->drive_serial) != 0)
+        return FALSE;
+    }
+
+  if (filter->has_size_min || filter->has_size_max)
+    {
+      guint64 size;
+
+      if (block != NULL)
+        size = udisks_block_get_size (block);
+      else if (drive != NULL)
+        size = udisks_drive_get_size (drive);
+      else
+        return FALSE;
+
+      if (filter->has_size_min && size < filter->size_min)
+        return FALSE;
+      if (filter->has_size_max && size > filter->size_max)
+        return FALSE;
+    }
+
+  if (filter->has_mounted)
+    {
+      UDisksFilesystem *filesystem = udisks_object_peek_filesystem (object);
+      const gchar *const *mount_points = NULL;
+      gboolean is_mounted;
+
+      if (filesystem != NULL)
+        mount_points = udisks_filesystem_get_mount_points (filesystem);
+      is_mounted = mount_points != NULL && mount_points[0] != NULL;
+      if (is_mounted != filter->mounted)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+property_names_free (GHashTable *property_names)
+{
+  if (property_names != NULL)
+    g_hash_table_unref (property_names);
+}
+
+static gboolean
+handle_query_objects (UDisksManager         *object,
+                      GDBusMethodInvocation *invocation,
+                      GVariant              *arg_filter,
+                      GVariant              *arg_projection,
+                      GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  QueryFilter filter;
+  GHashTable *projection = NULL;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  const gchar *interface_name;
+  GVariant *property_names;
+  GList *objects = NULL;
+  GList *l;
+  GError *error = NULL;
+
+  if (!query_filter_parse (arg_filter, &filter, &error))
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  if (g_variant_n_children (arg_projection) > 0)
+    {
+      projection = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                          (GDestroyNotify) property_names_free);
+      g_variant_iter_init (&iter, arg_projection);
+      while (g_variant_iter_next (&iter, "{&s@as}", &interface_name, &property_names))
+        {
+          GHashTable *names = NULL;
+          GVariantIter names_iter;
+          const gchar *name;
+
+          if (g_variant_n_children (property_names) > 0)
+            {
+              names = g_hash_table_new (g_str_hash, g_str_equal);
+              g_variant_iter_init (&names_iter, property_names);
+              while (g_variant_iter_next (&names_iter, "&s", &name))
+                g_hash_table_add (names, (gpointer) name);
+            }
+          g_hash_table_insert (projection, (gpointer) interface_name, names);
+          /* the names point into @arg_projection */
+          g_variant_unref (property_names);
+        }
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
+  objects = udisks_daemon_get_objects (manager->daemon);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *dbus_object = UDISKS_OBJECT (l->data);
+
+      if (query_filter_matches (manager, &filter, dbus_object))
+        add_object_properties (&builder, G_DBUS_OBJECT (dbus_object), projection);
+    }
+
+  udisks_manager_complete_query_objects (object,
+                                         invocation,
+                                         g_variant_builder_end (&builder));
+
+ out:
+  g_list_free_full (objects, g_object_unref);
+  if (projection != NULL)
+    g_hash_table_unref (projection);
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+emit_jobs_changed (gpointer user_data)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (user_data);
+  GPtrArray *events;
+  GVariantBuilder builder;
+  guint n;
+
+  g_mutex_lock (&manager->jobs_lock);
+  events = manager->pending_job_events;
+  manager->pending_job_events = g_ptr_array_new_with_free_func ((GDestroyNotify) job_event_free);
+  g_hash_table_remove_all (manager->pending_job_progress);
+  manager->jobs_changed_source_id = 0;
+  g_mutex_unlock (&manager->jobs_lock);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(osa{sv})"));
+  for (n = 0; n < events->len; n++)
+    {
+      JobEvent *event = g_ptr_array_index (events, n);
+      g_variant_builder_add (&builder, "(os@a{sv})", event->object_path, event->event, event->details);
+    }
+  if (events->len > 0)
+    udisks_manager_emit_jobs_changed (UDISKS_MANAGER (manager), g_variant_builder_end (&builder));
+  else
+    g_variant_builder_clear (&builder);
+
+  g_ptr_array_unref (events);
+  return G_SOURCE_REMOVE;
+}
+
+/* Queues @event of @job for the next JobsChanged signal, with @extra_details
+ * (a floating GVariant of type a{sv} or %NULL) added to the common details */
+static void
+queue_job_event (UDisksLinuxManager *manager,
+                 UDisksJob          *job,
+                 const gchar        *event_name,
+                 GVariant           *extra_details)
+{
+  GDBusObject *object;
+  static const gchar *const no_objects[] = { NULL };
+  JobEvent *event;
+  GVariantBuilder builder;
+  const gchar *const *objects;
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *value;
+
+  object = g_dbus_interface_get_object (G_DBUS_INTERFACE (job));
+
+  g_mutex_lock (&manager->jobs_lock);
+  /* nobody is interested */
+  if (object == NULL || g_hash_table_size (manager->job_watchers) == 0)
+    {
+      g_mutex_unlock (&manager->jobs_lock);
+      if (extra_details != NULL)
+        g_variant_unref (g_variant_ref_sink (extra_details));
+      return;
+    }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "operation",
+                         g_variant_new_string (udisks_job_get_operation (job)));
+  objects = udisks_job_get_objects (job);
+  g_variant_builder_add (&builder, "{sv}", "objects",
+                         g_variant_new_objv (objects != NULL ? objects : no_objects, -1));
+  g_variant_builder_add (&builder, "{sv}", "started-by-uid",
+                         g_variant_new_uint32 (udisks_job_get_started_by_uid (job)));
+  if (extra_details != NULL)
+    {
+      g_variant_iter_init (&iter, extra_details);
+      while (g_variant_iter_next (&iter, "{&sv}", &key, &value))
+        {
+          g_variant_builder_add (&builder, "{sv}", key, value);
+          g_variant_unref (value);
+        }
+      g_variant_unref (g_variant_ref_sink (extra_details));
+    }
+
+  /* only the latest progress of a job is of interest */
+  event = NULL;
+  if (g_strcmp0 (event_name, "progress") == 0)
+    event = g_hash_table_lookup (manager->pending_job_progress, g_dbus_object_get_object_path (object));
+  if (event != NULL)
+    {
+      g_variant_unref (event->details);
+    }
+  else
+    {
+      event = g_new0 (JobEvent, 1);
+      event->object_path = g_strdup (g_dbus_object_get_object_path (object));
+      event->event = event_name;
+      g_ptr_array_add (manager->pending_job_events, event);
+      if (g_strcmp0 (event_name, "progress") == 0)
+        g_hash_table_insert (manager->pending_job_progress, event->object_path, event);
+      else
+        g_hash_table_remove (manager->pending_job_progress, event->object_path);
+    }
+  event->details = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (manager->jobs_changed_source_id == 0)
+    manager->jobs_changed_source_id = g_timeout_add (JOBS_CHANGED_INTERVAL_MSEC, emit_jobs_changed, manager);
+  g_mutex_unlock (&manager->jobs_lock);
+}
+
+static void
+on_job_notify_progress (GObject    *job,
+                        GParamSpec *pspec,
+                        gpointer    user_data)
+{
+  GVariantBuilder builder;
+
+  if (!udisks_job_get_progress_valid (UDISKS_JOB (job)))
+    return;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "progress",
+                         g_variant_new_double (udisks_job_get_progress (UDISKS_JOB (job))));
+  queue_job_event (UDISKS_LINUX_MANAGER (user_data), UDISKS_JOB (job), "progress", g_variant_builder_end (&builder));
+}
+
+static void
+on_job_completed (UDisksJob   *job,
+                  gboolean     success,
+                  const gchar *message,
+                  gpointer     user_data)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "success", g_variant_new_boolean (success));
+  g_variant_builder_add (&builder, "{sv}", "message", g_variant_new_string (message != NULL ? message : ""));
+  queue_job_event (UDISKS_LINUX_MANAGER (user_data), job, "completed", g_variant_builder_end (&builder));
+}
+
+static void
+on_object_added (GDBusObjectManager *object_manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (user_data);
+  UDisksJob *job;
+
+  job = udisks_object_peek_job (UDISKS_OBJECT (object));
+  if (job == NULL)
+    return;
+
+  /* connected before the daemon's handler unexporting the job */
+  g_signal_connect_object (job, "notify::progress", G_CALLBACK (on_job_notify_progress), manager, 0);
+  g_signal_connect_object (job, "completed", G_CALLBACK (on_job_completed), manager, 0);
+  queue_job_event (manager, job, "started", NULL);
+}
+
+static void
+on_object_removed (GDBusObjectManager *object_manager,
+                   GDBusObject        *object,
+                   gpointer            user_data)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (user_data);
+
+  if (udisks_object_peek_drive (UDISKS_OBJECT (object)) == NULL)
+    return;
+
+  udisks_linux_manager_update_drive_health (manager, g_dbus_object_get_object_path (object), NULL);
+}
+
+static void
+on_interface_removed (GDBusObjectManager *object_manager,
+                      GDBusObject        *object,
+                      GDBusInterface     *interface,
+                      gpointer            user_data)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (user_data);
+
+  if (!UDISKS_IS_DRIVE_ATA (interface) && !UDISKS_IS_DRIVE_NVME (interface))
+    return;
+
+  udisks_linux_manager_update_drive_health (manager, g_dbus_object_get_object_path (object), NULL);
+}
+
+/* no reference to the manager, the watchers are removed when it's finalized */
+typedef struct
+{
+  UDisksLinuxManager *manager;
+  gchar *name;
+} JobWatcher;
+
+static void
+job_watcher_free (JobWatcher *watcher)
+{
+  g_free (watcher->name);
+  g_free (watcher);
+}
+
+static void
+on_job_watcher_vanished (GDBusConnection *connection,
+                         const gchar     *name,
+                         gpointer         user_data)
+{
+  JobWatcher *watcher = user_data;
+  UDisksLinuxManager *manager = watcher->manager;
+
+  g_mutex_lock (&manager->jobs_lock);
+  g_hash_table_remove (manager->job_watchers, watcher->name);
+  g_mutex_unlock (&manager->jobs_lock);
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_mount_filesystems (UDisksManager         *object,
+                          GDBusMethodInvocation *invocation,
+                          GVariant              *arg_filesystems,
+                          GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_filesystem_mount_many (manager->daemon, invocation,
+                                                arg_filesystems, arg_options, &error);
+  if (results == NULL)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    udisks_manager_complete_mount_filesystems (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_unmount_filesystems (UDisksManager         *object,
+                            GDBusMethodInvocation *invocation,
+                            GVariant              *arg_filesystems,
+                            GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_filesystem_unmount_many (manager->daemon, invocation,
+                                                  arg_filesystems, arg_options, &error);
+  if (results == NULL)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    udisks_manager_complete_unmount_filesystems (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_unlock_encrypted (UDisksManager         *object,
+                         GDBusMethodInvocation *invocation,
+                         GVariant              *arg_devices,
+                         GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_encrypted_unlock_many (manager->daemon, invocation,
+                                                arg_devices, arg_options, &error);
+  if (results == NULL)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    udisks_manager_complete_unlock_encrypted (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_power_off_drives (UDisksManager         *object,
+                         GDBusMethodInvocation *invocation,
+                         const gchar *const    *arg_drives,
+                         GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_drive_power_off_many (manager->daemon, invocation,
+                                               arg_drives, arg_options, &error);
+  if (results == NULL)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    udisks_manager_complete_power_off_drives (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_secure_erase_drives (UDisksManager         *object,
+                            GDBusMethodInvocation *invocation,
+                            const gchar *const    *arg_drives,
+                            GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_drive_secure_erase_many (manager->daemon, invocation,
+                                                  arg_drives, arg_options, &error);
+  if (results == NULL)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    udisks_manager_complete_secure_erase_drives (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_format_devices (UDisksManager         *object,
+                       GDBusMethodInvocation *invocation,
+                       GVariant              *arg_devices,
+                       GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+  GError *error = NULL;
+
+  results = udisks_linux_block_format_many (manager->daemon, invocation,
+                                            arg_devices, arg_options, &error);
+  if (results == NULL)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    udisks_manager_complete_format_devices (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_start_swapspaces (UDisksManager         *object,
+                         GDBusMethodInvocation *invocation,
+                         GVariant              *arg_swapspaces,
+                         GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  GVariant *results;
+
+  results = udisks_linux_swapspace_start_many (manager->daemon, invocation,
+                                               arg_swapspaces, arg_options);
+  udisks_manager_complete_start_swapspaces (object, invocation, results);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+static gboolean
+handle_watch_jobs (UDisksManager         *object,
+                   GDBusMethodInvocation *invocation,
+                   GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+  const gchar *sender = g_dbus_method_invocation_get_sender (invocation);
+  JobWatcher *watcher;
+  guint watcher_id;
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  g_mutex_lock (&manager->jobs_lock);
+  if (!g_hash_table_contains (manager->job_watchers, sender))
+    {
+      watcher = g_new0 (JobWatcher, 1);
+      watcher->manager = manager;
+      watcher->name = g_strdup (sender);
+      /* the method handler threads don't have a thread-default main context
+       * so the callback is invoked in the main loop of the daemon */
+      watcher_id = g_bus_watch_name_on_connection (g_dbus_method_invocation_get_connection (invocation),
+                                                   sender,
+                                                   G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                   NULL, /* name_appeared_handler */
+                                                   on_job_watcher_vanished,
+                                                   watcher,
+                                                   (GDestroyNotify) job_watcher_free);
+      g_hash_table_insert (manager->job_watchers, g_strdup (sender), GUINT_TO_POINTER (watcher_id));
+    }
+  g_mutex_unlock (&manager->jobs_lock);
+
+  udisks_manager_complete_watch_jobs (object, invocation);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+static gboolean
+handle_unwatch_jobs (UDisksManager         *object,
+                     GDBusMethodInvocation *invocation,
+                     GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+
+  /* there are no bus names to watch on peer-to-peer connections */
+  if (g_dbus_method_invocation_get_sender (invocation) == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR,
+                                             G_DBUS_ERROR_NOT_SUPPORTED,
+                                             "%s() is not supported on peer-to-peer connections",
+                                             g_dbus_method_invocation_get_method_name (invocation));
+      return TRUE;
+    }
+
+  g_mutex_lock (&manager->jobs_lock);
+  g_hash_table_remove (manager->job_watchers, g_dbus_method_invocation_get_sender (invocation));
+  g_mutex_unlock (&manager->jobs_lock);
+
+  udisks_manager_complete_unwatch_jobs (object, invocation);
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+handle_get_latency_statistics (UDisksManager         *object,
+                               GDBusMethodInvocation *invocation,
+                               GVariant              *arg_options)
+{
+  UDisksLinuxManager *manager = UDISKS_LINUX_MANAGER (object);
+
+  udisks_manager_complete_get_latency_statistics (object, invocation,
+                                                  udisks_metrics_to_variant (udisks_daemon_get_metrics (manager->daemon)));
+
+  return TRUE;  /* returning TRUE means that we handled the method invocation */
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -1181,10 +2603,23 @@ manager_iface_init (UDisksManagerIface *iface)
   iface->handle_loop_setup = handle_loop_setup;
   iface->handle_mdraid_create = handle_mdraid_create;
   iface->handle_enable_modules = handle_enable_modules;
+  iface->handle_enable_module = handle_enable_module;
   iface->handle_can_format = handle_can_format;
   iface->handle_can_resize = handle_can_resize;
   iface->handle_can_check = handle_can_check;
   iface->handle_can_repair = handle_can_repair;
   iface->handle_get_block_devices = handle_get_block_devices;
   iface->handle_resolve_device = handle_resolve_device;
+  iface->handle_get_objects = handle_get_objects;
+  iface->handle_query_objects = handle_query_objects;
+  iface->handle_mount_filesystems = handle_mount_filesystems;
+  iface->handle_unmount_filesystems = handle_unmount_filesystems;
+  iface->handle_unlock_encrypted = handle_unlock_encrypted;
+  iface->handle_power_off_drives = handle_power_off_drives;
+  iface->handle_secure_erase_drives = handle_secure_erase_drives;
+  iface->handle_format_devices = handle_format_devices;
+  iface->handle_start_swapspaces = handle_start_swapspaces;
+  iface->handle_watch_jobs = handle_watch_jobs;
+  iface->handle_unwatch_jobs = handle_unwatch_jobs;
+  iface->handle_get_latency_statistics = handle_get_latency_statistics;
 }
@@ -29,9 +29,30 @@ G_BEGIN_DECLS
 #define UDISKS_LINUX_MANAGER(o)    (G_TYPE_CHECK_INSTANCE_CAST ((o), UDISKS_TYPE_LINUX_MANAGER, UDisksLinuxManager))
 #define UDISKS_IS_LINUX_MANAGER(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), UDISKS_TYPE_LINUX_MANAGER))
 
+/**
+ * UDisksLinuxDriveHealth:
+ * @failing: Whether the drive reports it is about to fail.
+ * @attributes_failing: Whether any SMART attribute of the drive is failing right now.
+ * @temperature: The temperature of the drive in Kelvin or 0 if unknown.
+ * @num_bad_sectors: The number of bad sectors of the drive or 0 if unknown.
+ *
+ * The contribution of a drive to #UDisksManager:health-summary, see
+ * udisks_linux_manager_update_drive_health().
+ */
+struct _UDisksLinuxDriveHealth
+{
+  gboolean failing;
+  gboolean attributes_failing;
+  gdouble  temperature;
+  guint64  num_bad_sectors;
+};
+
 GType          udisks_linux_manager_get_type    (void) G_GNUC_CONST;
 UDisksManager *udisks_linux_manager_new         (UDisksDaemon       *daemon);
 UDisksDaemon  *udisks_linux_manager_get_daemon  (UDisksLinuxManager *manager);
+void           udisks_linux_manager_update_drive_health (UDisksLinuxManager           *manager,
+                                                         const gchar                  *drive_object_path,
+                                                         const UDisksLinuxDriveHealth *health);
 
 G_END_DECLS
 
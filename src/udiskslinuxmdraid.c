@@ -28,6 +28,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <mntent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include <glib/gstdio.h>
 
@@ -43,9 +46,11 @@
 #include "udisksdaemon.h"
 #include "udisksstate.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udiskslinuxdevice.h"
 #include "udiskslinuxblock.h"
 #include "udiskssimplejob.h"
+#include "udiskssysfsreader.h"
 
 /**
  * SECTION:udiskslinuxmdraid
@@ -69,6 +74,32 @@ struct _UDisksLinuxMDRaid
   UDisksMDRaidSkeleton parent_instance;
 
   guint polling_timeout;
+
+  /* keeps the md/ attributes of the running array open, they're read on
+   * every update and every second while syncing
+   */
+  UDisksSysfsReader *sysfs_reader;
+
+  /* array size from the superblock of a member of a stopped array, valid
+   * as long as the member and its superblock event counter are the same
+   */
+  dev_t examined_member;
+  gchar *examined_events;
+  guint64 examined_size;
+
+  /* protects the adaptive resync speed state below, it's set by
+   * SetSyncSpeed() and used while polling
+   */
+  GMutex sync_speed_lock;
+  gboolean sync_speed_adaptive;
+  /* the limits requested by SetSyncSpeed() in KiB/s, 0 for the system default */
+  guint64 sync_speed_min;
+  guint64 sync_speed_max;
+  /* the current ceiling in KiB/s and the foreground I/O counter of the
+   * array at the last sample, 0 if not sampled yet
+   */
+  guint64 sync_speed_ceiling;
+  guint64 sync_speed_last_ios;
 };
 
 struct _UDisksLinuxMDRaidClass
@@ -77,7 +108,13 @@ struct _UDisksLinuxMDRaidClass
 };
 
 static void ensure_polling (UDisksLinuxMDRaid  *mdraid,
+                            UDisksDaemon       *daemon,
                             gboolean            polling_on);
+static void update_sync_progress (UDisksLinuxMDRaid       *mdraid,
+                                  UDisksLinuxMDRaidObject *object,
+                                  UDisksLinuxDevice       *raid_device);
+static void adapt_sync_speed (UDisksLinuxMDRaid *mdraid,
+                              UDisksLinuxDevice *raid_device);
 
 static void mdraid_iface_init (UDisksMDRaidIface *iface);
 
@@ -91,7 +128,11 @@ udisks_linux_mdraid_finalize (GObject *object)
 {
   UDisksLinuxMDRaid *mdraid = UDISKS_LINUX_MDRAID (object);
 
-  ensure_polling (mdraid, FALSE);
+  ensure_polling (mdraid, NULL, FALSE);
+
+  g_free (mdraid->examined_events);
+  g_clear_pointer (&mdraid->sysfs_reader, udisks_sysfs_reader_free);
+  g_mutex_clear (&mdraid->sync_speed_lock);
 
   if (G_OBJECT_CLASS (udisks_linux_mdraid_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (udisks_linux_mdraid_parent_class)->finalize (object);
@@ -100,8 +141,7 @@ udisks_linux_mdraid_finalize (GObject *object)
 static void
 udisks_linux_mdraid_init (UDisksLinuxMDRaid *mdraid)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (mdraid),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&mdraid->sync_speed_lock);
 }
 
 static void
@@ -111,6 +151,8 @@ udisks_linux_mdraid_class_init (UDisksLinuxMDRaidClass *klass)
 
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize     = udisks_linux_mdraid_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -142,11 +184,15 @@ on_polling_timout (gpointer user_data)
   if (object == NULL)
     goto out;
 
-  /* synthesize uevent */
+  /* Only the progress needs polling - changes of md/sync_action and
+   * md/degraded are signalled by the kernel and result in a synthesized
+   * uevent, see raid_device_added() in udiskslinuxmdraidobject.c
+   */
   raid_device = udisks_linux_mdraid_object_get_device (object);
   if (raid_device != NULL)
     {
-      udisks_linux_mdraid_object_uevent (object, "change", raid_device, FALSE);
+      update_sync_progress (mdraid, object, raid_device);
+      adapt_sync_speed (mdraid, raid_device);
       g_object_unref (raid_device);
     }
 
@@ -157,15 +203,19 @@ on_polling_timout (gpointer user_data)
 
 static void
 ensure_polling (UDisksLinuxMDRaid  *mdraid,
+                UDisksDaemon       *daemon,
                 gboolean            polling_on)
 {
   if (polling_on)
     {
       if (mdraid->polling_timeout == 0)
         {
-          mdraid->polling_timeout = g_timeout_add_seconds (1,
-                                                           on_polling_timout,
-                                                           mdraid);
+          mdraid->polling_timeout = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                            "mdraid-sync-poll",
+                                                                            1,
+                                                                            on_polling_timout,
+                                                                            mdraid,
+                                                                            NULL);
         }
     }
   else
@@ -178,6 +228,326 @@ ensure_polling (UDisksLinuxMDRaid  *mdraid,
     }
 }
 
+/* Reads @attr of the running array @raid_device through the sysfs reader
+ * of @mdraid, creating it for the array as needed.
+ */
+static gchar *
+read_array_attr (UDisksLinuxMDRaid *mdraid,
+                 UDisksLinuxDevice *raid_device,
+                 const gchar       *attr)
+{
+  const gchar *sysfs_path;
+  GError *error = NULL;
+  gchar *ret;
+
+  sysfs_path = g_udev_device_get_sysfs_path (raid_device->udev_device);
+  if (mdraid->sysfs_reader != NULL &&
+      g_strcmp0 (udisks_sysfs_reader_get_sysfs_path (mdraid->sysfs_reader), sysfs_path) != 0)
+    g_clear_pointer (&mdraid->sysfs_reader, udisks_sysfs_reader_free);
+  if (mdraid->sysfs_reader == NULL)
+    mdraid->sysfs_reader = udisks_sysfs_reader_new (sysfs_path);
+
+  ret = udisks_sysfs_reader_read (mdraid->sysfs_reader, attr, &error);
+  if (ret == NULL)
+    {
+      udisks_warning ("Error reading sysfs attr: %s (%s, %d)",
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+
+  return ret;
+}
+
+static guint64
+read_array_attr_as_uint64 (UDisksLinuxMDRaid *mdraid,
+                           UDisksLinuxDevice *raid_device,
+                           const gchar       *attr)
+{
+  guint64 ret = 0;
+  gchar *str;
+
+  str = read_array_attr (mdraid, raid_device, attr);
+  if (str != NULL)
+    {
+      ret = g_ascii_strtoull (str, NULL, 10);
+      g_free (str);
+    }
+
+  return ret;
+}
+
+/* Gets the size of a stopped array from the superblock of @member, running
+ * mdadm only when the superblock changed since the last time.
+ */
+static guint64
+get_examined_size (UDisksLinuxMDRaid *mdraid,
+                   UDisksLinuxDevice *member)
+{
+  BDMDExamineData *raid_data = NULL;
+  GError *error = NULL;
+  const gchar *events;
+  guint64 size;
+  dev_t dev;
+
+  dev = g_udev_device_get_device_number (member->udev_device);
+  /* imported from 'mdadm --examine --export' by the udev rules */
+  events = g_udev_device_get_property (member->udev_device, "UDISKS_MD_MEMBER_EVENTS");
+  if (! events)
+      events = g_udev_device_get_property (member->udev_device, "STORAGED_MD_MEMBER_EVENTS");
+
+  if (events != NULL && mdraid->examined_events != NULL &&
+      mdraid->examined_member == dev &&
+      g_strcmp0 (mdraid->examined_events, events) == 0)
+    return mdraid->examined_size;
+
+  g_clear_pointer (&mdraid->examined_events, g_free);
+  mdraid->examined_size = 0;
+
+  raid_data = bd_md_examine (g_udev_device_get_device_file (member->udev_device),
+                             &error);
+  if (raid_data == NULL)
+    {
+      udisks_debug ("Failed to read array size: %s", error->message);
+      g_clear_error (&error);
+      return 0;
+    }
+  size = raid_data->size;
+  bd_md_examine_data_free (raid_data);
+
+  /* without the event counter there's no telling when to re-read it */
+  if (events != NULL)
+    {
+      mdraid->examined_member = dev;
+      mdraid->examined_events = g_strdup (events);
+      mdraid->examined_size = size;
+    }
+
+  return size;
+}
+
+/* Updates the sync progress of the array and of its sync job, if any,
+ * sampling only md/sync_completed and md/sync_speed.
+ */
+static void
+update_sync_progress (UDisksLinuxMDRaid       *mdraid,
+                      UDisksLinuxMDRaidObject *object,
+                      UDisksLinuxDevice       *raid_device)
+{
+  UDisksMDRaid *iface = UDISKS_MDRAID (mdraid);
+  UDisksBaseJob *job = NULL;
+  gchar *sync_completed = NULL;
+  gdouble sync_completed_val = 0.0;
+  guint64 sync_rate = 0;
+  guint64 sync_remaining_time = 0;
+
+  if (raid_device != NULL)
+    sync_completed = read_array_attr (mdraid, raid_device, "md/sync_completed");
+
+  if (sync_completed != NULL && g_strcmp0 (sync_completed, "none") != 0)
+    {
+      guint64 completed_sectors = 0;
+      guint64 num_sectors = 1;
+      if (sscanf (sync_completed, "%" G_GUINT64_FORMAT " / %" G_GUINT64_FORMAT,
+                  &completed_sectors, &num_sectors) == 2)
+        {
+          if (num_sectors != 0)
+            sync_completed_val = ((gdouble) completed_sectors) / ((gdouble) num_sectors);
+        }
+
+      /* this is KiB/s (see drivers/md/md.c:sync_speed_show() */
+      sync_rate = read_array_attr_as_uint64 (mdraid, raid_device, "md/sync_speed") * 1024;
+      if (sync_rate > 0)
+        {
+          guint64 num_bytes_remaining = (num_sectors - completed_sectors) * 512ULL;
+          sync_remaining_time = ((guint64) G_USEC_PER_SEC) * num_bytes_remaining / sync_rate;
+        }
+    }
+
+  job = udisks_linux_mdraid_object_get_sync_job (object);
+  if (job != NULL)
+    {
+      /* Update the job's interface */
+      udisks_job_set_progress (UDISKS_JOB (job), sync_completed_val);
+      udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+      udisks_job_set_rate (UDISKS_JOB (job), sync_rate);
+
+      udisks_job_set_expected_end_time (UDISKS_JOB (job),
+                                        g_get_real_time () + sync_remaining_time);
+    }
+  udisks_mdraid_set_sync_completed (iface, sync_completed_val);
+  udisks_mdraid_set_sync_rate (iface, sync_rate);
+  udisks_mdraid_set_sync_remaining_time (iface, sync_remaining_time);
+
+  g_free (sync_completed);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+write_array_attr (UDisksLinuxDevice  *raid_device,
+                  const gchar        *attr,
+                  const gchar        *value,
+                  GError            **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename;
+  gint fd;
+
+  filename = g_build_filename (g_udev_device_get_sysfs_path (raid_device->udev_device), attr, NULL);
+  fd = open (filename, O_WRONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %s", filename, g_strerror (errno));
+      goto out;
+    }
+  if (write (fd, value, strlen (value)) == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error writing %s: %s", filename, g_strerror (errno));
+      close (fd);
+      goto out;
+    }
+  close (fd);
+  ret = TRUE;
+
+ out:
+  g_free (filename);
+  return ret;
+}
+
+/* Writes @speed (in KiB/s) to the md/sync_speed_min or md/sync_speed_max
+ * file @attr of the array, 0 meaning the system wide default.
+ */
+static gboolean
+write_sync_speed (UDisksLinuxDevice  *raid_device,
+                  const gchar        *attr,
+                  guint64             speed,
+                  GError            **error)
+{
+  gchar *value;
+  gboolean ret;
+
+  if (speed == 0)
+    value = g_strdup ("system");
+  else
+    value = g_strdup_printf ("%" G_GUINT64_FORMAT, speed);
+  ret = write_array_attr (raid_device, attr, value, error);
+  g_free (value);
+
+  return ret;
+}
+
+/* Reads the system wide md/sync_speed_max default in KiB/s. */
+static guint64
+get_system_sync_speed_max (void)
+{
+  gchar *contents = NULL;
+  guint64 ret = 200000; /* the kernel default */
+
+  if (g_file_get_contents ("/proc/sys/dev/raid/speed_limit_max", &contents, NULL, NULL))
+    ret = g_ascii_strtoull (contents, NULL, 10);
+  g_free (contents);
+
+  return ret;
+}
+
+/* The number of foreground I/O requests of the running array so far. The
+ * resync I/O goes directly to the members, so it is not accounted here.
+ */
+static guint64
+get_array_ios (UDisksLinuxMDRaid *mdraid,
+               UDisksLinuxDevice *raid_device)
+{
+  gchar *stat;
+  guint64 fields[5] = {0, 0, 0, 0, 0};
+  guint64 ret = 0;
+
+  stat = read_array_attr (mdraid, raid_device, "stat");
+  /* reads completed, reads merged, sectors read, time reading, writes completed */
+  if (stat != NULL &&
+      sscanf (stat, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+              " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+              &fields[0], &fields[1], &fields[2], &fields[3], &fields[4]) == 5)
+    ret = fields[0] + fields[4];
+  g_free (stat);
+
+  return ret;
+}
+
+/* Called every second while the array is syncing. In adaptive mode,
+ * the sync speed ceiling is halved (down to the minimum) whenever the
+ * array got foreground I/O since the last sample and raised again by an
+ * eighth of the maximum per idle second. md itself only keeps the sync
+ * speed above md/sync_speed_min when there's foreground I/O, so this is
+ * what keeps the resync from hurting the latency of the foreground I/O.
+ */
+static void
+adapt_sync_speed (UDisksLinuxMDRaid *mdraid,
+                  UDisksLinuxDevice *raid_device)
+{
+  GError *error = NULL;
+  guint64 ios;
+  guint64 min_speed;
+  guint64 max_speed;
+  guint64 ceiling;
+
+  g_mutex_lock (&mdraid->sync_speed_lock);
+  if (!mdraid->sync_speed_adaptive)
+    goto out;
+
+  ios = get_array_ios (mdraid, raid_device);
+  max_speed = mdraid->sync_speed_max != 0 ? mdraid->sync_speed_max : get_system_sync_speed_max ();
+  /* the effective minimum, also when it's the system default */
+  min_speed = read_array_attr_as_uint64 (mdraid, raid_device, "md/sync_speed_min");
+  min_speed = MIN (MAX (min_speed, 1), max_speed);
+
+  if (mdraid->sync_speed_ceiling == 0)
+    ceiling = max_speed;
+  else if (ios != mdraid->sync_speed_last_ios)
+    ceiling = MAX (mdraid->sync_speed_ceiling / 2, min_speed);
+  else
+    ceiling = MIN (mdraid->sync_speed_ceiling + MAX (max_speed / 8, 1), max_speed);
+  mdraid->sync_speed_last_ios = ios;
+
+  if (ceiling != mdraid->sync_speed_ceiling)
+    {
+      if (!write_sync_speed (raid_device, "md/sync_speed_max", ceiling, &error))
+        {
+          udisks_warning ("Error adapting the sync speed: %s", error->message);
+          g_clear_error (&error);
+          goto out;
+        }
+      mdraid->sync_speed_ceiling = ceiling;
+      udisks_mdraid_set_sync_speed_max (UDISKS_MDRAID (mdraid), ceiling * 1024);
+    }
+
+ out:
+  g_mutex_unlock (&mdraid->sync_speed_lock);
+}
+
+/* Called when the array stops syncing, puts back the requested maximum in
+ * place of the adapted ceiling for the next sync.
+ */
+static void
+reset_adapted_sync_speed (UDisksLinuxMDRaid *mdraid,
+                          UDisksLinuxDevice *raid_device)
+{
+  GError *error = NULL;
+
+  g_mutex_lock (&mdraid->sync_speed_lock);
+  if (mdraid->sync_speed_adaptive && mdraid->sync_speed_ceiling != 0)
+    {
+      mdraid->sync_speed_ceiling = 0;
+      if (!write_sync_speed (raid_device, "md/sync_speed_max", mdraid->sync_speed_max, &error))
+        {
+          udisks_warning ("Error resetting the sync speed: %s", error->message);
+          g_clear_error (&error);
+        }
+    }
+  g_mutex_unlock (&mdraid->sync_speed_lock);
+}
+
 static gint
 member_cmpfunc (GVariant **a,
                 GVariant **b)
@@ -236,18 +606,14 @@ udisks_linux_mdraid_update (UDisksLinuxMDRaid       *mdraid,
   const gchar *uuid = NULL;
   const gchar *name = NULL;
   gchar *sync_action = NULL;
-  gchar *sync_completed = NULL;
   gchar *bitmap_location = NULL;
   guint degraded = 0;
   guint64 chunk_size = 0;
-  gdouble sync_completed_val = 0.0;
-  guint64 sync_rate = 0;
-  guint64 sync_remaining_time = 0;
+  guint64 sync_speed_min = 0;
+  guint64 sync_speed_max = 0;
   GVariantBuilder builder;
   UDisksDaemon *daemon = NULL;
   UDisksBaseJob *job = NULL;
-  GError *error = NULL;
-  BDMDExamineData *raid_data = NULL;
 
   daemon = udisks_linux_mdraid_object_get_daemon (object);
 
@@ -305,15 +671,7 @@ udisks_linux_mdraid_update (UDisksLinuxMDRaid       *mdraid,
     }
   else
     {
-      raid_data = bd_md_examine (g_udev_device_get_device_file (device->udev_device),
-                                 &error);
-      if (raid_data == NULL)
-        {
-          udisks_debug ("Failed to read array size: %s", error->message);
-          g_clear_error (&error);
-        }
-      else
-          size = raid_data->size;
+      size = get_examined_size (mdraid, device);
     }
 
   udisks_mdraid_set_uuid (iface, uuid);
@@ -323,47 +681,40 @@ udisks_linux_mdraid_update (UDisksLinuxMDRaid       *mdraid,
   udisks_mdraid_set_size (iface, size);
 
   udisks_mdraid_set_running (iface, raid_device != NULL);
+  /* the md/ directory goes away with the array */
+  if (raid_device == NULL)
+    g_clear_pointer (&mdraid->sysfs_reader, udisks_sysfs_reader_free);
 
   if (raid_device != NULL)
     {
       if (mdraid_has_redundancy (level))
         {
           /* Can't use GUdevDevice methods as they cache the result and these variables vary */
-          degraded = read_sysfs_attr_as_int (raid_device->udev_device, "md/degraded");
-          sync_action = read_sysfs_attr (raid_device->udev_device, "md/sync_action");
-          sync_completed = read_sysfs_attr (raid_device->udev_device, "md/sync_completed");
-          bitmap_location = read_sysfs_attr (raid_device->udev_device, "md/bitmap/location");
+          degraded = read_array_attr_as_uint64 (mdraid, raid_device, "md/degraded");
+          sync_action = read_array_attr (mdraid, raid_device, "md/sync_action");
+          bitmap_location = read_array_attr (mdraid, raid_device, "md/bitmap/location");
+          /* these are KiB/s, followed by "(system)" or "(local)" */
+          sync_speed_min = read_array_attr_as_uint64 (mdraid, raid_device, "md/sync_speed_min") * 1024;
+          sync_speed_max = read_array_attr_as_uint64 (mdraid, raid_device, "md/sync_speed_max") * 1024;
         }
 
       if (mdraid_has_stripes (level))
         {
-          chunk_size = read_sysfs_attr_as_uint64 (raid_device->udev_device, "md/chunk_size");
+          chunk_size = read_array_attr_as_uint64 (mdraid, raid_device, "md/chunk_size");
         }
     }
   udisks_mdraid_set_degraded (iface, degraded);
   udisks_mdraid_set_sync_action (iface, sync_action);
   udisks_mdraid_set_bitmap_location (iface, bitmap_location);
   udisks_mdraid_set_chunk_size (iface, chunk_size);
-
-  if (sync_completed != NULL && g_strcmp0 (sync_completed, "none") != 0)
-    {
-      guint64 completed_sectors = 0;
-      guint64 num_sectors = 1;
-      if (sscanf (sync_completed, "%" G_GUINT64_FORMAT " / %" G_GUINT64_FORMAT,
-                  &completed_sectors, &num_sectors) == 2)
-        {
-          if (num_sectors != 0)
-            sync_completed_val = ((gdouble) completed_sectors) / ((gdouble) num_sectors);
-        }
-
-      /* this is KiB/s (see drivers/md/md.c:sync_speed_show() */
-      sync_rate = read_sysfs_attr_as_uint64 (raid_device->udev_device, "md/sync_speed") * 1024;
-      if (sync_rate > 0)
-        {
-          guint64 num_bytes_remaining = (num_sectors - completed_sectors) * 512ULL;
-          sync_remaining_time = ((guint64) G_USEC_PER_SEC) * num_bytes_remaining / sync_rate;
-        }
-    }
+  udisks_mdraid_set_sync_speed_min (iface, sync_speed_min);
+  udisks_mdraid_set_sync_speed_max (iface, sync_speed_max);
+  g_mutex_lock (&mdraid->sync_speed_lock);
+  /* the kernel forgets the limits of a stopped array */
+  if (raid_device == NULL)
+    mdraid->sync_speed_adaptive = FALSE;
+  udisks_mdraid_set_sync_speed_adaptive (iface, mdraid->sync_speed_adaptive);
+  g_mutex_unlock (&mdraid->sync_speed_lock);
 
   if (sync_action == NULL || g_strcmp0 (sync_action, "idle") == 0)
     {
@@ -390,20 +741,8 @@ udisks_linux_mdraid_update (UDisksLinuxMDRaid       *mdraid,
           udisks_job_set_cancelable (UDISKS_JOB (job), FALSE);
           udisks_linux_mdraid_object_set_sync_job (object, job);
         }
-      else
-        job = udisks_linux_mdraid_object_get_sync_job (object);
-
-      /* Update the job's interface */
-      udisks_job_set_progress (UDISKS_JOB (job), sync_completed_val);
-      udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
-      udisks_job_set_rate (UDISKS_JOB (job), sync_rate);
-
-      udisks_job_set_expected_end_time (UDISKS_JOB (job),
-                                        g_get_real_time () + sync_remaining_time);
     }
-  udisks_mdraid_set_sync_completed (iface, sync_completed_val);
-  udisks_mdraid_set_sync_rate (iface, sync_rate);
-  udisks_mdraid_set_sync_remaining_time (iface, sync_remaining_time);
+  update_sync_progress (mdraid, object, sync_action != NULL ? raid_device : NULL);
 
   /* ensure we poll, exactly when we need to */
   if (g_strcmp0 (sync_action, "resync") == 0 ||
@@ -411,11 +750,13 @@ udisks_linux_mdraid_update (UDisksLinuxMDRaid       *mdraid,
       g_strcmp0 (sync_action, "check") == 0 ||
       g_strcmp0 (sync_action, "repair") == 0)
     {
-      ensure_polling (mdraid, TRUE);
+      ensure_polling (mdraid, daemon, TRUE);
     }
   else
     {
-      ensure_polling (mdraid, FALSE);
+      ensure_polling (mdraid, daemon, FALSE);
+      if (raid_device != NULL)
+        reset_adapted_sync_speed (mdraid, raid_device);
     }
 
   /* figure out active devices */
@@ -529,14 +870,10 @@ udisks_linux_mdraid_update (UDisksLinuxMDRaid       *mdraid,
                                                                                 uuid));
 
  out:
-  if (raid_data)
-      bd_md_examine_data_free (raid_data);
-  g_free (sync_completed);
   g_free (sync_action);
   g_free (bitmap_location);
   g_list_free_full (member_devices, g_object_unref);
   g_clear_object (&raid_device);
-  g_clear_error (&error);
   return ret;
 }
 
@@ -682,6 +1019,7 @@ handle_start (UDisksMDRaid           *_mdraid,
                                                      object,
                                                      NULL,
                                                      10, /* timeout_seconds */
+                                                     udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                      &error);
   if (block_object == NULL)
     {
@@ -1466,6 +1804,144 @@ handle_request_sync_action (UDisksMDRaid           *_mdraid,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+handle_set_sync_speed (UDisksMDRaid           *_mdraid,
+                       GDBusMethodInvocation  *invocation,
+                       guint64                 min,
+                       guint64                 max,
+                       GVariant               *options)
+{
+  UDisksLinuxMDRaid *mdraid = UDISKS_LINUX_MDRAID (_mdraid);
+  UDisksDaemon *daemon;
+  UDisksState *state;
+  UDisksLinuxMDRaidObject *object;
+  const gchar *action_id;
+  const gchar *message;
+  uid_t started_by_uid;
+  uid_t caller_uid;
+  UDisksLinuxDevice *raid_device = NULL;
+  GError *error = NULL;
+  gboolean adaptive = FALSE;
+  guint64 min_kib;
+  guint64 max_kib;
+
+  object = udisks_daemon_util_dup_object (mdraid, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_mdraid_object_get_daemon (object);
+  state = udisks_daemon_get_state (daemon);
+
+  error = NULL;
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  g_variant_lookup (options, "adaptive", "b", &adaptive);
+
+  /* md takes KiB/s */
+  min_kib = min / 1024;
+  max_kib = max / 1024;
+  if ((min != 0 && min_kib == 0) || (max != 0 && max_kib == 0))
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "Sync speed limits have to be at least 1 KiB/s");
+      goto out;
+    }
+  if (min_kib != 0 && max_kib != 0 && min_kib > max_kib)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                                             "The minimum sync speed cannot be greater than the maximum");
+      goto out;
+    }
+
+  raid_device = udisks_linux_mdraid_object_get_device (object);
+  if (raid_device == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "RAID Array is not running");
+      goto out;
+    }
+
+  if (!mdraid_has_redundancy (udisks_mdraid_get_level (_mdraid)))
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                                             "RAID Array has no redundancy to sync");
+      goto out;
+    }
+
+  if (!udisks_state_has_mdraid (state,
+                                g_udev_device_get_device_number (raid_device->udev_device),
+                                &started_by_uid))
+    {
+      /* allow stopping arrays stuff not mentioned in mounted-fs, but treat it like root mounted it */
+      started_by_uid = 0;
+    }
+
+  /* First check the user is authorized to manage RAID */
+  if (caller_uid != 0 && (caller_uid != started_by_uid))
+    {
+      /* Translators: Shown in authentication dialog when the user
+       * attempts to change the resync speed limits of a RAID array
+       */
+      /* TODO: variables */
+      message = N_("Authentication is required to change the sync speed of a RAID array");
+      action_id = "org.freedesktop.udisks2.manage-md-raid";
+      if (!udisks_daemon_util_check_authorization_sync (daemon,
+                                                        UDISKS_OBJECT (object),
+                                                        action_id,
+                                                        options,
+                                                        message,
+                                                        invocation))
+        goto out;
+    }
+
+  g_mutex_lock (&mdraid->sync_speed_lock);
+  /* newer kernels refuse a minimum above the maximum and the other way
+   * round, so lower the minimum to the default before changing both
+   */
+  if (!write_sync_speed (raid_device, "md/sync_speed_min", 0, &error) ||
+      !write_sync_speed (raid_device, "md/sync_speed_max", max_kib, &error) ||
+      !write_sync_speed (raid_device, "md/sync_speed_min", min_kib, &error))
+    {
+      g_mutex_unlock (&mdraid->sync_speed_lock);
+      g_prefix_error (&error, "Error setting the sync speed of the RAID array: ");
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  mdraid->sync_speed_adaptive = adaptive;
+  mdraid->sync_speed_min = min_kib;
+  mdraid->sync_speed_max = max_kib;
+  mdraid->sync_speed_ceiling = 0;
+  mdraid->sync_speed_last_ios = 0;
+  udisks_mdraid_set_sync_speed_adaptive (_mdraid, adaptive);
+  g_mutex_unlock (&mdraid->sync_speed_lock);
+
+  udisks_notice ("Set sync speed of RAID array %s to %" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT " KiB/s%s",
+                 g_udev_device_get_device_file (raid_device->udev_device),
+                 min_kib, max_kib, adaptive ? " (adaptive)" : "");
+
+  udisks_mdraid_complete_set_sync_speed (_mdraid, invocation);
+  udisks_linux_mdraid_update (mdraid, object);
+
+ out:
+  g_clear_object (&raid_device);
+  g_clear_object (&object);
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static gboolean
 udisks_linux_mdraid_delete (UDisksMDRaid           *mdraid,
                             GDBusMethodInvocation  *invocation,
@@ -1635,5 +2111,6 @@ mdraid_iface_init (UDisksMDRaidIface *iface)
   iface->handle_add_device = handle_add_device;
   iface->handle_set_bitmap_location = handle_set_bitmap_location;
   iface->handle_request_sync_action = handle_request_sync_action;
+  iface->handle_set_sync_speed = handle_set_sync_speed;
   iface->handle_delete = handle_delete;
 }
@@ -37,9 +37,11 @@
 
 #include "udiskslogging.h"
 #include "udiskslinuxpartition.h"
+#include "udiskslinuxpartitiontable.h"
 #include "udiskslinuxblockobject.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udiskslinuxdevice.h"
 #include "udiskslinuxblock.h"
 #include "udiskssimplejob.h"
@@ -81,13 +83,12 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxPartition, udisks_linux_partition, UDISKS_TY
 static void
 udisks_linux_partition_init (UDisksLinuxPartition *partition)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (partition),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
 udisks_linux_partition_class_init (UDisksLinuxPartitionClass *klass)
 {
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -177,37 +178,24 @@ out:
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static void update_partitions_list (UDisksObject           *disk_object,
-                                    UDisksLinuxBlockObject *part_object)
+/* Adds @part_object to the partition table on @disk_object, if any */
+static void
+add_to_partition_table (UDisksObject           *disk_object,
+                        UDisksLinuxBlockObject *part_object,
+                        guint                   number)
 {
   UDisksPartitionTable *table = NULL;
-  gchar **partitions = NULL;
   const gchar *object_path = NULL;
-  guint num_parts = 0;
 
   object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (part_object));
   if (object_path == NULL)
     return;
 
   table = udisks_object_peek_partition_table (disk_object);
-  if (table == NULL)
+  if (table == NULL || !UDISKS_IS_LINUX_PARTITION_TABLE (table))
     return;
 
-  partitions = udisks_partition_table_dup_partitions (table);
-  if (partitions != NULL && g_strv_contains ((const gchar **) partitions, object_path))
-    /* this partition is already in the property */
-    goto out;
-
-  num_parts = partitions ? g_strv_length (partitions) : 0;
-  partitions = g_realloc (partitions, (num_parts + 2) * sizeof (gchar *));
-  partitions[num_parts] = g_strdup (object_path);
-  partitions[num_parts + 1] = NULL;
-
-  udisks_partition_table_set_partitions (table, (const gchar**) partitions);
-
-out:
-  if (partitions)
-    g_strfreev (partitions);
+  udisks_linux_partition_table_add_partition (UDISKS_LINUX_PARTITION_TABLE (table), object_path, number);
 }
 
 /**
@@ -296,10 +284,8 @@ udisks_linux_partition_update (UDisksLinuxPartition   *partition,
         }
     }
 
-  if (disk_block_object != NULL) {
+  if (disk_block_object != NULL)
     table_object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (disk_block_object));
-    update_partitions_list (disk_block_object, object);
-  }
 
   udisks_partition_set_number (UDISKS_PARTITION (partition), number);
   udisks_partition_set_type_ (UDISKS_PARTITION (partition), type);
@@ -312,6 +298,10 @@ udisks_linux_partition_update (UDisksLinuxPartition   *partition,
   udisks_partition_set_is_container (UDISKS_PARTITION (partition), is_container);
   udisks_partition_set_is_contained (UDISKS_PARTITION (partition), is_contained);
 
+  /* after setting the Table property, the table checks it */
+  if (disk_block_object != NULL)
+    add_to_partition_table (disk_block_object, object, number);
+
   g_free (name);
   g_clear_object (&device);
   g_clear_object (&disk_block_object);
@@ -910,6 +900,7 @@ handle_resize (UDisksPartition       *partition,
                                                          &wait_data,
                                                          NULL,
                                                          10,
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          NULL);
 
   udisks_partition_complete_resize (partition, invocation);
@@ -39,6 +39,7 @@
 #include "udiskslinuxblockobject.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udiskslinuxdevice.h"
 #include "udiskslinuxblock.h"
 #include "udiskslinuxpartition.h"
@@ -64,6 +65,18 @@ typedef struct _UDisksLinuxPartitionTableClass   UDisksLinuxPartitionTableClass;
 struct _UDisksLinuxPartitionTable
 {
   UDisksPartitionTableSkeleton parent_instance;
+
+  /* protects partitions and partitions_seeded, the partitions are looked
+   * up from method handler threads
+   */
+  GMutex lock;
+  /* maps from the object path of a partition to its number, partitions
+   * add themselves with udisks_linux_partition_table_add_partition() so
+   * finding them doesn't need to go through all exported objects
+   */
+  GHashTable *partitions;
+  /* whether partitions that existed before the interface are in partitions */
+  gboolean partitions_seeded;
 };
 
 struct _UDisksLinuxPartitionTableClass
@@ -78,16 +91,34 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxPartitionTable, udisks_linux_partition_table
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+udisks_linux_partition_table_finalize (GObject *object)
+{
+  UDisksLinuxPartitionTable *partition_table = UDISKS_LINUX_PARTITION_TABLE (object);
+
+  g_hash_table_unref (partition_table->partitions);
+  g_mutex_clear (&partition_table->lock);
+
+  if (G_OBJECT_CLASS (udisks_linux_partition_table_parent_class)->finalize != NULL)
+    G_OBJECT_CLASS (udisks_linux_partition_table_parent_class)->finalize (object);
+}
+
 static void
 udisks_linux_partition_table_init (UDisksLinuxPartitionTable *partition_table)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (partition_table),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
+  g_mutex_init (&partition_table->lock);
+  partition_table->partitions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
 udisks_linux_partition_table_class_init (UDisksLinuxPartitionTableClass *klass)
 {
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = udisks_linux_partition_table_finalize;
+
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -106,6 +137,88 @@ udisks_linux_partition_table_new (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gint
+partition_number_cmpfunc (gconstpointer a,
+                          gconstpointer b)
+{
+  gint number_a = udisks_partition_get_number (UDISKS_PARTITION (a));
+  gint number_b = udisks_partition_get_number (UDISKS_PARTITION (b));
+
+  if (number_a != number_b)
+    return number_a < number_b ? -1 : 1;
+  return g_strcmp0 (g_dbus_object_get_object_path (g_dbus_interface_get_object (G_DBUS_INTERFACE (a))),
+                    g_dbus_object_get_object_path (g_dbus_interface_get_object (G_DBUS_INTERFACE (b))));
+}
+
+/* Finds the partitions of the table at @table_object_path by going through all exported objects */
+static GList *
+find_partitions (UDisksDaemon *daemon,
+                 const gchar  *table_object_path)
+{
+  GList *ret = NULL;
+  GList *l, *object_proxies = NULL;
+
+  object_proxies = udisks_daemon_get_objects (daemon);
+  for (l = object_proxies; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksPartition *partition;
+
+      partition = udisks_object_get_partition (object);
+      if (partition == NULL)
+        continue;
+
+      if (g_strcmp0 (udisks_partition_get_table (partition), table_object_path) == 0)
+        ret = g_list_prepend (ret, g_object_ref (partition));
+
+      g_object_unref (partition);
+    }
+  g_list_free_full (object_proxies, g_object_unref);
+
+  return g_list_reverse (ret);
+}
+
+/* Looks up the partitions that added themselves to @table, skipping those
+ * gone or moved to another table since.
+ */
+static GList *
+lookup_partitions (UDisksDaemon              *daemon,
+                   UDisksLinuxPartitionTable *table,
+                   const gchar               *table_object_path)
+{
+  GList *ret = NULL;
+  GList *object_paths;
+  GList *l;
+
+  g_mutex_lock (&table->lock);
+  object_paths = g_hash_table_get_keys (table->partitions);
+  for (l = object_paths; l != NULL; l = l->next)
+    l->data = g_strdup (l->data);
+  g_mutex_unlock (&table->lock);
+
+  for (l = object_paths; l != NULL; l = l->next)
+    {
+      UDisksObject *object;
+      UDisksPartition *partition;
+
+      object = udisks_daemon_find_object (daemon, l->data);
+      if (object == NULL)
+        continue;
+
+      partition = udisks_object_get_partition (object);
+      if (partition != NULL)
+        {
+          if (g_strcmp0 (udisks_partition_get_table (partition), table_object_path) == 0)
+            ret = g_list_prepend (ret, g_object_ref (partition));
+          g_object_unref (partition);
+        }
+      g_object_unref (object);
+    }
+  g_list_free_full (object_paths, g_free);
+
+  return ret;
+}
+
 /**
  * udisks_linux_partition_table_update:
  * @table: A #UDisksLinuxPartitionTable.
@@ -138,6 +251,19 @@ udisks_linux_partition_table_update (UDisksLinuxPartitionTable  *table,
 
   partition_objects = udisks_linux_partition_table_get_partitions (daemon, UDISKS_PARTITION_TABLE (table), &num_parts);
 
+  /* the partitions found are all there is, drop the ones gone since */
+  if (g_dbus_interface_get_object (G_DBUS_INTERFACE (table)) != NULL)
+    {
+      g_mutex_lock (&table->lock);
+      g_hash_table_remove_all (table->partitions);
+      for (object_p = partition_objects; object_p != NULL; object_p = object_p->next)
+        g_hash_table_insert (table->partitions,
+                             g_strdup (g_dbus_object_get_object_path (g_dbus_interface_get_object (G_DBUS_INTERFACE (object_p->data)))),
+                             GINT_TO_POINTER (udisks_partition_get_number (UDISKS_PARTITION (object_p->data))));
+      table->partitions_seeded = TRUE;
+      g_mutex_unlock (&table->lock);
+    }
+
   partition_object_paths = g_new0 (const gchar *, num_parts + 1);
   for (i = 0, object_p = partition_objects; object_p != NULL; object_p = object_p->next, i++)
     {
@@ -155,6 +281,66 @@ udisks_linux_partition_table_update (UDisksLinuxPartitionTable  *table,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* compares the object paths by the partition numbers in the table */
+static gint
+object_path_number_cmpfunc (gconstpointer a,
+                            gconstpointer b,
+                            gpointer      user_data)
+{
+  GHashTable *partitions = user_data;
+  gint number_a = GPOINTER_TO_INT (g_hash_table_lookup (partitions, *(const gchar **) a));
+  gint number_b = GPOINTER_TO_INT (g_hash_table_lookup (partitions, *(const gchar **) b));
+
+  if (number_a != number_b)
+    return number_a < number_b ? -1 : 1;
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/**
+ * udisks_linux_partition_table_add_partition:
+ * @table: A #UDisksLinuxPartitionTable.
+ * @object_path: The object path of a partition in @table.
+ * @number: The number of the partition.
+ *
+ * Records that the partition at @object_path is in @table, adding it to
+ * the #UDisksPartitionTable:partitions property if it's new. Partitions
+ * gone since are dropped on the next udisks_linux_partition_table_update().
+ *
+ * This is cheap for partitions already known with the same @number so
+ * it can be called on every update of a partition.
+ */
+void
+udisks_linux_partition_table_add_partition (UDisksLinuxPartitionTable *table,
+                                            const gchar               *object_path,
+                                            guint                      number)
+{
+  gpointer value;
+  const gchar **object_paths = NULL;
+  guint num_parts = 0;
+
+  g_return_if_fail (UDISKS_IS_LINUX_PARTITION_TABLE (table));
+  g_return_if_fail (object_path != NULL);
+
+  g_mutex_lock (&table->lock);
+  if (g_hash_table_lookup_extended (table->partitions, object_path, NULL, &value) &&
+      GPOINTER_TO_UINT (value) == number)
+    {
+      g_mutex_unlock (&table->lock);
+      return;
+    }
+
+  g_hash_table_insert (table->partitions, g_strdup (object_path), GUINT_TO_POINTER (number));
+  object_paths = (const gchar **) g_hash_table_get_keys_as_array (table->partitions, &num_parts);
+  g_qsort_with_data (object_paths, num_parts, sizeof (gchar *),
+                     object_path_number_cmpfunc, table->partitions);
+  udisks_partition_table_set_partitions (UDISKS_PARTITION_TABLE (table), object_paths);
+  g_mutex_unlock (&table->lock);
+
+  g_free (object_paths);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 GList *
 udisks_linux_partition_table_get_partitions (UDisksDaemon         *daemon,
                                              UDisksPartitionTable *table,
@@ -163,7 +349,8 @@ udisks_linux_partition_table_get_partitions (UDisksDaemon         *daemon,
   GList *ret = NULL;
   GDBusObject *table_object;
   const gchar *table_object_path;
-  GList *l, *object_proxies = NULL;
+  gboolean seeded = FALSE;
+
   *num_partitions = 0;
 
   table_object = g_dbus_interface_get_object (G_DBUS_INTERFACE (table));
@@ -171,27 +358,21 @@ udisks_linux_partition_table_get_partitions (UDisksDaemon         *daemon,
     goto out;
   table_object_path = g_dbus_object_get_object_path (table_object);
 
-  object_proxies = udisks_daemon_get_objects (daemon);
-  for (l = object_proxies; l != NULL; l = l->next)
+  if (UDISKS_IS_LINUX_PARTITION_TABLE (table))
     {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksPartition *partition;
-
-      partition = udisks_object_get_partition (object);
-      if (partition == NULL)
-        continue;
+      g_mutex_lock (&UDISKS_LINUX_PARTITION_TABLE (table)->lock);
+      seeded = UDISKS_LINUX_PARTITION_TABLE (table)->partitions_seeded;
+      g_mutex_unlock (&UDISKS_LINUX_PARTITION_TABLE (table)->lock);
+    }
 
-      if (g_strcmp0 (udisks_partition_get_table (partition), table_object_path) == 0)
-        {
-          ret = g_list_prepend (ret, g_object_ref (partition));
-          (*num_partitions)++;
-        }
+  if (seeded)
+    ret = lookup_partitions (daemon, UDISKS_LINUX_PARTITION_TABLE (table), table_object_path);
+  else
+    ret = find_partitions (daemon, table_object_path);
 
-      g_object_unref (partition);
-    }
-  ret = g_list_reverse (ret);
+  ret = g_list_sort (ret, partition_number_cmpfunc);
+  *num_partitions = g_list_length (ret);
  out:
-  g_list_free_full (object_proxies, g_object_unref);
   return ret;
 }
 
@@ -246,63 +427,44 @@ wait_for_partition (UDisksDaemon *daemon,
 
 #define MIB_SIZE (1048576L)
 
-static UDisksObject *
-udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *table,
-                                                      GDBusMethodInvocation  *invocation,
-                                                      guint64                 offset,
-                                                      guint64                 size,
-                                                      const gchar            *type,
-                                                      const gchar            *name,
-                                                      GVariant               *options)
+static UDisksObject **
+wait_for_partitions (UDisksDaemon *daemon,
+                     gpointer      user_data)
 {
-  const gchar *action_id = NULL;
-  const gchar *message = NULL;
-  UDisksBlock *block = NULL;
-  UDisksObject *object = NULL;
-  UDisksDaemon *daemon = NULL;
-  gchar *device_name = NULL;
-  WaitForPartitionData *wait_data = NULL;
-  UDisksObject *partition_object = NULL;
-  UDisksBlock *partition_block = NULL;
-  BDPartSpec *part_spec = NULL;
-  BDPartSpec *overlapping_part = NULL;
-  BDPartTypeReq part_type = 0;
-  gchar *table_type = NULL;
-  uid_t caller_uid;
-  GError *error = NULL;
-  UDisksBaseJob *job = NULL;
-  const gchar *partition_type = NULL;
+  GPtrArray *wait_datas = user_data;
+  UDisksObject **ret;
+  guint n;
 
-  object = udisks_daemon_util_dup_object (table, &error);
-  if (object == NULL)
+  ret = g_new0 (UDisksObject *, wait_datas->len + 1);
+  for (n = 0; n < wait_datas->len; n++)
     {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
+      ret[n] = wait_for_partition (daemon, g_ptr_array_index (wait_datas, n));
+      if (ret[n] == NULL)
+        {
+          /* not all of them are there yet */
+          while (n > 0)
+            g_object_unref (ret[--n]);
+          g_free (ret);
+          return NULL;
+        }
     }
 
-  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
-
-  g_variant_lookup (options, "partition-type", "&s", &partition_type);
-
-  block = udisks_object_get_block (object);
-  if (block == NULL)
-    {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Partition table object is not a block device");
-      goto out;
-    }
+  return ret;
+}
 
-  error = NULL;
-  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
-                                               invocation,
-                                               NULL /* GCancellable */,
-                                               &caller_uid,
-                                               &error))
-    {
-      g_dbus_method_invocation_return_gerror (invocation, error);
-      g_clear_error (&error);
-      goto out;
-    }
+/* Checks that the caller is authorized to create partitions on @object,
+ * returns %FALSE with @invocation handled otherwise.
+ */
+static gboolean
+check_create_partition_authorization (UDisksDaemon          *daemon,
+                                      UDisksObject          *object,
+                                      UDisksBlock           *block,
+                                      uid_t                  caller_uid,
+                                      GVariant              *options,
+                                      GDBusMethodInvocation *invocation)
+{
+  const gchar *action_id = NULL;
+  const gchar *message = NULL;
 
   action_id = "org.freedesktop.udisks2.modify-device";
   /* Translators: Shown in authentication dialog when the user
@@ -324,18 +486,35 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
         }
     }
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    action_id,
-                                                    options,
-                                                    message,
-                                                    invocation))
-    goto out;
+  return udisks_daemon_util_check_authorization_sync (daemon,
+                                                      object,
+                                                      action_id,
+                                                      options,
+                                                      message,
+                                                      invocation);
+}
 
-  device_name = g_strdup (udisks_block_get_device (block));
+/* Creates a partition on @device_name and sets its name and type, without
+ * waiting for its object.
+ */
+static BDPartSpec *
+create_partition (const gchar  *device_name,
+                  const gchar  *table_type,
+                  guint64       offset,
+                  guint64       size,
+                  const gchar  *type,
+                  const gchar  *name,
+                  GVariant     *options,
+                  GError      **error)
+{
+  BDPartSpec *part_spec = NULL;
+  BDPartSpec *overlapping_part = NULL;
+  BDPartTypeReq part_type = 0;
+  const gchar *partition_type = NULL;
+  GError *local_error = NULL;
+
+  g_variant_lookup (options, "partition-type", "&s", &partition_type);
 
-  table_type = udisks_partition_table_dup_type_ (table);
-  wait_data = g_new0 (WaitForPartitionData, 1);
   if (g_strcmp0 (table_type, "dos") == 0)
     {
       char *endp;
@@ -343,8 +522,8 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
 
       if (strlen (name) > 0)
         {
-          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                                 "MBR partition table does not support names");
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "MBR partition table does not support names");
           goto out;
         }
 
@@ -367,9 +546,9 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
             }
           else
             {
-              g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                                     "Don't know how to create partition of type `%s'",
-                                                     partition_type);
+              g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                           "Don't know how to create partition of type `%s'",
+                           partition_type);
               goto out;
             }
         }
@@ -387,22 +566,9 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
     }
   else
     {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Don't know how to create partitions this partition table of type `%s'",
-                                             table_type);
-      goto out;
-    }
-
-  job = udisks_daemon_launch_simple_job (daemon,
-                                         UDISKS_OBJECT (object),
-                                         "partition-create",
-                                         caller_uid,
-                                         NULL);
-
-  if (job == NULL)
-    {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Failed to create a job object");
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Don't know how to create partitions this partition table of type `%s'",
+                   table_type);
       goto out;
     }
 
@@ -415,7 +581,7 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
    *      use case. But we should definitely provide some functionality to get
    *      right "numbers" and stop doing this.
   */
-  overlapping_part = bd_part_get_part_by_pos (device_name, offset, &error);
+  overlapping_part = bd_part_get_part_by_pos (device_name, offset, &local_error);
   if (overlapping_part != NULL && ! (overlapping_part->type & BD_PART_TYPE_FREESPACE))
     {
       // extended partition or metadata of the extended partition
@@ -433,38 +599,37 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
       else
         {
           // overlapping partition is not a free space nor an extended part -> error
-          g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                                 "Requested start for the new partition %"G_GUINT64_FORMAT" "
-                                                 "overlaps with existing partition %s.",
-                                                  offset, overlapping_part->path);
+          g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "Requested start for the new partition %"G_GUINT64_FORMAT" "
+                       "overlaps with existing partition %s.",
+                       offset, overlapping_part->path);
           goto out;
         }
     }
   else
-    g_clear_error (&error);
+    g_clear_error (&local_error);
 
   part_spec = bd_part_create_part (device_name, part_type, offset,
-                                   size, BD_PART_ALIGN_OPTIMAL, &error);
+                                   size, BD_PART_ALIGN_OPTIMAL, &local_error);
   if (!part_spec)
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error creating partition on %s: %s",
-                                             udisks_block_get_device (block),
-                                             error->message);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_set_error (error,
+                   UDISKS_ERROR,
+                   UDISKS_ERROR_FAILED,
+                   "Error creating partition on %s: %s",
+                   device_name,
+                   local_error->message);
+      g_clear_error (&local_error);
       goto out;
     }
 
   /* set name if given */
   if (g_strcmp0 (table_type, "gpt") == 0 && strlen (name) > 0)
     {
-      if (!bd_part_set_part_name (device_name, part_spec->path, name, &error))
+      if (!bd_part_set_part_name (device_name, part_spec->path, name, error))
         {
-          g_prefix_error (&error, "Error setting name for newly created partition: ");
-          g_dbus_method_invocation_take_error (invocation, error);
-          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          g_prefix_error (error, "Error setting name for newly created partition: ");
+          g_clear_pointer (&part_spec, bd_part_spec_free);
           goto out;
         }
     }
@@ -475,69 +640,181 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
       gboolean ret = FALSE;
 
       if (g_strcmp0 (table_type, "gpt") == 0)
-          ret = bd_part_set_part_type (device_name, part_spec->path, type, &error);
+          ret = bd_part_set_part_type (device_name, part_spec->path, type, error);
       else if (g_strcmp0 (table_type, "dos") == 0)
-          ret = bd_part_set_part_id (device_name, part_spec->path, type, &error);
+          ret = bd_part_set_part_id (device_name, part_spec->path, type, error);
 
       if (!ret)
         {
-          g_prefix_error (&error, "Error setting type for newly created partition: ");
-          g_dbus_method_invocation_take_error (invocation, error);
-          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          g_prefix_error (error, "Error setting type for newly created partition: ");
+          g_clear_pointer (&part_spec, bd_part_spec_free);
           goto out;
         }
     }
 
+ out:
+  if (overlapping_part)
+    bd_part_spec_free (overlapping_part);
+  return part_spec;
+}
+
+static WaitForPartitionData *
+wait_for_partition_data_new (UDisksObject *partition_table_object,
+                             BDPartSpec   *part_spec)
+{
+  WaitForPartitionData *wait_data;
+
+  wait_data = g_new0 (WaitForPartitionData, 1);
   wait_data->ignore_container = (part_spec->type == BD_PART_TYPE_LOGICAL);
   wait_data->pos_to_wait_for = part_spec->start + (part_spec->size / 2L);
+  g_warn_if_fail (wait_data->pos_to_wait_for > 0);
+  wait_data->partition_table_object = partition_table_object;
+  return wait_data;
+}
+
+/* Wipes the newly created partition @part_spec with the object @partition_object */
+static gboolean
+wipe_partition (BDPartSpec    *part_spec,
+                UDisksObject  *partition_object,
+                GError       **error)
+{
+  UDisksBlock *partition_block;
+  GError *local_error = NULL;
+
+  partition_block = udisks_object_peek_block (partition_object);
+  if (partition_block == NULL)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Partition object is not a block device");
+      return FALSE;
+    }
+
+  if (part_spec->type == BD_PART_TYPE_EXTENDED)
+    return TRUE;
+
+  if (!bd_fs_wipe (part_spec->path, TRUE, &local_error))
+    {
+      if (g_error_matches (local_error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
+        g_clear_error (&local_error);
+      else
+        {
+          g_set_error (error,
+                       UDISKS_ERROR,
+                       UDISKS_ERROR_FAILED,
+                       "Error wiping newly created partition %s: %s",
+                       udisks_block_get_device (partition_block),
+                       local_error->message);
+          g_clear_error (&local_error);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static UDisksObject *
+udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *table,
+                                                      GDBusMethodInvocation  *invocation,
+                                                      guint64                 offset,
+                                                      guint64                 size,
+                                                      const gchar            *type,
+                                                      const gchar            *name,
+                                                      GVariant               *options)
+{
+  UDisksBlock *block = NULL;
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon = NULL;
+  gchar *device_name = NULL;
+  WaitForPartitionData *wait_data = NULL;
+  UDisksObject *partition_object = NULL;
+  BDPartSpec *part_spec = NULL;
+  gchar *table_type = NULL;
+  uid_t caller_uid;
+  GError *error = NULL;
+  UDisksBaseJob *job = NULL;
+
+  object = udisks_daemon_util_dup_object (table, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  block = udisks_object_get_block (object);
+  if (block == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Partition table object is not a block device");
+      goto out;
+    }
+
+  error = NULL;
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  if (!check_create_partition_authorization (daemon, object, block, caller_uid, options, invocation))
+    goto out;
+
+  device_name = g_strdup (udisks_block_get_device (block));
+
+  table_type = udisks_partition_table_dup_type_ (table);
+
+  job = udisks_daemon_launch_simple_job (daemon,
+                                         UDISKS_OBJECT (object),
+                                         "partition-create",
+                                         caller_uid,
+                                         NULL);
+
+  if (job == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Failed to create a job object");
+      goto out;
+    }
+
+  part_spec = create_partition (device_name, table_type, offset, size, type, name, options, &error);
+  if (!part_spec)
+    {
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
 
   /* sit and wait for the partition to show up */
-  g_warn_if_fail (wait_data->pos_to_wait_for > 0);
-  wait_data->partition_table_object = object;
+  wait_data = wait_for_partition_data_new (object, part_spec);
   error = NULL;
   partition_object = udisks_daemon_wait_for_object_sync (daemon,
                                                          wait_for_partition,
                                                          wait_data,
                                                          NULL,
                                                          30,
+                                                         udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
                                                          &error);
   if (partition_object == NULL)
     {
       g_prefix_error (&error, "Error waiting for partition to appear: ");
-      g_dbus_method_invocation_take_error (invocation, error);
       udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
-      goto out;
-    }
-  partition_block = udisks_object_get_block (partition_object);
-  if (partition_block == NULL)
-    {
-      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
-                                             "Partition object is not a block device");
-      g_clear_object (&partition_object);
-      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, NULL);
+      g_dbus_method_invocation_take_error (invocation, error);
       goto out;
     }
 
   /* wipe the newly created partition if wanted */
-  if (part_spec->type != BD_PART_TYPE_EXTENDED)
+  if (!wipe_partition (part_spec, partition_object, &error))
     {
-      if (!bd_fs_wipe (part_spec->path, TRUE, &error))
-        {
-          if (g_error_matches (error, BD_FS_ERROR, BD_FS_ERROR_NOFS))
-            g_clear_error (&error);
-          else
-            {
-              g_dbus_method_invocation_return_error (invocation,
-                                                     UDISKS_ERROR,
-                                                     UDISKS_ERROR_FAILED,
-                                                     "Error wiping newly created partition %s: %s",
-                                                     udisks_block_get_device (partition_block),
-                                                     error->message);
-              udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
-              g_clear_object (&partition_object);
-              goto out;
-            }
-        }
+      udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+      g_dbus_method_invocation_take_error (invocation, error);
+      g_clear_object (&partition_object);
+      goto out;
     }
 
   /* Trigger uevent on the disk -- we sometimes get add-remove-add uevents for
@@ -551,15 +828,11 @@ udisks_linux_partition_table_handle_create_partition (UDisksPartitionTable   *ta
  out:
   g_free (table_type);
   g_free (wait_data);
-  g_clear_error (&error);
-  g_clear_object (&partition_block);
   g_free (device_name);
   g_clear_object (&object);
   g_clear_object (&block);
   if (part_spec)
     bd_part_spec_free (part_spec);
-  if (overlapping_part)
-    bd_part_spec_free (overlapping_part);
   return partition_object;
 }
 
@@ -633,6 +906,168 @@ handle_create_partition (UDisksPartitionTable   *table,
   return TRUE; /* returning TRUE means that we handled the method invocation */
 }
 
+/* runs in thread dedicated to handling @invocation */
+static gboolean
+handle_create_partitions (UDisksPartitionTable   *table,
+                          GDBusMethodInvocation  *invocation,
+                          GVariant               *arg_partitions,
+                          GVariant               *arg_options)
+{
+  UDisksBlock *block = NULL;
+  UDisksObject *object = NULL;
+  UDisksDaemon *daemon = NULL;
+  gchar *device_name = NULL;
+  gchar *table_type = NULL;
+  GPtrArray *part_specs = NULL;
+  GPtrArray *wait_datas = NULL;
+  UDisksObject **partition_objects = NULL;
+  GPtrArray *object_paths = NULL;
+  GVariantIter iter;
+  guint64 offset;
+  guint64 size;
+  const gchar *type;
+  const gchar *name;
+  GVariant *options;
+  uid_t caller_uid;
+  GError *error = NULL;
+  UDisksBaseJob *job = NULL;
+  int fd;
+  guint n;
+
+  /* See handle_create_partition for a motivation of taking the lock, it
+   * is held for all the partitions.
+   */
+  fd = flock_block_dev (table);
+
+  object = udisks_daemon_util_dup_object (table, &error);
+  if (object == NULL)
+    {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+
+  daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  block = udisks_object_get_block (object);
+  if (block == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Partition table object is not a block device");
+      goto out;
+    }
+
+  if (!udisks_daemon_util_get_caller_uid_sync (daemon,
+                                               invocation,
+                                               NULL /* GCancellable */,
+                                               &caller_uid,
+                                               &error))
+    {
+      g_dbus_method_invocation_return_gerror (invocation, error);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  if (!check_create_partition_authorization (daemon, object, block, caller_uid, arg_options, invocation))
+    goto out;
+
+  device_name = g_strdup (udisks_block_get_device (block));
+  table_type = udisks_partition_table_dup_type_ (table);
+
+  job = udisks_daemon_launch_simple_job (daemon,
+                                         UDISKS_OBJECT (object),
+                                         "partition-create",
+                                         caller_uid,
+                                         NULL);
+  if (job == NULL)
+    {
+      g_dbus_method_invocation_return_error (invocation, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                                             "Failed to create a job object");
+      goto out;
+    }
+
+  /* create all the partitions first... */
+  part_specs = g_ptr_array_new_with_free_func ((GDestroyNotify) bd_part_spec_free);
+  wait_datas = g_ptr_array_new_with_free_func (g_free);
+  g_variant_iter_init (&iter, arg_partitions);
+  while (g_variant_iter_next (&iter, "(tt&s&s@a{sv})", &offset, &size, &type, &name, &options))
+    {
+      BDPartSpec *part_spec;
+
+      part_spec = create_partition (device_name, table_type, offset, size, type, name, options, &error);
+      g_variant_unref (options);
+      if (part_spec == NULL)
+        {
+          g_prefix_error (&error, "Error creating partition %u: ", part_specs->len + 1);
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      g_ptr_array_add (part_specs, part_spec);
+      g_ptr_array_add (wait_datas, wait_for_partition_data_new (object, part_spec));
+    }
+
+  /* ...then wait for all of them to show up at once */
+  if (part_specs->len > 0)
+    {
+      partition_objects = udisks_daemon_wait_for_objects_sync (daemon,
+                                                               wait_for_partitions,
+                                                               wait_datas,
+                                                               NULL,
+                                                               30,
+                                                               udisks_daemon_util_get_invocation_cancellable (invocation), /* cancellable */
+                                                               &error);
+      if (partition_objects == NULL)
+        {
+          g_prefix_error (&error, "Error waiting for partitions to appear: ");
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+    }
+
+  object_paths = g_ptr_array_new ();
+  for (n = 0; n < part_specs->len; n++)
+    {
+      if (!wipe_partition (g_ptr_array_index (part_specs, n), partition_objects[n], &error))
+        {
+          udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), FALSE, error->message);
+          g_dbus_method_invocation_take_error (invocation, error);
+          goto out;
+        }
+      g_ptr_array_add (object_paths, (gpointer) g_dbus_object_get_object_path (G_DBUS_OBJECT (partition_objects[n])));
+    }
+  g_ptr_array_add (object_paths, NULL);
+
+  /* See udisks_linux_partition_table_handle_create_partition(), once for all the partitions */
+  udisks_linux_block_object_trigger_uevent (UDISKS_LINUX_BLOCK_OBJECT (object));
+
+  udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), TRUE, NULL);
+
+  udisks_partition_table_complete_create_partitions (table, invocation,
+                                                     (const gchar *const *) object_paths->pdata);
+
+ out:
+  if (object_paths != NULL)
+    g_ptr_array_free (object_paths, TRUE);
+  if (partition_objects != NULL)
+    {
+      for (n = 0; partition_objects[n] != NULL; n++)
+        g_object_unref (partition_objects[n]);
+      g_free (partition_objects);
+    }
+  if (wait_datas != NULL)
+    g_ptr_array_unref (wait_datas);
+  if (part_specs != NULL)
+    g_ptr_array_unref (part_specs);
+  g_free (table_type);
+  g_free (device_name);
+  g_clear_object (&object);
+  g_clear_object (&block);
+  unflock_block_dev (fd);
+
+  return TRUE; /* returning TRUE means that we handled the method invocation */
+}
+
 /* runs in thread dedicated to handling @invocation */
 struct FormatCompleteData {
   UDisksPartitionTable *table;
@@ -701,4 +1136,5 @@ partition_table_iface_init (UDisksPartitionTableIface *iface)
 {
   iface->handle_create_partition = handle_create_partition;
   iface->handle_create_partition_and_format = handle_create_partition_and_format;
+  iface->handle_create_partitions = handle_create_partitions;
 }
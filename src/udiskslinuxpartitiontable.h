@@ -36,6 +36,9 @@ void                  udisks_linux_partition_table_update   (UDisksLinuxPartitio
 GList                *udisks_linux_partition_table_get_partitions (UDisksDaemon         *daemon,
                                                                    UDisksPartitionTable *table,
                                                                    guint                *num_partitions);
+void                  udisks_linux_partition_table_add_partition  (UDisksLinuxPartitionTable *table,
+                                                                   const gchar               *object_path,
+                                                                   guint                      number);
 
 G_END_DECLS
 
@@ -21,7 +21,12 @@
 #include "config.h"
 #include <glib/gi18n-lib.h>
 
+#include <stdlib.h>
 #include <string.h>
+#include <sys/sysmacros.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
 
 #include "udiskslogging.h"
 #include "udisksdaemon.h"
@@ -30,11 +35,22 @@
 #include "udiskslinuxblockobject.h"
 #include "udiskslinuxdriveobject.h"
 #include "udiskslinuxmdraidobject.h"
+#include "udiskslinuxenclosureobject.h"
+#include "udiskslinuxblock.h"
 #include "udiskslinuxmanager.h"
 #include "udisksstate.h"
 #include "udiskslinuxdevice.h"
+#include "udisksprobesnapshot.h"
 #include "udisksmodulemanager.h"
 #include "udisksdaemonutil.h"
+#include "udisksconfigmanager.h"
+#include "udisksjobscheduler.h"
+#include "udisksmetrics.h"
+#include "udisksmethoddispatcher.h"
+#include "udiskssysfsreader.h"
+#include "udiskstrace.h"
+#include "udisksfstabentry.h"
+#include "udiskscrypttabentry.h"
 
 #include <modules/udisksmoduleifacetypes.h>
 #include <modules/udisksmoduleobject.h>
@@ -62,52 +78,244 @@ struct _UDisksLinuxProvider
   UDisksProvider parent_instance;
 
   GUdevClient *gudev_client;
-  GAsyncQueue *probe_request_queue;
-  GThread *probe_request_thread;
+
+  /* the netlink socket gudev_client receives uevents on or -1 if it could
+   * not be found, and the number of uevents the kernel had dropped on it
+   * when last checked - main thread only, see check_uevent_overflow() */
+  gint uevent_fd;
+  guint32 uevent_drops;
+  guint uevent_resync_id;
+
+  /* pool of "probing" threads and the per-sysfs-path queues of pending
+   * ProbeRequest instances, see on_uevent() - protected by probe_lock */
+  GThreadPool *probe_pool;
+  GHashTable *sysfs_path_to_probe_requests;
+  GMutex probe_lock;
+
+  /* ProbeRequest instances waiting to be applied in the "uevent" thread, see
+   * on_probed_requests_timeout() - protected by probe_lock */
+  GQueue probed_requests;
+  GSource *probed_requests_source;
+
+  /* number of ProbeRequest instances not probed yet and the maximum seen,
+   * and the maximum length of probed_requests seen - protected by probe_lock,
+   * see the "probe-queue-depth" property and friends */
+  guint probe_queue_depth;
+  guint probe_queue_depth_peak;
+  gboolean probe_queue_depth_warned;
+  guint probed_requests_peak;
+  gboolean probed_requests_warned;
+  /* number of uevents received, for the sysfs reads per uevent in the
+   * footprint report - protected by probe_lock */
+  guint num_uevents;
+
+  /* maps from sysfs path to ParkedProbe for devices waiting for udev to
+   * initialize them - protected by probe_lock */
+  GHashTable *sysfs_path_to_parked_probe;
+  GFileMonitor *udev_data_dir_monitor;
+
+  /* uevents are applied to the exported objects in a dedicated thread
+   * running its own main context so slow updates don't hold up the
+   * dispatching of D-Bus method calls in the main thread */
+  GMainContext *uevent_context;
+  GMainLoop *uevent_loop;
+  GThread *uevent_thread;
 
   UDisksObjectSkeleton *manager_object;
 
   /* maps from sysfs path to UDisksLinuxBlockObject objects */
   GHashTable *sysfs_to_block;
 
+  /* indexes of exported UDisksLinuxBlockObject objects by sysfs path, device
+   * number and device file for lookups from any thread, see
+   * udisks_linux_provider_find_block_by_sysfs_path() and friends - the values
+   * are BlockIndexEntry structs owned by block_index_by_sysfs_path and the
+   * tables are protected by block_index_lock */
+  GHashTable *block_index_by_sysfs_path;
+  GHashTable *block_index_by_device_number;
+  GHashTable *block_index_by_device_file;
+  GMutex block_index_lock;
+
+  /* maps from whole-disk sysfs path to UDisksLinuxDriveObject for lookups
+   * from any thread, see udisks_linux_provider_find_drive_by_sysfs_path() -
+   * mirrors sysfs_path_to_drive and is protected by drive_index_lock */
+  GHashTable *drive_index_by_sysfs_path;
+  GMutex drive_index_lock;
+
+  /* the kernel holders/slaves graph of all block devices seen in uevents,
+   * see udisks_linux_provider_dup_slaves() - maps from sysfs path to a
+   * GStrv of the sysfs paths of the slaves and from sysfs path to a set of
+   * the sysfs paths of the holders, protected by holders_lock */
+  GHashTable *slaves_by_holder;
+  GHashTable *holders_by_slave;
+  GMutex holders_lock;
+
   /* maps from VPD (serial, wwn) and sysfs_path to UDisksLinuxDriveObject instances */
   GHashTable *vpd_to_drive;
   GHashTable *sysfs_path_to_drive;
 
+  /* maps from whole-disk sysfs path to the VpdCacheEntry with the identity
+   * of the drive computed on the last uevent, dropped on "remove" */
+  GHashTable *sysfs_path_to_vpd;
+  guint vpd_cache_hits;
+  guint vpd_cache_misses;
+
   /* maps from array UUID and sysfs_path to UDisksLinuxMDRaidObject instances */
   GHashTable *uuid_to_mdraid;
   GHashTable *sysfs_path_to_mdraid;
   GHashTable *sysfs_path_to_mdraid_members;
 
+  /* maps from sysfs path to UDisksLinuxEnclosureObject instances */
+  GHashTable *sysfs_path_to_enclosure;
+
   /* maps from UDisksModuleObjectNewFuncs to nested hashtables containing object
    * skeleton instances as keys and GLists of consumed sysfs path as values */
   GHashTable *module_funcs_to_instances;
 
+  /* reverse index of module_funcs_to_instances, maps from sysfs path to
+   * nested hashtables with the instances that claimed it as keys and their
+   * UDisksModuleObjectNewFuncs as values */
+  GHashTable *module_sysfs_path_to_owners;
+
+  /* dispatch table mapping from UDisksModuleObjectNewFuncs to
+   * ModuleDispatchEntry structs, filled lazily with the (pre-compiled) match
+   * criteria declared by modules */
+  GHashTable *module_dispatch;
+
   GFileMonitor *etc_udisks2_dir_monitor;
+  GFileMonitor *etc_modules_conf_dir_monitor;
+
+  /* configuration files changed since the last reload, relative to
+   * /etc/udisks2, and the timeout coalescing them - main thread only */
+  GHashTable *pending_config_reloads;
+  guint config_reload_timeout;
 
   /* Module interfaces list */
   GList *module_ifaces;
+  /* the UDisksModuleNewManagerIfaceFunc pointers module_ifaces came from */
+  GHashTable *module_iface_funcs;
+
+  /* whether modules are loaded one by one for the devices they handle,
+   * see UDISKS_MODULE_LOAD_LAZY */
+  gboolean lazy_modules;
+  /* names of the modules already requested to load, protected by provider_lock */
+  GHashTable *lazy_module_requests;
 
   /* set to TRUE only in the coldplug phase */
   gboolean coldplug;
 
+  /* start-up coldplug statistics, see Manager:ColdplugStatistics */
+  guint64 coldplug_n_probed;
+  gint64 coldplug_probe_usec;
+  gint64 coldplug_export_usec;
+
+  /* probed device data kept across restarts if enabled in udisks2.conf - set
+   * before the coldplug with probe_lock held, used by the probing threads */
+  UDisksProbeSnapshot *probe_snapshot;
+  /* the coldplugged UDisksLinuxDevice instances restored from probe_snapshot,
+   * probed again once the coldplug is complete */
+  GPtrArray *probe_snapshot_restored;
+
+  /* only with --profile-startup: device name -> gint64* start-up usec */
+  GHashTable *profile_device_usec;
+
   guint housekeeping_timeout;
-  guint64 housekeeping_last;
-  gboolean housekeeping_running;
+
+  /* protects the housekeeping state below, see provider_lock for the order */
+  GMutex housekeeping_lock;
+
+  /* maps from UDisksModuleObjectNewFunc to ModuleHousekeeping - protected by housekeeping_lock */
+  GHashTable *module_housekeeping;
+
+  /* maps from UDisksLinuxDriveObject to DriveHousekeeping - protected by housekeeping_lock */
+  GHashTable *drive_housekeeping;
+  guint housekeeping_n_drives_seen;
+  guint housekeeping_n_running;
+  guint housekeeping_max_parallel;
+  /* maps from controller sysfs path to the number of its drives being housekept - protected by housekeeping_lock */
+  GHashTable *housekeeping_controller_n_running;
+  guint housekeeping_max_parallel_per_controller;
 };
 
+/* provider_lock protects the maps of the objects (sysfs_to_block, the
+ * drive, mdraid and enclosure maps and the module instances), all written
+ * only by the "uevent" thread which updates them together for every
+ * uevent, and the module dispatch. The housekeeping state has a lock of
+ * its own, housekeeping_lock, so that scheduling and finishing the
+ * housekeeping in the main thread never waits for a uevent being
+ * processed. When both are needed, provider_lock is taken first; the
+ * index locks (block_index_lock, drive_index_lock, holders_lock) and
+ * probe_lock are innermost and never held while taking another lock.
+ */
 G_LOCK_DEFINE_STATIC (provider_lock);
 
+/* monotonic time provider_lock was acquired, only valid while it's held */
+static gint64 provider_lock_acquired_time;
+/* longest time provider_lock has been held, in usec - protected by provider_lock */
+static gint64 provider_lock_hold_peak;
+
+/* the thresholds above which the uevent pipeline is reported as congested */
+#define PROBE_QUEUE_DEPTH_WARN 512
+#define PROBED_REQUESTS_WARN 256
+#define PROVIDER_LOCK_HOLD_WARN_USEC (500 * 1000)
+
+enum
+{
+  PROP_0,
+  PROP_PROBE_QUEUE_DEPTH,
+  PROP_PROBE_QUEUE_DEPTH_PEAK,
+  PROP_PROBED_REQUESTS_BACKLOG,
+  PROP_PROBED_REQUESTS_BACKLOG_PEAK,
+  PROP_PROVIDER_LOCK_HOLD_PEAK,
+};
+
 struct _UDisksLinuxProviderClass
 {
   UDisksProviderClass parent_class;
 };
 
+static void
+provider_lock_acquire (UDisksLinuxProvider *provider)
+{
+  G_LOCK (provider_lock);
+  provider_lock_acquired_time = g_get_monotonic_time ();
+}
+
+/* releases provider_lock taken in @function, recording how long it was held */
+static void
+provider_lock_release (UDisksLinuxProvider *provider,
+                       const gchar         *function)
+{
+  UDisksDaemon *daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  gint64 held;
+
+  held = g_get_monotonic_time () - provider_lock_acquired_time;
+  if (held > provider_lock_hold_peak)
+    provider_lock_hold_peak = held;
+  G_UNLOCK (provider_lock);
+
+  udisks_metrics_record (udisks_daemon_get_metrics (daemon), UDISKS_METRICS_KIND_LOCK, "provider_lock", held);
+  if (held > PROVIDER_LOCK_HOLD_WARN_USEC)
+    udisks_notice ("The provider lock was held for %" G_GINT64_FORMAT " msec in %s()",
+                   held / 1000, function);
+}
+
 static void udisks_linux_provider_handle_uevent (UDisksLinuxProvider *provider,
                                                  const gchar         *action,
                                                  UDisksLinuxDevice   *device);
+static void handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
+                                             const gchar         *action,
+                                             UDisksLinuxDevice   *device);
 
 static gboolean on_housekeeping_timeout (gpointer user_data);
+static void schedule_drive_housekeeping (UDisksLinuxProvider *provider);
+static void on_object_manager_object_added (GDBusObjectManager *manager,
+                                            GDBusObject        *object,
+                                            gpointer            user_data);
+static void on_object_manager_object_removed (GDBusObjectManager *manager,
+                                              GDBusObject        *object,
+                                              gpointer            user_data);
+static void drive_housekeeping_free (gpointer data);
 
 static void fstab_monitor_on_entry_added (UDisksFstabMonitor *monitor,
                                           UDisksFstabEntry   *entry,
@@ -135,13 +343,29 @@ static void utab_monitor_on_entry_removed (UDisksUtabMonitor *monitor,
                                            gpointer           user_data);
 #endif
 
+static void on_etc_modules_conf_dir_monitor_changed (GFileMonitor     *monitor,
+                                                     GFile            *file,
+                                                     GFile            *other_file,
+                                                     GFileMonitorEvent event_type,
+                                                     gpointer          user_data);
 static void on_etc_udisks2_dir_monitor_changed (GFileMonitor     *monitor,
                                                 GFile            *file,
                                                 GFile            *other_file,
                                                 GFileMonitorEvent event_type,
                                                 gpointer          user_data);
 
-gpointer probe_request_thread_func (gpointer user_data);
+static void probe_request_pool_func (gpointer data,
+                                     gpointer user_data);
+
+static void on_udev_data_dir_monitor_changed (GFileMonitor     *monitor,
+                                              GFile            *file,
+                                              GFile            *other_file,
+                                              GFileMonitorEvent event_type,
+                                              gpointer          user_data);
+
+static void module_dispatch_entry_free (gpointer data);
+
+static void vpd_cache_entry_free (gpointer data);
 
 G_DEFINE_TYPE (UDisksLinuxProvider, udisks_linux_provider, UDISKS_TYPE_PROVIDER);
 
@@ -151,10 +375,34 @@ udisks_linux_provider_finalize (GObject *object)
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (object);
   UDisksDaemon *daemon;
 
-  /* stop the request thread and wait for it */
-  g_async_queue_push (provider->probe_request_queue, (gpointer) 0xdeadbeef);
-  g_thread_join (provider->probe_request_thread);
-  g_async_queue_unref (provider->probe_request_queue);
+  /* stop the probing threads and wait for them */
+  g_thread_pool_free (provider->probe_pool, TRUE, TRUE);
+
+  /* stop the uevent thread and wait for it */
+  g_main_loop_quit (provider->uevent_loop);
+  g_thread_join (provider->uevent_thread);
+  g_main_loop_unref (provider->uevent_loop);
+  if (provider->probe_snapshot != NULL)
+    udisks_probe_snapshot_free (provider->probe_snapshot);
+  if (provider->udev_data_dir_monitor != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (provider->udev_data_dir_monitor,
+                                            G_CALLBACK (on_udev_data_dir_monitor_changed),
+                                            provider);
+      g_object_unref (provider->udev_data_dir_monitor);
+    }
+  g_hash_table_unref (provider->sysfs_path_to_parked_probe);
+  g_hash_table_unref (provider->sysfs_path_to_probe_requests);
+  if (provider->probed_requests_source != NULL)
+    {
+      g_source_destroy (provider->probed_requests_source);
+      g_source_unref (provider->probed_requests_source);
+    }
+  g_queue_foreach (&provider->probed_requests, (GFunc) probe_request_free, NULL);
+  g_queue_clear (&provider->probed_requests);
+  g_mutex_clear (&provider->probe_lock);
+  g_mutex_clear (&provider->housekeeping_lock);
+  g_main_context_unref (provider->uevent_context);
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
 
@@ -165,24 +413,63 @@ udisks_linux_provider_finalize (GObject *object)
                                             provider);
       g_object_unref (provider->etc_udisks2_dir_monitor);
     }
+  if (provider->etc_modules_conf_dir_monitor != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (provider->etc_modules_conf_dir_monitor,
+                                            G_CALLBACK (on_etc_modules_conf_dir_monitor_changed),
+                                            provider);
+      g_object_unref (provider->etc_modules_conf_dir_monitor);
+    }
+  if (provider->config_reload_timeout > 0)
+    g_source_remove (provider->config_reload_timeout);
+  if (provider->uevent_resync_id > 0)
+    g_source_remove (provider->uevent_resync_id);
+  g_hash_table_unref (provider->pending_config_reloads);
 
   g_hash_table_unref (provider->sysfs_to_block);
+  g_hash_table_unref (provider->block_index_by_device_file);
+  g_hash_table_unref (provider->block_index_by_device_number);
+  g_hash_table_unref (provider->block_index_by_sysfs_path);
+  g_mutex_clear (&provider->block_index_lock);
+  g_hash_table_unref (provider->drive_index_by_sysfs_path);
+  g_mutex_clear (&provider->drive_index_lock);
+  g_hash_table_unref (provider->holders_by_slave);
+  g_hash_table_unref (provider->slaves_by_holder);
+  g_mutex_clear (&provider->holders_lock);
   g_hash_table_unref (provider->vpd_to_drive);
   g_hash_table_unref (provider->sysfs_path_to_drive);
+  g_hash_table_unref (provider->sysfs_path_to_vpd);
   g_hash_table_unref (provider->uuid_to_mdraid);
   g_hash_table_unref (provider->sysfs_path_to_mdraid);
   g_hash_table_unref (provider->sysfs_path_to_mdraid_members);
+  g_hash_table_unref (provider->sysfs_path_to_enclosure);
+  g_hash_table_unref (provider->module_sysfs_path_to_owners);
   g_hash_table_unref (provider->module_funcs_to_instances);
+  g_hash_table_unref (provider->module_dispatch);
   g_object_unref (provider->gudev_client);
 
   g_list_free (provider->module_ifaces);
+  g_hash_table_unref (provider->module_iface_funcs);
+  g_hash_table_unref (provider->lazy_module_requests);
 
   udisks_object_skeleton_set_manager (provider->manager_object, NULL);
   g_object_unref (provider->manager_object);
 
   if (provider->housekeeping_timeout > 0)
     g_source_remove (provider->housekeeping_timeout);
-
+  if (provider->drive_housekeeping != NULL)
+    g_hash_table_unref (provider->drive_housekeeping);
+  if (provider->housekeeping_controller_n_running != NULL)
+    g_hash_table_unref (provider->housekeeping_controller_n_running);
+  if (provider->module_housekeeping != NULL)
+    g_hash_table_unref (provider->module_housekeeping);
+
+  g_signal_handlers_disconnect_by_func (udisks_daemon_get_object_manager (daemon),
+                                        G_CALLBACK (on_object_manager_object_added),
+                                        provider);
+  g_signal_handlers_disconnect_by_func (udisks_daemon_get_object_manager (daemon),
+                                        G_CALLBACK (on_object_manager_object_removed),
+                                        provider);
   g_signal_handlers_disconnect_by_func (udisks_daemon_get_fstab_monitor (daemon),
                                         G_CALLBACK (fstab_monitor_on_entry_added),
                                         provider);
@@ -205,54 +492,350 @@ udisks_linux_provider_finalize (GObject *object)
 typedef struct
 {
   UDisksLinuxProvider *provider;
+  gchar *action;
   GUdevDevice *udev_device;
   UDisksLinuxDevice *udisks_device;
+  /* set once we've given up waiting for udev to initialize the device */
+  gboolean skip_init_wait;
+  /* monotonic time the request entered the current stage, for the metrics */
+  gint64 stage_start_time;
 } ProbeRequest;
 
 static void
 probe_request_free (ProbeRequest *request)
 {
   g_clear_object (&request->provider);
+  g_free (request->action);
   g_clear_object (&request->udev_device);
   g_clear_object (&request->udisks_device);
   g_slice_free (ProbeRequest, request);
 }
 
+/* records the time @request spent in @stage and starts the next stage */
+static void
+probe_request_record_stage (ProbeRequest *request,
+                            const gchar  *stage)
+{
+  UDisksDaemon *daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (request->provider));
+  gint64 now = g_get_monotonic_time ();
+
+  udisks_metrics_record (udisks_daemon_get_metrics (daemon),
+                         UDISKS_METRICS_KIND_UEVENT,
+                         stage,
+                         now - request->stage_start_time);
+  request->stage_start_time = now;
+}
+
+/* called with probe_lock held */
+static void
+probe_queue_depth_changed (UDisksLinuxProvider *provider,
+                           gint                 delta)
+{
+  provider->probe_queue_depth += delta;
+  if (provider->probe_queue_depth > provider->probe_queue_depth_peak)
+    provider->probe_queue_depth_peak = provider->probe_queue_depth;
+
+  /* only report crossing the threshold once, until the queue drains to half */
+  if (!provider->probe_queue_depth_warned && provider->probe_queue_depth > PROBE_QUEUE_DEPTH_WARN)
+    {
+      udisks_notice ("More than %u uevents are waiting to be probed", PROBE_QUEUE_DEPTH_WARN);
+      provider->probe_queue_depth_warned = TRUE;
+    }
+  else if (provider->probe_queue_depth_warned && provider->probe_queue_depth < PROBE_QUEUE_DEPTH_WARN / 2)
+    {
+      udisks_notice ("The uevent probe queue has drained (%u uevents, at most %u)",
+                     provider->probe_queue_depth, provider->probe_queue_depth_peak);
+      provider->probe_queue_depth_warned = FALSE;
+    }
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* called in main thread with a processed ProbeRequest struct - see probe_request_thread_func() */
+/* Probed requests are applied in batches: the first request to complete
+ * schedules a timeout and every request that completes before it fires is
+ * applied within the same main loop dispatch. Property changes on one
+ * interface made during a dispatch end up in a single PropertiesChanged
+ * signal, so this cuts down the signals emitted for bursts of uevents such
+ * as those following a partition table rewrite.
+ */
+#define PROBED_REQUESTS_BATCH_MSEC 10
+
+/* called in the "uevent" thread with the ProbeRequest structs processed since
+ * the last run - see probe_request_pool_func() */
 static gboolean
-on_idle_with_probed_uevent (gpointer user_data)
+on_probed_requests_timeout (gpointer user_data)
 {
-  ProbeRequest *request = user_data;
-  udisks_linux_provider_handle_uevent (request->provider,
-                                       g_udev_device_get_action (request->udev_device),
-                                       request->udisks_device);
-  probe_request_free (request);
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  GQueue requests = G_QUEUE_INIT;
+  ProbeRequest *request;
+  gint64 start_time;
+  guint n_requests;
+
+  g_object_ref (provider);
+
+  g_mutex_lock (&provider->probe_lock);
+  requests = provider->probed_requests;
+  g_queue_init (&provider->probed_requests);
+  /* report the next backlog once the batches get small again */
+  if (requests.length < PROBED_REQUESTS_WARN / 2)
+    provider->probed_requests_warned = FALSE;
+  g_source_unref (provider->probed_requests_source);
+  provider->probed_requests_source = NULL;
+  g_mutex_unlock (&provider->probe_lock);
+
+  start_time = g_get_monotonic_time ();
+  n_requests = requests.length;
+  while ((request = g_queue_pop_head (&requests)) != NULL)
+    {
+      probe_request_record_stage (request, "apply-wait");
+      UDISKS_TRACE2 (uevent_apply_start, request->action, g_udev_device_get_sysfs_path (request->udev_device));
+      udisks_linux_provider_handle_uevent (request->provider,
+                                           request->action,
+                                           request->udisks_device);
+      UDISKS_TRACE2 (uevent_apply_done, request->action, g_udev_device_get_sysfs_path (request->udev_device));
+      probe_request_record_stage (request, "apply");
+      probe_request_free (request);
+    }
+  udisks_debug ("Applied %u uevent(s) in %" G_GINT64_FORMAT " usec",
+                n_requests, g_get_monotonic_time () - start_time);
+
+  g_object_unref (provider);
+
   return FALSE; /* remove source */
 }
 
+/* called in a probing thread with a processed ProbeRequest struct */
+static void
+post_probed_request (UDisksLinuxProvider *provider,
+                     ProbeRequest        *request)
+{
+  g_mutex_lock (&provider->probe_lock);
+  g_queue_push_tail (&provider->probed_requests, request);
+  if (provider->probed_requests.length > provider->probed_requests_peak)
+    provider->probed_requests_peak = provider->probed_requests.length;
+  if (!provider->probed_requests_warned && provider->probed_requests.length > PROBED_REQUESTS_WARN)
+    {
+      udisks_notice ("More than %u probed uevents are waiting to be applied", PROBED_REQUESTS_WARN);
+      provider->probed_requests_warned = TRUE;
+    }
+  if (provider->probed_requests_source == NULL)
+    {
+      provider->probed_requests_source = g_timeout_source_new (PROBED_REQUESTS_BATCH_MSEC);
+      g_source_set_callback (provider->probed_requests_source, on_probed_requests_timeout, provider, NULL);
+      g_source_attach (provider->probed_requests_source, provider->uevent_context);
+    }
+  g_mutex_unlock (&provider->probe_lock);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
-gpointer
-probe_request_thread_func (gpointer user_data)
+static gpointer
+uevent_thread_func (gpointer user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+
+  /* Note that provider->uevent_context is deliberately not pushed as the
+   * thread-default context: interface skeletons created while applying uevents
+   * should still dispatch method calls and emit property changes in the main
+   * thread.
+   */
+  g_main_loop_run (provider->uevent_loop);
+
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Upper bound for the number of devices probed concurrently. Probing is
+ * mostly waiting for the device to answer ATA IDENTIFY so this is not
+ * tied to the number of CPUs.
+ */
+#define MAX_PROBE_THREADS 16
+
+/* How long to wait for udev to initialize a device before probing it anyway */
+#define PROBE_INIT_WAIT_TIMEOUT_MSEC 500
+
+/* Directory with the udev database, files are named b<major>:<minor> for block devices */
+#define UDEV_DATA_DIR "/run/udev/data"
+
+/* A device that is not yet initialized by udev. Its queue of requests stays in
+ * provider->sysfs_path_to_probe_requests but no probing thread works on it
+ * until the device becomes initialized or the timeout is reached.
+ */
+typedef struct
+{
+  UDisksLinuxProvider *provider;
+  gchar *sysfs_path;
+  gchar *udev_db_name;
+  guint timeout_id;
+} ParkedProbe;
+
+static void
+parked_probe_free (ParkedProbe *parked)
+{
+  if (parked->timeout_id > 0)
+    g_source_remove (parked->timeout_id);
+  g_free (parked->sysfs_path);
+  g_free (parked->udev_db_name);
+  g_slice_free (ParkedProbe, parked);
+}
+
+static void
+probe_request_queue_free (GQueue *queue)
+{
+  g_queue_free_full (queue, (GDestroyNotify) probe_request_free);
+}
+
+/* called in main thread with probe_lock held
+ *
+ * Refreshes the udev data for the request at the head of the parked queue and
+ * hands the queue back to the probing threads if the device is initialized now
+ * or if @force is %TRUE. Returns %TRUE if the device was unparked.
+ */
+static gboolean
+unpark_probe (UDisksLinuxProvider *provider,
+              ParkedProbe         *parked,
+              gboolean             force)
+{
+  GQueue *queue;
   ProbeRequest *request;
-  gboolean dev_initialized = FALSE;
-  guint n_tries = 0;
+  GUdevDevice *refreshed;
+  gboolean initialized = FALSE;
 
-  do
+  queue = g_hash_table_lookup (provider->sysfs_path_to_probe_requests, parked->sysfs_path);
+  request = queue != NULL ? g_queue_peek_head (queue) : NULL;
+  if (request != NULL)
     {
-      request = g_async_queue_pop (provider->probe_request_queue);
+      /* GUdevDevice caches the udev database so we need a new instance to see the change */
+      refreshed = g_udev_client_query_by_sysfs_path (provider->gudev_client, parked->sysfs_path);
+      if (refreshed != NULL)
+        {
+          initialized = g_udev_device_get_is_initialized (refreshed);
+          if (initialized || force)
+            {
+              g_object_unref (request->udev_device);
+              request->udev_device = g_object_ref (refreshed);
+            }
+          g_object_unref (refreshed);
+        }
+      if (!initialized && !force)
+        return FALSE;
+      if (!initialized)
+        {
+          udisks_debug ("Timed out waiting for udev to initialize %s", parked->sysfs_path);
+          request->skip_init_wait = TRUE;
+        }
+    }
 
-      /* used by _finalize() above to stop this thread - if received, we can
-       * no longer use @provider
-       */
-      if (request == (gpointer) 0xdeadbeef)
-        goto out;
+  g_thread_pool_push (provider->probe_pool, g_strdup (parked->sysfs_path), NULL);
+  g_hash_table_remove (provider->sysfs_path_to_parked_probe, parked->sysfs_path);
+  return TRUE;
+}
+
+/* called in main thread */
+static gboolean
+on_parked_probe_timeout (gpointer user_data)
+{
+  ParkedProbe *parked = user_data;
+  UDisksLinuxProvider *provider = parked->provider;
+
+  g_mutex_lock (&provider->probe_lock);
+  parked->timeout_id = 0;
+  unpark_probe (provider, parked, TRUE);
+  g_mutex_unlock (&provider->probe_lock);
+
+  return FALSE; /* remove source */
+}
+
+/* called in main thread */
+static void
+on_udev_data_dir_monitor_changed (GFileMonitor     *monitor,
+                                  GFile            *file,
+                                  GFile            *other_file,
+                                  GFileMonitorEvent event_type,
+                                  gpointer          user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  GHashTableIter iter;
+  ParkedProbe *parked;
+  gchar *db_name;
+
+  if (event_type != G_FILE_MONITOR_EVENT_CREATED &&
+      event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    return;
+
+  g_mutex_lock (&provider->probe_lock);
+  if (g_hash_table_size (provider->sysfs_path_to_parked_probe) > 0)
+    {
+      db_name = g_file_get_basename (file);
+      g_hash_table_iter_init (&iter, provider->sysfs_path_to_parked_probe);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &parked))
+        {
+          if (g_strcmp0 (parked->udev_db_name, db_name) == 0)
+            {
+              /* unpark_probe() may remove the entry itself, that's fine since we stop iterating */
+              unpark_probe (provider, parked, FALSE);
+              break;
+            }
+        }
+      g_free (db_name);
+    }
+  g_mutex_unlock (&provider->probe_lock);
+}
+
+/* called in a probing thread with probe_lock held */
+static void
+park_probe (UDisksLinuxProvider *provider,
+            const gchar         *sysfs_path,
+            GUdevDevice         *udev_device)
+{
+  ParkedProbe *parked;
+  dev_t dev;
+
+  parked = g_slice_new0 (ParkedProbe);
+  parked->provider = provider;
+  parked->sysfs_path = g_strdup (sysfs_path);
+  dev = g_udev_device_get_device_number (udev_device);
+  if (dev != 0)
+    parked->udev_db_name = g_strdup_printf ("%c%u:%u",
+                                            g_strcmp0 (g_udev_device_get_subsystem (udev_device), "block") == 0 ? 'b' : 'c',
+                                            major (dev), minor (dev));
+  parked->timeout_id = g_timeout_add (PROBE_INIT_WAIT_TIMEOUT_MSEC, on_parked_probe_timeout, parked);
+  g_hash_table_replace (provider->sysfs_path_to_parked_probe, parked->sysfs_path, parked);
+}
+
+/* Runs in a thread from provider->probe_pool with @data being the sysfs path
+ * of the device to probe. All requests queued for the particular sysfs path
+ * are processed by this one thread in order, while other threads tend to other
+ * devices. Since sources of the same priority are dispatched in the order
+ * they were attached, the uevents for the sysfs path are delivered to the main
+ * thread in their original order.
+ */
+static void
+probe_request_pool_func (gpointer data,
+                         gpointer user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  gchar *sysfs_path = data;
+  ProbeRequest *request;
+  GQueue *queue;
+  UDisksProbeSnapshot *snapshot;
+
+  do
+    {
+      g_mutex_lock (&provider->probe_lock);
+      queue = g_hash_table_lookup (provider->sysfs_path_to_probe_requests, sysfs_path);
+      request = queue != NULL ? g_queue_peek_head (queue) : NULL;
+      if (request == NULL)
+        {
+          /* nothing more to do for this device, let on_uevent() know a new
+           * probing thread needs to be requested for further uevents */
+          g_hash_table_remove (provider->sysfs_path_to_probe_requests, sysfs_path);
+          g_mutex_unlock (&provider->probe_lock);
+          break;
+        }
 
-      /* Try to wait for the device to become initialized(*) before we start
+      /* Wait for the device to become initialized(*) before we start
        * gathering data for it.
        *
        * (*) "Check if udev has already handled the device and has set up device
@@ -261,28 +844,46 @@ probe_request_thread_func (gpointer user_data)
        *      interfaces. All other devices return 1 here."
        *        -- UDEV docs
        *
-       * */
-      dev_initialized = g_udev_device_get_is_initialized (request->udev_device);
-      for (n_tries=5; !dev_initialized && (n_tries > 0); n_tries--)
-      {
-        g_usleep (100000);      /* microseconds */
-        dev_initialized = g_udev_device_get_is_initialized (request->udev_device);
-      }
+       * Instead of blocking this thread, the device is parked together with
+       * the rest of its queue and handed back to the pool once udev updates
+       * its database, another uevent arrives for it or the timeout is reached.
+       */
+      if (!request->skip_init_wait && !g_udev_device_get_is_initialized (request->udev_device))
+        {
+          park_probe (provider, sysfs_path, request->udev_device);
+          g_mutex_unlock (&provider->probe_lock);
+          break;
+        }
+      g_queue_pop_head (queue);
+      probe_queue_depth_changed (provider, -1);
+      snapshot = provider->probe_snapshot;
+      g_mutex_unlock (&provider->probe_lock);
 
       /* probe the device - this may take a while */
+      probe_request_record_stage (request, "probe-wait");
       request->udisks_device = udisks_linux_device_new_sync (request->udev_device);
+      probe_request_record_stage (request, "probe");
+
+      if (snapshot != NULL)
+        {
+          if (g_strcmp0 (request->action, "remove") == 0)
+            udisks_probe_snapshot_remove (snapshot, g_udev_device_get_sysfs_path (request->udev_device));
+          else
+            udisks_probe_snapshot_store (snapshot, request->udisks_device);
+        }
 
       /* now that we've probed the device, post the request back to the main thread */
-      g_idle_add (on_idle_with_probed_uevent, request);
+      post_probed_request (provider, request);
     }
   while (TRUE);
 
- out:
-  return NULL;
+  g_free (sysfs_path);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void check_uevent_overflow (UDisksLinuxProvider *provider);
+
 static void
 on_uevent (GUdevClient  *client,
            const gchar  *action,
@@ -291,1138 +892,3572 @@ on_uevent (GUdevClient  *client,
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
   ProbeRequest *request;
+  const gchar *sysfs_path;
+  GQueue *queue;
+  ParkedProbe *parked;
+
+  check_uevent_overflow (provider);
 
   request = g_slice_new0 (ProbeRequest);
   request->provider = g_object_ref (provider);
+  request->action = g_strdup (action);
   request->udev_device = g_object_ref (device);
+  request->stage_start_time = g_get_monotonic_time ();
 
-  /* process uevent in "probing-thread" */
-  g_async_queue_push (provider->probe_request_queue, request);
-}
-
-/* ---------------------------------------------------------------------------------------------------- */
-
-static void
-udisks_linux_provider_init (UDisksLinuxProvider *provider)
-{
-  const gchar *subsystems[] = {"block", "iscsi_connection", "scsi", NULL};
-  GFile *file;
-  GError *error = NULL;
-
-  /* get ourselves an udev client */
-  provider->gudev_client = g_udev_client_new (subsystems);
-
-  g_signal_connect (provider->gudev_client,
-                    "uevent",
-                    G_CALLBACK (on_uevent),
-                    provider);
-
-  provider->probe_request_queue = g_async_queue_new ();
-  provider->probe_request_thread = g_thread_new ("probing-thread",
-                                                 probe_request_thread_func,
-                                                 provider);
+  sysfs_path = g_udev_device_get_sysfs_path (device);
+  UDISKS_TRACE2 (uevent_received, action, sysfs_path);
 
-  file = g_file_new_for_path (PACKAGE_SYSCONF_DIR "/udisks2");
-  provider->etc_udisks2_dir_monitor = g_file_monitor_directory (file,
-                                                                G_FILE_MONITOR_NONE,
-                                                                NULL,
-                                                                &error);
-  if (provider->etc_udisks2_dir_monitor != NULL)
+  /* process uevent in one of the "probing" threads - if there already is a
+   * thread working on this device, just append the request to its queue so
+   * the uevents are not reordered
+   */
+  g_mutex_lock (&provider->probe_lock);
+  provider->num_uevents++;
+  queue = g_hash_table_lookup (provider->sysfs_path_to_probe_requests, sysfs_path);
+  if (queue != NULL)
     {
-      g_signal_connect (provider->etc_udisks2_dir_monitor,
-                        "changed",
-                        G_CALLBACK (on_etc_udisks2_dir_monitor_changed),
-                        provider);
+      ProbeRequest *pending = g_queue_peek_tail (queue);
+
+      /* Coalesce bursts of "change" uevents (mkfs, partprobe, ...) - requests
+       * in the queue have not been probed yet so a newer "change" request can
+       * simply replace a pending one. Anything else is queued as is so the
+       * relative order of "add" and "remove" uevents is kept. Uevents tagged
+       * with a SYNTH_UUID are kept too, someone may be waiting for them, see
+       * udisks_linux_block_object_trigger_uevent_sync().
+       */
+      if (pending != NULL &&
+          g_strcmp0 (action, "change") == 0 &&
+          g_strcmp0 (pending->action, "change") == 0 &&
+          g_udev_device_get_property (pending->udev_device, "SYNTH_UUID") == NULL)
+        {
+          udisks_debug ("coalescing change uevent for %s", sysfs_path);
+          probe_request_free (g_queue_pop_tail (queue));
+          provider->probe_queue_depth--;
+        }
+      g_queue_push_tail (queue, request);
+
+      /* a follow-up uevent for a parked device is a good time to check it again */
+      parked = g_hash_table_lookup (provider->sysfs_path_to_parked_probe, sysfs_path);
+      if (parked != NULL)
+        unpark_probe (provider, parked, FALSE);
     }
   else
     {
-      udisks_warning ("Error monitoring directory %s: %s (%s, %d)",
-                      PACKAGE_SYSCONF_DIR "/udisks2",
-                      error->message, g_quark_to_string (error->domain), error->code);
-      g_clear_error (&error);
+      queue = g_queue_new ();
+      g_queue_push_tail (queue, request);
+      g_hash_table_insert (provider->sysfs_path_to_probe_requests, g_strdup (sysfs_path), queue);
+      g_thread_pool_push (provider->probe_pool, g_strdup (sysfs_path), NULL);
     }
-  g_object_unref (file);
-
-  provider->module_ifaces = NULL;
+  probe_queue_depth_changed (provider, +1);
+  g_mutex_unlock (&provider->probe_lock);
 }
 
-static void
-synthesize_uevent_for_id (UDisksLinuxProvider *provider,
-                          const gchar         *id,
-                          const gchar         *action)
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
 {
-  GHashTableIter iter;
-  UDisksLinuxDriveObject *drive_object;
+  UDisksLinuxBlockObject *object;
+  gchar *sysfs_path;
+  gint64 device_number;
+  gchar *device_file;
+} BlockIndexEntry;
 
-  /* TODO: could have a GHashTable from id to UDisksLinuxDriveObject */
-  g_hash_table_iter_init (&iter, provider->sysfs_path_to_drive);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &drive_object))
-    {
-      UDisksDrive *drive = udisks_object_get_drive (UDISKS_OBJECT (drive_object));
-      if (drive != NULL)
-        {
-          if (g_strcmp0 (udisks_drive_get_id (drive), id) == 0)
-            {
-              udisks_debug ("synthesizing %s event on drive with id %s", action, id);
-              udisks_linux_drive_object_uevent (drive_object, action, NULL);
-            }
-          g_object_unref (drive);
-        }
-    }
+static void
+block_index_entry_free (BlockIndexEntry *entry)
+{
+  g_object_unref (entry->object);
+  g_free (entry->sysfs_path);
+  g_free (entry->device_file);
+  g_slice_free (BlockIndexEntry, entry);
 }
 
-static gchar *
-dup_id_from_config_name (const gchar *conf_filename)
+/* called with block_index_lock held */
+static void
+block_index_remove_locked (UDisksLinuxProvider *provider,
+                           const gchar         *sysfs_path)
 {
-  gchar *id;
+  BlockIndexEntry *entry;
 
-  udisks_debug ("Found config file %s", conf_filename);
+  entry = g_hash_table_lookup (provider->block_index_by_sysfs_path, sysfs_path);
+  if (entry == NULL)
+    return;
 
-  if (g_str_has_suffix (conf_filename, ".conf"))
-    {
-      id = g_strndup (conf_filename, strlen (conf_filename) - 5);
-      return id;
-    }
-  return NULL;
+  if (g_hash_table_lookup (provider->block_index_by_device_number, &entry->device_number) == entry)
+    g_hash_table_remove (provider->block_index_by_device_number, &entry->device_number);
+  if (entry->device_file != NULL &&
+      g_hash_table_lookup (provider->block_index_by_device_file, entry->device_file) == entry)
+    g_hash_table_remove (provider->block_index_by_device_file, entry->device_file);
+  g_hash_table_remove (provider->block_index_by_sysfs_path, sysfs_path);
 }
 
+/* called in the "uevent" thread with provider_lock held
+ *
+ * (Re-)indexes @object under the current device number and device file of
+ * @device or drops it from the indexes if @object is %NULL.
+ */
 static void
-on_etc_udisks2_dir_monitor_changed (GFileMonitor     *monitor,
-                                    GFile            *file,
-                                    GFile            *other_file,
-                                    GFileMonitorEvent event_type,
-                                    gpointer          user_data)
+block_index_update (UDisksLinuxProvider    *provider,
+                    const gchar            *sysfs_path,
+                    UDisksLinuxBlockObject *object,
+                    UDisksLinuxDevice      *device)
 {
-  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  BlockIndexEntry *entry;
 
-  if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
-      event_type == G_FILE_MONITOR_EVENT_DELETED ||
-      event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+  g_mutex_lock (&provider->block_index_lock);
+  block_index_remove_locked (provider, sysfs_path);
+  if (object != NULL)
     {
-      gchar *filename = g_file_get_basename (file);
-      gchar *id = dup_id_from_config_name (filename);
-      if (id)
-          synthesize_uevent_for_id (provider, id, "change");
-      g_free (id);
-      g_free (filename);
+      entry = g_slice_new0 (BlockIndexEntry);
+      entry->object = g_object_ref (object);
+      entry->sysfs_path = g_strdup (sysfs_path);
+      entry->device_number = g_udev_device_get_device_number (device->udev_device);
+      entry->device_file = g_strdup (g_udev_device_get_device_file (device->udev_device));
+      g_hash_table_insert (provider->block_index_by_sysfs_path, entry->sysfs_path, entry);
+      g_hash_table_insert (provider->block_index_by_device_number, &entry->device_number, entry);
+      if (entry->device_file != NULL)
+        g_hash_table_insert (provider->block_index_by_device_file, entry->device_file, entry);
     }
+  g_mutex_unlock (&provider->block_index_lock);
 }
 
-static guint
-count_alphas (const gchar *str)
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called in the "uevent" thread with provider_lock held
+ *
+ * Makes @sysfs_path point to @object in the drive index or drops it from
+ * the index if @object is %NULL.
+ */
+static void
+drive_index_update (UDisksLinuxProvider    *provider,
+                    const gchar            *sysfs_path,
+                    UDisksLinuxDriveObject *object)
 {
-  guint n = 0;
-  while (g_ascii_isalpha (str[n]))
-    n++;
-  return n;
+  g_mutex_lock (&provider->drive_index_lock);
+  if (object != NULL)
+    g_hash_table_replace (provider->drive_index_by_sysfs_path, g_strdup (sysfs_path), g_object_ref (object));
+  else
+    g_hash_table_remove (provider->drive_index_by_sysfs_path, sysfs_path);
+  g_mutex_unlock (&provider->drive_index_lock);
 }
 
-static gint
-device_name_cmp (const gchar *a,
-                 const gchar *b)
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called in the "uevent" thread with provider_lock held
+ *
+ * Replaces the edges from @sysfs_path to its slaves in the holders/slaves
+ * graph with the ones currently in sysfs or drops @sysfs_path from the
+ * graph if @remove is %TRUE.
+ */
+static void
+holders_graph_update (UDisksLinuxProvider *provider,
+                      const gchar         *sysfs_path,
+                      gboolean             remove)
 {
-  /* Ensures that sda comes before sdz%d and sdz%d comes before sdaa%d */
-  if (g_str_has_prefix (a, "sd") && g_str_has_prefix (b, "sd"))
+  gchar **slaves = NULL;
+  gchar **old_slaves;
+  GHashTable *holders;
+  guint n;
+
+  if (!remove)
     {
-      gint la = count_alphas (a);
-      gint lb = count_alphas (b);
-      if (la != lb)
-        return la - lb;
-      else
-        return g_strcmp0 (a, b);
+      slaves = udisks_daemon_util_resolve_links (sysfs_path, "slaves");
+      if (slaves == NULL)
+        slaves = g_new0 (gchar *, 1);
+    }
+
+  g_mutex_lock (&provider->holders_lock);
+
+  old_slaves = g_hash_table_lookup (provider->slaves_by_holder, sysfs_path);
+  for (n = 0; old_slaves != NULL && old_slaves[n] != NULL; n++)
+    {
+      holders = g_hash_table_lookup (provider->holders_by_slave, old_slaves[n]);
+      if (holders == NULL)
+        continue;
+      g_hash_table_remove (holders, sysfs_path);
+      if (g_hash_table_size (holders) == 0)
+        g_hash_table_remove (provider->holders_by_slave, old_slaves[n]);
+    }
+
+  if (slaves != NULL)
+    {
+      for (n = 0; slaves[n] != NULL; n++)
+        {
+          holders = g_hash_table_lookup (provider->holders_by_slave, slaves[n]);
+          if (holders == NULL)
+            {
+              holders = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+              g_hash_table_insert (provider->holders_by_slave, g_strdup (slaves[n]), holders);
+            }
+          g_hash_table_add (holders, g_strdup (sysfs_path));
+        }
+      g_hash_table_replace (provider->slaves_by_holder, g_strdup (sysfs_path), slaves);
     }
   else
     {
-      return g_strcmp0 (a, b);
+      g_hash_table_remove (provider->slaves_by_holder, sysfs_path);
+      g_hash_table_remove (provider->holders_by_slave, sysfs_path);
     }
-}
 
-static gint
-udev_device_name_cmp (GUdevDevice *a,
-                      GUdevDevice *b)
-{
-  return device_name_cmp (g_udev_device_get_name (a), g_udev_device_get_name (b));
+  g_mutex_unlock (&provider->holders_lock);
 }
 
-static GList *
-get_udisks_devices (UDisksLinuxProvider *provider)
-{
-  GList *devices;
-  GList *udisks_devices;
-  GList *l;
+/* ---------------------------------------------------------------------------------------------------- */
 
-  devices = g_udev_client_query_by_subsystem (provider->gudev_client, "block");
+/* Returns the file descriptors of all the NETLINK_KOBJECT_UEVENT sockets of the process */
+static GArray *
+list_uevent_sockets (void)
+{
+  GArray *ret;
+  GDir *dir;
+  const gchar *name;
 
-  /* make sure we process sda before sdz and sdz before sdaa */
-  devices = g_list_sort (devices, (GCompareFunc) udev_device_name_cmp);
+  ret = g_array_new (FALSE, FALSE, sizeof (gint));
+  dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  if (dir == NULL)
+    return ret;
 
-  udisks_devices = NULL;
-  for (l = devices; l != NULL; l = l->next)
+  while ((name = g_dir_read_name (dir)) != NULL)
     {
-      GUdevDevice *device = G_UDEV_DEVICE (l->data);
-      if (!g_udev_device_get_is_initialized (device))
+      gint fd = atoi (name);
+      gint value;
+      socklen_t len;
+
+      len = sizeof (value);
+      if (getsockopt (fd, SOL_SOCKET, SO_DOMAIN, &value, &len) != 0 || value != AF_NETLINK)
+        continue;
+      len = sizeof (value);
+      if (getsockopt (fd, SOL_SOCKET, SO_PROTOCOL, &value, &len) != 0 || value != NETLINK_KOBJECT_UEVENT)
         continue;
-      udisks_devices = g_list_prepend (udisks_devices, udisks_linux_device_new_sync (device));
+      g_array_append_val (ret, fd);
     }
-  udisks_devices = g_list_reverse (udisks_devices);
-  g_list_free_full (devices, g_object_unref);
+  g_dir_close (dir);
 
-  return udisks_devices;
+  return ret;
 }
 
-static void
-do_coldplug (UDisksLinuxProvider *provider,
-             GList               *udisks_devices)
+/* Returns the first socket in @after that is not in @before or -1 */
+static gint
+find_new_uevent_socket (GArray *before,
+                        GArray *after)
 {
-  GList *l;
+  guint n, m;
 
-  for (l = udisks_devices; l != NULL; l = l->next)
+  for (n = 0; n < after->len; n++)
     {
-      UDisksLinuxDevice *device = l->data;
-      udisks_linux_provider_handle_uevent (provider, "add", device);
+      gint fd = g_array_index (after, gint, n);
+
+      for (m = 0; m < before->len; m++)
+        if (g_array_index (before, gint, m) == fd)
+          break;
+      if (m == before->len)
+        return fd;
     }
+
+  return -1;
 }
 
-static void
-ensure_modules (UDisksLinuxProvider *provider)
+/* Gets the number of packets the kernel dropped on @fd because its receive buffer was full */
+static gboolean
+get_uevent_socket_drops (gint     fd,
+                         guint32 *out_drops)
 {
-  UDisksDaemon *daemon;
-  UDisksModuleManager *module_manager;
-  GDBusInterfaceSkeleton *iface;
-  UDisksModuleNewManagerIfaceFunc new_manager_iface_func;
-  GList *udisks_devices;
-  GList *l;
-  gboolean do_refresh = FALSE;
-  gboolean loaded;
+#ifdef SO_MEMINFO
+  guint32 meminfo[SK_MEMINFO_VARS];
+  socklen_t len = sizeof (meminfo);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) != 0 ||
+      len <= SK_MEMINFO_DROPS * sizeof (guint32))
+    return FALSE;
+  *out_drops = meminfo[SK_MEMINFO_DROPS];
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
 
-  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
-  module_manager = udisks_daemon_get_module_manager (daemon);
+/* called in main thread
+ *
+ * Brings the block objects back in line with the kernel after uevents were
+ * lost: devices in sysfs without an object get an "add" uevent and objects
+ * whose device is gone get a "remove" uevent, the rest is left alone.
+ */
+static gboolean
+on_uevent_resync (gpointer user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  GHashTable *present;
+  GHashTableIter iter;
+  BlockIndexEntry *entry;
+  GList *devices;
+  GList *stale = NULL;
+  GList *l;
+  guint n_added = 0;
+  guint n_removed = 0;
 
-  loaded = udisks_module_manager_get_modules_available (module_manager);
+  provider->uevent_resync_id = 0;
 
-  if (loaded)
+  present = g_hash_table_new (g_str_hash, g_str_equal);
+  devices = g_udev_client_query_by_subsystem (provider->gudev_client, "block");
+  for (l = devices; l != NULL; l = l->next)
     {
-      /* Attach additional interfaces from modules. */
-      udisks_debug ("Modules loaded, attaching interfaces...");
+      GUdevDevice *device = G_UDEV_DEVICE (l->data);
+      const gchar *sysfs_path = g_udev_device_get_sysfs_path (device);
+      UDisksLinuxBlockObject *object;
 
-      l = udisks_module_manager_get_new_manager_iface_funcs (module_manager);
-      for (; l != NULL; l = l->next)
+      g_hash_table_add (present, (gpointer) sysfs_path);
+      object = udisks_linux_provider_find_block_by_sysfs_path (provider, sysfs_path);
+      if (object != NULL)
         {
-          new_manager_iface_func = l->data;
-          iface = new_manager_iface_func (daemon);
-          if (iface != NULL)
-            {
-              g_dbus_object_skeleton_add_interface (G_DBUS_OBJECT_SKELETON (provider->manager_object), iface);
-              g_object_unref (iface);
-              do_refresh = TRUE;
-
-              provider->module_ifaces = g_list_append (provider->module_ifaces, iface);
-            }
+          g_object_unref (object);
+          continue;
         }
+      on_uevent (provider->gudev_client, "add", device, provider);
+      n_added++;
     }
-  else
+
+  g_mutex_lock (&provider->block_index_lock);
+  g_hash_table_iter_init (&iter, provider->block_index_by_sysfs_path);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
     {
-      /* Detach additional interfaces from modules. */
-      udisks_debug ("Modules unloading, detaching interfaces...");
+      if (!g_hash_table_contains (present, entry->sysfs_path))
+        stale = g_list_prepend (stale, g_object_ref (entry->object));
+    }
+  g_mutex_unlock (&provider->block_index_lock);
 
-      l = provider->module_ifaces;
-      for (; l != NULL; l = l->next)
-        {
-          iface = l->data;
-          g_dbus_object_skeleton_remove_interface (G_DBUS_OBJECT_SKELETON (provider->manager_object), iface);
+  for (l = stale; l != NULL; l = l->next)
+    {
+      UDisksLinuxDevice *device;
 
-          udisks_debug ("Interface removed");
-        }
-      g_list_free (provider->module_ifaces);
-      provider->module_ifaces = NULL;
+      device = udisks_linux_block_object_get_device (UDISKS_LINUX_BLOCK_OBJECT (l->data));
+      on_uevent (provider->gudev_client, "remove", device->udev_device, provider);
+      g_object_unref (device);
+      n_removed++;
+    }
 
-      /* Finish module unloading. */
-      udisks_module_manager_unload_modules (module_manager);
+  udisks_notice ("Resynchronized block devices after lost uevents: %u added, %u removed",
+                 n_added, n_removed);
 
-      do_refresh = TRUE;
-    }
+  g_list_free_full (stale, g_object_unref);
+  g_hash_table_unref (present);
+  g_list_free_full (devices, g_object_unref);
 
-  if (do_refresh)
-    {
-      /* Perform coldplug */
-      udisks_debug ("Performing coldplug...");
+  return G_SOURCE_REMOVE;
+}
+
+/* called in main thread on every uevent and housekeeping tick
+ *
+ * The kernel drops uevents that don't fit into the receive buffer of the
+ * socket (ENOBUFS) and GUdevClient silently skips over that, so look at the
+ * drop counter of the socket and resynchronize when it goes up.
+ */
+static void
+check_uevent_overflow (UDisksLinuxProvider *provider)
+{
+  guint32 drops;
+
+  if (provider->uevent_fd < 0 || !get_uevent_socket_drops (provider->uevent_fd, &drops))
+    return;
+
+  if (drops == provider->uevent_drops)
+    return;
+
+  udisks_warning ("Lost %u uevent(s) because the receive buffer was full, consider increasing uevent_buffer_size",
+                  drops - provider->uevent_drops);
+  provider->uevent_drops = drops;
 
-      udisks_devices = get_udisks_devices (provider);
-      do_coldplug (provider, udisks_devices);
-      g_list_free_full (udisks_devices, g_object_unref);
+  /* let the uevents still in the buffer through first */
+  if (provider->uevent_resync_id == 0)
+    provider->uevent_resync_id = g_idle_add_full (G_PRIORITY_LOW, on_uevent_resync, provider, NULL);
+}
+
+/* called in main thread before the coldplug */
+static void
+setup_uevent_socket (UDisksLinuxProvider *provider)
+{
+  UDisksDaemon *daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  guint size_mib;
+  gint size;
 
-      udisks_debug ("Coldplug complete");
+  if (provider->uevent_fd < 0)
+    return;
+
+  size_mib = udisks_config_manager_get_uevent_buffer_size (udisks_daemon_get_config_manager (daemon));
+  if (size_mib > 0)
+    {
+      size = size_mib * 1024 * 1024;
+      /* SO_RCVBUFFORCE is not capped by net.core.rmem_max but needs CAP_NET_ADMIN */
+      if (setsockopt (provider->uevent_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof (size)) != 0 &&
+          setsockopt (provider->uevent_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof (size)) != 0)
+        udisks_warning ("Error setting the receive buffer size of the uevent socket to %u MiB: %m", size_mib);
     }
+
+  if (!get_uevent_socket_drops (provider->uevent_fd, &provider->uevent_drops))
+    udisks_debug ("The kernel doesn't report dropped uevents, lost uevents won't be detected");
 }
 
-/**
- * The logind's PrepareForSleep D-Bus signal handler. There is one boolean
- * value in the 'parameters' GVariant tuple. When TRUE, the system is about to
- * suspend/hibernate, when FALSE the system has just woken up. Since the ATA
- * drives reset their configuration during suspend it needs to be re-read and
- * applied again.
- */
 static void
-on_system_sleep_signal (GDBusConnection *connection,
-                         const gchar *sender_name,
-                         const gchar *object_path,
-                         const gchar *interface_name,
-                         const gchar *signal_name,
-                         GVariant *parameters,
-                         gpointer user_data)
+udisks_linux_provider_init (UDisksLinuxProvider *provider)
 {
-  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  GDir *etc_dir;
-  GError *error;
-  const gchar *filename;
-  GVariant *tmp_bool;
-  gboolean suspending;
+  /* Matches on subsystem/devtype are compiled by libudev into a socket
+   * filter, so the SCSI hosts and targets coming and going during a rescan
+   * don't even wake us up - only scsi_device uevents are of interest.
+   */
+  const gchar *subsystems[] = {"block", "iscsi_connection", "scsi/scsi_device", "enclosure", NULL};
+  GArray *sockets_before;
+  GArray *sockets_after;
+  GFile *file;
+  GError *error = NULL;
 
-  if (g_variant_n_children(parameters) != 1)
+  /* get ourselves an udev client, GUdevClient doesn't give out its socket
+   * so find it by looking for the one it has just created */
+  sockets_before = list_uevent_sockets ();
+  provider->gudev_client = g_udev_client_new (subsystems);
+  sockets_after = list_uevent_sockets ();
+  provider->uevent_fd = find_new_uevent_socket (sockets_before, sockets_after);
+  if (provider->uevent_fd < 0)
+    udisks_warning ("Unable to find the uevent socket, lost uevents won't be detected");
+  g_array_unref (sockets_after);
+  g_array_unref (sockets_before);
+
+  g_signal_connect (provider->gudev_client,
+                    "uevent",
+                    G_CALLBACK (on_uevent),
+                    provider);
+
+  g_mutex_init (&provider->block_index_lock);
+  provider->block_index_by_sysfs_path = g_hash_table_new_full (g_str_hash,
+                                                               g_str_equal,
+                                                               NULL,
+                                                               (GDestroyNotify) block_index_entry_free);
+  provider->block_index_by_device_number = g_hash_table_new (g_int64_hash, g_int64_equal);
+  provider->block_index_by_device_file = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_mutex_init (&provider->drive_index_lock);
+  provider->drive_index_by_sysfs_path = g_hash_table_new_full (g_str_hash,
+                                                               g_str_equal,
+                                                               g_free,
+                                                               (GDestroyNotify) g_object_unref);
+
+  g_mutex_init (&provider->holders_lock);
+  provider->slaves_by_holder = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      g_free,
+                                                      (GDestroyNotify) g_strfreev);
+  provider->holders_by_slave = g_hash_table_new_full (g_str_hash,
+                                                      g_str_equal,
+                                                      g_free,
+                                                      (GDestroyNotify) g_hash_table_unref);
+
+  provider->uevent_context = g_main_context_new ();
+  provider->uevent_loop = g_main_loop_new (provider->uevent_context, FALSE);
+  provider->uevent_thread = g_thread_new ("uevent-thread", uevent_thread_func, provider);
+
+  g_mutex_init (&provider->probe_lock);
+  g_mutex_init (&provider->housekeeping_lock);
+  g_queue_init (&provider->probed_requests);
+  provider->sysfs_path_to_probe_requests = g_hash_table_new_full (g_str_hash,
+                                                                  g_str_equal,
+                                                                  g_free,
+                                                                  (GDestroyNotify) probe_request_queue_free);
+  provider->sysfs_path_to_parked_probe = g_hash_table_new_full (g_str_hash,
+                                                                g_str_equal,
+                                                                NULL,
+                                                                (GDestroyNotify) parked_probe_free);
+  provider->probe_pool = g_thread_pool_new (probe_request_pool_func,
+                                            provider,
+                                            MAX_PROBE_THREADS,
+                                            FALSE, /* exclusive */
+                                            NULL);
+
+  /* watch the udev database for devices waiting to be initialized */
+  file = g_file_new_for_path (UDEV_DATA_DIR);
+  provider->udev_data_dir_monitor = g_file_monitor_directory (file,
+                                                              G_FILE_MONITOR_NONE,
+                                                              NULL,
+                                                              &error);
+  if (provider->udev_data_dir_monitor != NULL)
     {
-      udisks_warning("Error: incorrect number of parameters to resume signal handler");
-      return;
+      g_signal_connect (provider->udev_data_dir_monitor,
+                        "changed",
+                        G_CALLBACK (on_udev_data_dir_monitor_changed),
+                        provider);
     }
-  tmp_bool = g_variant_get_child_value (parameters, 0);
-  if (!g_variant_is_of_type (tmp_bool, G_VARIANT_TYPE_BOOLEAN))
+  else
     {
-      udisks_warning("Error: incorrect parameter type of resume signal handler");
-      g_variant_unref (tmp_bool);
-      return;
+      udisks_warning ("Error monitoring directory %s: %s (%s, %d)",
+                      UDEV_DATA_DIR,
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
     }
-  suspending = g_variant_get_boolean (tmp_bool);
-  g_variant_unref (tmp_bool);
-  if (suspending)
-    return;
+  g_object_unref (file);
 
-  etc_dir = g_dir_open (PACKAGE_SYSCONF_DIR "/udisks2", 0, &error);
-  if (!etc_dir)
+  file = g_file_new_for_path (PACKAGE_SYSCONF_DIR "/udisks2");
+  provider->etc_udisks2_dir_monitor = g_file_monitor_directory (file,
+                                                                G_FILE_MONITOR_NONE,
+                                                                NULL,
+                                                                &error);
+  if (provider->etc_udisks2_dir_monitor != NULL)
     {
-      udisks_warning ("Error reading directory %s: %s (%s, %d)",
+      g_signal_connect (provider->etc_udisks2_dir_monitor,
+                        "changed",
+                        G_CALLBACK (on_etc_udisks2_dir_monitor_changed),
+                        provider);
+    }
+  else
+    {
+      udisks_warning ("Error monitoring directory %s: %s (%s, %d)",
                       PACKAGE_SYSCONF_DIR "/udisks2",
                       error->message, g_quark_to_string (error->domain), error->code);
       g_clear_error (&error);
-      return;
     }
+  g_object_unref (file);
 
-  while ((filename = g_dir_read_name (etc_dir)))
-    if (g_str_has_suffix (filename, ".conf"))
-      {
-        gchar *id = dup_id_from_config_name (filename);
-        synthesize_uevent_for_id (provider, id, "reconfigure");
-        g_free (id);
-      }
+  file = g_file_new_for_path (PACKAGE_SYSCONF_DIR "/udisks2/modules.conf.d");
+  provider->etc_modules_conf_dir_monitor = g_file_monitor_directory (file,
+                                                                     G_FILE_MONITOR_NONE,
+                                                                     NULL,
+                                                                     &error);
+  if (provider->etc_modules_conf_dir_monitor != NULL)
+    {
+      g_signal_connect (provider->etc_modules_conf_dir_monitor,
+                        "changed",
+                        G_CALLBACK (on_etc_modules_conf_dir_monitor_changed),
+                        provider);
+    }
+  else
+    {
+      udisks_debug ("Error monitoring directory %s: %s (%s, %d)",
+                    PACKAGE_SYSCONF_DIR "/udisks2/modules.conf.d",
+                    error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+  g_object_unref (file);
+  provider->pending_config_reloads = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-  g_dir_close (etc_dir);
+  provider->module_ifaces = NULL;
+  provider->module_iface_funcs = g_hash_table_new (g_direct_hash, g_direct_equal);
+  provider->lazy_module_requests = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 static void
-udisks_linux_provider_start (UDisksProvider *_provider)
-{
-  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (_provider);
+synthesize_uevent_for_id (UDisksLinuxProvider *provider,
+                          const gchar         *id,
+                          const gchar         *action)
+{
+  GHashTableIter iter;
+  UDisksLinuxDriveObject *drive_object;
+
+  /* called from the main thread, sysfs_path_to_drive is modified in the "uevent" thread */
+  provider_lock_acquire (provider);
+  /* A walk over the drives rather than another index: the Id of a drive
+   * may change with every update, and this only runs when a drive
+   * configuration file changes.
+   */
+  g_hash_table_iter_init (&iter, provider->sysfs_path_to_drive);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &drive_object))
+    {
+      UDisksDrive *drive = udisks_object_get_drive (UDISKS_OBJECT (drive_object));
+      if (drive != NULL)
+        {
+          if (g_strcmp0 (udisks_drive_get_id (drive), id) == 0)
+            {
+              udisks_debug ("synthesizing %s event on drive with id %s", action, id);
+              udisks_linux_drive_object_uevent (drive_object, action, NULL);
+            }
+          g_object_unref (drive);
+        }
+    }
+  provider_lock_release (provider, G_STRFUNC);
+}
+
+static gchar *
+dup_id_from_config_name (const gchar *conf_filename)
+{
+  gchar *id;
+
+  udisks_debug ("Found config file %s", conf_filename);
+
+  if (g_str_has_suffix (conf_filename, ".conf"))
+    {
+      id = g_strndup (conf_filename, strlen (conf_filename) - 5);
+      return id;
+    }
+  return NULL;
+}
+
+/* called from the main thread */
+static void
+reload_drive_configuration (UDisksLinuxProvider *provider,
+                            const gchar         *id)
+{
+  GHashTableIter iter;
+  UDisksLinuxDriveObject *drive_object;
+
+  /* sysfs_path_to_drive is modified in the "uevent" thread */
+  provider_lock_acquire (provider);
+  g_hash_table_iter_init (&iter, provider->sysfs_path_to_drive);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &drive_object))
+    {
+      UDisksDrive *drive = udisks_object_get_drive (UDISKS_OBJECT (drive_object));
+      if (drive != NULL)
+        {
+          if (g_strcmp0 (udisks_drive_get_id (drive), id) == 0)
+            {
+              udisks_debug ("Reloading configuration of drive with id %s", id);
+              udisks_linux_drive_object_reload_configuration (drive_object);
+            }
+          g_object_unref (drive);
+        }
+    }
+  provider_lock_release (provider, G_STRFUNC);
+}
+
+/* called from the main thread */
+static void
+reload_daemon_configuration (UDisksLinuxProvider *provider)
+{
   UDisksDaemon *daemon;
-  UDisksManager *manager;
+  UDisksConfigManager *config_manager;
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  config_manager = udisks_daemon_get_config_manager (daemon);
+  if (!udisks_config_manager_reload (config_manager))
+    {
+      udisks_debug ("Configuration of the daemon has not changed");
+      return;
+    }
+
+  udisks_notice ("Configuration of the daemon reloaded");
+
+  g_mutex_lock (&provider->housekeeping_lock);
+  provider->housekeeping_max_parallel = udisks_config_manager_get_housekeeping_max_parallel (config_manager);
+  provider->housekeeping_max_parallel_per_controller =
+    udisks_config_manager_get_housekeeping_max_parallel_per_controller (config_manager);
+  g_mutex_unlock (&provider->housekeeping_lock);
+
+  udisks_job_scheduler_set_limits (udisks_daemon_get_job_scheduler (daemon),
+                                   udisks_config_manager_get_jobs_max_parallel (config_manager),
+                                   udisks_config_manager_get_jobs_max_parallel_per_drive (config_manager));
+  udisks_method_dispatcher_set_limits (udisks_daemon_get_method_dispatcher (daemon),
+                                       udisks_config_manager_get_method_calls_max_threads (config_manager),
+                                       udisks_config_manager_get_method_calls_max_threads_per_caller (config_manager));
+
+  /* the housekeeping limits may have been raised */
+  schedule_drive_housekeeping (provider);
+}
+
+/* Returns the name of the module the modules.conf.d file @conf_filename
+ * (e.g. "udisks2_lvm2.conf") belongs to */
+static gchar *
+dup_module_from_config_name (const gchar *conf_filename)
+{
+  if (g_str_has_prefix (conf_filename, PACKAGE_NAME_UDISKS2 "_") &&
+      g_str_has_suffix (conf_filename, ".conf"))
+    return g_strndup (conf_filename + strlen (PACKAGE_NAME_UDISKS2 "_"),
+                      strlen (conf_filename) - strlen (PACKAGE_NAME_UDISKS2 "_") - 5);
+  return NULL;
+}
+
+/* Delay coalescing configuration file changes, config management tools
+ * often replace many files (or the same file several times) in a row */
+#define CONFIG_RELOAD_DELAY_MSEC 500
+
+#define MODULES_CONF_DIR_PREFIX "modules.conf.d/"
+
+static gboolean
+on_config_reload_timeout (gpointer user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
   UDisksModuleManager *module_manager;
+  GHashTable *pending;
+  GHashTableIter iter;
+  const gchar *name;
+
+  provider->config_reload_timeout = 0;
+  pending = provider->pending_config_reloads;
+  provider->pending_config_reloads = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  module_manager = udisks_daemon_get_module_manager (udisks_provider_get_daemon (UDISKS_PROVIDER (provider)));
+
+  g_hash_table_iter_init (&iter, pending);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL))
+    {
+      if (g_str_has_prefix (name, MODULES_CONF_DIR_PREFIX))
+        {
+          gchar *module_name = dup_module_from_config_name (name + strlen (MODULES_CONF_DIR_PREFIX));
+          if (module_name != NULL &&
+              !udisks_module_manager_reload_module_configuration (module_manager, module_name))
+            udisks_debug ("Module %s is not loaded or can't reload its configuration, ignoring change of %s",
+                          module_name, name);
+          g_free (module_name);
+        }
+      else if (g_strcmp0 (name, PACKAGE_NAME_UDISKS2 ".conf") == 0)
+        {
+          reload_daemon_configuration (provider);
+        }
+      else
+        {
+          gchar *id = dup_id_from_config_name (name);
+          if (id != NULL)
+            reload_drive_configuration (provider, id);
+          g_free (id);
+        }
+    }
+
+  g_hash_table_unref (pending);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_config_reload (UDisksLinuxProvider *provider,
+                     GFileMonitorEvent    event_type,
+                     const gchar         *name)
+{
+  if (event_type != G_FILE_MONITOR_EVENT_CREATED &&
+      event_type != G_FILE_MONITOR_EVENT_DELETED &&
+      event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+    return;
+
+  g_hash_table_add (provider->pending_config_reloads, g_strdup (name));
+
+  /* restart the delay so a burst of changes is handled at once */
+  if (provider->config_reload_timeout > 0)
+    g_source_remove (provider->config_reload_timeout);
+  provider->config_reload_timeout = g_timeout_add (CONFIG_RELOAD_DELAY_MSEC,
+                                                   on_config_reload_timeout,
+                                                   provider);
+}
+
+static void
+on_etc_udisks2_dir_monitor_changed (GFileMonitor     *monitor,
+                                    GFile            *file,
+                                    GFile            *other_file,
+                                    GFileMonitorEvent event_type,
+                                    gpointer          user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  gchar *filename = g_file_get_basename (file);
+
+  queue_config_reload (provider, event_type, filename);
+  g_free (filename);
+}
+
+static void
+on_etc_modules_conf_dir_monitor_changed (GFileMonitor     *monitor,
+                                         GFile            *file,
+                                         GFile            *other_file,
+                                         GFileMonitorEvent event_type,
+                                         gpointer          user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  gchar *filename = g_file_get_basename (file);
+  gchar *name = g_strconcat (MODULES_CONF_DIR_PREFIX, filename, NULL);
+
+  queue_config_reload (provider, event_type, name);
+  g_free (name);
+  g_free (filename);
+}
+
+static guint
+count_alphas (const gchar *str)
+{
+  guint n = 0;
+  while (g_ascii_isalpha (str[n]))
+    n++;
+  return n;
+}
+
+static gint
+device_name_cmp (const gchar *a,
+                 const gchar *b)
+{
+  /* Ensures that sda comes before sdz%d and sdz%d comes before sdaa%d */
+  if (g_str_has_prefix (a, "sd") && g_str_has_prefix (b, "sd"))
+    {
+      gint la = count_alphas (a);
+      gint lb = count_alphas (b);
+      if (la != lb)
+        return la - lb;
+      else
+        return g_strcmp0 (a, b);
+    }
+  else
+    {
+      return g_strcmp0 (a, b);
+    }
+}
+
+static gint
+udev_device_name_cmp (GUdevDevice *a,
+                      GUdevDevice *b)
+{
+  return device_name_cmp (g_udev_device_get_name (a), g_udev_device_get_name (b));
+}
+
+typedef struct
+{
+  GUdevDevice *udev_device;
+  UDisksLinuxDevice *udisks_device;
+  gint64 probe_usec;
+  /* whether the probed data was taken from the probe snapshot */
+  gboolean restored;
+} ColdplugProbeData;
+
+/* Number of the slowest devices listed with --profile-startup */
+#define PROFILE_SLOWEST_DEVICES 10
+
+static void
+profile_add_device_usec (UDisksLinuxProvider *provider,
+                         const gchar         *name,
+                         gint64               usec)
+{
+  gint64 *total;
+
+  if (provider->profile_device_usec == NULL)
+    return;
+
+  total = g_hash_table_lookup (provider->profile_device_usec, name);
+  if (total == NULL)
+    {
+      total = g_new0 (gint64, 1);
+      g_hash_table_insert (provider->profile_device_usec, g_strdup (name), total);
+    }
+  *total += usec;
+}
+
+static const gchar *
+profile_device_type (UDisksLinuxDevice *device)
+{
+  const gchar *name;
+
+  name = g_udev_device_get_name (device->udev_device);
+  if (g_str_has_prefix (name, "loop"))
+    return "loop";
+  if (g_str_has_prefix (name, "dm-"))
+    return "dm";
+  if (g_str_has_prefix (name, "md"))
+    return "md";
+  if (g_strcmp0 (g_udev_device_get_devtype (device->udev_device), "partition") == 0)
+    return "partition";
+  return "disk";
+}
+
+static gint
+profile_device_usec_cmp (gconstpointer a,
+                         gconstpointer b,
+                         gpointer      user_data)
+{
+  GHashTable *table = user_data;
+  gint64 usec_a = *(gint64 *) g_hash_table_lookup (table, *(const gchar **) a);
+  gint64 usec_b = *(gint64 *) g_hash_table_lookup (table, *(const gchar **) b);
+
+  /* descending */
+  return usec_a < usec_b ? 1 : (usec_a > usec_b ? -1 : 0);
+}
+
+static void
+profile_log_slowest_devices (UDisksLinuxProvider *provider)
+{
+  GPtrArray *names;
+  GHashTableIter iter;
+  gpointer key;
+  guint n;
+
+  if (provider->profile_device_usec == NULL)
+    return;
+
+  names = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, provider->profile_device_usec);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_ptr_array_add (names, key);
+  g_ptr_array_sort_with_data (names, profile_device_usec_cmp, provider->profile_device_usec);
+
+  for (n = 0; n < names->len && n < PROFILE_SLOWEST_DEVICES; n++)
+    {
+      const gchar *name = g_ptr_array_index (names, n);
+      udisks_notice ("Startup profile: slowest device #%u: %s (%.1f ms probing and exporting)",
+                     n + 1, name,
+                     *(gint64 *) g_hash_table_lookup (provider->profile_device_usec, name) / 1000.0);
+    }
+  g_ptr_array_free (names, TRUE);
+}
+
+/* Runs in a thread from the temporary pool created by get_udisks_devices() */
+static void
+coldplug_probe_pool_func (gpointer data,
+                          gpointer user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  ColdplugProbeData *probe_data = data;
+  gint64 start_time;
+
+  start_time = g_get_monotonic_time ();
+  if (provider->probe_snapshot != NULL)
+    probe_data->udisks_device = udisks_linux_device_new_from_snapshot_sync (probe_data->udev_device,
+                                                                            provider->probe_snapshot,
+                                                                            &probe_data->restored);
+  else
+    probe_data->udisks_device = udisks_linux_device_new_sync (probe_data->udev_device);
+  probe_data->probe_usec = g_get_monotonic_time () - start_time;
+}
+
+static GList *
+get_udisks_devices (UDisksLinuxProvider *provider)
+{
+  GList *devices;
   GList *udisks_devices;
+  GList *l;
+  GThreadPool *pool;
+  ColdplugProbeData *probe_data;
+  guint n_devices;
   guint n;
-  GDBusConnection *dbus_conn;
+  gint64 start_time;
+
+  start_time = g_get_monotonic_time ();
+
+  devices = g_udev_client_query_by_subsystem (provider->gudev_client, "block");
+
+  /* make sure we process sda before sdz and sdz before sdaa */
+  devices = g_list_sort (devices, (GCompareFunc) udev_device_name_cmp);
+
+  /* probe all the devices in parallel, each thread writes only to its own
+   * slot of the array so the sorted order is kept without any locking */
+  probe_data = g_new0 (ColdplugProbeData, g_list_length (devices));
+  n_devices = 0;
+  for (l = devices; l != NULL; l = l->next)
+    {
+      GUdevDevice *device = G_UDEV_DEVICE (l->data);
+      if (!g_udev_device_get_is_initialized (device))
+        continue;
+      probe_data[n_devices++].udev_device = device;
+    }
+
+  if (n_devices > 0)
+    {
+      pool = g_thread_pool_new (coldplug_probe_pool_func,
+                                provider,
+                                MIN (n_devices, MAX_PROBE_THREADS),
+                                TRUE, /* exclusive */
+                                NULL);
+      for (n = 0; n < n_devices; n++)
+        g_thread_pool_push (pool, &probe_data[n], NULL);
+      /* waits for all the devices to be probed */
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+
+  /* commit the results in the sorted order */
+  udisks_devices = NULL;
+  for (n = 0; n < n_devices; n++)
+    {
+      udisks_devices = g_list_prepend (udisks_devices, probe_data[n].udisks_device);
+      if (probe_data[n].restored && provider->probe_snapshot_restored != NULL)
+        g_ptr_array_add (provider->probe_snapshot_restored, g_object_ref (probe_data[n].udisks_device));
+      profile_add_device_usec (provider, g_udev_device_get_name (probe_data[n].udev_device),
+                               probe_data[n].probe_usec);
+    }
+  udisks_devices = g_list_reverse (udisks_devices);
+  g_free (probe_data);
+  g_list_free_full (devices, g_object_unref);
+
+  if (provider->coldplug)
+    {
+      provider->coldplug_n_probed += n_devices;
+      provider->coldplug_probe_usec += g_get_monotonic_time () - start_time;
+    }
+
+  return udisks_devices;
+}
+
+/* Enclosures don't need any probing */
+static void
+coldplug_enclosures (UDisksLinuxProvider *provider)
+{
+  GList *devices;
+  GList *l;
+
+  devices = g_udev_client_query_by_subsystem (provider->gudev_client, "enclosure");
+  for (l = devices; l != NULL; l = l->next)
+    {
+      UDisksLinuxDevice *device;
+
+      device = udisks_linux_device_new_sync (G_UDEV_DEVICE (l->data));
+      udisks_linux_provider_handle_uevent (provider, "add", device);
+      g_object_unref (device);
+    }
+  g_list_free_full (devices, g_object_unref);
+}
+
+typedef struct
+{
+  guint n_devices;
+  gint64 usec;
+} ProfileTypeStats;
+
+/* @phase is only used for the --profile-startup output */
+static void
+do_coldplug (UDisksLinuxProvider *provider,
+             GList               *udisks_devices,
+             const gchar         *phase)
+{
+  GList *l;
+  gint64 start_time;
+  GHashTable *type_stats = NULL;
+
+  start_time = g_get_monotonic_time ();
+
+  if (provider->profile_device_usec != NULL)
+    type_stats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+  for (l = udisks_devices; l != NULL; l = l->next)
+    {
+      UDisksLinuxDevice *device = l->data;
+      gint64 device_start_time = 0;
+
+      if (type_stats != NULL)
+        device_start_time = g_get_monotonic_time ();
+
+      udisks_linux_provider_handle_uevent (provider, "add", device);
+
+      if (type_stats != NULL)
+        {
+          const gchar *type = profile_device_type (device);
+          ProfileTypeStats *stats;
+          gint64 usec = g_get_monotonic_time () - device_start_time;
+
+          stats = g_hash_table_lookup (type_stats, type);
+          if (stats == NULL)
+            {
+              stats = g_new0 (ProfileTypeStats, 1);
+              g_hash_table_insert (type_stats, (gpointer) type, stats);
+            }
+          stats->n_devices++;
+          stats->usec += usec;
+          profile_add_device_usec (provider, g_udev_device_get_name (device->udev_device), usec);
+        }
+    }
+
+  if (provider->coldplug)
+    provider->coldplug_export_usec += g_get_monotonic_time () - start_time;
+
+  if (type_stats != NULL)
+    {
+      GHashTableIter iter;
+      gpointer key;
+      gpointer value;
+
+      g_hash_table_iter_init (&iter, type_stats);
+      while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+          ProfileTypeStats *stats = value;
+          udisks_notice ("Startup profile: %s: %u %s devices took %.1f ms",
+                         phase, stats->n_devices, (const gchar *) key, stats->usec / 1000.0);
+        }
+      g_hash_table_unref (type_stats);
+      udisks_daemon_profile_phase (udisks_provider_get_daemon (UDISKS_PROVIDER (provider)),
+                                   phase, start_time);
+    }
+}
+
+static gint
+block_object_name_cmp (UDisksLinuxBlockObject *a,
+                       UDisksLinuxBlockObject *b)
+{
+  UDisksLinuxDevice *device_a;
+  UDisksLinuxDevice *device_b;
+  gint ret;
+
+  device_a = udisks_linux_block_object_get_device (a);
+  device_b = udisks_linux_block_object_get_device (b);
+  ret = udev_device_name_cmp (device_a->udev_device, device_b->udev_device);
+  g_object_unref (device_a);
+  g_object_unref (device_b);
+
+  return ret;
+}
+
+/* Replays only the module stages of the coldplug, i.e. the dispatch to the
+ * module objects and the attaching of the module interfaces, for all the
+ * exported drives and block devices. The UDisksLinuxDevice objects attached
+ * to the drive and block objects are used as they are so the devices are not
+ * probed (e.g. with ATA IDENTIFY) all over again just because the set of
+ * loaded modules changed.
+ */
+static void
+replay_modules (UDisksLinuxProvider *provider)
+{
+  GList *drive_objects;
+  GList *block_objects;
+  GList *l;
+
+  provider_lock_acquire (provider);
+  drive_objects = g_hash_table_get_values (provider->vpd_to_drive);
+  g_list_foreach (drive_objects, (GFunc) udisks_g_object_ref_foreach, NULL);
+  block_objects = g_hash_table_get_values (provider->sysfs_to_block);
+  g_list_foreach (block_objects, (GFunc) udisks_g_object_ref_foreach, NULL);
+  provider_lock_release (provider, G_STRFUNC);
+
+  /* keep the coldplug order, sda before sdz and sdz before sdaa */
+  block_objects = g_list_sort (block_objects, (GCompareFunc) block_object_name_cmp);
+
+  /* one InterfacesAdded signal per object instead of one per module interface */
+  udisks_daemon_begin_interfaces_batch (udisks_provider_get_daemon (UDISKS_PROVIDER (provider)));
+
+  for (l = drive_objects; l != NULL; l = l->next)
+    udisks_linux_drive_object_update_module_ifaces (UDISKS_LINUX_DRIVE_OBJECT (l->data), "add");
+
+  for (l = block_objects; l != NULL; l = l->next)
+    {
+      UDisksLinuxBlockObject *object = UDISKS_LINUX_BLOCK_OBJECT (l->data);
+      UDisksLinuxDevice *device;
+
+      device = udisks_linux_block_object_get_device (object);
+      provider_lock_acquire (provider);
+      UDISKS_TRACE2 (module_dispatch_start, "add", g_udev_device_get_sysfs_path (device->udev_device));
+      handle_block_uevent_for_modules (provider, "add", device);
+      UDISKS_TRACE2 (module_dispatch_done, "add", g_udev_device_get_sysfs_path (device->udev_device));
+      provider_lock_release (provider, G_STRFUNC);
+      g_object_unref (device);
+
+      udisks_linux_block_object_update_module_ifaces (object, "add");
+
+      /* wake up anyone waiting for the block object to reach a certain state */
+      udisks_provider_emit_object_changed (UDISKS_PROVIDER (provider), G_DBUS_OBJECT (object));
+    }
+
+  udisks_daemon_end_interfaces_batch (udisks_provider_get_daemon (UDISKS_PROVIDER (provider)));
+
+  g_list_free_full (block_objects, g_object_unref);
+  g_list_free_full (drive_objects, g_object_unref);
+}
+
+static void
+ensure_modules (UDisksLinuxProvider *provider)
+{
+  UDisksDaemon *daemon;
+  UDisksModuleManager *module_manager;
+  GDBusInterfaceSkeleton *iface;
+  UDisksModuleNewManagerIfaceFunc new_manager_iface_func;
+  GList *l;
+  gboolean do_refresh = FALSE;
+  gint64 start_time;
+  gboolean loaded;
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  module_manager = udisks_daemon_get_module_manager (daemon);
+
+  loaded = udisks_module_manager_get_modules_available (module_manager);
+
+  if (loaded)
+    {
+      /* Attach additional interfaces from modules, modules may get loaded
+       * one by one so only the interfaces of the new modules are missing */
+      udisks_debug ("Modules loaded, attaching interfaces...");
+
+      l = udisks_module_manager_get_new_manager_iface_funcs (module_manager);
+      for (; l != NULL; l = l->next)
+        {
+          new_manager_iface_func = l->data;
+          if (g_hash_table_contains (provider->module_iface_funcs, new_manager_iface_func))
+            continue;
+          g_hash_table_add (provider->module_iface_funcs, new_manager_iface_func);
+          iface = new_manager_iface_func (daemon);
+          if (iface != NULL)
+            {
+              g_dbus_object_skeleton_add_interface (G_DBUS_OBJECT_SKELETON (provider->manager_object), iface);
+              g_object_unref (iface);
+              do_refresh = TRUE;
+
+              provider->module_ifaces = g_list_append (provider->module_ifaces, iface);
+            }
+        }
+
+      /* modules without manager interfaces need the replay as well */
+      do_refresh = TRUE;
+    }
+  else
+    {
+      /* Detach additional interfaces from modules. */
+      udisks_debug ("Modules unloading, detaching interfaces...");
+
+      l = provider->module_ifaces;
+      for (; l != NULL; l = l->next)
+        {
+          iface = l->data;
+          g_dbus_object_skeleton_remove_interface (G_DBUS_OBJECT_SKELETON (provider->manager_object), iface);
+
+          udisks_debug ("Interface removed");
+        }
+      g_list_free (provider->module_ifaces);
+      provider->module_ifaces = NULL;
+      g_hash_table_remove_all (provider->module_iface_funcs);
+
+      /* Finish module unloading. */
+      udisks_module_manager_unload_modules (module_manager);
+
+      do_refresh = TRUE;
+    }
+
+  if (do_refresh)
+    {
+      /* Replay the coldplug for the modules, the devices themselves haven't changed */
+      udisks_debug ("Replaying coldplug for modules...");
+
+      start_time = g_get_monotonic_time ();
+      replay_modules (provider);
+      udisks_daemon_profile_phase (daemon, "module coldplug replay", start_time);
+
+      udisks_debug ("Coldplug replay complete");
+    }
+}
+
+/**
+ * The logind's PrepareForSleep D-Bus signal handler. There is one boolean
+ * value in the 'parameters' GVariant tuple. When TRUE, the system is about to
+ * suspend/hibernate, when FALSE the system has just woken up. Since the ATA
+ * drives reset their configuration during suspend it needs to be re-read and
+ * applied again.
+ */
+static void
+on_system_sleep_signal (GDBusConnection *connection,
+                         const gchar *sender_name,
+                         const gchar *object_path,
+                         const gchar *interface_name,
+                         const gchar *signal_name,
+                         GVariant *parameters,
+                         gpointer user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  GDir *etc_dir;
+  GError *error;
+  const gchar *filename;
+  GVariant *tmp_bool;
+  gboolean suspending;
+
+  if (g_variant_n_children(parameters) != 1)
+    {
+      udisks_warning("Error: incorrect number of parameters to resume signal handler");
+      return;
+    }
+  tmp_bool = g_variant_get_child_value (parameters, 0);
+  if (!g_variant_is_of_type (tmp_bool, G_VARIANT_TYPE_BOOLEAN))
+    {
+      udisks_warning("Error: incorrect parameter type of resume signal handler");
+      g_variant_unref (tmp_bool);
+      return;
+    }
+  suspending = g_variant_get_boolean (tmp_bool);
+  g_variant_unref (tmp_bool);
+  if (suspending)
+    return;
+
+  etc_dir = g_dir_open (PACKAGE_SYSCONF_DIR "/udisks2", 0, &error);
+  if (!etc_dir)
+    {
+      udisks_warning ("Error reading directory %s: %s (%s, %d)",
+                      PACKAGE_SYSCONF_DIR "/udisks2",
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      return;
+    }
+
+  while ((filename = g_dir_read_name (etc_dir)))
+    if (g_str_has_suffix (filename, ".conf"))
+      {
+        gchar *id = dup_id_from_config_name (filename);
+        synthesize_uevent_for_id (provider, id, "reconfigure");
+        g_free (id);
+      }
+
+  g_dir_close (etc_dir);
+}
+
+static void
+publish_coldplug_complete (UDisksLinuxProvider *provider)
+{
+  UDisksManager *manager;
+  GVariantBuilder builder;
+
+  manager = udisks_object_peek_manager (UDISKS_OBJECT (provider->manager_object));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "devices-probed",
+                         g_variant_new_uint64 (provider->coldplug_n_probed));
+  g_variant_builder_add (&builder, "{sv}", "probe-time-usec",
+                         g_variant_new_uint64 (provider->coldplug_probe_usec));
+  g_variant_builder_add (&builder, "{sv}", "export-time-usec",
+                         g_variant_new_uint64 (provider->coldplug_export_usec));
+  udisks_manager_set_coldplug_statistics (manager, g_variant_builder_end (&builder));
+  udisks_manager_set_coldplug_complete (manager, TRUE);
+
+  udisks_info ("Coldplug statistics: %" G_GUINT64_FORMAT " devices probed in %" G_GINT64_FORMAT " ms, "
+               "objects exported in %" G_GINT64_FORMAT " ms",
+               provider->coldplug_n_probed,
+               provider->coldplug_probe_usec / 1000,
+               provider->coldplug_export_usec / 1000);
+}
+
+/* Runs in a dedicated thread, probes the devices restored from the probe
+ * snapshot again one by one and returns the sysfs paths of the devices whose
+ * probed data has changed */
+static void
+revalidate_probe_snapshot_thread_func (GTask        *task,
+                                       gpointer      source_object,
+                                       gpointer      task_data,
+                                       GCancellable *cancellable)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (source_object);
+  GPtrArray *devices = task_data;
+  GPtrArray *changed;
+  guint n;
+
+  changed = g_ptr_array_new_with_free_func (g_free);
+  for (n = 0; n < devices->len; n++)
+    {
+      UDisksLinuxDevice *device = g_ptr_array_index (devices, n);
+      UDisksLinuxDevice *probed;
+
+      probed = udisks_linux_device_new_sync (device->udev_device);
+      if (udisks_probe_snapshot_store (provider->probe_snapshot, probed))
+        g_ptr_array_add (changed, g_strdup (g_udev_device_get_sysfs_path (device->udev_device)));
+      g_object_unref (probed);
+    }
+
+  g_task_return_pointer (task, changed, (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+on_probe_snapshot_revalidated (GObject      *source_object,
+                               GAsyncResult *res,
+                               gpointer      user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (source_object);
+  GPtrArray *changed;
+  guint n;
+
+  changed = g_task_propagate_pointer (G_TASK (res), NULL);
+  for (n = 0; n < changed->len; n++)
+    {
+      const gchar *sysfs_path = g_ptr_array_index (changed, n);
+      UDisksLinuxBlockObject *object;
+
+      /* let the uevent update the objects with the right data */
+      object = udisks_linux_provider_find_block_by_sysfs_path (provider, sysfs_path);
+      if (object != NULL)
+        {
+          udisks_notice ("Probed data of %s has changed since the probe snapshot was taken", sysfs_path);
+          udisks_linux_block_object_trigger_uevent (object);
+          g_object_unref (object);
+        }
+    }
+  udisks_debug ("Revalidated the probe snapshot, %u devices changed", changed->len);
+  g_ptr_array_unref (changed);
+}
+
+static void
+revalidate_probe_snapshot (UDisksLinuxProvider *provider)
+{
+  GTask *task;
+
+  if (provider->probe_snapshot_restored == NULL)
+    return;
+
+  if (provider->probe_snapshot_restored->len > 0)
+    {
+      udisks_info ("Restored probed data of %u devices from the probe snapshot, revalidating",
+                   provider->probe_snapshot_restored->len);
+      task = g_task_new (provider, NULL, on_probe_snapshot_revalidated, NULL);
+      g_task_set_task_data (task, provider->probe_snapshot_restored, (GDestroyNotify) g_ptr_array_unref);
+      g_task_run_in_thread (task, revalidate_probe_snapshot_thread_func);
+      g_object_unref (task);
+    }
+  else
+    {
+      g_ptr_array_unref (provider->probe_snapshot_restored);
+    }
+  provider->probe_snapshot_restored = NULL;
+}
+
+static void
+udisks_linux_provider_start (UDisksProvider *_provider)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (_provider);
+  UDisksDaemon *daemon;
+  UDisksManager *manager;
+  UDisksModuleManager *module_manager;
+  GList *udisks_devices;
+  guint n;
+  GDBusConnection *dbus_conn;
+  gint64 start_time;
+
+  provider->coldplug = TRUE;
+
+  if (UDISKS_PROVIDER_CLASS (udisks_linux_provider_parent_class)->start != NULL)
+    UDISKS_PROVIDER_CLASS (udisks_linux_provider_parent_class)->start (_provider);
+
+  provider->sysfs_to_block = g_hash_table_new_full (g_str_hash,
+                                                    g_str_equal,
+                                                    g_free,
+                                                    (GDestroyNotify) g_object_unref);
+  provider->vpd_to_drive = g_hash_table_new_full (g_str_hash,
+                                                  g_str_equal,
+                                                  g_free,
+                                                  (GDestroyNotify) g_object_unref);
+  provider->sysfs_path_to_drive = g_hash_table_new_full (g_str_hash,
+                                                         g_str_equal,
+                                                         g_free,
+                                                         NULL);
+  provider->sysfs_path_to_vpd = g_hash_table_new_full (g_str_hash,
+                                                       g_str_equal,
+                                                       g_free,
+                                                       vpd_cache_entry_free);
+  provider->uuid_to_mdraid = g_hash_table_new_full (g_str_hash,
+                                                    g_str_equal,
+                                                    g_free,
+                                                    (GDestroyNotify) g_object_unref);
+  provider->sysfs_path_to_mdraid = g_hash_table_new_full (g_str_hash,
+                                                          g_str_equal,
+                                                          g_free,
+                                                          NULL);
+  provider->sysfs_path_to_mdraid_members = g_hash_table_new_full (g_str_hash,
+                                                                  g_str_equal,
+                                                                  g_free,
+                                                                  NULL);
+  provider->sysfs_path_to_enclosure = g_hash_table_new_full (g_str_hash,
+                                                             g_str_equal,
+                                                             g_free,
+                                                             (GDestroyNotify) g_object_unref);
+  provider->module_funcs_to_instances = g_hash_table_new_full (g_direct_hash,
+                                                               g_direct_equal,
+                                                               NULL,
+                                                               (GDestroyNotify) g_hash_table_unref);
+  provider->module_sysfs_path_to_owners = g_hash_table_new_full (g_str_hash,
+                                                                 g_str_equal,
+                                                                 g_free,
+                                                                 (GDestroyNotify) g_hash_table_unref);
+  provider->module_dispatch = g_hash_table_new_full (g_direct_hash,
+                                                     g_direct_equal,
+                                                     NULL,
+                                                     module_dispatch_entry_free);
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+
+  setup_uevent_socket (provider);
+
+  provider->lazy_modules = ! udisks_daemon_get_disable_modules (daemon) &&
+    udisks_config_manager_get_load_preference (udisks_daemon_get_config_manager (daemon)) == UDISKS_MODULE_LOAD_LAZY;
+
+  if (udisks_daemon_get_profile_startup (daemon))
+    provider->profile_device_usec = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  /* forward (un)exports as UDisksProvider signals, see wait_for_objects() */
+  g_signal_connect (udisks_daemon_get_object_manager (daemon),
+                    "object-added",
+                    G_CALLBACK (on_object_manager_object_added),
+                    provider);
+  g_signal_connect (udisks_daemon_get_object_manager (daemon),
+                    "object-removed",
+                    G_CALLBACK (on_object_manager_object_removed),
+                    provider);
+
+  provider->manager_object = udisks_object_skeleton_new ("/org/freedesktop/UDisks2/Manager");
+  manager = udisks_linux_manager_new (daemon);
+  udisks_object_skeleton_set_manager (provider->manager_object, manager);
+  g_object_unref (manager);
+
+  module_manager = udisks_daemon_get_module_manager (daemon);
+  g_signal_connect_swapped (module_manager, "notify::modules-ready", G_CALLBACK (ensure_modules), provider);
+  start_time = g_get_monotonic_time ();
+  ensure_modules (provider);
+  udisks_daemon_profile_phase (daemon, "ensure_modules()", start_time);
+
+  g_dbus_object_manager_server_export (udisks_daemon_get_object_manager (daemon),
+                                       G_DBUS_OBJECT_SKELETON (provider->manager_object));
+
+  if (udisks_config_manager_get_probe_snapshot (udisks_daemon_get_config_manager (daemon)))
+    {
+      start_time = g_get_monotonic_time ();
+      g_mutex_lock (&provider->probe_lock);
+      provider->probe_snapshot = udisks_probe_snapshot_new ();
+      g_mutex_unlock (&provider->probe_lock);
+      provider->probe_snapshot_restored = g_ptr_array_new_with_free_func (g_object_unref);
+      udisks_daemon_profile_phase (daemon, "probe snapshot", start_time);
+    }
+
+  /* probe for extra data we don't get from udev */
+  udisks_info ("Initialization (device probing)");
+  start_time = g_get_monotonic_time ();
+  udisks_devices = get_udisks_devices (provider);
+  udisks_daemon_profile_phase (daemon, "device probing", start_time);
+
+  /* do two coldplug runs to handle dependencies between devices */
+  for (n = 0; n < 2; n++)
+    {
+      udisks_info ("Initialization (coldplug %u/2)", n + 1);
+      do_coldplug (provider, udisks_devices, n == 0 ? "coldplug 1/2" : "coldplug 2/2");
+    }
+  g_list_free_full (udisks_devices, g_object_unref);
+
+  /* the enclosures refer to the drives in their slots so they go last */
+  start_time = g_get_monotonic_time ();
+  coldplug_enclosures (provider);
+  udisks_daemon_profile_phase (daemon, "enclosures", start_time);
+  udisks_info ("Initialization complete");
+
+  /* schedule housekeeping */
+  provider->drive_housekeeping = g_hash_table_new_full (g_direct_hash,
+                                                        g_direct_equal,
+                                                        g_object_unref,
+                                                        drive_housekeeping_free);
+  provider->housekeeping_controller_n_running = g_hash_table_new_full (g_str_hash,
+                                                                       g_str_equal,
+                                                                       g_free,
+                                                                       NULL);
+  provider->module_housekeeping = g_hash_table_new_full (g_direct_hash,
+                                                         g_direct_equal,
+                                                         NULL,
+                                                         g_free);
+  provider->housekeeping_max_parallel = udisks_config_manager_get_housekeeping_max_parallel (udisks_daemon_get_config_manager (daemon));
+  provider->housekeeping_max_parallel_per_controller =
+    udisks_config_manager_get_housekeeping_max_parallel_per_controller (udisks_daemon_get_config_manager (daemon));
+  provider->housekeeping_timeout = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                           "housekeeping",
+                                                                           HOUSEKEEPING_TICK_SECONDS,
+                                                                           on_housekeeping_timeout,
+                                                                           provider,
+                                                                           NULL);
+  /* ... and also do an initial run */
+  start_time = g_get_monotonic_time ();
+  on_housekeeping_timeout (provider);
+  udisks_daemon_profile_phase (daemon, "initial housekeeping scheduling", start_time);
+
+  profile_log_slowest_devices (provider);
+  if (provider->profile_device_usec != NULL)
+    {
+      g_hash_table_unref (provider->profile_device_usec);
+      provider->profile_device_usec = NULL;
+    }
+
+  provider->coldplug = FALSE;
+
+  /* let clients know the object tree is complete */
+  publish_coldplug_complete (provider);
+
+  /* make sure the data taken from the probe snapshot is still right */
+  revalidate_probe_snapshot (provider);
+
+  /* update Block:Configuration whenever fstab or crypttab entries are added or removed */
+  g_signal_connect (udisks_daemon_get_fstab_monitor (daemon),
+                    "entry-added",
+                    G_CALLBACK (fstab_monitor_on_entry_added),
+                    provider);
+  g_signal_connect (udisks_daemon_get_fstab_monitor (daemon),
+                    "entry-removed",
+                    G_CALLBACK (fstab_monitor_on_entry_removed),
+                    provider);
+  g_signal_connect (udisks_daemon_get_crypttab_monitor (daemon),
+                    "entry-added",
+                    G_CALLBACK (crypttab_monitor_on_entry_added),
+                    provider);
+  g_signal_connect (udisks_daemon_get_crypttab_monitor (daemon),
+                    "entry-removed",
+                    G_CALLBACK (crypttab_monitor_on_entry_removed),
+                    provider);
+#ifdef HAVE_LIBMOUNT
+  g_signal_connect (udisks_daemon_get_utab_monitor (daemon),
+                    "entry-added",
+                    G_CALLBACK (utab_monitor_on_entry_added),
+                    provider);
+  g_signal_connect (udisks_daemon_get_utab_monitor (daemon),
+                    "entry-removed",
+                    G_CALLBACK (utab_monitor_on_entry_removed),
+                    provider);
+#endif
+
+  /* The drive configurations need to be re-applied when system wakes up from suspend/hibernate */
+  dbus_conn = udisks_daemon_get_connection (daemon);
+  g_dbus_connection_signal_subscribe (dbus_conn,
+                                      "org.freedesktop.login1",         /* sender */
+                                      "org.freedesktop.login1.Manager", /* interface */
+                                      "PrepareForSleep",                /* signal */
+                                      "/org/freedesktop/login1",        /* object path */
+                                      NULL,                             /* arg0 */
+                                      G_DBUS_SIGNAL_FLAGS_NONE,         /* flags */
+                                      on_system_sleep_signal,           /* callback function */
+                                      provider,                         /* callback user data */
+                                      NULL);                            /* user data freeing func */
+}
+
+static void
+udisks_linux_provider_get_property (GObject    *object,
+                                    guint       prop_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (object);
+
+  switch (prop_id)
+    {
+    case PROP_PROBE_QUEUE_DEPTH:
+      g_mutex_lock (&provider->probe_lock);
+      g_value_set_uint (value, provider->probe_queue_depth);
+      g_mutex_unlock (&provider->probe_lock);
+      break;
+
+    case PROP_PROBE_QUEUE_DEPTH_PEAK:
+      g_mutex_lock (&provider->probe_lock);
+      g_value_set_uint (value, provider->probe_queue_depth_peak);
+      g_mutex_unlock (&provider->probe_lock);
+      break;
+
+    case PROP_PROBED_REQUESTS_BACKLOG:
+      g_mutex_lock (&provider->probe_lock);
+      g_value_set_uint (value, provider->probed_requests.length);
+      g_mutex_unlock (&provider->probe_lock);
+      break;
+
+    case PROP_PROBED_REQUESTS_BACKLOG_PEAK:
+      g_mutex_lock (&provider->probe_lock);
+      g_value_set_uint (value, provider->probed_requests_peak);
+      g_mutex_unlock (&provider->probe_lock);
+      break;
+
+    case PROP_PROVIDER_LOCK_HOLD_PEAK:
+      G_LOCK (provider_lock);
+      g_value_set_int64 (value, provider_lock_hold_peak);
+      G_UNLOCK (provider_lock);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+udisks_linux_provider_class_init (UDisksLinuxProviderClass *klass)
+{
+  GObjectClass *gobject_class;
+  UDisksProviderClass *provider_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize     = udisks_linux_provider_finalize;
+  gobject_class->get_property = udisks_linux_provider_get_property;
+
+  provider_class        = UDISKS_PROVIDER_CLASS (klass);
+  provider_class->start = udisks_linux_provider_start;
+
+  /**
+   * UDisksLinuxProvider:probe-queue-depth:
+   *
+   * The number of uevents waiting to be probed.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_PROBE_QUEUE_DEPTH,
+                                   g_param_spec_uint ("probe-queue-depth",
+                                                      "Probe queue depth",
+                                                      "The number of uevents waiting to be probed",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksLinuxProvider:probe-queue-depth-peak:
+   *
+   * The largest #UDisksLinuxProvider:probe-queue-depth seen.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_PROBE_QUEUE_DEPTH_PEAK,
+                                   g_param_spec_uint ("probe-queue-depth-peak",
+                                                      "Probe queue depth peak",
+                                                      "The largest number of uevents waiting to be probed",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksLinuxProvider:probed-requests-backlog:
+   *
+   * The number of probed uevents waiting to be applied to the exported objects.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_PROBED_REQUESTS_BACKLOG,
+                                   g_param_spec_uint ("probed-requests-backlog",
+                                                      "Probed requests backlog",
+                                                      "The number of probed uevents waiting to be applied",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksLinuxProvider:probed-requests-backlog-peak:
+   *
+   * The largest #UDisksLinuxProvider:probed-requests-backlog seen.
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_PROBED_REQUESTS_BACKLOG_PEAK,
+                                   g_param_spec_uint ("probed-requests-backlog-peak",
+                                                      "Probed requests backlog peak",
+                                                      "The largest number of probed uevents waiting to be applied",
+                                                      0, G_MAXUINT, 0,
+                                                      G_PARAM_READABLE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksLinuxProvider:provider-lock-hold-peak:
+   *
+   * The longest time, in microseconds, the lock protecting the object
+   * maps of the provider has been held. The distribution of the hold
+   * times is available from udisks_metrics_to_variant().
+   */
+  g_object_class_install_property (gobject_class,
+                                   PROP_PROVIDER_LOCK_HOLD_PEAK,
+                                   g_param_spec_int64 ("provider-lock-hold-peak",
+                                                       "Provider lock hold peak",
+                                                       "The longest time the provider lock has been held",
+                                                       0, G_MAXINT64, 0,
+                                                       G_PARAM_READABLE |
+                                                       G_PARAM_STATIC_STRINGS));
+}
+
+/**
+ * udisks_linux_provider_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Create a new provider object for Linux-specific objects / functionality.
+ *
+ * Returns: A #UDisksLinuxProvider object. Free with g_object_unref().
+ */
+UDisksLinuxProvider *
+udisks_linux_provider_new (UDisksDaemon  *daemon)
+{
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  return UDISKS_LINUX_PROVIDER (g_object_new (UDISKS_TYPE_LINUX_PROVIDER,
+                                              "daemon", daemon,
+                                              NULL));
+}
+
+/**
+ * udisks_linux_provider_get_udev_client:
+ * @provider: A #UDisksLinuxProvider.
+ *
+ * Gets the #GUdevClient used by @provider.
+ *
+ * Returns: A #GUdevClient owned by @provider. Do not free.
+ */
+GUdevClient *
+udisks_linux_provider_get_udev_client (UDisksLinuxProvider *provider)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+  return provider->gudev_client;
+}
+
+
+/**
+ * udisks_linux_provider_get_coldplug:
+ * @provider: A #UDisksLinuxProvider.
+ *
+ * Gets whether @provider is in the coldplug phase.
+ *
+ * Returns: %TRUE if in the coldplug phase, %FALSE otherwise.
+ **/
+gboolean
+udisks_linux_provider_get_coldplug (UDisksLinuxProvider *provider)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), FALSE);
+  return provider->coldplug;
+}
+
+/**
+ * udisks_linux_provider_get_uevent_context:
+ * @provider: A #UDisksLinuxProvider.
+ *
+ * Gets the #GMainContext of the thread uevents are applied in. Updates of
+ * the objects maintained by @provider triggered from elsewhere should be
+ * invoked in this context to be serialized with the uevents.
+ *
+ * Returns: A #GMainContext owned by @provider. Do not free.
+ */
+GMainContext *
+udisks_linux_provider_get_uevent_context (UDisksLinuxProvider *provider)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+  return provider->uevent_context;
+}
+
+/**
+ * udisks_linux_provider_invoke_for_modules:
+ * @provider: A #UDisksLinuxProvider.
+ * @func: Function to call.
+ * @data: Data to pass to @func.
+ * @notify: Function to free @data with or %NULL.
+ *
+ * Calls @func in the main thread, where the callbacks of modules are
+ * expected to run, see #UDisksModuleObjectIface. When called in the thread
+ * uevents are applied in, @func is queued to the default main context after
+ * the functions queued before, otherwise it's called right away.
+ */
+void
+udisks_linux_provider_invoke_for_modules (UDisksLinuxProvider *provider,
+                                          GSourceFunc          func,
+                                          gpointer             data,
+                                          GDestroyNotify       notify)
+{
+  g_return_if_fail (UDISKS_IS_LINUX_PROVIDER (provider));
+
+  if (g_thread_self () != provider->uevent_thread)
+    {
+      func (data);
+      if (notify != NULL)
+        notify (data);
+      return;
+    }
+
+  g_idle_add_full (G_PRIORITY_DEFAULT, func, data, notify);
+}
+
+/**
+ * udisks_linux_provider_get_manager:
+ * @provider: A #UDisksLinuxProvider.
+ *
+ * Gets the #UDisksLinuxManager exported by @provider.
+ *
+ * Returns: A #UDisksLinuxManager owned by @provider or %NULL if @provider has not been started. Do not free.
+ */
+UDisksLinuxManager *
+udisks_linux_provider_get_manager (UDisksLinuxProvider *provider)
+{
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  if (provider->manager_object == NULL)
+    return NULL;
+
+  return UDISKS_LINUX_MANAGER (udisks_object_peek_manager (UDISKS_OBJECT (provider->manager_object)));
+}
+
+/**
+ * udisks_linux_provider_append_footprint:
+ * @provider: A #UDisksLinuxProvider.
+ * @str: A #GString to append to.
+ *
+ * Appends the sizes of the internal tables of @provider to @str, one
+ * <literal>name: size</literal> line per table, followed by the
+ * #UDisksSysfsReader counters. Used for the report
+ * logged on SIGUSR1, see udisks_daemon_get_footprint_report().
+ */
+void
+udisks_linux_provider_append_footprint (UDisksLinuxProvider *provider,
+                                        GString             *str)
+{
+  GHashTableIter iter;
+  GHashTable *inst_table;
+  guint n_module_instances = 0;
+  guint num_sysfs_reads;
+  guint num_sysfs_opens;
+  guint num_uevents;
+
+  g_return_if_fail (UDISKS_IS_LINUX_PROVIDER (provider));
+
+  provider_lock_acquire (provider);
+  g_string_append_printf (str, "  sysfs_to_block: %u\n", g_hash_table_size (provider->sysfs_to_block));
+  g_string_append_printf (str, "  vpd_to_drive: %u\n", g_hash_table_size (provider->vpd_to_drive));
+  g_string_append_printf (str, "  sysfs_path_to_drive: %u\n", g_hash_table_size (provider->sysfs_path_to_drive));
+  g_string_append_printf (str, "  sysfs_path_to_vpd: %u (%u hits, %u misses)\n",
+                          g_hash_table_size (provider->sysfs_path_to_vpd),
+                          provider->vpd_cache_hits, provider->vpd_cache_misses);
+  g_string_append_printf (str, "  uuid_to_mdraid: %u\n", g_hash_table_size (provider->uuid_to_mdraid));
+  g_string_append_printf (str, "  sysfs_path_to_mdraid: %u\n", g_hash_table_size (provider->sysfs_path_to_mdraid));
+  g_string_append_printf (str, "  sysfs_path_to_mdraid_members: %u\n", g_hash_table_size (provider->sysfs_path_to_mdraid_members));
+  g_string_append_printf (str, "  sysfs_path_to_enclosure: %u\n", g_hash_table_size (provider->sysfs_path_to_enclosure));
+  g_hash_table_iter_init (&iter, provider->module_funcs_to_instances);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &inst_table))
+    n_module_instances += g_hash_table_size (inst_table);
+  g_string_append_printf (str, "  module_funcs_to_instances: %u (%u instances)\n",
+                          g_hash_table_size (provider->module_funcs_to_instances), n_module_instances);
+  g_string_append_printf (str, "  module_sysfs_path_to_owners: %u\n", g_hash_table_size (provider->module_sysfs_path_to_owners));
+  provider_lock_release (provider, G_STRFUNC);
+
+  g_mutex_lock (&provider->housekeeping_lock);
+  g_string_append_printf (str, "  drive_housekeeping: %u\n", g_hash_table_size (provider->drive_housekeeping));
+  g_string_append_printf (str, "  module_housekeeping: %u\n", g_hash_table_size (provider->module_housekeeping));
+  g_mutex_unlock (&provider->housekeeping_lock);
+
+  g_mutex_lock (&provider->block_index_lock);
+  g_string_append_printf (str, "  block_index_by_sysfs_path: %u\n", g_hash_table_size (provider->block_index_by_sysfs_path));
+  g_string_append_printf (str, "  block_index_by_device_number: %u\n", g_hash_table_size (provider->block_index_by_device_number));
+  g_string_append_printf (str, "  block_index_by_device_file: %u\n", g_hash_table_size (provider->block_index_by_device_file));
+  g_mutex_unlock (&provider->block_index_lock);
+
+  g_mutex_lock (&provider->holders_lock);
+  g_string_append_printf (str, "  slaves_by_holder: %u\n", g_hash_table_size (provider->slaves_by_holder));
+  g_string_append_printf (str, "  holders_by_slave: %u\n", g_hash_table_size (provider->holders_by_slave));
+  g_mutex_unlock (&provider->holders_lock);
+
+  g_mutex_lock (&provider->probe_lock);
+  g_string_append_printf (str, "  sysfs_path_to_probe_requests: %u\n", g_hash_table_size (provider->sysfs_path_to_probe_requests));
+  g_string_append_printf (str, "  sysfs_path_to_parked_probe: %u\n", g_hash_table_size (provider->sysfs_path_to_parked_probe));
+  g_string_append_printf (str, "  probed_requests: %u\n", provider->probed_requests.length);
+  num_uevents = provider->num_uevents;
+  g_mutex_unlock (&provider->probe_lock);
+
+  udisks_sysfs_reader_get_counters (&num_sysfs_reads, &num_sysfs_opens);
+  g_string_append_printf (str, "  sysfs reads: %u (%u opens, %.1f reads per uevent over %u uevents)\n",
+                          num_sysfs_reads, num_sysfs_opens,
+                          num_uevents > 0 ? (gdouble) num_sysfs_reads / num_uevents : 0.0,
+                          num_uevents);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_linux_provider_find_block_by_sysfs_path:
+ * @provider: A #UDisksLinuxProvider.
+ * @sysfs_path: A sysfs path.
+ *
+ * Looks up the exported block object for @sysfs_path. This can be
+ * called from any thread.
+ *
+ * Returns: (transfer full): A #UDisksLinuxBlockObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksLinuxBlockObject *
+udisks_linux_provider_find_block_by_sysfs_path (UDisksLinuxProvider *provider,
+                                                const gchar         *sysfs_path)
+{
+  BlockIndexEntry *entry;
+  UDisksLinuxBlockObject *ret = NULL;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  if (sysfs_path == NULL)
+    return NULL;
+
+  g_mutex_lock (&provider->block_index_lock);
+  entry = g_hash_table_lookup (provider->block_index_by_sysfs_path, sysfs_path);
+  if (entry != NULL)
+    ret = g_object_ref (entry->object);
+  g_mutex_unlock (&provider->block_index_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_provider_find_block_by_device_number:
+ * @provider: A #UDisksLinuxProvider.
+ * @device_number: A #dev_t with the device number to find.
+ *
+ * Looks up the exported block object with @device_number. This can
+ * be called from any thread.
+ *
+ * Returns: (transfer full): A #UDisksLinuxBlockObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksLinuxBlockObject *
+udisks_linux_provider_find_block_by_device_number (UDisksLinuxProvider *provider,
+                                                   dev_t                device_number)
+{
+  BlockIndexEntry *entry;
+  UDisksLinuxBlockObject *ret = NULL;
+  gint64 key = device_number;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  g_mutex_lock (&provider->block_index_lock);
+  entry = g_hash_table_lookup (provider->block_index_by_device_number, &key);
+  if (entry != NULL)
+    ret = g_object_ref (entry->object);
+  g_mutex_unlock (&provider->block_index_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_provider_find_block_by_device_file:
+ * @provider: A #UDisksLinuxProvider.
+ * @device_file: A device file, e.g. <filename>/dev/sda</filename>.
+ *
+ * Looks up the exported block object with @device_file. Symlinks
+ * are not resolved. This can be called from any thread.
+ *
+ * Returns: (transfer full): A #UDisksLinuxBlockObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksLinuxBlockObject *
+udisks_linux_provider_find_block_by_device_file (UDisksLinuxProvider *provider,
+                                                 const gchar         *device_file)
+{
+  BlockIndexEntry *entry;
+  UDisksLinuxBlockObject *ret = NULL;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  if (device_file == NULL)
+    return NULL;
+
+  g_mutex_lock (&provider->block_index_lock);
+  entry = g_hash_table_lookup (provider->block_index_by_device_file, device_file);
+  if (entry != NULL)
+    ret = g_object_ref (entry->object);
+  g_mutex_unlock (&provider->block_index_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_provider_find_drive_by_sysfs_path:
+ * @provider: A #UDisksLinuxProvider.
+ * @sysfs_path: The sysfs path of a whole-disk block device.
+ *
+ * Looks up the drive object that the whole-disk block device at
+ * @sysfs_path is a path of. This can be called from any thread.
+ *
+ * Returns: (transfer full): A #UDisksLinuxDriveObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksLinuxDriveObject *
+udisks_linux_provider_find_drive_by_sysfs_path (UDisksLinuxProvider *provider,
+                                                const gchar         *sysfs_path)
+{
+  UDisksLinuxDriveObject *ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  if (sysfs_path == NULL)
+    return NULL;
+
+  g_mutex_lock (&provider->drive_index_lock);
+  ret = g_hash_table_lookup (provider->drive_index_by_sysfs_path, sysfs_path);
+  if (ret != NULL)
+    g_object_ref (ret);
+  g_mutex_unlock (&provider->drive_index_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_provider_dup_slaves:
+ * @provider: A #UDisksLinuxProvider.
+ * @sysfs_path: The sysfs path of a block device.
+ *
+ * Looks up the slaves of the block device at @sysfs_path, i.e. the
+ * devices it is stacked on, in the holders/slaves graph the provider keeps
+ * up to date on uevents. This can be called from any thread.
+ *
+ * Returns: (transfer full): The sysfs paths of the slaves or %NULL if
+ *   there was no uevent for @sysfs_path yet. Free with g_strfreev().
+ */
+gchar **
+udisks_linux_provider_dup_slaves (UDisksLinuxProvider *provider,
+                                  const gchar         *sysfs_path)
+{
+  gchar **ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  if (sysfs_path == NULL)
+    return NULL;
+
+  g_mutex_lock (&provider->holders_lock);
+  ret = g_strdupv (g_hash_table_lookup (provider->slaves_by_holder, sysfs_path));
+  g_mutex_unlock (&provider->holders_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_linux_provider_dup_holders:
+ * @provider: A #UDisksLinuxProvider.
+ * @sysfs_path: The sysfs path of a block device.
+ *
+ * Looks up the holders of the block device at @sysfs_path, i.e. the
+ * devices stacked on it, in the holders/slaves graph the provider keeps
+ * up to date on uevents. This can be called from any thread.
+ *
+ * Returns: (transfer full): The sysfs paths of the holders. Free with g_strfreev().
+ */
+gchar **
+udisks_linux_provider_dup_holders (UDisksLinuxProvider *provider,
+                                   const gchar         *sysfs_path)
+{
+  GHashTable *holders;
+  GHashTableIter iter;
+  gpointer key;
+  GPtrArray *ret;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  ret = g_ptr_array_new ();
+  g_mutex_lock (&provider->holders_lock);
+  holders = sysfs_path != NULL ? g_hash_table_lookup (provider->holders_by_slave, sysfs_path) : NULL;
+  if (holders != NULL)
+    {
+      g_hash_table_iter_init (&iter, holders);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        g_ptr_array_add (ret, g_strdup (key));
+    }
+  g_mutex_unlock (&provider->holders_lock);
+  g_ptr_array_add (ret, NULL);
+
+  return (gchar **) g_ptr_array_free (ret, FALSE);
+}
+
+/**
+ * udisks_linux_provider_find_cleartext_block:
+ * @provider: A #UDisksLinuxProvider.
+ * @sysfs_path: The sysfs path of an encrypted block device.
+ * @crypto_object_path: The object path of the block object for @sysfs_path.
+ *
+ * Looks for the block object stacked on @sysfs_path with
+ * @crypto_object_path as its CryptoBackingDevice in the holders/slaves
+ * graph instead of going through all the objects. Like the backing device
+ * is resolved in udisks_linux_block_update(), holders without a block
+ * object are looked through. This can be called from any thread.
+ *
+ * Returns: (transfer full): A #UDisksLinuxBlockObject or %NULL if not found. Free with g_object_unref().
+ */
+UDisksLinuxBlockObject *
+udisks_linux_provider_find_cleartext_block (UDisksLinuxProvider *provider,
+                                            const gchar         *sysfs_path,
+                                            const gchar         *crypto_object_path)
+{
+  UDisksLinuxBlockObject *ret = NULL;
+  UDisksLinuxBlockObject *holder_object;
+  UDisksBlock *block;
+  gchar **holders;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
+
+  holders = udisks_linux_provider_dup_holders (provider, sysfs_path);
+  for (n = 0; holders[n] != NULL && ret == NULL; n++)
+    {
+      holder_object = udisks_linux_provider_find_block_by_sysfs_path (provider, holders[n]);
+      if (holder_object == NULL)
+        {
+          ret = udisks_linux_provider_find_cleartext_block (provider, holders[n], crypto_object_path);
+          continue;
+        }
+
+      block = udisks_object_peek_block (UDISKS_OBJECT (holder_object));
+      if (block != NULL && g_strcmp0 (udisks_block_get_crypto_backing_device (block), crypto_object_path) == 0)
+        ret = g_object_ref (holder_object);
+      g_object_unref (holder_object);
+    }
+  g_strfreev (holders);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+perform_initial_housekeeping_for_drive (GTask           *task,
+                                        gpointer         source_object,
+                                        gpointer         task_data,
+                                        GCancellable    *cancellable)
+{
+  UDisksLinuxDriveObject *object = UDISKS_LINUX_DRIVE_OBJECT (source_object);
+  GError *error;
+
+  error = NULL;
+  if (!udisks_linux_drive_object_housekeeping (object, 0,
+                                               NULL, /* TODO: cancellable */
+                                               &error))
+    {
+      udisks_warning ("Error performing initial housekeeping for drive %s: %s (%s, %d)",
+                      g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called with lock held */
+
+static void
+maybe_remove_mdraid_object (UDisksLinuxProvider     *provider,
+                            UDisksLinuxMDRaidObject *object)
+{
+  gchar *object_uuid = NULL;
+  UDisksDaemon *daemon = NULL;
+
+  /* remove the object only if there are no devices left */
+  if (udisks_linux_mdraid_object_have_devices (object))
+    goto out;
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+
+  object_uuid = g_strdup (udisks_linux_mdraid_object_get_uuid (object));
+  g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
+                                         g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  g_warn_if_fail (g_hash_table_remove (provider->uuid_to_mdraid, object_uuid));
+
+ out:
+  g_free (object_uuid);
+}
+
+static void
+handle_block_uevent_for_mdraid_with_uuid (UDisksLinuxProvider *provider,
+                                          const gchar         *action,
+                                          UDisksLinuxDevice   *device,
+                                          const gchar         *uuid,
+                                          gboolean             is_member)
+{
+  UDisksLinuxMDRaidObject *object;
+  UDisksDaemon *daemon;
+  const gchar *sysfs_path;
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+
+  /* if uuid is NULL or bogus, consider it a remove event */
+  if (uuid == NULL || g_strcmp0 (uuid, "00000000:00000000:00000000:00000000") == 0)
+    action = "remove";
+  else
+    {
+      /* sometimes the bogus UUID looks legit, but it is still bogus. */
+      if (!is_member)
+        {
+          UDisksLinuxMDRaidObject *candidate = g_hash_table_lookup (provider->sysfs_path_to_mdraid, sysfs_path);
+          if (candidate != NULL &&
+              g_strcmp0 (uuid, udisks_linux_mdraid_object_get_uuid (candidate)) != 0)
+            {
+              udisks_debug ("UUID of %s became bogus (changed from %s to %s)",
+                            sysfs_path, udisks_linux_mdraid_object_get_uuid (candidate), uuid);
+              action = "remove";
+            }
+        }
+    }
+
+  if (g_strcmp0 (action, "remove") == 0)
+    {
+      /* first check if this device was a member */
+      object = g_hash_table_lookup (provider->sysfs_path_to_mdraid_members, sysfs_path);
+      if (object != NULL)
+        {
+          udisks_linux_mdraid_object_uevent (object, action, device, TRUE /* is_member */);
+          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_mdraid_members, sysfs_path));
+          maybe_remove_mdraid_object (provider, object);
+        }
+
+      /* then check if the device was the raid device */
+      object = g_hash_table_lookup (provider->sysfs_path_to_mdraid, sysfs_path);
+      if (object != NULL)
+        {
+          udisks_linux_mdraid_object_uevent (object, action, device, FALSE /* is_member */);
+          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_mdraid, sysfs_path));
+          maybe_remove_mdraid_object (provider, object);
+        }
+    }
+  else
+    {
+      if (uuid == NULL)
+        goto out;
+
+      object = g_hash_table_lookup (provider->uuid_to_mdraid, uuid);
+      if (object != NULL)
+        {
+          if (is_member)
+            {
+              if (g_hash_table_lookup (provider->sysfs_path_to_mdraid_members, sysfs_path) == NULL)
+                g_hash_table_insert (provider->sysfs_path_to_mdraid_members, g_strdup (sysfs_path), object);
+            }
+          else
+            {
+              if (g_hash_table_lookup (provider->sysfs_path_to_mdraid, sysfs_path) == NULL)
+                g_hash_table_insert (provider->sysfs_path_to_mdraid, g_strdup (sysfs_path), object);
+            }
+          udisks_linux_mdraid_object_uevent (object, action, device, is_member);
+        }
+      else
+        {
+          object = udisks_linux_mdraid_object_new (daemon, uuid);
+          udisks_linux_mdraid_object_uevent (object, action, device, is_member);
+          udisks_daemon_export_object_uniquely (daemon, G_DBUS_OBJECT_SKELETON (object));
+          g_hash_table_insert (provider->uuid_to_mdraid, g_strdup (uuid), object);
+          if (is_member)
+            g_hash_table_insert (provider->sysfs_path_to_mdraid_members, g_strdup (sysfs_path), object);
+          else
+            g_hash_table_insert (provider->sysfs_path_to_mdraid, g_strdup (sysfs_path), object);
+        }
+    }
+
+ out:
+  ;
+}
+
+static void
+handle_block_uevent_for_mdraid (UDisksLinuxProvider *provider,
+                                const gchar         *action,
+                                UDisksLinuxDevice   *device)
+{
+  const gchar *uuid;
+  const gchar *member_uuid;
+
+  /* For nested RAID levels, a device can be both a member of one
+   * array and the RAID device for another. Therefore we need to
+   * consider both UUIDs.
+   *
+   * For removal, we also need to consider the case where there is no
+   * UUID.
+   */
+  uuid = g_udev_device_get_property (device->udev_device, "UDISKS_MD_UUID");
+  if (! uuid)
+    uuid = g_udev_device_get_property (device->udev_device, "STORAGED_MD_UUID");
+
+  member_uuid = g_udev_device_get_property (device->udev_device, "UDISKS_MD_MEMBER_UUID");
+  if (! member_uuid)
+    member_uuid = g_udev_device_get_property (device->udev_device, "STORAGED_MD_MEMBER_UUID");
+
+  if (uuid != NULL)
+    handle_block_uevent_for_mdraid_with_uuid (provider, action, device, uuid, FALSE);
+
+  if (member_uuid != NULL)
+    handle_block_uevent_for_mdraid_with_uuid (provider, action, device, member_uuid, TRUE);
+
+  if (uuid == NULL && member_uuid == NULL)
+    handle_block_uevent_for_mdraid_with_uuid (provider, action, device, NULL, FALSE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  gchar    *identity_key;
+  gboolean  include;
+  gchar    *vpd;
+} VpdCacheEntry;
+
+static void
+vpd_cache_entry_free (gpointer data)
+{
+  VpdCacheEntry *entry = data;
+
+  g_free (entry->identity_key);
+  g_free (entry->vpd);
+  g_free (entry);
+}
+
+/* Like udisks_linux_drive_object_should_include_device() but reuses the
+ * result of the last uevent for the same device unless any of the udev
+ * properties the identity is computed from changed.
+ *
+ * called with lock held */
+static gboolean
+should_include_device (UDisksLinuxProvider  *provider,
+                       UDisksLinuxDevice    *device,
+                       gchar               **out_vpd)
+{
+  const gchar *sysfs_path;
+  VpdCacheEntry *entry;
+  gchar *identity_key;
+
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+  identity_key = udisks_linux_drive_object_dup_identity_key (device);
+
+  entry = g_hash_table_lookup (provider->sysfs_path_to_vpd, sysfs_path);
+  if (entry != NULL && g_strcmp0 (entry->identity_key, identity_key) == 0)
+    {
+      provider->vpd_cache_hits++;
+      g_free (identity_key);
+    }
+  else
+    {
+      provider->vpd_cache_misses++;
+      entry = g_new0 (VpdCacheEntry, 1);
+      entry->identity_key = identity_key;
+      entry->include = udisks_linux_drive_object_should_include_device (provider->gudev_client, device, &entry->vpd);
+      g_hash_table_replace (provider->sysfs_path_to_vpd, g_strdup (sysfs_path), entry);
+    }
+
+  *out_vpd = g_strdup (entry->vpd);
+  return entry->include;
+}
+
+/* called with lock held */
+static void
+handle_block_uevent_for_drive (UDisksLinuxProvider *provider,
+                               const gchar         *action,
+                               UDisksLinuxDevice   *device)
+{
+  UDisksLinuxDriveObject *object;
+  UDisksDaemon *daemon;
+  GTask *task;
+  const gchar *sysfs_path;
+  gchar *vpd;
+
+  vpd = NULL;
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+
+  if (g_strcmp0 (action, "remove") == 0)
+    {
+      object = g_hash_table_lookup (provider->sysfs_path_to_drive, sysfs_path);
+      if (object != NULL)
+        {
+          GList *devices;
+
+          udisks_linux_drive_object_uevent (object, action, device);
+
+          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_drive, sysfs_path));
+          drive_index_update (provider, sysfs_path, NULL);
+          g_hash_table_remove (provider->sysfs_path_to_vpd, sysfs_path);
+
+          devices = udisks_linux_drive_object_get_devices (object);
+          if (devices == NULL)
+            {
+              const gchar *existing_vpd;
+              existing_vpd = g_object_get_data (G_OBJECT (object), "x-vpd");
+              g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
+                                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+              g_warn_if_fail (g_hash_table_remove (provider->vpd_to_drive, existing_vpd));
+            }
+          g_list_free_full (devices, g_object_unref);
+        }
+    }
+  else
+    {
+      /* a new device may reuse the sysfs path of a device that went
+       * away without being included, so never trust the cache on "add" */
+      if (g_strcmp0 (action, "add") == 0)
+        g_hash_table_remove (provider->sysfs_path_to_vpd, sysfs_path);
+      if (!should_include_device (provider, device, &vpd))
+        goto out;
+
+      if (vpd == NULL)
+        {
+          udisks_debug ("Ignoring block device %s with no serial or WWN",
+                        g_udev_device_get_sysfs_path (device->udev_device));
+          goto out;
+        }
+      object = g_hash_table_lookup (provider->vpd_to_drive, vpd);
+      if (object != NULL)
+        {
+          if (g_hash_table_lookup (provider->sysfs_path_to_drive, sysfs_path) == NULL)
+            {
+              g_hash_table_insert (provider->sysfs_path_to_drive, g_strdup (sysfs_path), object);
+              drive_index_update (provider, sysfs_path, object);
+            }
+          udisks_linux_drive_object_uevent (object, action, device);
+        }
+      else
+        {
+          if (g_strcmp0 (action, "add") == 0) /* don't create new drive object on "change" event */
+            {
+              object = udisks_linux_drive_object_new (daemon, device);
+              if (object != NULL)
+                {
+                  g_object_set_data_full (G_OBJECT (object), "x-vpd", g_strdup (vpd), g_free);
+                  udisks_daemon_export_object_uniquely (daemon, G_DBUS_OBJECT_SKELETON (object));
+                  g_hash_table_insert (provider->vpd_to_drive, g_strdup (vpd), object);
+                  g_hash_table_insert (provider->sysfs_path_to_drive, g_strdup (sysfs_path), object);
+                  drive_index_update (provider, sysfs_path, object);
+
+                  /* schedule initial housekeeping for the drive unless coldplugging */
+                  if (!provider->coldplug)
+                    {
+                      task = g_task_new (object, NULL, NULL, NULL);
+                      g_task_run_in_thread (task, perform_initial_housekeeping_for_drive);
+                      g_object_unref (task);
+                    }
+                }
+            }
+        }
+    }
+
+ out:
+  g_free (vpd);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Things that need to be done when receiving 'remove' uevent before removing
+   the dbus object.
+   Currently used only to properly unset the 'CleartextDevice' property after
+   removing cleartext device (e.g. when closing/locking a LUKS device)
+ */
+static void
+block_pre_remove (UDisksLinuxProvider *provider,
+                  UDisksLinuxBlockObject *object)
+{
+  UDisksDaemon *daemon = NULL;
+  UDisksBlock *block = NULL;
+  UDisksObject *backing_object = NULL;
+  UDisksEncrypted *encrypted = NULL;
+  gchar *backing_path = NULL;
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  block = udisks_object_peek_block (UDISKS_OBJECT (object));
+  if (block == NULL)
+    goto out;
+
+  backing_path = udisks_block_dup_crypto_backing_device (block);
+  if (!backing_path || g_strcmp0 (backing_path, "/") == 0)
+    goto out;
 
-  provider->coldplug = TRUE;
+  backing_object = udisks_daemon_find_object (daemon, backing_path);
+  if (backing_object == NULL)
+    goto out;
 
-  if (UDISKS_PROVIDER_CLASS (udisks_linux_provider_parent_class)->start != NULL)
-    UDISKS_PROVIDER_CLASS (udisks_linux_provider_parent_class)->start (_provider);
+  encrypted = udisks_object_peek_encrypted (UDISKS_OBJECT (backing_object));
+  if (encrypted == NULL)
+    goto out;
 
-  provider->sysfs_to_block = g_hash_table_new_full (g_str_hash,
-                                                    g_str_equal,
-                                                    g_free,
-                                                    (GDestroyNotify) g_object_unref);
-  provider->vpd_to_drive = g_hash_table_new_full (g_str_hash,
-                                                  g_str_equal,
-                                                  g_free,
-                                                  (GDestroyNotify) g_object_unref);
-  provider->sysfs_path_to_drive = g_hash_table_new_full (g_str_hash,
-                                                         g_str_equal,
-                                                         g_free,
-                                                         NULL);
-  provider->uuid_to_mdraid = g_hash_table_new_full (g_str_hash,
-                                                    g_str_equal,
-                                                    g_free,
-                                                    (GDestroyNotify) g_object_unref);
-  provider->sysfs_path_to_mdraid = g_hash_table_new_full (g_str_hash,
-                                                          g_str_equal,
-                                                          g_free,
-                                                          NULL);
-  provider->sysfs_path_to_mdraid_members = g_hash_table_new_full (g_str_hash,
-                                                                  g_str_equal,
-                                                                  g_free,
-                                                                  NULL);
-  provider->module_funcs_to_instances = g_hash_table_new_full (g_direct_hash,
-                                                               g_direct_equal,
-                                                               NULL,
-                                                               (GDestroyNotify) g_hash_table_unref);
+  udisks_encrypted_set_cleartext_device (UDISKS_ENCRYPTED (encrypted), "/");
+
+out:
+  g_clear_object (&backing_object);
+  g_free (backing_path);
+}
+
+/* called with lock held */
+static void
+handle_block_uevent_for_block (UDisksLinuxProvider *provider,
+                               const gchar         *action,
+                               UDisksLinuxDevice   *device)
+{
+  const gchar *sysfs_path;
+  UDisksLinuxBlockObject *object;
+  UDisksDaemon *daemon;
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
 
-  provider->manager_object = udisks_object_skeleton_new ("/org/freedesktop/UDisks2/Manager");
-  manager = udisks_linux_manager_new (daemon);
-  udisks_object_skeleton_set_manager (provider->manager_object, manager);
-  g_object_unref (manager);
+  /* a device that became passive is hidden like a removed one */
+  if (g_strcmp0 (action, "remove") == 0 ||
+      (udisks_config_manager_get_passive_devices (udisks_daemon_get_config_manager (daemon))
+         == UDISKS_PASSIVE_DEVICES_HIDDEN &&
+       udisks_linux_device_is_passive (device)))
+    {
+      object = g_hash_table_lookup (provider->sysfs_to_block, sysfs_path);
+      if (object != NULL)
+        {
+          block_pre_remove (provider, object);
+          block_index_update (provider, sysfs_path, NULL, NULL);
+          g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
+                                                 g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+          g_warn_if_fail (g_hash_table_remove (provider->sysfs_to_block, sysfs_path));
+        }
+    }
+  else
+    {
+      object = g_hash_table_lookup (provider->sysfs_to_block, sysfs_path);
+      if (object != NULL)
+        {
+          udisks_linux_block_object_uevent (object, action, device);
+          block_index_update (provider, sysfs_path, object, device);
+        }
+      else
+        {
+          object = udisks_linux_block_object_new (daemon, device);
+          udisks_daemon_export_object_uniquely (daemon, G_DBUS_OBJECT_SKELETON (object));
+          g_hash_table_insert (provider->sysfs_to_block, g_strdup (sysfs_path), object);
+          block_index_update (provider, sysfs_path, object, device);
+        }
+    }
+}
 
-  module_manager = udisks_daemon_get_module_manager (daemon);
-  g_signal_connect_swapped (module_manager, "notify::modules-ready", G_CALLBACK (ensure_modules), provider);
-  ensure_modules (provider);
+/* ---------------------------------------------------------------------------------------------------- */
 
-  g_dbus_object_manager_server_export (udisks_daemon_get_object_manager (daemon),
-                                       G_DBUS_OBJECT_SKELETON (provider->manager_object));
+typedef struct
+{
+  /* NULL if the function didn't declare any criteria */
+  const UDisksModuleObjectNewFuncMatch *match;
+  GPatternSpec *sysfs_path_pattern;
+} ModuleDispatchEntry;
 
-  /* probe for extra data we don't get from udev */
-  udisks_info ("Initialization (device probing)");
-  udisks_devices = get_udisks_devices (provider);
+static void
+module_dispatch_entry_free (gpointer data)
+{
+  ModuleDispatchEntry *entry = data;
 
-  /* do two coldplug runs to handle dependencies between devices */
-  for (n = 0; n < 2; n++)
+  if (entry->sysfs_path_pattern != NULL)
+    g_pattern_spec_free (entry->sysfs_path_pattern);
+  g_free (entry);
+}
+
+/* called with lock held */
+static ModuleDispatchEntry *
+get_module_dispatch_entry (UDisksLinuxProvider       *provider,
+                           UDisksModuleManager       *module_manager,
+                           UDisksModuleObjectNewFunc  module_object_new_func)
+{
+  ModuleDispatchEntry *entry;
+
+  entry = g_hash_table_lookup (provider->module_dispatch, module_object_new_func);
+  if (entry == NULL)
     {
-      udisks_info ("Initialization (coldplug %u/2)", n + 1);
-      do_coldplug (provider, udisks_devices);
+      entry = g_new0 (ModuleDispatchEntry, 1);
+      entry->match = udisks_module_manager_get_module_object_new_func_match (module_manager,
+                                                                             module_object_new_func);
+      if (entry->match != NULL && entry->match->sysfs_path_pattern != NULL)
+        entry->sysfs_path_pattern = g_pattern_spec_new (entry->match->sysfs_path_pattern);
+      g_hash_table_insert (provider->module_dispatch, module_object_new_func, entry);
     }
-  g_list_free_full (udisks_devices, g_object_unref);
-  udisks_info ("Initialization complete");
 
-  /* schedule housekeeping for every 10 minutes */
-  provider->housekeeping_timeout = g_timeout_add_seconds (10*60,
-                                                          on_housekeeping_timeout,
-                                                          provider);
-  /* ... and also do an initial run */
-  on_housekeeping_timeout (provider);
+  return entry;
+}
 
-  provider->coldplug = FALSE;
+/* Returns FALSE if @device can't be of any interest to the function of @entry */
+static gboolean
+module_dispatch_entry_matches (ModuleDispatchEntry *entry,
+                               UDisksLinuxDevice   *device,
+                               const gchar         *sysfs_path)
+{
+  const gchar * const *p;
 
-  /* update Block:Configuration whenever fstab or crypttab entries are added or removed */
-  g_signal_connect (udisks_daemon_get_fstab_monitor (daemon),
-                    "entry-added",
-                    G_CALLBACK (fstab_monitor_on_entry_added),
-                    provider);
-  g_signal_connect (udisks_daemon_get_fstab_monitor (daemon),
-                    "entry-removed",
-                    G_CALLBACK (fstab_monitor_on_entry_removed),
-                    provider);
-  g_signal_connect (udisks_daemon_get_crypttab_monitor (daemon),
-                    "entry-added",
-                    G_CALLBACK (crypttab_monitor_on_entry_added),
-                    provider);
-  g_signal_connect (udisks_daemon_get_crypttab_monitor (daemon),
-                    "entry-removed",
-                    G_CALLBACK (crypttab_monitor_on_entry_removed),
-                    provider);
-#ifdef HAVE_LIBMOUNT
-  g_signal_connect (udisks_daemon_get_utab_monitor (daemon),
-                    "entry-added",
-                    G_CALLBACK (utab_monitor_on_entry_added),
-                    provider);
-  g_signal_connect (udisks_daemon_get_utab_monitor (daemon),
-                    "entry-removed",
-                    G_CALLBACK (utab_monitor_on_entry_removed),
-                    provider);
-#endif
+  if (entry->match == NULL)
+    return TRUE;
 
-  /* The drive configurations need to be re-applied when system wakes up from suspend/hibernate */
-  dbus_conn = udisks_daemon_get_connection (daemon);
-  g_dbus_connection_signal_subscribe (dbus_conn,
-                                      "org.freedesktop.login1",         /* sender */
-                                      "org.freedesktop.login1.Manager", /* interface */
-                                      "PrepareForSleep",                /* signal */
-                                      "/org/freedesktop/login1",        /* object path */
-                                      NULL,                             /* arg0 */
-                                      G_DBUS_SIGNAL_FLAGS_NONE,         /* flags */
-                                      on_system_sleep_signal,           /* callback function */
-                                      provider,                         /* callback user data */
-                                      NULL);                            /* user data freeing func */
+  if (entry->match->devtype != NULL &&
+      g_strcmp0 (g_udev_device_get_devtype (device->udev_device), entry->match->devtype) != 0)
+    return FALSE;
+
+  if (entry->sysfs_path_pattern != NULL &&
+      ! g_pattern_match_string (entry->sysfs_path_pattern, sysfs_path))
+    return FALSE;
+
+  if (entry->match->udev_properties != NULL)
+    {
+      for (p = entry->match->udev_properties; *p != NULL; p++)
+        if (g_udev_device_has_property (device->udev_device, *p))
+          break;
+      if (*p == NULL)
+        return FALSE;
+    }
+
+  return TRUE;
 }
 
+/* called with lock held */
 static void
-udisks_linux_provider_class_init (UDisksLinuxProviderClass *klass)
+module_owner_add (UDisksLinuxProvider       *provider,
+                  const gchar               *sysfs_path,
+                  UDisksModuleObjectNewFunc  module_object_new_func,
+                  GDBusObjectSkeleton       *object)
 {
-  GObjectClass *gobject_class;
-  UDisksProviderClass *provider_class;
-
-  gobject_class = G_OBJECT_CLASS (klass);
-  gobject_class->finalize     = udisks_linux_provider_finalize;
+  GHashTable *owners;
 
-  provider_class        = UDISKS_PROVIDER_CLASS (klass);
-  provider_class->start = udisks_linux_provider_start;
+  owners = g_hash_table_lookup (provider->module_sysfs_path_to_owners, sysfs_path);
+  if (owners == NULL)
+    {
+      owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (provider->module_sysfs_path_to_owners, g_strdup (sysfs_path), owners);
+    }
+  g_hash_table_insert (owners, object, module_object_new_func);
 }
 
-/**
- * udisks_linux_provider_new:
- * @daemon: A #UDisksDaemon.
- *
- * Create a new provider object for Linux-specific objects / functionality.
- *
- * Returns: A #UDisksLinuxProvider object. Free with g_object_unref().
- */
-UDisksLinuxProvider *
-udisks_linux_provider_new (UDisksDaemon  *daemon)
+/* called with lock held */
+static void
+module_owner_remove (UDisksLinuxProvider *provider,
+                     const gchar         *sysfs_path,
+                     GDBusObjectSkeleton *object)
 {
-  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
-  return UDISKS_LINUX_PROVIDER (g_object_new (UDISKS_TYPE_LINUX_PROVIDER,
-                                              "daemon", daemon,
-                                              NULL));
+  GHashTable *owners;
+
+  owners = g_hash_table_lookup (provider->module_sysfs_path_to_owners, sysfs_path);
+  g_warn_if_fail (owners != NULL && g_hash_table_remove (owners, object));
+  if (owners != NULL && g_hash_table_size (owners) == 0)
+    g_hash_table_remove (provider->module_sysfs_path_to_owners, sysfs_path);
 }
 
-/**
- * udisks_linux_provider_get_udev_client:
- * @provider: A #UDisksLinuxProvider.
- *
- * Gets the #GUdevClient used by @provider.
- *
- * Returns: A #GUdevClient owned by @provider. Do not free.
- */
-GUdevClient *
-udisks_linux_provider_get_udev_client (UDisksLinuxProvider *provider)
+/* called with lock held - returns the instances of @module_object_new_func
+ * that claimed @sysfs_path, free with g_list_free() */
+static GList *
+module_owners_get (UDisksLinuxProvider       *provider,
+                   const gchar               *sysfs_path,
+                   UDisksModuleObjectNewFunc  module_object_new_func)
 {
-  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), NULL);
-  return provider->gudev_client;
-}
+  GHashTable *owners;
+  GHashTableIter iter;
+  gpointer object, func;
+  GList *ret = NULL;
 
+  owners = g_hash_table_lookup (provider->module_sysfs_path_to_owners, sysfs_path);
+  if (owners == NULL)
+    return NULL;
 
-/**
- * udisks_linux_provider_get_coldplug:
- * @provider: A #UDisksLinuxProvider.
- *
- * Gets whether @provider is in the coldplug phase.
- *
- * Returns: %TRUE if in the coldplug phase, %FALSE otherwise.
- **/
-gboolean
-udisks_linux_provider_get_coldplug (UDisksLinuxProvider *provider)
-{
-  g_return_val_if_fail (UDISKS_IS_LINUX_PROVIDER (provider), FALSE);
-  return provider->coldplug;
-}
+  g_hash_table_iter_init (&iter, owners);
+  while (g_hash_table_iter_next (&iter, &object, &func))
+    if (func == (gpointer) module_object_new_func)
+      ret = g_list_prepend (ret, object);
 
-/* ---------------------------------------------------------------------------------------------------- */
+  return ret;
+}
 
-static void
-perform_initial_housekeeping_for_drive (GTask           *task,
-                                        gpointer         source_object,
-                                        gpointer         task_data,
-                                        GCancellable    *cancellable)
+/* called with lock held - records the time spent in the module's callback
+ * next to the interface updates, see udisks_metrics_record() */
+static gboolean
+module_object_process_uevent (UDisksDaemon        *daemon,
+                              GDBusObjectSkeleton *object,
+                              const gchar         *action,
+                              UDisksLinuxDevice   *device)
 {
-  UDisksLinuxDriveObject *object = UDISKS_LINUX_DRIVE_OBJECT (source_object);
-  GError *error;
+  gint64 start_time;
+  gboolean ret;
 
-  error = NULL;
-  if (!udisks_linux_drive_object_housekeeping (object, 0,
-                                               NULL, /* TODO: cancellable */
-                                               &error))
-    {
-      udisks_warning ("Error performing initial housekeeping for drive %s: %s (%s, %d)",
-                      g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
-                      error->message, g_quark_to_string (error->domain), error->code);
-      g_clear_error (&error);
-    }
-}
+  start_time = g_get_monotonic_time ();
+  ret = udisks_module_object_process_uevent (UDISKS_MODULE_OBJECT (object), action, device);
+  udisks_metrics_record (udisks_daemon_get_metrics (daemon),
+                         UDISKS_METRICS_KIND_UPDATE,
+                         G_OBJECT_TYPE_NAME (object),
+                         g_get_monotonic_time () - start_time);
 
-/* ---------------------------------------------------------------------------------------------------- */
+  return ret;
+}
 
 /* called with lock held */
-
 static void
-maybe_remove_mdraid_object (UDisksLinuxProvider     *provider,
-                            UDisksLinuxMDRaidObject *object)
+handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
+                                 const gchar         *action,
+                                 UDisksLinuxDevice   *device)
 {
-  gchar *object_uuid = NULL;
-  UDisksDaemon *daemon = NULL;
-
-  /* remove the object only if there are no devices left */
-  if (udisks_linux_mdraid_object_have_devices (object))
-    goto out;
+  const gchar *sysfs_path;
+  GDBusObjectSkeleton *object;
+  UDisksDaemon *daemon;
+  UDisksModuleManager *module_manager;
+  GList *new_funcs, *l, *ll;
+  UDisksModuleObjectNewFunc module_object_new_func;
+  GHashTable *inst_table;
+  GHashTableIter iter;
+  gboolean handled;
+  GHashTable *inst_sysfs_paths;
+  GList *instances_to_remove;
+  GList *funcs_to_remove = NULL;
+  GList *owners;
+  gboolean may_match;
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  module_manager = udisks_daemon_get_module_manager (daemon);
+  if (! udisks_module_manager_get_modules_available (module_manager))
+    return;
 
-  object_uuid = g_strdup (udisks_linux_mdraid_object_get_uuid (object));
-  g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
-                                         g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-  g_warn_if_fail (g_hash_table_remove (provider->uuid_to_mdraid, object_uuid));
-
- out:
-  g_free (object_uuid);
-}
+  new_funcs = udisks_module_manager_get_module_object_new_funcs (module_manager);
 
-static void
-handle_block_uevent_for_mdraid_with_uuid (UDisksLinuxProvider *provider,
-                                          const gchar         *action,
-                                          UDisksLinuxDevice   *device,
-                                          const gchar         *uuid,
-                                          gboolean             is_member)
-{
-  UDisksLinuxMDRaidObject *object;
-  UDisksDaemon *daemon;
-  const gchar *sysfs_path;
+  /* The object hierarchy is as follows:
+   *
+   *   provider->module_funcs_to_instances:
+   *      key: a UDisksModuleObjectNewFunc (pointer)
+   *      value: nested hashtable
+   *          key: a UDisksObjectSkeleton instance implementing the UDisksModuleObject interface
+   *          value: nested hashtable
+   *              key: sysfs path attached to the UDisksObjectSkeleton instance
+   *              value: -- no values, just keys
+   *
+   *   provider->module_sysfs_path_to_owners (reverse index of the above):
+   *      key: sysfs path
+   *      value: nested hashtable
+   *          key: a UDisksObjectSkeleton instance that claimed the sysfs path
+   *          value: the UDisksModuleObjectNewFunc the instance belongs to
+   */
 
-  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
   sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
 
-  /* if uuid is NULL or bogus, consider it a remove event */
-  if (uuid == NULL || g_strcmp0 (uuid, "00000000:00000000:00000000:00000000") == 0)
-    action = "remove";
-  else
+  /* The following algorithm brings some guarantees to existing instances:
+   *  - every instance can claim one or more devices (sysfs paths)
+   *  - uevents for a claimed device only go to the instances that claimed it (looked up in
+   *    the reverse index, without iterating over all instances)
+   *  - existing instances are asked first and only when none is interested in claiming the device
+   *    a new instance for the current UDisksModuleObjectNewFunc is attempted to be created
+   *  - devices not matching the criteria declared for a UDisksModuleObjectNewFunc are only
+   *    routed to the instances that have already claimed them
+   */
+
+  for (l = new_funcs; l; l = l->next)
     {
-      /* sometimes the bogus UUID looks legit, but it is still bogus. */
-      if (!is_member)
+      handled = FALSE;
+      instances_to_remove = NULL;
+      module_object_new_func = l->data;
+      may_match = module_dispatch_entry_matches (get_module_dispatch_entry (provider, module_manager, module_object_new_func),
+                                                 device, sysfs_path);
+      inst_table = g_hash_table_lookup (provider->module_funcs_to_instances, module_object_new_func);
+      if (inst_table == NULL && ! may_match)
+        continue;
+
+      owners = inst_table ? module_owners_get (provider, sysfs_path, module_object_new_func) : NULL;
+      if (owners != NULL)
         {
-          UDisksLinuxMDRaidObject *candidate = g_hash_table_lookup (provider->sysfs_path_to_mdraid, sysfs_path);
-          if (candidate != NULL &&
-              g_strcmp0 (uuid, udisks_linux_mdraid_object_get_uuid (candidate)) != 0)
+          /* The device has been claimed already, route the uevent straight to the owning instances */
+          for (ll = owners; ll; ll = ll->next)
             {
-              udisks_debug ("UUID of %s became bogus (changed from %s to %s)",
-                            sysfs_path, udisks_linux_mdraid_object_get_uuid (candidate), uuid);
-              action = "remove";
+              object = ll->data;
+              if (! module_object_process_uevent (daemon, object, action, device))
+                {
+                  /* the object has indicated it's no longer interested in the current sysfs path */
+                  inst_sysfs_paths = g_hash_table_lookup (inst_table, object);
+                  g_warn_if_fail (g_hash_table_remove (inst_sysfs_paths, sysfs_path));
+                  module_owner_remove (provider, sysfs_path, object);
+                  if (g_hash_table_size (inst_sysfs_paths) == 0)
+                    {
+                      /* no more sysfs paths, queue for removal */
+                      instances_to_remove = g_list_append (instances_to_remove, object);
+                    }
+                }
             }
+          g_list_free (owners);
+          handled = TRUE;
         }
-    }
-
-  if (g_strcmp0 (action, "remove") == 0)
-    {
-      /* first check if this device was a member */
-      object = g_hash_table_lookup (provider->sysfs_path_to_mdraid_members, sysfs_path);
-      if (object != NULL)
-        {
-          udisks_linux_mdraid_object_uevent (object, action, device, TRUE /* is_member */);
-          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_mdraid_members, sysfs_path));
-          maybe_remove_mdraid_object (provider, object);
-        }
-
-      /* then check if the device was the raid device */
-      object = g_hash_table_lookup (provider->sysfs_path_to_mdraid, sysfs_path);
-      if (object != NULL)
+      else if (inst_table != NULL && may_match)
         {
-          udisks_linux_mdraid_object_uevent (object, action, device, FALSE /* is_member */);
-          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_mdraid, sysfs_path));
-          maybe_remove_mdraid_object (provider, object);
+          /* Ask existing instances whether they're interested in claiming the device */
+          g_hash_table_iter_init (&iter, inst_table);
+          while (g_hash_table_iter_next (&iter, (gpointer *) &object, (gpointer *) &inst_sysfs_paths))
+            {
+              if (module_object_process_uevent (daemon, object, action, device))
+                {
+                  /* the foreign instance is interested in claiming the device */
+                  g_hash_table_add (inst_sysfs_paths, g_strdup (sysfs_path));
+                  module_owner_add (provider, sysfs_path, module_object_new_func, object);
+                  handled = TRUE;
+                }
+            }
         }
-    }
-  else
-    {
-      if (uuid == NULL)
-        goto out;
 
-      object = g_hash_table_lookup (provider->uuid_to_mdraid, uuid);
-      if (object != NULL)
+      /* Remove empty instances */
+      if (instances_to_remove != NULL)
         {
-          if (is_member)
+          for (ll = instances_to_remove; ll; ll = ll->next)
             {
-              if (g_hash_table_lookup (provider->sysfs_path_to_mdraid_members, sysfs_path) == NULL)
-                g_hash_table_insert (provider->sysfs_path_to_mdraid_members, g_strdup (sysfs_path), object);
+              object = ll->data;
+              g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
+                                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+              g_warn_if_fail (g_hash_table_remove (inst_table, object));
             }
-          else
+          if (g_hash_table_size (inst_table) == 0)
             {
-              if (g_hash_table_lookup (provider->sysfs_path_to_mdraid, sysfs_path) == NULL)
-                g_hash_table_insert (provider->sysfs_path_to_mdraid, g_strdup (sysfs_path), object);
+              /* no more instances, queue for removal */
+              funcs_to_remove = g_list_append (funcs_to_remove, module_object_new_func);
+              inst_table = NULL;
             }
-          udisks_linux_mdraid_object_uevent (object, action, device, is_member);
+          g_list_free (instances_to_remove);
         }
-      else
+
+      /* no instance claimed or no instance was interested in this sysfs path, try creating new instance for the current UDisksModuleObjectNewFunc */
+      if (! handled && may_match)
         {
-          object = udisks_linux_mdraid_object_new (daemon, uuid);
-          udisks_linux_mdraid_object_uevent (object, action, device, is_member);
-          g_dbus_object_manager_server_export_uniquely (udisks_daemon_get_object_manager (daemon),
-                                                        G_DBUS_OBJECT_SKELETON (object));
-          g_hash_table_insert (provider->uuid_to_mdraid, g_strdup (uuid), object);
-          if (is_member)
-            g_hash_table_insert (provider->sysfs_path_to_mdraid_members, g_strdup (sysfs_path), object);
-          else
-            g_hash_table_insert (provider->sysfs_path_to_mdraid, g_strdup (sysfs_path), object);
+          object = module_object_new_func (daemon, device);
+          if (object != NULL)
+            {
+              udisks_daemon_export_object_uniquely (daemon, G_DBUS_OBJECT_SKELETON (object));
+              inst_sysfs_paths = g_hash_table_new_full (g_str_hash,
+                                                        g_str_equal,
+                                                        (GDestroyNotify) g_free,
+                                                        NULL);
+              g_hash_table_add (inst_sysfs_paths, g_strdup (sysfs_path));
+              if (inst_table == NULL)
+                {
+                  inst_table = g_hash_table_new_full (g_direct_hash,
+                                                      g_direct_equal,
+                                                      (GDestroyNotify) g_object_unref,
+                                                      (GDestroyNotify) g_hash_table_unref);
+                  g_hash_table_insert (provider->module_funcs_to_instances, module_object_new_func, inst_table);
+                }
+              g_hash_table_insert (inst_table, object, inst_sysfs_paths);
+              module_owner_add (provider, sysfs_path, module_object_new_func, object);
+            }
         }
     }
 
- out:
-  ;
+  /* Remove empty funcs */
+  if (funcs_to_remove != NULL)
+    {
+      for (ll = funcs_to_remove; ll; ll = ll->next)
+        g_warn_if_fail (g_hash_table_remove (provider->module_funcs_to_instances, ll->data));
+      g_list_free (funcs_to_remove);
+    }
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  UDisksLinuxProvider *provider;
+  const gchar *module_name;
+} LazyModuleRequest;
+
 static void
-handle_block_uevent_for_mdraid (UDisksLinuxProvider *provider,
-                                const gchar         *action,
-                                UDisksLinuxDevice   *device)
+lazy_module_request_free (LazyModuleRequest *request)
 {
-  const gchar *uuid;
-  const gchar *member_uuid;
+  g_object_unref (request->provider);
+  g_free (request);
+}
 
-  /* For nested RAID levels, a device can be both a member of one
-   * array and the RAID device for another. Therefore we need to
-   * consider both UUIDs.
-   *
-   * For removal, we also need to consider the case where there is no
-   * UUID.
-   */
-  uuid = g_udev_device_get_property (device->udev_device, "UDISKS_MD_UUID");
-  if (! uuid)
-    uuid = g_udev_device_get_property (device->udev_device, "STORAGED_MD_UUID");
+/* called in the main thread, see request_lazy_module() */
+static gboolean
+on_lazy_module_idle (gpointer user_data)
+{
+  LazyModuleRequest *request = user_data;
+  UDisksDaemon *daemon;
 
-  member_uuid = g_udev_device_get_property (device->udev_device, "UDISKS_MD_MEMBER_UUID");
-  if (! member_uuid)
-    member_uuid = g_udev_device_get_property (device->udev_device, "STORAGED_MD_MEMBER_UUID");
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (request->provider));
 
-  if (uuid != NULL)
-    handle_block_uevent_for_mdraid_with_uuid (provider, action, device, uuid, FALSE);
+  /* "modules-ready" is notified and ensure_modules() replays the coldplug for it */
+  if (! udisks_module_manager_load_module (udisks_daemon_get_module_manager (daemon), request->module_name))
+    udisks_debug ("Module %s not available, not loading it for its devices", request->module_name);
 
-  if (member_uuid != NULL)
-    handle_block_uevent_for_mdraid_with_uuid (provider, action, device, member_uuid, TRUE);
+  return G_SOURCE_REMOVE;
+}
 
-  if (uuid == NULL && member_uuid == NULL)
-    handle_block_uevent_for_mdraid_with_uuid (provider, action, device, NULL, FALSE);
+/* Requests loading of a module not loaded yet that handles @device.
+ *
+ * Called with lock held, possibly in the "uevent" thread. The module is
+ * loaded from the main thread as loading it emits "modules-ready" and
+ * module initialization may need the lock itself. Every module is only
+ * requested once, even if it turns out to be unavailable.
+ */
+static void
+request_lazy_module (UDisksLinuxProvider *provider,
+                     UDisksLinuxDevice   *device)
+{
+  UDisksDaemon *daemon;
+  LazyModuleRequest *request;
+  const gchar *module_name;
+
+  if (! provider->lazy_modules)
+    return;
+
+  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
+  module_name = udisks_module_manager_get_lazy_module_for_device (udisks_daemon_get_module_manager (daemon), device);
+  if (module_name == NULL || g_hash_table_contains (provider->lazy_module_requests, module_name))
+    return;
+
+  udisks_info ("Loading module %s for %s", module_name,
+               g_udev_device_get_device_file (device->udev_device));
+  g_hash_table_add (provider->lazy_module_requests, (gpointer) module_name);
+
+  request = g_new0 (LazyModuleRequest, 1);
+  request->provider = g_object_ref (provider);
+  request->module_name = module_name;
+  g_idle_add_full (G_PRIORITY_DEFAULT,
+                   on_lazy_module_idle,
+                   request,
+                   (GDestroyNotify) lazy_module_request_free);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* called with lock held */
+typedef struct
+{
+  UDisksLinuxProvider *provider;
+  gchar *action;
+  UDisksLinuxDevice *device;
+} ModulesUevent;
+
 static void
-handle_block_uevent_for_drive (UDisksLinuxProvider *provider,
-                               const gchar         *action,
-                               UDisksLinuxDevice   *device)
+modules_uevent_free (ModulesUevent *uevent)
 {
-  UDisksLinuxDriveObject *object;
-  UDisksDaemon *daemon;
-  GTask *task;
-  const gchar *sysfs_path;
-  gchar *vpd;
+  g_object_unref (uevent->provider);
+  g_free (uevent->action);
+  g_object_unref (uevent->device);
+  g_free (uevent);
+}
 
-  vpd = NULL;
-  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
-  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+/* called in the main thread, see queue_block_uevent_for_modules() */
+static gboolean
+on_modules_uevent_idle (gpointer user_data)
+{
+  ModulesUevent *uevent = user_data;
 
-  if (g_strcmp0 (action, "remove") == 0)
-    {
-      object = g_hash_table_lookup (provider->sysfs_path_to_drive, sysfs_path);
-      if (object != NULL)
-        {
-          GList *devices;
+  provider_lock_acquire (uevent->provider);
+  UDISKS_TRACE2 (module_dispatch_start, uevent->action, g_udev_device_get_sysfs_path (uevent->device->udev_device));
+  handle_block_uevent_for_modules (uevent->provider, uevent->action, uevent->device);
+  UDISKS_TRACE2 (module_dispatch_done, uevent->action, g_udev_device_get_sysfs_path (uevent->device->udev_device));
+  provider_lock_release (uevent->provider, G_STRFUNC);
 
-          udisks_linux_drive_object_uevent (object, action, device);
+  return G_SOURCE_REMOVE;
+}
 
-          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_drive, sysfs_path));
+/* called with lock held - modules are only called in the main thread, so the
+ * uevent is handed off to it when applied in the "uevent" thread */
+static void
+queue_block_uevent_for_modules (UDisksLinuxProvider *provider,
+                                const gchar         *action,
+                                UDisksLinuxDevice   *device)
+{
+  ModulesUevent *uevent;
 
-          devices = udisks_linux_drive_object_get_devices (object);
-          if (devices == NULL)
-            {
-              const gchar *existing_vpd;
-              existing_vpd = g_object_get_data (G_OBJECT (object), "x-vpd");
-              g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
-                                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-              g_warn_if_fail (g_hash_table_remove (provider->vpd_to_drive, existing_vpd));
-            }
-          g_list_free_full (devices, g_object_unref);
-        }
+  if (g_thread_self () != provider->uevent_thread)
+    {
+      UDISKS_TRACE2 (module_dispatch_start, action, g_udev_device_get_sysfs_path (device->udev_device));
+      handle_block_uevent_for_modules (provider, action, device);
+      UDISKS_TRACE2 (module_dispatch_done, action, g_udev_device_get_sysfs_path (device->udev_device));
+      return;
+    }
+
+  uevent = g_new0 (ModulesUevent, 1);
+  uevent->provider = g_object_ref (provider);
+  uevent->action = g_strdup (action);
+  uevent->device = g_object_ref (device);
+  g_idle_add_full (G_PRIORITY_DEFAULT,
+                   on_modules_uevent_idle,
+                   uevent,
+                   (GDestroyNotify) modules_uevent_free);
+}
+
+/* called with lock held */
+static void
+handle_block_uevent (UDisksLinuxProvider *provider,
+                     const gchar         *action,
+                     UDisksLinuxDevice   *device)
+{
+  /* We use the sysfs block device for all of
+   *
+   *  - UDisksLinuxDriveObject
+   *  - UDisksLinuxMDRaidObject
+   *  - UDisksLinuxBlockObject
+   *
+   * objects. Ensure that drive and mdraid objects are added before
+   * and removed after block objects.
+   *
+   * The holders/slaves graph is updated first so that the objects can
+   * resolve their relations to other block devices through it.
+   */
+  holders_graph_update (provider,
+                        g_udev_device_get_sysfs_path (device->udev_device),
+                        g_strcmp0 (action, "remove") == 0);
+
+  if (g_strcmp0 (action, "remove") == 0)
+    {
+      handle_block_uevent_for_block (provider, action, device);
+      handle_block_uevent_for_drive (provider, action, device);
+      handle_block_uevent_for_mdraid (provider, action, device);
+      queue_block_uevent_for_modules (provider, action, device);
     }
   else
     {
-      if (!udisks_linux_drive_object_should_include_device (provider->gudev_client, device, &vpd))
-        goto out;
-
-      if (vpd == NULL)
-        {
-          udisks_debug ("Ignoring block device %s with no serial or WWN",
-                        g_udev_device_get_sysfs_path (device->udev_device));
-          goto out;
-        }
-      object = g_hash_table_lookup (provider->vpd_to_drive, vpd);
-      if (object != NULL)
+      if (g_udev_device_get_property_as_boolean (device->udev_device, "DM_UDEV_DISABLE_OTHER_RULES_FLAG"))
         {
-          if (g_hash_table_lookup (provider->sysfs_path_to_drive, sysfs_path) == NULL)
-            g_hash_table_insert (provider->sysfs_path_to_drive, g_strdup (sysfs_path), object);
-          udisks_linux_drive_object_uevent (object, action, device);
+          /* Ignore the uevent if the device-mapper layer requests
+           * that other rules ignore this uevent
+           *
+           * It's somewhat nasty to do this but it avoids all kinds of
+           * race-conditions caused by the design of device-mapper
+           * (such as temporary-cryptsetup nodes and cleartext devices
+           * without ID_FS properties properly set).
+           */
         }
       else
         {
-          if (g_strcmp0 (action, "add") == 0) /* don't create new drive object on "change" event */
-            {
-              object = udisks_linux_drive_object_new (daemon, device);
-              if (object != NULL)
-                {
-                  g_object_set_data_full (G_OBJECT (object), "x-vpd", g_strdup (vpd), g_free);
-                  g_dbus_object_manager_server_export_uniquely (udisks_daemon_get_object_manager (daemon),
-                                                                G_DBUS_OBJECT_SKELETON (object));
-                  g_hash_table_insert (provider->vpd_to_drive, g_strdup (vpd), object);
-                  g_hash_table_insert (provider->sysfs_path_to_drive, g_strdup (sysfs_path), object);
-
-                  /* schedule initial housekeeping for the drive unless coldplugging */
-                  if (!provider->coldplug)
-                    {
-                      task = g_task_new (object, NULL, NULL, NULL);
-                      g_task_run_in_thread (task, perform_initial_housekeeping_for_drive);
-                      g_object_unref (task);
-                    }
-                }
-            }
+          request_lazy_module (provider, device);
+          queue_block_uevent_for_modules (provider, action, device);
+          handle_block_uevent_for_mdraid (provider, action, device);
+          handle_block_uevent_for_drive (provider, action, device);
+          handle_block_uevent_for_block (provider, action, device);
         }
     }
 
- out:
-  g_free (vpd);
+  if (g_strcmp0 (action, "add") != 0)
+    {
+      /* Possibly need to clean up entries referencing this device */
+      udisks_state_check_block (udisks_daemon_get_state (udisks_provider_get_daemon (UDISKS_PROVIDER (provider))),
+                                g_udev_device_get_device_number (device->udev_device));
+    }
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
-
-/* Things that need to be done when receiving 'remove' uevent before removing
-   the dbus object.
-   Currently used only to properly unset the 'CleartextDevice' property after
-   removing cleartext device (e.g. when closing/locking a LUKS device)
- */
+/* called with lock held */
 static void
-block_pre_remove (UDisksLinuxProvider *provider,
-                  UDisksLinuxBlockObject *object)
+add_drives_for_slot_devices (UDisksLinuxProvider  *provider,
+                             GHashTable           *drives,
+                             gchar               **slot_devices)
 {
-  UDisksDaemon *daemon = NULL;
-  UDisksBlock *block = NULL;
-  UDisksObject *backing_object = NULL;
-  UDisksEncrypted *encrypted = NULL;
-  gchar *backing_path = NULL;
-
-  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
-  block = udisks_object_peek_block (UDISKS_OBJECT (object));
-  if (block == NULL)
-    goto out;
-
-  backing_path = udisks_block_dup_crypto_backing_device (block);
-  if (!backing_path || g_strcmp0 (backing_path, "/") == 0)
-    goto out;
-
-  backing_object = udisks_daemon_find_object (daemon, backing_path);
-  if (backing_object == NULL)
-    goto out;
-
-  encrypted = udisks_object_peek_encrypted (UDISKS_OBJECT (backing_object));
-  if (encrypted == NULL)
-    goto out;
+  guint n;
 
-  udisks_encrypted_set_cleartext_device (UDISKS_ENCRYPTED (encrypted), "/");
+  for (n = 0; slot_devices != NULL && slot_devices[n] != NULL; n++)
+    {
+      UDisksLinuxDriveObject *object;
 
-out:
-  g_clear_object (&backing_object);
-  g_free (backing_path);
+      object = g_hash_table_lookup (provider->sysfs_path_to_drive, slot_devices[n]);
+      if (object != NULL)
+        g_hash_table_add (drives, object);
+    }
 }
 
 /* called with lock held */
 static void
-handle_block_uevent_for_block (UDisksLinuxProvider *provider,
-                               const gchar         *action,
-                               UDisksLinuxDevice   *device)
+handle_enclosure_uevent (UDisksLinuxProvider *provider,
+                         const gchar         *action,
+                         UDisksLinuxDevice   *device)
 {
-  const gchar *sysfs_path;
-  UDisksLinuxBlockObject *object;
+  UDisksLinuxEnclosureObject *object;
   UDisksDaemon *daemon;
+  const gchar *sysfs_path;
+  GHashTable *drives;
+  GHashTableIter iter;
+  gpointer key;
+  gchar **slot_devices;
 
   daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
   sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
 
+  /* the drives that are or were in a slot of the enclosure */
+  drives = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  object = g_hash_table_lookup (provider->sysfs_path_to_enclosure, sysfs_path);
   if (g_strcmp0 (action, "remove") == 0)
     {
-      object = g_hash_table_lookup (provider->sysfs_to_block, sysfs_path);
       if (object != NULL)
         {
-          block_pre_remove (provider, object);
+          slot_devices = udisks_linux_enclosure_object_dup_slot_devices (object);
+          add_drives_for_slot_devices (provider, drives, slot_devices);
+          g_strfreev (slot_devices);
           g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
                                                  g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-          g_warn_if_fail (g_hash_table_remove (provider->sysfs_to_block, sysfs_path));
+          g_warn_if_fail (g_hash_table_remove (provider->sysfs_path_to_enclosure, sysfs_path));
         }
     }
   else
     {
-      object = g_hash_table_lookup (provider->sysfs_to_block, sysfs_path);
       if (object != NULL)
         {
-          udisks_linux_block_object_uevent (object, action, device);
+          slot_devices = udisks_linux_enclosure_object_dup_slot_devices (object);
+          add_drives_for_slot_devices (provider, drives, slot_devices);
+          g_strfreev (slot_devices);
+          udisks_linux_enclosure_object_uevent (object, action, device);
         }
       else
         {
-          object = udisks_linux_block_object_new (daemon, device);
-          g_dbus_object_manager_server_export_uniquely (udisks_daemon_get_object_manager (daemon),
-                                                        G_DBUS_OBJECT_SKELETON (object));
-          g_hash_table_insert (provider->sysfs_to_block, g_strdup (sysfs_path), object);
+          object = udisks_linux_enclosure_object_new (daemon, device);
+          udisks_linux_enclosure_object_uevent (object, action, device);
+          g_dbus_object_manager_server_export (udisks_daemon_get_object_manager (daemon),
+                                               G_DBUS_OBJECT_SKELETON (object));
+          g_hash_table_insert (provider->sysfs_path_to_enclosure, g_strdup (sysfs_path), object);
+        }
+      slot_devices = udisks_linux_enclosure_object_dup_slot_devices (object);
+      add_drives_for_slot_devices (provider, drives, slot_devices);
+      g_strfreev (slot_devices);
+    }
+
+  /* The drives find their slot on their own uevents. The kernel adds and
+   * removes the links between the slots and the SCSI devices without any
+   * uevent for the SCSI devices though, e.g. when the ses module is loaded
+   * after the drives were found, so update the drives in the slots now.
+   */
+  if (!provider->coldplug)
+    {
+      g_hash_table_iter_init (&iter, drives);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        udisks_linux_drive_object_uevent (UDISKS_LINUX_DRIVE_OBJECT (key), "change", NULL);
+    }
+  g_hash_table_unref (drives);
+}
+
+/* called without lock held */
+static void
+udisks_linux_provider_handle_uevent (UDisksLinuxProvider *provider,
+                                     const gchar         *action,
+                                     UDisksLinuxDevice   *device)
+{
+  const gchar *subsystem;
+
+  provider_lock_acquire (provider);
+
+  udisks_debug ("uevent %s %s",
+                action,
+                g_udev_device_get_sysfs_path (device->udev_device));
+
+  subsystem = g_udev_device_get_subsystem (device->udev_device);
+  if (g_strcmp0 (subsystem, "block") == 0)
+    {
+      handle_block_uevent (provider, action, device);
+    }
+  else if (g_strcmp0 (subsystem, "enclosure") == 0)
+    {
+      handle_enclosure_uevent (provider, action, device);
+    }
+
+  provider_lock_release (provider, G_STRFUNC);
+
+  /* wake up anyone waiting for the block object to reach a certain state */
+  if (g_strcmp0 (subsystem, "block") == 0)
+    {
+      UDisksLinuxBlockObject *object;
+
+      object = udisks_linux_provider_find_block_by_sysfs_path (provider,
+                                                               g_udev_device_get_sysfs_path (device->udev_device));
+      if (object != NULL)
+        {
+          udisks_provider_emit_object_changed (UDISKS_PROVIDER (provider), G_DBUS_OBJECT (object));
+          g_object_unref (object);
         }
     }
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* called with lock held */
+/* may be called from any thread exporting objects */
 static void
-handle_block_uevent_for_modules (UDisksLinuxProvider *provider,
-                                 const gchar         *action,
-                                 UDisksLinuxDevice   *device)
+on_object_manager_object_added (GDBusObjectManager *manager,
+                                GDBusObject        *object,
+                                gpointer            user_data)
 {
-  const gchar *sysfs_path;
-  GDBusObjectSkeleton *object;
-  UDisksDaemon *daemon;
-  UDisksModuleManager *module_manager;
-  GList *new_funcs, *l, *ll;
-  UDisksModuleObjectNewFunc module_object_new_func;
-  GHashTable *inst_table;
-  GHashTableIter iter;
-  gboolean handled;
-  GHashTable *inst_sysfs_paths;
-  GList *instances_to_remove;
-  GList *funcs_to_remove = NULL;
+  udisks_provider_emit_object_added (UDISKS_PROVIDER (user_data), object);
+}
 
-  daemon = udisks_provider_get_daemon (UDISKS_PROVIDER (provider));
-  module_manager = udisks_daemon_get_module_manager (daemon);
-  if (! udisks_module_manager_get_modules_available (module_manager))
-    return;
+/* may be called from any thread unexporting objects */
+static void
+on_object_manager_object_removed (GDBusObjectManager *manager,
+                                  GDBusObject        *object,
+                                  gpointer            user_data)
+{
+  udisks_provider_emit_object_removed (UDISKS_PROVIDER (user_data), object);
+}
 
-  new_funcs = udisks_module_manager_get_module_object_new_funcs (module_manager);
+/* ---------------------------------------------------------------------------------------------------- */
 
-  /* The object hierarchy is as follows:
-   *
-   *   provider->module_funcs_to_instances:
-   *      key: a UDisksModuleObjectNewFunc (pointer)
-   *      value: nested hashtable
-   *          key: a UDisksObjectSkeleton instance implementing the UDisksModuleObject interface
-   *          value: nested hashtable
-   *              key: sysfs path attached to the UDisksObjectSkeleton instance
-   *              value: -- no values, just keys
-   */
+/* Interval between two housekeeping runs of the same drive or module object */
+#define HOUSEKEEPING_INTERVAL_SECONDS (10*60)
 
-  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+/* How often to check for drives due for housekeeping */
+#define HOUSEKEEPING_TICK_SECONDS 10
 
-  /* The following algorithm brings some guarantees to existing instances:
-   *  - every instance can claim one or more devices (sysfs paths)
-   *  - existing instances are asked first and only when none is interested in claiming the device
-   *    a new instance for the current UDisksModuleObjectNewFunc is attempted to be created
-   */
+/* Drives are not housekept all at once every HOUSEKEEPING_INTERVAL_SECONDS
+ * but each drive has its own deadline. The deadlines are spread over the
+ * interval so the SMART reads result in a steady trickle of I/O rather than
+ * a burst every ten minutes, and at most housekeeping_max_parallel drives
+ * are housekept at the same time. Drives sharing a controller also share its
+ * bandwidth and command slots so at most housekeeping_max_parallel_per_controller
+ * of them are housekept at the same time, letting drives on other
+ * controllers go ahead instead.
+ */
+typedef struct
+{
+  gint64 deadline;    /* monotonic time, usec */
+  gint64 last;        /* monotonic time of the last run, usec, or 0 if never */
+  gint64 started;     /* monotonic time the current run started, usec */
+  gint64 duration;    /* duration of the last run, usec */
+  gchar *controller;  /* sysfs path of the controller the drive is attached to */
+  gboolean running;
+} DriveHousekeeping;
 
-  for (l = new_funcs; l; l = l->next)
-    {
-      handled = FALSE;
-      instances_to_remove = NULL;
-      module_object_new_func = l->data;
-      inst_table = g_hash_table_lookup (provider->module_funcs_to_instances, module_object_new_func);
-      if (inst_table)
-        {
-          /* First try existing instances and ask them to process the uevent */
-          g_hash_table_iter_init (&iter, inst_table);
-          while (g_hash_table_iter_next (&iter, (gpointer *) &object, (gpointer *) &inst_sysfs_paths))
-            {
-              if (udisks_module_object_process_uevent (UDISKS_MODULE_OBJECT (object), action, device))
-                {
-                  handled = TRUE;
-                  if (g_hash_table_contains (inst_sysfs_paths, sysfs_path))
-                    {
-                      /* sysfs paths match, the object has processed the event just fine */
-                    }
-                  else
-                    {
-                      /* sysfs paths don't match yet the foreign instance is interested in claiming the device */
-                      g_hash_table_add (inst_sysfs_paths, g_strdup (sysfs_path));
-                    }
-                }
-              else
-                {
-                  if (g_hash_table_contains (inst_sysfs_paths, sysfs_path))
-                    {
-                      /* sysfs paths match, the object has indicated it's no longer interested in the current sysfs path */
-                      g_warn_if_fail (g_hash_table_remove (inst_sysfs_paths, sysfs_path));
-                      if (g_hash_table_size (inst_sysfs_paths) == 0)
-                        {
-                          /* no more sysfs paths, queue for removal */
-                          instances_to_remove = g_list_append (instances_to_remove, object);
-                        }
-                      handled = TRUE;
-                     }
-                  else
-                    {
-                      /* the instance is not interested in claiming this device */
-                      ;
-                    }
-                }
-            }
+static void
+drive_housekeeping_free (gpointer data)
+{
+  DriveHousekeeping *entry = data;
 
-          /* Remove empty instances */
-          if (instances_to_remove != NULL)
-            {
-              for (ll = instances_to_remove; ll; ll = ll->next)
-                {
-                  object = ll->data;
-                  g_dbus_object_manager_server_unexport (udisks_daemon_get_object_manager (daemon),
-                                                         g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-                  g_warn_if_fail (g_hash_table_remove (inst_table, object));
-                }
-              if (g_hash_table_size (inst_table) == 0)
-                {
-                  /* no more instances, queue for removal */
-                  funcs_to_remove = g_list_append (funcs_to_remove, module_object_new_func);
-                  inst_table = NULL;
-                }
-              g_list_free (instances_to_remove);
-            }
-        }
+  g_free (entry->controller);
+  g_free (entry);
+}
 
-      /* no instance claimed or no instance was interested in this sysfs path, try creating new instance for the current UDisksModuleObjectNewFunc */
-      if (! handled)
-        {
-          object = module_object_new_func (daemon, device);
-          if (object != NULL)
-            {
-              g_dbus_object_manager_server_export_uniquely (udisks_daemon_get_object_manager (daemon),
-                                                            G_DBUS_OBJECT_SKELETON (object));
-              inst_sysfs_paths = g_hash_table_new_full (g_str_hash,
-                                                        g_str_equal,
-                                                        (GDestroyNotify) g_free,
-                                                        NULL);
-              g_hash_table_add (inst_sysfs_paths, g_strdup (sysfs_path));
-              if (inst_table == NULL)
-                {
-                  inst_table = g_hash_table_new_full (g_direct_hash,
-                                                      g_direct_equal,
-                                                      (GDestroyNotify) g_object_unref,
-                                                      (GDestroyNotify) g_hash_table_unref);
-                  g_hash_table_insert (provider->module_funcs_to_instances, module_object_new_func, inst_table);
-                }
-              g_hash_table_insert (inst_table, object, inst_sysfs_paths);
-            }
-        }
+/* Returns the offset of the n-th drive within the housekeeping interval.
+ * Stepping by the golden ratio spreads the drives evenly over the interval
+ * no matter how many of them there are or the order they appear in.
+ */
+static gint64
+get_housekeeping_phase (guint n)
+{
+  gdouble frac;
+
+  frac = n * 0.6180339887498949;
+  frac -= (gint64) frac;
+  return (gint64) (frac * HOUSEKEEPING_INTERVAL_SECONDS * G_USEC_PER_SEC);
+}
+
+/* Returns the sysfs path of the controller (e.g. the SATA or SAS HBA) @object
+ * is attached to, falling back to the parent of the block device. The path
+ * is cut before the first per-port or per-device component so that all the
+ * drives behind the same controller map to the same string.
+ */
+static gchar *
+get_drive_controller (UDisksLinuxDriveObject *object)
+{
+  UDisksLinuxDevice *device;
+  const gchar *sysfs_path;
+  gchar **components = NULL;
+  GString *str;
+  guint n;
+  gchar *ret = NULL;
+
+  device = udisks_linux_drive_object_get_device (object, TRUE /* get_hw */);
+  if (device == NULL)
+    goto out;
+
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+  components = g_strsplit (sysfs_path, "/", -1);
+  str = g_string_new (NULL);
+  for (n = 0; components[n] != NULL; n++)
+    {
+      const gchar *c = components[n];
+
+      if ((g_str_has_prefix (c, "ata") && g_ascii_isdigit (c[3])) ||
+          (g_str_has_prefix (c, "host") && g_ascii_isdigit (c[4])) ||
+          g_strcmp0 (c, "nvme") == 0 ||
+          g_strcmp0 (c, "block") == 0)
+        break;
+      if (n > 0)
+        g_string_append_c (str, '/');
+      g_string_append (str, c);
     }
+  ret = g_string_free (str, FALSE);
+  g_object_unref (device);
 
-  /* Remove empty funcs */
-  if (funcs_to_remove != NULL)
+ out:
+  g_strfreev (components);
+  if (ret == NULL)
+    ret = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  return ret;
+}
+
+/* called with housekeeping_lock held */
+static guint
+get_controller_n_running_locked (UDisksLinuxProvider *provider,
+                                 const gchar         *controller)
+{
+  return GPOINTER_TO_UINT (g_hash_table_lookup (provider->housekeeping_controller_n_running, controller));
+}
+
+/* called with housekeeping_lock held */
+static void
+adjust_controller_n_running_locked (UDisksLinuxProvider *provider,
+                                    const gchar         *controller,
+                                    gint                 delta)
+{
+  guint n;
+
+  n = get_controller_n_running_locked (provider, controller) + delta;
+  if (n > 0)
+    g_hash_table_insert (provider->housekeeping_controller_n_running, g_strdup (controller), GUINT_TO_POINTER (n));
+  else
+    g_hash_table_remove (provider->housekeeping_controller_n_running, controller);
+}
+
+/* Runs in a thread from the GTask thread pool - called without lock held */
+static void
+drive_housekeeping_thread_func (GTask           *task,
+                                gpointer         source_object,
+                                gpointer         task_data,
+                                GCancellable    *cancellable)
+{
+  UDisksLinuxDriveObject *object = UDISKS_LINUX_DRIVE_OBJECT (source_object);
+  guint secs_since_last = GPOINTER_TO_UINT (task_data);
+  GError *error = NULL;
+
+  if (!udisks_linux_drive_object_housekeeping (object,
+                                               secs_since_last,
+                                               NULL, /* TODO: cancellable */
+                                               &error))
     {
-      for (ll = funcs_to_remove; ll; ll = ll->next)
-        g_warn_if_fail (g_hash_table_remove (provider->module_funcs_to_instances, ll->data));
-      g_list_free (funcs_to_remove);
+      udisks_warning ("Error performing housekeeping for drive %s: %s (%s, %d)",
+                      g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
     }
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
+/* called in main thread when the housekeeping of a drive is done */
+static void
+on_drive_housekeeping_done (GObject      *source_object,
+                            GAsyncResult *result,
+                            gpointer      user_data)
+{
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
+  DriveHousekeeping *entry;
+  gint64 now;
 
-/* called with lock held */
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&provider->housekeeping_lock);
+  provider->housekeeping_n_running--;
+  entry = g_hash_table_lookup (provider->drive_housekeeping, source_object);
+  if (entry != NULL)
+    {
+      adjust_controller_n_running_locked (provider, entry->controller, -1);
+      entry->running = FALSE;
+      entry->duration = now - entry->started;
+      udisks_debug ("Housekeeping for drive %s took %" G_GINT64_FORMAT " msec (controller %s)",
+                    g_dbus_object_get_object_path (G_DBUS_OBJECT (source_object)),
+                    entry->duration / 1000,
+                    entry->controller);
+      if (entry->last == 0)
+        entry->deadline = now + get_housekeeping_phase (provider->housekeeping_n_drives_seen++);
+      else
+        entry->deadline += HOUSEKEEPING_INTERVAL_SECONDS * G_USEC_PER_SEC;
+      /* don't try to catch up if we fell behind, e.g. after a suspend */
+      if (entry->deadline <= now)
+        entry->deadline = now + HOUSEKEEPING_INTERVAL_SECONDS * G_USEC_PER_SEC;
+      entry->last = now;
+    }
+  g_mutex_unlock (&provider->housekeeping_lock);
+
+  /* start the next drive that is due, if any */
+  schedule_drive_housekeeping (provider);
+
+  g_object_unref (provider);
+}
+
+/* called with housekeeping_lock held, @drives is the set of the current drive objects */
 static void
-handle_block_uevent (UDisksLinuxProvider *provider,
-                     const gchar         *action,
-                     UDisksLinuxDevice   *device)
+sync_drive_housekeeping_locked (UDisksLinuxProvider *provider,
+                                GHashTable          *drives,
+                                gint64               now)
 {
-  /* We use the sysfs block device for all of
-   *
-   *  - UDisksLinuxDriveObject
-   *  - UDisksLinuxMDRaidObject
-   *  - UDisksLinuxBlockObject
-   *
-   * objects. Ensure that drive and mdraid objects are added before
-   * and removed after block objects.
-   */
-  if (g_strcmp0 (action, "remove") == 0)
+  GHashTableIter iter;
+  UDisksLinuxDriveObject *object;
+  DriveHousekeeping *entry;
+
+  /* forget about drives that are gone */
+  g_hash_table_iter_init (&iter, provider->drive_housekeeping);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object, (gpointer *) &entry))
     {
-      handle_block_uevent_for_block (provider, action, device);
-      handle_block_uevent_for_drive (provider, action, device);
-      handle_block_uevent_for_mdraid (provider, action, device);
-      handle_block_uevent_for_modules (provider, action, device);
+      if (!entry->running && !g_hash_table_contains (drives, object))
+        g_hash_table_iter_remove (&iter);
     }
-  else
+
+  /* and pick up new ones */
+  g_hash_table_iter_init (&iter, drives);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object, NULL))
     {
-      if (g_udev_device_get_property_as_boolean (device->udev_device, "DM_UDEV_DISABLE_OTHER_RULES_FLAG"))
+      if (g_hash_table_contains (provider->drive_housekeeping, object))
+        continue;
+
+      entry = g_new0 (DriveHousekeeping, 1);
+      entry->controller = get_drive_controller (object);
+      if (provider->coldplug)
         {
-          /* Ignore the uevent if the device-mapper layer requests
-           * that other rules ignore this uevent
-           *
-           * It's somewhat nasty to do this but it avoids all kinds of
-           * race-conditions caused by the design of device-mapper
-           * (such as temporary-cryptsetup nodes and cleartext devices
-           * without ID_FS properties properly set).
-           */
+          /* initial housekeeping, done right away */
+          entry->deadline = now;
         }
       else
         {
-          handle_block_uevent_for_modules (provider, action, device);
-          handle_block_uevent_for_mdraid (provider, action, device);
-          handle_block_uevent_for_drive (provider, action, device);
-          handle_block_uevent_for_block (provider, action, device);
+          /* hotplugged drives get their initial housekeeping when added, see
+           * handle_block_uevent_for_drive() */
+          entry->last = now;
+          entry->deadline = now + get_housekeeping_phase (provider->housekeeping_n_drives_seen++);
         }
+      g_hash_table_insert (provider->drive_housekeeping, g_object_ref (object), entry);
     }
+}
 
-  if (g_strcmp0 (action, "add") != 0)
-    {
-      /* Possibly need to clean up */
-      udisks_state_check (udisks_daemon_get_state (udisks_provider_get_daemon (UDISKS_PROVIDER (provider))));
-    }
+static gint
+drive_housekeeping_deadline_cmp (gconstpointer a,
+                                 gconstpointer b,
+                                 gpointer      user_data)
+{
+  GHashTable *drive_housekeeping = user_data;
+  DriveHousekeeping *entry_a = g_hash_table_lookup (drive_housekeeping, a);
+  DriveHousekeeping *entry_b = g_hash_table_lookup (drive_housekeeping, b);
+
+  if (entry_a->deadline < entry_b->deadline)
+    return -1;
+  else if (entry_a->deadline > entry_b->deadline)
+    return 1;
+  return 0;
 }
 
-/* called without lock held */
+/* called in main thread */
 static void
-udisks_linux_provider_handle_uevent (UDisksLinuxProvider *provider,
-                                     const gchar         *action,
-                                     UDisksLinuxDevice   *device)
+schedule_drive_housekeeping (UDisksLinuxProvider *provider)
 {
-  const gchar *subsystem;
+  GHashTableIter iter;
+  UDisksLinuxDriveObject *object;
+  DriveHousekeeping *entry;
+  GHashTable *drives;
+  GList *due = NULL;
+  GList *l;
+  gint64 now;
 
-  G_LOCK (provider_lock);
+  now = g_get_monotonic_time ();
 
-  udisks_debug ("uevent %s %s",
-                action,
-                g_udev_device_get_sysfs_path (device->udev_device));
+  /* take a copy of the drives so that provider_lock is not held while scheduling */
+  drives = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+  provider_lock_acquire (provider);
+  g_hash_table_iter_init (&iter, provider->vpd_to_drive);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &object))
+    g_hash_table_add (drives, g_object_ref (object));
+  provider_lock_release (provider, G_STRFUNC);
 
-  subsystem = g_udev_device_get_subsystem (device->udev_device);
-  if (g_strcmp0 (subsystem, "block") == 0)
+  g_mutex_lock (&provider->housekeeping_lock);
+  sync_drive_housekeeping_locked (provider, drives, now);
+
+  if (provider->housekeeping_n_running >= provider->housekeeping_max_parallel)
+    goto out;
+
+  g_hash_table_iter_init (&iter, provider->drive_housekeeping);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object, (gpointer *) &entry))
     {
-      handle_block_uevent (provider, action, device);
+      if (!entry->running && entry->deadline <= now)
+        due = g_list_prepend (due, object);
     }
+  due = g_list_sort_with_data (due, drive_housekeeping_deadline_cmp, provider->drive_housekeeping);
 
-  G_UNLOCK (provider_lock);
-}
+  for (l = due; l != NULL && provider->housekeeping_n_running < provider->housekeeping_max_parallel; l = l->next)
+    {
+      GTask *task;
+      guint secs_since_last = 0;
 
-/* ---------------------------------------------------------------------------------------------------- */
+      object = l->data;
+      entry = g_hash_table_lookup (provider->drive_housekeeping, object);
 
-/* Runs in housekeeping thread - called without lock held */
-static void
-housekeeping_all_drives (UDisksLinuxProvider *provider,
-                         guint                secs_since_last)
-{
-  GList *objects;
-  GList *l;
+      /* the controller is busy, it gets another go when one of its drives is done */
+      if (get_controller_n_running_locked (provider, entry->controller) >= provider->housekeeping_max_parallel_per_controller)
+        continue;
 
-  G_LOCK (provider_lock);
-  objects = g_hash_table_get_values (provider->vpd_to_drive);
-  g_list_foreach (objects, (GFunc) udisks_g_object_ref_foreach, NULL);
-  G_UNLOCK (provider_lock);
+      if (entry->last > 0)
+        secs_since_last = MAX (1, (now - entry->last) / G_USEC_PER_SEC);
 
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksLinuxDriveObject *object = UDISKS_LINUX_DRIVE_OBJECT (l->data);
-      GError *error;
+      entry->running = TRUE;
+      entry->started = now;
+      provider->housekeeping_n_running++;
+      adjust_controller_n_running_locked (provider, entry->controller, 1);
 
-      error = NULL;
-      if (!udisks_linux_drive_object_housekeeping (object,
-                                                   secs_since_last,
-                                                   NULL, /* TODO: cancellable */
-                                                   &error))
-        {
-          udisks_warning ("Error performing housekeeping for drive %s: %s (%s, %d)",
-                          g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
-                          error->message, g_quark_to_string (error->domain), error->code);
-          g_clear_error (&error);
-        }
+      task = g_task_new (object, NULL, on_drive_housekeeping_done, g_object_ref (provider));
+      g_task_set_task_data (task, GUINT_TO_POINTER (secs_since_last), NULL);
+      g_task_run_in_thread (task, drive_housekeeping_thread_func);
+      g_object_unref (task);
     }
+  g_list_free (due);
 
-  g_list_free_full (objects, g_object_unref);
+ out:
+  g_mutex_unlock (&provider->housekeeping_lock);
+  g_hash_table_unref (drives);
 }
 
-/* Runs in housekeeping thread - called without lock held */
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Module objects are housekept per UDisksModuleObjectNewFunc, all the
+ * instances created by the same function at once, at the interval and cost
+ * the module declared for the function (see UDisksModuleObjectHousekeepingInfo).
+ * Cheap housekeeping runs on its own schedule, expensive housekeeping in
+ * addition counts against housekeeping_max_parallel together with drives.
+ * Functions with no housekeeping to do are never scheduled.
+ */
+typedef struct
+{
+  UDisksModuleObjectNewFunc new_func;
+  guint interval;     /* seconds, or 0 if never */
+  UDisksModuleHousekeepingCost cost;
+  gint64 deadline;    /* monotonic time, usec */
+  gint64 last;        /* monotonic time of the last run, usec, or 0 if never */
+  gint64 started;     /* monotonic time the current run started, usec */
+  gboolean running;
+} ModuleHousekeeping;
+
+/* Runs in a thread from the GTask thread pool - called without lock held */
 static void
-housekeeping_all_modules (UDisksLinuxProvider *provider,
-                          guint                secs_since_last)
+module_housekeeping_thread_func (GTask           *task,
+                                 gpointer         source_object,
+                                 gpointer         task_data,
+                                 GCancellable    *cancellable)
 {
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (source_object);
+  ModuleHousekeeping *entry = task_data;
   GList *objects = NULL;
   GList *l;
   GHashTable *inst_table;
-  GHashTableIter iter_funcs, iter_inst;
+  GHashTableIter iter;
   GDBusObjectSkeleton *inst;
+  guint secs_since_last = 0;
 
-  G_LOCK (provider_lock);
-  g_hash_table_iter_init (&iter_funcs, provider->module_funcs_to_instances);
-  while (g_hash_table_iter_next (&iter_funcs, NULL, (gpointer *) &inst_table))
+  g_mutex_lock (&provider->housekeeping_lock);
+  if (entry->last > 0)
+    secs_since_last = MAX (1, (entry->started - entry->last) / G_USEC_PER_SEC);
+  g_mutex_unlock (&provider->housekeeping_lock);
+
+  provider_lock_acquire (provider);
+  inst_table = g_hash_table_lookup (provider->module_funcs_to_instances, entry->new_func);
+  if (inst_table != NULL)
     {
-      g_hash_table_iter_init (&iter_inst, inst_table);
-      while (g_hash_table_iter_next (&iter_inst, (gpointer *) &inst, NULL))
-        objects = g_list_append (objects, g_object_ref (inst));
+      g_hash_table_iter_init (&iter, inst_table);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &inst, NULL))
+        objects = g_list_prepend (objects, g_object_ref (inst));
     }
-  G_UNLOCK (provider_lock);
+  provider_lock_release (provider, G_STRFUNC);
 
   for (l = objects; l != NULL; l = l->next)
     {
@@ -1445,78 +4480,335 @@ housekeeping_all_modules (UDisksLinuxProvider *provider,
   g_list_free_full (objects, g_object_unref);
 }
 
-/* ---------------------------------------------------------------------------------------------------- */
-
+/* called in main thread when the housekeeping of the instances of a module function is done */
 static void
-housekeeping_thread_func (GTask           *task,
-                          gpointer         source_object,
-                          gpointer         task_data,
-                          GCancellable    *cancellable)
+on_module_housekeeping_done (GObject      *source_object,
+                             GAsyncResult *result,
+                             gpointer      user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (source_object);
-  guint secs_since_last;
-  guint64 now;
+  ModuleHousekeeping *entry = user_data;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&provider->housekeeping_lock);
+  entry->running = FALSE;
+  if (entry->cost == UDISKS_MODULE_HOUSEKEEPING_COST_EXPENSIVE)
+    provider->housekeeping_n_running--;
+  udisks_debug ("Housekeeping of module objects took %" G_GINT64_FORMAT " msec (interval %u seconds)",
+                (now - entry->started) / 1000, entry->interval);
+  entry->last = now;
+  entry->deadline = now + (gint64) entry->interval * G_USEC_PER_SEC;
+  g_mutex_unlock (&provider->housekeeping_lock);
+
+  /* an expensive run may have held up drives */
+  if (entry->cost == UDISKS_MODULE_HOUSEKEEPING_COST_EXPENSIVE)
+    schedule_drive_housekeeping (provider);
+}
+
+/* called with housekeeping_lock held, @new_funcs is the set of the functions with instances */
+static void
+sync_module_housekeeping_locked (UDisksLinuxProvider *provider,
+                                 GHashTable          *new_funcs,
+                                 gint64               now)
+{
+  UDisksModuleManager *module_manager;
+  UDisksModuleObjectHousekeepingInfo *info;
+  UDisksModuleObjectNewFunc new_func;
+  ModuleHousekeeping *entry;
+  GHashTableIter iter;
+
+  /* forget about functions that have no instances anymore */
+  g_hash_table_iter_init (&iter, provider->module_housekeeping);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &new_func, (gpointer *) &entry))
+    {
+      if (!entry->running && !g_hash_table_contains (new_funcs, new_func))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  /* and pick up new ones */
+  module_manager = udisks_daemon_get_module_manager (udisks_provider_get_daemon (UDISKS_PROVIDER (provider)));
+  g_hash_table_iter_init (&iter, new_funcs);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &new_func, NULL))
+    {
+      if (g_hash_table_contains (provider->module_housekeeping, new_func))
+        continue;
+
+      entry = g_new0 (ModuleHousekeeping, 1);
+      entry->new_func = new_func;
+      info = udisks_module_manager_get_module_object_housekeeping_info (module_manager, new_func);
+      if (info != NULL)
+        {
+          entry->interval = info->interval;
+          entry->cost = info->cost;
+        }
+      else
+        {
+          entry->interval = HOUSEKEEPING_INTERVAL_SECONDS;
+          entry->cost = UDISKS_MODULE_HOUSEKEEPING_COST_EXPENSIVE;
+        }
+      /* the first run is right away when coldplugging, like for drives */
+      entry->deadline = provider->coldplug ? now : now + (gint64) entry->interval * G_USEC_PER_SEC;
+      g_hash_table_insert (provider->module_housekeeping, new_func, entry);
+    }
+}
+
+/* called in main thread */
+static void
+schedule_module_housekeeping (UDisksLinuxProvider *provider)
+{
+  GHashTableIter iter;
+  ModuleHousekeeping *entry;
+  GHashTable *new_funcs;
+  gpointer new_func;
+  gint64 now;
 
-  /* TODO: probably want some kind of timeout here to avoid faulty devices/drives blocking forever */
+  now = g_get_monotonic_time ();
 
-  secs_since_last = 0;
-  now = time (NULL);
-  if (provider->housekeeping_last > 0)
-    secs_since_last = now - provider->housekeeping_last;
-  provider->housekeeping_last = now;
+  new_funcs = g_hash_table_new (g_direct_hash, g_direct_equal);
+  provider_lock_acquire (provider);
+  g_hash_table_iter_init (&iter, provider->module_funcs_to_instances);
+  while (g_hash_table_iter_next (&iter, &new_func, NULL))
+    g_hash_table_add (new_funcs, new_func);
+  provider_lock_release (provider, G_STRFUNC);
 
-  udisks_info ("Housekeeping initiated (%u seconds since last housekeeping)", secs_since_last);
+  g_mutex_lock (&provider->housekeeping_lock);
+  sync_module_housekeeping_locked (provider, new_funcs, now);
 
-  housekeeping_all_drives (provider, secs_since_last);
-  housekeeping_all_modules (provider, secs_since_last);
+  g_hash_table_iter_init (&iter, provider->module_housekeeping);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      GTask *task;
 
-  udisks_info ("Housekeeping complete");
-  G_LOCK (provider_lock);
-  provider->housekeeping_running = FALSE;
-  G_UNLOCK (provider_lock);
+      if (entry->interval == 0 || entry->running || entry->deadline > now)
+        continue;
+
+      if (entry->cost == UDISKS_MODULE_HOUSEKEEPING_COST_EXPENSIVE)
+        {
+          /* wait for a free slot, it's checked again on the next tick */
+          if (provider->housekeeping_n_running >= provider->housekeeping_max_parallel)
+            continue;
+          provider->housekeeping_n_running++;
+        }
+
+      entry->running = TRUE;
+      entry->started = now;
+
+      task = g_task_new (provider, NULL, on_module_housekeeping_done, entry);
+      g_task_set_task_data (task, entry, NULL);
+      g_task_run_in_thread (task, module_housekeeping_thread_func);
+      g_object_unref (task);
+    }
+
+  g_mutex_unlock (&provider->housekeeping_lock);
+  g_hash_table_unref (new_funcs);
 }
 
-/* called from the main thread on start-up and every 10 minutes or so */
+/* called from the main thread on start-up and every HOUSEKEEPING_TICK_SECONDS */
 static gboolean
 on_housekeeping_timeout (gpointer user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  GTask *task;
 
-  G_LOCK (provider_lock);
-  if (provider->housekeeping_running)
-    goto out;
-  provider->housekeeping_running = TRUE;
-  task = g_task_new (provider, NULL, NULL, NULL);
-  g_task_run_in_thread (task, housekeeping_thread_func);
-  g_object_unref (task);
+  schedule_drive_housekeeping (provider);
+  schedule_module_housekeeping (provider);
 
- out:
-  G_UNLOCK (provider_lock);
+  /* catch uevents lost at the end of a burst, with no uevent after them */
+  check_uevent_overflow (provider);
 
   return TRUE; /* keep timeout around */
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static void
-update_all_block_objects (UDisksLinuxProvider *provider)
+/* called in the "uevent" thread */
+static gboolean
+update_all_block_mount_options_in_uevent_thread (gpointer user_data)
 {
+  UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
   GList *objects;
   GList *l;
 
-  G_LOCK (provider_lock);
+  provider_lock_acquire (provider);
   objects = g_hash_table_get_values (provider->sysfs_to_block);
   g_list_foreach (objects, (GFunc) udisks_g_object_ref_foreach, NULL);
-  G_UNLOCK (provider_lock);
+  provider_lock_release (provider, G_STRFUNC);
+
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksLinuxBlockObject *object = UDISKS_LINUX_BLOCK_OBJECT (l->data);
+      UDisksBlock *block;
+
+      block = udisks_object_peek_block (UDISKS_OBJECT (object));
+      if (block != NULL)
+        udisks_linux_block_update_partial (UDISKS_LINUX_BLOCK (block), object,
+                                           UDISKS_LINUX_BLOCK_UPDATE_MOUNT_OPTIONS);
+    }
+
+  g_list_free_full (objects, g_object_unref);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Updates the UserspaceMountOptions of all block objects, nothing else
+ * depends on the utab */
+static void
+update_all_block_mount_options (UDisksLinuxProvider *provider)
+{
+  /* serialize with the uevents being applied */
+  g_main_context_invoke_full (provider->uevent_context,
+                              G_PRIORITY_DEFAULT,
+                              update_all_block_mount_options_in_uevent_thread,
+                              g_object_ref (provider),
+                              g_object_unref);
+}
+
+typedef struct
+{
+  UDisksLinuxProvider *provider;
+  /* the fsname or device field of the entry, e.g. "UUID=..." */
+  gchar *spec;
+  /* the UUID in the x-parent option of the entry, if any */
+  gchar *parent_uuid;
+} ConfigurationChangeData;
+
+static void
+configuration_change_data_free (ConfigurationChangeData *data)
+{
+  g_object_unref (data->provider);
+  g_free (data->spec);
+  g_free (data->parent_uuid);
+  g_free (data);
+}
+
+/* checks whether @spec (as found in /etc/fstab or /etc/crypttab) refers to @object */
+static gboolean
+block_object_matches_spec (UDisksLinuxBlockObject *object,
+                           UDisksBlock            *block,
+                           const gchar            *spec)
+{
+  const gchar *const *symlinks;
+  UDisksLinuxDevice *device;
+  const gchar *value;
+  const gchar *property = NULL;
+  gboolean ret = FALSE;
+  guint n;
+
+  if (g_str_has_prefix (spec, "/dev"))
+    {
+      if (g_strcmp0 (spec, udisks_block_get_device (block)) == 0)
+        return TRUE;
+      symlinks = udisks_block_get_symlinks (block);
+      if (symlinks != NULL)
+        for (n = 0; symlinks[n] != NULL; n++)
+          if (g_strcmp0 (spec, symlinks[n]) == 0)
+            return TRUE;
+      return FALSE;
+    }
+
+  if (g_str_has_prefix (spec, "UUID="))
+    return spec[5] != '\0' && g_strcmp0 (spec + 5, udisks_block_get_id_uuid (block)) == 0;
+  if (g_str_has_prefix (spec, "LABEL="))
+    return spec[6] != '\0' && g_strcmp0 (spec + 6, udisks_block_get_id_label (block)) == 0;
+
+  if (g_str_has_prefix (spec, "PARTUUID="))
+    {
+      property = "ID_PART_ENTRY_UUID";
+      value = spec + 9;
+    }
+  else if (g_str_has_prefix (spec, "PARTLABEL="))
+    {
+      property = "ID_PART_ENTRY_NAME";
+      value = spec + 10;
+    }
+  else
+    {
+      /* not a device entry */
+      return FALSE;
+    }
+
+  if (*value == '\0')
+    return FALSE;
+  device = udisks_linux_block_object_get_device (object);
+  if (device != NULL && device->udev_device != NULL)
+    ret = g_strcmp0 (value, g_udev_device_get_property (device->udev_device, property)) == 0;
+  g_clear_object (&device);
+
+  return ret;
+}
+
+/* called in the "uevent" thread */
+static gboolean
+update_configuration_in_uevent_thread (gpointer user_data)
+{
+  ConfigurationChangeData *data = user_data;
+  GList *objects;
+  GList *l;
+
+  provider_lock_acquire (data->provider);
+  objects = g_hash_table_get_values (data->provider->sysfs_to_block);
+  g_list_foreach (objects, (GFunc) udisks_g_object_ref_foreach, NULL);
+  provider_lock_release (data->provider, G_STRFUNC);
 
   for (l = objects; l != NULL; l = l->next)
     {
       UDisksLinuxBlockObject *object = UDISKS_LINUX_BLOCK_OBJECT (l->data);
-      udisks_linux_block_object_uevent (object, "change", NULL);
+      UDisksBlock *block;
+
+      block = udisks_object_peek_block (UDISKS_OBJECT (object));
+      if (block == NULL)
+        continue;
+
+      /* the ChildConfiguration of the (encrypted) parent includes the entry */
+      if (data->parent_uuid != NULL &&
+          g_strcmp0 (data->parent_uuid, udisks_block_get_id_uuid (block)) == 0)
+        {
+          udisks_linux_block_object_uevent (object, "change", NULL);
+          continue;
+        }
+
+      if (block_object_matches_spec (object, block, data->spec))
+        udisks_linux_block_update_configuration (UDISKS_LINUX_BLOCK (block), object);
     }
 
   g_list_free_full (objects, g_object_unref);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Updates the configuration of the block objects an added or removed
+ * /etc/fstab or /etc/crypttab entry refers to */
+static void
+update_configuration_for_entry (UDisksLinuxProvider *provider,
+                                const gchar         *spec,
+                                const gchar         *options)
+{
+  ConfigurationChangeData *data;
+  gchar **opts;
+  guint n;
+
+  data = g_new0 (ConfigurationChangeData, 1);
+  data->provider = g_object_ref (provider);
+  data->spec = g_strdup (spec);
+
+  opts = g_strsplit (options != NULL ? options : "", ",", -1);
+  for (n = 0; opts[n] != NULL; n++)
+    {
+      if (g_str_has_prefix (opts[n], "x-parent="))
+        {
+          data->parent_uuid = g_strdup (opts[n] + strlen ("x-parent="));
+          break;
+        }
+    }
+  g_strfreev (opts);
+
+  /* serialize with the uevents being applied */
+  g_main_context_invoke_full (provider->uevent_context,
+                              G_PRIORITY_DEFAULT,
+                              update_configuration_in_uevent_thread,
+                              data,
+                              (GDestroyNotify) configuration_change_data_free);
 }
 
 static void
@@ -1525,7 +4817,9 @@ fstab_monitor_on_entry_added (UDisksFstabMonitor *monitor,
                               gpointer            user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  update_all_block_objects (provider);
+  update_configuration_for_entry (provider,
+                                  udisks_fstab_entry_get_fsname (entry),
+                                  udisks_fstab_entry_get_opts (entry));
 }
 
 static void
@@ -1534,7 +4828,9 @@ fstab_monitor_on_entry_removed (UDisksFstabMonitor *monitor,
                                 gpointer            user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  update_all_block_objects (provider);
+  update_configuration_for_entry (provider,
+                                  udisks_fstab_entry_get_fsname (entry),
+                                  udisks_fstab_entry_get_opts (entry));
 }
 
 static void
@@ -1543,7 +4839,9 @@ crypttab_monitor_on_entry_added (UDisksCrypttabMonitor *monitor,
                                  gpointer               user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  update_all_block_objects (provider);
+  update_configuration_for_entry (provider,
+                                  udisks_crypttab_entry_get_device (entry),
+                                  udisks_crypttab_entry_get_options (entry));
 }
 
 static void
@@ -1552,7 +4850,9 @@ crypttab_monitor_on_entry_removed (UDisksCrypttabMonitor *monitor,
                                    gpointer               user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  update_all_block_objects (provider);
+  update_configuration_for_entry (provider,
+                                  udisks_crypttab_entry_get_device (entry),
+                                  udisks_crypttab_entry_get_options (entry));
 }
 
 #ifdef HAVE_LIBMOUNT
@@ -1562,7 +4862,7 @@ utab_monitor_on_entry_added (UDisksUtabMonitor *monitor,
                              gpointer           user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  update_all_block_objects (provider);
+  update_all_block_mount_options (provider);
 }
 
 static void
@@ -1571,6 +4871,6 @@ utab_monitor_on_entry_removed (UDisksUtabMonitor *monitor,
                                gpointer           user_data)
 {
   UDisksLinuxProvider *provider = UDISKS_LINUX_PROVIDER (user_data);
-  update_all_block_objects (provider);
+  update_all_block_mount_options (provider);
 }
 #endif
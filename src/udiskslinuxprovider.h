@@ -34,6 +34,30 @@ GType                  udisks_linux_provider_get_type        (void) G_GNUC_CONST
 UDisksLinuxProvider   *udisks_linux_provider_new             (UDisksDaemon        *daemon);
 GUdevClient           *udisks_linux_provider_get_udev_client (UDisksLinuxProvider *provider);
 gboolean               udisks_linux_provider_get_coldplug    (UDisksLinuxProvider *provider);
+GMainContext          *udisks_linux_provider_get_uevent_context (UDisksLinuxProvider *provider);
+void                   udisks_linux_provider_invoke_for_modules (UDisksLinuxProvider *provider,
+                                                                 GSourceFunc          func,
+                                                                 gpointer             data,
+                                                                 GDestroyNotify       notify);
+UDisksLinuxManager    *udisks_linux_provider_get_manager     (UDisksLinuxProvider *provider);
+void                   udisks_linux_provider_append_footprint (UDisksLinuxProvider *provider,
+                                                               GString             *str);
+
+UDisksLinuxBlockObject *udisks_linux_provider_find_block_by_sysfs_path    (UDisksLinuxProvider *provider,
+                                                                          const gchar         *sysfs_path);
+UDisksLinuxBlockObject *udisks_linux_provider_find_block_by_device_number (UDisksLinuxProvider *provider,
+                                                                          dev_t                device_number);
+UDisksLinuxBlockObject *udisks_linux_provider_find_block_by_device_file   (UDisksLinuxProvider *provider,
+                                                                          const gchar         *device_file);
+UDisksLinuxDriveObject *udisks_linux_provider_find_drive_by_sysfs_path    (UDisksLinuxProvider *provider,
+                                                                          const gchar         *sysfs_path);
+gchar                 **udisks_linux_provider_dup_slaves                  (UDisksLinuxProvider *provider,
+                                                                          const gchar         *sysfs_path);
+gchar                 **udisks_linux_provider_dup_holders                 (UDisksLinuxProvider *provider,
+                                                                          const gchar         *sysfs_path);
+UDisksLinuxBlockObject *udisks_linux_provider_find_cleartext_block        (UDisksLinuxProvider *provider,
+                                                                          const gchar         *sysfs_path,
+                                                                          const gchar         *crypto_object_path);
 
 G_END_DECLS
 
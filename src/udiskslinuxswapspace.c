@@ -26,6 +26,7 @@
 #include <grp.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/swap.h>
 
 #include <blockdev/swap.h>
 #include <glib/gstdio.h>
@@ -35,6 +36,7 @@
 #include "udiskslinuxblockobject.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksmethoddispatcher.h"
 #include "udisksmountmonitor.h"
 #include "udiskslinuxdevice.h"
 #include "udisksthreadedjob.h"
@@ -77,13 +79,12 @@ G_DEFINE_TYPE_WITH_CODE (UDisksLinuxSwapspace, udisks_linux_swapspace, UDISKS_TY
 static void
 udisks_linux_swapspace_init (UDisksLinuxSwapspace *swapspace)
 {
-  g_dbus_interface_skeleton_set_flags (G_DBUS_INTERFACE_SKELETON (swapspace),
-                                       G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD);
 }
 
 static void
 udisks_linux_swapspace_class_init (UDisksLinuxSwapspaceClass *klass)
 {
+  udisks_method_dispatcher_hook_class (G_DBUS_INTERFACE_SKELETON_CLASS (klass));
 }
 
 /**
@@ -132,96 +133,301 @@ udisks_linux_swapspace_update (UDisksLinuxSwapspace   *swapspace,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+#ifndef SWAP_FLAG_DISCARD_ONCE
+#define SWAP_FLAG_DISCARD_ONCE  0x20000
+#endif
+#ifndef SWAP_FLAG_DISCARD_PAGES
+#define SWAP_FLAG_DISCARD_PAGES 0x40000
+#endif
+
+/**
+ * udisks_linux_swapspace_get_start_options:
+ * @options: The options of a method call.
+ * @out_priority: Return location for the priority, -1 for the default.
+ * @out_discard: (transfer none): Return location for the discard policy or %NULL if none.
+ * @error: Return location for error or %NULL.
+ *
+ * Gets the <parameter>priority</parameter> and
+ * <parameter>discard</parameter> options of Swapspace.Start() from
+ * @options, see udisks_linux_swapspace_swapon_sync().
+ *
+ * Returns: %TRUE if the options are valid, %FALSE with @error set otherwise.
+ */
+gboolean
+udisks_linux_swapspace_get_start_options (GVariant     *options,
+                                          gint         *out_priority,
+                                          const gchar **out_discard,
+                                          GError      **error)
+{
+  gint32 priority = -1;
+  const gchar *discard = NULL;
+
+  g_variant_lookup (options, "priority", "i", &priority);
+  g_variant_lookup (options, "discard", "&s", &discard);
+
+  if (priority < -1 || priority > SWAP_FLAG_PRIO_MASK)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "The priority option has to be between -1 and %d, not %d",
+                   SWAP_FLAG_PRIO_MASK, priority);
+      return FALSE;
+    }
+  if (discard != NULL && g_strcmp0 (discard, "once") != 0 && g_strcmp0 (discard, "pages") != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_OPTION_NOT_PERMITTED,
+                   "The discard option has to be once or pages, not %s", discard);
+      return FALSE;
+    }
+
+  *out_priority = priority;
+  *out_discard = discard;
+  return TRUE;
+}
+
+/**
+ * udisks_linux_swapspace_swapon_sync:
+ * @device: The device file to activate as swap.
+ * @priority: The swap priority or -1 for the default.
+ * @discard: (allow-none): The discard policy (<literal>once</literal> or <literal>pages</literal>) or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Activates the swap space on @device. Without a discard policy this
+ * is done by libblockdev, which has no way to pass one, so with a
+ * discard policy swapon(2) is called directly.
+ *
+ * Returns: %TRUE if the swap space is active, %FALSE with @error set otherwise.
+ */
+gboolean
+udisks_linux_swapspace_swapon_sync (const gchar  *device,
+                                    gint          priority,
+                                    const gchar  *discard,
+                                    GError      **error)
+{
+  gint flags = 0;
+
+  if (discard == NULL)
+    return bd_swap_swapon (device, priority, error);
+
+  if (priority >= 0)
+    flags |= SWAP_FLAG_PREFER | ((priority << SWAP_FLAG_PRIO_SHIFT) & SWAP_FLAG_PRIO_MASK);
+  flags |= SWAP_FLAG_DISCARD;
+  if (g_strcmp0 (discard, "once") == 0)
+    flags |= SWAP_FLAG_DISCARD_ONCE;
+  else if (g_strcmp0 (discard, "pages") == 0)
+    flags |= SWAP_FLAG_DISCARD_PAGES;
+
+  if (swapon (device, flags) != 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Failed to activate swap on %s: %m", device);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+typedef struct
+{
+  UDisksObject *object;
+  gint          priority;
+  const gchar  *discard;
+} StartJobData;
+
 static gboolean
 start_job_func (UDisksThreadedJob  *job,
                 GCancellable       *cancellable,
                 gpointer            user_data,
                 GError            **error)
 {
-  UDisksObject *object = UDISKS_OBJECT (user_data);
+  StartJobData *data = user_data;
   UDisksBlock *block;
   gchar *device;
   gboolean ret = FALSE;
 
-  block = udisks_object_get_block (object);
+  block = udisks_object_get_block (data->object);
   device = udisks_block_dup_device (block);
 
-  ret = bd_swap_swapon (device, -1, error);
+  ret = udisks_linux_swapspace_swapon_sync (device, data->priority, data->discard, error);
 
   g_object_unref (block);
   g_free (device);
   return ret;
 }
 
+/* runs in thread dedicated to handling @invocation or in the thread
+ * handling a Manager.StartSwapspaces() call */
 static gboolean
-handle_start (UDisksSwapspace        *swapspace,
-              GDBusMethodInvocation  *invocation,
-              GVariant               *options)
+start_swapspace (UDisksSwapspace          *swapspace,
+                 GDBusMethodInvocation    *invocation,
+                 GVariant                 *options,
+                 UDisksBulkAuthorization  *bulk,
+                 GError                  **error)
 {
   UDisksObject *object;
   UDisksDaemon *daemon;
-  GError *error = NULL;
+  StartJobData data;
   uid_t caller_uid;
+  gboolean ret = FALSE;
 
-  object = udisks_daemon_util_dup_object (swapspace, &error);
+  object = udisks_daemon_util_dup_object (swapspace, error);
   if (object == NULL)
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+    goto out;
 
   daemon = udisks_linux_block_object_get_daemon (UDISKS_LINUX_BLOCK_OBJECT (object));
 
+  if (!udisks_linux_swapspace_get_start_options (options, &data.priority, &data.discard, error))
+    goto out;
+
   if (!udisks_daemon_util_get_caller_uid_sync (daemon,
                                                invocation,
                                                NULL /* GCancellable */,
                                                &caller_uid,
-                                               &error))
-    {
-      g_dbus_method_invocation_take_error (invocation, error);
-      goto out;
-    }
+                                               error))
+    goto out;
 
-  if (!udisks_daemon_util_check_authorization_sync (daemon,
-                                                    object,
-                                                    "org.freedesktop.udisks2.manage-swapspace",
-                                                    options,
-                                                    /* Translators: Shown in authentication dialog when the user
-                                                     * requests activating a swap device.
-                                                     *
-                                                     * Do not translate $(drive), it's a placeholder and
-                                                     * will be replaced by the name of the drive/device in question
-                                                     */
-                                                    N_("Authentication is required to activate swapspace on $(drive)"),
-                                                    invocation))
+  if (!udisks_daemon_util_check_authorization_sync_bulk (daemon,
+                                                         object,
+                                                         "org.freedesktop.udisks2.manage-swapspace",
+                                                         options,
+                                                         /* Translators: Shown in authentication dialog when the user
+                                                          * requests activating a swap device.
+                                                          *
+                                                          * Do not translate $(drive), it's a placeholder and
+                                                          * will be replaced by the name of the drive/device in question
+                                                          */
+                                                         N_("Authentication is required to activate swapspace on $(drive)"),
+                                                         invocation,
+                                                         bulk,
+                                                         error))
     goto out;
 
+  data.object = object;
   if (!udisks_daemon_launch_threaded_job_sync (daemon,
                                                object,
                                                "swapspace-start",
                                                caller_uid,
                                                start_job_func,
-                                               object,
+                                               &data,
                                                NULL, /* user_data_free_func */
                                                NULL, /* cancellable */
-                                               &error))
+                                               error))
     {
-      g_dbus_method_invocation_return_error (invocation,
-                                             UDISKS_ERROR,
-                                             UDISKS_ERROR_FAILED,
-                                             "Error activating swap: %s",
-                                             error->message);
-      g_clear_error (&error);
+      g_prefix_error (error, "Error activating swap: ");
       goto out;
     }
 
-  udisks_swapspace_complete_start (swapspace, invocation);
+  ret = TRUE;
 
  out:
   g_clear_object (&object);
+  return ret;
+}
+
+static gboolean
+handle_start (UDisksSwapspace        *swapspace,
+              GDBusMethodInvocation  *invocation,
+              GVariant               *options)
+{
+  GError *error = NULL;
+
+  if (start_swapspace (swapspace, invocation, options, NULL, &error))
+    udisks_swapspace_complete_start (swapspace, invocation);
+  else
+    g_dbus_method_invocation_take_error (invocation, error);
+
   return TRUE;
 }
 
+typedef struct
+{
+  UDisksDaemon          *daemon;
+  GDBusMethodInvocation *invocation;
+  GVariant              *swapspaces;
+} StartManyData;
+
+/* runs in the thread of the pool of udisks_daemon_util_bulk_call_run(), in order */
+static void
+start_many_item_func (UDisksBulkCall  *call,
+                      guint            index,
+                      gpointer         user_data,
+                      GError         **error)
+{
+  StartManyData *start_data = user_data;
+  UDisksObject *object;
+  UDisksSwapspace *swapspace = NULL;
+  const gchar *object_path;
+  GVariant *swapspace_options;
+
+  g_variant_get_child (start_data->swapspaces, index, "(&o@a{sv})", &object_path, &swapspace_options);
+
+  object = udisks_daemon_find_object (start_data->daemon, object_path);
+  if (object != NULL)
+    swapspace = udisks_object_get_swapspace (object);
+  if (swapspace == NULL)
+    g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                 "No swapspace for object %s", object_path);
+  else
+    start_swapspace (swapspace, start_data->invocation, swapspace_options,
+                     udisks_daemon_util_bulk_call_get_authorization (call), error);
+
+  g_clear_object (&swapspace);
+  g_clear_object (&object);
+  g_variant_unref (swapspace_options);
+}
+
+/**
+ * udisks_linux_swapspace_start_many:
+ * @daemon: A #UDisksDaemon.
+ * @invocation: The #GDBusMethodInvocation of the Manager.StartSwapspaces() call.
+ * @swapspaces: The (object path, options) pairs of the swap spaces to activate.
+ * @options: The options of the call.
+ *
+ * Activates @swapspaces one after the other in the given order, sharing
+ * the polkit checks with identical details, see the documentation of the
+ * Manager.StartSwapspaces() method. Runs in the thread handling
+ * @invocation.
+ *
+ * Returns: A floating #GVariant of type <literal>a(oss)</literal> with the results.
+ */
+GVariant *
+udisks_linux_swapspace_start_many (UDisksDaemon          *daemon,
+                                   GDBusMethodInvocation *invocation,
+                                   GVariant              *swapspaces,
+                                   GVariant              *options)
+{
+  UDisksBulkCall *call;
+  StartManyData start_data;
+  GVariant *ret;
+  guint num_items;
+  guint n;
+
+  /* ordered calls have no max-parallel option and don't fail */
+  call = udisks_daemon_util_bulk_call_new (options,
+                                           /* Translators: Shown in authentication dialog when the
+                                            * user requests activating several swap devices at once.
+                                            */
+                                           N_("Authentication is required to activate swapspaces"),
+                                           TRUE,
+                                           NULL);
+
+  num_items = g_variant_n_children (swapspaces);
+  for (n = 0; n < num_items; n++)
+    {
+      const gchar *object_path;
+
+      g_variant_get_child (swapspaces, n, "(&oa{sv})", &object_path, NULL);
+      udisks_daemon_util_bulk_call_add (call, object_path);
+    }
+
+  start_data.daemon = daemon;
+  start_data.invocation = invocation;
+  start_data.swapspaces = swapspaces;
+  udisks_daemon_util_bulk_call_run (call, start_many_item_func, &start_data);
+
+  ret = udisks_daemon_util_bulk_call_build_results (call, NULL, NULL);
+  udisks_daemon_util_bulk_call_free (call);
+
+  return ret;
+}
 
 static gboolean
 stop_job_func (UDisksThreadedJob  *job,
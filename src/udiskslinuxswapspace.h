@@ -34,6 +34,19 @@ UDisksSwapspace *udisks_linux_swapspace_new      (void);
 void             udisks_linux_swapspace_update   (UDisksLinuxSwapspace   *swapspace,
                                                   UDisksLinuxBlockObject *object);
 
+gboolean         udisks_linux_swapspace_get_start_options (GVariant               *options,
+                                                           gint                   *out_priority,
+                                                           const gchar           **out_discard,
+                                                           GError                **error);
+gboolean         udisks_linux_swapspace_swapon_sync       (const gchar            *device,
+                                                           gint                    priority,
+                                                           const gchar            *discard,
+                                                           GError                **error);
+GVariant        *udisks_linux_swapspace_start_many        (UDisksDaemon           *daemon,
+                                                           GDBusMethodInvocation  *invocation,
+                                                           GVariant               *swapspaces,
+                                                           GVariant               *options);
+
 G_END_DECLS
 
 #endif /* __UDISKS_LINUX_SWAPSPACE_H__ */
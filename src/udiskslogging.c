@@ -21,6 +21,7 @@
 #include "config.h"
 #include <glib/gi18n-lib.h>
 
+#include <string.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
 
@@ -34,6 +35,46 @@
  * Logging routines.
  */
 
+/* Debug and info messages are thrown away by the default GLib log writer
+ * unless enabled in G_MESSAGES_DEBUG, so check that before formatting them
+ * - they are emitted for every uevent. Mirrors g_log_writer_default(). */
+static gboolean
+debug_enabled (void)
+{
+  static gsize enabled = 0;
+
+  if (g_once_init_enter (&enabled))
+    {
+      const gchar *domains = g_getenv ("G_MESSAGES_DEBUG");
+      gboolean value;
+
+      value = domains != NULL && (strcmp (domains, "all") == 0 || strstr (domains, "udisks") != NULL);
+      g_once_init_leave (&enabled, value ? 2 : 1);
+    }
+
+  return enabled == 2;
+}
+
+#if GLIB_CHECK_VERSION(2, 50, 0)
+/* the THREAD_ID field, formatted once per thread */
+static GPrivate thread_id_key = G_PRIVATE_INIT (g_free);
+
+static const gchar *
+get_thread_id (void)
+{
+  gchar *thread_id;
+
+  thread_id = g_private_get (&thread_id_key);
+  if (thread_id == NULL)
+    {
+      thread_id = g_strdup_printf ("%d", (gint) syscall (SYS_gettid));
+      g_private_set (&thread_id_key, thread_id);
+    }
+
+  return thread_id;
+}
+#endif
+
 /**
  * udisks_log:
  * @level: A #UDisksLogLevel.
@@ -53,19 +94,19 @@ udisks_log (UDisksLogLevel     level,
 {
   va_list var_args;
   gchar *message;
-  gchar *thread_id;
+
+  if ((level == UDISKS_LOG_LEVEL_DEBUG || level == UDISKS_LOG_LEVEL_INFO) && !debug_enabled ())
+    return;
 
   va_start (var_args, format);
   message = g_strdup_vprintf (format, var_args);
   va_end (var_args);
 
 #if GLIB_CHECK_VERSION(2, 50, 0)
-  thread_id = g_strdup_printf ("%d", (gint) syscall (SYS_gettid));
   g_log_structured ("udisks", (GLogLevelFlags) level,
-                    "THREAD_ID", thread_id,
+                    "THREAD_ID", get_thread_id (),
                     "CODE_FUNC", function, "CODE_FILE", location,
                     "MESSAGE", "%s", message);
-  g_free (thread_id);
 #else
   g_log ("udisks", level, "[%d]: %s [%s, %s()]", (gint) syscall (SYS_gettid), message, location, function);
 #endif
@@ -0,0 +1,941 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <string.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksmanagedobjectscache.h"
+
+/**
+ * SECTION:udisksmanagedobjectscache
+ * @title: UDisksManagedObjectsCache
+ * @short_description: Answers GetManagedObjects() from cached replies
+ *
+ * Every client starts by calling the
+ * <literal>org.freedesktop.DBus.ObjectManager.GetManagedObjects()</literal>
+ * method, which #GDBusObjectManagerServer answers by collecting the
+ * properties of all the interfaces of all the exported objects in the
+ * main thread. With thousands of objects that takes a noticeable amount
+ * of time for every client connecting.
+ *
+ * The managed objects cache instead keeps the serialized interfaces and
+ * properties of every object, dropping them whenever a property of the
+ * object changes or an interface is added to or removed from it. It
+ * answers the GetManagedObjects() calls itself, from a #GDBusConnection
+ * filter in the GDBus worker thread, so only the objects that changed
+ * since the last call need to be collected again and the main thread is
+ * not involved at all. The
+ * <literal>org.freedesktop.DBus.Properties.GetAll()</literal> calls on
+ * the objects are answered from the same cache, so that large
+ * properties like <literal>Configuration</literal> are not serialized
+ * in the main thread for them either.
+ *
+ * The cache also exports additional
+ * <literal>org.freedesktop.DBus.ObjectManager</literal> objects for the
+ * well-known subtrees of <literal>/org/freedesktop/UDisks2</literal>
+ * (e.g. <literal>/org/freedesktop/UDisks2/drives</literal>), managing
+ * just the objects below them, so that clients interested in one kind
+ * of objects only need to subscribe to the signals of that subtree.
+ *
+ * While interfaces are being added to many objects at once (see
+ * udisks_daemon_begin_interfaces_batch()), e.g. when the interfaces of
+ * newly loaded modules are attached to all the block devices, the
+ * <literal>InterfacesAdded</literal> signals the object managers would
+ * emit for every single interface are held back and replaced by one
+ * signal per object once the batch is over, so that clients see the
+ * objects change in one step.
+ */
+
+#define OBJECT_MANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
+#define PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+
+/* the subtrees with object managers of their own */
+static const gchar *const subtree_paths[] = {
+  "/org/freedesktop/UDisks2/block_devices",
+  "/org/freedesktop/UDisks2/drives",
+  "/org/freedesktop/UDisks2/mdraid",
+  "/org/freedesktop/UDisks2/enclosures",
+  "/org/freedesktop/UDisks2/jobs",
+  "/org/freedesktop/UDisks2/lvm",
+  "/org/freedesktop/UDisks2/iscsi",
+};
+
+static const gchar object_manager_introspection_xml[] =
+  "<node>"
+  "  <interface name='" OBJECT_MANAGER_INTERFACE "'>"
+  "    <method name='GetManagedObjects'>"
+  "      <arg type='a{oa{sa{sv}}}' name='object_paths_interfaces_and_properties' direction='out'/>"
+  "    </method>"
+  "    <signal name='InterfacesAdded'>"
+  "      <arg type='o' name='object_path'/>"
+  "      <arg type='a{sa{sv}}' name='interfaces_and_properties'/>"
+  "    </signal>"
+  "    <signal name='InterfacesRemoved'>"
+  "      <arg type='o' name='object_path'/>"
+  "      <arg type='as' name='interfaces'/>"
+  "    </signal>"
+  "  </interface>"
+  "</node>";
+
+struct _UDisksManagedObjectsCache
+{
+  UDisksDaemon *daemon;
+
+  GDBusObjectManager *object_manager;
+  gulong object_added_handler_id;
+  gulong object_removed_handler_id;
+  gulong interface_added_handler_id;
+  gulong interface_removed_handler_id;
+
+  guint filter_id;
+
+  GDBusNodeInfo *object_manager_info;
+  /* one per subtree_paths element, 0 if the registration failed */
+  guint subtree_registration_ids[G_N_ELEMENTS (subtree_paths)];
+
+  gulong interfaces_batched_handler_id;
+
+  /* protects everything below, the filter runs in the GDBus worker thread */
+  GMutex lock;
+  /* maps from object path to CachedObject */
+  GHashTable *objects;
+
+  /* whether a batch is in progress, see udisks_daemon_begin_interfaces_batch() */
+  gboolean batching;
+  /* the object paths interfaces were added to during the current batch */
+  GHashTable *batch;
+  /* maps from object path to HeldObject */
+  GHashTable *held;
+  /* the InterfacesAdded messages emitted at the end of a batch not seen by the filter yet */
+  GHashTable *flushes;
+};
+
+typedef struct
+{
+  GDBusObject *object;
+  /* serialized a{sa{sv}} of all the interfaces of the object, NULL if out of date */
+  GVariant *interfaces;
+} CachedObject;
+
+/* The InterfacesAdded signals of the object manager for an object are dropped
+ * by the filter while the object is in the current batch or the signal
+ * replacing them is still queued, as long as they don't carry interfaces
+ * other than the held back ones (e.g. when the object is exported again). */
+typedef struct
+{
+  /* the names of the interfaces added during the batches */
+  GHashTable *interface_names;
+  /* the number of messages in flushes for the object */
+  guint n_flushes;
+} HeldObject;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+cached_object_free (CachedObject *cached)
+{
+  g_object_unref (cached->object);
+  if (cached->interfaces != NULL)
+    g_variant_unref (cached->interfaces);
+  g_slice_free (CachedObject, cached);
+}
+
+static void
+held_object_free (HeldObject *held)
+{
+  g_hash_table_unref (held->interface_names);
+  g_slice_free (HeldObject, held);
+}
+
+static void
+invalidate (UDisksManagedObjectsCache *cache,
+            GDBusObject               *object)
+{
+  CachedObject *cached;
+
+  g_mutex_lock (&cache->lock);
+  cached = g_hash_table_lookup (cache->objects, g_dbus_object_get_object_path (object));
+  if (cached != NULL && cached->interfaces != NULL)
+    {
+      g_variant_unref (cached->interfaces);
+      cached->interfaces = NULL;
+    }
+  g_mutex_unlock (&cache->lock);
+}
+
+/* may be called from any thread setting properties */
+static void
+on_interface_notify (GObject    *interface,
+                     GParamSpec *pspec,
+                     gpointer    user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+  GDBusObject *object;
+
+  object = g_dbus_interface_dup_object (G_DBUS_INTERFACE (interface));
+  if (object != NULL)
+    {
+      invalidate (cache, object);
+      g_object_unref (object);
+    }
+}
+
+static void
+watch_interface (UDisksManagedObjectsCache *cache,
+                 GDBusInterface            *interface)
+{
+  if (g_signal_handler_find (interface, G_SIGNAL_MATCH_FUNC | G_SIGNAL_MATCH_DATA,
+                             0, 0, NULL, on_interface_notify, cache) == 0)
+    g_signal_connect (interface, "notify", G_CALLBACK (on_interface_notify), cache);
+}
+
+static void
+unwatch_interface (UDisksManagedObjectsCache *cache,
+                   GDBusInterface            *interface)
+{
+  g_signal_handlers_disconnect_by_func (interface, G_CALLBACK (on_interface_notify), cache);
+}
+
+static GVariant *
+collect_interfaces (GDBusObject *object)
+{
+  GVariantBuilder builder;
+  GVariant *ret;
+  GList *interfaces;
+  GList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (l = interfaces; l != NULL; l = l->next)
+    {
+      GDBusInterfaceSkeleton *interface = G_DBUS_INTERFACE_SKELETON (l->data);
+      GVariant *properties;
+
+      properties = g_dbus_interface_skeleton_get_properties (interface);
+      g_variant_builder_add (&builder, "{s@a{sv}}",
+                             g_dbus_interface_skeleton_get_info (interface)->name,
+                             properties);
+      g_variant_unref (properties);
+    }
+  g_list_free_full (interfaces, g_object_unref);
+
+  ret = g_variant_ref_sink (g_variant_builder_end (&builder));
+  /* serialize it right away so that the replies just copy the data */
+  g_variant_get_data (ret);
+
+  return ret;
+}
+
+/* Returns the subtree with an object manager of its own @object_path is in, if any */
+static const gchar *
+lookup_subtree (const gchar *object_path)
+{
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (subtree_paths); n++)
+    {
+      gsize len = strlen (subtree_paths[n]);
+
+      if (strncmp (object_path, subtree_paths[n], len) == 0 && object_path[len] == '/')
+        return subtree_paths[n];
+    }
+
+  return NULL;
+}
+
+static void
+emit_interfaces_added (UDisksManagedObjectsCache *cache,
+                       GDBusObject               *object,
+                       GVariant                  *interfaces)
+{
+  const gchar *object_path;
+  const gchar *subtree;
+  GError *error = NULL;
+
+  object_path = g_dbus_object_get_object_path (object);
+  subtree = lookup_subtree (object_path);
+  if (subtree == NULL)
+    return;
+
+  if (!g_dbus_connection_emit_signal (udisks_daemon_get_connection (cache->daemon),
+                                      NULL, /* destination_bus_name */
+                                      subtree,
+                                      OBJECT_MANAGER_INTERFACE,
+                                      "InterfacesAdded",
+                                      g_variant_new ("(o@a{sa{sv}})", object_path, interfaces),
+                                      &error))
+    {
+      udisks_warning ("Error emitting InterfacesAdded on %s: %s", subtree, error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+emit_interfaces_removed (UDisksManagedObjectsCache *cache,
+                         GDBusObject               *object,
+                         GList                     *interfaces)
+{
+  const gchar *object_path;
+  const gchar *subtree;
+  GVariantBuilder builder;
+  GError *error = NULL;
+  GList *l;
+
+  object_path = g_dbus_object_get_object_path (object);
+  subtree = lookup_subtree (object_path);
+  if (subtree == NULL)
+    return;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("as"));
+  for (l = interfaces; l != NULL; l = l->next)
+    g_variant_builder_add (&builder, "s", g_dbus_interface_get_info (G_DBUS_INTERFACE (l->data))->name);
+
+  if (!g_dbus_connection_emit_signal (udisks_daemon_get_connection (cache->daemon),
+                                      NULL, /* destination_bus_name */
+                                      subtree,
+                                      OBJECT_MANAGER_INTERFACE,
+                                      "InterfacesRemoved",
+                                      g_variant_new ("(oas)", object_path, &builder),
+                                      &error))
+    {
+      udisks_warning ("Error emitting InterfacesRemoved on %s: %s", subtree, error->message);
+      g_clear_error (&error);
+    }
+}
+
+static void
+add_object (UDisksManagedObjectsCache *cache,
+            GDBusObject               *object,
+            gboolean                   emit)
+{
+  const gchar *object_path;
+  GVariant *interfaces_and_properties = NULL;
+  GList *interfaces;
+  GList *l;
+
+  /* watch first so that no change after collecting the properties is missed */
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (l = interfaces; l != NULL; l = l->next)
+    watch_interface (cache, G_DBUS_INTERFACE (l->data));
+  g_list_free_full (interfaces, g_object_unref);
+
+  object_path = g_dbus_object_get_object_path (object);
+  g_mutex_lock (&cache->lock);
+  if (!g_hash_table_contains (cache->objects, object_path))
+    {
+      CachedObject *cached;
+
+      cached = g_slice_new0 (CachedObject);
+      cached->object = g_object_ref (object);
+      if (emit && lookup_subtree (object_path) != NULL)
+        {
+          cached->interfaces = collect_interfaces (object);
+          interfaces_and_properties = g_variant_ref (cached->interfaces);
+        }
+      g_hash_table_insert (cache->objects, g_strdup (object_path), cached);
+    }
+  g_mutex_unlock (&cache->lock);
+
+  if (interfaces_and_properties != NULL)
+    {
+      emit_interfaces_added (cache, object, interfaces_and_properties);
+      g_variant_unref (interfaces_and_properties);
+    }
+}
+
+/* may be called from any thread exporting objects */
+static void
+on_object_added (GDBusObjectManager *manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
+{
+  add_object (user_data, object, TRUE);
+}
+
+static void
+on_object_removed (GDBusObjectManager *manager,
+                   GDBusObject        *object,
+                   gpointer            user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+  GList *interfaces;
+  GList *l;
+
+  g_mutex_lock (&cache->lock);
+  g_hash_table_remove (cache->objects, g_dbus_object_get_object_path (object));
+  g_mutex_unlock (&cache->lock);
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (l = interfaces; l != NULL; l = l->next)
+    unwatch_interface (cache, G_DBUS_INTERFACE (l->data));
+  emit_interfaces_removed (cache, object, interfaces);
+  g_list_free_full (interfaces, g_object_unref);
+}
+
+/* Returns whether the InterfacesAdded signals for @interface are held back
+ * until the end of the current batch */
+static gboolean
+hold_interface (UDisksManagedObjectsCache *cache,
+                GDBusObject               *object,
+                GDBusInterface            *interface)
+{
+  const gchar *object_path;
+  HeldObject *held;
+  gboolean ret = FALSE;
+
+  object_path = g_dbus_object_get_object_path (object);
+  g_mutex_lock (&cache->lock);
+  if (cache->batching)
+    {
+      held = g_hash_table_lookup (cache->held, object_path);
+      if (held == NULL)
+        {
+          held = g_slice_new0 (HeldObject);
+          held->interface_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+          g_hash_table_insert (cache->held, g_strdup (object_path), held);
+        }
+      g_hash_table_add (held->interface_names, g_strdup (g_dbus_interface_get_info (interface)->name));
+      g_hash_table_add (cache->batch, g_strdup (object_path));
+      ret = TRUE;
+    }
+  g_mutex_unlock (&cache->lock);
+
+  return ret;
+}
+
+static void
+on_interface_added (GDBusObjectManager *manager,
+                    GDBusObject        *object,
+                    GDBusInterface     *interface,
+                    gpointer            user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+  GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (interface);
+  GVariantBuilder builder;
+  GVariant *properties;
+
+  watch_interface (cache, interface);
+  invalidate (cache, object);
+
+  if (hold_interface (cache, object, interface))
+    return;
+
+  if (lookup_subtree (g_dbus_object_get_object_path (object)) == NULL)
+    return;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  properties = g_dbus_interface_skeleton_get_properties (skeleton);
+  g_variant_builder_add (&builder, "{s@a{sv}}", g_dbus_interface_skeleton_get_info (skeleton)->name, properties);
+  g_variant_unref (properties);
+  emit_interfaces_added (cache, object, g_variant_builder_end (&builder));
+}
+
+static void
+on_interface_removed (GDBusObjectManager *manager,
+                      GDBusObject        *object,
+                      GDBusInterface     *interface,
+                      gpointer            user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+  GList interfaces = { interface, NULL, NULL };
+
+  unwatch_interface (cache, interface);
+  invalidate (cache, object);
+  emit_interfaces_removed (cache, object, &interfaces);
+}
+
+/* called with the lock held, returns NULL if none of the interfaces is there anymore */
+static GVariant *
+collect_held_interfaces (GDBusObject *object,
+                         HeldObject  *held)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *interface_name;
+  gboolean any = FALSE;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+  g_hash_table_iter_init (&iter, held->interface_names);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &interface_name, NULL))
+    {
+      GDBusInterface *interface;
+      GVariant *properties;
+
+      interface = g_dbus_object_get_interface (object, interface_name);
+      if (interface == NULL)
+        continue;
+      properties = g_dbus_interface_skeleton_get_properties (G_DBUS_INTERFACE_SKELETON (interface));
+      g_variant_builder_add (&builder, "{s@a{sv}}", interface_name, properties);
+      g_variant_unref (properties);
+      g_object_unref (interface);
+      any = TRUE;
+    }
+
+  if (!any)
+    {
+      g_variant_builder_clear (&builder);
+      return NULL;
+    }
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/* Emits one InterfacesAdded signal for every object in the batch that is over.
+ * The lock is held all the time, the filter running in the GDBus worker
+ * thread must not see the signals before they are added to flushes. */
+static void
+flush_batch (UDisksManagedObjectsCache *cache)
+{
+  GDBusConnection *connection;
+  const gchar *manager_path;
+  GHashTableIter iter;
+  const gchar *object_path;
+
+  connection = udisks_daemon_get_connection (cache->daemon);
+  manager_path = g_dbus_object_manager_get_object_path (cache->object_manager);
+
+  g_mutex_lock (&cache->lock);
+  cache->batching = FALSE;
+  g_hash_table_iter_init (&iter, cache->batch);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object_path, NULL))
+    {
+      HeldObject *held;
+      GDBusObject *object;
+      GVariant *interfaces = NULL;
+      GError *error = NULL;
+
+      held = g_hash_table_lookup (cache->held, object_path);
+      object = g_dbus_object_manager_get_object (cache->object_manager, object_path);
+      if (object != NULL)
+        interfaces = collect_held_interfaces (object, held);
+
+      if (interfaces != NULL)
+        {
+          GDBusMessage *message;
+
+          message = g_dbus_message_new_signal (manager_path, OBJECT_MANAGER_INTERFACE, "InterfacesAdded");
+          g_dbus_message_set_body (message, g_variant_new ("(o@a{sa{sv}})", object_path, interfaces));
+          g_hash_table_add (cache->flushes, message);
+          held->n_flushes++;
+          if (!g_dbus_connection_send_message (connection, message, G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, &error))
+            {
+              udisks_warning ("Error emitting InterfacesAdded for %s: %s", object_path, error->message);
+              g_clear_error (&error);
+              g_hash_table_remove (cache->flushes, message);
+              held->n_flushes--;
+            }
+          g_object_unref (message);
+
+          emit_interfaces_added (cache, object, interfaces);
+          g_variant_unref (interfaces);
+        }
+
+      if (held->n_flushes == 0)
+        g_hash_table_remove (cache->held, object_path);
+      g_clear_object (&object);
+      g_hash_table_iter_remove (&iter);
+    }
+  g_mutex_unlock (&cache->lock);
+}
+
+/* emitted in the thread starting or ending the batch */
+static void
+on_interfaces_batched_notify (GObject    *object,
+                              GParamSpec *pspec,
+                              gpointer    user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+
+  if (udisks_daemon_get_interfaces_batched (cache->daemon))
+    {
+      g_mutex_lock (&cache->lock);
+      cache->batching = TRUE;
+      g_mutex_unlock (&cache->lock);
+    }
+  else
+    {
+      flush_batch (cache);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_managed_objects_cache_get:
+ * @cache: A #UDisksManagedObjectsCache.
+ * @subtree: (allow-none): The object path of a subtree or %NULL for all the objects.
+ *
+ * Gets the interfaces and properties of all the objects exported by the
+ * daemon below @subtree, collecting them only for the objects that
+ * changed since the last call. May be called from any thread.
+ *
+ * Returns: A floating #GVariant of type <literal>a{oa{sa{sv}}}</literal>,
+ *   the same as the result of GetManagedObjects().
+ */
+GVariant *
+udisks_managed_objects_cache_get (UDisksManagedObjectsCache *cache,
+                                  const gchar               *subtree)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *object_path;
+  CachedObject *cached;
+  gsize subtree_len = subtree != NULL ? strlen (subtree) : 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
+  g_mutex_lock (&cache->lock);
+  g_hash_table_iter_init (&iter, cache->objects);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object_path, (gpointer *) &cached))
+    {
+      if (subtree != NULL &&
+          (strncmp (object_path, subtree, subtree_len) != 0 || object_path[subtree_len] != '/'))
+        continue;
+      if (cached->interfaces == NULL)
+        cached->interfaces = collect_interfaces (cached->object);
+      g_variant_builder_add (&builder, "{o@a{sa{sv}}}", object_path, cached->interfaces);
+    }
+  g_mutex_unlock (&cache->lock);
+
+  return g_variant_builder_end (&builder);
+}
+
+/* runs in the GDBus worker thread, drops the held back InterfacesAdded signals */
+static GDBusMessage *
+filter_outgoing (UDisksManagedObjectsCache *cache,
+                 GDBusMessage              *message)
+{
+  GVariant *body;
+  GVariant *interfaces;
+  const gchar *object_path;
+  HeldObject *held;
+  gboolean drop = FALSE;
+  gsize n;
+
+  if (g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_SIGNAL ||
+      g_strcmp0 (g_dbus_message_get_member (message), "InterfacesAdded") != 0 ||
+      g_strcmp0 (g_dbus_message_get_interface (message), OBJECT_MANAGER_INTERFACE) != 0 ||
+      g_strcmp0 (g_dbus_message_get_path (message), g_dbus_object_manager_get_object_path (cache->object_manager)) != 0)
+    return message;
+
+  body = g_dbus_message_get_body (message);
+  if (body == NULL || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(oa{sa{sv}})")))
+    return message;
+  g_variant_get (body, "(&o@a{sa{sv}})", &object_path, &interfaces);
+
+  g_mutex_lock (&cache->lock);
+  held = g_hash_table_lookup (cache->held, object_path);
+  if (held != NULL)
+    {
+      if (g_hash_table_remove (cache->flushes, message))
+        {
+          /* the signals emitted after this one are not held back anymore */
+          if (--held->n_flushes == 0 && !g_hash_table_contains (cache->batch, object_path))
+            g_hash_table_remove (cache->held, object_path);
+        }
+      else
+        {
+          drop = TRUE;
+          for (n = 0; n < g_variant_n_children (interfaces) && drop; n++)
+            {
+              const gchar *interface_name;
+
+              g_variant_get_child (interfaces, n, "{&s@a{sv}}", &interface_name, NULL);
+              if (!g_hash_table_contains (held->interface_names, interface_name))
+                drop = FALSE;
+            }
+        }
+    }
+  g_mutex_unlock (&cache->lock);
+  g_variant_unref (interfaces);
+
+  if (drop)
+    {
+      g_object_unref (message);
+      return NULL;
+    }
+  return message;
+}
+
+/* runs in the GDBus worker thread */
+static GDBusMessage *
+handle_get_all (UDisksManagedObjectsCache *cache,
+                GDBusConnection           *connection,
+                GDBusMessage              *message)
+{
+  GVariant *body;
+  const gchar *object_path;
+  const gchar *interface_name;
+  CachedObject *cached;
+  GVariant *properties = NULL;
+  GDBusMessage *reply;
+  GError *error = NULL;
+
+  /* leave calls with wrong arguments or for unknown objects and interfaces to fail */
+  body = g_dbus_message_get_body (message);
+  object_path = g_dbus_message_get_path (message);
+  if (object_path == NULL || body == NULL || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(s)")))
+    return message;
+  g_variant_get (body, "(&s)", &interface_name);
+
+  g_mutex_lock (&cache->lock);
+  cached = g_hash_table_lookup (cache->objects, object_path);
+  if (cached != NULL)
+    {
+      if (cached->interfaces == NULL)
+        cached->interfaces = collect_interfaces (cached->object);
+      properties = g_variant_lookup_value (cached->interfaces, interface_name, G_VARIANT_TYPE_VARDICT);
+    }
+  g_mutex_unlock (&cache->lock);
+
+  if (properties == NULL)
+    return message;
+
+  if (!(g_dbus_message_get_flags (message) & G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED))
+    {
+      reply = g_dbus_message_new_method_reply (message);
+      g_dbus_message_set_body (reply, g_variant_new ("(@a{sv})", properties));
+      if (!g_dbus_connection_send_message (connection, reply, G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, &error))
+        {
+          udisks_warning ("Error replying to GetAll() of %s: %s",
+                          g_dbus_message_get_sender (message), error->message);
+          g_clear_error (&error);
+        }
+      g_object_unref (reply);
+    }
+  g_variant_unref (properties);
+
+  /* handled, don't pass it on to the object */
+  g_object_unref (message);
+  return NULL;
+}
+
+/* runs in the GDBus worker thread */
+static GDBusMessage *
+on_message (GDBusConnection *connection,
+            GDBusMessage    *message,
+            gboolean         incoming,
+            gpointer         user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+  GDBusMessage *reply;
+  const gchar *path;
+  const gchar *subtree = NULL;
+  GError *error = NULL;
+  guint n;
+
+  if (!incoming)
+    return filter_outgoing (cache, message);
+
+  if (g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL)
+    return message;
+
+  if (g_strcmp0 (g_dbus_message_get_member (message), "GetAll") == 0 &&
+      g_strcmp0 (g_dbus_message_get_interface (message), PROPERTIES_INTERFACE) == 0)
+    return handle_get_all (cache, connection, message);
+
+  /* leave calls with wrong arguments to the object managers to fail */
+  if (g_strcmp0 (g_dbus_message_get_member (message), "GetManagedObjects") != 0 ||
+      g_strcmp0 (g_dbus_message_get_interface (message), OBJECT_MANAGER_INTERFACE) != 0 ||
+      g_dbus_message_get_body (message) != NULL)
+    return message;
+
+  path = g_dbus_message_get_path (message);
+  if (g_strcmp0 (path, g_dbus_object_manager_get_object_path (cache->object_manager)) != 0)
+    {
+      for (n = 0; n < G_N_ELEMENTS (subtree_paths) && subtree == NULL; n++)
+        if (cache->subtree_registration_ids[n] != 0 && g_strcmp0 (path, subtree_paths[n]) == 0)
+          subtree = subtree_paths[n];
+      if (subtree == NULL)
+        return message;
+    }
+
+  if (!(g_dbus_message_get_flags (message) & G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED))
+    {
+      reply = g_dbus_message_new_method_reply (message);
+      g_dbus_message_set_body (reply, g_variant_new ("(@a{oa{sa{sv}}})", udisks_managed_objects_cache_get (cache, subtree)));
+      if (!g_dbus_connection_send_message (connection, reply, G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, &error))
+        {
+          udisks_warning ("Error replying to GetManagedObjects() of %s: %s",
+                          g_dbus_message_get_sender (message), error->message);
+          g_clear_error (&error);
+        }
+      g_object_unref (reply);
+    }
+
+  /* handled, don't pass it on to the object manager */
+  g_object_unref (message);
+  return NULL;
+}
+
+/* only reached if the filter didn't handle the call, e.g. after it has been removed in
+ * udisks_managed_objects_cache_free() */
+static void
+subtree_method_call (GDBusConnection       *connection,
+                     const gchar           *sender,
+                     const gchar           *object_path,
+                     const gchar           *interface_name,
+                     const gchar           *method_name,
+                     GVariant              *parameters,
+                     GDBusMethodInvocation *invocation,
+                     gpointer               user_data)
+{
+  UDisksManagedObjectsCache *cache = user_data;
+
+  g_dbus_method_invocation_return_value (invocation,
+                                         g_variant_new ("(@a{oa{sa{sv}}})",
+                                                        udisks_managed_objects_cache_get (cache, object_path)));
+}
+
+static const GDBusInterfaceVTable subtree_vtable = {
+  subtree_method_call,
+  NULL, /* get_property */
+  NULL, /* set_property */
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_managed_objects_cache_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new #UDisksManagedObjectsCache answering the
+ * GetManagedObjects() calls on the object manager of @daemon from now
+ * on and exports the object managers of the subtrees. Must be called from the main thread, after all the other
+ * #GDBusConnection filters that need to see the GetManagedObjects() and
+ * GetAll() calls have been added since those calls are not passed on.
+ *
+ * Returns: A #UDisksManagedObjectsCache. Free with udisks_managed_objects_cache_free().
+ */
+UDisksManagedObjectsCache *
+udisks_managed_objects_cache_new (UDisksDaemon *daemon)
+{
+  UDisksManagedObjectsCache *cache;
+  GDBusConnection *connection;
+  GList *objects;
+  GList *l;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+
+  cache = g_new0 (UDisksManagedObjectsCache, 1);
+  cache->daemon = daemon;
+  g_mutex_init (&cache->lock);
+  cache->objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) cached_object_free);
+  cache->batch = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  cache->held = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) held_object_free);
+  cache->flushes = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  cache->object_manager = g_object_ref (G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (daemon)));
+  cache->object_added_handler_id = g_signal_connect (cache->object_manager, "object-added",
+                                                     G_CALLBACK (on_object_added), cache);
+  cache->object_removed_handler_id = g_signal_connect (cache->object_manager, "object-removed",
+                                                       G_CALLBACK (on_object_removed), cache);
+  cache->interface_added_handler_id = g_signal_connect (cache->object_manager, "interface-added",
+                                                        G_CALLBACK (on_interface_added), cache);
+  cache->interface_removed_handler_id = g_signal_connect (cache->object_manager, "interface-removed",
+                                                          G_CALLBACK (on_interface_removed), cache);
+
+  cache->interfaces_batched_handler_id = g_signal_connect (daemon, "notify::interfaces-batched",
+                                                           G_CALLBACK (on_interfaces_batched_notify), cache);
+  cache->batching = udisks_daemon_get_interfaces_batched (daemon);
+
+  /* the objects exported so far */
+  objects = g_dbus_object_manager_get_objects (cache->object_manager);
+  for (l = objects; l != NULL; l = l->next)
+    add_object (cache, G_DBUS_OBJECT (l->data), FALSE);
+  g_list_free_full (objects, g_object_unref);
+
+  connection = udisks_daemon_get_connection (daemon);
+  cache->object_manager_info = g_dbus_node_info_new_for_xml (object_manager_introspection_xml, NULL);
+  for (n = 0; n < G_N_ELEMENTS (subtree_paths); n++)
+    {
+      GError *error = NULL;
+
+      cache->subtree_registration_ids[n] =
+        g_dbus_connection_register_object (connection,
+                                           subtree_paths[n],
+                                           cache->object_manager_info->interfaces[0],
+                                           &subtree_vtable,
+                                           cache,
+                                           NULL, /* user_data_free_func */
+                                           &error);
+      if (cache->subtree_registration_ids[n] == 0)
+        {
+          udisks_warning ("Error exporting the object manager at %s: %s", subtree_paths[n], error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  cache->filter_id = g_dbus_connection_add_filter (connection, on_message, cache, NULL);
+
+  return cache;
+}
+
+/**
+ * udisks_managed_objects_cache_free:
+ * @cache: A #UDisksManagedObjectsCache.
+ *
+ * Frees @cache and unexports the object managers of the subtrees, the
+ * object manager of the daemon answers the GetManagedObjects() calls
+ * by itself again.
+ */
+void
+udisks_managed_objects_cache_free (UDisksManagedObjectsCache *cache)
+{
+  GDBusConnection *connection;
+  GHashTableIter iter;
+  CachedObject *cached;
+  guint n;
+
+  connection = udisks_daemon_get_connection (cache->daemon);
+  g_dbus_connection_remove_filter (connection, cache->filter_id);
+  for (n = 0; n < G_N_ELEMENTS (subtree_paths); n++)
+    if (cache->subtree_registration_ids[n] != 0)
+      g_dbus_connection_unregister_object (connection, cache->subtree_registration_ids[n]);
+  g_dbus_node_info_unref (cache->object_manager_info);
+
+  g_signal_handler_disconnect (cache->object_manager, cache->object_added_handler_id);
+  g_signal_handler_disconnect (cache->object_manager, cache->object_removed_handler_id);
+  g_signal_handler_disconnect (cache->object_manager, cache->interface_added_handler_id);
+  g_signal_handler_disconnect (cache->object_manager, cache->interface_removed_handler_id);
+  g_signal_handler_disconnect (cache->daemon, cache->interfaces_batched_handler_id);
+  g_object_unref (cache->object_manager);
+
+  g_hash_table_iter_init (&iter, cache->objects);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cached))
+    {
+      GList *interfaces;
+      GList *l;
+
+      interfaces = g_dbus_object_get_interfaces (cached->object);
+      for (l = interfaces; l != NULL; l = l->next)
+        unwatch_interface (cache, G_DBUS_INTERFACE (l->data));
+      g_list_free_full (interfaces, g_object_unref);
+    }
+  g_hash_table_unref (cache->objects);
+  g_hash_table_unref (cache->batch);
+  g_hash_table_unref (cache->held);
+  g_hash_table_unref (cache->flushes);
+  g_mutex_clear (&cache->lock);
+  g_free (cache);
+}
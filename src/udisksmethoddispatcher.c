@@ -0,0 +1,475 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksconfigmanager.h"
+#include "udisksmetrics.h"
+#include "udisksmethoddispatcher.h"
+
+/**
+ * SECTION:udisksmethoddispatcher
+ * @title: UDisksMethodDispatcher
+ * @short_description: Runs D-Bus method calls in a bounded thread pool
+ *
+ * Most method handlers of the daemon block, e.g. in
+ * udisks_daemon_launch_spawned_job_sync() or while waiting for a
+ * uevent, so they can't run in the main thread. Instead of handing every
+ * incoming call to a thread of its own, the interface skeletons hooked
+ * with udisks_method_dispatcher_hook_class() queue their method calls in
+ * the method dispatcher of the daemon.
+ *
+ * The dispatcher runs at most <literal>method_calls_max_threads</literal>
+ * calls at the same time and at most
+ * <literal>method_calls_max_threads_per_caller</literal> calls of the
+ * same D-Bus connection (see udisks2.conf(5), 0 means no limit for the
+ * latter). The queued calls are served round-robin among the callers,
+ * first come first served for the calls of the same caller, so that a
+ * client sending a burst of calls doesn't delay the calls of the others
+ * for more than one call of its own.
+ *
+ * The time the calls spend in the queue is recorded as the
+ * %UDISKS_METRICS_KIND_QUEUE metrics, the current and maximum queue
+ * depths are available from udisks_method_dispatcher_get_counts().
+ */
+
+struct _UDisksMethodDispatcher
+{
+  UDisksDaemon *daemon;
+
+  GThreadPool *pool;
+
+  /* protects all the members below */
+  GMutex lock;
+
+  guint max_threads;
+  guint max_threads_per_caller;
+
+  /* maps from the unique bus name of the caller to Caller */
+  GHashTable *callers;
+  /* Caller instances with queued calls, in round-robin order */
+  GQueue ready;
+
+  guint n_queued;
+  guint n_running;
+  guint max_queued;
+};
+
+typedef struct
+{
+  gchar *sender;
+  /* MethodCall instances, in the order they arrived */
+  GQueue calls;
+  guint n_running;
+  gboolean in_ready;
+} Caller;
+
+typedef struct
+{
+  Caller *caller;
+  GDBusInterfaceSkeleton *interface;
+  /* owned, passed on to method_call */
+  GDBusMethodInvocation *invocation;
+  GDBusInterfaceMethodCallFunc method_call;
+  gint64 queued_time;
+} MethodCall;
+
+/* The original get_vtable() of a hooked skeleton class and a copy of
+ * the vtable it returns with the method_call function replaced */
+typedef struct
+{
+  GDBusInterfaceVTable *(*get_vtable) (GDBusInterfaceSkeleton *interface);
+  GDBusInterfaceMethodCallFunc method_call;
+  GDBusInterfaceVTable vtable;
+  gboolean vtable_initialized;
+} HookedClass;
+
+G_LOCK_DEFINE_STATIC (hooked_class_lock);
+
+/* the dispatcher of the daemon, if any */
+static UDisksMethodDispatcher *default_dispatcher = NULL;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+caller_free (Caller *caller)
+{
+  g_warn_if_fail (g_queue_is_empty (&caller->calls));
+  g_free (caller->sender);
+  g_slice_free (Caller, caller);
+}
+
+/* Hands the next queued calls to the thread pool, round-robin among the
+ * callers not running too many calls already. */
+static void
+dispatch_queued_locked (UDisksMethodDispatcher *dispatcher)
+{
+  guint n_skipped = 0;
+
+  while (dispatcher->n_running < dispatcher->max_threads &&
+         n_skipped < g_queue_get_length (&dispatcher->ready))
+    {
+      Caller *caller;
+      MethodCall *call;
+
+      caller = g_queue_pop_head (&dispatcher->ready);
+      if (dispatcher->max_threads_per_caller > 0 &&
+          caller->n_running >= dispatcher->max_threads_per_caller)
+        {
+          g_queue_push_tail (&dispatcher->ready, caller);
+          n_skipped++;
+          continue;
+        }
+      n_skipped = 0;
+
+      call = g_queue_pop_head (&caller->calls);
+      if (g_queue_is_empty (&caller->calls))
+        caller->in_ready = FALSE;
+      else
+        g_queue_push_tail (&dispatcher->ready, caller);
+
+      caller->n_running++;
+      dispatcher->n_running++;
+      dispatcher->n_queued--;
+      g_thread_pool_push (dispatcher->pool, call, NULL);
+    }
+}
+
+/* runs in a thread of the pool */
+static void
+run_method_call (gpointer data,
+                 gpointer user_data)
+{
+  UDisksMethodDispatcher *dispatcher = user_data;
+  MethodCall *call = data;
+  Caller *caller = call->caller;
+  GDBusMethodInvocation *invocation = call->invocation;
+  gchar *name;
+
+  name = g_strdup_printf ("%s.%s",
+                          g_dbus_method_invocation_get_interface_name (invocation),
+                          g_dbus_method_invocation_get_method_name (invocation));
+  udisks_metrics_record (udisks_daemon_get_metrics (dispatcher->daemon),
+                         UDISKS_METRICS_KIND_QUEUE,
+                         name,
+                         g_get_monotonic_time () - call->queued_time);
+  g_free (name);
+
+  /* the invocation may be gone once this returns */
+  call->method_call (g_dbus_method_invocation_get_connection (invocation),
+                     g_dbus_method_invocation_get_sender (invocation),
+                     g_dbus_method_invocation_get_object_path (invocation),
+                     g_dbus_method_invocation_get_interface_name (invocation),
+                     g_dbus_method_invocation_get_method_name (invocation),
+                     g_dbus_method_invocation_get_parameters (invocation),
+                     invocation,
+                     call->interface);
+
+  g_mutex_lock (&dispatcher->lock);
+  caller->n_running--;
+  dispatcher->n_running--;
+  if (caller->n_running == 0 && g_queue_is_empty (&caller->calls))
+    g_hash_table_remove (dispatcher->callers, caller->sender);
+  dispatch_queued_locked (dispatcher);
+  g_mutex_unlock (&dispatcher->lock);
+
+  g_object_unref (call->interface);
+  g_slice_free (MethodCall, call);
+}
+
+static void
+queue_method_call (UDisksMethodDispatcher *dispatcher,
+                   MethodCall             *call)
+{
+  const gchar *sender;
+  Caller *caller;
+
+  /* peer-to-peer connections have no bus names */
+  sender = g_dbus_method_invocation_get_sender (call->invocation);
+  if (sender == NULL)
+    sender = "";
+
+  g_mutex_lock (&dispatcher->lock);
+  caller = g_hash_table_lookup (dispatcher->callers, sender);
+  if (caller == NULL)
+    {
+      caller = g_slice_new0 (Caller);
+      caller->sender = g_strdup (sender);
+      g_hash_table_insert (dispatcher->callers, caller->sender, caller);
+    }
+  call->caller = caller;
+  g_queue_push_tail (&caller->calls, call);
+  if (!caller->in_ready)
+    {
+      g_queue_push_tail (&dispatcher->ready, caller);
+      caller->in_ready = TRUE;
+    }
+
+  dispatcher->n_queued++;
+  dispatcher->max_queued = MAX (dispatcher->max_queued, dispatcher->n_queued);
+  dispatch_queued_locked (dispatcher);
+  g_mutex_unlock (&dispatcher->lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static HookedClass *
+lookup_hooked_class (GType type)
+{
+  GQuark quark = g_quark_from_static_string ("x-udisks-method-dispatcher-hooked-class");
+  HookedClass *hooked = NULL;
+
+  /* subclasses of hooked classes inherit the hooked get_vtable() */
+  for (; type != 0 && hooked == NULL; type = g_type_parent (type))
+    hooked = g_type_get_qdata (type, quark);
+
+  g_assert (hooked != NULL);
+  return hooked;
+}
+
+/* called in the main thread, once the call has been authorized */
+static void
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+  GDBusInterfaceSkeleton *interface = G_DBUS_INTERFACE_SKELETON (user_data);
+  UDisksMethodDispatcher *dispatcher;
+  HookedClass *hooked;
+  MethodCall *call;
+
+  hooked = lookup_hooked_class (G_TYPE_FROM_INSTANCE (interface));
+  dispatcher = g_atomic_pointer_get (&default_dispatcher);
+  if (dispatcher == NULL)
+    {
+      /* no daemon (anymore), e.g. on shutdown */
+      hooked->method_call (connection, sender, object_path, interface_name, method_name,
+                           parameters, invocation, user_data);
+      return;
+    }
+
+  call = g_slice_new0 (MethodCall);
+  call->interface = g_object_ref (interface);
+  call->invocation = invocation;
+  call->method_call = hooked->method_call;
+  call->queued_time = g_get_monotonic_time ();
+  queue_method_call (dispatcher, call);
+}
+
+static GDBusInterfaceVTable *
+hooked_get_vtable (GDBusInterfaceSkeleton *interface)
+{
+  HookedClass *hooked;
+
+  hooked = lookup_hooked_class (G_TYPE_FROM_INSTANCE (interface));
+
+  G_LOCK (hooked_class_lock);
+  if (!hooked->vtable_initialized)
+    {
+      GDBusInterfaceVTable *vtable;
+
+      vtable = hooked->get_vtable (interface);
+      hooked->method_call = vtable->method_call;
+      hooked->vtable = *vtable;
+      hooked->vtable.method_call = handle_method_call;
+      hooked->vtable_initialized = TRUE;
+    }
+  G_UNLOCK (hooked_class_lock);
+
+  return &hooked->vtable;
+}
+
+/**
+ * udisks_method_dispatcher_hook_class:
+ * @klass: The class of an interface skeleton.
+ *
+ * Makes the method calls on instances of @klass (and its subclasses)
+ * run in a thread of the #UDisksMethodDispatcher of the daemon instead
+ * of the main thread. Use this in the class_init function of the
+ * interfaces whose method handlers block instead of the
+ * %G_DBUS_INTERFACE_SKELETON_FLAGS_HANDLE_METHOD_INVOCATIONS_IN_THREAD
+ * flag.
+ *
+ * The method calls are authorized (the
+ * #GDBusInterfaceSkeleton::g-authorize-method and
+ * #GDBusObjectSkeleton::authorize-method signals) in the main thread
+ * before they are queued.
+ */
+void
+udisks_method_dispatcher_hook_class (GDBusInterfaceSkeletonClass *klass)
+{
+  HookedClass *hooked;
+
+  g_return_if_fail (G_IS_DBUS_INTERFACE_SKELETON_CLASS (klass));
+  g_return_if_fail (klass->get_vtable != hooked_get_vtable);
+
+  hooked = g_new0 (HookedClass, 1);
+  hooked->get_vtable = klass->get_vtable;
+  g_type_set_qdata (G_TYPE_FROM_CLASS (klass),
+                    g_quark_from_static_string ("x-udisks-method-dispatcher-hooked-class"),
+                    hooked);
+  klass->get_vtable = hooked_get_vtable;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_method_dispatcher_set_limits:
+ * @dispatcher: A #UDisksMethodDispatcher.
+ * @max_threads: The maximum number of method calls running at the same time, at least 1.
+ * @max_threads_per_caller: The maximum number of method calls of the same caller running at the same time or 0 for no limit.
+ *
+ * Changes the limits of @dispatcher, e.g. when the configuration has
+ * been reloaded. Queued calls the new limits allow to run are started
+ * right away, calls already running are never interrupted.
+ */
+void
+udisks_method_dispatcher_set_limits (UDisksMethodDispatcher *dispatcher,
+                                     guint                   max_threads,
+                                     guint                   max_threads_per_caller)
+{
+  g_return_if_fail (max_threads > 0);
+
+  g_mutex_lock (&dispatcher->lock);
+  dispatcher->max_threads = max_threads;
+  dispatcher->max_threads_per_caller = max_threads_per_caller;
+  g_thread_pool_set_max_threads (dispatcher->pool, max_threads, NULL);
+  dispatch_queued_locked (dispatcher);
+  g_mutex_unlock (&dispatcher->lock);
+}
+
+/**
+ * udisks_method_dispatcher_get_counts:
+ * @dispatcher: A #UDisksMethodDispatcher.
+ * @out_queued: (out) (allow-none): Return location for the number of queued method calls or %NULL.
+ * @out_running: (out) (allow-none): Return location for the number of running method calls or %NULL.
+ * @out_max_queued: (out) (allow-none): Return location for the maximum number of method calls queued at the same time since the daemon started or %NULL.
+ *
+ * Gets the queue depths of @dispatcher. May be called from any thread.
+ */
+void
+udisks_method_dispatcher_get_counts (UDisksMethodDispatcher *dispatcher,
+                                     guint                  *out_queued,
+                                     guint                  *out_running,
+                                     guint                  *out_max_queued)
+{
+  g_mutex_lock (&dispatcher->lock);
+  if (out_queued != NULL)
+    *out_queued = dispatcher->n_queued;
+  if (out_running != NULL)
+    *out_running = dispatcher->n_running;
+  if (out_max_queued != NULL)
+    *out_max_queued = dispatcher->max_queued;
+  g_mutex_unlock (&dispatcher->lock);
+}
+
+/**
+ * udisks_method_dispatcher_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new method dispatcher with the limits configured for
+ * @daemon and makes it handle the method calls of all the hooked
+ * interface skeletons. Must be called from the main thread.
+ *
+ * Returns: A #UDisksMethodDispatcher. Free with udisks_method_dispatcher_free().
+ */
+UDisksMethodDispatcher *
+udisks_method_dispatcher_new (UDisksDaemon *daemon)
+{
+  UDisksMethodDispatcher *dispatcher;
+  UDisksConfigManager *config_manager;
+
+  dispatcher = g_new0 (UDisksMethodDispatcher, 1);
+  /* we don't take a reference to the daemon */
+  dispatcher->daemon = daemon;
+
+  config_manager = udisks_daemon_get_config_manager (daemon);
+  dispatcher->max_threads = udisks_config_manager_get_method_calls_max_threads (config_manager);
+  dispatcher->max_threads_per_caller = udisks_config_manager_get_method_calls_max_threads_per_caller (config_manager);
+
+  g_mutex_init (&dispatcher->lock);
+  dispatcher->callers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) caller_free);
+  /* only fails for exclusive pools */
+  dispatcher->pool = g_thread_pool_new (run_method_call, dispatcher, dispatcher->max_threads, FALSE, NULL);
+
+  if (!g_atomic_pointer_compare_and_exchange (&default_dispatcher, NULL, dispatcher))
+    udisks_warning ("A method dispatcher already exists, not using the new one");
+
+  return dispatcher;
+}
+
+/**
+ * udisks_method_dispatcher_free:
+ * @dispatcher: A #UDisksMethodDispatcher.
+ *
+ * Waits for the running method calls to finish and frees @dispatcher.
+ * The queued method calls fail with an error.
+ */
+void
+udisks_method_dispatcher_free (UDisksMethodDispatcher *dispatcher)
+{
+  GList *calls = NULL;
+  GList *l;
+  Caller *caller;
+
+  g_atomic_pointer_compare_and_exchange (&default_dispatcher, dispatcher, NULL);
+
+  g_mutex_lock (&dispatcher->lock);
+  while ((caller = g_queue_pop_head (&dispatcher->ready)) != NULL)
+    {
+      MethodCall *call;
+
+      while ((call = g_queue_pop_head (&caller->calls)) != NULL)
+        calls = g_list_prepend (calls, call);
+      caller->in_ready = FALSE;
+      if (caller->n_running == 0)
+        g_hash_table_remove (dispatcher->callers, caller->sender);
+    }
+  dispatcher->n_queued = 0;
+  g_mutex_unlock (&dispatcher->lock);
+
+  for (l = calls; l != NULL; l = l->next)
+    {
+      MethodCall *call = l->data;
+
+      g_dbus_method_invocation_return_error (call->invocation,
+                                             UDISKS_ERROR,
+                                             UDISKS_ERROR_FAILED,
+                                             "The daemon is shutting down");
+      g_object_unref (call->interface);
+      g_slice_free (MethodCall, call);
+    }
+  g_list_free (calls);
+
+  /* waits for the running calls */
+  g_thread_pool_free (dispatcher->pool, FALSE, TRUE);
+
+  g_hash_table_unref (dispatcher->callers);
+  g_mutex_clear (&dispatcher->lock);
+  g_free (dispatcher);
+}
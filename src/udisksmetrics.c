@@ -0,0 +1,403 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksconfigmanager.h"
+#include "udisksdaemonutil.h"
+#include "udisksmetrics.h"
+#include "udisksmethoddispatcher.h"
+
+/**
+ * SECTION:udisksmetrics
+ * @title: UDisksMetrics
+ * @short_description: Latency histograms of the daemon
+ *
+ * The daemon keeps histograms of how long D-Bus method calls, the
+ * stages of the uevent handling and jobs take and how long its locks
+ * are held. They can be queried with
+ * the org.freedesktop.UDisks2.Manager.GetLatencyStatistics() method and,
+ * if <literal>metrics_file_interval</literal> is set in udisks2.conf(5),
+ * are periodically written to <filename>/run/udisks2/metrics.prom</filename>
+ * in the OpenMetrics text format.
+ *
+ * The latency of a method call is measured from the moment the call is
+ * dispatched (the #GDBusObjectSkeleton::authorize-method signal) until its
+ * #GDBusMethodInvocation is finalized, i.e. until the reply is sent, so
+ * it includes the authorization, the time the call waits in the queue
+ * of the #UDisksMethodDispatcher and replies sent from other threads.
+ * The current and maximum depth of that queue are written to the
+ * OpenMetrics file as gauges as well.
+ */
+
+#define METRICS_FILE "/run/udisks2/metrics.prom"
+
+/* upper bounds of the histogram buckets in usec, the last bucket is +Inf */
+static const gint64 bucket_bounds[] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000, 30000000, 60000000
+};
+#define N_BUCKETS (G_N_ELEMENTS (bucket_bounds) + 1)
+
+typedef struct
+{
+  guint64 buckets[N_BUCKETS];   /* not cumulative */
+  guint64 count;
+  gint64 sum;
+} Histogram;
+
+struct _UDisksMetrics
+{
+  UDisksDaemon *daemon;
+
+  GDBusObjectManager *object_manager;
+  gulong object_added_handler_id;
+
+  guint file_timeout_id;
+
+  /* protects histograms */
+  GMutex lock;
+  /* maps from name to Histogram, one table per UDisksMetricsKind */
+  GHashTable *histograms[UDISKS_METRICS_N_KINDS];
+};
+
+static const gchar *const kind_names[UDISKS_METRICS_N_KINDS] = {
+  "method", "uevent", "job", "lock", "timer", "queue", "update"
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  UDisksMetrics *metrics;
+  gchar *name;
+  gint64 start_time;
+} MethodCall;
+
+/* called when the invocation is finalized, i.e. once the call has been replied to */
+static void
+method_call_done (MethodCall *call)
+{
+  udisks_metrics_record (call->metrics, UDISKS_METRICS_KIND_METHOD, call->name,
+                         g_get_monotonic_time () - call->start_time);
+  g_free (call->name);
+  g_slice_free (MethodCall, call);
+}
+
+/* called in the main thread, before the call is queued */
+static gboolean
+on_authorize_method (GDBusObjectSkeleton    *object,
+                     GDBusInterfaceSkeleton *interface,
+                     GDBusMethodInvocation  *invocation,
+                     gpointer                user_data)
+{
+  MethodCall *call;
+
+  call = g_slice_new0 (MethodCall);
+  call->metrics = user_data;
+  call->name = g_strdup_printf ("%s.%s",
+                                g_dbus_method_invocation_get_interface_name (invocation),
+                                g_dbus_method_invocation_get_method_name (invocation));
+  call->start_time = g_get_monotonic_time ();
+  g_object_set_data_full (G_OBJECT (invocation), "x-udisks-metrics-method-call",
+                          call, (GDestroyNotify) method_call_done);
+
+  return TRUE; /* authorized, the actual checks are done by the handlers */
+}
+
+/* may be called from any thread exporting objects */
+static void
+on_object_added (GDBusObjectManager *manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
+{
+  if (G_IS_DBUS_OBJECT_SKELETON (object))
+    g_signal_connect (object, "authorize-method", G_CALLBACK (on_authorize_method), user_data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+on_file_timeout (gpointer user_data)
+{
+  UDisksMetrics *metrics = user_data;
+  gchar *contents;
+  GError *error = NULL;
+
+  contents = udisks_metrics_to_openmetrics (metrics);
+  if (!g_file_set_contents (METRICS_FILE, contents, -1, &error))
+    {
+      udisks_warning ("Error writing %s: %s", METRICS_FILE, error->message);
+      g_clear_error (&error);
+    }
+  g_free (contents);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * udisks_metrics_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new #UDisksMetrics instance recording the method calls on
+ * all the objects exported by @daemon from now on. Must be called from
+ * the main thread.
+ *
+ * Returns: A #UDisksMetrics. Free with udisks_metrics_free().
+ */
+UDisksMetrics *
+udisks_metrics_new (UDisksDaemon *daemon)
+{
+  UDisksMetrics *metrics;
+  guint interval;
+  guint n;
+
+  metrics = g_new0 (UDisksMetrics, 1);
+  metrics->daemon = daemon;
+  g_mutex_init (&metrics->lock);
+  for (n = 0; n < UDISKS_METRICS_N_KINDS; n++)
+    metrics->histograms[n] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  metrics->object_manager = g_object_ref (G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (daemon)));
+  metrics->object_added_handler_id = g_signal_connect (metrics->object_manager,
+                                                       "object-added",
+                                                       G_CALLBACK (on_object_added),
+                                                       metrics);
+
+  interval = udisks_config_manager_get_metrics_file_interval (udisks_daemon_get_config_manager (daemon));
+  if (interval > 0)
+    metrics->file_timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                       "metrics-file",
+                                                                       interval,
+                                                                       on_file_timeout,
+                                                                       metrics,
+                                                                       NULL);
+
+  return metrics;
+}
+
+/**
+ * udisks_metrics_free:
+ * @metrics: A #UDisksMetrics.
+ *
+ * Frees @metrics.
+ */
+void
+udisks_metrics_free (UDisksMetrics *metrics)
+{
+  guint n;
+
+  if (metrics->file_timeout_id > 0)
+    {
+      g_source_remove (metrics->file_timeout_id);
+      g_unlink (METRICS_FILE);
+    }
+  g_signal_handler_disconnect (metrics->object_manager, metrics->object_added_handler_id);
+  g_object_unref (metrics->object_manager);
+  for (n = 0; n < UDISKS_METRICS_N_KINDS; n++)
+    g_hash_table_unref (metrics->histograms[n]);
+  g_mutex_clear (&metrics->lock);
+  g_free (metrics);
+}
+
+/**
+ * udisks_metrics_record:
+ * @metrics: A #UDisksMetrics.
+ * @kind: The kind of the latency.
+ * @name: The name of the method, uevent stage or job operation.
+ * @usec: The latency in microseconds.
+ *
+ * Adds @usec to the histogram of @name. May be called from any thread.
+ */
+void
+udisks_metrics_record (UDisksMetrics     *metrics,
+                       UDisksMetricsKind  kind,
+                       const gchar       *name,
+                       gint64             usec)
+{
+  Histogram *histogram;
+  guint n;
+
+  g_return_if_fail (kind < UDISKS_METRICS_N_KINDS);
+
+  for (n = 0; n < G_N_ELEMENTS (bucket_bounds); n++)
+    if (usec <= bucket_bounds[n])
+      break;
+
+  g_mutex_lock (&metrics->lock);
+  histogram = g_hash_table_lookup (metrics->histograms[kind], name);
+  if (histogram == NULL)
+    {
+      histogram = g_new0 (Histogram, 1);
+      g_hash_table_insert (metrics->histograms[kind], g_strdup (name), histogram);
+    }
+  histogram->buckets[n]++;
+  histogram->count++;
+  histogram->sum += usec;
+  g_mutex_unlock (&metrics->lock);
+}
+
+/**
+ * udisks_metrics_to_variant:
+ * @metrics: A #UDisksMetrics.
+ *
+ * Gets all the histograms, see the documentation of the
+ * org.freedesktop.UDisks2.Manager.GetLatencyStatistics() method.
+ *
+ * Returns: A floating #GVariant of type <literal>a(ssxta(xt))</literal>.
+ */
+GVariant *
+udisks_metrics_to_variant (UDisksMetrics *metrics)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  const gchar *name;
+  Histogram *histogram;
+  guint kind;
+  guint n;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssxta(xt))"));
+  g_mutex_lock (&metrics->lock);
+  for (kind = 0; kind < UDISKS_METRICS_N_KINDS; kind++)
+    {
+      g_hash_table_iter_init (&iter, metrics->histograms[kind]);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &histogram))
+        {
+          guint64 cumulative = 0;
+
+          g_variant_builder_open (&builder, G_VARIANT_TYPE ("(ssxta(xt))"));
+          g_variant_builder_add (&builder, "s", kind_names[kind]);
+          g_variant_builder_add (&builder, "s", name);
+          g_variant_builder_add (&builder, "x", histogram->sum);
+          g_variant_builder_add (&builder, "t", histogram->count);
+          g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(xt)"));
+          for (n = 0; n < N_BUCKETS; n++)
+            {
+              cumulative += histogram->buckets[n];
+              g_variant_builder_add (&builder, "(xt)",
+                                     n < G_N_ELEMENTS (bucket_bounds) ? bucket_bounds[n] : (gint64) -1,
+                                     cumulative);
+            }
+          g_variant_builder_close (&builder);
+          g_variant_builder_close (&builder);
+        }
+    }
+  g_mutex_unlock (&metrics->lock);
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+append_label_value (GString     *str,
+                    const gchar *value)
+{
+  const gchar *p;
+
+  for (p = value; *p != '\0'; p++)
+    {
+      if (*p == '\\' || *p == '"')
+        g_string_append_c (str, '\\');
+      if (*p == '\n')
+        g_string_append (str, "\\n");
+      else
+        g_string_append_c (str, *p);
+    }
+}
+
+/**
+ * udisks_metrics_to_openmetrics:
+ * @metrics: A #UDisksMetrics.
+ *
+ * Formats all the histograms in the OpenMetrics text format, as
+ * <literal>udisks_&lt;kind&gt;_duration_seconds</literal> histograms with
+ * the name in the <literal>name</literal> label, followed by the
+ * <literal>udisks_method_calls_queued</literal>,
+ * <literal>udisks_method_calls_queued_max</literal> and
+ * <literal>udisks_method_calls_running</literal> gauges.
+ *
+ * Returns: The text. Free with g_free().
+ */
+gchar *
+udisks_metrics_to_openmetrics (UDisksMetrics *metrics)
+{
+  UDisksMethodDispatcher *dispatcher;
+  GString *str;
+  GHashTableIter iter;
+  const gchar *name;
+  Histogram *histogram;
+  guint kind;
+  guint n;
+
+  str = g_string_new (NULL);
+  g_mutex_lock (&metrics->lock);
+  for (kind = 0; kind < UDISKS_METRICS_N_KINDS; kind++)
+    {
+      g_string_append_printf (str, "# TYPE udisks_%s_duration_seconds histogram\n", kind_names[kind]);
+      g_string_append_printf (str, "# UNIT udisks_%s_duration_seconds seconds\n", kind_names[kind]);
+
+      g_hash_table_iter_init (&iter, metrics->histograms[kind]);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &histogram))
+        {
+          guint64 cumulative = 0;
+
+          for (n = 0; n < N_BUCKETS; n++)
+            {
+              cumulative += histogram->buckets[n];
+              g_string_append_printf (str, "udisks_%s_duration_seconds_bucket{name=\"", kind_names[kind]);
+              append_label_value (str, name);
+              if (n < G_N_ELEMENTS (bucket_bounds))
+                g_string_append_printf (str, "\",le=\"%g\"} %" G_GUINT64_FORMAT "\n",
+                                        bucket_bounds[n] / (gdouble) G_USEC_PER_SEC, cumulative);
+              else
+                g_string_append_printf (str, "\",le=\"+Inf\"} %" G_GUINT64_FORMAT "\n", cumulative);
+            }
+
+          g_string_append_printf (str, "udisks_%s_duration_seconds_sum{name=\"", kind_names[kind]);
+          append_label_value (str, name);
+          g_string_append_printf (str, "\"} %g\n", histogram->sum / (gdouble) G_USEC_PER_SEC);
+
+          g_string_append_printf (str, "udisks_%s_duration_seconds_count{name=\"", kind_names[kind]);
+          append_label_value (str, name);
+          g_string_append_printf (str, "\"} %" G_GUINT64_FORMAT "\n", histogram->count);
+        }
+    }
+  g_mutex_unlock (&metrics->lock);
+
+  dispatcher = udisks_daemon_get_method_dispatcher (metrics->daemon);
+  if (dispatcher != NULL)
+    {
+      guint queued;
+      guint running;
+      guint max_queued;
+
+      udisks_method_dispatcher_get_counts (dispatcher, &queued, &running, &max_queued);
+      g_string_append_printf (str, "# TYPE udisks_method_calls_queued gauge\nudisks_method_calls_queued %u\n", queued);
+      g_string_append_printf (str, "# TYPE udisks_method_calls_queued_max gauge\nudisks_method_calls_queued_max %u\n", max_queued);
+      g_string_append_printf (str, "# TYPE udisks_method_calls_running gauge\nudisks_method_calls_running %u\n", running);
+    }
+
+  g_string_append (str, "# EOF\n");
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,63 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_METRICS_H__
+#define __UDISKS_METRICS_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+/**
+ * UDisksMetricsKind:
+ * @UDISKS_METRICS_KIND_METHOD: D-Bus method calls, by interface and method name.
+ * @UDISKS_METRICS_KIND_UEVENT: Stages of the uevent handling, by stage name.
+ * @UDISKS_METRICS_KIND_JOB: Jobs, by operation.
+ * @UDISKS_METRICS_KIND_LOCK: Hold times of locks, by lock name.
+ * @UDISKS_METRICS_KIND_TIMER: Wakeups of periodic work, by the name of the work.
+ * @UDISKS_METRICS_KIND_QUEUE: Waits of D-Bus method calls for a thread of the #UDisksMethodDispatcher, by interface and method name.
+ * @UDISKS_METRICS_KIND_UPDATE: Updates of the interfaces and the module objects run for uevents, by type name.
+ *
+ * The kinds of latencies recorded with udisks_metrics_record().
+ */
+typedef enum
+{
+  UDISKS_METRICS_KIND_METHOD,
+  UDISKS_METRICS_KIND_UEVENT,
+  UDISKS_METRICS_KIND_JOB,
+  UDISKS_METRICS_KIND_LOCK,
+  UDISKS_METRICS_KIND_TIMER,
+  UDISKS_METRICS_KIND_QUEUE,
+  UDISKS_METRICS_KIND_UPDATE,
+  UDISKS_METRICS_N_KINDS
+} UDisksMetricsKind;
+
+UDisksMetrics *udisks_metrics_new            (UDisksDaemon      *daemon);
+void           udisks_metrics_free           (UDisksMetrics     *metrics);
+void           udisks_metrics_record         (UDisksMetrics     *metrics,
+                                              UDisksMetricsKind  kind,
+                                              const gchar       *name,
+                                              gint64             usec);
+GVariant      *udisks_metrics_to_variant     (UDisksMetrics     *metrics);
+gchar         *udisks_metrics_to_openmetrics (UDisksMetrics     *metrics);
+
+G_END_DECLS
+
+#endif /* __UDISKS_METRICS_H__ */
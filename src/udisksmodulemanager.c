@@ -38,6 +38,7 @@
 #include "udisksconfigmanager.h"
 #include "udisksprivate.h"
 #include "udiskslogging.h"
+#include "udiskslinuxdevice.h"
 #include <modules/udisksmoduleifacetypes.h>
 
 
@@ -87,8 +88,16 @@
  * --force-load-modules and --disable-modules commandline switches that makes
  * modules loaded right on startup or never loaded respectively.
  *
+ * Modules can also be loaded one by one, either on request (see the
+ * org.freedesktop.UDisks2.Manager.EnableModule() D-Bus method) or, with the
+ * <literal>lazy</literal> load preference, as soon as the first device the
+ * module is known to handle shows up (see
+ * udisks_module_manager_get_lazy_module_for_device()). Each module is only
+ * loaded once and modules that are not needed cost no start-up time or memory.
+ *
  * Upon successful activation, the "modules-ready" property on the #UDisksModuleManager
- * instance is set to %TRUE. Any daemon objects watching this property are
+ * instance is set to %TRUE and a notification is emitted whenever another module is
+ * loaded. Any daemon objects watching this property are
  * responsible for performing "coldplug" on their exported objects to assure
  * modules would pick up the devices they're interested in. See e.g.
  * UDisksModuleObjectNewFunc() to see how device binding works for
@@ -164,6 +173,9 @@ struct _UDisksModuleManager
   GList *block_object_interface_infos;
   GList *drive_object_interface_infos;
   GList *module_object_new_funcs;
+  GHashTable *module_object_new_func_matches;
+  GHashTable *block_object_interface_matches;
+  GHashTable *module_object_housekeeping_infos;
   GList *new_manager_iface_funcs;
   GList *module_track_parent_funcs;
   GList *teardown_funcs;
@@ -172,6 +184,12 @@ struct _UDisksModuleManager
   gboolean modules_ready;
   gboolean uninstalled;
 
+  /* names of the modules loaded so far */
+  GHashTable *loaded_modules;
+
+  /* maps from module ID to its UDisksModuleReloadConfigurationFunc, if any */
+  GHashTable *reload_configuration_funcs;
+
   GHashTable *state_pointers;
 };
 
@@ -218,7 +236,12 @@ udisks_module_manager_finalize (GObject *object)
   udisks_module_manager_unload_modules (manager);
 
   g_mutex_clear (&manager->modules_ready_lock);
+  g_hash_table_destroy (manager->loaded_modules);
+  g_hash_table_destroy (manager->reload_configuration_funcs);
   g_hash_table_destroy (manager->state_pointers);
+  g_hash_table_destroy (manager->module_object_new_func_matches);
+  g_hash_table_destroy (manager->block_object_interface_matches);
+  g_hash_table_destroy (manager->module_object_housekeeping_infos);
 
   if (G_OBJECT_CLASS (udisks_module_manager_parent_class)->finalize != NULL)
     G_OBJECT_CLASS (udisks_module_manager_parent_class)->finalize (object);
@@ -232,6 +255,11 @@ udisks_module_manager_init (UDisksModuleManager *manager)
 
   g_mutex_init (&manager->modules_ready_lock);
   manager->state_pointers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  manager->loaded_modules = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  manager->reload_configuration_funcs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  manager->module_object_new_func_matches = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  manager->block_object_interface_matches = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  manager->module_object_housekeeping_infos = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
 }
 
 static void
@@ -257,6 +285,13 @@ udisks_module_manager_free_modules (UDisksModuleManager *manager)
       manager->module_object_new_funcs = NULL;
     }
 
+  if (manager->module_object_new_func_matches != NULL)
+    g_hash_table_remove_all (manager->module_object_new_func_matches);
+  if (manager->block_object_interface_matches != NULL)
+    g_hash_table_remove_all (manager->block_object_interface_matches);
+  if (manager->module_object_housekeeping_infos != NULL)
+    g_hash_table_remove_all (manager->module_object_housekeeping_infos);
+
   if (manager->new_manager_iface_funcs != NULL)
     {
       g_list_free (manager->new_manager_iface_funcs);
@@ -355,21 +390,31 @@ udisks_module_manager_get_modules_list (UDisksModuleManager *manager)
   return modules_list;
 }
 
-/**
- * udisks_module_manager_load_modules:
- * @manager: A #UDisksModuleManager instance.
- *
- * Loads all modules at a time and emits the "modules-ready" signal.
- * Does nothing when called multiple times.
- */
-void
-udisks_module_manager_load_modules (UDisksModuleManager *manager)
+/* Name of the module in the @path shared object, e.g. "lvm2" for ".../libudisks2_lvm2.so" */
+static gchar *
+module_name_from_path (const gchar *path)
+{
+  gchar *basename;
+  gchar *name;
+  const gchar *prefix = "lib" PACKAGE_NAME_UDISKS2 "_";
+
+  basename = g_path_get_basename (path);
+  if (g_str_has_prefix (basename, prefix) && g_str_has_suffix (basename, ".so"))
+    name = g_strndup (basename + strlen (prefix), strlen (basename) - strlen (prefix) - strlen (".so"));
+  else
+    name = g_strdup (basename);
+  g_free (basename);
+
+  return name;
+}
+
+/* called with modules_ready_lock held, returns whether the module was loaded successfully */
+static gboolean
+load_module_file (UDisksModuleManager *manager,
+                  const gchar         *pth)
 {
-  GList *modules_to_load;
-  GList *modules_to_load_tmp;
   GModule *module;
   ModuleData *module_data;
-  gchar *pth;
 
   UDisksModuleIfaceSetupFunc block_object_iface_setup_func;
   UDisksModuleIfaceSetupFunc drive_object_iface_setup_func;
@@ -378,109 +423,345 @@ udisks_module_manager_load_modules (UDisksModuleManager *manager)
   UDisksModuleIDFunc module_id_func;
   UDisksModuleInitFunc module_init_func;
   UDisksModuleTeardownFunc module_teardown_func;
+  UDisksModuleReloadConfigurationFunc module_reload_configuration_func;
 
   /* Module API */
   gchar *module_id;
   gpointer module_state_pointer;
   UDisksModuleInterfaceInfo **infos, **infos_i;
+  UDisksModuleInterfaceMatchSetupFunc block_object_iface_match_setup_func;
+  UDisksModuleInterfaceMatch **iface_matches, **iface_matches_i;
   UDisksModuleObjectNewFunc *module_object_new_funcs, *module_object_new_funcs_i;
+  UDisksModuleObjectNewFuncMatchSetupFunc module_object_new_func_match_setup_func;
+  UDisksModuleObjectNewFuncMatch **matches, **matches_i;
+  UDisksModuleObjectHousekeepingInfoSetupFunc module_object_housekeeping_info_setup_func;
+  UDisksModuleObjectHousekeepingInfo **hk_infos, **hk_infos_i;
   UDisksModuleNewManagerIfaceFunc *module_new_manager_iface_funcs, *module_new_manager_iface_funcs_i;
   gpointer track_parent_func;
+  gchar *path_basename;
 
-  g_return_if_fail (UDISKS_IS_MODULE_MANAGER (manager));
+  module = g_module_open (pth, /* G_MODULE_BIND_LOCAL */ 0);
+  if (module == NULL)
+    {
+      udisks_critical ("Module loading failed: %s", g_module_error ());
+      return FALSE;
+    }
 
-  /* Repetitive loading guard */
-  g_mutex_lock (&manager->modules_ready_lock);
-  if (manager->modules_ready)
+  path_basename = g_path_get_basename (pth);
+  module_data = g_new0 (ModuleData, 1);
+  module_data->handle = module;
+  udisks_notice ("Loading module %s...", path_basename);
+  g_free (path_basename);
+  if (! g_module_symbol (module_data->handle, "udisks_module_id", (gpointer *) &module_id_func) ||
+      ! g_module_symbol (module_data->handle, "udisks_module_init", (gpointer *) &module_init_func) ||
+      ! g_module_symbol (module_data->handle, "udisks_module_teardown", (gpointer *) &module_teardown_func) ||
+      ! g_module_symbol (module_data->handle, "udisks_module_get_block_object_iface_setup_entries", (gpointer *) &block_object_iface_setup_func) ||
+      ! g_module_symbol (module_data->handle, "udisks_module_get_drive_object_iface_setup_entries", (gpointer *) &drive_object_iface_setup_func) ||
+      ! g_module_symbol (module_data->handle, "udisks_module_get_object_new_funcs", (gpointer *) &module_object_new_setup_func) ||
+      ! g_module_symbol (module_data->handle, "udisks_module_get_new_manager_iface_funcs", (gpointer *) &module_new_manager_iface_setup_func))
     {
-      g_mutex_unlock (&manager->modules_ready_lock);
-      return;
+      udisks_warning ("  Error importing required symbols from module '%s'", pth);
+      free_module_data (module_data);
+      return FALSE;
     }
 
-  /* Load the modules */
-  modules_to_load = udisks_module_manager_get_modules_list (manager);
-  for (modules_to_load_tmp = modules_to_load;
-       modules_to_load_tmp;
-       modules_to_load_tmp = modules_to_load_tmp->next)
+  /* Module name */
+  module_id = module_id_func ();
+
+  /* Initialize the module and store its state pointer. */
+  module_state_pointer = module_init_func (udisks_module_manager_get_daemon (manager));
+
+  /* Module tear down function */
+  manager->teardown_funcs = g_list_append (manager->teardown_funcs,  module_teardown_func);
+
+  infos = block_object_iface_setup_func ();
+  for (infos_i = infos; infos_i && *infos_i; infos_i++)
+    manager->block_object_interface_infos = g_list_append (manager->block_object_interface_infos, *infos_i);
+  g_free (infos);
+
+  /* Block object interface match keys are optional */
+  if (g_module_symbol (module_data->handle, "udisks_module_get_block_object_iface_matches", (gpointer *) &block_object_iface_match_setup_func))
+    {
+      iface_matches = block_object_iface_match_setup_func ();
+      for (iface_matches_i = iface_matches; iface_matches_i && *iface_matches_i; iface_matches_i++)
+        g_hash_table_replace (manager->block_object_interface_matches,
+                              GSIZE_TO_POINTER ((*iface_matches_i)->skeleton_type), *iface_matches_i);
+      g_free (iface_matches);
+    }
+
+  infos = drive_object_iface_setup_func ();
+  for (infos_i = infos; infos_i && *infos_i; infos_i++)
+    manager->drive_object_interface_infos = g_list_append (manager->drive_object_interface_infos, *infos_i);
+  g_free (infos);
+
+  module_object_new_funcs = module_object_new_setup_func ();
+  for (module_object_new_funcs_i = module_object_new_funcs; module_object_new_funcs_i && *module_object_new_funcs_i; module_object_new_funcs_i++)
+    manager->module_object_new_funcs = g_list_append (manager->module_object_new_funcs, *module_object_new_funcs_i);
+  g_free (module_object_new_funcs);
+
+  /* Object new func match criteria are optional */
+  if (g_module_symbol (module_data->handle, "udisks_module_get_object_new_func_matches", (gpointer *) &module_object_new_func_match_setup_func))
+    {
+      matches = module_object_new_func_match_setup_func ();
+      for (matches_i = matches; matches_i && *matches_i; matches_i++)
+        g_hash_table_replace (manager->module_object_new_func_matches, (*matches_i)->new_func, *matches_i);
+      g_free (matches);
+    }
+
+  /* Object housekeeping infos are optional too */
+  if (g_module_symbol (module_data->handle, "udisks_module_get_object_housekeeping_infos", (gpointer *) &module_object_housekeeping_info_setup_func))
     {
-      pth = (gchar *) modules_to_load_tmp->data;
-      module = g_module_open (pth, /* G_MODULE_BIND_LOCAL */ 0);
+      hk_infos = module_object_housekeeping_info_setup_func ();
+      for (hk_infos_i = hk_infos; hk_infos_i && *hk_infos_i; hk_infos_i++)
+        g_hash_table_replace (manager->module_object_housekeeping_infos, (*hk_infos_i)->new_func, *hk_infos_i);
+      g_free (hk_infos);
+    }
+
+  module_new_manager_iface_funcs = module_new_manager_iface_setup_func ();
+  for (module_new_manager_iface_funcs_i = module_new_manager_iface_funcs; module_new_manager_iface_funcs_i && *module_new_manager_iface_funcs_i; module_new_manager_iface_funcs_i++)
+    manager->new_manager_iface_funcs = g_list_append (manager->new_manager_iface_funcs, *module_new_manager_iface_funcs_i);
+  g_free (module_new_manager_iface_funcs);
+
+  if (g_module_symbol (module_data->handle, "udisks_module_track_parent", &track_parent_func))
+    {
+      udisks_debug("ADDING TRACK");
+      manager->module_track_parent_funcs = g_list_append (manager->module_track_parent_funcs,
+                                                          track_parent_func);
+    }
 
-      if (module != NULL)
+  if (module_id != NULL &&
+      g_module_symbol (module_data->handle, "udisks_module_reload_configuration", (gpointer *) &module_reload_configuration_func))
+    g_hash_table_replace (manager->reload_configuration_funcs, g_strdup (module_id), module_reload_configuration_func);
+
+  manager->modules = g_list_append (manager->modules, module_data);
+  if (module_state_pointer != NULL && module_id != NULL)
+    udisks_module_manager_set_module_state_pointer (manager, module_id, module_state_pointer);
+  g_free (module_id);
+
+  return TRUE;
+}
+
+/* Loads the modules from @modules_to_load (paths) that have not been loaded
+ * yet and emits the "modules-ready" signal if any got loaded */
+static void
+load_module_files (UDisksModuleManager *manager,
+                   GList               *modules_to_load)
+{
+  GList *l;
+  gchar *name;
+  gboolean loaded_any = FALSE;
+
+  g_mutex_lock (&manager->modules_ready_lock);
+  for (l = modules_to_load; l; l = l->next)
+    {
+      name = module_name_from_path (l->data);
+      /* Repetitive loading guard */
+      if (g_hash_table_contains (manager->loaded_modules, name))
+        {
+          g_free (name);
+          continue;
+        }
+      if (load_module_file (manager, l->data))
         {
-          gchar *path_basename = g_path_get_basename (pth);
-          module_data = g_new0 (ModuleData, 1);
-          module_data->handle = module;
-          udisks_notice ("Loading module %s...", path_basename);
-          g_free (path_basename);
-          if (! g_module_symbol (module_data->handle, "udisks_module_id", (gpointer *) &module_id_func) ||
-              ! g_module_symbol (module_data->handle, "udisks_module_init", (gpointer *) &module_init_func) ||
-              ! g_module_symbol (module_data->handle, "udisks_module_teardown", (gpointer *) &module_teardown_func) ||
-              ! g_module_symbol (module_data->handle, "udisks_module_get_block_object_iface_setup_entries", (gpointer *) &block_object_iface_setup_func) ||
-              ! g_module_symbol (module_data->handle, "udisks_module_get_drive_object_iface_setup_entries", (gpointer *) &drive_object_iface_setup_func) ||
-              ! g_module_symbol (module_data->handle, "udisks_module_get_object_new_funcs", (gpointer *) &module_object_new_setup_func) ||
-              ! g_module_symbol (module_data->handle, "udisks_module_get_new_manager_iface_funcs", (gpointer *) &module_new_manager_iface_setup_func))
-            {
-              udisks_warning ("  Error importing required symbols from module '%s'", pth);
-              free_module_data (module_data);
-            }
-          else
-            {
-              /* Module name */
-              module_id = module_id_func ();
-
-              /* Initialize the module and store its state pointer. */
-              module_state_pointer = module_init_func (udisks_module_manager_get_daemon (manager));
-
-              /* Module tear down function */
-              manager->teardown_funcs = g_list_append (manager->teardown_funcs,  module_teardown_func);
-
-              infos = block_object_iface_setup_func ();
-              for (infos_i = infos; infos_i && *infos_i; infos_i++)
-                manager->block_object_interface_infos = g_list_append (manager->block_object_interface_infos, *infos_i);
-              g_free (infos);
-
-              infos = drive_object_iface_setup_func ();
-              for (infos_i = infos; infos_i && *infos_i; infos_i++)
-                manager->drive_object_interface_infos = g_list_append (manager->drive_object_interface_infos, *infos_i);
-              g_free (infos);
-
-              module_object_new_funcs = module_object_new_setup_func ();
-              for (module_object_new_funcs_i = module_object_new_funcs; module_object_new_funcs_i && *module_object_new_funcs_i; module_object_new_funcs_i++)
-                manager->module_object_new_funcs = g_list_append (manager->module_object_new_funcs, *module_object_new_funcs_i);
-              g_free (module_object_new_funcs);
-
-              module_new_manager_iface_funcs = module_new_manager_iface_setup_func ();
-              for (module_new_manager_iface_funcs_i = module_new_manager_iface_funcs; module_new_manager_iface_funcs_i && *module_new_manager_iface_funcs_i; module_new_manager_iface_funcs_i++)
-                manager->new_manager_iface_funcs = g_list_append (manager->new_manager_iface_funcs, *module_new_manager_iface_funcs_i);
-              g_free (module_new_manager_iface_funcs);
-
-              if (g_module_symbol (module_data->handle, "udisks_module_track_parent", &track_parent_func))
-                {
-                  udisks_debug("ADDING TRACK");
-                  manager->module_track_parent_funcs = g_list_append (manager->module_track_parent_funcs,
-                                                                      track_parent_func);
-                }
-
-              manager->modules = g_list_append (manager->modules, module_data);
-              if (module_state_pointer != NULL && module_id != NULL)
-                udisks_module_manager_set_module_state_pointer (manager, module_id, module_state_pointer);
-              g_free (module_id);
-            }
+          g_hash_table_add (manager->loaded_modules, name);
+          loaded_any = TRUE;
         }
       else
         {
-          udisks_critical ("Module loading failed: %s", g_module_error ());
+          g_free (name);
         }
     }
-
-  manager->modules_ready = TRUE;
+  if (loaded_any)
+    manager->modules_ready = TRUE;
   g_mutex_unlock (&manager->modules_ready_lock);
 
+  /* Fires whenever the set of loaded modules grows */
+  if (loaded_any)
+    g_object_notify (G_OBJECT (manager), "modules-ready");
+}
+
+/**
+ * udisks_module_manager_load_modules:
+ * @manager: A #UDisksModuleManager instance.
+ *
+ * Loads all the modules that are not loaded yet and emits the
+ * "modules-ready" signal. Does nothing when called multiple times.
+ */
+void
+udisks_module_manager_load_modules (UDisksModuleManager *manager)
+{
+  GList *modules_to_load;
+
+  g_return_if_fail (UDISKS_IS_MODULE_MANAGER (manager));
+
+  modules_to_load = udisks_module_manager_get_modules_list (manager);
+  load_module_files (manager, modules_to_load);
   g_list_free_full (modules_to_load, (GDestroyNotify) g_free);
+}
+
+/**
+ * udisks_module_manager_load_module:
+ * @manager: A #UDisksModuleManager instance.
+ * @module_name: A module name, e.g. "lvm2".
+ *
+ * Loads the module @module_name if it's available and not loaded yet
+ * and emits the "modules-ready" signal. The other modules are left
+ * alone so that modules that are not needed don't cost any start-up
+ * time or memory.
+ *
+ * Returns: %TRUE if the module is loaded (now or before), %FALSE if
+ * there is no such module or it failed to load.
+ *
+ * Since: 2.9.0
+ */
+gboolean
+udisks_module_manager_load_module (UDisksModuleManager *manager,
+                                   const gchar         *module_name)
+{
+  GList *modules_list;
+  GList *modules_to_load = NULL;
+  GList *l;
+  gchar *name;
+
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), FALSE);
+  g_return_val_if_fail (module_name != NULL, FALSE);
+
+  if (udisks_module_manager_get_module_loaded (manager, module_name))
+    return TRUE;
+
+  /* only the modules enabled in the configuration can be loaded */
+  modules_list = udisks_module_manager_get_modules_list (manager);
+  for (l = modules_list; l; l = l->next)
+    {
+      name = module_name_from_path (l->data);
+      if (g_strcmp0 (name, module_name) == 0)
+        modules_to_load = g_list_append (modules_to_load, l->data);
+      g_free (name);
+    }
+  load_module_files (manager, modules_to_load);
+  g_list_free (modules_to_load);
+  g_list_free_full (modules_list, (GDestroyNotify) g_free);
+
+  return udisks_module_manager_get_module_loaded (manager, module_name);
+}
+
+/**
+ * udisks_module_manager_get_module_loaded:
+ * @manager: A #UDisksModuleManager instance.
+ * @module_name: A module name, e.g. "lvm2".
+ *
+ * Indicates whether the module @module_name has been loaded.
+ *
+ * Returns: %TRUE if the module has been loaded, %FALSE otherwise.
+ *
+ * Since: 2.9.0
+ */
+gboolean
+udisks_module_manager_get_module_loaded (UDisksModuleManager *manager,
+                                         const gchar         *module_name)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), FALSE);
+
+  g_mutex_lock (&manager->modules_ready_lock);
+  ret = g_hash_table_contains (manager->loaded_modules, module_name);
+  g_mutex_unlock (&manager->modules_ready_lock);
+
+  return ret;
+}
+
+/**
+ * udisks_module_manager_reload_module_configuration:
+ * @manager: A #UDisksModuleManager instance.
+ * @module_name: A module name, e.g. "lvm2".
+ *
+ * Makes the module @module_name read its configuration file again, see
+ * #UDisksModuleReloadConfigurationFunc.
+ *
+ * Returns: %TRUE if the module is loaded and supports reloading its
+ *          configuration, %FALSE otherwise.
+ *
+ * Since: 2.9.0
+ */
+gboolean
+udisks_module_manager_reload_module_configuration (UDisksModuleManager *manager,
+                                                   const gchar         *module_name)
+{
+  UDisksModuleReloadConfigurationFunc reload_func;
+
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), FALSE);
+  g_return_val_if_fail (module_name != NULL, FALSE);
+
+  g_mutex_lock (&manager->modules_ready_lock);
+  reload_func = g_hash_table_lookup (manager->reload_configuration_funcs, module_name);
+  g_mutex_unlock (&manager->modules_ready_lock);
+
+  if (reload_func == NULL)
+    return FALSE;
+
+  udisks_notice ("Reloading configuration of module %s", module_name);
+  reload_func (udisks_module_manager_get_daemon (manager));
+  return TRUE;
+}
+
+/* Devices that make the modules load with modules_load_preference=lazy. Only
+ * udev properties are matched so that the modules don't have to be loaded
+ * to tell whether they are interested in a device. */
+typedef struct
+{
+  const gchar *module_name;
+  const gchar *property;
+  const gchar *pattern;  /* g_pattern_match_simple() pattern for the value */
+} ModuleLazyTrigger;
+
+static const ModuleLazyTrigger lazy_triggers[] =
+{
+  {"lvm2", "ID_FS_TYPE", "LVM2_member"},
+  {"lvm2", "DM_VG_NAME", "?*"},
+  {"bcache", "ID_FS_TYPE", "bcache"},
+  {"btrfs", "ID_FS_TYPE", "btrfs"},
+  {"vdo", "ID_FS_TYPE", "vdo"},
+  {"zram", "DEVNAME", "/dev/zram*"},
+  {"iscsi", "ID_PATH", "*-iscsi-*"},
+  {NULL, NULL, NULL}
+};
+
+/**
+ * udisks_module_manager_get_lazy_module_for_device:
+ * @manager: A #UDisksModuleManager instance.
+ * @device: A #UDisksLinuxDevice.
+ *
+ * Finds a module that is not loaded yet but is known to handle devices
+ * like @device, see the <literal>lazy</literal> value of the
+ * <literal>modules_load_preference</literal> configuration option.
+ * The module may still be unavailable or disabled in the configuration,
+ * see udisks_module_manager_load_module().
+ *
+ * Returns: The name of the module or %NULL. Do not free.
+ *
+ * Since: 2.9.0
+ */
+const gchar *
+udisks_module_manager_get_lazy_module_for_device (UDisksModuleManager *manager,
+                                                  UDisksLinuxDevice   *device)
+{
+  const ModuleLazyTrigger *trigger;
+  const gchar *value;
+
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), NULL);
+  g_return_val_if_fail (UDISKS_IS_LINUX_DEVICE (device), NULL);
+
+  for (trigger = lazy_triggers; trigger->module_name != NULL; trigger++)
+    {
+      value = g_udev_device_get_property (device->udev_device, trigger->property);
+      if (value == NULL || ! g_pattern_match_simple (trigger->pattern, value))
+        continue;
+      if (! udisks_module_manager_get_module_loaded (manager, trigger->module_name))
+        return trigger->module_name;
+    }
 
-  /* Ensured to fire only once */
-  g_object_notify (G_OBJECT (manager), "modules-ready");
+  return NULL;
 }
 
 /**
@@ -513,6 +794,8 @@ udisks_module_manager_unload_modules (UDisksModuleManager *manager)
     }
 
   manager->modules_ready = FALSE;
+  g_hash_table_remove_all (manager->loaded_modules);
+  g_hash_table_remove_all (manager->reload_configuration_funcs);
 
   /* Free all the lists containing modules' API lists. */
   udisks_module_manager_free_modules (manager);
@@ -775,6 +1058,73 @@ udisks_module_manager_get_module_object_new_funcs (UDisksModuleManager *manager)
   return manager->module_object_new_funcs;
 }
 
+/**
+ * udisks_module_manager_get_block_object_iface_match:
+ * @manager: A #UDisksModuleManager instance.
+ * @skeleton_type: The #GType of a block object interface provided by a module.
+ *
+ * Gets the predicate keys the module declared for the block object interface
+ * of @skeleton_type. See #UDisksModuleInterfaceMatch for details.
+ *
+ * Returns: (transfer none) (nullable): A #UDisksModuleInterfaceMatch that belongs
+ *          to the manager and must not be freed or %NULL if the interface does not
+ *          declare any keys.
+ */
+UDisksModuleInterfaceMatch *
+udisks_module_manager_get_block_object_iface_match (UDisksModuleManager *manager,
+                                                    GType                skeleton_type)
+{
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), NULL);
+  if (! manager->modules_ready)
+    return NULL;
+  return g_hash_table_lookup (manager->block_object_interface_matches, GSIZE_TO_POINTER (skeleton_type));
+}
+
+/**
+ * udisks_module_manager_get_module_object_new_func_match:
+ * @manager: A #UDisksModuleManager instance.
+ * @new_func: A #UDisksModuleObjectNewFunc function pointer.
+ *
+ * Gets the match criteria the module declared for @new_func. See
+ * #UDisksModuleObjectNewFuncMatch for details.
+ *
+ * Returns: (transfer none) (nullable): A #UDisksModuleObjectNewFuncMatch that belongs
+ *          to the manager and must not be freed or %NULL if @new_func does not declare
+ *          any criteria.
+ */
+UDisksModuleObjectNewFuncMatch *
+udisks_module_manager_get_module_object_new_func_match (UDisksModuleManager       *manager,
+                                                        UDisksModuleObjectNewFunc  new_func)
+{
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), NULL);
+  if (! manager->modules_ready)
+    return NULL;
+  return g_hash_table_lookup (manager->module_object_new_func_matches, new_func);
+}
+
+/**
+ * udisks_module_manager_get_module_object_housekeeping_info:
+ * @manager: A #UDisksModuleManager instance.
+ * @new_func: A #UDisksModuleObjectNewFunc function pointer.
+ *
+ * Gets the housekeeping interval and cost the module declared for the
+ * instances created by @new_func. See #UDisksModuleObjectHousekeepingInfo
+ * for details.
+ *
+ * Returns: (transfer none) (nullable): A #UDisksModuleObjectHousekeepingInfo that
+ *          belongs to the manager and must not be freed or %NULL if @new_func does
+ *          not declare any.
+ */
+UDisksModuleObjectHousekeepingInfo *
+udisks_module_manager_get_module_object_housekeeping_info (UDisksModuleManager       *manager,
+                                                           UDisksModuleObjectNewFunc  new_func)
+{
+  g_return_val_if_fail (UDISKS_IS_MODULE_MANAGER (manager), NULL);
+  if (! manager->modules_ready)
+    return NULL;
+  return g_hash_table_lookup (manager->module_object_housekeeping_infos, new_func);
+}
+
 /**
  * udisks_module_manager_get_new_manager_iface_funcs:
  * @manager: A #UDisksModuleManager instance.
@@ -22,6 +22,7 @@
 #define __UDISKS_MODULE_MANAGER_H__
 
 #include "udisksdaemontypes.h"
+#include <modules/udisksmoduleifacetypes.h>
 
 G_BEGIN_DECLS
 
@@ -37,11 +38,25 @@ UDisksDaemon           *udisks_module_manager_get_daemon            (UDisksModul
 gboolean                udisks_module_manager_get_modules_available (UDisksModuleManager *manager);
 gboolean                udisks_module_manager_get_uninstalled       (UDisksModuleManager *manager);
 void                    udisks_module_manager_load_modules          (UDisksModuleManager *manager);
+gboolean                udisks_module_manager_load_module           (UDisksModuleManager *manager,
+                                                                     const gchar         *module_name);
+gboolean                udisks_module_manager_get_module_loaded     (UDisksModuleManager *manager,
+                                                                     const gchar         *module_name);
+gboolean                udisks_module_manager_reload_module_configuration (UDisksModuleManager *manager,
+                                                                           const gchar         *module_name);
+const gchar            *udisks_module_manager_get_lazy_module_for_device (UDisksModuleManager *manager,
+                                                                          UDisksLinuxDevice   *device);
 void                    udisks_module_manager_unload_modules        (UDisksModuleManager *manager);
 
 GList                  *udisks_module_manager_get_block_object_iface_infos (UDisksModuleManager  *manager);
 GList                  *udisks_module_manager_get_drive_object_iface_infos (UDisksModuleManager  *manager);
+UDisksModuleInterfaceMatch *udisks_module_manager_get_block_object_iface_match (UDisksModuleManager *manager,
+                                                                                GType                skeleton_type);
 GList                  *udisks_module_manager_get_module_object_new_funcs  (UDisksModuleManager  *manager);
+UDisksModuleObjectNewFuncMatch *udisks_module_manager_get_module_object_new_func_match (UDisksModuleManager       *manager,
+                                                                                        UDisksModuleObjectNewFunc  new_func);
+UDisksModuleObjectHousekeepingInfo *udisks_module_manager_get_module_object_housekeeping_info (UDisksModuleManager       *manager,
+                                                                                               UDisksModuleObjectNewFunc  new_func);
 GList                  *udisks_module_manager_get_new_manager_iface_funcs  (UDisksModuleManager  *manager);
 GList                  *udisks_module_manager_get_track_parent_funcs       (UDisksModuleManager  *manager);
 
@@ -75,8 +75,52 @@ struct _UDisksMountMonitor
   gboolean have_data;
   GList *mounts;
   GMutex mounts_mutex;
+
+  /* indexes of the mounts list, rebuilt along with it and protected by
+   * mounts_mutex: dev_t (gint64) -> GList of UDisksMount (most recent
+   * first) and mount path -> topmost UDisksMount of type
+   * UDISKS_MOUNT_TYPE_FILESYSTEM - neither holds references */
+  GHashTable *mounts_by_dev;
+  GHashTable *mounts_by_path;
+
+  /* mountinfo mount ID -> UDisksMount of type UDISKS_MOUNT_TYPE_FILESYSTEM,
+   * used to reuse unchanged mounts on reload - protected by mounts_mutex and
+   * doesn't hold references */
+  GHashTable *mounts_by_id;
+
+  /* dev_t (gint64) -> GList of DevWatch, see udisks_mount_monitor_add_dev_watch() -
+   * the table and the watch being called are protected by dev_watches_mutex,
+   * dev_watches_cond is signalled whenever a watch returns */
+  GHashTable *dev_watches;
+  GMutex dev_watches_mutex;
+  GCond dev_watches_cond;
+  struct DevWatch *running_dev_watch;
+  GThread *running_dev_watch_thread;
 };
 
+typedef struct DevWatch
+{
+  UDisksMountMonitorDevFunc func;
+  gpointer user_data;
+  /* the table and dispatch_dev_watches() hold references */
+  gint ref_count;
+  gboolean removed;
+} DevWatch;
+
+/* called with dev_watches_mutex held */
+static void
+dev_watch_unref (DevWatch *watch)
+{
+  if (--watch->ref_count == 0)
+    g_free (watch);
+}
+
+static void
+dev_watch_list_free (GList *watches)
+{
+  g_list_free_full (watches, (GDestroyNotify) dev_watch_unref);
+}
+
 typedef struct _UDisksMountMonitorClass UDisksMountMonitorClass;
 
 struct _UDisksMountMonitorClass
@@ -103,7 +147,6 @@ static guint signals[LAST_SIGNAL] = { 0 };
 G_DEFINE_TYPE (UDisksMountMonitor, udisks_mount_monitor, G_TYPE_OBJECT)
 
 static void udisks_mount_monitor_ensure (UDisksMountMonitor *monitor);
-static void udisks_mount_monitor_invalidate (UDisksMountMonitor *monitor);
 static void udisks_mount_monitor_constructed (GObject *object);
 
 static void
@@ -121,6 +164,12 @@ udisks_mount_monitor_finalize (GObject *object)
   if (monitor->swaps_watch_source != NULL)
     g_source_destroy (monitor->swaps_watch_source);
 
+  g_hash_table_unref (monitor->mounts_by_id);
+  g_hash_table_unref (monitor->dev_watches);
+  g_mutex_clear (&monitor->dev_watches_mutex);
+  g_cond_clear (&monitor->dev_watches_cond);
+  g_hash_table_unref (monitor->mounts_by_path);
+  g_hash_table_unref (monitor->mounts_by_dev);
   g_list_free_full (monitor->mounts, g_object_unref);
 
   g_mutex_clear (&monitor->mounts_mutex);
@@ -133,6 +182,14 @@ static void
 udisks_mount_monitor_init (UDisksMountMonitor *monitor)
 {
   monitor->mounts = NULL;
+  monitor->mounts_by_dev = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                                  g_free, (GDestroyNotify) g_list_free);
+  monitor->mounts_by_path = g_hash_table_new (g_str_hash, g_str_equal);
+  monitor->mounts_by_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+  monitor->dev_watches = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                                g_free, (GDestroyNotify) dev_watch_list_free);
+  g_mutex_init (&monitor->dev_watches_mutex);
+  g_cond_init (&monitor->dev_watches_cond);
   g_mutex_init (&monitor->mounts_mutex);
 }
 
@@ -189,91 +246,141 @@ udisks_mount_monitor_class_init (UDisksMountMonitorClass *klass)
                                                 UDISKS_TYPE_MOUNT);
 }
 
+/* Notifies the watches registered for the device of @mount */
 static void
-diff_sorted_lists (GList *list1,
-                   GList *list2,
-                   GCompareFunc compare,
-                   GList **added,
-                   GList **removed)
+dispatch_dev_watches (UDisksMountMonitor *monitor,
+                      UDisksMount        *mount,
+                      gboolean            added)
 {
-  int order;
+  gint64 key;
+  GList *watches;
+  GList *l;
+
+  key = (gint64) udisks_mount_get_dev (mount);
 
-  *added = *removed = NULL;
+  /* call out on a copy without holding the lock, so the watches may add
+   * and remove watches - removing one from another thread waits for it to
+   * return, see udisks_mount_monitor_remove_dev_watch() */
+  g_mutex_lock (&monitor->dev_watches_mutex);
+  watches = g_list_copy (g_hash_table_lookup (monitor->dev_watches, &key));
+  for (l = watches; l != NULL; l = l->next)
+    ((DevWatch *) l->data)->ref_count++;
 
-  while (list1 != NULL && list2 != NULL)
+  for (l = watches; l != NULL; l = l->next)
     {
-      order = (*compare) (list1->data, list2->data);
-      if (order < 0)
-        {
-          *removed = g_list_prepend (*removed, list1->data);
-          list1 = list1->next;
-        }
-      else if (order > 0)
+      DevWatch *watch = l->data;
+
+      if (!watch->removed)
         {
-          *added = g_list_prepend (*added, list2->data);
-          list2 = list2->next;
-        }
-      else
-        { /* same item */
-          list1 = list1->next;
-          list2 = list2->next;
+          monitor->running_dev_watch = watch;
+          monitor->running_dev_watch_thread = g_thread_self ();
+          g_mutex_unlock (&monitor->dev_watches_mutex);
+          watch->func (monitor, mount, added, watch->user_data);
+          g_mutex_lock (&monitor->dev_watches_mutex);
+          monitor->running_dev_watch = NULL;
+          monitor->running_dev_watch_thread = NULL;
+          g_cond_broadcast (&monitor->dev_watches_cond);
         }
+      dev_watch_unref (watch);
     }
-
-  while (list1 != NULL)
-    {
-      *removed = g_list_prepend (*removed, list1->data);
-      list1 = list1->next;
-    }
-  while (list2 != NULL)
-    {
-      *added = g_list_prepend (*added, list2->data);
-      list2 = list2->next;
-    }
+  g_mutex_unlock (&monitor->dev_watches_mutex);
+  g_list_free (watches);
 }
 
+static gboolean udisks_mount_monitor_get_mountinfo (UDisksMountMonitor  *monitor,
+                                                    GHashTable          *reusable,
+                                                    GList              **added,
+                                                    GError             **error);
+static gboolean udisks_mount_monitor_get_swaps (UDisksMountMonitor  *monitor,
+                                                GHashTable          *reusable,
+                                                GList              **added,
+                                                GError             **error);
+
+/* Re-reads mountinfo and swaps, reusing the UDisksMount objects of mounts
+ * that haven't changed (same mount ID and mount path for filesystems, same
+ * device for swaps) and allocating only for new ones.
+ */
 static void
 reload_mounts (UDisksMountMonitor *monitor)
 {
   GList *old_mounts;
-  GList *cur_mounts;
-  GList *added;
-  GList *removed;
+  GHashTable *reusable_mounts;
+  GHashTable *reusable_swaps;
+  GList *added = NULL;
+  GList *removed = NULL;
+  GHashTableIter iter;
+  UDisksMount *mount;
   GList *l;
+  GError *error = NULL;
 
   udisks_mount_monitor_ensure (monitor);
 
   g_mutex_lock (&monitor->mounts_mutex);
-  old_mounts = g_list_copy_deep (monitor->mounts, (GCopyFunc) udisks_g_object_ref_copy, NULL);
-  g_mutex_unlock (&monitor->mounts_mutex);
 
-  udisks_mount_monitor_invalidate (monitor);
-  udisks_mount_monitor_ensure (monitor);
+  /* steal the current state, the parsers below take out what's reused */
+  old_mounts = monitor->mounts;
+  monitor->mounts = NULL;
+  reusable_mounts = monitor->mounts_by_id;
+  monitor->mounts_by_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+  g_hash_table_remove_all (monitor->mounts_by_path);
+  g_hash_table_remove_all (monitor->mounts_by_dev);
+
+  reusable_swaps = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+  for (l = old_mounts; l != NULL; l = l->next)
+    {
+      mount = UDISKS_MOUNT (l->data);
+      if (udisks_mount_get_mount_type (mount) == UDISKS_MOUNT_TYPE_SWAP)
+        {
+          gint64 *key = g_new (gint64, 1);
+          *key = (gint64) udisks_mount_get_dev (mount);
+          g_hash_table_insert (reusable_swaps, key, mount);
+        }
+    }
+
+  if (!udisks_mount_monitor_get_mountinfo (monitor, reusable_mounts, &added, &error))
+    {
+      udisks_warning ("Error getting mounts: %s (%s, %d)",
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+
+  if (!udisks_mount_monitor_get_swaps (monitor, reusable_swaps, &added, &error))
+    {
+      udisks_warning ("Error getting swaps: %s (%s, %d)",
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+
+  /* whatever is left hasn't been reused */
+  g_hash_table_iter_init (&iter, reusable_mounts);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mount))
+    removed = g_list_prepend (removed, g_object_ref (mount));
+  g_hash_table_iter_init (&iter, reusable_swaps);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &mount))
+    removed = g_list_prepend (removed, g_object_ref (mount));
+
+  g_list_foreach (added, (GFunc) g_object_ref, NULL);
 
-  g_mutex_lock (&monitor->mounts_mutex);
-  cur_mounts = g_list_copy_deep (monitor->mounts, (GCopyFunc) udisks_g_object_ref_copy, NULL);
   g_mutex_unlock (&monitor->mounts_mutex);
 
-  old_mounts = g_list_sort (old_mounts, (GCompareFunc) udisks_mount_compare);
-  cur_mounts = g_list_sort (cur_mounts, (GCompareFunc) udisks_mount_compare);
-  diff_sorted_lists (old_mounts, cur_mounts, (GCompareFunc) udisks_mount_compare, &added, &removed);
+  g_hash_table_unref (reusable_swaps);
+  g_hash_table_unref (reusable_mounts);
+  g_list_free_full (old_mounts, g_object_unref);
 
   for (l = removed; l != NULL; l = l->next)
     {
-      UDisksMount *mount = UDISKS_MOUNT (l->data);
-      g_signal_emit (monitor, signals[MOUNT_REMOVED_SIGNAL], 0, mount);
+      dispatch_dev_watches (monitor, UDISKS_MOUNT (l->data), FALSE);
+      g_signal_emit (monitor, signals[MOUNT_REMOVED_SIGNAL], 0, UDISKS_MOUNT (l->data));
     }
 
   for (l = added; l != NULL; l = l->next)
     {
-      UDisksMount *mount = UDISKS_MOUNT (l->data);
-      g_signal_emit (monitor, signals[MOUNT_ADDED_SIGNAL], 0, mount);
+      dispatch_dev_watches (monitor, UDISKS_MOUNT (l->data), TRUE);
+      g_signal_emit (monitor, signals[MOUNT_ADDED_SIGNAL], 0, UDISKS_MOUNT (l->data));
     }
 
-  g_list_free_full (old_mounts, g_object_unref);
-  g_list_free_full (cur_mounts, g_object_unref);
-  g_list_free (removed);
-  g_list_free (added);
+  g_list_free_full (removed, g_object_unref);
+  g_list_free_full (added, g_object_unref);
 }
 
 static gboolean
@@ -385,19 +492,17 @@ udisks_mount_monitor_new (void)
   return UDISKS_MOUNT_MONITOR (g_object_new (UDISKS_TYPE_MOUNT_MONITOR, NULL));
 }
 
-static void
-udisks_mount_monitor_invalidate (UDisksMountMonitor *monitor)
+/* called with mounts_mutex held */
+static GList *
+lookup_mounts_for_dev (UDisksMountMonitor *monitor,
+                       dev_t               dev)
 {
-  g_mutex_lock (&monitor->mounts_mutex);
-
-  monitor->have_data = FALSE;
-
-  g_list_free_full (monitor->mounts, g_object_unref);
-  monitor->mounts = NULL;
+  gint64 key = (gint64) dev;
 
-  g_mutex_unlock (&monitor->mounts_mutex);
+  return g_hash_table_lookup (monitor->mounts_by_dev, &key);
 }
 
+/* called with mounts_mutex held */
 static gboolean
 have_mount (UDisksMountMonitor *monitor,
             dev_t               dev,
@@ -408,11 +513,10 @@ have_mount (UDisksMountMonitor *monitor,
 
   ret = FALSE;
 
-  for (l = monitor->mounts; l != NULL; l = l->next)
+  for (l = lookup_mounts_for_dev (monitor, dev); l != NULL; l = l->next)
     {
       UDisksMount *mount = UDISKS_MOUNT (l->data);
-      if (udisks_mount_get_dev (mount) == dev &&
-          g_strcmp0 (udisks_mount_get_mount_path (mount), mount_point) == 0)
+      if (g_strcmp0 (udisks_mount_get_mount_path (mount), mount_point) == 0)
         {
           ret = TRUE;
           break;
@@ -422,10 +526,39 @@ have_mount (UDisksMountMonitor *monitor,
   return ret;
 }
 
+/* called with mounts_mutex held, takes ownership of @mount */
+static void
+add_mount (UDisksMountMonitor *monitor,
+           UDisksMount        *mount)
+{
+  GList *dev_mounts;
+  gint64 *key;
+
+  monitor->mounts = g_list_prepend (monitor->mounts, mount);
+
+  key = g_new (gint64, 1);
+  *key = (gint64) udisks_mount_get_dev (mount);
+  dev_mounts = g_hash_table_lookup (monitor->mounts_by_dev, key);
+  if (dev_mounts != NULL)
+    g_hash_table_steal (monitor->mounts_by_dev, key);
+  g_hash_table_insert (monitor->mounts_by_dev, key, g_list_prepend (dev_mounts, mount));
+
+  /* later lines in mountinfo are mounted on top of earlier ones */
+  if (udisks_mount_get_mount_type (mount) == UDISKS_MOUNT_TYPE_FILESYSTEM)
+    g_hash_table_replace (monitor->mounts_by_path,
+                          (gpointer) udisks_mount_get_mount_path (mount),
+                          mount);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* called with mounts_mutex held - mounts found in @reusable (if not %NULL)
+ * are taken out of it and reused, newly created mounts are prepended to
+ * @added (if not %NULL) */
 static gboolean
 udisks_mount_monitor_get_mountinfo (UDisksMountMonitor  *monitor,
+                                    GHashTable          *reusable,
+                                    GList              **added,
                                     GError             **error)
 {
   gboolean ret;
@@ -476,6 +609,29 @@ udisks_mount_monitor_get_mountinfo (UDisksMountMonitor  *monitor,
       encoded_root[sizeof encoded_root - 1] = '\0';
       encoded_mount_point[sizeof encoded_mount_point - 1] = '\0';
 
+      mount_point = g_strcompress (encoded_mount_point);
+
+      /* The mount ID stays the same for the lifetime of a mount, reuse the
+       * existing object unless the ID has been recycled for another mount */
+      if (reusable != NULL)
+        {
+          UDisksMount *old_mount;
+
+          old_mount = g_hash_table_lookup (reusable, GUINT_TO_POINTER (mount_id));
+          if (old_mount != NULL &&
+              g_strcmp0 (udisks_mount_get_mount_path (old_mount), mount_point) == 0 &&
+              (major == 0 || udisks_mount_get_dev (old_mount) == makedev (major, minor)))
+            {
+              g_hash_table_steal (reusable, GUINT_TO_POINTER (mount_id));
+              if (!have_mount (monitor, udisks_mount_get_dev (old_mount), mount_point))
+                {
+                  add_mount (monitor, g_object_ref (old_mount));
+                  g_hash_table_insert (monitor->mounts_by_id, GUINT_TO_POINTER (mount_id), old_mount);
+                }
+              goto next;
+            }
+        }
+
       /* Temporary work-around for btrfs, see
        *
        *  https://bugzilla.redhat.com/show_bug.cgi?id=495152#c31
@@ -496,34 +652,34 @@ udisks_mount_monitor_get_mountinfo (UDisksMountMonitor  *monitor,
               if (sscanf (sep + 3, PATH_MAX_FMT " " PATH_MAX_FMT, fstype, mount_source) != 2)
                 {
                   udisks_warning ("Error parsing things past - for '%s'", lines[n]);
-                  continue;
+                  goto next;
                 }
               fstype[sizeof fstype - 1] = '\0';
               mount_source[sizeof mount_source - 1] = '\0';
 
               if (g_strcmp0 (fstype, "btrfs") != 0)
-                continue;
+                goto next;
 
               if (!g_str_has_prefix (mount_source, "/dev/"))
-                continue;
+                goto next;
 
               if (stat (mount_source, &statbuf) != 0)
                 {
                   udisks_warning ("Error statting %s: %m", mount_source);
-                  continue;
+                  goto next;
                 }
 
               if (!S_ISBLK (statbuf.st_mode))
                 {
                   udisks_warning ("%s is not a block device", mount_source);
-                  continue;
+                  goto next;
                 }
 
               dev = statbuf.st_rdev;
             }
           else
             {
-              continue;
+              goto next;
             }
         }
       else
@@ -531,16 +687,17 @@ udisks_mount_monitor_get_mountinfo (UDisksMountMonitor  *monitor,
           dev = makedev (major, minor);
         }
 
-      mount_point = g_strcompress (encoded_mount_point);
-
-      /* TODO: we can probably use a hash table or something if this turns out to be slow */
       if (!have_mount (monitor, dev, mount_point))
         {
           UDisksMount *mount;
           mount = _udisks_mount_new (dev, mount_point, UDISKS_MOUNT_TYPE_FILESYSTEM);
-          monitor->mounts = g_list_prepend (monitor->mounts, mount);
+          add_mount (monitor, mount);
+          g_hash_table_insert (monitor->mounts_by_id, GUINT_TO_POINTER (mount_id), mount);
+          if (added != NULL)
+            *added = g_list_prepend (*added, mount);
         }
 
+    next:
       g_free (mount_point);
     }
 
@@ -555,8 +712,13 @@ udisks_mount_monitor_get_mountinfo (UDisksMountMonitor  *monitor,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* called with mounts_mutex held - swaps found in @reusable (if not %NULL)
+ * are taken out of it and reused, newly created mounts are prepended to
+ * @added (if not %NULL) */
 static gboolean
 udisks_mount_monitor_get_swaps (UDisksMountMonitor  *monitor,
+                                GHashTable          *reusable,
+                                GList              **added,
                                 GError             **error)
 {
   gboolean ret;
@@ -615,9 +777,22 @@ udisks_mount_monitor_get_swaps (UDisksMountMonitor  *monitor,
 
       if (!have_mount (monitor, dev, NULL))
         {
+          gint64 key = (gint64) dev;
           UDisksMount *mount;
-          mount = _udisks_mount_new (dev, NULL, UDISKS_MOUNT_TYPE_SWAP);
-          monitor->mounts = g_list_prepend (monitor->mounts, mount);
+
+          mount = reusable != NULL ? g_hash_table_lookup (reusable, &key) : NULL;
+          if (mount != NULL)
+            {
+              g_hash_table_remove (reusable, &key);
+              add_mount (monitor, g_object_ref (mount));
+            }
+          else
+            {
+              mount = _udisks_mount_new (dev, NULL, UDISKS_MOUNT_TYPE_SWAP);
+              add_mount (monitor, mount);
+              if (added != NULL)
+                *added = g_list_prepend (*added, mount);
+            }
         }
     }
 
@@ -643,7 +818,7 @@ udisks_mount_monitor_ensure (UDisksMountMonitor *monitor)
   g_mutex_lock (&monitor->mounts_mutex);
 
   error = NULL;
-  if (!udisks_mount_monitor_get_mountinfo (monitor, &error))
+  if (!udisks_mount_monitor_get_mountinfo (monitor, NULL, NULL, &error))
     {
       udisks_warning ("Error getting mounts: %s (%s, %d)",
                       error->message, g_quark_to_string (error->domain), error->code);
@@ -651,7 +826,7 @@ udisks_mount_monitor_ensure (UDisksMountMonitor *monitor)
     }
 
   error = NULL;
-  if (!udisks_mount_monitor_get_swaps (monitor, &error))
+  if (!udisks_mount_monitor_get_swaps (monitor, NULL, NULL, &error))
     {
       udisks_warning ("Error getting swaps: %s (%s, %d)",
                       error->message, g_quark_to_string (error->domain), error->code);
@@ -689,15 +864,8 @@ udisks_mount_monitor_get_mounts_for_dev (UDisksMountMonitor *monitor,
 
   g_mutex_lock (&monitor->mounts_mutex);
 
-  for (l = monitor->mounts; l != NULL; l = l->next)
-    {
-      UDisksMount *mount = UDISKS_MOUNT (l->data);
-
-      if (udisks_mount_get_dev (mount) == dev)
-        {
-          ret = g_list_prepend (ret, g_object_ref (mount));
-        }
-    }
+  for (l = lookup_mounts_for_dev (monitor, dev); l != NULL; l = l->next)
+    ret = g_list_prepend (ret, g_object_ref (UDISKS_MOUNT (l->data)));
 
   g_mutex_unlock (&monitor->mounts_mutex);
 
@@ -730,20 +898,14 @@ udisks_mount_monitor_is_dev_in_use (UDisksMountMonitor  *monitor,
 
   g_mutex_lock (&monitor->mounts_mutex);
 
-  for (l = monitor->mounts; l != NULL; l = l->next)
+  l = lookup_mounts_for_dev (monitor, dev);
+  if (l != NULL)
     {
-      UDisksMount *mount = UDISKS_MOUNT (l->data);
-
-      if (udisks_mount_get_dev (mount) == dev)
-        {
-          if (out_type != NULL)
-            *out_type = udisks_mount_get_mount_type (mount);
-          ret = TRUE;
-          goto out;
-        }
+      if (out_type != NULL)
+        *out_type = udisks_mount_get_mount_type (UDISKS_MOUNT (l->data));
+      ret = TRUE;
     }
 
- out:
   g_mutex_unlock (&monitor->mounts_mutex);
   return ret;
 }
@@ -763,7 +925,7 @@ UDisksMount *
 udisks_mount_monitor_get_mount_for_path (UDisksMountMonitor  *monitor,
                                          const gchar         *mount_path)
 {
-  GList *l;
+  UDisksMount *mount;
 
   g_return_val_if_fail (UDISKS_IS_MOUNT_MONITOR (monitor), NULL);
   g_return_val_if_fail (mount_path != NULL, NULL);
@@ -772,19 +934,117 @@ udisks_mount_monitor_get_mount_for_path (UDisksMountMonitor  *monitor,
 
   g_mutex_lock (&monitor->mounts_mutex);
 
-  for (l = monitor->mounts; l != NULL; l = l->next)
-    {
-      UDisksMount *mount = UDISKS_MOUNT (l->data);
+  mount = g_hash_table_lookup (monitor->mounts_by_path, mount_path);
+  if (mount != NULL)
+    g_object_ref (mount);
 
-      if (udisks_mount_get_mount_type (mount) == UDISKS_MOUNT_TYPE_FILESYSTEM &&
-          g_strcmp0 (udisks_mount_get_mount_path (mount), mount_path) == 0)
-        {
-          g_object_ref (mount);
-          g_mutex_unlock (&monitor->mounts_mutex);
-          return mount;
-        }
+  g_mutex_unlock (&monitor->mounts_mutex);
+  return mount;
+}
+
+/**
+ * udisks_mount_monitor_add_dev_watch:
+ * @monitor: A #UDisksMountMonitor.
+ * @dev: A #dev_t device number.
+ * @func: Function to call when a mount for @dev is added or removed.
+ * @user_data: User data to pass to @func.
+ *
+ * Registers @func to be called for mount changes of @dev only. Unlike the
+ * #UDisksMountMonitor::mount-added and #UDisksMountMonitor::mount-removed
+ * signals, watches for other devices are not invoked at all.
+ *
+ * @func is called in the same thread as the signals, right before they are
+ * emitted, without any lock of @monitor held, so it may add and remove
+ * watches. The watches of a device are called in the order they were
+ * added, a watch added while they are being called is only called for
+ * later changes. Use udisks_mount_monitor_remove_dev_watch() to remove the
+ * watch.
+ */
+void
+udisks_mount_monitor_add_dev_watch (UDisksMountMonitor        *monitor,
+                                    dev_t                      dev,
+                                    UDisksMountMonitorDevFunc  func,
+                                    gpointer                   user_data)
+{
+  DevWatch *watch;
+  GList *watches;
+  gint64 *key;
+
+  g_return_if_fail (UDISKS_IS_MOUNT_MONITOR (monitor));
+  g_return_if_fail (func != NULL);
+
+  watch = g_new0 (DevWatch, 1);
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->ref_count = 1;
+
+  key = g_new (gint64, 1);
+  *key = (gint64) dev;
+
+  g_mutex_lock (&monitor->dev_watches_mutex);
+  watches = g_hash_table_lookup (monitor->dev_watches, key);
+  if (watches != NULL)
+    g_hash_table_steal (monitor->dev_watches, key);
+  g_hash_table_insert (monitor->dev_watches, key, g_list_append (watches, watch));
+  g_mutex_unlock (&monitor->dev_watches_mutex);
+}
+
+/**
+ * udisks_mount_monitor_remove_dev_watch:
+ * @monitor: A #UDisksMountMonitor.
+ * @dev: The #dev_t device number passed to udisks_mount_monitor_add_dev_watch().
+ * @func: The function passed to udisks_mount_monitor_add_dev_watch().
+ * @user_data: The user data passed to udisks_mount_monitor_add_dev_watch().
+ *
+ * Removes a watch added with udisks_mount_monitor_add_dev_watch(). Once this
+ * returns, @func is guaranteed not to be called again for it and, unless
+ * this is called from @func itself, not to be running.
+ */
+void
+udisks_mount_monitor_remove_dev_watch (UDisksMountMonitor        *monitor,
+                                       dev_t                      dev,
+                                       UDisksMountMonitorDevFunc  func,
+                                       gpointer                   user_data)
+{
+  GList *watches;
+  GList *l;
+  gint64 key = (gint64) dev;
+  gint64 *orig_key;
+  DevWatch *watch = NULL;
+
+  g_return_if_fail (UDISKS_IS_MOUNT_MONITOR (monitor));
+
+  g_mutex_lock (&monitor->dev_watches_mutex);
+  if (!g_hash_table_lookup_extended (monitor->dev_watches, &key, (gpointer *) &orig_key, (gpointer *) &watches))
+    goto out;
+
+  for (l = watches; l != NULL; l = l->next)
+    {
+      watch = l->data;
+      if (watch->func == func && watch->user_data == user_data)
+        break;
+    }
+  if (l == NULL)
+    {
+      udisks_warning ("No watch for device %u:%u with the given function and user data",
+                      major (dev), minor (dev));
+      goto out;
     }
 
-  g_mutex_unlock (&monitor->mounts_mutex);
-  return NULL;
+  watch->removed = TRUE;
+  g_hash_table_steal (monitor->dev_watches, &key);
+  watches = g_list_delete_link (watches, l);
+  if (watches != NULL)
+    g_hash_table_insert (monitor->dev_watches, orig_key, watches);
+  else
+    g_free (orig_key);
+
+  /* wait for the watch to return unless we're being called from it */
+  while (monitor->running_dev_watch == watch &&
+         monitor->running_dev_watch_thread != g_thread_self ())
+    g_cond_wait (&monitor->dev_watches_cond, &monitor->dev_watches_mutex);
+  dev_watch_unref (watch);
+
+ out:
+  g_mutex_unlock (&monitor->dev_watches_mutex);
 }
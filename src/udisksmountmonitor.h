@@ -38,6 +38,14 @@ gboolean             udisks_mount_monitor_is_dev_in_use      (UDisksMountMonitor
                                                               UDisksMountType     *out_type);
 UDisksMount         *udisks_mount_monitor_get_mount_for_path (UDisksMountMonitor  *monitor,
                                                               const gchar         *mount_path);
+void                 udisks_mount_monitor_add_dev_watch      (UDisksMountMonitor        *monitor,
+                                                              dev_t                      dev,
+                                                              UDisksMountMonitorDevFunc  func,
+                                                              gpointer                   user_data);
+void                 udisks_mount_monitor_remove_dev_watch   (UDisksMountMonitor        *monitor,
+                                                              dev_t                      dev,
+                                                              UDisksMountMonitorDevFunc  func,
+                                                              gpointer                   user_data);
 
 G_END_DECLS
 
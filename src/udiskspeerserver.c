@@ -0,0 +1,330 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksidlemonitor.h"
+#include "udiskspeerserver.h"
+
+/**
+ * SECTION:udiskspeerserver
+ * @title: UDisksPeerServer
+ * @short_description: Peer-to-peer connections on a private socket
+ *
+ * Every method call, reply and signal normally passes through the
+ * system message bus daemon, which for local clients making many calls
+ * (e.g. storage management agents polling the drive statistics) adds a
+ * noticeable amount of latency and CPU time.
+ *
+ * With the <link linkend="udisks2.conf.5"><option>private_socket</option></link>
+ * option enabled, the daemon additionally listens for peer-to-peer D-Bus
+ * connections on the <literal>unix:path=/run/udisks2/udisks2.socket</literal>
+ * address (see %UDISKS_PEER_SERVER_ADDRESS). Every connection gets a
+ * #GDBusObjectManagerServer of its own, exporting the very same objects
+ * as the daemon's object manager on the system bus, so the API is the
+ * same except that there is no bus daemon to track names, i.e. the
+ * methods subscribing the caller to signals are not supported.
+ *
+ * Only the <literal>EXTERNAL</literal> authentication mechanism is
+ * accepted and only processes running as root (as reported by the
+ * kernel for the socket, see <literal>SO_PEERCRED</literal>) may
+ * connect. The method calls are still authorized the same way as the
+ * calls received from the bus, with the credentials of the peer.
+ *
+ * The bus daemon does not see these connections, so they are
+ * registered with the #UDisksIdleMonitor, if any, for as long as they
+ * are open.
+ */
+
+#define OBJECT_MANAGER_PATH "/org/freedesktop/UDisks2"
+
+struct _UDisksPeerServer
+{
+  /* we don't take a reference to the daemon */
+  UDisksDaemon *daemon;
+  /* owned by the caller, may be NULL */
+  UDisksIdleMonitor *idle_monitor;
+
+  GDBusServer *server;
+  GDBusAuthObserver *observer;
+  gchar *socket_path;
+
+  /* GDBusConnection -> Peer */
+  GHashTable *peers;
+};
+
+typedef struct
+{
+  UDisksPeerServer *server;
+  GDBusConnection *connection;
+  GDBusObjectManagerServer *object_manager;
+  gulong object_added_handler_id;
+  gulong object_removed_handler_id;
+  gulong closed_handler_id;
+} Peer;
+
+static void
+peer_free (Peer *peer)
+{
+  GDBusObjectManager *daemon_manager;
+
+  daemon_manager = G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (peer->server->daemon));
+  g_signal_handler_disconnect (daemon_manager, peer->object_added_handler_id);
+  g_signal_handler_disconnect (daemon_manager, peer->object_removed_handler_id);
+  g_signal_handler_disconnect (peer->connection, peer->closed_handler_id);
+  if (peer->server->idle_monitor != NULL)
+    udisks_idle_monitor_remove_peer (peer->server->idle_monitor, peer->connection);
+
+  /* unexports all the interfaces from the peer connection only */
+  g_dbus_object_manager_server_set_connection (peer->object_manager, NULL);
+  g_object_unref (peer->object_manager);
+  g_object_unref (peer->connection);
+  g_free (peer);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_object_added (GDBusObjectManager *manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
+{
+  Peer *peer = user_data;
+
+  g_dbus_object_manager_server_export (peer->object_manager, G_DBUS_OBJECT_SKELETON (object));
+}
+
+static void
+on_object_removed (GDBusObjectManager *manager,
+                   GDBusObject        *object,
+                   gpointer            user_data)
+{
+  Peer *peer = user_data;
+
+  g_dbus_object_manager_server_unexport (peer->object_manager, g_dbus_object_get_object_path (object));
+}
+
+static void
+on_connection_closed (GDBusConnection *connection,
+                      gboolean         remote_peer_vanished,
+                      GError          *error,
+                      gpointer         user_data)
+{
+  Peer *peer = user_data;
+
+  udisks_debug ("Peer-to-peer connection %p closed", (gpointer) connection);
+  /* frees the peer */
+  g_hash_table_remove (peer->server->peers, connection);
+}
+
+static gboolean
+on_new_connection (GDBusServer     *dbus_server,
+                   GDBusConnection *connection,
+                   gpointer         user_data)
+{
+  UDisksPeerServer *server = user_data;
+  GDBusObjectManager *daemon_manager;
+  GList *objects, *l;
+  Peer *peer;
+
+  daemon_manager = G_DBUS_OBJECT_MANAGER (udisks_daemon_get_object_manager (server->daemon));
+
+  peer = g_new0 (Peer, 1);
+  peer->server = server;
+  peer->connection = g_object_ref (connection);
+  peer->object_manager = g_dbus_object_manager_server_new (OBJECT_MANAGER_PATH);
+
+  objects = g_dbus_object_manager_get_objects (daemon_manager);
+  for (l = objects; l != NULL; l = l->next)
+    g_dbus_object_manager_server_export (peer->object_manager, G_DBUS_OBJECT_SKELETON (l->data));
+  g_list_free_full (objects, g_object_unref);
+
+  peer->object_added_handler_id = g_signal_connect (daemon_manager, "object-added",
+                                                    G_CALLBACK (on_object_added), peer);
+  peer->object_removed_handler_id = g_signal_connect (daemon_manager, "object-removed",
+                                                      G_CALLBACK (on_object_removed), peer);
+  peer->closed_handler_id = g_signal_connect (connection, "closed",
+                                              G_CALLBACK (on_connection_closed), peer);
+
+  if (server->idle_monitor != NULL)
+    udisks_idle_monitor_add_peer (server->idle_monitor, connection);
+  g_dbus_object_manager_server_set_connection (peer->object_manager, connection);
+  g_hash_table_insert (server->peers, connection, peer);
+
+  udisks_debug ("Accepted peer-to-peer connection %p", (gpointer) connection);
+
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+on_allow_mechanism (GDBusAuthObserver *observer,
+                    const gchar       *mechanism,
+                    gpointer           user_data)
+{
+  /* only the kernel-provided credentials are trusted */
+  return g_strcmp0 (mechanism, "EXTERNAL") == 0;
+}
+
+static gboolean
+on_authorize_authenticated_peer (GDBusAuthObserver *observer,
+                                 GIOStream         *stream,
+                                 GCredentials      *credentials,
+                                 gpointer           user_data)
+{
+  GError *error = NULL;
+  uid_t uid;
+
+  if (credentials == NULL)
+    {
+      udisks_warning ("Rejecting peer-to-peer connection without credentials");
+      return FALSE;
+    }
+
+  uid = g_credentials_get_unix_user (credentials, &error);
+  if (error != NULL)
+    {
+      udisks_warning ("Rejecting peer-to-peer connection: %s (%s, %d)",
+                      error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      return FALSE;
+    }
+
+  if (uid != 0)
+    {
+      udisks_notice ("Rejecting peer-to-peer connection from uid %u", (guint) uid);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_peer_server_new:
+ * @daemon: A #UDisksDaemon.
+ * @idle_monitor: (allow-none): The #UDisksIdleMonitor of the daemon or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Starts listening for peer-to-peer connections on
+ * %UDISKS_PEER_SERVER_ADDRESS, replacing a stale socket left behind by a
+ * previous instance of the daemon. The connections are registered with
+ * @idle_monitor, which must outlive the returned server.
+ *
+ * Returns: A #UDisksPeerServer that should be freed with
+ * udisks_peer_server_free() or %NULL if @error is set.
+ */
+UDisksPeerServer *
+udisks_peer_server_new (UDisksDaemon       *daemon,
+                        UDisksIdleMonitor  *idle_monitor,
+                        GError            **error)
+{
+  UDisksPeerServer *server;
+  gchar *guid;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  server = g_new0 (UDisksPeerServer, 1);
+  server->daemon = daemon;
+  server->idle_monitor = idle_monitor;
+  server->socket_path = g_strdup (UDISKS_PEER_SERVER_ADDRESS + strlen ("unix:path="));
+  server->peers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, (GDestroyNotify) peer_free);
+
+  if (g_unlink (server->socket_path) != 0 && errno != ENOENT)
+    udisks_warning ("Error removing stale socket %s: %m", server->socket_path);
+
+  server->observer = g_dbus_auth_observer_new ();
+  g_signal_connect (server->observer, "allow-mechanism",
+                    G_CALLBACK (on_allow_mechanism), server);
+  g_signal_connect (server->observer, "authorize-authenticated-peer",
+                    G_CALLBACK (on_authorize_authenticated_peer), server);
+
+  guid = g_dbus_generate_guid ();
+  server->server = g_dbus_server_new_sync (UDISKS_PEER_SERVER_ADDRESS,
+                                           G_DBUS_SERVER_FLAGS_NONE,
+                                           guid,
+                                           server->observer,
+                                           NULL, /* GCancellable */
+                                           error);
+  g_free (guid);
+  if (server->server == NULL)
+    {
+      udisks_peer_server_free (server);
+      return NULL;
+    }
+
+  if (g_chmod (server->socket_path, 0600) != 0)
+    udisks_warning ("Error setting permissions of %s: %m", server->socket_path);
+
+  g_signal_connect (server->server, "new-connection",
+                    G_CALLBACK (on_new_connection), server);
+  g_dbus_server_start (server->server);
+
+  udisks_notice ("Listening for peer-to-peer connections on %s",
+                 g_dbus_server_get_client_address (server->server));
+
+  return server;
+}
+
+/**
+ * udisks_peer_server_free:
+ * @server: A #UDisksPeerServer.
+ *
+ * Stops listening, closes all the peer-to-peer connections and frees
+ * @server.
+ */
+void
+udisks_peer_server_free (UDisksPeerServer *server)
+{
+  GHashTableIter iter;
+  gpointer connection;
+
+  g_return_if_fail (server != NULL);
+
+  if (server->server != NULL)
+    {
+      g_dbus_server_stop (server->server);
+      g_object_unref (server->server);
+      g_unlink (server->socket_path);
+    }
+
+  g_hash_table_iter_init (&iter, server->peers);
+  while (g_hash_table_iter_next (&iter, &connection, NULL))
+    g_dbus_connection_close (G_DBUS_CONNECTION (connection), NULL, NULL, NULL);
+  g_hash_table_destroy (server->peers);
+
+  g_clear_object (&server->observer);
+  g_free (server->socket_path);
+  g_free (server);
+}
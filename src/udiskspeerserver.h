@@ -0,0 +1,37 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_PEER_SERVER_H__
+#define __UDISKS_PEER_SERVER_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+#define UDISKS_PEER_SERVER_ADDRESS "unix:path=/run/udisks2/udisks2.socket"
+
+UDisksPeerServer *udisks_peer_server_new  (UDisksDaemon      *daemon,
+                                           UDisksIdleMonitor *idle_monitor,
+                                           GError           **error);
+void              udisks_peer_server_free (UDisksPeerServer  *server);
+
+G_END_DECLS
+
+#endif /* __UDISKS_PEER_SERVER_H__ */
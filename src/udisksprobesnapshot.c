@@ -0,0 +1,468 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemonutil.h"
+#include "udiskslinuxdevice.h"
+#include "udisksprobesnapshot.h"
+
+/**
+ * SECTION:udisksprobesnapshot
+ * @title: UDisksProbeSnapshot
+ * @short_description: Probed device data kept across daemon restarts
+ *
+ * If <literal>probe_snapshot</literal> is enabled in udisks2.conf(5), the
+ * data udisksd probes from the devices itself (that is the ATA IDENTIFY
+ * data, everything else comes from the udev database) is written to
+ * <filename>/run/udisks2/probe-snapshot</filename>. When the daemon is
+ * restarted, the coldplug takes the data of the devices from the snapshot
+ * instead of sending commands to them, provided the device number, the
+ * serial number, the WWN and the revision reported by udev as well as the
+ * modification time of the device's directory in sysfs are the same as
+ * when the data was probed. The devices restored this way are probed
+ * again in the background once the coldplug is complete.
+ *
+ * Since the snapshot is kept in <filename>/run</filename> it never
+ * outlives the boot it was taken in.
+ */
+
+#define PROBE_SNAPSHOT_FILE "/run/udisks2/probe-snapshot"
+
+/* bumped whenever the format of the file changes */
+#define PROBE_SNAPSHOT_VERSION 1
+
+#define HEADER_GROUP "udisks2"
+#define VERSION_KEY "Version"
+#define IDENTITY_KEY "Identity"
+#define ATA_IDENTIFY_DEVICE_KEY "AtaIdentifyDevice"
+#define ATA_IDENTIFY_PACKET_DEVICE_KEY "AtaIdentifyPacketDevice"
+
+#define ATA_IDENTIFY_DATA_SIZE 512
+
+/* how long changes are collected before the file is written */
+#define SAVE_DELAY_SECONDS 2
+
+typedef struct
+{
+  gchar **identity;
+  guchar *ata_identify_device_data;
+  guchar *ata_identify_packet_device_data;
+} SnapshotEntry;
+
+struct _UDisksProbeSnapshot
+{
+  /* protects everything below, the snapshot is used from the probing threads */
+  GMutex lock;
+
+  /* maps from sysfs path to the SnapshotEntry read from the file */
+  GHashTable *loaded;
+  /* maps from sysfs path to the SnapshotEntry of the devices seen by this
+   * instance of the daemon - only these are written back */
+  GHashTable *current;
+
+  gboolean dirty;
+  guint save_timeout_id;
+};
+
+static void
+snapshot_entry_free (SnapshotEntry *entry)
+{
+  g_strfreev (entry->identity);
+  g_free (entry->ata_identify_device_data);
+  g_free (entry->ata_identify_packet_device_data);
+  g_free (entry);
+}
+
+static gboolean
+data_equal (const guchar *a,
+            const guchar *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+  return memcmp (a, b, ATA_IDENTIFY_DATA_SIZE) == 0;
+}
+
+/* Returns what the data of @udev_device is only valid for, or %NULL if
+ * the device can't be identified */
+static gchar **
+build_identity (GUdevDevice *udev_device)
+{
+  struct stat statbuf;
+  dev_t dev;
+  gchar **identity;
+
+  if (stat (g_udev_device_get_sysfs_path (udev_device), &statbuf) != 0)
+    return NULL;
+
+  dev = g_udev_device_get_device_number (udev_device);
+  identity = g_new0 (gchar *, 6);
+  identity[0] = g_strdup_printf ("%u:%u", major (dev), minor (dev));
+  identity[1] = g_strdup (g_udev_device_get_property (udev_device, "ID_SERIAL") ?: "");
+  identity[2] = g_strdup (g_udev_device_get_property (udev_device, "ID_WWN_WITH_EXTENSION") ?: "");
+  identity[3] = g_strdup (g_udev_device_get_property (udev_device, "ID_REVISION") ?: "");
+  identity[4] = g_strdup_printf ("%lld.%09ld", (long long) statbuf.st_mtim.tv_sec, statbuf.st_mtim.tv_nsec);
+  return identity;
+}
+
+static guchar *
+dup_data_from_key_file (GKeyFile    *key_file,
+                        const gchar *group,
+                        const gchar *key)
+{
+  gchar *encoded;
+  guchar *data;
+  gsize len = 0;
+
+  encoded = g_key_file_get_string (key_file, group, key, NULL);
+  if (encoded == NULL)
+    return NULL;
+  data = g_base64_decode (encoded, &len);
+  g_free (encoded);
+  if (len != ATA_IDENTIFY_DATA_SIZE)
+    {
+      g_free (data);
+      return NULL;
+    }
+  return data;
+}
+
+static void
+load (UDisksProbeSnapshot *snapshot)
+{
+  GKeyFile *key_file;
+  GError *error = NULL;
+  gchar **groups;
+  guint n;
+
+  key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (key_file, PROBE_SNAPSHOT_FILE, G_KEY_FILE_NONE, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        udisks_warning ("Error loading %s: %s", PROBE_SNAPSHOT_FILE, error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  if (g_key_file_get_integer (key_file, HEADER_GROUP, VERSION_KEY, NULL) != PROBE_SNAPSHOT_VERSION)
+    {
+      udisks_debug ("Ignoring %s written in a different format", PROBE_SNAPSHOT_FILE);
+      goto out;
+    }
+
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (n = 0; groups[n] != NULL; n++)
+    {
+      SnapshotEntry *entry;
+
+      if (g_strcmp0 (groups[n], HEADER_GROUP) == 0)
+        continue;
+
+      entry = g_new0 (SnapshotEntry, 1);
+      entry->identity = g_key_file_get_string_list (key_file, groups[n], IDENTITY_KEY, NULL, NULL);
+      entry->ata_identify_device_data = dup_data_from_key_file (key_file, groups[n],
+                                                                ATA_IDENTIFY_DEVICE_KEY);
+      entry->ata_identify_packet_device_data = dup_data_from_key_file (key_file, groups[n],
+                                                                       ATA_IDENTIFY_PACKET_DEVICE_KEY);
+      if (entry->identity == NULL ||
+          (entry->ata_identify_device_data == NULL && entry->ata_identify_packet_device_data == NULL))
+        {
+          snapshot_entry_free (entry);
+          continue;
+        }
+      g_hash_table_insert (snapshot->loaded, g_strdup (groups[n]), entry);
+    }
+  g_strfreev (groups);
+
+  udisks_info ("Loaded probed data of %u devices from %s",
+               g_hash_table_size (snapshot->loaded), PROBE_SNAPSHOT_FILE);
+
+ out:
+  g_key_file_free (key_file);
+}
+
+/**
+ * udisks_probe_snapshot_new:
+ *
+ * Creates a new #UDisksProbeSnapshot with the data written by the previous
+ * instance of the daemon, if any.
+ *
+ * Returns: A #UDisksProbeSnapshot. Free with udisks_probe_snapshot_free().
+ */
+UDisksProbeSnapshot *
+udisks_probe_snapshot_new (void)
+{
+  UDisksProbeSnapshot *snapshot;
+
+  snapshot = g_new0 (UDisksProbeSnapshot, 1);
+  g_mutex_init (&snapshot->lock);
+  snapshot->loaded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                            (GDestroyNotify) snapshot_entry_free);
+  snapshot->current = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify) snapshot_entry_free);
+  load (snapshot);
+
+  return snapshot;
+}
+
+/**
+ * udisks_probe_snapshot_free:
+ * @snapshot: A #UDisksProbeSnapshot.
+ *
+ * Writes any pending changes of @snapshot to disk, so the next instance of
+ * the daemon can use them, and frees @snapshot.
+ */
+void
+udisks_probe_snapshot_free (UDisksProbeSnapshot *snapshot)
+{
+  if (snapshot->save_timeout_id != 0)
+    g_source_remove (snapshot->save_timeout_id);
+  if (snapshot->dirty)
+    udisks_probe_snapshot_save (snapshot);
+  g_hash_table_unref (snapshot->current);
+  g_hash_table_unref (snapshot->loaded);
+  g_mutex_clear (&snapshot->lock);
+  g_free (snapshot);
+}
+
+static gboolean
+on_save_timeout (gpointer user_data)
+{
+  UDisksProbeSnapshot *snapshot = user_data;
+
+  g_mutex_lock (&snapshot->lock);
+  snapshot->save_timeout_id = 0;
+  g_mutex_unlock (&snapshot->lock);
+
+  udisks_probe_snapshot_save (snapshot);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* must be called with the lock held */
+static void
+schedule_save_locked (UDisksProbeSnapshot *snapshot)
+{
+  snapshot->dirty = TRUE;
+  if (snapshot->save_timeout_id == 0)
+    snapshot->save_timeout_id = g_timeout_add_seconds (SAVE_DELAY_SECONDS, on_save_timeout, snapshot);
+}
+
+/* must be called with the lock held */
+static gboolean
+remove_locked (UDisksProbeSnapshot *snapshot,
+               const gchar         *sysfs_path)
+{
+  g_hash_table_remove (snapshot->loaded, sysfs_path);
+  if (!g_hash_table_remove (snapshot->current, sysfs_path))
+    return FALSE;
+  schedule_save_locked (snapshot);
+  return TRUE;
+}
+
+/**
+ * udisks_probe_snapshot_restore:
+ * @snapshot: A #UDisksProbeSnapshot.
+ * @device: A #UDisksLinuxDevice that hasn't been probed yet.
+ *
+ * Sets the probed data of @device from the snapshot taken by the previous
+ * instance of the daemon if the device hasn't changed since. This can be
+ * called from any thread.
+ *
+ * Returns: %TRUE if the probed data was restored, %FALSE if @device needs
+ * to be probed.
+ */
+gboolean
+udisks_probe_snapshot_restore (UDisksProbeSnapshot *snapshot,
+                               UDisksLinuxDevice   *device)
+{
+  const gchar *sysfs_path;
+  gchar *loaded_key;
+  SnapshotEntry *entry;
+  gchar **identity;
+  gboolean ret = FALSE;
+
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+  identity = build_identity (device->udev_device);
+  if (identity == NULL)
+    return FALSE;
+
+  g_mutex_lock (&snapshot->lock);
+  if (g_hash_table_lookup_extended (snapshot->loaded, sysfs_path, (gpointer *) &loaded_key, (gpointer *) &entry) &&
+      udisks_daemon_util_strv_equal ((const gchar * const *) entry->identity, (const gchar * const *) identity))
+    {
+      udisks_linux_device_set_ata_identify_data (device, FALSE, entry->ata_identify_device_data);
+      udisks_linux_device_set_ata_identify_data (device, TRUE, entry->ata_identify_packet_device_data);
+
+      /* keep it for the next instance of the daemon */
+      g_hash_table_steal (snapshot->loaded, sysfs_path);
+      g_hash_table_insert (snapshot->current, loaded_key, entry);
+      schedule_save_locked (snapshot);
+      ret = TRUE;
+    }
+  g_mutex_unlock (&snapshot->lock);
+
+  g_strfreev (identity);
+  return ret;
+}
+
+/**
+ * udisks_probe_snapshot_store:
+ * @snapshot: A #UDisksProbeSnapshot.
+ * @device: A probed #UDisksLinuxDevice.
+ *
+ * Records the probed data of @device and schedules writing it to disk.
+ * Devices without any probed data are removed from the snapshot. This can
+ * be called from any thread.
+ *
+ * Returns: %TRUE if something was recorded for the device before and the
+ * probed data differs from it, %FALSE otherwise.
+ */
+gboolean
+udisks_probe_snapshot_store (UDisksProbeSnapshot *snapshot,
+                             UDisksLinuxDevice   *device)
+{
+  const gchar *sysfs_path;
+  SnapshotEntry *entry;
+  SnapshotEntry *old_entry;
+  gboolean ret = FALSE;
+
+  sysfs_path = g_udev_device_get_sysfs_path (device->udev_device);
+  if (device->ata_identify_device_data == NULL && device->ata_identify_packet_device_data == NULL)
+    {
+      g_mutex_lock (&snapshot->lock);
+      ret = remove_locked (snapshot, sysfs_path);
+      g_mutex_unlock (&snapshot->lock);
+      return ret;
+    }
+
+  entry = g_new0 (SnapshotEntry, 1);
+  entry->identity = build_identity (device->udev_device);
+  if (entry->identity == NULL)
+    {
+      snapshot_entry_free (entry);
+      g_mutex_lock (&snapshot->lock);
+      ret = remove_locked (snapshot, sysfs_path);
+      g_mutex_unlock (&snapshot->lock);
+      return ret;
+    }
+  entry->ata_identify_device_data = g_memdup (device->ata_identify_device_data,
+                                              device->ata_identify_device_data != NULL ? ATA_IDENTIFY_DATA_SIZE : 0);
+  entry->ata_identify_packet_device_data = g_memdup (device->ata_identify_packet_device_data,
+                                                     device->ata_identify_packet_device_data != NULL ? ATA_IDENTIFY_DATA_SIZE : 0);
+
+  g_mutex_lock (&snapshot->lock);
+  g_hash_table_remove (snapshot->loaded, sysfs_path);
+  old_entry = g_hash_table_lookup (snapshot->current, sysfs_path);
+  if (old_entry != NULL &&
+      udisks_daemon_util_strv_equal ((const gchar * const *) old_entry->identity, (const gchar * const *) entry->identity) &&
+      data_equal (old_entry->ata_identify_device_data, entry->ata_identify_device_data) &&
+      data_equal (old_entry->ata_identify_packet_device_data, entry->ata_identify_packet_device_data))
+    {
+      snapshot_entry_free (entry);
+    }
+  else
+    {
+      ret = old_entry != NULL;
+      g_hash_table_insert (snapshot->current, g_strdup (sysfs_path), entry);
+      schedule_save_locked (snapshot);
+    }
+  g_mutex_unlock (&snapshot->lock);
+
+  return ret;
+}
+
+/**
+ * udisks_probe_snapshot_remove:
+ * @snapshot: A #UDisksProbeSnapshot.
+ * @sysfs_path: The sysfs path of a device.
+ *
+ * Forgets the probed data of the device at @sysfs_path, e.g. because it
+ * was removed. This can be called from any thread.
+ */
+void
+udisks_probe_snapshot_remove (UDisksProbeSnapshot *snapshot,
+                              const gchar         *sysfs_path)
+{
+  g_mutex_lock (&snapshot->lock);
+  remove_locked (snapshot, sysfs_path);
+  g_mutex_unlock (&snapshot->lock);
+}
+
+/**
+ * udisks_probe_snapshot_save:
+ * @snapshot: A #UDisksProbeSnapshot.
+ *
+ * Writes the data of the devices seen by this instance of the daemon to
+ * disk. The data loaded from the previous snapshot that didn't match any
+ * device is dropped.
+ */
+void
+udisks_probe_snapshot_save (UDisksProbeSnapshot *snapshot)
+{
+  GKeyFile *key_file;
+  GHashTableIter iter;
+  const gchar *sysfs_path;
+  SnapshotEntry *entry;
+  gchar *contents;
+  GError *error = NULL;
+
+  key_file = g_key_file_new ();
+  g_key_file_set_integer (key_file, HEADER_GROUP, VERSION_KEY, PROBE_SNAPSHOT_VERSION);
+
+  g_mutex_lock (&snapshot->lock);
+  g_hash_table_iter_init (&iter, snapshot->current);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &sysfs_path, (gpointer *) &entry))
+    {
+      g_key_file_set_string_list (key_file, sysfs_path, IDENTITY_KEY,
+                                  (const gchar * const *) entry->identity,
+                                  g_strv_length (entry->identity));
+      if (entry->ata_identify_device_data != NULL)
+        {
+          gchar *encoded = g_base64_encode (entry->ata_identify_device_data, ATA_IDENTIFY_DATA_SIZE);
+          g_key_file_set_string (key_file, sysfs_path, ATA_IDENTIFY_DEVICE_KEY, encoded);
+          g_free (encoded);
+        }
+      if (entry->ata_identify_packet_device_data != NULL)
+        {
+          gchar *encoded = g_base64_encode (entry->ata_identify_packet_device_data, ATA_IDENTIFY_DATA_SIZE);
+          g_key_file_set_string (key_file, sysfs_path, ATA_IDENTIFY_PACKET_DEVICE_KEY, encoded);
+          g_free (encoded);
+        }
+    }
+  snapshot->dirty = FALSE;
+  g_mutex_unlock (&snapshot->lock);
+
+  contents = g_key_file_to_data (key_file, NULL, NULL);
+  if (!g_file_set_contents (PROBE_SNAPSHOT_FILE, contents, -1, &error))
+    {
+      udisks_warning ("Error writing %s: %s", PROBE_SNAPSHOT_FILE, error->message);
+      g_clear_error (&error);
+    }
+  g_free (contents);
+  g_key_file_free (key_file);
+}
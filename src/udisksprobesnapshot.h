@@ -0,0 +1,40 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_PROBE_SNAPSHOT_H__
+#define __UDISKS_PROBE_SNAPSHOT_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+UDisksProbeSnapshot *udisks_probe_snapshot_new     (void);
+void                 udisks_probe_snapshot_free    (UDisksProbeSnapshot *snapshot);
+gboolean             udisks_probe_snapshot_restore (UDisksProbeSnapshot *snapshot,
+                                                    UDisksLinuxDevice   *device);
+gboolean             udisks_probe_snapshot_store   (UDisksProbeSnapshot *snapshot,
+                                                    UDisksLinuxDevice   *device);
+void                 udisks_probe_snapshot_remove  (UDisksProbeSnapshot *snapshot,
+                                                    const gchar         *sysfs_path);
+void                 udisks_probe_snapshot_save    (UDisksProbeSnapshot *snapshot);
+
+G_END_DECLS
+
+#endif /* __UDISKS_PROBE_SNAPSHOT_H__ */
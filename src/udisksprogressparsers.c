@@ -0,0 +1,262 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "udisksprogressparsers.h"
+#include "udisksspawnedjob.h"
+
+/**
+ * SECTION:udisksprogressparsers
+ * @title: Progress parsers
+ * @short_description: Progress of spawned jobs from the output of known tools
+ *
+ * Tools like <command>mke2fs</command> or <command>e2fsck -C</command>
+ * report how far they are on their standard output. The parsers here
+ * turn that output into the progress of the #UDisksSpawnedJob running
+ * the tool, see udisks_spawned_job_set_progress_func().
+ */
+
+/* State shared by all the parsers, kept per job */
+typedef struct
+{
+  /* the part of the overall progress the current phase covers */
+  gdouble phase_start;
+  gdouble phase_end;
+  /* the progress is never reported to go back */
+  gdouble last;
+} ParserState;
+
+static gboolean
+report_progress (ParserState *state,
+                 gdouble      phase_progress,
+                 gdouble     *out_progress)
+{
+  gdouble progress;
+
+  progress = state->phase_start + CLAMP (phase_progress, 0.0, 1.0) * (state->phase_end - state->phase_start);
+  state->last = MAX (state->last, progress);
+  *out_progress = state->last;
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* mke2fs prints the label of a phase followed by a "done/total" counter
+ * which it rewrites in place using backspaces, e.g.
+ *
+ *   Writing inode tables:  12/160\b\b\b\b\b\b\b 13/160\b\b\b\b\b\b\bdone
+ */
+static const struct
+{
+  const gchar *label;
+  gdouble start;
+  gdouble end;
+} mke2fs_phases[] =
+{
+  { "Discarding device blocks", 0.00, 0.40 },
+  { "Allocating group tables",  0.40, 0.50 },
+  { "Writing inode tables",     0.50, 0.90 },
+  { "Creating journal",         0.90, 0.95 },
+  { "Writing superblocks",      0.95, 1.00 },
+};
+
+static gboolean
+parse_mke2fs (UDisksSpawnedJob *job,
+              const gchar      *line,
+              gdouble          *out_progress,
+              gpointer          user_data)
+{
+  ParserState *state = user_data;
+  const gchar *counter = line;
+  guint64 done, total;
+  guint n;
+
+  for (n = 0; n < G_N_ELEMENTS (mke2fs_phases); n++)
+    {
+      if (g_str_has_prefix (line, mke2fs_phases[n].label))
+        {
+          state->phase_start = mke2fs_phases[n].start;
+          state->phase_end = mke2fs_phases[n].end;
+          counter = strchr (line, ':');
+          if (counter == NULL)
+            return report_progress (state, 0.0, out_progress);
+          counter++;
+          break;
+        }
+    }
+  /* not in any known phase (yet) */
+  if (state->phase_end == 0.0)
+    return FALSE;
+
+  counter += strspn (counter, " ");
+  if (g_str_has_prefix (counter, "done"))
+    return report_progress (state, 1.0, out_progress);
+  if (sscanf (counter, "%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT, &done, &total) == 2 && total > 0)
+    return report_progress (state, (gdouble) done / total, out_progress);
+
+  return FALSE;
+}
+
+/* e2fsck -C fd writes "pass done total device" lines */
+static const gdouble e2fsck_pass_ends[] = { 0.0, 0.70, 0.90, 0.92, 0.95, 1.00 };
+
+static gboolean
+parse_e2fsck (UDisksSpawnedJob *job,
+              const gchar      *line,
+              gdouble          *out_progress,
+              gpointer          user_data)
+{
+  ParserState *state = user_data;
+  guint pass;
+  guint64 done, total;
+
+  if (sscanf (line, "%u %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT, &pass, &done, &total) != 3 ||
+      pass < 1 || pass >= G_N_ELEMENTS (e2fsck_pass_ends) || total == 0)
+    return FALSE;
+
+  state->phase_start = e2fsck_pass_ends[pass - 1];
+  state->phase_end = e2fsck_pass_ends[pass];
+  return report_progress (state, (gdouble) done / total, out_progress);
+}
+
+/* xfs_repair goes through seven phases reported as "Phase N - ..." */
+#define XFS_REPAIR_N_PHASES 7
+
+static gboolean
+parse_xfs_repair (UDisksSpawnedJob *job,
+                  const gchar      *line,
+                  gdouble          *out_progress,
+                  gpointer          user_data)
+{
+  ParserState *state = user_data;
+  guint phase;
+
+  if (sscanf (line, "Phase %u -", &phase) != 1 || phase < 1 || phase > XFS_REPAIR_N_PHASES)
+    return FALSE;
+
+  state->phase_start = (gdouble) (phase - 1) / XFS_REPAIR_N_PHASES;
+  state->phase_end = (gdouble) phase / XFS_REPAIR_N_PHASES;
+  return report_progress (state, 0.0, out_progress);
+}
+
+/* ntfsresize rewrites "xx.xx percent completed" using carriage returns */
+static gboolean
+parse_ntfsresize (UDisksSpawnedJob *job,
+                  const gchar      *line,
+                  gdouble          *out_progress,
+                  gpointer          user_data)
+{
+  ParserState *state = user_data;
+  gchar *end;
+  gdouble percent;
+
+  percent = g_ascii_strtod (line, &end);
+  if (end == line)
+    return FALSE;
+  end += strspn (end, " ");
+  if (!g_str_has_prefix (end, "percent completed"))
+    return FALSE;
+
+  state->phase_start = 0.0;
+  state->phase_end = 1.0;
+  return report_progress (state, percent / 100.0, out_progress);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const struct
+{
+  const gchar *program;
+  /* option the progress output must be requested with or %NULL */
+  const gchar *required_option;
+  UDisksSpawnedJobProgressFunc func;
+} parsers[] =
+{
+  { "mke2fs",     NULL, parse_mke2fs },
+  { "mkfs.ext2",  NULL, parse_mke2fs },
+  { "mkfs.ext3",  NULL, parse_mke2fs },
+  { "mkfs.ext4",  NULL, parse_mke2fs },
+  { "e2fsck",     "-C", parse_e2fsck },
+  { "fsck.ext2",  "-C", parse_e2fsck },
+  { "fsck.ext3",  "-C", parse_e2fsck },
+  { "fsck.ext4",  "-C", parse_e2fsck },
+  { "xfs_repair", NULL, parse_xfs_repair },
+  { "ntfsresize", NULL, parse_ntfsresize },
+};
+
+/* Whether @option is passed in @argv, possibly with its value attached */
+static gboolean
+has_option (gchar       **argv,
+            const gchar  *option)
+{
+  guint n;
+
+  for (n = 1; argv[n] != NULL; n++)
+    if (g_str_has_prefix (argv[n], option))
+      return TRUE;
+  return FALSE;
+}
+
+/**
+ * udisks_progress_parsers_attach:
+ * @job: A #UDisksSpawnedJob that has not been started yet.
+ * @command_line: The command line @job runs.
+ *
+ * Sets up parsing the progress of @job from its output if the program
+ * in @command_line is known to report its progress.
+ *
+ * Returns: %TRUE if a progress parser was set up for @job, %FALSE otherwise.
+ */
+gboolean
+udisks_progress_parsers_attach (UDisksSpawnedJob *job,
+                                const gchar      *command_line)
+{
+  gchar **argv = NULL;
+  gchar *program = NULL;
+  gboolean ret = FALSE;
+  guint n;
+
+  g_return_val_if_fail (UDISKS_IS_SPAWNED_JOB (job), FALSE);
+
+  if (!g_shell_parse_argv (command_line, NULL, &argv, NULL))
+    goto out;
+
+  program = g_path_get_basename (argv[0]);
+  for (n = 0; n < G_N_ELEMENTS (parsers); n++)
+    {
+      if (g_strcmp0 (program, parsers[n].program) != 0)
+        continue;
+      if (parsers[n].required_option != NULL && !has_option (argv, parsers[n].required_option))
+        continue;
+
+      udisks_spawned_job_set_progress_func (job, parsers[n].func, g_new0 (ParserState, 1), g_free);
+      ret = TRUE;
+      break;
+    }
+
+ out:
+  g_free (program);
+  g_strfreev (argv);
+  return ret;
+}
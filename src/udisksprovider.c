@@ -58,6 +58,16 @@ enum
   PROP_DAEMON
 };
 
+enum
+{
+  OBJECT_ADDED_SIGNAL,
+  OBJECT_CHANGED_SIGNAL,
+  OBJECT_REMOVED_SIGNAL,
+  LAST_SIGNAL,
+};
+
+static guint signals[LAST_SIGNAL] = { 0 };
+
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (UDisksProvider, udisks_provider, G_TYPE_OBJECT,
                                   G_ADD_PRIVATE (UDisksProvider));
 
@@ -153,6 +163,73 @@ udisks_provider_class_init (UDisksProviderClass *klass)
                                                         G_PARAM_WRITABLE |
                                                         G_PARAM_CONSTRUCT_ONLY |
                                                         G_PARAM_STATIC_STRINGS));
+
+  /**
+   * UDisksProvider::object-added:
+   * @provider: A #UDisksProvider.
+   * @object: The #GDBusObject that was exported.
+   *
+   * Emitted when @provider exported a new object.
+   *
+   * This signal may be emitted from any thread.
+   *
+   * Since: 2.9.0
+   */
+  signals[OBJECT_ADDED_SIGNAL] = g_signal_new ("object-added",
+                                               G_OBJECT_CLASS_TYPE (klass),
+                                               G_SIGNAL_RUN_LAST,
+                                               0,
+                                               NULL,
+                                               NULL,
+                                               g_cclosure_marshal_VOID__OBJECT,
+                                               G_TYPE_NONE,
+                                               1,
+                                               G_TYPE_DBUS_OBJECT);
+
+  /**
+   * UDisksProvider::object-changed:
+   * @provider: A #UDisksProvider.
+   * @object: The #GDBusObject that was updated.
+   *
+   * Emitted when @provider finished updating the interfaces of an
+   * exported object, e.g. after a uevent.
+   *
+   * This signal may be emitted from any thread.
+   *
+   * Since: 2.9.0
+   */
+  signals[OBJECT_CHANGED_SIGNAL] = g_signal_new ("object-changed",
+                                                 G_OBJECT_CLASS_TYPE (klass),
+                                                 G_SIGNAL_RUN_LAST,
+                                                 0,
+                                                 NULL,
+                                                 NULL,
+                                                 g_cclosure_marshal_VOID__OBJECT,
+                                                 G_TYPE_NONE,
+                                                 1,
+                                                 G_TYPE_DBUS_OBJECT);
+
+  /**
+   * UDisksProvider::object-removed:
+   * @provider: A #UDisksProvider.
+   * @object: The #GDBusObject that was unexported.
+   *
+   * Emitted when @provider unexported an object.
+   *
+   * This signal may be emitted from any thread.
+   *
+   * Since: 2.9.0
+   */
+  signals[OBJECT_REMOVED_SIGNAL] = g_signal_new ("object-removed",
+                                                 G_OBJECT_CLASS_TYPE (klass),
+                                                 G_SIGNAL_RUN_LAST,
+                                                 0,
+                                                 NULL,
+                                                 NULL,
+                                                 g_cclosure_marshal_VOID__OBJECT,
+                                                 G_TYPE_NONE,
+                                                 1,
+                                                 G_TYPE_DBUS_OBJECT);
 }
 
 /**
@@ -183,5 +260,62 @@ udisks_provider_start  (UDisksProvider *provider)
   UDISKS_PROVIDER_GET_CLASS (provider)->start (provider);
 }
 
+/**
+ * udisks_provider_emit_object_added:
+ * @provider: A #UDisksProvider.
+ * @object: The #GDBusObject that was exported.
+ *
+ * Emits the #UDisksProvider::object-added signal. Meant to be used
+ * by subclasses only.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_provider_emit_object_added (UDisksProvider *provider,
+                                   GDBusObject    *object)
+{
+  g_return_if_fail (UDISKS_IS_PROVIDER (provider));
+  g_return_if_fail (G_IS_DBUS_OBJECT (object));
+  g_signal_emit (provider, signals[OBJECT_ADDED_SIGNAL], 0, object);
+}
+
+/**
+ * udisks_provider_emit_object_changed:
+ * @provider: A #UDisksProvider.
+ * @object: The #GDBusObject that was updated.
+ *
+ * Emits the #UDisksProvider::object-changed signal. Meant to be used
+ * by subclasses only.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_provider_emit_object_changed (UDisksProvider *provider,
+                                     GDBusObject    *object)
+{
+  g_return_if_fail (UDISKS_IS_PROVIDER (provider));
+  g_return_if_fail (G_IS_DBUS_OBJECT (object));
+  g_signal_emit (provider, signals[OBJECT_CHANGED_SIGNAL], 0, object);
+}
+
+/**
+ * udisks_provider_emit_object_removed:
+ * @provider: A #UDisksProvider.
+ * @object: The #GDBusObject that was unexported.
+ *
+ * Emits the #UDisksProvider::object-removed signal. Meant to be used
+ * by subclasses only.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_provider_emit_object_removed (UDisksProvider *provider,
+                                     GDBusObject    *object)
+{
+  g_return_if_fail (UDISKS_IS_PROVIDER (provider));
+  g_return_if_fail (G_IS_DBUS_OBJECT (object));
+  g_signal_emit (provider, signals[OBJECT_REMOVED_SIGNAL], 0, object);
+}
+
 
 /* ---------------------------------------------------------------------------------------------------- */
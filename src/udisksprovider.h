@@ -70,6 +70,13 @@ GType           udisks_provider_get_type   (void) G_GNUC_CONST;
 UDisksDaemon   *udisks_provider_get_daemon (UDisksProvider *provider);
 void            udisks_provider_start      (UDisksProvider *provider);
 
+void            udisks_provider_emit_object_added   (UDisksProvider *provider,
+                                                     GDBusObject    *object);
+void            udisks_provider_emit_object_changed (UDisksProvider *provider,
+                                                     GDBusObject    *object);
+void            udisks_provider_emit_object_removed (UDisksProvider *provider,
+                                                     GDBusObject    *object);
+
 G_END_DECLS
 
 #endif /* __UDISKS_PROVIDER_H__ */
@@ -29,12 +29,22 @@
 #include <pwd.h>
 #include <grp.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#include <spawn.h>
+#endif
+
+#include <glib-unix.h>
 
 #include "udisksbasejob.h"
 #include "udisksspawnedjob.h"
 #include "udisks-daemon-marshal.h"
 #include "udisksdaemon.h"
 #include "udisksdaemonutil.h"
+#include "udisksjobscheduler.h"
+#include "udiskstrace.h"
 
 /**
  * SECTION:udisksspawnedjob
@@ -47,6 +57,27 @@
 
 typedef struct _UDisksSpawnedJobClass   UDisksSpawnedJobClass;
 
+/* Size of the reads from the pipes of the child */
+#define READ_BUFFER_SIZE (64 * 1024)
+
+/* Longest line passed to the progress function, longer lines are cut */
+#define MAX_PROGRESS_LINE 4096
+
+/* Output of the child on stdout or stderr. Past the output limit only the
+ * first half of the limit is kept in @str and the last half in the @tail
+ * ring buffer, see child_output_append() and child_output_finish(). */
+typedef struct
+{
+  GString *str;
+  gchar *tail;
+  gsize tail_size;
+  gsize tail_pos;
+  gsize tail_len;
+  guint64 n_dropped;
+  /* the incomplete last line, only used with a progress function */
+  GString *line;
+} ChildOutput;
+
 /**
  * UDisksSpawnedJob:
  *
@@ -77,17 +108,21 @@ struct _UDisksSpawnedJob
   gint child_stdout_fd;
   gint child_stderr_fd;
 
-  GIOChannel *child_stdin_channel;
-  GIOChannel *child_stdout_channel;
-  GIOChannel *child_stderr_channel;
-
   GSource *child_watch_source;
   GSource *child_stdin_source;
   GSource *child_stdout_source;
   GSource *child_stderr_source;
 
-  GString *child_stdout;
-  GString *child_stderr;
+  /* shared by stdout and stderr, allocated on first use */
+  gchar *read_buffer;
+
+  ChildOutput child_stdout;
+  ChildOutput child_stderr;
+  gsize output_limit;
+
+  UDisksSpawnedJobProgressFunc progress_func;
+  gpointer progress_func_user_data;
+  GDestroyNotify progress_func_user_data_free_func;
 };
 
 struct _UDisksSpawnedJobClass
@@ -152,6 +187,9 @@ udisks_spawned_job_finalize (GObject *object)
 
   g_free (job->command_line);
 
+  if (job->progress_func_user_data_free_func != NULL)
+    job->progress_func_user_data_free_func (job->progress_func_user_data);
+
   if (job->input_string != NULL)
     g_boxed_free (autowipe_buffer_get_type (), (gpointer) job->input_string);
 
@@ -231,13 +269,15 @@ emit_completed_with_error_in_idle_cb (gpointer user_data)
   EmitCompletedData *data = user_data;
   gboolean ret;
 
+  child_output_finish (&data->job->child_stdout);
+  child_output_finish (&data->job->child_stderr);
   g_signal_emit (data->job,
                  signals[SPAWNED_JOB_COMPLETED_SIGNAL],
                  0,
                  data->error,
-                 0,                        /* status */
-                 data->job->child_stdout,  /* standard_output */
-                 data->job->child_stderr,  /* standard_error */
+                 0,                            /* status */
+                 data->job->child_stdout.str,  /* standard_output */
+                 data->job->child_stderr.str,  /* standard_error */
                  &ret);
   g_object_unref (data->job);
   g_clear_error (&(data->error));
@@ -282,70 +322,254 @@ on_cancelled (GCancellable *cancellable,
   g_clear_error (&error);
 }
 
+static void
+child_output_init (ChildOutput *output)
+{
+  memset (output, 0, sizeof (ChildOutput));
+  output->str = g_string_new (NULL);
+}
+
+static void
+child_output_clear (ChildOutput *output)
+{
+  if (output->str != NULL)
+    g_string_free (output->str, TRUE);
+  g_free (output->tail);
+  if (output->line != NULL)
+    g_string_free (output->line, TRUE);
+  memset (output, 0, sizeof (ChildOutput));
+}
+
+static void
+child_output_append (ChildOutput *output,
+                     gsize        limit,
+                     const gchar *data,
+                     gsize        len)
+{
+  gsize head_size;
+
+  if (limit == 0)
+    {
+      g_string_append_len (output->str, data, len);
+      return;
+    }
+
+  /* fill the head first */
+  head_size = limit - limit / 2;
+  if (output->str->len < head_size)
+    {
+      gsize n = MIN (len, head_size - output->str->len);
+      g_string_append_len (output->str, data, n);
+      data += n;
+      len -= n;
+    }
+  if (len == 0)
+    return;
+
+  /* then keep the most recent bytes in the tail ring buffer */
+  if (output->tail == NULL)
+    {
+      output->tail_size = MAX (limit / 2, 1);
+      output->tail = g_malloc (output->tail_size);
+    }
+  if (len >= output->tail_size)
+    {
+      output->n_dropped += output->tail_len + (len - output->tail_size);
+      memcpy (output->tail, data + len - output->tail_size, output->tail_size);
+      output->tail_pos = 0;
+      output->tail_len = output->tail_size;
+      return;
+    }
+  while (len > 0)
+    {
+      gsize n = MIN (len, output->tail_size - output->tail_pos);
+      if (output->tail_len == output->tail_size)
+        output->n_dropped += n;
+      else
+        output->n_dropped += MAX ((gssize) (output->tail_len + n) - (gssize) output->tail_size, 0);
+      memcpy (output->tail + output->tail_pos, data, n);
+      output->tail_pos = (output->tail_pos + n) % output->tail_size;
+      output->tail_len = MIN (output->tail_len + n, output->tail_size);
+      data += n;
+      len -= n;
+    }
+}
+
+/* Moves the tail (if any) to @output->str, called before handing it out */
+static void
+child_output_finish (ChildOutput *output)
+{
+  gsize start;
+
+  if (output->tail == NULL || output->tail_len == 0)
+    return;
+
+  if (output->n_dropped > 0)
+    g_string_append_printf (output->str,
+                            "\n[... %" G_GUINT64_FORMAT " bytes omitted ...]\n",
+                            output->n_dropped);
+  start = (output->tail_pos + output->tail_size - output->tail_len) % output->tail_size;
+  if (start + output->tail_len <= output->tail_size)
+    {
+      g_string_append_len (output->str, output->tail + start, output->tail_len);
+    }
+  else
+    {
+      g_string_append_len (output->str, output->tail + start, output->tail_size - start);
+      g_string_append_len (output->str, output->tail, output->tail_len - (output->tail_size - start));
+    }
+  output->tail_pos = 0;
+  output->tail_len = 0;
+  output->n_dropped = 0;
+}
+
+/* Splits @data into lines (terminated by '\n', or '\r' and '\b' as used by
+ * progress bars and counters) and passes the complete ones to the progress
+ * function */
+static void
+child_output_parse_progress (UDisksSpawnedJob *job,
+                             ChildOutput      *output,
+                             const gchar      *data,
+                             gsize             len)
+{
+  gsize n;
+
+  if (output->line == NULL)
+    output->line = g_string_new (NULL);
+
+  for (n = 0; n < len; n++)
+    {
+      gdouble progress;
+
+      if (data[n] != '\n' && data[n] != '\r' && data[n] != '\b')
+        {
+          if (output->line->len < MAX_PROGRESS_LINE)
+            g_string_append_c (output->line, data[n]);
+          continue;
+        }
+      if (output->line->len == 0)
+        continue;
+
+      progress = -1.0;
+      if (job->progress_func (job, output->line->str, &progress, job->progress_func_user_data) &&
+          progress >= 0.0 && progress <= 1.0)
+        {
+          if (!udisks_job_get_progress_valid (UDISKS_JOB (job)))
+            udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+          udisks_job_set_progress (UDISKS_JOB (job), progress);
+        }
+      g_string_truncate (output->line, 0);
+    }
+}
+
+/* Reads everything available on @fd until it would block, returns FALSE
+ * on EOF or error */
+static gboolean
+read_child_output (UDisksSpawnedJob *job,
+                   gint              fd,
+                   ChildOutput      *output)
+{
+  gssize bytes_read;
+
+  if (job->read_buffer == NULL)
+    job->read_buffer = g_malloc (READ_BUFFER_SIZE);
+
+  while (TRUE)
+    {
+      bytes_read = read (fd, job->read_buffer, READ_BUFFER_SIZE);
+      if (bytes_read > 0)
+        {
+          child_output_append (output, job->output_limit, job->read_buffer, bytes_read);
+          if (job->progress_func != NULL)
+            child_output_parse_progress (job, output, job->read_buffer, bytes_read);
+        }
+      else if (bytes_read == 0)
+        {
+          return FALSE;
+        }
+      else if (errno == EINTR)
+        {
+          continue;
+        }
+      else
+        {
+          return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+}
+
 static gboolean
-read_child_stderr (GIOChannel *channel,
+read_child_stderr (gint         fd,
                    GIOCondition condition,
-                   gpointer user_data)
+                   gpointer     user_data)
 {
   UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
-  gchar buf[1024];
-  gsize bytes_read = 0;
 
-  g_io_channel_read_chars (channel, buf, sizeof buf, &bytes_read, NULL);
-  g_string_append_len (job->child_stderr, buf, bytes_read);
-  return TRUE;
+  if (read_child_output (job, fd, &job->child_stderr))
+    return G_SOURCE_CONTINUE;
+
+  /* EOF, the source is destroyed when we return */
+  job->child_stderr_source = NULL;
+  return G_SOURCE_REMOVE;
 }
 
 static gboolean
-read_child_stdout (GIOChannel *channel,
+read_child_stdout (gint         fd,
                    GIOCondition condition,
-                   gpointer user_data)
+                   gpointer     user_data)
 {
   UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
-  gchar buf[1024];
-  gsize bytes_read = 0;
 
-  g_io_channel_read_chars (channel, buf, sizeof buf, &bytes_read, NULL);
-  g_string_append_len (job->child_stdout, buf, bytes_read);
-  return TRUE;
+  if (read_child_output (job, fd, &job->child_stdout))
+    return G_SOURCE_CONTINUE;
+
+  /* EOF, the source is destroyed when we return */
+  job->child_stdout_source = NULL;
+  return G_SOURCE_REMOVE;
 }
 
 static gboolean
-write_child_stdin (GIOChannel *channel,
+write_child_stdin (gint         fd,
                    GIOCondition condition,
-                   gpointer user_data)
+                   gpointer     user_data)
 {
   UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
-  gsize bytes_written = 0;
+  gssize bytes_written;
   gsize bytes_to_write = 0;
 
-  if (job->input_string != NULL)
-    {
-      bytes_to_write = job->input_string->len - (job->input_string_cursor - job->input_string->str);
-    }
+  if (job->input_string != NULL && job->input_string_cursor != NULL)
+    bytes_to_write = job->input_string->len - (job->input_string_cursor - job->input_string->str);
 
-  if (job->input_string_cursor == NULL || bytes_to_write == 0)
+  /* write as much as the pipe takes, without any intermediate buffering */
+  while (bytes_to_write > 0)
     {
-      /* nothing left to write; close our end so the child will get EOF */
-      g_io_channel_unref (job->child_stdin_channel);
-      g_source_destroy (job->child_stdin_source);
-      g_warn_if_fail (close (job->child_stdin_fd) == 0);
-      job->child_stdin_channel = NULL;
-      job->child_stdin_source = NULL;
-      job->child_stdin_fd = -1;
-      return FALSE;
+      bytes_written = write (fd, job->input_string_cursor, bytes_to_write);
+      if (bytes_written > 0)
+        {
+          job->input_string_cursor += bytes_written;
+          bytes_to_write -= bytes_written;
+        }
+      else if (bytes_written < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      else if (bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+          /* keep writing once the child read some */
+          return G_SOURCE_CONTINUE;
+        }
+      else
+        {
+          /* e.g. the child closed its end, nothing more to write */
+          break;
+        }
     }
 
-  g_io_channel_write_chars (channel,
-                            job->input_string_cursor,
-                            bytes_to_write,
-                            &bytes_written,
-                            NULL);
-  g_io_channel_flush (channel, NULL);
-  job->input_string_cursor += bytes_written;
-
-  /* keep writing */
-  return TRUE;
+  /* nothing left to write; close our end so the child will get EOF */
+  g_warn_if_fail (close (job->child_stdin_fd) == 0);
+  job->child_stdin_source = NULL;
+  job->child_stdin_fd = -1;
+  return G_SOURCE_REMOVE;
 }
 
 static void
@@ -354,24 +578,19 @@ child_watch_cb (GPid     pid,
                 gpointer user_data)
 {
   UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (user_data);
-  gchar *buf;
-  gsize buf_size;
   gboolean ret;
 
-  buf_size = 0;
-  if (g_io_channel_read_to_end (job->child_stdout_channel, &buf, &buf_size, NULL) == G_IO_STATUS_NORMAL)
-    {
-      g_string_append_len (job->child_stdout, buf, buf_size);
-      g_free (buf);
-    }
-  buf_size = 0;
-  if (g_io_channel_read_to_end (job->child_stderr_channel, &buf, &buf_size, NULL) == G_IO_STATUS_NORMAL)
-    {
-      g_string_append_len (job->child_stderr, buf, buf_size);
-      g_free (buf);
-    }
+  /* collect what's left in the pipes (without blocking, e.g. when a
+   * daemonized grandchild keeps them open) */
+  if (job->child_stdout_source != NULL)
+    read_child_output (job, job->child_stdout_fd, &job->child_stdout);
+  if (job->child_stderr_source != NULL)
+    read_child_output (job, job->child_stderr_fd, &job->child_stderr);
+  child_output_finish (&job->child_stdout);
+  child_output_finish (&job->child_stderr);
 
   //g_debug ("helper(pid %5d): completed with exit code %d\n", job->child_pid, WEXITSTATUS (status));
+  UDISKS_TRACE3 (spawned_job_exited, job->command_line, pid, status);
 
   /* take a reference so it's safe for a signal-handler to release the last one */
   g_object_ref (job);
@@ -380,8 +599,8 @@ child_watch_cb (GPid     pid,
                  0,
                  NULL, /* GError */
                  status,
-                 job->child_stdout,
-                 job->child_stderr,
+                 job->child_stdout.str,
+                 job->child_stderr.str,
                  &ret);
   job->child_pid = 0;
   job->child_watch_source = NULL;
@@ -437,8 +656,8 @@ child_setup (gpointer user_data)
 static void
 udisks_spawned_job_init (UDisksSpawnedJob *job)
 {
-  job->child_stdout = g_string_new (NULL);
-  job->child_stderr = g_string_new (NULL);
+  child_output_init (&job->child_stdout);
+  child_output_init (&job->child_stderr);
   job->child_stdin_fd = -1;
   job->child_stdout_fd = -1;
   job->child_stderr_fd = -1;
@@ -622,6 +841,60 @@ udisks_spawned_job_get_command_line (UDisksSpawnedJob *job)
   return job->command_line;
 }
 
+/**
+ * udisks_spawned_job_set_output_limit:
+ * @job: A #UDisksSpawnedJob.
+ * @limit: Maximum number of bytes of output to keep or 0 for no limit.
+ *
+ * Limits the amount of standard output and standard error of the child
+ * process kept in memory to roughly @limit bytes each. Past the limit,
+ * the beginning and the end of the output is passed to the
+ * #UDisksSpawnedJob::spawned-job-completed signal with a note about the
+ * number of bytes omitted in between. By default the output is not limited.
+ *
+ * This must be called before @job is started.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_spawned_job_set_output_limit (UDisksSpawnedJob *job,
+                                     gsize             limit)
+{
+  g_return_if_fail (UDISKS_IS_SPAWNED_JOB (job));
+  job->output_limit = limit;
+}
+
+/**
+ * udisks_spawned_job_set_progress_func:
+ * @job: A #UDisksSpawnedJob.
+ * @func: (nullable): A #UDisksSpawnedJobProgressFunc or %NULL.
+ * @user_data: User data to pass to @func.
+ * @user_data_free_func: (nullable): Function to free @user_data with or %NULL.
+ *
+ * Sets a function parsing the progress of @job from the output of the
+ * child process as it comes in. The #UDisksJob:progress property of @job
+ * is updated with the values reported by @func and the expected end time
+ * of the job is estimated from them.
+ *
+ * This must be called before @job is started.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_spawned_job_set_progress_func (UDisksSpawnedJob             *job,
+                                      UDisksSpawnedJobProgressFunc  func,
+                                      gpointer                      user_data,
+                                      GDestroyNotify                user_data_free_func)
+{
+  g_return_if_fail (UDISKS_IS_SPAWNED_JOB (job));
+  if (job->progress_func_user_data_free_func != NULL)
+    job->progress_func_user_data_free_func (job->progress_func_user_data);
+  job->progress_func = func;
+  job->progress_func_user_data = user_data;
+  job->progress_func_user_data_free_func = user_data_free_func;
+  udisks_base_job_set_auto_estimate (UDISKS_BASE_JOB (job), func != NULL);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -817,33 +1090,10 @@ udisks_spawned_job_release_resources (UDisksSpawnedJob *job)
       job->child_pid = 0;
     }
 
-  if (job->child_stdout != NULL)
-    {
-      g_string_free (job->child_stdout, TRUE);
-      job->child_stdout = NULL;
-    }
-
-  if (job->child_stderr != NULL)
-    {
-      g_string_free (job->child_stderr, TRUE);
-      job->child_stderr = NULL;
-    }
-
-  if (job->child_stdin_channel != NULL)
-    {
-      g_io_channel_unref (job->child_stdin_channel);
-      job->child_stdin_channel = NULL;
-    }
-  if (job->child_stdout_channel != NULL)
-    {
-      g_io_channel_unref (job->child_stdout_channel);
-      job->child_stdout_channel = NULL;
-    }
-  if (job->child_stderr_channel != NULL)
-    {
-      g_io_channel_unref (job->child_stderr_channel);
-      job->child_stderr_channel = NULL;
-    }
+  child_output_clear (&job->child_stdout);
+  child_output_clear (&job->child_stderr);
+  g_free (job->read_buffer);
+  job->read_buffer = NULL;
 
   if (job->child_stdin_source != NULL)
     {
@@ -890,22 +1140,111 @@ udisks_spawned_job_release_resources (UDisksSpawnedJob *job)
     }
 }
 
-/**
- * udisks_spawned_job_start:
- * @job: the job to start
- *
- * Connect to the #UDisksSpawnedJob::spawned-job-completed or
- * #UDisksJob::completed signals to get notified when the job is done.
- *
- * */
-void udisks_spawned_job_start (UDisksSpawnedJob *job)
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+extern char **environ;
+
+/* Spawns the child with posix_spawn() which, unlike fork(), doesn't copy the
+ * page tables of the (possibly large) daemon. Only usable when the child
+ * runs with our identity as there's no spawn attribute to switch users. */
+static gboolean
+spawn_with_posix_spawn (UDisksSpawnedJob  *job,
+                        gchar            **child_argv,
+                        GError           **error)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t sigset;
+  gint stdin_pipe[2] = { -1, -1 };
+  gint stdout_pipe[2] = { -1, -1 };
+  gint stderr_pipe[2] = { -1, -1 };
+  pid_t pid;
+  gint rc;
+  gboolean ret = FALSE;
+
+  /* our ends must not leak to the child, its ends get dup2()-ed */
+  if ((job->input_string != NULL && !g_unix_open_pipe (stdin_pipe, FD_CLOEXEC, error)) ||
+      !g_unix_open_pipe (stdout_pipe, FD_CLOEXEC, error) ||
+      !g_unix_open_pipe (stderr_pipe, FD_CLOEXEC, error))
+    goto out;
+
+  posix_spawn_file_actions_init (&actions);
+  if (stdin_pipe[0] != -1)
+    posix_spawn_file_actions_adddup2 (&actions, stdin_pipe[0], STDIN_FILENO);
+  else
+    posix_spawn_file_actions_addopen (&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2 (&actions, stdout_pipe[1], STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2 (&actions, stderr_pipe[1], STDERR_FILENO);
+  /* same as GLib does by default, also for descriptors opened without O_CLOEXEC */
+  posix_spawn_file_actions_addclosefrom_np (&actions, STDERR_FILENO + 1);
+
+  /* don't pass the signal setup of the (calling thread of the) daemon on */
+  posix_spawnattr_init (&attr);
+  sigfillset (&sigset);
+  posix_spawnattr_setsigdefault (&attr, &sigset);
+  sigemptyset (&sigset);
+  posix_spawnattr_setsigmask (&attr, &sigset);
+  posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+  rc = posix_spawnp (&pid, child_argv[0], &actions, &attr, child_argv, environ);
+
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+
+  if (rc != 0)
+    {
+      /* same domain and message as g_spawn_async_with_pipes() */
+      g_set_error (error,
+                   G_SPAWN_ERROR,
+                   rc == ENOENT ? G_SPAWN_ERROR_NOENT :
+                   rc == EACCES ? G_SPAWN_ERROR_ACCES :
+                   rc == ENOMEM ? G_SPAWN_ERROR_NOMEM : G_SPAWN_ERROR_FAILED,
+                   "Failed to execute child process `%s' (%s)",
+                   child_argv[0], g_strerror (rc));
+      goto out;
+    }
+
+  job->child_pid = pid;
+  if (stdin_pipe[1] != -1)
+    {
+      job->child_stdin_fd = stdin_pipe[1];
+      stdin_pipe[1] = -1;
+    }
+  job->child_stdout_fd = stdout_pipe[0];
+  stdout_pipe[0] = -1;
+  job->child_stderr_fd = stderr_pipe[0];
+  stderr_pipe[0] = -1;
+  ret = TRUE;
+
+ out:
+  /* the child's ends and, on failure, ours too */
+  if (stdin_pipe[0] != -1)
+    close (stdin_pipe[0]);
+  if (stdin_pipe[1] != -1)
+    close (stdin_pipe[1]);
+  if (stdout_pipe[0] != -1)
+    close (stdout_pipe[0]);
+  if (stdout_pipe[1] != -1)
+    close (stdout_pipe[1]);
+  if (stderr_pipe[0] != -1)
+    close (stderr_pipe[0]);
+  if (stderr_pipe[1] != -1)
+    close (stderr_pipe[1]);
+  return ret;
+}
+#endif
+
+static void
+spawned_job_start_now (UDisksBaseJob *_job)
 {
+  UDisksSpawnedJob *job = UDISKS_SPAWNED_JOB (_job);
   GError *error;
   gint child_argc;
   gchar **child_argv = NULL;
   struct passwd pwstruct;
   gchar pwbuf[8192];
   struct passwd *pw = NULL;
+  gboolean switch_identity;
+  gboolean spawned;
   int rc;
 
   job->main_context = g_main_context_get_thread_default ();
@@ -941,7 +1280,8 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
     }
 
   /* Save real egid and gid info for the child process */
-  if (job->run_as_uid != getuid () || job->run_as_euid != geteuid ())
+  switch_identity = job->run_as_uid != getuid () || job->run_as_euid != geteuid ();
+  if (switch_identity)
     {
       rc = getpwuid_r (job->run_as_euid, &pwstruct, pwbuf, sizeof pwbuf, &pw);
       if (rc != 0 || pw == NULL)
@@ -969,17 +1309,40 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
     }
 
   error = NULL;
-  if (!g_spawn_async_with_pipes (NULL, /* working directory */
-                                 child_argv,
-                                 NULL, /* envp */
-                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                 child_setup, /* child_setup */
-                                 job, /* child_setup's user_data */
-                                 &(job->child_pid),
-                                 job->input_string != NULL ? &(job->child_stdin_fd) : NULL,
-                                 &(job->child_stdout_fd),
-                                 &(job->child_stderr_fd),
-                                 &error))
+  if (!switch_identity)
+    {
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+      spawned = spawn_with_posix_spawn (job, child_argv, &error);
+#else
+      /* without a child_setup() function GLib may use posix_spawn() itself */
+      spawned = g_spawn_async_with_pipes (NULL, /* working directory */
+                                          child_argv,
+                                          NULL, /* envp */
+                                          G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                          NULL, /* child_setup */
+                                          NULL, /* child_setup's user_data */
+                                          &(job->child_pid),
+                                          job->input_string != NULL ? &(job->child_stdin_fd) : NULL,
+                                          &(job->child_stdout_fd),
+                                          &(job->child_stderr_fd),
+                                          &error);
+#endif
+    }
+  else
+    {
+      spawned = g_spawn_async_with_pipes (NULL, /* working directory */
+                                          child_argv,
+                                          NULL, /* envp */
+                                          G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                          child_setup, /* child_setup */
+                                          job, /* child_setup's user_data */
+                                          &(job->child_pid),
+                                          job->input_string != NULL ? &(job->child_stdin_fd) : NULL,
+                                          &(job->child_stdout_fd),
+                                          &(job->child_stderr_fd),
+                                          &error);
+    }
+  if (!spawned)
     {
       g_prefix_error (&error,
                       "Error spawning command-line `%s': ",
@@ -988,6 +1351,7 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
       g_clear_error (&error);
       goto out;
     }
+  UDISKS_TRACE2 (spawned_job_forked, job->command_line, job->child_pid);
 
   job->child_watch_source = g_child_watch_source_new (job->child_pid);
 #if __GNUC__ >= 8
@@ -1010,11 +1374,8 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
       if (job->input_string)
         job->input_string_cursor = job->input_string->str;
 
-      job->child_stdin_channel = g_io_channel_unix_new (job->child_stdin_fd);
-      // we want to write binary, suppress checking the encoding:
-      g_io_channel_set_encoding (job->child_stdin_channel, NULL, NULL);
-      g_io_channel_set_flags (job->child_stdin_channel, G_IO_FLAG_NONBLOCK, NULL);
-      job->child_stdin_source = g_io_create_watch (job->child_stdin_channel, G_IO_OUT);
+      g_unix_set_fd_nonblocking (job->child_stdin_fd, TRUE, NULL);
+      job->child_stdin_source = g_unix_fd_source_new (job->child_stdin_fd, G_IO_OUT | G_IO_ERR);
 #if __GNUC__ >= 8
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-function-type"
@@ -1031,9 +1392,8 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
       g_source_unref (job->child_stdin_source);
     }
 
-  job->child_stdout_channel = g_io_channel_unix_new (job->child_stdout_fd);
-  g_io_channel_set_flags (job->child_stdout_channel, G_IO_FLAG_NONBLOCK, NULL);
-  job->child_stdout_source = g_io_create_watch (job->child_stdout_channel, G_IO_IN);
+  g_unix_set_fd_nonblocking (job->child_stdout_fd, TRUE, NULL);
+  job->child_stdout_source = g_unix_fd_source_new (job->child_stdout_fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
 #if __GNUC__ >= 8
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-function-type"
@@ -1049,9 +1409,8 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
   g_source_attach (job->child_stdout_source, job->main_context);
   g_source_unref (job->child_stdout_source);
 
-  job->child_stderr_channel = g_io_channel_unix_new (job->child_stderr_fd);
-  g_io_channel_set_flags (job->child_stderr_channel, G_IO_FLAG_NONBLOCK, NULL);
-  job->child_stderr_source = g_io_create_watch (job->child_stderr_channel, G_IO_IN);
+  g_unix_set_fd_nonblocking (job->child_stderr_fd, TRUE, NULL);
+  job->child_stderr_source = g_unix_fd_source_new (job->child_stderr_fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
 #if __GNUC__ >= 8
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-function-type"
@@ -1071,6 +1430,30 @@ void udisks_spawned_job_start (UDisksSpawnedJob *job)
   g_strfreev (child_argv);
 }
 
+/**
+ * udisks_spawned_job_start:
+ * @job: the job to start
+ *
+ * Connect to the #UDisksSpawnedJob::spawned-job-completed or
+ * #UDisksJob::completed signals to get notified when the job is done.
+ *
+ * If too many jobs are running already, @job is queued and the command
+ * is spawned later, see #UDisksJobScheduler.
+ */
+void
+udisks_spawned_job_start (UDisksSpawnedJob *job)
+{
+  UDisksDaemon *daemon;
+
+  daemon = udisks_base_job_get_daemon (UDISKS_BASE_JOB (job));
+  if (daemon != NULL)
+    udisks_job_scheduler_submit (udisks_daemon_get_job_scheduler (daemon),
+                                 UDISKS_BASE_JOB (job),
+                                 spawned_job_start_now);
+  else
+    spawned_job_start_now (UDISKS_BASE_JOB (job));
+}
+
 /* manage strings with potentially unsafe content */
 
 static gpointer
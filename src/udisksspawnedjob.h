@@ -37,6 +37,12 @@ UDisksSpawnedJob  *udisks_spawned_job_new              (const gchar  *command_li
                                                         UDisksDaemon *daemon,
                                                         GCancellable *cancellable);
 const gchar       *udisks_spawned_job_get_command_line (UDisksSpawnedJob *job);
+void               udisks_spawned_job_set_output_limit (UDisksSpawnedJob *job,
+                                                        gsize             limit);
+void               udisks_spawned_job_set_progress_func (UDisksSpawnedJob             *job,
+                                                         UDisksSpawnedJobProgressFunc  func,
+                                                         gpointer                      user_data,
+                                                         GDestroyNotify                user_data_free_func);
 void udisks_spawned_job_start (UDisksSpawnedJob *job);
 
 G_END_DECLS
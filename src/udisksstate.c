@@ -30,8 +30,11 @@
 #include <sys/ioctl.h>
 #include <linux/loop.h>
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "udisksdaemon.h"
 #include "udisksstate.h"
@@ -41,6 +44,7 @@
 #include "udiskslinuxprovider.h"
 #include "udisksdaemonutil.h"
 #include "udiskslinuxencryptedhelpers.h"
+#include "udiskstrace.h"
 
 /**
  * SECTION:udisksstate
@@ -126,6 +130,18 @@
  *     </tbody>
  *   </tgroup>
  * </table>
+ * Changes are not written by rewriting these files. Instead, each
+ * changed or removed entry is appended as a record to a journal next to
+ * the file, e.g. <filename>/run/udisks2/loop.journal</filename>. A record
+ * is a fixed-size header, made of a magic number, the operation and the
+ * size of the payload, followed by the serialized '{sa{sv}}' or
+ * '{ta{sv}}' entry padded to 8 bytes. Removals carry the entry with no
+ * details. Once the journal grows larger than the file itself (and a
+ * minimum size), it is folded back into the file, which is replaced
+ * atomically, and removed. When read, the file is mapped into memory and
+ * the journal, if any, is replayed on top of it. A torn record at the
+ * end of the journal, e.g. after a crash, ends the replay.
+ *
  * Cleaning up is implemented by running a thread (to ensure that
  * actions are serialized) that checks all data in the files mentioned
  * above and cleans up the entry in question by e.g. unmounting a
@@ -158,10 +174,70 @@ struct _UDisksState
   GMainContext *context;
   GMainLoop *loop;
 
-  /* key-path -> GVariant */
+  /* key-path -> GVariant, authoritative once loaded */
   GHashTable *cache;
+
+  /* "key:detail" -> (lookup key -> entry), see udisks_state_get_index() */
+  GHashTable *indexes;
+
+  /* key-path -> key, for entries in @cache not yet written out */
+  GHashTable *dirty;
+  /* key-path -> JournalState, what the file and its journal on disk amount to */
+  GHashTable *journals;
+  /* pending write-back, attached to @context */
+  GSource *flush_source;
+  /* TRUE while the clean-up thread is running and writes are deferred */
+  gboolean write_back;
+
+  /* dev_t -> dev_t, block devices to check on the next targeted check */
+  GHashTable *devs_to_check;
+  /* pending targeted check, attached to @context */
+  GSource *check_source;
+  /* periodic full check, attached to @context */
+  GSource *full_check_source;
 };
 
+/* How often to check all entries, independently of which devices changed */
+#define UDISKS_STATE_FULL_CHECK_INTERVAL_SECONDS (10 * 60)
+
+/* How long to coalesce state changes before writing them out */
+#define UDISKS_STATE_FLUSH_DELAY_MSEC 100
+
+/* Journals are never folded back into their file while smaller than this */
+#define UDISKS_STATE_JOURNAL_MIN_COMPACT_SIZE (64 * 1024)
+
+#define JOURNAL_RECORD_MAGIC 0x4a534455 /* "UDSJ" */
+
+typedef enum
+{
+  JOURNAL_OP_SET = 1,
+  JOURNAL_OP_REMOVE = 2
+} JournalOp;
+
+/* followed by @size bytes of the serialized entry, padded to 8 bytes */
+typedef struct
+{
+  guint32 magic;
+  guint32 op;
+  guint64 size;
+} JournalRecordHeader;
+
+typedef struct
+{
+  /* the value the file and the journal amount to, in normal form */
+  GVariant *written;
+  /* the size of the journal in bytes */
+  gsize journal_size;
+} JournalState;
+
+static void
+journal_state_free (JournalState *journal)
+{
+  if (journal->written != NULL)
+    g_variant_unref (journal->written);
+  g_slice_free (JournalState, journal);
+}
+
 typedef struct _UDisksStateClass UDisksStateClass;
 
 struct _UDisksStateClass
@@ -175,16 +251,21 @@ enum
   PROP_DAEMON
 };
 
-static void      udisks_state_check_in_thread     (UDisksState          *state);
+static void      udisks_state_check_in_thread     (UDisksState          *state,
+                                                   GHashTable           *devs_to_check);
 static void      udisks_state_check_mounted_fs    (UDisksState          *state,
+                                                   GHashTable           *devs_to_check,
                                                    GArray               *devs_to_clean);
 static void      udisks_state_check_unlocked_crypto_dev (UDisksState          *state,
+                                                         GHashTable           *devs_to_check,
                                                          gboolean              check_only,
                                                          GArray               *devs_to_clean);
 static void      udisks_state_check_loop          (UDisksState          *state,
+                                                   GHashTable           *devs_to_check,
                                                    gboolean              check_only,
                                                    GArray               *devs_to_clean);
 static void      udisks_state_check_mdraid        (UDisksState          *state,
+                                                   GHashTable           *devs_to_check,
                                                    gboolean              check_only,
                                                    GArray               *devs_to_clean);
 static GVariant *udisks_state_get                 (UDisksState          *state,
@@ -195,6 +276,12 @@ static gboolean  udisks_state_set                 (UDisksState          *state,
                                                    const gchar          *key,
                                                    const GVariantType   *type,
                                                    GVariant             *value);
+static void      udisks_state_flush_unlocked      (UDisksState          *state);
+static GVariant *udisks_state_lookup_entry        (UDisksState          *state,
+                                                   const gchar          *key,
+                                                   const GVariantType   *type,
+                                                   const gchar          *detail,
+                                                   GVariant             *lookup_key);
 
 G_DEFINE_TYPE (UDisksState, udisks_state, G_TYPE_OBJECT);
 
@@ -203,6 +290,10 @@ udisks_state_init (UDisksState *state)
 {
   g_mutex_init (&state->lock);
   state->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_variant_unref);
+  state->indexes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_hash_table_unref);
+  state->dirty = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  state->journals = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) journal_state_free);
+  state->devs_to_check = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
 }
 
 static void
@@ -210,6 +301,14 @@ udisks_state_finalize (GObject *object)
 {
   UDisksState *state = UDISKS_STATE (object);
 
+  g_mutex_lock (&state->lock);
+  udisks_state_flush_unlocked (state);
+  g_mutex_unlock (&state->lock);
+
+  g_hash_table_unref (state->devs_to_check);
+  g_hash_table_unref (state->dirty);
+  g_hash_table_unref (state->journals);
+  g_hash_table_unref (state->indexes);
   g_hash_table_unref (state->cache);
   g_mutex_clear (&state->lock);
 
@@ -302,6 +401,14 @@ udisks_state_new (UDisksDaemon *daemon)
                                      NULL));
 }
 
+static gboolean
+udisks_state_full_check_func (gpointer user_data)
+{
+  UDisksState *state = UDISKS_STATE (user_data);
+  udisks_state_check_in_thread (state, NULL);
+  return G_SOURCE_CONTINUE;
+}
+
 static gpointer
 udisks_state_thread_func (gpointer user_data)
 {
@@ -331,6 +438,10 @@ udisks_state_thread_func (gpointer user_data)
  *
  * The clean-up thread will hold a reference to @state for as long as
  * it's running - use udisks_state_stop_cleanup() to stop it.
+ *
+ * While the clean-up thread is running, changes to the state files
+ * are written out from it in batches instead of synchronously. All
+ * entries are also checked periodically, see udisks_state_check_block().
  */
 void
 udisks_state_start_cleanup (UDisksState *state)
@@ -340,9 +451,23 @@ udisks_state_start_cleanup (UDisksState *state)
 
   state->context = g_main_context_new ();
   state->loop = g_main_loop_new (state->context, FALSE);
+
+  state->full_check_source = udisks_daemon_util_timeout_source_new (state->daemon,
+                                                                    "state-full-check",
+                                                                    UDISKS_STATE_FULL_CHECK_INTERVAL_SECONDS);
+  g_source_set_callback (state->full_check_source,
+                         udisks_state_full_check_func,
+                         state,
+                         NULL);
+  g_source_attach (state->full_check_source, state->context);
+
   state->thread = g_thread_new ("cleanup",
                                 udisks_state_thread_func,
                                 g_object_ref (state));
+
+  g_mutex_lock (&state->lock);
+  state->write_back = TRUE;
+  g_mutex_unlock (&state->lock);
 }
 
 /**
@@ -350,6 +475,8 @@ udisks_state_start_cleanup (UDisksState *state)
  * @state: A #UDisksState.
  *
  * Stops the clean-up thread. Blocks the calling thread until it has stopped.
+ *
+ * Any pending changes to the state files are written out before returning.
  */
 void
 udisks_state_stop_cleanup (UDisksState *state)
@@ -359,6 +486,28 @@ udisks_state_stop_cleanup (UDisksState *state)
   g_return_if_fail (UDISKS_IS_STATE (state));
   g_return_if_fail (state->thread != NULL);
 
+  g_mutex_lock (&state->lock);
+  state->write_back = FALSE;
+  if (state->flush_source != NULL)
+    {
+      g_source_destroy (state->flush_source);
+      g_source_unref (state->flush_source);
+      state->flush_source = NULL;
+    }
+  if (state->check_source != NULL)
+    {
+      g_source_destroy (state->check_source);
+      g_source_unref (state->check_source);
+      state->check_source = NULL;
+    }
+  g_hash_table_remove_all (state->devs_to_check);
+  udisks_state_flush_unlocked (state);
+  g_mutex_unlock (&state->lock);
+
+  g_source_destroy (state->full_check_source);
+  g_source_unref (state->full_check_source);
+  state->full_check_source = NULL;
+
   thread = state->thread;
   g_main_loop_quit (state->loop);
   g_thread_join (thread);
@@ -368,7 +517,7 @@ static gboolean
 udisks_state_check_func (gpointer user_data)
 {
   UDisksState *state = UDISKS_STATE (user_data);
-  udisks_state_check_in_thread (state);
+  udisks_state_check_in_thread (state, NULL);
   return FALSE;
 }
 
@@ -378,6 +527,9 @@ udisks_state_check_func (gpointer user_data)
  *
  * Causes the clean-up thread for @state to check if anything should be cleaned up.
  *
+ * All entries are checked. If only a known block device changed, use
+ * udisks_state_check_block() instead.
+ *
  * This can be called from any thread and will not block the calling thread.
  */
 void
@@ -391,6 +543,81 @@ udisks_state_check (UDisksState *state)
                          state);
 }
 
+static gboolean
+udisks_state_check_block_func (gpointer user_data)
+{
+  UDisksState *state = UDISKS_STATE (user_data);
+  GHashTable *devs_to_check;
+
+  g_mutex_lock (&state->lock);
+  if (state->check_source != NULL)
+    {
+      g_source_unref (state->check_source);
+      state->check_source = NULL;
+    }
+  devs_to_check = state->devs_to_check;
+  state->devs_to_check = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free, NULL);
+  g_mutex_unlock (&state->lock);
+
+  if (g_hash_table_size (devs_to_check) > 0)
+    udisks_state_check_in_thread (state, devs_to_check);
+  g_hash_table_unref (devs_to_check);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+dev_set_add (GHashTable *set,
+             dev_t       dev)
+{
+  gint64 *key;
+
+  key = g_new (gint64, 1);
+  *key = dev;
+  g_hash_table_add (set, key);
+}
+
+static gboolean
+dev_set_contains (GHashTable *set,
+                  dev_t       dev)
+{
+  gint64 key = dev;
+  return g_hash_table_contains (set, &key);
+}
+
+/**
+ * udisks_state_check_block:
+ * @state: A #UDisksState.
+ * @block_device: The #dev_t of a block device that changed or went away.
+ *
+ * Like udisks_state_check() but only the entries referencing
+ * @block_device (and the filesystems mounted from devices that are
+ * cleaned up as a result) are checked.
+ *
+ * Calls made before the clean-up thread gets to run are coalesced
+ * into a single check. This can be called from any thread and will
+ * not block the calling thread.
+ */
+void
+udisks_state_check_block (UDisksState *state,
+                          dev_t        block_device)
+{
+  g_return_if_fail (UDISKS_IS_STATE (state));
+  g_return_if_fail (state->thread != NULL);
+
+  g_mutex_lock (&state->lock);
+  dev_set_add (state->devs_to_check, block_device);
+  if (state->check_source == NULL)
+    {
+      state->check_source = g_idle_source_new ();
+      g_source_set_callback (state->check_source,
+                             udisks_state_check_block_func,
+                             state,
+                             NULL);
+      g_source_attach (state->check_source, state->context);
+    }
+  g_mutex_unlock (&state->lock);
+}
 
 typedef struct
 {
@@ -403,7 +630,7 @@ typedef struct
 static gboolean
 udisks_state_check_sync_func (UDisksStateCheckSyncData *data)
 {
-  udisks_state_check_in_thread (data->state);
+  udisks_state_check_in_thread (data->state, NULL);
 
   /* signal the calling thread the cleanup has finished */
   g_mutex_lock (&data->data_mutex);
@@ -466,11 +693,17 @@ udisks_state_get_daemon (UDisksState *state)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* must be called from state thread */
+/* must be called from state thread
+ *
+ * If @devs_to_check is not %NULL, only entries referencing one of
+ * the devices in it are checked.
+ */
 static void
-udisks_state_check_in_thread (UDisksState *state)
+udisks_state_check_in_thread (UDisksState *state,
+                              GHashTable  *devs_to_check)
 {
   GArray *devs_to_clean;
+  guint n;
 
   g_mutex_lock (&state->lock);
 
@@ -478,39 +711,57 @@ udisks_state_check_in_thread (UDisksState *state)
    * can't be stopped if they are in use
    */
 
-  udisks_info ("Cleanup check start");
+  if (devs_to_check != NULL)
+    udisks_info ("Cleanup check start (%u devices)", g_hash_table_size (devs_to_check));
+  else
+    udisks_info ("Cleanup check start");
 
   /* First go through all block devices we might tear down
    * but only check + record devices marked for cleaning
    */
   devs_to_clean = g_array_new (FALSE, FALSE, sizeof (dev_t));
   udisks_state_check_unlocked_crypto_dev (state,
+                                          devs_to_check,
                                           TRUE, /* check_only */
                                           devs_to_clean);
   udisks_state_check_loop (state,
+                           devs_to_check,
                            TRUE, /* check_only */
                            devs_to_clean);
 
   udisks_state_check_mdraid (state,
+                             devs_to_check,
                              TRUE, /* check_only */
                              devs_to_clean);
 
+  /* Filesystems mounted from the devices we intend to clean need
+   * to be checked as well
+   */
+  if (devs_to_check != NULL)
+    {
+      for (n = 0; n < devs_to_clean->len; n++)
+        dev_set_add (devs_to_check, g_array_index (devs_to_clean, dev_t, n));
+    }
+
   /* Then go through all mounted filesystems and pass the
    * devices that we intend to clean...
    */
-  udisks_state_check_mounted_fs (state, devs_to_clean);
+  udisks_state_check_mounted_fs (state, devs_to_check, devs_to_clean);
 
   /* Then go through all block devices and clear them up
    * ... for real this time
    */
   udisks_state_check_unlocked_crypto_dev (state,
+                                          devs_to_check,
                                           FALSE, /* check_only */
                                           NULL);
   udisks_state_check_loop (state,
+                           devs_to_check,
                            FALSE, /* check_only */
                            NULL);
 
   udisks_state_check_mdraid (state,
+                             devs_to_check,
                              FALSE, /* check_only */
                              NULL);
 
@@ -830,9 +1081,30 @@ udisks_state_check_mounted_fs_entry (UDisksState  *state,
   return keep;
 }
 
+/* returns TRUE if the entry references a device in @devs_to_check */
+static gboolean
+udisks_state_mounted_fs_entry_is_affected (GVariant   *value,
+                                           GHashTable *devs_to_check)
+{
+  GVariant *details;
+  GVariant *block_device_value;
+  gboolean ret;
+
+  g_variant_get (value, "{&s@a{sv}}", NULL, &details);
+  block_device_value = lookup_asv (details, "block-device");
+  /* invalid entries are always checked */
+  ret = block_device_value == NULL ||
+        dev_set_contains (devs_to_check, g_variant_get_uint64 (block_device_value));
+  if (block_device_value != NULL)
+    g_variant_unref (block_device_value);
+  g_variant_unref (details);
+  return ret;
+}
+
 /* called with mutex->lock held */
 static void
 udisks_state_check_mounted_fs (UDisksState *state,
+                               GHashTable  *devs_to_check,
                                GArray      *devs_to_clean)
 {
   gboolean changed;
@@ -860,7 +1132,8 @@ udisks_state_check_mounted_fs (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_mounted_fs_entry (state, child, devs_to_clean))
+          if ((devs_to_check != NULL && !udisks_state_mounted_fs_entry_is_affected (child, devs_to_check)) ||
+              udisks_state_check_mounted_fs_entry (state, child, devs_to_clean))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -1008,7 +1281,6 @@ udisks_state_find_mounted_fs (UDisksState   *state,
 {
   gchar *ret;
   GVariant *value;
-  gboolean ok = FALSE;
 
   g_return_val_if_fail (UDISKS_IS_STATE (state), NULL);
 
@@ -1017,75 +1289,48 @@ udisks_state_find_mounted_fs (UDisksState   *state,
   ret = NULL;
   value = NULL;
 
-  /* load existing entries */
-  value = udisks_state_get (state,
-                            "mounted-fs",
-                            G_VARIANT_TYPE ("a{sa{sv}}"), &ok);
-  if (!ok)
-    goto out;
-
-  /* look through list */
+  value = udisks_state_lookup_entry (state,
+                                     "mounted-fs",
+                                     G_VARIANT_TYPE ("a{sa{sv}}"),
+                                     "block-device",
+                                     g_variant_new_uint64 (block_device));
   if (value != NULL)
     {
-      GVariantIter iter;
-      GVariant *child;
-      g_variant_iter_init (&iter, value);
-      while ((child = g_variant_iter_next_value (&iter)) != NULL)
-        {
-          const gchar *mount_point;
-          GVariant *details;
-          GVariant *block_device_value;
+      const gchar *mount_point;
+      GVariant *details;
 
-          g_variant_get (child,
-                         "{&s@a{sv}}",
-                         &mount_point,
-                         &details);
+      g_variant_get (value,
+                     "{&s@a{sv}}",
+                     &mount_point,
+                     &details);
 
-          block_device_value = lookup_asv (details, "block-device");
-          if (block_device_value != NULL)
+      ret = g_strdup (mount_point);
+      if (out_uid != NULL)
+        {
+          GVariant *lookup_value;
+          lookup_value = lookup_asv (details, "mounted-by-uid");
+          *out_uid = 0;
+          if (lookup_value != NULL)
             {
-              dev_t iter_block_device;
-              iter_block_device = g_variant_get_uint64 (block_device_value);
-              if (iter_block_device == block_device)
-                {
-                  ret = g_strdup (mount_point);
-                  if (out_uid != NULL)
-                    {
-                      GVariant *lookup_value;
-                      lookup_value = lookup_asv (details, "mounted-by-uid");
-                      *out_uid = 0;
-                      if (lookup_value != NULL)
-                        {
-                          *out_uid = g_variant_get_uint32 (lookup_value);
-                          g_variant_unref (lookup_value);
-                        }
-                    }
-                  if (out_fstab_mount != NULL)
-                    {
-                      GVariant *lookup_value;
-                      lookup_value = lookup_asv (details, "fstab-mount");
-                      *out_fstab_mount = FALSE;
-                      if (lookup_value != NULL)
-                        {
-                          *out_fstab_mount = g_variant_get_boolean (lookup_value);
-                          g_variant_unref (lookup_value);
-                        }
-                    }
-                  g_variant_unref (block_device_value);
-                  g_variant_unref (details);
-                  g_variant_unref (child);
-                  goto out;
-                }
-              g_variant_unref (block_device_value);
+              *out_uid = g_variant_get_uint32 (lookup_value);
+              g_variant_unref (lookup_value);
+            }
+        }
+      if (out_fstab_mount != NULL)
+        {
+          GVariant *lookup_value;
+          lookup_value = lookup_asv (details, "fstab-mount");
+          *out_fstab_mount = FALSE;
+          if (lookup_value != NULL)
+            {
+              *out_fstab_mount = g_variant_get_boolean (lookup_value);
+              g_variant_unref (lookup_value);
             }
-          g_variant_unref (details);
-          g_variant_unref (child);
         }
+      g_variant_unref (details);
+      g_variant_unref (value);
     }
 
- out:
-  if (value != NULL)
-    g_variant_unref (value);
   g_mutex_unlock (&state->lock);
   return ret;
 }
@@ -1253,9 +1498,32 @@ udisks_state_check_unlocked_crypto_dev_entry (UDisksState  *state,
   return keep;
 }
 
+/* returns TRUE if the entry references a device in @devs_to_check */
+static gboolean
+udisks_state_unlocked_crypto_dev_entry_is_affected (GVariant   *value,
+                                                    GHashTable *devs_to_check)
+{
+  guint64 cleartext_device;
+  GVariant *details;
+  GVariant *crypto_device_value;
+  gboolean ret;
+
+  g_variant_get (value, "{t@a{sv}}", &cleartext_device, &details);
+  crypto_device_value = lookup_asv (details, "crypto-device");
+  /* invalid entries are always checked */
+  ret = crypto_device_value == NULL ||
+        dev_set_contains (devs_to_check, cleartext_device) ||
+        dev_set_contains (devs_to_check, g_variant_get_uint64 (crypto_device_value));
+  if (crypto_device_value != NULL)
+    g_variant_unref (crypto_device_value);
+  g_variant_unref (details);
+  return ret;
+}
+
 /* called with mutex->lock held */
 static void
 udisks_state_check_unlocked_crypto_dev (UDisksState *state,
+                                        GHashTable  *devs_to_check,
                                         gboolean     check_only,
                                         GArray      *devs_to_clean)
 {
@@ -1284,7 +1552,8 @@ udisks_state_check_unlocked_crypto_dev (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_unlocked_crypto_dev_entry (state, child, check_only, devs_to_clean))
+          if ((devs_to_check != NULL && !udisks_state_unlocked_crypto_dev_entry_is_affected (child, devs_to_check)) ||
+              udisks_state_check_unlocked_crypto_dev_entry (state, child, check_only, devs_to_clean))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -1429,7 +1698,6 @@ udisks_state_find_unlocked_crypto_dev (UDisksState   *state,
 {
   dev_t ret;
   GVariant *value;
-  gboolean ok = FALSE;
 
   g_return_val_if_fail (UDISKS_IS_STATE (state), 0);
 
@@ -1438,64 +1706,37 @@ udisks_state_find_unlocked_crypto_dev (UDisksState   *state,
   ret = 0;
   value = NULL;
 
-  /* load existing entries */
-  value = udisks_state_get (state,
-                            "unlocked-crypto-dev",
-                            G_VARIANT_TYPE ("a{ta{sv}}"), &ok);
-  if (!ok)
-    goto out;
-
-  /* look through list */
+  value = udisks_state_lookup_entry (state,
+                                     "unlocked-crypto-dev",
+                                     G_VARIANT_TYPE ("a{ta{sv}}"),
+                                     "crypto-device",
+                                     g_variant_new_uint64 (crypto_device));
   if (value != NULL)
     {
-      GVariantIter iter;
-      GVariant *child;
-      g_variant_iter_init (&iter, value);
-      while ((child = g_variant_iter_next_value (&iter)) != NULL)
-        {
-          guint64 cleartext_device;
-          GVariant *details;
-          GVariant *crypto_device_value;
+      guint64 cleartext_device;
+      GVariant *details;
 
-          g_variant_get (child,
-                         "{t@a{sv}}",
-                         &cleartext_device,
-                         &details);
+      g_variant_get (value,
+                     "{t@a{sv}}",
+                     &cleartext_device,
+                     &details);
 
-          crypto_device_value = lookup_asv (details, "crypto-device");
-          if (crypto_device_value != NULL)
+      ret = cleartext_device;
+      if (out_uid != NULL)
+        {
+          GVariant *lookup_value;
+          lookup_value = lookup_asv (details, "unlocked-by-uid");
+          *out_uid = 0;
+          if (lookup_value != NULL)
             {
-              dev_t iter_crypto_device;
-              iter_crypto_device = g_variant_get_uint64 (crypto_device_value);
-              if (iter_crypto_device == crypto_device)
-                {
-                  ret = cleartext_device;
-                  if (out_uid != NULL)
-                    {
-                      GVariant *lookup_value;
-                      lookup_value = lookup_asv (details, "unlocked-by-uid");
-                      *out_uid = 0;
-                      if (lookup_value != NULL)
-                        {
-                          *out_uid = g_variant_get_uint32 (lookup_value);
-                          g_variant_unref (lookup_value);
-                        }
-                    }
-                  g_variant_unref (crypto_device_value);
-                  g_variant_unref (details);
-                  g_variant_unref (child);
-                  goto out;
-                }
-              g_variant_unref (crypto_device_value);
+              *out_uid = g_variant_get_uint32 (lookup_value);
+              g_variant_unref (lookup_value);
             }
-          g_variant_unref (details);
-          g_variant_unref (child);
         }
+      g_variant_unref (details);
+      g_variant_unref (value);
     }
 
- out:
-  if (value != NULL)
-    g_variant_unref (value);
   g_mutex_unlock (&state->lock);
   return ret;
 }
@@ -1595,8 +1836,24 @@ udisks_state_check_loop_entry (UDisksState  *state,
   return keep;
 }
 
+/* returns TRUE if the entry references a device in @devs_to_check */
+static gboolean
+udisks_state_loop_entry_is_affected (GVariant   *value,
+                                     GHashTable *devs_to_check)
+{
+  const gchar *loop_device;
+  struct stat statbuf;
+
+  g_variant_get (value, "{&s@a{sv}}", &loop_device, NULL);
+  /* if the device node is gone, let the entry check deal with it */
+  if (stat (loop_device, &statbuf) != 0 || !S_ISBLK (statbuf.st_mode))
+    return TRUE;
+  return dev_set_contains (devs_to_check, statbuf.st_rdev);
+}
+
 static void
 udisks_state_check_loop (UDisksState *state,
+                         GHashTable  *devs_to_check,
                          gboolean     check_only,
                          GArray      *devs_to_clean)
 {
@@ -1625,7 +1882,8 @@ udisks_state_check_loop (UDisksState *state,
       g_variant_iter_init (&iter, value);
       while ((child = g_variant_iter_next_value (&iter)) != NULL)
         {
-          if (udisks_state_check_loop_entry (state, child, check_only, devs_to_clean))
+          if ((devs_to_check != NULL && !udisks_state_loop_entry_is_affected (child, devs_to_check)) ||
+              udisks_state_check_loop_entry (state, child, check_only, devs_to_clean))
             g_variant_builder_add_value (&builder, child);
           else
             changed = TRUE;
@@ -1753,123 +2011,59 @@ udisks_state_add_loop (UDisksState   *state,
 }
 
 /**
- * node_cb:
- * @child:          Element in the list you are visiting
- * @compare_data:   Data used for comparison
- * @user_data:      Data supplied by call to iterate list
+ * udisks_state_has_loop:
+ * @state: A #UDisksState
+ * @device_file: A loop device file.
+ * @out_uid: Return location for the user id who setup the loop device or %NULL.
+ * @error: Return location for error or %NULL.
  *
- * Returns: %TRUE if the iteration should stop, else %FALSE
- */
-typedef gboolean (*node_cb)(GVariant *child, gpointer compare_data,
-                            gpointer user_data);
-
-
-/**
- * iterate_list:
- * @list:           The list to iterate over
- * @visit:          The function called on each element in the list
- * @compare_data:   Data used for comparison
- * @user_data:      Pointer to user supplied data
+ * Checks if @device_file is set up via udisks.
  *
- * Returns: %TRUE if iteration was stopped by node_cb, else %FALSE
+ * Returns: %TRUE if set up via udisks, otherwise %FALSE or if @error is set.
  */
-static gboolean
-iterate_list (GVariant *list, node_cb visit, gpointer compare_data,
-              gpointer user_data)
-{
-  gboolean rc = FALSE;
-  GVariantIter iter;
-  GVariant *child = NULL;
-
-  if (!list)
-    return rc;
-
-  g_variant_iter_init (&iter, list);
-
-  while (!rc && ((child = g_variant_iter_next_value (&iter)) != NULL))
-    {
-      rc = visit (child, compare_data, user_data);
-      g_variant_unref (child);
-    }
-
-  return rc;
-}
-
-static gboolean
-_udisks_state_has_loop_list_visitor (GVariant *child, gpointer compare_data,
-                                     gpointer user_data )
+gboolean
+udisks_state_has_loop (UDisksState   *state,
+                       const gchar   *device_file,
+                       uid_t         *out_uid)
 {
   gboolean ret = FALSE;
-  const gchar *iter_device_file = NULL;
-  GVariant *details = NULL;
-  uid_t *out_uid = (uid_t *) user_data;
+  GVariant *value = NULL;
+
+  g_return_val_if_fail (UDISKS_IS_STATE (state), FALSE);
 
-  g_variant_get (child, "{&s@a{sv}}", &iter_device_file, &details);
+  g_mutex_lock (&state->lock);
 
-  if (g_strcmp0 (iter_device_file, ((gchar*)compare_data)) == 0)
+  value = udisks_state_lookup_entry (state,
+                                     "loop",
+                                     G_VARIANT_TYPE ("a{sa{sv}}"),
+                                     NULL,
+                                     g_variant_new_string (device_file));
+  if (value != NULL)
     {
+      ret = TRUE;
       if (out_uid != NULL)
         {
+          GVariant *details;
           GVariant *lookup_value;
+
+          details = g_variant_get_child_value (value, 1);
           lookup_value = lookup_asv (details, "setup-by-uid");
           *out_uid = 0;
           if (lookup_value != NULL)
             {
               *out_uid = g_variant_get_uint32 (lookup_value);
               g_variant_unref (lookup_value);
-              ret = TRUE;
             }
+          g_variant_unref (details);
         }
+      g_variant_unref (value);
     }
-    g_variant_unref (details);
 
-    return ret;
+  g_mutex_unlock (&state->lock);
+  return ret;
 }
 
-/**
- * udisks_state_has_loop:
- * @state: A #UDisksState
- * @device_file: A loop device file.
- * @out_uid: Return location for the user id who setup the loop device or %NULL.
- * @error: Return location for error or %NULL.
- *
- * Checks if @device_file is set up via udisks.
- *
- * Returns: %TRUE if set up via udisks, otherwise %FALSE or if @error is set.
- */
-gboolean
-udisks_state_has_loop (UDisksState   *state,
-                       const gchar   *device_file,
-                       uid_t         *out_uid)
-{
-  gboolean ret;
-  GVariant *value;
-  gboolean ok = FALSE;
-
-  g_return_val_if_fail (UDISKS_IS_STATE (state), FALSE);
-
-  g_mutex_lock (&state->lock);
-
-  ret = 0;
-  value = NULL;
-
-  /* load existing entries */
-  value = udisks_state_get (state,
-                            "loop",
-                            G_VARIANT_TYPE ("a{sa{sv}}"), &ok);
-  if (ok && value)
-   {
-      ret = iterate_list (value,
-                          _udisks_state_has_loop_list_visitor,
-                          (gpointer) device_file, (gpointer) out_uid);
-      g_variant_unref (value);
-   }
-
-  g_mutex_unlock (&state->lock);
-  return ret;
-}
-
-/* ---------------------------------------------------------------------------------------------------- */
+/* ---------------------------------------------------------------------------------------------------- */
 
 /* returns TRUE if the entry should be kept */
 static gboolean
@@ -1940,8 +2134,20 @@ udisks_state_check_mdraid_entry (UDisksState  *state,
   return keep;
 }
 
+/* returns TRUE if the entry references a device in @devs_to_check */
+static gboolean
+udisks_state_mdraid_entry_is_affected (GVariant   *value,
+                                       GHashTable *devs_to_check)
+{
+  guint64 raid_device;
+
+  g_variant_get (value, "{t@a{sv}}", &raid_device, NULL);
+  return dev_set_contains (devs_to_check, raid_device);
+}
+
 static void
 udisks_state_check_mdraid (UDisksState *state,
+                           GHashTable  *devs_to_check,
                            gboolean     check_only,
                            GArray      *devs_to_clean)
 {
@@ -2081,24 +2287,43 @@ udisks_state_add_mdraid (UDisksState   *state,
   g_mutex_unlock (&state->lock);
 }
 
-static gboolean
-_udisks_state_has_mdraid_list_visitor (GVariant *child, gpointer compare_data,
-                                       gpointer user_data )
+/**
+ * udisks_state_has_mdraid:
+ * @state: A #UDisksState
+ * @raid_device: A #dev_t for the RAID device.
+ * @out_uid: Return location for the user id who setup the loop device or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Checks if @raid_device is set up via udisks.
+ *
+ * Returns: %TRUE if set up via udisks, otherwise %FALSE or if @error is set.
+ */
+gboolean
+udisks_state_has_mdraid (UDisksState   *state,
+                         dev_t          raid_device,
+                         uid_t         *out_uid)
 {
   gboolean ret = FALSE;
-  guint64 iter_raid_device;
-  GVariant *details;
-  dev_t *raid_device = (dev_t*) compare_data;
-  uid_t *out_uid = (uid_t*) user_data;
+  GVariant *value = NULL;
+
+  g_return_val_if_fail (UDISKS_IS_STATE (state), FALSE);
 
-  g_variant_get (child, "{t@a{sv}}", &iter_raid_device, &details);
+  g_mutex_lock (&state->lock);
 
-  if (iter_raid_device == *raid_device)
+  value = udisks_state_lookup_entry (state,
+                                     "mdraid",
+                                     G_VARIANT_TYPE ("a{ta{sv}}"),
+                                     NULL,
+                                     g_variant_new_uint64 (raid_device));
+  if (value != NULL)
     {
       ret = TRUE;
       if (out_uid != NULL)
         {
+          GVariant *details;
           GVariant *lookup_value;
+
+          details = g_variant_get_child_value (value, 1);
           lookup_value = lookup_asv (details, "started-by-uid");
           *out_uid = 0;
           if (lookup_value != NULL)
@@ -2106,53 +2331,218 @@ _udisks_state_has_mdraid_list_visitor (GVariant *child, gpointer compare_data,
               *out_uid = g_variant_get_uint32 (lookup_value);
               g_variant_unref (lookup_value);
             }
+          g_variant_unref (details);
         }
-      g_variant_unref (details);
+      g_variant_unref (value);
     }
+
+  g_mutex_unlock (&state->lock);
   return ret;
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
 /**
- * udisks_state_has_mdraid:
+ * udisks_state_has_entries:
  * @state: A #UDisksState
- * @raid_device: A #dev_t for the RAID device.
- * @out_uid: Return location for the user id who setup the loop device or %NULL.
- * @error: Return location for error or %NULL.
  *
- * Checks if @raid_device is set up via udisks.
+ * Checks if anything set up via udisks (mounted filesystems, unlocked
+ * encrypted devices, loop devices and RAID arrays) needs to be cleaned up
+ * by the daemon eventually.
  *
- * Returns: %TRUE if set up via udisks, otherwise %FALSE or if @error is set.
+ * Returns: %TRUE if any entries are recorded in @state, otherwise %FALSE.
  */
 gboolean
-udisks_state_has_mdraid (UDisksState   *state,
-                         dev_t          raid_device,
-                         uid_t         *out_uid)
+udisks_state_has_entries (UDisksState *state)
 {
+  static const struct
+  {
+    const gchar *key;
+    const gchar *type;
+  } keys[] = {
+    { "mounted-fs", "a{sa{sv}}" },
+    { "unlocked-crypto-dev", "a{ta{sv}}" },
+    { "loop", "a{sa{sv}}" },
+    { "mdraid", "a{ta{sv}}" },
+  };
   gboolean ret = FALSE;
-  GVariant *value = NULL;
-  gboolean ok = FALSE;
+  guint n;
 
   g_return_val_if_fail (UDISKS_IS_STATE (state), FALSE);
 
   g_mutex_lock (&state->lock);
-
-  /* load existing entries */
-  value = udisks_state_get (state,
-                            "mdraid",
-                            G_VARIANT_TYPE ("a{ta{sv}}"), &ok);
-  if (ok && value)
+  for (n = 0; n < G_N_ELEMENTS (keys) && !ret; n++)
     {
-      ret = iterate_list (value, _udisks_state_has_mdraid_list_visitor,
-                          (gpointer) &raid_device, (gpointer) out_uid);
-      g_variant_unref (value);
+      GVariant *value;
+      gboolean ok;
+
+      value = udisks_state_get (state, keys[n].key, G_VARIANT_TYPE (keys[n].type), &ok);
+      /* play it safe if the state can't be read */
+      if (!ok)
+        ret = TRUE;
+      if (value != NULL)
+        {
+          if (g_variant_n_children (value) > 0)
+            ret = TRUE;
+          g_variant_unref (value);
+        }
     }
-
   g_mutex_unlock (&state->lock);
+
   return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gchar *
+udisks_state_get_path (const gchar *key)
+{
+#ifdef HAVE_FHS_MEDIA
+  /* /media usually isn't on a tmpfs, so we need to make this persistant */
+  if (strcmp (key, "mounted-fs") == 0)
+    return g_strdup_printf (PACKAGE_LOCALSTATE_DIR "/lib/udisks2/%s", key);
+#endif
+  return g_strdup_printf ("/run/udisks2/%s", key);
+}
+
+static gchar *
+udisks_state_get_journal_path (const gchar *path)
+{
+  return g_strdup_printf ("%s.journal", path);
+}
+
+/* Maps @path into memory, returns %NULL if it doesn't exist or, with
+ * *ok set to %FALSE, can't be read
+ */
+static GBytes *
+map_file (const gchar *key,
+          const gchar *path,
+          gboolean    *ok)
+{
+  GMappedFile *mapped_file;
+  GBytes *ret;
+  GError *error = NULL;
+
+  mapped_file = g_mapped_file_new (path, FALSE, &error);
+  if (mapped_file == NULL)
+    {
+      if (error->domain != G_FILE_ERROR || error->code != G_FILE_ERROR_NOENT)
+        {
+          *ok = FALSE;
+          udisks_warning ("Error getting %s: %s (%s, %d)",
+                          key,
+                          error->message,
+                          g_quark_to_string (error->domain),
+                          error->code);
+        }
+      g_clear_error (&error);
+      return NULL;
+    }
+
+  ret = g_mapped_file_get_bytes (mapped_file);
+  g_mapped_file_unref (mapped_file);
+  return ret;
+}
+
+/* Replays the journal in @journal_data on top of @value, a '{?a{sv}}'
+ * array, returns the resulting value and sets *out_valid_size to the
+ * number of bytes of complete records.
+ */
+static GVariant *
+replay_journal (const gchar        *journal_path,
+                const GVariantType *type,
+                GVariant           *value,
+                GBytes             *journal_data,
+                gsize              *out_valid_size)
+{
+  const GVariantType *entry_type;
+  GHashTable *entries;
+  GQueue order = G_QUEUE_INIT;
+  GVariantBuilder builder;
+  const guchar *data;
+  gsize length;
+  gsize offset = 0;
+  GList *l;
+
+  entry_type = g_variant_type_element (type);
+
+  /* lookup key -> entry, @order keeps the keys in order */
+  entries = g_hash_table_new_full (g_variant_hash, g_variant_equal,
+                                   (GDestroyNotify) g_variant_unref,
+                                   (GDestroyNotify) g_variant_unref);
+  if (value != NULL)
+    {
+      GVariantIter iter;
+      GVariant *child;
+
+      g_variant_iter_init (&iter, value);
+      while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          GVariant *lookup_key = g_variant_get_child_value (child, 0);
+          if (!g_hash_table_contains (entries, lookup_key))
+            g_queue_push_tail (&order, g_variant_ref (lookup_key));
+          g_hash_table_insert (entries, lookup_key, child);
+        }
+    }
+
+  data = g_bytes_get_data (journal_data, &length);
+  while (offset < length)
+    {
+      JournalRecordHeader header;
+      guint64 padded_size;
+      GBytes *entry_data;
+      GVariant *entry;
+      GVariant *lookup_key;
+
+      if (length - offset < sizeof (header))
+        break;
+      memcpy (&header, data + offset, sizeof (header));
+      padded_size = (header.size + 7) & ~((guint64) 7);
+      if (header.magic != JOURNAL_RECORD_MAGIC ||
+          (header.op != JOURNAL_OP_SET && header.op != JOURNAL_OP_REMOVE) ||
+          padded_size < header.size ||
+          padded_size > length - offset - sizeof (header))
+        break;
+
+      entry_data = g_bytes_new_from_bytes (journal_data, offset + sizeof (header), header.size);
+      entry = g_variant_ref_sink (g_variant_new_from_bytes (entry_type, entry_data, FALSE));
+      g_bytes_unref (entry_data);
+
+      lookup_key = g_variant_get_child_value (entry, 0);
+      if (header.op == JOURNAL_OP_SET)
+        {
+          if (!g_hash_table_contains (entries, lookup_key))
+            g_queue_push_tail (&order, g_variant_ref (lookup_key));
+          g_hash_table_insert (entries, g_variant_ref (lookup_key), g_variant_ref (entry));
+        }
+      else
+        {
+          g_hash_table_remove (entries, lookup_key);
+        }
+      g_variant_unref (lookup_key);
+      g_variant_unref (entry);
+
+      offset += sizeof (header) + padded_size;
+    }
+
+  if (offset < length)
+    udisks_warning ("Ignoring %" G_GSIZE_FORMAT " bytes of incomplete records at the end of %s",
+                    length - offset, journal_path);
+  *out_valid_size = offset;
+
+  g_variant_builder_init (&builder, type);
+  for (l = order.head; l != NULL; l = l->next)
+    {
+      GVariant *entry = g_hash_table_lookup (entries, l->data);
+      if (entry != NULL)
+        g_variant_builder_add_value (&builder, entry);
+    }
+  g_queue_free_full (&order, (GDestroyNotify) g_variant_unref);
+  g_hash_table_unref (entries);
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
 static GVariant *
 udisks_state_get (UDisksState           *state,
                   const gchar           *key,
@@ -2160,10 +2550,11 @@ udisks_state_get (UDisksState           *state,
                   gboolean              *ok)
 {
   gchar *path = NULL;
+  gchar *journal_path = NULL;
   GVariant *ret = NULL;
-  gchar *contents = NULL;
-  GError *local_error = NULL;
-  gsize length = 0;
+  GBytes *data = NULL;
+  GBytes *journal_data = NULL;
+  JournalState *journal;
 
   *ok = TRUE;
 
@@ -2172,20 +2563,7 @@ udisks_state_get (UDisksState           *state,
   g_return_val_if_fail (g_variant_type_is_definite (type), NULL);
   g_return_val_if_fail (ok != NULL, NULL);
 
-  /* TODO:
-   *
-   * - could use a cache here to avoid loading files all the time
-   * - could also mmap the file
-   */
-
-#ifdef HAVE_FHS_MEDIA
-  /* /media usually isn't on a tmpfs, so we need to make this persistant */
-  if (strcmp (key, "mounted-fs") == 0)
-    path = g_strdup_printf (PACKAGE_LOCALSTATE_DIR "/lib/udisks2/%s", key);
-  else
-#endif
-    path = g_strdup_printf ("/run/udisks2/%s", key);
-
+  path = udisks_state_get_path (key);
 
   /* see if it's already in the cache */
   ret = g_hash_table_lookup (state->cache, path);
@@ -2195,78 +2573,205 @@ udisks_state_get (UDisksState           *state,
       goto out;
     }
 
-  if (!g_file_get_contents (path,
-                            &contents,
-                            &length,
-                            &local_error))
+  data = map_file (key, path, ok);
+  if (!*ok)
+    goto out;
+  if (data != NULL)
+    ret = g_variant_ref_sink (g_variant_new_from_bytes (type, data, FALSE));
+
+  journal = g_slice_new0 (JournalState);
+
+  journal_path = udisks_state_get_journal_path (path);
+  journal_data = map_file (key, journal_path, ok);
+  if (!*ok)
     {
-      if (local_error->domain == G_FILE_ERROR && local_error->code == G_FILE_ERROR_NOENT)
-        {
-          /* this is not an error */
-          g_clear_error (&local_error);
-          goto out;
-        }
+      journal_state_free (journal);
+      g_clear_pointer (&ret, g_variant_unref);
+      goto out;
+    }
+  if (journal_data != NULL)
+    {
+      GVariant *replayed;
+
+      replayed = replay_journal (journal_path, type, ret, journal_data, &journal->journal_size);
+      if (ret != NULL)
+        g_variant_unref (ret);
+      ret = replayed;
+
+      /* drop a torn record so new records are appended after the good ones */
+      if (journal->journal_size < g_bytes_get_size (journal_data) &&
+          truncate (journal_path, journal->journal_size) != 0)
+        udisks_warning ("Error truncating %s: %m", journal_path);
+    }
 
-      *ok = FALSE;
-      udisks_warning ("Error getting %s: %s (%s, %d)",
-                      key,
-                      local_error->message,
-                      g_quark_to_string (local_error->domain),
-                      local_error->code);
-      g_clear_error (&local_error);
+  if (ret == NULL)
+    {
+      /* nothing on disk, remember that so the first write creates the file */
+      journal_state_free (journal);
       goto out;
     }
 
-  ret = g_variant_new_from_data (type,
-                                 (gconstpointer) contents,
-                                 length,
-                                 FALSE,
-                                 g_free,
-                                 contents);
-  g_variant_ref_sink (ret);
+  /* copy out of the mapped files, they are replaced or appended to later */
+  journal->written = g_variant_get_normal_form (ret);
+  g_variant_unref (ret);
+  ret = g_variant_ref (journal->written);
+  g_hash_table_insert (state->journals, g_strdup (path), journal);
 
-  contents = NULL; /* ownership transfered to the returned GVariant */
+  /* the files are only read once, the cache is authoritative from now on */
+  g_hash_table_insert (state->cache, g_strdup (path), g_variant_ref (ret));
 
  out:
-  g_free (contents);
+  if (data != NULL)
+    g_bytes_unref (data);
+  if (journal_data != NULL)
+    g_bytes_unref (journal_data);
+  g_free (journal_path);
   g_free (path);
   return ret;
 }
 
+/* called with state->lock held
+ *
+ * Returns an index mapping either the dictionary key of each entry in
+ * @key or, if @detail is not %NULL, the value of that detail to the
+ * '{?a{sv}}' entry itself. Only basic types are valid as lookup keys.
+ * The index is built on first use and dropped by udisks_state_set().
+ *
+ * Returns: (transfer none): The index or %NULL if @key couldn't be read.
+ */
+static GHashTable *
+udisks_state_get_index (UDisksState        *state,
+                        const gchar        *key,
+                        const GVariantType *type,
+                        const gchar        *detail)
+{
+  GHashTable *index;
+  GVariant *value;
+  GVariantIter iter;
+  GVariant *child;
+  gchar *name;
+  gboolean ok = FALSE;
+
+  name = g_strdup_printf ("%s:%s", key, detail != NULL ? detail : "");
+  index = g_hash_table_lookup (state->indexes, name);
+  if (index != NULL)
+    goto out;
+
+  value = udisks_state_get (state, key, type, &ok);
+  if (!ok)
+    goto out;
+
+  index = g_hash_table_new_full (g_variant_hash,
+                                 g_variant_equal,
+                                 (GDestroyNotify) g_variant_unref,
+                                 (GDestroyNotify) g_variant_unref);
+  if (value != NULL)
+    {
+      g_variant_iter_init (&iter, value);
+      while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          GVariant *lookup_key;
+
+          if (detail == NULL)
+            {
+              lookup_key = g_variant_get_child_value (child, 0);
+            }
+          else
+            {
+              GVariant *details;
+              details = g_variant_get_child_value (child, 1);
+              lookup_key = lookup_asv (details, detail);
+              g_variant_unref (details);
+            }
+
+          /* the first matching entry wins, just like the linear lookups used to */
+          if (lookup_key != NULL && !g_hash_table_contains (index, lookup_key))
+            g_hash_table_insert (index, lookup_key, g_variant_ref (child));
+          else if (lookup_key != NULL)
+            g_variant_unref (lookup_key);
+          g_variant_unref (child);
+        }
+      g_variant_unref (value);
+    }
+
+  g_hash_table_insert (state->indexes, name, index);
+  name = NULL;
+
+ out:
+  g_free (name);
+  return index;
+}
+
+/* called with state->lock held, consumes a floating @lookup_key
+ *
+ * Returns: (transfer full): The matching '{?a{sv}}' entry or %NULL.
+ */
+static GVariant *
+udisks_state_lookup_entry (UDisksState        *state,
+                           const gchar        *key,
+                           const GVariantType *type,
+                           const gchar        *detail,
+                           GVariant           *lookup_key)
+{
+  GHashTable *index;
+  GVariant *ret = NULL;
+
+  g_variant_ref_sink (lookup_key);
+
+  index = udisks_state_get_index (state, key, type, detail);
+  if (index != NULL)
+    {
+      ret = g_hash_table_lookup (index, lookup_key);
+      if (ret != NULL)
+        g_variant_ref (ret);
+    }
+
+  g_variant_unref (lookup_key);
+  return ret;
+}
+
 static gboolean
-udisks_state_set (UDisksState          *state,
-                  const gchar          *key,
-                  const GVariantType   *type,
-                  GVariant             *value)
+index_belongs_to_key (gpointer key,
+                      gpointer value,
+                      gpointer user_data)
+{
+  return g_str_has_prefix ((const gchar *) key, (const gchar *) user_data);
+}
+
+/* called with state->lock held */
+static void
+udisks_state_drop_indexes (UDisksState *state,
+                           const gchar *key)
+{
+  gchar *prefix;
+
+  prefix = g_strdup_printf ("%s:", key);
+  g_hash_table_foreach_remove (state->indexes, index_belongs_to_key, prefix);
+  g_free (prefix);
+}
+
+/* Writes @value to @path in full and removes the journal */
+static gboolean
+udisks_state_compact (UDisksState  *state,
+                      const gchar  *key,
+                      const gchar  *path,
+                      GVariant     *value)
 {
   gboolean ret = FALSE;
   gsize size = 0;
-  gchar *path = NULL;
-  gchar *data= NULL;
-  GVariant *normalized = NULL;
+  gchar *data = NULL;
+  gchar *journal_path = NULL;
   GError *error = NULL;
+  JournalState *journal;
 
-  g_return_val_if_fail (UDISKS_IS_STATE (state), FALSE);
-  g_return_val_if_fail (key != NULL, FALSE);
-  g_return_val_if_fail (g_variant_type_is_definite (type), FALSE);
-  g_return_val_if_fail (g_variant_is_of_type (value, type), FALSE);
-
-  g_variant_ref_sink (value);
-  normalized = g_variant_get_normal_form (value);
-  size = g_variant_get_size (normalized);
+  size = g_variant_get_size (value);
   data = g_malloc (size);
-  g_variant_store (normalized, data);
-
-#ifdef HAVE_FHS_MEDIA
-  /* /media usually isn't on a tmpfs, so we need to make this persistant */
-  if (strcmp (key, "mounted-fs") == 0)
-    path = g_strdup_printf (PACKAGE_LOCALSTATE_DIR "/lib/udisks2/%s", key);
-  else
-#endif
-    path = g_strdup_printf ("/run/udisks2/%s", key);
-
-  g_hash_table_insert (state->cache, g_strdup (path), g_variant_ref (value));
+  g_variant_store (value, data);
 
+  /* g_file_set_contents() writes to a temporary file and renames it
+   * into place so the file on disk is always either the old or the
+   * new complete serialization
+   */
   if (!g_file_set_contents (path,
                             data,
                             size,
@@ -2279,13 +2784,250 @@ udisks_state_set (UDisksState          *state,
       g_clear_error (&error);
       goto out;
     }
+  UDISKS_TRACE2 (state_file_written, path, size);
+
+  /* Replaying a journal that is older than the file just written results
+   * in the same value again, so crashing before this is harmless
+   */
+  journal_path = udisks_state_get_journal_path (path);
+  if (g_unlink (journal_path) != 0 && errno != ENOENT)
+    udisks_warning ("Error removing %s: %m", journal_path);
+
+  journal = g_slice_new0 (JournalState);
+  journal->written = g_variant_ref (value);
+  g_hash_table_insert (state->journals, g_strdup (path), journal);
+
+  ret = TRUE;
+
+ out:
+  g_free (journal_path);
+  g_free (data);
+  return ret;
+}
+
+static void
+append_journal_record (GByteArray *records,
+                       JournalOp   op,
+                       GVariant   *entry)
+{
+  JournalRecordHeader header;
+  static const guint8 padding[8] = { 0 };
+  gsize size;
+  guint len;
+
+  size = g_variant_get_size (entry);
+  header.magic = JOURNAL_RECORD_MAGIC;
+  header.op = op;
+  header.size = size;
+  g_byte_array_append (records, (const guint8 *) &header, sizeof (header));
+
+  len = records->len;
+  g_byte_array_set_size (records, len + size);
+  g_variant_store (entry, records->data + len);
+  if (size % 8 != 0)
+    g_byte_array_append (records, padding, 8 - size % 8);
+}
+
+/* Appends records turning @old into @value, two '{?a{sv}}' arrays, to @records */
+static void
+diff_entries (const GVariantType *type,
+              GVariant           *old,
+              GVariant           *value,
+              GByteArray         *records)
+{
+  GHashTable *old_entries;
+  GHashTableIter hash_iter;
+  GVariantIter iter;
+  GVariant *child;
+  GVariant *details = NULL;
+
+  old_entries = g_hash_table_new_full (g_variant_hash, g_variant_equal,
+                                       (GDestroyNotify) g_variant_unref,
+                                       (GDestroyNotify) g_variant_unref);
+  g_variant_iter_init (&iter, old);
+  while ((child = g_variant_iter_next_value (&iter)) != NULL)
+    g_hash_table_insert (old_entries, g_variant_get_child_value (child, 0), child);
+
+  g_variant_iter_init (&iter, value);
+  while ((child = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      GVariant *lookup_key = g_variant_get_child_value (child, 0);
+      GVariant *old_child = g_hash_table_lookup (old_entries, lookup_key);
+
+      if (old_child == NULL || !g_variant_equal (old_child, child))
+        append_journal_record (records, JOURNAL_OP_SET, child);
+      g_hash_table_remove (old_entries, lookup_key);
+      g_variant_unref (lookup_key);
+      g_variant_unref (child);
+    }
+
+  /* the entries left are gone */
+  g_hash_table_iter_init (&hash_iter, old_entries);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer *) &child, NULL))
+    {
+      GVariant *entry;
+
+      if (details == NULL)
+        details = g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0));
+      entry = g_variant_ref_sink (g_variant_new_dict_entry (child, details));
+      append_journal_record (records, JOURNAL_OP_REMOVE, entry);
+      g_variant_unref (entry);
+    }
+  if (details != NULL)
+    g_variant_unref (details);
+  g_hash_table_unref (old_entries);
+}
+
+static gboolean
+udisks_state_write (UDisksState  *state,
+                    const gchar  *key,
+                    const gchar  *path,
+                    GVariant     *value)
+{
+  gboolean ret = FALSE;
+  JournalState *journal;
+  GByteArray *records = NULL;
+  gchar *journal_path = NULL;
+  gint fd = -1;
+  gssize written;
+
+  journal = g_hash_table_lookup (state->journals, path);
+  if (journal == NULL)
+    return udisks_state_compact (state, key, path, value);
+
+  records = g_byte_array_new ();
+  diff_entries (g_variant_get_type (value), journal->written, value, records);
+  if (records->len == 0)
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  /* fold the journal back once it costs more to replay than the file */
+  if (journal->journal_size + records->len > MAX (UDISKS_STATE_JOURNAL_MIN_COMPACT_SIZE,
+                                                  g_variant_get_size (value)))
+    {
+      ret = udisks_state_compact (state, key, path, value);
+      goto out;
+    }
 
+  journal_path = udisks_state_get_journal_path (path);
+  fd = open (journal_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1)
+    {
+      udisks_warning ("Error opening %s: %m", journal_path);
+      ret = udisks_state_compact (state, key, path, value);
+      goto out;
+    }
+
+  /* a torn write ends the replay with the records before it, see replay_journal() */
+  written = write (fd, records->data, records->len);
+  if (written != (gssize) records->len || fdatasync (fd) != 0)
+    {
+      udisks_warning ("Error appending to %s: %m", journal_path);
+      /* don't leave a partial record for the next ones to be appended to */
+      if (ftruncate (fd, journal->journal_size) != 0)
+        udisks_warning ("Error truncating %s: %m", journal_path);
+      ret = udisks_state_compact (state, key, path, value);
+      goto out;
+    }
+  UDISKS_TRACE2 (state_file_written, journal_path, records->len);
+
+  journal->journal_size += records->len;
+  g_variant_unref (journal->written);
+  journal->written = g_variant_ref (value);
   ret = TRUE;
 
  out:
+  if (fd != -1)
+    close (fd);
+  g_free (journal_path);
+  g_byte_array_unref (records);
+  return ret;
+}
+
+/* called with state->lock held */
+static void
+udisks_state_flush_unlocked (UDisksState *state)
+{
+  GHashTableIter iter;
+  const gchar *path;
+  const gchar *key;
+
+  /* each key is written once no matter how often it changed since the last flush */
+  g_hash_table_iter_init (&iter, state->dirty);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &path, (gpointer *) &key))
+    {
+      GVariant *value;
 
+      value = g_hash_table_lookup (state->cache, path);
+      if (value != NULL)
+        udisks_state_write (state, key, path, value);
+    }
+  g_hash_table_remove_all (state->dirty);
+}
+
+static gboolean
+udisks_state_flush_func (gpointer user_data)
+{
+  UDisksState *state = UDISKS_STATE (user_data);
+
+  g_mutex_lock (&state->lock);
+  if (state->flush_source != NULL)
+    {
+      g_source_unref (state->flush_source);
+      state->flush_source = NULL;
+    }
+  udisks_state_flush_unlocked (state);
+  g_mutex_unlock (&state->lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* called with state->lock held */
+static gboolean
+udisks_state_set (UDisksState          *state,
+                  const gchar          *key,
+                  const GVariantType   *type,
+                  GVariant             *value)
+{
+  gboolean ret = TRUE;
+  gchar *path = NULL;
+  GVariant *normalized = NULL;
+
+  g_return_val_if_fail (UDISKS_IS_STATE (state), FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+  g_return_val_if_fail (g_variant_type_is_definite (type), FALSE);
+  g_return_val_if_fail (g_variant_is_of_type (value, type), FALSE);
+
+  g_variant_ref_sink (value);
+  normalized = g_variant_get_normal_form (value);
+
+  path = udisks_state_get_path (key);
+  g_hash_table_insert (state->cache, g_strdup (path), g_variant_ref (normalized));
+  udisks_state_drop_indexes (state, key);
+
+  if (!state->write_back)
+    {
+      /* no clean-up thread to write it out later */
+      g_hash_table_remove (state->dirty, path);
+      ret = udisks_state_write (state, key, path, normalized);
+      goto out;
+    }
+
+  g_hash_table_insert (state->dirty, g_strdup (path), g_strdup (key));
+  if (state->flush_source == NULL)
+    {
+      state->flush_source = g_timeout_source_new (UDISKS_STATE_FLUSH_DELAY_MSEC);
+      g_source_set_callback (state->flush_source,
+                             udisks_state_flush_func,
+                             state,
+                             NULL);
+      g_source_attach (state->flush_source, state->context);
+    }
+
+ out:
   g_free (path);
-  g_free (data);
   g_variant_unref (normalized);
   g_variant_unref (value);
   return ret;
@@ -35,6 +35,8 @@ UDisksDaemon  *udisks_state_get_daemon           (UDisksState   *state);
 void           udisks_state_start_cleanup        (UDisksState   *state);
 void           udisks_state_stop_cleanup         (UDisksState   *state);
 void           udisks_state_check                (UDisksState   *state);
+void           udisks_state_check_block          (UDisksState   *state,
+                                                  dev_t          block_device);
 void           udisks_state_check_sync           (UDisksState   *state);
 /* mounted-fs */
 void           udisks_state_add_mounted_fs       (UDisksState   *state,
@@ -71,6 +73,7 @@ void             udisks_state_add_mdraid         (UDisksState   *state,
 gboolean         udisks_state_has_mdraid         (UDisksState   *state,
                                                   dev_t          raid_device,
                                                   uid_t         *out_uid);
+gboolean         udisks_state_has_entries        (UDisksState   *state);
 
 G_END_DECLS
 
@@ -0,0 +1,310 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "udisksdaemontypes.h"
+#include "udiskssuperblock.h"
+
+/**
+ * SECTION:udiskssuperblock
+ * @title: Superblock parsing
+ * @short_description: Helper routines for reading filesystem superblocks
+ *
+ * Helper routines for getting the size of a filesystem straight from
+ * its superblock. Unlike the filesystem specific tools this only
+ * takes a single read from the device.
+ */
+
+#define EXT_SUPERBLOCK_OFFSET 1024
+#define EXT_FEATURE_INCOMPAT_64BIT 0x80
+#define BTRFS_SUPERBLOCK_OFFSET (64 * 1024)
+
+static guint16
+get_le16 (const guchar *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static guint32
+get_le32 (const guchar *p)
+{
+  return (guint32) p[0] | ((guint32) p[1] << 8) | ((guint32) p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static guint64
+get_le64 (const guchar *p)
+{
+  return (guint64) get_le32 (p) | ((guint64) get_le32 (p + 4) << 32);
+}
+
+static guint32
+get_be32 (const guchar *p)
+{
+  return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) | ((guint32) p[2] << 8) | (guint32) p[3];
+}
+
+static guint64
+get_be64 (const guchar *p)
+{
+  return ((guint64) get_be32 (p) << 32) | (guint64) get_be32 (p + 4);
+}
+
+static gboolean
+parse_ext (const guchar *buf,
+           guint64      *out_size)
+{
+  const guchar *sb = buf + EXT_SUPERBLOCK_OFFSET;
+  guint32 log_block_size;
+  guint64 block_count;
+
+  if (get_le16 (sb + 0x38) != 0xef53)
+    return FALSE;
+
+  log_block_size = get_le32 (sb + 0x18);
+  if (log_block_size > 6)
+    return FALSE;
+
+  block_count = get_le32 (sb + 0x04);
+  if (get_le32 (sb + 0x60) & EXT_FEATURE_INCOMPAT_64BIT)
+    block_count |= (guint64) get_le32 (sb + 0x150) << 32;
+
+  *out_size = block_count * (1024 << log_block_size);
+  return TRUE;
+}
+
+static gboolean
+parse_xfs (const guchar *buf,
+           guint64      *out_size)
+{
+  guint32 block_size;
+
+  if (get_be32 (buf) != 0x58465342) /* XFSB */
+    return FALSE;
+
+  block_size = get_be32 (buf + 4);
+  if (block_size < 512 || block_size > 65536)
+    return FALSE;
+
+  *out_size = get_be64 (buf + 8) * block_size;
+  return TRUE;
+}
+
+static gboolean
+parse_btrfs (const guchar *buf,
+             guint64      *out_size)
+{
+  if (memcmp (buf + 0x40, "_BHRfS_M", 8) != 0)
+    return FALSE;
+
+  /* total size of all the devices of the filesystem */
+  *out_size = get_le64 (buf + 0x70);
+  return TRUE;
+}
+
+static gboolean
+parse_vfat (const guchar *buf,
+            guint64      *out_size)
+{
+  guint16 bytes_per_sector;
+  guint64 sectors;
+
+  if (buf[510] != 0x55 || buf[511] != 0xaa)
+    return FALSE;
+
+  bytes_per_sector = get_le16 (buf + 11);
+  if (bytes_per_sector < 512 || bytes_per_sector > 4096 || (bytes_per_sector & (bytes_per_sector - 1)) != 0)
+    return FALSE;
+  if (buf[13] == 0) /* sectors per cluster */
+    return FALSE;
+
+  sectors = get_le16 (buf + 19);
+  if (sectors == 0)
+    sectors = get_le32 (buf + 32);
+
+  *out_size = sectors * bytes_per_sector;
+  return TRUE;
+}
+
+static gboolean
+parse_exfat (const guchar *buf,
+             guint64      *out_size)
+{
+  guint8 bytes_per_sector_shift;
+
+  if (memcmp (buf + 3, "EXFAT   ", 8) != 0)
+    return FALSE;
+
+  bytes_per_sector_shift = buf[108];
+  if (bytes_per_sector_shift < 9 || bytes_per_sector_shift > 12)
+    return FALSE;
+
+  *out_size = get_le64 (buf + 72) << bytes_per_sector_shift;
+  return TRUE;
+}
+
+/**
+ * udisks_superblock_is_supported:
+ * @fs_type: A filesystem type, e.g. <literal>ext4</literal>.
+ *
+ * Checks whether the size of @fs_type filesystems can be read from the
+ * superblock.
+ *
+ * Returns: %TRUE if supported.
+ */
+gboolean
+udisks_superblock_is_supported (const gchar *fs_type)
+{
+  return g_strcmp0 (fs_type, "ext2") == 0 ||
+    g_strcmp0 (fs_type, "ext3") == 0 ||
+    g_strcmp0 (fs_type, "ext4") == 0 ||
+    g_strcmp0 (fs_type, "xfs") == 0 ||
+    g_strcmp0 (fs_type, "btrfs") == 0 ||
+    g_strcmp0 (fs_type, "vfat") == 0 ||
+    g_strcmp0 (fs_type, "exfat") == 0;
+}
+
+/**
+ * udisks_superblock_get_offset:
+ * @fs_type: A supported filesystem type.
+ *
+ * Gets the offset of the #UDISKS_SUPERBLOCK_READ_SIZE bytes to read for
+ * udisks_superblock_parse_size(). The offset is always aligned to the
+ * read size.
+ *
+ * Returns: The offset in bytes.
+ */
+goffset
+udisks_superblock_get_offset (const gchar *fs_type)
+{
+  if (g_strcmp0 (fs_type, "btrfs") == 0)
+    return BTRFS_SUPERBLOCK_OFFSET;
+  return 0;
+}
+
+/**
+ * udisks_superblock_parse_size:
+ * @fs_type: A supported filesystem type.
+ * @buf: The data read at udisks_superblock_get_offset().
+ * @buf_size: The size of @buf.
+ * @out_size: (out): Return location for the size of the filesystem in bytes.
+ *
+ * Parses the size of a @fs_type filesystem from the superblock in @buf.
+ *
+ * Returns: %TRUE if @out_size was set, %FALSE if @buf doesn't contain a
+ *   valid superblock.
+ */
+gboolean
+udisks_superblock_parse_size (const gchar  *fs_type,
+                              const guchar *buf,
+                              gsize         buf_size,
+                              guint64      *out_size)
+{
+  g_return_val_if_fail (buf != NULL, FALSE);
+  g_return_val_if_fail (out_size != NULL, FALSE);
+
+  if (buf_size < UDISKS_SUPERBLOCK_READ_SIZE)
+    return FALSE;
+
+  if (g_strcmp0 (fs_type, "ext2") == 0 || g_strcmp0 (fs_type, "ext3") == 0 || g_strcmp0 (fs_type, "ext4") == 0)
+    return parse_ext (buf, out_size);
+  else if (g_strcmp0 (fs_type, "xfs") == 0)
+    return parse_xfs (buf, out_size);
+  else if (g_strcmp0 (fs_type, "btrfs") == 0)
+    return parse_btrfs (buf, out_size);
+  else if (g_strcmp0 (fs_type, "vfat") == 0)
+    return parse_vfat (buf, out_size);
+  else if (g_strcmp0 (fs_type, "exfat") == 0)
+    return parse_exfat (buf, out_size);
+
+  return FALSE;
+}
+
+/**
+ * udisks_superblock_read_size:
+ * @device_file: The block device (or image file) containing the filesystem.
+ * @fs_type: A filesystem type, e.g. <literal>ext4</literal>.
+ * @out_size: (out): Return location for the size of the filesystem in bytes.
+ * @error: Return location for error or %NULL.
+ *
+ * Reads the size of the @fs_type filesystem on @device_file from its
+ * superblock with a single aligned read.
+ *
+ * Returns: %TRUE if @out_size was set, %FALSE if @error is set.
+ */
+gboolean
+udisks_superblock_read_size (const gchar  *device_file,
+                             const gchar  *fs_type,
+                             guint64      *out_size,
+                             GError      **error)
+{
+  guchar buf[UDISKS_SUPERBLOCK_READ_SIZE];
+  ssize_t num_read;
+  gint fd;
+
+  g_return_val_if_fail (device_file != NULL, FALSE);
+  g_return_val_if_fail (out_size != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (!udisks_superblock_is_supported (fs_type))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED,
+                   "Reading the superblock of %s filesystems is not supported", fs_type);
+      return FALSE;
+    }
+
+  fd = open (device_file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %m", device_file);
+      return FALSE;
+    }
+
+  do
+    num_read = pread (fd, buf, sizeof (buf), udisks_superblock_get_offset (fs_type));
+  while (num_read < 0 && errno == EINTR);
+  if (num_read < 0)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error reading %s: %m", device_file);
+      close (fd);
+      return FALSE;
+    }
+  close (fd);
+
+  if (!udisks_superblock_parse_size (fs_type, buf, num_read, out_size))
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "No valid %s superblock found on %s", fs_type, device_file);
+      return FALSE;
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,48 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2017 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_SUPERBLOCK_H__
+#define __UDISKS_SUPERBLOCK_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * UDISKS_SUPERBLOCK_READ_SIZE:
+ *
+ * The number of bytes read from the device to parse a superblock.
+ */
+#define UDISKS_SUPERBLOCK_READ_SIZE 4096
+
+gboolean  udisks_superblock_is_supported (const gchar  *fs_type);
+goffset   udisks_superblock_get_offset   (const gchar  *fs_type);
+gboolean  udisks_superblock_parse_size   (const gchar  *fs_type,
+                                          const guchar *buf,
+                                          gsize         buf_size,
+                                          guint64      *out_size);
+gboolean  udisks_superblock_read_size    (const gchar  *device_file,
+                                          const gchar  *fs_type,
+                                          guint64      *out_size,
+                                          GError      **error);
+
+G_END_DECLS
+
+#endif /* __UDISKS_SUPERBLOCK_H__ */
@@ -0,0 +1,265 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "udiskslogging.h"
+#include "udiskserror.h"
+#include "udiskssysfsreader.h"
+
+/**
+ * SECTION:udiskssysfsreader
+ * @title: UDisksSysfsReader
+ * @short_description: Repeated reads of the sysfs attributes of a device
+ *
+ * A sysfs attribute is generated anew by the kernel on every read at
+ * offset 0, so there is no need to open, read and close the file each
+ * time it is sampled. A #UDisksSysfsReader keeps the files of the
+ * attributes of one device open once they have been read and reads them
+ * again with pread(2), turning the three syscalls and the path lookup
+ * into a single one. It is meant to be kept around for the lifetime of
+ * the object polling the device, e.g. for <literal>md/sync_completed</literal>
+ * or <literal>stat</literal>.
+ *
+ * Every read and every open is counted, see udisks_sysfs_reader_get_counters().
+ */
+
+/* sysfs attributes are at most a page */
+#define ATTR_BUFFER_SIZE 4096
+
+struct _UDisksSysfsReader
+{
+  gchar *sysfs_path;
+
+  /* protects fds, the reader can be shared by threads */
+  GMutex lock;
+  /* maps from attribute name to the fd, as GINT_TO_POINTER (fd + 1) */
+  GHashTable *fds;
+};
+
+static gint num_reads = 0;
+static gint num_opens = 0;
+
+static void
+close_fd (gpointer data)
+{
+  close (GPOINTER_TO_INT (data) - 1);
+}
+
+/**
+ * udisks_sysfs_reader_new:
+ * @sysfs_path: The sysfs path of a device.
+ *
+ * Creates a new #UDisksSysfsReader for the attributes of the device at
+ * @sysfs_path. No files are opened until they are read.
+ *
+ * Returns: A #UDisksSysfsReader. Free with udisks_sysfs_reader_free().
+ */
+UDisksSysfsReader *
+udisks_sysfs_reader_new (const gchar *sysfs_path)
+{
+  UDisksSysfsReader *reader;
+
+  g_return_val_if_fail (sysfs_path != NULL, NULL);
+
+  reader = g_new0 (UDisksSysfsReader, 1);
+  reader->sysfs_path = g_strdup (sysfs_path);
+  g_mutex_init (&reader->lock);
+  reader->fds = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, close_fd);
+
+  return reader;
+}
+
+/**
+ * udisks_sysfs_reader_free:
+ * @reader: A #UDisksSysfsReader.
+ *
+ * Closes all files kept open by @reader and frees it.
+ */
+void
+udisks_sysfs_reader_free (UDisksSysfsReader *reader)
+{
+  g_hash_table_unref (reader->fds);
+  g_mutex_clear (&reader->lock);
+  g_free (reader->sysfs_path);
+  g_free (reader);
+}
+
+/**
+ * udisks_sysfs_reader_get_sysfs_path:
+ * @reader: A #UDisksSysfsReader.
+ *
+ * Gets the sysfs path of the device @reader reads the attributes of.
+ *
+ * Returns: (transfer none): The sysfs path. Do not free, owned by @reader.
+ */
+const gchar *
+udisks_sysfs_reader_get_sysfs_path (UDisksSysfsReader *reader)
+{
+  return reader->sysfs_path;
+}
+
+/* called with lock held, returns -1 and sets @error on failure */
+static gint
+get_fd (UDisksSysfsReader  *reader,
+        const gchar        *attr,
+        GError            **error)
+{
+  gpointer value;
+  gchar *path;
+  gint fd;
+
+  value = g_hash_table_lookup (reader->fds, attr);
+  if (value != NULL)
+    return GPOINTER_TO_INT (value) - 1;
+
+  path = g_build_filename (reader->sysfs_path, attr, NULL);
+  g_atomic_int_inc (&num_opens);
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    {
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error opening %s: %s", path, g_strerror (errno));
+      g_free (path);
+      return -1;
+    }
+  g_free (path);
+
+  g_hash_table_insert (reader->fds, g_strdup (attr), GINT_TO_POINTER (fd + 1));
+  return fd;
+}
+
+/**
+ * udisks_sysfs_reader_read:
+ * @reader: A #UDisksSysfsReader.
+ * @attr: The name of the attribute, relative to the sysfs path of the device, e.g. <literal>md/sync_completed</literal>.
+ * @error: Return location for error or %NULL.
+ *
+ * Reads the current value of @attr, keeping its file open for the next
+ * read. If reading from a file kept open fails, e.g. because the device
+ * went away and came back with the same sysfs path, it is opened again
+ * once.
+ *
+ * Returns: The value with leading and trailing whitespace removed or %NULL if @error is set. Free with g_free().
+ */
+gchar *
+udisks_sysfs_reader_read (UDisksSysfsReader  *reader,
+                          const gchar        *attr,
+                          GError            **error)
+{
+  gchar buf[ATTR_BUFFER_SIZE];
+  gchar *ret = NULL;
+  gboolean retried = FALSE;
+  ssize_t num_read;
+  gint fd;
+
+  g_return_val_if_fail (reader != NULL, NULL);
+  g_return_val_if_fail (attr != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  g_mutex_lock (&reader->lock);
+
+ again:
+  fd = get_fd (reader, attr, error);
+  if (fd == -1)
+    goto out;
+
+  g_atomic_int_inc (&num_reads);
+  do
+    num_read = pread (fd, buf, sizeof (buf) - 1, 0);
+  while (num_read == -1 && errno == EINTR);
+
+  if (num_read == -1)
+    {
+      gint errsv = errno;
+
+      g_hash_table_remove (reader->fds, attr);
+      if (!retried)
+        {
+          retried = TRUE;
+          goto again;
+        }
+      g_set_error (error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error reading %s/%s: %s", reader->sysfs_path, attr, g_strerror (errsv));
+      goto out;
+    }
+
+  buf[num_read] = '\0';
+  ret = g_strstrip (g_strdup (buf));
+
+ out:
+  g_mutex_unlock (&reader->lock);
+  return ret;
+}
+
+/**
+ * udisks_sysfs_reader_read_uint64:
+ * @reader: A #UDisksSysfsReader.
+ * @attr: The name of the attribute, relative to the sysfs path of the device.
+ * @error: Return location for error or %NULL.
+ *
+ * Like udisks_sysfs_reader_read() but parses the value as an unsigned
+ * number.
+ *
+ * Returns: The value or 0 if @error is set.
+ */
+guint64
+udisks_sysfs_reader_read_uint64 (UDisksSysfsReader  *reader,
+                                 const gchar        *attr,
+                                 GError            **error)
+{
+  guint64 ret = 0;
+  gchar *str;
+
+  str = udisks_sysfs_reader_read (reader, attr, error);
+  if (str != NULL)
+    {
+      ret = g_ascii_strtoull (str, NULL, 10);
+      g_free (str);
+    }
+
+  return ret;
+}
+
+/**
+ * udisks_sysfs_reader_get_counters:
+ * @out_num_reads: (out) (allow-none): Return location for the number of reads or %NULL.
+ * @out_num_opens: (out) (allow-none): Return location for the number of opened files or %NULL.
+ *
+ * Gets how many attributes have been read and how many files have been
+ * opened by all #UDisksSysfsReader instances since the daemon started.
+ * The counters wrap around. This can be called from any thread.
+ */
+void
+udisks_sysfs_reader_get_counters (guint *out_num_reads,
+                                  guint *out_num_opens)
+{
+  if (out_num_reads != NULL)
+    *out_num_reads = (guint) g_atomic_int_get (&num_reads);
+  if (out_num_opens != NULL)
+    *out_num_opens = (guint) g_atomic_int_get (&num_opens);
+}
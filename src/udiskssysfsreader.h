@@ -0,0 +1,42 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_SYSFS_READER_H__
+#define __UDISKS_SYSFS_READER_H__
+
+#include "udisksdaemontypes.h"
+
+G_BEGIN_DECLS
+
+UDisksSysfsReader *udisks_sysfs_reader_new            (const gchar        *sysfs_path);
+void               udisks_sysfs_reader_free           (UDisksSysfsReader  *reader);
+const gchar       *udisks_sysfs_reader_get_sysfs_path (UDisksSysfsReader  *reader);
+gchar             *udisks_sysfs_reader_read           (UDisksSysfsReader  *reader,
+                                                       const gchar        *attr,
+                                                       GError            **error);
+guint64            udisks_sysfs_reader_read_uint64    (UDisksSysfsReader  *reader,
+                                                       const gchar        *attr,
+                                                       GError            **error);
+void               udisks_sysfs_reader_get_counters   (guint              *out_num_reads,
+                                                       guint              *out_num_opens);
+
+G_END_DECLS
+
+#endif /* __UDISKS_SYSFS_READER_H__ */
@@ -28,6 +28,7 @@
 #include "udisksthreadedjob.h"
 #include "udisks-daemon-marshal.h"
 #include "udisksdaemon.h"
+#include "udisksjobscheduler.h"
 
 /**
  * SECTION:udisksthreadedjob
@@ -367,17 +368,10 @@ udisks_threaded_job_new (UDisksThreadedJobFunc  job_func,
                                             NULL));
 }
 
-/**
- * udisks_threaded_job_start:
- * @job: the job to start
- *
- * Start the @job. Connect to the #UDisksThreadedJob::threaded-job-completed or
- * #UDisksJob::completed signals to get notified when the job is done.
- *
- * */
-void
-udisks_threaded_job_start (UDisksThreadedJob *job)
+static void
+threaded_job_start_now (UDisksBaseJob *_job)
 {
+  UDisksThreadedJob *job = UDISKS_THREADED_JOB (_job);
   GTask *task;
 
   task = g_task_new (job,
@@ -392,12 +386,37 @@ udisks_threaded_job_start (UDisksThreadedJob *job)
   g_object_unref (task);
 }
 
+/**
+ * udisks_threaded_job_start:
+ * @job: the job to start
+ *
+ * Start the @job. Connect to the #UDisksThreadedJob::threaded-job-completed or
+ * #UDisksJob::completed signals to get notified when the job is done.
+ *
+ * If too many jobs are running already, @job is queued and started later,
+ * see #UDisksJobScheduler.
+ */
+void
+udisks_threaded_job_start (UDisksThreadedJob *job)
+{
+  UDisksDaemon *daemon;
+
+  daemon = udisks_base_job_get_daemon (UDISKS_BASE_JOB (job));
+  if (daemon != NULL)
+    udisks_job_scheduler_submit (udisks_daemon_get_job_scheduler (daemon),
+                                 UDISKS_BASE_JOB (job),
+                                 threaded_job_start_now);
+  else
+    threaded_job_start_now (UDISKS_BASE_JOB (job));
+}
+
 /**
  * udisks_threaded_job_run_sync:
  * @job: the job to run
  * @error: The #GError set in case of failure
  *
- * Run the @job synchronously.
+ * Run the @job synchronously, after waiting for the job limits to
+ * allow that, see #UDisksJobScheduler.
  *
  * Connect to the #UDisksThreadedJob::threaded-job-completed or
  * #UDisksJob::completed signals to get notified when the job is done.
@@ -408,9 +427,15 @@ gboolean
 udisks_threaded_job_run_sync (UDisksThreadedJob     *job,
                               GError               **error)
 {
+  UDisksDaemon *daemon;
   GTask *task;
   gboolean job_result;
 
+  daemon = udisks_base_job_get_daemon (UDISKS_BASE_JOB (job));
+  if (daemon != NULL)
+    udisks_job_scheduler_acquire_sync (udisks_daemon_get_job_scheduler (daemon),
+                                       UDISKS_BASE_JOB (job));
+
   task = g_task_new (job,
                      udisks_base_job_get_cancellable (UDISKS_BASE_JOB (job)),
                      NULL,
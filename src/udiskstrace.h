@@ -0,0 +1,64 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __UDISKS_TRACE_H__
+#define __UDISKS_TRACE_H__
+
+#include "config.h"
+
+/* Static tracepoints (USDT) in the "udisks" provider. They cost a single
+ * nop when not enabled, so they are compiled in whenever <sys/sdt.h> is
+ * available and can be attached to in a running daemon, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/libexec/udisks2/udisksd:udisks:smart_read_done { ... }'
+ *
+ * The probes and their arguments are:
+ *
+ *   uevent_received (action, sysfs_path)
+ *   uevent_apply_start (action, sysfs_path)
+ *   uevent_apply_done (action, sysfs_path)
+ *   module_dispatch_start (action, sysfs_path)
+ *   module_dispatch_done (action, sysfs_path)
+ *   update_iface_start (object_path, interface_type_name)
+ *   update_iface_done (object_path, interface_type_name)
+ *   job_started (object_path, operation)
+ *   job_completed (object_path, operation, success)
+ *   spawned_job_forked (command_line, pid)
+ *   spawned_job_exited (command_line, pid, wait_status)
+ *   state_file_written (path, size)
+ *   smart_read_start (device_file)
+ *   smart_read_done (device_file, success)
+ *
+ * Arguments are always evaluated, so only pass values that are already
+ * at hand.
+ */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define UDISKS_TRACE1(name, a)          DTRACE_PROBE1 (udisks, name, a)
+#define UDISKS_TRACE2(name, a, b)       DTRACE_PROBE2 (udisks, name, a, b)
+#define UDISKS_TRACE3(name, a, b, c)    DTRACE_PROBE3 (udisks, name, a, b, c)
+#else
+#define UDISKS_TRACE1(name, a)          G_STMT_START { } G_STMT_END
+#define UDISKS_TRACE2(name, a, b)       G_STMT_START { } G_STMT_END
+#define UDISKS_TRACE3(name, a, b, c)    G_STMT_START { } G_STMT_END
+#endif
+
+#endif /* __UDISKS_TRACE_H__ */
@@ -0,0 +1,588 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2019 Red Hat, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "config.h"
+#include <glib/gi18n-lib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "udiskslogging.h"
+#include "udisksdaemon.h"
+#include "udisksconfigmanager.h"
+#include "udisksdaemonutil.h"
+#include "udisksbasejob.h"
+#include "udiskssimplejob.h"
+#include "udiskstrimscheduler.h"
+
+/**
+ * SECTION:udiskstrimscheduler
+ * @title: UDisksTrimScheduler
+ * @short_description: Periodic trimming of mounted filesystems
+ *
+ * If <literal>trim_interval</literal> is set in udisks2.conf(5), the
+ * daemon discards the unused blocks of the mounted filesystems on
+ * non-rotating drives (the #UDisksDrive:rotation-rate property is 0)
+ * every that many seconds using the <literal>FITRIM</literal> ioctl.
+ * Filesystems mounted with the <literal>discard</literal> option are
+ * skipped since they discard blocks as they are freed.
+ *
+ * Unlike trimming all filesystems at the same time from a timer, the
+ * drives are trimmed one at a time and the first trim of a drive is
+ * done at a point within the first interval derived from its
+ * #UDisksDrive:id, so that drives (and machines) don't trim at the
+ * same time. The times of the last trims are kept in
+ * <filename>/var/lib/udisks2/trim.conf</filename> across restarts.
+ *
+ * Each filesystem is trimmed by a <literal>filesystem-trim</literal>
+ * job reporting the progress through the filesystem, completing with
+ * the number of bytes trimmed as its message. The filesystem is
+ * trimmed in chunks at no more than <literal>trim_max_bandwidth</literal>
+ * MiB/s, without keeping it busy between the chunks so that it can be
+ * unmounted while being trimmed.
+ */
+
+/* how often the drives are checked for being due, in seconds */
+#define TRIM_CHECK_SECONDS 300
+
+/* the part of the filesystem trimmed by one FITRIM call */
+#define TRIM_CHUNK_SIZE (1024 * 1024 * 1024ULL)
+
+/* longest sleep between the checks for cancellation while throttled */
+#define TRIM_THROTTLE_MAX_SLEEP_USEC (G_USEC_PER_SEC / 10)
+
+#define TRIM_STATE_FILE PACKAGE_LOCALSTATE_DIR "/lib/udisks2/trim.conf"
+#define TRIM_STATE_LAST_TRIM_KEY "LastTrim"
+
+struct _UDisksTrimScheduler
+{
+  UDisksDaemon *daemon;
+
+  guint check_timeout_id;
+
+  /* a single thread, drives are trimmed one after another */
+  GThreadPool *pool;
+  /* cancelled when the scheduler is freed */
+  GCancellable *cancellable;
+
+  /* protects busy and state */
+  GMutex lock;
+  /* set of the IDs of the drives queued or being trimmed */
+  GHashTable *busy;
+  /* group per drive ID with the real time of its last trim in seconds */
+  GKeyFile *state;
+};
+
+typedef struct
+{
+  UDisksObject *object;
+  gchar *mount_point;
+} TrimTarget;
+
+typedef struct
+{
+  gchar *drive_id;
+  /* of TrimTarget */
+  GList *targets;
+} TrimRun;
+
+static void
+trim_target_free (TrimTarget *target)
+{
+  g_object_unref (target->object);
+  g_free (target->mount_point);
+  g_free (target);
+}
+
+static void
+trim_run_free (TrimRun *run)
+{
+  g_free (run->drive_id);
+  g_list_free_full (run->targets, (GDestroyNotify) trim_target_free);
+  g_free (run);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* must be called with scheduler->lock held */
+static void
+save_state_locked (UDisksTrimScheduler *scheduler)
+{
+  GError *error = NULL;
+  gchar *data;
+
+  data = g_key_file_to_data (scheduler->state, NULL, NULL);
+  if (!udisks_daemon_util_file_set_contents (TRIM_STATE_FILE, data, -1, 0600, &error))
+    {
+      udisks_warning ("Error writing %s: %s", TRIM_STATE_FILE, error->message);
+      g_clear_error (&error);
+    }
+  g_free (data);
+}
+
+/* Returns the mount points of the filesystems mounted with online discard */
+static GHashTable *
+get_discard_mount_points (void)
+{
+  GHashTable *ret;
+  gchar *contents = NULL;
+  gchar **lines;
+  guint n;
+
+  ret = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  if (!g_file_get_contents ("/proc/self/mounts", &contents, NULL, NULL))
+    return ret;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (n = 0; lines[n] != NULL; n++)
+    {
+      gchar **fields = g_strsplit (lines[n], " ", 0);
+
+      if (g_strv_length (fields) >= 4)
+        {
+          gchar **options = g_strsplit (fields[3], ",", -1);
+          guint m;
+
+          /* btrfs uses e.g. discard=async */
+          for (m = 0; options[m] != NULL; m++)
+            {
+              if (g_strcmp0 (options[m], "discard") == 0 || g_str_has_prefix (options[m], "discard="))
+                {
+                  g_hash_table_add (ret, g_strcompress (fields[1]));
+                  break;
+                }
+            }
+          g_strfreev (options);
+        }
+      g_strfreev (fields);
+    }
+  g_strfreev (lines);
+  g_free (contents);
+
+  return ret;
+}
+
+/* Gets the drive @block is on, looking through unlocked encrypted devices */
+static UDisksDrive *
+find_drive (UDisksDaemon *daemon,
+            UDisksBlock  *block)
+{
+  UDisksObject *object = NULL;
+  UDisksDrive *ret = NULL;
+  guint n;
+
+  /* cleartext devices of encrypted devices have no drive */
+  for (n = 0; n < 4 && block != NULL; n++)
+    {
+      UDisksObject *next;
+
+      if (g_strcmp0 (udisks_block_get_drive (block), "/") != 0)
+        {
+          next = udisks_daemon_find_object (daemon, udisks_block_get_drive (block));
+          if (next != NULL)
+            {
+              ret = udisks_object_get_drive (next);
+              g_object_unref (next);
+            }
+          break;
+        }
+      if (g_strcmp0 (udisks_block_get_crypto_backing_device (block), "/") == 0)
+        break;
+
+      next = udisks_daemon_find_object (daemon, udisks_block_get_crypto_backing_device (block));
+      g_clear_object (&object);
+      object = next;
+      block = object != NULL ? udisks_object_peek_block (object) : NULL;
+    }
+  g_clear_object (&object);
+
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+trim_throttle_wait (guint64        max_bytes_per_sec,
+                    guint64        pos,
+                    gint64         start_usec,
+                    GCancellable  *cancellable,
+                    GCancellable  *job_cancellable)
+{
+  gint64 target_usec;
+
+  if (max_bytes_per_sec == 0)
+    return TRUE;
+
+  target_usec = start_usec + ((gdouble) pos) * G_USEC_PER_SEC / max_bytes_per_sec;
+  while (TRUE)
+    {
+      gint64 now = g_get_monotonic_time ();
+
+      if (g_cancellable_is_cancelled (cancellable) || g_cancellable_is_cancelled (job_cancellable))
+        return FALSE;
+      if (now >= target_usec)
+        return TRUE;
+      g_usleep (MIN (target_usec - now, TRIM_THROTTLE_MAX_SLEEP_USEC));
+    }
+}
+
+/* runs in the thread of the pool */
+static gboolean
+trim_filesystem (UDisksTrimScheduler  *scheduler,
+                 TrimTarget           *target,
+                 GError              **error)
+{
+  UDisksConfigManager *config_manager = udisks_daemon_get_config_manager (scheduler->daemon);
+  UDisksBaseJob *job = NULL;
+  GCancellable *job_cancellable;
+  struct statvfs vfs;
+  struct stat st;
+  dev_t dev;
+  guint64 max_bandwidth;
+  guint64 size;
+  guint64 pos;
+  guint64 trimmed = 0;
+  gint64 start_usec;
+  gint64 time_of_last_signal;
+  gchar *trimmed_str = NULL;
+  gchar *message = NULL;
+  gboolean ret = FALSE;
+  GError *local_error = NULL;
+
+  if (statvfs (target->mount_point, &vfs) != 0 || stat (target->mount_point, &st) != 0)
+    {
+      g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                   "Error getting the size of the filesystem mounted at %s: %m", target->mount_point);
+      goto out;
+    }
+  size = (guint64) vfs.f_blocks * vfs.f_frsize;
+  dev = st.st_dev;
+  max_bandwidth = udisks_config_manager_get_trim_max_bandwidth (config_manager);
+
+  job = udisks_daemon_launch_simple_job (scheduler->daemon, target->object, "filesystem-trim", 0, NULL);
+  job_cancellable = udisks_base_job_get_cancellable (job);
+  udisks_job_set_progress_valid (UDISKS_JOB (job), TRUE);
+  udisks_job_set_bytes (UDISKS_JOB (job), size);
+  udisks_job_set_rate_limit (UDISKS_JOB (job), max_bandwidth);
+
+  start_usec = time_of_last_signal = g_get_monotonic_time ();
+  pos = 0;
+  while (pos < size)
+    {
+      struct fstrim_range range;
+      guint64 chunk;
+      gint64 now;
+      gint fd;
+
+      if (!trim_throttle_wait (max_bandwidth, pos, start_usec, scheduler->cancellable, job_cancellable))
+        {
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_CANCELLED,
+                       "Job was canceled");
+          goto out;
+        }
+
+      /* don't keep the filesystem busy between the chunks, it may be
+       * unmounted in the meantime */
+      fd = open (target->mount_point, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (fd == -1 || fstat (fd, &st) != 0 || st.st_dev != dev)
+        {
+          if (fd != -1)
+            close (fd);
+          g_set_error (&local_error, UDISKS_ERROR, UDISKS_ERROR_FAILED,
+                       "The filesystem is no longer mounted at %s", target->mount_point);
+          goto out;
+        }
+
+      chunk = MIN (size - pos, TRIM_CHUNK_SIZE);
+      memset (&range, 0, sizeof (range));
+      range.start = pos;
+      /* the last chunk covers whatever is beyond the reported size */
+      range.len = pos + chunk < size ? chunk : G_MAXUINT64 - pos;
+      range.minlen = 0;
+      if (ioctl (fd, FITRIM, &range) != 0)
+        {
+          gint errsv = errno;
+          close (fd);
+          if (errsv == EINTR)
+            continue;
+          g_set_error (&local_error, UDISKS_ERROR,
+                       errsv == EOPNOTSUPP ? UDISKS_ERROR_NOT_SUPPORTED : UDISKS_ERROR_FAILED,
+                       "Error trimming the filesystem mounted at %s: %s",
+                       target->mount_point, g_strerror (errsv));
+          goto out;
+        }
+      close (fd);
+
+      /* on return the length is the number of bytes trimmed */
+      trimmed += range.len;
+      pos += chunk;
+
+      now = g_get_monotonic_time ();
+      if (now - time_of_last_signal > G_USEC_PER_SEC)
+        {
+          udisks_job_set_progress (UDISKS_JOB (job), ((gdouble) pos) / size);
+          if (now > start_usec)
+            udisks_job_set_rate (UDISKS_JOB (job), (guint64) (((gdouble) pos) * G_USEC_PER_SEC / (now - start_usec)));
+          time_of_last_signal = now;
+        }
+    }
+
+  trimmed_str = g_format_size_full (trimmed, G_FORMAT_SIZE_LONG_FORMAT);
+  message = g_strdup_printf ("Trimmed %" G_GUINT64_FORMAT " bytes", trimmed);
+  udisks_notice ("Trimmed %s of the filesystem mounted at %s", trimmed_str, target->mount_point);
+  ret = TRUE;
+
+ out:
+  if (job != NULL)
+    udisks_simple_job_complete (UDISKS_SIMPLE_JOB (job), ret,
+                                ret ? message : local_error->message);
+  if (local_error != NULL)
+    g_propagate_error (error, local_error);
+  g_free (message);
+  g_free (trimmed_str);
+  return ret;
+}
+
+/* runs in the thread of the pool */
+static void
+trim_drive_func (gpointer data,
+                 gpointer user_data)
+{
+  UDisksTrimScheduler *scheduler = user_data;
+  TrimRun *run = data;
+  GList *l;
+
+  for (l = run->targets; l != NULL && !g_cancellable_is_cancelled (scheduler->cancellable); l = l->next)
+    {
+      TrimTarget *target = l->data;
+      GError *error = NULL;
+
+      if (!trim_filesystem (scheduler, target, &error))
+        {
+          udisks_warning ("%s", error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  g_mutex_lock (&scheduler->lock);
+  if (!g_cancellable_is_cancelled (scheduler->cancellable))
+    {
+      /* also when failed, to not retry a failing drive every few minutes */
+      g_key_file_set_int64 (scheduler->state, run->drive_id, TRIM_STATE_LAST_TRIM_KEY,
+                            g_get_real_time () / G_USEC_PER_SEC);
+      save_state_locked (scheduler);
+    }
+  g_hash_table_remove (scheduler->busy, run->drive_id);
+  g_mutex_unlock (&scheduler->lock);
+
+  trim_run_free (run);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Collects the mounted filesystems to trim, per drive ID */
+static GHashTable *
+collect_runs (UDisksTrimScheduler *scheduler)
+{
+  GHashTable *runs;
+  GHashTable *discard_mount_points;
+  GList *objects;
+  GList *l;
+
+  runs = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) trim_run_free);
+  discard_mount_points = get_discard_mount_points ();
+
+  objects = udisks_daemon_get_objects (scheduler->daemon);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksFilesystem *filesystem;
+      UDisksBlock *block;
+      UDisksDrive *drive;
+      const gchar *const *mount_points;
+      TrimTarget *target;
+      TrimRun *run;
+
+      filesystem = udisks_object_peek_filesystem (object);
+      block = udisks_object_peek_block (object);
+      if (filesystem == NULL || block == NULL)
+        continue;
+      mount_points = udisks_filesystem_get_mount_points (filesystem);
+      if (mount_points == NULL || mount_points[0] == NULL)
+        continue;
+      if (g_hash_table_contains (discard_mount_points, mount_points[0]))
+        {
+          udisks_debug ("Not trimming %s, mounted with online discard", mount_points[0]);
+          continue;
+        }
+
+      drive = find_drive (scheduler->daemon, block);
+      if (drive == NULL)
+        continue;
+      if (udisks_drive_get_rotation_rate (drive) != 0 || strlen (udisks_drive_get_id (drive)) == 0)
+        {
+          g_object_unref (drive);
+          continue;
+        }
+
+      run = g_hash_table_lookup (runs, udisks_drive_get_id (drive));
+      if (run == NULL)
+        {
+          run = g_new0 (TrimRun, 1);
+          run->drive_id = udisks_drive_dup_id (drive);
+          g_hash_table_insert (runs, run->drive_id, run);
+        }
+      target = g_new0 (TrimTarget, 1);
+      target->object = g_object_ref (object);
+      target->mount_point = g_strdup (mount_points[0]);
+      run->targets = g_list_append (run->targets, target);
+
+      g_object_unref (drive);
+    }
+  g_list_free_full (objects, g_object_unref);
+  g_hash_table_unref (discard_mount_points);
+
+  return runs;
+}
+
+static gboolean
+on_check_timeout (gpointer user_data)
+{
+  UDisksTrimScheduler *scheduler = user_data;
+  GHashTable *runs;
+  GHashTableIter iter;
+  TrimRun *run;
+  gboolean state_changed = FALSE;
+  guint interval;
+  gint64 now;
+
+  interval = udisks_config_manager_get_trim_interval (udisks_daemon_get_config_manager (scheduler->daemon));
+  if (interval == 0)
+    return G_SOURCE_CONTINUE;
+
+  runs = collect_runs (scheduler);
+  now = g_get_real_time () / G_USEC_PER_SEC;
+
+  g_mutex_lock (&scheduler->lock);
+  g_hash_table_iter_init (&iter, runs);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &run))
+    {
+      GError *error = NULL;
+      gint64 last_trim;
+
+      if (g_hash_table_contains (scheduler->busy, run->drive_id))
+        continue;
+
+      last_trim = g_key_file_get_int64 (scheduler->state, run->drive_id, TRIM_STATE_LAST_TRIM_KEY, &error);
+      if (error != NULL)
+        {
+          /* never trimmed, pretend the last trim was a drive specific
+           * part of an interval ago to spread the first trims */
+          g_clear_error (&error);
+          last_trim = now - (g_str_hash (run->drive_id) % interval);
+          g_key_file_set_int64 (scheduler->state, run->drive_id, TRIM_STATE_LAST_TRIM_KEY, last_trim);
+          state_changed = TRUE;
+        }
+      if (now < last_trim + interval)
+        continue;
+
+      g_hash_table_add (scheduler->busy, g_strdup (run->drive_id));
+      g_hash_table_iter_steal (&iter);
+      g_thread_pool_push (scheduler->pool, run, NULL);
+    }
+  if (state_changed)
+    save_state_locked (scheduler);
+  g_mutex_unlock (&scheduler->lock);
+
+  g_hash_table_unref (runs);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * udisks_trim_scheduler_new:
+ * @daemon: A #UDisksDaemon.
+ *
+ * Creates a new #UDisksTrimScheduler trimming the mounted filesystems
+ * on non-rotating drives of @daemon once every
+ * <literal>trim_interval</literal> seconds. Nothing is trimmed as long
+ * as the interval is 0.
+ *
+ * Returns: A #UDisksTrimScheduler. Free with udisks_trim_scheduler_free().
+ */
+UDisksTrimScheduler *
+udisks_trim_scheduler_new (UDisksDaemon *daemon)
+{
+  UDisksTrimScheduler *scheduler;
+  GError *error = NULL;
+
+  g_return_val_if_fail (UDISKS_IS_DAEMON (daemon), NULL);
+
+  scheduler = g_new0 (UDisksTrimScheduler, 1);
+  scheduler->daemon = daemon;
+  scheduler->cancellable = g_cancellable_new ();
+  g_mutex_init (&scheduler->lock);
+  scheduler->busy = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  scheduler->state = g_key_file_new ();
+  if (!g_key_file_load_from_file (scheduler->state, TRIM_STATE_FILE, G_KEY_FILE_NONE, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        udisks_warning ("Error reading %s: %s", TRIM_STATE_FILE, error->message);
+      g_clear_error (&error);
+    }
+  scheduler->pool = g_thread_pool_new (trim_drive_func, scheduler, 1, FALSE, NULL);
+  scheduler->check_timeout_id = udisks_daemon_util_timeout_add_seconds (daemon,
+                                                                        "trim-check",
+                                                                        TRIM_CHECK_SECONDS,
+                                                                        on_check_timeout,
+                                                                        scheduler,
+                                                                        NULL);
+
+  return scheduler;
+}
+
+/**
+ * udisks_trim_scheduler_free:
+ * @scheduler: A #UDisksTrimScheduler.
+ *
+ * Stops the trim in progress, if any, and frees @scheduler.
+ */
+void
+udisks_trim_scheduler_free (UDisksTrimScheduler *scheduler)
+{
+  g_source_remove (scheduler->check_timeout_id);
+  g_cancellable_cancel (scheduler->cancellable);
+  /* the queued drives are skipped quickly once cancelled */
+  g_thread_pool_free (scheduler->pool, FALSE, TRUE);
+  g_hash_table_unref (scheduler->busy);
+  g_key_file_free (scheduler->state);
+  g_mutex_clear (&scheduler->lock);
+  g_object_unref (scheduler->cancellable);
+  g_free (scheduler);
+}
@@ -291,22 +291,35 @@ if_proxy_cmp (GDBusProxy *a,
   return g_strcmp0 (g_dbus_proxy_get_interface_name (a), g_dbus_proxy_get_interface_name (b));
 }
 
+static gint
+property_name_cmp (gconstpointer a,
+                   gconstpointer b)
+{
+  return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* Prints the (a{sv}) @properties sorted by name */
 static void
-print_interface_properties (GDBusProxy *proxy,
-                            guint       indent)
+print_properties (GVariant *properties,
+                  guint     indent)
 {
-  gchar **cached_properties;
+  GPtrArray *property_names;
+  GVariantIter iter;
+  const gchar *name;
   guint n;
   guint value_column;
   guint max_property_name_len;
 
-  /* note: this is guaranteed to be sorted */
-  cached_properties = g_dbus_proxy_get_cached_property_names (proxy);
+  property_names = g_ptr_array_new ();
+  g_variant_iter_init (&iter, properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &name, NULL))
+    g_ptr_array_add (property_names, (gpointer) name);
+  g_ptr_array_sort (property_names, property_name_cmp);
 
   max_property_name_len = 0;
-  for (n = 0; cached_properties != NULL && cached_properties[n] != NULL; n++)
+  for (n = 0; n < property_names->len; n++)
     {
-      const gchar *property_name = cached_properties[n];
+      const gchar *property_name = property_names->pdata[n];
       guint property_name_len;
       property_name_len = strlen (property_name);
       if (max_property_name_len < property_name_len)
@@ -319,9 +332,9 @@ print_interface_properties (GDBusProxy *proxy,
   else if (value_column > 64)
     value_column = 64;
 
-  for (n = 0; cached_properties != NULL && cached_properties[n] != NULL; n++)
+  for (n = 0; n < property_names->len; n++)
     {
-      const gchar *property_name = cached_properties[n];
+      const gchar *property_name = property_names->pdata[n];
       GVariant *value;
       gchar *value_str;
       guint rightmost;
@@ -332,7 +345,7 @@ print_interface_properties (GDBusProxy *proxy,
       if (value_indent < 0)
         value_indent = 0;
 
-      value = g_dbus_proxy_get_cached_property (proxy, property_name);
+      value = g_variant_lookup_value (properties, property_name, NULL);
 
       value_str = variant_to_string_with_indent (value, indent + strlen (property_name) + 2 + value_indent);
 
@@ -345,7 +358,42 @@ print_interface_properties (GDBusProxy *proxy,
       g_free (value_str);
       g_variant_unref (value);
     }
+  g_ptr_array_free (property_names, TRUE);
+}
+
+/* Gets the cached properties of @proxy as a floating a{sv} GVariant */
+static GVariant *
+proxy_get_properties (GDBusProxy *proxy)
+{
+  gchar **cached_properties;
+  GVariantBuilder builder;
+  guint n;
+
+  cached_properties = g_dbus_proxy_get_cached_property_names (proxy);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  for (n = 0; cached_properties != NULL && cached_properties[n] != NULL; n++)
+    {
+      GVariant *value;
+
+      value = g_dbus_proxy_get_cached_property (proxy, cached_properties[n]);
+      g_variant_builder_add (&builder, "{sv}", cached_properties[n], value);
+      g_variant_unref (value);
+    }
   g_strfreev (cached_properties);
+
+  return g_variant_builder_end (&builder);
+}
+
+static void
+print_interface_properties (GDBusProxy *proxy,
+                            guint       indent)
+{
+  GVariant *properties;
+
+  properties = g_variant_ref_sink (proxy_get_properties (proxy));
+  print_properties (properties, indent);
+  g_variant_unref (properties);
 }
 
 static void
@@ -375,6 +423,133 @@ print_object (UDisksObject *object,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static gboolean
+ensure_client (void)
+{
+  GError *error = NULL;
+
+  if (client != NULL)
+    return TRUE;
+
+  client = udisks_client_new_sync (NULL, /* GCancellable */
+                                   &error);
+  if (client == NULL)
+    {
+      g_printerr ("Error connecting to the udisks daemon: %s\n", error->message);
+      g_clear_error (&error);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Prints a single object fetched with the Manager.GetObjects() method,
+ * without the UDisksClient which would get all the objects. Returns
+ * FALSE if that is not possible, e.g. with an older daemon.
+ */
+static gboolean
+print_object_lazy (const gchar *path,
+                   const gchar *device,
+                   gboolean    *out_found)
+{
+  gboolean ret = FALSE;
+  UDisksManager *manager;
+  GVariantBuilder devspec;
+  gchar **resolved = NULL;
+  gchar *object_path = NULL;
+  const gchar *object_paths[2] = { NULL, NULL };
+  const gchar *no_interfaces[1] = { NULL };
+  GVariant *objects = NULL;
+  GVariant *interfaces = NULL;
+  GVariantIter iter;
+  const gchar *interface_name;
+  GVariant *properties;
+  GPtrArray *interface_names;
+  guint n;
+
+  *out_found = FALSE;
+
+  manager = udisks_manager_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+                                                   G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                   G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                   "org.freedesktop.UDisks2",
+                                                   "/org/freedesktop/UDisks2/Manager",
+                                                   NULL, /* GCancellable */
+                                                   NULL);
+  if (manager == NULL)
+    goto out;
+
+  if (device != NULL)
+    {
+      g_variant_builder_init (&devspec, G_VARIANT_TYPE_VARDICT);
+      g_variant_builder_add (&devspec, "{sv}", "path", g_variant_new_string (device));
+      if (!udisks_manager_call_resolve_device_sync (manager,
+                                                    g_variant_builder_end (&devspec),
+                                                    g_variant_new ("a{sv}", NULL), /* options */
+                                                    &resolved,
+                                                    NULL, /* GCancellable */
+                                                    NULL))
+        goto out;
+      if (resolved[0] == NULL)
+        {
+          ret = TRUE;
+          goto out;
+        }
+      object_path = g_strdup (resolved[0]);
+    }
+  else
+    {
+      object_path = g_strdup_printf ("/org/freedesktop/UDisks2/%s", path);
+    }
+
+  object_paths[0] = object_path;
+  if (!udisks_manager_call_get_objects_sync (manager,
+                                             object_paths,
+                                             no_interfaces,
+                                             g_variant_new ("a{sv}", NULL), /* options */
+                                             &objects,
+                                             NULL, /* GCancellable */
+                                             NULL))
+    goto out;
+  ret = TRUE;
+
+  interfaces = g_variant_lookup_value (objects, object_path, G_VARIANT_TYPE ("a{sa{sv}}"));
+  if (interfaces == NULL)
+    goto out;
+  *out_found = TRUE;
+
+  g_print ("%s%s%s:%s\n",
+           _color_get (_COLOR_BOLD_ON), _color_get (_COLOR_FG_BLUE), object_path, _color_get (_COLOR_RESET));
+
+  /* We want to print the interfaces in order */
+  interface_names = g_ptr_array_new ();
+  g_variant_iter_init (&iter, interfaces);
+  while (g_variant_iter_next (&iter, "{&s@a{sv}}", &interface_name, NULL))
+    g_ptr_array_add (interface_names, (gpointer) interface_name);
+  g_ptr_array_sort (interface_names, property_name_cmp);
+
+  for (n = 0; n < interface_names->len; n++)
+    {
+      interface_name = interface_names->pdata[n];
+      g_print ("%*s%s%s%s:%s\n",
+               2, "",
+               _color_get (_COLOR_BOLD_ON), _color_get (_COLOR_FG_MAGENTA), interface_name, _color_get (_COLOR_RESET));
+      properties = g_variant_lookup_value (interfaces, interface_name, G_VARIANT_TYPE_VARDICT);
+      print_properties (properties, 4);
+      g_variant_unref (properties);
+    }
+  g_ptr_array_free (interface_names, TRUE);
+
+ out:
+  if (interfaces != NULL)
+    g_variant_unref (interfaces);
+  if (objects != NULL)
+    g_variant_unref (objects);
+  g_strfreev (resolved);
+  g_free (object_path);
+  g_clear_object (&manager);
+  return ret;
+}
+
 static UDisksObject *
 lookup_object_by_path (const gchar *path)
 {
@@ -2317,6 +2492,7 @@ handle_command_info (gint        *argc,
   UDisksBlock *block;
   UDisksDrive *drive;
   guint n;
+  gboolean found;
 
   ret = 1;
   opt_info_object = NULL;
@@ -2377,6 +2553,27 @@ handle_command_info (gint        *argc,
                "--drive \n");
     }
 
+  /* Looking up objects by path or device doesn't need the state of all
+   * the other objects, everything else does.
+   */
+  if (!request_completion && opt_info_drive == NULL &&
+      (opt_info_object != NULL || opt_info_device != NULL))
+    {
+      if (print_object_lazy (opt_info_object, opt_info_device, &found))
+        {
+          if (found)
+            ret = 0;
+          else if (opt_info_object != NULL)
+            g_printerr ("Error looking up object with path %s\n", opt_info_object);
+          else
+            g_printerr ("Error looking up object for device %s\n", opt_info_device);
+          goto out;
+        }
+    }
+
+  if (!ensure_client ())
+    goto out;
+
   if (complete_objects)
     {
       const gchar *object_path;
@@ -2510,11 +2707,369 @@ obj_proxy_drive_sortkey_cmp (GDBusObject *a,
 }
 
 
+static gboolean opt_dump_json = FALSE;
+static gchar **opt_dump_interfaces = NULL;
+static gchar **opt_dump_properties = NULL;
+
 static const GOptionEntry command_dump_entries[] =
 {
-  { NULL }
+  {
+    "json",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_dump_json,
+    "Print one JSON object per line",
+    NULL
+  },
+  {
+    "interface",
+    'i',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_dump_interfaces,
+    "Only print this interface (may be repeated)",
+    NULL
+  },
+  {
+    "property",
+    'P',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_dump_properties,
+    "Only print this property (may be repeated)",
+    NULL
+  },
+  {
+    NULL
+  }
 };
 
+static void
+json_append_string (GString     *str,
+                    const gchar *value)
+{
+  const gchar *p;
+
+  g_string_append_c (str, '"');
+  for (p = value; *p != '\0'; p++)
+    {
+      switch (*p)
+        {
+        case '"':
+          g_string_append (str, "\\\"");
+          break;
+        case '\\':
+          g_string_append (str, "\\\\");
+          break;
+        case '\n':
+          g_string_append (str, "\\n");
+          break;
+        case '\t':
+          g_string_append (str, "\\t");
+          break;
+        default:
+          if ((guchar) *p < 0x20)
+            g_string_append_printf (str, "\\u%04x", (guint) *p);
+          else
+            g_string_append_c (str, *p);
+          break;
+        }
+    }
+  g_string_append_c (str, '"');
+}
+
+/* Appends @value as JSON: dictionaries become objects, other containers
+ * arrays and byte strings (e.g. Block:Device) strings.
+ */
+static void
+json_append_variant (GString  *str,
+                     GVariant *value)
+{
+  GVariantIter iter;
+  GVariant *child;
+  gboolean first = TRUE;
+
+  switch (g_variant_classify (value))
+    {
+    case G_VARIANT_CLASS_BOOLEAN:
+      g_string_append (str, g_variant_get_boolean (value) ? "true" : "false");
+      break;
+    case G_VARIANT_CLASS_BYTE:
+      g_string_append_printf (str, "%u", (guint) g_variant_get_byte (value));
+      break;
+    case G_VARIANT_CLASS_INT16:
+      g_string_append_printf (str, "%d", (gint) g_variant_get_int16 (value));
+      break;
+    case G_VARIANT_CLASS_UINT16:
+      g_string_append_printf (str, "%u", (guint) g_variant_get_uint16 (value));
+      break;
+    case G_VARIANT_CLASS_INT32:
+      g_string_append_printf (str, "%d", g_variant_get_int32 (value));
+      break;
+    case G_VARIANT_CLASS_UINT32:
+      g_string_append_printf (str, "%u", g_variant_get_uint32 (value));
+      break;
+    case G_VARIANT_CLASS_INT64:
+      g_string_append_printf (str, "%" G_GINT64_FORMAT, g_variant_get_int64 (value));
+      break;
+    case G_VARIANT_CLASS_UINT64:
+      g_string_append_printf (str, "%" G_GUINT64_FORMAT, g_variant_get_uint64 (value));
+      break;
+    case G_VARIANT_CLASS_HANDLE:
+      g_string_append_printf (str, "%d", g_variant_get_handle (value));
+      break;
+    case G_VARIANT_CLASS_DOUBLE:
+      {
+        gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+        g_string_append (str, g_ascii_dtostr (buf, sizeof (buf), g_variant_get_double (value)));
+      }
+      break;
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+      json_append_string (str, g_variant_get_string (value, NULL));
+      break;
+    case G_VARIANT_CLASS_VARIANT:
+      child = g_variant_get_variant (value);
+      json_append_variant (str, child);
+      g_variant_unref (child);
+      break;
+    case G_VARIANT_CLASS_ARRAY:
+      if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+        {
+          gsize len;
+          const gchar *data = g_variant_get_fixed_array (value, &len, 1);
+          if (len > 0 && data[len - 1] == '\0' && strlen (data) == len - 1 &&
+              g_utf8_validate (data, -1, NULL))
+            {
+              json_append_string (str, data);
+              break;
+            }
+        }
+      if (g_variant_type_is_dict_entry (g_variant_type_element (g_variant_get_type (value))))
+        {
+          g_string_append_c (str, '{');
+          g_variant_iter_init (&iter, value);
+          while ((child = g_variant_iter_next_value (&iter)) != NULL)
+            {
+              GVariant *key = g_variant_get_child_value (child, 0);
+              GVariant *val = g_variant_get_child_value (child, 1);
+              gchar *key_str;
+
+              if (!first)
+                g_string_append_c (str, ',');
+              first = FALSE;
+              /* JSON only has string keys */
+              if (g_variant_is_of_type (key, G_VARIANT_TYPE_STRING) ||
+                  g_variant_is_of_type (key, G_VARIANT_TYPE_OBJECT_PATH))
+                key_str = g_variant_dup_string (key, NULL);
+              else
+                key_str = g_variant_print (key, FALSE);
+              json_append_string (str, key_str);
+              g_string_append_c (str, ':');
+              json_append_variant (str, val);
+              g_free (key_str);
+              g_variant_unref (val);
+              g_variant_unref (key);
+              g_variant_unref (child);
+            }
+          g_string_append_c (str, '}');
+          break;
+        }
+      /* fall through */
+    case G_VARIANT_CLASS_TUPLE:
+    case G_VARIANT_CLASS_MAYBE:
+    case G_VARIANT_CLASS_DICT_ENTRY:
+      g_string_append_c (str, '[');
+      g_variant_iter_init (&iter, value);
+      while ((child = g_variant_iter_next_value (&iter)) != NULL)
+        {
+          if (!first)
+            g_string_append_c (str, ',');
+          first = FALSE;
+          json_append_variant (str, child);
+          g_variant_unref (child);
+        }
+      g_string_append_c (str, ']');
+      break;
+    }
+}
+
+static gboolean
+dump_wants_interface (const gchar *interface_name)
+{
+  return opt_dump_interfaces == NULL ||
+    g_strv_contains ((const gchar *const *) opt_dump_interfaces, interface_name);
+}
+
+static gboolean
+dump_wants_property (const gchar *property_name)
+{
+  return opt_dump_properties == NULL ||
+    g_strv_contains ((const gchar *const *) opt_dump_properties, property_name);
+}
+
+/* Prints @object_path and its (a{sa{sv}}) @interfaces as a single line
+ * of JSON, leaving out what wasn't asked for.
+ */
+static void
+dump_object_json (GString     *str,
+                  const gchar *object_path,
+                  GVariant    *interfaces)
+{
+  GVariantIter iter;
+  const gchar *interface_name;
+  GVariant *properties;
+  gboolean first_interface = TRUE;
+
+  g_string_truncate (str, 0);
+  g_string_append (str, "{\"object\":");
+  json_append_string (str, object_path);
+  g_string_append (str, ",\"interfaces\":{");
+
+  g_variant_iter_init (&iter, interfaces);
+  while (g_variant_iter_next (&iter, "{&s@a{sv}}", &interface_name, &properties))
+    {
+      GVariantIter props_iter;
+      const gchar *property_name;
+      GVariant *value;
+      gboolean first_property = TRUE;
+
+      if (!dump_wants_interface (interface_name))
+        {
+          g_variant_unref (properties);
+          continue;
+        }
+
+      if (!first_interface)
+        g_string_append_c (str, ',');
+      first_interface = FALSE;
+      json_append_string (str, interface_name);
+      g_string_append (str, ":{");
+
+      g_variant_iter_init (&props_iter, properties);
+      while (g_variant_iter_next (&props_iter, "{&sv}", &property_name, &value))
+        {
+          if (dump_wants_property (property_name))
+            {
+              if (!first_property)
+                g_string_append_c (str, ',');
+              first_property = FALSE;
+              json_append_string (str, property_name);
+              g_string_append_c (str, ':');
+              json_append_variant (str, value);
+            }
+          g_variant_unref (value);
+        }
+      g_string_append_c (str, '}');
+      g_variant_unref (properties);
+    }
+  g_string_append (str, "}}\n");
+
+  /* objects having none of the requested interfaces are skipped */
+  if (opt_dump_interfaces != NULL && first_interface)
+    return;
+
+  /* flush every line so consumers can process them as they come */
+  fwrite (str->str, 1, str->len, stdout);
+  fflush (stdout);
+}
+
+/* Dumps the objects as JSON using Manager.QueryObjects() which lets the
+ * daemon leave out the interfaces not asked for. Returns FALSE if the
+ * daemon doesn't support that.
+ */
+static gboolean
+dump_json_query (void)
+{
+  UDisksManager *manager;
+  GVariantBuilder filter;
+  GVariantBuilder projection;
+  GVariant *objects = NULL;
+  GVariantIter iter;
+  const gchar *object_path;
+  GVariant *interfaces;
+  GString *str;
+  const gchar *const all_properties[1] = { NULL };
+  guint n;
+
+  manager = udisks_manager_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+                                                   G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                   G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                   "org.freedesktop.UDisks2",
+                                                   "/org/freedesktop/UDisks2/Manager",
+                                                   NULL, /* GCancellable */
+                                                   NULL);
+  if (manager == NULL)
+    return FALSE;
+
+  g_variant_builder_init (&filter, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_init (&projection, G_VARIANT_TYPE ("a{sas}"));
+  for (n = 0; opt_dump_interfaces != NULL && opt_dump_interfaces[n] != NULL; n++)
+    g_variant_builder_add (&projection, "{s^as}", opt_dump_interfaces[n],
+                           opt_dump_properties != NULL ? (const gchar *const *) opt_dump_properties : all_properties);
+
+  if (!udisks_manager_call_query_objects_sync (manager,
+                                               g_variant_builder_end (&filter),
+                                               g_variant_builder_end (&projection),
+                                               g_variant_new ("a{sv}", NULL), /* options */
+                                               &objects,
+                                               NULL, /* GCancellable */
+                                               NULL))
+    {
+      g_object_unref (manager);
+      return FALSE;
+    }
+
+  str = g_string_new (NULL);
+  g_variant_iter_init (&iter, objects);
+  while (g_variant_iter_next (&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces))
+    {
+      dump_object_json (str, object_path, interfaces);
+      g_variant_unref (interfaces);
+    }
+  g_string_free (str, TRUE);
+
+  g_variant_unref (objects);
+  g_object_unref (manager);
+  return TRUE;
+}
+
+static void
+dump_json_client (void)
+{
+  GList *objects, *l;
+  GString *str;
+
+  str = g_string_new (NULL);
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      GDBusObject *object = G_DBUS_OBJECT (l->data);
+      GList *interface_proxies, *ll;
+      GVariantBuilder builder;
+      GVariant *interfaces;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+      interface_proxies = g_dbus_object_get_interfaces (object);
+      for (ll = interface_proxies; ll != NULL; ll = ll->next)
+        {
+          GDBusProxy *iproxy = G_DBUS_PROXY (ll->data);
+          g_variant_builder_add (&builder, "{s@a{sv}}",
+                                 g_dbus_proxy_get_interface_name (iproxy),
+                                 proxy_get_properties (iproxy));
+        }
+      g_list_free_full (interface_proxies, g_object_unref);
+
+      interfaces = g_variant_ref_sink (g_variant_builder_end (&builder));
+      dump_object_json (str, g_dbus_object_get_object_path (object), interfaces);
+      g_variant_unref (interfaces);
+    }
+  g_list_free_full (objects, g_object_unref);
+  g_string_free (str, TRUE);
+}
+
 static gint
 handle_command_dump (gint        *argc,
                      gchar      **argv[],
@@ -2530,6 +3085,9 @@ handle_command_dump (gint        *argc,
   gboolean first;
 
   ret = 1;
+  opt_dump_json = FALSE;
+  opt_dump_interfaces = NULL;
+  opt_dump_properties = NULL;
 
   modify_argv0_for_command (argc, argv, "dump");
 
@@ -2555,6 +3113,21 @@ handle_command_dump (gint        *argc,
   if (request_completion)
     goto out;
 
+  if (opt_dump_json)
+    {
+      if (!dump_json_query ())
+        {
+          if (!ensure_client ())
+            goto out;
+          dump_json_client ();
+        }
+      ret = 0;
+      goto out;
+    }
+
+  if (!ensure_client ())
+    goto out;
+
   _color_run_pager ();
 
   objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
@@ -2580,6 +3153,8 @@ handle_command_dump (gint        *argc,
 
  out:
   g_option_context_free (o);
+  g_strfreev (opt_dump_interfaces);
+  g_strfreev (opt_dump_properties);
   return ret;
 }
 
@@ -2820,11 +3395,254 @@ monitor_on_interface_proxy_signal (GDBusObjectManagerClient  *manager,
 }
 
 
+static gboolean opt_monitor_compact = FALSE;
+static gchar *opt_monitor_object_path = NULL;
+static gchar **opt_monitor_interfaces = NULL;
+
 static const GOptionEntry command_monitor_entries[] =
 {
-  { NULL }
+  {
+    "compact",
+    0, /* no short option */
+    0,
+    G_OPTION_ARG_NONE,
+    &opt_monitor_compact,
+    "Print one line per event with only the changed properties",
+    NULL
+  },
+  {
+    "object-path",
+    'p',
+    0,
+    G_OPTION_ARG_STRING,
+    &opt_monitor_object_path,
+    "Only monitor objects below this path (implies --compact)",
+    NULL
+  },
+  {
+    "interface",
+    'i',
+    0,
+    G_OPTION_ARG_STRING_ARRAY,
+    &opt_monitor_interfaces,
+    "Only monitor this interface (may be repeated, implies --compact)",
+    NULL
+  },
+  {
+    NULL
+  }
 };
 
+/* In the compact mode the signals are subscribed to directly on the bus
+ * instead of going through the UDisksClient which would keep proxies
+ * for, and get the properties of, all objects. Match rules are added
+ * for the filters so the bus daemon doesn't even send the signals that
+ * aren't asked for.
+ */
+
+static gboolean
+monitor_compact_wants_path (const gchar *object_path)
+{
+  gsize len;
+
+  if (opt_monitor_object_path == NULL || g_strcmp0 (opt_monitor_object_path, "/") == 0)
+    return TRUE;
+
+  len = strlen (opt_monitor_object_path);
+  return strncmp (object_path, opt_monitor_object_path, len) == 0 &&
+    (object_path[len] == '\0' || object_path[len] == '/');
+}
+
+static gboolean
+monitor_compact_wants_interface (const gchar *interface_name)
+{
+  return opt_monitor_interfaces == NULL ||
+    g_strv_contains ((const gchar *const *) opt_monitor_interfaces, interface_name);
+}
+
+static void
+monitor_compact_print_timestamp (GString *str)
+{
+  GDateTime *now;
+  gchar *time_str;
+
+  now = g_date_time_new_now_local ();
+  time_str = g_date_time_format (now, "%H:%M:%S");
+  g_string_append_printf (str, "%s.%03d", time_str, g_date_time_get_microsecond (now) / 1000);
+  g_free (time_str);
+  g_date_time_unref (now);
+}
+
+static void
+monitor_compact_print (GString *str)
+{
+  g_string_append_c (str, '\n');
+  fwrite (str->str, 1, str->len, stdout);
+  fflush (stdout);
+}
+
+static void
+monitor_compact_on_properties_changed (GDBusConnection *connection,
+                                       const gchar     *sender_name,
+                                       const gchar     *object_path,
+                                       const gchar     *interface_name,
+                                       const gchar     *signal_name,
+                                       GVariant        *parameters,
+                                       gpointer         user_data)
+{
+  const gchar *changed_interface;
+  GVariant *changed_properties;
+  GVariantIter iter;
+  const gchar *property_name;
+  GVariant *value;
+  GString *str;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)")))
+    return;
+
+  g_variant_get (parameters, "(&s@a{sv}@as)", &changed_interface, &changed_properties, NULL);
+  if (!monitor_compact_wants_path (object_path) || !monitor_compact_wants_interface (changed_interface))
+    goto out;
+
+  str = g_string_new (NULL);
+  monitor_compact_print_timestamp (str);
+  g_string_append_printf (str, " %s %s", object_path, changed_interface);
+  g_variant_iter_init (&iter, changed_properties);
+  while (g_variant_iter_next (&iter, "{&sv}", &property_name, &value))
+    {
+      g_string_append_printf (str, " %s=", property_name);
+      g_variant_print_string (value, str, FALSE);
+      g_variant_unref (value);
+    }
+  monitor_compact_print (str);
+  g_string_free (str, TRUE);
+
+ out:
+  g_variant_unref (changed_properties);
+}
+
+static void
+monitor_compact_on_interfaces_changed (GDBusConnection *connection,
+                                       const gchar     *sender_name,
+                                       const gchar     *object_path,
+                                       const gchar     *interface_name,
+                                       const gchar     *signal_name,
+                                       GVariant        *parameters,
+                                       gpointer         user_data)
+{
+  gboolean added = g_strcmp0 (signal_name, "InterfacesAdded") == 0;
+  const gchar *changed_object_path;
+  GVariant *interfaces;
+  GVariantIter iter;
+  const gchar *name;
+  GString *str;
+  gboolean any = FALSE;
+
+  if (added && g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oa{sa{sv}})")))
+    g_variant_get (parameters, "(&o@a{sa{sv}})", &changed_object_path, &interfaces);
+  else if (!added && g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oas)")))
+    g_variant_get (parameters, "(&o@as)", &changed_object_path, &interfaces);
+  else
+    return;
+
+  if (!monitor_compact_wants_path (changed_object_path))
+    goto out;
+
+  str = g_string_new (NULL);
+  monitor_compact_print_timestamp (str);
+  g_string_append_printf (str, " %s", changed_object_path);
+  g_variant_iter_init (&iter, interfaces);
+  while (added ? g_variant_iter_next (&iter, "{&s@a{sv}}", &name, NULL) : g_variant_iter_next (&iter, "&s", &name))
+    {
+      if (!monitor_compact_wants_interface (name))
+        continue;
+      g_string_append_printf (str, " %c%s", added ? '+' : '-', name);
+      any = TRUE;
+    }
+  if (any)
+    monitor_compact_print (str);
+  g_string_free (str, TRUE);
+
+ out:
+  g_variant_unref (interfaces);
+}
+
+static void
+monitor_compact_add_match (GDBusConnection *connection,
+                           const gchar     *interface_name)
+{
+  gchar *rule;
+
+  rule = g_strdup_printf ("type='signal',sender='org.freedesktop.UDisks2',"
+                          "interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',"
+                          "path_namespace='%s'%s%s%s",
+                          opt_monitor_object_path != NULL ? opt_monitor_object_path : "/org/freedesktop/UDisks2",
+                          interface_name != NULL ? ",arg0='" : "",
+                          interface_name != NULL ? interface_name : "",
+                          interface_name != NULL ? "'" : "");
+  g_dbus_connection_call (connection,
+                          "org.freedesktop.DBus",
+                          "/org/freedesktop/DBus",
+                          "org.freedesktop.DBus",
+                          "AddMatch",
+                          g_variant_new ("(s)", rule),
+                          NULL, /* reply_type */
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1, /* default timeout */
+                          NULL, /* GCancellable */
+                          NULL, /* GAsyncReadyCallback */
+                          NULL);
+  g_free (rule);
+}
+
+static gboolean
+monitor_compact_run (void)
+{
+  GDBusConnection *connection;
+  GError *error = NULL;
+  guint n;
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+  if (connection == NULL)
+    {
+      g_printerr ("Error connecting to the system bus: %s\n", error->message);
+      g_clear_error (&error);
+      return FALSE;
+    }
+
+  /* the match rules are added by hand since GDBus can't do path_namespace */
+  g_dbus_connection_signal_subscribe (connection,
+                                      "org.freedesktop.UDisks2",
+                                      "org.freedesktop.DBus.Properties",
+                                      "PropertiesChanged",
+                                      NULL, /* object_path */
+                                      NULL, /* arg0 */
+                                      G_DBUS_SIGNAL_FLAGS_NO_MATCH_RULE,
+                                      monitor_compact_on_properties_changed,
+                                      NULL, /* user_data */
+                                      NULL); /* user_data_free_func */
+  g_dbus_connection_signal_subscribe (connection,
+                                      "org.freedesktop.UDisks2",
+                                      "org.freedesktop.DBus.ObjectManager",
+                                      NULL, /* member */
+                                      "/org/freedesktop/UDisks2",
+                                      NULL, /* arg0 */
+                                      G_DBUS_SIGNAL_FLAGS_NONE,
+                                      monitor_compact_on_interfaces_changed,
+                                      NULL, /* user_data */
+                                      NULL); /* user_data_free_func */
+
+  if (opt_monitor_interfaces == NULL)
+    monitor_compact_add_match (connection, NULL);
+  for (n = 0; opt_monitor_interfaces != NULL && opt_monitor_interfaces[n] != NULL; n++)
+    monitor_compact_add_match (connection, opt_monitor_interfaces[n]);
+
+  g_main_loop_run (loop);
+
+  g_object_unref (connection);
+  return TRUE;
+}
+
 static gint
 handle_command_monitor (gint        *argc,
                         gchar      **argv[],
@@ -2836,8 +3654,12 @@ handle_command_monitor (gint        *argc,
   GOptionContext *o;
   gchar *s;
   GDBusObjectManager *manager;
+  guint n;
 
   ret = 1;
+  opt_monitor_compact = FALSE;
+  opt_monitor_object_path = NULL;
+  opt_monitor_interfaces = NULL;
 
   modify_argv0_for_command (argc, argv, "monitor");
 
@@ -2863,6 +3685,31 @@ handle_command_monitor (gint        *argc,
   if (request_completion)
     goto out;
 
+  if (opt_monitor_object_path != NULL && !g_variant_is_object_path (opt_monitor_object_path))
+    {
+      g_printerr ("Invalid object path `%s'\n", opt_monitor_object_path);
+      goto out;
+    }
+
+  for (n = 0; opt_monitor_interfaces != NULL && opt_monitor_interfaces[n] != NULL; n++)
+    {
+      if (!g_dbus_is_interface_name (opt_monitor_interfaces[n]))
+        {
+          g_printerr ("Invalid interface name `%s'\n", opt_monitor_interfaces[n]);
+          goto out;
+        }
+    }
+
+  if (opt_monitor_compact || opt_monitor_object_path != NULL || opt_monitor_interfaces != NULL)
+    {
+      if (monitor_compact_run ())
+        ret = 0;
+      goto out;
+    }
+
+  if (!ensure_client ())
+    goto out;
+
   g_print ("Monitoring the udisks daemon. Press Ctrl+C to exit.\n");
 
   manager = udisks_client_get_object_manager (client);
@@ -2904,6 +3751,8 @@ handle_command_monitor (gint        *argc,
 
  out:
   g_option_context_free (o);
+  g_free (opt_monitor_object_path);
+  g_strfreev (opt_monitor_interfaces);
   return ret;
 }
 
@@ -3243,7 +4092,6 @@ main (int argc,
   gboolean request_completion;
   gchar *completion_cur;
   gchar *completion_prev;
-  GError *error;
 
   ret = 1;
   completion_cur = NULL;
@@ -3262,15 +4110,10 @@ main (int argc,
 
   loop = g_main_loop_new (NULL, FALSE);
 
-  error = NULL;
-  client = udisks_client_new_sync (NULL, /* GCancellable */
-                                   &error);
-  if (client == NULL)
-    {
-      g_printerr ("Error connecting to the udisks daemon: %s\n", error->message);
-      g_clear_error (&error);
-      goto out;
-    }
+  /* the info, dump and monitor commands only connect if needed */
+  if (g_strcmp0 (argv[1], "info") != 0 && g_strcmp0 (argv[1], "dump") != 0 &&
+      g_strcmp0 (argv[1], "monitor") != 0 && !ensure_client ())
+    goto out;
 
   request_completion = FALSE;
 
@@ -22,6 +22,7 @@
 #include <glib/gi18n-lib.h>
 
 #include "udisksclient.h"
+#include "udisksclientprivate.h"
 #include "udiskserror.h"
 #include "udisks-generated.h"
 #include "udisksobjectinfo.h"
@@ -61,8 +62,52 @@ struct _UDisksClient
   GMainContext *context;
 
   GSource *changed_timeout_source;
+
+  /* Lookup indexes, protected by index_lock. Each of the blocks_by_* and
+   * partitions_by_table tables maps a property value to the set of
+   * ClientIndexEntry instances having it.
+   */
+  GMutex index_lock;
+  GHashTable *index_entries;    /* object path -> ClientIndexEntry */
+  GHashTable *blocks_by_label;
+  GHashTable *blocks_by_uuid;
+  GHashTable *blocks_by_dev;
+  GHashTable *blocks_by_drive;
+  GHashTable *blocks_by_mdraid;
+  GHashTable *blocks_by_mdraid_member;
+  GHashTable *blocks_by_crypto_backing_device;
+  GHashTable *partitions_by_table;
+  GHashTable *jobs_by_object;
+
+  /* object paths for the next UDisksClient::topology-changed signal */
+  GHashTable *pending_topology_changes;
+
+  /* object path -> UDisksObjectInfo, also protected by index_lock */
+  GHashTable *object_info_cache;
+  guint64 object_info_generation;
+
+  /* object path -> set of interface names for the next
+   * UDisksClient::objects-changed signal, also protected by index_lock
+   */
+  GHashTable *pending_changes;
 };
 
+/* The values an object was indexed with, needed to remove it again */
+typedef struct
+{
+  UDisksObject *object;
+  gboolean is_partition;
+  gchar *id_label;
+  gchar *id_uuid;
+  gchar *device_number;
+  gchar *drive;
+  gchar *mdraid;
+  gchar *mdraid_member;
+  gchar *crypto_backing_device;
+  gchar *partition_table;
+  gchar **job_objects;
+} ClientIndexEntry;
+
 typedef struct
 {
   GObjectClass parent_class;
@@ -80,6 +125,8 @@ enum
 enum
 {
   CHANGED_SIGNAL,
+  TOPOLOGY_CHANGED_SIGNAL,
+  OBJECTS_CHANGED_SIGNAL,
   LAST_SIGNAL
 };
 
@@ -115,6 +162,13 @@ static void on_interface_proxy_properties_changed (GDBusObjectManagerClient   *m
 
 static void maybe_emit_changed_now (UDisksClient *client);
 
+static void index_update_object (UDisksClient *client,
+                                 GDBusObject  *object,
+                                 gboolean      interfaces_changed);
+
+static void index_remove_object (UDisksClient *client,
+                                 GDBusObject  *object);
+
 static void init_interface_proxy (UDisksClient *client,
                                   GDBusProxy   *proxy);
 
@@ -162,9 +216,46 @@ udisks_client_finalize (GObject *object)
 
   g_clear_object (&client->bus_connection);
 
+  g_hash_table_unref (client->blocks_by_label);
+  g_hash_table_unref (client->blocks_by_uuid);
+  g_hash_table_unref (client->blocks_by_dev);
+  g_hash_table_unref (client->blocks_by_drive);
+  g_hash_table_unref (client->blocks_by_mdraid);
+  g_hash_table_unref (client->blocks_by_mdraid_member);
+  g_hash_table_unref (client->blocks_by_crypto_backing_device);
+  g_hash_table_unref (client->partitions_by_table);
+  g_hash_table_unref (client->jobs_by_object);
+  g_hash_table_unref (client->index_entries);
+  g_hash_table_unref (client->pending_topology_changes);
+  g_hash_table_unref (client->object_info_cache);
+  g_hash_table_unref (client->pending_changes);
+  g_mutex_clear (&client->index_lock);
+
   G_OBJECT_CLASS (udisks_client_parent_class)->finalize (object);
 }
 
+static GHashTable *
+index_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_hash_table_unref);
+}
+
+static void
+client_index_entry_free (ClientIndexEntry *entry)
+{
+  g_free (entry->id_label);
+  g_free (entry->id_uuid);
+  g_free (entry->device_number);
+  g_free (entry->drive);
+  g_free (entry->mdraid);
+  g_free (entry->mdraid_member);
+  g_free (entry->crypto_backing_device);
+  g_free (entry->partition_table);
+  g_strfreev (entry->job_objects);
+  g_object_unref (entry->object);
+  g_slice_free (ClientIndexEntry, entry);
+}
+
 static void
 udisks_client_init (UDisksClient *client)
 {
@@ -175,6 +266,22 @@ udisks_client_init (UDisksClient *client)
    */
   udisks_error_domain = UDISKS_ERROR;
   udisks_error_domain; /* shut up -Wunused-but-set-variable */
+
+  g_mutex_init (&client->index_lock);
+  client->index_entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, (GDestroyNotify) client_index_entry_free);
+  client->blocks_by_label = index_new ();
+  client->blocks_by_uuid = index_new ();
+  client->blocks_by_dev = index_new ();
+  client->blocks_by_drive = index_new ();
+  client->blocks_by_mdraid = index_new ();
+  client->blocks_by_mdraid_member = index_new ();
+  client->blocks_by_crypto_backing_device = index_new ();
+  client->partitions_by_table = index_new ();
+  client->jobs_by_object = index_new ();
+  client->pending_topology_changes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  client->object_info_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  client->pending_changes = index_new ();
 }
 
 static void
@@ -302,7 +409,8 @@ udisks_client_class_init (UDisksClientClass *klass)
    * Note that calling udisks_client_settle() will cause this signal
    * to fire if any changes are outstanding.
    *
-   * For greater detail, connect to the
+   * To find out what changed, connect to
+   * #UDisksClient::objects-changed or, for greater detail, to the
    * #GDBusObjectManager::object-added,
    * #GDBusObjectManager::object-removed,
    * #GDBusObjectManager::interface-added,
@@ -320,6 +428,63 @@ udisks_client_class_init (UDisksClientClass *klass)
                                           G_TYPE_NONE,
                                           0);
 
+  /**
+   * UDisksClient::topology-changed:
+   * @client: A #UDisksClient.
+   * @object_paths: (array zero-terminated=1) (element-type utf8): The
+   *   object paths of the objects whose place in the device tree or
+   *   whose children changed.
+   *
+   * This signal is emitted right before #UDisksClient::changed if
+   * objects were added or removed, had interfaces added or removed or
+   * if any of the properties relating them to other objects changed:
+   * the #UDisksBlock:drive, #UDisksBlock:mdraid,
+   * #UDisksBlock:mdraid-member, #UDisksBlock:crypto-backing-device
+   * and #UDisksPartition:table properties.
+   *
+   * For every such object, both the object itself and the objects it
+   * is and was a child of are included in @object_paths, so user
+   * interfaces showing a tree of devices only need to update the
+   * subtrees rooted at @object_paths.
+   *
+   * Since: 2.9.0
+   */
+  signals[TOPOLOGY_CHANGED_SIGNAL] = g_signal_new ("topology-changed",
+                                                   G_OBJECT_CLASS_TYPE (klass),
+                                                   G_SIGNAL_RUN_LAST,
+                                                   0, /* G_STRUCT_OFFSET */
+                                                   NULL, /* accu */
+                                                   NULL, /* accu data */
+                                                   g_cclosure_marshal_generic,
+                                                   G_TYPE_NONE,
+                                                   1,
+                                                   G_TYPE_STRV);
+
+  /**
+   * UDisksClient::objects-changed:
+   * @client: A #UDisksClient.
+   * @changes: A #GVariant of type <literal>a{oas}</literal> mapping
+   *   object paths to the names of the interfaces that changed.
+   *
+   * This signal is emitted right before #UDisksClient::changed and
+   * reports what changed since the last emission: the objects that
+   * were added or removed (with all their interfaces), the interfaces
+   * that were added or removed and the interfaces properties changed
+   * on. Use udisks_client_peek_object() to find out whether an object
+   * still exists.
+   *
+   * Since: 2.9.0
+   */
+  signals[OBJECTS_CHANGED_SIGNAL] = g_signal_new ("objects-changed",
+                                                  G_OBJECT_CLASS_TYPE (klass),
+                                                  G_SIGNAL_RUN_LAST,
+                                                  0, /* G_STRUCT_OFFSET */
+                                                  NULL, /* accu */
+                                                  NULL, /* accu data */
+                                                  g_cclosure_marshal_generic,
+                                                  G_TYPE_NONE,
+                                                  1,
+                                                  G_TYPE_VARIANT);
 }
 
 /**
@@ -510,10 +675,11 @@ initable_init (GInitable     *initable,
   if (client->object_manager == NULL)
     goto out;
 
-  /* init all proxies */
+  /* init all proxies and the lookup indexes */
   objects = g_dbus_object_manager_get_objects (client->object_manager);
   for (l = objects; l != NULL; l = l->next)
     {
+      index_update_object (client, G_DBUS_OBJECT (l->data), FALSE);
       interfaces = g_dbus_object_get_interfaces (G_DBUS_OBJECT (l->data));
       for (ll = interfaces; ll != NULL; ll = ll->next)
         {
@@ -522,6 +688,7 @@ initable_init (GInitable     *initable,
       g_list_free_full (interfaces, g_object_unref);
     }
   g_list_free_full (objects, g_object_unref);
+  g_hash_table_remove_all (client->pending_topology_changes);
 
   g_signal_connect (client->object_manager,
                     "object-added",
@@ -641,6 +808,451 @@ udisks_client_settle (UDisksClient *client)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* The lookup functions below used to go through all the objects for
+ * every call, making views calling them for every object quadratic.
+ * Instead the values they look up are indexed whenever an object or an
+ * interface is added or a property changes.
+ */
+
+static void
+index_insert (GHashTable       *index,
+              const gchar      *key,
+              ClientIndexEntry *entry)
+{
+  GHashTable *entries;
+
+  if (key == NULL)
+    return;
+
+  entries = g_hash_table_lookup (index, key);
+  if (entries == NULL)
+    {
+      entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (index, g_strdup (key), entries);
+    }
+  g_hash_table_add (entries, entry);
+}
+
+static void
+index_remove (GHashTable       *index,
+              const gchar      *key,
+              ClientIndexEntry *entry)
+{
+  GHashTable *entries;
+
+  if (key == NULL)
+    return;
+
+  entries = g_hash_table_lookup (index, key);
+  if (entries == NULL)
+    return;
+
+  g_hash_table_remove (entries, entry);
+  if (g_hash_table_size (entries) == 0)
+    g_hash_table_remove (index, key);
+}
+
+static gchar *
+format_device_number (guint64 device_number)
+{
+  return g_strdup_printf ("%" G_GUINT64_FORMAT, device_number);
+}
+
+/* must be called with index_lock held */
+static void
+index_entry_unlink (UDisksClient     *client,
+                    ClientIndexEntry *entry)
+{
+  guint n;
+
+  index_remove (client->blocks_by_label, entry->id_label, entry);
+  index_remove (client->blocks_by_uuid, entry->id_uuid, entry);
+  index_remove (client->blocks_by_dev, entry->device_number, entry);
+  index_remove (client->blocks_by_drive, entry->drive, entry);
+  index_remove (client->blocks_by_mdraid, entry->mdraid, entry);
+  index_remove (client->blocks_by_mdraid_member, entry->mdraid_member, entry);
+  index_remove (client->blocks_by_crypto_backing_device, entry->crypto_backing_device, entry);
+  index_remove (client->partitions_by_table, entry->partition_table, entry);
+  for (n = 0; entry->job_objects != NULL && entry->job_objects[n] != NULL; n++)
+    index_remove (client->jobs_by_object, entry->job_objects[n], entry);
+}
+
+/* must be called with index_lock held */
+static void
+index_entry_link (UDisksClient     *client,
+                  ClientIndexEntry *entry)
+{
+  UDisksBlock *block;
+  UDisksPartition *partition;
+  UDisksJob *job;
+  guint n;
+
+  block = udisks_object_get_block (entry->object);
+  partition = udisks_object_get_partition (entry->object);
+  job = udisks_object_get_job (entry->object);
+
+  entry->is_partition = partition != NULL;
+
+  if (block != NULL)
+    {
+      entry->id_label = g_strdup (udisks_block_get_id_label (block));
+      entry->id_uuid = g_strdup (udisks_block_get_id_uuid (block));
+      entry->device_number = format_device_number (udisks_block_get_device_number (block));
+      entry->drive = g_strdup (udisks_block_get_drive (block));
+      entry->mdraid = g_strdup (udisks_block_get_mdraid (block));
+      entry->mdraid_member = g_strdup (udisks_block_get_mdraid_member (block));
+      entry->crypto_backing_device = g_strdup (udisks_block_get_crypto_backing_device (block));
+
+      index_insert (client->blocks_by_label, entry->id_label, entry);
+      index_insert (client->blocks_by_uuid, entry->id_uuid, entry);
+      index_insert (client->blocks_by_dev, entry->device_number, entry);
+      index_insert (client->blocks_by_drive, entry->drive, entry);
+      index_insert (client->blocks_by_mdraid, entry->mdraid, entry);
+      index_insert (client->blocks_by_mdraid_member, entry->mdraid_member, entry);
+      index_insert (client->blocks_by_crypto_backing_device, entry->crypto_backing_device, entry);
+      g_object_unref (block);
+    }
+
+  if (partition != NULL)
+    {
+      entry->partition_table = g_strdup (udisks_partition_get_table (partition));
+      index_insert (client->partitions_by_table, entry->partition_table, entry);
+      g_object_unref (partition);
+    }
+
+  /* the objects of a job don't change while it is running */
+  if (job != NULL)
+    {
+      entry->job_objects = g_strdupv ((gchar **) udisks_job_get_objects (job));
+      for (n = 0; entry->job_objects != NULL && entry->job_objects[n] != NULL; n++)
+        index_insert (client->jobs_by_object, entry->job_objects[n], entry);
+      g_object_unref (job);
+    }
+}
+
+static gboolean
+index_entry_topology_equal (ClientIndexEntry *a,
+                            ClientIndexEntry *b)
+{
+  return a->is_partition == b->is_partition &&
+    g_strcmp0 (a->drive, b->drive) == 0 &&
+    g_strcmp0 (a->mdraid, b->mdraid) == 0 &&
+    g_strcmp0 (a->mdraid_member, b->mdraid_member) == 0 &&
+    g_strcmp0 (a->crypto_backing_device, b->crypto_backing_device) == 0 &&
+    g_strcmp0 (a->partition_table, b->partition_table) == 0;
+}
+
+static void
+note_topology_change (UDisksClient *client,
+                      const gchar  *object_path)
+{
+  /* unset object path properties are "/" */
+  if (object_path == NULL || g_strcmp0 (object_path, "/") == 0)
+    return;
+
+  if (!g_hash_table_contains (client->pending_topology_changes, object_path))
+    g_hash_table_add (client->pending_topology_changes, g_strdup (object_path));
+}
+
+/* must be called with index_lock held */
+static void
+index_entry_note_topology_change (UDisksClient     *client,
+                                  ClientIndexEntry *entry)
+{
+  note_topology_change (client, g_dbus_object_get_object_path (G_DBUS_OBJECT (entry->object)));
+  note_topology_change (client, entry->drive);
+  note_topology_change (client, entry->mdraid);
+  note_topology_change (client, entry->mdraid_member);
+  note_topology_change (client, entry->crypto_backing_device);
+  note_topology_change (client, entry->partition_table);
+}
+
+static void
+object_info_cache_remove_entries (UDisksClient *client,
+                                  GHashTable   *index,
+                                  const gchar  *key)
+{
+  GHashTable *entries;
+  GHashTableIter iter;
+  ClientIndexEntry *entry;
+
+  entries = g_hash_table_lookup (index, key);
+  if (entries == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
+    g_hash_table_remove (client->object_info_cache,
+                         g_dbus_object_get_object_path (G_DBUS_OBJECT (entry->object)));
+}
+
+/* Drops the cached #UDisksObjectInfo of @object_path and of the objects
+ * whose info is built from it: the info for a drive uses its whole disk
+ * block device and the info for a block device uses its drive or
+ * MD-RAID array. @entry is the index entry of @object_path, if any.
+ *
+ * Must be called with index_lock held.
+ */
+static void
+object_info_cache_invalidate (UDisksClient     *client,
+                              const gchar      *object_path,
+                              ClientIndexEntry *entry)
+{
+  g_hash_table_remove (client->object_info_cache, object_path);
+  object_info_cache_remove_entries (client, client->blocks_by_drive, object_path);
+  object_info_cache_remove_entries (client, client->blocks_by_mdraid, object_path);
+  object_info_cache_remove_entries (client, client->partitions_by_table, object_path);
+  if (entry != NULL)
+    {
+      if (entry->drive != NULL)
+        g_hash_table_remove (client->object_info_cache, entry->drive);
+      if (entry->mdraid != NULL)
+        g_hash_table_remove (client->object_info_cache, entry->mdraid);
+    }
+  client->object_info_generation++;
+}
+
+static void
+index_update_object (UDisksClient *client,
+                     GDBusObject  *object,
+                     gboolean      interfaces_changed)
+{
+  const gchar *object_path;
+  ClientIndexEntry *old_entry;
+  ClientIndexEntry *entry;
+
+  object_path = g_dbus_object_get_object_path (object);
+
+  /* Re-index into a new entry so that the old values are still around
+   * to compare the position in the device tree with.
+   */
+  entry = g_slice_new0 (ClientIndexEntry);
+  entry->object = g_object_ref (UDISKS_OBJECT (object));
+
+  g_mutex_lock (&client->index_lock);
+  old_entry = g_hash_table_lookup (client->index_entries, object_path);
+  if (old_entry != NULL)
+    index_entry_unlink (client, old_entry);
+  index_entry_link (client, entry);
+
+  if (old_entry == NULL || interfaces_changed || !index_entry_topology_equal (old_entry, entry))
+    {
+      if (old_entry != NULL)
+        index_entry_note_topology_change (client, old_entry);
+      index_entry_note_topology_change (client, entry);
+    }
+
+  if (old_entry != NULL)
+    object_info_cache_invalidate (client, object_path, old_entry);
+  object_info_cache_invalidate (client, object_path, entry);
+
+  /* frees old_entry */
+  g_hash_table_replace (client->index_entries, g_strdup (object_path), entry);
+  g_mutex_unlock (&client->index_lock);
+}
+
+static void
+index_remove_object (UDisksClient *client,
+                     GDBusObject  *object)
+{
+  const gchar *object_path;
+  ClientIndexEntry *entry;
+
+  object_path = g_dbus_object_get_object_path (object);
+
+  g_mutex_lock (&client->index_lock);
+  entry = g_hash_table_lookup (client->index_entries, object_path);
+  if (entry != NULL)
+    {
+      index_entry_unlink (client, entry);
+      index_entry_note_topology_change (client, entry);
+      object_info_cache_invalidate (client, object_path, entry);
+      g_hash_table_remove (client->index_entries, object_path);
+    }
+  else
+    {
+      object_info_cache_invalidate (client, object_path, NULL);
+    }
+  g_mutex_unlock (&client->index_lock);
+}
+
+static void
+index_invalidate_object_info (UDisksClient *client,
+                              GDBusObject  *object)
+{
+  const gchar *object_path;
+
+  object_path = g_dbus_object_get_object_path (object);
+
+  g_mutex_lock (&client->index_lock);
+  object_info_cache_invalidate (client,
+                                object_path,
+                                g_hash_table_lookup (client->index_entries, object_path));
+  g_mutex_unlock (&client->index_lock);
+}
+
+/* Gets the cached #UDisksObjectInfo for @object, if any, and the
+ * generation of the cache to pass to _udisks_client_cache_object_info().
+ */
+UDisksObjectInfo *
+_udisks_client_get_cached_object_info (UDisksClient *client,
+                                       UDisksObject *object,
+                                       guint64      *out_generation)
+{
+  UDisksObjectInfo *ret;
+
+  g_mutex_lock (&client->index_lock);
+  ret = g_hash_table_lookup (client->object_info_cache,
+                             g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  if (ret != NULL)
+    g_object_ref (ret);
+  *out_generation = client->object_info_generation;
+  g_mutex_unlock (&client->index_lock);
+
+  return ret;
+}
+
+/* Caches @info for @object unless anything was invalidated since
+ * @generation, in which case @info might already be outdated.
+ */
+void
+_udisks_client_cache_object_info (UDisksClient     *client,
+                                  UDisksObject     *object,
+                                  UDisksObjectInfo *info,
+                                  guint64           generation)
+{
+  const gchar *object_path;
+
+  object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+
+  g_mutex_lock (&client->index_lock);
+  if (generation == client->object_info_generation &&
+      g_hash_table_contains (client->index_entries, object_path))
+    g_hash_table_insert (client->object_info_cache, g_strdup (object_path), g_object_ref (info));
+  g_mutex_unlock (&client->index_lock);
+}
+
+typedef struct
+{
+  UDisksClientLookupFunc func;
+  GObject *arg;
+  GDestroyNotify result_free;
+} LookupData;
+
+static void
+lookup_data_free (LookupData *data)
+{
+  g_object_unref (data->arg);
+  g_slice_free (LookupData, data);
+}
+
+static gboolean
+on_lookup_idle (gpointer user_data)
+{
+  GTask *task = G_TASK (user_data);
+  LookupData *data = g_task_get_task_data (task);
+
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_pointer (task,
+                           data->func (UDISKS_CLIENT (g_task_get_source_object (task)), data->arg),
+                           data->result_free);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * _udisks_client_lookup_async:
+ * @client: A #UDisksClient.
+ * @source_tag: The public function, checked by the _finish() function.
+ * @func: The synchronous lookup function.
+ * @arg: The object to pass to @func.
+ * @result_free: Function to free the result of @func with if it is not used.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: Function that will be called when the result is ready.
+ * @user_data: Data to pass to @callback.
+ *
+ * Runs @func from an idle source in the thread-default main context of
+ * the calling thread and returns its result through a #GTask.
+ *
+ * The generated D-Bus proxies hand out their cached values without
+ * copying them so they can only be used from the thread @client was
+ * created in. Deferring the work instead of running it in another
+ * thread lets callers keep their user interface responsive by handling
+ * pending events first and dropping lookups that are no longer needed.
+ */
+void
+_udisks_client_lookup_async (UDisksClient           *client,
+                             gpointer                source_tag,
+                             UDisksClientLookupFunc  func,
+                             GObject                *arg,
+                             GDestroyNotify          result_free,
+                             GCancellable           *cancellable,
+                             GAsyncReadyCallback     callback,
+                             gpointer                user_data)
+{
+  GTask *task;
+  LookupData *data;
+  GSource *source;
+
+  data = g_slice_new0 (LookupData);
+  data->func = func;
+  data->arg = g_object_ref (arg);
+  data->result_free = result_free;
+
+  task = g_task_new (client, cancellable, callback, user_data);
+  g_task_set_source_tag (task, source_tag);
+  g_task_set_task_data (task, data, (GDestroyNotify) lookup_data_free);
+  g_task_set_priority (task, G_PRIORITY_DEFAULT_IDLE);
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+  g_source_set_callback (source, on_lookup_idle, task, g_object_unref);
+  g_source_attach (source, g_task_get_context (task));
+  g_source_unref (source);
+}
+
+/* Gets the blocks of the objects indexed under @key in @index. */
+static GList *
+index_lookup_blocks (UDisksClient *client,
+                     GHashTable   *index,
+                     const gchar  *key,
+                     gboolean      only_first_one,
+                     gboolean      skip_partitions)
+{
+  GList *ret = NULL;
+  GHashTable *entries;
+  GHashTableIter iter;
+  ClientIndexEntry *entry;
+
+  g_mutex_lock (&client->index_lock);
+  entries = g_hash_table_lookup (index, key);
+  if (entries == NULL)
+    goto out;
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
+    {
+      UDisksBlock *block;
+
+      if (skip_partitions && entry->is_partition)
+        continue;
+
+      block = udisks_object_get_block (entry->object);
+      if (block == NULL)
+        continue;
+
+      ret = g_list_prepend (ret, block);
+      if (only_first_one)
+        goto out;
+    }
+
+ out:
+  g_mutex_unlock (&client->index_lock);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 /**
  * udisks_client_get_object:
  * @client: A #UDisksClient.
@@ -701,31 +1313,10 @@ GList *
 udisks_client_get_block_for_label (UDisksClient        *client,
                                    const gchar         *label)
 {
-  GList *ret = NULL;
-  GList *l, *object_proxies = NULL;
-
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (label != NULL, NULL);
 
-  object_proxies = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = object_proxies; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_get_block (object);
-      if (block == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_block_get_id_label (block), label) == 0)
-        ret = g_list_prepend (ret, block);
-      else
-        g_object_unref (block);
-    }
-
-  g_list_free_full (object_proxies, g_object_unref);
-  ret = g_list_reverse (ret);
-  return ret;
+  return index_lookup_blocks (client, client->blocks_by_label, label, FALSE, FALSE);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -745,31 +1336,10 @@ GList *
 udisks_client_get_block_for_uuid (UDisksClient        *client,
                                   const gchar         *uuid)
 {
-  GList *ret = NULL;
-  GList *l, *object_proxies = NULL;
-
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (uuid != NULL, NULL);
 
-  object_proxies = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = object_proxies; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_get_block (object);
-      if (block == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_block_get_id_uuid (block), uuid) == 0)
-        ret = g_list_prepend (ret, block);
-      else
-        g_object_unref (block);
-    }
-
-  g_list_free_full (object_proxies, g_object_unref);
-  ret = g_list_reverse (ret);
-  return ret;
+  return index_lookup_blocks (client, client->blocks_by_uuid, uuid, FALSE, FALSE);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -791,70 +1361,22 @@ udisks_client_get_block_for_dev (UDisksClient *client,
                                  dev_t         block_device_number)
 {
   UDisksBlock *ret = NULL;
-  GList *l, *object_proxies = NULL;
+  GList *blocks;
+  gchar *key;
 
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
 
-  object_proxies = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = object_proxies; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_get_block (object);
-      if (block == NULL)
-        continue;
-
-      if (udisks_block_get_device_number (block) == block_device_number)
-        {
-          ret = block;
-          goto out;
-        }
-      g_object_unref (block);
-    }
-
- out:
-  g_list_free_full (object_proxies, g_object_unref);
+  key = format_device_number (block_device_number);
+  blocks = index_lookup_blocks (client, client->blocks_by_dev, key, TRUE, FALSE);
+  if (blocks != NULL)
+    ret = blocks->data;
+  g_list_free (blocks);
+  g_free (key);
   return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static GList *
-get_top_level_blocks_for_drive (UDisksClient *client,
-                                const gchar  *drive_object_path)
-{
-  GList *ret;
-  GList *l;
-  GList *object_proxies;
-  GDBusObjectManager *object_manager;
-
-  object_manager = udisks_client_get_object_manager (client);
-  object_proxies = g_dbus_object_manager_get_objects (object_manager);
-
-  ret = NULL;
-  for (l = object_proxies; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-      UDisksPartition *partition;
-
-      block = udisks_object_get_block (object);
-      partition = udisks_object_peek_partition (object);
-      if (block == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_block_get_drive (block), drive_object_path) == 0 &&
-          partition == NULL)
-        {
-          ret = g_list_append (ret, g_object_ref (object));
-        }
-      g_object_unref (block);
-    }
-  g_list_free_full (object_proxies, g_object_unref);
-  return ret;
-}
-
 /**
  * udisks_client_get_block_for_drive:
  * @client: A #UDisksClient.
@@ -882,8 +1404,7 @@ udisks_client_get_block_for_drive (UDisksClient        *client,
 {
   UDisksBlock *ret = NULL;
   GDBusObject *object;
-  GList *blocks = NULL;
-  GList *l;
+  GList *blocks;
 
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (UDISKS_IS_DRIVE (drive), NULL);
@@ -892,20 +1413,17 @@ udisks_client_get_block_for_drive (UDisksClient        *client,
   if (object == NULL)
     goto out;
 
-  blocks = get_top_level_blocks_for_drive (client, g_dbus_object_get_object_path (object));
-  for (l = blocks; l != NULL; l = l->next)
-    {
-      UDisksBlock *block = udisks_object_peek_block (UDISKS_OBJECT (l->data));
-      if (block != NULL)
-        {
-          /* TODO: actually look at @get_physical */
-          ret = g_object_ref (block);
-          goto out;
-        }
-    }
+  /* TODO: actually look at @get_physical */
+  blocks = index_lookup_blocks (client,
+                                client->blocks_by_drive,
+                                g_dbus_object_get_object_path (object),
+                                TRUE,   /* Retrieve first one */
+                                TRUE);  /* Skip partitions */
+  if (blocks != NULL)
+    ret = blocks->data;
+  g_list_free (blocks);
 
  out:
-  g_list_free_full (blocks, g_object_unref);
   return ret;
 }
 
@@ -969,66 +1487,27 @@ udisks_client_get_mdraid_for_block (UDisksClient  *client,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-typedef const gchar *
-(*member_retrieve_cb) (UDisksBlock *object);
-
 static GList *
 _udisks_client_get_block_or_blocks_for_mdraid (UDisksClient *client,
                                                UDisksMDRaid *raid,
-                                               member_retrieve_cb member_get,
-                                               gboolean only_first_one,
-                                               gboolean skip_partitions)
+                                               GHashTable   *index,
+                                               gboolean      only_first_one,
+                                               gboolean      skip_partitions)
 {
-  GList *ret = NULL;
-  GList *l, *object_proxies = NULL;
   GDBusObject *raid_object;
-  const gchar *raid_objpath;
 
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (UDISKS_IS_MDRAID (raid), NULL);
 
   raid_object = g_dbus_interface_get_object (G_DBUS_INTERFACE (raid));
   if (raid_object == NULL)
-    goto out;
-
-  raid_objpath = g_dbus_object_get_object_path (raid_object);
-
-  object_proxies = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = object_proxies; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksBlock *block;
-
-      block = udisks_object_get_block (object);
-      if (block == NULL)
-        continue;
-
-      /* ignore partitions */
-      if (skip_partitions)
-        {
-          if (udisks_object_peek_partition (object) != NULL)
-            {
-              g_object_unref (block);
-              continue;
-            }
-        }
-
-      if (g_strcmp0 (member_get (block), raid_objpath) == 0)
-        {
-          ret = g_list_prepend (ret, block);
-
-          if (only_first_one)
-            goto out;
-        }
-      else
-        {
-          g_object_unref (block);
-        }
-    }
+    return NULL;
 
- out:
-  g_list_free_full (object_proxies, g_object_unref);
-  return ret;
+  return index_lookup_blocks (client,
+                              index,
+                              g_dbus_object_get_object_path (raid_object),
+                              only_first_one,
+                              skip_partitions);
 }
 
 /**
@@ -1061,7 +1540,7 @@ udisks_client_get_block_for_mdraid (UDisksClient *client,
 
   b_list = _udisks_client_get_block_or_blocks_for_mdraid (client,
                                                           raid,
-                                                          udisks_block_get_mdraid,
+                                                          client->blocks_by_mdraid,
                                                           TRUE,   /* Retrieve first one */
                                                           TRUE);  /* Skip partitions */
   if (b_list)
@@ -1097,7 +1576,7 @@ udisks_client_get_all_blocks_for_mdraid (UDisksClient *client,
 {
   return g_list_reverse (_udisks_client_get_block_or_blocks_for_mdraid (client,
                                                                         raid,
-                                                                        udisks_block_get_mdraid,
+                                                                        client->blocks_by_mdraid,
                                                                         FALSE,    /* Retrieve all */
                                                                         TRUE));   /* Skip partitions */
 }
@@ -1121,7 +1600,7 @@ udisks_client_get_members_for_mdraid (UDisksClient *client,
 {
   return _udisks_client_get_block_or_blocks_for_mdraid (client,
                                                         raid,
-                                                        udisks_block_get_mdraid_member,
+                                                        client->blocks_by_mdraid_member,
                                                         FALSE,    /* Retrieve all */
                                                         FALSE);   /* Don't skip partitions */
 }
@@ -1251,6 +1730,63 @@ udisks_client_get_partition_info (UDisksClient    *client,
   return ret;
 }
 
+/**
+ * udisks_client_get_partition_info_async:
+ * @client: A #UDisksClient.
+ * @partition: A #UDisksPartition.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: Function that will be called when the result is ready.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of udisks_client_get_partition_info(). See
+ * udisks_client_get_object_info_async() for when @callback is invoked.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_client_get_partition_info_async (UDisksClient        *client,
+                                        UDisksPartition     *partition,
+                                        GCancellable        *cancellable,
+                                        GAsyncReadyCallback  callback,
+                                        gpointer             user_data)
+{
+  g_return_if_fail (UDISKS_IS_CLIENT (client));
+  g_return_if_fail (UDISKS_IS_PARTITION (partition));
+
+  _udisks_client_lookup_async (client,
+                               udisks_client_get_partition_info_async,
+                               (UDisksClientLookupFunc) udisks_client_get_partition_info,
+                               G_OBJECT (partition),
+                               g_free,
+                               cancellable,
+                               callback,
+                               user_data);
+}
+
+/**
+ * udisks_client_get_partition_info_finish:
+ * @client: A #UDisksClient.
+ * @res: A #GAsyncResult.
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with udisks_client_get_partition_info_async().
+ *
+ * Returns: (transfer full): A string that should be freed with g_free()
+ *   or %NULL if @error is set or there is no information.
+ *
+ * Since: 2.9.0
+ */
+gchar *
+udisks_client_get_partition_info_finish (UDisksClient  *client,
+                                         GAsyncResult  *res,
+                                         GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, client), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (res)) == udisks_client_get_partition_info_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /**
@@ -1269,34 +1805,22 @@ udisks_client_get_cleartext_block (UDisksClient  *client,
 {
   UDisksBlock *ret = NULL;
   GDBusObject *object;
-  const gchar *object_path;
-  GList *objects = NULL;
-  GList *l;
+  GList *blocks;
 
   object = g_dbus_interface_get_object (G_DBUS_INTERFACE (block));
   if (object == NULL)
     goto out;
 
-  object_path = g_dbus_object_get_object_path (object);
-  objects = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *iter_object = UDISKS_OBJECT (l->data);
-      UDisksBlock *iter_block;
-
-      iter_block = udisks_object_peek_block (iter_object);
-      if (iter_block == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_block_get_crypto_backing_device (iter_block), object_path) == 0)
-        {
-          ret = g_object_ref (iter_block);
-          goto out;
-        }
-    }
+  blocks = index_lookup_blocks (client,
+                                client->blocks_by_crypto_backing_device,
+                                g_dbus_object_get_object_path (object),
+                                TRUE,   /* Retrieve first one */
+                                FALSE); /* Don't skip partitions */
+  if (blocks != NULL)
+    ret = blocks->data;
+  g_list_free (blocks);
 
  out:
-  g_list_free_full (objects, g_object_unref);
   return ret;
 }
 
@@ -1373,8 +1897,9 @@ udisks_client_get_partitions (UDisksClient         *client,
 {
   GList *ret = NULL;
   GDBusObject *table_object;
-  const gchar *table_object_path;
-  GList *l, *object_proxies = NULL;
+  GHashTable *entries;
+  GHashTableIter iter;
+  ClientIndexEntry *entry;
 
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (UDISKS_IS_PARTITION_TABLE (table), NULL);
@@ -1382,26 +1907,25 @@ udisks_client_get_partitions (UDisksClient         *client,
   table_object = g_dbus_interface_get_object (G_DBUS_INTERFACE (table));
   if (table_object == NULL)
     goto out;
-  table_object_path = g_dbus_object_get_object_path (table_object);
 
-  object_proxies = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = object_proxies; l != NULL; l = l->next)
+  g_mutex_lock (&client->index_lock);
+  entries = g_hash_table_lookup (client->partitions_by_table,
+                                 g_dbus_object_get_object_path (table_object));
+  if (entries != NULL)
     {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      UDisksPartition *partition;
-
-      partition = udisks_object_get_partition (object);
-      if (partition == NULL)
-        continue;
-
-      if (g_strcmp0 (udisks_partition_get_table (partition), table_object_path) == 0)
-        ret = g_list_prepend (ret, g_object_ref (partition));
+      g_hash_table_iter_init (&iter, entries);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
+        {
+          UDisksPartition *partition;
 
-      g_object_unref (partition);
+          partition = udisks_object_get_partition (entry->object);
+          if (partition != NULL)
+            ret = g_list_prepend (ret, partition);
+        }
     }
-  ret = g_list_reverse (ret);
+  g_mutex_unlock (&client->index_lock);
+
  out:
-  g_list_free_full (object_proxies, g_object_unref);
   return ret;
 }
 
@@ -1498,7 +2022,8 @@ udisks_client_get_loop_for_block (UDisksClient  *client,
  * @client: A #UDisksClient.
  * @object: A #UDisksObject.
  *
- * Gets all the #UDisksJob instances that reference @object, if any.
+ * Gets all the #UDisksJob instances that reference @object, if any,
+ * in no particular order.
  *
  * Returns: (transfer full) (element-type UDisksJob): A list of #UDisksJob instances. The
  *   returned list should be freed with g_list_free() after each
@@ -1509,44 +2034,202 @@ udisks_client_get_jobs_for_object (UDisksClient  *client,
                                    UDisksObject  *object)
 {
   GList *ret = NULL;
-  const gchar *object_path;
-  GList *l, *object_proxies = NULL;
-
-  /* TODO: this is probably slow. Can optimize by maintaining a hash-table from object path to UDisksJob* */
+  GHashTable *entries;
+  GHashTableIter iter;
+  ClientIndexEntry *entry;
 
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (UDISKS_IS_OBJECT (object), NULL);
 
-  object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
-
-  object_proxies = g_dbus_object_manager_get_objects (client->object_manager);
-  for (l = object_proxies; l != NULL; l = l->next)
+  g_mutex_lock (&client->index_lock);
+  entries = g_hash_table_lookup (client->jobs_by_object,
+                                 g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  if (entries != NULL)
     {
-      UDisksObject *job_object = UDISKS_OBJECT (l->data);
-      UDisksJob *job;
-
-      job = udisks_object_get_job (job_object);
-      if (job != NULL)
+      g_hash_table_iter_init (&iter, entries);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &entry, NULL))
         {
-          const gchar *const *object_paths;
-          guint n;
-          object_paths = udisks_job_get_objects (job);
-          for (n = 0; object_paths != NULL && object_paths[n] != NULL; n++)
-            {
-              if (g_strcmp0 (object_paths[n], object_path) == 0)
-                ret = g_list_prepend (ret, g_object_ref (job));
-            }
-          g_object_unref (job);
+          UDisksJob *job;
+
+          job = udisks_object_get_job (entry->object);
+          if (job != NULL)
+            ret = g_list_prepend (ret, job);
         }
     }
-  ret = g_list_reverse (ret);
+  g_mutex_unlock (&client->index_lock);
 
-  g_list_free_full (object_proxies, g_object_unref);
   return ret;
 }
 
+static void
+jobs_list_free (GList *jobs)
+{
+  g_list_free_full (jobs, g_object_unref);
+}
+
+/**
+ * udisks_client_get_jobs_for_object_async:
+ * @client: A #UDisksClient.
+ * @object: A #UDisksObject.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: Function that will be called when the result is ready.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of udisks_client_get_jobs_for_object(). See
+ * udisks_client_get_object_info_async() for when @callback is invoked.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_client_get_jobs_for_object_async (UDisksClient        *client,
+                                         UDisksObject        *object,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data)
+{
+  g_return_if_fail (UDISKS_IS_CLIENT (client));
+  g_return_if_fail (UDISKS_IS_OBJECT (object));
+
+  _udisks_client_lookup_async (client,
+                               udisks_client_get_jobs_for_object_async,
+                               (UDisksClientLookupFunc) udisks_client_get_jobs_for_object,
+                               G_OBJECT (object),
+                               (GDestroyNotify) jobs_list_free,
+                               cancellable,
+                               callback,
+                               user_data);
+}
+
+/**
+ * udisks_client_get_jobs_for_object_finish:
+ * @client: A #UDisksClient.
+ * @res: A #GAsyncResult.
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with udisks_client_get_jobs_for_object_async().
+ *
+ * Returns: (transfer full) (element-type UDisksJob): A list of #UDisksJob
+ *   instances or %NULL if @error is set or there are none. The returned
+ *   list should be freed with g_list_free() after each element has been
+ *   freed with g_object_unref().
+ *
+ * Since: 2.9.0
+ */
+GList *
+udisks_client_get_jobs_for_object_finish (UDisksClient  *client,
+                                          GAsyncResult  *res,
+                                          GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, client), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (res)) == udisks_client_get_jobs_for_object_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+emit_topology_changed (UDisksClient *client)
+{
+  GHashTable *changes;
+  gchar **object_paths;
+
+  g_mutex_lock (&client->index_lock);
+  changes = client->pending_topology_changes;
+  if (g_hash_table_size (changes) == 0)
+    {
+      g_mutex_unlock (&client->index_lock);
+      return;
+    }
+  client->pending_topology_changes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  g_mutex_unlock (&client->index_lock);
+
+  /* the keys are owned by the returned array now */
+  object_paths = (gchar **) g_hash_table_get_keys_as_array (changes, NULL);
+  g_hash_table_steal_all (changes);
+  g_hash_table_unref (changes);
+
+  g_signal_emit (client, signals[TOPOLOGY_CHANGED_SIGNAL], 0, object_paths);
+  g_strfreev (object_paths);
+}
+
+static void
+note_change (UDisksClient *client,
+             GDBusObject  *object,
+             const gchar  *interface_name)
+{
+  const gchar *object_path;
+  GHashTable *interface_names;
+
+  object_path = g_dbus_object_get_object_path (object);
+
+  g_mutex_lock (&client->index_lock);
+  interface_names = g_hash_table_lookup (client->pending_changes, object_path);
+  if (interface_names == NULL)
+    {
+      interface_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+      g_hash_table_insert (client->pending_changes, g_strdup (object_path), interface_names);
+    }
+  if (!g_hash_table_contains (interface_names, interface_name))
+    g_hash_table_add (interface_names, g_strdup (interface_name));
+  g_mutex_unlock (&client->index_lock);
+}
+
+static void
+note_object_change (UDisksClient *client,
+                    GDBusObject  *object)
+{
+  GList *interfaces, *l;
+
+  interfaces = g_dbus_object_get_interfaces (object);
+  for (l = interfaces; l != NULL; l = l->next)
+    note_change (client, object, g_dbus_proxy_get_interface_name (G_DBUS_PROXY (l->data)));
+  g_list_free_full (interfaces, g_object_unref);
+}
+
+static void
+emit_objects_changed (UDisksClient *client)
+{
+  GHashTable *changes;
+  GHashTableIter iter;
+  const gchar *object_path;
+  GHashTable *interface_names;
+  GVariantBuilder builder;
+  GVariant *variant;
+
+  g_mutex_lock (&client->index_lock);
+  changes = client->pending_changes;
+  if (g_hash_table_size (changes) == 0)
+    {
+      g_mutex_unlock (&client->index_lock);
+      return;
+    }
+  client->pending_changes = index_new ();
+  g_mutex_unlock (&client->index_lock);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oas}"));
+  g_hash_table_iter_init (&iter, changes);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object_path, (gpointer *) &interface_names))
+    {
+      GHashTableIter interface_iter;
+      const gchar *interface_name;
+
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("{oas}"));
+      g_variant_builder_add (&builder, "o", object_path);
+      g_variant_builder_open (&builder, G_VARIANT_TYPE ("as"));
+      g_hash_table_iter_init (&interface_iter, interface_names);
+      while (g_hash_table_iter_next (&interface_iter, (gpointer *) &interface_name, NULL))
+        g_variant_builder_add (&builder, "s", interface_name);
+      g_variant_builder_close (&builder);
+      g_variant_builder_close (&builder);
+    }
+  g_hash_table_unref (changes);
+
+  variant = g_variant_ref_sink (g_variant_builder_end (&builder));
+  g_signal_emit (client, signals[OBJECTS_CHANGED_SIGNAL], 0, variant);
+  g_variant_unref (variant);
+}
+
 static void
 maybe_emit_changed_now (UDisksClient *client)
 {
@@ -1556,6 +2239,8 @@ maybe_emit_changed_now (UDisksClient *client)
   g_source_destroy (client->changed_timeout_source);
   client->changed_timeout_source = NULL;
 
+  emit_topology_changed (client);
+  emit_objects_changed (client);
   g_signal_emit (client, signals[CHANGED_SIGNAL], 0);
 
  out:
@@ -1568,6 +2253,8 @@ on_changed_timeout (gpointer user_data)
 {
   UDisksClient *client = UDISKS_CLIENT (user_data);
   client->changed_timeout_source = NULL;
+  emit_topology_changed (client);
+  emit_objects_changed (client);
   g_signal_emit (client, signals[CHANGED_SIGNAL], 0);
   return FALSE; /* remove source */
 }
@@ -1610,6 +2297,9 @@ on_object_added (GDBusObjectManager  *manager,
   UDisksClient *client = UDISKS_CLIENT (user_data);
   GList *interfaces, *l;
 
+  index_update_object (client, object, TRUE);
+  note_object_change (client, object);
+
   interfaces = g_dbus_object_get_interfaces (object);
   for (l = interfaces; l != NULL; l = l->next)
     {
@@ -1626,6 +2316,8 @@ on_object_removed (GDBusObjectManager  *manager,
                    gpointer             user_data)
 {
   UDisksClient *client = UDISKS_CLIENT (user_data);
+  index_remove_object (client, object);
+  note_object_change (client, object);
   udisks_client_queue_changed (client);
 }
 
@@ -1646,6 +2338,8 @@ on_interface_added (GDBusObjectManager  *manager,
   UDisksClient *client = UDISKS_CLIENT (user_data);
 
   init_interface_proxy (client, G_DBUS_PROXY (interface));
+  index_update_object (client, object, TRUE);
+  note_change (client, object, g_dbus_proxy_get_interface_name (G_DBUS_PROXY (interface)));
 
   udisks_client_queue_changed (client);
 }
@@ -1657,6 +2351,8 @@ on_interface_removed (GDBusObjectManager  *manager,
                       gpointer             user_data)
 {
   UDisksClient *client = UDISKS_CLIENT (user_data);
+  index_update_object (client, object, TRUE);
+  note_change (client, object, g_dbus_proxy_get_interface_name (G_DBUS_PROXY (interface)));
   udisks_client_queue_changed (client);
 }
 
@@ -1673,9 +2369,18 @@ on_interface_proxy_properties_changed (GDBusObjectManagerClient   *manager,
 
   GVariantIter iter;
   gchar *property_name = NULL;
+  const gchar *interface_name;
+
+  /* keep the lookup indexes up to date, see index_entry_link() */
+  interface_name = g_dbus_proxy_get_interface_name (interface_proxy);
+  if (g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Block") == 0 ||
+      g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Partition") == 0)
+    index_update_object (client, G_DBUS_OBJECT (object_proxy), FALSE);
+  else if (g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Job") != 0)
+    index_invalidate_object_info (client, G_DBUS_OBJECT (object_proxy));
 
   /* never emit the change signal for Job objects */
-  if (g_strcmp0 (g_dbus_proxy_get_interface_name (interface_proxy), "org.freedesktop.UDisks2.Drive.Job") == 0)
+  if (g_strcmp0 (interface_name, "org.freedesktop.UDisks2.Drive.Job") == 0)
     return;
 
   g_variant_iter_init (&iter, changed_properties);
@@ -1684,6 +2389,7 @@ on_interface_proxy_properties_changed (GDBusObjectManagerClient   *manager,
       if (! g_hash_table_contains (client_class->changed_blacklist, property_name))
         {
           /* one of the properties is not on the blacklist -> emit change signal */
+          note_change (client, G_DBUS_OBJECT (object_proxy), interface_name);
           udisks_client_queue_changed (client);
           return;
         }
@@ -2606,6 +3312,7 @@ udisks_client_get_job_description_from_operation (const gchar *operation)
       g_hash_table_insert (hash, (gpointer) "encrypted-lock",       (gpointer) C_("job", "Locking Device"));
       g_hash_table_insert (hash, (gpointer) "encrypted-modify",     (gpointer) C_("job", "Modifying Encrypted Device"));
       g_hash_table_insert (hash, (gpointer) "encrypted-resize",     (gpointer) C_("job", "Resizing Encrypted Device"));
+      g_hash_table_insert (hash, (gpointer) "encrypted-reencrypt",  (gpointer) C_("job", "Reencrypting Encrypted Device"));
       g_hash_table_insert (hash, (gpointer) "swapspace-start",      (gpointer) C_("job", "Starting Swap Device"));
       g_hash_table_insert (hash, (gpointer) "swapspace-stop",       (gpointer) C_("job", "Stopping Swap Device"));
       g_hash_table_insert (hash, (gpointer) "swapspace-modify",     (gpointer) C_("job", "Modifying Swap Device"));
@@ -2615,6 +3322,7 @@ udisks_client_get_job_description_from_operation (const gchar *operation)
       g_hash_table_insert (hash, (gpointer) "filesystem-modify",    (gpointer) C_("job", "Modifying Filesystem"));
       g_hash_table_insert (hash, (gpointer) "filesystem-repair",    (gpointer) C_("job", "Repairing Filesystem"));
       g_hash_table_insert (hash, (gpointer) "filesystem-resize",    (gpointer) C_("job", "Resizing Filesystem"));
+      g_hash_table_insert (hash, (gpointer) "filesystem-trim",      (gpointer) C_("job", "Trimming Filesystem"));
       g_hash_table_insert (hash, (gpointer) "format-erase",         (gpointer) C_("job", "Erasing Device"));
       g_hash_table_insert (hash, (gpointer) "format-mkfs",          (gpointer) C_("job", "Creating Filesystem"));
       g_hash_table_insert (hash, (gpointer) "loop-setup",           (gpointer) C_("job", "Setting Up Loop Device"));
@@ -2624,6 +3332,8 @@ udisks_client_get_job_description_from_operation (const gchar *operation)
       g_hash_table_insert (hash, (gpointer) "cleanup",              (gpointer) C_("job", "Cleaning Up"));
       g_hash_table_insert (hash, (gpointer) "ata-secure-erase",     (gpointer) C_("job", "ATA Secure Erase"));
       g_hash_table_insert (hash, (gpointer) "ata-enhanced-secure-erase", (gpointer) C_("job", "ATA Enhanced Secure Erase"));
+      g_hash_table_insert (hash, (gpointer) "block-reset-zones",    (gpointer) C_("job", "Resetting Zones"));
+      g_hash_table_insert (hash, (gpointer) "block-benchmark",      (gpointer) C_("job", "Benchmarking Device"));
       g_hash_table_insert (hash, (gpointer) "md-raid-stop",         (gpointer) C_("job", "Stopping RAID Array"));
       g_hash_table_insert (hash, (gpointer) "md-raid-start",        (gpointer) C_("job", "Starting RAID Array"));
       g_hash_table_insert (hash, (gpointer) "md-raid-fault-device", (gpointer) C_("job", "Marking Device as Faulty"));
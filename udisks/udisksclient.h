@@ -99,6 +99,14 @@ GList              *udisks_client_get_drive_siblings  (UDisksClient       *clien
 
 GList              *udisks_client_get_jobs_for_object (UDisksClient        *client,
                                                        UDisksObject        *object);
+void                udisks_client_get_jobs_for_object_async  (UDisksClient        *client,
+                                                              UDisksObject        *object,
+                                                              GCancellable        *cancellable,
+                                                              GAsyncReadyCallback  callback,
+                                                              gpointer             user_data);
+GList              *udisks_client_get_jobs_for_object_finish (UDisksClient        *client,
+                                                              GAsyncResult        *res,
+                                                              GError             **error);
 
 G_DEPRECATED_FOR(udisks_client_get_object_info)
 void                udisks_client_get_drive_info      (UDisksClient        *client,
@@ -111,9 +119,25 @@ void                udisks_client_get_drive_info      (UDisksClient        *clie
 
 UDisksObjectInfo   *udisks_client_get_object_info     (UDisksClient        *client,
                                                        UDisksObject        *object);
+void                udisks_client_get_object_info_async  (UDisksClient        *client,
+                                                          UDisksObject        *object,
+                                                          GCancellable        *cancellable,
+                                                          GAsyncReadyCallback  callback,
+                                                          gpointer             user_data);
+UDisksObjectInfo   *udisks_client_get_object_info_finish (UDisksClient        *client,
+                                                          GAsyncResult        *res,
+                                                          GError             **error);
 
 gchar              *udisks_client_get_partition_info  (UDisksClient        *client,
                                                        UDisksPartition     *partition);
+void                udisks_client_get_partition_info_async  (UDisksClient        *client,
+                                                             UDisksPartition     *partition,
+                                                             GCancellable        *cancellable,
+                                                             GAsyncReadyCallback  callback,
+                                                             gpointer             user_data);
+gchar              *udisks_client_get_partition_info_finish (UDisksClient        *client,
+                                                             GAsyncResult        *res,
+                                                             GError             **error);
 
 
 gchar              *udisks_client_get_size_for_display (UDisksClient *client,
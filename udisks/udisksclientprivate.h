@@ -0,0 +1,51 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (C) 2012 David Zeuthen <zeuthen@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __UDISKS_CLIENT_PRIVATE_H__
+#define __UDISKS_CLIENT_PRIVATE_H__
+
+#include "udisksclient.h"
+
+G_BEGIN_DECLS
+
+UDisksObjectInfo *_udisks_client_get_cached_object_info (UDisksClient     *client,
+                                                         UDisksObject     *object,
+                                                         guint64          *out_generation);
+
+void              _udisks_client_cache_object_info      (UDisksClient     *client,
+                                                         UDisksObject     *object,
+                                                         UDisksObjectInfo *info,
+                                                         guint64           generation);
+
+typedef gpointer (*UDisksClientLookupFunc) (UDisksClient *client,
+                                            gpointer      arg);
+
+void              _udisks_client_lookup_async           (UDisksClient           *client,
+                                                         gpointer                source_tag,
+                                                         UDisksClientLookupFunc  func,
+                                                         GObject                *arg,
+                                                         GDestroyNotify          result_free,
+                                                         GCancellable           *cancellable,
+                                                         GAsyncReadyCallback     callback,
+                                                         gpointer                user_data);
+
+G_END_DECLS
+
+#endif /* __UDISKS_CLIENT_PRIVATE_H__ */
@@ -23,6 +23,7 @@
 
 #include "udisksobjectinfo.h"
 #include "udisksclient.h"
+#include "udisksclientprivate.h"
 #include "udisks-generated.h"
 
 /**
@@ -890,6 +891,10 @@ udisks_client_get_object_info_for_drive (UDisksClient     *client,
  * present in an user interface. Information is returned in the
  * #UDisksObjectInfo object and is localized.
  *
+ * The information is cached by @client until properties of @object or
+ * of related objects, e.g. the drive of a block device, change, so
+ * calling this repeatedly is cheap.
+ *
  * Returns: (transfer full): A #UDisksObjectInfo instance that should be freed with g_object_unref().
  *
  * Since: 2.1
@@ -904,10 +909,15 @@ udisks_client_get_object_info (UDisksClient        *client,
   UDisksPartition *partition = NULL;
   UDisksMDRaid *mdraid = NULL;
   UDisksLoop *loop = NULL;
+  guint64 generation;
 
   g_return_val_if_fail (UDISKS_IS_CLIENT (client), NULL);
   g_return_val_if_fail (UDISKS_IS_OBJECT (object), NULL);
 
+  ret = _udisks_client_get_cached_object_info (client, object, &generation);
+  if (ret != NULL)
+    return ret;
+
   ret = udisks_object_info_new (object);
   drive = udisks_object_get_drive (object);
   block = udisks_object_get_block (object);
@@ -950,6 +960,8 @@ udisks_client_get_object_info (UDisksClient        *client,
   g_clear_object (&block);
   g_clear_object (&drive);
 
+  _udisks_client_cache_object_info (client, object, ret, generation);
+
 #if 0
   /* for debugging */
   g_print ("%s -> dd='%s', md='%s', ol='%s' and di='%s', mi='%s' sk='%s'\n",
@@ -965,6 +977,71 @@ udisks_client_get_object_info (UDisksClient        *client,
   return ret;
 }
 
+/**
+ * udisks_client_get_object_info_async:
+ * @client: A #UDisksClient.
+ * @object: A #UDisksObject.
+ * @cancellable: (allow-none): A #GCancellable or %NULL.
+ * @callback: Function that will be called when the result is ready.
+ * @user_data: Data to pass to @callback.
+ *
+ * Asynchronous version of udisks_client_get_object_info().
+ *
+ * The information is built once the <link
+ * linkend="g-main-context-push-thread-default">thread-default main
+ * loop</link> of the thread you are calling this method from is idle,
+ * so pending events such as redraws are handled first, and @callback
+ * is invoked in that main loop. Lookups that are no longer needed,
+ * e.g. for rows scrolled out of view, can be dropped by cancelling
+ * @cancellable. Like the other #UDisksClient methods this must be
+ * called from the thread @client was created in.
+ *
+ * Since: 2.9.0
+ */
+void
+udisks_client_get_object_info_async (UDisksClient        *client,
+                                     UDisksObject        *object,
+                                     GCancellable        *cancellable,
+                                     GAsyncReadyCallback  callback,
+                                     gpointer             user_data)
+{
+  g_return_if_fail (UDISKS_IS_CLIENT (client));
+  g_return_if_fail (UDISKS_IS_OBJECT (object));
+
+  _udisks_client_lookup_async (client,
+                               udisks_client_get_object_info_async,
+                               (UDisksClientLookupFunc) udisks_client_get_object_info,
+                               G_OBJECT (object),
+                               g_object_unref,
+                               cancellable,
+                               callback,
+                               user_data);
+}
+
+/**
+ * udisks_client_get_object_info_finish:
+ * @client: A #UDisksClient.
+ * @res: A #GAsyncResult.
+ * @error: Return location for error or %NULL.
+ *
+ * Finishes an operation started with udisks_client_get_object_info_async().
+ *
+ * Returns: (transfer full): A #UDisksObjectInfo instance that should be
+ *   freed with g_object_unref() or %NULL if @error is set.
+ *
+ * Since: 2.9.0
+ */
+UDisksObjectInfo *
+udisks_client_get_object_info_finish (UDisksClient  *client,
+                                      GAsyncResult  *res,
+                                      GError       **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, client), NULL);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (res)) == udisks_client_get_object_info_async, NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gpointer